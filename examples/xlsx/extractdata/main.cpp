@@ -1,5 +1,6 @@
 #include <QtCore>
 #include "xlsxdocument.h"
+#include "xlsxsheetreader.h"
 
 int main()
 {
@@ -37,5 +38,13 @@ int main()
     }
     //![2]
 
+    //![3]
+    QXlsx::SheetReader reader("Book1.xlsx");
+    while (reader.nextRow()) {
+        for (int i = 0; i < reader.cellCount(); ++i)
+            qDebug() << reader.row() << reader.column(i) << reader.value(i);
+    }
+    //![3]
+
     return 0;
 }
@@ -6,6 +6,56 @@
 
 using namespace QXlsx;
 
+//![2]
+/*
+  Shows each worksheet of the document in a tab of its own as soon as it
+  has been loaded, the tabs of the sheets still being loaded hold a label.
+*/
+class SheetTabs : public QTabWidget
+{
+    Q_OBJECT
+public:
+    explicit SheetTabs(Document *xlsx)
+        : m_xlsx(xlsx)
+    {
+        setTabPosition(QTabWidget::South);
+        foreach (QString sheetName, xlsx->sheetNames())
+            addTab(new QLabel(tr("Loading..."), this), sheetName);
+        connect(xlsx, SIGNAL(sheetLoaded(QString)), this, SLOT(showSheet(QString)));
+    }
+
+public slots:
+    void showSheet(const QString &sheetName)
+    {
+        int index = 0;
+        while (index < count() && tabText(index) != sheetName)
+            ++index;
+        if (index == count())
+            return;
+
+        QWidget *label = widget(index);
+        const bool current = index == currentIndex();
+        removeTab(index);
+        delete label;
+
+        Worksheet *sheet = dynamic_cast<Worksheet *>(m_xlsx->sheet(sheetName));
+        if (!sheet)
+            return;
+        QTableView *view = new QTableView(this);
+        view->setModel(new SheetModel(sheet, view));
+        foreach (CellRange range, sheet->mergedCells())
+            view->setSpan(range.firstRow() - 1, range.firstColumn() - 1, range.rowCount(),
+                          range.columnCount());
+        insertTab(index, view, sheetName);
+        if (current)
+            setCurrentIndex(index);
+    }
+
+private:
+    Document *m_xlsx;
+};
+//![2]
+
 int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
@@ -17,26 +67,15 @@ int main(int argc, char **argv)
     //![0]
 
     //![1]
-    QTabWidget tabWidget;
+    // The sheets are parsed in the background once their names are known
+    Document xlsx;
+    xlsx.openAsync(filePath);
+    SheetTabs tabWidget(&xlsx);
     tabWidget.setWindowTitle(filePath + " - Qt Xlsx Demo");
-    tabWidget.setTabPosition(QTabWidget::South);
     //![1]
 
-    //![2]
-    Document xlsx(filePath);
-    foreach (QString sheetName, xlsx.sheetNames()) {
-        Worksheet *sheet = dynamic_cast<Worksheet *>(xlsx.sheet(sheetName));
-        if (sheet) {
-            QTableView *view = new QTableView(&tabWidget);
-            view->setModel(new SheetModel(sheet, view));
-            foreach (CellRange range, sheet->mergedCells())
-                view->setSpan(range.firstRow() - 1, range.firstColumn() - 1, range.rowCount(),
-                              range.columnCount());
-            tabWidget.addTab(view, sheetName);
-        }
-    }
-    //![2]
-
     tabWidget.show();
     return app.exec();
 }
+
+#include "main.moc"
@@ -4,12 +4,7 @@ QT += widgets
 #include(../../../src/xlsx/qtxlsx.pri)
 QT+= xlsx
 
-SOURCES += main.cpp \
-    xlsxsheetmodel.cpp
-
-HEADERS += \
-    xlsxsheetmodel.h \
-    xlsxsheetmodel_p.h
+SOURCES += main.cpp
 
 # install
 target.path = $$[QT_INSTALL_EXAMPLES]/xlsx/xlsxwidget
@@ -2,7 +2,19 @@ INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 QT += core gui gui-private
+# zlib is used by the zip writer
+contains(QT_CONFIG, system-zlib) {
+    if(unix|mingw): LIBS_PRIVATE += -lz
+    else: LIBS_PRIVATE += zdll.lib
+} else {
+    QT_PRIVATE += zlib-private
+}
+# CryptGenRandom() keys the encrypted packages before Qt 5.10
+win32:!mingw: LIBS_PRIVATE += advapi32.lib
+else:win32: LIBS_PRIVATE += -ladvapi32
 !build_xlsx_lib:DEFINES += XLSX_NO_LIB
+# Hot path counters reported by Document::statistics(), off by default
+xlsx_statistics:DEFINES += XLSX_STATISTICS
 
 HEADERS += $$PWD/xlsxdocpropscore_p.h \
     $$PWD/xlsxdocpropsapp_p.h \
@@ -26,12 +38,49 @@ HEADERS += $$PWD/xlsxdocpropscore_p.h \
     $$PWD/xlsxglobal.h \
     $$PWD/xlsxdrawing_p.h \
     $$PWD/xlsxzipreader_p.h \
+    $$PWD/xlsxaes_p.h \
+    $$PWD/xlsxcompoundfile_p.h \
+    $$PWD/xlsxencryption_p.h \
+    $$PWD/xlsxsheetreader.h \
+    $$PWD/xlsxrawcell.h \
+    $$PWD/xlsxrowwriter.h \
+    $$PWD/xlsxtypedrowwriter.h \
+    $$PWD/xlsxsheetmodel.h \
+    $$PWD/xlsxsheetmodel_p.h \
+    $$PWD/xlsxsheettemplate.h \
+    $$PWD/xlsxsheettemplate_p.h \
+    $$PWD/xlsxsheetreader_p.h \
+    $$PWD/xlsxsheetappender.h \
+    $$PWD/xlsxsheetappender_p.h \
     $$PWD/xlsxdocument.h \
+    $$PWD/xlsxdocumentbatch.h \
+    $$PWD/xlsxloadfilter.h \
+    $$PWD/xlsxloadfilter_p.h \
+    $$PWD/xlsxprofiler.h \
+    $$PWD/xlsxprofiler_p.h \
+    $$PWD/xlsxprogressmonitor.h \
+    $$PWD/xlsxsheetloader_p.h \
+    $$PWD/xlsxstatistics_p.h \
     $$PWD/xlsxdocument_p.h \
     $$PWD/xlsxcell.h \
     $$PWD/xlsxcell_p.h \
+    $$PWD/xlsxcelltable_p.h \
+    $$PWD/xlsxcellrangeindex_p.h \
+    $$PWD/xlsxcellvalueindex_p.h \
+    $$PWD/xlsxcellrangeset_p.h \
+    $$PWD/xlsxpixelaxis_p.h \
+    $$PWD/xlsxtextmeter_p.h \
+    $$PWD/xlsxcardinality_p.h \
+    $$PWD/xlsxhyperlinktable_p.h \
+    $$PWD/xlsxcommentswriter_p.h \
+    $$PWD/xlsxtable_p.h \
+    $$PWD/xlsxsheetdatawriter_p.h \
+    $$PWD/xlsxxmlpullparser_p.h \
+    $$PWD/xlsxformulaengine_p.h \
+    $$PWD/xlsxconditionalformattingevaluator_p.h \
     $$PWD/xlsxdatavalidation.h \
     $$PWD/xlsxdatavalidation_p.h \
+    $$PWD/xlsxdatavalidationchecker_p.h \
     $$PWD/xlsxcellreference.h \
     $$PWD/xlsxcellrange.h \
     $$PWD/xlsxrichstring_p.h \
@@ -39,7 +88,10 @@ HEADERS += $$PWD/xlsxdocpropscore_p.h \
     $$PWD/xlsxconditionalformatting.h \
     $$PWD/xlsxconditionalformatting_p.h \
     $$PWD/xlsxcolor_p.h \
+    $$PWD/xlsxbiff12_p.h \
+    $$PWD/xlsxcsv_p.h \
     $$PWD/xlsxnumformatparser_p.h \
+    $$PWD/xlsxnumformatter_p.h \
     $$PWD/xlsxdrawinganchor_p.h \
     $$PWD/xlsxmediafile_p.h \
     $$PWD/xlsxabstractooxmlfile.h \
@@ -66,15 +118,49 @@ SOURCES += $$PWD/xlsxdocpropscore.cpp \
     $$PWD/xlsxzipwriter.cpp \
     $$PWD/xlsxdrawing.cpp \
     $$PWD/xlsxzipreader.cpp \
+    $$PWD/xlsxaes.cpp \
+    $$PWD/xlsxcompoundfile.cpp \
+    $$PWD/xlsxencryption.cpp \
+    $$PWD/xlsxsheetreader.cpp \
+    $$PWD/xlsxsheetappender.cpp \
+    $$PWD/xlsxrawcell.cpp \
+    $$PWD/xlsxrowwriter.cpp \
+    $$PWD/xlsxtypedrowwriter.cpp \
+    $$PWD/xlsxsheetmodel.cpp \
+    $$PWD/xlsxsheettemplate.cpp \
     $$PWD/xlsxdocument.cpp \
+    $$PWD/xlsxdocumentbatch.cpp \
+    $$PWD/xlsxloadfilter.cpp \
+    $$PWD/xlsxprofiler.cpp \
+    $$PWD/xlsxprogressmonitor.cpp \
+    $$PWD/xlsxsheetloader.cpp \
+    $$PWD/xlsxstatistics.cpp \
     $$PWD/xlsxcell.cpp \
+    $$PWD/xlsxcelltable.cpp \
+    $$PWD/xlsxcellrangeindex.cpp \
+    $$PWD/xlsxcellvalueindex.cpp \
+    $$PWD/xlsxcellrangeset.cpp \
+    $$PWD/xlsxpixelaxis.cpp \
+    $$PWD/xlsxtextmeter.cpp \
+    $$PWD/xlsxcardinality.cpp \
+    $$PWD/xlsxhyperlinktable.cpp \
+    $$PWD/xlsxcommentswriter.cpp \
+    $$PWD/xlsxtable.cpp \
+    $$PWD/xlsxsheetdatawriter.cpp \
+    $$PWD/xlsxxmlpullparser.cpp \
+    $$PWD/xlsxformulaengine.cpp \
+    $$PWD/xlsxconditionalformattingevaluator.cpp \
     $$PWD/xlsxdatavalidation.cpp \
+    $$PWD/xlsxdatavalidationchecker.cpp \
     $$PWD/xlsxcellreference.cpp \
     $$PWD/xlsxcellrange.cpp \
     $$PWD/xlsxrichstring.cpp \
     $$PWD/xlsxconditionalformatting.cpp \
     $$PWD/xlsxcolor.cpp \
+    $$PWD/xlsxbiff12.cpp \
+    $$PWD/xlsxcsv.cpp \
     $$PWD/xlsxnumformatparser.cpp \
+    $$PWD/xlsxnumformatter.cpp \
     $$PWD/xlsxdrawinganchor.cpp \
     $$PWD/xlsxmediafile.cpp \
     $$PWD/xlsxabstractooxmlfile.cpp \
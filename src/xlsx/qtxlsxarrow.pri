@@ -0,0 +1,9 @@
+# Bridge between worksheets and Apache Arrow arrays. It only relies on the
+# Arrow C data interface, so no Arrow library is needed.
+#
+# Include this file after qtxlsx.pri, or build the module with
+#     qmake CONFIG+=xlsx_arrow
+
+HEADERS += $$PWD/xlsxarrow.h
+
+SOURCES += $$PWD/xlsxarrow.cpp
@@ -6,6 +6,7 @@ load(qt_module)
 
 CONFIG += build_xlsx_lib
 include(qtxlsx.pri)
+xlsx_arrow: include(qtxlsxarrow.pri)
 
 #Define this macro if you want to run tests, so more AIPs will get exported.
 CONFIG(debug, debug|release):DEFINES += XLSX_TEST
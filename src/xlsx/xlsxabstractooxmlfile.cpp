@@ -35,6 +35,7 @@ AbstractOOXmlFilePrivate::AbstractOOXmlFilePrivate(
     AbstractOOXmlFile *q, AbstractOOXmlFile::CreateFlag flag = AbstractOOXmlFile::F_NewFromScratch)
     : relationships(new Relationships)
     , flag(flag)
+    , dirty(flag == AbstractOOXmlFile::F_NewFromScratch)
     , q_ptr(q)
 {
 }
@@ -80,11 +81,15 @@ QByteArray AbstractOOXmlFile::saveToXmlData() const
 
 bool AbstractOOXmlFile::loadFromXmlData(const QByteArray &data)
 {
+    Q_D(AbstractOOXmlFile);
     QBuffer buffer;
     buffer.setData(data);
     buffer.open(QIODevice::ReadOnly);
 
-    return loadFromXmlFile(&buffer);
+    const bool ok = loadFromXmlFile(&buffer);
+    // Whatever the loading did, the part matches its source now
+    d->dirty = false;
+    return ok;
 }
 
 /*!
@@ -105,6 +110,39 @@ QString AbstractOOXmlFile::filePath() const
     return d->filePathInPackage;
 }
 
+/*!
+ * \internal
+ *
+ * Returns whether the part has been modified since it was loaded. Parts
+ * created from scratch are always dirty. Clean parts can be copied from
+ * the source package as they are when the document is saved.
+ */
+bool AbstractOOXmlFile::isDirty() const
+{
+    Q_D(const AbstractOOXmlFile);
+    return d->dirty;
+}
+
+/*!
+ * \internal
+ *
+ * Returns the number of elements reported to the profiler when the part is
+ * loaded or saved, 0 by default.
+ */
+qint64 AbstractOOXmlFile::elementCount() const
+{
+    return 0;
+}
+
+/*!
+ * \internal
+ */
+void AbstractOOXmlFile::setDirty(bool dirty)
+{
+    Q_D(AbstractOOXmlFile);
+    d->dirty = dirty;
+}
+
 /*!
  * \internal
  */
@@ -48,12 +48,16 @@ public:
 
     virtual QByteArray saveToXmlData() const;
     virtual bool loadFromXmlData(const QByteArray &data);
+    virtual qint64 elementCount() const;
 
     Relationships *relationships() const;
 
     void setFilePath(const QString path);
     QString filePath() const;
 
+    bool isDirty() const;
+    void setDirty(bool dirty = true);
+
 protected:
     AbstractOOXmlFile(CreateFlag flag);
     AbstractOOXmlFile(AbstractOOXmlFilePrivate *d);
@@ -56,6 +56,7 @@ public:
                                // used when load the .xlsx file
     Relationships *relationships;
     AbstractOOXmlFile::CreateFlag flag;
+    bool dirty; // modified since it was loaded
     AbstractOOXmlFile *q_ptr;
 };
 
@@ -0,0 +1,494 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxaes_p.h"
+
+#include <QGlobalStatic>
+
+#include <cstring>
+
+#if (defined(Q_PROCESSOR_X86) || defined(__i386__) || defined(__x86_64__)) && defined(Q_CC_GNU)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define XLSX_HAVE_AESNI
+#define XLSX_AESNI_TARGET __attribute__((target("aes,sse2")))
+#elif defined(Q_CC_MSVC) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <wmmintrin.h>
+#define XLSX_HAVE_AESNI
+#define XLSX_AESNI_TARGET
+#endif
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+inline quint32 rotateRight(quint32 word, int bits)
+{
+    return (word >> bits) | (word << (32 - bits));
+}
+
+inline quint32 readWord(const uchar *data)
+{
+    return (quint32(data[0]) << 24) | (quint32(data[1]) << 16) | (quint32(data[2]) << 8)
+           | quint32(data[3]);
+}
+
+inline void writeWord(quint32 word, uchar *data)
+{
+    data[0] = uchar(word >> 24);
+    data[1] = uchar(word >> 16);
+    data[2] = uchar(word >> 8);
+    data[3] = uchar(word);
+}
+
+inline uchar multiply(uchar a, uchar b)
+{
+    uchar product = 0;
+    while (b) {
+        if (b & 1)
+            product ^= a;
+        a = uchar((a << 1) ^ (a & 0x80 ? 0x1B : 0));
+        b >>= 1;
+    }
+    return product;
+}
+
+/*
+  The S-boxes and the round tables, computed once from the field
+  arithmetic rather than typed in. Each table of four is the first one
+  rotated.
+ */
+struct AesTables
+{
+    AesTables();
+
+    uchar sbox[256];
+    uchar inverseSbox[256];
+    quint32 encrypt[4][256];
+    quint32 decrypt[4][256];
+};
+
+AesTables::AesTables()
+{
+    // p runs over the multiplicative group by multiplying by 3, and q over
+    // its inverses by dividing by 3
+    uchar p = 1;
+    uchar q = 1;
+    do {
+        p = uchar(p ^ (p << 1) ^ (p & 0x80 ? 0x1B : 0));
+        q ^= uchar(q << 1);
+        q ^= uchar(q << 2);
+        q ^= uchar(q << 4);
+        if (q & 0x80)
+            q ^= 0x09;
+        const uchar affine = uchar(q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6))
+                                   ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4)));
+        sbox[p] = affine ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; ++i)
+        inverseSbox[sbox[i]] = uchar(i);
+
+    for (int i = 0; i < 256; ++i) {
+        const uchar s = sbox[i];
+        const uchar si = inverseSbox[i];
+        encrypt[0][i] = (quint32(multiply(s, 2)) << 24) | (quint32(s) << 16) | (quint32(s) << 8)
+                        | quint32(multiply(s, 3));
+        decrypt[0][i] = (quint32(multiply(si, 14)) << 24) | (quint32(multiply(si, 9)) << 16)
+                        | (quint32(multiply(si, 13)) << 8) | quint32(multiply(si, 11));
+        for (int t = 1; t < 4; ++t) {
+            encrypt[t][i] = rotateRight(encrypt[0][i], 8 * t);
+            decrypt[t][i] = rotateRight(decrypt[0][i], 8 * t);
+        }
+    }
+}
+
+Q_GLOBAL_STATIC(AesTables, aesTables)
+
+bool hardwareSupportEnabled = true;
+
+#if defined(XLSX_HAVE_AESNI)
+bool cpuHasAesNi()
+{
+#if defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 25);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+#endif
+}
+
+const bool aesNiAvailable = cpuHasAesNi();
+
+XLSX_AESNI_TARGET
+void aesNiInvertKeys(const uchar *encryptKeys, uchar *decryptKeys, int rounds)
+{
+    const __m128i *in = reinterpret_cast<const __m128i *>(encryptKeys);
+    __m128i *out = reinterpret_cast<__m128i *>(decryptKeys);
+    _mm_storeu_si128(out, _mm_loadu_si128(in + rounds));
+    for (int round = 1; round < rounds; ++round)
+        _mm_storeu_si128(out + round, _mm_aesimc_si128(_mm_loadu_si128(in + rounds - round)));
+    _mm_storeu_si128(out + rounds, _mm_loadu_si128(in));
+}
+
+XLSX_AESNI_TARGET
+void aesNiEncryptCbc(const uchar *roundKeys, int rounds, uchar *data, int size, const uchar *iv)
+{
+    const __m128i *keys = reinterpret_cast<const __m128i *>(roundKeys);
+    __m128i key[15];
+    for (int round = 0; round <= rounds; ++round)
+        key[round] = _mm_loadu_si128(keys + round);
+
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(iv));
+    for (int pos = 0; pos < size; pos += 16) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + pos);
+        block = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128(p), block), key[0]);
+        for (int round = 1; round < rounds; ++round)
+            block = _mm_aesenc_si128(block, key[round]);
+        block = _mm_aesenclast_si128(block, key[rounds]);
+        _mm_storeu_si128(p, block);
+    }
+}
+
+/*
+  The blocks are deciphered four at a time, which CBC allows since each
+  one only depends on its ciphertext.
+ */
+XLSX_AESNI_TARGET
+void aesNiDecryptCbc(const uchar *roundKeys, int rounds, uchar *data, int size, const uchar *iv)
+{
+    const __m128i *keys = reinterpret_cast<const __m128i *>(roundKeys);
+    __m128i key[15];
+    for (int round = 0; round <= rounds; ++round)
+        key[round] = _mm_loadu_si128(keys + round);
+
+    __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i *>(iv));
+    int pos = 0;
+    for (; pos + 64 <= size; pos += 64) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + pos);
+        const __m128i c0 = _mm_loadu_si128(p);
+        const __m128i c1 = _mm_loadu_si128(p + 1);
+        const __m128i c2 = _mm_loadu_si128(p + 2);
+        const __m128i c3 = _mm_loadu_si128(p + 3);
+        __m128i b0 = _mm_xor_si128(c0, key[0]);
+        __m128i b1 = _mm_xor_si128(c1, key[0]);
+        __m128i b2 = _mm_xor_si128(c2, key[0]);
+        __m128i b3 = _mm_xor_si128(c3, key[0]);
+        for (int round = 1; round < rounds; ++round) {
+            b0 = _mm_aesdec_si128(b0, key[round]);
+            b1 = _mm_aesdec_si128(b1, key[round]);
+            b2 = _mm_aesdec_si128(b2, key[round]);
+            b3 = _mm_aesdec_si128(b3, key[round]);
+        }
+        b0 = _mm_aesdeclast_si128(b0, key[rounds]);
+        b1 = _mm_aesdeclast_si128(b1, key[rounds]);
+        b2 = _mm_aesdeclast_si128(b2, key[rounds]);
+        b3 = _mm_aesdeclast_si128(b3, key[rounds]);
+        _mm_storeu_si128(p, _mm_xor_si128(b0, previous));
+        _mm_storeu_si128(p + 1, _mm_xor_si128(b1, c0));
+        _mm_storeu_si128(p + 2, _mm_xor_si128(b2, c1));
+        _mm_storeu_si128(p + 3, _mm_xor_si128(b3, c2));
+        previous = c3;
+    }
+    for (; pos < size; pos += 16) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + pos);
+        const __m128i cipher = _mm_loadu_si128(p);
+        __m128i block = _mm_xor_si128(cipher, key[0]);
+        for (int round = 1; round < rounds; ++round)
+            block = _mm_aesdec_si128(block, key[round]);
+        block = _mm_aesdeclast_si128(block, key[rounds]);
+        _mm_storeu_si128(p, _mm_xor_si128(block, previous));
+        previous = cipher;
+    }
+}
+#endif
+
+} // namespace
+
+Aes::Aes()
+    : m_rounds(0)
+    , m_hardware(false)
+{
+}
+
+/*
+  Expand \a key, of 16, 24 or 32 bytes, into the round keys. Returns false
+  for any other size.
+ */
+bool Aes::setKey(const QByteArray &key)
+{
+    const int words = key.size() / 4;
+    if (key.size() != 16 && key.size() != 24 && key.size() != 32) {
+        m_rounds = 0;
+        return false;
+    }
+    const AesTables *tables = aesTables();
+    m_rounds = words + 6;
+    const int total = 4 * (m_rounds + 1);
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(key.constData());
+    for (int i = 0; i < words; ++i)
+        m_encryptKeys[i] = readWord(bytes + 4 * i);
+    quint32 rcon = 0x01;
+    for (int i = words; i < total; ++i) {
+        quint32 temp = m_encryptKeys[i - 1];
+        if (i % words == 0) {
+            temp = (temp << 8) | (temp >> 24);
+            temp = (quint32(tables->sbox[temp >> 24]) << 24)
+                   | (quint32(tables->sbox[(temp >> 16) & 0xFF]) << 16)
+                   | (quint32(tables->sbox[(temp >> 8) & 0xFF]) << 8)
+                   | quint32(tables->sbox[temp & 0xFF]);
+            temp ^= rcon << 24;
+            rcon = multiply(uchar(rcon), 2);
+        } else if (words > 6 && i % words == 4) {
+            temp = (quint32(tables->sbox[temp >> 24]) << 24)
+                   | (quint32(tables->sbox[(temp >> 16) & 0xFF]) << 16)
+                   | (quint32(tables->sbox[(temp >> 8) & 0xFF]) << 8)
+                   | quint32(tables->sbox[temp & 0xFF]);
+        }
+        m_encryptKeys[i] = m_encryptKeys[i - words] ^ temp;
+    }
+
+    // The decryption runs the rounds backwards, the inner ones with the
+    // inverse mix columns applied to their keys
+    for (int round = 0; round <= m_rounds; ++round) {
+        for (int j = 0; j < 4; ++j) {
+            const quint32 word = m_encryptKeys[4 * (m_rounds - round) + j];
+            if (round == 0 || round == m_rounds) {
+                m_decryptKeys[4 * round + j] = word;
+            } else {
+                m_decryptKeys[4 * round + j] = tables->decrypt[0][tables->sbox[word >> 24]]
+                    ^ tables->decrypt[1][tables->sbox[(word >> 16) & 0xFF]]
+                    ^ tables->decrypt[2][tables->sbox[(word >> 8) & 0xFF]]
+                    ^ tables->decrypt[3][tables->sbox[word & 0xFF]];
+            }
+        }
+    }
+
+    m_hardware = false;
+#if defined(XLSX_HAVE_AESNI)
+    if (hasHardwareSupport()) {
+        for (int i = 0; i < total; ++i)
+            writeWord(m_encryptKeys[i], m_hardwareEncryptKeys + 4 * i);
+        aesNiInvertKeys(m_hardwareEncryptKeys, m_hardwareDecryptKeys, m_rounds);
+        m_hardware = true;
+    }
+#endif
+    return true;
+}
+
+void Aes::encryptBlock(const uchar *in, uchar *out) const
+{
+    const AesTables *tables = aesTables();
+    const quint32(*te)[256] = tables->encrypt;
+    const quint32 *key = m_encryptKeys;
+    quint32 s0 = readWord(in) ^ key[0];
+    quint32 s1 = readWord(in + 4) ^ key[1];
+    quint32 s2 = readWord(in + 8) ^ key[2];
+    quint32 s3 = readWord(in + 12) ^ key[3];
+    for (int round = 1; round < m_rounds; ++round) {
+        key += 4;
+        const quint32 t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xFF] ^ te[2][(s2 >> 8) & 0xFF]
+                           ^ te[3][s3 & 0xFF] ^ key[0];
+        const quint32 t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xFF] ^ te[2][(s3 >> 8) & 0xFF]
+                           ^ te[3][s0 & 0xFF] ^ key[1];
+        const quint32 t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xFF] ^ te[2][(s0 >> 8) & 0xFF]
+                           ^ te[3][s1 & 0xFF] ^ key[2];
+        const quint32 t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xFF] ^ te[2][(s1 >> 8) & 0xFF]
+                           ^ te[3][s2 & 0xFF] ^ key[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    key += 4;
+    const uchar *s = tables->sbox;
+    writeWord((quint32(s[s0 >> 24]) << 24 | quint32(s[(s1 >> 16) & 0xFF]) << 16
+               | quint32(s[(s2 >> 8) & 0xFF]) << 8 | quint32(s[s3 & 0xFF]))
+                  ^ key[0],
+              out);
+    writeWord((quint32(s[s1 >> 24]) << 24 | quint32(s[(s2 >> 16) & 0xFF]) << 16
+               | quint32(s[(s3 >> 8) & 0xFF]) << 8 | quint32(s[s0 & 0xFF]))
+                  ^ key[1],
+              out + 4);
+    writeWord((quint32(s[s2 >> 24]) << 24 | quint32(s[(s3 >> 16) & 0xFF]) << 16
+               | quint32(s[(s0 >> 8) & 0xFF]) << 8 | quint32(s[s1 & 0xFF]))
+                  ^ key[2],
+              out + 8);
+    writeWord((quint32(s[s3 >> 24]) << 24 | quint32(s[(s0 >> 16) & 0xFF]) << 16
+               | quint32(s[(s1 >> 8) & 0xFF]) << 8 | quint32(s[s2 & 0xFF]))
+                  ^ key[3],
+              out + 12);
+}
+
+void Aes::decryptBlock(const uchar *in, uchar *out) const
+{
+    const AesTables *tables = aesTables();
+    const quint32(*td)[256] = tables->decrypt;
+    const quint32 *key = m_decryptKeys;
+    quint32 s0 = readWord(in) ^ key[0];
+    quint32 s1 = readWord(in + 4) ^ key[1];
+    quint32 s2 = readWord(in + 8) ^ key[2];
+    quint32 s3 = readWord(in + 12) ^ key[3];
+    for (int round = 1; round < m_rounds; ++round) {
+        key += 4;
+        const quint32 t0 = td[0][s0 >> 24] ^ td[1][(s3 >> 16) & 0xFF] ^ td[2][(s2 >> 8) & 0xFF]
+                           ^ td[3][s1 & 0xFF] ^ key[0];
+        const quint32 t1 = td[0][s1 >> 24] ^ td[1][(s0 >> 16) & 0xFF] ^ td[2][(s3 >> 8) & 0xFF]
+                           ^ td[3][s2 & 0xFF] ^ key[1];
+        const quint32 t2 = td[0][s2 >> 24] ^ td[1][(s1 >> 16) & 0xFF] ^ td[2][(s0 >> 8) & 0xFF]
+                           ^ td[3][s3 & 0xFF] ^ key[2];
+        const quint32 t3 = td[0][s3 >> 24] ^ td[1][(s2 >> 16) & 0xFF] ^ td[2][(s1 >> 8) & 0xFF]
+                           ^ td[3][s0 & 0xFF] ^ key[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    key += 4;
+    const uchar *s = tables->inverseSbox;
+    writeWord((quint32(s[s0 >> 24]) << 24 | quint32(s[(s3 >> 16) & 0xFF]) << 16
+               | quint32(s[(s2 >> 8) & 0xFF]) << 8 | quint32(s[s1 & 0xFF]))
+                  ^ key[0],
+              out);
+    writeWord((quint32(s[s1 >> 24]) << 24 | quint32(s[(s0 >> 16) & 0xFF]) << 16
+               | quint32(s[(s3 >> 8) & 0xFF]) << 8 | quint32(s[s2 & 0xFF]))
+                  ^ key[1],
+              out + 4);
+    writeWord((quint32(s[s2 >> 24]) << 24 | quint32(s[(s1 >> 16) & 0xFF]) << 16
+               | quint32(s[(s0 >> 8) & 0xFF]) << 8 | quint32(s[s3 & 0xFF]))
+                  ^ key[2],
+              out + 8);
+    writeWord((quint32(s[s3 >> 24]) << 24 | quint32(s[(s2 >> 16) & 0xFF]) << 16
+               | quint32(s[(s1 >> 8) & 0xFF]) << 8 | quint32(s[s0 & 0xFF]))
+                  ^ key[3],
+              out + 12);
+}
+
+/*
+  Encrypt \a size bytes of \a data in place in the CBC mode, starting from
+  the 16 bytes of \a iv. \a size must be a multiple of the block size.
+ */
+void Aes::encryptCbc(uchar *data, int size, const uchar *iv) const
+{
+    Q_ASSERT(size % BlockSize == 0);
+#if defined(XLSX_HAVE_AESNI)
+    if (m_hardware) {
+        aesNiEncryptCbc(m_hardwareEncryptKeys, m_rounds, data, size, iv);
+        return;
+    }
+#endif
+    const uchar *previous = iv;
+    for (int pos = 0; pos < size; pos += BlockSize) {
+        uchar *block = data + pos;
+        for (int i = 0; i < BlockSize; ++i)
+            block[i] ^= previous[i];
+        encryptBlock(block, block);
+        previous = block;
+    }
+}
+
+/*
+  Decrypt \a size bytes of \a data in place in the CBC mode, starting from
+  the 16 bytes of \a iv. \a size must be a multiple of the block size.
+ */
+void Aes::decryptCbc(uchar *data, int size, const uchar *iv) const
+{
+    Q_ASSERT(size % BlockSize == 0);
+#if defined(XLSX_HAVE_AESNI)
+    if (m_hardware) {
+        aesNiDecryptCbc(m_hardwareDecryptKeys, m_rounds, data, size, iv);
+        return;
+    }
+#endif
+    uchar previous[BlockSize];
+    uchar cipher[BlockSize];
+    memcpy(previous, iv, BlockSize);
+    for (int pos = 0; pos < size; pos += BlockSize) {
+        uchar *block = data + pos;
+        memcpy(cipher, block, BlockSize);
+        decryptBlock(block, block);
+        for (int i = 0; i < BlockSize; ++i)
+            block[i] ^= previous[i];
+        memcpy(previous, cipher, BlockSize);
+    }
+}
+
+/*
+  Returns \a data encrypted in the CBC mode from \a iv, padded with zeros
+  to a multiple of the block size. The extra bytes of a longer \a iv are
+  ignored.
+ */
+QByteArray Aes::encryptCbc(const QByteArray &data, const QByteArray &iv) const
+{
+    Q_ASSERT(iv.size() >= BlockSize);
+    QByteArray result = data;
+    if (result.size() % BlockSize)
+        result.append(QByteArray(BlockSize - result.size() % BlockSize, 0));
+    encryptCbc(reinterpret_cast<uchar *>(result.data()), result.size(),
+               reinterpret_cast<const uchar *>(iv.constData()));
+    return result;
+}
+
+/*
+  Returns \a data decrypted in the CBC mode from \a iv. A partial block at
+  the end of \a data is dropped.
+ */
+QByteArray Aes::decryptCbc(const QByteArray &data, const QByteArray &iv) const
+{
+    Q_ASSERT(iv.size() >= BlockSize);
+    QByteArray result = data.left(data.size() - data.size() % BlockSize);
+    decryptCbc(reinterpret_cast<uchar *>(result.data()), result.size(),
+               reinterpret_cast<const uchar *>(iv.constData()));
+    return result;
+}
+
+/*
+  Returns true if the ciphers set up from now on use the AES-NI
+  instructions.
+ */
+bool Aes::hasHardwareSupport()
+{
+#if defined(XLSX_HAVE_AESNI)
+    return aesNiAvailable && hardwareSupportEnabled;
+#else
+    return false;
+#endif
+}
+
+/*
+  Allow the AES-NI instructions when \a enable is true, the default, for
+  the ciphers set up from now on. Turned off by the tests to check the
+  lookup tables on any machine.
+ */
+void Aes::setHardwareSupportEnabled(bool enable)
+{
+    hardwareSupportEnabled = enable;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,85 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXAES_P_H
+#define XLSXAES_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The AES block cipher, with 128, 192 or 256 bit keys, used by the
+  encrypted packages. The blocks are ciphered with the AES-NI instructions
+  when the processor has them, whatever the flags the library is built
+  with, and with lookup tables otherwise.
+ */
+class XLSX_AUTOTEST_EXPORT Aes
+{
+public:
+    enum { BlockSize = 16 };
+
+    Aes();
+
+    bool setKey(const QByteArray &key);
+    bool isValid() const { return m_rounds != 0; }
+
+    void encryptBlock(const uchar *in, uchar *out) const;
+    void decryptBlock(const uchar *in, uchar *out) const;
+    void encryptCbc(uchar *data, int size, const uchar *iv) const;
+    void decryptCbc(uchar *data, int size, const uchar *iv) const;
+    QByteArray encryptCbc(const QByteArray &data, const QByteArray &iv) const;
+    QByteArray decryptCbc(const QByteArray &data, const QByteArray &iv) const;
+
+    static bool hasHardwareSupport();
+    static void setHardwareSupportEnabled(bool enable);
+
+private:
+    // The round keys as big endian words, the decryption ones in reverse
+    // order with the inverse mix columns applied
+    quint32 m_encryptKeys[60];
+    quint32 m_decryptKeys[60];
+    // The same as bytes, in the order the AES-NI instructions take them
+    uchar m_hardwareEncryptKeys[240];
+    uchar m_hardwareDecryptKeys[240];
+    int m_rounds; // 0 until a key is set
+    bool m_hardware;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXAES_P_H
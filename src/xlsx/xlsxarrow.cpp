@@ -0,0 +1,697 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxarrow.h"
+#include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxformat.h"
+#include "xlsxsharedstrings_p.h"
+#include "xlsxcellreference.h"
+#include "xlsxutility_p.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include <QDebug>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The values of the arrays which can be stored in cells.
+ */
+enum ArrowKind {
+    UnsupportedKind,
+    NullKind,
+    BooleanKind,
+    NumberKind,
+    DateKind, // dates and timestamps
+    StringKind,
+    DictionaryKind // strings encoded as indices of a dictionary
+};
+
+/*
+  Returns the kind of the values of an array with the \a format. For the
+  dates and the timestamps, \a msecsPerUnit is set to the milliseconds of
+  one unit. The time zone of the timestamps is ignored.
+ */
+static ArrowKind arrowKind(const char *format, double *msecsPerUnit)
+{
+    *msecsPerUnit = 1;
+    if (!format || !format[0])
+        return UnsupportedKind;
+
+    if (!format[1]) {
+        switch (format[0]) {
+        case 'n':
+            return NullKind;
+        case 'b':
+            return BooleanKind;
+        case 'c':
+        case 'C':
+        case 's':
+        case 'S':
+        case 'i':
+        case 'I':
+        case 'l':
+        case 'L':
+        case 'f':
+        case 'g':
+            return NumberKind;
+        case 'u':
+        case 'U':
+            return StringKind;
+        default:
+            return UnsupportedKind;
+        }
+    }
+
+    if (qstrcmp(format, "tdD") == 0) {
+        *msecsPerUnit = 86400000;
+        return DateKind;
+    }
+    if (qstrcmp(format, "tdm") == 0)
+        return DateKind;
+    if (format[0] == 't' && format[1] == 's' && format[2] && format[3] == ':') {
+        switch (format[2]) {
+        case 's':
+            *msecsPerUnit = 1000;
+            return DateKind;
+        case 'm':
+            return DateKind;
+        case 'u':
+            *msecsPerUnit = 0.001;
+            return DateKind;
+        case 'n':
+            *msecsPerUnit = 0.000001;
+            return DateKind;
+        default:
+            break;
+        }
+    }
+    return UnsupportedKind;
+}
+
+static bool isIntegerFormat(const char *format)
+{
+    return format && format[0] && !format[1] && strchr("cCsSiIlL", format[0]);
+}
+
+/*
+  Returns the element \a i of the primitive \a data of the arrow \a type.
+ */
+static double arrowNumber(char type, const void *data, qint64 i)
+{
+    switch (type) {
+    case 'c':
+        return static_cast<const qint8 *>(data)[i];
+    case 'C':
+        return static_cast<const quint8 *>(data)[i];
+    case 's':
+        return static_cast<const qint16 *>(data)[i];
+    case 'S':
+        return static_cast<const quint16 *>(data)[i];
+    case 'i':
+        return static_cast<const qint32 *>(data)[i];
+    case 'I':
+        return static_cast<const quint32 *>(data)[i];
+    case 'l':
+        return static_cast<const qint64 *>(data)[i];
+    case 'L':
+        return static_cast<const quint64 *>(data)[i];
+    case 'f':
+        return static_cast<const float *>(data)[i];
+    default:
+        return static_cast<const double *>(data)[i];
+    }
+}
+
+static bool arrowBit(const void *bitmap, qint64 i)
+{
+    return static_cast<const uchar *>(bitmap)[i >> 3] & (1 << (i & 7));
+}
+
+static void setArrowBit(QByteArray *bitmap, qint64 i)
+{
+    bitmap->data()[i >> 3] |= char(1 << (i & 7));
+}
+
+/*
+  Returns true if the element \a i of \a array, counted from its offset,
+  is null.
+ */
+static bool isArrowNull(const ArrowArray *array, qint64 i)
+{
+    if (array->null_count == 0 || array->n_buffers < 1 || !array->buffers[0])
+        return false;
+    return !arrowBit(array->buffers[0], array->offset + i);
+}
+
+/*
+  Returns the element \a i of the utf8 \a array, whose offsets are 64-bit
+  integers if \a large is true.
+ */
+static QString arrowString(const ArrowArray *array, qint64 i, bool large)
+{
+    const qint64 j = array->offset + i;
+    qint64 begin;
+    qint64 end;
+    if (large) {
+        const qint64 *offsets = static_cast<const qint64 *>(array->buffers[1]);
+        begin = offsets[j];
+        end = offsets[j + 1];
+    } else {
+        const qint32 *offsets = static_cast<const qint32 *>(array->buffers[1]);
+        begin = offsets[j];
+        end = offsets[j + 1];
+    }
+    return QString::fromUtf8(static_cast<const char *>(array->buffers[2]) + begin,
+                             int(end - begin));
+}
+
+/*
+  Write the values of \a array down \a col from \a row. Null values give
+  blank cells which keep their format, like the null values of
+  Worksheet::writeColumn() do.
+ */
+static bool writeArrowColumn(WorksheetPrivate *d, int row, int col, const ArrowSchema *schema,
+                             const ArrowArray *array)
+{
+    double msecsPerUnit;
+    ArrowKind kind = arrowKind(schema->format, &msecsPerUnit);
+    if (schema->dictionary) {
+        double unused;
+        const bool strings =
+            array->dictionary && arrowKind(schema->dictionary->format, &unused) == StringKind;
+        kind = isIntegerFormat(schema->format) && strings ? DictionaryKind : UnsupportedKind;
+    }
+    if (kind == UnsupportedKind) {
+        qDebug("Unsupported arrow format %s", schema->format);
+        return false;
+    }
+    if (array->length == 0)
+        return true;
+    if (array->length > XLSX_ROW_MAX
+        || !d->checkBatchDimensions(row, col, row + int(array->length) - 1, col)) {
+        return false;
+    }
+
+    int xf = -2;
+    if (kind == DateKind) {
+        Format format;
+        format.setNumberFormat(d->workbook->defaultDateFormat());
+        xf = d->batchXfIndex(format);
+    }
+
+    // Each entry of the dictionary is added to the shared strings once
+    const ArrowArray *dictionary = array->dictionary;
+    const bool largeStrings = kind == DictionaryKind ? schema->dictionary->format[0] == 'U'
+                                                     : schema->format[0] == 'U';
+    QVector<int> sstIndexes(kind == DictionaryKind ? int(dictionary->length) : 0, -1);
+
+    const bool date1904 = d->workbook->isDate1904();
+    SharedStrings *sst = d->sharedStrings();
+    const int count = int(array->length);
+    QVector<CellData> cells(count);
+    for (int i = 0; i < count; ++i) {
+        const int cellXf = d->batchCellXfIndex(xf, row + i, col);
+        const qint64 j = array->offset + i;
+        cells[i] = CellData(CellData::Blank, Cell::NumberType, cellXf);
+        if (kind == NullKind || isArrowNull(array, i))
+            continue;
+
+        switch (kind) {
+        case BooleanKind:
+            cells[i] = CellData::fromBool(arrowBit(array->buffers[1], j), cellXf);
+            break;
+        case NumberKind:
+            cells[i] = CellData::fromNumber(arrowNumber(schema->format[0], array->buffers[1], j),
+                                            cellXf);
+            break;
+        case DateKind: {
+            const char type = qstrcmp(schema->format, "tdD") == 0 ? 'i' : 'l';
+            const qint64 msecs = qRound64(arrowNumber(type, array->buffers[1], j) * msecsPerUnit);
+            double number;
+            msecsSinceEpochToNumbers(&msecs, 1, &number, date1904);
+            cells[i] = CellData::fromNumber(number, cellXf);
+            break;
+        }
+        case StringKind:
+            cells[i] = CellData::fromSharedString(
+                sst->addSharedString(arrowString(array, i, largeStrings)), cellXf);
+            break;
+        case DictionaryKind: {
+            const qint64 index = qint64(arrowNumber(schema->format[0], array->buffers[1], j));
+            if (index < 0 || index >= dictionary->length || isArrowNull(dictionary, index))
+                break;
+            int &sstIndex = sstIndexes[int(index)];
+            if (sstIndex == -1)
+                sstIndex = sst->addSharedString(arrowString(dictionary, index, largeStrings));
+            else
+                sst->incRefByStringIndex(sstIndex);
+            cells[i] = CellData::fromSharedString(sstIndex, cellXf);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    d->storeBatchCells(row, col, cells, true);
+    return true;
+}
+
+/*
+  Buffers and children owned by the arrays made by ArrowBridge.
+ */
+class ArrowArrayData
+{
+public:
+    QVector<QByteArray> buffers;
+    QVector<const void *> bufferPointers;
+    QVector<ArrowArray *> children;
+    ArrowArray *dictionary;
+};
+
+class ArrowSchemaData
+{
+public:
+    QByteArray format;
+    QByteArray name;
+    QVector<ArrowSchema *> children;
+    ArrowSchema *dictionary;
+};
+
+static void releaseArray(ArrowArray *array)
+{
+    ArrowArrayData *data = static_cast<ArrowArrayData *>(array->private_data);
+    // Children which are moved by the consumer are released already
+    foreach (ArrowArray *child, data->children) {
+        if (child->release)
+            child->release(child);
+        delete child;
+    }
+    if (data->dictionary) {
+        if (data->dictionary->release)
+            data->dictionary->release(data->dictionary);
+        delete data->dictionary;
+    }
+    delete data;
+    array->release = 0;
+}
+
+static void releaseSchema(ArrowSchema *schema)
+{
+    ArrowSchemaData *data = static_cast<ArrowSchemaData *>(schema->private_data);
+    foreach (ArrowSchema *child, data->children) {
+        if (child->release)
+            child->release(child);
+        delete child;
+    }
+    if (data->dictionary) {
+        if (data->dictionary->release)
+            data->dictionary->release(data->dictionary);
+        delete data->dictionary;
+    }
+    delete data;
+    schema->release = 0;
+}
+
+/*
+  Fill \a array with the \a buffers, a null one giving a null pointer.
+ */
+static ArrowArrayData *initArray(ArrowArray *array, qint64 length, qint64 nullCount,
+                                 const QVector<QByteArray> &buffers)
+{
+    ArrowArrayData *data = new ArrowArrayData;
+    data->buffers = buffers;
+    data->dictionary = 0;
+    foreach (const QByteArray &buffer, data->buffers)
+        data->bufferPointers.append(buffer.isNull() ? 0 : buffer.constData());
+
+    array->length = length;
+    array->null_count = nullCount;
+    array->offset = 0;
+    array->n_buffers = data->bufferPointers.size();
+    array->n_children = 0;
+    array->buffers = data->bufferPointers.data();
+    array->children = 0;
+    array->dictionary = 0;
+    array->release = releaseArray;
+    array->private_data = data;
+    return data;
+}
+
+static ArrowSchemaData *initSchema(ArrowSchema *schema, const char *format, const QByteArray &name)
+{
+    ArrowSchemaData *data = new ArrowSchemaData;
+    data->format = format;
+    data->name = name;
+    data->dictionary = 0;
+
+    schema->format = data->format.constData();
+    schema->name = data->name.constData();
+    schema->metadata = 0;
+    schema->flags = ARROW_FLAG_NULLABLE;
+    schema->n_children = 0;
+    schema->children = 0;
+    schema->dictionary = 0;
+    schema->release = releaseSchema;
+    schema->private_data = data;
+    return data;
+}
+
+static QByteArray columnName(int column)
+{
+    QString name = CellReference(1, column).toString();
+    name.chop(1);
+    return name.toUtf8();
+}
+
+static bool isStringCell(const WorksheetPrivate *d, const CellData &cell)
+{
+    if (cell.storage == CellData::SharedString)
+        return true;
+    if (cell.storage != CellData::Extra)
+        return false;
+    if (d->cellTable.extra(cell.index).sharedStringIndex != -1)
+        return true;
+    return cell.cellType == Cell::StringType || cell.cellType == Cell::InlineStringType;
+}
+
+/*
+  Export the cells of \a column from \a firstRow to \a lastRow. Strings make
+  a column of dictionary encoded strings, in which the other values are
+  given as text. Otherwise numbers make a column of doubles, or of
+  timestamps if they all have a date time format, and booleans a column
+  of booleans. Empty cells and errors are null.
+ */
+static void readArrowColumn(const WorksheetPrivate *d, int column, int firstRow, int lastRow,
+                            const QByteArray &name, ArrowSchema *schema, ArrowArray *array)
+{
+    const int count = lastRow - firstRow + 1;
+    QVector<const CellData *> cells(count, 0);
+    const CellTable &table = d->cellTable;
+    for (int i = table.rowLowerBound(firstRow); i < table.size() && table.rowNumberAt(i) <= lastRow;
+         ++i) {
+        const CellRow &row = table.rowAt(i);
+        const int j = row.indexOf(column);
+        if (j != -1)
+            cells[table.rowNumberAt(i) - firstRow] = &row.cells[j];
+    }
+
+    bool hasString = false;
+    bool hasNumber = false;
+    bool hasBool = false;
+    bool allDates = true;
+    QHash<int, bool> dateFormats;
+    for (int i = 0; i < count && !hasString; ++i) {
+        const CellData *cell = cells[i];
+        double number;
+        if (!cell) {
+            continue;
+        } else if (isStringCell(d, *cell)) {
+            hasString = true;
+        } else if (cell->type() == Cell::BooleanType && d->cellValue(*cell).isValid()) {
+            hasBool = true;
+        } else if (d->cellNumber(*cell, &number)) {
+            hasNumber = true;
+            if (!allDates)
+                continue;
+            QHash<int, bool>::const_iterator it = dateFormats.constFind(cell->xfIndex);
+            if (it == dateFormats.constEnd()) {
+                const bool date = cell->xfIndex != -1 && d->cellFormat(*cell).isDateTimeFormat();
+                it = dateFormats.insert(cell->xfIndex, date);
+            }
+            allDates = it.value();
+        }
+    }
+
+    QByteArray validity((count + 7) / 8, 0);
+    int nullCount = 0;
+    QVector<QByteArray> buffers;
+    const char *format = "g";
+    if (hasString) {
+        format = "i";
+        QByteArray indexes(count * int(sizeof(qint32)), 0);
+        qint32 *index = reinterpret_cast<qint32 *>(indexes.data());
+        QHash<int, int> sstEntries;
+        QHash<QString, int> textEntries;
+        QByteArray offsets(int(sizeof(qint32)), 0);
+        QByteArray text;
+        for (int i = 0; i < count; ++i) {
+            const CellData *cell = cells[i];
+            const QVariant value = cell ? d->cellValue(*cell) : QVariant();
+            if (!value.isValid() || cell->type() == Cell::ErrorType) {
+                ++nullCount;
+                continue;
+            }
+            const int sstIndex = cell->storage == CellData::SharedString
+                ? cell->index
+                : cell->storage == CellData::Extra ? table.extra(cell->index).sharedStringIndex
+                                                   : -1;
+            QHash<int, int>::const_iterator sstIt = sstEntries.constFind(sstIndex);
+            if (sstIndex == -1 || sstIt == sstEntries.constEnd()) {
+                const QString string = value.toString();
+                QHash<QString, int>::const_iterator it = textEntries.constFind(string);
+                if (it == textEntries.constEnd()) {
+                    text.append(string.toUtf8());
+                    const qint32 end = text.size();
+                    offsets.append(reinterpret_cast<const char *>(&end), int(sizeof(end)));
+                    it = textEntries.insert(string, textEntries.size());
+                }
+                if (sstIndex != -1)
+                    sstIt = sstEntries.insert(sstIndex, it.value());
+                index[i] = it.value();
+            } else {
+                index[i] = sstIt.value();
+            }
+            setArrowBit(&validity, i);
+        }
+
+        ArrowArray *dictionary = new ArrowArray;
+        initArray(dictionary, textEntries.size(), 0,
+                  QVector<QByteArray>() << QByteArray() << offsets << text);
+        ArrowSchema *dictionarySchema = new ArrowSchema;
+        initSchema(dictionarySchema, "u", QByteArray());
+
+        buffers << (nullCount ? validity : QByteArray()) << indexes;
+        ArrowArrayData *data = initArray(array, count, nullCount, buffers);
+        data->dictionary = dictionary;
+        array->dictionary = dictionary;
+        ArrowSchemaData *schemaData = initSchema(schema, format, name);
+        schemaData->dictionary = dictionarySchema;
+        schema->dictionary = dictionarySchema;
+        return;
+    }
+
+    if (hasBool && !hasNumber) {
+        format = "b";
+        QByteArray values((count + 7) / 8, 0);
+        for (int i = 0; i < count; ++i) {
+            const CellData *cell = cells[i];
+            if (!cell || cell->type() != Cell::BooleanType || !d->cellValue(*cell).isValid()) {
+                ++nullCount;
+                continue;
+            }
+            if (d->cellValue(*cell).toBool())
+                setArrowBit(&values, i);
+            setArrowBit(&validity, i);
+        }
+        buffers << (nullCount ? validity : QByteArray()) << values;
+    } else {
+        const bool dates = hasNumber && allDates;
+        format = dates ? "tsm:" : "g";
+        QVector<double> numbers(count, 0);
+        for (int i = 0; i < count; ++i) {
+            const CellData *cell = cells[i];
+            if (cell && cell->type() == Cell::BooleanType && d->cellValue(*cell).isValid()) {
+                numbers[i] = d->cellValue(*cell).toBool() ? 1 : 0;
+            } else if (!cell || !d->cellNumber(*cell, &numbers[i])) {
+                ++nullCount;
+                continue;
+            }
+            setArrowBit(&validity, i);
+        }
+        QByteArray values(count * 8, 0);
+        if (dates) {
+            numbersToMsecsSinceEpoch(numbers.constData(), count,
+                                     reinterpret_cast<qint64 *>(values.data()),
+                                     d->workbook->isDate1904());
+        } else {
+            memcpy(values.data(), numbers.constData(), count * sizeof(double));
+        }
+        buffers << (nullCount ? validity : QByteArray()) << values;
+    }
+    initArray(array, count, nullCount, buffers);
+    initSchema(schema, format, name);
+}
+
+/*!
+    \class ArrowBridge
+    \inmodule QtXlsx
+    \brief Moves columns of data between worksheets and Apache Arrow arrays.
+
+    The arrays are exchanged through the Arrow C data interface, so no Arrow
+    library is needed. Record batches are exchanged as struct arrays, as
+    done by the C data interface of Arrow itself.
+
+    The bridge is built when the library is configured with
+    \c{CONFIG+=xlsx_arrow}.
+ */
+
+/*!
+    Writes the values of \a array, described by \a schema, down \a column
+    from \a firstRow. Booleans, numbers, strings, dictionary encoded
+    strings, dates and timestamps are supported. Dates and timestamps get
+    the default date format of the workbook, and null values give blank
+    cells. Strings are stored as they are, like Worksheet::RawWrite does.
+
+    The array stays owned by the caller. Returns false if the array is
+    empty, of an unsupported type, or doesn't fit in the sheet.
+ */
+bool ArrowBridge::writeArray(Worksheet *sheet, int firstRow, int column,
+                             const ArrowSchema *schema, const ArrowArray *array)
+{
+    if (!sheet || !schema || !array || array->length <= 0)
+        return false;
+    return writeArrowColumn(sheet->d_func(), firstRow, column, schema, array);
+}
+
+/*!
+    Writes the columns of the record batch \a array, described by
+    \a schema, from (\a firstRow, \a firstColumn). If \a header is true,
+    the names of the fields are written in \a firstRow, and the values
+    below them. Each column is written like writeArray() does.
+ */
+bool ArrowBridge::writeRecordBatch(Worksheet *sheet, int firstRow, int firstColumn,
+                                   const ArrowSchema *schema, const ArrowArray *array,
+                                   bool header)
+{
+    if (!sheet || !schema || !array || qstrcmp(schema->format, "+s") != 0
+        || schema->n_children <= 0 || schema->n_children != array->n_children) {
+        return false;
+    }
+
+    WorksheetPrivate *d = sheet->d_func();
+    const int columnCount = int(schema->n_children);
+    if (header) {
+        if (!d->checkBatchDimensions(firstRow, firstColumn, firstRow,
+                                     firstColumn + columnCount - 1)) {
+            return false;
+        }
+        QStringList names;
+        for (int i = 0; i < columnCount; ++i)
+            names.append(QString::fromUtf8(schema->children[i]->name));
+        d->writeBatchStrings(firstRow, firstColumn, names, false, Format());
+        ++firstRow;
+    }
+
+    bool ret = true;
+    for (int i = 0; i < columnCount; ++i) {
+        // The offset and the length of the batch apply to its columns
+        ArrowArray child = *array->children[i];
+        child.offset += array->offset;
+        child.length = array->length;
+        if (array->offset)
+            child.null_count = -1;
+        if (!writeArrowColumn(d, firstRow, firstColumn + i, schema->children[i], &child))
+            ret = false;
+    }
+    return ret;
+}
+
+/*!
+    Exports the cells of \a column from \a firstRow to \a lastRow to
+    \a array, described by \a schema. Strings give dictionary encoded
+    strings, each shared string being one entry of the dictionary, and the
+    other values of such a column are given as text. Otherwise, numbers
+    give doubles, or timestamps in milliseconds if they all have a date
+    time format, and booleans give booleans. Empty cells and errors are
+    null.
+
+    The caller owns the exported structures and must release them.
+ */
+bool ArrowBridge::readArray(const Worksheet *sheet, int column, int firstRow, int lastRow,
+                            ArrowSchema *schema, ArrowArray *array)
+{
+    if (!sheet || !schema || !array || column < 1 || column > XLSX_COLUMN_MAX || firstRow < 1
+        || lastRow < firstRow || lastRow > XLSX_ROW_MAX) {
+        return false;
+    }
+
+    readArrowColumn(sheet->d_func(), column, firstRow, lastRow, columnName(column), schema,
+                    array);
+    return true;
+}
+
+/*!
+    Exports the cells of \a range as a record batch to \a array, described
+    by \a schema, one column of the range giving one field. If \a header is
+    true, the first row of the range gives the names of the fields.
+    Otherwise the fields are named after the columns. Each column is
+    exported like readArray() does.
+ */
+bool ArrowBridge::readRecordBatch(const Worksheet *sheet, const CellRange &range,
+                                  ArrowSchema *schema, ArrowArray *array, bool header)
+{
+    if (!sheet || !schema || !array || !range.isValid() || range.firstRow() < 1
+        || range.firstColumn() < 1 || range.lastRow() > XLSX_ROW_MAX
+        || range.lastColumn() > XLSX_COLUMN_MAX) {
+        return false;
+    }
+
+    const WorksheetPrivate *d = sheet->d_func();
+    const int firstRow = header ? range.firstRow() + 1 : range.firstRow();
+    const int columnCount = range.columnCount();
+    ArrowArrayData *data = initArray(array, range.lastRow() - firstRow + 1, 0,
+                                     QVector<QByteArray>() << QByteArray());
+    ArrowSchemaData *schemaData = initSchema(schema, "+s", QByteArray());
+    for (int i = 0; i < columnCount; ++i) {
+        const int column = range.firstColumn() + i;
+        QByteArray name;
+        if (header) {
+            const CellData *cell = d->cellTable.cell(range.firstRow(), column);
+            if (cell)
+                name = d->cellValue(*cell).toString().toUtf8();
+        }
+        if (name.isEmpty())
+            name = columnName(column);
+
+        ArrowSchema *childSchema = new ArrowSchema;
+        ArrowArray *child = new ArrowArray;
+        readArrowColumn(d, column, firstRow, range.lastRow(), name, childSchema, child);
+        schemaData->children.append(childSchema);
+        data->children.append(child);
+    }
+    array->n_children = columnCount;
+    array->children = data->children.data();
+    schema->n_children = columnCount;
+    schema->children = schemaData->children.data();
+    return true;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,107 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXARROW_H
+#define QXLSX_XLSXARROW_H
+
+#include "xlsxglobal.h"
+#include "xlsxcellrange.h"
+
+#include <stdint.h>
+
+// The structures of the Apache Arrow C data interface, as defined by its
+// specification. The guard lets them coexist with Arrow's own headers.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema
+{
+    // Array type description
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+struct ArrowArray
+{
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+} // extern "C"
+
+#endif // ARROW_C_DATA_INTERFACE
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Worksheet;
+
+class Q_XLSX_EXPORT ArrowBridge
+{
+public:
+    static bool writeArray(Worksheet *sheet, int firstRow, int column, const ArrowSchema *schema,
+                           const ArrowArray *array);
+    static bool writeRecordBatch(Worksheet *sheet, int firstRow, int firstColumn,
+                                 const ArrowSchema *schema, const ArrowArray *array,
+                                 bool header = true);
+
+    static bool readArray(const Worksheet *sheet, int column, int firstRow, int lastRow,
+                          ArrowSchema *schema, ArrowArray *array);
+    static bool readRecordBatch(const Worksheet *sheet, const CellRange &range,
+                                ArrowSchema *schema, ArrowArray *array, bool header = true);
+
+private:
+    ArrowBridge();
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXARROW_H
@@ -0,0 +1,281 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxbiff12_p.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+Biff12Writer::Biff12Writer(QIODevice *device)
+    : m_device(device)
+    , m_type(-1)
+{
+    m_buffer.reserve(BufferSize);
+}
+
+Biff12Writer::~Biff12Writer()
+{
+    flush();
+}
+
+/*
+  Start the record of the given \a type, its data is written by the
+  write functions until endRecord() is called.
+ */
+void Biff12Writer::beginRecord(int type)
+{
+    Q_ASSERT(m_type == -1);
+    m_type = type;
+    m_data.resize(0);
+}
+
+void Biff12Writer::endRecord()
+{
+    Q_ASSERT(m_type != -1);
+    // The type is a variable length integer too, of at most two bytes
+    writeVarInt(quint32(m_type));
+    writeVarInt(quint32(m_data.size()));
+    m_buffer.append(m_data);
+    m_type = -1;
+    if (m_buffer.size() >= BufferSize)
+        flush();
+}
+
+/*
+  Write a record of the given \a type which has no data, such as the
+  records which begin and end a collection.
+ */
+void Biff12Writer::writeRecord(int type)
+{
+    beginRecord(type);
+    endRecord();
+}
+
+void Biff12Writer::writeVarInt(quint32 value)
+{
+    do {
+        char byte = char(value & 0x7F);
+        value >>= 7;
+        if (value)
+            byte |= char(0x80);
+        m_buffer.append(byte);
+    } while (value);
+}
+
+void Biff12Writer::writeUInt8(quint8 value)
+{
+    m_data.append(char(value));
+}
+
+void Biff12Writer::writeUInt16(quint16 value)
+{
+    uchar bytes[2];
+    qToLittleEndian<quint16>(value, bytes);
+    m_data.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+void Biff12Writer::writeUInt32(quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    m_data.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+void Biff12Writer::writeDouble(double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uchar bytes[8];
+    qToLittleEndian<quint64>(bits, bytes);
+    m_data.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+/*
+  Write \a text as a XLWideString: the number of UTF-16 code units,
+  followed by them.
+ */
+void Biff12Writer::writeString(const QString &text)
+{
+    writeUInt32(quint32(text.size()));
+    const int pos = m_data.size();
+    m_data.resize(pos + text.size() * 2);
+    uchar *bytes = reinterpret_cast<uchar *>(m_data.data() + pos);
+    const ushort *units = text.utf16();
+    for (int i = 0; i < text.size(); ++i)
+        qToLittleEndian<quint16>(units[i], bytes + i * 2);
+}
+
+/*
+  Write the null value of a XLNullableWideString.
+ */
+void Biff12Writer::writeNullString()
+{
+    writeUInt32(0xFFFFFFFF);
+}
+
+void Biff12Writer::writeZeros(int count)
+{
+    m_data.append(QByteArray(count, '\0'));
+}
+
+/*
+  Write all the finished records to the device.
+ */
+void Biff12Writer::flush()
+{
+    if (!m_buffer.isEmpty())
+        m_device->write(m_buffer);
+    m_buffer.resize(0);
+}
+
+Biff12Reader::Biff12Reader(const QByteArray &data)
+    : m_data(data)
+    , m_bytes(reinterpret_cast<const uchar *>(m_data.constData()))
+    , m_size(m_data.size())
+    , m_type(-1)
+    , m_recordStart(0)
+    , m_pos(0)
+    , m_end(0)
+    , m_error(false)
+{
+}
+
+/*
+  Move to the next record, whatever has been read of the current one.
+  Returns false at the end of the data, or if the next record is
+  truncated.
+ */
+bool Biff12Reader::readNext()
+{
+    m_pos = m_end;
+    quint32 type;
+    quint32 size;
+    if (m_pos >= m_size || !readVarInt(2, &type) || !readVarInt(4, &size)
+        || size > quint32(m_size - m_pos)) {
+        m_type = -1;
+        m_end = m_pos = m_size;
+        return false;
+    }
+    m_type = int(type);
+    m_recordStart = m_pos;
+    m_end = m_pos + int(size);
+    return true;
+}
+
+bool Biff12Reader::readVarInt(int maxBytes, quint32 *value)
+{
+    *value = 0;
+    for (int i = 0; i < maxBytes; ++i) {
+        if (m_pos >= m_size) {
+            m_error = true;
+            return false;
+        }
+        const uchar byte = m_bytes[m_pos++];
+        *value |= quint32(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80))
+            return true;
+    }
+    // The last byte allowed still had its continuation bit
+    m_error = true;
+    return false;
+}
+
+bool Biff12Reader::canRead(int count)
+{
+    if (m_end - m_pos >= count)
+        return true;
+    m_error = true;
+    m_pos = m_end;
+    return false;
+}
+
+quint8 Biff12Reader::readUInt8()
+{
+    if (!canRead(1))
+        return 0;
+    return m_bytes[m_pos++];
+}
+
+quint16 Biff12Reader::readUInt16()
+{
+    if (!canRead(2))
+        return 0;
+    const quint16 value = qFromLittleEndian<quint16>(m_bytes + m_pos);
+    m_pos += 2;
+    return value;
+}
+
+quint32 Biff12Reader::readUInt32()
+{
+    if (!canRead(4))
+        return 0;
+    const quint32 value = qFromLittleEndian<quint32>(m_bytes + m_pos);
+    m_pos += 4;
+    return value;
+}
+
+double Biff12Reader::readDouble()
+{
+    if (!canRead(8))
+        return 0;
+    const quint64 bits = qFromLittleEndian<quint64>(m_bytes + m_pos);
+    m_pos += 8;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/*
+  Read a XLWideString, or a XLNullableWideString whose null value is
+  returned as a null string.
+ */
+QString Biff12Reader::readString()
+{
+    const quint32 count = readUInt32();
+    if (count == 0xFFFFFFFF || count == 0)
+        return QString();
+    if (count > quint32(m_end - m_pos) / 2) {
+        m_error = true;
+        m_pos = m_end;
+        return QString();
+    }
+    QString text(int(count), Qt::Uninitialized);
+    ushort *units = reinterpret_cast<ushort *>(text.data());
+    for (int i = 0; i < int(count); ++i)
+        units[i] = qFromLittleEndian<quint16>(m_bytes + m_pos + i * 2);
+    m_pos += int(count) * 2;
+    return text;
+}
+
+void Biff12Reader::skip(int count)
+{
+    if (canRead(count))
+        m_pos += count;
+}
+
+QT_END_NAMESPACE_XLSX
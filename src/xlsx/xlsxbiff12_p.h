@@ -0,0 +1,193 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXBIFF12_P_H
+#define XLSXBIFF12_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QString>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The types of the BIFF12 records used by the parts of a .xlsb package,
+  named as in [MS-XLSB] 2.3.
+ */
+enum Biff12RecordType {
+    BrtRowHdr = 0,
+    BrtCellBlank = 1,
+    BrtCellRk = 2,
+    BrtCellError = 3,
+    BrtCellBool = 4,
+    BrtCellReal = 5,
+    BrtCellSt = 6,
+    BrtCellIsst = 7,
+    BrtFmlaString = 8,
+    BrtFmlaNum = 9,
+    BrtFmlaBool = 10,
+    BrtFmlaError = 11,
+    BrtSSTItem = 19,
+    BrtFont = 43,
+    BrtFmt = 44,
+    BrtFill = 45,
+    BrtBorder = 46,
+    BrtXF = 47,
+    BrtStyle = 48,
+    BrtColInfo = 60,
+    BrtFileVersion = 128,
+    BrtBeginSheet = 129,
+    BrtEndSheet = 130,
+    BrtBeginBook = 131,
+    BrtEndBook = 132,
+    BrtBeginBundleShs = 143,
+    BrtEndBundleShs = 144,
+    BrtBeginSheetData = 145,
+    BrtEndSheetData = 146,
+    BrtWsDim = 148,
+    BrtWbProp = 153,
+    BrtBundleSh = 156,
+    BrtBeginSst = 159,
+    BrtEndSst = 160,
+    BrtMergeCell = 176,
+    BrtBeginMergeCells = 177,
+    BrtEndMergeCells = 178,
+    BrtBeginStyleSheet = 278,
+    BrtEndStyleSheet = 279,
+    BrtBeginColInfos = 390,
+    BrtEndColInfos = 391,
+    BrtBeginDXFs = 505,
+    BrtEndDXFs = 506,
+    BrtBeginFills = 603,
+    BrtEndFills = 604,
+    BrtBeginFonts = 611,
+    BrtEndFonts = 612,
+    BrtBeginBorders = 613,
+    BrtEndBorders = 614,
+    BrtBeginFmts = 615,
+    BrtEndFmts = 616,
+    BrtBeginCellXFs = 617,
+    BrtEndCellXFs = 618,
+    BrtBeginStyles = 619,
+    BrtEndStyles = 620,
+    BrtBeginCellStyleXFs = 626,
+    BrtEndCellStyleXFs = 627
+};
+
+/*
+  Writes BIFF12 records: the record type and the size of the data are
+  variable length integers of 7 bits per byte, followed by the data in
+  little endian order. The data of the current record is collected, as
+  its size comes first, and the records are written to the device in
+  large blocks.
+ */
+class XLSX_AUTOTEST_EXPORT Biff12Writer
+{
+public:
+    explicit Biff12Writer(QIODevice *device);
+    ~Biff12Writer();
+
+    void beginRecord(int type);
+    void endRecord();
+    void writeRecord(int type);
+
+    void writeUInt8(quint8 value);
+    void writeUInt16(quint16 value);
+    void writeUInt32(quint32 value);
+    void writeDouble(double value);
+    void writeString(const QString &text);
+    void writeNullString();
+    void writeZeros(int count);
+
+    void flush();
+
+private:
+    Q_DISABLE_COPY(Biff12Writer)
+
+    enum { BufferSize = 64 * 1024 };
+
+    void writeVarInt(quint32 value);
+
+    QIODevice *m_device;
+    int m_type;
+    QByteArray m_data; // of the current record
+    QByteArray m_buffer; // records not written to the device yet
+};
+
+/*
+  Reads the BIFF12 records of a part which is held in memory. The fields
+  of the current record are read in turn, reading past its end returns
+  zeros and sets the error flag, so that a truncated record can't be
+  read beyond.
+ */
+class XLSX_AUTOTEST_EXPORT Biff12Reader
+{
+public:
+    explicit Biff12Reader(const QByteArray &data);
+
+    bool readNext();
+    int recordType() const { return m_type; }
+    int recordSize() const { return m_end - m_recordStart; }
+    bool atRecordEnd() const { return m_pos >= m_end; }
+    bool hasError() const { return m_error; }
+
+    quint8 readUInt8();
+    quint16 readUInt16();
+    quint32 readUInt32();
+    qint32 readInt32() { return qint32(readUInt32()); }
+    double readDouble();
+    QString readString();
+    void skip(int count);
+
+private:
+    bool readVarInt(int maxBytes, quint32 *value);
+    bool canRead(int count);
+
+    QByteArray m_data;
+    const uchar *m_bytes;
+    int m_size;
+    int m_type;
+    int m_recordStart;
+    int m_pos; // in the current record
+    int m_end; // of the current record
+    bool m_error;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXBIFF12_P_H
@@ -0,0 +1,89 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxcardinality_p.h"
+
+#include <QHash>
+
+#include <math.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+CardinalityEstimator::CardinalityEstimator()
+    : m_count(0)
+{
+    memset(m_registers, 0, sizeof(m_registers));
+}
+
+/*
+  Add \a text to the strings counted. The first bits of its hash select a
+  register, which keeps the longest run of leading zeros seen in the
+  other bits.
+ */
+void CardinalityEstimator::add(const QString &text)
+{
+    // qHash() is not mixed well enough for its bits to be used directly
+    quint64 hash = qHash(text);
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
+
+    const int index = int(hash >> (64 - RegisterBits));
+    quint64 rest = hash << RegisterBits;
+    int rank = 1;
+    while (rank <= 64 - RegisterBits && !(rest & Q_UINT64_C(0x8000000000000000))) {
+        ++rank;
+        rest <<= 1;
+    }
+    if (rank > m_registers[index])
+        m_registers[index] = rank;
+    ++m_count;
+}
+
+/*
+  Returns the estimated number of distinct strings added. Small counts,
+  with registers left empty, are estimated by linear counting instead.
+ */
+double CardinalityEstimator::estimate() const
+{
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < RegisterCount; ++i) {
+        sum += ldexp(1.0, -m_registers[i]);
+        if (!m_registers[i])
+            ++zeros;
+    }
+    const double m = RegisterCount;
+    const double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros)
+        estimate = m * log(m / zeros);
+    return qMin(estimate, double(m_count));
+}
+
+QT_END_NAMESPACE_XLSX
@@ -31,10 +31,13 @@
 #include "xlsxworkbook.h"
 #include <QDateTime>
 
+#include <new>
+
 QT_BEGIN_NAMESPACE_XLSX
 
 CellPrivate::CellPrivate(Cell *p)
     : q_ptr(p)
+    , pooled(false)
 {
 }
 
@@ -45,6 +48,7 @@ CellPrivate::CellPrivate(const CellPrivate *const cp)
     , format(cp->format)
     , richString(cp->richString)
     , parent(cp->parent)
+    , pooled(false)
 {
 }
 
@@ -87,12 +91,27 @@ Cell::Cell(const Cell *const cell)
     d_ptr->q_ptr = this;
 }
 
+/*!
+ * \internal
+ * Constructs a cell which uses the private data \a d, as done by CellPool.
+ */
+Cell::Cell(CellPrivate *d, Worksheet *parent)
+    : d_ptr(d)
+{
+    d_ptr->q_ptr = this;
+    d_ptr->cellType = NumberType;
+    d_ptr->parent = parent;
+}
+
 /*!
  * Destroys the Cell and cleans up.
  */
 Cell::~Cell()
 {
-    delete d_ptr;
+    if (d_ptr->pooled)
+        d_ptr->~CellPrivate();
+    else
+        delete d_ptr;
 }
 
 /*!
@@ -177,4 +196,55 @@ bool Cell::isRichString() const
     return d->richString.isRichString();
 }
 
+CellPool::CellPool()
+    : m_used(0)
+{
+}
+
+CellPool::~CellPool()
+{
+    for (int i = 0; i < m_blocks.size(); ++i) {
+        Slot *block = m_blocks[i];
+        const int used = i == m_blocks.size() - 1 ? m_used : int(BlockSize);
+        for (int j = 0; j < used; ++j) {
+            if (block[j].live)
+                reinterpret_cast<Cell *>(&block[j].cell)->~Cell();
+        }
+        delete[] block;
+    }
+}
+
+/*
+  Create an empty cell of the worksheet \a parent.
+ */
+Cell *CellPool::create(Worksheet *parent)
+{
+    Slot *slot;
+    if (!m_free.isEmpty()) {
+        slot = m_free.takeLast();
+    } else {
+        if (m_blocks.isEmpty() || m_used == BlockSize) {
+            m_blocks.append(new Slot[BlockSize]());
+            m_used = 0;
+        }
+        slot = &m_blocks.last()[m_used++];
+    }
+
+    CellPrivate *d = new (&slot->data) CellPrivate(0);
+    d->pooled = true;
+    slot->live = true;
+    return new (&slot->cell) Cell(d, parent);
+}
+
+/*
+  Destroy the \a cell, which must have been created by this pool.
+ */
+void CellPool::destroy(Cell *cell)
+{
+    Slot *slot = reinterpret_cast<Slot *>(cell);
+    cell->~Cell();
+    slot->live = false;
+    m_free.append(slot);
+}
+
 QT_END_NAMESPACE_XLSX
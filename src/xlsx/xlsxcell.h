@@ -35,6 +35,7 @@ class Worksheet;
 class Format;
 class CellFormula;
 class CellPrivate;
+class CellPool;
 class WorksheetPrivate;
 
 class Q_XLSX_EXPORT Cell
@@ -67,10 +68,12 @@ public:
 private:
     friend class Worksheet;
     friend class WorksheetPrivate;
+    friend class CellPool;
 
     Cell(const QVariant &data = QVariant(), CellType type = NumberType,
          const Format &format = Format(), Worksheet *parent = 0);
     Cell(const Cell *const cell);
+    Cell(CellPrivate *d, Worksheet *parent);
     CellPrivate *const d_ptr;
 };
 
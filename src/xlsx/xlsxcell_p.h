@@ -43,6 +43,9 @@
 #include "xlsxcellformula.h"
 #include <QList>
 #include <QSharedPointer>
+#include <QVector>
+
+#include <type_traits>
 
 QT_BEGIN_NAMESPACE_XLSX
 
@@ -62,6 +65,40 @@ public:
 
     Worksheet *parent;
     Cell *q_ptr;
+    bool pooled; // allocated by a CellPool
+};
+
+/*
+  Storage of the Cell objects handed out by a worksheet. A cell and its
+  private data share one slot, and the slots are allocated in large
+  blocks, which are released together when the pool is destroyed.
+  Slots of destroyed cells are reused.
+ */
+class XLSX_AUTOTEST_EXPORT CellPool
+{
+public:
+    CellPool();
+    ~CellPool();
+
+    Cell *create(Worksheet *parent);
+    void destroy(Cell *cell);
+
+private:
+    Q_DISABLE_COPY(CellPool)
+
+    enum { BlockSize = 256 };
+
+    struct Slot
+    {
+        // The cell must be the first member, see destroy()
+        std::aligned_storage<sizeof(Cell), Q_ALIGNOF(Cell)>::type cell;
+        std::aligned_storage<sizeof(CellPrivate), Q_ALIGNOF(CellPrivate)>::type data;
+        bool live;
+    };
+
+    QVector<Slot *> m_blocks;
+    int m_used; // slots used in the last block
+    QVector<Slot *> m_free;
 };
 
 QT_END_NAMESPACE_XLSX
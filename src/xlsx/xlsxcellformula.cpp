@@ -25,6 +25,7 @@
 #include "xlsxcellformula.h"
 #include "xlsxcellformula_p.h"
 #include "xlsxutility_p.h"
+#include "xlsxxmlpullparser_p.h"
 
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
@@ -230,7 +231,7 @@ bool CellFormula::loadFromXml(QXmlStreamReader &reader)
         d->reference = CellRange(refString);
     }
 
-    QString ca = attributes.value(QLatin1String("si")).toString();
+    QString ca = attributes.value(QLatin1String("ca")).toString();
     d->ca = parseXsdBoolean(ca, false);
 
     if (attributes.hasAttribute(QLatin1String("si")))
@@ -240,6 +241,36 @@ bool CellFormula::loadFromXml(QXmlStreamReader &reader)
     return true;
 }
 
+/*!
+ * \internal
+ * \overload
+ * Load the <f> element the native \a parser is on, the same as above.
+ */
+bool CellFormula::loadFromXml(XmlPullParser &parser)
+{
+    Q_ASSERT(parser.isName("f"));
+    if (!d)
+        d = new CellFormulaPrivate(QString(), CellRange(), NormalType);
+
+    if (parser.attributeEquals("t", "array"))
+        d->type = ArrayType;
+    else if (parser.attributeEquals("t", "shared"))
+        d->type = SharedType;
+    else
+        d->type = NormalType;
+
+    if (parser.hasAttribute("ref"))
+        d->reference = CellRange(parser.attributeText("ref"));
+
+    d->ca = parseXsdBoolean(parser.attributeText("ca"), false);
+
+    if (parser.hasAttribute("si"))
+        d->si = parser.attributeInt("si");
+
+    d->formula = parser.readElementText();
+    return true;
+}
+
 /*!
  * \internal
  */
@@ -37,6 +37,7 @@ class CellFormulaPrivate;
 class CellRange;
 class Worksheet;
 class WorksheetPrivate;
+class XmlPullParser;
 
 class Q_XLSX_EXPORT CellFormula
 {
@@ -48,6 +49,15 @@ public:
     CellFormula(const QString &formula, FormulaType type = NormalType);
     CellFormula(const QString &formula, const CellRange &ref, FormulaType type);
     CellFormula(const CellFormula &other);
+#ifdef Q_COMPILER_RVALUE_REFS
+    CellFormula(CellFormula &&other) Q_DECL_NOTHROW : d(std::move(other.d)) {}
+    CellFormula &operator=(CellFormula &&other) Q_DECL_NOTHROW
+    {
+        swap(other);
+        return *this;
+    }
+#endif
+    void swap(CellFormula &other) Q_DECL_NOTHROW { d.swap(other.d); }
     ~CellFormula();
     CellFormula &operator=(const CellFormula &other);
     bool isValid() const;
@@ -62,6 +72,7 @@ public:
 
     bool saveToXml(QXmlStreamWriter &writer) const;
     bool loadFromXml(QXmlStreamReader &reader);
+    bool loadFromXml(XmlPullParser &parser);
 
 private:
     friend class Worksheet;
@@ -71,4 +82,6 @@ private:
 
 QT_END_NAMESPACE_XLSX
 
+Q_DECLARE_TYPEINFO(QXlsx::CellFormula, Q_MOVABLE_TYPE);
+
 #endif // QXLSX_XLSXCELLFORMULA_H
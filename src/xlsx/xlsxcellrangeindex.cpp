@@ -0,0 +1,230 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcellrangeindex_p.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+// Rows of a block, as a shift
+static const int blockShift = 4;
+// Ranges spanning more blocks are kept apart
+static const int maxBlocks = 64;
+
+static inline bool rangesIntersect(const CellRange &a, const CellRange &b)
+{
+    return a.firstRow() <= b.lastRow() && b.firstRow() <= a.lastRow()
+        && a.firstColumn() <= b.lastColumn() && b.firstColumn() <= a.lastColumn();
+}
+
+/*
+  The ranges are registered to each block of 16 rows they span, so that
+  a lookup only scans the ranges of the blocks it spans.
+ */
+CellRangeIndex::CellRangeIndex()
+    : m_size(0)
+{
+}
+
+/*
+  Add \a range with the \a value, which is returned by the lookups.
+ */
+void CellRangeIndex::insert(const CellRange &range, int value)
+{
+    if (!range.isValid())
+        return;
+
+    Entry entry;
+    entry.range = range;
+    entry.value = value;
+    ++m_size;
+
+    const int firstBlock = range.firstRow() >> blockShift;
+    const int lastBlock = range.lastRow() >> blockShift;
+    if (lastBlock - firstBlock >= maxBlocks) {
+        m_tallRanges.append(entry);
+        return;
+    }
+    for (int block = firstBlock; block <= lastBlock; ++block)
+        m_blocks[block].append(entry);
+}
+
+/*
+  Remove the \a range stored with the \a value. Returns false if there is
+  no such range.
+ */
+bool CellRangeIndex::remove(const CellRange &range, int value)
+{
+    if (!range.isValid())
+        return false;
+
+    const int firstBlock = range.firstRow() >> blockShift;
+    const int lastBlock = range.lastRow() >> blockShift;
+    bool removed = false;
+    if (lastBlock - firstBlock >= maxBlocks) {
+        const int i = entryIndex(m_tallRanges, range, value);
+        if (i != -1) {
+            m_tallRanges.remove(i);
+            removed = true;
+        }
+    } else {
+        // The order of the entries of a block doesn't matter
+        for (int block = firstBlock; block <= lastBlock; ++block) {
+            QHash<int, QVector<Entry>>::iterator it = m_blocks.find(block);
+            if (it == m_blocks.end())
+                continue;
+            QVector<Entry> &entries = it.value();
+            const int i = entryIndex(entries, range, value);
+            if (i == -1)
+                continue;
+            entries[i] = entries.last();
+            entries.removeLast();
+            if (entries.isEmpty())
+                m_blocks.erase(it);
+            removed = true;
+        }
+    }
+    if (removed)
+        --m_size;
+    return removed;
+}
+
+void CellRangeIndex::clear()
+{
+    m_blocks.clear();
+    m_tallRanges.clear();
+    m_size = 0;
+}
+
+/*
+  Returns the values of the ranges which contain the cell (\a row,
+  \a column), in ascending order, each once.
+ */
+QList<int> CellRangeIndex::valuesAt(int row, int column) const
+{
+    return intersecting(CellRange(row, column, row, column));
+}
+
+/*
+  Returns the values of the ranges which intersect \a range, in
+  ascending order. A value stored with several ranges is returned once.
+ */
+QList<int> CellRangeIndex::intersecting(const CellRange &range) const
+{
+    QList<int> values;
+    find(range, &values);
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+/*
+  Returns true if any range intersects \a range.
+ */
+bool CellRangeIndex::intersects(const CellRange &range) const
+{
+    return find(range, 0);
+}
+
+/*
+  Returns the position of the \a range stored with the \a value in
+  \a entries, or -1.
+ */
+int CellRangeIndex::entryIndex(const QVector<Entry> &entries, const CellRange &range, int value)
+{
+    for (int i = 0; i < entries.size(); ++i) {
+        if (entries[i].value == value && entries[i].range == range)
+            return i;
+    }
+    return -1;
+}
+
+/*
+  Append the values of the ranges intersecting \a range to \a values, or
+  stop at the first one if \a values is 0. Returns true if one was found.
+ */
+bool CellRangeIndex::find(const CellRange &range, QList<int> *values) const
+{
+    if (!range.isValid() || m_size == 0)
+        return false;
+
+    bool found = false;
+    foreach (const Entry &entry, m_tallRanges) {
+        if (rangesIntersect(entry.range, range)) {
+            if (!values)
+                return true;
+            values->append(entry.value);
+            found = true;
+        }
+    }
+
+    const int firstBlock = range.firstRow() >> blockShift;
+    const int lastBlock = range.lastRow() >> blockShift;
+    if (lastBlock - firstBlock + 1 > m_blocks.size()) {
+        QHash<int, QVector<Entry>>::const_iterator it = m_blocks.constBegin();
+        for (; it != m_blocks.constEnd(); ++it) {
+            if (it.key() >= firstBlock && it.key() <= lastBlock
+                && findInBlock(it.key(), it.value(), range, values)) {
+                if (!values)
+                    return true;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    for (int block = firstBlock; block <= lastBlock; ++block) {
+        QHash<int, QVector<Entry>>::const_iterator it = m_blocks.constFind(block);
+        if (it != m_blocks.constEnd() && findInBlock(block, it.value(), range, values)) {
+            if (!values)
+                return true;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*
+  Like find(), for the \a entries of \a block. A range spanning several
+  blocks is only taken in the block where its intersection with \a range
+  starts, so that it is found once.
+ */
+bool CellRangeIndex::findInBlock(int block, const QVector<Entry> &entries,
+                                 const CellRange &range, QList<int> *values) const
+{
+    bool found = false;
+    foreach (const Entry &entry, entries) {
+        if (rangesIntersect(entry.range, range)
+            && (qMax(entry.range.firstRow(), range.firstRow()) >> blockShift) == block) {
+            if (!values)
+                return true;
+            values->append(entry.value);
+            found = true;
+        }
+    }
+    return found;
+}
+
+QT_END_NAMESPACE_XLSX
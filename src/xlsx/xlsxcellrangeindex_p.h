@@ -0,0 +1,89 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCELLRANGEINDEX_P_H
+#define XLSXCELLRANGEINDEX_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxcellrange.h"
+
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  Finds the ranges which contain a cell, or intersect another range,
+  without scanning all of them. Each range is stored with a value, such
+  as its position in the list which owns it.
+ */
+class XLSX_AUTOTEST_EXPORT CellRangeIndex
+{
+public:
+    CellRangeIndex();
+
+    bool isEmpty() const { return m_size == 0; }
+    int size() const { return m_size; }
+    void insert(const CellRange &range, int value);
+    bool remove(const CellRange &range, int value);
+    void clear();
+
+    QList<int> valuesAt(int row, int column) const;
+    QList<int> intersecting(const CellRange &range) const;
+    bool intersects(const CellRange &range) const;
+
+private:
+    struct Entry
+    {
+        CellRange range;
+        int value;
+    };
+
+    static int entryIndex(const QVector<Entry> &entries, const CellRange &range, int value);
+    bool find(const CellRange &range, QList<int> *values) const;
+    bool findInBlock(int block, const QVector<Entry> &entries, const CellRange &range,
+                     QList<int> *values) const;
+
+    // Ranges are bucketed by blocks of rows, except those spanning too
+    // many blocks, such as whole columns, which are kept apart.
+    QHash<int, QVector<Entry>> m_blocks;
+    QVector<Entry> m_tallRanges;
+    int m_size;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCELLRANGEINDEX_P_H
@@ -0,0 +1,185 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcellrangeset_p.h"
+
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+typedef QPair<int, int> ColumnSpan;
+
+bool firstRowLessThan(const CellRange &left, const CellRange &right)
+{
+    return left.firstRow() < right.firstRow();
+}
+
+bool topLeftLessThan(const CellRange &left, const CellRange &right)
+{
+    if (left.firstRow() != right.firstRow())
+        return left.firstRow() < right.firstRow();
+    return left.firstColumn() < right.firstColumn();
+}
+
+} // namespace
+
+CellRangeSet::CellRangeSet(const QList<CellRange> &ranges)
+{
+    foreach (const CellRange &range, ranges)
+        append(m_ranges, range);
+}
+
+/*
+  Append \a range to \a ranges, extending the last range instead when
+  \a range continues it downwards or to the right.
+ */
+void CellRangeSet::append(QList<CellRange> &ranges, const CellRange &range)
+{
+    if (!ranges.isEmpty() && range.isValid()) {
+        CellRange &last = ranges.last();
+        if (last.firstColumn() == range.firstColumn() && last.lastColumn() == range.lastColumn()
+            && last.lastRow() + 1 == range.firstRow()) {
+            last.setLastRow(range.lastRow());
+            return;
+        }
+        if (last.firstRow() == range.firstRow() && last.lastRow() == range.lastRow()
+            && last.lastColumn() + 1 == range.firstColumn()) {
+            last.setLastColumn(range.lastColumn());
+            return;
+        }
+    }
+    ranges.append(range);
+}
+
+/*
+  Returns ranges which cover exactly the cells of the set, merging the
+  adjacent and overlapping ones. The rows are swept from band to band,
+  a band being rows covered by the same ranges, and the column spans of
+  consecutive bands which are the same are merged into one range.
+
+  The list of the set is returned as it is if it is already smaller, or
+  if the top left cell of its first range would not start a range.
+ */
+QList<CellRange> CellRangeSet::coalesced() const
+{
+    if (m_ranges.size() < 2)
+        return m_ranges;
+
+    QVector<CellRange> sorted;
+    QVector<int> boundaries;
+    foreach (const CellRange &range, m_ranges) {
+        if (!range.isValid())
+            continue;
+        sorted.append(range);
+        boundaries.append(range.firstRow());
+        boundaries.append(range.lastRow() + 1);
+    }
+    if (sorted.isEmpty())
+        return m_ranges;
+    std::sort(sorted.begin(), sorted.end(), firstRowLessThan);
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    QList<CellRange> result;
+    QVector<CellRange> active;
+    QVector<ColumnSpan> openSpans; // the spans of the previous band
+    QVector<int> openRows; // the first rows of their ranges
+    int next = 0;
+    for (int b = 0; b < boundaries.size(); ++b) {
+        const int top = boundaries[b];
+
+        for (int i = active.size() - 1; i >= 0; --i) {
+            if (active[i].lastRow() < top)
+                active.remove(i);
+        }
+        while (next < sorted.size() && sorted[next].firstRow() == top)
+            active.append(sorted[next++]);
+
+        // The column spans of the band, merged
+        QVector<ColumnSpan> spans;
+        foreach (const CellRange &range, active)
+            spans.append(ColumnSpan(range.firstColumn(), range.lastColumn()));
+        std::sort(spans.begin(), spans.end());
+        int merged = 0;
+        for (int i = 1; i < spans.size(); ++i) {
+            if (spans[i].first <= spans[merged].second + 1)
+                spans[merged].second = qMax(spans[merged].second, spans[i].second);
+            else
+                spans[++merged] = spans[i];
+        }
+        if (!spans.isEmpty())
+            spans.resize(merged + 1);
+
+        // Continue the ranges of the previous band which have the same
+        // spans, and close the others
+        QVector<int> rows(spans.size(), top);
+        int j = 0;
+        for (int i = 0; i < openSpans.size(); ++i) {
+            while (j < spans.size() && spans[j] < openSpans[i])
+                ++j;
+            if (j < spans.size() && spans[j] == openSpans[i]) {
+                rows[j] = openRows[i];
+            } else {
+                result.append(CellRange(openRows[i], openSpans[i].first, top - 1,
+                                        openSpans[i].second));
+            }
+        }
+        openSpans = spans;
+        openRows = rows;
+    }
+
+    std::sort(result.begin(), result.end(), topLeftLessThan);
+    if (result.size() >= m_ranges.size())
+        return m_ranges;
+
+    const int rootRow = m_ranges.first().firstRow();
+    const int rootColumn = m_ranges.first().firstColumn();
+    for (int i = 0; i < result.size(); ++i) {
+        if (result[i].firstRow() == rootRow && result[i].firstColumn() == rootColumn) {
+            result.move(i, 0);
+            return result;
+        }
+    }
+    return m_ranges;
+}
+
+/*
+  Returns the coalesced ranges of the set separated by spaces, as they
+  are written to sqref attributes.
+ */
+QString CellRangeSet::toString() const
+{
+    QStringList texts;
+    foreach (const CellRange &range, coalesced())
+        texts.append(range.toString());
+    return texts.join(QLatin1Char(' '));
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,78 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCELLRANGESET_P_H
+#define XLSXCELLRANGESET_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxcellrange.h"
+
+#include <QList>
+#include <QString>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  A set of cells, held as a list of ranges, such as the sqref of a data
+  validation or a conditional formatting. Ranges which continue the last
+  one are merged into it as they are added, which is enough for lists
+  built cell by cell, and coalesced() merges the adjacent and overlapping
+  ranges of the whole list.
+
+  The first range keeps its top left cell, from which the relative
+  references of the formulas of validations and formattings are taken.
+ */
+class XLSX_AUTOTEST_EXPORT CellRangeSet
+{
+public:
+    CellRangeSet() {}
+    explicit CellRangeSet(const QList<CellRange> &ranges);
+
+    bool isEmpty() const { return m_ranges.isEmpty(); }
+    void add(const CellRange &range) { append(m_ranges, range); }
+    QList<CellRange> ranges() const { return m_ranges; }
+
+    QList<CellRange> coalesced() const;
+    QString toString() const;
+
+    static void append(QList<CellRange> &ranges, const CellRange &range);
+
+private:
+    QList<CellRange> m_ranges;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCELLRANGESET_P_H
@@ -23,61 +23,11 @@
 **
 ****************************************************************************/
 #include "xlsxcellreference.h"
-#include <QStringList>
-#include <QMap>
-#include <QRegularExpression>
+#include "xlsxutility_p.h"
+#include <QString>
 
 QT_BEGIN_NAMESPACE_XLSX
 
-namespace {
-
-int intPow(int x, int p)
-{
-    if (p == 0)
-        return 1;
-    if (p == 1)
-        return x;
-
-    int tmp = intPow(x, p / 2);
-    if (p % 2 == 0)
-        return tmp * tmp;
-    else
-        return x * tmp * tmp;
-}
-
-QString col_to_name(int col_num)
-{
-    static QMap<int, QString> col_cache;
-
-    if (!col_cache.contains(col_num)) {
-        QString col_str;
-        int remainder;
-        while (col_num) {
-            remainder = col_num % 26;
-            if (remainder == 0)
-                remainder = 26;
-            col_str.prepend(QChar('A' + remainder - 1));
-            col_num = (col_num - 1) / 26;
-        }
-        col_cache.insert(col_num, col_str);
-    }
-
-    return col_cache[col_num];
-}
-
-int col_from_name(const QString &col_str)
-{
-    int col = 0;
-    int expn = 0;
-    for (int i = col_str.size() - 1; i > -1; --i) {
-        col += (col_str[i].unicode() - 'A' + 1) * intPow(26, expn);
-        expn++;
-    }
-
-    return col;
-}
-} // namespace
-
 /*!
     \class CellReference
     \brief For one single cell such as "A1"
@@ -118,20 +68,17 @@ CellReference::CellReference(const QString &cell)
     Constructs the Reference form the given \a cell string.
 */
 CellReference::CellReference(const char *cell)
+    : _row(-1)
+    , _column(-1)
 {
-    init(QString::fromLatin1(cell));
+    parseCellReference(cell, -1, &_row, &_column);
 }
 
 void CellReference::init(const QString &cell_str)
 {
-    static QRegularExpression re(QStringLiteral("^\\$?([A-Z]{1,3})\\$?(\\d+)$"));
-    QRegularExpressionMatch match = re.match(cell_str);
-    if (match.hasMatch()) {
-        const QString col_str = match.captured(1);
-        const QString row_str = match.captured(2);
-        _row = row_str.toInt();
-        _column = col_from_name(col_str);
-    }
+    _row = -1;
+    _column = -1;
+    parseCellReference(QStringRef(&cell_str), &_row, &_column);
 }
 
 /*!
@@ -160,14 +107,9 @@ QString CellReference::toString(bool row_abs, bool col_abs) const
     if (!isValid())
         return QString();
 
-    QString cell_str;
-    if (col_abs)
-        cell_str.append(QLatin1Char('$'));
-    cell_str.append(col_to_name(_column));
-    if (row_abs)
-        cell_str.append(QLatin1Char('$'));
-    cell_str.append(QString::number(_row));
-    return cell_str;
+    char buffer[XLSX_CELL_REFERENCE_BUFFER_SIZE];
+    const int size = formatCellReference(_row, _column, buffer, row_abs, col_abs);
+    return QString::fromLatin1(buffer, size);
 }
 
 /*!
@@ -0,0 +1,865 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcelltable_p.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The temporary file the blocks of rows of a table are spilled to. Chunks
+  are only appended, so the copies of a table can share the file.
+ */
+class CellSpillFile
+{
+public:
+    QMutex mutex;
+    QTemporaryFile file;
+};
+
+/*
+  Returns the position of \a column in the row, or -1 if the row
+  has no cell at \a column.
+ */
+int CellRow::indexOf(int column) const
+{
+    int i = lowerBound(column);
+    if (i < columns.size() && columns[i] == column)
+        return i;
+    return -1;
+}
+
+/*
+  Returns the position of the first cell whose column is not less than
+  \a column. Cells are normally added from left to right, so the end of
+  the row is checked first.
+ */
+int CellRow::lowerBound(int column) const
+{
+    if (columns.isEmpty() || columns.last() < column)
+        return columns.size();
+    return std::lower_bound(columns.constBegin(), columns.constEnd(), column)
+           - columns.constBegin();
+}
+
+/*
+  \class CellTable
+  \internal
+
+  Compact storage of the cells of one worksheet. Rows are kept in a
+  vector sorted by row number, and each row holds its columns and
+  values in two sorted vectors. The first and the last column of each
+  row are kept along with its number, so the spans of the rows and the
+  columns of the whole table are known without going over the cells.
+
+  To bound the memory of giant sheets, blocks of SpillBlockRows rows can
+  be spilled to a compressed chunk of a temporary file. Their row numbers
+  stay in memory, the rows are read back when they are accessed. A block
+  which is only read is kept with its chunk, and released again by
+  releaseRestoredBlocks() or the next spill(), or by trimRestoredBlocks()
+  once more than the limit of blocks have been read back. A block which
+  is written to loses its chunk. The extra data are never spilled.
+ */
+CellTable::CellTable()
+    : m_firstColumn(-1)
+    , m_lastColumn(-1)
+    , m_columnsValid(true)
+    , m_restoredBlockLimit(0)
+    , m_residentCells(0)
+    , m_spilledCells(0)
+    , m_layoutChanges(0)
+{
+}
+
+/*
+  Returns the position of the first row of the table which is not above \a row.
+ */
+int CellTable::rowLowerBound(int row) const
+{
+    if (m_rowNumbers.isEmpty() || m_rowNumbers.last() < row)
+        return m_rowNumbers.size();
+    return std::lower_bound(m_rowNumbers.constBegin(), m_rowNumbers.constEnd(), row)
+           - m_rowNumbers.constBegin();
+}
+
+/*
+  Returns the first column of the cells of the table, or -1 if it is empty.
+ */
+int CellTable::firstColumn() const
+{
+    if (!m_columnsValid)
+        updateColumns();
+    return m_firstColumn;
+}
+
+/*
+  Returns the last column of the cells of the table, or -1 if it is empty.
+ */
+int CellTable::lastColumn() const
+{
+    if (!m_columnsValid)
+        updateColumns();
+    return m_lastColumn;
+}
+
+/*
+  Find the columns of the table again from the spans of its rows, after
+  cells have been removed.
+ */
+void CellTable::updateColumns() const
+{
+    m_firstColumn = -1;
+    m_lastColumn = -1;
+    for (int i = 0; i < m_rowSpans.size(); ++i) {
+        const ColumnSpan &span = m_rowSpans[i];
+        if (m_firstColumn == -1 || span.first < m_firstColumn)
+            m_firstColumn = span.first;
+        if (span.last > m_lastColumn)
+            m_lastColumn = span.last;
+    }
+    m_columnsValid = true;
+}
+
+/*
+  Returns the position of \a row, which is added as an empty row if the
+  table doesn't have it. A cell must be added to the row then.
+ */
+int CellTable::insertRow(int row)
+{
+    int i = rowLowerBound(row);
+    if (i == m_rowNumbers.size() || m_rowNumbers[i] != row) {
+        const ColumnSpan span = {0, 0};
+        m_rowNumbers.insert(i, row);
+        m_rows.insert(i, CellRow());
+        m_rowSpans.insert(i, span);
+    }
+    return i;
+}
+
+/*
+  Take the span of the row at \a index from its cells, once cells have
+  been added to it.
+ */
+void CellTable::updateRowSpan(int index)
+{
+    const CellRow &cells = m_rows.at(index);
+    ColumnSpan &span = m_rowSpans[index];
+    span.first = cells.firstColumn();
+    span.last = cells.lastColumn();
+    if (m_columnsValid) {
+        if (m_firstColumn == -1 || span.first < m_firstColumn)
+            m_firstColumn = span.first;
+        if (span.last > m_lastColumn)
+            m_lastColumn = span.last;
+    }
+}
+
+/*
+  Returns the position of \a row in the table, or -1 if it doesn't exist.
+ */
+int CellTable::indexOfRow(int row) const
+{
+    int i = rowLowerBound(row);
+    if (i < m_rowNumbers.size() && m_rowNumbers[i] == row)
+        return i;
+    return -1;
+}
+
+const CellRow *CellTable::row(int row) const
+{
+    int i = indexOfRow(row);
+    if (i == -1)
+        return 0;
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), false);
+    return &m_rows.at(i);
+}
+
+const CellData *CellTable::cell(int row, int column) const
+{
+    int i = indexOfRow(row);
+    if (i == -1)
+        return 0;
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), false);
+    const CellRow &cells = m_rows.at(i);
+    int j = cells.indexOf(column);
+    if (j == -1)
+        return 0;
+    return &cells.cells[j];
+}
+
+CellData *CellTable::cell(int row, int column)
+{
+    int i = indexOfRow(row);
+    if (i == -1)
+        return 0;
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), true);
+    markChanged(row, row);
+    CellRow &cells = m_rows[i];
+    int j = cells.indexOf(column);
+    if (j == -1)
+        return 0;
+    return &cells.cells[j];
+}
+
+/*
+  Store \a data at (\a row, \a column), replacing the cell which may
+  exist there. The extra data of the replaced cell is released, unless
+  \a data refers to the same extra data.
+ */
+void CellTable::setCell(int row, int column, const CellData &data)
+{
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), true);
+    markChanged(row, row);
+    const int i = insertRow(row);
+
+    CellRow &cells = m_rows[i];
+    int j = cells.lowerBound(column);
+    if (j < cells.columns.size() && cells.columns[j] == column) {
+        const CellData &old = cells.cells[j];
+        if (!(data.storage == CellData::Extra && old.storage == CellData::Extra
+              && data.index == old.index)) {
+            releaseExtra(old);
+        }
+        cells.cells[j] = data;
+    } else {
+        cells.columns.insert(j, column);
+        cells.cells.insert(j, data);
+        ++m_residentCells;
+        updateRowSpan(i);
+    }
+}
+
+/*
+  Store the \a count cells \a data in \a row, starting at \a firstColumn.
+  When the cells are appended to the row, which is the common case, its
+  storage is grown once for all of them.
+ */
+void CellTable::setCells(int row, int firstColumn, const CellData *data, int count)
+{
+    if (count <= 0)
+        return;
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), true);
+    markChanged(row, row);
+
+    const int i = insertRow(row);
+    CellRow &cells = m_rows[i];
+    if (!cells.isEmpty() && cells.lastColumn() >= firstColumn) {
+        for (int j = 0; j < count; ++j)
+            setCell(row, firstColumn + j, data[j]);
+        return;
+    }
+
+    const int size = cells.size();
+    cells.columns.resize(size + count);
+    cells.cells.resize(size + count);
+    for (int j = 0; j < count; ++j) {
+        cells.columns[size + j] = firstColumn + j;
+        cells.cells[size + j] = data[j];
+    }
+    m_residentCells += count;
+    updateRowSpan(i);
+}
+
+void CellTable::removeRow(int row)
+{
+    int i = indexOfRow(row);
+    if (i == -1)
+        return;
+    if (!m_spilledBlocks.isEmpty())
+        restoreBlock(blockOf(row), true);
+    markChanged(row, row);
+
+    const CellRow &cells = m_rows.at(i);
+    for (int j = 0; j < cells.cells.size(); ++j)
+        releaseExtra(cells.cells[j]);
+    m_residentCells -= cells.size();
+
+    m_rowNumbers.remove(i);
+    m_rows.remove(i);
+    m_rowSpans.remove(i);
+    m_columnsValid = false;
+}
+
+/*
+  Move the rows from \a row on down by \a count rows. Only the row
+  numbers change, the cells stay where they are.
+ */
+void CellTable::insertRows(int row, int count)
+{
+    restoreAllBlocks();
+    ++m_layoutChanges;
+    for (int i = rowLowerBound(row); i < m_rowNumbers.size(); ++i)
+        m_rowNumbers[i] += count;
+}
+
+/*
+  Remove the \a count rows from \a row on, and move the rows below them
+  up. The extra data of the removed cells are released.
+ */
+void CellTable::removeRows(int row, int count)
+{
+    restoreAllBlocks();
+    ++m_layoutChanges;
+    const int first = rowLowerBound(row);
+    const int end = rowLowerBound(row + count);
+    for (int i = first; i < end; ++i) {
+        const CellRow &cells = m_rows.at(i);
+        for (int j = 0; j < cells.cells.size(); ++j)
+            releaseExtra(cells.cells[j]);
+        m_residentCells -= cells.size();
+    }
+    m_rowNumbers.remove(first, end - first);
+    m_rows.remove(first, end - first);
+    m_rowSpans.remove(first, end - first);
+    for (int i = first; i < m_rowNumbers.size(); ++i)
+        m_rowNumbers[i] -= count;
+    if (end > first)
+        m_columnsValid = false;
+}
+
+/*
+  Move the cells from \a column on right by \a count columns, in every row.
+ */
+void CellTable::insertColumns(int column, int count)
+{
+    restoreAllBlocks();
+    ++m_layoutChanges;
+    for (int i = 0; i < m_rows.size(); ++i) {
+        CellRow &cells = m_rows[i];
+        if (cells.isEmpty() || cells.lastColumn() < column)
+            continue;
+        for (int j = cells.lowerBound(column); j < cells.size(); ++j)
+            cells.columns[j] += count;
+        ColumnSpan &span = m_rowSpans[i];
+        if (span.first >= column)
+            span.first += count;
+        span.last += count;
+    }
+    if (m_columnsValid && m_lastColumn >= column) {
+        if (m_firstColumn >= column)
+            m_firstColumn += count;
+        m_lastColumn += count;
+    }
+}
+
+/*
+  Remove the cells of the \a count columns from \a column on, and move the
+  cells on their right left, in every row. The rows left empty are removed.
+ */
+void CellTable::removeColumns(int column, int count)
+{
+    restoreAllBlocks();
+    ++m_layoutChanges;
+    int kept = 0;
+    for (int i = 0; i < m_rows.size(); ++i) {
+        CellRow &cells = m_rows[i];
+        if (!cells.isEmpty() && cells.lastColumn() >= column) {
+            const int first = cells.lowerBound(column);
+            const int end = cells.lowerBound(column + count);
+            for (int j = first; j < end; ++j)
+                releaseExtra(cells.cells[j]);
+            m_residentCells -= end - first;
+            cells.columns.remove(first, end - first);
+            cells.cells.remove(first, end - first);
+            for (int j = first; j < cells.size(); ++j)
+                cells.columns[j] -= count;
+        }
+        if (cells.isEmpty())
+            continue;
+        if (kept != i) {
+            m_rowNumbers[kept] = m_rowNumbers[i];
+            m_rows[kept].columns.swap(cells.columns);
+            m_rows[kept].cells.swap(cells.cells);
+        }
+        m_rowSpans[kept].first = m_rows[kept].firstColumn();
+        m_rowSpans[kept].last = m_rows[kept].lastColumn();
+        ++kept;
+    }
+    m_rowNumbers.resize(kept);
+    m_rows.resize(kept);
+    m_rowSpans.resize(kept);
+    m_columnsValid = false;
+}
+
+/*
+  Remove the cells of the rows [\a firstRow, \a lastRow] which are in the
+  columns [\a firstColumn, \a lastColumn], and release their extra data.
+  When \a keepFormats is true, the cells which have a format are left
+  blank instead. The rows left empty are removed.
+ */
+void CellTable::removeCells(int firstRow, int firstColumn, int lastRow, int lastColumn,
+                            bool keepFormats)
+{
+    const int first = rowLowerBound(firstRow);
+    const int end = rowLowerBound(lastRow + 1);
+    if (!m_spilledBlocks.isEmpty()) {
+        for (int i = first; i < end; ++i)
+            restoreBlock(blockOf(m_rowNumbers[i]), true);
+    }
+    if (first < end)
+        markChanged(m_rowNumbers[first], m_rowNumbers[end - 1]);
+
+    int keptRows = first;
+    for (int i = first; i < end; ++i) {
+        CellRow &cells = m_rows[i];
+        const int from = cells.lowerBound(firstColumn);
+        const int to = cells.lowerBound(lastColumn + 1);
+        int kept = from;
+        for (int j = from; j < to; ++j) {
+            const CellData &cell = cells.cells[j];
+            releaseExtra(cell);
+            if (keepFormats && cell.xfIndex != -1) {
+                cells.columns[kept] = cells.columns[j];
+                cells.cells[kept] = CellData(CellData::Blank, Cell::NumberType, cell.xfIndex);
+                ++kept;
+            }
+        }
+        m_residentCells -= to - kept;
+        cells.columns.remove(kept, to - kept);
+        cells.cells.remove(kept, to - kept);
+
+        if (cells.isEmpty())
+            continue;
+        if (keptRows != i) {
+            m_rowNumbers[keptRows] = m_rowNumbers[i];
+            m_rows[keptRows].columns.swap(cells.columns);
+            m_rows[keptRows].cells.swap(cells.cells);
+        }
+        m_rowSpans[keptRows].first = m_rows[keptRows].firstColumn();
+        m_rowSpans[keptRows].last = m_rows[keptRows].lastColumn();
+        ++keptRows;
+    }
+    m_rowNumbers.remove(keptRows, end - keptRows);
+    m_rows.remove(keptRows, end - keptRows);
+    m_rowSpans.remove(keptRows, end - keptRows);
+    if (first < end)
+        m_columnsValid = false;
+}
+
+/*
+  Reorder the cells of the rows [\a firstRow, \a lastRow] which are in the
+  columns [\a firstColumn, \a lastColumn]: row firstRow + i receives the
+  cells of row firstRow + \a order[i]. The cells are moved with their
+  extra data, only their rows change. The rows left empty are removed.
+ */
+void CellTable::permuteRows(int firstRow, int firstColumn, int lastRow, int lastColumn,
+                            const QVector<int> &order)
+{
+    const int count = lastRow - firstRow + 1;
+    Q_ASSERT(order.size() == count);
+    const int first = rowLowerBound(firstRow);
+    const int end = rowLowerBound(lastRow + 1);
+    if (!m_spilledBlocks.isEmpty()) {
+        for (int i = first; i < end; ++i)
+            restoreBlock(blockOf(m_rowNumbers[i]), true);
+    }
+    // The cells may move to rows which had none, up to lastRow
+    if (first < end)
+        markChanged(firstRow, lastRow);
+
+    // Take the rows out, and the cells of the columns out of the rows
+    QVector<CellRow> rests(count);
+    QVector<CellRow> moved(count);
+    for (int i = first; i < end; ++i) {
+        const int offset = m_rowNumbers[i] - firstRow;
+        CellRow &rest = rests[offset];
+        rest.columns.swap(m_rows[i].columns);
+        rest.cells.swap(m_rows[i].cells);
+        const int from = rest.lowerBound(firstColumn);
+        const int to = rest.lowerBound(lastColumn + 1);
+        moved[offset].columns = rest.columns.mid(from, to - from);
+        moved[offset].cells = rest.cells.mid(from, to - from);
+        rest.columns.remove(from, to - from);
+        rest.cells.remove(from, to - from);
+    }
+
+    // The cells only move between rows, the columns of the table stay the same
+    QVector<int> rowNumbers;
+    QVector<CellRow> rows;
+    QVector<ColumnSpan> rowSpans;
+    rowNumbers.reserve(m_rowNumbers.size());
+    rows.reserve(m_rows.size());
+    rowSpans.reserve(m_rowSpans.size());
+    for (int i = 0; i < first; ++i) {
+        rowNumbers.append(m_rowNumbers[i]);
+        rowSpans.append(m_rowSpans[i]);
+        rows.append(CellRow());
+        rows.last().columns.swap(m_rows[i].columns);
+        rows.last().cells.swap(m_rows[i].cells);
+    }
+    for (int offset = 0; offset < count; ++offset) {
+        CellRow &rest = rests[offset];
+        const CellRow &cells = moved[order[offset]];
+        if (rest.isEmpty() && cells.isEmpty())
+            continue;
+        rowNumbers.append(firstRow + offset);
+        rows.append(CellRow());
+        CellRow &row = rows.last();
+        if (rest.isEmpty()) {
+            row.columns = cells.columns;
+            row.cells = cells.cells;
+        } else {
+            const int at = rest.lowerBound(firstColumn);
+            row.columns = rest.columns.mid(0, at) + cells.columns + rest.columns.mid(at);
+            row.cells = rest.cells.mid(0, at) + cells.cells + rest.cells.mid(at);
+        }
+        const ColumnSpan span = {row.firstColumn(), row.lastColumn()};
+        rowSpans.append(span);
+    }
+    for (int i = end; i < m_rows.size(); ++i) {
+        rowNumbers.append(m_rowNumbers[i]);
+        rowSpans.append(m_rowSpans[i]);
+        rows.append(CellRow());
+        rows.last().columns.swap(m_rows[i].columns);
+        rows.last().cells.swap(m_rows[i].cells);
+    }
+    m_rowNumbers.swap(rowNumbers);
+    m_rows.swap(rows);
+    m_rowSpans.swap(rowSpans);
+}
+
+void CellTable::clear()
+{
+    ++m_layoutChanges;
+    m_rowNumbers.clear();
+    m_rows.clear();
+    m_rowSpans.clear();
+    m_firstColumn = -1;
+    m_lastColumn = -1;
+    m_columnsValid = true;
+    m_extras.clear();
+    m_freeExtras.clear();
+    m_spillFile.clear();
+    m_spilledBlocks.clear();
+    m_restoredBlocks.clear();
+    m_residentCells = 0;
+    m_spilledCells = 0;
+}
+
+/*
+  Returns a number which changes whenever the cells of the block of rows
+  \a block, the blocks being SpillBlockRows rows numbered from 0, may have
+  changed. Handing a cell or a row out for writing counts as a change.
+  The extra data is only changed in place for the cells with a formula,
+  which aren't followed. The blocks all change when rows or columns are
+  inserted or removed.
+ */
+quint64 CellTable::blockRevision(int block) const
+{
+    const quint32 changes = block < m_blockChanges.size() ? m_blockChanges[block] : 0;
+    return (quint64(m_layoutChanges) << 32) | changes;
+}
+
+/*
+  Count a change of the blocks of the rows [\a firstRow, \a lastRow].
+ */
+void CellTable::markChanged(int firstRow, int lastRow)
+{
+    const int last = blockOf(lastRow);
+    if (last >= m_blockChanges.size())
+        m_blockChanges.resize(last + 1);
+    for (int block = blockOf(firstRow); block <= last; ++block)
+        ++m_blockChanges[block];
+}
+
+/*
+  Add \a extra to the table of extra data, and return its index.
+  Released slots are reused.
+ */
+int CellTable::addExtra(const CellExtraData &extra)
+{
+    if (!m_freeExtras.isEmpty()) {
+        int index = m_freeExtras.takeLast();
+        m_extras[index] = extra;
+        return index;
+    }
+    m_extras.append(extra);
+    return m_extras.size() - 1;
+}
+
+/*
+  Returns the number of cells of all the rows, spilled or not.
+ */
+qint64 CellTable::cellCount() const
+{
+    return m_residentCells + m_spilledCells;
+}
+
+/*
+  Returns the bytes allocated for the rows, cells and extra data. The
+  strings, formulas and rich strings of the extras are counted by their
+  handles only.
+ */
+qint64 CellTable::memoryUsage() const
+{
+    qint64 size = qint64(m_rowNumbers.capacity()) * sizeof(int)
+        + qint64(m_rows.capacity()) * sizeof(CellRow)
+        + qint64(m_rowSpans.capacity()) * sizeof(ColumnSpan)
+        + qint64(m_extras.capacity()) * sizeof(CellExtraData)
+        + qint64(m_freeExtras.capacity()) * sizeof(int);
+    foreach (const CellRow &row, m_rows) {
+        size += qint64(row.columns.capacity()) * sizeof(int)
+            + qint64(row.cells.capacity()) * sizeof(CellData);
+    }
+    foreach (const CellExtraData &extra, m_extras) {
+        if (extra.value.type() == QVariant::String)
+            size += qint64(extra.value.toString().capacity()) * sizeof(QChar);
+        size += qint64(extra.inlineRuns.capacity()) * sizeof(InlineRun);
+    }
+    return size;
+}
+
+/*
+  Returns about how many bytes the rows and cells in memory and the extra
+  data take, without going over them as memoryUsage() does.
+ */
+qint64 CellTable::memoryEstimate() const
+{
+    return qint64(m_rowNumbers.size()) * (sizeof(int) + sizeof(CellRow) + sizeof(ColumnSpan))
+        + m_residentCells * (sizeof(int) + sizeof(CellData))
+        + qint64(m_extras.size()) * sizeof(CellExtraData);
+}
+
+/*
+  Release the capacity left by the removed rows and cells, and the slots
+  of the released extra data. When no row is spilled, the extra data of
+  the cells is moved down over the released slots; otherwise only the
+  slots at the end of the table are dropped. Only the cells of the rows
+  in memory are changed, this isn't counted as a change of their blocks.
+ */
+void CellTable::squeeze()
+{
+    if (!m_freeExtras.isEmpty() && m_spilledBlocks.isEmpty()) {
+        QVector<int> extraMap(m_extras.size(), 0);
+        foreach (int index, m_freeExtras)
+            extraMap[index] = -1;
+        int kept = 0;
+        for (int i = 0; i < m_extras.size(); ++i) {
+            if (extraMap[i] == -1)
+                continue;
+            extraMap[i] = kept;
+            if (kept != i)
+                m_extras[kept] = m_extras[i];
+            ++kept;
+        }
+        m_extras.resize(kept);
+        m_freeExtras.clear();
+        for (int i = 0; i < m_rows.size(); ++i) {
+            CellRow &cells = m_rows[i];
+            for (int j = 0; j < cells.size(); ++j) {
+                CellData &cell = cells.cells[j];
+                if (cell.storage == CellData::Extra)
+                    cell.index = extraMap[cell.index];
+            }
+        }
+    } else if (!m_freeExtras.isEmpty()) {
+        std::sort(m_freeExtras.begin(), m_freeExtras.end());
+        while (!m_freeExtras.isEmpty() && m_freeExtras.last() == m_extras.size() - 1) {
+            m_freeExtras.removeLast();
+            m_extras.removeLast();
+        }
+    }
+
+    m_rowNumbers.squeeze();
+    m_rowSpans.squeeze();
+    m_rows.squeeze();
+    for (int i = 0; i < m_rows.size(); ++i) {
+        m_rows[i].columns.squeeze();
+        m_rows[i].cells.squeeze();
+    }
+    m_extras.squeeze();
+    m_freeExtras.squeeze();
+}
+
+/*
+  Spill the blocks of rows which are entirely above the block of
+  \a beforeRow to the spill file, and release their memory. The blocks
+  which are already spilled, and have only been read since, are simply
+  released. When the file can't be written, the rows stay in memory.
+ */
+void CellTable::spill(int beforeRow)
+{
+    const int lastBlock = blockOf(beforeRow);
+    int i = 0;
+    while (i < m_rowNumbers.size() && blockOf(m_rowNumbers[i]) < lastBlock) {
+        const int block = blockOf(m_rowNumbers[i]);
+        const int end = rowLowerBound((block + 1) * SpillBlockRows + 1);
+
+        QMap<int, SpilledBlock>::iterator it = m_spilledBlocks.find(block);
+        if (it != m_spilledBlocks.end()) {
+            if (it->resident)
+                dropBlock(block, *it);
+            i = end;
+            continue;
+        }
+
+        // Each row is its number, its size, and its columns and cells as
+        // they are in memory
+        QByteArray data;
+        qint64 cellCount = 0;
+        for (int j = i; j < end; ++j) {
+            const CellRow &cells = m_rows.at(j);
+            const int header[2] = {m_rowNumbers[j], cells.size()};
+            data.append(reinterpret_cast<const char *>(header), sizeof(header));
+            data.append(reinterpret_cast<const char *>(cells.columns.constData()),
+                        cells.size() * int(sizeof(int)));
+            data.append(reinterpret_cast<const char *>(cells.cells.constData()),
+                        cells.size() * int(sizeof(CellData)));
+            cellCount += cells.size();
+        }
+        const QByteArray chunk = qCompress(data, 1);
+
+        if (!m_spillFile)
+            m_spillFile = QSharedPointer<CellSpillFile>(new CellSpillFile);
+        SpilledBlock spilled = {0, chunk.size(), cellCount, true};
+        {
+            QMutexLocker locker(&m_spillFile->mutex);
+            QFile &file = m_spillFile->file;
+            if (!file.isOpen() && !file.open())
+                return;
+            spilled.offset = file.size();
+            if (!file.seek(spilled.offset) || file.write(chunk) != chunk.size())
+                return;
+        }
+        dropBlock(block, *m_spilledBlocks.insert(block, spilled));
+        i = end;
+    }
+}
+
+/*
+  Release the memory of the spilled blocks which have been read back and
+  not changed since, but the \a keep most recently used ones.
+  References to their rows become invalid, so this is only done between
+  rows by the loops going over the whole table, or when a cell is looked
+  up by the API.
+ */
+void CellTable::dropRestoredBlocks(int keep) const
+{
+    while (m_restoredBlocks.size() > keep) {
+        const int block = m_restoredBlocks.first();
+        dropBlock(block, m_spilledBlocks[block]);
+    }
+}
+
+/*
+  Read \a block back from the spill file if it is spilled. When \a write
+  is true, the rows are about to be changed and the chunk is forgotten.
+ */
+void CellTable::restoreBlock(int block, bool write) const
+{
+    QMap<int, SpilledBlock>::iterator it = m_spilledBlocks.find(block);
+    if (it == m_spilledBlocks.end())
+        return;
+
+    if (it->resident) {
+        if (m_restoredBlockLimit && !write && m_restoredBlocks.last() != block) {
+            m_restoredBlocks.removeOne(block);
+            m_restoredBlocks.append(block);
+        }
+    } else {
+        QByteArray chunk;
+        {
+            QMutexLocker locker(&m_spillFile->mutex);
+            QFile &file = m_spillFile->file;
+            if (file.seek(it->offset))
+                chunk = file.read(it->size);
+        }
+        const QByteArray data = qUncompress(chunk);
+        if (data.isEmpty() && it->cellCount)
+            qWarning("CellTable: rows %d to %d can not be read back from the spill file",
+                     block * SpillBlockRows + 1, (block + 1) * SpillBlockRows);
+
+        const char *ptr = data.constData();
+        const char *dataEnd = ptr + data.size();
+        int i = rowLowerBound(block * SpillBlockRows + 1);
+        while (ptr + 2 * sizeof(int) <= dataEnd && i < m_rowNumbers.size()) {
+            int header[2];
+            memcpy(header, ptr, sizeof(header));
+            ptr += sizeof(header);
+            Q_ASSERT(header[0] == m_rowNumbers[i]);
+            CellRow &cells = m_rows[i++];
+            cells.columns.resize(header[1]);
+            cells.cells.resize(header[1]);
+            memcpy(cells.columns.data(), ptr, header[1] * sizeof(int));
+            ptr += header[1] * sizeof(int);
+            memcpy(cells.cells.data(), ptr, header[1] * sizeof(CellData));
+            ptr += header[1] * sizeof(CellData);
+        }
+        it->resident = true;
+        m_restoredBlocks.append(block);
+        m_residentCells += it->cellCount;
+        m_spilledCells -= it->cellCount;
+    }
+
+    if (write) {
+        m_restoredBlocks.removeOne(block);
+        m_spilledBlocks.erase(it);
+    }
+}
+
+/*
+  Read all the spilled blocks back, for the changes which move rows from
+  one block to another. The spill file is left to the copies of the table.
+ */
+void CellTable::restoreAllBlocks()
+{
+    const QList<int> blocks = m_spilledBlocks.keys();
+    foreach (int block, blocks)
+        restoreBlock(block, true);
+}
+
+/*
+  Release the rows of \a block, which are in \a spilled.
+ */
+void CellTable::dropBlock(int block, SpilledBlock &spilled) const
+{
+    const int end = rowLowerBound((block + 1) * SpillBlockRows + 1);
+    for (int i = rowLowerBound(block * SpillBlockRows + 1); i < end; ++i)
+        m_rows[i] = CellRow();
+    spilled.resident = false;
+    m_restoredBlocks.removeOne(block);
+    m_residentCells -= spilled.cellCount;
+    m_spilledCells += spilled.cellCount;
+}
+
+void CellTable::releaseExtra(const CellData &data)
+{
+    if (data.storage != CellData::Extra)
+        return;
+    m_extras[data.index] = CellExtraData();
+    m_freeExtras.append(data.index);
+}
+
+QT_END_NAMESPACE_XLSX
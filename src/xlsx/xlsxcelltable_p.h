@@ -0,0 +1,303 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCELLTABLE_P_H
+#define XLSXCELLTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxcell.h"
+#include "xlsxcellformula.h"
+#include "xlsxrichstring.h"
+
+#include <QList>
+#include <QMap>
+#include <QSharedPointer>
+#include <QVariant>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The stored value of one cell. The number, boolean or string index is
+  held inline; anything which can not be expressed that way (formulas,
+  inline strings, error texts, ...) lives in the CellExtraData table of
+  the owning CellTable, and index refers to it.
+ */
+class CellData
+{
+public:
+    enum Storage {
+        Blank, // No value
+        Number, // number
+        Boolean, // boolean
+        SharedString, // index of the shared string table
+        Extra // index of the extra data table
+    };
+
+    CellData(Storage s = Blank, Cell::CellType type = Cell::NumberType, int xf = -1)
+        : number(0)
+        , xfIndex(xf)
+        , cellType(static_cast<quint8>(type))
+        , storage(static_cast<quint8>(s))
+    {
+    }
+
+    static CellData fromNumber(double value, int xfIndex)
+    {
+        CellData data(Number, Cell::NumberType, xfIndex);
+        data.number = value;
+        return data;
+    }
+    static CellData fromBool(bool value, int xfIndex)
+    {
+        CellData data(Boolean, Cell::BooleanType, xfIndex);
+        data.boolean = value;
+        return data;
+    }
+    static CellData fromSharedString(int sstIndex, int xfIndex)
+    {
+        CellData data(SharedString, Cell::SharedStringType, xfIndex);
+        data.index = sstIndex;
+        return data;
+    }
+    static CellData fromExtra(int extraIndex, Cell::CellType type, int xfIndex)
+    {
+        CellData data(Extra, type, xfIndex);
+        data.index = extraIndex;
+        return data;
+    }
+
+    Cell::CellType type() const { return static_cast<Cell::CellType>(cellType); }
+
+    union {
+        double number;
+        bool boolean;
+        int index;
+    };
+    qint32 xfIndex; // -1 when no format is used
+    quint8 cellType; // Cell::CellType
+    quint8 storage; // CellData::Storage
+};
+
+/*
+  A run of the rich text of an inline string: its length in the text
+  of the cell, and the font it is written with, an index into the inline
+  fonts of the sheet, or -1 for the font of the cell.
+ */
+struct InlineRun
+{
+    int length;
+    int fontId;
+};
+
+class CellExtraData
+{
+public:
+    CellExtraData()
+        : sharedStringIndex(-1)
+    {
+    }
+
+    QVariant value;
+    CellFormula formula;
+    // The runs of a rich inline string, whose whole text is the value
+    QVector<InlineRun> inlineRuns;
+    int sharedStringIndex; // index of the value in the shared strings, or -1
+};
+
+/*
+  Cells of one row, sorted by column.
+ */
+class XLSX_AUTOTEST_EXPORT CellRow
+{
+public:
+    int size() const { return columns.size(); }
+    bool isEmpty() const { return columns.isEmpty(); }
+    int firstColumn() const { return columns.first(); }
+    int lastColumn() const { return columns.last(); }
+    int indexOf(int column) const;
+    int lowerBound(int column) const;
+
+    QVector<int> columns;
+    QVector<CellData> cells;
+};
+
+/*
+  The first and the last column of the cells of a row.
+ */
+struct ColumnSpan
+{
+    int first;
+    int last;
+};
+
+class CellSpillFile;
+
+class XLSX_AUTOTEST_EXPORT CellTable
+{
+public:
+    // Rows are spilled to disk by blocks of this many rows
+    enum { SpillBlockRows = 1024 };
+
+    CellTable();
+
+    bool isEmpty() const { return m_rowNumbers.isEmpty(); }
+    int size() const { return m_rowNumbers.size(); }
+    qint64 cellCount() const;
+    int firstRow() const { return m_rowNumbers.first(); }
+    int lastRow() const { return m_rowNumbers.last(); }
+
+    int rowNumberAt(int index) const { return m_rowNumbers[index]; }
+    // The columns of the row at index, known without reading a spilled row back
+    const ColumnSpan &rowSpanAt(int index) const { return m_rowSpans[index]; }
+    int firstColumn() const;
+    int lastColumn() const;
+    const CellRow &rowAt(int index) const
+    {
+        if (!m_spilledBlocks.isEmpty())
+            restoreBlock(blockOf(m_rowNumbers[index]), false);
+        return m_rows.at(index);
+    }
+    CellRow &rowAt(int index)
+    {
+        if (!m_spilledBlocks.isEmpty())
+            restoreBlock(blockOf(m_rowNumbers[index]), true);
+        markChanged(m_rowNumbers[index], m_rowNumbers[index]);
+        return m_rows[index];
+    }
+    int indexOfRow(int row) const;
+    bool contains(int row) const { return indexOfRow(row) != -1; }
+    const CellRow *row(int row) const;
+    int rowLowerBound(int row) const;
+
+    const CellData *cell(int row, int column) const;
+    CellData *cell(int row, int column);
+    void setCell(int row, int column, const CellData &data);
+    void setCells(int row, int firstColumn, const CellData *data, int count);
+    void removeRow(int row);
+    void removeCells(int firstRow, int firstColumn, int lastRow, int lastColumn,
+                     bool keepFormats = false);
+    void permuteRows(int firstRow, int firstColumn, int lastRow, int lastColumn,
+                     const QVector<int> &order);
+    void clear();
+
+    void insertRows(int row, int count);
+    void removeRows(int row, int count);
+    void insertColumns(int column, int count);
+    void removeColumns(int column, int count);
+
+    int addExtra(const CellExtraData &extra);
+    const CellExtraData &extra(int index) const { return m_extras[index]; }
+    CellExtraData &extra(int index) { return m_extras[index]; }
+    int extraCount() const { return m_extras.size() - m_freeExtras.size(); }
+
+    qint64 memoryUsage() const;
+    qint64 memoryEstimate() const;
+    void squeeze();
+    void spill(int beforeRow);
+    void releaseRestoredBlocks() const
+    {
+        if (!m_restoredBlocks.isEmpty())
+            dropRestoredBlocks(0);
+    }
+    void trimRestoredBlocks() const
+    {
+        if (m_restoredBlockLimit && m_restoredBlocks.size() > m_restoredBlockLimit)
+            dropRestoredBlocks(m_restoredBlockLimit);
+    }
+    void setRestoredBlockLimit(int limit) { m_restoredBlockLimit = limit; }
+    bool hasSpilledRows() const { return !m_spilledBlocks.isEmpty(); }
+    quint64 blockRevision(int block) const;
+
+private:
+    // A block of rows stored in the spill file, the rows may also be in
+    // memory again when they have only been read since
+    struct SpilledBlock
+    {
+        qint64 offset;
+        int size;
+        qint64 cellCount;
+        bool resident;
+    };
+
+    static int blockOf(int row) { return (row - 1) / SpillBlockRows; }
+    int insertRow(int row);
+    void updateRowSpan(int index);
+    void updateColumns() const;
+    void restoreBlock(int block, bool write) const;
+    void restoreAllBlocks();
+    void dropBlock(int block, SpilledBlock &spilled) const;
+    void dropRestoredBlocks(int keep) const;
+    void releaseExtra(const CellData &data);
+    void markChanged(int firstRow, int lastRow);
+
+    QVector<int> m_rowNumbers;
+    mutable QVector<CellRow> m_rows;
+    QVector<ColumnSpan> m_rowSpans;
+    // The columns of all the cells, found again from the row spans once
+    // cells have been removed
+    mutable int m_firstColumn;
+    mutable int m_lastColumn;
+    mutable bool m_columnsValid;
+    QVector<CellExtraData> m_extras;
+    QVector<int> m_freeExtras;
+
+    // Spilled rows are left empty in m_rows. The file is shared by the
+    // copies of the table, its chunks are never overwritten.
+    QSharedPointer<CellSpillFile> m_spillFile;
+    mutable QMap<int, SpilledBlock> m_spilledBlocks;
+    // The blocks read back and unchanged since, the least recently used
+    // first when there is a limit
+    mutable QList<int> m_restoredBlocks;
+    int m_restoredBlockLimit;
+    mutable qint64 m_residentCells;
+    mutable qint64 m_spilledCells;
+
+    // The journal of the changes: the number of times the cells of each
+    // block of rows have been handed out for writing, and of the changes
+    // which move the cells of all the blocks. Never reset, see blockRevision().
+    QVector<quint32> m_blockChanges;
+    quint32 m_layoutChanges;
+};
+
+QT_END_NAMESPACE_XLSX
+
+Q_DECLARE_TYPEINFO(QXlsx::CellData, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(QXlsx::InlineRun, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(QXlsx::ColumnSpan, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(QXlsx::CellExtraData, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(QXlsx::CellRow, Q_MOVABLE_TYPE);
+
+#endif // XLSXCELLTABLE_P_H
@@ -0,0 +1,155 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcellvalueindex_p.h"
+
+#include <algorithm>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+CellValueIndex::Key CellValueIndex::Key::fromNumber(double number)
+{
+    Key key;
+    key.type = Number;
+    // -0 and 0 are the same value
+    if (number == 0)
+        number = 0;
+    std::memcpy(&key.bits, &number, sizeof(number));
+    return key;
+}
+
+CellValueIndex::Key CellValueIndex::Key::fromBoolean(bool value)
+{
+    Key key;
+    key.type = Boolean;
+    key.bits = value;
+    return key;
+}
+
+CellValueIndex::Key CellValueIndex::Key::fromSharedString(int index)
+{
+    Key key;
+    key.type = SharedString;
+    key.bits = quint64(index);
+    return key;
+}
+
+CellValueIndex::Key CellValueIndex::Key::fromText(const QString &text)
+{
+    Key key;
+    key.type = Text;
+    key.text = text;
+    return key;
+}
+
+uint qHash(const CellValueIndex::Key &key, uint seed)
+{
+    if (key.type == CellValueIndex::Key::Text)
+        return qHash(key.text, seed);
+    return qHash(key.bits, seed) ^ uint(key.type);
+}
+
+CellValueIndex::CellValueIndex()
+{
+}
+
+/*
+  Start the index of \a column, whose cells are then given to insert().
+ */
+void CellValueIndex::addColumn(int column)
+{
+    m_columns[column];
+}
+
+/*
+  Add the cell (\a row, \a column) to the rows of \a key, if the column is
+  indexed. Returns true if the column had no other cell with this value.
+ */
+bool CellValueIndex::insert(const Key &key, int row, int column)
+{
+    if (key.isNull())
+        return false;
+    QHash<int, Column>::iterator it = m_columns.find(column);
+    if (it == m_columns.end())
+        return false;
+
+    QVector<int> &rows = (*it)[key];
+    // The cells are indexed row by row, so this is where they usually go
+    if (rows.isEmpty() || rows.last() < row) {
+        rows.append(row);
+        return rows.size() == 1;
+    }
+    QVector<int>::iterator pos = std::lower_bound(rows.begin(), rows.end(), row);
+    if (*pos != row)
+        rows.insert(pos, row);
+    return false;
+}
+
+/*
+  Remove the cell (\a row, \a column) from the rows of \a key.
+ */
+void CellValueIndex::remove(const Key &key, int row, int column)
+{
+    if (key.isNull())
+        return;
+    QHash<int, Column>::iterator it = m_columns.find(column);
+    if (it == m_columns.end())
+        return;
+    Column::iterator rowsIt = it->find(key);
+    if (rowsIt == it->end())
+        return;
+
+    QVector<int> &rows = *rowsIt;
+    QVector<int>::iterator pos = std::lower_bound(rows.begin(), rows.end(), row);
+    if (pos != rows.end() && *pos == row)
+        rows.erase(pos);
+    if (rows.isEmpty())
+        it->erase(rowsIt);
+}
+
+/*
+  Returns the sorted rows of \a column which hold \a key.
+ */
+const QVector<int> &CellValueIndex::rows(const Key &key, int column) const
+{
+    static const QVector<int> none;
+    QHash<int, Column>::const_iterator it = m_columns.constFind(column);
+    if (it == m_columns.constEnd())
+        return none;
+    Column::const_iterator rowsIt = it->constFind(key);
+    return rowsIt == it->constEnd() ? none : *rowsIt;
+}
+
+/*
+  Record that the shared string \a sharedStringIndex has the \a text too.
+ */
+void CellValueIndex::addAlias(const QString &text, int sharedStringIndex)
+{
+    QVector<int> &indexes = m_aliases[text];
+    if (!indexes.contains(sharedStringIndex))
+        indexes.append(sharedStringIndex);
+}
+
+QT_END_NAMESPACE_XLSX
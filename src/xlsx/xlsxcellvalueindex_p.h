@@ -0,0 +1,108 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCELLVALUEINDEX_P_H
+#define XLSXCELLVALUEINDEX_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  Finds the rows of a column which hold a value, without reading the
+  cells. The columns are indexed one by one, as they are searched, and
+  the rows of each value are kept sorted. Shared strings are found by
+  their index in the shared strings, the other strings by their text.
+ */
+class XLSX_AUTOTEST_EXPORT CellValueIndex
+{
+public:
+    struct Key
+    {
+        enum Type { None, Number, Boolean, SharedString, Text };
+
+        Key()
+            : type(None)
+            , bits(0)
+        {
+        }
+
+        static Key fromNumber(double number);
+        static Key fromBoolean(bool value);
+        static Key fromSharedString(int index);
+        static Key fromText(const QString &text);
+
+        bool isNull() const { return type == None; }
+        bool operator==(const Key &other) const
+        {
+            return type == other.type && bits == other.bits && text == other.text;
+        }
+
+        int type;
+        quint64 bits; // the number, the boolean or the shared string index
+        QString text;
+    };
+
+    CellValueIndex();
+
+    bool hasColumn(int column) const { return m_columns.contains(column); }
+    int columnCount() const { return m_columns.size(); }
+    void addColumn(int column);
+    bool insert(const Key &key, int row, int column);
+    void remove(const Key &key, int row, int column);
+    const QVector<int> &rows(const Key &key, int column) const;
+
+    void addAlias(const QString &text, int sharedStringIndex);
+    QVector<int> aliases(const QString &text) const { return m_aliases.value(text); }
+
+private:
+    // The sorted rows of each value of a column
+    typedef QHash<Key, QVector<int>> Column;
+
+    QHash<int, Column> m_columns;
+    // The shared strings which SharedStrings doesn't give for their text,
+    // rich strings and duplicates
+    QHash<QString, QVector<int>> m_aliases;
+};
+
+uint qHash(const CellValueIndex::Key &key, uint seed = 0);
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCELLVALUEINDEX_P_H
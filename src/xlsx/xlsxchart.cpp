@@ -25,19 +25,131 @@
 
 #include "xlsxchart_p.h"
 #include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxworkbook.h"
 #include "xlsxcellrange.h"
 #include "xlsxutility_p.h"
 
+#include <QBitArray>
+#include <QBuffer>
 #include <QIODevice>
+#include <QVector>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
 #include <QDebug>
 
+#include <cmath>
+
 QT_BEGIN_NAMESPACE_XLSX
 
+namespace {
+
+/*
+  Keep the lowest and the highest of the \a points in each of \a pointCount
+  / 2 buckets of consecutive points, in their order, so that the spikes
+  survive.
+ */
+QVector<int> minMaxPoints(const QVector<int> &points, const QVector<double> &values,
+                          int pointCount)
+{
+    QVector<int> result;
+    const qint64 size = points.size();
+    const int buckets = qMax(1, pointCount / 2);
+    result.reserve(buckets * 2);
+    for (int bucket = 0; bucket < buckets; ++bucket) {
+        const int from = int(size * bucket / buckets);
+        const int to = int(size * (bucket + 1) / buckets);
+        if (from == to)
+            continue;
+        int lowest = from;
+        int highest = from;
+        for (int i = from + 1; i < to; ++i) {
+            if (values[points[i]] < values[points[lowest]])
+                lowest = i;
+            else if (values[points[i]] > values[points[highest]])
+                highest = i;
+        }
+        result.append(points[qMin(lowest, highest)]);
+        if (lowest != highest)
+            result.append(points[qMax(lowest, highest)]);
+    }
+    return result;
+}
+
+inline double pointPosition(const QVector<double> &positions, int point)
+{
+    return positions.isEmpty() ? double(point) : positions[point];
+}
+
+/*
+  Keep \a pointCount of the \a points with the largest triangle three
+  buckets algorithm: the first and last points, and in each bucket the
+  point making the largest triangle with the point kept before it and the
+  average of the next bucket. The points are placed at \a positions, or
+  at their indexes when it's empty.
+ */
+QVector<int> lttbPoints(const QVector<int> &points, const QVector<double> &positions,
+                        const QVector<double> &values, int pointCount)
+{
+    const int size = points.size();
+    if (size <= pointCount || pointCount < 3)
+        return points;
+
+    QVector<int> result;
+    result.reserve(pointCount);
+    result.append(points[0]);
+    const double every = double(size - 2) / (pointCount - 2);
+    int kept = 0;
+    for (int bucket = 0; bucket < pointCount - 2; ++bucket) {
+        const int nextFrom = int((bucket + 1) * every) + 1;
+        const int nextTo = qMin(int((bucket + 2) * every) + 1, size);
+        double averageX = 0;
+        double averageY = 0;
+        for (int i = nextFrom; i < nextTo; ++i) {
+            averageX += pointPosition(positions, points[i]);
+            averageY += values[points[i]];
+        }
+        if (nextTo > nextFrom) {
+            averageX /= nextTo - nextFrom;
+            averageY /= nextTo - nextFrom;
+        } else {
+            averageX = pointPosition(positions, points[size - 1]);
+            averageY = values[points[size - 1]];
+        }
+
+        const double keptX = pointPosition(positions, points[kept]);
+        const double keptY = values[points[kept]];
+        const int from = int(bucket * every) + 1;
+        const int to = int((bucket + 1) * every) + 1;
+        double largestArea = -1;
+        int next = from;
+        for (int i = from; i < to; ++i) {
+            const double x = pointPosition(positions, points[i]);
+            const double area = std::fabs((keptX - averageX) * (values[points[i]] - keptY)
+                                          - (keptX - x) * (averageY - keptY));
+            if (area > largestArea) {
+                largestArea = area;
+                next = i;
+            }
+        }
+        result.append(points[next]);
+        kept = next;
+    }
+    result.append(points[size - 1]);
+    return result;
+}
+
+} // namespace
+
 ChartPrivate::ChartPrivate(Chart *q, Chart::CreateFlag flag)
     : AbstractOOXmlFilePrivate(q, flag)
     , chartType(static_cast<Chart::ChartType>(0))
+    , valueCacheEnabled(false)
+    , downsamplingMode(Chart::NoDownsampling)
+    , downsamplingPointCount(1000)
+    , templateRowOffset(0)
+    , templateColumnOffset(0)
+    , templateReferences(0)
 {
 }
 
@@ -73,6 +185,17 @@ ChartPrivate::~ChartPrivate()
   \omitvalue CT_Bubble
 */
 
+/*!
+  \enum Chart::DownsamplingMode
+
+  \value NoDownsampling The series refer to all the cells of their ranges.
+  \value MinMaxDownsampling The lowest and the highest values of each
+         bucket of consecutive points are kept.
+  \value LttbDownsampling The points which change the shape of the series
+         the most are kept, with the largest triangle three buckets
+         algorithm.
+*/
+
 /*!
  * \internal
  */
@@ -95,6 +218,8 @@ Chart::~Chart()
 void Chart::addSeries(const CellRange &range, AbstractSheet *sheet)
 {
     Q_D(Chart);
+    setDirty();
+    d->clearTemplate();
     if (!range.isValid())
         return;
     if (sheet && sheet->sheetType() != AbstractSheet::ST_WorkSheet)
@@ -159,6 +284,8 @@ void Chart::addSeries(const CellRange &range, AbstractSheet *sheet)
 void Chart::setChartType(ChartType type)
 {
     Q_D(Chart);
+    setDirty();
+    d->clearTemplate();
     d->chartType = type;
 }
 
@@ -172,6 +299,108 @@ void Chart::setChartStyle(int id)
     //! Todo
 }
 
+/*!
+ * Returns true if the values of the series are saved with the chart.
+ *
+ * \sa setValueCacheEnabled()
+ */
+bool Chart::isValueCacheEnabled() const
+{
+    Q_D(const Chart);
+    return d->valueCacheEnabled;
+}
+
+/*!
+ * Saves the current values of the cells referenced by the series in the
+ * chart when \a enable is true, so that the chart can be drawn without
+ * reading the worksheets. Categories holding text are then saved as
+ * strings. The default is false.
+ */
+void Chart::setValueCacheEnabled(bool enable)
+{
+    Q_D(Chart);
+    setDirty();
+    d->clearTemplate();
+    d->valueCacheEnabled = enable;
+}
+
+/*!
+ * Returns how the series holding too many points are reduced.
+ *
+ * \sa setDownsampling()
+ */
+Chart::DownsamplingMode Chart::downsamplingMode() const
+{
+    Q_D(const Chart);
+    return d->downsamplingMode;
+}
+
+/*!
+ * Returns the number of points the series are reduced to.
+ *
+ * \sa setDownsampling()
+ */
+int Chart::downsamplingPointCount() const
+{
+    Q_D(const Chart);
+    return d->downsamplingPointCount;
+}
+
+/*!
+ * Reduces the series of more than \a pointCount points to at most
+ * \a pointCount of them with \a mode when the chart is saved, so that
+ * series of millions of cells can still be drawn. The values of the kept
+ * points are read from the sheets and saved as literals in place of the
+ * references, which means such series no longer follow the changes of
+ * their cells. The cells without a value are dropped. At least 3 points
+ * are kept.
+ *
+ * Copies made by setTemplate() refer to the whole ranges.
+ */
+void Chart::setDownsampling(DownsamplingMode mode, int pointCount)
+{
+    Q_D(Chart);
+    setDirty();
+    d->clearTemplate();
+    d->downsamplingMode = mode;
+    d->downsamplingPointCount = qMax(3, pointCount);
+}
+
+/*!
+ * Makes this chart a copy of \a chart whose series refer to the cells
+ * \a rowOffset rows below and \a columnOffset columns right of the cells
+ * of the series of \a chart. The series and the axes of this chart are
+ * replaced.
+ *
+ * The xml of \a chart is generated once and shared by all its copies,
+ * which only write their own references when they are saved. The copy
+ * is taken from the current state of \a chart. Values are never cached
+ * in the copies, see setValueCacheEnabled(), and calling addSeries() or
+ * setChartType() on a copy starts a new chart.
+ */
+void Chart::setTemplate(const Chart *chart, int rowOffset, int columnOffset)
+{
+    Q_D(Chart);
+    if (!chart || chart == this)
+        return;
+    setDirty();
+    const ChartPrivate *source = chart->d_func();
+    d->clearTemplate();
+    d->seriesList.clear();
+    d->axisList.clear();
+    d->chartType = source->chartType;
+    d->valueCacheEnabled = false;
+    if (source->templateData) {
+        d->templateData = source->templateData;
+        d->templateRowOffset = source->templateRowOffset + rowOffset;
+        d->templateColumnOffset = source->templateColumnOffset + columnOffset;
+    } else {
+        d->templateData = source->makeTemplate();
+        d->templateRowOffset = rowOffset;
+        d->templateColumnOffset = columnOffset;
+    }
+}
+
 /*!
  * \internal
  */
@@ -179,6 +408,20 @@ void Chart::saveToXmlFile(QIODevice *device) const
 {
     Q_D(const Chart);
 
+    if (d->templateData) {
+        const ChartTemplate &data = *d->templateData;
+        for (int i = 0; i < data.references.size(); ++i) {
+            QString text = d->movedReference(data.references[i]);
+            text.replace(QLatin1Char('&'), QLatin1String("&amp;"));
+            text.replace(QLatin1Char('<'), QLatin1String("&lt;"));
+            text.replace(QLatin1Char('>'), QLatin1String("&gt;"));
+            device->write(data.parts[i]);
+            device->write(text.toUtf8());
+        }
+        device->write(data.parts.last());
+        return;
+    }
+
     QXmlStreamWriter writer(device);
 
     writer.writeStartDocument(QStringLiteral("1.0"), true);
@@ -566,14 +809,20 @@ void ChartPrivate::saveXmlSer(QXmlStreamWriter &writer, XlsxSeries *ser, int id)
     writer.writeEmptyElement(QStringLiteral("c:order"));
     writer.writeAttribute(QStringLiteral("val"), QString::number(id));
 
+    QVector<QString> xValues;
+    bool xText = false;
+    QVector<QString> yValues;
+    const bool reduced = downsampledValues(ser, &xValues, &xText, &yValues);
+
     if (!ser->axDataSource_numRef.isEmpty()) {
         if (chartType == Chart::CT_Scatter || chartType == Chart::CT_Bubble)
             writer.writeStartElement(QStringLiteral("c:xVal"));
         else
             writer.writeStartElement(QStringLiteral("c:cat"));
-        writer.writeStartElement(QStringLiteral("c:numRef"));
-        writer.writeTextElement(QStringLiteral("c:f"), ser->axDataSource_numRef);
-        writer.writeEndElement(); // c:numRef
+        if (reduced)
+            saveXmlLiteral(writer, xValues, xText);
+        else
+            saveXmlDataSource(writer, ser->axDataSource_numRef, true);
         writer.writeEndElement(); // c:cat or c:xVal
     }
 
@@ -582,15 +831,288 @@ void ChartPrivate::saveXmlSer(QXmlStreamWriter &writer, XlsxSeries *ser, int id)
             writer.writeStartElement(QStringLiteral("c:yVal"));
         else
             writer.writeStartElement(QStringLiteral("c:val"));
-        writer.writeStartElement(QStringLiteral("c:numRef"));
-        writer.writeTextElement(QStringLiteral("c:f"), ser->numberDataSource_numRef);
-        writer.writeEndElement(); // c:numRef
+        if (reduced)
+            saveXmlLiteral(writer, yValues, false);
+        else
+            saveXmlDataSource(writer, ser->numberDataSource_numRef, false);
         writer.writeEndElement(); // c:val or c:yVal
     }
 
     writer.writeEndElement(); // c:ser
 }
 
+/*
+  Write the reference \a ref, with the values of its cells when the value
+  cache is enabled. The cells are read in one pass. A \a category holding
+  text is written as a string reference.
+ */
+void ChartPrivate::saveXmlDataSource(QXmlStreamWriter &writer, const QString &ref,
+                                     bool category) const
+{
+    if (templateReferences) {
+        // Written in place of the reference by makeTemplate()
+        templateReferences->append(ref);
+        writer.writeStartElement(QStringLiteral("c:numRef"));
+        writer.writeTextElement(QStringLiteral("c:f"), QString(QChar(0xE000)));
+        writer.writeEndElement(); // c:numRef
+        return;
+    }
+
+    CellRange range;
+    const WorksheetPrivate *worksheet = valueCacheEnabled ? referencedSheet(ref, &range) : 0;
+    if (!worksheet) {
+        writer.writeStartElement(QStringLiteral("c:numRef"));
+        writer.writeTextElement(QStringLiteral("c:f"), ref);
+        writer.writeEndElement(); // c:numRef
+        return;
+    }
+
+    const int count = range.rowCount() * range.columnCount();
+    QVector<double> numbers(count, 0);
+    QBitArray valid(count);
+    worksheet->readNumbers(range, numbers.data(), &valid);
+
+    QVector<QString> texts;
+    if (category) {
+        texts.resize(count);
+        worksheet->readTexts(range, texts.data());
+        bool hasText = false;
+        for (int i = 0; i < count && !hasText; ++i)
+            hasText = !valid.testBit(i) && !texts[i].isEmpty();
+        if (!hasText)
+            texts.clear();
+    }
+
+    writer.writeStartElement(texts.isEmpty() ? QStringLiteral("c:numRef")
+                                             : QStringLiteral("c:strRef"));
+    writer.writeTextElement(QStringLiteral("c:f"), ref);
+    if (texts.isEmpty()) {
+        writer.writeStartElement(QStringLiteral("c:numCache"));
+        writer.writeTextElement(QStringLiteral("c:formatCode"), QStringLiteral("General"));
+    } else {
+        writer.writeStartElement(QStringLiteral("c:strCache"));
+    }
+    writer.writeEmptyElement(QStringLiteral("c:ptCount"));
+    writer.writeAttribute(QStringLiteral("val"), QString::number(count));
+    char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+    for (int i = 0; i < count; ++i) {
+        QString value;
+        if (!texts.isEmpty())
+            value = texts[i];
+        else if (valid.testBit(i))
+            value = QString::fromLatin1(buffer, formatDouble(numbers[i], buffer));
+        if (value.isEmpty())
+            continue;
+        writer.writeStartElement(QStringLiteral("c:pt"));
+        writer.writeAttribute(QStringLiteral("idx"), QString::number(i));
+        writer.writeTextElement(QStringLiteral("c:v"), value);
+        writer.writeEndElement(); // c:pt
+    }
+    writer.writeEndElement(); // c:numCache or c:strCache
+    writer.writeEndElement(); // c:numRef or c:strRef
+}
+
+/*
+  Reduce the points of \a ser as set by Chart::setDownsampling(). Returns
+  false if the series is left alone, or else the values of the kept points
+  in \a xValues and \a yValues, \a xText telling whether the categories
+  hold text. The cells of each reference are read in one pass.
+ */
+bool ChartPrivate::downsampledValues(const XlsxSeries *ser, QVector<QString> *xValues,
+                                     bool *xText, QVector<QString> *yValues) const
+{
+    if (downsamplingMode == Chart::NoDownsampling || templateReferences
+        || ser->numberDataSource_numRef.isEmpty()) {
+        return false;
+    }
+
+    CellRange yRange;
+    const WorksheetPrivate *ySheet = referencedSheet(ser->numberDataSource_numRef, &yRange);
+    if (!ySheet)
+        return false;
+    const int count = yRange.rowCount() * yRange.columnCount();
+    if (count <= downsamplingPointCount)
+        return false;
+    QVector<double> ys(count, 0);
+    QBitArray yValid(count);
+    ySheet->readNumbers(yRange, ys.data(), &yValid);
+
+    const bool scatter = chartType == Chart::CT_Scatter || chartType == Chart::CT_Bubble;
+    QVector<double> xs;
+    QBitArray xValid;
+    QVector<QString> texts;
+    if (!ser->axDataSource_numRef.isEmpty()) {
+        CellRange xRange;
+        const WorksheetPrivate *xSheet = referencedSheet(ser->axDataSource_numRef, &xRange);
+        if (!xSheet || xRange.rowCount() * xRange.columnCount() != count)
+            return false;
+        xs.fill(0, count);
+        xValid.resize(count);
+        xSheet->readNumbers(xRange, xs.data(), &xValid);
+        if (!scatter) {
+            texts.resize(count);
+            xSheet->readTexts(xRange, texts.data());
+            bool hasText = false;
+            for (int i = 0; i < count && !hasText; ++i)
+                hasText = !xValid.testBit(i) && !texts[i].isEmpty();
+            if (!hasText)
+                texts.clear();
+        }
+    }
+
+    // The cells without a value aren't drawn, nor are the scatter points
+    // without an x value
+    QVector<int> points;
+    points.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (yValid.testBit(i) && (!scatter || xs.isEmpty() || xValid.testBit(i)))
+            points.append(i);
+    }
+    if (points.size() <= downsamplingPointCount)
+        return false;
+
+    QVector<int> kept;
+    if (downsamplingMode == Chart::MinMaxDownsampling)
+        kept = minMaxPoints(points, ys, downsamplingPointCount);
+    else
+        kept = lttbPoints(points, scatter ? xs : QVector<double>(), ys, downsamplingPointCount);
+
+    char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+    *xText = !texts.isEmpty();
+    xValues->clear();
+    yValues->clear();
+    xValues->reserve(kept.size());
+    yValues->reserve(kept.size());
+    foreach (int i, kept) {
+        if (*xText)
+            xValues->append(texts[i]);
+        else if (!xs.isEmpty() && xValid.testBit(i))
+            xValues->append(QString::fromLatin1(buffer, formatDouble(xs[i], buffer)));
+        else
+            xValues->append(QString());
+        yValues->append(QString::fromLatin1(buffer, formatDouble(ys[i], buffer)));
+    }
+    return true;
+}
+
+/*
+  Write \a values as a literal, the points without a value being left
+  out. Literals hold the points of the downsampled series.
+ */
+void ChartPrivate::saveXmlLiteral(QXmlStreamWriter &writer, const QVector<QString> &values,
+                                  bool text) const
+{
+    if (text) {
+        writer.writeStartElement(QStringLiteral("c:strLit"));
+    } else {
+        writer.writeStartElement(QStringLiteral("c:numLit"));
+        writer.writeTextElement(QStringLiteral("c:formatCode"), QStringLiteral("General"));
+    }
+    writer.writeEmptyElement(QStringLiteral("c:ptCount"));
+    writer.writeAttribute(QStringLiteral("val"), QString::number(values.size()));
+    for (int i = 0; i < values.size(); ++i) {
+        if (values[i].isEmpty())
+            continue;
+        writer.writeStartElement(QStringLiteral("c:pt"));
+        writer.writeAttribute(QStringLiteral("idx"), QString::number(i));
+        writer.writeTextElement(QStringLiteral("c:v"), values[i]);
+        writer.writeEndElement(); // c:pt
+    }
+    writer.writeEndElement(); // c:numLit or c:strLit
+}
+
+/*
+  Returns the xml of this chart split at the references of its series,
+  which is generated again after the chart is changed.
+ */
+QSharedPointer<const ChartTemplate> ChartPrivate::makeTemplate() const
+{
+    if (templateCache)
+        return templateCache;
+
+    QSharedPointer<ChartTemplate> data(new ChartTemplate);
+    QByteArray xml;
+    QBuffer buffer(&xml);
+    buffer.open(QIODevice::WriteOnly);
+    templateReferences = &data->references;
+    q_func()->saveToXmlFile(&buffer);
+    templateReferences = 0;
+
+    const QByteArray placeholder = QString(QChar(0xE000)).toUtf8();
+    int from = 0;
+    for (int pos = xml.indexOf(placeholder); pos != -1; pos = xml.indexOf(placeholder, from)) {
+        data->parts.append(xml.mid(from, pos - from));
+        from = pos + placeholder.size();
+    }
+    data->parts.append(xml.mid(from));
+    Q_ASSERT(data->parts.size() == data->references.size() + 1);
+
+    templateCache = data;
+    return templateCache;
+}
+
+/*
+  Returns the reference \a ref of the template moved by the offsets given
+  to Chart::setTemplate(), or a #REF! error if it leaves the sheet.
+ */
+QString ChartPrivate::movedReference(const QString &ref) const
+{
+    if (templateRowOffset == 0 && templateColumnOffset == 0)
+        return ref;
+
+    const int separator = ref.lastIndexOf(QLatin1Char('!'));
+    const CellRange range(ref.mid(separator + 1));
+    const CellRange moved(range.firstRow() + templateRowOffset,
+                          range.firstColumn() + templateColumnOffset,
+                          range.lastRow() + templateRowOffset,
+                          range.lastColumn() + templateColumnOffset);
+    if (!range.isValid() || moved.firstRow() < 1 || moved.firstColumn() < 1
+        || moved.lastRow() > XLSX_ROW_MAX || moved.lastColumn() > XLSX_COLUMN_MAX)
+        return ref.left(separator + 1) + QLatin1String("#REF!");
+    return ref.left(separator + 1) + moved.toString(true, true);
+}
+
+/*
+  Stop using the template which the chart is a copy of, and forget the
+  xml of the chart as a template.
+ */
+void ChartPrivate::clearTemplate()
+{
+    templateData.reset();
+    templateRowOffset = 0;
+    templateColumnOffset = 0;
+    templateCache.reset();
+}
+
+/*
+  Returns the worksheet referred to by \a ref, such as "'My Sheet'!$A$1:$A$9",
+  and stores its range in \a range. Returns 0 if it isn't a worksheet.
+ */
+const WorksheetPrivate *ChartPrivate::referencedSheet(const QString &ref, CellRange *range) const
+{
+    const int separator = ref.lastIndexOf(QLatin1Char('!'));
+    if (separator < 0 || !sheet)
+        return 0;
+    *range = CellRange(ref.mid(separator + 1));
+    if (!range->isValid())
+        return 0;
+
+    QString name = ref.left(separator);
+    if (name.length() > 2 && name.startsWith(QLatin1Char('\''))
+        && name.endsWith(QLatin1Char('\'')))
+        name = unescapeSheetName(name);
+    Workbook *workbook = sheet->workbook();
+    for (int i = 0; i < workbook->sheetCount(); ++i) {
+        AbstractSheet *target = workbook->sheet(i);
+        if (target->sheetName() == name) {
+            if (target->sheetType() != AbstractSheet::ST_WorkSheet)
+                return 0;
+            return static_cast<Worksheet *>(target)->d_func();
+        }
+    }
+    return 0;
+}
+
 bool ChartPrivate::loadXmlAxis(QXmlStreamReader &reader)
 {
     Q_ASSERT(reader.name().endsWith(QLatin1String("Ax")));
@@ -65,11 +65,23 @@ public:
         CT_Bubble
     };
 
+    enum DownsamplingMode {
+        NoDownsampling,
+        MinMaxDownsampling,
+        LttbDownsampling
+    };
+
     ~Chart();
 
     void addSeries(const CellRange &range, AbstractSheet *sheet = 0);
     void setChartType(ChartType type);
     void setChartStyle(int id);
+    bool isValueCacheEnabled() const;
+    void setValueCacheEnabled(bool enable = true);
+    DownsamplingMode downsamplingMode() const;
+    int downsamplingPointCount() const;
+    void setDownsampling(DownsamplingMode mode, int pointCount = 1000);
+    void setTemplate(const Chart *chart, int rowOffset = 0, int columnOffset = 0);
 
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
@@ -40,13 +40,19 @@
 #include "xlsxabstractooxmlfile_p.h"
 #include "xlsxchart.h"
 
+#include <QByteArray>
+#include <QList>
 #include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
 
 class QXmlStreamReader;
 class QXmlStreamWriter;
 
 namespace QXlsx {
 
+class WorksheetPrivate;
+
 class XlsxSeries
 {
 public:
@@ -55,6 +61,17 @@ public:
     QString axDataSource_numRef; // xval, cat
 };
 
+/*
+  The xml of a chart split at the references of its series, so that copies
+  of the chart only write their own references.
+ */
+class ChartTemplate
+{
+public:
+    QList<QByteArray> parts; // one more than the references
+    QStringList references;
+};
+
 class XlsxAxis
 {
 public:
@@ -101,9 +118,29 @@ public:
     void saveXmlAreaChart(QXmlStreamWriter &writer) const;
     void saveXmlDoughnutChart(QXmlStreamWriter &writer) const;
     void saveXmlSer(QXmlStreamWriter &writer, XlsxSeries *ser, int id) const;
+    void saveXmlDataSource(QXmlStreamWriter &writer, const QString &ref, bool category) const;
+    bool downsampledValues(const XlsxSeries *ser, QVector<QString> *xValues, bool *xText,
+                           QVector<QString> *yValues) const;
+    void saveXmlLiteral(QXmlStreamWriter &writer, const QVector<QString> &values,
+                        bool text) const;
+    const WorksheetPrivate *referencedSheet(const QString &ref, CellRange *range) const;
+    QSharedPointer<const ChartTemplate> makeTemplate() const;
+    QString movedReference(const QString &ref) const;
+    void clearTemplate();
     void saveXmlAxes(QXmlStreamWriter &writer) const;
 
     Chart::ChartType chartType;
+    bool valueCacheEnabled;
+    Chart::DownsamplingMode downsamplingMode;
+    int downsamplingPointCount;
+
+    // Set when the chart is a copy of a template, see Chart::setTemplate()
+    QSharedPointer<const ChartTemplate> templateData;
+    int templateRowOffset;
+    int templateColumnOffset;
+    // This chart as a template, and the references collected while making it
+    mutable QSharedPointer<const ChartTemplate> templateCache;
+    mutable QStringList *templateReferences;
 
     QList<QSharedPointer<XlsxSeries>> seriesList;
     QList<QSharedPointer<XlsxAxis>> axisList;
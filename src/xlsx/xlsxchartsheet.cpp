@@ -91,6 +91,23 @@ Chartsheet *Chartsheet::copy(const QString &distName, int distId) const
     return 0;
 }
 
+/*!
+ * \internal
+ *
+ * Make a sheet of \a workbook, a snapshot of the workbook of this sheet,
+ * which shares the chart and the drawing of this sheet.
+ */
+Chartsheet *Chartsheet::snapshot(Workbook *workbook) const
+{
+    Q_D(const Chartsheet);
+    Chartsheet *sheet = new Chartsheet(d->name, d->id, workbook, F_LoadFromExists);
+    ChartsheetPrivate *sheet_d = sheet->d_func();
+    sheet_d->sheetState = d->sheetState;
+    sheet_d->drawing = d->drawing;
+    sheet_d->chart = d->chart;
+    return sheet;
+}
+
 /*!
  * Destroys this workssheet.
  */
@@ -129,7 +146,7 @@ void Chartsheet::saveToXmlFile(QIODevice *device) const
     writer.writeAttribute(QStringLiteral("zoomToFit"), QStringLiteral("1"));
     writer.writeEndElement(); // sheetViews
 
-    int idx = d->workbook->drawings().indexOf(d->drawing.data());
+    int idx = d->workbook->drawingIndex(d->drawing.data());
     d->relationships->addWorksheetRelationship(
         QStringLiteral("/drawing"), QStringLiteral("../drawings/drawing%1.xml").arg(idx + 1));
 
@@ -1,5 +1,7 @@
 #include "xlsxcolor_p.h"
+#include "xlsxbiff12_p.h"
 #include "xlsxstyles_p.h"
+#include "xlsxtheme_p.h"
 #include "xlsxutility_p.h"
 
 #include <QDataStream>
@@ -68,6 +70,36 @@ QStringList XlsxColor::themeColor() const
     return QStringList();
 }
 
+/*
+  Returns the color this refers to: the indexed colors are looked up in the
+  palette of \a styles, and the theme colors in \a theme, with their tint
+  applied to the luminance. Returns an invalid color when it can't be
+  resolved.
+ */
+QColor XlsxColor::resolvedColor(const Styles *styles, const Theme *theme) const
+{
+    if (isRgbColor())
+        return rgbColor();
+    if (isIndexedColor())
+        return styles ? styles->getColorByIndex(indexedColor()) : QColor();
+    if (!isThemeColor() || !theme)
+        return QColor();
+
+    const QStringList themes = val.toStringList();
+    QColor color = theme->color(themes[0].toInt());
+    const double tint = themes.value(1).toDouble();
+    if (!color.isValid() || tint == 0)
+        return color;
+    qreal hue, saturation, lightness, alpha;
+    color.getHslF(&hue, &saturation, &lightness, &alpha);
+    if (tint < 0)
+        lightness *= 1 + tint;
+    else
+        lightness = lightness * (1 - tint) + tint;
+    color.setHslF(hue, saturation, qBound(qreal(0), lightness, qreal(1)), alpha);
+    return color;
+}
+
 bool XlsxColor::saveToXml(QXmlStreamWriter &writer, const QString &node) const
 {
     if (!node.isEmpty())
@@ -109,6 +141,67 @@ bool XlsxColor::loadFromXml(QXmlStreamReader &reader)
     return true;
 }
 
+/*
+  The color structure of the BIFF12 records: the type of the color and
+  whether the RGB value is valid, the index of an indexed or theme color,
+  the tint as a fraction of 32767 and the RGBA value, 8 bytes in all.
+ */
+void XlsxColor::saveToBinary(Biff12Writer &writer) const
+{
+    enum { Auto = 0, Indexed = 1, Rgb = 2, Theme = 3 };
+
+    int type = Auto;
+    int index = 0;
+    int tint = 0;
+    QColor color;
+    if (val.userType() == qMetaTypeId<QColor>()) {
+        type = Rgb;
+        color = val.value<QColor>();
+    } else if (val.userType() == QMetaType::QStringList) {
+        type = Theme;
+        QStringList themes = val.toStringList();
+        index = themes[0].toInt();
+        tint = qRound(qBound(-1.0, themes[1].toDouble(), 1.0) * 32767);
+    } else if (val.userType() == QMetaType::Int) {
+        type = Indexed;
+        index = val.toInt();
+    }
+
+    writer.writeUInt8(quint8((type << 1) | (type == Rgb ? 1 : 0)));
+    writer.writeUInt8(quint8(index));
+    writer.writeUInt16(quint16(qint16(tint)));
+    writer.writeUInt8(quint8(color.isValid() ? color.red() : 0));
+    writer.writeUInt8(quint8(color.isValid() ? color.green() : 0));
+    writer.writeUInt8(quint8(color.isValid() ? color.blue() : 0));
+    writer.writeUInt8(quint8(color.isValid() ? color.alpha() : 0xFF));
+}
+
+/*
+  An automatic color leaves the color invalid.
+ */
+void XlsxColor::loadFromBinary(Biff12Reader &reader)
+{
+    const int type = reader.readUInt8() >> 1;
+    const int index = reader.readUInt8();
+    const int tint = qint16(reader.readUInt16());
+    const int red = reader.readUInt8();
+    const int green = reader.readUInt8();
+    const int blue = reader.readUInt8();
+    const int alpha = reader.readUInt8();
+
+    val = QVariant();
+    if (type == 1) {
+        val.setValue(index);
+    } else if (type == 2) {
+        val.setValue(QColor(red, green, blue, alpha));
+    } else if (type == 3) {
+        QString tintString;
+        if (tint != 0)
+            tintString = QString::number(tint / 32767.0);
+        val.setValue(QStringList() << QString::number(index) << tintString);
+    }
+}
+
 XlsxColor::operator QVariant() const
 {
     return QVariant(qMetaTypeId<XlsxColor>(), this);
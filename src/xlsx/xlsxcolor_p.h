@@ -47,6 +47,9 @@ class QXmlStreamReader;
 namespace QXlsx {
 
 class Styles;
+class Theme;
+class Biff12Writer;
+class Biff12Reader;
 
 class Q_XLSX_EXPORT XlsxColor
 {
@@ -63,6 +66,7 @@ public:
     QColor rgbColor() const;
     int indexedColor() const;
     QStringList themeColor() const;
+    QColor resolvedColor(const Styles *styles, const Theme *theme) const;
 
     operator QVariant() const;
 
@@ -71,6 +75,8 @@ public:
 
     bool saveToXml(QXmlStreamWriter &writer, const QString &node = QString()) const;
     bool loadFromXml(QXmlStreamReader &reader);
+    void saveToBinary(Biff12Writer &writer) const;
+    void loadFromBinary(Biff12Reader &reader);
 
 private:
     QVariant val;
@@ -0,0 +1,166 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxcommentswriter_p.h"
+#include "xlsxsheetdatawriter_p.h"
+#include "xlsxworksheet_p.h"
+
+#include <QIODevice>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const int ShapeBlockSize = 1024;
+
+/*
+  The shape of a hidden note, the same as Excel writes. A '%' stands for the
+  shape id, the anchor, the row and the column, in that order.
+ */
+const char NoteShapeTemplate[] =
+    "<v:shape id=\"_x0000_s%\" type=\"#_x0000_t202\" style=\"position:absolute;"
+    "margin-left:59.25pt;margin-top:1.5pt;width:108pt;height:59.25pt;z-index:1;"
+    "visibility:hidden\" fillcolor=\"#ffffe1\" o:insetmode=\"auto\">"
+    "<v:fill color2=\"#ffffe1\"/><v:shadow on=\"t\" color=\"black\" obscured=\"t\"/>"
+    "<v:path o:connecttype=\"none\"/><v:textbox style=\"mso-direction-alt:auto\">"
+    "<div style=\"text-align:left\"></div></v:textbox>"
+    "<x:ClientData ObjectType=\"Note\"><x:MoveWithCells/><x:SizeWithCells/>"
+    "<x:Anchor>%</x:Anchor><x:AutoFill>False</x:AutoFill><x:Row>%</x:Row>"
+    "<x:Column>%</x:Column></x:ClientData></v:shape>";
+
+} // namespace
+
+CommentsWriter::CommentsWriter(const QMap<int, QMap<int, QString>> &comments,
+                               const QString &author)
+    : m_comments(comments)
+    , m_author(author)
+    , m_count(0)
+{
+    QMap<int, QMap<int, QString>>::const_iterator it = comments.constBegin();
+    for (; it != comments.constEnd(); ++it)
+        m_count += it.value().size();
+
+    const QByteArray shape = QByteArray::fromRawData(NoteShapeTemplate,
+                                                     sizeof(NoteShapeTemplate) - 1);
+    int start = 0;
+    for (int part = ShapeId; part <= ShapeEnd; ++part) {
+        int end = part == ShapeEnd ? shape.size() : shape.indexOf('%', start);
+        m_shapeTemplate[part] = QByteArray(shape.constData() + start, end - start);
+        start = end + 1;
+    }
+}
+
+/*
+  Returns the number of blocks of shape ids taken by the notes. The first
+  id of each block is not used.
+ */
+int CommentsWriter::shapeBlockCount() const
+{
+    return (m_count + ShapeBlockSize - 2) / (ShapeBlockSize - 1);
+}
+
+void CommentsWriter::saveComments(QIODevice *device) const
+{
+    SheetDataWriter writer(device);
+    writer.writeRaw("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                    "<comments xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+                    "\"><authors><author>");
+    writer.writeEscaped(m_author);
+    writer.writeRaw("</author></authors><commentList>");
+
+    QMap<int, QMap<int, QString>>::const_iterator rowIt = m_comments.constBegin();
+    for (; rowIt != m_comments.constEnd(); ++rowIt) {
+        QMap<int, QString>::const_iterator it = rowIt.value().constBegin();
+        for (; it != rowIt.value().constEnd(); ++it) {
+            writer.writeRaw("<comment ref=\"");
+            writer.writeCellReference(rowIt.key(), it.key());
+            writer.writeRaw("\" authorId=\"0\"><text><t xml:space=\"preserve\">");
+            writer.writeEscaped(it.value());
+            writer.writeRaw("</t></text></comment>");
+        }
+    }
+    writer.writeRaw("</commentList></comments>");
+}
+
+/*
+  Write the VML drawing with the shapes of the notes, their ids being taken
+  from the blocks from \a firstShapeBlock on.
+ */
+void CommentsWriter::saveVmlDrawing(QIODevice *device, int firstShapeBlock) const
+{
+    SheetDataWriter writer(device);
+    writer.writeRaw("<xml xmlns:v=\"urn:schemas-microsoft-com:vml\" "
+                    "xmlns:o=\"urn:schemas-microsoft-com:office:office\" "
+                    "xmlns:x=\"urn:schemas-microsoft-com:office:excel\">"
+                    "<o:shapelayout v:ext=\"edit\"><o:idmap v:ext=\"edit\" data=\"");
+    const int blockCount = qMax(shapeBlockCount(), 1);
+    for (int i = 0; i < blockCount; ++i) {
+        if (i)
+            writer.writeRaw(",");
+        writer.writeInt(firstShapeBlock + i);
+    }
+    writer.writeRaw("\"/></o:shapelayout>"
+                    "<v:shapetype id=\"_x0000_t202\" coordsize=\"21600,21600\" o:spt=\"202\" "
+                    "path=\"m,l,21600r21600,l21600,xe\"><v:stroke joinstyle=\"miter\"/>"
+                    "<v:path gradientshapeok=\"t\" o:connecttype=\"rect\"/></v:shapetype>");
+
+    int block = firstShapeBlock;
+    int idInBlock = 0;
+    QMap<int, QMap<int, QString>>::const_iterator rowIt = m_comments.constBegin();
+    for (; rowIt != m_comments.constEnd(); ++rowIt) {
+        // The note box is shown to the right of the cell, from the row above
+        const int row = rowIt.key() - 1;
+        const int topRow = qMax(row - 1, 0);
+        QMap<int, QString>::const_iterator it = rowIt.value().constBegin();
+        for (; it != rowIt.value().constEnd(); ++it) {
+            const int column = it.key() - 1;
+            const int leftColumn = qMin(column + 1, XLSX_COLUMN_MAX - 3);
+            if (++idInBlock == ShapeBlockSize) {
+                ++block;
+                idInBlock = 1;
+            }
+
+            const QByteArray *part = m_shapeTemplate;
+            writer.writeRaw(part[ShapeId].constData(), part[ShapeId].size());
+            writer.writeInt(qint64(block) * ShapeBlockSize + idInBlock);
+            writer.writeRaw(part[ShapeAnchor].constData(), part[ShapeAnchor].size());
+            const int anchor[8] = {leftColumn,     15, topRow,     row ? 10 : 2,
+                                   leftColumn + 2, 15, topRow + 4, row ? 4 : 16};
+            for (int i = 0; i < 8; ++i) {
+                if (i)
+                    writer.writeRaw(", ");
+                writer.writeInt(anchor[i]);
+            }
+            writer.writeRaw(part[ShapeRow].constData(), part[ShapeRow].size());
+            writer.writeInt(row);
+            writer.writeRaw(part[ShapeColumn].constData(), part[ShapeColumn].size());
+            writer.writeInt(column);
+            writer.writeRaw(part[ShapeEnd].constData(), part[ShapeEnd].size());
+        }
+    }
+    writer.writeRaw("</xml>");
+}
+
+QT_END_NAMESPACE_XLSX
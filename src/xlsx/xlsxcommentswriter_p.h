@@ -0,0 +1,83 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXCOMMENTSWRITER_P_H
+#define XLSXCOMMENTSWRITER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  Writes the comments part of a sheet and the legacy VML drawing which holds
+  the shapes of its notes, straight from the comments of the sheet.
+
+  All the notes share one author and one shape type, and their shapes only
+  differ by their ids and their cell anchors, so each shape is written as
+  the bytes of a template, split once when the writer is created, with the
+  numbers written in between. The shape ids are taken from blocks of 1024
+  ids; the blocks of a sheet follow those of the sheets saved before it.
+ */
+class XLSX_AUTOTEST_EXPORT CommentsWriter
+{
+public:
+    CommentsWriter(const QMap<int, QMap<int, QString>> &comments, const QString &author);
+
+    int count() const { return m_count; }
+    int shapeBlockCount() const;
+
+    void saveComments(QIODevice *device) const;
+    void saveVmlDrawing(QIODevice *device, int firstShapeBlock) const;
+
+private:
+    enum ShapeTemplatePart { ShapeId, ShapeAnchor, ShapeRow, ShapeColumn, ShapeEnd };
+
+    const QMap<int, QMap<int, QString>> &m_comments;
+    QString m_author;
+    int m_count;
+    // The bytes of the shape template written before its variable parts
+    QByteArray m_shapeTemplate[ShapeEnd + 1];
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCOMMENTSWRITER_P_H
@@ -0,0 +1,793 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcompoundfile_p.h"
+
+#include <QBuffer>
+#include <QIODevice>
+#include <QPair>
+#include <QStringList>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const char CFB_SIGNATURE[] = "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1";
+const int CFB_HEADER_SIZE = 512;
+const int CFB_ENTRY_SIZE = 128;
+const int CFB_HEADER_DIFAT_COUNT = 109;
+const int CFB_SECTOR_SHIFT = 9; // version 3
+const int CFB_MINI_SECTOR_SHIFT = 6;
+const quint32 CFB_MINI_STREAM_CUTOFF = 4096;
+
+// Sector ids above MAX_REGULAR_SECTOR have a special meaning
+const quint32 MAX_REGULAR_SECTOR = 0xFFFFFFFA;
+const quint32 DIFAT_SECTOR = 0xFFFFFFFC;
+const quint32 FAT_SECTOR = 0xFFFFFFFD;
+const quint32 END_OF_CHAIN = 0xFFFFFFFE;
+const quint32 FREE_SECTOR = 0xFFFFFFFF;
+const quint32 NO_STREAM = 0xFFFFFFFF;
+
+enum EntryType { StorageEntry = 1, StreamEntry = 2, RootEntry = 5 };
+
+quint16 readUInt16(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+quint32 readUInt32(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+quint64 readUInt64(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+void writeUInt16(QByteArray &data, int pos, quint16 value)
+{
+    qToLittleEndian(value, reinterpret_cast<uchar *>(data.data() + pos));
+}
+
+void writeUInt32(QByteArray &data, int pos, quint32 value)
+{
+    qToLittleEndian(value, reinterpret_cast<uchar *>(data.data() + pos));
+}
+
+void writeUInt64(QByteArray &data, int pos, quint64 value)
+{
+    qToLittleEndian(value, reinterpret_cast<uchar *>(data.data() + pos));
+}
+
+/*
+  The sibling order of the directory: shorter names first, then the
+  upper case names compared code unit by code unit.
+ */
+bool lessEntryName(const QPair<QString, int> &a, const QPair<QString, int> &b)
+{
+    if (a.first.size() != b.first.size())
+        return a.first.size() < b.first.size();
+    return a.first.toUpper() < b.first.toUpper();
+}
+
+/*
+  A stream stored in the regular sectors of the file, read in place. The
+  contiguous sectors of the chain are read at once.
+ */
+class CompoundStreamDevice : public QIODevice
+{
+public:
+    CompoundStreamDevice(QIODevice *device, const QVector<quint32> &chain, qint64 size,
+                         int sectorShift)
+        : m_device(device), m_chain(chain), m_size(size), m_sectorShift(sectorShift)
+    {
+    }
+
+    bool isSequential() const { return false; }
+    qint64 size() const { return m_size; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        const qint64 sectorSize = qint64(1) << m_sectorShift;
+        qint64 position = pos();
+        qint64 remaining = qMin(maxSize, m_size - position);
+        qint64 done = 0;
+        while (remaining > 0) {
+            int index = int(position >> m_sectorShift);
+            const qint64 offset = position & (sectorSize - 1);
+            qint64 length = sectorSize - offset;
+            while (length < remaining && index + 1 < m_chain.size()
+                   && m_chain[index + 1] == m_chain[index] + 1) {
+                length += sectorSize;
+                ++index;
+            }
+            length = qMin(length, remaining);
+            const qint64 start = (qint64(m_chain[int(position >> m_sectorShift)]) + 1)
+                                 << m_sectorShift;
+            if (!m_device->seek(start + offset) || m_device->read(data + done, length) != length)
+                return done ? done : -1;
+            done += length;
+            position += length;
+            remaining -= length;
+        }
+        return done;
+    }
+
+    qint64 writeData(const char *, qint64) { return -1; }
+
+private:
+    QIODevice *m_device;
+    QVector<quint32> m_chain;
+    qint64 m_size;
+    int m_sectorShift;
+};
+
+/*
+  The stream being written by CompoundFileWriter, which takes the sectors
+  following the ones already written. The stream can be seeked back or
+  read back, as long as the file device can.
+ */
+class CompoundStreamWriter : public QIODevice
+{
+public:
+    CompoundStreamWriter(QIODevice *device, qint64 offset)
+        : m_device(device), m_offset(offset), m_size(0)
+    {
+    }
+
+    bool isSequential() const { return false; }
+    qint64 size() const { return m_size; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        const qint64 length = qMin(maxSize, m_size - pos());
+        if (length <= 0)
+            return length == 0 ? 0 : -1;
+        if (!m_device->seek(m_offset + pos()))
+            return -1;
+        return m_device->read(data, length);
+    }
+
+    qint64 writeData(const char *data, qint64 size)
+    {
+        if (!m_device->seek(m_offset + pos()))
+            return -1;
+        const qint64 written = m_device->write(data, size);
+        if (written > 0)
+            m_size = qMax(m_size, pos() + written);
+        return written;
+    }
+
+private:
+    QIODevice *m_device;
+    qint64 m_offset;
+    qint64 m_size;
+};
+
+} // namespace
+
+CompoundFileReader::CompoundFileReader(QIODevice *device)
+    : m_device(device)
+    , m_valid(false)
+    , m_sectorShift(CFB_SECTOR_SHIFT)
+    , m_miniSectorShift(CFB_MINI_SECTOR_SHIFT)
+    , m_miniStreamCutoff(CFB_MINI_STREAM_CUTOFF)
+    , m_miniStreamRead(false)
+{
+    m_valid = readHeader();
+}
+
+/*
+  Returns true if \a device, which is open, starts with the signature of
+  the compound files. The position of the device is left unchanged.
+ */
+bool CompoundFileReader::isCompoundFile(QIODevice *device)
+{
+    if (!device || !device->isReadable())
+        return false;
+    if (device->isSequential())
+        return device->peek(8) == QByteArray::fromRawData(CFB_SIGNATURE, 8);
+    const qint64 pos = device->pos();
+    const bool ok = device->seek(0) && device->read(8) == QByteArray::fromRawData(CFB_SIGNATURE, 8);
+    device->seek(pos);
+    return ok;
+}
+
+bool CompoundFileReader::readHeader()
+{
+    if (!m_device || !m_device->seek(0))
+        return false;
+    const QByteArray header = m_device->read(CFB_HEADER_SIZE);
+    if (header.size() != CFB_HEADER_SIZE || !header.startsWith(QByteArray(CFB_SIGNATURE, 8)))
+        return false;
+
+    m_sectorShift = readUInt16(header, 30);
+    m_miniSectorShift = readUInt16(header, 32);
+    if ((m_sectorShift != 9 && m_sectorShift != 12) || m_miniSectorShift >= m_sectorShift)
+        return false;
+    const quint32 fatCount = readUInt32(header, 44);
+    const quint32 directoryStart = readUInt32(header, 48);
+    m_miniStreamCutoff = readUInt32(header, 56);
+    const quint32 miniFatStart = readUInt32(header, 60);
+    quint32 difatSector = readUInt32(header, 68);
+    const quint32 difatCount = readUInt32(header, 72);
+
+    // The FAT sectors are listed by the header, then by the DIFAT chain
+    QVector<quint32> fatSectors;
+    for (int i = 0; i < CFB_HEADER_DIFAT_COUNT; ++i) {
+        const quint32 sector = readUInt32(header, 76 + i * 4);
+        if (sector < MAX_REGULAR_SECTOR)
+            fatSectors.append(sector);
+    }
+    const int idsPerSector = (1 << m_sectorShift) / 4;
+    for (quint32 i = 0; i < difatCount && difatSector < MAX_REGULAR_SECTOR; ++i) {
+        const QByteArray data = readSector(difatSector);
+        if (data.isEmpty())
+            return false;
+        for (int j = 0; j < idsPerSector - 1; ++j) {
+            const quint32 sector = readUInt32(data, j * 4);
+            if (sector < MAX_REGULAR_SECTOR)
+                fatSectors.append(sector);
+        }
+        difatSector = readUInt32(data, (idsPerSector - 1) * 4);
+    }
+    if (quint32(fatSectors.size()) > fatCount)
+        fatSectors.resize(fatCount);
+
+    m_fat.reserve(fatSectors.size() * idsPerSector);
+    foreach (quint32 sector, fatSectors) {
+        const QByteArray data = readSector(sector);
+        if (data.isEmpty())
+            return false;
+        for (int j = 0; j < idsPerSector; ++j)
+            m_fat.append(readUInt32(data, j * 4));
+    }
+
+    QVector<quint32> chain;
+    if (!readSectors(directoryStart, m_fat, &chain))
+        return false;
+    const QByteArray directory = readChain(chain, qint64(chain.size()) << m_sectorShift);
+    for (int pos = 0; pos + CFB_ENTRY_SIZE <= directory.size(); pos += CFB_ENTRY_SIZE) {
+        CompoundFileEntry entry;
+        const int nameLength = qMin(int(readUInt16(directory, pos + 64)), 64) / 2 - 1;
+        for (int i = 0; i < nameLength; ++i)
+            entry.name.append(QChar(readUInt16(directory, pos + i * 2)));
+        entry.type = uchar(directory[pos + 66]);
+        entry.left = readUInt32(directory, pos + 68);
+        entry.right = readUInt32(directory, pos + 72);
+        entry.child = readUInt32(directory, pos + 76);
+        entry.startSector = readUInt32(directory, pos + 116);
+        entry.size = qint64(readUInt64(directory, pos + 120));
+        // The high part of the size may be garbage in the version 3 files
+        if (m_sectorShift == 9)
+            entry.size &= Q_INT64_C(0xFFFFFFFF);
+        m_entries.append(entry);
+    }
+    if (m_entries.isEmpty() || m_entries.first().type != RootEntry)
+        return false;
+
+    if (miniFatStart < MAX_REGULAR_SECTOR) {
+        if (!readSectors(miniFatStart, m_fat, &chain))
+            return false;
+        const QByteArray miniFat = readChain(chain, qint64(chain.size()) << m_sectorShift);
+        m_miniFat.reserve(miniFat.size() / 4);
+        for (int pos = 0; pos + 4 <= miniFat.size(); pos += 4)
+            m_miniFat.append(readUInt32(miniFat, pos));
+    }
+    return true;
+}
+
+QByteArray CompoundFileReader::readSector(quint32 sector) const
+{
+    const qint64 size = qint64(1) << m_sectorShift;
+    if (!m_device->seek((qint64(sector) + 1) << m_sectorShift))
+        return QByteArray();
+    QByteArray data = m_device->read(size);
+    return data.size() == size ? data : QByteArray();
+}
+
+/*
+  Follow the chain starting at \a first through \a table, the FAT or the
+  mini FAT, into \a chain. Returns false if the chain is broken or loops.
+ */
+bool CompoundFileReader::readSectors(quint32 first, const QVector<quint32> &table,
+                                     QVector<quint32> *chain) const
+{
+    chain->clear();
+    quint32 sector = first;
+    while (sector < MAX_REGULAR_SECTOR) {
+        if (sector >= quint32(table.size()) || chain->size() >= table.size())
+            return false;
+        chain->append(sector);
+        sector = table[sector];
+    }
+    return sector == END_OF_CHAIN;
+}
+
+QByteArray CompoundFileReader::readChain(const QVector<quint32> &chain, qint64 size) const
+{
+    QByteArray data;
+    data.reserve(int(qMin(size, qint64(chain.size()) << m_sectorShift)));
+    foreach (quint32 sector, chain) {
+        if (data.size() >= size)
+            break;
+        const QByteArray sectorData = readSector(sector);
+        if (sectorData.isEmpty())
+            return QByteArray();
+        data.append(sectorData);
+    }
+    if (data.size() < size)
+        return QByteArray();
+    data.truncate(int(size));
+    return data;
+}
+
+/*
+  Find the entry named \a name among the children of \a storage, which
+  are the nodes of a binary tree. The names are case insensitive.
+ */
+int CompoundFileReader::findChild(int storage, const QString &name) const
+{
+    QVector<quint32> pending;
+    pending.append(m_entries[storage].child);
+    int visited = 0;
+    while (!pending.isEmpty()) {
+        const quint32 index = pending.takeLast();
+        if (index >= quint32(m_entries.size()) || ++visited > m_entries.size())
+            continue;
+        const CompoundFileEntry &entry = m_entries[index];
+        if (entry.name.compare(name, Qt::CaseInsensitive) == 0)
+            return int(index);
+        pending.append(entry.left);
+        pending.append(entry.right);
+    }
+    return -1;
+}
+
+int CompoundFileReader::findEntry(const QString &path) const
+{
+    if (!m_valid)
+        return -1;
+    int index = 0;
+    foreach (const QString &name, path.split(QLatin1Char('/'))) {
+        index = findChild(index, name);
+        if (index == -1)
+            return -1;
+    }
+    return index;
+}
+
+bool CompoundFileReader::contains(const QString &path) const
+{
+    const int index = findEntry(path);
+    return index != -1 && m_entries[index].type == StreamEntry;
+}
+
+qint64 CompoundFileReader::streamSize(const QString &path) const
+{
+    const int index = findEntry(path);
+    if (index == -1 || m_entries[index].type != StreamEntry)
+        return -1;
+    return m_entries[index].size;
+}
+
+/*
+  Returns the data of the stream at \a path, or an empty array if there
+  is no such stream or it can't be read.
+ */
+QByteArray CompoundFileReader::streamData(const QString &path) const
+{
+    const int index = findEntry(path);
+    if (index == -1 || m_entries[index].type != StreamEntry)
+        return QByteArray();
+    const CompoundFileEntry &entry = m_entries[index];
+
+    QVector<quint32> chain;
+    if (entry.size >= m_miniStreamCutoff) {
+        if (!readSectors(entry.startSector, m_fat, &chain))
+            return QByteArray();
+        return readChain(chain, entry.size);
+    }
+
+    if (!m_miniStreamRead) {
+        const CompoundFileEntry &root = m_entries.first();
+        if (readSectors(root.startSector, m_fat, &chain))
+            m_miniStream = readChain(chain, root.size);
+        m_miniStreamRead = true;
+    }
+    if (!readSectors(entry.startSector, m_miniFat, &chain))
+        return QByteArray();
+    QByteArray data;
+    data.reserve(int(entry.size));
+    const int miniSectorSize = 1 << m_miniSectorShift;
+    foreach (quint32 sector, chain) {
+        const qint64 pos = qint64(sector) << m_miniSectorShift;
+        if (pos + miniSectorSize > m_miniStream.size())
+            return QByteArray();
+        data.append(m_miniStream.constData() + pos, miniSectorSize);
+    }
+    if (data.size() < entry.size)
+        return QByteArray();
+    data.truncate(int(entry.size));
+    return data;
+}
+
+/*
+  Returns a random access device, open for reading, over the stream at
+  \a path, or 0 if there is no such stream. The large streams are read in
+  place from the file device, which must outlive the returned device.
+  The caller takes the ownership of the returned device.
+ */
+QIODevice *CompoundFileReader::openStream(const QString &path) const
+{
+    const int index = findEntry(path);
+    if (index == -1 || m_entries[index].type != StreamEntry)
+        return 0;
+    const CompoundFileEntry &entry = m_entries[index];
+
+    if (entry.size < m_miniStreamCutoff) {
+        QBuffer *buffer = new QBuffer;
+        buffer->setData(streamData(path));
+        if (buffer->data().size() != entry.size) {
+            delete buffer;
+            return 0;
+        }
+        buffer->open(QIODevice::ReadOnly);
+        return buffer;
+    }
+
+    QVector<quint32> chain;
+    if (!readSectors(entry.startSector, m_fat, &chain)
+        || (qint64(chain.size()) << m_sectorShift) < entry.size) {
+        return 0;
+    }
+    CompoundStreamDevice *device =
+        new CompoundStreamDevice(m_device, chain, entry.size, m_sectorShift);
+    device->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    return device;
+}
+
+CompoundFileWriter::CompoundFileWriter(QIODevice *device)
+    : m_device(device), m_error(false), m_closed(false), m_sectorCount(0), m_stream(0),
+      m_streamNode(-1)
+{
+    Node root;
+    root.name = QStringLiteral("Root Entry");
+    root.type = RootEntry;
+    root.startSector = END_OF_CHAIN;
+    root.size = 0;
+    m_nodes.append(root);
+
+    // Room for the header, which is written last
+    m_error = !m_device || !m_device->seek(0)
+              || m_device->write(QByteArray(CFB_HEADER_SIZE, 0)) != CFB_HEADER_SIZE;
+}
+
+CompoundFileWriter::~CompoundFileWriter()
+{
+    if (!m_closed)
+        close();
+    delete m_stream;
+}
+
+/*
+  Add the node of \a type at \a path, and the storages leading to it.
+  Returns the index of the node, or -1 if there is one at \a path
+  already.
+ */
+int CompoundFileWriter::addNode(const QString &path, int type)
+{
+    const QStringList names = path.split(QLatin1Char('/'));
+    int parent = 0;
+    for (int i = 0; i < names.size(); ++i) {
+        int index = -1;
+        foreach (int child, m_nodes[parent].children) {
+            if (m_nodes[child].name.compare(names[i], Qt::CaseInsensitive) == 0) {
+                index = child;
+                break;
+            }
+        }
+        const bool last = i == names.size() - 1;
+        if (index != -1) {
+            if (last || m_nodes[index].type != StorageEntry)
+                return -1;
+            parent = index;
+            continue;
+        }
+        Node node;
+        // The names are limited to 31 characters
+        node.name = names[i].left(31);
+        node.type = last ? type : int(StorageEntry);
+        node.startSector = last ? END_OF_CHAIN : 0;
+        node.size = 0;
+        m_nodes.append(node);
+        m_nodes[parent].children.append(m_nodes.size() - 1);
+        parent = m_nodes.size() - 1;
+    }
+    return parent;
+}
+
+/*
+  Write \a data, padded to whole sectors, after the sectors written, and
+  record their chain, or mark them with \a marker. Returns the first
+  sector, or END_OF_CHAIN if \a data is empty.
+ */
+quint32 CompoundFileWriter::writeSectors(const QByteArray &data, quint32 marker)
+{
+    const int sectorSize = 1 << CFB_SECTOR_SHIFT;
+    const quint32 count = quint32((data.size() + sectorSize - 1) / sectorSize);
+    if (count == 0)
+        return END_OF_CHAIN;
+    if (!m_device->seek((qint64(m_sectorCount) + 1) << CFB_SECTOR_SHIFT)
+        || m_device->write(data) != data.size()) {
+        m_error = true;
+    }
+    const int padding = int(count) * sectorSize - data.size();
+    if (padding && m_device->write(QByteArray(padding, 0)) != padding)
+        m_error = true;
+    Run run = {m_sectorCount, count, marker};
+    m_runs.append(run);
+    m_sectorCount += count;
+    return run.start;
+}
+
+/*
+  Returns a device writing the stream at \a path in place, or 0 if a
+  stream is being written already. The device belongs to the writer and
+  is valid until endStream().
+ */
+QIODevice *CompoundFileWriter::beginStream(const QString &path)
+{
+    if (m_stream || m_closed || m_error)
+        return 0;
+    m_streamNode = addNode(path, StreamEntry);
+    if (m_streamNode == -1)
+        return 0;
+    m_stream =
+        new CompoundStreamWriter(m_device, (qint64(m_sectorCount) + 1) << CFB_SECTOR_SHIFT);
+    m_stream->open((m_device->isReadable() ? QIODevice::ReadWrite : QIODevice::WriteOnly)
+                   | QIODevice::Unbuffered);
+    return m_stream;
+}
+
+/*
+  Ends the stream begun by beginStream(). Its sectors are padded, and
+  taken, before the next stream is written.
+ */
+bool CompoundFileWriter::endStream()
+{
+    if (!m_stream)
+        return false;
+    const qint64 size = m_stream->size();
+    delete m_stream;
+    m_stream = 0;
+
+    const qint64 sectorSize = 1 << CFB_SECTOR_SHIFT;
+    const quint32 count = quint32((size + sectorSize - 1) / sectorSize);
+    Node &node = m_nodes[m_streamNode];
+    node.size = size;
+    if (count) {
+        const qint64 end = (qint64(m_sectorCount) + 1) << CFB_SECTOR_SHIFT;
+        const int padding = int(count * sectorSize - size);
+        if (padding
+            && (!m_device->seek(end + size)
+                || m_device->write(QByteArray(padding, 0)) != padding)) {
+            m_error = true;
+        }
+        node.startSector = m_sectorCount;
+        Run run = {m_sectorCount, count, 0};
+        m_runs.append(run);
+        m_sectorCount += count;
+    }
+    m_streamNode = -1;
+    return !m_error;
+}
+
+/*
+  Add the stream at \a path holding \a data. The small streams go to the
+  mini stream, written by close().
+ */
+bool CompoundFileWriter::addStream(const QString &path, const QByteArray &data)
+{
+    if (m_stream || m_closed)
+        return false;
+    const int index = addNode(path, StreamEntry);
+    if (index == -1)
+        return false;
+    m_nodes[index].size = data.size();
+    if (quint32(data.size()) >= CFB_MINI_STREAM_CUTOFF) {
+        m_nodes[index].startSector = writeSectors(data);
+    } else {
+        m_miniNodes.append(index);
+        m_miniData.append(data);
+    }
+    return !m_error;
+}
+
+/*
+  The FAT entry of \a sector.
+ */
+quint32 CompoundFileWriter::nextSector(quint32 sector) const
+{
+    foreach (const Run &run, m_runs) {
+        if (sector >= run.start && sector < run.start + run.count) {
+            if (run.marker)
+                return run.marker;
+            return sector + 1 < run.start + run.count ? sector + 1 : END_OF_CHAIN;
+        }
+    }
+    return FREE_SECTOR;
+}
+
+QByteArray CompoundFileWriter::directoryData() const
+{
+    const int count = (m_nodes.size() + 3) / 4 * 4;
+    QByteArray data(count * CFB_ENTRY_SIZE, 0);
+    for (int i = 0; i < count; ++i) {
+        const int pos = i * CFB_ENTRY_SIZE;
+        writeUInt32(data, pos + 68, NO_STREAM);
+        writeUInt32(data, pos + 72, NO_STREAM);
+        writeUInt32(data, pos + 76, NO_STREAM);
+    }
+
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        const int pos = i * CFB_ENTRY_SIZE;
+        for (int j = 0; j < node.name.size(); ++j)
+            writeUInt16(data, pos + j * 2, node.name[j].unicode());
+        writeUInt16(data, pos + 64, quint16((node.name.size() + 1) * 2));
+        data[pos + 66] = char(node.type);
+        data[pos + 67] = 1; // black
+
+        // The children are all black, each one the right sibling of the
+        // previous one, which is a valid red-black tree as well.
+        QList<QPair<QString, int> > children;
+        foreach (int child, node.children)
+            children.append(qMakePair(m_nodes[child].name, child));
+        std::sort(children.begin(), children.end(), lessEntryName);
+        if (!children.isEmpty())
+            writeUInt32(data, pos + 76, children.first().second);
+        for (int j = 0; j + 1 < children.size(); ++j)
+            writeUInt32(data, children[j].second * CFB_ENTRY_SIZE + 72, children[j + 1].second);
+
+        if (node.type != StorageEntry) {
+            writeUInt32(data, pos + 116, node.startSector);
+            writeUInt64(data, pos + 120, quint64(node.size));
+        }
+    }
+    return data;
+}
+
+/*
+  Write the mini stream, the directory, the allocation tables, then the
+  header. Returns false if something couldn't be written.
+ */
+bool CompoundFileWriter::close()
+{
+    if (m_closed)
+        return !m_error;
+    if (m_stream)
+        endStream();
+    m_closed = true;
+    if (m_error)
+        return false;
+
+    // The mini stream is held by the regular sectors of the root
+    const int miniSectorSize = 1 << CFB_MINI_SECTOR_SHIFT;
+    QByteArray miniStream;
+    QByteArray miniFat;
+    for (int i = 0; i < m_miniNodes.size(); ++i) {
+        const QByteArray &data = m_miniData[i];
+        const int count = (data.size() + miniSectorSize - 1) / miniSectorSize;
+        const quint32 first = quint32(miniStream.size() / miniSectorSize);
+        m_nodes[m_miniNodes[i]].startSector = count ? first : END_OF_CHAIN;
+        QByteArray entries(count * 4, 0);
+        for (int j = 0; j < count; ++j)
+            writeUInt32(entries, j * 4, j + 1 < count ? first + j + 1 : END_OF_CHAIN);
+        miniFat.append(entries);
+        miniStream.append(data);
+        miniStream.append(QByteArray(count * miniSectorSize - data.size(), 0));
+    }
+    m_miniData.clear();
+    m_nodes[0].startSector = writeSectors(miniStream);
+    m_nodes[0].size = miniStream.size();
+
+    const int sectorSize = 1 << CFB_SECTOR_SHIFT;
+    const int idsPerSector = sectorSize / 4;
+    if (miniFat.size() % sectorSize) {
+        const int size = miniFat.size();
+        miniFat.resize((size / sectorSize + 1) * sectorSize);
+        memset(miniFat.data() + size, 0xFF, miniFat.size() - size);
+    }
+    const quint32 miniFatStart = writeSectors(miniFat);
+    const quint32 miniFatCount = quint32(miniFat.size() / sectorSize);
+    const quint32 directoryStart = writeSectors(directoryData());
+
+    // The FAT covers its own sectors and the DIFAT ones
+    quint32 fatCount = 0;
+    quint32 difatCount = 0;
+    for (;;) {
+        const quint32 total = m_sectorCount + fatCount + difatCount;
+        const quint32 fat = (total + idsPerSector - 1) / idsPerSector;
+        const quint32 difat =
+            fat > quint32(CFB_HEADER_DIFAT_COUNT)
+                ? (fat - CFB_HEADER_DIFAT_COUNT + idsPerSector - 2) / (idsPerSector - 1)
+                : 0;
+        if (fat == fatCount && difat == difatCount)
+            break;
+        fatCount = fat;
+        difatCount = difat;
+    }
+    const quint32 fatStart = m_sectorCount;
+    const quint32 difatStart = fatStart + fatCount;
+    Run fatRun = {fatStart, fatCount, FAT_SECTOR};
+    m_runs.append(fatRun);
+    Run difatRun = {difatStart, difatCount, DIFAT_SECTOR};
+    m_runs.append(difatRun);
+
+    QByteArray tables(int(fatCount + difatCount) * sectorSize, 0);
+    for (quint32 sector = 0; sector < fatCount * idsPerSector; ++sector)
+        writeUInt32(tables, int(sector) * 4, nextSector(sector));
+    for (quint32 i = 0; i < difatCount; ++i) {
+        const int pos = int(fatCount + i) * sectorSize;
+        for (int j = 0; j < idsPerSector - 1; ++j) {
+            const quint32 fat = CFB_HEADER_DIFAT_COUNT + i * (idsPerSector - 1) + j;
+            writeUInt32(tables, pos + j * 4, fat < fatCount ? fatStart + fat : FREE_SECTOR);
+        }
+        writeUInt32(tables, pos + (idsPerSector - 1) * 4,
+                    i + 1 < difatCount ? difatStart + i + 1 : END_OF_CHAIN);
+    }
+    m_runs.removeLast();
+    m_runs.removeLast();
+    writeSectors(tables);
+
+    QByteArray header(CFB_HEADER_SIZE, 0);
+    memcpy(header.data(), CFB_SIGNATURE, 8);
+    writeUInt16(header, 24, 0x003E); // minor version
+    writeUInt16(header, 26, 3); // major version
+    writeUInt16(header, 28, 0xFFFE); // little endian
+    writeUInt16(header, 30, CFB_SECTOR_SHIFT);
+    writeUInt16(header, 32, CFB_MINI_SECTOR_SHIFT);
+    writeUInt32(header, 44, fatCount);
+    writeUInt32(header, 48, directoryStart);
+    writeUInt32(header, 56, CFB_MINI_STREAM_CUTOFF);
+    writeUInt32(header, 60, miniFatStart);
+    writeUInt32(header, 64, miniFatCount);
+    writeUInt32(header, 68, difatCount ? difatStart : END_OF_CHAIN);
+    writeUInt32(header, 72, difatCount);
+    for (int i = 0; i < CFB_HEADER_DIFAT_COUNT; ++i)
+        writeUInt32(header, 76 + i * 4, quint32(i) < fatCount ? fatStart + i : FREE_SECTOR);
+    if (!m_device->seek(0) || m_device->write(header) != header.size())
+        m_error = true;
+    return !m_error;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,160 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCOMPOUNDFILE_P_H
+#define XLSXCOMPOUNDFILE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+struct CompoundFileEntry
+{
+    QString name;
+    int type; // 1 for a storage, 2 for a stream, 5 for the root
+    quint32 left;
+    quint32 right;
+    quint32 child;
+    quint32 startSector;
+    qint64 size;
+};
+
+/*
+  Reads the streams of an OLE compound file, the container of the
+  encrypted packages. The streams are found by their paths, made of the
+  names of their storages and their own name joined by '/'. The streams
+  as large as the mini stream cutoff are read sector by sector through
+  openStream(), the smaller ones are read at once.
+ */
+class XLSX_AUTOTEST_EXPORT CompoundFileReader
+{
+public:
+    explicit CompoundFileReader(QIODevice *device);
+
+    static bool isCompoundFile(QIODevice *device);
+
+    bool isValid() const { return m_valid; }
+    bool contains(const QString &path) const;
+    qint64 streamSize(const QString &path) const;
+    QByteArray streamData(const QString &path) const;
+    QIODevice *openStream(const QString &path) const;
+
+private:
+    bool readHeader();
+    QByteArray readSector(quint32 sector) const;
+    bool readSectors(quint32 first, const QVector<quint32> &table, QVector<quint32> *chain) const;
+    QByteArray readChain(const QVector<quint32> &chain, qint64 size) const;
+    int findEntry(const QString &path) const;
+    int findChild(int storage, const QString &name) const;
+
+    QIODevice *m_device;
+    bool m_valid;
+    int m_sectorShift;
+    int m_miniSectorShift;
+    quint32 m_miniStreamCutoff;
+    QVector<quint32> m_fat;
+    QVector<quint32> m_miniFat;
+    QList<CompoundFileEntry> m_entries;
+    mutable QByteArray m_miniStream; // read on first use
+    mutable bool m_miniStreamRead;
+};
+
+/*
+  Writes an OLE compound file with 512 byte sectors. The large streams
+  are written in place as they come, through the device returned by
+  beginStream(), which can be seeked back within the stream. The other
+  streams are kept until close(), which writes the mini stream, the
+  directory and the allocation tables, then the header.
+
+  The device must be random access, and readable too for the streams to
+  be read back.
+ */
+class XLSX_AUTOTEST_EXPORT CompoundFileWriter
+{
+public:
+    explicit CompoundFileWriter(QIODevice *device);
+    ~CompoundFileWriter();
+
+    QIODevice *beginStream(const QString &path);
+    bool endStream();
+    bool addStream(const QString &path, const QByteArray &data);
+    bool close();
+    bool error() const { return m_error; }
+
+private:
+    Q_DISABLE_COPY(CompoundFileWriter)
+
+    struct Node
+    {
+        QString name;
+        int type;
+        QList<int> children;
+        quint32 startSector;
+        qint64 size;
+    };
+    struct Run
+    {
+        quint32 start;
+        quint32 count;
+        quint32 marker; // set in place of the chain for the allocation tables
+    };
+
+    int addNode(const QString &path, int type);
+    quint32 writeSectors(const QByteArray &data, quint32 marker = 0);
+    quint32 nextSector(quint32 sector) const;
+    QByteArray directoryData() const;
+
+    QIODevice *m_device;
+    bool m_error;
+    bool m_closed;
+    quint32 m_sectorCount; // written after the header
+    QList<Run> m_runs; // the chains, which are all contiguous
+    QList<Node> m_nodes; // the root first
+    QList<int> m_miniNodes; // the streams of the mini stream
+    QList<QByteArray> m_miniData;
+    QIODevice *m_stream; // the stream being written, or 0
+    int m_streamNode;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCOMPOUNDFILE_P_H
@@ -27,7 +27,10 @@
 #include "xlsxconditionalformatting_p.h"
 #include "xlsxworksheet.h"
 #include "xlsxcellrange.h"
+#include "xlsxcellrangeset_p.h"
+#include "xlsxcellreference.h"
 #include "xlsxstyles_p.h"
+#include "xlsxutility_p.h"
 
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
@@ -42,6 +45,8 @@ ConditionalFormattingPrivate::ConditionalFormattingPrivate()
 ConditionalFormattingPrivate::ConditionalFormattingPrivate(
     const ConditionalFormattingPrivate &other)
     : QSharedData(other)
+    , cfRules(other.cfRules)
+    , ranges(other.ranges)
 {
 }
 
@@ -49,6 +54,49 @@ ConditionalFormattingPrivate::~ConditionalFormattingPrivate()
 {
 }
 
+/*
+  Returns a key which is the same for the conditional formattings which
+  only differ by their ranges, so that they can be merged into one.
+  Returns an empty string if the formatting shouldn't be merged: rules
+  computed from all the values of their ranges, such as top 10 rules or
+  color scales, would change, and some formulas can't be compared.
+ */
+QString ConditionalFormattingPrivate::mergeKey() const
+{
+    if (ranges.isEmpty() || cfRules.isEmpty())
+        return QString();
+    const CellReference root = ranges.first().topLeft();
+
+    QStringList parts;
+    foreach (const QSharedPointer<XlsxCfRuleData> &rule, cfRules) {
+        const QString type = rule->attrs.value(XlsxCfRuleData::A_type).toString();
+        if (type == QLatin1String("top10") || type == QLatin1String("aboveAverage")
+            || type == QLatin1String("duplicateValues") || type == QLatin1String("uniqueValues")
+            || type == QLatin1String("colorScale") || type == QLatin1String("dataBar")
+            || type == QLatin1String("iconSet")) {
+            return QString();
+        }
+
+        parts << QString::number(rule->priority)
+              << QString::fromLatin1(rule->dxfFormat.formatKey().toHex());
+        QMap<int, QVariant>::const_iterator it = rule->attrs.constBegin();
+        for (; it != rule->attrs.constEnd(); ++it) {
+            if (!it.value().canConvert<QString>())
+                return QString();
+            QString value = it.value().toString();
+            if (it.key() == XlsxCfRuleData::A_formula1 || it.key() == XlsxCfRuleData::A_formula2
+                || it.key() == XlsxCfRuleData::A_formula3) {
+                value = relativeFormulaKey(value, root);
+                if (value.isNull())
+                    return QString();
+            }
+            parts << QString::number(it.key()) << value;
+        }
+        parts << QString();
+    }
+    return parts.join(QChar(0));
+}
+
 void ConditionalFormattingPrivate::writeCfVo(QXmlStreamWriter &writer,
                                              const XlsxCfVoData &cfvo) const
 {
@@ -462,7 +510,7 @@ QList<CellRange> ConditionalFormatting::ranges() const
  */
 void ConditionalFormatting::addCell(const CellReference &cell)
 {
-    d->ranges.append(CellRange(cell, cell));
+    CellRangeSet::append(d->ranges, CellRange(cell, cell));
 }
 
 /*!
@@ -471,7 +519,7 @@ void ConditionalFormatting::addCell(const CellReference &cell)
  */
 void ConditionalFormatting::addCell(int row, int col)
 {
-    d->ranges.append(CellRange(row, col, row, col));
+    CellRangeSet::append(d->ranges, CellRange(row, col, row, col));
 }
 
 /*!
@@ -481,7 +529,7 @@ void ConditionalFormatting::addCell(int row, int col)
  */
 void ConditionalFormatting::addRange(int firstRow, int firstCol, int lastRow, int lastCol)
 {
-    d->ranges.append(CellRange(firstRow, firstCol, lastRow, lastCol));
+    CellRangeSet::append(d->ranges, CellRange(firstRow, firstCol, lastRow, lastCol));
 }
 
 /*!
@@ -489,7 +537,7 @@ void ConditionalFormatting::addRange(int firstRow, int firstCol, int lastRow, in
  */
 void ConditionalFormatting::addRange(const CellRange &range)
 {
-    d->ranges.append(range);
+    CellRangeSet::append(d->ranges, range);
 }
 
 bool ConditionalFormattingPrivate::readCfRule(QXmlStreamReader &reader, XlsxCfRuleData *rule,
@@ -616,7 +664,7 @@ bool ConditionalFormattingPrivate::readCfColorScale(QXmlStreamReader &reader, Xl
                 else if (!rule->attrs.contains(XlsxCfRuleData::A_cfvo2))
                     rule->attrs[XlsxCfRuleData::A_cfvo2] = QVariant::fromValue(data);
                 else
-                    rule->attrs[XlsxCfRuleData::A_cfvo2] = QVariant::fromValue(data);
+                    rule->attrs[XlsxCfRuleData::A_cfvo3] = QVariant::fromValue(data);
             } else if (reader.name() == QLatin1String("color")) {
                 XlsxColor color;
                 color.loadFromXml(reader);
@@ -699,10 +747,7 @@ bool ConditionalFormatting::loadFromXml(QXmlStreamReader &reader, Styles *styles
 bool ConditionalFormatting::saveToXml(QXmlStreamWriter &writer) const
 {
     writer.writeStartElement(QStringLiteral("conditionalFormatting"));
-    QStringList sqref;
-    foreach (CellRange range, ranges())
-        sqref.append(range.toString());
-    writer.writeAttribute(QStringLiteral("sqref"), sqref.join(QLatin1Char(' ')));
+    writer.writeAttribute(QStringLiteral("sqref"), CellRangeSet(d->ranges).toString());
 
     for (int i = 0; i < d->cfRules.size(); ++i) {
         const QSharedPointer<XlsxCfRuleData> &rule = d->cfRules[i];
@@ -41,6 +41,8 @@ QT_BEGIN_NAMESPACE_XLSX
 
 class Format;
 class Worksheet;
+class ConditionalFormattingEvaluator;
+class WorksheetPrivate;
 class Styles;
 
 class ConditionalFormattingPrivate;
@@ -94,6 +96,15 @@ public:
 
     ConditionalFormatting();
     ConditionalFormatting(const ConditionalFormatting &other);
+#ifdef Q_COMPILER_RVALUE_REFS
+    ConditionalFormatting(ConditionalFormatting &&other) Q_DECL_NOTHROW : d(std::move(other.d)) {}
+    ConditionalFormatting &operator=(ConditionalFormatting &&other) Q_DECL_NOTHROW
+    {
+        swap(other);
+        return *this;
+    }
+#endif
+    void swap(ConditionalFormatting &other) Q_DECL_NOTHROW { d.swap(other.d); }
     ~ConditionalFormatting();
 
     bool addHighlightCellsRule(HighlightRuleType type, const Format &format,
@@ -124,6 +135,8 @@ public:
 
 private:
     friend class Worksheet;
+    friend class ConditionalFormattingEvaluator;
+    friend class WorksheetPrivate;
     friend class ::ConditionalFormattingTest;
     bool saveToXml(QXmlStreamWriter &writer) const;
     bool loadFromXml(QXmlStreamReader &reader, Styles *styles = 0);
@@ -132,4 +145,6 @@ private:
 
 QT_END_NAMESPACE_XLSX
 
+Q_DECLARE_TYPEINFO(QXlsx::ConditionalFormatting, Q_MOVABLE_TYPE);
+
 #endif // QXLSX_XLSXCONDITIONALFORMATTING_H
@@ -118,6 +118,8 @@ public:
     ConditionalFormattingPrivate(const ConditionalFormattingPrivate &other);
     ~ConditionalFormattingPrivate();
 
+    QString mergeKey() const;
+
     void writeCfVo(QXmlStreamWriter &writer, const XlsxCfVoData &cfvo) const;
     bool readCfVo(QXmlStreamReader &reader, XlsxCfVoData &cfvo);
     bool readCfRule(QXmlStreamReader &reader, XlsxCfRuleData *cfRule, Styles *styles);
@@ -0,0 +1,524 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxconditionalformattingevaluator_p.h"
+#include "xlsxconditionalformatting_p.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxcolor_p.h"
+#include "xlsxcellreference.h"
+
+#include <algorithm>
+#include <math.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const QString ruleTypeNames[] = {
+    QString(),
+    QStringLiteral("cellIs"),
+    QStringLiteral("containsText"),
+    QStringLiteral("notContainsText"),
+    QStringLiteral("beginsWith"),
+    QStringLiteral("endsWith"),
+    QStringLiteral("containsBlanks"),
+    QStringLiteral("notContainsBlanks"),
+    QStringLiteral("containsErrors"),
+    QStringLiteral("notContainsErrors"),
+    QStringLiteral("duplicateValues"),
+    QStringLiteral("uniqueValues"),
+    QStringLiteral("top10"),
+    QStringLiteral("aboveAverage"),
+    QStringLiteral("expression"),
+    QStringLiteral("colorScale"),
+    QStringLiteral("dataBar")
+};
+
+/*
+  The key under which duplicateValues and uniqueValues rules count
+  \a value. Text is compared case-insensitively, as Excel does, and
+  blank cells are not counted.
+ */
+QString valueKey(const FormulaValue &value)
+{
+    switch (value.type) {
+    case FormulaValue::Number:
+        return QLatin1Char('n') + QString::number(value.number, 'g', 17);
+    case FormulaValue::String:
+        return value.text.isEmpty() ? QString() : QLatin1Char('s') + value.text.toLower();
+    case FormulaValue::Boolean:
+        return QLatin1Char('b') + QString::number(value.number);
+    case FormulaValue::Error:
+        return QLatin1Char('e') + value.text;
+    default:
+        return QString();
+    }
+}
+
+bool isTrue(const FormulaValue &value)
+{
+    return (value.type == FormulaValue::Number || value.type == FormulaValue::Boolean)
+           && value.number != 0;
+}
+
+/*
+  The value at \a fraction of the sorted \a numbers, interpolated like
+  PERCENTILE() does.
+ */
+double percentile(const QVector<double> &numbers, double fraction)
+{
+    fraction = qBound(0.0, fraction, 1.0);
+    const double rank = fraction * (numbers.size() - 1);
+    const int lower = int(floor(rank));
+    if (lower + 1 >= numbers.size())
+        return numbers.last();
+    return numbers[lower] + (rank - lower) * (numbers[lower + 1] - numbers[lower]);
+}
+
+QColor interpolateColor(const QColor &from, const QColor &to, double fraction)
+{
+    return QColor::fromRgbF(from.redF() + (to.redF() - from.redF()) * fraction,
+                            from.greenF() + (to.greenF() - from.greenF()) * fraction,
+                            from.blueF() + (to.blueF() - from.blueF()) * fraction,
+                            from.alphaF() + (to.alphaF() - from.alphaF()) * fraction);
+}
+
+/*
+  The color of the rule, the indexed and theme colors being looked up in
+  \a styles and \a theme.
+ */
+QColor ruleColor(const XlsxCfRuleData &rule, int attribute, const Styles *styles,
+                 const Theme *theme)
+{
+    if (!rule.attrs.contains(attribute))
+        return QColor();
+    return rule.attrs[attribute].value<XlsxColor>().resolvedColor(styles, theme);
+}
+
+} // namespace
+
+bool ConditionalFormattingEvaluator::RuleRef::operator<(const RuleRef &other) const
+{
+    if (priority != other.priority)
+        return priority < other.priority;
+    if (formatting != other.formatting)
+        return formatting < other.formatting;
+    return rule < other.rule;
+}
+
+ConditionalFormattingEvaluator::RuleState::RuleState()
+    : type(UnsupportedRule)
+    , average(0)
+    , stdDev(0)
+    , threshold(0)
+    , operandsConstant(true)
+{
+    scale[0] = scale[1] = scale[2] = 0;
+}
+
+ConditionalFormattingEvaluator::ConditionalFormattingEvaluator(const WorksheetPrivate *sheet)
+    : m_sheet(sheet)
+{
+}
+
+/*
+  Returns the format the conditional formattings give to the cell
+  (\a row, \a column), or an invalid format if none applies. When
+  several rules match, the properties of the rule with the higher
+  priority win. Color scales give a solid fill.
+ */
+Format ConditionalFormattingEvaluator::format(int row, int column)
+{
+    QVector<Format> formats;
+    foreach (const RuleRef &ref, rulesAt(row, column)) {
+        const XlsxCfRuleData &rule = ruleData(ref);
+        const RuleState &ruleState = state(ref);
+        if (ruleState.type == ColorScaleRule) {
+            const FormulaValue value = FormulaEngine::cellValue(m_sheet, row, column);
+            QColor color;
+            if (value.type != FormulaValue::Number || !scaleColor(ruleState, value.number, &color))
+                continue;
+            Format fill;
+            fill.setFillPattern(Format::PatternSolid);
+            fill.setPatternBackgroundColor(color);
+            formats.append(fill);
+        } else if (ruleState.type == DataBarRule || !matches(ruleState, rule, row, column)) {
+            continue;
+        } else {
+            formats.append(rule.dxfFormat);
+        }
+        if (rule.attrs.value(XlsxCfRuleData::A_stopIfTrue).toBool())
+            break;
+    }
+
+    Format result;
+    for (int i = formats.size() - 1; i >= 0; --i)
+        result.mergeFormat(formats[i]);
+    return result;
+}
+
+/*
+  Returns true if a data bar rule applies to the cell (\a row, \a column),
+  storing the length of its bar, from 0 to 1 of the cell width, in
+  \a length and its color in \a color.
+ */
+bool ConditionalFormattingEvaluator::dataBar(int row, int column, double *length, QColor *color)
+{
+    foreach (const RuleRef &ref, rulesAt(row, column)) {
+        const RuleState &ruleState = state(ref);
+        if (ruleState.type != DataBarRule)
+            continue;
+        const FormulaValue value = FormulaEngine::cellValue(m_sheet, row, column);
+        if (value.type != FormulaValue::Number || ruleState.numbers.isEmpty())
+            return false;
+        const double span = ruleState.scale[1] - ruleState.scale[0];
+        const double fraction = span > 0 ? (value.number - ruleState.scale[0]) / span : 1.0;
+        if (length)
+            *length = qBound(0.0, fraction, 1.0);
+        if (color)
+            *color = ruleState.colors[0];
+        return true;
+    }
+    return false;
+}
+
+/*
+  The rules which apply to the cell (\a row, \a column), in the order
+  they are evaluated.
+ */
+QVector<ConditionalFormattingEvaluator::RuleRef> ConditionalFormattingEvaluator::rulesAt(
+    int row, int column) const
+{
+    QVector<RuleRef> refs;
+    foreach (int index, m_sheet->conditionalFormattingIndex.valuesAt(row, column)) {
+        const ConditionalFormatting &cf = m_sheet->conditionalFormattingList[index];
+        for (int i = 0; i < cf.d->cfRules.size(); ++i) {
+            RuleRef ref;
+            ref.formatting = index;
+            ref.rule = i;
+            ref.priority = cf.d->cfRules[i]->priority;
+            refs.append(ref);
+        }
+    }
+    std::sort(refs.begin(), refs.end());
+    return refs;
+}
+
+const XlsxCfRuleData &ConditionalFormattingEvaluator::ruleData(const RuleRef &ref) const
+{
+    return *m_sheet->conditionalFormattingList[ref.formatting].d->cfRules[ref.rule];
+}
+
+const ConditionalFormattingEvaluator::RuleState &ConditionalFormattingEvaluator::state(
+    const RuleRef &ref)
+{
+    const quint64 key = (quint64(ref.formatting) << 32) | quint32(ref.rule);
+    QHash<quint64, RuleState>::iterator it = m_states.find(key);
+    if (it == m_states.end()) {
+        it = m_states.insert(key, RuleState());
+        initState(ruleData(ref), ref.formatting, &it.value());
+    }
+    return it.value();
+}
+
+/*
+  Computes what \a rule, of the conditional formatting \a formatting,
+  needs to be evaluated: the statistics of the values of its ranges
+  and its constant operands.
+ */
+void ConditionalFormattingEvaluator::initState(const XlsxCfRuleData &rule, int formatting,
+                                               RuleState *state) const
+{
+    const QString typeName = rule.attrs.value(XlsxCfRuleData::A_type).toString();
+    for (int i = CellIsRule; i <= DataBarRule; ++i) {
+        if (ruleTypeNames[i] == typeName) {
+            state->type = RuleType(i);
+            break;
+        }
+    }
+
+    const ConditionalFormatting &cf = m_sheet->conditionalFormattingList[formatting];
+    const QList<CellRange> ranges = cf.ranges();
+    if (ranges.isEmpty())
+        return;
+    // Relative references of the formulas are relative to the top left cell
+    const CellReference root = ranges.first().topLeft();
+
+    if (state->type == CellIsRule || state->type == ExpressionRule) {
+        const QString formula1 = rule.attrs.value(XlsxCfRuleData::A_formula1).toString();
+        const QString formula2 = rule.attrs.value(XlsxCfRuleData::A_formula2).toString();
+        state->operand1 = SharedFormulaTemplate(formula1, root);
+        state->operand2 = SharedFormulaTemplate(formula2, root);
+        state->operandsConstant = state->type == CellIsRule
+                                  && ParsedFormula(formula1).referenceNodes().isEmpty()
+                                  && ParsedFormula(formula2).referenceNodes().isEmpty();
+        if (state->operandsConstant) {
+            state->value1 = formulaValue(formula1);
+            state->value2 = formulaValue(formula2);
+        }
+        return;
+    }
+
+    const bool needNumbers = state->type == Top10Rule || state->type == AboveAverageRule
+                             || state->type == ColorScaleRule || state->type == DataBarRule;
+    const bool needCounts = state->type == DuplicateRule || state->type == UniqueRule;
+    if (!needNumbers && !needCounts)
+        return;
+
+    // All values of the ranges are read once, here
+    const CellTable &table = m_sheet->cellTable;
+    foreach (const CellRange &range, ranges) {
+        for (int i = table.rowLowerBound(range.firstRow());
+             i < table.size() && table.rowNumberAt(i) <= range.lastRow(); ++i) {
+            const int row = table.rowNumberAt(i);
+            const CellRow &cells = table.rowAt(i);
+            for (int j = cells.lowerBound(range.firstColumn());
+                 j < cells.size() && cells.columns[j] <= range.lastColumn(); ++j) {
+                const FormulaValue value =
+                    FormulaEngine::cellValue(m_sheet, row, cells.columns[j]);
+                if (needNumbers && value.type == FormulaValue::Number)
+                    state->numbers.append(value.number);
+                if (needCounts) {
+                    const QString key = valueKey(value);
+                    if (!key.isEmpty())
+                        ++state->counts[key];
+                }
+            }
+        }
+    }
+
+    if (state->numbers.isEmpty())
+        return;
+    std::sort(state->numbers.begin(), state->numbers.end());
+    const QVector<double> &numbers = state->numbers;
+    const int count = numbers.size();
+
+    if (state->type == Top10Rule) {
+        const int rank = rule.attrs.value(XlsxCfRuleData::A_rank, 10).toInt();
+        int selected = rule.attrs.value(XlsxCfRuleData::A_percent).toBool()
+                           ? int(floor(count * rank / 100.0))
+                           : rank;
+        selected = qBound(1, selected, count);
+        state->threshold = rule.attrs.value(XlsxCfRuleData::A_bottom).toBool()
+                               ? numbers[selected - 1]
+                               : numbers[count - selected];
+    } else if (state->type == AboveAverageRule) {
+        double sum = 0;
+        foreach (double number, numbers)
+            sum += number;
+        state->average = sum / count;
+        // Population standard deviation, like STDEVP()
+        double squares = 0;
+        foreach (double number, numbers)
+            squares += (number - state->average) * (number - state->average);
+        state->stdDev = sqrt(squares / count);
+    } else {
+        const int points = state->type == ColorScaleRule
+                                   && rule.attrs.contains(XlsxCfRuleData::A_cfvo3)
+                               ? 3
+                               : 2;
+        Workbook *book = m_sheet->workbook;
+        const Styles *styles = book ? book->styles() : 0;
+        const Theme *theme = book ? book->theme() : 0;
+        for (int i = 0; i < points; ++i) {
+            const QVariant cfvo = rule.attrs.value(XlsxCfRuleData::A_cfvo1 + i);
+            state->scale[i] = scaleValue(cfvo.value<XlsxCfVoData>(), numbers);
+            state->colors[i] = ruleColor(rule, XlsxCfRuleData::A_color1 + i, styles, theme);
+        }
+    }
+}
+
+/*
+  The value of the threshold \a cfvo of a color scale or data bar, for
+  the sorted \a numbers of its ranges.
+ */
+double ConditionalFormattingEvaluator::scaleValue(const XlsxCfVoData &cfvo,
+                                                  const QVector<double> &numbers) const
+{
+    bool ok = false;
+    double value = cfvo.value.toDouble(&ok);
+    if (!ok && cfvo.type != ConditionalFormatting::VOT_Min
+        && cfvo.type != ConditionalFormatting::VOT_Max) {
+        const FormulaValue result = formulaValue(cfvo.value);
+        value = result.type == FormulaValue::Number ? result.number : 0;
+    }
+
+    switch (cfvo.type) {
+    case ConditionalFormatting::VOT_Min:
+        return numbers.first();
+    case ConditionalFormatting::VOT_Max:
+        return numbers.last();
+    case ConditionalFormatting::VOT_Percent:
+        return numbers.first() + (numbers.last() - numbers.first()) * value / 100;
+    case ConditionalFormatting::VOT_Percentile:
+        return percentile(numbers, value / 100);
+    default: // VOT_Num and VOT_Formula
+        return value;
+    }
+}
+
+FormulaValue ConditionalFormattingEvaluator::formulaValue(const QString &formula) const
+{
+    if (formula.isEmpty())
+        return FormulaValue();
+    const ParsedFormula parsed(formula);
+    if (!parsed.isValid())
+        return FormulaValue::fromError(QStringLiteral("#NAME?"));
+    return FormulaEngine::evaluate(parsed, m_sheet);
+}
+
+/*
+  Returns true if the highlight \a rule matches the cell (\a row, \a column).
+ */
+bool ConditionalFormattingEvaluator::matches(const RuleState &state, const XlsxCfRuleData &rule,
+                                             int row, int column) const
+{
+    const FormulaValue value = FormulaEngine::cellValue(m_sheet, row, column);
+
+    switch (state.type) {
+    case CellIsRule: {
+        if (value.isError())
+            return false;
+        FormulaValue value1 = state.value1;
+        FormulaValue value2 = state.value2;
+        if (!state.operandsConstant) {
+            const CellReference cell(row, column);
+            value1 = formulaValue(state.operand1.formulaText(cell));
+            value2 = formulaValue(state.operand2.formulaText(cell));
+        }
+        if (value1.isError())
+            return false;
+        const QString op = rule.attrs.value(XlsxCfRuleData::A_operator).toString();
+        const int result = FormulaEngine::compare(value, value1);
+        if (op == QLatin1String("equal"))
+            return result == 0;
+        if (op == QLatin1String("notEqual"))
+            return result != 0;
+        if (op == QLatin1String("greaterThan"))
+            return result > 0;
+        if (op == QLatin1String("greaterThanOrEqual"))
+            return result >= 0;
+        if (op == QLatin1String("lessThan"))
+            return result < 0;
+        if (op == QLatin1String("lessThanOrEqual"))
+            return result <= 0;
+        if (op == QLatin1String("between") || op == QLatin1String("notBetween")) {
+            if (value2.isError())
+                return false;
+            // The bounds may be given in either order
+            const bool swapped = FormulaEngine::compare(value1, value2) > 0;
+            const bool inside = FormulaEngine::compare(value, swapped ? value2 : value1) >= 0
+                                && FormulaEngine::compare(value, swapped ? value1 : value2) <= 0;
+            return op == QLatin1String("between") ? inside : !inside;
+        }
+        return false;
+    }
+    case ContainsTextRule:
+    case NotContainsTextRule:
+    case BeginsWithRule:
+    case EndsWithRule: {
+        if (value.isError())
+            return state.type == NotContainsTextRule;
+        const QString text = FormulaEngine::text(value);
+        const QString needle = rule.attrs.value(XlsxCfRuleData::A_text).toString();
+        if (state.type == BeginsWithRule)
+            return text.startsWith(needle, Qt::CaseInsensitive);
+        if (state.type == EndsWithRule)
+            return text.endsWith(needle, Qt::CaseInsensitive);
+        const bool contains = text.contains(needle, Qt::CaseInsensitive);
+        return state.type == ContainsTextRule ? contains : !contains;
+    }
+    case BlanksRule:
+    case NoBlanksRule: {
+        const bool blank =
+            value.type == FormulaValue::Empty
+            || (value.type == FormulaValue::String && value.text.trimmed().isEmpty());
+        return state.type == BlanksRule ? blank : !blank;
+    }
+    case ErrorsRule:
+        return value.isError();
+    case NoErrorsRule:
+        return !value.isError();
+    case DuplicateRule:
+    case UniqueRule: {
+        const QString key = valueKey(value);
+        if (key.isEmpty())
+            return false;
+        const int count = state.counts.value(key);
+        return state.type == DuplicateRule ? count > 1 : count == 1;
+    }
+    case Top10Rule:
+        if (value.type != FormulaValue::Number || state.numbers.isEmpty())
+            return false;
+        return rule.attrs.value(XlsxCfRuleData::A_bottom).toBool()
+                   ? value.number <= state.threshold
+                   : value.number >= state.threshold;
+    case AboveAverageRule: {
+        if (value.type != FormulaValue::Number || state.numbers.isEmpty())
+            return false;
+        const bool above = rule.attrs.value(XlsxCfRuleData::A_aboveAverage, true).toBool();
+        const bool equal = rule.attrs.value(XlsxCfRuleData::A_equalAverage).toBool();
+        const double offset = rule.attrs.value(XlsxCfRuleData::A_stdDev).toInt() * state.stdDev;
+        if (above) {
+            const double limit = state.average + offset;
+            return equal ? value.number >= limit : value.number > limit;
+        }
+        const double limit = state.average - offset;
+        return equal ? value.number <= limit : value.number < limit;
+    }
+    case ExpressionRule:
+        return isTrue(formulaValue(state.operand1.formulaText(CellReference(row, column))));
+    default:
+        return false;
+    }
+}
+
+/*
+  Stores the color a color scale gives to \a value in \a color. Returns
+  false if the colors of the scale aren't known.
+ */
+bool ConditionalFormattingEvaluator::scaleColor(const RuleState &state, double value,
+                                                QColor *color) const
+{
+    if (state.numbers.isEmpty() || !state.colors[0].isValid() || !state.colors[1].isValid())
+        return false;
+
+    const int last = state.colors[2].isValid() ? 2 : 1;
+    if (value <= state.scale[0]) {
+        *color = state.colors[0];
+        return true;
+    }
+    if (value >= state.scale[last]) {
+        *color = state.colors[last];
+        return true;
+    }
+    const int segment = last == 2 && value > state.scale[1] ? 1 : 0;
+    const double span = state.scale[segment + 1] - state.scale[segment];
+    const double fraction = span > 0 ? (value - state.scale[segment]) / span : 0;
+    *color = interpolateColor(state.colors[segment], state.colors[segment + 1], fraction);
+    return true;
+}
+
+QT_END_NAMESPACE_XLSX
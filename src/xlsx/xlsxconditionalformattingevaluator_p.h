@@ -0,0 +1,142 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCONDITIONALFORMATTINGEVALUATOR_P_H
+#define XLSXCONDITIONALFORMATTINGEVALUATOR_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxformat.h"
+#include "xlsxformulaengine_p.h"
+#include "xlsxutility_p.h"
+
+#include <QColor>
+#include <QHash>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class WorksheetPrivate;
+class XlsxCfRuleData;
+class XlsxCfVoData;
+
+/*
+  Computes the effect of the conditional formattings of a worksheet on
+  its cells. The statistics a rule needs, such as the sorted numbers of
+  its ranges for top 10 and color scale rules, are computed the first
+  time the rule is used, so that each cell then only costs a lookup of
+  its rules and a few comparisons.
+
+  The evaluator must be discarded when the cells or the conditional
+  formattings of the sheet change.
+ */
+class XLSX_AUTOTEST_EXPORT ConditionalFormattingEvaluator
+{
+public:
+    explicit ConditionalFormattingEvaluator(const WorksheetPrivate *sheet);
+
+    Format format(int row, int column);
+    bool dataBar(int row, int column, double *length, QColor *color);
+
+private:
+    Q_DISABLE_COPY(ConditionalFormattingEvaluator)
+
+    enum RuleType {
+        UnsupportedRule,
+        CellIsRule,
+        ContainsTextRule,
+        NotContainsTextRule,
+        BeginsWithRule,
+        EndsWithRule,
+        BlanksRule,
+        NoBlanksRule,
+        ErrorsRule,
+        NoErrorsRule,
+        DuplicateRule,
+        UniqueRule,
+        Top10Rule,
+        AboveAverageRule,
+        ExpressionRule,
+        ColorScaleRule,
+        DataBarRule
+    };
+
+    // A rule of one of the conditional formattings of the sheet
+    struct RuleRef
+    {
+        int formatting;
+        int rule;
+        int priority;
+
+        bool operator<(const RuleRef &other) const;
+    };
+
+    // What a rule needs to be evaluated, computed once
+    struct RuleState
+    {
+        RuleState();
+
+        RuleType type;
+        QVector<double> numbers; // the numbers of the ranges, sorted
+        double average;
+        double stdDev;
+        double threshold; // the last number selected by a top 10 rule
+        double scale[3]; // the values of the color scale or data bar points
+        QColor colors[3];
+        QHash<QString, int> counts; // occurrences of the values, for duplicates
+        // The formulas of cell is and expression rules, and the values of
+        // the formulas of cell is rules when they don't refer to cells
+        SharedFormulaTemplate operand1;
+        SharedFormulaTemplate operand2;
+        bool operandsConstant;
+        FormulaValue value1;
+        FormulaValue value2;
+    };
+
+    QVector<RuleRef> rulesAt(int row, int column) const;
+    const XlsxCfRuleData &ruleData(const RuleRef &ref) const;
+    const RuleState &state(const RuleRef &ref);
+    void initState(const XlsxCfRuleData &rule, int formatting, RuleState *state) const;
+    double scaleValue(const XlsxCfVoData &cfvo, const QVector<double> &numbers) const;
+    FormulaValue formulaValue(const QString &formula) const;
+    bool matches(const RuleState &state, const XlsxCfRuleData &rule, int row, int column) const;
+    bool scaleColor(const RuleState &state, double value, QColor *color) const;
+
+    const WorksheetPrivate *m_sheet;
+    QHash<quint64, RuleState> m_states;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCONDITIONALFORMATTINGEVALUATOR_P_H
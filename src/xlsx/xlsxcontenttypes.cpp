@@ -23,23 +23,81 @@
 **
 ****************************************************************************/
 #include "xlsxcontenttypes_p.h"
-#include <QXmlStreamWriter>
+#include "xlsxsheetdatawriter_p.h"
 #include <QXmlStreamReader>
 #include <QFile>
 #include <QMapIterator>
 #include <QBuffer>
 #include <QDebug>
 
+#include <cstring>
+
 namespace QXlsx {
 
+namespace {
+
+/*
+  Name and content type of each ContentTypes::PartType. The part number,
+  if any, goes between the name prefix and suffix.
+ */
+struct PartTypeInfo
+{
+    const char *prefix;
+    const char *suffix;
+    const char *contentType;
+};
+
+#define XLSX_DOCUMENT_TYPE(type) "application/vnd.openxmlformats-officedocument." type
+#define XLSX_PACKAGE_TYPE(type) "application/vnd.openxmlformats-package." type
+
+const PartTypeInfo partTypeInfos[] = {
+    { "/docProps/core.xml", "", XLSX_PACKAGE_TYPE("core-properties+xml") },
+    { "/docProps/app.xml", "", XLSX_DOCUMENT_TYPE("extended-properties+xml") },
+    { "/xl/styles.xml", "", XLSX_DOCUMENT_TYPE("spreadsheetml.styles+xml") },
+    { "/xl/theme/theme1.xml", "", XLSX_DOCUMENT_TYPE("theme+xml") },
+    { "/xl/workbook.xml", "", XLSX_DOCUMENT_TYPE("spreadsheetml.sheet.main+xml") },
+    { "/xl/worksheets/sheet", ".xml", XLSX_DOCUMENT_TYPE("spreadsheetml.worksheet+xml") },
+    { "/xl/chartsheets/sheet", ".xml", XLSX_DOCUMENT_TYPE("spreadsheetml.chartsheet+xml") },
+    { "/xl/charts/chart", ".xml", XLSX_DOCUMENT_TYPE("drawingml.chart+xml") },
+    { "/xl/drawings/drawing", ".xml", XLSX_DOCUMENT_TYPE("drawing+xml") },
+    { "/xl/comments", ".xml", XLSX_DOCUMENT_TYPE("spreadsheetml.comments+xml") },
+    { "/xl/tables/table", ".xml", XLSX_DOCUMENT_TYPE("spreadsheetml.table+xml") },
+    { "/xl/externalLinks/externalLink", ".xml",
+      XLSX_DOCUMENT_TYPE("spreadsheetml.externalLink+xml") },
+    { "/xl/sharedStrings.xml", "", XLSX_DOCUMENT_TYPE("spreadsheetml.sharedStrings+xml") },
+    { "/xl/calcChain.xml", "", XLSX_DOCUMENT_TYPE("spreadsheetml.calcChain+xml") },
+    { "/xl/workbook.bin", "", "application/vnd.ms-excel.sheet.binary.macroEnabled.main" },
+    { "/xl/styles.bin", "", "application/vnd.ms-excel.styles" },
+    { "/xl/worksheets/sheet", ".bin", "application/vnd.ms-excel.worksheet" },
+    { "/xl/sharedStrings.bin", "", "application/vnd.ms-excel.sharedStrings" }
+};
+
+void writeRawString(SheetDataWriter &writer, const char *data)
+{
+    writer.writeRaw(data, int(strlen(data)));
+}
+
+void writeTypeElement(SheetDataWriter &writer, const char *element, const char *nameAttribute,
+                      const QString &name, const QString &contentType)
+{
+    writer.writeRaw("<");
+    writeRawString(writer, element);
+    writer.writeRaw(" ");
+    writeRawString(writer, nameAttribute);
+    writer.writeRaw("=\"");
+    writer.writeEscapedAttribute(name);
+    writer.writeRaw("\" ContentType=\"");
+    writer.writeEscapedAttribute(contentType);
+    writer.writeRaw("\"/>");
+}
+
+} // namespace
+
 ContentTypes::ContentTypes(CreateFlag flag)
     : AbstractOOXmlFile(flag)
 {
-    m_package_prefix = QStringLiteral("application/vnd.openxmlformats-package.");
-    m_document_prefix = QStringLiteral("application/vnd.openxmlformats-officedocument.");
-
     m_defaults.insert(QStringLiteral("rels"),
-                      m_package_prefix + QStringLiteral("relationships+xml"));
+                      QStringLiteral(XLSX_PACKAGE_TYPE("relationships+xml")));
     m_defaults.insert(QStringLiteral("xml"), QStringLiteral("application/xml"));
 }
 
@@ -50,96 +108,95 @@ void ContentTypes::addDefault(const QString &key, const QString &value)
 
 void ContentTypes::addOverride(const QString &key, const QString &value)
 {
-    m_overrides.insert(key, value);
+    m_customOverrides.insert(key, value);
+}
+
+/*
+  Add the override of the part of the given \a type, \a number is the
+  one in the part name of the numbered parts. Each part is expected to be
+  added once.
+ */
+void ContentTypes::addOverride(PartType type, int number)
+{
+    Override item;
+    item.type = type;
+    item.number = number;
+    m_overrides.append(item);
 }
 
 void ContentTypes::addDocPropApp()
 {
-    addOverride(QStringLiteral("/docProps/app.xml"),
-                m_document_prefix + QStringLiteral("extended-properties+xml"));
+    addOverride(DocPropAppPart);
 }
 
 void ContentTypes::addDocPropCore()
 {
-    addOverride(QStringLiteral("/docProps/core.xml"),
-                m_package_prefix + QStringLiteral("core-properties+xml"));
+    addOverride(DocPropCorePart);
 }
 
 void ContentTypes::addStyles()
 {
-    addOverride(QStringLiteral("/xl/styles.xml"),
-                m_document_prefix + QStringLiteral("spreadsheetml.styles+xml"));
+    addOverride(StylesPart);
 }
 
 void ContentTypes::addTheme()
 {
-    addOverride(QStringLiteral("/xl/theme/theme1.xml"),
-                m_document_prefix + QStringLiteral("theme+xml"));
+    addOverride(ThemePart);
 }
 
 void ContentTypes::addWorkbook()
 {
-    addOverride(QStringLiteral("/xl/workbook.xml"),
-                m_document_prefix + QStringLiteral("spreadsheetml.sheet.main+xml"));
+    addOverride(WorkbookPart);
 }
 
-void ContentTypes::addWorksheetName(const QString &name)
+void ContentTypes::addWorksheet(int number)
 {
-    addOverride(QStringLiteral("/xl/worksheets/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("spreadsheetml.worksheet+xml"));
+    addOverride(WorksheetPart, number);
 }
 
-void ContentTypes::addChartsheetName(const QString &name)
+void ContentTypes::addChartsheet(int number)
 {
-    addOverride(QStringLiteral("/xl/chartsheets/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("spreadsheetml.chartsheet+xml"));
+    addOverride(ChartsheetPart, number);
 }
 
-void ContentTypes::addDrawingName(const QString &name)
+void ContentTypes::addDrawing(int number)
 {
-    addOverride(QStringLiteral("/xl/drawings/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("drawing+xml"));
+    addOverride(DrawingPart, number);
 }
 
-void ContentTypes::addChartName(const QString &name)
+void ContentTypes::addChart(int number)
 {
-    addOverride(QStringLiteral("/xl/charts/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("drawingml.chart+xml"));
+    addOverride(ChartPart, number);
 }
 
-void ContentTypes::addCommentName(const QString &name)
+void ContentTypes::addComment(int number)
 {
-    addOverride(QStringLiteral("/xl/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("spreadsheetml.comments+xml"));
+    addOverride(CommentPart, number);
 }
 
-void ContentTypes::addTableName(const QString &name)
+void ContentTypes::addTable(int number)
 {
-    addOverride(QStringLiteral("/xl/tables/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("spreadsheetml.table+xml"));
+    addOverride(TablePart, number);
 }
 
-void ContentTypes::addExternalLinkName(const QString &name)
+void ContentTypes::addExternalLink(int number)
 {
-    addOverride(QStringLiteral("/xl/externalLinks/%1.xml").arg(name),
-                m_document_prefix + QStringLiteral("spreadsheetml.externalLink+xml"));
+    addOverride(ExternalLinkPart, number);
 }
 
 void ContentTypes::addSharedString()
 {
-    addOverride(QStringLiteral("/xl/sharedStrings.xml"),
-                m_document_prefix + QStringLiteral("spreadsheetml.sharedStrings+xml"));
+    addOverride(SharedStringsPart);
 }
 
 void ContentTypes::addVmlName()
 {
-    addOverride(QStringLiteral("vml"), m_document_prefix + QStringLiteral("vmlDrawing"));
+    addDefault(QStringLiteral("vml"), QStringLiteral(XLSX_DOCUMENT_TYPE("vmlDrawing")));
 }
 
 void ContentTypes::addCalcChain()
 {
-    addOverride(QStringLiteral("/xl/calcChain.xml"),
-                m_document_prefix + QStringLiteral("spreadsheetml.calcChain+xml"));
+    addOverride(CalcChainPart);
 }
 
 void ContentTypes::addVbaProject()
@@ -151,48 +208,49 @@ void ContentTypes::addVbaProject()
 void ContentTypes::clearOverrides()
 {
     m_overrides.clear();
+    m_customOverrides.clear();
 }
 
 void ContentTypes::saveToXmlFile(QIODevice *device) const
 {
-    QXmlStreamWriter writer(device);
-
-    writer.writeStartDocument(QStringLiteral("1.0"), true);
-    writer.writeStartElement(QStringLiteral("Types"));
-    writer.writeAttribute(
-        QStringLiteral("xmlns"),
-        QStringLiteral("http://schemas.openxmlformats.org/package/2006/content-types"));
-
-    {
-        QMapIterator<QString, QString> it(m_defaults);
-        while (it.hasNext()) {
-            it.next();
-            writer.writeStartElement(QStringLiteral("Default"));
-            writer.writeAttribute(QStringLiteral("Extension"), it.key());
-            writer.writeAttribute(QStringLiteral("ContentType"), it.value());
-            writer.writeEndElement(); // Default
-        }
+    SheetDataWriter writer(device);
+
+    writer.writeRaw("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                    "<Types "
+                    "xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">");
+
+    QMapIterator<QString, QString> it(m_defaults);
+    while (it.hasNext()) {
+        it.next();
+        writeTypeElement(writer, "Default", "Extension", it.key(), it.value());
     }
 
-    {
-        QMapIterator<QString, QString> it(m_overrides);
-        while (it.hasNext()) {
-            it.next();
-            writer.writeStartElement(QStringLiteral("Override"));
-            writer.writeAttribute(QStringLiteral("PartName"), it.key());
-            writer.writeAttribute(QStringLiteral("ContentType"), it.value());
-            writer.writeEndElement(); // Override
+    foreach (const Override &item, m_overrides) {
+        const PartTypeInfo &info = partTypeInfos[item.type];
+        writer.writeRaw("<Override PartName=\"");
+        writeRawString(writer, info.prefix);
+        if (*info.suffix) {
+            writer.writeInt(item.number);
+            writeRawString(writer, info.suffix);
         }
+        writer.writeRaw("\" ContentType=\"");
+        writeRawString(writer, info.contentType);
+        writer.writeRaw("\"/>");
     }
 
-    writer.writeEndElement(); // Types
-    writer.writeEndDocument();
+    QMapIterator<QString, QString> customIt(m_customOverrides);
+    while (customIt.hasNext()) {
+        customIt.next();
+        writeTypeElement(writer, "Override", "PartName", customIt.key(), customIt.value());
+    }
+
+    writer.writeRaw("</Types>");
 }
 
 bool ContentTypes::loadFromXmlFile(QIODevice *device)
 {
     m_defaults.clear();
-    m_overrides.clear();
+    clearOverrides();
 
     QXmlStreamReader reader(device);
     while (!reader.atEnd()) {
@@ -207,7 +265,7 @@ bool ContentTypes::loadFromXmlFile(QIODevice *device)
                 QXmlStreamAttributes attrs = reader.attributes();
                 QString partName = attrs.value(QLatin1String("PartName")).toString();
                 QString type = attrs.value(QLatin1String("ContentType")).toString();
-                m_overrides.insert(partName, type);
+                m_customOverrides.insert(partName, type);
             }
         }
 
@@ -41,6 +41,7 @@
 #include <QString>
 #include <QStringList>
 #include <QMap>
+#include <QVector>
 
 class QIODevice;
 
@@ -49,10 +50,35 @@ namespace QXlsx {
 class ContentTypes : public AbstractOOXmlFile
 {
 public:
+    // The parts written by the package, their names and content types are
+    // kept as static byte strings
+    enum PartType {
+        DocPropCorePart,
+        DocPropAppPart,
+        StylesPart,
+        ThemePart,
+        WorkbookPart,
+        WorksheetPart,
+        ChartsheetPart,
+        ChartPart,
+        DrawingPart,
+        CommentPart,
+        TablePart,
+        ExternalLinkPart,
+        SharedStringsPart,
+        CalcChainPart,
+        // The parts of the .xlsb packages
+        BinaryWorkbookPart,
+        BinaryStylesPart,
+        BinaryWorksheetPart,
+        BinarySharedStringsPart
+    };
+
     ContentTypes(CreateFlag flag);
 
     void addDefault(const QString &key, const QString &value);
     void addOverride(const QString &key, const QString &value);
+    void addOverride(PartType type, int number = 0);
 
     // Convenient funcation for addOverride()
     void addDocPropCore();
@@ -60,13 +86,13 @@ public:
     void addStyles();
     void addTheme();
     void addWorkbook();
-    void addWorksheetName(const QString &name);
-    void addChartsheetName(const QString &name);
-    void addChartName(const QString &name);
-    void addDrawingName(const QString &name);
-    void addCommentName(const QString &name);
-    void addTableName(const QString &name);
-    void addExternalLinkName(const QString &name);
+    void addWorksheet(int number);
+    void addChartsheet(int number);
+    void addChart(int number);
+    void addDrawing(int number);
+    void addComment(int number);
+    void addTable(int number);
+    void addExternalLink(int number);
     void addSharedString();
     void addVmlName();
     void addCalcChain();
@@ -78,11 +104,16 @@ public:
     bool loadFromXmlFile(QIODevice *device);
 
 private:
-    QMap<QString, QString> m_defaults;
-    QMap<QString, QString> m_overrides;
+    struct Override
+    {
+        PartType type;
+        int number; // of the numbered parts, such as sheet1.xml
+    };
 
-    QString m_package_prefix;
-    QString m_document_prefix;
+    QMap<QString, QString> m_defaults;
+    QVector<Override> m_overrides;
+    // The overrides given by their part names, and those of loaded packages
+    QMap<QString, QString> m_customOverrides;
 };
 }
 #endif // XLSXCONTENTTYPES_H
@@ -0,0 +1,365 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxcsv_p.h"
+#include "xlsxutility_p.h"
+
+#include <QIODevice>
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const quint64 LowBits = Q_UINT64_C(0x0101010101010101);
+const quint64 HighBits = Q_UINT64_C(0x8080808080808080);
+
+/*
+  Returns a non zero value if one of the bytes of \a word is the byte
+  repeated in \a pattern. Only the lowest flagged byte is certain to
+  match, the bytes of the word are checked one by one afterwards.
+ */
+inline quint64 matchBytes(quint64 word, quint64 pattern)
+{
+    const quint64 bits = word ^ pattern;
+    return (bits - LowBits) & ~bits & HighBits;
+}
+
+/*
+  Returns the end of the unquoted text of a field which starts at \a pos,
+  the quotes in the middle of a field being kept as they are.
+ */
+int fieldEnd(const char *data, int pos, int size, char delimiter)
+{
+    forever {
+        pos += CsvReader::findSpecial(data + pos, size - pos, delimiter);
+        if (pos == size || data[pos] != '"')
+            return pos;
+        ++pos;
+    }
+}
+
+} // namespace
+
+CsvReader::CsvReader(QIODevice *device, char delimiter)
+    : m_device(device)
+    , m_delimiter(delimiter)
+    , m_pos(0)
+    , m_firstBlock(true)
+    , m_atEnd(false)
+    , m_error(false)
+{
+    m_record.data.reserve(BlockSize);
+}
+
+/*
+  Returns the position of the first \a delimiter, quote or line break of
+  the \a size bytes of \a data, or \a size if there is none. Eight bytes
+  are checked at once, this is where the time of a load goes.
+ */
+int CsvReader::findSpecial(const char *data, int size, char delimiter)
+{
+    const quint64 delimiters = LowBits * uchar(delimiter);
+    const quint64 quotes = LowBits * uchar('"');
+    const quint64 returns = LowBits * uchar('\r');
+    const quint64 newlines = LowBits * uchar('\n');
+
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        if (matchBytes(word, delimiters) | matchBytes(word, quotes) | matchBytes(word, returns)
+            | matchBytes(word, newlines)) {
+            break;
+        }
+    }
+    for (; i < size; ++i) {
+        const char c = data[i];
+        if (c == delimiter || c == '"' || c == '\r' || c == '\n')
+            return i;
+    }
+    return size;
+}
+
+/*
+  Returns the position of the first quote of the \a size bytes of
+  \a data, or \a size if there is none.
+ */
+int CsvReader::findQuote(const char *data, int size)
+{
+    const void *quote = memchr(data, '"', size);
+    return quote ? int(static_cast<const char *>(quote) - data) : size;
+}
+
+/*
+  Parse the field of \a size bytes at \a data as a plain decimal number,
+  such as "-12.5" or "1e-3". The numbers with a leading zero, such as the
+  zip code "01234", are texts. Returns false if the field isn't one.
+ */
+bool CsvReader::parseNumber(const char *data, int size, double *number)
+{
+    if (size == 0 || size > 64)
+        return false;
+    const int first = data[0] == '-' ? 1 : 0;
+    if (first + 1 < size && data[first] == '0' && data[first + 1] >= '0'
+        && data[first + 1] <= '9') {
+        return false;
+    }
+    bool digits = false;
+    for (int i = first; i < size; ++i) {
+        const char c = data[i];
+        if (c >= '0' && c <= '9')
+            digits = true;
+        else if (c != '.' && c != 'e' && c != 'E' && c != '+' && c != '-')
+            return false;
+    }
+    if (!digits)
+        return false;
+    bool ok = false;
+    *number = parseDouble(data, size, &ok);
+    return ok;
+}
+
+/*
+  Parse the field of \a size bytes at \a data as TRUE or FALSE, in any
+  case. Returns false if the field isn't one of them.
+ */
+bool CsvReader::parseBoolean(const char *data, int size, bool *value)
+{
+    if (size == 4 && qstrnicmp(data, "true", 4) == 0) {
+        *value = true;
+        return true;
+    }
+    if (size == 5 && qstrnicmp(data, "false", 5) == 0) {
+        *value = false;
+        return true;
+    }
+    return false;
+}
+
+/*
+  Returns the CsvColumnType of each column of \a records: the columns
+  whose fields are all numbers or all booleans have that type, the empty
+  fields aside, the other ones are strings.
+ */
+QVector<int> CsvReader::columnTypes(const QVector<CsvRecord> &records)
+{
+    QVector<int> types;
+    QVector<bool> seen;
+    foreach (const CsvRecord &record, records) {
+        if (record.fieldCount() > types.size()) {
+            types.resize(record.fieldCount());
+            seen.resize(record.fieldCount());
+        }
+        for (int i = 0; i < record.fieldCount(); ++i) {
+            const char *data = record.fieldData(i);
+            const int size = record.fieldSize(i);
+            if (size == 0 || (seen[i] && types[i] == CsvStringColumn))
+                continue;
+            double number;
+            bool boolean;
+            int type = CsvStringColumn;
+            if (parseNumber(data, size, &number))
+                type = CsvNumberColumn;
+            else if (parseBoolean(data, size, &boolean))
+                type = CsvBooleanColumn;
+            types[i] = seen[i] && types[i] != type ? int(CsvStringColumn) : type;
+            seen[i] = true;
+        }
+    }
+    return types;
+}
+
+/*
+  Read the next record, returns false once there is none left. An empty
+  line is a record of one empty field.
+ */
+bool CsvReader::readRecord()
+{
+    forever {
+        if (m_pos < m_buffer.size() && parseRecord(m_atEnd))
+            return true;
+        if (m_atEnd)
+            return false;
+        readBlock();
+    }
+}
+
+/*
+  Append the next block of the device to the bytes not parsed yet. The
+  block grows with the record being parsed, so that a long record isn't
+  parsed again for each block.
+ */
+bool CsvReader::readBlock()
+{
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    const int size = m_buffer.size();
+    const int blockSize = qMax(int(BlockSize), size);
+    m_buffer.resize(size + blockSize);
+    qint64 count = m_device->read(m_buffer.data() + size, blockSize);
+    if (count <= 0) {
+        m_error = count < 0;
+        m_atEnd = true;
+        count = 0;
+    }
+    m_buffer.resize(size + int(count));
+
+    // The byte order mark of UTF-8 is skipped
+    if (m_firstBlock && m_buffer.size() >= 3) {
+        m_firstBlock = false;
+        if (m_buffer.startsWith("\xEF\xBB\xBF"))
+            m_pos = 3;
+    }
+    return count > 0;
+}
+
+/*
+  Parse the record which starts at m_pos. Returns false if more bytes are
+  needed to find its end, unless the device is \a atEnd. A quoted field
+  which isn't closed ends with the file.
+ */
+bool CsvReader::parseRecord(bool atEnd)
+{
+    QByteArray &fields = m_record.data;
+    fields.resize(0);
+    m_record.ends.resize(0);
+    const char *data = m_buffer.constData();
+    const int size = m_buffer.size();
+    int pos = m_pos;
+
+    forever {
+        if (pos < size && data[pos] == '"') {
+            ++pos;
+            forever {
+                const int quote = pos + findQuote(data + pos, size - pos);
+                if ((quote == size || quote + 1 == size) && !atEnd)
+                    return false;
+                fields.append(data + pos, quote - pos);
+                pos = qMin(quote + 1, size);
+                // Two quotes stand for one
+                if (pos == size || data[pos] != '"')
+                    break;
+                fields.append('"');
+                ++pos;
+            }
+        }
+        // The text following the closing quote is kept too
+        const int end = fieldEnd(data, pos, size, m_delimiter);
+        fields.append(data + pos, end - pos);
+        pos = end;
+        m_record.ends.append(fields.size());
+
+        if (pos == size) {
+            if (!atEnd)
+                return false;
+            break;
+        }
+        const char c = data[pos++];
+        if (c == m_delimiter)
+            continue;
+        if (c == '\r') {
+            if (pos == size && !atEnd)
+                return false;
+            if (pos < size && data[pos] == '\n')
+                ++pos;
+        }
+        break;
+    }
+    m_pos = pos;
+    return true;
+}
+
+CsvWriter::CsvWriter(QIODevice *device, char delimiter)
+    : m_device(device)
+    , m_delimiter(delimiter)
+    , m_recordStarted(false)
+    , m_error(false)
+{
+    m_buffer.reserve(BufferSize + 1024);
+}
+
+CsvWriter::~CsvWriter()
+{
+    flush();
+}
+
+/*
+  Write the next field of the record, the \a size bytes of UTF-8 \a data.
+ */
+void CsvWriter::writeField(const char *data, int size)
+{
+    if (m_recordStarted)
+        m_buffer.append(m_delimiter);
+    m_recordStarted = true;
+
+    if (CsvReader::findSpecial(data, size, m_delimiter) == size) {
+        m_buffer.append(data, size);
+    } else {
+        m_buffer.append('"');
+        int pos = 0;
+        forever {
+            const int quote = pos + CsvReader::findQuote(data + pos, size - pos);
+            m_buffer.append(data + pos, quote - pos);
+            if (quote == size)
+                break;
+            m_buffer.append("\"\"", 2);
+            pos = quote + 1;
+        }
+        m_buffer.append('"');
+    }
+    if (m_buffer.size() >= BufferSize)
+        flush();
+}
+
+void CsvWriter::writeField(const QString &text)
+{
+    const QByteArray data = text.toUtf8();
+    writeField(data.constData(), data.size());
+}
+
+void CsvWriter::endRecord()
+{
+    m_buffer.append("\r\n", 2);
+    m_recordStarted = false;
+    if (m_buffer.size() >= BufferSize)
+        flush();
+}
+
+/*
+  Write the buffered records to the device. Returns false if the device
+  failed to write some of them.
+ */
+bool CsvWriter::flush()
+{
+    if (!m_buffer.isEmpty()) {
+        if (m_device->write(m_buffer) != m_buffer.size())
+            m_error = true;
+        m_buffer.resize(0);
+    }
+    return !m_error;
+}
+
+QT_END_NAMESPACE_XLSX
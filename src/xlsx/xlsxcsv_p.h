@@ -0,0 +1,143 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXCSV_P_H
+#define XLSXCSV_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The fields of one record, as undecoded UTF-8 without their quotes.
+ */
+class CsvRecord
+{
+public:
+    int fieldCount() const { return ends.size(); }
+    int fieldStart(int index) const { return index ? ends[index - 1] : 0; }
+    int fieldSize(int index) const { return ends[index] - fieldStart(index); }
+    const char *fieldData(int index) const { return data.constData() + fieldStart(index); }
+    QString fieldText(int index) const
+    {
+        return QString::fromUtf8(fieldData(index), fieldSize(index));
+    }
+
+    QByteArray data; // the fields one after another
+    QVector<int> ends; // the end of each field in data
+};
+
+enum CsvColumnType {
+    CsvStringColumn,
+    CsvNumberColumn,
+    CsvBooleanColumn
+};
+
+/*
+  Reads the records of a UTF-8 CSV file as described by RFC 4180, one
+  record at a time. The device is read by large blocks, and the bytes of
+  the fields are scanned a machine word at a time for the delimiter, the
+  quote and the line breaks.
+ */
+class XLSX_AUTOTEST_EXPORT CsvReader
+{
+public:
+    CsvReader(QIODevice *device, char delimiter);
+
+    bool readRecord();
+    const CsvRecord &record() const { return m_record; }
+    bool hasError() const { return m_error; }
+
+    static int findSpecial(const char *data, int size, char delimiter);
+    static int findQuote(const char *data, int size);
+    static bool parseNumber(const char *data, int size, double *number);
+    static bool parseBoolean(const char *data, int size, bool *value);
+    static QVector<int> columnTypes(const QVector<CsvRecord> &records);
+
+private:
+    Q_DISABLE_COPY(CsvReader)
+
+    enum { BlockSize = 64 * 1024 };
+
+    bool parseRecord(bool atEnd);
+    bool readBlock();
+
+    QIODevice *m_device;
+    char m_delimiter;
+    QByteArray m_buffer; // bytes read from the device
+    int m_pos; // start of the next record in m_buffer
+    bool m_firstBlock;
+    bool m_atEnd; // nothing more can be read from the device
+    bool m_error;
+    CsvRecord m_record;
+};
+
+/*
+  Writes the records of a UTF-8 CSV file, the fields which contain the
+  delimiter, a quote or a line break being quoted. The records end with
+  CRLF, and are written to the device in large blocks.
+ */
+class XLSX_AUTOTEST_EXPORT CsvWriter
+{
+public:
+    CsvWriter(QIODevice *device, char delimiter);
+    ~CsvWriter();
+
+    void writeField(const char *data, int size);
+    void writeField(const QString &text);
+    void endRecord();
+    bool flush();
+
+private:
+    Q_DISABLE_COPY(CsvWriter)
+
+    enum { BufferSize = 64 * 1024 };
+
+    QIODevice *m_device;
+    char m_delimiter;
+    bool m_recordStarted;
+    bool m_error;
+    QByteArray m_buffer;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXCSV_P_H
@@ -27,6 +27,9 @@
 #include "xlsxdatavalidation_p.h"
 #include "xlsxworksheet.h"
 #include "xlsxcellrange.h"
+#include "xlsxcellrangeset_p.h"
+#include "xlsxcellreference.h"
+#include "xlsxutility_p.h"
 
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
@@ -60,12 +63,19 @@ DataValidationPrivate::DataValidationPrivate(DataValidation::ValidationType type
 
 DataValidationPrivate::DataValidationPrivate(const DataValidationPrivate &other)
     : QSharedData(other)
-    , validationType(DataValidation::None)
-    , validationOperator(DataValidation::Between)
-    , errorStyle(DataValidation::Stop)
-    , allowBlank(false)
-    , isPromptMessageVisible(true)
-    , isErrorMessageVisible(true)
+    , validationType(other.validationType)
+    , validationOperator(other.validationOperator)
+    , errorStyle(other.errorStyle)
+    , allowBlank(other.allowBlank)
+    , isPromptMessageVisible(other.isPromptMessageVisible)
+    , isErrorMessageVisible(other.isErrorMessageVisible)
+    , formula1(other.formula1)
+    , formula2(other.formula2)
+    , errorMessage(other.errorMessage)
+    , errorMessageTitle(other.errorMessageTitle)
+    , promptMessage(other.promptMessage)
+    , promptMessageTitle(other.promptMessageTitle)
+    , ranges(other.ranges)
 {
 }
 
@@ -73,6 +83,33 @@ DataValidationPrivate::~DataValidationPrivate()
 {
 }
 
+/*
+  Returns a key which is the same for the validations which only differ
+  by their ranges, so that they can be merged into one. The relative
+  references of the formulas are taken from the top left cell of the
+  first range. Returns an empty string if the validation shouldn't be
+  merged, for example because a formula could refer to cells in a way
+  which can't be told apart from its text.
+ */
+QString DataValidationPrivate::mergeKey() const
+{
+    if (ranges.isEmpty())
+        return QString();
+    const CellReference root = ranges.first().topLeft();
+    const QString key1 = relativeFormulaKey(formula1, root);
+    const QString key2 = relativeFormulaKey(formula2, root);
+    if (key1.isNull() || key2.isNull())
+        return QString();
+
+    QStringList parts;
+    parts << QString::number(validationType) << QString::number(validationOperator)
+          << QString::number(errorStyle) << QString::number(allowBlank)
+          << QString::number(isPromptMessageVisible) << QString::number(isErrorMessageVisible)
+          << key1 << key2 << errorMessage << errorMessageTitle << promptMessage
+          << promptMessageTitle;
+    return parts.join(QChar(0));
+}
+
 /*!
  * \class DataValidation
  * \brief Data validation for single cell or a range
@@ -363,7 +400,7 @@ void DataValidation::setErrorMessageVisible(bool visible)
  */
 void DataValidation::addCell(const CellReference &cell)
 {
-    d->ranges.append(CellRange(cell, cell));
+    CellRangeSet::append(d->ranges, CellRange(cell, cell));
 }
 
 /*!
@@ -372,7 +409,7 @@ void DataValidation::addCell(const CellReference &cell)
  */
 void DataValidation::addCell(int row, int col)
 {
-    d->ranges.append(CellRange(row, col, row, col));
+    CellRangeSet::append(d->ranges, CellRange(row, col, row, col));
 }
 
 /*!
@@ -382,7 +419,7 @@ void DataValidation::addCell(int row, int col)
  */
 void DataValidation::addRange(int firstRow, int firstCol, int lastRow, int lastCol)
 {
-    d->ranges.append(CellRange(firstRow, firstCol, lastRow, lastCol));
+    CellRangeSet::append(d->ranges, CellRange(firstRow, firstCol, lastRow, lastCol));
 }
 
 /*!
@@ -390,40 +427,71 @@ void DataValidation::addRange(int firstRow, int firstCol, int lastRow, int lastC
  */
 void DataValidation::addRange(const CellRange &range)
 {
-    d->ranges.append(range);
+    CellRangeSet::append(d->ranges, range);
+}
+
+namespace {
+
+QMap<DataValidation::ValidationType, QString> validationTypeStrings()
+{
+    QMap<DataValidation::ValidationType, QString> typeMap;
+    typeMap.insert(DataValidation::None, QStringLiteral("none"));
+    typeMap.insert(DataValidation::Whole, QStringLiteral("whole"));
+    typeMap.insert(DataValidation::Decimal, QStringLiteral("decimal"));
+    typeMap.insert(DataValidation::List, QStringLiteral("list"));
+    typeMap.insert(DataValidation::Date, QStringLiteral("date"));
+    typeMap.insert(DataValidation::Time, QStringLiteral("time"));
+    typeMap.insert(DataValidation::TextLength, QStringLiteral("textLength"));
+    typeMap.insert(DataValidation::Custom, QStringLiteral("custom"));
+    return typeMap;
+}
+
+QMap<DataValidation::ValidationOperator, QString> validationOperatorStrings()
+{
+    QMap<DataValidation::ValidationOperator, QString> opMap;
+    opMap.insert(DataValidation::Between, QStringLiteral("between"));
+    opMap.insert(DataValidation::NotBetween, QStringLiteral("notBetween"));
+    opMap.insert(DataValidation::Equal, QStringLiteral("equal"));
+    opMap.insert(DataValidation::NotEqual, QStringLiteral("notEqual"));
+    opMap.insert(DataValidation::LessThan, QStringLiteral("lessThan"));
+    opMap.insert(DataValidation::LessThanOrEqual, QStringLiteral("lessThanOrEqual"));
+    opMap.insert(DataValidation::GreaterThan, QStringLiteral("greaterThan"));
+    opMap.insert(DataValidation::GreaterThanOrEqual, QStringLiteral("greaterThanOrEqual"));
+    return opMap;
+}
+
+QMap<DataValidation::ErrorStyle, QString> errorStyleStrings()
+{
+    QMap<DataValidation::ErrorStyle, QString> esMap;
+    esMap.insert(DataValidation::Stop, QStringLiteral("stop"));
+    esMap.insert(DataValidation::Warning, QStringLiteral("warning"));
+    esMap.insert(DataValidation::Information, QStringLiteral("information"));
+    return esMap;
+}
+
+template <typename T>
+QMap<QString, T> reversedMap(const QMap<T, QString> &map)
+{
+    QMap<QString, T> result;
+    for (typename QMap<T, QString>::const_iterator it = map.constBegin(); it != map.constEnd();
+         ++it) {
+        result.insert(it.value(), it.key());
+    }
+    return result;
 }
 
+} // namespace
+
 /*!
  * \internal
  */
 bool DataValidation::saveToXml(QXmlStreamWriter &writer) const
 {
-    static QMap<DataValidation::ValidationType, QString> typeMap;
-    static QMap<DataValidation::ValidationOperator, QString> opMap;
-    static QMap<DataValidation::ErrorStyle, QString> esMap;
-    if (typeMap.isEmpty()) {
-        typeMap.insert(DataValidation::None, QStringLiteral("none"));
-        typeMap.insert(DataValidation::Whole, QStringLiteral("whole"));
-        typeMap.insert(DataValidation::Decimal, QStringLiteral("decimal"));
-        typeMap.insert(DataValidation::List, QStringLiteral("list"));
-        typeMap.insert(DataValidation::Date, QStringLiteral("date"));
-        typeMap.insert(DataValidation::Time, QStringLiteral("time"));
-        typeMap.insert(DataValidation::TextLength, QStringLiteral("textLength"));
-        typeMap.insert(DataValidation::Custom, QStringLiteral("custom"));
-
-        opMap.insert(DataValidation::Between, QStringLiteral("between"));
-        opMap.insert(DataValidation::NotBetween, QStringLiteral("notBetween"));
-        opMap.insert(DataValidation::Equal, QStringLiteral("equal"));
-        opMap.insert(DataValidation::NotEqual, QStringLiteral("notEqual"));
-        opMap.insert(DataValidation::LessThan, QStringLiteral("lessThan"));
-        opMap.insert(DataValidation::LessThanOrEqual, QStringLiteral("lessThanOrEqual"));
-        opMap.insert(DataValidation::GreaterThan, QStringLiteral("greaterThan"));
-        opMap.insert(DataValidation::GreaterThanOrEqual, QStringLiteral("greaterThanOrEqual"));
-
-        esMap.insert(DataValidation::Stop, QStringLiteral("stop"));
-        esMap.insert(DataValidation::Warning, QStringLiteral("warning"));
-        esMap.insert(DataValidation::Information, QStringLiteral("information"));
-    }
+    // Thread-safe initialization, sheets may be saved concurrently.
+    static const QMap<DataValidation::ValidationType, QString> typeMap = validationTypeStrings();
+    static const QMap<DataValidation::ValidationOperator, QString> opMap =
+        validationOperatorStrings();
+    static const QMap<DataValidation::ErrorStyle, QString> esMap = errorStyleStrings();
 
     writer.writeStartElement(QStringLiteral("dataValidation"));
     if (validationType() != DataValidation::None)
@@ -449,10 +517,7 @@ bool DataValidation::saveToXml(QXmlStreamWriter &writer) const
     if (!promptMessage().isEmpty())
         writer.writeAttribute(QStringLiteral("prompt"), promptMessage());
 
-    QStringList sqref;
-    foreach (CellRange range, ranges())
-        sqref.append(range.toString());
-    writer.writeAttribute(QStringLiteral("sqref"), sqref.join(QLatin1Char(' ')));
+    writer.writeAttribute(QStringLiteral("sqref"), CellRangeSet(d->ranges).toString());
 
     if (!formula1().isEmpty())
         writer.writeTextElement(QStringLiteral("formula1"), formula1());
@@ -471,32 +536,13 @@ DataValidation DataValidation::loadFromXml(QXmlStreamReader &reader)
 {
     Q_ASSERT(reader.name() == QLatin1String("dataValidation"));
 
-    static QMap<QString, DataValidation::ValidationType> typeMap;
-    static QMap<QString, DataValidation::ValidationOperator> opMap;
-    static QMap<QString, DataValidation::ErrorStyle> esMap;
-    if (typeMap.isEmpty()) {
-        typeMap.insert(QStringLiteral("none"), DataValidation::None);
-        typeMap.insert(QStringLiteral("whole"), DataValidation::Whole);
-        typeMap.insert(QStringLiteral("decimal"), DataValidation::Decimal);
-        typeMap.insert(QStringLiteral("list"), DataValidation::List);
-        typeMap.insert(QStringLiteral("date"), DataValidation::Date);
-        typeMap.insert(QStringLiteral("time"), DataValidation::Time);
-        typeMap.insert(QStringLiteral("textLength"), DataValidation::TextLength);
-        typeMap.insert(QStringLiteral("custom"), DataValidation::Custom);
-
-        opMap.insert(QStringLiteral("between"), DataValidation::Between);
-        opMap.insert(QStringLiteral("notBetween"), DataValidation::NotBetween);
-        opMap.insert(QStringLiteral("equal"), DataValidation::Equal);
-        opMap.insert(QStringLiteral("notEqual"), DataValidation::NotEqual);
-        opMap.insert(QStringLiteral("lessThan"), DataValidation::LessThan);
-        opMap.insert(QStringLiteral("lessThanOrEqual"), DataValidation::LessThanOrEqual);
-        opMap.insert(QStringLiteral("greaterThan"), DataValidation::GreaterThan);
-        opMap.insert(QStringLiteral("greaterThanOrEqual"), DataValidation::GreaterThanOrEqual);
-
-        esMap.insert(QStringLiteral("stop"), DataValidation::Stop);
-        esMap.insert(QStringLiteral("warning"), DataValidation::Warning);
-        esMap.insert(QStringLiteral("information"), DataValidation::Information);
-    }
+    // Thread-safe initialization, sheets may be loaded concurrently.
+    static const QMap<QString, DataValidation::ValidationType> typeMap =
+        reversedMap(validationTypeStrings());
+    static const QMap<QString, DataValidation::ValidationOperator> opMap =
+        reversedMap(validationOperatorStrings());
+    static const QMap<QString, DataValidation::ErrorStyle> esMap =
+        reversedMap(errorStyleStrings());
 
     DataValidation validation;
     QXmlStreamAttributes attrs = reader.attributes();
@@ -558,4 +604,30 @@ DataValidation DataValidation::loadFromXml(QXmlStreamReader &reader)
     return validation;
 }
 
+/*!
+ * \class DataValidationViolation
+ * \brief A cell whose value isn't allowed by a data validation
+ * \inmodule QtXlsx
+ *
+ * Violations are returned by Worksheet::validate().
+ */
+
+/*!
+ * \variable DataValidationViolation::row
+ *
+ * The row of the cell.
+ */
+
+/*!
+ * \variable DataValidationViolation::column
+ *
+ * The column of the cell.
+ */
+
+/*!
+ * \variable DataValidationViolation::validation
+ *
+ * The data validation which doesn't allow the value of the cell.
+ */
+
 QT_END_NAMESPACE_XLSX
@@ -40,6 +40,7 @@ class CellRange;
 class CellReference;
 
 class DataValidationPrivate;
+class WorksheetPrivate;
 class Q_XLSX_EXPORT DataValidation
 {
 public:
@@ -63,6 +64,15 @@ public:
                    const QString &formula1 = QString(), const QString &formula2 = QString(),
                    bool allowBlank = false);
     DataValidation(const DataValidation &other);
+#ifdef Q_COMPILER_RVALUE_REFS
+    DataValidation(DataValidation &&other) Q_DECL_NOTHROW : d(std::move(other.d)) {}
+    DataValidation &operator=(DataValidation &&other) Q_DECL_NOTHROW
+    {
+        swap(other);
+        return *this;
+    }
+#endif
+    void swap(DataValidation &other) Q_DECL_NOTHROW { d.swap(other.d); }
     ~DataValidation();
 
     ValidationType validationType() const;
@@ -101,9 +111,33 @@ public:
     static DataValidation loadFromXml(QXmlStreamReader &reader);
 
 private:
+    friend class WorksheetPrivate;
     QSharedDataPointer<DataValidationPrivate> d;
 };
 
+class Q_XLSX_EXPORT DataValidationViolation
+{
+public:
+    DataValidationViolation()
+        : row(0)
+        , column(0)
+    {
+    }
+    DataValidationViolation(int row, int column, const DataValidation &validation)
+        : row(row)
+        , column(column)
+        , validation(validation)
+    {
+    }
+
+    int row;
+    int column;
+    DataValidation validation;
+};
+
 QT_END_NAMESPACE_XLSX
 
+Q_DECLARE_TYPEINFO(QXlsx::DataValidation, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(QXlsx::DataValidationViolation, Q_MOVABLE_TYPE);
+
 #endif // QXLSX_XLSXDATAVALIDATION_H
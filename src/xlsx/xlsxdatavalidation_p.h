@@ -52,6 +52,8 @@ public:
     DataValidationPrivate(const DataValidationPrivate &other);
     ~DataValidationPrivate();
 
+    QString mergeKey() const;
+
     DataValidation::ValidationType validationType;
     DataValidation::ValidationOperator validationOperator;
     DataValidation::ErrorStyle errorStyle;
@@ -0,0 +1,199 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxdatavalidationchecker_p.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxcellrange.h"
+#include "xlsxcellreference.h"
+
+#include <math.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+static QString stripEqualSign(const QString &formula)
+{
+    return formula.startsWith(QLatin1Char('=')) ? formula.mid(1) : formula;
+}
+
+DataValidationChecker::DataValidationChecker(const WorksheetPrivate *sheet,
+                                             const DataValidation &validation)
+    : m_sheet(sheet)
+    , m_validation(validation)
+    , m_checkable(true)
+    , m_constant(true)
+{
+    const QString formula1 = stripEqualSign(validation.formula1());
+    const QString formula2 = stripEqualSign(validation.formula2());
+
+    if (validation.validationType() == DataValidation::List) {
+        if (formula1.startsWith(QLatin1Char('"'))) {
+            // An inline list, such as "a,b,c"
+            QString list = formula1.mid(1);
+            if (list.endsWith(QLatin1Char('"')))
+                list.chop(1);
+            foreach (const QString &item, list.split(QLatin1Char(',')))
+                m_items.insert(item.trimmed().toLower());
+            return;
+        }
+        const ParsedFormula parsed(formula1);
+        if (!parsed.isValid()
+            || parsed.node(parsed.root()).type != ParsedFormula::Reference) {
+            m_checkable = false;
+            return;
+        }
+        const ParsedFormula::Node &node = parsed.node(parsed.root());
+        for (int row = node.firstRow; row <= node.lastRow; ++row) {
+            for (int column = node.firstColumn; column <= node.lastColumn; ++column) {
+                const FormulaValue item = FormulaEngine::cellValue(sheet, row, column);
+                if (item.type != FormulaValue::Empty)
+                    m_items.insert(FormulaEngine::text(item).toLower());
+            }
+        }
+        return;
+    }
+
+    if (validation.ranges().isEmpty())
+        return;
+    const CellReference root = validation.ranges().first().topLeft();
+    m_formula1 = SharedFormulaTemplate(formula1, root);
+    m_formula2 = SharedFormulaTemplate(formula2, root);
+    m_constant = validation.validationType() != DataValidation::Custom
+                 && ParsedFormula(formula1).referenceNodes().isEmpty()
+                 && ParsedFormula(formula2).referenceNodes().isEmpty();
+    if (m_constant) {
+        m_value1 = evaluate(formula1);
+        m_value2 = evaluate(formula2);
+    }
+}
+
+/*
+  Returns true if \a value, of the cell (\a row, \a column), is allowed by
+  the validation.
+ */
+bool DataValidationChecker::isValid(int row, int column, const FormulaValue &value) const
+{
+    if (!m_checkable)
+        return true;
+    if (value.type == FormulaValue::Empty
+        || (value.type == FormulaValue::String && value.text.isEmpty())) {
+        return m_validation.allowBlank();
+    }
+
+    double first = 0;
+    double second = 0;
+    switch (m_validation.validationType()) {
+    case DataValidation::Whole:
+    case DataValidation::Decimal:
+    case DataValidation::Date:
+    case DataValidation::Time:
+        if (value.type != FormulaValue::Number)
+            return false;
+        if (m_validation.validationType() == DataValidation::Whole
+            && floor(value.number) != value.number) {
+            return false;
+        }
+        if (!operands(row, column, &first, &second))
+            return true;
+        return compare(value.number, first, second);
+    case DataValidation::TextLength:
+        if (value.isError())
+            return false;
+        if (!operands(row, column, &first, &second))
+            return true;
+        return compare(FormulaEngine::text(value).size(), first, second);
+    case DataValidation::List:
+        if (value.isError())
+            return false;
+        return m_items.contains(FormulaEngine::text(value).toLower());
+    case DataValidation::Custom: {
+        const FormulaValue result = evaluate(m_formula1.formulaText(CellReference(row, column)));
+        if (result.type == FormulaValue::Error)
+            return false;
+        return result.number != 0;
+    }
+    default:
+        return true;
+    }
+}
+
+FormulaValue DataValidationChecker::evaluate(const QString &formula) const
+{
+    if (formula.isEmpty())
+        return FormulaValue();
+    const ParsedFormula parsed(formula);
+    if (!parsed.isValid())
+        return FormulaValue::fromError(QStringLiteral("#NAME?"));
+    return FormulaEngine::evaluate(parsed, m_sheet);
+}
+
+/*
+  Stores the numbers the value of the cell (\a row, \a column) is
+  compared with in \a first and \a second. Returns false if they can't be
+  calculated, in which case the validation isn't checked.
+ */
+bool DataValidationChecker::operands(int row, int column, double *first, double *second) const
+{
+    FormulaValue value1 = m_value1;
+    FormulaValue value2 = m_value2;
+    if (!m_constant) {
+        const CellReference cell(row, column);
+        value1 = evaluate(m_formula1.formulaText(cell));
+        value2 = evaluate(m_formula2.formulaText(cell));
+    }
+    if (value1.type != FormulaValue::Number)
+        return false;
+    const DataValidation::ValidationOperator op = m_validation.validationOperator();
+    if ((op == DataValidation::Between || op == DataValidation::NotBetween)
+        && value2.type != FormulaValue::Number) {
+        return false;
+    }
+    *first = value1.number;
+    *second = value2.number;
+    return true;
+}
+
+bool DataValidationChecker::compare(double value, double first, double second) const
+{
+    switch (m_validation.validationOperator()) {
+    case DataValidation::Between:
+        return value >= qMin(first, second) && value <= qMax(first, second);
+    case DataValidation::NotBetween:
+        return value < qMin(first, second) || value > qMax(first, second);
+    case DataValidation::Equal:
+        return value == first;
+    case DataValidation::NotEqual:
+        return value != first;
+    case DataValidation::LessThan:
+        return value < first;
+    case DataValidation::LessThanOrEqual:
+        return value <= first;
+    case DataValidation::GreaterThan:
+        return value > first;
+    case DataValidation::GreaterThanOrEqual:
+        return value >= first;
+    }
+    return true;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,86 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXDATAVALIDATIONCHECKER_P_H
+#define XLSXDATAVALIDATIONCHECKER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxdatavalidation.h"
+#include "xlsxformulaengine_p.h"
+#include "xlsxutility_p.h"
+
+#include <QSet>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class WorksheetPrivate;
+
+/*
+  Checks the values of cells against one data validation of a sheet.
+  The operands of the validation, and the items of a list, are computed
+  once when the checker is created, unless they depend on the position
+  of the checked cell.
+
+  Validations which can't be checked, such as lists taken from other
+  sheets, accept every value.
+ */
+class XLSX_AUTOTEST_EXPORT DataValidationChecker
+{
+public:
+    DataValidationChecker(const WorksheetPrivate *sheet, const DataValidation &validation);
+
+    bool isValid(int row, int column, const FormulaValue &value) const;
+
+private:
+    FormulaValue evaluate(const QString &formula) const;
+    bool operands(int row, int column, double *first, double *second) const;
+    bool compare(double value, double first, double second) const;
+
+    const WorksheetPrivate *m_sheet;
+    DataValidation m_validation;
+    bool m_checkable;
+    // The formulas, relative to the top left cell of the validation, and
+    // their values when they don't refer to cells
+    SharedFormulaTemplate m_formula1;
+    SharedFormulaTemplate m_formula2;
+    bool m_constant;
+    FormulaValue m_value1;
+    FormulaValue m_value2;
+    QSet<QString> m_items; // the items of a list, in lower case
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXDATAVALIDATIONCHECKER_P_H
@@ -27,6 +27,9 @@
 #include "xlsxdocument_p.h"
 #include "xlsxworkbook.h"
 #include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxcell.h"
+#include "xlsxcell_p.h"
 #include "xlsxcontenttypes_p.h"
 #include "xlsxrelationships_p.h"
 #include "xlsxstyles_p.h"
@@ -37,15 +40,33 @@
 #include "xlsxutility_p.h"
 #include "xlsxworkbook_p.h"
 #include "xlsxdrawing_p.h"
+#include "xlsxtable_p.h"
+#include "xlsxcommentswriter_p.h"
 #include "xlsxmediafile_p.h"
 #include "xlsxchart.h"
 #include "xlsxzipreader_p.h"
 #include "xlsxzipwriter_p.h"
-
+#include "xlsxencryption_p.h"
+#include "xlsxprofiler_p.h"
+#include "xlsxprogressmonitor.h"
+#include "xlsxsheetloader_p.h"
+#include "xlsxstatistics_p.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QFile>
+#include <QFileInfo>
 #include <QPointF>
 #include <QBuffer>
 #include <QDir>
+#include <QHash>
+#include <QMapIterator>
+#include <QSet>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QFutureInterface>
 
 QT_BEGIN_NAMESPACE_XLSX
 
@@ -87,6 +108,13 @@ QT_BEGIN_NAMESPACE_XLSX
 DocumentPrivate::DocumentPrivate(Document *p)
     : q_ptr(p)
     , defaultPackageName(QStringLiteral("Book1.xlsx"))
+    , saveOptions(Document::DefaultSaveOptions)
+    , compression(Document::DefaultCompression)
+    , fileFormat(Document::Xlsx)
+    , loadOptions(Document::DefaultLoadOptions)
+    , profiler(0)
+    , progressMonitor(0)
+    , memoryBudget(0)
 {
 }
 
@@ -96,27 +124,200 @@ void DocumentPrivate::init()
         contentTypes =
             QSharedPointer<ContentTypes>(new ContentTypes(ContentTypes::F_NewFromScratch));
 
-    if (workbook.isNull())
+    if (workbook.isNull()) {
         workbook = QSharedPointer<Workbook>(new Workbook(Workbook::F_NewFromScratch));
+        workbook->d_func()->memoryBudget = memoryBudget;
+    }
+}
+
+/*
+  Returns true if the progress monitor has canceled the load or the save.
+ */
+bool DocumentPrivate::isCanceled() const
+{
+    return progressMonitor && progressMonitor->isCanceled();
+}
+
+/*
+  Load \a file from \a data, reported to the profiler as the ParsePhase of
+  the part \a partName, and to the progress monitor once it's done. Nothing
+  is parsed once the load has been canceled. This is called by several
+  threads when the sheets are loaded in parallel.
+ */
+void DocumentPrivate::parsePart(AbstractOOXmlFile *file, const QByteArray &data,
+                                const QString &partName)
+{
+    if (isCanceled())
+        return;
+    {
+        ProfilerScope scope(profiler, Profiler::ParsePhase, partName);
+        if (partName.endsWith(QLatin1String(".bin")))
+            loadBinaryPart(file, data);
+        else
+            file->loadFromXmlData(data);
+        if (scope.isActive()) {
+            scope.setBytes(data.size());
+            scope.setElements(file->elementCount());
+        }
+    }
+    if (progressMonitor && !progressMonitor->isCanceled())
+        progressMonitor->partDone(partName, loadedParts.fetchAndAddOrdered(1) + 1);
+}
+
+/*
+  Load \a file, one of the workbook, styles, shared strings or worksheet
+  parts of an xlsb package, from its BIFF12 records. The parts stay dirty,
+  they are never copied to a saved package.
+ */
+void DocumentPrivate::loadBinaryPart(AbstractOOXmlFile *file, const QByteArray &data)
+{
+    if (file == workbook.data()) {
+        workbook->loadFromBinaryData(data);
+    } else if (file == workbook->styles()) {
+        workbook->styles()->loadFromBinaryData(data);
+    } else if (file == workbook->sharedStrings()) {
+        workbook->sharedStrings()->loadFromBinaryData(data, workbook->styles());
+    } else {
+        for (int i = 0; i < workbook->sheetCount(); ++i) {
+            AbstractSheet *sheet = workbook->sheet(i);
+            if (sheet == file && sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+                static_cast<Worksheet *>(sheet)->loadFromBinaryData(data);
+        }
+    }
+}
+
+namespace {
+
+/*
+  Load one sheet, used when the sheets are loaded in parallel. The zip reader
+  can not be shared by threads, so only the parsing runs concurrently.
+ */
+class LoadSheetTask : public QRunnable
+{
+public:
+    LoadSheetTask(AbstractSheet *sheet, ZipReader *zipReader, QMutex *zipMutex,
+                  DocumentPrivate *document)
+        : m_sheet(sheet)
+        , m_zipReader(zipReader)
+        , m_zipMutex(zipMutex)
+        , m_document(document)
+    {
+    }
+
+    void run()
+    {
+        if (m_document->isCanceled())
+            return;
+        QByteArray relsData;
+        QByteArray sheetData;
+        {
+            QMutexLocker locker(m_zipMutex);
+            QString rel_path = getRelFilePath(m_sheet->filePath());
+            if (m_zipReader->contains(rel_path))
+                relsData = m_zipReader->fileData(rel_path);
+            sheetData = m_zipReader->fileData(m_sheet->filePath());
+        }
+        if (!relsData.isEmpty())
+            m_sheet->relationships()->loadFromXmlData(relsData);
+        m_document->parsePart(m_sheet, sheetData, m_sheet->filePath());
+    }
+
+private:
+    AbstractSheet *m_sheet;
+    ZipReader *m_zipReader;
+    QMutex *m_zipMutex;
+    DocumentPrivate *m_document;
+};
+
+} // namespace
+
+void DocumentPrivate::open(const QString &name)
+{
+    packageName = name;
+    QFile file(name);
+    if (file.open(QIODevice::ReadOnly) && EncryptedPackageReader::isEncryptedPackage(&file)) {
+        file.close();
+        loadEncryptedPackage(new EncryptedPackageReader(name));
+    } else if (file.exists()) {
+        file.close();
+        // The reader owns the file, which stays open for the lazy load mode.
+        loadPackage(QSharedPointer<ZipReader>(new ZipReader(name)));
+    }
+    init();
 }
 
 bool DocumentPrivate::loadPackage(QIODevice *device)
 {
-    Q_Q(Document);
-    ZipReader zipReader(device);
-    QStringList filePaths = zipReader.filePaths();
+    if (EncryptedPackageReader::isEncryptedPackage(device))
+        return loadEncryptedPackage(new EncryptedPackageReader(device));
+    return loadPackage(QSharedPointer<ZipReader>(new ZipReader(device)));
+}
+
+/*
+  Load the package deciphered by \a reader, which is taken over, with the
+  password of the document, or the default one Excel encrypts the
+  workbooks with when it has none. The segments of the package are
+  deciphered as the zip reader reads them. The parts are all loaded at
+  once, since the file may be overwritten by the save.
+ */
+bool DocumentPrivate::loadEncryptedPackage(EncryptedPackageReader *reader)
+{
+    QScopedPointer<EncryptedPackageReader> guard(reader);
+    if (!reader->decrypt(password.isEmpty() ? QStringLiteral("VelvetSweatshop") : password)) {
+        qWarning("The password of the encrypted package is wrong, or its encryption unsupported");
+        return false;
+    }
+    const Document::LoadOptions options = loadOptions;
+    loadOptions = options & ~Document::LazyLoad;
+    const bool ok = loadPackage(QSharedPointer<ZipReader>(new ZipReader(guard.take(), true)));
+    loadOptions = options;
+    return ok;
+}
+
+/*
+  Load the package of \a zipReader, reported to the profiler as a whole and
+  part by part.
+ */
+bool DocumentPrivate::loadPackage(const QSharedPointer<ZipReader> &zipReader)
+{
+    ProfilerScope scope(profiler, Profiler::LoadPhase);
+    // The sheets loaded later on by the lazy load mode are not reported
+    zipReader->setProfiler(profiler);
+    loadedParts.store(0);
+    const bool ok = loadParts(zipReader);
+    zipReader->setProfiler(0);
+    if (workbook) {
+        foreach (QSharedPointer<AbstractSheet> sheet,
+                 workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet))
+            static_cast<Worksheet *>(sheet.data())->d_func()->progressMonitor = 0;
+    }
+
+    // A canceled load leaves an empty document
+    if (isCanceled()) {
+        workbook.clear();
+        contentTypes.clear();
+        sourcePackage.clear();
+        documentProperties.clear();
+        return false;
+    }
+    return ok;
+}
 
+bool DocumentPrivate::loadParts(const QSharedPointer<ZipReader> &zipReader)
+{
+    Q_Q(Document);
     // Load the Content_Types file
-    if (!filePaths.contains(QLatin1String("[Content_Types].xml")))
+    if (!zipReader->contains(QStringLiteral("[Content_Types].xml")))
         return false;
     contentTypes = QSharedPointer<ContentTypes>(new ContentTypes(ContentTypes::F_LoadFromExists));
-    contentTypes->loadFromXmlData(zipReader.fileData(QStringLiteral("[Content_Types].xml")));
+    parsePart(contentTypes.data(), zipReader->fileData(QStringLiteral("[Content_Types].xml")),
+              QStringLiteral("[Content_Types].xml"));
 
     // Load root rels file
-    if (!filePaths.contains(QLatin1String("_rels/.rels")))
+    if (!zipReader->contains(QStringLiteral("_rels/.rels")))
         return false;
     Relationships rootRels;
-    rootRels.loadFromXmlData(zipReader.fileData(QStringLiteral("_rels/.rels")));
+    rootRels.loadFromXmlData(zipReader->fileData(QStringLiteral("_rels/.rels")));
 
     // load core property
     QList<XlsxRelationship> rels_core =
@@ -127,7 +328,7 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         QString docPropsCore_Name = rels_core[0].target;
 
         DocPropsCore props(DocPropsCore::F_LoadFromExists);
-        props.loadFromXmlData(zipReader.fileData(docPropsCore_Name));
+        props.loadFromXmlData(zipReader->fileData(docPropsCore_Name));
         foreach (QString name, props.propertyNames())
             q->setDocumentProperty(name, props.property(name));
     }
@@ -141,7 +342,7 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         QString docPropsApp_Name = rels_app[0].target;
 
         DocPropsApp props(DocPropsApp::F_LoadFromExists);
-        props.loadFromXmlData(zipReader.fileData(docPropsApp_Name));
+        props.loadFromXmlData(zipReader->fileData(docPropsApp_Name));
         foreach (QString name, props.propertyNames())
             q->setDocumentProperty(name, props.property(name));
     }
@@ -149,15 +350,21 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
     // load workbook now, Get the workbook file path from the root rels file
     // In normal case, this should be "xl/workbook.xml"
     workbook = QSharedPointer<Workbook>(new Workbook(Workbook::F_LoadFromExists));
+    workbook->d_func()->memoryBudget = memoryBudget;
+    workbook->d_func()->rowBlockLoad = loadOptions & Document::RowBlockLoad;
+    workbook->d_func()->loadFilter = loadFilter;
     QList<XlsxRelationship> rels_xl =
         rootRels.documentRelationships(QStringLiteral("/officeDocument"));
     if (rels_xl.isEmpty())
         return false;
     QString xlworkbook_Path = rels_xl[0].target;
     QString xlworkbook_Dir = splitPath(xlworkbook_Path)[0];
-    workbook->relationships()->loadFromXmlData(zipReader.fileData(getRelFilePath(xlworkbook_Path)));
+    workbook->relationships()->loadFromXmlData(zipReader->fileData(getRelFilePath(xlworkbook_Path)));
     workbook->setFilePath(xlworkbook_Path);
-    workbook->loadFromXmlData(zipReader.fileData(xlworkbook_Path));
+    // The parts of an xlsb package are BIFF12 records
+    const bool binary = xlworkbook_Path.endsWith(QLatin1String(".bin"));
+    fileFormat = binary ? Document::Xlsb : Document::Xlsx;
+    parsePart(workbook.data(), zipReader->fileData(xlworkbook_Path), xlworkbook_Path);
 
     // load styles
     QList<XlsxRelationship> rels_styles =
@@ -167,8 +374,12 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         QString name = rels_styles[0].target;
         QString path = xlworkbook_Dir + QLatin1String("/") + name;
         QSharedPointer<Styles> styles(new Styles(Styles::F_LoadFromExists));
-        styles->loadFromXmlData(zipReader.fileData(path));
+        styles->setFilePath(path);
+        if (loadOptions & Document::ReadOnlyLoad)
+            styles->deferLookupTables();
+        // The binary shared strings refer to the fonts of the styles
         workbook->d_func()->styles = styles;
+        parsePart(styles.data(), zipReader->fileData(path), path);
     }
 
     // load sharedStrings
@@ -178,7 +389,8 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         // In normal case this should be sharedStrings.xml which in xl
         QString name = rels_sharedStrings[0].target;
         QString path = xlworkbook_Dir + QLatin1String("/") + name;
-        workbook->d_func()->sharedStrings->loadFromXmlData(zipReader.fileData(path));
+        workbook->d_func()->sharedStrings->setFilePath(path);
+        parsePart(workbook->d_func()->sharedStrings.data(), zipReader->fileData(path), path);
     }
 
     // load theme
@@ -188,17 +400,8 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         // In normal case this should be theme/theme1.xml which in xl
         QString name = rels_theme[0].target;
         QString path = xlworkbook_Dir + QLatin1String("/") + name;
-        workbook->theme()->loadFromXmlData(zipReader.fileData(path));
-    }
-
-    // load sheets
-    for (int i = 0; i < workbook->sheetCount(); ++i) {
-        AbstractSheet *sheet = workbook->sheet(i);
-        QString rel_path = getRelFilePath(sheet->filePath());
-        // If the .rel file exists, load it.
-        if (zipReader.filePaths().contains(rel_path))
-            sheet->relationships()->loadFromXmlData(zipReader.fileData(rel_path));
-        sheet->loadFromXmlData(zipReader.fileData(sheet->filePath()));
+        workbook->theme()->setFilePath(path);
+        parsePart(workbook->theme(), zipReader->fileData(path), path);
     }
 
     // load external links
@@ -206,118 +409,723 @@ bool DocumentPrivate::loadPackage(QIODevice *device)
         SimpleOOXmlFile *link = workbook->d_func()->externalLinks[i].data();
         QString rel_path = getRelFilePath(link->filePath());
         // If the .rel file exists, load it.
-        if (zipReader.filePaths().contains(rel_path))
-            link->relationships()->loadFromXmlData(zipReader.fileData(rel_path));
-        link->loadFromXmlData(zipReader.fileData(link->filePath()));
+        if (zipReader->contains(rel_path))
+            link->relationships()->loadFromXmlData(zipReader->fileData(rel_path));
+        parsePart(link, zipReader->fileData(link->filePath()), link->filePath());
+    }
+
+    if (binary) {
+        // Only the worksheets of an xlsb package are loaded, one after another
+        for (int i = 0; i < workbook->sheetCount() && !isCanceled(); ++i) {
+            AbstractSheet *sheet = workbook->sheet(i);
+            if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+                continue;
+            static_cast<Worksheet *>(sheet)->d_func()->progressMonitor = progressMonitor;
+            parsePart(sheet, zipReader->fileData(sheet->filePath()), sheet->filePath());
+        }
+        return true;
+    }
+
+    // The parts which are still unchanged when the document is saved are
+    // copied from the package, as long as it can be read again.
+    if (!zipReader->fileName().isEmpty() || (loadOptions & Document::LazyLoad))
+        sourcePackage = zipReader;
+
+    if (loadOptions & Document::LazyLoad) {
+        // The sheets are loaded by the workbook when they are first
+        // accessed, their drawings when the anchors are needed.
+        workbook->d_func()->setLazyPackage(zipReader);
+        return true;
+    }
+
+    // load sheets
+    if (loadOptions & Document::ParallelLoad) {
+        // Styles and shared strings are only read by the sheets from now on,
+        // except the reference counts of the shared strings, which are merged
+        // once all the sheets are loaded.
+        QMutex zipMutex;
+        QThreadPool pool;
+        for (int i = 0; i < workbook->sheetCount(); ++i) {
+            AbstractSheet *sheet = workbook->sheet(i);
+            if (sheet->sheetType() == AbstractSheet::ST_WorkSheet) {
+                if (!loadFilter.acceptsSheet(sheet->sheetName()))
+                    continue;
+                WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet)->d_func();
+                sheet_d->deferSstRefs = true;
+                sheet_d->progressMonitor = progressMonitor;
+            }
+            pool.start(new LoadSheetTask(sheet, zipReader.data(), &zipMutex, this));
+        }
+        pool.waitForDone();
+
+        for (int i = 0; i < workbook->sheetCount(); ++i) {
+            AbstractSheet *sheet = workbook->sheet(i);
+            if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+                continue;
+            static_cast<Worksheet *>(sheet)->d_func()->mergeSstRefs();
+        }
+    } else {
+        for (int i = 0; i < workbook->sheetCount() && !isCanceled(); ++i) {
+            AbstractSheet *sheet = workbook->sheet(i);
+            // The filtered out worksheets aren't even inflated
+            if (sheet->sheetType() == AbstractSheet::ST_WorkSheet
+                && !loadFilter.acceptsSheet(sheet->sheetName())) {
+                continue;
+            }
+            if (sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+                static_cast<Worksheet *>(sheet)->d_func()->progressMonitor = progressMonitor;
+            QString rel_path = getRelFilePath(sheet->filePath());
+            // If the .rel file exists, load it.
+            if (zipReader->contains(rel_path))
+                sheet->relationships()->loadFromXmlData(zipReader->fileData(rel_path));
+            parsePart(sheet, zipReader->fileData(sheet->filePath()), sheet->filePath());
+        }
     }
 
-    // load drawings
-    for (int i = 0; i < workbook->drawings().size(); ++i) {
-        Drawing *drawing = workbook->drawings()[i];
+    // load tables
+    foreach (Table *table, workbook->tables())
+        parsePart(table, zipReader->fileData(table->filePath()), table->filePath());
+
+    // load drawings, which are left in the package as well when it's a
+    // file, until their anchors are needed. Their charts and pictures are
+    // loaded with them.
+    const bool keepPartsInPackage = !zipReader->fileName().isEmpty();
+    const QList<Drawing *> drawings = workbook->drawings();
+    for (int i = 0; i < drawings.size(); ++i) {
+        Drawing *drawing = drawings[i];
         QString rel_path = getRelFilePath(drawing->filePath());
-        if (zipReader.filePaths().contains(rel_path))
-            drawing->relationships()->loadFromXmlData(zipReader.fileData(rel_path));
-        drawing->loadFromXmlData(zipReader.fileData(drawing->filePath()));
+        if (zipReader->contains(rel_path))
+            drawing->relationships()->loadFromXmlData(zipReader->fileData(rel_path));
+        if (keepPartsInPackage)
+            drawing->setPackage(zipReader);
+        else
+            parsePart(drawing, zipReader->fileData(drawing->filePath()), drawing->filePath());
     }
 
     // load charts
     QList<QSharedPointer<Chart>> chartFileToLoad = workbook->chartFiles();
     for (int i = 0; i < chartFileToLoad.size(); ++i) {
         QSharedPointer<Chart> cf = chartFileToLoad[i];
-        cf->loadFromXmlData(zipReader.fileData(cf->filePath()));
+        parsePart(cf.data(), zipReader->fileData(cf->filePath()), cf->filePath());
     }
 
-    // load media files
+    // load media files, which are left in the package when it's a file
+    // owned by the reader, until their contents are needed.
     QList<QSharedPointer<MediaFile>> mediaFileToLoad = workbook->mediaFiles();
     for (int i = 0; i < mediaFileToLoad.size(); ++i) {
         QSharedPointer<MediaFile> mf = mediaFileToLoad[i];
         const QString path = mf->fileName();
         const QString suffix = path.mid(path.lastIndexOf(QLatin1Char('.')) + 1);
-        mf->set(zipReader.fileData(path), suffix);
+        if (keepPartsInPackage)
+            mf->setPackageEntry(zipReader, suffix);
+        else
+            mf->set(zipReader->fileData(path), suffix);
     }
 
     return true;
 }
 
-bool DocumentPrivate::savePackage(QIODevice *device) const
+namespace {
+
+typedef QHash<const AbstractOOXmlFile *, ZipEntryDevice *> CompressedEntryHash;
+
+/*
+  Serialize one part and compress it to memory, used by the parallel save.
+ */
+class SaveXmlFileTask : public QRunnable
+{
+public:
+    SaveXmlFileTask(const AbstractOOXmlFile *file, ZipEntryDevice *entry, const QString &filePath,
+                    Profiler *profiler)
+        : m_file(file)
+        , m_entry(entry)
+        , m_filePath(filePath)
+        , m_profiler(profiler)
+    {
+    }
+
+    void run()
+    {
+        ProfilerScope scope(m_profiler, Profiler::WritePhase, m_filePath);
+        m_file->saveToXmlFile(m_entry);
+        m_entry->finish();
+        if (scope.isActive()) {
+            scope.setBytes(m_entry->info().uncompressedSize);
+            scope.setElements(m_file->elementCount());
+        }
+    }
+
+private:
+    const AbstractOOXmlFile *m_file;
+    ZipEntryDevice *m_entry;
+    QString m_filePath;
+    Profiler *m_profiler;
+};
+
+/*
+  Serialize \a file straight into a new zip entry named \a filePath,
+  so that the xml data is compressed as it is generated. If the file
+  has already been compressed by the parallel save, the entry in
+  \a compressedEntries is written instead, it has already been reported
+  to the \a profiler by the task which compressed it.
+ */
+void addXmlFile(ZipWriter &zipWriter, const QString &filePath, const AbstractOOXmlFile *file,
+                const CompressedEntryHash &compressedEntries, Profiler *profiler)
+{
+    if (ZipEntryDevice *entry = compressedEntries.value(file)) {
+        zipWriter.addCompressedFile(filePath, entry);
+        return;
+    }
+    ProfilerScope scope(profiler, Profiler::WritePhase, filePath);
+    file->saveToXmlFile(zipWriter.beginFile(filePath));
+    zipWriter.endFile();
+    if (scope.isActive()) {
+        scope.setBytes(zipWriter.lastFileSize());
+        scope.setElements(file->elementCount());
+    }
+}
+
+void addXmlFile(ZipWriter &zipWriter, const QString &filePath, const AbstractOOXmlFile *file,
+                Profiler *profiler)
+{
+    addXmlFile(zipWriter, filePath, file, CompressedEntryHash(), profiler);
+}
+
+/*
+  The default theme deflated with each compression level, shared by all
+  the documents.
+ */
+struct DeflatedThemes
+{
+    QMutex mutex;
+    QHash<int, QPair<ZipEntryInfo, QByteArray>> entries;
+};
+
+Q_GLOBAL_STATIC(DeflatedThemes, deflatedThemes)
+
+/*
+  Write \a theme as \a filePath. The default theme is only compressed once
+  for the process with each compression level.
+ */
+void addThemeFile(ZipWriter &zipWriter, const QString &filePath, const Theme *theme,
+                  Profiler *profiler)
+{
+    const int level = zipWriter.compressionLevel(filePath);
+    if (!theme->isDefault() || level == 0) {
+        addXmlFile(zipWriter, filePath, theme, profiler);
+        return;
+    }
+
+    ProfilerScope scope(profiler, Profiler::WritePhase, filePath);
+    QMutexLocker locker(&deflatedThemes()->mutex);
+    QHash<int, QPair<ZipEntryInfo, QByteArray>>::iterator it =
+        deflatedThemes()->entries.find(level);
+    if (it == deflatedThemes()->entries.end()) {
+        ZipEntryDevice entry(QString(), 0, level);
+        theme->saveToXmlFile(&entry);
+        entry.finish();
+        it = deflatedThemes()->entries.insert(level, qMakePair(entry.info(),
+                                                                entry.compressedData()));
+    }
+    const ZipEntryInfo &info = it.value().first;
+    zipWriter.addRawFile(filePath, it.value().second, info.crc, info.uncompressedSize);
+    if (scope.isActive())
+        scope.setBytes(info.uncompressedSize);
+}
+
+/*
+  Serialize \a relationships straight into a new zip entry named \a filePath.
+ */
+void addRelationshipsFile(ZipWriter &zipWriter, const QString &filePath,
+                          const Relationships *relationships, Profiler *profiler)
+{
+    ProfilerScope scope(profiler, Profiler::WritePhase, filePath);
+    relationships->saveToXmlFile(zipWriter.beginFile(filePath));
+    zipWriter.endFile();
+    if (scope.isActive()) {
+        scope.setBytes(zipWriter.lastFileSize());
+        scope.setElements(relationships->count());
+    }
+}
+
+/*
+  Write the comments part numbered \a number and its VML drawing, whose
+  shape ids are taken from the blocks from \a shapeBlock on.
+ */
+void addCommentsFiles(ZipWriter &zipWriter, int number, const CommentsWriter &commentsWriter,
+                      int shapeBlock, Profiler *profiler)
+{
+    for (int part = 0; part < 2; ++part) {
+        const QString path = part == 0
+                                 ? QStringLiteral("xl/comments%1.xml").arg(number)
+                                 : QStringLiteral("xl/drawings/vmlDrawing%1.vml").arg(number);
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        if (part == 0)
+            commentsWriter.saveComments(zipWriter.beginFile(path));
+        else
+            commentsWriter.saveVmlDrawing(zipWriter.beginFile(path), shapeBlock);
+        zipWriter.endFile();
+        if (scope.isActive()) {
+            scope.setBytes(zipWriter.lastFileSize());
+            scope.setElements(commentsWriter.count());
+        }
+    }
+}
+
+/*
+  Returns the zlib level used by ZipWriter for \a compression.
+ */
+int zipCompressionLevel(Document::Compression compression)
+{
+    switch (compression) {
+    case Document::NoCompression:
+        return 0;
+    case Document::FastCompression:
+        return 1;
+    case Document::BestCompression:
+        return 9;
+    default:
+        return -1;
+    }
+}
+
+// The snapshots made by an older layout of the model are not loaded
+const quint32 SnapshotMagic = 0x51585353; // "QXSS"
+const quint32 SnapshotVersion = 1;
+
+/*
+  The extra entry of the snapshot packages, holding the magic number, the
+  version, the file format of the document, and the name and the key of
+  its source file.
+ */
+QString snapshotHeaderPath()
+{
+    return QStringLiteral("qtxlsx/snapshot.bin");
+}
+
+/*
+  Returns the SHA-1 hash of the contents of the file \a name, or an empty
+  key if it can't be read.
+ */
+QByteArray snapshotSourceKey(const QString &name)
+{
+    QFile file(name);
+    if (name.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file))
+        return QByteArray();
+    return hash.result();
+}
+
+/*
+  Copies the parts which have not been modified since they were loaded
+  from the source package as they are, without serializing and compressing
+  them again. A part is only copied when it's saved to the path it was
+  read from, and when every part which its relationships refer to is saved
+  to the path it was read from too.
+ */
+class RawPartCopier
+{
+public:
+    RawPartCopier(ZipReader *source, Profiler *profiler)
+        : m_source(source)
+        , m_profiler(profiler)
+    {
+    }
+
+    void addSavedPath(const QString &sourcePath, const QString &savedPath)
+    {
+        if (!sourcePath.isEmpty())
+            m_savedPaths.insert(sourcePath, savedPath);
+    }
+
+    /*
+      Select \a file, saved to \a savedPath, for the copy if possible.
+      The relationships of the \a file are checked when it \a hasRelationships,
+      otherwise it must have none in the source package.
+     */
+    bool select(AbstractOOXmlFile *file, const QString &savedPath, bool hasRelationships)
+    {
+        if (!canCopy(file, savedPath, hasRelationships)) {
+            // The relationships are renumbered when the part is serialized,
+            // the part in the source package no longer matches them.
+            if (hasRelationships)
+                file->setDirty();
+            return false;
+        }
+        m_selectedFiles.insert(file);
+        return true;
+    }
+
+    bool isSelected(const AbstractOOXmlFile *file) const
+    {
+        return m_selectedFiles.contains(file);
+    }
+
+    /*
+      Copy the selected \a file to \a savedPath. Returns false if the
+      part has not been selected, or if it's not deflated in the source.
+     */
+    bool copy(ZipWriter &zipWriter, const QString &savedPath, const AbstractOOXmlFile *file) const
+    {
+        // Parts which should be stored are written again
+        if (!isSelected(file) || zipWriter.compressionLevel(savedPath) == 0)
+            return false;
+        ProfilerScope scope(m_profiler, Profiler::WritePhase, savedPath);
+        QByteArray data;
+        ZipFileInfo info;
+        if (!m_source->rawFileData(savedPath, &data, &info))
+            return false;
+        zipWriter.addRawFile(savedPath, data, info.crc, info.uncompressedSize);
+        if (scope.isActive()) {
+            scope.setBytes(info.uncompressedSize);
+            scope.setElements(file->elementCount());
+        }
+        return true;
+    }
+
+private:
+    bool canCopy(const AbstractOOXmlFile *file, const QString &savedPath,
+                 bool hasRelationships) const
+    {
+        if (!m_source || file->isDirty() || file->filePath() != savedPath)
+            return false;
+        if (m_source->fileSize(savedPath) < 0)
+            return false;
+        if (!hasRelationships)
+            return !m_source->contains(getRelFilePath(savedPath));
+
+        const QString dir = splitPath(savedPath)[0];
+        foreach (const XlsxRelationship &rel, file->relationships()->allRelationships()) {
+            if (rel.targetMode == QLatin1String("External"))
+                continue;
+            const QString target = rel.target.startsWith(QLatin1Char('/'))
+                ? rel.target.mid(1)
+                : QDir::cleanPath(dir + QLatin1String("/") + rel.target);
+            if (m_savedPaths.value(target) != target)
+                return false;
+        }
+        return true;
+    }
+
+    ZipReader *m_source;
+    Profiler *m_profiler;
+    QHash<QString, QString> m_savedPaths;
+    QSet<const AbstractOOXmlFile *> m_selectedFiles;
+};
+
+} // namespace
+
+/*
+  Recalculate the formulas and compact the tables, done before the parts
+  are written.
+ */
+void DocumentPrivate::prepareSave() const
+{
+    ProfilerScope scope(profiler, Profiler::PrepareSavePhase);
+    // The rows filled by other threads are part of the sheets from now on
+    foreach (QSharedPointer<AbstractSheet> sheet,
+             workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet)) {
+        static_cast<Worksheet *>(sheet.data())->d_func()->mergeRowWriters();
+    }
+    if (workbook->isCalculationEnabled())
+        workbook->recalculate();
+
+    // The shared strings which are no longer used are dropped from the saved
+    // table, unless some indexes have already been written to the stream
+    // files of the constant memory mode.
+    SharedStrings *sharedStrings = workbook->sharedStrings();
+    foreach (QSharedPointer<AbstractSheet> sheet,
+             workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet)) {
+        if (static_cast<Worksheet *>(sheet.data())->isConstantMemoryEnabled())
+            sharedStrings->disableCompaction();
+    }
+    sharedStrings->updateSaveIndices();
+    if (saveOptions & Document::CompactStyles)
+        workbook->compactStyles();
+    // The charts and pictures of the drawings are numbered from here on
+    workbook->d_func()->loadDrawings();
+    // Waits for the images which are encoded in the background
+    workbook->deduplicateMediaFiles();
+}
+
+/*
+  Write the package to \a device, after prepareSave() unless \a prepare is
+  false because it has already been done. The package is encrypted as it
+  is written when the document has a password, except for the snapshots.
+ */
+bool DocumentPrivate::savePackage(QIODevice *device, bool prepare) const
+{
+    // The source package can't be read any more once it's overwritten.
+    if (QFile *file = qobject_cast<QFile *>(device)) {
+        if (sourcePackage && !sourcePackage->fileName().isEmpty()
+            && QFileInfo(file->fileName()) == QFileInfo(sourcePackage->fileName()))
+            sourcePackage.reset();
+    }
+
+    if (password.isEmpty() || !snapshotHeader.isEmpty())
+        return writePackage(device, prepare);
+    EncryptedPackageWriter writer(device, password);
+    if (writer.error())
+        return false;
+    const bool ok = writePackage(&writer, prepare);
+    return writer.finish() && ok;
+}
+
+bool DocumentPrivate::writePackage(QIODevice *device, bool prepare) const
 {
     Q_Q(const Document);
+    // The snapshots are stored uncompressed, as binary parts when possible
+    const bool snapshot = !snapshotHeader.isEmpty();
+    Document::FileFormat format = fileFormat;
+    if (snapshot)
+        format = binaryUnsupportedFeature().isEmpty() ? Document::Xlsb : Document::Xlsx;
+    if (format == Document::Xlsb && !snapshot) {
+        const QString feature = binaryUnsupportedFeature();
+        if (!feature.isEmpty()) {
+            qWarning("The document has %s, which can't be saved as xlsb", qPrintable(feature));
+            return false;
+        }
+    }
+    ProfilerScope saveScope(profiler, Profiler::SavePhase);
     ZipWriter zipWriter(device);
     if (zipWriter.error())
         return false;
+    zipWriter.setCompressionLevel(snapshot ? 0 : zipCompressionLevel(compression));
+    zipWriter.setParallelDeflateEnabled(saveOptions & Document::ParallelCompression);
+    zipWriter.setProgressMonitor(progressMonitor);
+    QMapIterator<QString, Document::Compression> it(partCompressions);
+    while (it.hasNext() && !snapshot) {
+        it.next();
+        zipWriter.setCompressionLevel(it.key(), zipCompressionLevel(it.value()));
+    }
+    if (snapshot)
+        zipWriter.addFile(snapshotHeaderPath(), snapshotHeader);
 
     contentTypes->clearOverrides();
 
     DocPropsApp docPropsApp(DocPropsApp::F_NewFromScratch);
     DocPropsCore docPropsCore(DocPropsCore::F_NewFromScratch);
 
-    // save worksheet xml files
     QList<QSharedPointer<AbstractSheet>> worksheets =
         workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet);
+    QList<QSharedPointer<AbstractSheet>> chartsheets =
+        workbook->getSheetsByTypes(AbstractSheet::ST_ChartSheet);
+    foreach (QSharedPointer<AbstractSheet> sheet, worksheets) {
+        WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        sheet_d->progressMonitor = progressMonitor;
+        sheet_d->incrementalSave = saveOptions & Document::IncrementalSave;
+    }
+
+    SharedStrings *sharedStrings = workbook->sharedStrings();
+    if (prepare)
+        prepareSave();
+
+    if (format == Document::Xlsb) {
+        const bool ok = saveBinaryPackage(zipWriter);
+        foreach (QSharedPointer<AbstractSheet> sheet, worksheets)
+            static_cast<Worksheet *>(sheet.data())->d_func()->progressMonitor = 0;
+        return ok;
+    }
+
+    // Select the parts which can be copied from the source package. The
+    // cells of the worksheets refer to the shared strings by their index,
+    // which must be kept in the saved table.
+    const QList<Drawing *> drawings = workbook->drawings();
+    const QList<QSharedPointer<Chart>> chartFiles = workbook->chartFiles();
+    const QList<QSharedPointer<MediaFile>> mediaFiles = workbook->mediaFiles();
+    // The sheets look their drawing up while they are saved, which may be
+    // done by several threads
+    QHash<const Drawing *, int> &drawingIndexes = workbook->d_func()->savedDrawingIndexes;
+    for (int i = 0; i < drawings.size(); ++i)
+        drawingIndexes.insert(drawings[i], i);
+    const QList<Table *> tables = workbook->tables();
+    QHash<const Table *, int> &tableIndexes = workbook->d_func()->savedTableIndexes;
+    for (int i = 0; i < tables.size(); ++i)
+        tableIndexes.insert(tables[i], i);
+    const QList<Worksheet *> commentedSheets = workbook->commentedSheets();
+    QHash<const Worksheet *, int> &commentIndexes = workbook->d_func()->savedCommentIndexes;
+    for (int i = 0; i < commentedSheets.size(); ++i)
+        commentIndexes.insert(commentedSheets[i], i);
+    RawPartCopier rawParts(sourcePackage.data(), profiler);
+    for (int i = 0; i < worksheets.size(); ++i) {
+        rawParts.addSavedPath(worksheets[i]->filePath(),
+                              QStringLiteral("xl/worksheets/sheet%1.xml").arg(i + 1));
+    }
+    for (int i = 0; i < chartsheets.size(); ++i) {
+        rawParts.addSavedPath(chartsheets[i]->filePath(),
+                              QStringLiteral("xl/chartsheets/sheet%1.xml").arg(i + 1));
+    }
+    for (int i = 0; i < drawings.size(); ++i) {
+        rawParts.addSavedPath(drawings[i]->filePath(),
+                              QStringLiteral("xl/drawings/drawing%1.xml").arg(i + 1));
+    }
+    for (int i = 0; i < chartFiles.size(); ++i) {
+        rawParts.addSavedPath(chartFiles[i]->filePath(),
+                              QStringLiteral("xl/charts/chart%1.xml").arg(i + 1));
+    }
+    for (int i = 0; i < tables.size(); ++i) {
+        rawParts.addSavedPath(tables[i]->filePath(),
+                              QStringLiteral("xl/tables/table%1.xml").arg(i + 1));
+    }
+    for (int i = 0; i < mediaFiles.size(); ++i) {
+        rawParts.addSavedPath(
+            mediaFiles[i]->fileName(),
+            QStringLiteral("xl/media/image%1.%2").arg(i + 1).arg(mediaFiles[i]->suffix()));
+    }
+    if (sharedStrings->hasStableIndices()) {
+        for (int i = 0; i < worksheets.size(); ++i) {
+            rawParts.select(worksheets[i].data(),
+                            QStringLiteral("xl/worksheets/sheet%1.xml").arg(i + 1), true);
+        }
+        rawParts.select(sharedStrings, QStringLiteral("xl/sharedStrings.xml"), false);
+    } else {
+        foreach (QSharedPointer<AbstractSheet> sheet, worksheets)
+            sheet->setDirty();
+    }
+    for (int i = 0; i < chartsheets.size(); ++i) {
+        rawParts.select(chartsheets[i].data(),
+                        QStringLiteral("xl/chartsheets/sheet%1.xml").arg(i + 1), true);
+    }
+    for (int i = 0; i < drawings.size(); ++i) {
+        rawParts.select(drawings[i],
+                        QStringLiteral("xl/drawings/drawing%1.xml").arg(i + 1), true);
+    }
+    for (int i = 0; i < chartFiles.size(); ++i)
+        rawParts.select(chartFiles[i].data(), QStringLiteral("xl/charts/chart%1.xml").arg(i + 1),
+                        false);
+    rawParts.select(workbook->styles(), QStringLiteral("xl/styles.xml"), false);
+    rawParts.select(workbook->theme(), QStringLiteral("xl/theme/theme1.xml"), false);
+
+    // Serialize and compress the sheets, drawings and charts in a thread
+    // pool. Only shared state which is frozen at this point is read by
+    // them: the shared string and xf indexes are assigned when the cells
+    // are written. The compressed entries are written to the package in
+    // the usual order below.
+    CompressedEntryHash compressedEntries;
+    if (saveOptions & Document::ParallelSave) {
+        QList<const AbstractOOXmlFile *> files;
+        QStringList paths;
+        for (int i = 0; i < worksheets.size(); ++i) {
+            files.append(worksheets[i].data());
+            paths.append(QStringLiteral("xl/worksheets/sheet%1.xml").arg(i + 1));
+        }
+        for (int i = 0; i < chartsheets.size(); ++i) {
+            files.append(chartsheets[i].data());
+            paths.append(QStringLiteral("xl/chartsheets/sheet%1.xml").arg(i + 1));
+        }
+        for (int i = 0; i < drawings.size(); ++i) {
+            files.append(drawings[i]);
+            paths.append(QStringLiteral("xl/drawings/drawing%1.xml").arg(i + 1));
+        }
+        for (int i = 0; i < chartFiles.size(); ++i) {
+            files.append(chartFiles[i].data());
+            paths.append(QStringLiteral("xl/charts/chart%1.xml").arg(i + 1));
+        }
+
+        QThreadPool pool;
+        for (int i = 0; i < files.size(); ++i) {
+            const AbstractOOXmlFile *file = files[i];
+            if (rawParts.isSelected(file))
+                continue;
+            ZipEntryDevice *entry =
+                new ZipEntryDevice(QString(), 0, zipWriter.compressionLevel(paths[i]));
+            compressedEntries.insert(file, entry);
+            pool.start(new SaveXmlFileTask(file, entry, paths[i], profiler));
+        }
+        pool.waitForDone();
+    }
+
+    // save worksheet xml files
     if (!worksheets.isEmpty())
         docPropsApp.addHeadingPair(QStringLiteral("Worksheets"), worksheets.size());
-    for (int i = 0; i < worksheets.size(); ++i) {
+    for (int i = 0; i < worksheets.size() && !isCanceled(); ++i) {
         QSharedPointer<AbstractSheet> sheet = worksheets[i];
-        contentTypes->addWorksheetName(QStringLiteral("sheet%1").arg(i + 1));
+        contentTypes->addWorksheet(i + 1);
         docPropsApp.addPartTitle(sheet->sheetName());
 
-        zipWriter.addFile(QStringLiteral("xl/worksheets/sheet%1.xml").arg(i + 1),
-                          sheet->saveToXmlData());
+        const QString path = QStringLiteral("xl/worksheets/sheet%1.xml").arg(i + 1);
+        if (!rawParts.copy(zipWriter, path, sheet.data()))
+            addXmlFile(zipWriter, path, sheet.data(), compressedEntries, profiler);
         Relationships *rel = sheet->relationships();
         if (!rel->isEmpty())
-            zipWriter.addFile(QStringLiteral("xl/worksheets/_rels/sheet%1.xml.rels").arg(i + 1),
-                              rel->saveToXmlData());
+            addRelationshipsFile(zipWriter,
+                                 QStringLiteral("xl/worksheets/_rels/sheet%1.xml.rels").arg(i + 1),
+                                 rel, profiler);
     }
 
     // save chartsheet xml files
-    QList<QSharedPointer<AbstractSheet>> chartsheets =
-        workbook->getSheetsByTypes(AbstractSheet::ST_ChartSheet);
     if (!chartsheets.isEmpty())
         docPropsApp.addHeadingPair(QStringLiteral("Chartsheets"), chartsheets.size());
-    for (int i = 0; i < chartsheets.size(); ++i) {
+    for (int i = 0; i < chartsheets.size() && !isCanceled(); ++i) {
         QSharedPointer<AbstractSheet> sheet = chartsheets[i];
-        contentTypes->addWorksheetName(QStringLiteral("sheet%1").arg(i + 1));
+        contentTypes->addChartsheet(i + 1);
         docPropsApp.addPartTitle(sheet->sheetName());
 
-        zipWriter.addFile(QStringLiteral("xl/chartsheets/sheet%1.xml").arg(i + 1),
-                          sheet->saveToXmlData());
+        const QString path = QStringLiteral("xl/chartsheets/sheet%1.xml").arg(i + 1);
+        if (!rawParts.copy(zipWriter, path, sheet.data()))
+            addXmlFile(zipWriter, path, sheet.data(), compressedEntries, profiler);
         Relationships *rel = sheet->relationships();
         if (!rel->isEmpty())
-            zipWriter.addFile(QStringLiteral("xl/chartsheets/_rels/sheet%1.xml.rels").arg(i + 1),
-                              rel->saveToXmlData());
+            addRelationshipsFile(zipWriter,
+                                 QStringLiteral("xl/chartsheets/_rels/sheet%1.xml.rels").arg(i + 1),
+                                 rel, profiler);
     }
 
     // save external links xml files
     for (int i = 0; i < workbook->d_func()->externalLinks.count(); ++i) {
         SimpleOOXmlFile *link = workbook->d_func()->externalLinks[i].data();
-        contentTypes->addExternalLinkName(QStringLiteral("externalLink%1").arg(i + 1));
+        contentTypes->addExternalLink(i + 1);
 
-        zipWriter.addFile(QStringLiteral("xl/externalLinks/externalLink%1.xml").arg(i + 1),
-                          link->saveToXmlData());
+        addXmlFile(zipWriter, QStringLiteral("xl/externalLinks/externalLink%1.xml").arg(i + 1),
+                   link, profiler);
         Relationships *rel = link->relationships();
         if (!rel->isEmpty())
-            zipWriter.addFile(
-                QStringLiteral("xl/externalLinks/_rels/externalLink%1.xml.rels").arg(i + 1),
-                rel->saveToXmlData());
+            addRelationshipsFile(
+                zipWriter,
+                QStringLiteral("xl/externalLinks/_rels/externalLink%1.xml.rels").arg(i + 1), rel,
+                profiler);
     }
 
     // save workbook xml file
     contentTypes->addWorkbook();
-    zipWriter.addFile(QStringLiteral("xl/workbook.xml"), workbook->saveToXmlData());
-    zipWriter.addFile(QStringLiteral("xl/_rels/workbook.xml.rels"),
-                      workbook->relationships()->saveToXmlData());
+    addXmlFile(zipWriter, QStringLiteral("xl/workbook.xml"), workbook.data(), profiler);
+    addRelationshipsFile(zipWriter, QStringLiteral("xl/_rels/workbook.xml.rels"),
+                         workbook->relationships(), profiler);
 
     // save drawing xml files
-    for (int i = 0; i < workbook->drawings().size(); ++i) {
-        contentTypes->addDrawingName(QStringLiteral("drawing%1").arg(i + 1));
+    for (int i = 0; i < drawings.size(); ++i) {
+        contentTypes->addDrawing(i + 1);
 
-        Drawing *drawing = workbook->drawings()[i];
-        zipWriter.addFile(QStringLiteral("xl/drawings/drawing%1.xml").arg(i + 1),
-                          drawing->saveToXmlData());
+        Drawing *drawing = drawings[i];
+        const QString path = QStringLiteral("xl/drawings/drawing%1.xml").arg(i + 1);
+        if (!rawParts.copy(zipWriter, path, drawing))
+            addXmlFile(zipWriter, path, drawing, compressedEntries, profiler);
         if (!drawing->relationships()->isEmpty())
-            zipWriter.addFile(QStringLiteral("xl/drawings/_rels/drawing%1.xml.rels").arg(i + 1),
-                              drawing->relationships()->saveToXmlData());
+            addRelationshipsFile(zipWriter,
+                                 QStringLiteral("xl/drawings/_rels/drawing%1.xml.rels").arg(i + 1),
+                                 drawing->relationships(), profiler);
+    }
+
+    // save table xml files, the unchanged ones as they were loaded
+    for (int i = 0; i < tables.size(); ++i) {
+        contentTypes->addTable(i + 1);
+        addXmlFile(zipWriter, QStringLiteral("xl/tables/table%1.xml").arg(i + 1), tables[i],
+                   profiler);
+    }
+
+    // save the comments and the VML drawings with their shapes
+    int shapeBlock = 1;
+    for (int i = 0; i < commentedSheets.size() && !isCanceled(); ++i) {
+        const WorksheetPrivate *sheet_d = commentedSheets[i]->d_func();
+        CommentsWriter commentsWriter(sheet_d->comments, sheet_d->commentAuthor);
+        contentTypes->addComment(i + 1);
+        addCommentsFiles(zipWriter, i + 1, commentsWriter, shapeBlock, profiler);
+        shapeBlock += commentsWriter.shapeBlockCount();
     }
+    if (!commentedSheets.isEmpty())
+        contentTypes->addVmlName();
 
     // save docProps app/core xml file
     foreach (QString name, q->documentPropertyNames()) {
@@ -326,39 +1134,53 @@ bool DocumentPrivate::savePackage(QIODevice *device) const
     }
     contentTypes->addDocPropApp();
     contentTypes->addDocPropCore();
-    zipWriter.addFile(QStringLiteral("docProps/app.xml"), docPropsApp.saveToXmlData());
-    zipWriter.addFile(QStringLiteral("docProps/core.xml"), docPropsCore.saveToXmlData());
+    addXmlFile(zipWriter, QStringLiteral("docProps/app.xml"), &docPropsApp, profiler);
+    addXmlFile(zipWriter, QStringLiteral("docProps/core.xml"), &docPropsCore, profiler);
 
     // save sharedStrings xml file
-    if (!workbook->sharedStrings()->isEmpty()) {
+    if (!sharedStrings->isEmpty()) {
         contentTypes->addSharedString();
-        zipWriter.addFile(QStringLiteral("xl/sharedStrings.xml"),
-                          workbook->sharedStrings()->saveToXmlData());
+        const QString path = QStringLiteral("xl/sharedStrings.xml");
+        if (!rawParts.copy(zipWriter, path, sharedStrings))
+            addXmlFile(zipWriter, path, sharedStrings, profiler);
     }
 
     // save styles xml file
     contentTypes->addStyles();
-    zipWriter.addFile(QStringLiteral("xl/styles.xml"), workbook->styles()->saveToXmlData());
+    if (!rawParts.copy(zipWriter, QStringLiteral("xl/styles.xml"), workbook->styles()))
+        addXmlFile(zipWriter, QStringLiteral("xl/styles.xml"), workbook->styles(), profiler);
 
     // save theme xml file
     contentTypes->addTheme();
-    zipWriter.addFile(QStringLiteral("xl/theme/theme1.xml"), workbook->theme()->saveToXmlData());
+    if (!rawParts.copy(zipWriter, QStringLiteral("xl/theme/theme1.xml"), workbook->theme()))
+        addThemeFile(zipWriter, QStringLiteral("xl/theme/theme1.xml"), workbook->theme(), profiler);
 
     // save chart xml files
-    for (int i = 0; i < workbook->chartFiles().size(); ++i) {
-        contentTypes->addChartName(QStringLiteral("chart%1").arg(i + 1));
-        QSharedPointer<Chart> cf = workbook->chartFiles()[i];
-        zipWriter.addFile(QStringLiteral("xl/charts/chart%1.xml").arg(i + 1), cf->saveToXmlData());
+    for (int i = 0; i < chartFiles.size(); ++i) {
+        contentTypes->addChart(i + 1);
+        QSharedPointer<Chart> cf = chartFiles[i];
+        const QString path = QStringLiteral("xl/charts/chart%1.xml").arg(i + 1);
+        if (!rawParts.copy(zipWriter, path, cf.data()))
+            addXmlFile(zipWriter, path, cf.data(), compressedEntries, profiler);
     }
 
     // save image files
-    for (int i = 0; i < workbook->mediaFiles().size(); ++i) {
-        QSharedPointer<MediaFile> mf = workbook->mediaFiles()[i];
+    for (int i = 0; i < mediaFiles.size() && !isCanceled(); ++i) {
+        QSharedPointer<MediaFile> mf = mediaFiles[i];
         if (!mf->mimeType().isEmpty())
             contentTypes->addDefault(mf->suffix(), mf->mimeType());
 
-        zipWriter.addFile(QStringLiteral("xl/media/image%1.%2").arg(i + 1).arg(mf->suffix()),
-                          mf->contents());
+        // Pictures still in the source package are copied without being inflated
+        const QString path = QStringLiteral("xl/media/image%1.%2").arg(i + 1).arg(mf->suffix());
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        QByteArray rawData;
+        ZipFileInfo info;
+        if (mf->package() && zipWriter.compressionLevel(path) != 0
+            && mf->package()->rawFileData(mf->fileName(), &rawData, &info))
+            zipWriter.addRawFile(path, rawData, info.crc, info.uncompressedSize);
+        else
+            zipWriter.addFile(path, mf->contents());
+        scope.setBytes(zipWriter.lastFileSize());
     }
 
     // save root .rels xml file
@@ -369,15 +1191,236 @@ bool DocumentPrivate::savePackage(QIODevice *device) const
                                     QStringLiteral("docProps/core.xml"));
     rootrels.addDocumentRelationship(QStringLiteral("/extended-properties"),
                                      QStringLiteral("docProps/app.xml"));
-    zipWriter.addFile(QStringLiteral("_rels/.rels"), rootrels.saveToXmlData());
+    addRelationshipsFile(zipWriter, QStringLiteral("_rels/.rels"), &rootrels, profiler);
 
     // save content types xml file
-    zipWriter.addFile(QStringLiteral("[Content_Types].xml"), contentTypes->saveToXmlData());
+    addXmlFile(zipWriter, QStringLiteral("[Content_Types].xml"), contentTypes.data(), profiler);
 
     zipWriter.close();
-    return true;
+    qDeleteAll(compressedEntries);
+    drawingIndexes.clear();
+    tableIndexes.clear();
+    commentIndexes.clear();
+    bool streamError = false;
+    foreach (QSharedPointer<AbstractSheet> sheet, worksheets) {
+        WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        sheet_d->progressMonitor = 0;
+        streamError = streamError || sheet_d->streamError;
+    }
+    // A canceled save leaves an incomplete package
+    return !zipWriter.error() && !isCanceled() && !streamError;
+}
+
+/*
+  Returns what the document has that the binary parts can't hold, or an
+  empty string when it can be saved as xlsb. The formulas would have to
+  be compiled to parsed expressions, so they are refused like the parts
+  which have no binary writer.
+ */
+QString DocumentPrivate::binaryUnsupportedFeature() const
+{
+    if (!workbook->getSheetsByTypes(AbstractSheet::ST_ChartSheet).isEmpty())
+        return QStringLiteral("chartsheets");
+    if (!workbook->d_func()->definedNamesList.isEmpty())
+        return QStringLiteral("defined names");
+    if (!workbook->d_func()->externalLinks.isEmpty())
+        return QStringLiteral("external links");
+    if (workbook->sharedStrings()->hasRichStrings())
+        return QStringLiteral("rich strings");
+
+    foreach (QSharedPointer<AbstractSheet> sheet,
+             workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet)) {
+        const WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        if (sheet_d->constantMemory)
+            return QStringLiteral("constant memory worksheets");
+        if (sheet_d->drawing)
+            return QStringLiteral("drawings");
+        if (!sheet_d->tables.isEmpty())
+            return QStringLiteral("tables");
+        if (sheet_d->autoFilterRange.isValid())
+            return QStringLiteral("autofilters");
+        if (!sheet_d->comments.isEmpty())
+            return QStringLiteral("comments");
+        if (!sheet_d->urlTable.isEmpty())
+            return QStringLiteral("hyperlinks");
+        if (!sheet_d->dataValidationsList.isEmpty())
+            return QStringLiteral("data validations");
+        if (!sheet_d->conditionalFormattingList.isEmpty())
+            return QStringLiteral("conditional formattings");
+
+        const CellTable &cellTable = sheet_d->cellTable;
+        for (int i = 0; i < cellTable.size(); ++i) {
+            if (i % CellTable::SpillBlockRows == 0)
+                cellTable.releaseRestoredBlocks();
+            const CellRow &row = cellTable.rowAt(i);
+            for (int j = 0; j < row.size(); ++j) {
+                const CellData &cell = row.cells[j];
+                if (cell.storage != CellData::Extra)
+                    continue;
+                const CellExtraData &extra = cellTable.extra(cell.index);
+                if (extra.formula.isValid())
+                    return QStringLiteral("formulas");
+                if (!extra.inlineRuns.isEmpty())
+                    return QStringLiteral("rich strings");
+            }
+        }
+    }
+    return QString();
+}
+
+/*
+  Write the workbook, styles, shared strings and worksheet parts of an
+  xlsb package, once binaryUnsupportedFeature() has accepted the
+  document. The document properties and the theme stay xml parts.
+ */
+bool DocumentPrivate::saveBinaryPackage(ZipWriter &zipWriter) const
+{
+    Q_Q(const Document);
+    DocPropsApp docPropsApp(DocPropsApp::F_NewFromScratch);
+    DocPropsCore docPropsCore(DocPropsCore::F_NewFromScratch);
+    QList<QSharedPointer<AbstractSheet>> worksheets =
+        workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet);
+    SharedStrings *sharedStrings = workbook->sharedStrings();
+
+    // save workbook bin file, which adds the sheets of an empty workbook
+    {
+        contentTypes->addOverride(ContentTypes::BinaryWorkbookPart);
+        const QString path = QStringLiteral("xl/workbook.bin");
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        workbook->saveToBinaryFile(zipWriter.beginFile(path));
+        zipWriter.endFile();
+        scope.setBytes(zipWriter.lastFileSize());
+    }
+    addRelationshipsFile(zipWriter, QStringLiteral("xl/_rels/workbook.bin.rels"),
+                         workbook->relationships(), profiler);
+    if (worksheets.isEmpty())
+        worksheets = workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet);
+
+    // save worksheet bin files
+    if (!worksheets.isEmpty())
+        docPropsApp.addHeadingPair(QStringLiteral("Worksheets"), worksheets.size());
+    for (int i = 0; i < worksheets.size() && !isCanceled(); ++i) {
+        const Worksheet *sheet = static_cast<Worksheet *>(worksheets[i].data());
+        contentTypes->addOverride(ContentTypes::BinaryWorksheetPart, i + 1);
+        docPropsApp.addPartTitle(sheet->sheetName());
+
+        const QString path = QStringLiteral("xl/worksheets/sheet%1.bin").arg(i + 1);
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        sheet->saveToBinaryFile(zipWriter.beginFile(path));
+        zipWriter.endFile();
+        scope.setBytes(zipWriter.lastFileSize());
+    }
+
+    // save docProps app/core xml file
+    foreach (QString name, q->documentPropertyNames()) {
+        docPropsApp.setProperty(name, q->documentProperty(name));
+        docPropsCore.setProperty(name, q->documentProperty(name));
+    }
+    contentTypes->addDocPropApp();
+    contentTypes->addDocPropCore();
+    addXmlFile(zipWriter, QStringLiteral("docProps/app.xml"), &docPropsApp, profiler);
+    addXmlFile(zipWriter, QStringLiteral("docProps/core.xml"), &docPropsCore, profiler);
+
+    // save sharedStrings bin file
+    if (!sharedStrings->isEmpty()) {
+        contentTypes->addOverride(ContentTypes::BinarySharedStringsPart);
+        const QString path = QStringLiteral("xl/sharedStrings.bin");
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        sharedStrings->saveToBinaryFile(zipWriter.beginFile(path));
+        zipWriter.endFile();
+        scope.setBytes(zipWriter.lastFileSize());
+    }
+
+    // save styles bin file
+    {
+        contentTypes->addOverride(ContentTypes::BinaryStylesPart);
+        const QString path = QStringLiteral("xl/styles.bin");
+        ProfilerScope scope(profiler, Profiler::WritePhase, path);
+        workbook->styles()->saveToBinaryFile(zipWriter.beginFile(path));
+        zipWriter.endFile();
+        scope.setBytes(zipWriter.lastFileSize());
+    }
+
+    // save theme xml file
+    contentTypes->addTheme();
+    addThemeFile(zipWriter, QStringLiteral("xl/theme/theme1.xml"), workbook->theme(), profiler);
+
+    // save root .rels xml file
+    Relationships rootrels;
+    rootrels.addDocumentRelationship(QStringLiteral("/officeDocument"),
+                                     QStringLiteral("xl/workbook.bin"));
+    rootrels.addPackageRelationship(QStringLiteral("/metadata/core-properties"),
+                                    QStringLiteral("docProps/core.xml"));
+    rootrels.addDocumentRelationship(QStringLiteral("/extended-properties"),
+                                     QStringLiteral("docProps/app.xml"));
+    addRelationshipsFile(zipWriter, QStringLiteral("_rels/.rels"), &rootrels, profiler);
+
+    // save content types xml file
+    addXmlFile(zipWriter, QStringLiteral("[Content_Types].xml"), contentTypes.data(), profiler);
+
+    zipWriter.close();
+    return !zipWriter.error() && !isCanceled();
 }
 
+/*
+  Load the parts still left in the package before the file \a name is
+  written, in case the document has been loaded from it.
+ */
+void DocumentPrivate::detachFromFile(const QString &name) const
+{
+    workbook->d_func()->loadDrawings();
+    foreach (QSharedPointer<MediaFile> media, workbook->mediaFiles()) {
+        if (media->package() && QFileInfo(media->package()->fileName()) == QFileInfo(name))
+            media->detachPackage();
+    }
+}
+
+namespace {
+
+// The asynchronous saves have threads of their own, as the parallel
+// compression waits for tasks of the global thread pool.
+Q_GLOBAL_STATIC(QThreadPool, asyncSavePool)
+
+/*
+  Save the \a snapshot of a document, which is deleted afterwards, to the
+  file \a fileName, and report the result to the future.
+ */
+class SaveSnapshotTask : public QRunnable
+{
+public:
+    SaveSnapshotTask(Document *snapshot, const DocumentPrivate *snapshotPrivate,
+                     const QString &fileName)
+        : m_snapshot(snapshot)
+        , m_snapshotPrivate(snapshotPrivate)
+        , m_fileName(fileName)
+    {
+        m_future.reportStarted();
+    }
+
+    QFuture<bool> future() { return m_future.future(); }
+
+    void run()
+    {
+        QFile file(m_fileName);
+        const QIODevice::OpenMode mode = m_snapshotPrivate->password.isEmpty()
+                                             ? QIODevice::WriteOnly
+                                             : QIODevice::ReadWrite | QIODevice::Truncate;
+        const bool ok = file.open(mode) && m_snapshotPrivate->savePackage(&file, false);
+        file.close();
+        m_snapshot.reset();
+        m_future.reportResult(ok);
+        m_future.reportFinished();
+    }
+
+private:
+    QScopedPointer<Document> m_snapshot;
+    const DocumentPrivate *m_snapshotPrivate;
+    QString m_fileName;
+    QFutureInterface<bool> m_future;
+};
+
+} // namespace
+
 /*!
   \class Document
   \inmodule QtXlsx
@@ -405,13 +1448,20 @@ Document::Document(const QString &name, QObject *parent)
     : QObject(parent)
     , d_ptr(new DocumentPrivate(this))
 {
-    d_ptr->packageName = name;
-    if (QFile::exists(name)) {
-        QFile xlsx(name);
-        if (xlsx.open(QFile::ReadOnly))
-            d_ptr->loadPackage(&xlsx);
-    }
-    d_ptr->init();
+    d_ptr->open(name);
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document named \a name with the given load \a options.
+ * The \a parent argument is passed to QObject's constructor.
+ */
+Document::Document(const QString &name, LoadOptions options, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->loadOptions = options;
+    d_ptr->open(name);
 }
 
 /*!
@@ -428,6 +1478,174 @@ Document::Document(QIODevice *device, QObject *parent)
     d_ptr->init();
 }
 
+/*!
+ * \overload
+ * Try to open an existing xlsx document from \a device with the given load \a options.
+ * The \a parent argument is passed to QObject's constructor.
+ */
+Document::Document(QIODevice *device, LoadOptions options, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->loadOptions = options;
+    if (device && device->isReadable())
+        d_ptr->loadPackage(device);
+    d_ptr->init();
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document named \a name with the given load \a options,
+ * only loading the sheets and the cells accepted by \a filter.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setLoadFilter()
+ */
+Document::Document(const QString &name, const LoadFilter &filter, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->loadOptions = options;
+    d_ptr->loadFilter = filter;
+    d_ptr->open(name);
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document from \a device with the given load \a options,
+ * only loading the sheets and the cells accepted by \a filter.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setLoadFilter()
+ */
+Document::Document(QIODevice *device, const LoadFilter &filter, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->loadOptions = options;
+    d_ptr->loadFilter = filter;
+    if (device && device->isReadable())
+        d_ptr->loadPackage(device);
+    d_ptr->init();
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document named \a name with the given load \a options,
+ * reporting the phases of the load to \a profiler.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setProfiler()
+ */
+Document::Document(Profiler *profiler, const QString &name, LoadOptions options, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->profiler = profiler;
+    d_ptr->loadOptions = options;
+    d_ptr->open(name);
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document from \a device with the given load \a options,
+ * reporting the phases of the load to \a profiler.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setProfiler()
+ */
+Document::Document(Profiler *profiler, QIODevice *device, LoadOptions options, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->profiler = profiler;
+    d_ptr->loadOptions = options;
+    if (device && device->isReadable())
+        d_ptr->loadPackage(device);
+    d_ptr->init();
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document named \a name with the given load \a options,
+ * reporting the progress of the load to \a monitor, which can cancel it.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setProgressMonitor()
+ */
+Document::Document(ProgressMonitor *monitor, const QString &name, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->progressMonitor = monitor;
+    d_ptr->loadOptions = options;
+    d_ptr->open(name);
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document from \a device with the given load \a options,
+ * reporting the progress of the load to \a monitor, which can cancel it.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setProgressMonitor()
+ */
+Document::Document(ProgressMonitor *monitor, QIODevice *device, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->progressMonitor = monitor;
+    d_ptr->loadOptions = options;
+    if (device && device->isReadable())
+        d_ptr->loadPackage(device);
+    d_ptr->init();
+}
+
+/*!
+ * \overload
+ * Try to open the existing xlsx document named \a name, encrypted with
+ * \a password, with the given load \a options. The document is empty if
+ * the password is wrong. The password is kept to encrypt the document
+ * when it is saved. The \a parent argument is passed to QObject's
+ * constructor.
+ *
+ * \sa setPassword()
+ */
+Document::Document(const QString &name, const QString &password, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->password = password;
+    d_ptr->loadOptions = options;
+    d_ptr->open(name);
+}
+
+/*!
+ * \overload
+ * Try to open an existing xlsx document from \a device, encrypted with
+ * \a password, with the given load \a options. The \a device must be
+ * random access for an encrypted package to be read.
+ * The \a parent argument is passed to QObject's constructor.
+ *
+ * \sa setPassword()
+ */
+Document::Document(QIODevice *device, const QString &password, LoadOptions options,
+                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new DocumentPrivate(this))
+{
+    d_ptr->password = password;
+    d_ptr->loadOptions = options;
+    if (device && device->isReadable())
+        d_ptr->loadPackage(device);
+    d_ptr->init();
+}
+
 /*!
     \overload
 
@@ -487,6 +1705,39 @@ bool Document::insertImage(int row, int column, const QImage &image)
     return false;
 }
 
+/*!
+ * Inserts the \a images one below the other to the current active
+ * worksheet, starting at the position \a row, \a col, with \a spacing
+ * pixels between them. Returns false if one of the images is null.
+ *
+ * \sa Worksheet::insertImages()
+ */
+bool Document::insertImages(int row, int col, const QList<QImage> &images, int spacing)
+{
+    if (Worksheet *sheet = currentWorksheet())
+        return sheet->insertImages(row, col, images, spacing);
+    return false;
+}
+
+/*!
+ * \overload
+ *
+ * Insert the \a encoded bytes of an image, in the format given by
+ * \a suffix, to current active worksheet at the position \a row,
+ * \a column, without decoding them. The size of the image is
+ * \a pixelSize, or is read from its header when \a pixelSize isn't valid.
+ * Returns true if success.
+ *
+ * \sa Worksheet::insertImage()
+ */
+bool Document::insertImage(int row, int column, const QByteArray &encoded,
+                           const QString &suffix, const QSize &pixelSize)
+{
+    if (Worksheet *sheet = currentWorksheet())
+        return sheet->insertImage(row, column, encoded, suffix, pixelSize);
+    return false;
+}
+
 /*!
  * Creates an chart with the given \a size and insert it to the current
  * active worksheet at the position \a row, \a col.
@@ -524,6 +1775,17 @@ bool Document::unmergeCells(const CellRange &range)
     return false;
 }
 
+/*!
+  Returns the merged cells of the current worksheet which contain the cell
+  (\a row, \a column), or an invalid range if the cell isn't merged.
+ */
+CellRange Document::mergedRangeAt(int row, int column) const
+{
+    if (Worksheet *sheet = currentWorksheet())
+        return sheet->mergedRangeAt(row, column);
+    return CellRange();
+}
+
 /*!
   Sets width in characters of columns with the given \a range and \a width.
   Returns true on success.
@@ -613,10 +1875,24 @@ bool Document::setColumnFormat(int colFirst, int colLast, const Format &format)
   Columns are 1-indexed.
   Returns true on success.
  */
-bool Document::setColumnHidden(int colFirst, int colLast, bool hidden)
+bool Document::setColumnHidden(int colFirst, int colLast, bool hidden)
+{
+    if (Worksheet *sheet = currentWorksheet())
+        return sheet->setColumnHidden(colFirst, colLast, hidden);
+    return false;
+}
+
+/*!
+  Sets the widths of the columns of \a range of the current worksheet to fit
+  their cells, the whole sheet when \a range is invalid.
+  Returns true on success.
+
+  \sa Worksheet::autoFitColumns()
+ */
+bool Document::autoFitColumns(const CellRange &range)
 {
     if (Worksheet *sheet = currentWorksheet())
-        return sheet->setColumnHidden(colFirst, colLast, hidden);
+        return sheet->autoFitColumns(range);
     return false;
 }
 
@@ -842,6 +2118,82 @@ bool Document::defineName(const QString &name, const QString &formula, const QSt
     return d->workbook->defineName(name, formula, comment, scope);
 }
 
+/*
+  Returns the worksheet the range of the defined name \a name is on, the
+  range being stored in \a range, or 0 when the name doesn't refer to a
+  range of a worksheet. The names of the current sheet come first.
+ */
+Worksheet *DocumentPrivate::definedNameSheet(const QString &name, CellRange *range) const
+{
+    AbstractSheet *current = workbook->activeSheet();
+    QString sheetName;
+    *range = workbook->definedNameRange(name, current ? current->sheetName() : QString(),
+                                        &sheetName);
+    if (!range->isValid())
+        return 0;
+    AbstractSheet *sheet = sheetName.isEmpty()
+                               ? current
+                               : workbook->sheet(workbook->sheetIndex(sheetName));
+    if (!sheet || sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+        return 0;
+    return static_cast<Worksheet *>(sheet);
+}
+
+/*!
+ * Returns the range the defined name \a name refers to, or an invalid
+ * range when the name doesn't exist or isn't a single range. The names
+ * scoped to the current sheet hide the global ones, and the case of
+ * \a name is ignored. The sheet of the range is stored in \a sheetName if
+ * it isn't null.
+ *
+ * \sa defineName(), readRange()
+ */
+CellRange Document::definedNameRange(const QString &name, QString *sheetName) const
+{
+    Q_D(const Document);
+    AbstractSheet *current = d->workbook->activeSheet();
+    return d->workbook->definedNameRange(name, current ? current->sheetName() : QString(),
+                                         sheetName);
+}
+
+/*!
+ * Reads the values of the cells of the range the defined name \a name
+ * refers to, row by row. Empty cells are read as null variants. Returns
+ * an empty vector if the name isn't a range of a worksheet.
+ *
+ * \sa definedNameRange()
+ */
+QVector<QVariant> Document::readRange(const QString &name) const
+{
+    Q_D(const Document);
+    CellRange range;
+    Worksheet *sheet = d->definedNameSheet(name, &range);
+    QVector<QVariant> values;
+    if (!sheet)
+        return values;
+
+    values.reserve(range.rowCount() * range.columnCount());
+    for (int row = range.firstRow(); row <= range.lastRow(); ++row) {
+        for (int col = range.firstColumn(); col <= range.lastColumn(); ++col)
+            values.append(sheet->read(row, col));
+    }
+    return values;
+}
+
+/*!
+ * \overload
+ * Reads the numbers of the range the defined name \a name refers to into
+ * \a values, with the bulk reader of Worksheet::readRange(). Returns false
+ * if the name isn't a range of a worksheet.
+ */
+bool Document::readRange(const QString &name, QVector<double> *values, QBitArray *valid) const
+{
+    Q_D(const Document);
+    CellRange range;
+    Worksheet *sheet = d->definedNameSheet(name, &range);
+    return sheet && sheet->readRange(range, values, valid);
+}
+
 /*!
     Return the range that contains cell data.
  */
@@ -916,7 +2268,7 @@ Workbook *Document::workbook() const
 AbstractSheet *Document::sheet(const QString &sheetName) const
 {
     Q_D(const Document);
-    return d->workbook->sheet(sheetNames().indexOf(sheetName));
+    return d->workbook->sheet(d->workbook->sheetIndex(sheetName));
 }
 
 /*!
@@ -948,7 +2300,7 @@ bool Document::renameSheet(const QString &oldName, const QString &newName)
     Q_D(Document);
     if (oldName == newName)
         return false;
-    return d->workbook->renameSheet(sheetNames().indexOf(oldName), newName);
+    return d->workbook->renameSheet(d->workbook->sheetIndex(oldName), newName);
 }
 
 /*!
@@ -960,7 +2312,7 @@ bool Document::copySheet(const QString &srcName, const QString &distName)
     Q_D(Document);
     if (srcName == distName)
         return false;
-    return d->workbook->copySheet(sheetNames().indexOf(srcName), distName);
+    return d->workbook->copySheet(d->workbook->sheetIndex(srcName), distName);
 }
 
 /*!
@@ -970,7 +2322,7 @@ bool Document::copySheet(const QString &srcName, const QString &distName)
 bool Document::moveSheet(const QString &srcName, int distIndex)
 {
     Q_D(Document);
-    return d->workbook->moveSheet(sheetNames().indexOf(srcName), distIndex);
+    return d->workbook->moveSheet(d->workbook->sheetIndex(srcName), distIndex);
 }
 
 /*!
@@ -980,7 +2332,7 @@ bool Document::moveSheet(const QString &srcName, int distIndex)
 bool Document::deleteSheet(const QString &name)
 {
     Q_D(Document);
-    return d->workbook->deleteSheet(sheetNames().indexOf(name));
+    return d->workbook->deleteSheet(d->workbook->sheetIndex(name));
 }
 
 /*!
@@ -1013,7 +2365,7 @@ Worksheet *Document::currentWorksheet() const
 bool Document::selectSheet(const QString &name)
 {
     Q_D(Document);
-    return d->workbook->setActiveSheet(sheetNames().indexOf(name));
+    return d->workbook->setActiveSheet(d->workbook->sheetIndex(name));
 }
 
 /*!
@@ -1025,6 +2377,121 @@ QStringList Document::sheetNames() const
     return d->workbook->worksheetNames();
 }
 
+/*!
+ * Replaces the contents of the document with the file \a name, whose sheets
+ * are parsed on a worker thread. Returns false if the file can't be loaded,
+ * the document is then empty.
+ *
+ * The workbook, the styles and the shared strings are loaded before this
+ * function returns, so that the names of the sheets are known. The sheets
+ * are then parsed in the background, the active sheet first. The
+ * sheetLoaded() signal is emitted for each of them once the event loop of
+ * the thread of the document gets control again, then loadFinished() is
+ * emitted. Accessing a sheet which hasn't been reported yet loads it on the
+ * spot, waiting for the worker when it's parsing the sheet.
+ *
+ * The file must not change until loadFinished() has been emitted.
+ *
+ * \sa LazyLoad
+ */
+bool Document::openAsync(const QString &name)
+{
+    Q_D(Document);
+    d->workbook.clear();
+    d->contentTypes.clear();
+    d->sourcePackage.clear();
+    d->documentProperties.clear();
+    d->packageName = name;
+
+    const LoadOptions options = d->loadOptions;
+    d->loadOptions = (options | LazyLoad) & ~ParallelLoad;
+    const bool ok =
+        QFile::exists(name) && d->loadPackage(QSharedPointer<ZipReader>(new ZipReader(name)));
+    d->loadOptions = options;
+    d->init();
+
+    SheetLoader *loader = d->workbook->d_func()->loadSheetsInBackground(name);
+    if (loader) {
+        connect(loader, SIGNAL(sheetLoaded(QString)), this, SIGNAL(sheetLoaded(QString)));
+        connect(loader, SIGNAL(finished()), this, SIGNAL(loadFinished()));
+    } else {
+        QMetaObject::invokeMethod(this, "loadFinished", Qt::QueuedConnection);
+    }
+    return ok;
+}
+
+/*!
+ * Replaces the contents of the document with the snapshot \a snapshotName
+ * saved by saveSnapshot(). Returns false, leaving the document unchanged,
+ * if the file isn't a snapshot of this version of the library, or if
+ * \a sourceName is given and the snapshot hasn't been made from a file
+ * with the same contents. Returns false, the document being then empty,
+ * if the snapshot can't be loaded.
+ *
+ * The snapshot file is mapped into memory, and its parts, which aren't
+ * compressed, are read from the mapping. The document is saved to
+ * \a sourceName, or to the source file recorded in the snapshot, by save().
+ *
+ * \code
+ * QScopedPointer<Document> xlsx(new Document);
+ * if (!xlsx->loadSnapshot("reference.snapshot", "reference.xlsx")) {
+ *     xlsx.reset(new Document("reference.xlsx"));
+ *     xlsx->saveSnapshot("reference.snapshot");
+ * }
+ * \endcode
+ *
+ * \sa saveSnapshot()
+ */
+bool Document::loadSnapshot(const QString &snapshotName, const QString &sourceName)
+{
+    Q_D(Document);
+    if (!QFile::exists(snapshotName))
+        return false;
+    QSharedPointer<ZipReader> zipReader(new ZipReader(snapshotName));
+    if (!zipReader->contains(snapshotHeaderPath()))
+        return false;
+
+    QByteArray header = zipReader->fileData(snapshotHeaderPath());
+    QDataStream stream(&header, QIODevice::ReadOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 format = Xlsx;
+    QString source;
+    QByteArray key;
+    stream >> magic >> version >> format >> source >> key;
+    if (stream.status() != QDataStream::Ok || magic != SnapshotMagic
+        || version != SnapshotVersion)
+        return false;
+    if (!sourceName.isEmpty() && (key.isEmpty() || snapshotSourceKey(sourceName) != key))
+        return false;
+
+    d->workbook.clear();
+    d->contentTypes.clear();
+    d->sourcePackage.clear();
+    d->documentProperties.clear();
+    d->packageName = sourceName.isEmpty() ? source : sourceName;
+    const bool ok = d->loadPackage(zipReader);
+    d->init();
+    // The binary parts of the snapshot don't change how it is saved
+    d->fileFormat = FileFormat(format);
+    return ok;
+}
+
+/*!
+ * \fn void Document::sheetLoaded(const QString &sheetName)
+ *
+ * This signal is emitted once the sheet \a sheetName, opened by
+ * openAsync(), has been loaded.
+ */
+
+/*!
+ * \fn void Document::loadFinished()
+ *
+ * This signal is emitted once all the sheets of the file opened by
+ * openAsync() have been loaded.
+ */
+
 /*!
  * Save current document to the filesystem. If no name specified when
  * the document constructed, a default name "book1.xlsx" will be used.
@@ -1044,8 +2511,16 @@ bool Document::save() const
  */
 bool Document::saveAs(const QString &name) const
 {
+    Q_D(const Document);
+    d->detachFromFile(name);
+
+    // The encrypted package is read back once written, for its integrity
+    // check
     QFile file(name);
-    if (file.open(QIODevice::WriteOnly))
+    const QIODevice::OpenMode mode = d->password.isEmpty()
+                                         ? QIODevice::WriteOnly
+                                         : QIODevice::ReadWrite | QIODevice::Truncate;
+    if (file.open(mode))
         return saveAs(&file);
     return false;
 }
@@ -1054,6 +2529,11 @@ bool Document::saveAs(const QString &name) const
  * \overload
  * This function writes a document to the given \a device.
  *
+ * The \a device doesn't have to be seekable: the package is then written
+ * with data descriptors, each part going out as soon as it is
+ * compressed, so that a socket or an HTTP response can be fed while the
+ * document is saved, without buffering the whole package first.
+ *
  * \warning The \a device will be closed when this function returned.
  */
 bool Document::saveAs(QIODevice *device) const
@@ -1062,6 +2542,508 @@ bool Document::saveAs(QIODevice *device) const
     return d->savePackage(device);
 }
 
+/*!
+ * Saves the document to the file with the given \a name on a worker thread,
+ * and returns a future holding whether it has been saved successfully.
+ *
+ * The formulas are recalculated and the tables compacted before this
+ * function returns, then a snapshot of the document is saved. The cells,
+ * formats and sheets of the document may be changed while the save runs,
+ * the changes are not part of the saved file. The drawings, charts and
+ * pictures are shared with the snapshot: they must not be changed, and the
+ * document must not be saved again, until the future is finished.
+ *
+ * No snapshot can be taken of the worksheets of the constant memory mode,
+ * the documents which have some are saved before this function returns.
+ *
+ * \sa saveAs()
+ */
+QFuture<bool> Document::saveAsAsync(const QString &name) const
+{
+    Q_D(const Document);
+    d->detachFromFile(name);
+
+    foreach (QSharedPointer<AbstractSheet> sheet,
+             d->workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet)) {
+        if (static_cast<Worksheet *>(sheet.data())->isConstantMemoryEnabled()) {
+            QFutureInterface<bool> future;
+            future.reportStarted();
+            const bool ok = saveAs(name);
+            future.reportResult(ok);
+            future.reportFinished();
+            return future.future();
+        }
+    }
+
+    d->prepareSave();
+    // The source package can't be read any more once it's overwritten.
+    if (d->sourcePackage && !d->sourcePackage->fileName().isEmpty()
+        && QFileInfo(name) == QFileInfo(d->sourcePackage->fileName()))
+        d->sourcePackage.reset();
+
+    Document *snapshot = new Document;
+    DocumentPrivate *snapshot_d = snapshot->d_func();
+    snapshot_d->workbook = QSharedPointer<Workbook>(d->workbook->snapshot());
+    snapshot_d->documentProperties = d->documentProperties;
+    snapshot_d->saveOptions = d->saveOptions;
+    snapshot_d->compression = d->compression;
+    snapshot_d->fileFormat = d->fileFormat;
+    snapshot_d->partCompressions = d->partCompressions;
+    snapshot_d->profiler = d->profiler;
+    snapshot_d->progressMonitor = d->progressMonitor;
+    snapshot_d->password = d->password;
+
+    SaveSnapshotTask *task = new SaveSnapshotTask(snapshot, snapshot_d, name);
+    QFuture<bool> future = task->future();
+    asyncSavePool()->start(task);
+    return future;
+}
+
+/*!
+ * Saves a snapshot of the document to the file \a snapshotName, which
+ * loadSnapshot() reads back much faster than the workbook itself. Returns
+ * true if saved successfully.
+ *
+ * The snapshot records the hash of the contents of \a sourceName, or of
+ * the file the document has been opened from when it's empty, against
+ * which loadSnapshot() checks that it isn't stale.
+ *
+ * The parts of the snapshot are stored without compression. The
+ * workbook, the styles, the shared strings and the worksheets are saved
+ * as BIFF12 records, the same as the Xlsb format, unless the document has
+ * anything this format can't hold, in which case the snapshot is made of
+ * xml parts. A snapshot is only meant to be read by the same version of
+ * the library, not by other applications.
+ *
+ * \sa loadSnapshot(), FileFormat
+ */
+bool Document::saveSnapshot(const QString &snapshotName, const QString &sourceName) const
+{
+    Q_D(const Document);
+    const QString source = sourceName.isEmpty() ? d->packageName : sourceName;
+    QByteArray header;
+    {
+        QDataStream stream(&header, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << SnapshotMagic << SnapshotVersion << qint32(d->fileFormat) << source
+               << snapshotSourceKey(source);
+    }
+
+    d->detachFromFile(snapshotName);
+    QFile file(snapshotName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    d->snapshotHeader = header;
+    const bool ok = d->savePackage(&file);
+    d->snapshotHeader.clear();
+    return ok;
+}
+
+/*!
+ * Discards the sheets, the cells, the formats, the strings and the
+ * properties of the document, which becomes the same as a new Document,
+ * so that one Document can be reused for many small files.
+ *
+ * The save and load options, the compressions, the file format, the
+ * profiler, the progress monitor, the memory budget and the settings of
+ * the workbook which change how the cells are written are kept.
+ *
+ * \sa saveAs()
+ */
+void Document::reset()
+{
+    Q_D(Document);
+    QSharedPointer<Workbook> old = d->workbook;
+    d->workbook.clear();
+    d->contentTypes.clear();
+    d->sourcePackage.clear();
+    d->packageName.clear();
+    d->documentProperties.clear();
+    d->init();
+
+    WorkbookPrivate *book_d = d->workbook->d_func();
+    const WorkbookPrivate *old_d = old->d_func();
+    book_d->strings_to_numbers_enabled = old_d->strings_to_numbers_enabled;
+    book_d->strings_to_hyperlinks_enabled = old_d->strings_to_hyperlinks_enabled;
+    book_d->html_to_richstring_enabled = old_d->html_to_richstring_enabled;
+    book_d->defaultDateFormat = old_d->defaultDateFormat;
+    if (old_d->concurrent_writes_enabled)
+        d->workbook->setConcurrentWritesEnabled(true);
+}
+
+/*!
+    \enum Document::SaveOption
+
+    \value DefaultSaveOptions All the parts are serialized one after another.
+    \value ParallelSave The worksheets, chartsheets, drawings and charts are
+           serialized and compressed on a thread pool. Their compressed data
+           is kept in memory until it is written to the package.
+    \value ParallelCompression The large parts, such as a big worksheet,
+           are deflated in chunks on the global thread pool while they are
+           serialized. The compressed files are slightly larger.
+    \value CompactStyles The identical cell formats are merged and the
+           unused ones are dropped before the document is saved, see
+           Workbook::compactStyles().
+    \value IncrementalSave The rows of the worksheets are kept, in blocks
+           of 1024 rows, once they have been written, and the blocks which
+           haven't changed are written as they are by the next save. That
+           saves most of the work when a large document is saved again
+           after a few edits, at the cost of the memory taken by the kept
+           rows. The blocks with formulas are always written again.
+ */
+
+/*!
+    \enum Document::LoadOption
+
+    \value DefaultLoadOptions All the parts are loaded one after another.
+    \value ParallelLoad The worksheets and chartsheets are parsed on a thread
+           pool once the styles and the shared strings have been loaded.
+    \value LazyLoad Each worksheet or chartsheet, together with its drawing,
+           charts and pictures, is only parsed when it is first accessed.
+           The package stays open until then, and pictures keep referring to
+           it until their contents are needed, so a document loaded from a
+           device needs the device to stay open too. This option takes
+           precedence over ParallelLoad.
+    \value ReadOnlyLoad The lookup tables which are only used to add new
+           formats are not built while the styles are loaded, but when
+           the first format is added, or when the styles are saved. The
+           lookup table of the shared strings is always built that way.
+    \value RowBlockLoad The rows of the worksheets are stored by blocks in
+           a compressed temporary file while they are loaded, and only the
+           blocks which have been read last are kept in memory. The memory
+           then follows the rows which are accessed rather than the size of
+           the sheets, at the cost of slower random reads. The rows which
+           are changed stay in memory.
+ */
+
+/*!
+ * Sets the \a options used when the document is saved.
+ */
+void Document::setSaveOptions(SaveOptions options)
+{
+    Q_D(Document);
+    d->saveOptions = options;
+}
+
+/*!
+ * Returns the options used when the document is saved.
+ */
+Document::SaveOptions Document::saveOptions() const
+{
+    Q_D(const Document);
+    return d->saveOptions;
+}
+
+/*!
+    \enum Document::Compression
+
+    \value NoCompression The parts are stored without compression.
+    \value FastCompression The parts are deflated as fast as possible,
+           which gives larger files.
+    \value DefaultCompression The parts are deflated with the default
+           level of zlib.
+    \value BestCompression The parts are deflated to the smallest size,
+           which is the slowest.
+
+    Parts which are copied unchanged from the package the document was
+    loaded from keep their compression, unless they must be stored.
+ */
+
+/*!
+ * Sets the \a compression of the parts of the package when the document
+ * is saved.
+ */
+void Document::setCompression(Compression compression)
+{
+    Q_D(Document);
+    d->compression = compression;
+}
+
+/*!
+ * \overload
+ * Sets the \a compression of the part \a partName, such as
+ * "xl/worksheets/sheet1.xml", or of all the parts in the folder
+ * \a partName when it ends with a slash, such as "xl/media/". This
+ * takes precedence over the compression of the document.
+ */
+void Document::setCompression(const QString &partName, Compression compression)
+{
+    Q_D(Document);
+    d->partCompressions[partName] = compression;
+}
+
+/*!
+ * Returns the compression of the parts of the package.
+ */
+Document::Compression Document::compression() const
+{
+    Q_D(const Document);
+    return d->compression;
+}
+
+/*!
+    \enum Document::FileFormat
+
+    \value Xlsx The parts of the package are xml files.
+    \value Xlsb The workbook, styles, shared strings and worksheets are
+           BIFF12 binary records, which are smaller and faster to read and
+           write. The formulas, chartsheets, drawings, tables, comments,
+           hyperlinks, data validations, conditional formattings, defined
+           names and rich strings can't be saved in this format: the save
+           fails when the document has any of them. The formulas of a
+           loaded xlsb file keep their values only.
+ */
+
+/*!
+ * Sets the \a format the document is saved in. The format is that of the
+ * file the document has been loaded from, Xlsx for a new document.
+ */
+void Document::setFileFormat(FileFormat format)
+{
+    Q_D(Document);
+    d->fileFormat = format;
+}
+
+/*!
+ * Returns the format the document is saved in.
+ */
+Document::FileFormat Document::fileFormat() const
+{
+    Q_D(const Document);
+    return d->fileFormat;
+}
+
+/*!
+ * Sets the \a password the document is encrypted with when it is saved,
+ * the package then being stored in a compound file with the agile
+ * encryption of Office: AES-256 and SHA-512. The package is encrypted
+ * segment by segment as it is written. An empty password, the default,
+ * saves the package unencrypted. The snapshots are never encrypted. The
+ * save fails when the system has no secure random generator to make up
+ * the keys.
+ *
+ * The encrypted packages are loaded with the password given to the
+ * constructor, or with the default password of Excel when there is none.
+ * Only the agile encryption, with AES in the CBC mode, can be read.
+ */
+void Document::setPassword(const QString &password)
+{
+    Q_D(Document);
+    d->password = password;
+}
+
+/*!
+ * Returns the password the document is encrypted with when it is saved.
+ */
+QString Document::password() const
+{
+    Q_D(const Document);
+    return d->password;
+}
+
+/*!
+ * Sets the \a profiler to which the phases of the next loads and saves
+ * of the document are reported. The document doesn't take ownership of
+ * the \a profiler, which must outlive it or be reset to 0 first. No
+ * measurement is done when there is no profiler, which is the default.
+ *
+ * \sa Profiler
+ */
+void Document::setProfiler(Profiler *profiler)
+{
+    Q_D(Document);
+    d->profiler = profiler;
+}
+
+/*!
+ * Returns the profiler of the document, or 0 if none has been set.
+ */
+Profiler *Document::profiler() const
+{
+    Q_D(const Document);
+    return d->profiler;
+}
+
+/*!
+ * Sets the \a monitor which follows the next loads and saves of the
+ * document, and which can cancel them. The document doesn't take ownership
+ * of the \a monitor, which must outlive it or be reset to 0 first.
+ *
+ * A canceled save returns false, and a canceled load leaves an empty
+ * document.
+ *
+ * \sa ProgressMonitor
+ */
+void Document::setProgressMonitor(ProgressMonitor *monitor)
+{
+    Q_D(Document);
+    d->progressMonitor = monitor;
+}
+
+/*!
+ * Returns the progress monitor of the document, or 0 if none has been set.
+ */
+ProgressMonitor *Document::progressMonitor() const
+{
+    Q_D(const Document);
+    return d->progressMonitor;
+}
+
+/*!
+ * Sets the number of \a bytes the cells of the document may take in
+ * memory. Once they take more, the finished blocks of rows of the
+ * worksheets are spilled to compressed temporary files, and read back
+ * when they are accessed or saved. Writing rows from top to bottom keeps
+ * the memory of a giant worksheet bounded; random access to the spilled
+ * rows is slower.
+ *
+ * The extra data of the cells, such as formulas and inline strings, stay
+ * in memory. When \l Workbook::setConcurrentWritesEnabled() is on, each
+ * worksheet only spills its own rows.
+ *
+ * The default budget, 0, keeps all the cells in memory.
+ */
+void Document::setMemoryBudget(qint64 bytes)
+{
+    Q_D(Document);
+    d->memoryBudget = qMax(bytes, qint64(0));
+    d->workbook->d_func()->memoryBudget = d->memoryBudget;
+}
+
+/*!
+ * Returns the number of bytes the cells of the document may take in
+ * memory, or 0 if there is no budget.
+ *
+ * \sa setMemoryBudget()
+ */
+qint64 Document::memoryBudget() const
+{
+    Q_D(const Document);
+    return d->memoryBudget;
+}
+
+/*!
+ * Releases the memory the document keeps after bulk edits without
+ * needing it: drops the shared strings no cell uses any more, compacts
+ * the styles as \l Workbook::compactStyles() does, drops the row and
+ * column infos left with the default values, which are saved as empty
+ * rows, and releases the capacity left in the tables by the removed cells
+ * and the caches built again on demand. The sheets which haven't been
+ * loaded yet with \l LazyLoad are loaded first, and the rows filled by
+ * the row writers are merged. The contents of the document don't change.
+ *
+ * The shared string indexes of the raw cell values read before, and the
+ * style ids returned by Workbook::registerFormat(), must be read or
+ * registered again. No typed row writer may be filling a row meanwhile.
+ *
+ * Returns false, leaving the document unchanged, if a worksheet is in
+ * constant memory mode.
+ *
+ * \sa memoryUsage()
+ */
+bool Document::compact()
+{
+    Q_D(Document);
+    foreach (QSharedPointer<AbstractSheet> sheet,
+             d->workbook->getSheetsByTypes(AbstractSheet::ST_WorkSheet)) {
+        static_cast<Worksheet *>(sheet.data())->d_func()->mergeRowWriters();
+    }
+    return d->workbook->d_func()->compact();
+}
+
+/*!
+ * \class QXlsx::DocumentMemoryUsage
+ * \inmodule QtXlsx
+ * \brief The bytes held by each component of a document.
+ *
+ * The cell tables of the worksheets, the Cell objects handed out by
+ * cellAt(), the shared strings table and the styles are estimated from
+ * the sizes and capacities of their containers. The spilled rows, see
+ * setMemoryBudget(), are not counted.
+ */
+
+/*!
+ * Returns the bytes held by the cells, the shared strings and the styles
+ * of the document, compared before and after compact(). The rows are
+ * gone over without reading the spilled ones back, and the sheets which
+ * haven't been loaded yet with \l LazyLoad are not loaded.
+ *
+ * \sa compact()
+ */
+DocumentMemoryUsage Document::memoryUsage() const
+{
+    Q_D(const Document);
+    DocumentMemoryUsage usage;
+    WorkbookPrivate *book_d = d->workbook->d_func();
+    foreach (QSharedPointer<AbstractSheet> sheet, book_d->sheets) {
+        if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        const WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        usage.cells += sheet_d->cellTable.memoryUsage();
+        usage.cellObjects +=
+            qint64(sheet_d->cellCache.size()) * (sizeof(Cell) + sizeof(CellPrivate));
+    }
+    usage.sharedStrings = book_d->sharedStrings->memoryUsage();
+    usage.styles = book_d->styles->memoryUsage();
+    usage.total = usage.cells + usage.cellObjects + usage.sharedStrings + usage.styles;
+    return usage;
+}
+
+/*!
+ * Sets the \a filter applied by the next openAsync() call, and by the
+ * sheets of the current document which haven't been loaded yet, with
+ * \l LazyLoad. The constructors which take a filter set it before
+ * loading the document.
+ *
+ * \sa LoadFilter
+ */
+void Document::setLoadFilter(const LoadFilter &filter)
+{
+    Q_D(Document);
+    d->loadFilter = filter;
+    d->workbook->d_func()->loadFilter = filter;
+}
+
+/*!
+ * Returns the filter applied to the sheets as they are loaded.
+ *
+ * \sa setLoadFilter()
+ */
+LoadFilter Document::loadFilter() const
+{
+    Q_D(const Document);
+    return d->loadFilter;
+}
+
+/*!
+ * Returns the hot path counters of all the documents of the process since
+ * the last resetStatistics() call: the cells stored in the worksheets,
+ * loaded cells included, the strings found in the shared strings table or
+ * added to it, the cell formats found in the styles or added to them, the
+ * format keys and fingerprints computed, the regular expressions evaluated
+ * by Worksheet::write(), the lookups done per row by the save of the sheet
+ * data, and the bytes inflated and deflated by the package.
+ *
+ * Many format keys and cell format lookups for few cells written usually
+ * mean that a new Format is built for each cell.
+ *
+ * The counters are only compiled in when the library is built with
+ * \c{CONFIG += xlsx_statistics}, they all stay 0 and
+ * DocumentStatistics::enabled is false otherwise.
+ */
+DocumentStatistics Document::statistics()
+{
+    return Statistics::snapshot();
+}
+
+/*!
+ * Sets all the counters returned by statistics() to 0.
+ */
+void Document::resetStatistics()
+{
+    Statistics::reset();
+}
+
 /*!
  * Destroys the document and cleans up.
  */
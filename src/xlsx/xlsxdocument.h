@@ -29,6 +29,8 @@
 #include "xlsxglobal.h"
 #include "xlsxformat.h"
 #include "xlsxworksheet.h"
+#include "xlsxloadfilter.h"
+#include <QFuture>
 #include <QObject>
 #include <QVariant>
 class QIODevice;
@@ -43,6 +45,56 @@ class DataValidation;
 class ConditionalFormatting;
 class Chart;
 class CellReference;
+class Profiler;
+class ProgressMonitor;
+
+struct DocumentStatistics
+{
+    DocumentStatistics()
+        : enabled(false)
+        , cellsWritten(0)
+        , sharedStringHits(0)
+        , sharedStringMisses(0)
+        , cellFormatHits(0)
+        , cellFormatMisses(0)
+        , formatKeyComputations(0)
+        , regexEvaluations(0)
+        , sheetDataLookups(0)
+        , bytesInflated(0)
+        , bytesDeflated(0)
+    {
+    }
+
+    bool enabled;
+    qint64 cellsWritten;
+    qint64 sharedStringHits;
+    qint64 sharedStringMisses;
+    qint64 cellFormatHits;
+    qint64 cellFormatMisses;
+    qint64 formatKeyComputations;
+    qint64 regexEvaluations;
+    qint64 sheetDataLookups;
+    qint64 bytesInflated;
+    qint64 bytesDeflated;
+};
+
+struct DocumentMemoryUsage
+{
+    DocumentMemoryUsage()
+        : cells(0)
+        , cellObjects(0)
+        , sharedStrings(0)
+        , styles(0)
+        , total(0)
+    {
+    }
+
+    qint64 cells;
+    qint64 cellObjects;
+    qint64 sharedStrings;
+    qint64 styles;
+    qint64 total;
+};
 
 class DocumentPrivate;
 class Q_XLSX_EXPORT Document : public QObject
@@ -51,9 +103,57 @@ class Q_XLSX_EXPORT Document : public QObject
     Q_DECLARE_PRIVATE(Document)
 
 public:
+    enum SaveOption {
+        DefaultSaveOptions = 0x0,
+        ParallelSave = 0x1,
+        ParallelCompression = 0x2,
+        CompactStyles = 0x4,
+        IncrementalSave = 0x8
+    };
+    Q_DECLARE_FLAGS(SaveOptions, SaveOption)
+
+    enum LoadOption {
+        DefaultLoadOptions = 0x0,
+        ParallelLoad = 0x1,
+        LazyLoad = 0x2,
+        ReadOnlyLoad = 0x4,
+        RowBlockLoad = 0x8
+    };
+    Q_DECLARE_FLAGS(LoadOptions, LoadOption)
+
+    enum Compression {
+        NoCompression,
+        FastCompression,
+        DefaultCompression,
+        BestCompression
+    };
+
+    enum FileFormat {
+        Xlsx,
+        Xlsb
+    };
+
     explicit Document(QObject *parent = 0);
     Document(const QString &xlsxName, QObject *parent = 0);
+    Document(const QString &xlsxName, LoadOptions options, QObject *parent = 0);
     Document(QIODevice *device, QObject *parent = 0);
+    Document(QIODevice *device, LoadOptions options, QObject *parent = 0);
+    Document(const QString &xlsxName, const LoadFilter &filter,
+             LoadOptions options = DefaultLoadOptions, QObject *parent = 0);
+    Document(QIODevice *device, const LoadFilter &filter, LoadOptions options = DefaultLoadOptions,
+             QObject *parent = 0);
+    Document(Profiler *profiler, const QString &xlsxName,
+             LoadOptions options = DefaultLoadOptions, QObject *parent = 0);
+    Document(Profiler *profiler, QIODevice *device, LoadOptions options = DefaultLoadOptions,
+             QObject *parent = 0);
+    Document(ProgressMonitor *monitor, const QString &xlsxName,
+             LoadOptions options = DefaultLoadOptions, QObject *parent = 0);
+    Document(ProgressMonitor *monitor, QIODevice *device,
+             LoadOptions options = DefaultLoadOptions, QObject *parent = 0);
+    Document(const QString &xlsxName, const QString &password,
+             LoadOptions options = DefaultLoadOptions, QObject *parent = 0);
+    Document(QIODevice *device, const QString &password, LoadOptions options = DefaultLoadOptions,
+             QObject *parent = 0);
     ~Document();
 
     bool write(const CellReference &cell, const QVariant &value, const Format &format = Format());
@@ -61,9 +161,13 @@ public:
     QVariant read(const CellReference &cell) const;
     QVariant read(int row, int col) const;
     bool insertImage(int row, int col, const QImage &image);
+    bool insertImages(int row, int col, const QList<QImage> &images, int spacing = 0);
+    bool insertImage(int row, int col, const QByteArray &encoded, const QString &suffix,
+                     const QSize &pixelSize = QSize());
     Chart *insertChart(int row, int col, const QSize &size);
     bool mergeCells(const CellRange &range, const Format &format = Format());
     bool unmergeCells(const CellRange &range);
+    CellRange mergedRangeAt(int row, int column) const;
 
     bool setColumnWidth(const CellRange &range, double width);
     bool setColumnFormat(const CellRange &range, const Format &format);
@@ -74,6 +178,7 @@ public:
     bool setColumnWidth(int colFirst, int colLast, double width);
     bool setColumnFormat(int colFirst, int colLast, const Format &format);
     bool setColumnHidden(int colFirst, int colLast, bool hidden);
+    bool autoFitColumns(const CellRange &range = CellRange());
     double columnWidth(int column);
     Format columnFormat(int column);
     bool isColumnHidden(int column);
@@ -99,6 +204,9 @@ public:
 
     bool defineName(const QString &name, const QString &formula, const QString &comment = QString(),
                     const QString &scope = QString());
+    CellRange definedNameRange(const QString &name, QString *sheetName = 0) const;
+    QVector<QVariant> readRange(const QString &name) const;
+    bool readRange(const QString &name, QVector<double> *values, QBitArray *valid = 0) const;
 
     CellRange dimension() const;
 
@@ -122,15 +230,52 @@ public:
     AbstractSheet *currentSheet() const;
     Worksheet *currentWorksheet() const;
 
+    bool openAsync(const QString &xlsXname);
+    bool loadSnapshot(const QString &snapshotName, const QString &sourceName = QString());
     bool save() const;
     bool saveAs(const QString &xlsXname) const;
     bool saveAs(QIODevice *device) const;
+    QFuture<bool> saveAsAsync(const QString &xlsXname) const;
+    bool saveSnapshot(const QString &snapshotName, const QString &sourceName = QString()) const;
+    void reset();
+
+    void setSaveOptions(SaveOptions options);
+    SaveOptions saveOptions() const;
+    void setCompression(Compression compression);
+    void setCompression(const QString &partName, Compression compression);
+    Compression compression() const;
+    void setFileFormat(FileFormat format);
+    FileFormat fileFormat() const;
+    void setPassword(const QString &password);
+    QString password() const;
+
+    void setProfiler(Profiler *profiler);
+    Profiler *profiler() const;
+    void setProgressMonitor(ProgressMonitor *monitor);
+    ProgressMonitor *progressMonitor() const;
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    bool compact();
+    DocumentMemoryUsage memoryUsage() const;
+    void setLoadFilter(const LoadFilter &filter);
+    LoadFilter loadFilter() const;
+
+    static DocumentStatistics statistics();
+    static void resetStatistics();
+
+Q_SIGNALS:
+    void sheetLoaded(const QString &sheetName);
+    void loadFinished();
 
 private:
+    friend class DocumentBatchPrivate;
     Q_DISABLE_COPY(Document)
     DocumentPrivate *const d_ptr;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(Document::SaveOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(Document::LoadOptions)
+
 QT_END_NAMESPACE_XLSX
 
 #endif // QXLSX_XLSXDOCUMENT_H
@@ -40,20 +40,41 @@
 #include "xlsxdocument.h"
 #include "xlsxworkbook.h"
 #include "xlsxcontenttypes_p.h"
+#include "xlsxloadfilter.h"
 
+#include <QAtomicInt>
 #include <QMap>
 
 namespace QXlsx {
 
+class ZipReader;
+class ZipWriter;
+class EncryptedPackageReader;
+class AbstractOOXmlFile;
+class ProgressMonitor;
+
 class DocumentPrivate
 {
     Q_DECLARE_PUBLIC(Document)
 public:
     DocumentPrivate(Document *p);
     void init();
+    void open(const QString &name);
 
     bool loadPackage(QIODevice *device);
-    bool savePackage(QIODevice *device) const;
+    bool loadPackage(const QSharedPointer<ZipReader> &zipReader);
+    bool loadEncryptedPackage(EncryptedPackageReader *reader);
+    bool loadParts(const QSharedPointer<ZipReader> &zipReader);
+    void parsePart(AbstractOOXmlFile *file, const QByteArray &data, const QString &partName);
+    bool isCanceled() const;
+    void prepareSave() const;
+    bool savePackage(QIODevice *device, bool prepare = true) const;
+    bool writePackage(QIODevice *device, bool prepare) const;
+    QString binaryUnsupportedFeature() const;
+    bool saveBinaryPackage(ZipWriter &zipWriter) const;
+    void loadBinaryPart(AbstractOOXmlFile *file, const QByteArray &data);
+    void detachFromFile(const QString &name) const;
+    Worksheet *definedNameSheet(const QString &name, CellRange *range) const;
 
     Document *q_ptr;
     const QString defaultPackageName; // default name when package name not specified
@@ -62,6 +83,20 @@ public:
     QMap<QString, QString> documentProperties; // core, app and custom properties
     QSharedPointer<Workbook> workbook;
     QSharedPointer<ContentTypes> contentTypes;
+    mutable QSharedPointer<ZipReader> sourcePackage; // package the document was loaded from
+
+    Document::SaveOptions saveOptions;
+    Document::Compression compression;
+    Document::FileFormat fileFormat; // of the next save, set by the load
+    QMap<QString, Document::Compression> partCompressions; // by part or directory name
+    Document::LoadOptions loadOptions;
+    LoadFilter loadFilter;
+    Profiler *profiler; // not owned, 0 when the load and save are not profiled
+    ProgressMonitor *progressMonitor; // not owned, 0 when the progress is not followed
+    qint64 memoryBudget; // passed on to each workbook
+    QString password; // of the package loaded and saved, empty if not encrypted
+    QAtomicInt loadedParts; // parts parsed by the current load
+    mutable QByteArray snapshotHeader; // set while saveSnapshot() writes the package
 };
 }
 
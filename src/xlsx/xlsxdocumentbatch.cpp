@@ -0,0 +1,335 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxdocumentbatch.h"
+#include "xlsxdocument.h"
+#include "xlsxdocument_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxworkbook_p.h"
+#include "xlsxstyles_p.h"
+#include "xlsxtheme_p.h"
+#include "xlsxzipreader_p.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class DocumentBatchPrivate
+{
+public:
+    DocumentBatchPrivate();
+
+    bool load(QIODevice *device);
+    Document *createDocument(QIODevice *package);
+
+    QByteArray templateData;
+    QScopedPointer<Document> base;
+    int maxThreadCount;
+
+    QMutex mutex;
+    QList<int> failed; // of the last generate() call
+};
+
+DocumentBatchPrivate::DocumentBatchPrivate()
+    : maxThreadCount(QThread::idealThreadCount())
+{
+}
+
+/*
+  Read the template package from \a device and load it once. The lookup
+  tables of the styles are built then, as the formats they index are
+  shared with the copies of the workbook.
+ */
+bool DocumentBatchPrivate::load(QIODevice *device)
+{
+    if (!device || !device->isReadable())
+        return false;
+    templateData = device->readAll();
+    QBuffer buffer(&templateData);
+    buffer.open(QIODevice::ReadOnly);
+    base.reset(new Document(&buffer));
+    if (base->sheetNames().isEmpty())
+        return false;
+    base->workbook()->styles()->buildLookupTables();
+    base->workbook()->deduplicateMediaFiles();
+    return true;
+}
+
+/*
+  Returns a new document holding a copy of the template, whose cells are
+  shared with it until they are written. The parts of the template which
+  are still unchanged when the document is saved are copied, compressed,
+  from \a package, which must outlive the document.
+ */
+Document *DocumentBatchPrivate::createDocument(QIODevice *package)
+{
+    Document *document = new Document;
+    DocumentPrivate *document_d = document->d_func();
+    const DocumentPrivate *base_d = base->d_func();
+    {
+        // The template is only read, but the copies are taken in turn
+        QMutexLocker locker(&mutex);
+        document_d->workbook = QSharedPointer<Workbook>(base_d->workbook->snapshot());
+    }
+
+    Workbook *workbook = document_d->workbook.data();
+    Workbook *baseWorkbook = base_d->workbook.data();
+    workbook->styles()->setFilePath(baseWorkbook->styles()->filePath());
+    workbook->styles()->setDirty(baseWorkbook->styles()->isDirty());
+    workbook->theme()->setFilePath(baseWorkbook->theme()->filePath());
+    workbook->theme()->setDirty(baseWorkbook->theme()->isDirty());
+
+    document_d->documentProperties = base_d->documentProperties;
+    document_d->saveOptions = base_d->saveOptions;
+    document_d->compression = base_d->compression;
+    document_d->fileFormat = base_d->fileFormat;
+    document_d->partCompressions = base_d->partCompressions;
+    document_d->sourcePackage = QSharedPointer<ZipReader>(new ZipReader(package));
+    return document;
+}
+
+namespace {
+
+/*
+  Fill and save the document \a index of a batch, on a thread of the pool.
+ */
+class GenerateDocumentTask : public QRunnable
+{
+public:
+    GenerateDocumentTask(DocumentBatchPrivate *batch, DocumentFiller *filler, int index,
+                         const QString &fileName)
+        : m_batch(batch)
+        , m_filler(filler)
+        , m_index(index)
+        , m_fileName(fileName)
+    {
+    }
+
+    void run()
+    {
+        // Each document reads the template package through a buffer of its own
+        QBuffer package(&m_batch->templateData);
+        package.open(QIODevice::ReadOnly);
+        QScopedPointer<Document> document(m_batch->createDocument(&package));
+        if (m_filler->fill(document.data(), m_index) && document->saveAs(m_fileName))
+            return;
+        QMutexLocker locker(&m_batch->mutex);
+        m_batch->failed.append(m_index);
+    }
+
+private:
+    DocumentBatchPrivate *m_batch;
+    DocumentFiller *m_filler;
+    int m_index;
+    QString m_fileName;
+};
+
+} // namespace
+
+/*!
+  \class DocumentFiller
+  \inmodule QtXlsx
+  \brief The DocumentFiller class writes the contents of the documents
+  of a DocumentBatch.
+
+  The fill() function is called by the threads of the batch, for several
+  documents at the same time.
+
+  \sa DocumentBatch
+*/
+
+/*!
+  Creates a filler.
+*/
+DocumentFiller::DocumentFiller()
+{
+}
+
+/*!
+  Destroys the filler.
+*/
+DocumentFiller::~DocumentFiller()
+{
+}
+
+/*!
+  \fn bool DocumentFiller::fill(Document *document, int index)
+
+  Writes the contents of the document \a index of the batch to
+  \a document, which holds a copy of the template. Returns false if the
+  document must not be saved.
+*/
+
+/*!
+  \class DocumentBatch
+  \inmodule QtXlsx
+  \brief The DocumentBatch class generates many documents from the same
+  template, in parallel.
+
+  The template is parsed once, the documents being copies of it which
+  only hold what they change: the cells of the template are shared until
+  they are written, the shared strings and the styles are copied with
+  their indexes, and the parts of the template which aren't changed, such
+  as the theme, the styles, the drawings and the pictures, are copied
+  compressed from the template package when the documents are saved.
+
+  \code
+  class InvoiceFiller : public DocumentFiller
+  {
+  public:
+      bool fill(Document *document, int index)
+      {
+          document->write("B2", customers[index].name);
+          return true;
+      }
+      QList<Customer> customers;
+  };
+
+  DocumentBatch batch("invoice.xlsx");
+  InvoiceFiller filler;
+  batch.generate(fileNames, &filler);
+  \endcode
+
+  The documents are filled and saved by a thread pool of the batch. The
+  drawings, charts and pictures of the template are shared by all the
+  documents, the fillers must not change them.
+
+  \sa DocumentFiller, SheetTemplate
+*/
+
+/*!
+  Loads the template named \a templateName.
+*/
+DocumentBatch::DocumentBatch(const QString &templateName)
+    : d_ptr(new DocumentBatchPrivate)
+{
+    QFile file(templateName);
+    if (file.open(QIODevice::ReadOnly))
+        d_ptr->load(&file);
+}
+
+/*!
+  Loads the template from \a device.
+*/
+DocumentBatch::DocumentBatch(QIODevice *device)
+    : d_ptr(new DocumentBatchPrivate)
+{
+    d_ptr->load(device);
+}
+
+/*!
+  Destroys the batch.
+*/
+DocumentBatch::~DocumentBatch()
+{
+    delete d_ptr;
+}
+
+/*!
+  Returns true if the template has been loaded.
+*/
+bool DocumentBatch::isValid() const
+{
+    Q_D(const DocumentBatch);
+    return d->base && !d->templateData.isEmpty();
+}
+
+/*!
+  Returns the document loaded from the template, or 0 if the batch isn't
+  valid. Its save options, compressions, file format and properties are
+  the ones of the generated documents. It must not be changed while
+  documents are generated.
+*/
+Document *DocumentBatch::templateDocument() const
+{
+    Q_D(const DocumentBatch);
+    return isValid() ? d->base.data() : 0;
+}
+
+/*!
+  Sets the number of documents which are filled and saved at the same
+  time to \a count. The default is QThread::idealThreadCount().
+*/
+void DocumentBatch::setMaxThreadCount(int count)
+{
+    Q_D(DocumentBatch);
+    d->maxThreadCount = qMax(1, count);
+}
+
+/*!
+  Returns the number of documents which are filled and saved at the same
+  time.
+*/
+int DocumentBatch::maxThreadCount() const
+{
+    Q_D(const DocumentBatch);
+    return d->maxThreadCount;
+}
+
+/*!
+  Generates one document per file name of \a fileNames, each one filled
+  by \a filler with its index in the list, and waits until all of them
+  are saved. Returns true if every document has been filled and saved.
+
+  \sa failedDocuments()
+*/
+bool DocumentBatch::generate(const QStringList &fileNames, DocumentFiller *filler)
+{
+    Q_D(DocumentBatch);
+    d->failed.clear();
+    if (!isValid() || !filler) {
+        for (int i = 0; i < fileNames.size(); ++i)
+            d->failed.append(i);
+        return fileNames.isEmpty();
+    }
+
+    // The parallel compression of the saves waits for tasks of the
+    // global pool, the documents have threads of their own.
+    QThreadPool pool;
+    pool.setMaxThreadCount(d->maxThreadCount);
+    for (int i = 0; i < fileNames.size(); ++i)
+        pool.start(new GenerateDocumentTask(d, filler, i, fileNames[i]));
+    pool.waitForDone();
+    std::sort(d->failed.begin(), d->failed.end());
+    return d->failed.isEmpty();
+}
+
+/*!
+  Returns the indexes of the documents which haven't been saved by the
+  last generate() call, in increasing order.
+*/
+QList<int> DocumentBatch::failedDocuments() const
+{
+    Q_D(const DocumentBatch);
+    return d->failed;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -26,6 +26,10 @@
 #include "xlsxdrawing_p.h"
 #include "xlsxdrawinganchor_p.h"
 #include "xlsxabstractsheet.h"
+#include "xlsxchart.h"
+#include "xlsxmediafile_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxzipreader_p.h"
 
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
@@ -66,6 +70,14 @@ void Drawing::saveToXmlFile(QIODevice *device) const
     writer.writeEndDocument();
 }
 
+/*
+  The anchors of the drawing are its elements.
+ */
+qint64 Drawing::elementCount() const
+{
+    return anchors.size();
+}
+
 bool Drawing::loadFromXmlFile(QIODevice *device)
 {
     QXmlStreamReader reader(device);
@@ -88,4 +100,46 @@ bool Drawing::loadFromXmlFile(QIODevice *device)
     return true;
 }
 
+/*
+  Leave the part in \a package, to be parsed the first time the anchors
+  are needed. The relationships of the part must be loaded already. An
+  unchanged drawing is still copied from the package when it's saved.
+ */
+void Drawing::setPackage(const QSharedPointer<ZipReader> &package)
+{
+    m_package = package;
+}
+
+bool Drawing::isLoaded() const
+{
+    return !m_package;
+}
+
+/*
+  Parse the part left in the package by setPackage(), with the charts
+  and the pictures it refers to. Does nothing once the part is parsed.
+ */
+void Drawing::load()
+{
+    if (!m_package)
+        return;
+    const QSharedPointer<ZipReader> package = m_package;
+    m_package.reset();
+
+    const int chartCount = workbook->chartFiles().size();
+    const int mediaCount = workbook->mediaFiles().size();
+    loadFromXmlData(package->fileData(filePath()));
+
+    // The charts and pictures of the drawing have just been appended
+    const QList<QSharedPointer<Chart>> charts = workbook->chartFiles();
+    for (int i = chartCount; i < charts.size(); ++i)
+        charts[i]->loadFromXmlData(package->fileData(charts[i]->filePath()));
+    const QList<QSharedPointer<MediaFile>> mediaFiles = workbook->mediaFiles();
+    for (int i = mediaCount; i < mediaFiles.size(); ++i) {
+        const QString path = mediaFiles[i]->fileName();
+        const QString suffix = path.mid(path.lastIndexOf(QLatin1Char('.')) + 1);
+        mediaFiles[i]->setPackageEntry(package, suffix);
+    }
+}
+
 } // namespace QXlsx
@@ -53,6 +53,7 @@ class DrawingAnchor;
 class Workbook;
 class AbstractSheet;
 class MediaFile;
+class ZipReader;
 
 class Drawing : public AbstractOOXmlFile
 {
@@ -61,10 +62,19 @@ public:
     ~Drawing();
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
+    qint64 elementCount() const;
+
+    void setPackage(const QSharedPointer<ZipReader> &package);
+    bool isLoaded() const;
+    void load();
 
     AbstractSheet *sheet;
     Workbook *workbook;
     QList<DrawingAnchor *> anchors;
+
+private:
+    // The part is parsed from it on first access, null once parsed
+    QSharedPointer<ZipReader> m_package;
 };
 
 } // namespace QXlsx
@@ -32,7 +32,6 @@
 
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
-#include <QBuffer>
 #include <QDir>
 
 namespace QXlsx {
@@ -82,16 +81,34 @@ DrawingAnchor::~DrawingAnchor()
 {
 }
 
+/*
+  The image is encoded to PNG in the background, see MediaFile::setImage().
+ */
 void DrawingAnchor::setObjectPicture(const QImage &img)
 {
-    QByteArray ba;
-    QBuffer buffer(&ba);
-    buffer.open(QIODevice::WriteOnly);
-    img.save(&buffer, "PNG");
+    m_pictureFile =
+        m_drawing->workbook->addMediaFile(QSharedPointer<MediaFile>(new MediaFile(img)));
+
+    m_objectType = Picture;
+}
 
-    m_pictureFile = QSharedPointer<MediaFile>(
-        new MediaFile(ba, QStringLiteral("png"), QStringLiteral("image/png")));
-    m_drawing->workbook->addMediaFile(m_pictureFile);
+/*
+  Use the encoded image \a bytes as they are. The \a suffix, such as
+  "png" or "jpeg", names the media file and gives its content type.
+ */
+void DrawingAnchor::setObjectPicture(const QByteArray &bytes, const QString &suffix)
+{
+    const QString extension = suffix.toLower();
+    QString subtype = extension;
+    if (extension == QLatin1String("jpg") || extension == QLatin1String("jpe"))
+        subtype = QStringLiteral("jpeg");
+    else if (extension == QLatin1String("tif"))
+        subtype = QStringLiteral("tiff");
+    else if (extension == QLatin1String("svg"))
+        subtype = QStringLiteral("svg+xml");
+
+    m_pictureFile = m_drawing->workbook->addMediaFile(QSharedPointer<MediaFile>(
+        new MediaFile(bytes, extension, QStringLiteral("image/") + subtype)));
 
     m_objectType = Picture;
 }
@@ -333,7 +350,7 @@ void DrawingAnchor::saveXmlObjectGraphicFrame(QXmlStreamWriter &writer) const
     writer.writeAttribute(QStringLiteral("uri"),
                           QStringLiteral("http://schemas.openxmlformats.org/drawingml/2006/chart"));
 
-    int idx = m_drawing->workbook->chartFiles().indexOf(m_chartFile);
+    int idx = m_drawing->workbook->chartFileIndex(m_chartFile.data());
     m_drawing->relationships()->addDocumentRelationship(
         QStringLiteral("/chart"), QStringLiteral("../charts/chart%1.xml").arg(idx + 1));
 
@@ -69,6 +69,7 @@ public:
     DrawingAnchor(Drawing *drawing, ObjectType objectType);
     virtual ~DrawingAnchor();
     void setObjectPicture(const QImage &img);
+    void setObjectPicture(const QByteArray &bytes, const QString &suffix);
     void setObjectGraphicFrame(QSharedPointer<Chart> chart);
 
     virtual bool loadFromXml(QXmlStreamReader &reader) = 0;
@@ -0,0 +1,729 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxencryption_p.h"
+#include "xlsxcompoundfile_p.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QMessageAuthenticationCode>
+#include <QTemporaryFile>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QtEndian>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#elif defined(Q_OS_WIN)
+#include <qt_windows.h>
+#include <wincrypt.h>
+#endif
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const int SEGMENT_SIZE = 4096;
+const int VERIFIER_SALT_SIZE = 16;
+
+// The block keys the keys of the password are derived with
+const char VERIFIER_INPUT_BLOCK_KEY[] = "\xFE\xA7\xD2\x76\x3B\x4B\x9E\x79";
+const char VERIFIER_HASH_BLOCK_KEY[] = "\xD7\xAA\x0F\x6D\x30\x61\x34\x4E";
+const char KEY_VALUE_BLOCK_KEY[] = "\x14\x6E\x0B\xE7\xAB\xAC\xD0\xD6";
+// and the initialization vectors of the integrity check
+const char HMAC_KEY_BLOCK_KEY[] = "\x5F\xB2\xAD\x01\x0C\xB9\xE1\xF6";
+const char HMAC_VALUE_BLOCK_KEY[] = "\xA0\x67\x7F\x02\xB2\x2C\x84\x33";
+
+QString encryptionNamespace()
+{
+    return QStringLiteral("http://schemas.microsoft.com/office/2006/encryption");
+}
+
+QString passwordNamespace()
+{
+    return QStringLiteral("http://schemas.microsoft.com/office/2006/keyEncryptor/password");
+}
+
+QString encryptedPackagePath()
+{
+    return QStringLiteral("EncryptedPackage");
+}
+
+QString encryptionInfoPath()
+{
+    return QStringLiteral("EncryptionInfo");
+}
+
+QByteArray blockKey(const char *key)
+{
+    return QByteArray::fromRawData(key, 8);
+}
+
+void appendUInt16(QByteArray &data, quint16 value)
+{
+    uchar buf[2];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 2);
+}
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    uchar buf[4];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 4);
+}
+
+QByteArray utf16LittleEndian(const QString &text)
+{
+    QByteArray data;
+    data.reserve(text.size() * 2);
+    for (int i = 0; i < text.size(); ++i)
+        appendUInt16(data, text[i].unicode());
+    return data;
+}
+
+/*
+  Append \a text as a length prefixed UTF-16 string, padded to 4 bytes,
+  the strings of the data spaces.
+ */
+void appendUnicodeString(QByteArray &data, const QString &text)
+{
+    const QByteArray utf16 = utf16LittleEndian(text);
+    appendUInt32(data, quint32(utf16.size()));
+    data.append(utf16);
+    if (utf16.size() % 4)
+        data.append(QByteArray(4 - utf16.size() % 4, 0));
+}
+
+bool hashAlgorithm(const QString &name, QCryptographicHash::Algorithm *algorithm, int *size)
+{
+    if (name == QLatin1String("SHA1")) {
+        *algorithm = QCryptographicHash::Sha1;
+        *size = 20;
+    } else if (name == QLatin1String("SHA256")) {
+        *algorithm = QCryptographicHash::Sha256;
+        *size = 32;
+    } else if (name == QLatin1String("SHA384")) {
+        *algorithm = QCryptographicHash::Sha384;
+        *size = 48;
+    } else if (name == QLatin1String("SHA512")) {
+        *algorithm = QCryptographicHash::Sha512;
+        *size = 64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QString hashAlgorithmName(QCryptographicHash::Algorithm algorithm)
+{
+    switch (algorithm) {
+    case QCryptographicHash::Sha1:
+        return QStringLiteral("SHA1");
+    case QCryptographicHash::Sha256:
+        return QStringLiteral("SHA256");
+    case QCryptographicHash::Sha384:
+        return QStringLiteral("SHA384");
+    default:
+        return QStringLiteral("SHA512");
+    }
+}
+
+/*
+  Returns \a data cut to \a size bytes, or padded with \a padding.
+ */
+QByteArray fitToSize(const QByteArray &data, int size, char padding)
+{
+    if (data.size() >= size)
+        return data.left(size);
+    return data + QByteArray(size - data.size(), padding);
+}
+
+QByteArray hash(const AgileKeyParameters &parameters, const QByteArray &a, const QByteArray &b)
+{
+    QCryptographicHash hash(parameters.hashAlgorithm);
+    hash.addData(a);
+    hash.addData(b);
+    return hash.result();
+}
+
+/*
+  The hash of \a password, rehashed with the iteration count as many
+  times as the spin count.
+ */
+QByteArray passwordHash(const AgileKeyParameters &parameters, const QString &password)
+{
+    QByteArray result = hash(parameters, parameters.salt, utf16LittleEndian(password));
+    QCryptographicHash hash(parameters.hashAlgorithm);
+    uchar iteration[4];
+    for (int i = 0; i < parameters.spinCount; ++i) {
+        qToLittleEndian(quint32(i), iteration);
+        hash.reset();
+        hash.addData(reinterpret_cast<const char *>(iteration), 4);
+        hash.addData(result);
+        result = hash.result();
+    }
+    return result;
+}
+
+QByteArray deriveKey(const AgileKeyParameters &parameters, const QByteArray &passwordHash,
+                     const char *key)
+{
+    return fitToSize(hash(parameters, passwordHash, blockKey(key)), parameters.keyBits / 8, 0x36);
+}
+
+/*
+  The initialization vector of the segment \a index of the package, or of
+  the integrity check when \a key is given.
+ */
+QByteArray packageIv(const AgileKeyParameters &parameters, quint32 index, const char *key = 0)
+{
+    QByteArray suffix;
+    if (key)
+        suffix = blockKey(key);
+    else
+        appendUInt32(suffix, index);
+    return fitToSize(hash(parameters, parameters.salt, suffix), parameters.blockSize, 0x36);
+}
+
+/*
+  Fill \a data with \a size bytes from the random generator of the
+  system, which the keys need. Returns false if there is none.
+ */
+bool randomBytes(int size, QByteArray *data)
+{
+    data->resize(size);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    for (int i = 0; i < size; ++i)
+        (*data)[i] = char(QRandomGenerator::system()->generate());
+    return true;
+#elif defined(Q_OS_WIN)
+    HCRYPTPROV provider;
+    if (!CryptAcquireContextW(&provider, 0, 0, PROV_RSA_FULL,
+                              CRYPT_VERIFYCONTEXT | CRYPT_SILENT)) {
+        return false;
+    }
+    const bool ok = CryptGenRandom(provider, DWORD(size), reinterpret_cast<BYTE *>(data->data()));
+    CryptReleaseContext(provider, 0);
+    return ok;
+#else
+    QFile file(QStringLiteral("/dev/urandom"));
+    return file.open(QIODevice::Unbuffered | QIODevice::ReadOnly)
+        && file.read(data->data(), size) == size;
+#endif
+}
+
+QByteArray base64Attribute(const QXmlStreamAttributes &attributes, const char *name)
+{
+    return QByteArray::fromBase64(attributes.value(QLatin1String(name)).toString().toLatin1());
+}
+
+/*
+  Read the attributes of <keyData> or <p:encryptedKey> into
+  \a parameters. Only the AES in the CBC mode is supported.
+ */
+bool readKeyParameters(const QXmlStreamAttributes &attributes, AgileKeyParameters *parameters)
+{
+    if (attributes.value(QLatin1String("cipherAlgorithm")) != QLatin1String("AES")
+        || attributes.value(QLatin1String("cipherChaining")) != QLatin1String("ChainingModeCBC")
+        || !hashAlgorithm(attributes.value(QLatin1String("hashAlgorithm")).toString(),
+                          &parameters->hashAlgorithm, &parameters->hashSize)) {
+        return false;
+    }
+    parameters->keyBits = attributes.value(QLatin1String("keyBits")).toString().toInt();
+    parameters->blockSize = attributes.value(QLatin1String("blockSize")).toString().toInt();
+    parameters->salt = base64Attribute(attributes, "saltValue");
+    if (attributes.hasAttribute(QLatin1String("spinCount")))
+        parameters->spinCount = attributes.value(QLatin1String("spinCount")).toString().toInt();
+    return (parameters->keyBits == 128 || parameters->keyBits == 192
+            || parameters->keyBits == 256)
+           && parameters->blockSize == Aes::BlockSize && !parameters->salt.isEmpty()
+           && parameters->spinCount >= 0 && parameters->spinCount <= 10000000;
+}
+
+void writeKeyParameters(QXmlStreamWriter &writer, const AgileKeyParameters &parameters)
+{
+    writer.writeAttribute(QStringLiteral("saltSize"), QString::number(parameters.salt.size()));
+    writer.writeAttribute(QStringLiteral("blockSize"), QString::number(parameters.blockSize));
+    writer.writeAttribute(QStringLiteral("keyBits"), QString::number(parameters.keyBits));
+    writer.writeAttribute(QStringLiteral("hashSize"), QString::number(parameters.hashSize));
+    writer.writeAttribute(QStringLiteral("cipherAlgorithm"), QStringLiteral("AES"));
+    writer.writeAttribute(QStringLiteral("cipherChaining"), QStringLiteral("ChainingModeCBC"));
+    writer.writeAttribute(QStringLiteral("hashAlgorithm"),
+                          hashAlgorithmName(parameters.hashAlgorithm));
+    writer.writeAttribute(QStringLiteral("saltValue"),
+                          QString::fromLatin1(parameters.salt.toBase64()));
+}
+
+} // namespace
+
+AgileKeyParameters::AgileKeyParameters()
+    : hashAlgorithm(QCryptographicHash::Sha512), hashSize(64), keyBits(256),
+      blockSize(Aes::BlockSize), spinCount(100000)
+{
+}
+
+EncryptedPackageReader::EncryptedPackageReader(const QString &fileName)
+    : m_file(new QFile(fileName)), m_size(0), m_segmentIndex(-1)
+{
+    if (m_file->open(QIODevice::ReadOnly))
+        m_compoundFile.reset(new CompoundFileReader(m_file.data()));
+}
+
+/*
+  The \a device, which must be open and random access, has to outlive the
+  reader.
+ */
+EncryptedPackageReader::EncryptedPackageReader(QIODevice *device)
+    : m_size(0), m_segmentIndex(-1)
+{
+    if (device && device->isReadable() && !device->isSequential())
+        m_compoundFile.reset(new CompoundFileReader(device));
+}
+
+EncryptedPackageReader::~EncryptedPackageReader()
+{
+}
+
+/*
+  Returns true if \a device, which is open, holds a compound file rather
+  than a zip package, which is how the encrypted packages are stored.
+ */
+bool EncryptedPackageReader::isEncryptedPackage(QIODevice *device)
+{
+    return CompoundFileReader::isCompoundFile(device);
+}
+
+bool EncryptedPackageReader::isSequential() const
+{
+    return false;
+}
+
+qint64 EncryptedPackageReader::size() const
+{
+    return m_size;
+}
+
+/*
+  Check \a password against the verifier of the package and open the
+  device. Returns false if the password is wrong, or if the package isn't
+  encrypted with the agile encryption. The integrity check of the
+  package isn't verified, a damaged package failing to be read as a zip
+  archive anyway.
+ */
+bool EncryptedPackageReader::decrypt(const QString &password)
+{
+    if (!m_compoundFile || !m_compoundFile->isValid() || isOpen())
+        return false;
+    // The agile encryption is the version 4.4, the XML descriptor follows
+    // the reserved flags.
+    const QByteArray info = m_compoundFile->streamData(encryptionInfoPath());
+    const uchar *version = reinterpret_cast<const uchar *>(info.constData());
+    if (info.size() < 8 || qFromLittleEndian<quint16>(version) != 4
+        || qFromLittleEndian<quint16>(version + 2) != 4) {
+        return false;
+    }
+    QByteArray verifierInput;
+    QByteArray verifierHash;
+    QByteArray keyValue;
+    if (!readEncryptionInfo(info.mid(8), &verifierInput, &verifierHash, &keyValue))
+        return false;
+
+    const QByteArray hash = passwordHash(m_passwordKey, password);
+    const QByteArray iv = fitToSize(m_passwordKey.salt, m_passwordKey.blockSize, 0x36);
+    Aes aes;
+    aes.setKey(deriveKey(m_passwordKey, hash, VERIFIER_INPUT_BLOCK_KEY));
+    const QByteArray input = aes.decryptCbc(verifierInput, iv).left(m_passwordKey.salt.size());
+    aes.setKey(deriveKey(m_passwordKey, hash, VERIFIER_HASH_BLOCK_KEY));
+    const QByteArray expected = aes.decryptCbc(verifierHash, iv).left(m_passwordKey.hashSize);
+    if (expected.isEmpty()
+        || QCryptographicHash::hash(input, m_passwordKey.hashAlgorithm) != expected) {
+        return false;
+    }
+    aes.setKey(deriveKey(m_passwordKey, hash, KEY_VALUE_BLOCK_KEY));
+    if (!m_aes.setKey(aes.decryptCbc(keyValue, iv).left(m_keyData.keyBits / 8)))
+        return false;
+
+    // The stream starts with the size of the package
+    m_package.reset(m_compoundFile->openStream(encryptedPackagePath()));
+    uchar size[8];
+    if (!m_package || m_package->read(reinterpret_cast<char *>(size), 8) != 8)
+        return false;
+    m_size = qint64(qFromLittleEndian<quint64>(size));
+    if (m_size < 0 || m_size > m_package->size() - 8)
+        return false;
+    m_segmentIndex = -1;
+    return open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+bool EncryptedPackageReader::readEncryptionInfo(const QByteArray &xml, QByteArray *verifierInput,
+                                                QByteArray *verifierHash, QByteArray *keyValue)
+{
+    bool keyData = false;
+    bool passwordKey = false;
+    QXmlStreamReader reader(xml);
+    while (!reader.atEnd()) {
+        if (reader.readNext() != QXmlStreamReader::StartElement)
+            continue;
+        const QXmlStreamAttributes attributes = reader.attributes();
+        if (reader.name() == QLatin1String("keyData")
+            && reader.namespaceUri() == encryptionNamespace()) {
+            keyData = readKeyParameters(attributes, &m_keyData);
+        } else if (reader.name() == QLatin1String("encryptedKey")
+                   && reader.namespaceUri() == passwordNamespace()) {
+            passwordKey = readKeyParameters(attributes, &m_passwordKey);
+            *verifierInput = base64Attribute(attributes, "encryptedVerifierHashInput");
+            *verifierHash = base64Attribute(attributes, "encryptedVerifierHashValue");
+            *keyValue = base64Attribute(attributes, "encryptedKeyValue");
+        }
+    }
+    return !reader.hasError() && keyData && passwordKey;
+}
+
+/*
+  Read the segment \a index of the package into \a data, which has room
+  for a whole segment, and decipher it in place.
+ */
+bool EncryptedPackageReader::readSegment(qint64 index, char *data)
+{
+    const qint64 offset = 8 + index * SEGMENT_SIZE;
+    int length = int(qMin(qint64(SEGMENT_SIZE), m_package->size() - offset));
+    length -= length % Aes::BlockSize;
+    if (length <= 0 || !m_package->seek(offset) || m_package->read(data, length) != length)
+        return false;
+    const QByteArray iv = packageIv(m_keyData, quint32(index));
+    m_aes.decryptCbc(reinterpret_cast<uchar *>(data), length,
+                     reinterpret_cast<const uchar *>(iv.constData()));
+    return true;
+}
+
+qint64 EncryptedPackageReader::readData(char *data, qint64 maxSize)
+{
+    qint64 position = pos();
+    const qint64 length = qMin(maxSize, m_size - position);
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 index = position / SEGMENT_SIZE;
+        const int offset = int(position % SEGMENT_SIZE);
+        const int count = int(qMin(qint64(SEGMENT_SIZE - offset), length - done));
+        if (count == SEGMENT_SIZE) {
+            // The whole segments are deciphered in place
+            if (!readSegment(index, data + done))
+                return done ? done : -1;
+        } else {
+            if (index != m_segmentIndex) {
+                m_segment.resize(SEGMENT_SIZE);
+                m_segmentIndex = -1;
+                if (!readSegment(index, m_segment.data()))
+                    return done ? done : -1;
+                m_segmentIndex = index;
+            }
+            memcpy(data + done, m_segment.constData() + offset, count);
+        }
+        done += count;
+        position += count;
+    }
+    return done;
+}
+
+qint64 EncryptedPackageReader::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+/*
+  The keys are made up, and the password key derived, at once. The
+  \a device must be open for writing.
+ */
+EncryptedPackageWriter::EncryptedPackageWriter(QIODevice *device, const QString &password)
+    : m_device(device), m_stream(0), m_segmentIndex(0), m_size(0), m_finished(false),
+      m_error(false)
+{
+    // Without a random generator worth the name, the keys could be guessed
+    QByteArray intermediateKey;
+    QByteArray verifierInput;
+    if (!randomBytes(VERIFIER_SALT_SIZE, &m_keyData.salt)
+        || !randomBytes(VERIFIER_SALT_SIZE, &m_passwordKey.salt)
+        || !randomBytes(m_keyData.keyBits / 8, &intermediateKey)
+        || !randomBytes(VERIFIER_SALT_SIZE, &verifierInput)) {
+        m_error = true;
+        return;
+    }
+    m_aes.setKey(intermediateKey);
+
+    // The password is checked by deciphering a random verifier, and its
+    // hash, with keys derived from the password.
+    const QByteArray hash = passwordHash(m_passwordKey, password);
+    const QByteArray iv = fitToSize(m_passwordKey.salt, m_passwordKey.blockSize, 0x36);
+    Aes aes;
+    aes.setKey(deriveKey(m_passwordKey, hash, VERIFIER_INPUT_BLOCK_KEY));
+    m_encryptedVerifierInput = aes.encryptCbc(verifierInput, iv);
+    aes.setKey(deriveKey(m_passwordKey, hash, VERIFIER_HASH_BLOCK_KEY));
+    m_encryptedVerifierHash =
+        aes.encryptCbc(QCryptographicHash::hash(verifierInput, m_passwordKey.hashAlgorithm), iv);
+    aes.setKey(deriveKey(m_passwordKey, hash, KEY_VALUE_BLOCK_KEY));
+    m_encryptedKeyValue = aes.encryptCbc(intermediateKey, iv);
+
+    if (!m_device || !m_device->isWritable()) {
+        m_error = true;
+        return;
+    }
+    QIODevice *output = m_device;
+    if (m_device->isSequential() || !m_device->isReadable()) {
+        QTemporaryFile *file = new QTemporaryFile;
+        m_temporaryFile.reset(file);
+        if (!file->open()) {
+            m_error = true;
+            return;
+        }
+        output = file;
+    }
+    m_compoundFile.reset(new CompoundFileWriter(output));
+    m_stream = m_compoundFile->beginStream(encryptedPackagePath());
+    // Room for the size of the package
+    if (!m_stream || m_stream->write(QByteArray(8, 0)) != 8) {
+        m_error = true;
+        return;
+    }
+    m_segment.reserve(SEGMENT_SIZE);
+    open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+EncryptedPackageWriter::~EncryptedPackageWriter()
+{
+    if (!m_finished)
+        finish();
+}
+
+bool EncryptedPackageWriter::isSequential() const
+{
+    return true;
+}
+
+qint64 EncryptedPackageWriter::readData(char *, qint64)
+{
+    return -1;
+}
+
+qint64 EncryptedPackageWriter::writeData(const char *data, qint64 size)
+{
+    if (m_error || m_finished)
+        return -1;
+    qint64 done = 0;
+    while (done < size && !m_error) {
+        const int count = int(qMin(qint64(SEGMENT_SIZE - m_segment.size()), size - done));
+        m_segment.append(data + done, count);
+        done += count;
+        if (m_segment.size() == SEGMENT_SIZE)
+            writeSegment();
+    }
+    m_size += size;
+    return m_error ? -1 : size;
+}
+
+/*
+  Cipher the segment filled, the last one being padded to whole blocks,
+  into the stream.
+ */
+void EncryptedPackageWriter::writeSegment()
+{
+    if (m_segment.size() % Aes::BlockSize)
+        m_segment.append(QByteArray(Aes::BlockSize - m_segment.size() % Aes::BlockSize, 0));
+    const QByteArray iv = packageIv(m_keyData, quint32(m_segmentIndex++));
+    m_aes.encryptCbc(reinterpret_cast<uchar *>(m_segment.data()), m_segment.size(),
+                     reinterpret_cast<const uchar *>(iv.constData()));
+    if (m_stream->write(m_segment) != m_segment.size())
+        m_error = true;
+    m_segment.resize(0);
+}
+
+/*
+  Write the last segment and the size of the package, then the integrity
+  check, the encryption info and the data spaces describing the
+  encryption. Returns false if the package couldn't be written.
+ */
+bool EncryptedPackageWriter::finish()
+{
+    if (m_finished)
+        return !m_error;
+    m_finished = true;
+    if (isOpen())
+        QIODevice::close();
+    if (!m_error && !m_segment.isEmpty())
+        writeSegment();
+    if (m_error)
+        return false;
+
+    uchar size[8];
+    qToLittleEndian(quint64(m_size), size);
+    if (!m_stream->seek(0) || m_stream->write(reinterpret_cast<const char *>(size), 8) != 8) {
+        m_error = true;
+        return false;
+    }
+
+    // The HMAC of the whole stream, keyed by a random key ciphered along
+    QByteArray hmacKey;
+    if (!randomBytes(m_keyData.hashSize, &hmacKey)) {
+        m_error = true;
+        return false;
+    }
+    QMessageAuthenticationCode hmac(m_keyData.hashAlgorithm, hmacKey);
+    const qint64 streamSize = m_stream->size();
+    QByteArray buffer(64 * 1024, 0);
+    if (!m_stream->seek(0))
+        m_error = true;
+    for (qint64 done = 0; done < streamSize && !m_error;) {
+        const qint64 length = m_stream->read(buffer.data(), qMin(qint64(buffer.size()),
+                                                                 streamSize - done));
+        if (length <= 0)
+            m_error = true;
+        hmac.addData(buffer.constData(), int(qMax(length, qint64(0))));
+        done += length;
+    }
+    if (m_error || !m_compoundFile->endStream()) {
+        m_error = true;
+        return false;
+    }
+
+    m_compoundFile->addStream(encryptionInfoPath(), encryptionInfo(hmacKey, hmac.result()));
+    writeDataSpaces();
+    if (!m_compoundFile->close())
+        m_error = true;
+
+    if (m_temporaryFile && !m_error) {
+        QIODevice *file = m_temporaryFile.data();
+        if (!file->seek(0))
+            m_error = true;
+        while (!m_error && !file->atEnd()) {
+            const qint64 length = file->read(buffer.data(), buffer.size());
+            if (length <= 0 || m_device->write(buffer.constData(), length) != length)
+                m_error = true;
+        }
+    }
+    return !m_error;
+}
+
+QByteArray EncryptedPackageWriter::encryptionInfo(const QByteArray &hmacKey,
+                                                  const QByteArray &hmacValue) const
+{
+    const QByteArray encryptedHmacKey =
+        m_aes.encryptCbc(hmacKey, packageIv(m_keyData, 0, HMAC_KEY_BLOCK_KEY));
+    const QByteArray encryptedHmacValue =
+        m_aes.encryptCbc(hmacValue, packageIv(m_keyData, 0, HMAC_VALUE_BLOCK_KEY));
+
+    QByteArray xml;
+    QXmlStreamWriter writer(&xml);
+    writer.writeStartDocument(QStringLiteral("1.0"), true);
+    writer.writeStartElement(QStringLiteral("encryption"));
+    writer.writeDefaultNamespace(encryptionNamespace());
+    writer.writeNamespace(passwordNamespace(), QStringLiteral("p"));
+
+    writer.writeEmptyElement(QStringLiteral("keyData"));
+    writeKeyParameters(writer, m_keyData);
+    writer.writeEmptyElement(QStringLiteral("dataIntegrity"));
+    writer.writeAttribute(QStringLiteral("encryptedHmacKey"),
+                          QString::fromLatin1(encryptedHmacKey.toBase64()));
+    writer.writeAttribute(QStringLiteral("encryptedHmacValue"),
+                          QString::fromLatin1(encryptedHmacValue.toBase64()));
+
+    writer.writeStartElement(QStringLiteral("keyEncryptors"));
+    writer.writeStartElement(QStringLiteral("keyEncryptor"));
+    writer.writeAttribute(QStringLiteral("uri"), passwordNamespace());
+    writer.writeEmptyElement(passwordNamespace(), QStringLiteral("encryptedKey"));
+    writer.writeAttribute(QStringLiteral("spinCount"), QString::number(m_passwordKey.spinCount));
+    writeKeyParameters(writer, m_passwordKey);
+    writer.writeAttribute(QStringLiteral("encryptedVerifierHashInput"),
+                          QString::fromLatin1(m_encryptedVerifierInput.toBase64()));
+    writer.writeAttribute(QStringLiteral("encryptedVerifierHashValue"),
+                          QString::fromLatin1(m_encryptedVerifierHash.toBase64()));
+    writer.writeAttribute(QStringLiteral("encryptedKeyValue"),
+                          QString::fromLatin1(m_encryptedKeyValue.toBase64()));
+    writer.writeEndDocument();
+
+    // The version 4.4 and the reserved flags come first
+    QByteArray data;
+    appendUInt16(data, 4);
+    appendUInt16(data, 4);
+    appendUInt32(data, 0x40);
+    return data + xml;
+}
+
+/*
+  The data spaces tell the EncryptedPackage stream is ciphered by the
+  strong encryption transform.
+ */
+void EncryptedPackageWriter::writeDataSpaces()
+{
+    const QString dataSpaces = QChar(6) + QStringLiteral("DataSpaces/");
+
+    QByteArray version;
+    appendUnicodeString(version, QStringLiteral("Microsoft.Container.DataSpaces"));
+    for (int i = 0; i < 3; ++i) {
+        appendUInt16(version, 1);
+        appendUInt16(version, 0);
+    }
+    m_compoundFile->addStream(dataSpaces + QStringLiteral("Version"), version);
+
+    QByteArray entry;
+    appendUInt32(entry, 1); // reference components
+    appendUInt32(entry, 0); // a stream
+    appendUnicodeString(entry, encryptedPackagePath());
+    appendUnicodeString(entry, QStringLiteral("StrongEncryptionDataSpace"));
+    QByteArray map;
+    appendUInt32(map, 8); // header length
+    appendUInt32(map, 1); // entries
+    appendUInt32(map, quint32(entry.size() + 4));
+    map.append(entry);
+    m_compoundFile->addStream(dataSpaces + QStringLiteral("DataSpaceMap"), map);
+
+    QByteArray definition;
+    appendUInt32(definition, 8); // header length
+    appendUInt32(definition, 1); // transforms
+    appendUnicodeString(definition, QStringLiteral("StrongEncryptionTransform"));
+    m_compoundFile->addStream(
+        dataSpaces + QStringLiteral("DataSpaceInfo/StrongEncryptionDataSpace"), definition);
+
+    QByteArray transform;
+    QByteArray id;
+    appendUInt32(id, 1); // transform type
+    appendUnicodeString(id, QStringLiteral("{FF9A3F03-56EF-4613-BDD5-5A41C1D07246}"));
+    appendUInt32(transform, quint32(id.size() + 4));
+    transform.append(id);
+    appendUnicodeString(transform, QStringLiteral("Microsoft.Container.EncryptionTransform"));
+    for (int i = 0; i < 3; ++i) {
+        appendUInt16(transform, 1);
+        appendUInt16(transform, 0);
+    }
+    appendUInt32(transform, 0); // no encryption name
+    appendUInt32(transform, 0); // block size
+    appendUInt32(transform, 0); // cipher mode
+    appendUInt32(transform, 4); // reserved
+    m_compoundFile->addStream(dataSpaces
+                                  + QStringLiteral("TransformInfo/StrongEncryptionTransform/")
+                                  + QChar(6) + QStringLiteral("Primary"),
+                              transform);
+}
+
+QT_END_NAMESPACE_XLSX
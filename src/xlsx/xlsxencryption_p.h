@@ -0,0 +1,162 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXENCRYPTION_P_H
+#define XLSXENCRYPTION_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxaes_p.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QIODevice>
+#include <QScopedPointer>
+#include <QString>
+
+class QFile;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class CompoundFileReader;
+class CompoundFileWriter;
+
+/*
+  The parameters of a key of the agile encryption: the intermediate key
+  ciphering the package, described by <keyData>, or the key derived from
+  the password, described by <p:encryptedKey>.
+ */
+struct AgileKeyParameters
+{
+    AgileKeyParameters();
+
+    QCryptographicHash::Algorithm hashAlgorithm;
+    int hashSize;
+    int keyBits;
+    int blockSize;
+    int spinCount;
+    QByteArray salt;
+};
+
+/*
+  The package of a workbook encrypted with the agile encryption of the
+  Office documents, read as a random access device. The package is stored
+  by the EncryptedPackage stream of a compound file, in 4096 byte
+  segments ciphered one by one, which are deciphered as they are read.
+
+  The device is open once decrypt() has been given the right password.
+ */
+class XLSX_AUTOTEST_EXPORT EncryptedPackageReader : public QIODevice
+{
+public:
+    explicit EncryptedPackageReader(const QString &fileName);
+    explicit EncryptedPackageReader(QIODevice *device);
+    ~EncryptedPackageReader();
+
+    static bool isEncryptedPackage(QIODevice *device);
+
+    bool decrypt(const QString &password);
+    bool isSequential() const;
+    qint64 size() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private:
+    bool readEncryptionInfo(const QByteArray &xml, QByteArray *verifierInput,
+                            QByteArray *verifierHash, QByteArray *keyValue);
+    bool readSegment(qint64 index, char *data);
+
+    QScopedPointer<QFile> m_file;
+    QScopedPointer<CompoundFileReader> m_compoundFile;
+    QScopedPointer<QIODevice> m_package; // the EncryptedPackage stream
+    AgileKeyParameters m_keyData;
+    AgileKeyParameters m_passwordKey;
+    Aes m_aes;
+    qint64 m_size;
+    qint64 m_segmentIndex; // of m_segment, -1 if none
+    QByteArray m_segment;
+};
+
+/*
+  Writes a package encrypted from \a password to a device, with AES-256
+  and SHA-512. The package is ciphered segment by segment as it is
+  written, straight into the EncryptedPackage stream of the compound
+  file. finish() must be called once the whole package has been written.
+
+  The compound file is written to a temporary file first when the device
+  can't be read back and seeked, which the integrity check needs.
+ */
+class XLSX_AUTOTEST_EXPORT EncryptedPackageWriter : public QIODevice
+{
+public:
+    EncryptedPackageWriter(QIODevice *device, const QString &password);
+    ~EncryptedPackageWriter();
+
+    bool isSequential() const;
+    bool finish();
+    bool error() const { return m_error; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private:
+    Q_DISABLE_COPY(EncryptedPackageWriter)
+
+    void writeSegment();
+    QByteArray encryptionInfo(const QByteArray &hmacKey, const QByteArray &hmacValue) const;
+    void writeDataSpaces();
+
+    QIODevice *m_device;
+    QScopedPointer<QIODevice> m_temporaryFile; // written in place of m_device, or 0
+    QScopedPointer<CompoundFileWriter> m_compoundFile;
+    QIODevice *m_stream; // the EncryptedPackage stream
+    AgileKeyParameters m_keyData;
+    AgileKeyParameters m_passwordKey;
+    QByteArray m_encryptedVerifierInput;
+    QByteArray m_encryptedVerifierHash;
+    QByteArray m_encryptedKeyValue;
+    Aes m_aes;
+    QByteArray m_segment; // the bytes of the segment being filled
+    qint64 m_segmentIndex;
+    qint64 m_size;
+    bool m_finished;
+    bool m_error;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXENCRYPTION_P_H
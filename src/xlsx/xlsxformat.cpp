@@ -26,13 +26,136 @@
 #include "xlsxformat_p.h"
 #include "xlsxcolor_p.h"
 #include "xlsxnumformatparser_p.h"
+#include "xlsxstatistics_p.h"
 #include <QDataStream>
 #include <QDebug>
 
+#include <string.h>
+
 QT_BEGIN_NAMESPACE_XLSX
 
+namespace {
+
+inline quint64 mixFingerprint(quint64 h, quint64 value)
+{
+    // splitmix64 finalizer over the combined value
+    h ^= value + Q_UINT64_C(0x9e3779b97f4a7c15) + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+    h ^= h >> 27;
+    h *= Q_UINT64_C(0x94d049bb133111eb);
+    h ^= h >> 31;
+    return h;
+}
+
+quint64 bytesFingerprint(const void *data, int size)
+{
+    // 64 bit FNV-1a
+    const uchar *p = static_cast<const uchar *>(data);
+    quint64 h = Q_UINT64_C(0xcbf29ce484222325);
+    for (int i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= Q_UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+quint64 stringFingerprint(const QString &str)
+{
+    return bytesFingerprint(str.constData(), str.size() * int(sizeof(QChar)));
+}
+
+quint64 valueFingerprint(const QVariant &value)
+{
+    const int type = value.userType();
+    quint64 h = mixFingerprint(0, quint64(type));
+    switch (type) {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return mixFingerprint(h, quint64(value.toLongLong()));
+    case QMetaType::Double: {
+        double d = value.toDouble();
+        quint64 bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return mixFingerprint(h, bits);
+    }
+    case QMetaType::QString:
+        return mixFingerprint(h, stringFingerprint(value.toString()));
+    default:
+        break;
+    }
+
+    if (type == qMetaTypeId<XlsxColor>()) {
+        XlsxColor color = value.value<XlsxColor>();
+        if (color.isRgbColor())
+            return mixFingerprint(mixFingerprint(h, 1), color.rgbColor().rgba());
+        if (color.isIndexedColor())
+            return mixFingerprint(mixFingerprint(h, 2), quint64(color.indexedColor()));
+        if (color.isThemeColor()) {
+            h = mixFingerprint(h, 3);
+            foreach (const QString &str, color.themeColor())
+                h = mixFingerprint(h, stringFingerprint(str));
+            return h;
+        }
+        return h;
+    }
+
+    // Not expected to be reached, but keep it correct for other types
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream << value;
+    return mixFingerprint(h, bytesFingerprint(bytes.constData(), bytes.size()));
+}
+
+/*
+  Fingerprint of the properties whose id is in [first, last). It is 0 if
+  there is no such property, and never 0 otherwise.
+ */
+quint64 propertiesFingerprint(const FormatPrivate *d, int first, int last)
+{
+    if (!d->hasPropertyIn(first, last))
+        return 0;
+
+    Statistics::count(Statistics::FormatKeyComputations);
+    quint64 h = 0;
+    for (int id = first; id < last; ++id) {
+        if (!d->hasProperty(id))
+            continue;
+        h = mixFingerprint(h, quint64(id));
+        h = mixFingerprint(h, valueFingerprint(d->propertyValue(id)));
+    }
+    return h ? h : 1;
+}
+
+/*
+  Serializes the properties whose id is in [first, last) to a key.
+ */
+QByteArray propertiesKey(const FormatPrivate *d, int first, int last)
+{
+    QByteArray key;
+    if (!d->hasPropertyIn(first, last))
+        return key;
+
+    Statistics::count(Statistics::FormatKeyComputations);
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    for (int id = first; id < last; ++id) {
+        if (d->hasProperty(id))
+            stream << id << d->propertyValue(id);
+    }
+    return key;
+}
+
+} // namespace
+
 FormatPrivate::FormatPrivate()
     : dirty(true)
+    , fingerprint(0)
+    , font_fingerprint(0)
+    , fill_fingerprint(0)
+    , border_fingerprint(0)
     , font_dirty(true)
     , font_index_valid(false)
     , font_index(0)
@@ -48,6 +171,8 @@ FormatPrivate::FormatPrivate()
     , dxf_index(-1)
     , dxf_indexValid(false)
     , theme(0)
+    , date_time(-1)
+    , property_mask(0)
 {
 }
 
@@ -55,6 +180,10 @@ FormatPrivate::FormatPrivate(const FormatPrivate &other)
     : QSharedData(other)
     , dirty(other.dirty)
     , formatKey(other.formatKey)
+    , fingerprint(other.fingerprint)
+    , font_fingerprint(other.font_fingerprint)
+    , fill_fingerprint(other.fill_fingerprint)
+    , border_fingerprint(other.border_fingerprint)
     , font_dirty(other.font_dirty)
     , font_index_valid(other.font_index_valid)
     , font_key(other.font_key)
@@ -73,8 +202,13 @@ FormatPrivate::FormatPrivate(const FormatPrivate &other)
     , dxf_index(other.dxf_index)
     , dxf_indexValid(other.dxf_indexValid)
     , theme(other.theme)
-    , properties(other.properties)
+    , date_time(other.date_time)
+    , property_mask(other.property_mask)
 {
+    for (int id = 0; id < P_ENDID; ++id) {
+        if (property_mask & propertyBit(id))
+            property_values[id] = other.property_values[id];
+    }
 }
 
 FormatPrivate::~FormatPrivate()
@@ -273,23 +407,24 @@ void Format::setNumberFormat(const QString &format)
  */
 bool Format::isDateTimeFormat() const
 {
-    if (hasProperty(FormatPrivate::P_NumFmt_FormatCode)) {
-        // Custom numFmt, so
-        // Gauss from the number string
-        return NumFormatParser::isDateTime(numberFormat());
-    } else if (hasProperty(FormatPrivate::P_NumFmt_Id)) {
-        // Non-custom numFmt
-        int idx = numberFormatIndex();
-
-        // Is built-in date time number id?
-        if ((idx >= 14 && idx <= 22) || (idx >= 45 && idx <= 47))
-            return true;
+    if (!d)
+        return false;
 
-        if ((idx >= 27 && idx <= 36) || (idx >= 50 && idx <= 58)) // Used in CHS\CHT\JPN\KOR
-            return true;
+    // The result is kept until the number format changes, so the formats
+    // shared by many cells only classify their number format once.
+    if (d->date_time == -1) {
+        if (hasProperty(FormatPrivate::P_NumFmt_FormatCode)) {
+            // Custom numFmt, so
+            // Gauss from the number string
+            d->date_time = NumFormatParser::isDateTime(numberFormat());
+        } else if (hasProperty(FormatPrivate::P_NumFmt_Id)) {
+            // Non-custom numFmt
+            d->date_time = NumFormatParser::isBuiltinDateTime(numberFormatIndex());
+        } else {
+            d->date_time = 0;
+        }
     }
-
-    return false;
+    return d->date_time == 1;
 }
 
 /*!
@@ -312,6 +447,17 @@ void Format::fixNumberFormat(int id, const QString &format)
     setProperty(FormatPrivate::P_NumFmt_FormatCode, format, QString(), false);
 }
 
+/*!
+    \internal
+    Called by styles to set whether the number format shows a date or a
+    time when it is already known.
+ */
+void Format::fixDateTimeFormat(bool dateTime)
+{
+    if (d)
+        d->date_time = dateTime ? 1 : 0;
+}
+
 /*!
     \internal
     Return true if the format has number format.
@@ -545,20 +691,30 @@ QByteArray Format::fontKey() const
         return QByteArray();
 
     if (d->font_dirty) {
-        QByteArray key;
-        QDataStream stream(&key, QIODevice::WriteOnly);
-        for (int i = FormatPrivate::P_Font_STARTID; i < FormatPrivate::P_Font_ENDID; ++i) {
-            if (d->properties.contains(i))
-                stream << i << d->properties[i];
-        };
-
-        const_cast<Format *>(this)->d->font_key = key;
+        const_cast<Format *>(this)->d->font_key = propertiesKey(
+            d.constData(), FormatPrivate::P_Font_STARTID, FormatPrivate::P_Font_ENDID);
         const_cast<Format *>(this)->d->font_dirty = false;
     }
 
     return d->font_key;
 }
 
+/*!
+ * \internal
+ * Returns a 64 bit fingerprint of the font properties, which is 0 if the
+ * format has no font data.
+ */
+quint64 Format::fontFingerprint() const
+{
+    if (!d)
+        return 0;
+    if (!d->font_fingerprint) {
+        d->font_fingerprint = propertiesFingerprint(d.constData(), FormatPrivate::P_Font_STARTID,
+                                                    FormatPrivate::P_Font_ENDID);
+    }
+    return d->font_fingerprint;
+}
+
 /*!
     \internal
     Return true if the format has font format, otherwise return false.
@@ -568,11 +724,7 @@ bool Format::hasFontData() const
     if (!d)
         return false;
 
-    for (int i = FormatPrivate::P_Font_STARTID; i < FormatPrivate::P_Font_ENDID; ++i) {
-        if (hasProperty(i))
-            return true;
-    }
-    return false;
+    return d->hasPropertyIn(FormatPrivate::P_Font_STARTID, FormatPrivate::P_Font_ENDID);
 }
 
 /*!
@@ -712,11 +864,8 @@ bool Format::hasAlignmentData() const
     if (!d)
         return false;
 
-    for (int i = FormatPrivate::P_Alignment_STARTID; i < FormatPrivate::P_Alignment_ENDID; ++i) {
-        if (hasProperty(i))
-            return true;
-    }
-    return false;
+    return d->hasPropertyIn(FormatPrivate::P_Alignment_STARTID,
+                            FormatPrivate::P_Alignment_ENDID);
 }
 
 /*!
@@ -956,20 +1105,30 @@ QByteArray Format::borderKey() const
         return QByteArray();
 
     if (d->border_dirty) {
-        QByteArray key;
-        QDataStream stream(&key, QIODevice::WriteOnly);
-        for (int i = FormatPrivate::P_Border_STARTID; i < FormatPrivate::P_Border_ENDID; ++i) {
-            if (d->properties.contains(i))
-                stream << i << d->properties[i];
-        };
-
-        const_cast<Format *>(this)->d->border_key = key;
+        const_cast<Format *>(this)->d->border_key = propertiesKey(
+            d.constData(), FormatPrivate::P_Border_STARTID, FormatPrivate::P_Border_ENDID);
         const_cast<Format *>(this)->d->border_dirty = false;
     }
 
     return d->border_key;
 }
 
+/*!
+ * \internal
+ * Returns a 64 bit fingerprint of the border properties, which is 0 if the
+ * format has no border data.
+ */
+quint64 Format::borderFingerprint() const
+{
+    if (!d)
+        return 0;
+    if (!d->border_fingerprint) {
+        d->border_fingerprint = propertiesFingerprint(
+            d.constData(), FormatPrivate::P_Border_STARTID, FormatPrivate::P_Border_ENDID);
+    }
+    return d->border_fingerprint;
+}
+
 /*!
     \internal
     Return true if the format has border format, otherwise return false.
@@ -979,11 +1138,7 @@ bool Format::hasBorderData() const
     if (!d)
         return false;
 
-    for (int i = FormatPrivate::P_Border_STARTID; i < FormatPrivate::P_Border_ENDID; ++i) {
-        if (hasProperty(i))
-            return true;
-    }
-    return false;
+    return d->hasPropertyIn(FormatPrivate::P_Border_STARTID, FormatPrivate::P_Border_ENDID);
 }
 
 /*!
@@ -1076,20 +1231,30 @@ QByteArray Format::fillKey() const
         return QByteArray();
 
     if (d->fill_dirty) {
-        QByteArray key;
-        QDataStream stream(&key, QIODevice::WriteOnly);
-        for (int i = FormatPrivate::P_Fill_STARTID; i < FormatPrivate::P_Fill_ENDID; ++i) {
-            if (d->properties.contains(i))
-                stream << i << d->properties[i];
-        };
-
-        const_cast<Format *>(this)->d->fill_key = key;
+        const_cast<Format *>(this)->d->fill_key = propertiesKey(
+            d.constData(), FormatPrivate::P_Fill_STARTID, FormatPrivate::P_Fill_ENDID);
         const_cast<Format *>(this)->d->fill_dirty = false;
     }
 
     return d->fill_key;
 }
 
+/*!
+ * \internal
+ * Returns a 64 bit fingerprint of the fill properties, which is 0 if the
+ * format has no fill data.
+ */
+quint64 Format::fillFingerprint() const
+{
+    if (!d)
+        return 0;
+    if (!d->fill_fingerprint) {
+        d->fill_fingerprint = propertiesFingerprint(d.constData(), FormatPrivate::P_Fill_STARTID,
+                                                    FormatPrivate::P_Fill_ENDID);
+    }
+    return d->fill_fingerprint;
+}
+
 /*!
     \internal
     Return true if the format has fill format, otherwise return false.
@@ -1099,11 +1264,7 @@ bool Format::hasFillData() const
     if (!d)
         return false;
 
-    for (int i = FormatPrivate::P_Fill_STARTID; i < FormatPrivate::P_Fill_ENDID; ++i) {
-        if (hasProperty(i))
-            return true;
-    }
-    return false;
+    return d->hasPropertyIn(FormatPrivate::P_Fill_STARTID, FormatPrivate::P_Fill_ENDID);
 }
 
 /*!
@@ -1166,10 +1327,10 @@ void Format::mergeFormat(const Format &modifier)
         return;
     }
 
-    QMapIterator<int, QVariant> it(modifier.d->properties);
-    while (it.hasNext()) {
-        it.next();
-        setProperty(it.key(), it.value());
+    const FormatPrivate *m = modifier.d.constData();
+    for (int id = 0; id < FormatPrivate::P_ENDID; ++id) {
+        if (m->hasProperty(id))
+            setProperty(id, m->propertyValue(id));
     }
 }
 
@@ -1190,7 +1351,7 @@ bool Format::isEmpty() const
 {
     if (!d)
         return true;
-    return d->properties.isEmpty();
+    return !d->hasProperties();
 }
 
 /*!
@@ -1202,22 +1363,29 @@ QByteArray Format::formatKey() const
         return QByteArray();
 
     if (d->dirty) {
-        QByteArray key;
-        QDataStream stream(&key, QIODevice::WriteOnly);
-
-        QMapIterator<int, QVariant> i(d->properties);
-        while (i.hasNext()) {
-            i.next();
-            stream << i.key() << i.value();
-        }
-
-        d->formatKey = key;
+        d->formatKey =
+            propertiesKey(d.constData(), FormatPrivate::P_STARTID, FormatPrivate::P_ENDID);
         d->dirty = false;
     }
 
     return d->formatKey;
 }
 
+/*!
+ * \internal
+ * Returns a 64 bit fingerprint of all the properties, which is 0 if the
+ * format is empty. Formats with the same properties have the same fingerprint.
+ */
+quint64 Format::formatFingerprint() const
+{
+    if (!d)
+        return 0;
+    if (!d->fingerprint)
+        d->fingerprint =
+            propertiesFingerprint(d.constData(), FormatPrivate::P_STARTID, FormatPrivate::P_ENDID);
+    return d->fingerprint;
+}
+
 /*!
  * \internal
  *  Called by QXlsx::Styles or some unittests.
@@ -1289,7 +1457,7 @@ bool Format::dxfIndexValid() const
 */
 bool Format::operator==(const Format &format) const
 {
-    return this->formatKey() == format.formatKey();
+    return formatFingerprint() == format.formatFingerprint();
 }
 
 /*!
@@ -1297,7 +1465,7 @@ bool Format::operator==(const Format &format) const
 */
 bool Format::operator!=(const Format &format) const
 {
-    return this->formatKey() != format.formatKey();
+    return formatFingerprint() != format.formatFingerprint();
 }
 
 int Format::theme() const
@@ -1310,8 +1478,8 @@ int Format::theme() const
  */
 QVariant Format::property(int propertyId, const QVariant &defaultValue) const
 {
-    if (d && d->properties.contains(propertyId))
-        return d->properties[propertyId];
+    if (d && d->hasProperty(propertyId))
+        return d->propertyValue(propertyId);
     return defaultValue;
 }
 
@@ -1321,37 +1489,50 @@ QVariant Format::property(int propertyId, const QVariant &defaultValue) const
 void Format::setProperty(int propertyId, const QVariant &value, const QVariant &clearValue,
                          bool detach)
 {
+    if (!FormatPrivate::isValidPropertyId(propertyId)) {
+        qWarning("QXlsx::Format: invalid property id %d", propertyId);
+        return;
+    }
+
     if (!d)
         d = new FormatPrivate;
 
     if (value != clearValue) {
-        if (d->properties.contains(propertyId) && d->properties[propertyId] == value)
+        if (d->hasProperty(propertyId) && d->propertyValue(propertyId) == value)
             return;
         if (detach)
             d.detach();
-        d->properties[propertyId] = value;
+        d->setPropertyValue(propertyId, value);
     } else {
-        if (!d->properties.contains(propertyId))
+        if (!d->hasProperty(propertyId))
             return;
         if (detach)
             d.detach();
-        d->properties.remove(propertyId);
+        d->removeProperty(propertyId);
     }
 
     d->dirty = true;
+    d->fingerprint = 0;
     d->xf_indexValid = false;
     d->dxf_indexValid = false;
+    if (propertyId == FormatPrivate::P_NumFmt_Id
+        || propertyId == FormatPrivate::P_NumFmt_FormatCode) {
+        d->date_time = -1;
+    }
 
     if (propertyId >= FormatPrivate::P_Font_STARTID && propertyId < FormatPrivate::P_Font_ENDID) {
         d->font_dirty = true;
+        d->font_fingerprint = 0;
         d->font_index_valid = false;
     } else if (propertyId >= FormatPrivate::P_Border_STARTID
                && propertyId < FormatPrivate::P_Border_ENDID) {
         d->border_dirty = true;
+        d->border_fingerprint = 0;
         d->border_index_valid = false;
     } else if (propertyId >= FormatPrivate::P_Fill_STARTID
                && propertyId < FormatPrivate::P_Fill_ENDID) {
         d->fill_dirty = true;
+        d->fill_fingerprint = 0;
         d->fill_index_valid = false;
     }
 }
@@ -1371,7 +1552,7 @@ bool Format::hasProperty(int propertyId) const
 {
     if (!d)
         return false;
-    return d->properties.contains(propertyId);
+    return d->hasProperty(propertyId);
 }
 
 /*!
@@ -1382,7 +1563,7 @@ bool Format::boolProperty(int propertyId, bool defaultValue) const
     if (!hasProperty(propertyId))
         return defaultValue;
 
-    const QVariant prop = d->properties[propertyId];
+    const QVariant &prop = d->propertyValue(propertyId);
     if (prop.userType() != QMetaType::Bool)
         return defaultValue;
     return prop.toBool();
@@ -1396,7 +1577,7 @@ int Format::intProperty(int propertyId, int defaultValue) const
     if (!hasProperty(propertyId))
         return defaultValue;
 
-    const QVariant prop = d->properties[propertyId];
+    const QVariant &prop = d->propertyValue(propertyId);
     if (prop.userType() != QMetaType::Int)
         return defaultValue;
     return prop.toInt();
@@ -1410,7 +1591,7 @@ double Format::doubleProperty(int propertyId, double defaultValue) const
     if (!hasProperty(propertyId))
         return defaultValue;
 
-    const QVariant prop = d->properties[propertyId];
+    const QVariant &prop = d->propertyValue(propertyId);
     if (prop.userType() != QMetaType::Double && prop.userType() != QMetaType::Float)
         return defaultValue;
     return prop.toDouble();
@@ -1424,7 +1605,7 @@ QString Format::stringProperty(int propertyId, const QString &defaultValue) cons
     if (!hasProperty(propertyId))
         return defaultValue;
 
-    const QVariant prop = d->properties[propertyId];
+    const QVariant &prop = d->propertyValue(propertyId);
     if (prop.userType() != QMetaType::QString)
         return defaultValue;
     return prop.toString();
@@ -1438,7 +1619,7 @@ QColor Format::colorProperty(int propertyId, const QColor &defaultValue) const
     if (!hasProperty(propertyId))
         return defaultValue;
 
-    const QVariant prop = d->properties[propertyId];
+    const QVariant &prop = d->propertyValue(propertyId);
     if (prop.userType() != qMetaTypeId<XlsxColor>())
         return defaultValue;
     return qvariant_cast<XlsxColor>(prop).rgbColor();
@@ -1447,7 +1628,19 @@ QColor Format::colorProperty(int propertyId, const QColor &defaultValue) const
 #ifndef QT_NO_DEBUG_STREAM
 QDebug operator<<(QDebug dbg, const Format &f)
 {
-    dbg.nospace() << "QXlsx::Format(" << f.d->properties << ")";
+    dbg.nospace() << "QXlsx::Format(";
+    if (f.d) {
+        bool first = true;
+        for (int id = 0; id < FormatPrivate::P_ENDID; ++id) {
+            if (!f.d->hasProperty(id))
+                continue;
+            if (!first)
+                dbg << ", ";
+            dbg << id << ": " << f.d->propertyValue(id);
+            first = false;
+        }
+    }
+    dbg << ")";
     return dbg.space();
 }
 #endif
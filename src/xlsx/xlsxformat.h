@@ -125,6 +125,15 @@ public:
     Format();
     Format(const Format &other);
     Format &operator=(const Format &rhs);
+#ifdef Q_COMPILER_RVALUE_REFS
+    Format(Format &&other) Q_DECL_NOTHROW : d(std::move(other.d)) {}
+    Format &operator=(Format &&other) Q_DECL_NOTHROW
+    {
+        swap(other);
+        return *this;
+    }
+#endif
+    void swap(Format &other) Q_DECL_NOTHROW { d.swap(other.d); }
     ~Format();
 
     int numberFormatIndex() const;
@@ -234,20 +243,25 @@ public:
     bool fontIndexValid() const;
     int fontIndex() const;
     QByteArray fontKey() const;
+    quint64 fontFingerprint() const;
     bool borderIndexValid() const;
     QByteArray borderKey() const;
+    quint64 borderFingerprint() const;
     int borderIndex() const;
     bool fillIndexValid() const;
     QByteArray fillKey() const;
+    quint64 fillFingerprint() const;
     int fillIndex() const;
 
     QByteArray formatKey() const;
+    quint64 formatFingerprint() const;
     bool xfIndexValid() const;
     int xfIndex() const;
     bool dxfIndexValid() const;
     int dxfIndex() const;
 
     void fixNumberFormat(int id, const QString &format);
+    void fixDateTimeFormat(bool dateTime);
     void setFontIndex(int index);
     void setBorderIndex(int index);
     void setFillIndex(int index);
@@ -270,4 +284,6 @@ Q_XLSX_EXPORT QDebug operator<<(QDebug dbg, const Format &f);
 
 QT_END_NAMESPACE_XLSX
 
+Q_DECLARE_TYPEINFO(QXlsx::Format, Q_MOVABLE_TYPE);
+
 #endif // QXLSX_FORMAT_H
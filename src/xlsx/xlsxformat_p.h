@@ -38,8 +38,7 @@
 
 #include "xlsxformat.h"
 #include <QSharedData>
-#include <QMap>
-#include <QSet>
+#include <QVariant>
 
 namespace QXlsx {
 
@@ -125,9 +124,43 @@ public:
     FormatPrivate(const FormatPrivate &other);
     ~FormatPrivate();
 
+    static quint64 propertyBit(int id) { return Q_UINT64_C(1) << id; }
+    static quint64 propertyBits(int first, int last)
+    {
+        return (propertyBit(last - first) - 1) << first;
+    }
+    static bool isValidPropertyId(int id) { return id >= 0 && id < P_ENDID; }
+
+    bool hasProperty(int id) const
+    {
+        return isValidPropertyId(id) && (property_mask & propertyBit(id));
+    }
+    bool hasPropertyIn(int first, int last) const
+    {
+        return property_mask & propertyBits(first, last);
+    }
+    bool hasProperties() const { return property_mask != 0; }
+    const QVariant &propertyValue(int id) const { return property_values[id]; }
+    void setPropertyValue(int id, const QVariant &value)
+    {
+        property_values[id] = value;
+        property_mask |= propertyBit(id);
+    }
+    void removeProperty(int id)
+    {
+        property_values[id] = QVariant();
+        property_mask &= ~propertyBit(id);
+    }
+
     bool dirty; // The key re-generation is need.
     QByteArray formatKey;
 
+    // Fingerprints of the properties, 0 when they need to be computed.
+    quint64 fingerprint;
+    quint64 font_fingerprint;
+    quint64 fill_fingerprint;
+    quint64 border_fingerprint;
+
     bool font_dirty;
     bool font_index_valid;
     QByteArray font_key;
@@ -151,9 +184,17 @@ public:
     bool dxf_indexValid;
 
     int theme;
-
-    QMap<int, QVariant> properties;
+    // 1 if the number format shows a date or a time, 0 if not, -1 until known
+    int date_time;
+
+    // Properties are stored flat, indexed by their id, so that the font, border,
+    // fill, alignment and protection groups are contiguous ranges. Bit i of
+    // property_mask is set when property i exists.
+    quint64 property_mask;
+    QVariant property_values[P_ENDID];
 };
+
+Q_STATIC_ASSERT(FormatPrivate::P_ENDID <= 64);
 }
 
 #endif // XLSXFORMAT_P_H
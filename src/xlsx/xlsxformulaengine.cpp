@@ -0,0 +1,1261 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxformulaengine_p.h"
+#include "xlsxconditionalformattingevaluator_p.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxcellreference.h"
+#include "xlsxutility_p.h"
+
+#include <QDebug>
+#include <QStringRef>
+
+#include <algorithm>
+#include <math.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+static inline quint64 formulaCellKey(int row, int col)
+{
+    return (quint64(row) << 32) | quint32(col);
+}
+
+static inline int keyRow(quint64 key)
+{
+    return int(key >> 32);
+}
+
+static inline int keyColumn(quint64 key)
+{
+    return int(key & 0xffffffff);
+}
+
+struct FormulaFunctionInfo
+{
+    const char *name;
+    int id;
+    int minArgs;
+    int maxArgs;
+};
+
+static const FormulaFunctionInfo formulaFunctions[] = {
+    { "SUM", ParsedFormula::Sum, 1, 255 },
+    { "AVERAGE", ParsedFormula::Average, 1, 255 },
+    { "MIN", ParsedFormula::Min, 1, 255 },
+    { "MAX", ParsedFormula::Max, 1, 255 },
+    { "COUNT", ParsedFormula::Count, 1, 255 },
+    { "IF", ParsedFormula::If, 2, 3 },
+    { "AND", ParsedFormula::And, 1, 255 },
+    { "OR", ParsedFormula::Or, 1, 255 },
+    { "NOT", ParsedFormula::Not, 1, 1 },
+    { "ABS", ParsedFormula::Abs, 1, 1 },
+    { "ROUND", ParsedFormula::Round, 2, 2 },
+    { "VLOOKUP", ParsedFormula::VLookup, 3, 4 },
+};
+
+static const char *const formulaErrors[] = { "#NULL!", "#DIV/0!", "#VALUE!", "#REF!",
+                                             "#NAME?", "#NUM!",   "#N/A" };
+
+ParsedFormula::ParsedFormula()
+    : m_root(-1)
+    , m_pos(0)
+{
+}
+
+/*
+  Parse \a formulaText, with or without its leading '='.
+ */
+ParsedFormula::ParsedFormula(const QString &formulaText)
+    : m_root(-1)
+    , m_text(formulaText)
+    , m_pos(0)
+{
+    if (m_text.startsWith(QLatin1Char('=')))
+        m_pos = 1;
+    const int root = parseComparison();
+    skipSpaces();
+    if (root != -1 && m_pos == m_text.size())
+        m_root = root;
+    else
+        m_nodes.clear();
+    m_text.clear();
+}
+
+/*
+  Returns the indexes of the nodes which refer to cells or ranges.
+ */
+QVector<int> ParsedFormula::referenceNodes() const
+{
+    QVector<int> nodes;
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].type == Reference)
+            nodes.append(i);
+    }
+    return nodes;
+}
+
+QChar ParsedFormula::peek(int offset) const
+{
+    return m_pos + offset < m_text.size() ? m_text.at(m_pos + offset) : QChar();
+}
+
+void ParsedFormula::skipSpaces()
+{
+    while (m_pos < m_text.size() && m_text.at(m_pos).isSpace())
+        ++m_pos;
+}
+
+int ParsedFormula::addNode(const Node &node)
+{
+    m_nodes.append(node);
+    return m_nodes.size() - 1;
+}
+
+int ParsedFormula::addBinary(int op, int left, int right)
+{
+    if (left == -1 || right == -1)
+        return -1;
+    Node node(Binary, op);
+    node.args << left << right;
+    return addNode(node);
+}
+
+// The parse functions return the index of the parsed node, or -1 on errors.
+// They are listed from the lowest precedence to the highest one.
+
+int ParsedFormula::parseComparison()
+{
+    int left = parseConcat();
+    while (left != -1) {
+        skipSpaces();
+        const QChar c = peek();
+        int op;
+        int length = 1;
+        if (c == QLatin1Char('=')) {
+            op = Equal;
+        } else if (c == QLatin1Char('<')) {
+            op = Less;
+            if (peek(1) == QLatin1Char('>')) {
+                op = NotEqual;
+                length = 2;
+            } else if (peek(1) == QLatin1Char('=')) {
+                op = LessEqual;
+                length = 2;
+            }
+        } else if (c == QLatin1Char('>')) {
+            op = Greater;
+            if (peek(1) == QLatin1Char('=')) {
+                op = GreaterEqual;
+                length = 2;
+            }
+        } else {
+            break;
+        }
+        m_pos += length;
+        left = addBinary(op, left, parseConcat());
+    }
+    return left;
+}
+
+int ParsedFormula::parseConcat()
+{
+    int left = parseAdditive();
+    while (left != -1) {
+        skipSpaces();
+        if (peek() != QLatin1Char('&'))
+            break;
+        ++m_pos;
+        left = addBinary(Concat, left, parseAdditive());
+    }
+    return left;
+}
+
+int ParsedFormula::parseAdditive()
+{
+    int left = parseTerm();
+    while (left != -1) {
+        skipSpaces();
+        const QChar c = peek();
+        if (c != QLatin1Char('+') && c != QLatin1Char('-'))
+            break;
+        ++m_pos;
+        left = addBinary(c == QLatin1Char('+') ? Add : Subtract, left, parseTerm());
+    }
+    return left;
+}
+
+int ParsedFormula::parseTerm()
+{
+    int left = parsePower();
+    while (left != -1) {
+        skipSpaces();
+        const QChar c = peek();
+        if (c != QLatin1Char('*') && c != QLatin1Char('/'))
+            break;
+        ++m_pos;
+        left = addBinary(c == QLatin1Char('*') ? Multiply : Divide, left, parsePower());
+    }
+    return left;
+}
+
+int ParsedFormula::parsePower()
+{
+    int left = parseUnary();
+    while (left != -1) {
+        skipSpaces();
+        if (peek() != QLatin1Char('^'))
+            break;
+        ++m_pos;
+        left = addBinary(Power, left, parseUnary());
+    }
+    return left;
+}
+
+int ParsedFormula::parseUnary()
+{
+    // As in Excel, the negation binds tighter than ^, so -2^2 is 4
+    skipSpaces();
+    const QChar c = peek();
+    if (c != QLatin1Char('-') && c != QLatin1Char('+'))
+        return parsePostfix();
+
+    ++m_pos;
+    const int operand = parseUnary();
+    if (operand == -1 || c == QLatin1Char('+'))
+        return operand;
+    Node node(Negate);
+    node.args << operand;
+    return addNode(node);
+}
+
+int ParsedFormula::parsePostfix()
+{
+    int operand = parsePrimary();
+    while (operand != -1) {
+        skipSpaces();
+        if (peek() != QLatin1Char('%'))
+            break;
+        ++m_pos;
+        Node node(Percent);
+        node.args << operand;
+        operand = addNode(node);
+    }
+    return operand;
+}
+
+int ParsedFormula::parsePrimary()
+{
+    skipSpaces();
+    const QChar c = peek();
+    if (c.isDigit() || c == QLatin1Char('.'))
+        return parseNumber();
+    if (c == QLatin1Char('"'))
+        return parseString();
+    if (c == QLatin1Char('#'))
+        return parseError();
+    if (c == QLatin1Char('(')) {
+        ++m_pos;
+        const int inner = parseComparison();
+        skipSpaces();
+        if (inner == -1 || peek() != QLatin1Char(')'))
+            return -1;
+        ++m_pos;
+        return inner;
+    }
+    if (c.isLetter() || c == QLatin1Char('_') || c == QLatin1Char('$'))
+        return parseIdentifier();
+    return -1;
+}
+
+int ParsedFormula::parseNumber()
+{
+    const int start = m_pos;
+    while (peek().isDigit())
+        ++m_pos;
+    if (peek() == QLatin1Char('.')) {
+        ++m_pos;
+        while (peek().isDigit())
+            ++m_pos;
+    }
+    if (peek() == QLatin1Char('E') || peek() == QLatin1Char('e')) {
+        int i = 1;
+        if (peek(i) == QLatin1Char('+') || peek(i) == QLatin1Char('-'))
+            ++i;
+        if (peek(i).isDigit()) {
+            m_pos += i;
+            while (peek().isDigit())
+                ++m_pos;
+        }
+    }
+
+    bool ok = false;
+    Node node(Constant);
+    node.value = FormulaValue::fromNumber(parseDouble(m_text.midRef(start, m_pos - start), &ok));
+    return ok ? addNode(node) : -1;
+}
+
+int ParsedFormula::parseString()
+{
+    QString text;
+    ++m_pos;
+    forever {
+        if (m_pos >= m_text.size())
+            return -1;
+        const QChar c = m_text.at(m_pos++);
+        if (c == QLatin1Char('"')) {
+            // Quotes are doubled inside strings
+            if (peek() != QLatin1Char('"'))
+                break;
+            ++m_pos;
+        }
+        text.append(c);
+    }
+    Node node(Constant);
+    node.value = FormulaValue::fromString(text);
+    return addNode(node);
+}
+
+int ParsedFormula::parseError()
+{
+    const QStringRef rest = m_text.midRef(m_pos);
+    for (unsigned i = 0; i < sizeof(formulaErrors) / sizeof(formulaErrors[0]); ++i) {
+        const QLatin1String error(formulaErrors[i]);
+        if (rest.startsWith(error, Qt::CaseInsensitive)) {
+            m_pos += error.size();
+            Node node(Constant);
+            node.value = FormulaValue::fromError(error);
+            return addNode(node);
+        }
+    }
+    return -1;
+}
+
+static bool isIdentifierChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_') || c == QLatin1Char('.')
+        || c == QLatin1Char('$');
+}
+
+/*
+  Parse a function call, a boolean constant, a cell reference or a range.
+  Anything else, such as a defined name or a reference to another sheet,
+  makes the formula invalid.
+ */
+int ParsedFormula::parseIdentifier()
+{
+    const int start = m_pos;
+    while (m_pos < m_text.size() && isIdentifierChar(m_text.at(m_pos)))
+        ++m_pos;
+    const QString name = m_text.mid(start, m_pos - start).toUpper();
+
+    if (peek() == QLatin1Char('(')) {
+        ++m_pos;
+        return parseFunction(name);
+    }
+    if (name == QLatin1String("TRUE") || name == QLatin1String("FALSE")) {
+        Node node(Constant);
+        node.value = FormulaValue::fromBool(name == QLatin1String("TRUE"));
+        return addNode(node);
+    }
+
+    Node node(Reference);
+    if (!parseReference(name, &node.firstRow, &node.firstColumn))
+        return -1;
+    node.lastRow = node.firstRow;
+    node.lastColumn = node.firstColumn;
+    if (peek() == QLatin1Char(':')) {
+        const int secondStart = ++m_pos;
+        while (m_pos < m_text.size() && isIdentifierChar(m_text.at(m_pos)))
+            ++m_pos;
+        int row;
+        int column;
+        if (!parseReference(m_text.mid(secondStart, m_pos - secondStart).toUpper(), &row, &column))
+            return -1;
+        node.firstRow = qMin(node.firstRow, row);
+        node.lastRow = qMax(node.lastRow, row);
+        node.firstColumn = qMin(node.firstColumn, column);
+        node.lastColumn = qMax(node.lastColumn, column);
+    }
+    return addNode(node);
+}
+
+bool ParsedFormula::parseReference(const QString &text, int *row, int *column) const
+{
+    return parseCellReference(QStringRef(&text), row, column) && *row >= 1
+        && *row <= XLSX_ROW_MAX && *column >= 1 && *column <= XLSX_COLUMN_MAX;
+}
+
+int ParsedFormula::parseFunction(const QString &name)
+{
+    const FormulaFunctionInfo *info = 0;
+    for (unsigned i = 0; i < sizeof(formulaFunctions) / sizeof(formulaFunctions[0]); ++i) {
+        if (name == QLatin1String(formulaFunctions[i].name)) {
+            info = &formulaFunctions[i];
+            break;
+        }
+    }
+    if (!info)
+        return -1;
+
+    Node node(Function, info->id);
+    skipSpaces();
+    if (peek() == QLatin1Char(')')) {
+        ++m_pos;
+    } else {
+        forever {
+            skipSpaces();
+            const QChar c = peek();
+            // An omitted argument is empty
+            const int arg = c == QLatin1Char(',') || c == QLatin1Char(')') ? addNode(Node(Constant))
+                                                                           : parseComparison();
+            if (arg == -1)
+                return -1;
+            node.args.append(arg);
+            skipSpaces();
+            if (peek() == QLatin1Char(',')) {
+                ++m_pos;
+            } else if (peek() == QLatin1Char(')')) {
+                ++m_pos;
+                break;
+            } else {
+                return -1;
+            }
+        }
+    }
+    if (node.args.size() < info->minArgs || node.args.size() > info->maxArgs)
+        return -1;
+    return addNode(node);
+}
+
+static FormulaValue errorValue(const char *error)
+{
+    return FormulaValue::fromError(QString::fromLatin1(error));
+}
+
+static FormulaValue numberResult(double value)
+{
+    if (qIsNaN(value) || qIsInf(value))
+        return errorValue("#NUM!");
+    return FormulaValue::fromNumber(value);
+}
+
+/*
+  Convert \a value to a number, or set \a error to the error it causes.
+ */
+static bool toNumber(const FormulaValue &value, double *number, FormulaValue *error)
+{
+    switch (value.type) {
+    case FormulaValue::Empty:
+        *number = 0;
+        return true;
+    case FormulaValue::Number:
+    case FormulaValue::Boolean:
+        *number = value.number;
+        return true;
+    case FormulaValue::String: {
+        const QString text = value.text.trimmed();
+        bool ok = false;
+        *number = parseDouble(QStringRef(&text), &ok);
+        if (ok)
+            return true;
+        *error = errorValue("#VALUE!");
+        return false;
+    }
+    default:
+        *error = value;
+        return false;
+    }
+}
+
+static bool toBool(const FormulaValue &value, bool *result, FormulaValue *error)
+{
+    switch (value.type) {
+    case FormulaValue::Empty:
+        *result = false;
+        return true;
+    case FormulaValue::Number:
+    case FormulaValue::Boolean:
+        *result = value.number != 0;
+        return true;
+    case FormulaValue::String:
+        if (value.text.compare(QLatin1String("TRUE"), Qt::CaseInsensitive) == 0) {
+            *result = true;
+            return true;
+        } else if (value.text.compare(QLatin1String("FALSE"), Qt::CaseInsensitive) == 0) {
+            *result = false;
+            return true;
+        }
+        *error = errorValue("#VALUE!");
+        return false;
+    default:
+        *error = value;
+        return false;
+    }
+}
+
+static QString toText(const FormulaValue &value)
+{
+    switch (value.type) {
+    case FormulaValue::Number:
+        return QString::number(value.number, 'g', 15).toUpper();
+    case FormulaValue::Boolean:
+        return value.number ? QStringLiteral("TRUE") : QStringLiteral("FALSE");
+    case FormulaValue::String:
+        return value.text;
+    default:
+        return QString();
+    }
+}
+
+static FormulaValue emptyValueAs(FormulaValue::Type type)
+{
+    if (type == FormulaValue::String)
+        return FormulaValue::fromString(QString());
+    if (type == FormulaValue::Boolean)
+        return FormulaValue::fromBool(false);
+    return FormulaValue::fromNumber(0);
+}
+
+/*
+  Compare two values which are not errors the way Excel does: numbers
+  are less than strings, which are less than booleans, strings are
+  compared without case, and an empty value is the default of the type
+  it is compared with.
+ */
+static int compareValues(FormulaValue left, FormulaValue right)
+{
+    if (left.type == FormulaValue::Empty)
+        left = emptyValueAs(right.type);
+    if (right.type == FormulaValue::Empty)
+        right = emptyValueAs(left.type);
+
+    static const int typeOrder[] = { 0, 0, 1, 2, 3 }; // Empty, Number, String, Boolean, Error
+    if (left.type != right.type)
+        return typeOrder[left.type] < typeOrder[right.type] ? -1 : 1;
+    if (left.type == FormulaValue::String)
+        return left.text.compare(right.text, Qt::CaseInsensitive);
+    if (left.number == right.number)
+        return 0;
+    return left.number < right.number ? -1 : 1;
+}
+
+static FormulaValue cellDataValue(const WorksheetPrivate *sheet, const CellData &cell)
+{
+    if (cell.storage == CellData::Blank)
+        return FormulaValue();
+
+    const QVariant value = sheet->cellValue(cell);
+    switch (cell.type()) {
+    case Cell::NumberType:
+        return value.isValid() ? FormulaValue::fromNumber(value.toDouble()) : FormulaValue();
+    case Cell::BooleanType:
+        return FormulaValue::fromBool(value.toBool());
+    case Cell::ErrorType:
+        return FormulaValue::fromError(value.toString());
+    default:
+        return FormulaValue::fromString(value.toString());
+    }
+}
+
+/*
+  Evaluates one formula with the current values of the cells. The engine
+  calculates the formulas it refers to first.
+ */
+class FormulaEngine::Evaluator
+{
+public:
+    Evaluator(const WorksheetPrivate *sheet, const ParsedFormula &formula)
+        : m_sheet(sheet)
+        , m_formula(formula)
+    {
+    }
+
+    FormulaValue evaluate() { return value(m_formula.root()); }
+
+private:
+    typedef ParsedFormula::Node Node;
+
+    FormulaValue value(int index);
+    FormulaValue cellValue(int row, int col);
+    void rangeValues(const Node &range, QVector<FormulaValue> *values);
+    FormulaValue binary(const Node &node);
+    FormulaValue function(const Node &node);
+    FormulaValue aggregate(const Node &node);
+    FormulaValue logical(const Node &node);
+    FormulaValue round(const Node &node);
+    FormulaValue vlookup(const Node &node);
+
+    const WorksheetPrivate *m_sheet;
+    const ParsedFormula &m_formula;
+};
+
+FormulaValue FormulaEngine::Evaluator::value(int index)
+{
+    const Node &node = m_formula.node(index);
+    switch (node.type) {
+    case ParsedFormula::Constant:
+        return node.value;
+    case ParsedFormula::Reference:
+        // A range can only be used by the functions which take one
+        if (node.isRange())
+            return errorValue("#VALUE!");
+        return cellValue(node.firstRow, node.firstColumn);
+    case ParsedFormula::Negate:
+    case ParsedFormula::Percent: {
+        double number;
+        FormulaValue error;
+        if (!toNumber(value(node.args[0]), &number, &error))
+            return error;
+        return FormulaValue::fromNumber(node.type == ParsedFormula::Negate ? -number
+                                                                           : number / 100);
+    }
+    case ParsedFormula::Binary:
+        return binary(node);
+    default:
+        return function(node);
+    }
+}
+
+FormulaValue FormulaEngine::Evaluator::cellValue(int row, int col)
+{
+    const CellData *cell = m_sheet->cellTable.cell(row, col);
+    return cell ? cellDataValue(m_sheet, *cell) : FormulaValue();
+}
+
+/*
+  Append the values of the cells of \a range which are stored, row by row.
+ */
+void FormulaEngine::Evaluator::rangeValues(const Node &range, QVector<FormulaValue> *values)
+{
+    const CellTable &table = m_sheet->cellTable;
+    // Calculating the cells doesn't add or remove any, so rows stay valid
+    for (int i = table.rowLowerBound(range.firstRow);
+         i < table.size() && table.rowNumberAt(i) <= range.lastRow; ++i) {
+        const int row = table.rowNumberAt(i);
+        const CellRow &cells = table.rowAt(i);
+        for (int j = cells.lowerBound(range.firstColumn);
+             j < cells.size() && cells.columns[j] <= range.lastColumn; ++j)
+            values->append(cellValue(row, cells.columns[j]));
+    }
+}
+
+FormulaValue FormulaEngine::Evaluator::binary(const Node &node)
+{
+    const FormulaValue left = value(node.args[0]);
+    if (left.isError())
+        return left;
+    const FormulaValue right = value(node.args[1]);
+    if (right.isError())
+        return right;
+
+    switch (node.op) {
+    case ParsedFormula::Equal:
+        return FormulaValue::fromBool(compareValues(left, right) == 0);
+    case ParsedFormula::NotEqual:
+        return FormulaValue::fromBool(compareValues(left, right) != 0);
+    case ParsedFormula::Less:
+        return FormulaValue::fromBool(compareValues(left, right) < 0);
+    case ParsedFormula::LessEqual:
+        return FormulaValue::fromBool(compareValues(left, right) <= 0);
+    case ParsedFormula::Greater:
+        return FormulaValue::fromBool(compareValues(left, right) > 0);
+    case ParsedFormula::GreaterEqual:
+        return FormulaValue::fromBool(compareValues(left, right) >= 0);
+    case ParsedFormula::Concat:
+        return FormulaValue::fromString(toText(left) + toText(right));
+    default:
+        break;
+    }
+
+    double a;
+    double b;
+    FormulaValue error;
+    if (!toNumber(left, &a, &error) || !toNumber(right, &b, &error))
+        return error;
+    switch (node.op) {
+    case ParsedFormula::Add:
+        return numberResult(a + b);
+    case ParsedFormula::Subtract:
+        return numberResult(a - b);
+    case ParsedFormula::Multiply:
+        return numberResult(a * b);
+    case ParsedFormula::Divide:
+        if (b == 0)
+            return errorValue("#DIV/0!");
+        return numberResult(a / b);
+    default: // Power
+        if (a == 0 && b == 0)
+            return errorValue("#NUM!");
+        return numberResult(pow(a, b));
+    }
+}
+
+FormulaValue FormulaEngine::Evaluator::function(const Node &node)
+{
+    FormulaValue error;
+    switch (node.op) {
+    case ParsedFormula::If: {
+        bool condition;
+        if (!toBool(value(node.args[0]), &condition, &error))
+            return error;
+        // Only the selected branch is evaluated
+        if (condition)
+            return value(node.args[1]);
+        return node.args.size() > 2 ? value(node.args[2]) : FormulaValue::fromBool(false);
+    }
+    case ParsedFormula::And:
+    case ParsedFormula::Or:
+        return logical(node);
+    case ParsedFormula::Not: {
+        bool b;
+        if (!toBool(value(node.args[0]), &b, &error))
+            return error;
+        return FormulaValue::fromBool(!b);
+    }
+    case ParsedFormula::Abs: {
+        double number;
+        if (!toNumber(value(node.args[0]), &number, &error))
+            return error;
+        return FormulaValue::fromNumber(fabs(number));
+    }
+    case ParsedFormula::Round:
+        return round(node);
+    case ParsedFormula::VLookup:
+        return vlookup(node);
+    default:
+        return aggregate(node);
+    }
+}
+
+/*
+  SUM, AVERAGE, MIN, MAX and COUNT. Only the numbers of the ranges are
+  used, while the other arguments are converted to numbers.
+ */
+FormulaValue FormulaEngine::Evaluator::aggregate(const Node &node)
+{
+    double sum = 0;
+    double minValue = 0;
+    double maxValue = 0;
+    int count = 0;
+    QVector<FormulaValue> values;
+
+    foreach (int arg, node.args) {
+        const Node &argNode = m_formula.node(arg);
+        values.clear();
+        if (argNode.type == ParsedFormula::Reference) {
+            rangeValues(argNode, &values);
+        } else {
+            const FormulaValue v = value(arg);
+            double number;
+            FormulaValue error;
+            if (node.op == ParsedFormula::Count) {
+                if (v.type != FormulaValue::Empty && toNumber(v, &number, &error))
+                    ++count;
+                continue;
+            }
+            if (!toNumber(v, &number, &error))
+                return error;
+            values.append(FormulaValue::fromNumber(number));
+        }
+
+        foreach (const FormulaValue &v, values) {
+            if (v.isError() && node.op != ParsedFormula::Count)
+                return v;
+            if (v.type != FormulaValue::Number)
+                continue;
+            sum += v.number;
+            minValue = count ? qMin(minValue, v.number) : v.number;
+            maxValue = count ? qMax(maxValue, v.number) : v.number;
+            ++count;
+        }
+    }
+
+    switch (node.op) {
+    case ParsedFormula::Sum:
+        return numberResult(sum);
+    case ParsedFormula::Average:
+        if (!count)
+            return errorValue("#DIV/0!");
+        return numberResult(sum / count);
+    case ParsedFormula::Min:
+        return FormulaValue::fromNumber(minValue);
+    case ParsedFormula::Max:
+        return FormulaValue::fromNumber(maxValue);
+    default: // Count
+        return FormulaValue::fromNumber(count);
+    }
+}
+
+/*
+  AND and OR. The text and empty cells of the ranges are ignored.
+ */
+FormulaValue FormulaEngine::Evaluator::logical(const Node &node)
+{
+    const bool isAnd = node.op == ParsedFormula::And;
+    bool result = isAnd;
+    bool found = false;
+    QVector<FormulaValue> values;
+
+    foreach (int arg, node.args) {
+        const Node &argNode = m_formula.node(arg);
+        if (argNode.type == ParsedFormula::Reference) {
+            values.clear();
+            rangeValues(argNode, &values);
+            foreach (const FormulaValue &v, values) {
+                if (v.isError())
+                    return v;
+                if (v.type != FormulaValue::Number && v.type != FormulaValue::Boolean)
+                    continue;
+                result = isAnd ? result && v.number != 0 : result || v.number != 0;
+                found = true;
+            }
+        } else {
+            bool b;
+            FormulaValue error;
+            if (!toBool(value(arg), &b, &error))
+                return error;
+            result = isAnd ? result && b : result || b;
+            found = true;
+        }
+    }
+    if (!found)
+        return errorValue("#VALUE!");
+    return FormulaValue::fromBool(result);
+}
+
+/*
+  ROUND, which rounds halves away from zero.
+ */
+FormulaValue FormulaEngine::Evaluator::round(const Node &node)
+{
+    double number;
+    double digits;
+    FormulaValue error;
+    if (!toNumber(value(node.args[0]), &number, &error)
+        || !toNumber(value(node.args[1]), &digits, &error))
+        return error;
+
+    // Negative digits divide by a power of ten, which unlike multiplying
+    // by 0.01 is exact, so that ROUND(1250, -2) gives 1300
+    const int places = int(qBound(-308.0, digits, 308.0));
+    const double scale = pow(10.0, qAbs(places));
+    const double magnitude = places >= 0 ? fabs(number) * scale : fabs(number) / scale;
+    if (qIsInf(magnitude))
+        return FormulaValue::fromNumber(number);
+    // Drop the binary representation error first, so that 2.675 gives 2.68
+    const double scaled = floor(QString::number(magnitude, 'g', 15).toDouble() + 0.5);
+    const double rounded = places >= 0 ? scaled / scale : scaled * scale;
+    return numberResult(number < 0 ? -rounded : rounded);
+}
+
+/*
+  VLOOKUP. The exact match finds the first row whose first cell equals
+  the looked up value, and the approximate one expects the rows sorted
+  in ascending order and finds the last row not greater than it.
+ */
+FormulaValue FormulaEngine::Evaluator::vlookup(const Node &node)
+{
+    const FormulaValue lookup = value(node.args[0]);
+    if (lookup.isError())
+        return lookup;
+    const Node &table = m_formula.node(node.args[1]);
+    if (table.type != ParsedFormula::Reference)
+        return errorValue("#VALUE!");
+
+    double columnIndex;
+    FormulaValue error;
+    if (!toNumber(value(node.args[2]), &columnIndex, &error))
+        return error;
+    if (columnIndex < 1)
+        return errorValue("#VALUE!");
+    if (columnIndex > table.lastColumn - table.firstColumn + 1)
+        return errorValue("#REF!");
+
+    bool approximate = true;
+    if (node.args.size() > 3 && !toBool(value(node.args[3]), &approximate, &error))
+        return error;
+
+    const CellTable &cells = m_sheet->cellTable;
+    int found = 0;
+    for (int i = cells.rowLowerBound(table.firstRow);
+         i < cells.size() && cells.rowNumberAt(i) <= table.lastRow; ++i) {
+        if (cells.rowAt(i).indexOf(table.firstColumn) == -1)
+            continue;
+        const int row = cells.rowNumberAt(i);
+        const FormulaValue key = cellValue(row, table.firstColumn);
+        if (key.type == FormulaValue::Empty || key.isError())
+            continue;
+        if (!approximate) {
+            if (compareValues(key, lookup) == 0) {
+                found = row;
+                break;
+            }
+        } else if (key.type == lookup.type) {
+            if (compareValues(key, lookup) > 0)
+                break;
+            found = row;
+        }
+    }
+    if (!found)
+        return errorValue("#N/A");
+    return cellValue(found, table.firstColumn + int(columnIndex) - 1);
+}
+
+FormulaEngine::FormulaEngine(WorksheetPrivate *sheet)
+    : m_sheet(sheet)
+{
+    // All the formulas are calculated by the first recalculation
+    const CellTable &table = m_sheet->cellTable;
+    for (int i = 0; i < table.size(); ++i) {
+        const CellRow &cells = table.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const CellData &cell = cells.cells[j];
+            if (cell.storage == CellData::Extra && table.extra(cell.index).formula.isValid())
+                cellChanged(table.rowNumberAt(i), cells.columns[j]);
+        }
+    }
+}
+
+/*
+  Evaluate \a formula with the current values of the cells of \a sheet.
+ */
+FormulaValue FormulaEngine::evaluate(const ParsedFormula &formula, const WorksheetPrivate *sheet)
+{
+    if (!formula.isValid())
+        return errorValue("#NAME?");
+    Evaluator evaluator(sheet, formula);
+    return evaluator.evaluate();
+}
+
+/*
+  Returns the value of the cell (\a row, \a col) of \a sheet, as seen by
+  formulas. The cached results of formulas are used as they are.
+ */
+FormulaValue FormulaEngine::cellValue(const WorksheetPrivate *sheet, int row, int col)
+{
+    const CellData *cell = sheet->cellTable.cell(row, col);
+    return cell ? cellDataValue(sheet, *cell) : FormulaValue();
+}
+
+/*
+  Compares \a left and \a right like the comparison operators of formulas
+  do. Returns a negative number, 0 or a positive number.
+ */
+int FormulaEngine::compare(const FormulaValue &left, const FormulaValue &right)
+{
+    return compareValues(left, right);
+}
+
+/*
+  Returns \a value as text, like the concatenation operator does.
+ */
+QString FormulaEngine::text(const FormulaValue &value)
+{
+    return toText(value);
+}
+
+/*
+  Record that the cell (\a row, \a col) has been written, so that it and
+  the formulas depending on it are calculated by the next recalculate().
+ */
+void FormulaEngine::cellChanged(int row, int col)
+{
+    const quint64 key = formulaCellKey(row, col);
+    const QString text = formulaTextAt(row, col);
+
+    QHash<quint64, FormulaCell>::iterator it = m_formulas.find(key);
+    if (it != m_formulas.end() && it->text != text) {
+        removeDependencies(key, it->parsed);
+        m_formulas.erase(it);
+        it = m_formulas.end();
+    }
+    if (it == m_formulas.end() && !text.isEmpty()) {
+        FormulaCell formula;
+        formula.text = text;
+        formula.parsed = ParsedFormula(text);
+        addDependencies(key, formula.parsed);
+        m_formulas.insert(key, formula);
+    }
+    m_dirty.insert(key);
+}
+
+/*
+  Calculate the formulas which depend on the cells changed since the last
+  call, and store their results.
+ */
+void FormulaEngine::recalculate()
+{
+    if (m_dirty.isEmpty())
+        return;
+
+    QVector<quint64> stack;
+    stack.reserve(m_dirty.size());
+    foreach (quint64 key, m_dirty)
+        stack.append(key);
+    m_dirty.clear();
+
+    while (!stack.isEmpty()) {
+        const quint64 key = stack.takeLast();
+        if (m_formulas.contains(key)) {
+            if (m_pending.contains(key))
+                continue;
+            m_pending.insert(key, Waiting);
+        }
+        collectDependents(key, &stack);
+    }
+
+    // Calculated in the order of the cells, whatever the formulas refer to
+    QList<quint64> keys = m_pending.keys();
+    std::sort(keys.begin(), keys.end());
+    foreach (quint64 key, keys)
+        calculate(key);
+    m_pending.clear();
+}
+
+/*
+  Calculate the formula of the cell \a key if it is waiting for it, after
+  the waiting formulas it refers to, directly or not. The formulas are
+  visited depth first with a stack of their own, as the chains of formulas
+  can be much deeper than the call stack. A formula which refers back to
+  one being visited uses its cached value.
+ */
+void FormulaEngine::calculate(quint64 key)
+{
+    if (m_pending.value(key, Done) == Done)
+        return;
+
+    QVector<quint64> stack;
+    QVector<quint64> precedents;
+    stack.append(key);
+    while (!stack.isEmpty()) {
+        const quint64 top = stack.last();
+        QHash<quint64, int>::iterator it = m_pending.find(top);
+        if (it.value() == Done) {
+            stack.removeLast();
+            continue;
+        }
+        if (it.value() == Waiting) {
+            it.value() = Visiting;
+            precedents.clear();
+            collectPrecedents(top, &precedents);
+            foreach (quint64 precedent, precedents) {
+                const int state = m_pending.value(precedent);
+                if (state == Waiting) {
+                    stack.append(precedent);
+                } else if (state == Visiting) {
+                    qDebug("FormulaEngine: circular reference in the formula of %s",
+                           qPrintable(CellReference(keyRow(top), keyColumn(top)).toString()));
+                }
+            }
+            continue;
+        }
+
+        // Visiting, and its precedents are done
+        stack.removeLast();
+        it.value() = Done;
+        const FormulaCell &formula = m_formulas.constFind(top).value();
+        if (formula.parsed.isValid()) {
+            Evaluator evaluator(m_sheet, formula.parsed);
+            storeResult(top, evaluator.evaluate());
+        }
+    }
+}
+
+/*
+  Store \a value as the cached value of the formula cell \a key.
+ */
+void FormulaEngine::storeResult(quint64 key, const FormulaValue &value)
+{
+    const int row = keyRow(key);
+    const int col = keyColumn(key);
+    CellData *cell = m_sheet->cellTable.cell(row, col);
+    if (!cell || cell->storage != CellData::Extra)
+        return;
+
+    Cell::CellType type;
+    QVariant result;
+    switch (value.type) {
+    case FormulaValue::String:
+        type = Cell::StringType;
+        result = value.text;
+        break;
+    case FormulaValue::Boolean:
+        type = Cell::BooleanType;
+        result = value.number != 0;
+        break;
+    case FormulaValue::Error:
+        type = Cell::ErrorType;
+        result = value.text;
+        break;
+    default: // A reference to an empty cell gives 0
+        type = Cell::NumberType;
+        result = value.number;
+        break;
+    }
+
+    CellExtraData &extra = m_sheet->cellTable.extra(cell->index);
+    if (cell->type() == type && extra.sharedStringIndex == -1 && extra.value == result)
+        return;
+
+    const CellValueIndex::Key indexed = m_sheet->indexedValue(row, col);
+    m_sheet->releaseSharedString(*cell);
+    extra.sharedStringIndex = -1;
+    extra.inlineRuns.clear();
+    extra.value = result;
+    cell->cellType = type;
+    m_sheet->reindexValue(row, col, indexed);
+    m_sheet->updateCachedCell(row, col);
+    m_sheet->cfEvaluator.reset();
+    m_sheet->dirty = true;
+}
+
+/*
+  Returns the text of the formula of the cell (\a row, \a col), or an
+  empty string if it has no formula which can be calculated. The text of
+  the cells sharing a formula is built from the one of the first cell.
+ */
+QString FormulaEngine::formulaTextAt(int row, int col) const
+{
+    const CellData *cell = m_sheet->cellTable.cell(row, col);
+    if (!cell || cell->storage != CellData::Extra)
+        return QString();
+
+    const CellFormula &formula = m_sheet->cellTable.extra(cell->index).formula;
+    if (!formula.isValid())
+        return QString();
+    if (formula.formulaType() == CellFormula::SharedType) {
+        if (!formula.formulaText().isEmpty())
+            return formula.formulaText();
+        return m_sheet->sharedFormulaTemplate(formula.sharedIndex())
+            .formulaText(CellReference(row, col));
+    }
+    if (formula.formulaType() != CellFormula::NormalType)
+        return QString();
+    return formula.formulaText();
+}
+
+void FormulaEngine::addDependencies(quint64 key, const ParsedFormula &formula)
+{
+    foreach (int index, formula.referenceNodes()) {
+        const ParsedFormula::Node &node = formula.node(index);
+        const qint64 size =
+            qint64(node.lastRow - node.firstRow + 1) * (node.lastColumn - node.firstColumn + 1);
+        if (size <= RangeCellLimit) {
+            for (int row = node.firstRow; row <= node.lastRow; ++row) {
+                for (int col = node.firstColumn; col <= node.lastColumn; ++col)
+                    m_cellDependents[formulaCellKey(row, col)].append(key);
+            }
+        } else {
+            RangeDependent dependent;
+            dependent.key = key;
+            dependent.firstRow = node.firstRow;
+            dependent.lastRow = node.lastRow;
+            for (int col = node.firstColumn; col <= node.lastColumn; ++col)
+                m_columnDependents[col].append(dependent);
+        }
+    }
+}
+
+void FormulaEngine::removeDependencies(quint64 key, const ParsedFormula &formula)
+{
+    foreach (int index, formula.referenceNodes()) {
+        const ParsedFormula::Node &node = formula.node(index);
+        const qint64 size =
+            qint64(node.lastRow - node.firstRow + 1) * (node.lastColumn - node.firstColumn + 1);
+        if (size <= RangeCellLimit) {
+            for (int row = node.firstRow; row <= node.lastRow; ++row) {
+                for (int col = node.firstColumn; col <= node.lastColumn; ++col) {
+                    QHash<quint64, QVector<quint64>>::iterator it =
+                        m_cellDependents.find(formulaCellKey(row, col));
+                    if (it == m_cellDependents.end())
+                        continue;
+                    it->removeOne(key);
+                    if (it->isEmpty())
+                        m_cellDependents.erase(it);
+                }
+            }
+        } else {
+            for (int col = node.firstColumn; col <= node.lastColumn; ++col) {
+                QVector<RangeDependent> &dependents = m_columnDependents[col];
+                for (int i = 0; i < dependents.size(); ++i) {
+                    const RangeDependent &dependent = dependents[i];
+                    if (dependent.key == key && dependent.firstRow == node.firstRow
+                        && dependent.lastRow == node.lastRow) {
+                        dependents.remove(i);
+                        break;
+                    }
+                }
+                if (dependents.isEmpty())
+                    m_columnDependents.remove(col);
+            }
+        }
+    }
+}
+
+/*
+  Append the formula cells waiting for recalculation which the formula of
+  the cell \a key refers to, to \a result. Only the stored cells of its
+  ranges are looked at.
+ */
+void FormulaEngine::collectPrecedents(quint64 key, QVector<quint64> *result) const
+{
+    const ParsedFormula &formula = m_formulas.constFind(key).value().parsed;
+    const CellTable &table = m_sheet->cellTable;
+    foreach (int index, formula.referenceNodes()) {
+        const ParsedFormula::Node &node = formula.node(index);
+        for (int i = table.rowLowerBound(node.firstRow);
+             i < table.size() && table.rowNumberAt(i) <= node.lastRow; ++i) {
+            const int row = table.rowNumberAt(i);
+            const CellRow &cells = table.rowAt(i);
+            for (int j = cells.lowerBound(node.firstColumn);
+                 j < cells.size() && cells.columns[j] <= node.lastColumn; ++j) {
+                const quint64 precedent = formulaCellKey(row, cells.columns[j]);
+                if (m_pending.contains(precedent))
+                    result->append(precedent);
+            }
+        }
+    }
+}
+
+/*
+  Append the formula cells which refer to the cell \a key to \a result.
+ */
+void FormulaEngine::collectDependents(quint64 key, QVector<quint64> *result) const
+{
+    QHash<quint64, QVector<quint64>>::const_iterator it = m_cellDependents.constFind(key);
+    if (it != m_cellDependents.constEnd())
+        *result += it.value();
+
+    QHash<int, QVector<RangeDependent>>::const_iterator ranges =
+        m_columnDependents.constFind(keyColumn(key));
+    if (ranges == m_columnDependents.constEnd())
+        return;
+    const int row = keyRow(key);
+    foreach (const RangeDependent &dependent, ranges.value()) {
+        if (row >= dependent.firstRow && row <= dependent.lastRow)
+            result->append(dependent.key);
+    }
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,257 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXFORMULAENGINE_P_H
+#define XLSXFORMULAENGINE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class WorksheetPrivate;
+
+/*
+  The value of a cell, or of a part of a formula, as seen by the formula
+  engine. The boolean of a Boolean value is held in number, and the error
+  text (such as "#DIV/0!") of an Error value in text.
+ */
+class FormulaValue
+{
+public:
+    enum Type { Empty, Number, String, Boolean, Error };
+
+    FormulaValue()
+        : type(Empty)
+        , number(0)
+    {
+    }
+
+    static FormulaValue fromNumber(double value)
+    {
+        FormulaValue v;
+        v.type = Number;
+        v.number = value;
+        return v;
+    }
+    static FormulaValue fromBool(bool value)
+    {
+        FormulaValue v;
+        v.type = Boolean;
+        v.number = value ? 1 : 0;
+        return v;
+    }
+    static FormulaValue fromString(const QString &value)
+    {
+        FormulaValue v;
+        v.type = String;
+        v.text = value;
+        return v;
+    }
+    static FormulaValue fromError(const QString &error)
+    {
+        FormulaValue v;
+        v.type = Error;
+        v.text = error;
+        return v;
+    }
+
+    bool isError() const { return type == Error; }
+    bool operator==(const FormulaValue &other) const
+    {
+        return type == other.type && number == other.number && text == other.text;
+    }
+
+    Type type;
+    double number;
+    QString text;
+};
+
+/*
+  A formula parsed into a tree of nodes, which are stored in one vector
+  and refer to their arguments by index. Formulas using syntax which the
+  engine doesn't support, such as references to other sheets, defined
+  names, array constants or unknown functions, are not valid.
+ */
+class XLSX_AUTOTEST_EXPORT ParsedFormula
+{
+public:
+    enum NodeType { Constant, Reference, Negate, Percent, Binary, Function };
+
+    enum Operator {
+        Add, Subtract, Multiply, Divide, Power, Concat,
+        Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual
+    };
+
+    enum FunctionId { Sum, Average, Min, Max, Count, If, And, Or, Not, Abs, Round, VLookup };
+
+    struct Node
+    {
+        Node(NodeType type = Constant, int op = 0)
+            : type(type)
+            , op(op)
+            , firstRow(0)
+            , firstColumn(0)
+            , lastRow(0)
+            , lastColumn(0)
+        {
+        }
+
+        bool isRange() const
+        {
+            return type == Reference && (firstRow != lastRow || firstColumn != lastColumn);
+        }
+
+        NodeType type;
+        int op; // Operator of a Binary node, FunctionId of a Function node
+        FormulaValue value; // Constant
+        // Area of a Reference node, a single cell or a range
+        int firstRow;
+        int firstColumn;
+        int lastRow;
+        int lastColumn;
+        QVector<int> args;
+    };
+
+    ParsedFormula();
+    explicit ParsedFormula(const QString &formulaText);
+
+    bool isValid() const { return m_root != -1; }
+    int root() const { return m_root; }
+    const Node &node(int index) const { return m_nodes[index]; }
+    QVector<int> referenceNodes() const;
+
+private:
+    int parseComparison();
+    int parseConcat();
+    int parseAdditive();
+    int parseTerm();
+    int parsePower();
+    int parseUnary();
+    int parsePostfix();
+    int parsePrimary();
+    int parseNumber();
+    int parseString();
+    int parseError();
+    int parseIdentifier();
+    int parseFunction(const QString &name);
+    bool parseReference(const QString &text, int *row, int *column) const;
+    int addNode(const Node &node);
+    int addBinary(int op, int left, int right);
+    QChar peek(int offset = 0) const;
+    void skipSpaces();
+
+    QVector<Node> m_nodes;
+    int m_root;
+    // Parser state
+    QString m_text;
+    int m_pos;
+};
+
+/*
+  Calculates the formulas of one worksheet. The references of each
+  formula are recorded in a dependency graph, so that when a cell is
+  changed only the formulas which depend on it, directly or through
+  other formulas, are calculated again by recalculate(). The results
+  are stored as the cached values of the formula cells, which are
+  written to <v> when the sheet is saved.
+
+  Formulas which can't be parsed keep the cached value they were loaded
+  or written with.
+ */
+class XLSX_AUTOTEST_EXPORT FormulaEngine
+{
+public:
+    explicit FormulaEngine(WorksheetPrivate *sheet);
+
+    void cellChanged(int row, int col);
+    void recalculate();
+
+    static FormulaValue evaluate(const ParsedFormula &formula, const WorksheetPrivate *sheet);
+    static FormulaValue cellValue(const WorksheetPrivate *sheet, int row, int col);
+    static int compare(const FormulaValue &left, const FormulaValue &right);
+    static QString text(const FormulaValue &value);
+
+private:
+    Q_DISABLE_COPY(FormulaEngine)
+
+    // Ranges larger than this are tracked per column instead of per cell
+    enum { RangeCellLimit = 256 };
+
+    // States of the formulas being calculated by recalculate()
+    enum { Waiting, Visiting, Done };
+
+    struct FormulaCell
+    {
+        QString text;
+        ParsedFormula parsed;
+    };
+
+    struct RangeDependent
+    {
+        quint64 key; // the formula cell
+        int firstRow;
+        int lastRow;
+    };
+
+    class Evaluator;
+    friend class Evaluator;
+
+    void addDependencies(quint64 key, const ParsedFormula &formula);
+    void removeDependencies(quint64 key, const ParsedFormula &formula);
+    void collectDependents(quint64 key, QVector<quint64> *result) const;
+    void collectPrecedents(quint64 key, QVector<quint64> *result) const;
+    void calculate(quint64 key);
+    void storeResult(quint64 key, const FormulaValue &value);
+    QString formulaTextAt(int row, int col) const;
+
+    WorksheetPrivate *m_sheet;
+    QHash<quint64, FormulaCell> m_formulas;
+    QHash<quint64, QVector<quint64>> m_cellDependents;
+    QHash<int, QVector<RangeDependent>> m_columnDependents;
+    // Cells changed since the last recalculation
+    QSet<quint64> m_dirty;
+    // Formulas being calculated by recalculate(), with their state
+    QHash<quint64, int> m_pending;
+};
+
+QT_END_NAMESPACE_XLSX
+
+Q_DECLARE_TYPEINFO(QXlsx::FormulaValue, Q_MOVABLE_TYPE);
+
+#endif // XLSXFORMULAENGINE_P_H
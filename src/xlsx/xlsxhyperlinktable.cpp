@@ -0,0 +1,212 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxhyperlinktable_p.h"
+#include "xlsxcellrange.h"
+#include "xlsxutility_p.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+bool linkLessThan(const HyperlinkTable::Link &left, const HyperlinkTable::Link &right)
+{
+    return left.row < right.row || (left.row == right.row && left.column < right.column);
+}
+
+} // namespace
+
+HyperlinkTable::HyperlinkTable()
+{
+    m_strings.append(QString());
+    m_stringIds.insert(QString(), 0);
+}
+
+/*
+  Returns the link at \a i, with its strings.
+ */
+XlsxHyperlinkData HyperlinkTable::data(int i) const
+{
+    const Link &link = m_links[i];
+    return XlsxHyperlinkData(link.target == -1 ? XlsxHyperlinkData::Internal
+                                               : XlsxHyperlinkData::External,
+                             link.target == -1 ? QString() : m_strings[link.target],
+                             m_strings[link.location], m_strings[link.display],
+                             m_strings[link.tooltip]);
+}
+
+/*
+  Returns the index of the link of the cell (\a row, \a column), or -1 if
+  the cell has none.
+ */
+int HyperlinkTable::indexOf(int row, int column) const
+{
+    const int i = lowerBound(row, column);
+    if (i < m_links.size() && m_links[i].row == row && m_links[i].column == column)
+        return i;
+    return -1;
+}
+
+/*
+  Returns the index of the first link which is not before the cell
+  (\a row, \a column). The links are mostly added in order, so the end is
+  looked at first.
+ */
+int HyperlinkTable::lowerBound(int row, int column) const
+{
+    const Link key = {row, column, -1, 0, 0, 0};
+    if (m_links.isEmpty() || linkLessThan(m_links.last(), key))
+        return m_links.size();
+    return int(std::lower_bound(m_links.constBegin(), m_links.constEnd(), key, linkLessThan)
+               - m_links.constBegin());
+}
+
+int HyperlinkTable::stringId(const QString &text)
+{
+    QHash<QString, int>::const_iterator it = m_stringIds.constFind(text);
+    if (it != m_stringIds.constEnd())
+        return it.value();
+    const int id = m_strings.size();
+    m_strings.append(text);
+    m_stringIds.insert(text, id);
+    return id;
+}
+
+/*
+  Set the link of the cell (\a row, \a column) to \a data.
+ */
+void HyperlinkTable::insert(int row, int column, const XlsxHyperlinkData &data)
+{
+    Link link;
+    link.row = row;
+    link.column = column;
+    link.target = data.linkType == XlsxHyperlinkData::External ? stringId(data.target) : -1;
+    link.location = stringId(data.location);
+    link.display = stringId(data.display);
+    link.tooltip = stringId(data.tooltip);
+
+    const int i = lowerBound(row, column);
+    if (i < m_links.size() && m_links[i].row == row && m_links[i].column == column)
+        m_links[i] = link;
+    else
+        m_links.insert(i, link);
+}
+
+/*
+  Set the \a links, taken from this table, to their cells, at once. The
+  links already there are replaced.
+ */
+void HyperlinkTable::insert(const QVector<Link> &links)
+{
+    if (links.isEmpty())
+        return;
+    m_links += links;
+    std::stable_sort(m_links.begin(), m_links.end(), linkLessThan);
+
+    // Of the links of a cell, the last one inserted is kept
+    int out = 0;
+    for (int i = 0; i < m_links.size(); ++i) {
+        if (out > 0 && !linkLessThan(m_links[out - 1], m_links[i]))
+            m_links[out - 1] = m_links[i];
+        else
+            m_links[out++] = m_links[i];
+    }
+    m_links.resize(out);
+}
+
+/*
+  Returns the links of the cells of \a range.
+ */
+QVector<HyperlinkTable::Link> HyperlinkTable::links(const CellRange &range) const
+{
+    QVector<Link> result;
+    const int end = lowerBound(range.lastRow() + 1, 0);
+    for (int i = lowerBound(range.firstRow(), 0); i < end; ++i) {
+        const Link &link = m_links[i];
+        if (link.column >= range.firstColumn() && link.column <= range.lastColumn())
+            result.append(link);
+    }
+    return result;
+}
+
+/*
+  Remove the links of the cells of \a range.
+ */
+void HyperlinkTable::remove(const CellRange &range)
+{
+    const int begin = lowerBound(range.firstRow(), 0);
+    const int end = lowerBound(range.lastRow() + 1, 0);
+    int out = begin;
+    for (int i = begin; i < end; ++i) {
+        const Link &link = m_links[i];
+        if (link.column < range.firstColumn() || link.column > range.lastColumn())
+            m_links[out++] = link;
+    }
+    m_links.erase(m_links.begin() + out, m_links.begin() + end);
+}
+
+/*
+  Move the links as the rows, or the columns when \a rows is false, are
+  inserted or removed. See shiftSpan(). The links keep their order.
+ */
+void HyperlinkTable::shift(bool rows, int first, int count, int max)
+{
+    int out = 0;
+    for (int i = 0; i < m_links.size(); ++i) {
+        Link link = m_links[i];
+        int *position = rows ? &link.row : &link.column;
+        if (shiftSpan(position, position, first, count, max))
+            m_links[out++] = link;
+    }
+    m_links.resize(out);
+}
+
+/*
+  Move the links of \a range as its rows are sorted, the row firstRow + i
+  of the range going to firstRow + \a target[i].
+ */
+void HyperlinkTable::permuteRows(const CellRange &range, const QVector<int> &target)
+{
+    QVector<Link> moved = links(range);
+    if (moved.isEmpty())
+        return;
+    remove(range);
+    for (int i = 0; i < moved.size(); ++i)
+        moved[i].row = range.firstRow() + target[moved[i].row - range.firstRow()];
+    insert(moved);
+}
+
+void HyperlinkTable::clear()
+{
+    m_links.clear();
+    m_strings.clear();
+    m_stringIds.clear();
+    m_strings.append(QString());
+    m_stringIds.insert(QString(), 0);
+}
+
+QT_END_NAMESPACE_XLSX
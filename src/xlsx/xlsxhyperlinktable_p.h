@@ -0,0 +1,123 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXHYPERLINKTABLE_P_H
+#define XLSXHYPERLINKTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class CellRange;
+
+struct XlsxHyperlinkData
+{
+    enum LinkType { External, Internal };
+
+    XlsxHyperlinkData(LinkType linkType = External, const QString &target = QString(),
+                      const QString &location = QString(), const QString &display = QString(),
+                      const QString &tip = QString())
+        : linkType(linkType)
+        , target(target)
+        , location(location)
+        , display(display)
+        , tooltip(tip)
+    {
+    }
+
+    LinkType linkType;
+    QString target; // For External link
+    QString location;
+    QString display;
+    QString tooltip;
+};
+
+/*
+  The hyperlinks of a sheet, sorted by row and column. A link only holds
+  the ids of its strings, each distinct string being stored once for the
+  sheet, so a million links to a few targets take little more than their
+  cell references. The strings are kept until the table is cleared.
+ */
+class XLSX_AUTOTEST_EXPORT HyperlinkTable
+{
+public:
+    struct Link
+    {
+        int row;
+        int column;
+        int target; // -1 for the links within the workbook
+        int location;
+        int display;
+        int tooltip;
+    };
+
+    HyperlinkTable();
+
+    bool isEmpty() const { return m_links.isEmpty(); }
+    int size() const { return m_links.size(); }
+    const Link &at(int i) const { return m_links[i]; }
+    const QString &string(int id) const { return m_strings[id]; }
+    int stringCount() const { return m_strings.size(); }
+    XlsxHyperlinkData data(int i) const;
+    int indexOf(int row, int column) const;
+
+    void insert(int row, int column, const XlsxHyperlinkData &data);
+    void insert(const QVector<Link> &links);
+    QVector<Link> links(const CellRange &range) const;
+    void remove(const CellRange &range);
+    void shift(bool rows, int first, int count, int max);
+    void permuteRows(const CellRange &range, const QVector<int> &target);
+    void clear();
+
+private:
+    int lowerBound(int row, int column) const;
+    int stringId(const QString &text);
+
+    QVector<Link> m_links;
+    QStringList m_strings; // the empty string is the first one
+    QHash<QString, int> m_stringIds;
+};
+
+QT_END_NAMESPACE_XLSX
+
+Q_DECLARE_TYPEINFO(QXlsx::HyperlinkTable::Link, Q_PRIMITIVE_TYPE);
+
+#endif // XLSXHYPERLINKTABLE_P_H
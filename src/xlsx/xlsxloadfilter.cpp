@@ -0,0 +1,232 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxloadfilter.h"
+#include "xlsxloadfilter_p.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+const int MaxColumn = 16384;
+}
+
+LoadFilterPrivate::LoadFilterPrivate()
+    : options(LoadFilter::DefaultOptions)
+{
+}
+
+/*!
+  \class QXlsx::LoadFilter
+  \inmodule QtXlsx
+  \brief The parts of a workbook which are loaded by a Document.
+
+  Jobs which only need a few columns of a large sheet, or its first rows,
+  can tell the document to load only those. The cells which are filtered
+  out are skipped while the sheet is parsed, no value, format or formula
+  is ever built for them.
+
+  A filter can select the sheets, the columns and a range of cells, the
+  cells loaded being those which are accepted by all of them. The
+  formulas and the styles of the cells and rows can be left out too.
+
+  \code
+  LoadFilter filter;
+  filter.setSheets(QStringList() << "Orders");
+  filter.setColumns(QList<int>() << 1 << 4 << 7);
+  filter.setRange(CellRange("A1:XFD1000"));
+  filter.setOptions(LoadFilter::ValuesOnly);
+  Document preview("Orders.xlsx", filter);
+  \endcode
+
+  The sheets which aren't selected are empty in the document. Filters are
+  meant for the jobs which only read the workbook: a filtered document
+  which is saved only keeps what has been loaded, but for the parts which
+  are copied unchanged from the package it has been loaded from.
+
+  \sa Document::Document()
+ */
+
+/*!
+  \enum LoadFilter::Option
+
+  \value DefaultOptions The cells are loaded with their formulas and styles.
+  \value SkipFormulas The formulas aren't loaded, the cells only keep the
+         values they were saved with.
+  \value SkipStyles The formats of the cells and of the rows aren't loaded.
+  \value ValuesOnly The cells are loaded without formulas and styles.
+ */
+
+/*!
+  Constructs a filter which loads everything.
+ */
+LoadFilter::LoadFilter()
+    : d(new LoadFilterPrivate)
+{
+}
+
+/*!
+  Constructs a copy of \a other.
+ */
+LoadFilter::LoadFilter(const LoadFilter &other)
+    : d(other.d)
+{
+}
+
+/*!
+  Assigns \a other to this filter and returns a reference to this filter.
+ */
+LoadFilter &LoadFilter::operator=(const LoadFilter &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+  Destroys the filter.
+ */
+LoadFilter::~LoadFilter()
+{
+}
+
+/*!
+  Returns true if the filter loads everything.
+ */
+bool LoadFilter::isEmpty() const
+{
+    return d->sheets.isEmpty() && d->columns.isEmpty() && !d->range.isValid()
+        && d->options == DefaultOptions;
+}
+
+/*!
+  Only load the worksheets named \a sheetNames. All the sheets are loaded
+  when the list is empty, which is the default.
+ */
+void LoadFilter::setSheets(const QStringList &sheetNames)
+{
+    d->sheets = sheetNames;
+}
+
+/*!
+  Returns the names of the worksheets which are loaded, or an empty list
+  if all of them are.
+ */
+QStringList LoadFilter::sheets() const
+{
+    return d->sheets;
+}
+
+/*!
+  Only load the cells of the \a columns, numbered from 1. All the columns
+  are loaded when the list is empty, which is the default.
+ */
+void LoadFilter::setColumns(const QList<int> &columns)
+{
+    d->columns.clear();
+    foreach (int column, columns) {
+        if (column < 1 || column > MaxColumn)
+            continue;
+        if (column >= d->columns.size())
+            d->columns.resize(column + 1);
+        d->columns[column] = true;
+    }
+}
+
+/*!
+  Returns the columns whose cells are loaded, or an empty list if all of
+  them are.
+ */
+QList<int> LoadFilter::columns() const
+{
+    QList<int> columns;
+    for (int column = 1; column < d->columns.size(); ++column) {
+        if (d->columns[column])
+            columns.append(column);
+    }
+    return columns;
+}
+
+/*!
+  Only load the cells of \a range, and the rows it covers. The whole sheet
+  is loaded when the range is invalid, which is the default.
+ */
+void LoadFilter::setRange(const CellRange &range)
+{
+    d->range = range;
+}
+
+/*!
+  Returns the range of the cells which are loaded, which is invalid if
+  the whole sheet is.
+ */
+CellRange LoadFilter::range() const
+{
+    return d->range;
+}
+
+/*!
+  Sets the \a options of the filter.
+ */
+void LoadFilter::setOptions(Options options)
+{
+    d->options = options;
+}
+
+/*!
+  Returns the options of the filter.
+ */
+LoadFilter::Options LoadFilter::options() const
+{
+    return d->options;
+}
+
+/*!
+  Returns true if the worksheet \a sheetName is loaded.
+ */
+bool LoadFilter::acceptsSheet(const QString &sheetName) const
+{
+    return d->sheets.isEmpty() || d->sheets.contains(sheetName);
+}
+
+/*!
+  Returns true if some cells of \a row may be loaded.
+ */
+bool LoadFilter::acceptsRow(int row) const
+{
+    return !d->range.isValid() || (row >= d->range.firstRow() && row <= d->range.lastRow());
+}
+
+/*!
+  Returns true if the cell at \a row and \a column is loaded.
+ */
+bool LoadFilter::acceptsCell(int row, int column) const
+{
+    if (d->range.isValid()
+        && (row < d->range.firstRow() || row > d->range.lastRow()
+            || column < d->range.firstColumn() || column > d->range.lastColumn())) {
+        return false;
+    }
+    return d->columns.isEmpty() || (column < d->columns.size() && d->columns[column]);
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,77 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXLOADFILTER_H
+#define QXLSX_XLSXLOADFILTER_H
+
+#include "xlsxglobal.h"
+#include <QSharedDataPointer>
+#include <QStringList>
+#include <QList>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class CellRange;
+class LoadFilterPrivate;
+
+class Q_XLSX_EXPORT LoadFilter
+{
+public:
+    enum Option {
+        DefaultOptions = 0x0,
+        SkipFormulas = 0x1,
+        SkipStyles = 0x2,
+        ValuesOnly = SkipFormulas | SkipStyles
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    LoadFilter();
+    LoadFilter(const LoadFilter &other);
+    LoadFilter &operator=(const LoadFilter &other);
+    ~LoadFilter();
+
+    bool isEmpty() const;
+
+    void setSheets(const QStringList &sheetNames);
+    QStringList sheets() const;
+    void setColumns(const QList<int> &columns);
+    QList<int> columns() const;
+    void setRange(const CellRange &range);
+    CellRange range() const;
+    void setOptions(Options options);
+    Options options() const;
+
+    bool acceptsSheet(const QString &sheetName) const;
+    bool acceptsRow(int row) const;
+    bool acceptsCell(int row, int column) const;
+
+private:
+    QSharedDataPointer<LoadFilterPrivate> d;
+};
+
+QT_END_NAMESPACE_XLSX
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(QXlsx::LoadFilter::Options)
+
+#endif // QXLSX_XLSXLOADFILTER_H
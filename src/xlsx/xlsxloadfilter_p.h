@@ -22,9 +22,8 @@
 ** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 **
 ****************************************************************************/
-
-#ifndef XLSXSHEETMODEL_P_H
-#define XLSXSHEETMODEL_P_H
+#ifndef XLSXLOADFILTER_P_H
+#define XLSXLOADFILTER_P_H
 
 //
 //  W A R N I N G
@@ -37,20 +36,24 @@
 // We mean it.
 //
 
-#include "xlsxsheetmodel.h"
+#include "xlsxloadfilter.h"
+#include "xlsxcellrange.h"
+#include <QSharedData>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE_XLSX
 
-class SheetModelPrivate
+class LoadFilterPrivate : public QSharedData
 {
-    Q_DECLARE_PUBLIC(SheetModel)
 public:
-    SheetModelPrivate(SheetModel *p);
+    LoadFilterPrivate();
 
-    Worksheet *sheet;
-    SheetModel *q_ptr;
+    QStringList sheets;
+    QVector<bool> columns; // indexed by column number, empty when all are loaded
+    CellRange range; // invalid when all the rows and columns are loaded
+    LoadFilter::Options options;
 };
 
 QT_END_NAMESPACE_XLSX
 
-#endif // XLSXSHEETMODEL_P_H
+#endif // XLSXLOADFILTER_P_H
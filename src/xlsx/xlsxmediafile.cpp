@@ -24,22 +24,38 @@
 ****************************************************************************/
 
 #include "xlsxmediafile_p.h"
-#include <QCryptographicHash>
+#include "xlsxzipreader_p.h"
+#include "xlsxutility_p.h"
+
+#include <QBuffer>
+#include <QtEndian>
 
 namespace QXlsx {
 
 MediaFile::MediaFile(const QByteArray &bytes, const QString &suffix, const QString &mimeType)
-    : m_contents(bytes)
+    : m_size(bytes.size())
+    , m_contents(bytes)
     , m_suffix(suffix)
     , m_mimeType(mimeType)
+    , m_imageKey(0)
     , m_index(0)
     , m_indexValid(false)
 {
-    m_hashKey = QCryptographicHash::hash(m_contents, QCryptographicHash::Md5);
+}
+
+MediaFile::MediaFile(const QImage &image)
+    : m_size(0)
+    , m_imageKey(0)
+    , m_index(0)
+    , m_indexValid(false)
+{
+    setImage(image);
 }
 
 MediaFile::MediaFile(const QString &fileName)
     : m_fileName(fileName)
+    , m_size(0)
+    , m_imageKey(0)
     , m_index(0)
     , m_indexValid(false)
 {
@@ -47,13 +63,102 @@ MediaFile::MediaFile(const QString &fileName)
 
 void MediaFile::set(const QByteArray &bytes, const QString &suffix, const QString &mimeType)
 {
+    QMutexLocker locker(&m_mutex);
+    m_package.reset();
+    m_size = bytes.size();
     m_contents = bytes;
+    m_image = QImage();
+    m_imageKey = 0;
     m_suffix = suffix;
     m_mimeType = mimeType;
-    m_hashKey = QCryptographicHash::hash(m_contents, QCryptographicHash::Md5);
+    m_hashKey.clear();
+    m_indexValid = false;
+}
+
+/*
+  Keep \a image, which is implicitly shared, and encode it to PNG only
+  when the contents are first needed. This can happen in another thread,
+  so that inserting many images doesn't block the caller.
+ */
+void MediaFile::setImage(const QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    m_package.reset();
+    m_size = 0;
+    m_contents.clear();
+    m_image = image;
+    m_imageKey = image.cacheKey();
+    m_suffix = QStringLiteral("png");
+    m_mimeType = QStringLiteral("image/png");
+    m_hashKey.clear();
+    m_indexValid = false;
+}
+
+/*
+  Returns false while the image given to setImage() hasn't been encoded.
+ */
+bool MediaFile::isEncoded() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_image.isNull();
+}
+
+/*
+  Returns the QImage::cacheKey() of the image given to setImage(), or 0.
+  Copies of the same image have the same key.
+ */
+qint64 MediaFile::imageKey() const
+{
+    return m_imageKey;
+}
+
+/*
+  Refer to the entry fileName() of \a package instead of loading it. The
+  contents are only read when contents() or hashKey() is called, and can
+  be copied as they are when the document is saved, see package().
+ */
+void MediaFile::setPackageEntry(const QSharedPointer<ZipReader> &package, const QString &suffix)
+{
+    const qint64 size = package->fileSize(m_fileName);
+    if (size < 0) {
+        // Not an entry which can be read on its own, load it now.
+        set(package->fileData(m_fileName), suffix);
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_size = size;
+    m_package = package;
+    m_contents.clear();
+    m_image = QImage();
+    m_imageKey = 0;
+    m_suffix = suffix;
+    m_mimeType.clear();
+    m_hashKey.clear();
     m_indexValid = false;
 }
 
+/*
+  Returns the package holding the contents, or a null pointer if they
+  have been loaded.
+ */
+QSharedPointer<ZipReader> MediaFile::package() const
+{
+    return m_package;
+}
+
+/*
+  Load the contents and stop referring to the package, which is needed
+  before the package file is overwritten.
+ */
+void MediaFile::detachPackage()
+{
+    if (!m_package)
+        return;
+    contents();
+    m_package.reset();
+}
+
 void MediaFile::setFileName(const QString &name)
 {
     m_fileName = name;
@@ -76,9 +181,41 @@ QString MediaFile::mimeType() const
 
 QByteArray MediaFile::contents() const
 {
+    QMutexLocker locker(&m_mutex);
+    loadContents();
     return m_contents;
 }
 
+/*
+  Returns the size of the contents, which encodes a pending image.
+ */
+qint64 MediaFile::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_image.isNull())
+        loadContents();
+    return m_size;
+}
+
+/*
+  Encode the pending image or read the package entry, m_mutex must be
+  locked.
+ */
+void MediaFile::loadContents() const
+{
+    if (!m_image.isNull()) {
+        QByteArray bytes;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        m_image.save(&buffer, "PNG");
+        m_contents = bytes;
+        m_size = bytes.size();
+        m_image = QImage();
+    } else if (m_package && m_contents.isNull()) {
+        m_contents = m_package->fileData(m_fileName);
+    }
+}
+
 int MediaFile::index() const
 {
     return m_index;
@@ -95,8 +232,21 @@ void MediaFile::setIndex(int idx)
     m_indexValid = true;
 }
 
+/*
+  Returns a key made of the size and a hash of the contents, computed on
+  first use. Files with different contents can share a key, so equal
+  keys only tell which contents are worth comparing.
+ */
 QByteArray MediaFile::hashKey() const
 {
+    QMutexLocker locker(&m_mutex);
+    if (m_hashKey.isEmpty()) {
+        loadContents();
+        m_hashKey.resize(16);
+        uchar *data = reinterpret_cast<uchar *>(m_hashKey.data());
+        qToLittleEndian<quint64>(contentHash(m_contents), data);
+        qToLittleEndian<quint64>(quint64(m_size), data + 8);
+    }
     return m_hashKey;
 }
 
@@ -41,19 +41,32 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QSharedPointer>
 
 namespace QXlsx {
 
+class ZipReader;
+
 class MediaFile
 {
 public:
     MediaFile(const QString &fileName);
     MediaFile(const QByteArray &bytes, const QString &suffix, const QString &mimeType = QString());
+    MediaFile(const QImage &image);
 
     void set(const QByteArray &bytes, const QString &suffix, const QString &mimeType = QString());
+    void setImage(const QImage &image);
+    bool isEncoded() const;
+    qint64 imageKey() const;
+    void setPackageEntry(const QSharedPointer<ZipReader> &package, const QString &suffix);
+    QSharedPointer<ZipReader> package() const;
+    void detachPackage();
     QString suffix() const;
     QString mimeType() const;
     QByteArray contents() const;
+    qint64 size() const;
 
     bool isIndexValid() const;
     int index() const;
@@ -64,14 +77,21 @@ public:
     QString fileName() const;
 
 private:
+    void loadContents() const;
+
     QString m_fileName; //...
-    QByteArray m_contents;
+    QSharedPointer<ZipReader> m_package; // holds the contents until they are needed
+    mutable qint64 m_size;
+    mutable QByteArray m_contents;
+    mutable QImage m_image; // encoded to PNG when the contents are needed
+    qint64 m_imageKey;
+    mutable QMutex m_mutex; // the image may be encoded by another thread
     QString m_suffix;
     QString m_mimeType;
 
     int m_index;
     bool m_indexValid;
-    QByteArray m_hashKey;
+    mutable QByteArray m_hashKey;
 };
 
 } // namespace QXlsx
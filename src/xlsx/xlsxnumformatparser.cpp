@@ -28,6 +28,18 @@
 
 namespace QXlsx {
 
+/*
+  Returns true if the built-in number format \a numFmtId shows a date
+  or a time.
+ */
+bool NumFormatParser::isBuiltinDateTime(int numFmtId)
+{
+    if ((numFmtId >= 14 && numFmtId <= 22) || (numFmtId >= 45 && numFmtId <= 47))
+        return true;
+    // Used in CHS\CHT\JPN\KOR
+    return (numFmtId >= 27 && numFmtId <= 36) || (numFmtId >= 50 && numFmtId <= 58);
+}
+
 bool NumFormatParser::isDateTime(const QString &formatCode)
 {
     for (int i = 0; i < formatCode.length(); ++i) {
@@ -44,6 +44,7 @@ class NumFormatParser
 {
 public:
     static bool isDateTime(const QString &formatCode);
+    static bool isBuiltinDateTime(int numFmtId);
 };
 
 } // namespace QXlsx
@@ -0,0 +1,1056 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxnumformatter_p.h"
+#include "xlsxnumformatparser_p.h"
+
+#include <QByteArray>
+#include <QDate>
+#include <QVarLengthArray>
+
+#include <cmath>
+
+namespace QXlsx {
+
+namespace {
+
+enum NumberPart {
+    IntegerPart,
+    DecimalPart,
+    ExponentPart,
+    DenominatorPart
+};
+
+struct NamedColor
+{
+    const char *name;
+    QRgb rgb;
+};
+
+// In the order of [Color1] to [Color8]
+const NamedColor namedColors[] = {
+    {"black", 0xFF000000}, {"white", 0xFFFFFFFF}, {"red", 0xFFFF0000},
+    {"green", 0xFF00FF00}, {"blue", 0xFF0000FF}, {"yellow", 0xFFFFFF00},
+    {"magenta", 0xFFFF00FF}, {"cyan", 0xFF00FFFF},
+};
+
+const char *const monthNames[] = {"January", "February", "March", "April", "May", "June", "July",
+                                  "August", "September", "October", "November", "December"};
+
+const char *const dayNames[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday",
+                                "Saturday"};
+
+// The first day Excel can't show, 10000-01-01
+const double MaxDateSerial = 2958466;
+
+bool isPlaceholder(QChar c)
+{
+    return c == QLatin1Char('0') || c == QLatin1Char('#') || c == QLatin1Char('?');
+}
+
+qint64 powerOfTen(int exponent)
+{
+    qint64 power = 1;
+    while (exponent-- > 0)
+        power *= 10;
+    return power;
+}
+
+/*
+  Append \a number to \a out, padded with zeros to \a width digits.
+ */
+void appendNumber(QString &out, qint64 number, int width = 1)
+{
+    char digits[24];
+    int pos = sizeof(digits);
+    do {
+        digits[--pos] = char('0' + number % 10);
+        number /= 10;
+    } while (number);
+    for (int size = sizeof(digits) - pos; size < width; ++size)
+        out += QLatin1Char('0');
+    out += QLatin1String(digits + pos, int(sizeof(digits)) - pos);
+}
+
+/*
+  Write the digits of \a x >= 0 rounded to \a decimals decimals to \a
+  digits, the integer ones followed by the decimal ones, and return the
+  number of integer digits. The integer part is at least "0".
+ */
+int fixedDigits(double x, int decimals, QVarLengthArray<char, 64> &digits)
+{
+    digits.clear();
+    if (decimals <= 15) {
+        const double scaled = x * double(powerOfTen(decimals));
+        if (scaled < 9e15) {
+            // Excel rounds the 15 digits it keeps, 2.675 shows as 2.68
+            quint64 number = quint64(std::floor(scaled * (1 + 1e-15) + 0.5));
+            char buffer[24];
+            int pos = sizeof(buffer);
+            do {
+                buffer[--pos] = char('0' + number % 10);
+                number /= 10;
+            } while (number);
+            while (int(sizeof(buffer)) - pos <= decimals)
+                buffer[--pos] = '0';
+            const int size = sizeof(buffer) - pos;
+            digits.append(buffer + pos, size);
+            return size - decimals;
+        }
+    }
+
+    const QByteArray number = QByteArray::number(x, 'f', decimals);
+    int point = number.indexOf('.');
+    if (point == -1)
+        point = number.size();
+    digits.append(number.constData(), point);
+    if (point < number.size())
+        digits.append(number.constData() + point + 1, number.size() - point - 1);
+    return point;
+}
+
+QString overflowText()
+{
+    return QStringLiteral("########");
+}
+
+} // namespace
+
+NumFormatter::Section::Section()
+    : condition(NoCondition)
+    , conditionValue(0)
+    , dateTime(false)
+    , text(false)
+    , grouping(false)
+    , exponentSign(false)
+    , hour12(false)
+    , scale(0)
+    , denominator(0)
+    , secondDecimals(0)
+{
+}
+
+/*
+  Compile the sections of \a formatCode, split on the semicolons which
+  aren't quoted or escaped. An empty code is the General format.
+ */
+NumFormatter::NumFormatter(const QString &formatCode)
+    : m_formatCode(formatCode)
+    , m_textSection(-1)
+{
+    const QString code = formatCode.isEmpty() ? QStringLiteral("General") : formatCode;
+    bool quoted = false;
+    int start = 0;
+    for (int i = 0; i <= code.size(); ++i) {
+        if (i == code.size() || (!quoted && code.at(i) == QLatin1Char(';'))) {
+            m_sections.append(compileSection(code.mid(start, i - start)));
+            start = i + 1;
+        } else if (code.at(i) == QLatin1Char('"')) {
+            quoted = !quoted;
+        } else if (!quoted && code.at(i) == QLatin1Char('\\')) {
+            ++i;
+        }
+    }
+
+    for (int i = 0; i < m_sections.size(); ++i) {
+        if (m_sections[i].text) {
+            m_textSection = i;
+            break;
+        }
+    }
+    if (m_textSection == -1 && m_sections.size() > 3)
+        m_textSection = 3;
+}
+
+/*
+  Returns true if the numbers are shown as dates or times by the first
+  section, the way NumFormatParser::isDateTime() classifies the codes.
+ */
+bool NumFormatter::isDateTime() const
+{
+    for (int i = 0; i < m_sections.size(); ++i) {
+        if (i != m_textSection)
+            return m_sections[i].dateTime;
+    }
+    return false;
+}
+
+/*
+  Returns the text of \a value, in the section chosen by the sign of the
+  value or by the conditions. The color of the section, which is invalid
+  if it has none, is written to \a color. The dates are counted from 1904
+  when \a date1904 is true.
+ */
+QString NumFormatter::format(double value, bool date1904, QColor *color) const
+{
+    QString out;
+    if (color)
+        *color = QColor();
+
+    bool absolute = false;
+    bool found = false;
+    const Section *section = numberSection(value, &absolute, &found);
+    if (!found)
+        return overflowText();
+    if (!section) {
+        // Only a text section, the numbers are shown as General
+        if (value < 0)
+            out += QLatin1Char('-');
+        renderGeneral(std::fabs(value), out);
+        return out;
+    }
+
+    if (section->dateTime) {
+        if (!renderDateTime(*section, value, date1904, out))
+            return overflowText();
+    } else {
+        if (value < 0 && !absolute)
+            out += QLatin1Char('-');
+        if (section->numeratorDigits.isEmpty())
+            renderNumber(*section, std::fabs(value), out);
+        else
+            renderFraction(*section, std::fabs(value), out);
+    }
+    if (color)
+        *color = section->color;
+    return out;
+}
+
+/*
+  Returns \a text as the text section shows it, or unchanged if the code
+  has no text section.
+ */
+QString NumFormatter::formatText(const QString &text, QColor *color) const
+{
+    if (color)
+        *color = QColor();
+    if (m_textSection == -1)
+        return text;
+
+    const Section &section = m_sections[m_textSection];
+    QString out;
+    foreach (const Op &op, section.ops) {
+        if (op.type == Literal)
+            out += op.text;
+        else if (op.type == Text)
+            out += text;
+    }
+    if (color)
+        *color = section.color;
+    return out;
+}
+
+NumFormatter::Section NumFormatter::compileSection(const QString &code)
+{
+    Section section;
+    section.dateTime = NumFormatParser::isDateTime(code);
+
+    int part = IntegerPart;
+    int i = 0;
+    while (i < code.size()) {
+        const QChar c = code.at(i);
+        if (c == QLatin1Char('"')) {
+            int end = code.indexOf(QLatin1Char('"'), i + 1);
+            if (end == -1)
+                end = code.size();
+            addLiteral(section, code.mid(i + 1, end - i - 1));
+            i = end + 1;
+        } else if (c == QLatin1Char('\\')) {
+            addLiteral(section, code.mid(i + 1, 1));
+            i += 2;
+        } else if (c == QLatin1Char('_')) {
+            // Leaves the room of the next character
+            addLiteral(section, QStringLiteral(" "));
+            i += 2;
+        } else if (c == QLatin1Char('*')) {
+            // Repeats the next character to fill the cell
+            i += 2;
+        } else if (c == QLatin1Char('[')) {
+            int end = code.indexOf(QLatin1Char(']'), i + 1);
+            if (end == -1)
+                end = code.size();
+            compileBracket(code.mid(i + 1, end - i - 1), section);
+            i = end + 1;
+        } else if (c == QLatin1Char('@')) {
+            section.text = true;
+            const Op op = {Text, 0, QString()};
+            section.ops.append(op);
+            ++i;
+        } else if (code.midRef(i, 7).compare(QLatin1String("General"), Qt::CaseInsensitive)
+                   == 0) {
+            const Op op = {General, 0, QString()};
+            section.ops.append(op);
+            i += 7;
+        } else if (section.dateTime) {
+            addDateOp(section, code, &i);
+        } else {
+            addNumberOp(section, code, &i, &part);
+        }
+    }
+
+    if (section.dateTime) {
+        resolveMinutes(section);
+        return section;
+    }
+
+    // ".00" shows the integer digits before the point all the same
+    if (section.integerDigits.isEmpty()) {
+        for (int j = 0; j < section.ops.size(); ++j) {
+            const OpType type = section.ops[j].type;
+            if (type == DecimalPoint || type == DecimalDigits || type == Exponent) {
+                const Op op = {IntegerDigit, 0, QString()};
+                section.ops.insert(j, op);
+                section.integerDigits = "#";
+                break;
+            }
+        }
+    }
+    return section;
+}
+
+/*
+  Compile the bracketed \a content, a color, a condition, a currency or
+  an elapsed time.
+ */
+void NumFormatter::compileBracket(const QString &content, Section &section)
+{
+    if (content.isEmpty())
+        return;
+
+    const QString name = content.toLower();
+    const QChar first = name.at(0);
+    if (section.dateTime && (first == QLatin1Char('h') || first == QLatin1Char('m')
+                             || first == QLatin1Char('s'))
+        && name.count(first) == name.size()) {
+        const OpType type = first == QLatin1Char('h')
+                                ? ElapsedHours
+                                : (first == QLatin1Char('m') ? ElapsedMinutes : ElapsedSeconds);
+        const Op op = {type, name.size(), QString()};
+        section.ops.append(op);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(namedColors) / sizeof(NamedColor); ++i) {
+        if (name == QLatin1String(namedColors[i].name)) {
+            section.color = QColor::fromRgb(namedColors[i].rgb);
+            return;
+        }
+    }
+    if (name.startsWith(QLatin1String("color"))) {
+        // The other colors of the palette aren't resolved
+        const int index = name.mid(5).toInt();
+        if (index >= 1 && index <= int(sizeof(namedColors) / sizeof(NamedColor)))
+            section.color = QColor::fromRgb(namedColors[index - 1].rgb);
+        return;
+    }
+
+    if (first == QLatin1Char('$')) {
+        // [$€-407] is the currency symbol followed by the locale
+        const int dash = content.indexOf(QLatin1Char('-'));
+        addLiteral(section, content.mid(1, dash == -1 ? -1 : dash - 1));
+        return;
+    }
+
+    int size = 0;
+    if (content.startsWith(QLatin1String("<="))) {
+        section.condition = LessOrEqual;
+        size = 2;
+    } else if (content.startsWith(QLatin1String(">="))) {
+        section.condition = GreaterOrEqual;
+        size = 2;
+    } else if (content.startsWith(QLatin1String("<>"))) {
+        section.condition = NotEqual;
+        size = 2;
+    } else if (first == QLatin1Char('<')) {
+        section.condition = Less;
+        size = 1;
+    } else if (first == QLatin1Char('>')) {
+        section.condition = Greater;
+        size = 1;
+    } else if (first == QLatin1Char('=')) {
+        section.condition = Equal;
+        size = 1;
+    }
+    if (size)
+        section.conditionValue = content.mid(size).trimmed().toDouble();
+}
+
+void NumFormatter::addLiteral(Section &section, const QString &text)
+{
+    if (text.isEmpty())
+        return;
+    if (!section.ops.isEmpty() && section.ops.last().type == Literal) {
+        section.ops.last().text += text;
+    } else {
+        const Op op = {Literal, 0, text};
+        section.ops.append(op);
+    }
+}
+
+/*
+  Compile the character at \a pos of the number section \a code, \a part
+  being the part of the number its placeholders go to.
+ */
+void NumFormatter::addNumberOp(Section &section, const QString &code, int *pos, int *part)
+{
+    const int i = *pos;
+    const QChar c = code.at(i);
+    *pos = i + 1;
+
+    if (isPlaceholder(c)) {
+        const char placeholder = c.toLatin1();
+        switch (*part) {
+        case IntegerPart: {
+            const Op op = {IntegerDigit, section.integerDigits.size(), QString()};
+            section.ops.append(op);
+            section.integerDigits += placeholder;
+            break;
+        }
+        case DecimalPart:
+            if (section.decimalDigits.isEmpty()) {
+                const Op op = {DecimalDigits, 0, QString()};
+                section.ops.append(op);
+            }
+            section.decimalDigits += placeholder;
+            break;
+        case ExponentPart:
+            section.exponentDigits += placeholder;
+            break;
+        default:
+            if (section.denominator)
+                addLiteral(section, QString(c));
+            else
+                section.denominatorDigits += placeholder;
+            break;
+        }
+        return;
+    }
+
+    const bool hasDigits = !section.integerDigits.isEmpty() || !section.decimalDigits.isEmpty()
+                           || !section.numeratorDigits.isEmpty();
+    switch (c.unicode()) {
+    case '.':
+        if (*part == IntegerPart) {
+            const Op op = {DecimalPoint, 0, QString()};
+            section.ops.append(op);
+            *part = DecimalPart;
+            return;
+        }
+        break;
+    case ',': {
+        int end = i;
+        while (end < code.size() && code.at(end) == QLatin1Char(','))
+            ++end;
+        *pos = end;
+        const bool digitNext = end < code.size() && isPlaceholder(code.at(end));
+        if (digitNext && *part == IntegerPart && !section.integerDigits.isEmpty()) {
+            section.grouping = true;
+        } else if (!digitNext && hasDigits) {
+            // Each trailing comma divides the number by 1000
+            section.scale -= 3 * (end - i);
+        } else if (!hasDigits) {
+            addLiteral(section, code.mid(i, end - i));
+        }
+        return;
+    }
+    case '%':
+        section.scale += 2;
+        break;
+    case 'E':
+    case 'e':
+        if (i + 1 < code.size() && (code.at(i + 1) == QLatin1Char('+')
+                                    || code.at(i + 1) == QLatin1Char('-'))
+            && (*part == IntegerPart || *part == DecimalPart)) {
+            const Op op = {Exponent, 0, QString()};
+            section.ops.append(op);
+            section.exponentSign = code.at(i + 1) == QLatin1Char('+');
+            *part = ExponentPart;
+            *pos = i + 2;
+            return;
+        }
+        break;
+    case '/': {
+        // The placeholders right before the slash make the numerator
+        int first = section.ops.size();
+        while (first > 0 && section.ops[first - 1].type == IntegerDigit)
+            --first;
+        const int count = section.ops.size() - first;
+        if (*part != IntegerPart || count == 0)
+            break;
+        section.numeratorDigits = section.integerDigits.right(count);
+        section.integerDigits.chop(count);
+        section.ops.resize(first);
+        const Op numerator = {Numerator, 0, QString()};
+        const Op slash = {FractionSlash, 0, QString()};
+        const Op denominator = {Denominator, 0, QString()};
+        section.ops << numerator << slash << denominator;
+        *part = DenominatorPart;
+
+        // A denominator such as "# ?/8" is fixed
+        int end = i + 1;
+        while (end < code.size() && code.at(end).isDigit())
+            ++end;
+        if (end > i + 1 && code.at(i + 1) != QLatin1Char('0')) {
+            section.denominator = code.mid(i + 1, end - i - 1).toInt();
+            *pos = end;
+        }
+        return;
+    }
+    default:
+        break;
+    }
+    addLiteral(section, QString(c));
+}
+
+/*
+  Compile the date or time part at \a pos of the date section \a code.
+ */
+void NumFormatter::addDateOp(Section &section, const QString &code, int *pos)
+{
+    const int i = *pos;
+    const QChar c = code.at(i).toLower();
+    int count = 1;
+    const ushort letter = c.unicode();
+    if (letter == 'y' || letter == 'm' || letter == 'd' || letter == 'h' || letter == 's') {
+        while (i + count < code.size() && code.at(i + count).toLower() == c)
+            ++count;
+    }
+
+    OpType type = Literal;
+    QString text;
+    switch (letter) {
+    case 'y':
+        type = Year;
+        break;
+    case 'm':
+        type = count > 2 ? MonthName : Month;
+        break;
+    case 'd':
+        type = count > 2 ? DayName : Day;
+        break;
+    case 'h':
+        type = Hour;
+        break;
+    case 's':
+        type = Second;
+        break;
+    case 'a':
+        if (code.midRef(i, 5).compare(QLatin1String("am/pm"), Qt::CaseInsensitive) == 0) {
+            type = AmPm;
+            text = QStringLiteral("AM/PM");
+            count = 5;
+        } else if (code.midRef(i, 3).compare(QLatin1String("a/p"), Qt::CaseInsensitive) == 0) {
+            type = AmPm;
+            text = code.mid(i, 3);
+            count = 3;
+        }
+        if (type == AmPm)
+            section.hour12 = true;
+        break;
+    case '.':
+        while (i + count < code.size() && code.at(i + count) == QLatin1Char('0'))
+            ++count;
+        if (count > 1) {
+            type = SecondFraction;
+            section.secondDecimals = qMax(section.secondDecimals, qMin(count - 1, 3));
+        }
+        break;
+    default:
+        break;
+    }
+
+    *pos = i + count;
+    if (type == Literal) {
+        addLiteral(section, code.mid(i, count));
+    } else {
+        const Op op = {type, type == SecondFraction ? qMin(count - 1, 3) : count, text};
+        section.ops.append(op);
+    }
+}
+
+/*
+  Turn the months which follow the hours, or come before the seconds,
+  into minutes.
+ */
+void NumFormatter::resolveMinutes(Section &section)
+{
+    for (int i = 0; i < section.ops.size(); ++i) {
+        if (section.ops[i].type != Month)
+            continue;
+        int previous = i - 1;
+        while (previous >= 0 && section.ops[previous].type == Literal)
+            --previous;
+        int next = i + 1;
+        while (next < section.ops.size() && section.ops[next].type == Literal)
+            ++next;
+        const OpType before = previous >= 0 ? section.ops[previous].type : Literal;
+        const OpType after = next < section.ops.size() ? section.ops[next].type : Literal;
+        if (before == Hour || before == ElapsedHours || after == Second
+            || after == ElapsedSeconds)
+            section.ops[i].type = Minute;
+    }
+}
+
+/*
+  Returns the section \a value is shown by, or 0 if there are only a text
+  section. \a absolute is set when the section shows the value without
+  its sign, and \a found is cleared when none of the conditions match.
+ */
+const NumFormatter::Section *NumFormatter::numberSection(double value, bool *absolute,
+                                                        bool *found) const
+{
+    const Section *sections[3];
+    int count = 0;
+    bool conditional = false;
+    for (int i = 0; i < m_sections.size() && count < 3; ++i) {
+        if (i == m_textSection)
+            continue;
+        sections[count++] = &m_sections[i];
+        conditional = conditional || m_sections[i].condition != NoCondition;
+    }
+
+    *absolute = false;
+    *found = true;
+    if (count == 0)
+        return 0;
+
+    if (!conditional) {
+        if (value < 0 && count >= 2) {
+            *absolute = true;
+            return sections[1];
+        }
+        if (value == 0 && count >= 3)
+            return sections[2];
+        return sections[0];
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const Section *section = sections[i];
+        if (section->condition == NoCondition)
+            return section;
+        if (matches(*section, value)) {
+            // The sign goes when only negative numbers can match
+            *absolute = (section->condition == Less || section->condition == LessOrEqual)
+                        && section->conditionValue <= 0;
+            return section;
+        }
+    }
+    *found = false;
+    return 0;
+}
+
+bool NumFormatter::matches(const Section &section, double value)
+{
+    switch (section.condition) {
+    case Less:
+        return value < section.conditionValue;
+    case LessOrEqual:
+        return value <= section.conditionValue;
+    case Greater:
+        return value > section.conditionValue;
+    case GreaterOrEqual:
+        return value >= section.conditionValue;
+    case Equal:
+        return value == section.conditionValue;
+    case NotEqual:
+        return value != section.conditionValue;
+    default:
+        return true;
+    }
+}
+
+/*
+  Append \a value >= 0 in the General format: up to 10 decimals, fewer
+  as the integer part grows, and the scientific notation for the numbers
+  that are too large or too small.
+ */
+void NumFormatter::renderGeneral(double value, QString &out)
+{
+    if (value == 0) {
+        out += QLatin1Char('0');
+        return;
+    }
+
+    if (value >= 1e11 || value < 1e-4) {
+        const QByteArray number = QByteArray::number(value, 'E', 5);
+        const int exponent = number.indexOf('E');
+        int end = exponent;
+        while (number.at(end - 1) == '0')
+            --end;
+        if (number.at(end - 1) == '.')
+            --end;
+        out += QLatin1String(number.constData(), end);
+        out += QLatin1String(number.constData() + exponent, number.size() - exponent);
+        return;
+    }
+
+    const int integerSize = value >= 1 ? int(std::floor(std::log10(value))) + 1 : 1;
+    const int decimals = qMax(0, 10 - integerSize);
+    QVarLengthArray<char, 64> digits;
+    const int integerDigits = fixedDigits(value, decimals, digits);
+    int end = digits.size();
+    while (end > integerDigits && digits[end - 1] == '0')
+        --end;
+    out += QLatin1String(digits.constData(), integerDigits);
+    if (end > integerDigits) {
+        out += QLatin1Char('.');
+        out += QLatin1String(digits.constData() + integerDigits, end - integerDigits);
+    }
+}
+
+/*
+  Append the integer placeholder \a index of \a section, \a digits being
+  the \a size digits of the integer part. The first placeholder shows the
+  digits there are no placeholders for.
+ */
+void NumFormatter::renderIntegerDigit(const Section &section, int index, const char *digits,
+                                      int size, QString &out)
+{
+    // Positions are counted from the units
+    const int position = section.integerDigits.size() - 1 - index;
+    const int first = index == 0 ? qMax(size - 1, position) : position;
+    for (int p = first; p >= position; --p) {
+        QChar digit;
+        if (p < size) {
+            digit = QLatin1Char(digits[size - 1 - p]);
+        } else {
+            const char placeholder = section.integerDigits.at(index);
+            if (placeholder == '#')
+                continue;
+            digit = QLatin1Char(placeholder == '0' ? '0' : ' ');
+        }
+        out += digit;
+        if (section.grouping && p > 0 && p % 3 == 0)
+            out += digit == QLatin1Char(' ') ? QLatin1Char(' ') : QLatin1Char(',');
+    }
+}
+
+void NumFormatter::renderNumber(const Section &section, double value, QString &out)
+{
+    double x = value;
+    if (section.scale)
+        x *= std::pow(10.0, section.scale);
+
+    const int decimals = section.decimalDigits.size();
+    QVarLengthArray<char, 64> digits;
+    int integerSize;
+    int exponent = 0;
+    if (section.exponentDigits.isEmpty() || x == 0) {
+        integerSize = fixedDigits(x, decimals, digits);
+    } else {
+        // Engineering notation when the integer part has '#' placeholders
+        const int count = section.integerDigits.size();
+        const bool engineering = count > 1 && section.integerDigits.contains('#');
+        exponent = int(std::floor(std::log10(x)));
+        if (engineering)
+            exponent = int(std::floor(double(exponent) / count)) * count;
+        else
+            exponent -= count - 1;
+        integerSize = fixedDigits(x / std::pow(10.0, exponent), decimals, digits);
+        if (integerSize > count) {
+            // Rounded up to another digit
+            exponent += engineering ? count : 1;
+            integerSize = fixedDigits(x / std::pow(10.0, exponent), decimals, digits);
+        }
+    }
+
+    // A zero integer part has no digits of its own
+    const int integerDigits = integerSize == 1 && digits[0] == '0' ? 0 : integerSize;
+    const char *integerStart = digits.constData() + integerSize - integerDigits;
+    const char *decimalStart = digits.constData() + integerSize;
+
+    foreach (const Op &op, section.ops) {
+        switch (op.type) {
+        case Literal:
+            out += op.text;
+            break;
+        case General:
+            renderGeneral(value, out);
+            break;
+        case IntegerDigit:
+            renderIntegerDigit(section, op.count, integerStart, integerDigits, out);
+            break;
+        case DecimalPoint:
+            out += QLatin1Char('.');
+            break;
+        case DecimalDigits: {
+            int last = decimals - 1;
+            while (last >= 0 && decimalStart[last] == '0' && section.decimalDigits.at(last) != '0')
+                --last;
+            for (int i = 0; i < decimals; ++i) {
+                if (i <= last)
+                    out += QLatin1Char(decimalStart[i]);
+                else if (section.decimalDigits.at(i) == '?')
+                    out += QLatin1Char(' ');
+            }
+            break;
+        }
+        case Exponent:
+            out += QLatin1Char('E');
+            if (exponent < 0)
+                out += QLatin1Char('-');
+            else if (section.exponentSign)
+                out += QLatin1Char('+');
+            appendNumber(out, qAbs(exponent), section.exponentDigits.count('0'));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+  Append \a value >= 0 as a whole number and a fraction, or as a fraction
+  only when the section has no integer placeholders. The denominators
+  are either fixed or as large as their placeholders allow.
+ */
+void NumFormatter::renderFraction(const Section &section, double value, QString &out)
+{
+    double x = value;
+    if (section.scale)
+        x *= std::pow(10.0, section.scale);
+    const bool whole = !section.integerDigits.isEmpty();
+    if (x >= 1e15) {
+        renderGeneral(x, out);
+        return;
+    }
+
+    double integer = whole ? std::floor(x) : 0;
+    const double fraction = x - integer;
+    qint64 numerator;
+    qint64 denominator;
+    if (section.denominator) {
+        denominator = section.denominator;
+        numerator = qint64(std::floor(fraction * denominator + 0.5));
+    } else {
+        // The best approximation from the continued fraction
+        const qint64 maxDenominator =
+            powerOfTen(qMin(int(section.denominatorDigits.size()), 9)) - 1;
+        qint64 p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+        double rest = fraction;
+        for (int i = 0; i < 64; ++i) {
+            const qint64 a = qint64(std::floor(rest));
+            const qint64 p2 = a * p1 + p0;
+            const qint64 q2 = a * q1 + q0;
+            if (q2 > qMax(maxDenominator, qint64(1))) {
+                const qint64 k = (maxDenominator - q0) / q1;
+                const qint64 p = p0 + k * p1;
+                const qint64 q = q0 + k * q1;
+                if (std::fabs(double(p) / q - fraction) < std::fabs(double(p1) / q1 - fraction)) {
+                    p1 = p;
+                    q1 = q;
+                }
+                break;
+            }
+            p0 = p1;
+            q0 = q1;
+            p1 = p2;
+            q1 = q2;
+            const double remainder = rest - a;
+            if (remainder < 1e-12)
+                break;
+            rest = 1 / remainder;
+        }
+        numerator = p1;
+        denominator = q1;
+    }
+    if (whole && numerator == denominator) {
+        integer += 1;
+        numerator = 0;
+    }
+
+    // The fraction is left blank for whole numbers
+    const bool blank = whole && numerator == 0;
+    QVarLengthArray<char, 64> digits;
+    int integerDigits = fixedDigits(integer, 0, digits);
+    if (integerDigits == 1 && digits[0] == '0' && !blank)
+        integerDigits = 0;
+
+    foreach (const Op &op, section.ops) {
+        switch (op.type) {
+        case Literal:
+            out += op.text;
+            break;
+        case General:
+            renderGeneral(value, out);
+            break;
+        case IntegerDigit:
+            if (integerDigits == 1 && digits[0] == '0') {
+                // "0" for a zero, whatever the placeholder
+                if (op.count == section.integerDigits.size() - 1)
+                    out += QLatin1Char('0');
+            } else {
+                renderIntegerDigit(section, op.count, digits.constData(), integerDigits, out);
+            }
+            break;
+        case Numerator: {
+            const int size = section.numeratorDigits.size();
+            if (blank) {
+                out += QString(size, QLatin1Char(' '));
+                break;
+            }
+            QString number;
+            appendNumber(number, numerator);
+            for (int i = 0; i < size - number.size(); ++i) {
+                const char placeholder = section.numeratorDigits.at(i);
+                if (placeholder != '#')
+                    out += QLatin1Char(placeholder == '0' ? '0' : ' ');
+            }
+            out += number;
+            break;
+        }
+        case FractionSlash:
+            out += blank ? QLatin1Char(' ') : QLatin1Char('/');
+            break;
+        case Denominator: {
+            QString number;
+            appendNumber(number, denominator);
+            if (section.denominator) {
+                out += blank ? QString(number.size(), QLatin1Char(' ')) : number;
+                break;
+            }
+            const int size = section.denominatorDigits.size();
+            if (blank) {
+                out += QString(size, QLatin1Char(' '));
+                break;
+            }
+            out += number;
+            for (int i = number.size(); i < size; ++i) {
+                if (section.denominatorDigits.at(i) == '?')
+                    out += QLatin1Char(' ');
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/*
+  Append \a value as a date or a time, rounded to the precision of the
+  seconds shown. Returns false for the values which aren't dates.
+ */
+bool NumFormatter::renderDateTime(const Section &section, double value, bool date1904,
+                                  QString &out)
+{
+    if (value < 0 || value >= MaxDateSerial)
+        return false;
+
+    const qint64 unit = powerOfTen(section.secondDecimals);
+    const qint64 unitsPerDay = 86400 * unit;
+    const qint64 total = qint64(std::floor(value * unitsPerDay * (1 + 1e-15) + 0.5));
+    const int days = int(total / unitsPerDay);
+    const qint64 totalSeconds = total / unit;
+    const int seconds = int(totalSeconds % 86400);
+    const int fraction = int(total % unit);
+    const int hour = seconds / 3600;
+
+    // Excel counts 1900-02-29, and day 0 is 1900-01-00
+    int year = 1900, month = 1, day = 0;
+    if (date1904) {
+        QDate(1904, 1, 1).addDays(days).getDate(&year, &month, &day);
+    } else if (days == 60) {
+        month = 2;
+        day = 29;
+    } else if (days > 0) {
+        QDate(1899, 12, days < 60 ? 31 : 30).addDays(days).getDate(&year, &month, &day);
+    }
+    const int weekDay = (days + (date1904 ? 5 : 6)) % 7;
+
+    foreach (const Op &op, section.ops) {
+        switch (op.type) {
+        case Literal:
+            out += op.text;
+            break;
+        case General:
+            renderGeneral(value, out);
+            break;
+        case Year:
+            if (op.count <= 2)
+                appendNumber(out, year % 100, 2);
+            else
+                appendNumber(out, year, 4);
+            break;
+        case Month:
+            appendNumber(out, month, op.count);
+            break;
+        case MonthName: {
+            const QLatin1String name(monthNames[month - 1]);
+            if (op.count == 3)
+                out += QLatin1String(name.data(), 3);
+            else if (op.count == 5)
+                out += QLatin1Char(name.data()[0]);
+            else
+                out += name;
+            break;
+        }
+        case Day:
+            appendNumber(out, day, op.count);
+            break;
+        case DayName: {
+            const QLatin1String name(dayNames[weekDay]);
+            out += op.count == 3 ? QLatin1String(name.data(), 3) : name;
+            break;
+        }
+        case Hour:
+            if (section.hour12)
+                appendNumber(out, hour % 12 == 0 ? 12 : hour % 12, qMin(op.count, 2));
+            else
+                appendNumber(out, hour, qMin(op.count, 2));
+            break;
+        case Minute:
+            appendNumber(out, seconds / 60 % 60, qMin(op.count, 2));
+            break;
+        case Second:
+            appendNumber(out, seconds % 60, qMin(op.count, 2));
+            break;
+        case SecondFraction:
+            out += QLatin1Char('.');
+            appendNumber(out, fraction / powerOfTen(section.secondDecimals - op.count),
+                         op.count);
+            break;
+        case ElapsedHours:
+            appendNumber(out, totalSeconds / 3600, op.count);
+            break;
+        case ElapsedMinutes:
+            appendNumber(out, totalSeconds / 60, op.count);
+            break;
+        case ElapsedSeconds:
+            appendNumber(out, totalSeconds, op.count);
+            break;
+        case AmPm:
+            if (op.text.size() == 5)
+                out += hour < 12 ? QLatin1String("AM") : QLatin1String("PM");
+            else
+                out += op.text.at(hour < 12 ? 0 : 2);
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+} // namespace QXlsx
@@ -0,0 +1,161 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_NUMFORMATTER_H
+#define QXLSX_NUMFORMATTER_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QColor>
+#include <QString>
+#include <QVector>
+
+namespace QXlsx {
+
+/*
+  A number format code compiled into the programs of its sections, which
+  render the values the way Excel shows them in the cells. The code is
+  parsed once: the digit placeholders, the separators, the date and time
+  parts and the literals become a list of operations, and the colors,
+  the conditions and the layout of the digits are worked out for each
+  section.
+
+  Only the English names of the months and days are known, and the
+  locale and calendar prefixes such as [$-409] are skipped.
+ */
+class XLSX_AUTOTEST_EXPORT NumFormatter
+{
+public:
+    explicit NumFormatter(const QString &formatCode);
+
+    QString formatCode() const { return m_formatCode; }
+    bool isDateTime() const;
+
+    QString format(double value, bool date1904 = false, QColor *color = 0) const;
+    QString formatText(const QString &text, QColor *color = 0) const;
+
+private:
+    enum OpType {
+        Literal,
+        General,
+        Text,
+        IntegerDigit, // the placeholder at index count of the integer part
+        DecimalPoint,
+        DecimalDigits,
+        Exponent,
+        Numerator,
+        FractionSlash,
+        Denominator,
+        Year,
+        Month,
+        MonthName,
+        Day,
+        DayName,
+        Hour,
+        Minute,
+        Second,
+        SecondFraction,
+        ElapsedHours,
+        ElapsedMinutes,
+        ElapsedSeconds,
+        AmPm
+    };
+
+    enum Condition {
+        NoCondition,
+        Less,
+        LessOrEqual,
+        Greater,
+        GreaterOrEqual,
+        Equal,
+        NotEqual
+    };
+
+    struct Op
+    {
+        OpType type;
+        int count; // the number of letters of a date part, or an index of a placeholder
+        QString text;
+    };
+
+    struct Section
+    {
+        Section();
+
+        QVector<Op> ops;
+        QColor color;
+        Condition condition;
+        double conditionValue;
+        bool dateTime;
+        bool text;
+        bool grouping;
+        bool exponentSign; // "E+" rather than "E-"
+        bool hour12;
+        int scale; // power of ten the value is multiplied by, for '%' and trailing ','
+        int denominator; // written in the code, 0 for placeholders
+        int secondDecimals;
+        QByteArray integerDigits; // the '0', '#' and '?' placeholders
+        QByteArray decimalDigits;
+        QByteArray exponentDigits;
+        QByteArray numeratorDigits;
+        QByteArray denominatorDigits;
+    };
+
+    static Section compileSection(const QString &code);
+    static void compileBracket(const QString &content, Section &section);
+    static void addLiteral(Section &section, const QString &text);
+    static void addNumberOp(Section &section, const QString &code, int *pos, int *part);
+    static void addDateOp(Section &section, const QString &code, int *pos);
+    static void resolveMinutes(Section &section);
+
+    const Section *numberSection(double value, bool *absolute, bool *found) const;
+    static bool matches(const Section &section, double value);
+    static void renderGeneral(double value, QString &out);
+    static void renderIntegerDigit(const Section &section, int index, const char *digits,
+                                   int size, QString &out);
+    static void renderNumber(const Section &section, double value, QString &out);
+    static void renderFraction(const Section &section, double value, QString &out);
+    static bool renderDateTime(const Section &section, double value, bool date1904,
+                               QString &out);
+
+    QString m_formatCode;
+    QVector<Section> m_sections;
+    int m_textSection; // -1 when the text is shown as it is
+};
+
+} // namespace QXlsx
+
+#endif // QXLSX_NUMFORMATTER_H
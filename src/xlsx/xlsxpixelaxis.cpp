@@ -0,0 +1,135 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxpixelaxis_p.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+PixelAxis::PixelAxis(int defaultSize)
+    : m_defaultSize(defaultSize)
+{
+}
+
+/*
+  Gives the \a size to the indexes [\a first, \a last]. The runs must be
+  added in increasing order, without overlapping.
+ */
+void PixelAxis::addRun(int first, int last, int size)
+{
+    Q_ASSERT(first <= last && (m_runs.isEmpty() || m_runs.last().last < first));
+    Run run;
+    run.first = first;
+    run.last = last;
+    run.size = size;
+    run.offset = offset(first);
+    m_runs.append(run);
+}
+
+/*
+  Returns the position of the last run starting at or before \a index,
+  or -1.
+ */
+int PixelAxis::runBefore(int index) const
+{
+    int low = 0;
+    int high = m_runs.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (m_runs[middle].first <= index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low - 1;
+}
+
+/*
+  Returns the size of the row or column \a index.
+ */
+int PixelAxis::size(int index) const
+{
+    const int i = runBefore(index);
+    if (i >= 0 && index <= m_runs[i].last)
+        return m_runs[i].size;
+    return m_defaultSize;
+}
+
+/*
+  Returns the number of pixels before the row or column \a index.
+ */
+qint64 PixelAxis::offset(int index) const
+{
+    const int i = runBefore(index);
+    if (i < 0)
+        return qint64(index - 1) * m_defaultSize;
+
+    const Run &run = m_runs[i];
+    if (index <= run.last)
+        return run.offset + qint64(index - run.first) * run.size;
+    return run.offset + qint64(run.last - run.first + 1) * run.size
+           + qint64(index - run.last - 1) * m_defaultSize;
+}
+
+/*
+  Returns the row or column which contains the \a pixel, counted from the
+  start of the first one, and stores the pixels between its start and
+  \a pixel in \a remainder. Rows and columns of size 0 are never returned.
+ */
+int PixelAxis::indexAt(qint64 pixel, int *remainder) const
+{
+    if (pixel < 0)
+        pixel = 0;
+
+    // The last run starting at or before the pixel
+    int low = 0;
+    int high = m_runs.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (m_runs[middle].offset <= pixel)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    int index;
+    if (low == 0) {
+        index = m_defaultSize > 0 ? int(pixel / m_defaultSize) + 1 : 1;
+    } else {
+        const Run &run = m_runs[low - 1];
+        const qint64 end = run.offset + qint64(run.last - run.first + 1) * run.size;
+        if (pixel < end)
+            index = run.first + int((pixel - run.offset) / run.size);
+        else if (m_defaultSize > 0)
+            index = run.last + 1 + int((pixel - end) / m_defaultSize);
+        else
+            index = run.last + 1;
+    }
+
+    if (remainder)
+        *remainder = int(pixel - offset(index));
+    return index;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,81 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXPIXELAXIS_P_H
+#define XLSXPIXELAXIS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The sizes in pixels of the rows or the columns of a sheet, with the
+  pixel offset at which each run of equally sized rows or columns
+  starts. The rows or columns outside the runs have the default size.
+  This converts between pixel positions and cells in O(log n) of the
+  number of runs. Indexes are 1-based, like the rows and columns.
+ */
+class XLSX_AUTOTEST_EXPORT PixelAxis
+{
+public:
+    explicit PixelAxis(int defaultSize = 0);
+
+    void addRun(int first, int last, int size);
+
+    int size(int index) const;
+    qint64 offset(int index) const;
+    int indexAt(qint64 pixel, int *remainder = 0) const;
+
+private:
+    struct Run
+    {
+        int first;
+        int last;
+        int size;
+        qint64 offset; // of first
+    };
+
+    int runBefore(int index) const;
+
+    int m_defaultSize;
+    QVector<Run> m_runs;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXPIXELAXIS_P_H
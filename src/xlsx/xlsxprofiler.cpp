@@ -0,0 +1,97 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxprofiler.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*!
+  \class Profiler
+  \inmodule QtXlsx
+  \brief The Profiler class is notified of the phases of loading and saving a document.
+
+  Install a subclass with Document::setProfiler() to find out where the
+  time of a load or a save goes. Every phase is reported by a begin() call
+  followed by an end() call, the phases of the parts being nested in the
+  LoadPhase or SavePhase of the whole package.
+
+  When the document is loaded or saved in parallel, the phases of the parts
+  may be reported by several threads at the same time.
+
+  Nothing is measured when no profiler is installed.
+*/
+
+/*!
+  \enum Profiler::Phase
+
+  \value LoadPhase The whole load of a package.
+  \value SavePhase The whole save of a package.
+  \value PrepareSavePhase The recalculation of the formulas and the compaction
+         of the shared strings, styles and pictures done before the parts are
+         written.
+  \value InflatePhase Reading one part out of the package, the bytes are the
+         uncompressed size of the part.
+  \value ParsePhase Parsing one part. The elements are the cells of a
+         worksheet, the strings of the shared strings table or the cell
+         formats of the styles.
+  \value WritePhase Serializing and compressing one part into the package,
+         the bytes are the uncompressed size of the part. The elements are
+         counted as for ParsePhase.
+*/
+
+/*!
+  Destroys the profiler.
+*/
+Profiler::~Profiler()
+{
+}
+
+/*!
+  Called when \a phase starts. \a partName is the name of the part in the
+  package, or empty for the phases of the whole package.
+
+  The default implementation does nothing.
+*/
+void Profiler::begin(Phase phase, const QString &partName)
+{
+    Q_UNUSED(phase)
+    Q_UNUSED(partName)
+}
+
+/*!
+  Called when \a phase of the part \a partName is finished, with the number
+  of \a bytes and \a elements processed, which are 0 when not known.
+
+  The default implementation does nothing.
+*/
+void Profiler::end(Phase phase, const QString &partName, qint64 bytes, qint64 elements)
+{
+    Q_UNUSED(phase)
+    Q_UNUSED(partName)
+    Q_UNUSED(bytes)
+    Q_UNUSED(elements)
+}
+
+QT_END_NAMESPACE_XLSX
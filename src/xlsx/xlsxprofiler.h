@@ -0,0 +1,54 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QXLSX_XLSXPROFILER_H
+#define QXLSX_XLSXPROFILER_H
+
+#include "xlsxglobal.h"
+#include <QString>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Q_XLSX_EXPORT Profiler
+{
+public:
+    enum Phase {
+        LoadPhase, // The whole load of a package
+        SavePhase, // The whole save of a package
+        PrepareSavePhase, // Recalculation and compaction done before the parts are written
+        InflatePhase, // Reading one part out of the package
+        ParsePhase, // Parsing one part
+        WritePhase // Serializing and compressing one part into the package
+    };
+
+    virtual ~Profiler();
+
+    virtual void begin(Phase phase, const QString &partName);
+    virtual void end(Phase phase, const QString &partName, qint64 bytes, qint64 elements);
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXPROFILER_H
@@ -0,0 +1,87 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXPROFILER_P_H
+#define XLSXPROFILER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxprofiler.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  Reports one phase to a profiler, from its construction to its destruction.
+  Nothing is done when the profiler is null, the counts should only be
+  computed when isActive() is true.
+ */
+class ProfilerScope
+{
+public:
+    ProfilerScope(Profiler *profiler, Profiler::Phase phase,
+                  const QString &partName = QString())
+        : m_profiler(profiler)
+        , m_phase(phase)
+        , m_bytes(0)
+        , m_elements(0)
+    {
+        if (m_profiler) {
+            m_partName = partName;
+            m_profiler->begin(m_phase, m_partName);
+        }
+    }
+
+    ~ProfilerScope()
+    {
+        if (m_profiler)
+            m_profiler->end(m_phase, m_partName, m_bytes, m_elements);
+    }
+
+    bool isActive() const { return m_profiler != 0; }
+    void setBytes(qint64 bytes) { m_bytes = bytes; }
+    void setElements(qint64 elements) { m_elements = elements; }
+
+private:
+    Q_DISABLE_COPY(ProfilerScope)
+
+    Profiler *m_profiler;
+    Profiler::Phase m_phase;
+    QString m_partName;
+    qint64 m_bytes;
+    qint64 m_elements;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXPROFILER_P_H
@@ -0,0 +1,133 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxprogressmonitor.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*!
+  \class ProgressMonitor
+  \inmodule QtXlsx
+  \brief The ProgressMonitor class follows the load or the save of a document,
+  and can cancel it.
+
+  Install a subclass with Document::setProgressMonitor() to be told of the
+  parts loaded or saved, of the rows of the worksheets, and of the bytes
+  written to the package. Calling cancel(), from any thread, makes the load
+  or the save stop at the next part or within rowInterval() rows of a
+  worksheet. A canceled save returns false and leaves an incomplete package,
+  a canceled load leaves an empty document.
+
+  When the document is loaded or saved in parallel, the callbacks may be
+  called by several threads at the same time.
+
+  A monitor stays canceled until reset() is called.
+*/
+
+/*!
+  Creates a monitor which is not canceled.
+*/
+ProgressMonitor::ProgressMonitor()
+    : m_canceled(0)
+{
+}
+
+/*!
+  Destroys the monitor.
+*/
+ProgressMonitor::~ProgressMonitor()
+{
+}
+
+/*!
+  Called when the part \a partName has been parsed or written to the
+  package, \a partsDone being the number of parts done so far.
+
+  The default implementation does nothing.
+*/
+void ProgressMonitor::partDone(const QString &partName, int partsDone)
+{
+    Q_UNUSED(partName)
+    Q_UNUSED(partsDone)
+}
+
+/*!
+  Called every rowInterval() rows while the worksheet \a sheetName is
+  parsed or written, \a rowsDone being the number of rows done so far.
+
+  The default implementation does nothing.
+*/
+void ProgressMonitor::rowsDone(const QString &sheetName, int rowsDone)
+{
+    Q_UNUSED(sheetName)
+    Q_UNUSED(rowsDone)
+}
+
+/*!
+  Called after each part written to the package, with the total number
+  of \a bytes written so far.
+
+  The default implementation does nothing.
+*/
+void ProgressMonitor::bytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes)
+}
+
+/*!
+  Asks the load or the save to stop. This can be called from any thread.
+*/
+void ProgressMonitor::cancel()
+{
+    m_canceled.storeRelease(1);
+}
+
+/*!
+  Clears the cancellation, so that the monitor can be used again.
+*/
+void ProgressMonitor::reset()
+{
+    m_canceled.storeRelease(0);
+}
+
+/*!
+  Returns true if cancel() has been called since the monitor was created
+  or reset.
+*/
+bool ProgressMonitor::isCanceled() const
+{
+    return m_canceled.loadAcquire() != 0;
+}
+
+/*!
+  Returns the number of rows after which the worksheets report their
+  progress and check for cancellation.
+*/
+int ProgressMonitor::rowInterval()
+{
+    return 1024;
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,188 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxrawcell.h"
+#include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*!
+  \class RawCellValue
+  \inmodule QtXlsx
+  \brief The RawCellValue class holds the value of a cell as it is stored.
+
+  Unlike Worksheet::read(), reading a raw value builds no QVariant and looks
+  at no format: a date is the number of days it is stored as, and a shared
+  string is its index, its text being given by Worksheet::sharedString().
+  formatIndex is the index of the cell format in the styles of the
+  workbook, cells with the same formatIndex have equal formats.
+
+  \sa Worksheet::readRaw(), RawRowIterator
+*/
+
+/*!
+  \enum RawCellValue::Type
+
+  \value Empty There is no cell, or the cell is blank.
+  \value Number The cell holds a number, in \c number.
+  \value Boolean The cell holds a boolean, in \c boolean.
+  \value SharedString The cell holds a shared string, whose index is
+         \c sharedStringIndex.
+  \value Other The cell holds something else, such as an inline string or
+         an error, which Worksheet::read() returns.
+*/
+
+class RawRowIteratorPrivate
+{
+public:
+    RawRowIteratorPrivate(const WorksheetPrivate *sheet, const CellRange &range)
+        : sheet(sheet)
+        , range(range)
+        , rowIndex(-1)
+        , first(0)
+        , end(0)
+    {
+    }
+
+    const WorksheetPrivate *sheet;
+    CellRange range; // all the cells when not valid
+    int rowIndex; // in the cell table, -1 before the first row
+    int first; // the cells of the row in the range
+    int end;
+};
+
+/*!
+  \class RawRowIterator
+  \inmodule QtXlsx
+  \brief The RawRowIterator class goes over the rows of a worksheet and
+  reads the raw values of their cells.
+
+  Only the rows which have cells in the range are returned, and only their
+  cells in the range. The worksheet must not be changed while it is
+  iterated.
+
+  \code
+  RawRowIterator it(sheet);
+  while (it.nextRow()) {
+      for (int i = 0; i < it.cellCount(); ++i) {
+          RawCellValue value = it.value(i);
+          if (value.type == RawCellValue::Number)
+              sum += value.number;
+      }
+  }
+  \endcode
+
+  \sa RawCellValue
+*/
+
+/*!
+  Creates an iterator over the cells of \a sheet which are in \a range, or
+  over all its cells if \a range is not valid. nextRow() must be called to
+  get to the first row.
+*/
+RawRowIterator::RawRowIterator(const Worksheet *sheet, const CellRange &range)
+    : d_ptr(new RawRowIteratorPrivate(sheet->d_func(), range))
+{
+}
+
+/*!
+  Destroys the iterator.
+*/
+RawRowIterator::~RawRowIterator()
+{
+    delete d_ptr;
+}
+
+/*!
+  Moves to the next row which has cells in the range. Returns false when
+  there is none left.
+*/
+bool RawRowIterator::nextRow()
+{
+    Q_D(RawRowIterator);
+    const CellTable &table = d->sheet->cellTable;
+    // No reference to the rows is held between two calls
+    table.trimRestoredBlocks();
+
+    const bool all = !d->range.isValid();
+    int i = d->rowIndex == -1 ? table.rowLowerBound(all ? 1 : d->range.firstRow())
+                              : d->rowIndex + 1;
+    for (; i < table.size(); ++i) {
+        if (!all && table.rowNumberAt(i) > d->range.lastRow())
+            break;
+        const CellRow &cells = table.rowAt(i);
+        d->first = all ? 0 : cells.lowerBound(d->range.firstColumn());
+        d->end = all ? cells.size() : cells.lowerBound(d->range.lastColumn() + 1);
+        if (d->first < d->end) {
+            d->rowIndex = i;
+            return true;
+        }
+    }
+    d->rowIndex = table.size();
+    d->first = d->end = 0;
+    return false;
+}
+
+/*!
+  Returns the number of the current row.
+*/
+int RawRowIterator::row() const
+{
+    Q_D(const RawRowIterator);
+    if (d->first == d->end)
+        return -1;
+    return d->sheet->cellTable.rowNumberAt(d->rowIndex);
+}
+
+/*!
+  Returns the number of cells of the current row in the range.
+*/
+int RawRowIterator::cellCount() const
+{
+    Q_D(const RawRowIterator);
+    return d->end - d->first;
+}
+
+/*!
+  Returns the column of the cell \a index of the current row.
+*/
+int RawRowIterator::column(int index) const
+{
+    Q_D(const RawRowIterator);
+    Q_ASSERT(index >= 0 && index < d->end - d->first);
+    return d->sheet->cellTable.rowAt(d->rowIndex).columns[d->first + index];
+}
+
+/*!
+  Returns the raw value of the cell \a index of the current row.
+*/
+RawCellValue RawRowIterator::value(int index) const
+{
+    Q_D(const RawRowIterator);
+    Q_ASSERT(index >= 0 && index < d->end - d->first);
+    return d->sheet->rawValue(d->sheet->cellTable.rowAt(d->rowIndex).cells[d->first + index]);
+}
+
+QT_END_NAMESPACE_XLSX
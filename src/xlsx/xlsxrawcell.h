@@ -0,0 +1,83 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXRAWCELL_H
+#define QXLSX_XLSXRAWCELL_H
+
+#include "xlsxglobal.h"
+#include "xlsxcellrange.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Worksheet;
+class RawRowIteratorPrivate;
+
+class Q_XLSX_EXPORT RawCellValue
+{
+public:
+    enum Type {
+        Empty, // No cell, or a blank one
+        Number, // number, dates and times included
+        Boolean,
+        SharedString, // index in the shared strings
+        Other // inline string, error, ... read it with Worksheet::read()
+    };
+
+    RawCellValue()
+        : type(Empty)
+        , number(0)
+        , formatIndex(-1)
+    {
+    }
+
+    Type type;
+    union {
+        double number;
+        bool boolean;
+        int sharedStringIndex;
+    };
+    int formatIndex; // -1 when the cell has no format
+};
+
+class Q_XLSX_EXPORT RawRowIterator
+{
+    Q_DECLARE_PRIVATE(RawRowIterator)
+public:
+    explicit RawRowIterator(const Worksheet *sheet, const CellRange &range = CellRange());
+    ~RawRowIterator();
+
+    bool nextRow();
+    int row() const;
+    int cellCount() const;
+    int column(int index) const;
+    RawCellValue value(int index) const;
+
+private:
+    Q_DISABLE_COPY(RawRowIterator)
+    RawRowIteratorPrivate *const d_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXRAWCELL_H
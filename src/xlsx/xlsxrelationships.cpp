@@ -23,7 +23,7 @@
 **
 ****************************************************************************/
 #include "xlsxrelationships_p.h"
-#include <QXmlStreamWriter>
+#include "xlsxsheetdatawriter_p.h"
 #include <QXmlStreamReader>
 #include <QDir>
 #include <QFile>
@@ -87,10 +87,11 @@ void Relationships::addWorksheetRelationship(const QString &relativeType, const
 QList<XlsxRelationship> Relationships::relationships(const QString &type) const
 {
     QList<XlsxRelationship> res;
-    foreach (XlsxRelationship ship, m_relationships) {
-        if (ship.type == type)
-            res.append(ship);
-    }
+    const int typeIndex = m_typeIndexes.value(type, -1);
+    if (typeIndex == -1)
+        return res;
+    foreach (int index, m_typeRelationships[typeIndex])
+        res.append(m_relationships[index]);
     return res;
 }
 
@@ -103,29 +104,52 @@ void Relationships::addRelationship(const QString &type, const QString &target,
     relation.target = target;
     relation.targetMode = targetMode;
 
-    m_relationships.append(relation);
+    appendRelationship(relation);
+}
+
+/*
+  Append \a relationship and index it by its type and its id. The type
+  string is shared with the other relationships of the same type, so
+  that it is stored once.
+ */
+void Relationships::appendRelationship(XlsxRelationship relationship)
+{
+    const int index = m_relationships.size();
+    QHash<QString, int>::const_iterator it = m_typeIndexes.constFind(relationship.type);
+    if (it == m_typeIndexes.constEnd()) {
+        it = m_typeIndexes.insert(relationship.type, m_types.size());
+        m_types.append(relationship.type);
+        m_typeRelationships.append(QList<int>());
+    }
+    relationship.type = m_types[it.value()];
+    m_typeRelationships[it.value()].append(index);
+    if (!m_idIndexes.contains(relationship.id))
+        m_idIndexes.insert(relationship.id, index);
+
+    m_relationships.append(relationship);
 }
 
 void Relationships::saveToXmlFile(QIODevice *device) const
 {
-    QXmlStreamWriter writer(device);
-
-    writer.writeStartDocument(QStringLiteral("1.0"), true);
-    writer.writeStartElement(QStringLiteral("Relationships"));
-    writer.writeAttribute(
-        QStringLiteral("xmlns"),
-        QStringLiteral("http://schemas.openxmlformats.org/package/2006/relationships"));
-    foreach (XlsxRelationship relation, m_relationships) {
-        writer.writeStartElement(QStringLiteral("Relationship"));
-        writer.writeAttribute(QStringLiteral("Id"), relation.id);
-        writer.writeAttribute(QStringLiteral("Type"), relation.type);
-        writer.writeAttribute(QStringLiteral("Target"), relation.target);
-        if (!relation.targetMode.isNull())
-            writer.writeAttribute(QStringLiteral("TargetMode"), relation.targetMode);
-        writer.writeEndElement();
+    SheetDataWriter writer(device);
+
+    writer.writeRaw("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                    "<Relationships "
+                    "xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">");
+    foreach (const XlsxRelationship &relation, m_relationships) {
+        writer.writeRaw("<Relationship Id=\"");
+        writer.writeEscapedAttribute(relation.id);
+        writer.writeRaw("\" Type=\"");
+        writer.writeEscapedAttribute(relation.type);
+        writer.writeRaw("\" Target=\"");
+        writer.writeEscapedAttribute(relation.target);
+        if (!relation.targetMode.isNull()) {
+            writer.writeRaw("\" TargetMode=\"");
+            writer.writeEscapedAttribute(relation.targetMode);
+        }
+        writer.writeRaw("\"/>");
     }
-    writer.writeEndElement(); // Relationships
-    writer.writeEndDocument();
+    writer.writeRaw("</Relationships>");
 }
 
 QByteArray Relationships::saveToXmlData() const
@@ -152,7 +176,7 @@ bool Relationships::loadFromXmlFile(QIODevice *device)
                 relationship.type = attributes.value(QLatin1String("Type")).toString();
                 relationship.target = attributes.value(QLatin1String("Target")).toString();
                 relationship.targetMode = attributes.value(QLatin1String("TargetMode")).toString();
-                m_relationships.append(relationship);
+                appendRelationship(relationship);
             }
         }
 
@@ -172,16 +196,24 @@ bool Relationships::loadFromXmlData(const QByteArray &data)
 
 XlsxRelationship Relationships::getRelationshipById(const QString &id) const
 {
-    foreach (XlsxRelationship ship, m_relationships) {
-        if (ship.id == id)
-            return ship;
-    }
-    return XlsxRelationship();
+    const int index = m_idIndexes.value(id, -1);
+    if (index == -1)
+        return XlsxRelationship();
+    return m_relationships[index];
+}
+
+QList<XlsxRelationship> Relationships::allRelationships() const
+{
+    return m_relationships;
 }
 
 void Relationships::clear()
 {
     m_relationships.clear();
+    m_types.clear();
+    m_typeIndexes.clear();
+    m_typeRelationships.clear();
+    m_idIndexes.clear();
 }
 
 int Relationships::count() const
@@ -37,8 +37,10 @@
 //
 
 #include "xlsxglobal.h"
+#include <QHash>
 #include <QList>
 #include <QString>
+#include <QStringList>
 class QIODevice;
 
 namespace QXlsx {
@@ -72,6 +74,7 @@ public:
     bool loadFromXmlFile(QIODevice *device);
     bool loadFromXmlData(const QByteArray &data);
     XlsxRelationship getRelationshipById(const QString &id) const;
+    QList<XlsxRelationship> allRelationships() const;
 
     void clear();
     int count() const;
@@ -81,8 +84,16 @@ private:
     QList<XlsxRelationship> relationships(const QString &type) const;
     void addRelationship(const QString &type, const QString &target,
                          const QString &targetMode = QString());
+    void appendRelationship(XlsxRelationship relationship);
 
     QList<XlsxRelationship> m_relationships;
+    // The distinct relationship types, shared by the relationships, and
+    // the positions of the relationships of each of them
+    QStringList m_types;
+    QHash<QString, int> m_typeIndexes;
+    QList<QList<int>> m_typeRelationships;
+    // The position of the first relationship of each id
+    QHash<QString, int> m_idIndexes;
 };
 }
 #endif // XLSXRELATIONSHIPS_H
@@ -33,6 +33,9 @@ QT_BEGIN_NAMESPACE_XLSX
 
 RichStringPrivate::RichStringPrivate()
     : _dirty(true)
+    , _hash(0)
+    , _hashSeed(0)
+    , _hashValid(false)
 {
 }
 
@@ -40,8 +43,11 @@ RichStringPrivate::RichStringPrivate(const RichStringPrivate &other)
     : QSharedData(other)
     , fragmentTexts(other.fragmentTexts)
     , fragmentFormats(other.fragmentFormats)
-    , _idKey(other.idKey())
+    , _idKey(other._idKey)
     , _dirty(other._dirty)
+    , _hash(other._hash)
+    , _hashSeed(other._hashSeed)
+    , _hashValid(other._hashValid)
 {
 }
 
@@ -196,6 +202,23 @@ void RichString::addFragment(const QString &text, const Format &format)
     d->_dirty = true;
 }
 
+#ifdef Q_COMPILER_RVALUE_REFS
+/*!
+    \overload
+
+    Moves the \a text and \a format of the new fragment into the string.
+ */
+void RichString::addFragment(QString &&text, Format &&format)
+{
+    // QList can't take rvalues, so swap the values into empty entries
+    d->fragmentTexts.append(QString());
+    d->fragmentTexts.last().swap(text);
+    d->fragmentFormats.append(Format());
+    d->fragmentFormats.last().swap(format);
+    d->_dirty = true;
+}
+#endif
+
 /*!
     Returns fragment text at the position \a index.
  */
@@ -241,21 +264,69 @@ QByteArray RichStringPrivate::idKey() const
         }
         rs->_idKey = bytes;
         rs->_dirty = false;
+        rs->_hashValid = false;
     }
 
     return _idKey;
 }
 
+/*!
+ * \internal
+ * The plain strings are hashed as their text, like their id key is.
+ * The hash of the rich strings is kept until a fragment is added.
+ */
+uint RichStringPrivate::hash(uint seed) const
+{
+    if (fragmentTexts.size() == 1)
+        return qHash(fragmentTexts[0], seed);
+
+    const QByteArray key = idKey();
+    if (!_hashValid || _hashSeed != seed) {
+        RichStringPrivate *rs = const_cast<RichStringPrivate *>(this);
+        rs->_hash = qHash(key, seed);
+        rs->_hashSeed = seed;
+        rs->_hashValid = true;
+    }
+    return _hash;
+}
+
+/*!
+ * \internal
+ * Compare the fragments one by one, which gives the same result as
+ * comparing the id keys without building them.
+ */
+bool RichStringPrivate::isEqual(const RichStringPrivate &other) const
+{
+    if (this == &other)
+        return true;
+    if (fragmentTexts.size() != other.fragmentTexts.size())
+        return false;
+    if (fragmentTexts.size() == 1)
+        return fragmentTexts[0] == other.fragmentTexts[0];
+
+    for (int i = 0; i < fragmentTexts.size(); ++i) {
+        if (fragmentTexts[i] != other.fragmentTexts[i])
+            return false;
+    }
+    for (int i = 0; i < fragmentFormats.size(); ++i) {
+        const Format &format = fragmentFormats[i];
+        const Format &otherFormat = other.fragmentFormats[i];
+        const QByteArray key = format.hasFontData() ? format.fontKey() : QByteArray();
+        const QByteArray otherKey =
+            otherFormat.hasFontData() ? otherFormat.fontKey() : QByteArray();
+        if (key != otherKey)
+            return false;
+    }
+    return true;
+}
+
 /*!
     Returns true if this string \a rs1 is equal to string \a rs2;
     otherwise returns false.
  */
 bool operator==(const RichString &rs1, const RichString &rs2)
 {
-    if (rs1.fragmentCount() != rs2.fragmentCount())
-        return false;
-
-    return rs1.d->idKey() == rs2.d->idKey();
+    return rs1.d->isEqual(*rs2.d);
 }
 
 /*!
@@ -264,10 +335,7 @@ bool operator==(const RichString &rs1, const RichString &rs2)
  */
 bool operator!=(const RichString &rs1, const RichString &rs2)
 {
-    if (rs1.fragmentCount() != rs2.fragmentCount())
-        return true;
-
-    return rs1.d->idKey() != rs2.d->idKey();
+    return !rs1.d->isEqual(*rs2.d);
 }
 
 /*!
@@ -326,7 +394,7 @@ bool operator!=(const QString &rs1, const RichString &rs2)
 
 uint qHash(const RichString &rs, uint seed) Q_DECL_NOTHROW
 {
-    return qHash(rs.d->idKey(), seed);
+    return rs.d->hash(seed);
 }
 
 #ifndef QT_NO_DEBUG_STREAM
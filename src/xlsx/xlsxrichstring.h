@@ -43,6 +43,15 @@ public:
     RichString();
     explicit RichString(const QString text);
     RichString(const RichString &other);
+#ifdef Q_COMPILER_RVALUE_REFS
+    RichString(RichString &&other) Q_DECL_NOTHROW : d(std::move(other.d)) {}
+    RichString &operator=(RichString &&other) Q_DECL_NOTHROW
+    {
+        swap(other);
+        return *this;
+    }
+#endif
+    void swap(RichString &other) Q_DECL_NOTHROW { d.swap(other.d); }
     ~RichString();
 
     bool isRichString() const;
@@ -54,6 +63,9 @@ public:
 
     int fragmentCount() const;
     void addFragment(const QString &text, const Format &format);
+#ifdef Q_COMPILER_RVALUE_REFS
+    void addFragment(QString &&text, Format &&format);
+#endif
     QString fragmentText(int index) const;
     Format fragmentFormat(int index) const;
 
@@ -85,6 +97,7 @@ Q_XLSX_EXPORT QDebug operator<<(QDebug dbg, const RichString &rs);
 
 QT_END_NAMESPACE_XLSX
 
+Q_DECLARE_TYPEINFO(QXlsx::RichString, Q_MOVABLE_TYPE);
 Q_DECLARE_METATYPE(QXlsx::RichString)
 
 #endif // XLSXRICHSTRING_H
@@ -48,11 +48,17 @@ public:
     ~RichStringPrivate();
 
     QByteArray idKey() const;
+    uint hash(uint seed) const;
+    bool isEqual(const RichStringPrivate &other) const;
 
     QStringList fragmentTexts;
     QList<Format> fragmentFormats;
     QByteArray _idKey;
     bool _dirty;
+    // qHash() of _idKey with the seed _hashSeed, for the rich strings
+    uint _hash;
+    uint _hashSeed;
+    bool _hashValid;
 };
 
 QT_END_NAMESPACE_XLSX
@@ -0,0 +1,384 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxrowwriter.h"
+#include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxsharedstrings_p.h"
+#include "xlsxcelltable_p.h"
+
+#include <QMap>
+#include <QTextDocument>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The cells of a writer are kept in a table of its own. Only the values
+  which are stored as they are, numbers, booleans, plain strings and
+  blank cells, are converted by the writing thread; the others, formulas,
+  dates, urls, ..., are kept as they have been written, and go through
+  Worksheet::write() when the writer is merged.
+ */
+class RowWriterPrivate
+{
+public:
+    RowWriterPrivate(WorksheetPrivate *sheet, int firstRow, int lastRow)
+        : sheet(sheet)
+        , firstRow(firstRow)
+        , lastRow(lastRow)
+    {
+    }
+
+    struct PendingCell
+    {
+        QVariant value;
+        Format format;
+    };
+
+    static quint64 cellKey(int row, int column) { return (quint64(row) << 32) | quint32(column); }
+    bool accepts(int row, int column) const;
+    bool isPlainString(const QString &value) const;
+    bool variantCell(const QVariant &value, int xf, CellData *cell);
+    void setCell(int row, int column, const CellData &cell);
+    void setPending(int row, int column, const QVariant &value, const Format &format);
+    void release(const CellData &cell);
+
+    WorksheetPrivate *sheet;
+    int firstRow;
+    int lastRow;
+    // The xf index of the cells written without a format is -2, they keep
+    // the format they have in the sheet, see WorksheetPrivate::batchXfIndex()
+    CellTable cells;
+    QMap<quint64, PendingCell> pending;
+};
+
+bool RowWriterPrivate::accepts(int row, int column) const
+{
+    return row >= firstRow && row <= lastRow && column >= 1 && column <= XLSX_COLUMN_MAX;
+}
+
+/*
+  Returns true if Worksheet::write() would store \a value as a plain
+  string. The url pattern isn't matched by the writing threads, all the
+  strings which may be urls are left to Worksheet::write().
+ */
+bool RowWriterPrivate::isPlainString(const QString &value) const
+{
+    if (value.startsWith(QLatin1Char('=')))
+        return false;
+    if (sheet->workbook->isStringsToHyperlinksEnabled() && value.contains(QLatin1Char(':')))
+        return false;
+    if (sheet->workbook->isHtmlToRichStringEnabled() && Qt::mightBeRichText(value))
+        return false;
+    return true;
+}
+
+/*
+  Convert \a value to the \a cell stored by Worksheet::write(), with the
+  \a xf index. Returns false for the values left to it.
+ */
+bool RowWriterPrivate::variantCell(const QVariant &value, int xf, CellData *cell)
+{
+    switch (value.userType()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+    case QMetaType::Float:
+        *cell = CellData::fromNumber(value.toDouble(), xf);
+        return true;
+    case QMetaType::Bool:
+        *cell = CellData::fromBool(value.toBool(), xf);
+        return true;
+    case QMetaType::QString: {
+        const QString string = value.toString();
+        if (!isPlainString(string))
+            return false;
+        // The adaptive storage counts the strings of each column, which
+        // is left to the thread of the sheet: they are shared then.
+        if (sheet->stringStorage == Worksheet::InlineStringStorage) {
+            CellExtraData extra;
+            extra.value = string;
+            *cell = CellData::fromExtra(cells.addExtra(extra), Cell::InlineStringType, xf);
+        } else {
+            *cell = CellData::fromSharedString(sheet->sharedStrings()->addSharedString(string),
+                                               xf);
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+/*
+  Drop the reference which the overwritten \a cell holds on its shared
+  string, as WorksheetPrivate::releaseSharedString() does.
+ */
+void RowWriterPrivate::release(const CellData &cell)
+{
+    if (cell.storage == CellData::SharedString)
+        sheet->sharedStrings()->decRefByStringIndex(cell.index);
+}
+
+void RowWriterPrivate::setCell(int row, int column, const CellData &cell)
+{
+    if (const CellData *old = cells.cell(row, column))
+        release(*old);
+    pending.remove(cellKey(row, column));
+    cells.setCell(row, column, cell);
+}
+
+void RowWriterPrivate::setPending(int row, int column, const QVariant &value,
+                                  const Format &format)
+{
+    if (const CellData *old = cells.cell(row, column)) {
+        release(*old);
+        cells.removeCells(row, column, row, column);
+    }
+    PendingCell cell;
+    cell.value = value;
+    cell.format = format;
+    pending.insert(cellKey(row, column), cell);
+}
+
+/*!
+  \class RowWriter
+  \inmodule QtXlsx
+  \brief The RowWriter class fills a range of rows of a worksheet from a
+  thread of its own.
+
+  The rows of one worksheet can be computed by several threads, each one
+  filling its own range of rows through a writer returned by
+  Worksheet::rowWriter(). The cells of a writer are kept apart from the
+  sheet, and are merged into it, in the order of the rows, when the
+  document is saved, or when Worksheet::mergeRowWriters() is called. The
+  writer is deleted then, and the dimension of the sheet and the spans of
+  its rows cover the cells written.
+
+  \code
+  RowWriter *top = sheet->rowWriter(1, 50000);
+  RowWriter *bottom = sheet->rowWriter(50001, 100000);
+  QFuture<void> first = QtConcurrent::run(fillRows, top);
+  QFuture<void> second = QtConcurrent::run(fillRows, bottom);
+  first.waitForFinished();
+  second.waitForFinished();
+  xlsx.save();
+  \endcode
+
+  A writer must only be used by one thread at a time, and each thread
+  must write with its own Format objects. The sheet itself must not be
+  read or changed while its writers are being filled, and the writers
+  must be done before the document is saved.
+
+  The numbers, booleans and strings are stored by the writing thread,
+  with the shared strings and the styles of the workbook locked as for
+  Workbook::setConcurrentWritesEnabled(). The other values, such as
+  formulas or dates, are written to the sheet by Worksheet::write() when
+  the writer is merged.
+
+  \sa Worksheet::rowWriter()
+*/
+
+/*
+  Created by Worksheet::rowWriter() only, for the rows \a firstRow to
+  \a lastRow of \a sheet.
+ */
+RowWriter::RowWriter(WorksheetPrivate *sheet, int firstRow, int lastRow)
+    : d_ptr(new RowWriterPrivate(sheet, firstRow, lastRow))
+{
+}
+
+/*
+  Deleted by the worksheet, once merged. The references to the shared
+  strings of the writers which are never merged are dropped.
+ */
+RowWriter::~RowWriter()
+{
+    Q_D(RowWriter);
+    const CellTable &cells = d->cells;
+    for (int i = 0; i < cells.size(); ++i) {
+        const CellRow &row = cells.rowAt(i);
+        for (int j = 0; j < row.size(); ++j)
+            d->release(row.cells[j]);
+    }
+    delete d_ptr;
+}
+
+/*!
+  Returns the first row the writer fills.
+*/
+int RowWriter::firstRow() const
+{
+    Q_D(const RowWriter);
+    return d->firstRow;
+}
+
+/*!
+  Returns the last row the writer fills.
+*/
+int RowWriter::lastRow() const
+{
+    Q_D(const RowWriter);
+    return d->lastRow;
+}
+
+/*!
+  Writes \a value to the cell (\a row, \a column) with the \a format, as
+  Worksheet::write() does. Returns false if the row isn't one of the
+  writer.
+*/
+bool RowWriter::write(int row, int column, const QVariant &value, const Format &format)
+{
+    Q_D(RowWriter);
+    if (!d->accepts(row, column))
+        return false;
+    if (value.isNull())
+        return writeBlank(row, column, format);
+
+    CellData cell;
+    if (d->variantCell(value, d->sheet->batchXfIndex(format), &cell))
+        d->setCell(row, column, cell);
+    else
+        d->setPending(row, column, value, format);
+    return true;
+}
+
+/*!
+  Writes the number \a value to the cell (\a row, \a column) with the
+  \a format. Returns false if the row isn't one of the writer.
+*/
+bool RowWriter::writeNumeric(int row, int column, double value, const Format &format)
+{
+    Q_D(RowWriter);
+    if (!d->accepts(row, column))
+        return false;
+    d->setCell(row, column, CellData::fromNumber(value, d->sheet->batchXfIndex(format)));
+    return true;
+}
+
+/*!
+  Writes the boolean \a value to the cell (\a row, \a column) with the
+  \a format. Returns false if the row isn't one of the writer.
+*/
+bool RowWriter::writeBool(int row, int column, bool value, const Format &format)
+{
+    Q_D(RowWriter);
+    if (!d->accepts(row, column))
+        return false;
+    d->setCell(row, column, CellData::fromBool(value, d->sheet->batchXfIndex(format)));
+    return true;
+}
+
+/*!
+  Writes a blank cell with the \a format to (\a row, \a column). Returns
+  false if the row isn't one of the writer.
+*/
+bool RowWriter::writeBlank(int row, int column, const Format &format)
+{
+    Q_D(RowWriter);
+    if (!d->accepts(row, column))
+        return false;
+    d->setCell(row, column,
+               CellData(CellData::Blank, Cell::NumberType, d->sheet->batchXfIndex(format)));
+    return true;
+}
+
+/*!
+  Writes the \a values to the cells of \a row, starting at \a firstColumn,
+  with the \a format. Returns false if nothing can be written.
+*/
+bool RowWriter::writeRow(int row, int firstColumn, const QVector<QVariant> &values,
+                         const Format &format)
+{
+    Q_D(RowWriter);
+    if (values.isEmpty() || !d->accepts(row, firstColumn)
+        || !d->accepts(row, firstColumn + values.size() - 1)) {
+        return false;
+    }
+
+    const int xf = d->sheet->batchXfIndex(format);
+    for (int i = 0; i < values.size(); ++i) {
+        CellData cell;
+        if (values[i].isNull())
+            d->setCell(row, firstColumn + i, CellData(CellData::Blank, Cell::NumberType, xf));
+        else if (d->variantCell(values[i], xf, &cell))
+            d->setCell(row, firstColumn + i, cell);
+        else
+            d->setPending(row, firstColumn + i, values[i], format);
+    }
+    return true;
+}
+
+/*
+  Move the cells of the writer to the sheet, by runs of adjacent cells,
+  and write the values left to Worksheet::write(). Called from the thread
+  of the sheet.
+ */
+void RowWriter::merge()
+{
+    Q_D(RowWriter);
+    WorksheetPrivate *sheet = d->sheet;
+    CellTable &cells = d->cells;
+    if (!cells.isEmpty()
+        && sheet->checkBatchDimensions(cells.firstRow(), cells.firstColumn(), cells.lastRow(),
+                                       cells.lastColumn())) {
+        QVector<CellData> run;
+        for (int i = 0; i < cells.size(); ++i) {
+            const int row = cells.rowNumberAt(i);
+            const CellRow &cellRow = static_cast<const CellTable &>(cells).rowAt(i);
+            int j = 0;
+            while (j < cellRow.size()) {
+                const int firstColumn = cellRow.columns[j];
+                run.clear();
+                do {
+                    CellData cell = cellRow.cells[j];
+                    cell.xfIndex = sheet->batchCellXfIndex(cell.xfIndex, row,
+                                                           firstColumn + run.size());
+                    if (cell.storage == CellData::Extra)
+                        cell.index = sheet->cellTable.addExtra(cells.extra(cell.index));
+                    run.append(cell);
+                    ++j;
+                } while (j < cellRow.size() && cellRow.columns[j] == firstColumn + run.size());
+                sheet->setCells(row, firstColumn, run.constData(), run.size());
+            }
+        }
+        // The references to the shared strings now belong to the sheet
+        cells.clear();
+    }
+
+    Worksheet *q = sheet->q_func();
+    QMapIterator<quint64, RowWriterPrivate::PendingCell> it(d->pending);
+    while (it.hasNext()) {
+        it.next();
+        q->write(int(it.key() >> 32), int(it.key() & 0xFFFFFFFF), it.value().value,
+                 it.value().format);
+    }
+    d->pending.clear();
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,65 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXROWWRITER_H
+#define QXLSX_XLSXROWWRITER_H
+
+#include "xlsxglobal.h"
+#include "xlsxformat.h"
+#include <QVariant>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class WorksheetPrivate;
+class RowWriterPrivate;
+
+class Q_XLSX_EXPORT RowWriter
+{
+    Q_DECLARE_PRIVATE(RowWriter)
+public:
+    int firstRow() const;
+    int lastRow() const;
+
+    bool write(int row, int column, const QVariant &value, const Format &format = Format());
+    bool writeNumeric(int row, int column, double value, const Format &format = Format());
+    bool writeBool(int row, int column, bool value, const Format &format = Format());
+    bool writeBlank(int row, int column, const Format &format = Format());
+    bool writeRow(int row, int firstColumn, const QVector<QVariant> &values,
+                  const Format &format = Format());
+
+private:
+    friend class Worksheet;
+    friend class WorksheetPrivate;
+    Q_DISABLE_COPY(RowWriter)
+    RowWriter(WorksheetPrivate *sheet, int firstRow, int lastRow);
+    ~RowWriter();
+    void merge();
+
+    RowWriterPrivate *const d_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXROWWRITER_H
@@ -24,15 +24,27 @@
 ****************************************************************************/
 #include "xlsxrichstring.h"
 #include "xlsxsharedstrings_p.h"
+#include "xlsxbiff12_p.h"
+#include "xlsxstatistics_p.h"
 #include "xlsxutility_p.h"
 #include "xlsxformat_p.h"
 #include "xlsxcolor_p.h"
+#include "xlsxstyles_p.h"
+#include "xlsxsheetdatawriter_p.h"
+#include "xlsxxmlpullparser_p.h"
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
 #include <QDir>
 #include <QFile>
 #include <QDebug>
 #include <QBuffer>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <climits>
 
 namespace QXlsx {
 
@@ -40,112 +52,548 @@ namespace QXlsx {
  * Note that, when we open an existing .xlsx file (broken file?),
  * duplicated string items may exist in the shared string table.
  *
- * In such case, the size of stringList will larger than stringTable.
- * Duplicated items can be removed once we loaded all the worksheets.
+ * In such case, only the last one of them can be found by lookup.
+ * All of them keep their index, as it's used by the worksheets.
+ *
+ * A string is released when it's no longer referenced by any cell. Its
+ * slot is reused by the next new string, and it's dropped from the saved
+ * table, the indexes of the following strings being shifted at save time.
+ *
+ * In thread safe mode, every public function locks the table, so that the
+ * worksheets of a workbook can be written from different threads. They
+ * share the work through the ...Locked() helpers, which expect the lock
+ * to be held, as the mutex isn't recursive.
  */
 
 SharedStrings::SharedStrings(CreateFlag flag)
     : AbstractOOXmlFile(flag)
+    , m_stringCount(0)
+    , m_lookupTablesValid(true)
+    , m_compactionEnabled(true)
+    , m_saveIndicesDirty(true)
+    , m_saveCount(0)
+{
+}
+
+/*
+ * Returns a new table holding the same strings, with the same indexes and
+ * reference counts, which is not thread safe.
+ */
+SharedStrings *SharedStrings::clone() const
 {
-    m_stringCount = 0;
+    QMutexLocker locker(m_mutex.data());
+    SharedStrings *sst = new SharedStrings(F_NewFromScratch);
+    sst->m_strings = m_strings;
+    sst->m_plainStringTable = m_plainStringTable;
+    sst->m_richStringTable = m_richStringTable;
+    sst->m_lookupTablesValid = m_lookupTablesValid;
+    sst->m_richStrings = m_richStrings;
+    sst->m_runFormats = m_runFormats;
+    sst->m_freeSlots = m_freeSlots;
+    sst->m_stringCount = m_stringCount;
+    sst->m_compactionEnabled = m_compactionEnabled;
+    sst->m_saveIndicesDirty = m_saveIndicesDirty;
+    sst->m_saveIndices = m_saveIndices;
+    sst->m_saveCount = m_saveCount;
+    sst->m_saveIndexChanges = m_saveIndexChanges;
+    return sst;
+}
+
+/*
+ * Lock the table in every call when \a enable is true. This must not be
+ * changed while the table is used by other threads.
+ */
+void SharedStrings::setThreadSafe(bool enable)
+{
+    if (enable && !m_mutex)
+        m_mutex.reset(new QMutex);
+    else if (!enable)
+        m_mutex.reset();
 }
 
 int SharedStrings::count() const
 {
+    QMutexLocker locker(m_mutex.data());
     return m_stringCount;
 }
 
+/*
+ * Returns the number of slots, including the released ones. Every valid
+ * string index is less than this.
+ */
+int SharedStrings::slotCount() const
+{
+    QMutexLocker locker(m_mutex.data());
+    return m_strings.size();
+}
+
+/*
+ * Returns an estimate of the bytes held by the strings, their slots and
+ * the lookup tables. Each hash node is counted as its key and value plus
+ * the next pointer and the hash code.
+ */
+qint64 SharedStrings::memoryUsage() const
+{
+    QMutexLocker locker(m_mutex.data());
+    qint64 size = qint64(m_strings.capacity()) * sizeof(XlsxSharedStringInfo)
+        + qint64(m_freeSlots.capacity()) * sizeof(int)
+        + qint64(m_saveIndices.capacity()) * sizeof(int);
+    foreach (const XlsxSharedStringInfo &info, m_strings) {
+        if (info.used)
+            size += qint64(info.text.capacity()) * sizeof(QChar);
+    }
+    const qint64 nodeOverhead = sizeof(void *) + sizeof(uint);
+    size += m_plainStringTable.size() * (sizeof(QString) + sizeof(int) + nodeOverhead)
+        + m_richStringTable.size() * (sizeof(RichString) + sizeof(int) + nodeOverhead)
+        + m_richStrings.size() * (sizeof(int) + sizeof(RichString) + nodeOverhead)
+        + m_runFormats.size() * (sizeof(quint64) + sizeof(Format) + nodeOverhead);
+    return size;
+}
+
 bool SharedStrings::isEmpty() const
 {
-    return m_stringList.isEmpty();
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+    return m_saveCount == 0;
+}
+
+/*
+  Returns true if one of the strings in use has rich text runs.
+ */
+bool SharedStrings::hasRichStrings() const
+{
+    QMutexLocker locker(m_mutex.data());
+    return !m_richStrings.isEmpty();
 }
 
 int SharedStrings::addSharedString(const QString &string)
 {
-    return addSharedString(RichString(string));
+    QMutexLocker locker(m_mutex.data());
+    return addSharedStringLocked(string);
+}
+
+int SharedStrings::addSharedStringLocked(const QString &string)
+{
+    m_stringCount += 1;
+
+    buildLookupTables();
+    QHash<QString, int>::const_iterator it = m_plainStringTable.constFind(string);
+    if (it != m_plainStringTable.constEnd()) {
+        Statistics::count(Statistics::SharedStringHits);
+        if (!m_strings[it.value()].count++)
+            m_saveIndicesDirty = true;
+        return it.value();
+    }
+
+    Statistics::count(Statistics::SharedStringMisses);
+    int index = addString(string, RichString(), 1);
+    m_plainStringTable.insert(string, index);
+    return index;
 }
 
 int SharedStrings::addSharedString(const RichString &string)
 {
+    QMutexLocker locker(m_mutex.data());
+    if (!string.isRichString())
+        return addSharedStringLocked(string.toPlainString());
+
     m_stringCount += 1;
 
-    if (m_stringTable.contains(string)) {
-        XlsxSharedStringInfo &item = m_stringTable[string];
-        item.count += 1;
-        return item.index;
+    buildLookupTables();
+    QHash<RichString, int>::const_iterator it = m_richStringTable.constFind(string);
+    if (it != m_richStringTable.constEnd()) {
+        Statistics::count(Statistics::SharedStringHits);
+        if (!m_strings[it.value()].count++)
+            m_saveIndicesDirty = true;
+        return it.value();
+    }
+
+    Statistics::count(Statistics::SharedStringMisses);
+    int index = addString(string.toPlainString(), string, 1);
+    m_richStringTable.insert(m_richStrings.value(index), index);
+    return index;
+}
+
+/*
+ * Store a string in a free slot, or in a new one, without adding it
+ * to the lookup tables.
+ */
+int SharedStrings::addString(const QString &text, const RichString &richString, int refCount)
+{
+    const bool rich = richString.isRichString();
+    int index;
+    if (!m_freeSlots.isEmpty()) {
+        index = m_freeSlots.takeLast();
+        m_strings[index] = XlsxSharedStringInfo(text, refCount, rich);
+    } else {
+        index = m_strings.size();
+        m_strings.append(XlsxSharedStringInfo(text, refCount, rich));
     }
+    if (rich)
+        m_richStrings.insert(index, internRunFormats(richString));
 
-    int index = m_stringList.size();
-    m_stringTable[string] = XlsxSharedStringInfo(index);
-    m_stringList.append(string);
+    m_saveIndicesDirty = true;
+    setDirty();
     return index;
 }
 
+/*
+ * Returns \a richString with the formats of its runs replaced by the ones
+ * the table already holds, so that the runs with the same properties
+ * share one Format instead of one copy of the properties each, which is
+ * how the rich strings are loaded or usually built. The formats are kept
+ * until the table is discarded.
+ */
+RichString SharedStrings::internRunFormats(const RichString &richString)
+{
+    RichString interned;
+    for (int i = 0; i < richString.fragmentCount(); ++i) {
+        const Format format = richString.fragmentFormat(i);
+        if (!format.isValid()) {
+            interned.addFragment(richString.fragmentText(i), format);
+            continue;
+        }
+        const quint64 fingerprint = format.formatFingerprint();
+        QHash<quint64, Format>::iterator it = m_runFormats.find(fingerprint);
+        if (it == m_runFormats.end())
+            it = m_runFormats.insert(fingerprint, format);
+        interned.addFragment(richString.fragmentText(i), it.value());
+    }
+    return interned;
+}
+
 void SharedStrings::incRefByStringIndex(int idx)
 {
-    if (idx < 0 || idx >= m_stringList.size()) {
+    incRefByStringIndex(idx, 1);
+}
+
+/*
+ * Same as above, but add \a count references at once.
+ */
+void SharedStrings::incRefByStringIndex(int idx, int count)
+{
+    QMutexLocker locker(m_mutex.data());
+    incRefByStringIndexLocked(idx, count);
+}
+
+void SharedStrings::incRefByStringIndexLocked(int idx, int count)
+{
+    if (idx < 0 || idx >= m_strings.size() || !m_strings[idx].used) {
         qDebug("SharedStrings: invlid index");
         return;
     }
+    if (!count)
+        return;
 
-    addSharedString(m_stringList[idx]);
+    XlsxSharedStringInfo &item = m_strings[idx];
+    if (!item.count || item.count + count <= 0)
+        m_saveIndicesDirty = true;
+    item.count += count;
+    m_stringCount += count;
+    if (item.count <= 0)
+        releaseString(idx);
 }
 
 /*
- * Broken, don't use.
+ * Remove one reference to the string \a idx, which is released when
+ * it's no longer referenced.
  */
+void SharedStrings::decRefByStringIndex(int idx)
+{
+    incRefByStringIndex(idx, -1);
+}
+
 void SharedStrings::removeSharedString(const QString &string)
 {
-    removeSharedString(RichString(string));
+    QMutexLocker locker(m_mutex.data());
+    int idx = getSharedStringIndexLocked(string);
+    if (idx != -1)
+        incRefByStringIndexLocked(idx, -1);
+}
+
+void SharedStrings::removeSharedString(const RichString &string)
+{
+    QMutexLocker locker(m_mutex.data());
+    int idx = getSharedStringIndexLocked(string);
+    if (idx != -1)
+        incRefByStringIndexLocked(idx, -1);
 }
 
 /*
- * Broken, don't use.
+ * Index the strings which haven't been indexed since the table was
+ * loaded. Of the duplicated strings, the last one is found.
  */
-void SharedStrings::removeSharedString(const RichString &string)
+void SharedStrings::buildLookupTables() const
 {
-    if (!m_stringTable.contains(string))
+    if (m_lookupTablesValid)
         return;
 
-    m_stringCount -= 1;
-
-    XlsxSharedStringInfo &item = m_stringTable[string];
-    item.count -= 1;
-
-    if (item.count <= 0) {
-        for (int i = item.index + 1; i < m_stringList.size(); ++i)
-            m_stringTable[m_stringList[i]].index -= 1;
+    m_plainStringTable.clear();
+    m_richStringTable.clear();
+    m_plainStringTable.reserve(m_strings.size() - m_richStrings.size());
+    for (int i = 0; i < m_strings.size(); ++i) {
+        const XlsxSharedStringInfo &item = m_strings[i];
+        if (!item.used)
+            continue;
+        if (item.rich)
+            m_richStringTable.insert(m_richStrings.value(i), i);
+        else
+            m_plainStringTable.insert(item.text, i);
+    }
+    m_lookupTablesValid = true;
+}
 
-        m_stringList.removeAt(item.index);
-        m_stringTable.remove(string);
+void SharedStrings::releaseString(int index)
+{
+    XlsxSharedStringInfo &item = m_strings[index];
+    if (item.rich) {
+        QHash<int, RichString>::iterator it = m_richStrings.find(index);
+        QHash<RichString, int>::iterator tableIt = m_richStringTable.find(it.value());
+        if (m_lookupTablesValid && tableIt != m_richStringTable.end() && tableIt.value() == index)
+            m_richStringTable.erase(tableIt);
+        m_richStrings.erase(it);
+    } else if (m_lookupTablesValid) {
+        QHash<QString, int>::iterator tableIt = m_plainStringTable.find(item.text);
+        if (tableIt != m_plainStringTable.end() && tableIt.value() == index)
+            m_plainStringTable.erase(tableIt);
     }
+
+    m_stringCount -= item.count;
+    item = XlsxSharedStringInfo(QString(), 0);
+    item.used = false;
+    m_freeSlots.append(index);
+    m_saveIndicesDirty = true;
+    setDirty();
 }
 
 int SharedStrings::getSharedStringIndex(const QString &string) const
 {
-    return getSharedStringIndex(RichString(string));
+    QMutexLocker locker(m_mutex.data());
+    return getSharedStringIndexLocked(string);
 }
 
 int SharedStrings::getSharedStringIndex(const RichString &string) const
 {
-    if (m_stringTable.contains(string))
-        return m_stringTable[string].index;
-    return -1;
+    QMutexLocker locker(m_mutex.data());
+    return getSharedStringIndexLocked(string);
+}
+
+int SharedStrings::getSharedStringIndexLocked(const QString &string) const
+{
+    buildLookupTables();
+    return m_plainStringTable.value(string, -1);
+}
+
+int SharedStrings::getSharedStringIndexLocked(const RichString &string) const
+{
+    if (!string.isRichString())
+        return getSharedStringIndexLocked(string.toPlainString());
+    buildLookupTables();
+    return m_richStringTable.value(string, -1);
 }
 
 RichString SharedStrings::getSharedString(int index) const
 {
-    if (index < m_stringList.count() && index >= 0)
-        return m_stringList[index];
+    QMutexLocker locker(m_mutex.data());
+    return getSharedStringLocked(index);
+}
+
+RichString SharedStrings::getSharedStringLocked(int index) const
+{
+    if (index < m_strings.count() && index >= 0) {
+        const XlsxSharedStringInfo &item = m_strings[index];
+        if (item.rich)
+            return m_richStrings.value(index);
+        if (item.used)
+            return RichString(item.text);
+    }
     return RichString();
 }
 
+/*
+ * Same as getSharedString(index).toPlainString(), without building
+ * a RichString.
+ */
+QString SharedStrings::getSharedPlainString(int index) const
+{
+    QMutexLocker locker(m_mutex.data());
+    if (index < m_strings.count() && index >= 0)
+        return m_strings[index].text;
+    return QString();
+}
+
 QList<RichString> SharedStrings::getSharedStrings() const
 {
-    return m_stringList;
+    QMutexLocker locker(m_mutex.data());
+    QList<RichString> strings;
+    for (int i = 0; i < m_strings.size(); ++i)
+        strings.append(getSharedStringLocked(i));
+    return strings;
+}
+
+/*
+ * Keep the indexes of the strings unchanged when saving. Used when some
+ * indexes have already been written, by the constant memory mode.
+ */
+void SharedStrings::disableCompaction()
+{
+    QMutexLocker locker(m_mutex.data());
+    if (!m_compactionEnabled)
+        return;
+    m_compactionEnabled = false;
+    m_saveIndicesDirty = true;
+}
+
+/*
+ * Drop the slots of the strings which are no longer referenced, the
+ * released ones included, and move the other strings down, in the same
+ * order, so that their indexes in the saved table don't change. The
+ * lookup tables are built again on the next lookup. \a indexMap is filled
+ * with the new index of each slot, or -1 for the dropped ones.
+ *
+ * Returns false, the indexes being unchanged and \a indexMap left empty,
+ * if no slot is dropped or if compaction is disabled. The unused capacity
+ * of the table is released in any case.
+ */
+bool SharedStrings::compact(QVector<int> *indexMap)
+{
+    QMutexLocker locker(m_mutex.data());
+    indexMap->clear();
+    // The strings keep the indexes they are saved with
+    updateSaveIndicesLocked();
+    const int oldCount = m_strings.size();
+    const bool dropped = m_compactionEnabled && m_saveCount < oldCount;
+    if (dropped) {
+        indexMap->fill(-1, oldCount);
+        QVector<XlsxSharedStringInfo> strings;
+        strings.reserve(m_saveCount);
+        QVector<int> keptSlots;
+        keptSlots.reserve(m_saveCount);
+        QHash<int, RichString> richStrings;
+        QHash<quint64, Format> runFormats;
+        // Only the formats of the runs of the kept strings are interned again
+        m_runFormats.swap(runFormats);
+        for (int i = 0; i < oldCount; ++i) {
+            const XlsxSharedStringInfo &item = m_strings[i];
+            if (item.count <= 0)
+                continue;
+            (*indexMap)[i] = strings.size();
+            if (item.rich)
+                richStrings.insert(strings.size(), internRunFormats(m_richStrings.value(i)));
+            keptSlots.append(i);
+            strings.append(item);
+        }
+        m_strings.swap(strings);
+        m_richStrings.swap(richStrings);
+        m_freeSlots.clear();
+        m_plainStringTable.clear();
+        m_richStringTable.clear();
+        m_lookupTablesValid = false;
+
+        // The first changed string of each update moves down with the
+        // strings, see firstChangedSaveIndex()
+        for (int i = 0; i < m_saveIndexChanges.size(); ++i) {
+            int &first = m_saveIndexChanges[i];
+            first = int(std::lower_bound(keptSlots.constBegin(), keptSlots.constEnd(), first)
+                        - keptSlots.constBegin());
+        }
+        for (int i = 0; i < m_saveCount; ++i)
+            m_saveIndices[i] = i;
+        m_saveIndices.resize(m_saveCount);
+        setDirty();
+    }
+
+    m_strings.squeeze();
+    m_richStrings.squeeze();
+    m_runFormats.squeeze();
+    m_freeSlots.squeeze();
+    m_saveIndices.squeeze();
+    m_saveIndexChanges.squeeze();
+    return dropped;
+}
+
+/*
+ * Compute the indexes which the strings will have in the saved table.
+ * This must be called before saving the worksheets in several threads.
+ */
+void SharedStrings::updateSaveIndices() const
+{
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+}
+
+void SharedStrings::updateSaveIndicesLocked() const
+{
+    if (!m_saveIndicesDirty)
+        return;
+
+    // The strings added since the last update had no saved index before
+    const int previousSize = m_saveIndices.size();
+    int firstChanged = previousSize;
+    m_saveIndices.resize(m_strings.size());
+    m_saveCount = 0;
+    for (int i = 0; i < m_strings.size(); ++i) {
+        const int index = !m_compactionEnabled || m_strings[i].count > 0 ? m_saveCount++ : -1;
+        if (firstChanged == previousSize && i < previousSize && m_saveIndices[i] != index)
+            firstChanged = i;
+        m_saveIndices[i] = index;
+    }
+    m_saveIndexChanges.append(firstChanged);
+    m_saveIndicesDirty = false;
+}
+
+/*
+ * Returns the number of times the saved indexes have been computed,
+ * which is to be given to firstChangedSaveIndex() later.
+ */
+int SharedStrings::saveIndexGeneration() const
+{
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+    return m_saveIndexChanges.size();
+}
+
+/*
+ * Returns the first string whose saved index has changed since the saved
+ * indexes were at the \a generation returned by saveIndexGeneration(), or
+ * INT_MAX when no saved index has changed. The xml written with the
+ * saved indexes of the strings before it is still valid.
+ */
+int SharedStrings::firstChangedSaveIndex(int generation) const
+{
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+    int first = INT_MAX;
+    for (int i = qMax(generation, 0); i < m_saveIndexChanges.size(); ++i)
+        first = qMin(first, m_saveIndexChanges[i]);
+    return first;
+}
+
+/*
+ * Returns true if every string keeps its index in the saved table, so
+ * that the cells of the worksheets which were loaded with it still refer
+ * to the right strings.
+ */
+bool SharedStrings::hasStableIndices() const
+{
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+    return m_saveCount == m_strings.size();
+}
+
+/*
+ * Returns the index of the string \a index in the saved table.
+ */
+int SharedStrings::saveIndex(int index) const
+{
+    QMutexLocker locker(m_mutex.data());
+    updateSaveIndicesLocked();
+    if (index < 0 || index >= m_saveIndices.size())
+        return -1;
+    return m_saveIndices[index];
 }
 
-void SharedStrings::writeRichStringPart_rPr(QXmlStreamWriter &writer, const Format &format) const
+void SharedStrings::writeRichStringPart_rPr(QXmlStreamWriter &writer, const Format &format)
 {
     if (!format.hasFontData())
         return;
@@ -210,59 +658,74 @@ void SharedStrings::writeRichStringPart_rPr(QXmlStreamWriter &writer, const Form
     }
 }
 
-void SharedStrings::saveToXmlFile(QIODevice *device) const
+/*
+ * Returns the <rPr> element of the runs whose font is the one of \a format.
+ */
+QByteArray SharedStrings::richStringPart_rPrXml(const Format &format)
 {
-    QXmlStreamWriter writer(device);
+    QByteArray rPr;
+    QBuffer buffer(&rPr);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter writer(&buffer);
+    writer.writeStartElement(QStringLiteral("rPr"));
+    writeRichStringPart_rPr(writer, format);
+    writer.writeEndElement(); // rPr
+    return rPr;
+}
 
-    if (m_stringList.size() != m_stringTable.size()) {
-        // Duplicated string items exist in m_stringList
-        // Clean up can not be done here, as the indices
-        // have been used when we save the worksheets part.
-    }
+/*
+ * The table is written with the writer of <sheetData>, which escapes the
+ * strings by blocks; the <rPr> of each font is only built once.
+ */
+void SharedStrings::saveToXmlFile(QIODevice *device) const
+{
+    updateSaveIndices();
 
-    writer.writeStartDocument(QStringLiteral("1.0"), true);
-    writer.writeStartElement(QStringLiteral("sst"));
-    writer.writeAttribute(
-        QStringLiteral("xmlns"),
-        QStringLiteral("http://schemas.openxmlformats.org/spreadsheetml/2006/main"));
-    writer.writeAttribute(QStringLiteral("count"), QString::number(m_stringCount));
-    writer.writeAttribute(QStringLiteral("uniqueCount"), QString::number(m_stringList.size()));
+    SheetDataWriter writer(device);
+    writer.writeRaw("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                    "<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\""
+                    " count=\"");
+    writer.writeInt(m_stringCount);
+    writer.writeRaw("\" uniqueCount=\"");
+    writer.writeInt(m_saveCount);
+    writer.writeRaw("\">");
 
-    foreach (RichString string, m_stringList) {
-        writer.writeStartElement(QStringLiteral("si"));
-        if (string.isRichString()) {
+    QHash<quint64, QByteArray> fontXml;
+    for (int idx = 0; idx < m_strings.size(); ++idx) {
+        if (m_saveIndices[idx] == -1)
+            continue;
+        const XlsxSharedStringInfo &item = m_strings[idx];
+        writer.writeRaw("<si>");
+        if (item.rich) {
+            const RichString string = m_richStrings.value(idx);
             // Rich text string
             for (int i = 0; i < string.fragmentCount(); ++i) {
-                writer.writeStartElement(QStringLiteral("r"));
-                if (string.fragmentFormat(i).hasFontData()) {
-                    writer.writeStartElement(QStringLiteral("rPr"));
-                    writeRichStringPart_rPr(writer, string.fragmentFormat(i));
-                    writer.writeEndElement(); // rPr
+                writer.writeRaw("<r>");
+                const Format format = string.fragmentFormat(i);
+                if (format.hasFontData()) {
+                    const quint64 fingerprint = format.fontFingerprint();
+                    QHash<quint64, QByteArray>::iterator it = fontXml.find(fingerprint);
+                    if (it == fontXml.end())
+                        it = fontXml.insert(fingerprint, richStringPart_rPrXml(format));
+                    writer.writeRaw(it.value().constData(), it.value().size());
                 }
-                writer.writeStartElement(QStringLiteral("t"));
-                if (isSpaceReserveNeeded(string.fragmentText(i)))
-                    writer.writeAttribute(QStringLiteral("xml:space"), QStringLiteral("preserve"));
-                writer.writeCharacters(string.fragmentText(i));
-                writer.writeEndElement(); // t
-
-                writer.writeEndElement(); // r
+                writer.writeTextElement(string.fragmentText(i));
+                writer.writeRaw("</r>");
             }
         } else {
-            writer.writeStartElement(QStringLiteral("t"));
-            QString pString = string.toPlainString();
-            if (isSpaceReserveNeeded(pString))
-                writer.writeAttribute(QStringLiteral("xml:space"), QStringLiteral("preserve"));
-            writer.writeCharacters(pString);
-            writer.writeEndElement(); // t
+            writer.writeTextElement(item.text);
         }
-        writer.writeEndElement(); // si
+        writer.writeRaw("</si>");
     }
 
-    writer.writeEndElement(); // sst
-    writer.writeEndDocument();
+    writer.writeRaw("</sst>");
 }
 
-void SharedStrings::readString(QXmlStreamReader &reader)
+/*
+ * Read the <si> element the \a reader is on. Reading doesn't change the
+ * table, so the strings can be read by several threads.
+ */
+RichString SharedStrings::readString(QXmlStreamReader &reader) const
 {
     Q_ASSERT(reader.name() == QLatin1String("si"));
 
@@ -277,15 +740,51 @@ void SharedStrings::readString(QXmlStreamReader &reader)
                 readRichStringPart(reader, richString);
             else if (reader.name() == QLatin1String("t"))
                 readPlainStringPart(reader, richString);
+            else if (reader.name() == QLatin1String("rPh")) // phonetic run
+                reader.skipCurrentElement();
         }
     }
 
-    int idx = m_stringList.size();
-    m_stringTable[richString] = XlsxSharedStringInfo(idx, 0);
-    m_stringList.append(richString);
+    return richString;
 }
 
-void SharedStrings::readRichStringPart(QXmlStreamReader &reader, RichString &richString)
+/*
+ * \overload
+ * Read the <si> element the native \a parser is on. The run properties
+ * are read by QXmlStreamReader from the bytes of their <rPr> element, and
+ * the phonetic runs are skipped.
+ */
+RichString SharedStrings::readString(XmlPullParser &parser) const
+{
+    Q_ASSERT(parser.isName("si"));
+
+    RichString richString;
+    while (parser.readNextStartElement()) {
+        if (parser.isName("t")) {
+            richString.addFragment(parser.readElementText(), Format());
+        } else if (parser.isName("r")) {
+            QString text;
+            Format format;
+            while (parser.readNextStartElement()) {
+                if (parser.isName("rPr")) {
+                    QXmlStreamReader reader(parser.readElementXml());
+                    if (reader.readNextStartElement())
+                        format = readRichStringPart_rPr(reader);
+                } else if (parser.isName("t")) {
+                    text = parser.readElementText();
+                } else {
+                    parser.skipCurrentElement();
+                }
+            }
+            richString.addFragment(text, format);
+        } else {
+            parser.skipCurrentElement();
+        }
+    }
+    return richString;
+}
+
+void SharedStrings::readRichStringPart(QXmlStreamReader &reader, RichString &richString) const
 {
     Q_ASSERT(reader.name() == QLatin1String("r"));
 
@@ -306,7 +805,7 @@ void SharedStrings::readRichStringPart(QXmlStreamReader &reader, RichString &ric
     richString.addFragment(text, format);
 }
 
-void SharedStrings::readPlainStringPart(QXmlStreamReader &reader, RichString &richString)
+void SharedStrings::readPlainStringPart(QXmlStreamReader &reader, RichString &richString) const
 {
     Q_ASSERT(reader.name() == QLatin1String("t"));
 
@@ -381,6 +880,14 @@ Format SharedStrings::readRichStringPart_rPr(QXmlStreamReader &reader)
     return format;
 }
 
+/*
+ * The strings of the table are its elements.
+ */
+qint64 SharedStrings::elementCount() const
+{
+    return count();
+}
+
 bool SharedStrings::loadFromXmlFile(QIODevice *device)
 {
     QXmlStreamReader reader(device);
@@ -394,22 +901,275 @@ bool SharedStrings::loadFromXmlFile(QIODevice *device)
                 if ((hasUniqueCountAttr = attributes.hasAttribute(QLatin1String("uniqueCount"))))
                     count = attributes.value(QLatin1String("uniqueCount")).toString().toInt();
             } else if (reader.name() == QLatin1String("si")) {
-                readString(reader);
+                // Referenced by the worksheets once they are loaded.
+                const RichString richString = readString(reader);
+                addString(richString.toPlainString(), richString, 0);
+            }
+        }
+    }
+    m_lookupTablesValid = false;
+
+    if (hasUniqueCountAttr && m_strings.size() != count) {
+        qDebug("Error: Shared string count");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+  Write the table as the BIFF12 records of a sharedStrings.bin part. The
+  runs of the rich strings would refer to the fonts of the styles, which
+  don't hold the fonts of the runs, so only their text is written.
+ */
+void SharedStrings::saveToBinaryFile(QIODevice *device) const
+{
+    updateSaveIndices();
+
+    Biff12Writer writer(device);
+    writer.beginRecord(BrtBeginSst);
+    writer.writeUInt32(m_stringCount);
+    writer.writeUInt32(m_saveCount);
+    writer.endRecord();
+    for (int idx = 0; idx < m_strings.size(); ++idx) {
+        if (m_saveIndices[idx] == -1)
+            continue;
+        writer.beginRecord(BrtSSTItem);
+        writer.writeUInt8(0); // neither rich nor phonetic
+        writer.writeString(m_strings[idx].text);
+        writer.endRecord();
+    }
+    writer.writeRecord(BrtEndSst);
+}
+
+/*
+  Read the table from the BIFF12 records of a sharedStrings.bin part. The
+  runs of the rich strings take the fonts of \a styles, which is loaded
+  first.
+ */
+bool SharedStrings::loadFromBinaryData(const QByteArray &data, const Styles *styles)
+{
+    Biff12Reader reader(data);
+    int count = -1;
+    while (reader.readNext()) {
+        if (reader.recordType() == BrtBeginSst) {
+            reader.skip(4);
+            count = reader.readInt32();
+        } else if (reader.recordType() == BrtSSTItem) {
+            const quint8 flags = reader.readUInt8();
+            const QString text = reader.readString();
+            RichString richString;
+            if (flags & 0x01) {
+                const int runCount = reader.readInt32();
+                QVector<int> starts;
+                QVector<int> fonts;
+                for (int i = 0; i < runCount && !reader.hasError(); ++i) {
+                    starts.append(qBound(0, int(reader.readUInt16()), text.size()));
+                    fonts.append(reader.readUInt16());
+                }
+                if (!starts.isEmpty() && starts.first() > 0)
+                    richString.addFragment(text.left(starts.first()), Format());
+                for (int i = 0; i < starts.size(); ++i) {
+                    const int end = i + 1 < starts.size() ? starts[i + 1] : text.size();
+                    const Format font = styles->fontFormat(fonts[i]);
+                    Format format;
+                    for (int id = FormatPrivate::P_Font_STARTID; id < FormatPrivate::P_Font_ENDID;
+                         ++id) {
+                        if (font.hasProperty(id))
+                            format.setProperty(id, font.property(id));
+                    }
+                    if (end > starts[i])
+                        richString.addFragment(text.mid(starts[i], end - starts[i]), format);
+                }
             }
+            // Referenced by the worksheets once they are loaded.
+            addString(text, richString, 0);
         }
     }
+    m_lookupTablesValid = false;
 
-    if (hasUniqueCountAttr && m_stringList.size() != count) {
+    if (reader.hasError() || (count != -1 && m_strings.size() != count)) {
         qDebug("Error: Shared string count");
         return false;
     }
+    return true;
+}
+
+namespace {
+
+/*
+  Read the <si> elements of one slice of the table, a run of sibling
+  elements which the native parser reads without a root element.
+ */
+class ReadStringsTask : public QRunnable
+{
+public:
+    ReadStringsTask(const SharedStrings *sst, const QByteArray &slice)
+        : m_sst(sst)
+        , m_slice(slice)
+        , m_ok(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        XmlPullParser parser(m_slice);
+        while (parser.readNextStartElement()) {
+            if (parser.isName("si"))
+                m_strings.append(m_sst->readString(parser));
+            else
+                parser.skipCurrentElement();
+        }
+        m_ok = parser.tokenType() == XmlPullParser::EndDocument;
+    }
+
+    const SharedStrings *m_sst;
+    QByteArray m_slice;
+    QVector<RichString> m_strings;
+    bool m_ok;
+};
+
+/*
+  Returns the position of the first "<si" start tag at or after \a from,
+  or -1. A '<' can't appear in text or attribute values, so every match
+  is a tag.
+ */
+int findStringStart(const QByteArray &data, int from, int to)
+{
+    while ((from = data.indexOf("<si", from)) != -1 && from + 3 < to) {
+        const char c = data.at(from + 3);
+        if (c == '>' || c == '/' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            return from;
+        from += 3;
+    }
+    return -1;
+}
+
+} // namespace
 
-    if (m_stringList.size() != m_stringTable.size()) {
-        // qDebug("Warning: Duplicated items exist in shared string table.");
-        // Nothing we can do here, as indices of the strings will be used when loading sheets.
+/*
+ * The tables of several million strings are cut into slices at <si>
+ * boundaries, found by a plain byte scan, and the slices are read by
+ * several threads. The other tables are read by the native XmlPullParser,
+ * or by loadFromXmlFile() when they aren't in UTF-8 or use prefixed
+ * elements.
+ */
+bool SharedStrings::loadFromXmlData(const QByteArray &data)
+{
+    const int threadCount = QThread::idealThreadCount();
+    bool ok = true;
+    if (data.size() < 4 * 1024 * 1024 || threadCount < 2 || !loadFromXmlDataInParallel(data)) {
+        if (!loadFromXmlDataNatively(data, &ok))
+            return AbstractOOXmlFile::loadFromXmlData(data);
     }
 
+    setDirty(false);
+    return ok;
+}
+
+/*
+ * Returns false, without changing the table, if \a data can't be read by
+ * the native parser. Otherwise \a ok is set to false if the count of the
+ * strings is wrong, the same as loadFromXmlFile().
+ */
+bool SharedStrings::loadFromXmlDataNatively(const QByteArray &data, bool *ok)
+{
+    if (!XmlPullParser::canParse(data))
+        return false;
+
+    XmlPullParser parser(data);
+    if (!parser.readNextStartElement() || !parser.isName("sst"))
+        return false;
+
+    const bool hasUniqueCountAttr = parser.hasAttribute("uniqueCount");
+    const int count = parser.attributeInt("uniqueCount");
+    while (parser.readNextStartElement()) {
+        if (parser.isName("si")) {
+            // Referenced by the worksheets once they are loaded.
+            const RichString richString = readString(parser);
+            addString(richString.toPlainString(), richString, 0);
+        } else {
+            parser.skipCurrentElement();
+        }
+    }
+    m_lookupTablesValid = false;
+
+    *ok = !hasUniqueCountAttr || m_strings.size() == count;
+    if (!*ok)
+        qDebug("Error: Shared string count");
     return true;
 }
 
+/*
+ * Returns false, without changing the table, if \a data isn't simple
+ * enough to be sliced.
+ */
+bool SharedStrings::loadFromXmlDataInParallel(const QByteArray &data)
+{
+    // Comments and CDATA sections could contain anything
+    if (data.contains("<!--") || data.contains("<![CDATA["))
+        return false;
+
+    int count = -1;
+    {
+        QXmlStreamReader reader(data);
+        while (!reader.atEnd()) {
+            if (reader.readNext() == QXmlStreamReader::StartElement) {
+                if (reader.name() != QLatin1String("sst"))
+                    return false;
+                QXmlStreamAttributes attributes = reader.attributes();
+                if (attributes.hasAttribute(QLatin1String("uniqueCount")))
+                    count = attributes.value(QLatin1String("uniqueCount")).toString().toInt();
+                break;
+            }
+        }
+    }
+
+    const int end = data.lastIndexOf("</sst");
+    const int begin = findStringStart(data, 0, end);
+    if (begin == -1)
+        return false; // Prefixed or empty table
+
+    const int sliceCount = QThread::idealThreadCount();
+    QList<ReadStringsTask *> tasks;
+    QThreadPool pool;
+    int sliceBegin = begin;
+    for (int i = 1; i <= sliceCount && sliceBegin != -1; ++i) {
+        int sliceEnd = end;
+        if (i < sliceCount) {
+            const int target = begin + int(qint64(end - begin) * i / sliceCount);
+            sliceEnd = findStringStart(data, qMax(sliceBegin + 1, target), end);
+        }
+        const int size = (sliceEnd == -1 ? end : sliceEnd) - sliceBegin;
+        ReadStringsTask *task =
+            new ReadStringsTask(this, QByteArray::fromRawData(data.constData() + sliceBegin, size));
+        tasks.append(task);
+        pool.start(task);
+        sliceBegin = sliceEnd;
+    }
+    pool.waitForDone();
+
+    bool ok = true;
+    int total = 0;
+    foreach (ReadStringsTask *task, tasks) {
+        ok = ok && task->m_ok;
+        total += task->m_strings.size();
+    }
+    // Let loadFromXmlFile() report the wrong counts
+    if (count != -1 && total != count)
+        ok = false;
+
+    if (ok) {
+        m_strings.reserve(total);
+        foreach (ReadStringsTask *task, tasks) {
+            foreach (const RichString &richString, task->m_strings)
+                addString(richString.toPlainString(), richString, 0);
+        }
+        m_lookupTablesValid = false;
+    }
+    qDeleteAll(tasks);
+    return ok;
+}
+
 } // namespace
@@ -40,8 +40,11 @@
 #include "xlsxrichstring.h"
 #include "xlsxabstractooxmlfile.h"
 #include <QHash>
+#include <QMutex>
+#include <QScopedPointer>
 #include <QStringList>
 #include <QSharedPointer>
+#include <QVector>
 
 class QIODevice;
 class QXmlStreamReader;
@@ -49,50 +52,116 @@ class QXmlStreamWriter;
 
 namespace QXlsx {
 
+class Styles;
+class XmlPullParser;
+
 class XlsxSharedStringInfo
 {
 public:
-    XlsxSharedStringInfo(int index = 0, int count = 1)
-        : index(index)
+    XlsxSharedStringInfo(const QString &text = QString(), int count = 1, bool rich = false)
+        : text(text)
         , count(count)
+        , rich(rich)
+        , used(true)
     {
     }
 
-    int index;
+    QString text; // plain text, the rich string itself is stored apart
     int count;
+    bool rich;
+    bool used; // false once the slot has been released
 };
 
 class XLSX_AUTOTEST_EXPORT SharedStrings : public AbstractOOXmlFile
 {
 public:
     SharedStrings(CreateFlag flag);
+    SharedStrings *clone() const;
+    void setThreadSafe(bool enable);
     int count() const;
+    int slotCount() const;
     bool isEmpty() const;
+    bool hasRichStrings() const;
+    qint64 memoryUsage() const;
 
     int addSharedString(const QString &string);
     int addSharedString(const RichString &string);
     void removeSharedString(const QString &string);
     void removeSharedString(const RichString &string);
     void incRefByStringIndex(int idx);
+    void incRefByStringIndex(int idx, int count);
+    void decRefByStringIndex(int idx);
 
     int getSharedStringIndex(const QString &string) const;
     int getSharedStringIndex(const RichString &string) const;
     RichString getSharedString(int index) const;
+    QString getSharedPlainString(int index) const;
     QList<RichString> getSharedStrings() const;
 
+    void disableCompaction();
+    bool compact(QVector<int> *indexMap);
+    void updateSaveIndices() const;
+    bool hasStableIndices() const;
+    int saveIndex(int index) const;
+    int saveIndexGeneration() const;
+    int firstChangedSaveIndex(int generation) const;
+
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
+    qint64 elementCount() const;
+    bool loadFromXmlData(const QByteArray &data);
+    void saveToBinaryFile(QIODevice *device) const;
+    bool loadFromBinaryData(const QByteArray &data, const Styles *styles);
+
+    RichString readString(QXmlStreamReader &reader) const; // <si>
+    RichString readString(XmlPullParser &parser) const;
+    // Also used for the runs of the rich inline strings of the worksheets
+    static Format readRichStringPart_rPr(QXmlStreamReader &reader);
+    static void writeRichStringPart_rPr(QXmlStreamWriter &writer, const Format &format);
+    static QByteArray richStringPart_rPrXml(const Format &format);
 
 private:
-    void readString(QXmlStreamReader &reader); // <si>
-    void readRichStringPart(QXmlStreamReader &reader, RichString &rich); // <r>
-    void readPlainStringPart(QXmlStreamReader &reader, RichString &rich); // <v>
-    Format readRichStringPart_rPr(QXmlStreamReader &reader);
-    void writeRichStringPart_rPr(QXmlStreamWriter &writer, const Format &format) const;
-
-    QHash<RichString, XlsxSharedStringInfo> m_stringTable; // for fast lookup
-    QList<RichString> m_stringList;
+    int addSharedStringLocked(const QString &string);
+    void incRefByStringIndexLocked(int idx, int count);
+    int getSharedStringIndexLocked(const QString &string) const;
+    int getSharedStringIndexLocked(const RichString &string) const;
+    RichString getSharedStringLocked(int index) const;
+    void updateSaveIndicesLocked() const;
+    int addString(const QString &text, const RichString &richString, int refCount);
+    RichString internRunFormats(const RichString &richString);
+    void releaseString(int index);
+    void buildLookupTables() const;
+    bool loadFromXmlDataInParallel(const QByteArray &data);
+    bool loadFromXmlDataNatively(const QByteArray &data, bool *ok);
+    void readRichStringPart(QXmlStreamReader &reader, RichString &rich) const; // <r>
+    void readPlainStringPart(QXmlStreamReader &reader, RichString &rich) const; // <v>
+
+    // Strings are stored in slots whose index never changes, so that the
+    // cells can keep them. Released slots are reused, and only the
+    // referenced slots are written, their indexes being compacted.
+    QVector<XlsxSharedStringInfo> m_strings;
+    // The lookup tables are only built once a string is added or looked
+    // up, not when the table is loaded.
+    mutable QHash<QString, int> m_plainStringTable; // for fast lookup
+    mutable QHash<RichString, int> m_richStringTable;
+    mutable bool m_lookupTablesValid;
+    QHash<int, RichString> m_richStrings;
+    // One Format for all the runs with the same properties, by fingerprint
+    QHash<quint64, Format> m_runFormats;
+    QVector<int> m_freeSlots;
     int m_stringCount;
+
+    bool m_compactionEnabled;
+    mutable bool m_saveIndicesDirty;
+    mutable QVector<int> m_saveIndices;
+    mutable int m_saveCount;
+    // The first string whose saved index changed, for each update of the
+    // saved indexes, see firstChangedSaveIndex()
+    mutable QVector<int> m_saveIndexChanges;
+
+    // Only set in thread safe mode. It isn't recursive, the public
+    // functions only call the ...Locked() helpers.
+    QScopedPointer<QMutex> m_mutex;
 };
 }
 #endif // XLSXSHAREDSTRINGS_H
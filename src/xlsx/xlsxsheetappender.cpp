@@ -0,0 +1,536 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxsheetappender.h"
+#include "xlsxsheetappender_p.h"
+#include "xlsxsheetdatawriter_p.h"
+#include "xlsxzipreader_p.h"
+#include "xlsxzipwriter_p.h"
+#include "xlsxutility_p.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+const int MaxRows = 1048576;
+const int MaxColumns = 16384;
+const int ChunkSize = 64 * 1024;
+// Kept back while looking for </sheetData>, long enough for it and for
+// the beginning of a <row> tag
+const int Overlap = 64;
+
+/*
+  Returns the r attribute of the last <row> tag which starts before \a end
+  in \a data, or 0 if there is none.
+ */
+int lastRowNumber(const QByteArray &data, int end)
+{
+    if (end <= 0)
+        return 0;
+    const int pos = data.lastIndexOf("<row ", end - 1);
+    if (pos == -1)
+        return 0;
+    const int tagEnd = data.indexOf('>', pos);
+    const int attr = data.indexOf(" r=\"", pos);
+    if (attr == -1 || (tagEnd != -1 && attr > tagEnd))
+        return 0;
+    int row = 0;
+    for (int i = attr + 4; i < data.size() && data[i] >= '0' && data[i] <= '9'; ++i)
+        row = row * 10 + (data[i] - '0');
+    return row;
+}
+
+} // namespace
+
+SheetAppenderPrivate::SheetAppenderPrivate(SheetAppender *p)
+    : package(0)
+    , lastRow(0)
+    , lastColumn(0)
+    , q_ptr(p)
+{
+}
+
+SheetAppenderPrivate::~SheetAppenderPrivate()
+{
+}
+
+/*
+  Find the sheet \a sheetName, and the last row it stores, from the part
+  of the sheet which comes before its rows.
+ */
+void SheetAppenderPrivate::init(const QString &sheetName)
+{
+    sheetPath.clear();
+    lastRow = 0;
+    dimension = CellRange();
+    if (!package.zipReader || !package.openPackage())
+        return;
+    const int index = sheetName.isEmpty() ? 0 : package.sheetNames.indexOf(sheetName);
+    if (index < 0 || index >= package.sheetPaths.size())
+        return;
+    package.sheetIndex = index;
+
+    QScopedPointer<QIODevice> sheet(package.zipReader->openFile(package.sheetPaths[index]));
+    QByteArray head;
+    const int headEnd = sheet ? readSheetHead(sheet.data(), &head) : -1;
+    if (headEnd == -1)
+        return;
+    sheetPath = package.sheetPaths[index];
+
+    const int pos = head.lastIndexOf("<dimension ", headEnd);
+    const int ref = pos == -1 ? -1 : head.indexOf("ref=\"", pos);
+    if (ref != -1 && ref < headEnd) {
+        const int refEnd = head.indexOf('"', ref + 5);
+        dimension = CellRange(QString::fromLatin1(head.mid(ref + 5, refEnd - ref - 5)));
+    }
+
+    // Excel writes A1 as the dimension of empty sheets, their sheet data
+    // is an empty element
+    if (head[headEnd - 2] == '/')
+        lastRow = 0;
+    else if (dimension.isValid())
+        lastRow = dimension.lastRow();
+    else
+        lastRow = scanLastRow();
+}
+
+/*
+  Read the beginning of the \a sheet into \a head, at least up to the
+  <sheetData> tag. Returns the offset following the tag, or -1 if the
+  sheet has no sheet data.
+ */
+int SheetAppenderPrivate::readSheetHead(QIODevice *sheet, QByteArray *head) const
+{
+    int pos = 0;
+    forever {
+        const int tag = head->indexOf("<sheetData", pos);
+        if (tag != -1) {
+            const int tagEnd = head->indexOf('>', tag);
+            if (tagEnd != -1)
+                return tagEnd + 1;
+        } else {
+            pos = qMax(0, head->size() - 16);
+        }
+        const QByteArray chunk = sheet->read(ChunkSize);
+        if (chunk.isEmpty())
+            return -1;
+        head->append(chunk);
+    }
+}
+
+/*
+  Find the last row of a sheet which has no <dimension>, by inflating it
+  once without parsing it.
+ */
+int SheetAppenderPrivate::scanLastRow() const
+{
+    QScopedPointer<QIODevice> sheet(package.zipReader->openFile(sheetPath));
+    if (!sheet)
+        return 0;
+    int row = 0;
+    QByteArray data;
+    forever {
+        const QByteArray chunk = sheet->read(ChunkSize);
+        if (chunk.isEmpty())
+            break;
+        data.append(chunk);
+        const int size = qMax(0, data.size() - Overlap);
+        row = qMax(row, lastRowNumber(data, size));
+        data.remove(0, size);
+    }
+    return qMax(row, lastRowNumber(data, data.size()));
+}
+
+/*
+  Returns the first \a headEnd bytes of \a head, with the <dimension>
+  grown to cover the appended rows, and an empty <sheetData/> opened so
+  that the rows can follow it.
+ */
+QByteArray SheetAppenderPrivate::updatedHead(const QByteArray &head, int headEnd) const
+{
+    QByteArray result = head.left(headEnd);
+    if (result.endsWith("/>"))
+        result.replace(result.size() - 2, 2, ">");
+    if (rows.isEmpty() || lastColumn == 0 || !dimension.isValid())
+        return result;
+
+    CellRange range(lastRow + 1, 1, lastRow + rows.size(), lastColumn);
+    if (lastRow > 0) {
+        range = CellRange(qMin(range.firstRow(), dimension.firstRow()),
+                          qMin(range.firstColumn(), dimension.firstColumn()),
+                          qMax(range.lastRow(), dimension.lastRow()),
+                          qMax(range.lastColumn(), dimension.lastColumn()));
+    }
+    const int pos = result.lastIndexOf("<dimension ");
+    const int ref = result.indexOf("ref=\"", pos) + 5;
+    const int refEnd = result.indexOf('"', ref);
+    result.replace(ref, refEnd - ref, range.toString().toLatin1());
+    return result;
+}
+
+/*
+  Write the appended rows with \a writer. Numbers, booleans and dates are
+  written as values, everything else as inline strings, so that neither
+  the shared strings nor the styles of the package have to be changed.
+ */
+void SheetAppenderPrivate::saveRows(SheetDataWriter &writer) const
+{
+    writer.reserveColumns(lastColumn);
+    for (int i = 0; i < rows.size(); ++i) {
+        const QList<QVariant> &values = rows[i];
+        const int row = lastRow + 1 + i;
+        bool started = false;
+        for (int col = 0; col < values.size(); ++col) {
+            const QVariant &value = values[col];
+            if (!value.isValid())
+                continue;
+            if (!started) {
+                writer.writeRaw("<row r=\"");
+                writer.writeInt(row);
+                writer.writeRaw("\">");
+                started = true;
+            }
+            writer.writeRaw("<c r=\"");
+            writer.writeCellReference(row, col + 1);
+            switch (value.userType()) {
+            case QMetaType::Bool:
+                writer.writeRaw("\" t=\"b\"><v>");
+                writer.writeRaw(value.toBool() ? "1" : "0", 1);
+                break;
+            case QMetaType::Int:
+            case QMetaType::UInt:
+            case QMetaType::LongLong:
+            case QMetaType::ULongLong:
+            case QMetaType::Double:
+            case QMetaType::Float:
+                writer.writeRaw("\"><v>");
+                writer.writeDouble(value.toDouble());
+                break;
+            case QMetaType::QDate:
+            case QMetaType::QDateTime:
+                writer.writeRaw("\"><v>");
+                writer.writeDouble(datetimeToNumber(value.toDateTime(), package.date1904));
+                break;
+            case QMetaType::QTime:
+                writer.writeRaw("\"><v>");
+                writer.writeDouble(timeToNumber(value.toTime()));
+                break;
+            default: {
+                const QString text = value.toString();
+                writer.writeRaw("\" t=\"inlineStr\"><is>");
+                writer.writeTextElement(text);
+                writer.writeRaw("</is></c>");
+                continue;
+            }
+            }
+            writer.writeRaw("</v></c>");
+        }
+        if (started)
+            writer.writeRaw("</row>");
+    }
+    writer.flush();
+}
+
+/*
+  Copy the sheet to \a output, the appended rows being written in front
+  of </sheetData>. The existing rows are only searched for the end of
+  the sheet data and for their numbers, which must come before the
+  appended rows. Returns false if the sheet can't be appended to.
+ */
+bool SheetAppenderPrivate::saveSheet(QIODevice *output) const
+{
+    QScopedPointer<QIODevice> sheet(package.zipReader->openFile(sheetPath));
+    if (!sheet)
+        return false;
+    QByteArray data;
+    const int headEnd = readSheetHead(sheet.data(), &data);
+    if (headEnd == -1)
+        return false;
+    const bool emptySheetData = data[headEnd - 2] == '/';
+    output->write(updatedHead(data, headEnd));
+    data.remove(0, headEnd);
+
+    SheetDataWriter writer(output);
+    if (emptySheetData) {
+        saveRows(writer);
+        output->write("</sheetData>");
+    } else {
+        int end;
+        while ((end = data.indexOf("</sheetData>")) == -1) {
+            const int size = qMax(0, data.size() - Overlap);
+            if (lastRowNumber(data, size) > lastRow)
+                return false;
+            output->write(data.constData(), size);
+            data.remove(0, size);
+            const QByteArray chunk = sheet->read(ChunkSize);
+            if (chunk.isEmpty())
+                return false;
+            data.append(chunk);
+        }
+        if (lastRowNumber(data, end) > lastRow)
+            return false;
+        output->write(data.constData(), end);
+        data.remove(0, end);
+        saveRows(writer);
+    }
+
+    // What follows the sheet data is copied as it is
+    while (!data.isEmpty()) {
+        output->write(data);
+        data = sheet->read(ChunkSize);
+    }
+    return true;
+}
+
+/*
+  Write the package to \a device. All the parts but the sheet are copied
+  without being inflated, unless they are stored in the source package.
+ */
+bool SheetAppenderPrivate::savePackage(QIODevice *device) const
+{
+    ZipWriter zipWriter(device);
+    foreach (const QString &path, package.zipReader->filePaths()) {
+        if (path == sheetPath) {
+            QIODevice *output = zipWriter.beginFile(path);
+            const bool appended = saveSheet(output);
+            zipWriter.endFile();
+            if (!appended) {
+                qWarning("The rows of %s don't end with the last row of its dimension",
+                         qPrintable(path));
+                return false;
+            }
+            continue;
+        }
+        QByteArray data;
+        ZipFileInfo info;
+        if (package.zipReader->rawFileData(path, &data, &info))
+            zipWriter.addRawFile(path, data, info.crc, info.uncompressedSize);
+        else
+            zipWriter.addFile(path, package.zipReader->fileData(path));
+    }
+    zipWriter.close();
+    return !zipWriter.error();
+}
+
+/*!
+  \class SheetAppender
+  \inmodule QtXlsx
+  \brief The SheetAppender class adds rows at the end of a worksheet of
+  an existing .xlsx file.
+
+  Unlike Document, which loads the whole workbook before it can be
+  saved again, SheetAppender never parses the cells of the worksheet. When
+  the package is saved, the worksheet is streamed through while it's being
+  inflated, the new rows are written in front of the end of its sheet
+  data, and its dimension is updated. The other parts of the package are
+  copied as they are, without even being inflated.
+
+  \code
+  SheetAppender appender("Log.xlsx", "Events");
+  appender.appendRow(QList<QVariant>() << QDateTime::currentDateTime() << "Started" << 1);
+  appender.save();
+  \endcode
+
+  The rows follow lastRow(), the last row stored in the worksheet.
+  Strings are stored as inline strings and no cell has a format, since the
+  shared strings and the styles of the package are left untouched, so
+  dates and times are written as their serial numbers.
+*/
+
+/*!
+  Opens the worksheet \a sheetName of the .xlsx file \a xlsxName to append
+  rows to it. The first worksheet is used if \a sheetName is empty.
+ */
+SheetAppender::SheetAppender(const QString &xlsxName, const QString &sheetName)
+    : d_ptr(new SheetAppenderPrivate(this))
+{
+    Q_D(SheetAppender);
+    d->fileName = xlsxName;
+    d->package.file.reset(new QFile(xlsxName));
+    if (d->package.file->open(QIODevice::ReadOnly)) {
+        d->package.zipReader.reset(new ZipReader(d->package.file.data()));
+        d->init(sheetName);
+    }
+}
+
+/*!
+  Opens the worksheet \a sheetName of the .xlsx package read from
+  \a device, which must be kept open until the rows have been saved.
+  The first worksheet is used if \a sheetName is empty.
+ */
+SheetAppender::SheetAppender(QIODevice *device, const QString &sheetName)
+    : d_ptr(new SheetAppenderPrivate(this))
+{
+    Q_D(SheetAppender);
+    if (device && device->isReadable()) {
+        d->package.zipReader.reset(new ZipReader(device));
+        d->init(sheetName);
+    }
+}
+
+/*!
+  Destroys the appender. The rows which have not been saved are lost.
+ */
+SheetAppender::~SheetAppender()
+{
+    delete d_ptr;
+}
+
+/*!
+  Returns true if the worksheet has been found, otherwise returns false.
+ */
+bool SheetAppender::isValid() const
+{
+    Q_D(const SheetAppender);
+    return !d->sheetPath.isEmpty();
+}
+
+/*!
+  Returns the names of the worksheets of the package.
+ */
+QStringList SheetAppender::sheetNames() const
+{
+    Q_D(const SheetAppender);
+    return d->package.sheetNames;
+}
+
+/*!
+  Returns the name of the worksheet the rows are appended to.
+ */
+QString SheetAppender::sheetName() const
+{
+    Q_D(const SheetAppender);
+    if (!isValid())
+        return QString();
+    return d->package.sheetNames[d->package.sheetIndex];
+}
+
+/*!
+  Returns the last row stored in the worksheet, or 0 if it's empty. This
+  is taken from the dimension of the worksheet when it has one.
+ */
+int SheetAppender::lastRow() const
+{
+    Q_D(const SheetAppender);
+    return d->lastRow;
+}
+
+/*!
+  Appends a row made of \a values, the first one going to the first
+  column. Invalid values leave their cell empty. Returns the number of
+  the row, or -1 if the worksheet is not valid or has no room left.
+ */
+int SheetAppender::appendRow(const QList<QVariant> &values)
+{
+    Q_D(SheetAppender);
+    if (!isValid() || d->lastRow + d->rows.size() >= MaxRows || values.size() > MaxColumns)
+        return -1;
+    d->rows.append(values);
+    for (int col = values.size(); col > d->lastColumn; --col) {
+        if (values[col - 1].isValid()) {
+            d->lastColumn = col;
+            break;
+        }
+    }
+    return d->lastRow + d->rows.size();
+}
+
+/*!
+  Returns the number of rows appended since the package was opened.
+ */
+int SheetAppender::appendedRowCount() const
+{
+    Q_D(const SheetAppender);
+    return d->rows.size();
+}
+
+/*!
+  Saves the package to the file it has been opened from. The appended
+  rows then become part of the worksheet, and further rows follow them.
+  Returns true if saved successfully.
+ */
+bool SheetAppender::save()
+{
+    Q_D(SheetAppender);
+    if (d->fileName.isEmpty())
+        return false;
+    return saveAs(d->fileName);
+}
+
+/*!
+  Saves the package to the file with the given \a name.
+  Returns true if saved successfully.
+ */
+bool SheetAppender::saveAs(const QString &name)
+{
+    Q_D(SheetAppender);
+    if (!isValid())
+        return false;
+    QSaveFile file(name);
+    if (!file.open(QIODevice::WriteOnly) || !saveAs(&file))
+        return false;
+    const bool replaced = !d->fileName.isEmpty()
+                          && QFileInfo(name).absoluteFilePath()
+                                 == QFileInfo(d->fileName).absoluteFilePath();
+    if (!replaced)
+        return file.commit();
+
+    // The source is closed before it's replaced, and opened again so that
+    // more rows can be appended. When it couldn't be replaced, the rows are
+    // kept for the next save. The appender is no longer valid if the source
+    // can't be opened again.
+    const QString sheet = sheetName();
+    d->package.zipReader.reset();
+    d->package.file->close();
+    const bool committed = file.commit();
+    if (committed) {
+        d->rows.clear();
+        d->lastColumn = 0;
+    }
+    d->package.sheetNames.clear();
+    d->package.sheetPaths.clear();
+    if (d->package.file->open(QIODevice::ReadOnly))
+        d->package.zipReader.reset(new ZipReader(d->package.file.data()));
+    d->init(sheet);
+    return committed;
+}
+
+/*!
+  \overload
+  Saves the package to the \a device.
+  Returns true if saved successfully.
+ */
+bool SheetAppender::saveAs(QIODevice *device)
+{
+    Q_D(SheetAppender);
+    if (!isValid() || !device || !device->isWritable())
+        return false;
+    return d->savePackage(device);
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,80 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QXLSX_XLSXSHEETAPPENDER_P_H
+#define QXLSX_XLSXSHEETAPPENDER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxsheetappender.h"
+#include "xlsxsheetreader_p.h"
+#include "xlsxcellrange.h"
+#include <QList>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class SheetDataWriter;
+
+class SheetAppenderPrivate
+{
+    Q_DECLARE_PUBLIC(SheetAppender)
+public:
+    SheetAppenderPrivate(SheetAppender *p);
+    ~SheetAppenderPrivate();
+
+    void init(const QString &sheetName);
+    int readSheetHead(QIODevice *sheet, QByteArray *head) const;
+    int scanLastRow() const;
+    QByteArray updatedHead(const QByteArray &head, int headEnd) const;
+    bool saveSheet(QIODevice *output) const;
+    void saveRows(SheetDataWriter &writer) const;
+    bool savePackage(QIODevice *device) const;
+
+    // Finds the parts of the package, the same way as the SheetReader
+    SheetReaderPrivate package;
+    QString fileName;
+    QString sheetPath;
+
+    int lastRow; // last row stored in the sheet, 0 if the sheet is empty
+    CellRange dimension; // as read from <dimension>, may be invalid
+    QList<QList<QVariant> > rows;
+    int lastColumn; // widest of the appended rows
+
+    SheetAppender *q_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXSHEETAPPENDER_P_H
@@ -0,0 +1,347 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxsheetdatawriter_p.h"
+#include "xlsxutility_p.h"
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XLSX_HAVE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define XLSX_HAVE_NEON
+#endif
+
+QT_BEGIN_NAMESPACE_XLSX
+
+SheetDataWriter::SheetDataWriter(QIODevice *device)
+    : m_device(device)
+    , m_capture(0)
+    , m_row(-1)
+    , m_rowDigitsSize(0)
+    , m_size(0)
+{
+}
+
+SheetDataWriter::~SheetDataWriter()
+{
+    flush();
+}
+
+/*
+  Write all the buffered data to the device.
+ */
+void SheetDataWriter::flush()
+{
+    if (m_size > 0) {
+        m_device->write(m_buffer, m_size);
+        if (m_capture)
+            m_capture->append(m_buffer, m_size);
+    }
+    m_size = 0;
+}
+
+/*
+  Also append the data written from now on to \a capture, until the capture
+  is set to 0. The data buffered before is written to the device first.
+ */
+void SheetDataWriter::setCapture(QByteArray *capture)
+{
+    flush();
+    m_capture = capture;
+}
+
+void SheetDataWriter::writeRaw(const char *data, int size)
+{
+    reserve(size);
+    if (size > BufferSize) {
+        m_device->write(data, size);
+        if (m_capture)
+            m_capture->append(data, size);
+        return;
+    }
+    memcpy(m_buffer + m_size, data, size);
+    m_size += size;
+}
+
+void SheetDataWriter::writeInt(qint64 value)
+{
+    char digits[24];
+    int pos = sizeof(digits);
+    quint64 number = value < 0 ? quint64(0) - quint64(value) : quint64(value);
+    do {
+        digits[--pos] = char('0' + number % 10);
+        number /= 10;
+    } while (number);
+    if (value < 0)
+        digits[--pos] = '-';
+    writeRaw(digits + pos, sizeof(digits) - pos);
+}
+
+/*
+  Write the shortest text which reads back as exactly \a value.
+ */
+void SheetDataWriter::writeDouble(double value)
+{
+    reserve(XLSX_DOUBLE_BUFFER_SIZE);
+    m_size += formatDouble(value, m_buffer + m_size);
+}
+
+/*
+  Prepare the column letter table for the columns up to \a lastColumn,
+  the entries are filled the first time a column is written.
+ */
+void SheetDataWriter::reserveColumns(int lastColumn)
+{
+    const ColumnName empty = {{0, 0, 0}, 0};
+    const int size = m_columnNames.size();
+    if (lastColumn >= size) {
+        m_columnNames.resize(lastColumn + 1);
+        for (int i = size; i <= lastColumn; ++i)
+            m_columnNames[i] = empty;
+    }
+}
+
+const SheetDataWriter::ColumnName &SheetDataWriter::columnName(int column)
+{
+    if (column >= m_columnNames.size())
+        reserveColumns(column);
+
+    ColumnName &name = m_columnNames[column];
+    if (name.size == 0) {
+        char letters[3];
+        int pos = sizeof(letters);
+        while (column > 0 && pos > 0) {
+            const int modulo = (column - 1) % 26;
+            letters[--pos] = char('A' + modulo);
+            column = (column - modulo) / 26;
+        }
+        name.size = char(sizeof(letters) - pos);
+        memcpy(name.letters, letters + pos, name.size);
+    }
+    return name;
+}
+
+/*
+  Write the A1 style reference of the cell at \a row and \a column.
+ */
+void SheetDataWriter::writeCellReference(int row, int column)
+{
+    if (row != m_row) {
+        int pos = sizeof(m_rowDigits);
+        uint number = uint(qMax(row, 0));
+        do {
+            m_rowDigits[--pos] = char('0' + number % 10);
+            number /= 10;
+        } while (number);
+        m_rowDigitsSize = sizeof(m_rowDigits) - pos;
+        memmove(m_rowDigits, m_rowDigits + pos, m_rowDigitsSize);
+        m_row = row;
+    }
+
+    Q_ASSERT(column > 0);
+    const ColumnName &name = columnName(column);
+    reserve(sizeof(name.letters) + sizeof(m_rowDigits));
+    char *out = m_buffer + m_size;
+    memcpy(out, name.letters, name.size);
+    memcpy(out + name.size, m_rowDigits, m_rowDigitsSize);
+    m_size += name.size + m_rowDigitsSize;
+}
+
+/*
+  Write the <t> element of \a text, with xml:space="preserve" when its
+  leading or trailing whitespaces must be kept.
+ */
+void SheetDataWriter::writeTextElement(const QString &text)
+{
+    if (isSpaceReserveNeeded(text))
+        writeRaw("<t xml:space=\"preserve\">");
+    else
+        writeRaw("<t>");
+    writeUtf8(text, false);
+    writeRaw("</t>");
+}
+
+namespace {
+
+inline bool isPlainAscii(ushort u, bool attribute)
+{
+    if (u >= 0x80 || u == '<' || u == '>' || u == '&' || u == '\r')
+        return false;
+    return !attribute || (u != '"' && u != '\n' && u != '\t');
+}
+
+/*
+  Copy the characters at the start of \a data which are written as they
+  are, ASCII characters which aren't escaped, to \a out, narrowing them to
+  bytes. Stops after \a size characters, and returns the number of
+  characters copied. 8 characters are checked and narrowed at a time with
+  SSE2 or NEON.
+ */
+int copyPlainAscii(const ushort *data, int size, char *out, bool attribute)
+{
+    int i = 0;
+#if defined(XLSX_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i nonAscii = _mm_set1_epi16(short(0xFF80));
+    const __m128i lt = _mm_set1_epi16('<');
+    const __m128i gt = _mm_set1_epi16('>');
+    const __m128i amp = _mm_set1_epi16('&');
+    const __m128i cr = _mm_set1_epi16('\r');
+    const __m128i quot = _mm_set1_epi16(attribute ? '"' : '<');
+    const __m128i lf = _mm_set1_epi16(attribute ? '\n' : '<');
+    const __m128i tab = _mm_set1_epi16(attribute ? '\t' : '<');
+    for (; i + 8 <= size; i += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i escaped = _mm_or_si128(_mm_cmpeq_epi16(chunk, lt), _mm_cmpeq_epi16(chunk, gt));
+        escaped = _mm_or_si128(escaped, _mm_cmpeq_epi16(chunk, amp));
+        escaped = _mm_or_si128(escaped, _mm_cmpeq_epi16(chunk, cr));
+        escaped = _mm_or_si128(escaped, _mm_cmpeq_epi16(chunk, quot));
+        escaped = _mm_or_si128(escaped, _mm_cmpeq_epi16(chunk, lf));
+        escaped = _mm_or_si128(escaped, _mm_cmpeq_epi16(chunk, tab));
+        const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(chunk, nonAscii), zero);
+        if (_mm_movemask_epi8(_mm_andnot_si128(escaped, ascii)) != 0xFFFF)
+            break;
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(chunk, chunk));
+    }
+#elif defined(XLSX_HAVE_NEON)
+    const uint16x8_t quot = vdupq_n_u16(attribute ? '"' : '<');
+    const uint16x8_t lf = vdupq_n_u16(attribute ? '\n' : '<');
+    const uint16x8_t tab = vdupq_n_u16(attribute ? '\t' : '<');
+    for (; i + 8 <= size; i += 8) {
+        const uint16x8_t chunk = vld1q_u16(data + i);
+        uint16x8_t escaped = vcgtq_u16(chunk, vdupq_n_u16(0x7F));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, vdupq_n_u16('<')));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, vdupq_n_u16('>')));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, vdupq_n_u16('&')));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, vdupq_n_u16('\r')));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, quot));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, lf));
+        escaped = vorrq_u16(escaped, vceqq_u16(chunk, tab));
+        const uint64x2_t lanes = vreinterpretq_u64_u16(escaped);
+        if (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1))
+            break;
+        vst1_u8(reinterpret_cast<uint8_t *>(out + i), vmovn_u16(chunk));
+    }
+#endif
+    // The rest, and the block which holds the first escaped character
+    for (; i < size && isPlainAscii(data[i], attribute); ++i)
+        out[i] = char(data[i]);
+    return i;
+}
+
+} // namespace
+
+/*
+  Write \a text as UTF-8, with the xml special characters escaped. The
+  quotes and the whitespaces which attribute values would normalize are
+  escaped too when the text is an \a attribute value. The runs of plain
+  ASCII characters, which most text is made of, are copied by blocks.
+ */
+void SheetDataWriter::writeUtf8(const QString &text, bool attribute)
+{
+    const ushort *data = text.utf16();
+    const int size = text.size();
+    int i = 0;
+    while (i < size) {
+        /* Keep room for the escaped character which ends the run: the
+           longest output of one character is "&quot;" or a 4 byte sequence.
+           Reserving twice that room leaves some for the run itself. */
+        const int escapedRoom = 16;
+        reserve(2 * escapedRoom);
+        const int room = BufferSize - m_size - escapedRoom;
+        const int count = qMin(size - i, room);
+        const int copied = copyPlainAscii(data + i, count, m_buffer + m_size, attribute);
+        m_size += copied;
+        i += copied;
+        if (copied == count)
+            continue;
+
+        char *out = m_buffer + m_size;
+        uint u = data[i];
+        if (u < 0x80) {
+            const char *entity;
+            switch (u) {
+            case '<':
+                entity = "&lt;";
+                break;
+            case '>':
+                entity = "&gt;";
+                break;
+            case '&':
+                entity = "&amp;";
+                break;
+            case '\r':
+                entity = "&#13;";
+                break;
+            case '"':
+                entity = "&quot;";
+                break;
+            case '\n':
+                entity = "&#10;";
+                break;
+            default: // '\t' of an attribute value
+                entity = "&#9;";
+                break;
+            }
+            const int entitySize = int(strlen(entity));
+            memcpy(out, entity, entitySize);
+            m_size += entitySize;
+            ++i;
+            continue;
+        }
+
+        const QChar ch(data[i]);
+        if (ch.isHighSurrogate() && i + 1 < size && QChar(data[i + 1]).isLowSurrogate())
+            u = QChar::surrogateToUcs4(data[i], data[++i]);
+        else if (ch.isSurrogate())
+            u = QChar::ReplacementCharacter;
+        ++i;
+
+        if (u < 0x800) {
+            out[0] = char(0xc0 | (u >> 6));
+            out[1] = char(0x80 | (u & 0x3f));
+            m_size += 2;
+        } else if (u < 0x10000) {
+            out[0] = char(0xe0 | (u >> 12));
+            out[1] = char(0x80 | ((u >> 6) & 0x3f));
+            out[2] = char(0x80 | (u & 0x3f));
+            m_size += 3;
+        } else {
+            out[0] = char(0xf0 | (u >> 18));
+            out[1] = char(0x80 | ((u >> 12) & 0x3f));
+            out[2] = char(0x80 | ((u >> 6) & 0x3f));
+            out[3] = char(0x80 | (u & 0x3f));
+            m_size += 4;
+        }
+    }
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,113 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXSHEETDATAWRITER_P_H
+#define XLSXSHEETDATAWRITER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QVector>
+
+class QByteArray;
+class QIODevice;
+class QString;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  A minimal UTF-8 xml emitter used for the <row>/<c>/<v> elements of
+  <sheetData>, which make up the bulk of a worksheet part, and for the
+  relationships and content types parts. Tags and
+  attribute names are written as precomposed bytes, numbers are formatted
+  without temporary strings, and only text payloads are escaped. The
+  output is collected in a fixed buffer and written to the device in
+  large blocks.
+
+  Cell references are the first thing written for every cell, so the
+  column letters are kept in a table which is filled once per column, and
+  the digits of the current row are reused by all the cells of the row.
+ */
+class XLSX_AUTOTEST_EXPORT SheetDataWriter
+{
+public:
+    explicit SheetDataWriter(QIODevice *device);
+    ~SheetDataWriter();
+
+    template <int N> void writeRaw(const char (&literal)[N]) { writeRaw(literal, N - 1); }
+    void writeRaw(const char *data, int size);
+    void writeInt(qint64 value);
+    void writeDouble(double value);
+    void writeCellReference(int row, int column);
+    void reserveColumns(int lastColumn);
+    void writeEscaped(const QString &text) { writeUtf8(text, false); }
+    void writeEscapedAttribute(const QString &text) { writeUtf8(text, true); }
+    void writeTextElement(const QString &text);
+
+    void flush();
+    void setCapture(QByteArray *capture);
+
+private:
+    Q_DISABLE_COPY(SheetDataWriter)
+
+    enum { BufferSize = 16 * 1024 };
+
+    inline void reserve(int size)
+    {
+        if (m_size + size > BufferSize)
+            flush();
+    }
+
+    struct ColumnName
+    {
+        char letters[3];
+        char size; // 0 if not computed yet
+    };
+
+    const ColumnName &columnName(int column);
+    void writeUtf8(const QString &text, bool attribute);
+
+    QIODevice *m_device;
+    QByteArray *m_capture;
+    QVector<ColumnName> m_columnNames;
+    int m_row;
+    int m_rowDigitsSize;
+    char m_rowDigits[12];
+    int m_size;
+    char m_buffer[BufferSize];
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXSHEETDATAWRITER_P_H
@@ -0,0 +1,221 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxsheetloader_p.h"
+#include "xlsxabstractsheet.h"
+#include "xlsxsharedstrings_p.h"
+#include "xlsxstyles_p.h"
+#include "xlsxutility_p.h"
+#include "xlsxworkbook_p.h"
+#include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxzipreader_p.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+// The background loads have a thread of their own each, so that they
+// don't hold up the tasks of the global thread pool for their whole run.
+Q_GLOBAL_STATIC(QThreadPool, backgroundLoadPool)
+
+class SheetLoaderTask : public QRunnable
+{
+public:
+    explicit SheetLoaderTask(SheetLoader *loader)
+        : m_loader(loader)
+    {
+    }
+
+    void run() { m_loader->run(); }
+
+private:
+    SheetLoader *m_loader;
+};
+
+} // namespace
+
+SheetLoader::SheetLoader(WorkbookPrivate *workbook, const QString &packageName)
+    : m_workbook(workbook)
+    , m_packageName(packageName)
+    , m_current(0)
+    , m_running(false)
+    , m_finished(false)
+{
+}
+
+/*
+  Drops the sheets which are still queued, and waits until the worker is
+  done with the sheet it's parsing.
+ */
+SheetLoader::~SheetLoader()
+{
+    QMutexLocker locker(&m_mutex);
+    m_queue.clear();
+    while (m_running)
+        m_sheetParsed.wait(&m_mutex);
+}
+
+/*
+  Parse \a sheets on the worker thread, in this order. The shared strings
+  and the styles, which the sheets being parsed look up, are locked until
+  all the sheets are loaded.
+ */
+void SheetLoader::start(const QList<AbstractSheet *> &sheets)
+{
+    m_workbook->sharedStrings->setThreadSafe(true);
+    m_workbook->styles->setThreadSafe(true);
+    m_queue = sheets;
+    m_running = true;
+    backgroundLoadPool()->start(new SheetLoaderTask(this));
+}
+
+/*
+  Called by the workbook before it loads \a sheet. Returns true if the
+  sheet has been parsed by the worker, after waiting for it when it's being
+  parsed. Returns false if the workbook has to parse the sheet itself, the
+  worker then leaves it alone.
+ */
+bool SheetLoader::takeSheet(AbstractSheet *sheet)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_queue.removeOne(sheet))
+        return false;
+    while (m_current == sheet)
+        m_sheetParsed.wait(&m_mutex);
+    return m_parsed.removeOne(sheet);
+}
+
+/*
+  Called by the workbook before it removes \a sheet, which is not loaded.
+ */
+void SheetLoader::dropSheet(AbstractSheet *sheet)
+{
+    takeSheet(sheet);
+    QMetaObject::invokeMethod(this, "loadParsedSheets", Qt::QueuedConnection);
+}
+
+/*
+  Called by the workbook once \a sheet is loaded, whichever loaded it.
+  The sheetLoaded() signal is emitted when the thread of the loader gets
+  control again.
+ */
+void SheetLoader::reportLoaded(AbstractSheet *sheet)
+{
+    m_loadedNames.append(sheet->sheetName());
+    QMetaObject::invokeMethod(this, "loadParsedSheets", Qt::QueuedConnection);
+}
+
+/*
+  Returns true once all the sheets have been loaded and reported.
+ */
+bool SheetLoader::isFinished() const
+{
+    return m_finished;
+}
+
+/*
+  Runs on the worker thread. Only the sheets themselves are parsed, with the
+  references to the shared strings counted by the sheets, as the drawings
+  add charts and pictures to the workbook.
+ */
+void SheetLoader::run()
+{
+    ZipReader zipReader(m_packageName);
+    // The sheets left are loaded on the thread of the loader when the
+    // package can't be read.
+    const bool readable = !zipReader.filePaths().isEmpty();
+    QMutexLocker locker(&m_mutex);
+    while (readable && !m_queue.isEmpty()) {
+        m_current = m_queue.takeFirst();
+        locker.unlock();
+
+        AbstractSheet *sheet = m_current;
+        if (sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+            static_cast<Worksheet *>(sheet)->d_func()->deferSstRefs = true;
+        const QString rel_path = getRelFilePath(sheet->filePath());
+        if (zipReader.contains(rel_path))
+            sheet->relationships()->loadFromXmlData(zipReader.fileData(rel_path));
+        sheet->loadFromXmlData(zipReader.fileData(sheet->filePath()));
+
+        locker.relock();
+        m_parsed.append(sheet);
+        m_current = 0;
+        m_sheetParsed.wakeAll();
+        QMetaObject::invokeMethod(this, "loadParsedSheets", Qt::QueuedConnection);
+    }
+    // Posted before the loader can be deleted
+    QMetaObject::invokeMethod(this, "loadParsedSheets", Qt::QueuedConnection);
+    m_running = false;
+    m_sheetParsed.wakeAll();
+}
+
+/*
+  Has the workbook load the sheets parsed so far, and all the sheets left
+  once the worker is done, then reports them.
+ */
+void SheetLoader::loadParsedSheets()
+{
+    forever {
+        QMutexLocker locker(&m_mutex);
+        AbstractSheet *sheet = 0;
+        if (!m_parsed.isEmpty())
+            sheet = m_parsed.first();
+        else if (!m_running && !m_queue.isEmpty())
+            sheet = m_queue.first();
+        if (!sheet)
+            break;
+        locker.unlock();
+        m_workbook->loadSheet(sheet);
+
+        // Left there if the workbook doesn't wait for the sheet any more
+        locker.relock();
+        m_parsed.removeOne(sheet);
+        m_queue.removeOne(sheet);
+    }
+
+    const QStringList names = m_loadedNames;
+    m_loadedNames.clear();
+    foreach (const QString &name, names)
+        emit sheetLoaded(name);
+
+    QMutexLocker locker(&m_mutex);
+    if (m_finished || m_running || !m_parsed.isEmpty() || !m_queue.isEmpty())
+        return;
+    locker.unlock();
+    m_finished = true;
+    if (!m_workbook->concurrent_writes_enabled) {
+        m_workbook->sharedStrings->setThreadSafe(false);
+        m_workbook->styles->setThreadSafe(false);
+    }
+    emit finished();
+}
+
+QT_END_NAMESPACE_XLSX
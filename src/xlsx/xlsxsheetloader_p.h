@@ -0,0 +1,102 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXSHEETLOADER_P_H
+#define XLSXSHEETLOADER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QWaitCondition>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class AbstractSheet;
+class WorkbookPrivate;
+
+/*
+  Parses the sheets of a lazily loaded workbook on a worker thread, in the
+  order they are queued, while the workbook is used on the thread of the
+  loader. The worker reads the package file on its own. The parsed sheets
+  are handed back to the workbook, which loads their drawings, charts and
+  pictures, once the thread of the loader gets control again, or as soon as
+  they are accessed.
+ */
+class XLSX_AUTOTEST_EXPORT SheetLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetLoader(WorkbookPrivate *workbook, const QString &packageName);
+    ~SheetLoader();
+
+    void start(const QList<AbstractSheet *> &sheets);
+    bool takeSheet(AbstractSheet *sheet);
+    void dropSheet(AbstractSheet *sheet);
+    void reportLoaded(AbstractSheet *sheet);
+    bool isFinished() const;
+
+    void run();
+
+Q_SIGNALS:
+    void sheetLoaded(const QString &sheetName);
+    void finished();
+
+private Q_SLOTS:
+    void loadParsedSheets();
+
+private:
+    Q_DISABLE_COPY(SheetLoader)
+
+    WorkbookPrivate *m_workbook;
+    QString m_packageName;
+    mutable QMutex m_mutex;
+    QWaitCondition m_sheetParsed;
+    QList<AbstractSheet *> m_queue; // not parsed yet, the next one first
+    AbstractSheet *m_current; // being parsed by the worker
+    QList<AbstractSheet *> m_parsed; // parsed, to be loaded by the workbook
+    bool m_running;
+
+    // Only used on the thread of the loader
+    QStringList m_loadedNames; // to be reported by sheetLoaded()
+    bool m_finished;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXSHEETLOADER_P_H
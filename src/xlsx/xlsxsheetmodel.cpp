@@ -0,0 +1,407 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxsheetmodel.h"
+#include "xlsxsheetmodel_p.h"
+#include "xlsxworksheet.h"
+#include "xlsxcell.h"
+#include "xlsxcellreference.h"
+#include "xlsxformat.h"
+#include "xlsxrawcell.h"
+#include "xlsxutility_p.h"
+
+#include <QBrush>
+#include <QFont>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+static inline quint64 cellKey(int row, int col)
+{
+    return (quint64(row) << 32) | quint32(col);
+}
+
+SheetModelPrivate::SheetModelPrivate(SheetModel *p)
+    : sheet(0)
+    , prefetchBlock(-1)
+    , q_ptr(p)
+{
+}
+
+/*
+  Returns the cached values of the cell (\a row, \a column), or 0 if there
+  is no cell there. The block of rows of the cell is read first if needed,
+  and the next block in the direction of the scrolling is prefetched.
+ */
+const SheetModelPrivate::CachedCell *SheetModelPrivate::cachedCell(int row, int column)
+{
+    const int block = (row - 1) / BlockRows;
+    const CachedBlock &cells = cachedBlock(block);
+
+    const int offset = (row - 1) % BlockRows;
+    if (offset >= BlockRows * 3 / 4)
+        schedulePrefetch(block + 1);
+    else if (offset < BlockRows / 4)
+        schedulePrefetch(block - 1);
+
+    CachedBlock::const_iterator it = cells.constFind(cellKey(row, column));
+    return it == cells.constEnd() ? 0 : &it.value();
+}
+
+const SheetModelPrivate::CachedBlock &SheetModelPrivate::cachedBlock(int block)
+{
+    QHash<int, CachedBlock>::iterator it = blocks.find(block);
+    if (it != blocks.end()) {
+        if (recentBlocks.last() != block) {
+            recentBlocks.removeOne(block);
+            recentBlocks.append(block);
+        }
+        return it.value();
+    }
+
+    if (recentBlocks.size() >= MaxCachedBlocks)
+        blocks.remove(recentBlocks.takeFirst());
+    it = blocks.insert(block, CachedBlock());
+    recentBlocks.append(block);
+    fillBlock(block, it.value());
+    return it.value();
+}
+
+/*
+  Read the cells of \a block into \a cells. The raw values are read in one
+  pass over the rows, only the dates, and the cells which are neither
+  numbers, booleans nor shared strings, go through read() or cellAt().
+ */
+void SheetModelPrivate::fillBlock(int block, CachedBlock &cells)
+{
+    const CellRange dimension = sheet->dimension();
+    if (!dimension.isValid())
+        return;
+    const int firstRow = block * BlockRows + 1;
+    const CellRange range(firstRow, 1, firstRow + BlockRows - 1, dimension.lastColumn());
+
+    RawRowIterator it(sheet, range);
+    while (it.nextRow()) {
+        const int row = it.row();
+        for (int i = 0; i < it.cellCount(); ++i) {
+            const int column = it.column(i);
+            const RawCellValue value = it.value(i);
+            CachedCell cell;
+            cell.formatIndex = value.formatIndex;
+            switch (value.type) {
+            case RawCellValue::Number:
+                if (cachedStyle(value.formatIndex, row, column).dateTime)
+                    cell.display = sheet->read(row, column);
+                else
+                    cell.display = value.number;
+                break;
+            case RawCellValue::Boolean:
+                cell.display = value.boolean;
+                break;
+            case RawCellValue::SharedString:
+                cell.display = sheet->sharedString(value.sharedStringIndex);
+                break;
+            case RawCellValue::Other:
+                cell.display = sheet->cellAt(row, column)->value();
+                break;
+            default:
+                break;
+            }
+            cells.insert(cellKey(row, column), cell);
+        }
+    }
+}
+
+/*
+  Returns the roles of the format \a formatIndex, which is the format of
+  the cell (\a row, \a column).
+ */
+const SheetModelPrivate::CachedStyle &SheetModelPrivate::cachedStyle(int formatIndex, int row,
+                                                                     int column)
+{
+    QHash<int, CachedStyle>::const_iterator it = styles.constFind(formatIndex);
+    if (it != styles.constEnd())
+        return it.value();
+
+    CachedStyle style;
+    style.dateTime = false;
+    Cell *cell = formatIndex == -1 ? 0 : sheet->cellAt(row, column);
+    if (cell) {
+        const Format format = cell->format();
+        style.dateTime = format.isDateTimeFormat();
+
+        Qt::Alignment align;
+        switch (format.horizontalAlignment()) {
+        case Format::AlignLeft:
+            align |= Qt::AlignLeft;
+            break;
+        case Format::AlignRight:
+            align |= Qt::AlignRight;
+            break;
+        case Format::AlignHCenter:
+            align |= Qt::AlignHCenter;
+            break;
+        case Format::AlignHJustify:
+            align |= Qt::AlignJustify;
+            break;
+        default:
+            break;
+        }
+        switch (format.verticalAlignment()) {
+        case Format::AlignTop:
+            align |= Qt::AlignTop;
+            break;
+        case Format::AlignBottom:
+            align |= Qt::AlignBottom;
+            break;
+        case Format::AlignVCenter:
+            align |= Qt::AlignVCenter;
+            break;
+        default:
+            break;
+        }
+        style.alignment = QVariant(align);
+        if (format.hasFontData())
+            style.font = format.font();
+        if (format.fontColor().isValid())
+            style.foreground = QBrush(format.fontColor());
+        if (format.patternBackgroundColor().isValid())
+            style.background = QBrush(format.patternBackgroundColor());
+    } else {
+        style.alignment = QVariant(Qt::Alignment());
+    }
+    return styles.insert(formatIndex, style).value();
+}
+
+/*
+  Read \a block once the events pending are processed, unless it is
+  already cached or out of the sheet.
+ */
+void SheetModelPrivate::schedulePrefetch(int block)
+{
+    Q_Q(SheetModel);
+    if (block < 0 || prefetchBlock != -1 || blocks.contains(block)
+        || block * BlockRows >= sheet->dimension().lastRow()) {
+        return;
+    }
+    prefetchBlock = block;
+    QMetaObject::invokeMethod(q, "prefetchRows", Qt::QueuedConnection);
+}
+
+/*!
+ * \class SheetModel
+ * \inmodule QtXlsx
+ * \brief The SheetModel class presents a worksheet to the item views.
+ *
+ * The display values, the fonts, the brushes and the alignments of the
+ * cells are cached by blocks of rows, so that repainting the visible cells
+ * doesn't read them again. A few blocks around the visible rows are kept,
+ * and the block that follows in the direction of the scrolling is read
+ * once the pending events have been processed. The formats are read once
+ * for all the cells which share them.
+ *
+ * Cells changed through setData() are read again. When the worksheet is
+ * changed directly, call invalidate().
+ *
+ * \note SheetModel indices start from 0, while Worksheet
+ * column/row indices start from 1.
+ */
+
+/*!
+ * \enum SheetModel::ItemDataRole
+ *
+ * \value DisplayTextRole The text of the cell as Excel shows it, in the
+ *        number format of the cell. See Worksheet::displayText().
+ */
+
+/*!
+ * Creates a model object with the given \a sheet and \a parent.
+ */
+SheetModel::SheetModel(Worksheet *sheet, QObject *parent)
+    : QAbstractTableModel(parent)
+    , d_ptr(new SheetModelPrivate(this))
+{
+    d_ptr->sheet = sheet;
+}
+
+/*!
+ * Destroys the model.
+ */
+SheetModel::~SheetModel()
+{
+    delete d_ptr;
+}
+
+/*!
+ * \reimp
+ */
+int SheetModel::rowCount(const QModelIndex & /*parent*/) const
+{
+    Q_D(const SheetModel);
+    return d->sheet->dimension().lastRow();
+}
+
+/*!
+ * \reimp
+ */
+int SheetModel::columnCount(const QModelIndex & /*parent*/) const
+{
+    Q_D(const SheetModel);
+    return d->sheet->dimension().lastColumn();
+}
+
+/*!
+ * \reimp
+ */
+Qt::ItemFlags SheetModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable;
+}
+
+/*!
+ * \reimp
+ */
+QVariant SheetModel::data(const QModelIndex &index, int role) const
+{
+    // The cache is filled by the const accessors
+    SheetModelPrivate *d = d_ptr;
+
+    if (!index.isValid())
+        return QVariant();
+    const int row = index.row() + 1;
+    const int column = index.column() + 1;
+
+    // Only asked for when a cell is edited
+    if (role == Qt::EditRole)
+        return d->sheet->read(row, column);
+    // Not cached, the number formats are compiled once by the styles
+    if (role == DisplayTextRole)
+        return d->sheet->displayText(row, column);
+
+    const SheetModelPrivate::CachedCell *cell = d->cachedCell(row, column);
+    if (!cell)
+        return QVariant();
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return cell->display;
+    case Qt::TextAlignmentRole:
+        return d->cachedStyle(cell->formatIndex, row, column).alignment;
+    case Qt::FontRole:
+        return d->cachedStyle(cell->formatIndex, row, column).font;
+    case Qt::ForegroundRole:
+        return d->cachedStyle(cell->formatIndex, row, column).foreground;
+    case Qt::BackgroundRole:
+        return d->cachedStyle(cell->formatIndex, row, column).background;
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+/*!
+ * \reimp
+ */
+QVariant SheetModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role == Qt::DisplayRole) {
+        if (orientation == Qt::Horizontal)
+            return CellReference(1, section + 1).toString().remove(QLatin1Char('1'));
+        else
+            return QString::number(section + 1);
+    }
+    return QVariant();
+}
+
+/*!
+ * \reimp
+ */
+bool SheetModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    Q_D(SheetModel);
+
+    if (!index.isValid() || role != Qt::EditRole)
+        return false;
+
+    if (!d->sheet->write(index.row() + 1, index.column() + 1, value))
+        return false;
+    invalidate(CellRange(index.row() + 1, index.column() + 1, index.row() + 1,
+                         index.column() + 1));
+    return true;
+}
+
+/*!
+ * Returns the sheet object.
+ */
+Worksheet *SheetModel::sheet() const
+{
+    Q_D(const SheetModel);
+    return d->sheet;
+}
+
+/*!
+ * Drops the cached values of the cells of \a range, or of all the cells
+ * when \a range is not valid, and tells the views they changed. To be
+ * called when the worksheet is changed other than through setData().
+ */
+void SheetModel::invalidate(const CellRange &range)
+{
+    Q_D(SheetModel);
+
+    CellRange changed = range;
+    if (range.isValid()) {
+        for (int block = (range.firstRow() - 1) / SheetModelPrivate::BlockRows;
+             block <= (range.lastRow() - 1) / SheetModelPrivate::BlockRows; ++block) {
+            if (d->blocks.remove(block))
+                d->recentBlocks.removeOne(block);
+        }
+    } else {
+        // The formats may have been changed or compacted too
+        d->blocks.clear();
+        d->recentBlocks.clear();
+        d->styles.clear();
+        changed = CellRange(1, 1, rowCount(), columnCount());
+    }
+
+    if (changed.lastRow() >= 1 && changed.lastColumn() >= 1) {
+        emit dataChanged(index(changed.firstRow() - 1, changed.firstColumn() - 1),
+                         index(changed.lastRow() - 1, changed.lastColumn() - 1));
+    }
+}
+
+/*
+  Read the block of rows scheduled by schedulePrefetch().
+ */
+void SheetModel::prefetchRows()
+{
+    Q_D(SheetModel);
+    const int block = d->prefetchBlock;
+    d->prefetchBlock = -1;
+    if (block != -1 && !d->blocks.contains(block))
+        d->cachedBlock(block);
+}
+
+QT_END_NAMESPACE_XLSX
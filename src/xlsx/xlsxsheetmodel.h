@@ -27,6 +27,7 @@
 #define QXLSX_XLSXSHEETMODEL_H
 
 #include "xlsxglobal.h"
+#include "xlsxcellrange.h"
 #include <QAbstractTableModel>
 
 QT_BEGIN_NAMESPACE_XLSX
@@ -34,11 +35,15 @@ QT_BEGIN_NAMESPACE_XLSX
 class Worksheet;
 class SheetModelPrivate;
 
-class SheetModel : public QAbstractTableModel
+class Q_XLSX_EXPORT SheetModel : public QAbstractTableModel
 {
     Q_OBJECT
     Q_DECLARE_PRIVATE(SheetModel)
 public:
+    enum ItemDataRole {
+        DisplayTextRole = Qt::UserRole + 1
+    };
+
     explicit SheetModel(Worksheet *sheet, QObject *parent = 0);
     ~SheetModel();
 
@@ -50,9 +55,12 @@ public:
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
 
     Worksheet *sheet() const;
-signals:
 
-public slots:
+public Q_SLOTS:
+    void invalidate(const CellRange &range = CellRange());
+
+private Q_SLOTS:
+    void prefetchRows();
 
 private:
     SheetModelPrivate *const d_ptr;
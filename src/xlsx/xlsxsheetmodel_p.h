@@ -0,0 +1,91 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXSHEETMODEL_P_H
+#define XLSXSHEETMODEL_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxsheetmodel.h"
+
+#include <QHash>
+#include <QList>
+#include <QVariant>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class SheetModelPrivate
+{
+    Q_DECLARE_PUBLIC(SheetModel)
+public:
+    // The rows are cached by blocks of this many rows
+    enum { BlockRows = 128, MaxCachedBlocks = 8 };
+
+    struct CachedCell
+    {
+        QVariant display;
+        int formatIndex;
+    };
+    // The cells of a block of rows, by row and column
+    typedef QHash<quint64, CachedCell> CachedBlock;
+
+    // The roles which only depend on the format of a cell
+    struct CachedStyle
+    {
+        QVariant alignment;
+        QVariant font;
+        QVariant foreground;
+        QVariant background;
+        bool dateTime;
+    };
+
+    SheetModelPrivate(SheetModel *p);
+
+    const CachedCell *cachedCell(int row, int column);
+    const CachedBlock &cachedBlock(int block);
+    void fillBlock(int block, CachedBlock &cells);
+    const CachedStyle &cachedStyle(int formatIndex, int row, int column);
+    void schedulePrefetch(int block);
+
+    Worksheet *sheet;
+    QHash<int, CachedBlock> blocks;
+    QList<int> recentBlocks; // the least recently used first
+    QHash<int, CachedStyle> styles; // by format index
+    int prefetchBlock; // -1 when no prefetch is pending
+    SheetModel *q_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXSHEETMODEL_P_H
@@ -0,0 +1,444 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxsheetreader.h"
+#include "xlsxsheetreader_p.h"
+#include "xlsxzipreader_p.h"
+#include "xlsxrelationships_p.h"
+#include "xlsxsharedstrings_p.h"
+#include "xlsxstyles_p.h"
+#include "xlsxutility_p.h"
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+SheetReaderPrivate::SheetReaderPrivate(SheetReader *p)
+    : date1904(false)
+    , sheetIndex(-1)
+    , rowNumber(0)
+    , cellCount(0)
+    , q_ptr(p)
+{
+}
+
+SheetReaderPrivate::~SheetReaderPrivate()
+{
+}
+
+void SheetReaderPrivate::init(const QString &sheetName)
+{
+    if (!openPackage())
+        return;
+    if (sheetName.isEmpty())
+        openSheet(0);
+    else
+        openSheet(sheetNames.indexOf(sheetName));
+}
+
+/*
+  Find the worksheets, the shared strings and the styles of the package.
+  Only the small workbook and relationships parts are read here.
+ */
+bool SheetReaderPrivate::openPackage()
+{
+    if (!zipReader->contains(QStringLiteral("_rels/.rels")))
+        return false;
+    Relationships rootRels;
+    rootRels.loadFromXmlData(zipReader->fileData(QStringLiteral("_rels/.rels")));
+
+    // In normal case, this should be "xl/workbook.xml"
+    QList<XlsxRelationship> rels_xl =
+        rootRels.documentRelationships(QStringLiteral("/officeDocument"));
+    if (rels_xl.isEmpty())
+        return false;
+    const QString xlworkbook_Path = rels_xl[0].target;
+    const QString xlworkbook_Dir = splitPath(xlworkbook_Path)[0];
+    Relationships workbookRels;
+    workbookRels.loadFromXmlData(zipReader->fileData(getRelFilePath(xlworkbook_Path)));
+
+    QList<XlsxRelationship> rels_sharedStrings =
+        workbookRels.documentRelationships(QStringLiteral("/sharedStrings"));
+    if (!rels_sharedStrings.isEmpty())
+        sharedStringsPath = xlworkbook_Dir + QLatin1String("/") + rels_sharedStrings[0].target;
+    QList<XlsxRelationship> rels_styles =
+        workbookRels.documentRelationships(QStringLiteral("/styles"));
+    if (!rels_styles.isEmpty())
+        stylesPath = xlworkbook_Dir + QLatin1String("/") + rels_styles[0].target;
+
+    QXmlStreamReader workbookReader(zipReader->fileData(xlworkbook_Path));
+    while (!workbookReader.atEnd()) {
+        QXmlStreamReader::TokenType token = workbookReader.readNext();
+        if (token != QXmlStreamReader::StartElement)
+            continue;
+        QXmlStreamAttributes attributes = workbookReader.attributes();
+        if (workbookReader.name() == QLatin1String("workbookPr")) {
+            const QStringRef value = attributes.value(QLatin1String("date1904"));
+            date1904 = value == QLatin1String("1") || value == QLatin1String("true");
+            continue;
+        }
+        if (workbookReader.name() != QLatin1String("sheet"))
+            continue;
+        XlsxRelationship relationship = workbookRels.getRelationshipById(
+            attributes.value(QLatin1String("r:id")).toString());
+        if (!relationship.type.endsWith(QLatin1String("/worksheet")))
+            continue;
+        sheetNames.append(attributes.value(QLatin1String("name")).toString());
+        sheetPaths.append(
+            QDir::cleanPath(xlworkbook_Dir + QLatin1String("/") + relationship.target));
+    }
+    return true;
+}
+
+bool SheetReaderPrivate::openSheet(int index)
+{
+    reader.clear();
+    sheetDevice.reset();
+    sheetIndex = -1;
+    rowNumber = 0;
+    cellCount = 0;
+    if (index < 0 || index >= sheetPaths.size())
+        return false;
+
+    sheetDevice.reset(zipReader->openFile(sheetPaths[index]));
+    if (!sheetDevice)
+        return false;
+    reader.setDevice(sheetDevice.data());
+    sheetIndex = index;
+    return true;
+}
+
+void SheetReaderPrivate::readRow()
+{
+    Q_ASSERT(reader.name() == QLatin1String("row"));
+
+    // Rows and cells without reference follow the previous ones
+    const QXmlStreamAttributes attributes = reader.attributes();
+    if (attributes.hasAttribute(QLatin1String("r")))
+        rowNumber = attributes.value(QLatin1String("r")).toInt();
+    else
+        ++rowNumber;
+
+    cellCount = 0;
+    int column = 0;
+    while (!reader.atEnd()) {
+        QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::EndElement && reader.name() == QLatin1String("row"))
+            break;
+        if (token == QXmlStreamReader::StartElement && reader.name() == QLatin1String("c")) {
+            readCell(column);
+            column = cells[cellCount - 1].column;
+        }
+    }
+}
+
+void SheetReaderPrivate::readCell(int previousColumn)
+{
+    Q_ASSERT(reader.name() == QLatin1String("c"));
+
+    if (cellCount == cells.size())
+        cells.append(SheetReaderCell());
+    SheetReaderCell &cell = cells[cellCount++];
+
+    const QXmlStreamAttributes attributes = reader.attributes();
+    const QStringRef r = attributes.value(QLatin1String("r"));
+    int row = 0;
+    if (r.isEmpty() || !parseCellReference(r, &row, &cell.column))
+        cell.column = previousColumn + 1;
+    const QStringRef s = attributes.value(QLatin1String("s"));
+    cell.xfIndex = s.isEmpty() ? -1 : s.toInt();
+
+    const QStringRef t = attributes.value(QLatin1String("t"));
+    if (t == QLatin1String("s"))
+        cell.cellType = Cell::SharedStringType;
+    else if (t == QLatin1String("inlineStr"))
+        cell.cellType = Cell::InlineStringType;
+    else if (t == QLatin1String("str"))
+        cell.cellType = Cell::StringType;
+    else if (t == QLatin1String("b"))
+        cell.cellType = Cell::BooleanType;
+    else if (t == QLatin1String("e"))
+        cell.cellType = Cell::ErrorType;
+    else
+        cell.cellType = Cell::NumberType;
+
+    cell.text.clear();
+    while (!reader.atEnd()) {
+        QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::EndElement && reader.name() == QLatin1String("c"))
+            break;
+        if (token != QXmlStreamReader::StartElement)
+            continue;
+        if (reader.name() == QLatin1String("v"))
+            cell.text = reader.readElementText();
+        else if (reader.name() == QLatin1String("t")) // <is><t> or <is><r><t>
+            cell.text += reader.readElementText();
+        else if (reader.name() == QLatin1String("f") || reader.name() == QLatin1String("rPh"))
+            reader.skipCurrentElement();
+    }
+}
+
+SharedStrings *SheetReaderPrivate::sharedStrings() const
+{
+    if (!sharedStringTable) {
+        sharedStringTable.reset(new SharedStrings(SharedStrings::F_LoadFromExists));
+        if (!sharedStringsPath.isEmpty()) {
+            QScopedPointer<QIODevice> device(zipReader->openFile(sharedStringsPath));
+            if (device)
+                sharedStringTable->loadFromXmlFile(device.data());
+        }
+    }
+    return sharedStringTable.data();
+}
+
+Styles *SheetReaderPrivate::styles() const
+{
+    if (!styleTable) {
+        styleTable = QSharedPointer<Styles>(new Styles(Styles::F_LoadFromExists));
+        if (!stylesPath.isEmpty())
+            styleTable->loadFromXmlData(zipReader->fileData(stylesPath));
+    }
+    return styleTable.data();
+}
+
+/*!
+  \class SheetReader
+  \inmodule QtXlsx
+  \brief The SheetReader class reads the rows of a worksheet one after another.
+
+  Unlike Document, which loads the whole workbook in memory, SheetReader
+  walks the sheet data of one worksheet while it's being inflated from the
+  .xlsx package, so the memory used doesn't depend on the size of the
+  sheet. The shared strings and the styles are only loaded when a cell
+  which needs them is read.
+
+  \code
+  SheetReader reader("Book1.xlsx");
+  while (reader.nextRow()) {
+      for (int i = 0; i < reader.cellCount(); ++i)
+          qDebug() << reader.row() << reader.column(i) << reader.value(i);
+  }
+  \endcode
+
+  Only the rows which are stored in the file are returned, in the order
+  of the file.
+*/
+
+/*!
+  Creates a reader for the worksheet \a sheetName of the .xlsx file
+  \a xlsxName. The first worksheet is read if \a sheetName is empty.
+ */
+SheetReader::SheetReader(const QString &xlsxName, const QString &sheetName)
+    : d_ptr(new SheetReaderPrivate(this))
+{
+    Q_D(SheetReader);
+    d->file.reset(new QFile(xlsxName));
+    if (d->file->open(QIODevice::ReadOnly)) {
+        d->zipReader.reset(new ZipReader(d->file.data()));
+        d->init(sheetName);
+    }
+}
+
+/*!
+  Creates a reader for the worksheet \a sheetName of the .xlsx package
+  read from \a device, which must be kept open while the reader is used.
+  The first worksheet is read if \a sheetName is empty.
+ */
+SheetReader::SheetReader(QIODevice *device, const QString &sheetName)
+    : d_ptr(new SheetReaderPrivate(this))
+{
+    Q_D(SheetReader);
+    if (device && device->isReadable()) {
+        d->zipReader.reset(new ZipReader(device));
+        d->init(sheetName);
+    }
+}
+
+/*!
+  Destroys the reader.
+ */
+SheetReader::~SheetReader()
+{
+    delete d_ptr;
+}
+
+/*!
+  Returns true if a worksheet has been found, otherwise returns false.
+ */
+bool SheetReader::isValid() const
+{
+    Q_D(const SheetReader);
+    return d->sheetIndex != -1;
+}
+
+/*!
+  Returns true if the sheet data could not be parsed.
+ */
+bool SheetReader::hasError() const
+{
+    Q_D(const SheetReader);
+    return d->reader.hasError();
+}
+
+/*!
+  Returns the names of the worksheets of the package.
+ */
+QStringList SheetReader::sheetNames() const
+{
+    Q_D(const SheetReader);
+    return d->sheetNames;
+}
+
+/*!
+  Returns the name of the worksheet which is read.
+ */
+QString SheetReader::sheetName() const
+{
+    Q_D(const SheetReader);
+    if (d->sheetIndex == -1)
+        return QString();
+    return d->sheetNames[d->sheetIndex];
+}
+
+/*!
+  Starts to read the worksheet \a name from its first row.
+  Returns false if there is no such worksheet.
+ */
+bool SheetReader::selectSheet(const QString &name)
+{
+    Q_D(SheetReader);
+    return d->openSheet(d->sheetNames.indexOf(name));
+}
+
+/*!
+  Reads the next row of the worksheet. Returns false once all the rows
+  have been read.
+ */
+bool SheetReader::nextRow()
+{
+    Q_D(SheetReader);
+    d->cellCount = 0;
+    if (!d->sheetDevice)
+        return false;
+
+    QXmlStreamReader &reader = d->reader;
+    while (!reader.atEnd()) {
+        QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            if (reader.name() == QLatin1String("row")) {
+                d->readRow();
+                return true;
+            }
+        } else if (token == QXmlStreamReader::EndElement
+                   && reader.name() == QLatin1String("sheetData")) {
+            break;
+        }
+    }
+
+    // Nothing useful follows the sheet data
+    d->sheetDevice.reset();
+    return false;
+}
+
+/*!
+  Returns the number of the current row, starting from 1.
+ */
+int SheetReader::row() const
+{
+    Q_D(const SheetReader);
+    return d->rowNumber;
+}
+
+/*!
+  Returns the number of cells stored in the current row.
+ */
+int SheetReader::cellCount() const
+{
+    Q_D(const SheetReader);
+    return d->cellCount;
+}
+
+/*!
+  Returns the column, starting from 1, of the cell \a index of the current row.
+ */
+int SheetReader::column(int index) const
+{
+    Q_D(const SheetReader);
+    if (index < 0 || index >= d->cellCount)
+        return 0;
+    return d->cells[index].column;
+}
+
+/*!
+  Returns the type of the cell \a index of the current row.
+ */
+Cell::CellType SheetReader::cellType(int index) const
+{
+    Q_D(const SheetReader);
+    if (index < 0 || index >= d->cellCount)
+        return Cell::NumberType;
+    return d->cells[index].cellType;
+}
+
+/*!
+  Returns the value of the cell \a index of the current row. The result
+  of formulas is returned, and numbers are not converted to dates, which
+  format() can be used for.
+ */
+QVariant SheetReader::value(int index) const
+{
+    Q_D(const SheetReader);
+    if (index < 0 || index >= d->cellCount)
+        return QVariant();
+
+    const SheetReaderCell &cell = d->cells[index];
+    switch (cell.cellType) {
+    case Cell::NumberType:
+        if (cell.text.isEmpty())
+            return QVariant();
+        return parseDouble(QStringRef(&cell.text));
+    case Cell::BooleanType:
+        return cell.text.toInt() ? true : false;
+    case Cell::SharedStringType:
+        return d->sharedStrings()->getSharedPlainString(cell.text.toInt());
+    default:
+        break;
+    }
+    return cell.text;
+}
+
+/*!
+  Returns the format of the cell \a index of the current row.
+ */
+Format SheetReader::format(int index) const
+{
+    Q_D(const SheetReader);
+    if (index < 0 || index >= d->cellCount || d->cells[index].xfIndex == -1)
+        return Format();
+    return d->styles()->xfFormat(d->cells[index].xfIndex);
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,71 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QXLSX_XLSXSHEETREADER_H
+#define QXLSX_XLSXSHEETREADER_H
+
+#include "xlsxglobal.h"
+#include "xlsxcell.h"
+#include "xlsxformat.h"
+#include <QStringList>
+#include <QVariant>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class SheetReaderPrivate;
+
+class Q_XLSX_EXPORT SheetReader
+{
+    Q_DECLARE_PRIVATE(SheetReader)
+public:
+    explicit SheetReader(const QString &xlsxName, const QString &sheetName = QString());
+    explicit SheetReader(QIODevice *device, const QString &sheetName = QString());
+    ~SheetReader();
+
+    bool isValid() const;
+    bool hasError() const;
+
+    QStringList sheetNames() const;
+    QString sheetName() const;
+    bool selectSheet(const QString &name);
+
+    bool nextRow();
+    int row() const;
+    int cellCount() const;
+    int column(int index) const;
+    Cell::CellType cellType(int index) const;
+    QVariant value(int index) const;
+    Format format(int index) const;
+
+private:
+    Q_DISABLE_COPY(SheetReader)
+    SheetReaderPrivate *const d_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXSHEETREADER_H
@@ -0,0 +1,115 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QXLSX_XLSXSHEETREADER_P_H
+#define QXLSX_XLSXSHEETREADER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include "xlsxsheetreader.h"
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QXmlStreamReader>
+#include <QVector>
+
+class QFile;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class ZipReader;
+class SharedStrings;
+class Styles;
+
+class SheetReaderCell
+{
+public:
+    SheetReaderCell()
+        : column(0)
+        , cellType(Cell::NumberType)
+        , xfIndex(-1)
+    {
+    }
+
+    int column;
+    Cell::CellType cellType;
+    int xfIndex;
+    QString text; // contents of <v>, or the text of an inline string
+};
+
+class SheetReaderPrivate
+{
+    Q_DECLARE_PUBLIC(SheetReader)
+public:
+    SheetReaderPrivate(SheetReader *p);
+    ~SheetReaderPrivate();
+
+    void init(const QString &sheetName);
+    bool openPackage();
+    bool openSheet(int index);
+    void readRow();
+    void readCell(int previousColumn);
+    SharedStrings *sharedStrings() const;
+    Styles *styles() const;
+
+    QScopedPointer<QFile> file;
+    QScopedPointer<ZipReader> zipReader;
+    QStringList sheetNames;
+    QStringList sheetPaths;
+    QString sharedStringsPath;
+    QString stylesPath;
+    bool date1904;
+
+    int sheetIndex;
+    QScopedPointer<QIODevice> sheetDevice;
+    QXmlStreamReader reader;
+
+    // Loaded when they are needed for the first time
+    mutable QScopedPointer<SharedStrings> sharedStringTable;
+    mutable QSharedPointer<Styles> styleTable;
+
+    // Cells of the current row. The vector is only grown, so that
+    // its items can be reused by the following rows.
+    int rowNumber;
+    int cellCount;
+    QVector<SheetReaderCell> cells;
+
+    SheetReader *q_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+Q_DECLARE_TYPEINFO(QXlsx::SheetReaderCell, Q_MOVABLE_TYPE);
+
+#endif // QXLSX_XLSXSHEETREADER_P_H
@@ -0,0 +1,377 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxsheettemplate.h"
+#include "xlsxsheettemplate_p.h"
+#include "xlsxworksheet.h"
+#include "xlsxrawcell.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+static bool regionLessThan(const SheetTemplatePrivate::Region &left,
+                           const SheetTemplatePrivate::Region &right)
+{
+    return left.firstRow < right.firstRow;
+}
+
+SheetTemplatePrivate::SheetTemplatePrivate(SheetTemplate *p)
+    : q_ptr(p)
+{
+}
+
+/*
+  Find the placeholders of \a sheet, in one pass over its cells. The text
+  of a shared string is only looked at once, however many cells hold it.
+ */
+void SheetTemplatePrivate::index(const Worksheet *sheet)
+{
+    dimension = sheet->dimension();
+
+    // The parsed texts of the shared strings, -1 when there is no placeholder
+    QHash<int, int> parsedStrings;
+    QVector<Text> texts;
+
+    RawRowIterator it(sheet);
+    while (it.nextRow()) {
+        for (int i = 0; i < it.cellCount(); ++i) {
+            const RawCellValue value = it.value(i);
+            Placeholder placeholder;
+            placeholder.row = it.row();
+            placeholder.column = it.column(i);
+            if (value.type == RawCellValue::SharedString) {
+                QHash<int, int>::iterator parsed = parsedStrings.find(value.sharedStringIndex);
+                if (parsed == parsedStrings.end()) {
+                    Text text;
+                    int index = -1;
+                    if (parse(sheet->sharedString(value.sharedStringIndex), &text)) {
+                        index = texts.size();
+                        texts.append(text);
+                    }
+                    parsed = parsedStrings.insert(value.sharedStringIndex, index);
+                }
+                if (parsed.value() == -1)
+                    continue;
+                placeholder.text = texts[parsed.value()];
+            } else if (value.type == RawCellValue::Other) {
+                const QVariant text = sheet->read(placeholder.row, placeholder.column);
+                if (text.userType() != QMetaType::QString
+                    || !parse(text.toString(), &placeholder.text)) {
+                    continue;
+                }
+            } else {
+                continue;
+            }
+            placeholders.append(placeholder);
+
+            foreach (const QString &name, placeholder.text.names) {
+                const int dot = name.indexOf(QLatin1Char('.'));
+                if (dot < 1)
+                    continue;
+                const QString regionName = name.left(dot);
+                QHash<QString, Region>::iterator region = regions.find(regionName);
+                if (region == regions.end()) {
+                    Region newRegion = { regionName, placeholder.row, placeholder.row };
+                    regions.insert(regionName, newRegion);
+                } else {
+                    region->lastRow = placeholder.row;
+                }
+            }
+        }
+    }
+}
+
+/*
+  Cut \a text around its {{name}} placeholders into \a parsed. Returns
+  false if there is no placeholder in \a text.
+ */
+bool SheetTemplatePrivate::parse(const QString &text, Text *parsed)
+{
+    int from = 0;
+    int start;
+    while ((start = text.indexOf(QLatin1String("{{"), from)) != -1) {
+        const int end = text.indexOf(QLatin1String("}}"), start + 2);
+        if (end == -1)
+            break;
+        const QString name = text.mid(start + 2, end - start - 2).trimmed();
+        if (name.isEmpty()) {
+            from = end + 2;
+            continue;
+        }
+        parsed->parts.append(text.mid(from, start - from));
+        parsed->names.append(name);
+        from = end + 2;
+    }
+    if (parsed->names.isEmpty())
+        return false;
+    parsed->parts.append(text.mid(from));
+    return true;
+}
+
+/*
+  Returns the regions whose name is given a list in \a data, by row. A
+  region which overlaps one above it is not repeated.
+ */
+QList<SheetTemplatePrivate::Region>
+SheetTemplatePrivate::repeatedRegions(const QVariantMap &data) const
+{
+    QList<Region> candidates;
+    foreach (const Region &region, regions) {
+        if (data.value(region.name).userType() == QMetaType::QVariantList)
+            candidates.append(region);
+    }
+    std::sort(candidates.begin(), candidates.end(), regionLessThan);
+
+    QList<Region> repeated;
+    foreach (const Region &region, candidates) {
+        if (!repeated.isEmpty() && region.firstRow <= repeated.last().lastRow) {
+            qWarning("SheetTemplate: the rows of %s overlap the rows of %s, they are not repeated",
+                     qPrintable(region.name), qPrintable(repeated.last().name));
+            continue;
+        }
+        repeated.append(region);
+    }
+    return repeated;
+}
+
+/*
+  Make \a count copies of the rows of \a region, one below the other, with
+  the cells of \a columns, the merged cells and the row heights. The rows
+  are removed when \a count is 0.
+ */
+void SheetTemplatePrivate::repeatRows(Worksheet *sheet, const Region &region, int count,
+                                      const CellRange &columns)
+{
+    const int height = region.lastRow - region.firstRow + 1;
+    if (count == 0) {
+        sheet->removeRows(region.firstRow, height);
+        return;
+    }
+    if (count == 1)
+        return;
+
+    sheet->insertRows(region.lastRow + 1, (count - 1) * height);
+    const CellRange block(region.firstRow, columns.firstColumn(), region.lastRow,
+                          columns.lastColumn());
+    QList<CellRange> merges;
+    foreach (const CellRange &range, sheet->mergedCells()) {
+        if (range.firstRow() >= region.firstRow && range.lastRow() <= region.lastRow)
+            merges.append(range);
+    }
+    QVector<double> heights(height);
+    for (int i = 0; i < height; ++i)
+        heights[i] = sheet->rowHeight(region.firstRow + i);
+
+    for (int copy = 1; copy < count; ++copy) {
+        const int offset = copy * height;
+        sheet->copyRange(block, CellReference(region.firstRow + offset, columns.firstColumn()));
+        foreach (const CellRange &range, merges) {
+            sheet->mergeCells(CellRange(range.firstRow() + offset, range.firstColumn(),
+                                        range.lastRow() + offset, range.lastColumn()));
+        }
+        for (int i = 0; i < height; ++i) {
+            const int row = region.firstRow + offset + i;
+            if (sheet->rowHeight(row) != heights[i])
+                sheet->setRowHeight(row, row, heights[i]);
+        }
+    }
+}
+
+/*
+  Returns the value of the placeholder \a name. "<region>.<field>" is the
+  field of the \a record of the repeated \a region, and otherwise looked up
+  in \a data, "<map>.<key>" being the value of key in the map.
+ */
+QVariant SheetTemplatePrivate::value(const QString &name, const QVariantMap &data,
+                                     const Region *region, const QVariantMap &record)
+{
+    if (region && name.size() > region->name.size() + 1 && name.startsWith(region->name)
+        && name.at(region->name.size()) == QLatin1Char('.')) {
+        return record.value(name.mid(region->name.size() + 1));
+    }
+    QVariantMap::const_iterator it = data.constFind(name);
+    if (it != data.constEnd())
+        return it.value();
+    const int dot = name.indexOf(QLatin1Char('.'));
+    if (dot > 0)
+        return data.value(name.left(dot)).toMap().value(name.mid(dot + 1));
+    return QVariant();
+}
+
+/*
+  Write the values of \a placeholder to its cell, moved to \a row. A cell
+  which holds a single placeholder gets its value as it is, a number stays
+  a number; otherwise the values are written in the text of the cell.
+ */
+bool SheetTemplatePrivate::write(Worksheet *sheet, const Placeholder &placeholder, int row,
+                                 const QVariantMap &data, const Region *region,
+                                 const QVariantMap &record)
+{
+    const Text &text = placeholder.text;
+    if (text.names.size() == 1 && text.parts[0].isEmpty() && text.parts[1].isEmpty())
+        return sheet->write(row, placeholder.column, value(text.names[0], data, region, record));
+
+    QString result = text.parts[0];
+    for (int i = 0; i < text.names.size(); ++i) {
+        result += value(text.names[i], data, region, record).toString();
+        result += text.parts[i + 1];
+    }
+    return sheet->writeString(row, placeholder.column, result);
+}
+
+/*!
+  \class SheetTemplate
+  \inmodule QtXlsx
+  \brief The SheetTemplate class fills the {{name}} placeholders of a
+  worksheet.
+
+  The cells of a template sheet are looked at once, when the SheetTemplate
+  is created. fill() then only writes the cells of the placeholders, so
+  that the same index serves every worksheet loaded from the same template
+  file, whatever the size of the sheet:
+
+  \code
+  Document source("invoice.xlsx");
+  SheetTemplate invoice(source.currentWorksheet());
+  foreach (const QVariantMap &order, orders) {
+      Document xlsx("invoice.xlsx");
+      invoice.fill(xlsx.currentWorksheet(), order);
+      xlsx.saveAs(order.value("file").toString());
+  }
+  \endcode
+
+  The rows holding the placeholders named "<name>.<field>" are a region,
+  which is repeated once for each record when the value of name is a
+  QVariantList of QVariantMap records: rows are inserted below the region,
+  and the cells, the merged cells and the row heights of the region are
+  copied to them. The region is removed when the list is empty. When the
+  value of name is a QVariantMap, the placeholders are its values instead.
+*/
+
+/*!
+  Creates the index of the placeholders of \a sheet.
+*/
+SheetTemplate::SheetTemplate(const Worksheet *sheet)
+    : d_ptr(new SheetTemplatePrivate(this))
+{
+    d_ptr->index(sheet);
+}
+
+/*!
+  Destroys the index.
+*/
+SheetTemplate::~SheetTemplate()
+{
+    delete d_ptr;
+}
+
+/*!
+  Returns the names of the placeholders of the template, each one once, in
+  the order they are first found.
+*/
+QStringList SheetTemplate::placeholders() const
+{
+    Q_D(const SheetTemplate);
+    QStringList names;
+    foreach (const SheetTemplatePrivate::Placeholder &placeholder, d->placeholders) {
+        foreach (const QString &name, placeholder.text.names) {
+            if (!names.contains(name))
+                names.append(name);
+        }
+    }
+    return names;
+}
+
+/*!
+  Returns the cells of the template which hold the placeholder \a name.
+*/
+QList<CellReference> SheetTemplate::locations(const QString &name) const
+{
+    Q_D(const SheetTemplate);
+    QList<CellReference> cells;
+    foreach (const SheetTemplatePrivate::Placeholder &placeholder, d->placeholders) {
+        if (placeholder.text.names.contains(name))
+            cells.append(CellReference(placeholder.row, placeholder.column));
+    }
+    return cells;
+}
+
+/*!
+  Write the values of \a data to the placeholders of \a sheet, which must
+  be a worksheet loaded from the template, as it was. The placeholders
+  without a value are left empty.
+
+  Returns false if the dimension of \a sheet is not the one of the
+  template, or if a value could not be written.
+*/
+bool SheetTemplate::fill(Worksheet *sheet, const QVariantMap &data) const
+{
+    Q_D(const SheetTemplate);
+    if (!sheet || sheet->dimension() != d->dimension)
+        return false;
+
+    const QList<SheetTemplatePrivate::Region> regions = d->repeatedRegions(data);
+    QVector<QVariantList> records(regions.size());
+    // From the bottom up, so that the rows of the other regions stay where they are
+    for (int i = regions.size() - 1; i >= 0; --i) {
+        records[i] = data.value(regions[i].name).toList();
+        SheetTemplatePrivate::repeatRows(sheet, regions[i], records[i].size(), d->dimension);
+    }
+
+    bool ok = true;
+    int shift = 0;
+    int p = 0;
+    const QVariantMap noRecord;
+    for (int i = 0; i <= regions.size(); ++i) {
+        const bool last = i == regions.size();
+        for (; p < d->placeholders.size() && (last || d->placeholders[p].row < regions[i].firstRow);
+             ++p) {
+            const SheetTemplatePrivate::Placeholder &placeholder = d->placeholders[p];
+            ok &= d->write(sheet, placeholder, placeholder.row + shift, data, 0, noRecord);
+        }
+        if (last)
+            break;
+
+        const SheetTemplatePrivate::Region &region = regions[i];
+        const int height = region.lastRow - region.firstRow + 1;
+        int end = p;
+        while (end < d->placeholders.size() && d->placeholders[end].row <= region.lastRow)
+            ++end;
+        for (int copy = 0; copy < records[i].size(); ++copy) {
+            const QVariantMap record = records[i][copy].toMap();
+            for (int q = p; q < end; ++q) {
+                const SheetTemplatePrivate::Placeholder &placeholder = d->placeholders[q];
+                ok &= d->write(sheet, placeholder, placeholder.row + shift + copy * height, data,
+                               &region, record);
+            }
+        }
+        p = end;
+        shift += (records[i].size() - 1) * height;
+    }
+    return ok;
+}
+
+QT_END_NAMESPACE_XLSX
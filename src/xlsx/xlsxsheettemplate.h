@@ -0,0 +1,57 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXSHEETTEMPLATE_H
+#define QXLSX_XLSXSHEETTEMPLATE_H
+
+#include "xlsxglobal.h"
+#include "xlsxcellreference.h"
+#include <QList>
+#include <QStringList>
+#include <QVariantMap>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Worksheet;
+class SheetTemplatePrivate;
+
+class Q_XLSX_EXPORT SheetTemplate
+{
+    Q_DECLARE_PRIVATE(SheetTemplate)
+public:
+    explicit SheetTemplate(const Worksheet *sheet);
+    ~SheetTemplate();
+
+    QStringList placeholders() const;
+    QList<CellReference> locations(const QString &name) const;
+    bool fill(Worksheet *sheet, const QVariantMap &data) const;
+
+private:
+    Q_DISABLE_COPY(SheetTemplate)
+    SheetTemplatePrivate *const d_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXSHEETTEMPLATE_H
@@ -0,0 +1,94 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXSHEETTEMPLATE_P_H
+#define XLSXSHEETTEMPLATE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxsheettemplate.h"
+#include "xlsxcellrange.h"
+
+#include <QHash>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class SheetTemplatePrivate
+{
+    Q_DECLARE_PUBLIC(SheetTemplate)
+public:
+    // The text of a cell, cut around its placeholders
+    struct Text
+    {
+        QStringList names; // in the order they appear
+        QStringList parts; // one more than the names
+    };
+
+    struct Placeholder
+    {
+        int row;
+        int column;
+        Text text;
+    };
+
+    // The rows which hold the placeholders named "<name>.<field>"
+    struct Region
+    {
+        QString name;
+        int firstRow;
+        int lastRow;
+    };
+
+    SheetTemplatePrivate(SheetTemplate *p);
+
+    void index(const Worksheet *sheet);
+    static bool parse(const QString &text, Text *parsed);
+    QList<Region> repeatedRegions(const QVariantMap &data) const;
+    static void repeatRows(Worksheet *sheet, const Region &region, int count,
+                           const CellRange &columns);
+    static QVariant value(const QString &name, const QVariantMap &data, const Region *region,
+                          const QVariantMap &record);
+    static bool write(Worksheet *sheet, const Placeholder &placeholder, int row,
+                      const QVariantMap &data, const Region *region, const QVariantMap &record);
+
+    QVector<Placeholder> placeholders; // by row, then column
+    QHash<QString, Region> regions; // by name
+    CellRange dimension;
+    SheetTemplate *q_ptr;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXSHEETTEMPLATE_P_H
@@ -0,0 +1,68 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxstatistics_p.h"
+#include "xlsxdocument.h"
+
+QT_BEGIN_NAMESPACE_XLSX
+
+QAtomicInteger<qint64> Statistics::s_counters[Statistics::CounterCount];
+
+/*
+  Returns true if the counters are compiled in.
+ */
+bool Statistics::isEnabled()
+{
+#ifdef XLSX_STATISTICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+DocumentStatistics Statistics::snapshot()
+{
+    DocumentStatistics statistics;
+    statistics.enabled = isEnabled();
+    statistics.cellsWritten = s_counters[CellsWritten].load();
+    statistics.sharedStringHits = s_counters[SharedStringHits].load();
+    statistics.sharedStringMisses = s_counters[SharedStringMisses].load();
+    statistics.cellFormatHits = s_counters[CellFormatHits].load();
+    statistics.cellFormatMisses = s_counters[CellFormatMisses].load();
+    statistics.formatKeyComputations = s_counters[FormatKeyComputations].load();
+    statistics.regexEvaluations = s_counters[RegexEvaluations].load();
+    statistics.sheetDataLookups = s_counters[SheetDataLookups].load();
+    statistics.bytesInflated = s_counters[BytesInflated].load();
+    statistics.bytesDeflated = s_counters[BytesDeflated].load();
+    return statistics;
+}
+
+void Statistics::reset()
+{
+    for (int i = 0; i < CounterCount; ++i)
+        s_counters[i].store(0);
+}
+
+QT_END_NAMESPACE_XLSX
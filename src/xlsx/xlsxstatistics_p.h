@@ -0,0 +1,89 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXSTATISTICS_P_H
+#define XLSXSTATISTICS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+#include <QAtomicInteger>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+struct DocumentStatistics;
+
+/*
+  The hot path counters reported by Document::statistics(), shared by all
+  the documents of the process. They are only compiled in when the library
+  is built with XLSX_STATISTICS defined, count() does nothing otherwise.
+ */
+class XLSX_AUTOTEST_EXPORT Statistics
+{
+public:
+    enum Counter {
+        CellsWritten,
+        SharedStringHits,
+        SharedStringMisses,
+        CellFormatHits,
+        CellFormatMisses,
+        FormatKeyComputations,
+        RegexEvaluations,
+        SheetDataLookups,
+        BytesInflated,
+        BytesDeflated,
+        CounterCount
+    };
+
+    static inline void count(Counter counter, qint64 n = 1)
+    {
+#ifdef XLSX_STATISTICS
+        s_counters[counter].fetchAndAddRelaxed(n);
+#else
+        Q_UNUSED(counter);
+        Q_UNUSED(n);
+#endif
+    }
+
+    static bool isEnabled();
+    static DocumentStatistics snapshot();
+    static void reset();
+
+private:
+    static QAtomicInteger<qint64> s_counters[CounterCount];
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXSTATISTICS_P_H
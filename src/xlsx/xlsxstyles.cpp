@@ -23,9 +23,14 @@
 **
 ****************************************************************************/
 #include "xlsxstyles_p.h"
+#include "xlsxbiff12_p.h"
 #include "xlsxformat_p.h"
 #include "xlsxutility_p.h"
 #include "xlsxcolor_p.h"
+#include "xlsxnumformatparser_p.h"
+#include "xlsxnumformatter_p.h"
+#include "xlsxstatistics_p.h"
+#include "xlsxworkbook.h"
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
 #include <QFile>
@@ -33,9 +38,108 @@
 #include <QDataStream>
 #include <QDebug>
 #include <QBuffer>
+#include <QMutexLocker>
+#include <QSet>
 
 namespace QXlsx {
 
+namespace {
+
+/*
+  The tables shared by all the styles, which are constant initialized, so
+  creating a Document costs nothing of them.
+ */
+struct BuiltinNumFmt
+{
+    int id;
+    const char *code;
+};
+
+// Ids 5 to 8 and 41 to 44 are currency formats, which depend on the locale
+const BuiltinNumFmt builtinNumFmts[] = {
+    {0, "General"},
+    {1, "0"},
+    {2, "0.00"},
+    {3, "#,##0"},
+    {4, "#,##0.00"},
+    {9, "0%"},
+    {10, "0.00%"},
+    {11, "0.00E+00"},
+    {12, "# ?/?"},
+    {13, "# ?\?/??"}, // Note: "??/" is a c++ trigraph, so escape one "?"
+    {14, "m/d/yy"},
+    {15, "d-mmm-yy"},
+    {16, "d-mmm"},
+    {17, "mmm-yy"},
+    {18, "h:mm AM/PM"},
+    {19, "h:mm:ss AM/PM"},
+    {20, "h:mm"},
+    {21, "h:mm:ss"},
+    {22, "m/d/yy h:mm"},
+    {37, "(#,##0_);(#,##0)"},
+    {38, "(#,##0_);[Red](#,##0)"},
+    {39, "(#,##0.00_);(#,##0.00)"},
+    {40, "(#,##0.00_);[Red](#,##0.00)"},
+    {45, "mm:ss"},
+    {46, "[h]:mm:ss"},
+    {47, "mm:ss.0"},
+    {48, "##0.0E+0"},
+    {49, "@"},
+};
+
+const QRgb defaultIndexedColors[] = {
+    0xFF000000, 0xFFFFFFFF, 0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00, 0xFFFF00FF, 0xFF00FFFF,
+    0xFF000000, 0xFFFFFFFF, 0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00, 0xFFFF00FF, 0xFF00FFFF,
+    0xFF800000, 0xFF008000, 0xFF000080, 0xFF808000, 0xFF800080, 0xFF008080, 0xFFC0C0C0, 0xFF808080,
+    0xFF9999FF, 0xFF993366, 0xFFFFFFCC, 0xFFCCFFFF, 0xFF660066, 0xFFFF8080, 0xFF0066CC, 0xFFCCCCFF,
+    0xFF000080, 0xFFFF00FF, 0xFFFFFF00, 0xFF00FFFF, 0xFF800080, 0xFF800000, 0xFF008080, 0xFF0000FF,
+    0xFF00CCFF, 0xFFCCFFFF, 0xFFCCFFCC, 0xFFFFFF99, 0xFF99CCFF, 0xFFFF99CC, 0xFFCC99FF, 0xFFFFCC99,
+    0xFF3366FF, 0xFF33CCCC, 0xFF99CC00, 0xFFFFCC00, 0xFFFF9900, 0xFFFF6600, 0xFF666699, 0xFF969696,
+    0xFF003366, 0xFF339966, 0xFF003300, 0xFF333300, 0xFF993300, 0xFF993366, 0xFF333399, 0xFF333333,
+};
+
+// Looking the codes up, built once for the process
+struct BuiltinNumFmtIds : public QHash<QString, int>
+{
+    BuiltinNumFmtIds()
+    {
+        for (size_t i = 0; i < sizeof(builtinNumFmts) / sizeof(BuiltinNumFmt); ++i)
+            insert(QString::fromLatin1(builtinNumFmts[i].code), builtinNumFmts[i].id);
+    }
+};
+
+Q_GLOBAL_STATIC(BuiltinNumFmtIds, builtinNumFmtIds)
+
+quint64 defaultFillFingerprint()
+{
+    Format fill;
+    fill.setFillPattern(Format::PatternGray125);
+    return fill.fillFingerprint();
+}
+
+const char *builtinNumFmtCode(int id)
+{
+    for (size_t i = 0; i < sizeof(builtinNumFmts) / sizeof(BuiltinNumFmt); ++i) {
+        if (builtinNumFmts[i].id == id)
+            return builtinNumFmts[i].code;
+    }
+    return 0;
+}
+
+bool registerMetaTypes()
+{
+    if (QMetaType::type("XlsxColor") == QMetaType::UnknownType) {
+        qRegisterMetaType<XlsxColor>("XlsxColor");
+        qRegisterMetaTypeStreamOperators<XlsxColor>("XlsxColor");
+#if QT_VERSION >= 0x050200
+        QMetaType::registerDebugStreamOperator<XlsxColor>();
+#endif
+    }
+    return true;
+}
+
+} // namespace
+
 /*
   When loading from existing .xlsx file. we should create a clean styles object.
   otherwise, default formats should be added.
@@ -46,17 +150,12 @@ Styles::Styles(CreateFlag flag)
     , m_nextCustomNumFmtId(176)
     , m_isIndexedColorsDefault(true)
     , m_emptyFormatAdded(false)
+    , m_lookupTablesDeferred(false)
 {
     //! Fix me. Should the custom num fmt Id starts with 164 or 176 or others??
 
-    //! Fix me! Where should we put these register code?
-    if (QMetaType::type("XlsxColor") == QMetaType::UnknownType) {
-        qRegisterMetaType<XlsxColor>("XlsxColor");
-        qRegisterMetaTypeStreamOperators<XlsxColor>("XlsxColor");
-#if QT_VERSION >= 0x050200
-        QMetaType::registerDebugStreamOperator<XlsxColor>();
-#endif
-    }
+    static const bool metaTypesRegistered = registerMetaTypes();
+    Q_UNUSED(metaTypesRegistered);
 
     if (flag == F_NewFromScratch) {
         // Add default Format
@@ -67,7 +166,7 @@ Styles::Styles(CreateFlag flag)
         Format fillFmt;
         fillFmt.setFillPattern(Format::PatternGray125);
         m_fillsList.append(fillFmt);
-        m_fillsHash.insert(fillFmt.fillKey(), fillFmt);
+        m_fillsHash.insert(fillFmt.fillFingerprint(), fillFmt);
     }
 }
 
@@ -75,22 +174,298 @@ Styles::~Styles()
 {
 }
 
+/*
+  Returns new styles holding the same formats, with the same indexes,
+  which are not thread safe. The formats themselves are implicitly shared.
+ */
+Styles *Styles::clone() const
+{
+    QMutexLocker locker(m_mutex.data());
+    Styles *styles = new Styles(F_LoadFromExists);
+    styles->m_customNumFmtIdMap = m_customNumFmtIdMap;
+    styles->m_customNumFmtsHash = m_customNumFmtsHash;
+    styles->m_nextCustomNumFmtId = m_nextCustomNumFmtId;
+    styles->m_numFormatters = m_numFormatters;
+    styles->m_fontsList = m_fontsList;
+    styles->m_fillsList = m_fillsList;
+    styles->m_bordersList = m_bordersList;
+    styles->m_fontsHash = m_fontsHash;
+    styles->m_fillsHash = m_fillsHash;
+    styles->m_bordersHash = m_bordersHash;
+    styles->m_indexedColors = m_indexedColors;
+    styles->m_isIndexedColorsDefault = m_isIndexedColorsDefault;
+    styles->m_xf_formatsList = m_xf_formatsList;
+    styles->m_xf_formatsHash = m_xf_formatsHash;
+    styles->m_dxf_formatsList = m_dxf_formatsList;
+    styles->m_dxf_formatsHash = m_dxf_formatsHash;
+    styles->m_emptyFormatAdded = m_emptyFormatAdded;
+    styles->m_lookupTablesDeferred = m_lookupTablesDeferred;
+    return styles;
+}
+
+/*
+  Lock the styles in every call made while writing cells when \a enable
+  is true. The cached indexes of the formats are assigned with the lock
+  held, so the formats must not be shared by the threads either.
+ */
+void Styles::setThreadSafe(bool enable)
+{
+    if (enable && !m_mutex)
+        m_mutex.reset(new QMutex);
+    else if (!enable)
+        m_mutex.reset();
+}
+
 Format Styles::xfFormat(int idx) const
 {
+    QMutexLocker locker(m_mutex.data());
     if (idx < 0 || idx >= m_xf_formatsList.size())
         return Format();
 
     return m_xf_formatsList[idx];
 }
 
+/*
+  Don't build the lookup tables while the styles are loaded, only the lists
+  which the cells are read from. Used when the document is only read.
+ */
+void Styles::deferLookupTables()
+{
+    m_lookupTablesDeferred = true;
+}
+
+/*
+  Build the lookup tables which have been deferred, as the loader normally
+  does: the formats are added again in order, once the fonts, fills and
+  borders have been indexed.
+ */
+void Styles::buildLookupTables()
+{
+    QMutexLocker locker(m_mutex.data());
+    buildLookupTablesLocked();
+}
+
+/*
+  The same, the lock being held, as for the ...Locked() helpers below
+  which the public functions share.
+ */
+void Styles::buildLookupTablesLocked()
+{
+    if (!m_lookupTablesDeferred)
+        return;
+    m_lookupTablesDeferred = false;
+    const bool dirty = isDirty();
+
+    foreach (const Format &font, m_fontsList)
+        m_fontsHash.insert(font.fontFingerprint(), font);
+    foreach (const Format &fill, m_fillsList)
+        m_fillsHash.insert(fill.fillFingerprint(), fill);
+    foreach (const Format &border, m_bordersList)
+        m_bordersHash.insert(border.borderFingerprint(), border);
+
+    QList<Format> xfFormats;
+    xfFormats.swap(m_xf_formatsList);
+    foreach (const Format &format, xfFormats)
+        addXfFormatLocked(format, true);
+    QList<Format> dxfFormats;
+    dxfFormats.swap(m_dxf_formatsList);
+    foreach (const Format &format, dxfFormats)
+        addDxfFormatLocked(format, true);
+
+    setDirty(dirty);
+}
+
+/*
+  Add \a format to the xf formats, and return its index or -1 for an
+  empty format. Cells can be written with the returned id from then on,
+  without copying the format again.
+ */
+int Styles::registerFormat(const Format &format)
+{
+    QMutexLocker locker(m_mutex.data());
+    if (format.isEmpty())
+        return -1;
+    addXfFormatLocked(format);
+    return format.xfIndex();
+}
+
+/*
+  Returns true if \a styleId is -1 or the index of an xf format.
+ */
+bool Styles::isValidStyleId(int styleId) const
+{
+    QMutexLocker locker(m_mutex.data());
+    return styleId >= -1 && styleId < m_xf_formatsList.size();
+}
+
 Format Styles::dxfFormat(int idx) const
 {
+    QMutexLocker locker(m_mutex.data());
     if (idx < 0 || idx >= m_dxf_formatsList.size())
         return Format();
 
     return m_dxf_formatsList[idx];
 }
 
+StyleStatistics Styles::statistics() const
+{
+    QMutexLocker locker(m_mutex.data());
+    StyleStatistics statistics;
+    statistics.numberFormats = m_customNumFmtIdMap.size();
+    statistics.fonts = m_fontsList.size();
+    statistics.fills = m_fillsList.size();
+    statistics.borders = m_bordersList.size();
+    statistics.cellFormats = m_xf_formatsList.size();
+    statistics.differentialFormats = m_dxf_formatsList.size();
+    return statistics;
+}
+
+/*
+  Returns an estimate of the bytes held by the formats of the tables and
+  by their lookup tables. The properties shared by the formats of several
+  tables are counted once, by their fixed size. Each hash node is counted
+  as its key and value plus the next pointer and the hash code.
+ */
+qint64 Styles::memoryUsage() const
+{
+    QMutexLocker locker(m_mutex.data());
+    const QList<Format> *const lists[] = {&m_fontsList, &m_fillsList, &m_bordersList,
+                                          &m_xf_formatsList, &m_dxf_formatsList};
+    QSet<const FormatPrivate *> properties;
+    qint64 size = 0;
+    for (int i = 0; i < int(sizeof(lists) / sizeof(lists[0])); ++i) {
+        size += qint64(lists[i]->size()) * sizeof(Format);
+        foreach (const Format &format, *lists[i]) {
+            if (format.d)
+                properties.insert(format.d.constData());
+        }
+    }
+    const qint64 nodeOverhead = sizeof(void *) + sizeof(uint);
+    const qint64 hashedFormats = m_fontsHash.size() + m_fillsHash.size() + m_bordersHash.size()
+        + m_xf_formatsHash.size() + m_dxf_formatsHash.size();
+    size += properties.size() * sizeof(FormatPrivate)
+        + hashedFormats * (sizeof(quint64) + sizeof(Format) + nodeOverhead)
+        + m_customNumFmtIdMap.size() * (sizeof(XlsxFormatNumberData) + 2 * nodeOverhead);
+    return size;
+}
+
+/*
+  Merge the identical xf formats, drop the ones which are not set in
+  \a usedXfs, and keep only the fonts, fills and borders used by the
+  remaining ones. The first xf, font and border and the first two fills
+  are the defaults, which are always kept. \a xfMap is filled with the
+  new index of each xf format, or -1 for the dropped ones.
+
+  The formats which still cache an old index are assigned a new one when
+  they are added again.
+ */
+void Styles::compact(const QVector<bool> &usedXfs, QVector<int> *xfMap)
+{
+    QMutexLocker locker(m_mutex.data());
+    buildLookupTablesLocked();
+
+    const int xfCount = m_xf_formatsList.size();
+    xfMap->fill(-1, xfCount);
+
+    QList<Format> xfFormats;
+    QHash<quint64, Format> xfFormatsHash;
+    QHash<quint64, int> xfIndexes;
+    for (int i = 0; i < xfCount; ++i) {
+        if (i > 0 && (i >= usedXfs.size() || !usedXfs[i]))
+            continue;
+        Format &format = m_xf_formatsList[i];
+        const quint64 fingerprint = format.formatFingerprint();
+        QHash<quint64, int>::const_iterator it = xfIndexes.constFind(fingerprint);
+        const int index = it != xfIndexes.constEnd() ? it.value() : xfFormats.size();
+        (*xfMap)[i] = index;
+        if (!format.isEmpty())
+            format.setXfIndex(index);
+        if (it == xfIndexes.constEnd()) {
+            xfFormats.append(format);
+            xfFormatsHash.insert(fingerprint, format);
+            xfIndexes.insert(fingerprint, index);
+        }
+    }
+
+    QList<Format> fonts;
+    QList<Format> fills;
+    QList<Format> borders;
+    QHash<quint64, Format> fontsHash;
+    QHash<quint64, Format> fillsHash;
+    QHash<quint64, Format> bordersHash;
+    for (int i = 0; i < m_fontsList.size() && i < 1; ++i) {
+        if (m_fontsList[i].hasFontData())
+            m_fontsList[i].setFontIndex(i);
+        fonts.append(m_fontsList[i]);
+        fontsHash.insert(m_fontsList[i].fontFingerprint(), m_fontsList[i]);
+    }
+    for (int i = 0; i < m_fillsList.size() && i < 2; ++i) {
+        if (m_fillsList[i].hasFillData())
+            m_fillsList[i].setFillIndex(i);
+        fills.append(m_fillsList[i]);
+        fillsHash.insert(m_fillsList[i].fillFingerprint(), m_fillsList[i]);
+    }
+    for (int i = 0; i < m_bordersList.size() && i < 1; ++i) {
+        if (m_bordersList[i].hasBorderData())
+            m_bordersList[i].setBorderIndex(i);
+        borders.append(m_bordersList[i]);
+        bordersHash.insert(m_bordersList[i].borderFingerprint(), m_bordersList[i]);
+    }
+
+    for (int i = 0; i < xfFormats.size(); ++i) {
+        Format &format = xfFormats[i];
+        if (format.hasFontData()) {
+            const quint64 fingerprint = format.fontFingerprint();
+            QHash<quint64, Format>::const_iterator it = fontsHash.constFind(fingerprint);
+            if (it == fontsHash.constEnd()) {
+                format.setFontIndex(fonts.size());
+                fonts.append(format);
+                fontsHash.insert(fingerprint, format);
+            } else {
+                format.setFontIndex(it.value().fontIndex());
+            }
+        }
+        if (format.hasFillData()) {
+            const quint64 fingerprint = format.fillFingerprint();
+            QHash<quint64, Format>::const_iterator it = fillsHash.constFind(fingerprint);
+            if (it == fillsHash.constEnd()) {
+                format.setFillIndex(fills.size());
+                fills.append(format);
+                fillsHash.insert(fingerprint, format);
+            } else {
+                format.setFillIndex(it.value().fillIndex());
+            }
+        }
+        if (format.hasBorderData()) {
+            const quint64 fingerprint = format.borderFingerprint();
+            QHash<quint64, Format>::const_iterator it = bordersHash.constFind(fingerprint);
+            if (it == bordersHash.constEnd()) {
+                format.setBorderIndex(borders.size());
+                borders.append(format);
+                bordersHash.insert(fingerprint, format);
+            } else {
+                format.setBorderIndex(it.value().borderIndex());
+            }
+        }
+    }
+
+    m_xf_formatsList.swap(xfFormats);
+    m_xf_formatsHash.swap(xfFormatsHash);
+    m_fontsList.swap(fonts);
+    m_fontsHash.swap(fontsHash);
+    m_fillsList.swap(fills);
+    m_fillsHash.swap(fillsHash);
+    m_bordersList.swap(borders);
+    m_bordersHash.swap(bordersHash);
+
+    m_emptyFormatAdded = false;
+    foreach (const Format &format, m_xf_formatsList) {
+        if (format.isEmpty())
+            m_emptyFormatAdded = true;
+    }
+    setDirty();
+}
+
 void Styles::fixNumFmt(const Format &format)
 {
     if (!format.hasNumFmtData())
@@ -101,65 +476,24 @@ void Styles::fixNumFmt(const Format &format)
         return;
     }
 
-    if (m_builtinNumFmtsHash.isEmpty()) {
-        m_builtinNumFmtsHash.insert(QStringLiteral("General"), 0);
-        m_builtinNumFmtsHash.insert(QStringLiteral("0"), 1);
-        m_builtinNumFmtsHash.insert(QStringLiteral("0.00"), 2);
-        m_builtinNumFmtsHash.insert(QStringLiteral("#,##0"), 3);
-        m_builtinNumFmtsHash.insert(QStringLiteral("#,##0.00"), 4);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("($#,##0_);($#,##0)"), 5);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("($#,##0_);[Red]($#,##0)"), 6);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("($#,##0.00_);($#,##0.00)"), 7);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("($#,##0.00_);[Red]($#,##0.00)"),
-        //            8);
-        m_builtinNumFmtsHash.insert(QStringLiteral("0%"), 9);
-        m_builtinNumFmtsHash.insert(QStringLiteral("0.00%"), 10);
-        m_builtinNumFmtsHash.insert(QStringLiteral("0.00E+00"), 11);
-        m_builtinNumFmtsHash.insert(QStringLiteral("# ?/?"), 12);
-        m_builtinNumFmtsHash.insert(QStringLiteral("# ?\?/??"),
-                                    13); // Note: "??/" is a c++ trigraph, so escape one "?"
-        m_builtinNumFmtsHash.insert(QStringLiteral("m/d/yy"), 14);
-        m_builtinNumFmtsHash.insert(QStringLiteral("d-mmm-yy"), 15);
-        m_builtinNumFmtsHash.insert(QStringLiteral("d-mmm"), 16);
-        m_builtinNumFmtsHash.insert(QStringLiteral("mmm-yy"), 17);
-        m_builtinNumFmtsHash.insert(QStringLiteral("h:mm AM/PM"), 18);
-        m_builtinNumFmtsHash.insert(QStringLiteral("h:mm:ss AM/PM"), 19);
-        m_builtinNumFmtsHash.insert(QStringLiteral("h:mm"), 20);
-        m_builtinNumFmtsHash.insert(QStringLiteral("h:mm:ss"), 21);
-        m_builtinNumFmtsHash.insert(QStringLiteral("m/d/yy h:mm"), 22);
-
-        m_builtinNumFmtsHash.insert(QStringLiteral("(#,##0_);(#,##0)"), 37);
-        m_builtinNumFmtsHash.insert(QStringLiteral("(#,##0_);[Red](#,##0)"), 38);
-        m_builtinNumFmtsHash.insert(QStringLiteral("(#,##0.00_);(#,##0.00)"), 39);
-        m_builtinNumFmtsHash.insert(QStringLiteral("(#,##0.00_);[Red](#,##0.00)"), 40);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("_(* #,##0_);_(* (#,##0);_(*
-        //            \"-\"_);_(_)"), 41); m_builtinNumFmtsHash.insert(QStringLiteral("_($*
-        //            #,##0_);_($* (#,##0);_($* \"-\"_);_(_)"), 42);
-        //            m_builtinNumFmtsHash.insert(QStringLiteral("_(* #,##0.00_);_(* (#,##0.00);_(*
-        //            \"-\"??_);_(_)"), 43); m_builtinNumFmtsHash.insert(QStringLiteral("_($*
-        //            #,##0.00_);_($* (#,##0.00);_($* \"-\"??_);_(_)"), 44);
-        m_builtinNumFmtsHash.insert(QStringLiteral("mm:ss"), 45);
-        m_builtinNumFmtsHash.insert(QStringLiteral("[h]:mm:ss"), 46);
-        m_builtinNumFmtsHash.insert(QStringLiteral("mm:ss.0"), 47);
-        m_builtinNumFmtsHash.insert(QStringLiteral("##0.0E+0"), 48);
-        m_builtinNumFmtsHash.insert(QStringLiteral("@"), 49);
-    }
-
     const QString str = format.numberFormat();
     if (!str.isEmpty()) {
         // Assign proper number format index
-        if (m_builtinNumFmtsHash.contains(str)) {
-            const_cast<Format *>(&format)->fixNumberFormat(m_builtinNumFmtsHash[str], str);
+        QHash<QString, int>::const_iterator builtin = builtinNumFmtIds()->constFind(str);
+        if (builtin != builtinNumFmtIds()->constEnd()) {
+            const_cast<Format *>(&format)->fixNumberFormat(builtin.value(), str);
         } else if (m_customNumFmtsHash.contains(str)) {
-            const_cast<Format *>(&format)->fixNumberFormat(m_customNumFmtsHash[str]->formatIndex,
-                                                           str);
+            const QSharedPointer<XlsxFormatNumberData> fmt = m_customNumFmtsHash[str];
+            const_cast<Format *>(&format)->fixNumberFormat(fmt->formatIndex, str);
+            const_cast<Format *>(&format)->fixDateTimeFormat(fmt->isDateTime);
         } else {
             // Assign a new fmt Id.
-            const_cast<Format *>(&format)->fixNumberFormat(m_nextCustomNumFmtId, str);
-
             QSharedPointer<XlsxFormatNumberData> fmt(new XlsxFormatNumberData);
             fmt->formatIndex = m_nextCustomNumFmtId;
             fmt->formatString = str;
+            fmt->isDateTime = NumFormatParser::isDateTime(str);
+            const_cast<Format *>(&format)->fixNumberFormat(m_nextCustomNumFmtId, str);
+            const_cast<Format *>(&format)->fixDateTimeFormat(fmt->isDateTime);
             m_customNumFmtIdMap.insert(m_nextCustomNumFmtId, fmt);
             m_customNumFmtsHash.insert(str, fmt);
 
@@ -169,21 +503,14 @@ void Styles::fixNumFmt(const Format &format)
         int id = format.numberFormatIndex();
         // Assign proper format code, this is needed by dxf format
         if (m_customNumFmtIdMap.contains(id)) {
-            const_cast<Format *>(&format)->fixNumberFormat(id,
-                                                           m_customNumFmtIdMap[id]->formatString);
+            const QSharedPointer<XlsxFormatNumberData> fmt = m_customNumFmtIdMap[id];
+            const_cast<Format *>(&format)->fixNumberFormat(id, fmt->formatString);
+            const_cast<Format *>(&format)->fixDateTimeFormat(fmt->isDateTime);
         } else {
-            QHashIterator<QString, int> it(m_builtinNumFmtsHash);
-            bool find = false;
-            while (it.hasNext()) {
-                it.next();
-                if (it.value() == id) {
-                    const_cast<Format *>(&format)->fixNumberFormat(id, it.key());
-                    find = true;
-                    break;
-                }
-            }
-
-            if (!find) {
+            const char *code = builtinNumFmtCode(id);
+            if (code) {
+                const_cast<Format *>(&format)->fixNumberFormat(id, QString::fromLatin1(code));
+            } else {
                 // Wrong numFmt
                 const_cast<Format *>(&format)->fixNumberFormat(id, QStringLiteral("General"));
             }
@@ -200,6 +527,13 @@ void Styles::fixNumFmt(const Format &format)
 */
 void Styles::addXfFormat(const Format &format, bool force)
 {
+    QMutexLocker locker(m_mutex.data());
+    addXfFormatLocked(format, force);
+}
+
+void Styles::addXfFormatLocked(const Format &format, bool force)
+{
+    buildLookupTablesLocked();
     if (format.isEmpty()) {
         // Try do something for empty Format.
         if (m_emptyFormatAdded && !force)
@@ -211,83 +545,152 @@ void Styles::addXfFormat(const Format &format, bool force)
     if (format.hasNumFmtData() && !format.hasProperty(FormatPrivate::P_NumFmt_Id))
         fixNumFmt(format);
 
-    // Font
-    if (format.hasFontData() && !format.fontIndexValid()) {
+    // Font. The cached indexes may refer to the entries dropped by compact()
+    const quint64 fontFingerprint = format.fontFingerprint();
+    QHash<quint64, Format>::const_iterator fontIt = m_fontsHash.constFind(fontFingerprint);
+    if (format.hasFontData()
+        && (!format.fontIndexValid() || format.fontIndex() >= m_fontsList.size()
+            || m_fontsList[format.fontIndex()].fontFingerprint() != fontFingerprint)) {
         // Assign proper font index, if has font data.
-        if (!m_fontsHash.contains(format.fontKey()))
+        if (fontIt == m_fontsHash.constEnd())
             const_cast<Format *>(&format)->setFontIndex(m_fontsList.size());
         else
-            const_cast<Format *>(&format)->setFontIndex(m_fontsHash[format.fontKey()].fontIndex());
+            const_cast<Format *>(&format)->setFontIndex(fontIt.value().fontIndex());
     }
-    if (!m_fontsHash.contains(format.fontKey())) {
+    if (fontIt == m_fontsHash.constEnd()) {
         // Still a valid font if the format has no fontData. (All font properties are default)
         m_fontsList.append(format);
-        m_fontsHash[format.fontKey()] = format;
+        m_fontsHash.insert(fontFingerprint, format);
     }
 
     // Fill
-    if (format.hasFillData() && !format.fillIndexValid()) {
+    const quint64 fillFingerprint = format.fillFingerprint();
+    QHash<quint64, Format>::const_iterator fillIt = m_fillsHash.constFind(fillFingerprint);
+    if (format.hasFillData()
+        && (!format.fillIndexValid() || format.fillIndex() >= m_fillsList.size()
+            || m_fillsList[format.fillIndex()].fillFingerprint() != fillFingerprint)) {
         // Assign proper fill index, if has fill data.
-        if (!m_fillsHash.contains(format.fillKey()))
+        if (fillIt == m_fillsHash.constEnd())
             const_cast<Format *>(&format)->setFillIndex(m_fillsList.size());
         else
-            const_cast<Format *>(&format)->setFillIndex(m_fillsHash[format.fillKey()].fillIndex());
+            const_cast<Format *>(&format)->setFillIndex(fillIt.value().fillIndex());
     }
-    if (!m_fillsHash.contains(format.fillKey())) {
+    if (fillIt == m_fillsHash.constEnd()) {
         // Still a valid fill if the format has no fillData. (All fill properties are default)
         m_fillsList.append(format);
-        m_fillsHash[format.fillKey()] = format;
+        m_fillsHash.insert(fillFingerprint, format);
     }
 
     // Border
-    if (format.hasBorderData() && !format.borderIndexValid()) {
+    const quint64 borderFingerprint = format.borderFingerprint();
+    QHash<quint64, Format>::const_iterator borderIt = m_bordersHash.constFind(borderFingerprint);
+    if (format.hasBorderData()
+        && (!format.borderIndexValid() || format.borderIndex() >= m_bordersList.size()
+            || m_bordersList[format.borderIndex()].borderFingerprint() != borderFingerprint)) {
         // Assign proper border index, if has border data.
-        if (!m_bordersHash.contains(format.borderKey()))
+        if (borderIt == m_bordersHash.constEnd())
             const_cast<Format *>(&format)->setBorderIndex(m_bordersList.size());
         else
-            const_cast<Format *>(&format)->setBorderIndex(
-                m_bordersHash[format.borderKey()].borderIndex());
+            const_cast<Format *>(&format)->setBorderIndex(borderIt.value().borderIndex());
     }
-    if (!m_bordersHash.contains(format.borderKey())) {
+    if (borderIt == m_bordersHash.constEnd()) {
         // Still a valid border if the format has no borderData. (All border properties are default)
         m_bordersList.append(format);
-        m_bordersHash[format.borderKey()] = format;
+        m_bordersHash.insert(borderFingerprint, format);
     }
 
     // Format
-    if (!format.isEmpty() && !format.xfIndexValid()) {
-        if (m_xf_formatsHash.contains(format.formatKey()))
-            const_cast<Format *>(&format)->setXfIndex(
-                m_xf_formatsHash[format.formatKey()].xfIndex());
+    const quint64 fingerprint = format.formatFingerprint();
+    QHash<quint64, Format>::const_iterator xfIt = m_xf_formatsHash.constFind(fingerprint);
+    if (!force) {
+        Statistics::count(xfIt != m_xf_formatsHash.constEnd() ? Statistics::CellFormatHits
+                                                              : Statistics::CellFormatMisses);
+    }
+    if (!format.isEmpty()
+        && (!format.xfIndexValid() || format.xfIndex() >= m_xf_formatsList.size()
+            || m_xf_formatsList[format.xfIndex()].formatFingerprint() != fingerprint)) {
+        if (xfIt != m_xf_formatsHash.constEnd())
+            const_cast<Format *>(&format)->setXfIndex(xfIt.value().xfIndex());
         else
             const_cast<Format *>(&format)->setXfIndex(m_xf_formatsList.size());
     }
-    if (!m_xf_formatsHash.contains(format.formatKey()) || force) {
+    if (xfIt == m_xf_formatsHash.constEnd() || force) {
         m_xf_formatsList.append(format);
-        m_xf_formatsHash[format.formatKey()] = format;
+        m_xf_formatsHash.insert(fingerprint, format);
+        setDirty();
     }
 }
 
 void Styles::addDxfFormat(const Format &format, bool force)
 {
+    QMutexLocker locker(m_mutex.data());
+    addDxfFormatLocked(format, force);
+}
+
+void Styles::addDxfFormatLocked(const Format &format, bool force)
+{
+    buildLookupTablesLocked();
     // numFmt
     if (format.hasNumFmtData())
         fixNumFmt(format);
 
+    const quint64 fingerprint = format.formatFingerprint();
+    QHash<quint64, Format>::const_iterator it = m_dxf_formatsHash.constFind(fingerprint);
     if (!format.isEmpty() && !format.dxfIndexValid()) {
-        if (m_dxf_formatsHash.contains(format.formatKey()))
-            const_cast<Format *>(&format)->setDxfIndex(
-                m_dxf_formatsHash[format.formatKey()].dxfIndex());
+        if (it != m_dxf_formatsHash.constEnd())
+            const_cast<Format *>(&format)->setDxfIndex(it.value().dxfIndex());
         else
             const_cast<Format *>(&format)->setDxfIndex(m_dxf_formatsList.size());
     }
-    if (!m_dxf_formatsHash.contains(format.formatKey()) || force) {
+    if (it == m_dxf_formatsHash.constEnd() || force) {
         m_dxf_formatsList.append(format);
-        m_dxf_formatsHash[format.formatKey()] = format;
+        m_dxf_formatsHash.insert(fingerprint, format);
+        setDirty();
     }
 }
 
+QByteArray Styles::defaultStylesXml()
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    Styles(F_NewFromScratch).writeXml(&buffer);
+    return data;
+}
+
+/*
+  Whether the styles only hold the formats of new styles: the empty cell
+  format, its font and its border, and the two fills every workbook has.
+ */
+bool Styles::hasDefaultFormats() const
+{
+    static const quint64 gray125Fingerprint = defaultFillFingerprint();
+    return m_xf_formatsList.size() == 1 && m_xf_formatsList[0].isEmpty()
+           && m_fontsList.size() == 1 && !m_fontsList[0].hasFontData()
+           && m_fillsList.size() == 2 && !m_fillsList[0].hasFillData()
+           && m_fillsList[1].fillFingerprint() == gray125Fingerprint
+           && m_bordersList.size() == 1 && !m_bordersList[0].hasBorderData()
+           && m_dxf_formatsList.isEmpty() && m_customNumFmtIdMap.isEmpty()
+           && m_isIndexedColorsDefault;
+}
+
+/*
+  The styles of a new workbook are written once for the process, which
+  saves most of the cost of the small files.
+ */
 void Styles::saveToXmlFile(QIODevice *device) const
+{
+    // The indexes of the fonts, fills and borders are assigned with the tables
+    const_cast<Styles *>(this)->buildLookupTables();
+    if (hasDefaultFormats()) {
+        static const QByteArray defaultXml = defaultStylesXml();
+        device->write(defaultXml);
+        return;
+    }
+    writeXml(device);
+}
+
+void Styles::writeXml(QIODevice *device) const
 {
     QXmlStreamWriter writer(device);
 
@@ -759,6 +1162,7 @@ bool Styles::readNumFmts(QXmlStreamReader &reader)
                 QSharedPointer<XlsxFormatNumberData> fmt(new XlsxFormatNumberData);
                 fmt->formatIndex = attributes.value(QLatin1String("numFmtId")).toString().toInt();
                 fmt->formatString = attributes.value(QLatin1String("formatCode")).toString();
+                fmt->isDateTime = NumFormatParser::isDateTime(fmt->formatString);
                 if (fmt->formatIndex >= m_nextCustomNumFmtId)
                     m_nextCustomNumFmtId = fmt->formatIndex + 1;
                 m_customNumFmtIdMap.insert(fmt->formatIndex, fmt);
@@ -791,7 +1195,8 @@ bool Styles::readFonts(QXmlStreamReader &reader)
                 Format format;
                 readFont(reader, format);
                 m_fontsList.append(format);
-                m_fontsHash.insert(format.fontKey(), format);
+                if (!m_lookupTablesDeferred)
+                    m_fontsHash.insert(format.fontFingerprint(), format);
                 if (format.isValid())
                     format.setFontIndex(m_fontsList.size() - 1);
             }
@@ -886,7 +1291,8 @@ bool Styles::readFills(QXmlStreamReader &reader)
                 Format fill;
                 readFill(reader, fill);
                 m_fillsList.append(fill);
-                m_fillsHash.insert(fill.fillKey(), fill);
+                if (!m_lookupTablesDeferred)
+                    m_fillsHash.insert(fill.fillFingerprint(), fill);
                 if (fill.isValid())
                     fill.setFillIndex(m_fillsList.size() - 1);
             }
@@ -986,7 +1392,8 @@ bool Styles::readBorders(QXmlStreamReader &reader)
                 Format border;
                 readBorder(reader, border);
                 m_bordersList.append(border);
-                m_bordersHash.insert(border.borderKey(), border);
+                if (!m_lookupTablesDeferred)
+                    m_bordersHash.insert(border.borderFingerprint(), border);
                 if (border.isValid())
                     border.setBorderIndex(m_bordersList.size() - 1);
             }
@@ -1104,6 +1511,92 @@ bool Styles::readSubBorder(QXmlStreamReader &reader, const QString &name,
     return true;
 }
 
+namespace {
+
+/*
+  The attributes of the <xf> elements: the ids come first, then the apply
+  flags in the same order.
+ */
+enum XfAttribute {
+    XfNumFmtId,
+    XfFontId,
+    XfFillId,
+    XfBorderId,
+    XfIdCount,
+    XfApplyNumberFormat = XfIdCount,
+    XfApplyFont,
+    XfApplyFill,
+    XfApplyBorder,
+    XfApplyAlignment,
+    XfOtherAttribute
+};
+
+XfAttribute xfAttributeId(const QStringRef &name)
+{
+    switch (name.size()) {
+    case 6:
+        if (name == QLatin1String("fontId"))
+            return XfFontId;
+        if (name == QLatin1String("fillId"))
+            return XfFillId;
+        break;
+    case 8:
+        if (name == QLatin1String("numFmtId"))
+            return XfNumFmtId;
+        if (name == QLatin1String("borderId"))
+            return XfBorderId;
+        break;
+    case 9:
+        if (name == QLatin1String("applyFont"))
+            return XfApplyFont;
+        if (name == QLatin1String("applyFill"))
+            return XfApplyFill;
+        break;
+    case 11:
+        if (name == QLatin1String("applyBorder"))
+            return XfApplyBorder;
+        break;
+    case 14:
+        if (name == QLatin1String("applyAlignment"))
+            return XfApplyAlignment;
+        break;
+    case 17:
+        if (name == QLatin1String("applyNumberFormat"))
+            return XfApplyNumberFormat;
+        break;
+    default:
+        break;
+    }
+    return XfOtherAttribute;
+}
+
+inline bool isXsdTrue(const QStringRef &value)
+{
+    return value == QLatin1String("1") || value == QLatin1String("true");
+}
+
+} // namespace
+
+/*
+  Copy the properties of \a source from \a first to \a last, one of the
+  property groups, to \a format, which isn't shared yet. The values are
+  stored as they are, the keys and fingerprints of a new format being
+  computed on first use anyway.
+ */
+void Styles::copyProperties(Format &format, const Format &source, int first, int last)
+{
+    const FormatPrivate *from = source.d.constData();
+    if (!from || !from->hasPropertyIn(first, last))
+        return;
+    if (!format.d)
+        format.d = new FormatPrivate;
+    FormatPrivate *to = format.d.data();
+    for (int id = first; id < last; ++id) {
+        if (from->hasProperty(id))
+            to->setPropertyValue(id, from->propertyValue(id));
+    }
+}
+
 bool Styles::readCellXfs(QXmlStreamReader &reader)
 {
     Q_ASSERT(reader.name() == QLatin1String("cellXfs"));
@@ -1118,82 +1611,57 @@ bool Styles::readCellXfs(QXmlStreamReader &reader)
             if (reader.name() == QLatin1String("xf")) {
 
                 Format format;
-                QXmlStreamAttributes xfAttrs = reader.attributes();
-
-                //        qDebug()<<reader.name()<<reader.tokenString()<<" .........";
-                //        for (int i=0; i<xfAttrs.size(); ++i)
-                //            qDebug()<<"... "<<i<<" "<<xfAttrs[i].name()<<xfAttrs[i].value();
-
-                if (xfAttrs.hasAttribute(QLatin1String("numFmtId"))) {
-                    int numFmtIndex = xfAttrs.value(QLatin1String("numFmtId")).toString().toInt();
-                    bool apply = parseXsdBoolean(
-                        xfAttrs.value(QLatin1String("applyNumberFormat")).toString());
-                    if (apply) {
-                        if (!m_customNumFmtIdMap.contains(numFmtIndex))
-                            format.setNumberFormatIndex(numFmtIndex);
-                        else
-                            format.setNumberFormat(numFmtIndex,
-                                                   m_customNumFmtIdMap[numFmtIndex]->formatString);
-                    }
+                int ids[XfIdCount] = {-1, -1, -1, -1};
+                bool applied[XfIdCount] = {false, false, false, false};
+                bool applyAlignment = false;
+                const QXmlStreamAttributes xfAttrs = reader.attributes();
+                for (int i = 0; i < xfAttrs.size(); ++i) {
+                    const QXmlStreamAttribute &attribute = xfAttrs[i];
+                    const int id = xfAttributeId(attribute.name());
+                    if (id < XfIdCount)
+                        ids[id] = attribute.value().toInt();
+                    else if (id < XfApplyAlignment)
+                        applied[id - XfApplyNumberFormat] = isXsdTrue(attribute.value());
+                    else if (id == XfApplyAlignment)
+                        applyAlignment = isXsdTrue(attribute.value());
                 }
 
-                if (xfAttrs.hasAttribute(QLatin1String("fontId"))) {
-                    int fontIndex = xfAttrs.value(QLatin1String("fontId")).toString().toInt();
-                    if (fontIndex >= m_fontsList.size()) {
-                        qDebug("Error read styles.xml, cellXfs fontId");
+                if (ids[XfNumFmtId] != -1 && applied[XfNumFmtId]) {
+                    const int numFmtIndex = ids[XfNumFmtId];
+                    const QSharedPointer<XlsxFormatNumberData> fmt =
+                        m_customNumFmtIdMap.value(numFmtIndex);
+                    if (!fmt) {
+                        format.setNumberFormatIndex(numFmtIndex);
+                        format.fixDateTimeFormat(NumFormatParser::isBuiltinDateTime(numFmtIndex));
                     } else {
-                        bool apply =
-                            parseXsdBoolean(xfAttrs.value(QLatin1String("applyFont")).toString());
-                        if (apply) {
-                            Format fontFormat = m_fontsList[fontIndex];
-                            for (int i = FormatPrivate::P_Font_STARTID;
-                                 i < FormatPrivate::P_Font_ENDID; ++i) {
-                                if (fontFormat.hasProperty(i))
-                                    format.setProperty(i, fontFormat.property(i));
-                            }
-                        }
+                        format.setNumberFormat(numFmtIndex, fmt->formatString);
+                        format.fixDateTimeFormat(fmt->isDateTime);
                     }
                 }
 
-                if (xfAttrs.hasAttribute(QLatin1String("fillId"))) {
-                    int id = xfAttrs.value(QLatin1String("fillId")).toString().toInt();
-                    if (id >= m_fillsList.size()) {
-                        qDebug("Error read styles.xml, cellXfs fillId");
-                    } else {
-                        bool apply =
-                            parseXsdBoolean(xfAttrs.value(QLatin1String("applyFill")).toString());
-                        if (apply) {
-                            Format fillFormat = m_fillsList[id];
-                            for (int i = FormatPrivate::P_Fill_STARTID;
-                                 i < FormatPrivate::P_Fill_ENDID; ++i) {
-                                if (fillFormat.hasProperty(i))
-                                    format.setProperty(i, fillFormat.property(i));
-                            }
-                        }
-                    }
+                if (ids[XfFontId] >= m_fontsList.size()) {
+                    qDebug("Error read styles.xml, cellXfs fontId");
+                } else if (ids[XfFontId] != -1 && applied[XfFontId]) {
+                    copyProperties(format, m_fontsList.at(ids[XfFontId]),
+                                   FormatPrivate::P_Font_STARTID, FormatPrivate::P_Font_ENDID);
                 }
 
-                if (xfAttrs.hasAttribute(QLatin1String("borderId"))) {
-                    int id = xfAttrs.value(QLatin1String("borderId")).toString().toInt();
-                    if (id >= m_bordersList.size()) {
-                        qDebug("Error read styles.xml, cellXfs borderId");
-                    } else {
-                        bool apply =
-                            parseXsdBoolean(xfAttrs.value(QLatin1String("applyBorder")).toString());
-                        if (apply) {
-                            Format borderFormat = m_bordersList[id];
-                            for (int i = FormatPrivate::P_Border_STARTID;
-                                 i < FormatPrivate::P_Border_ENDID; ++i) {
-                                if (borderFormat.hasProperty(i))
-                                    format.setProperty(i, borderFormat.property(i));
-                            }
-                        }
-                    }
+                if (ids[XfFillId] >= m_fillsList.size()) {
+                    qDebug("Error read styles.xml, cellXfs fillId");
+                } else if (ids[XfFillId] != -1 && applied[XfFillId]) {
+                    copyProperties(format, m_fillsList.at(ids[XfFillId]),
+                                   FormatPrivate::P_Fill_STARTID, FormatPrivate::P_Fill_ENDID);
+                }
+
+                if (ids[XfBorderId] >= m_bordersList.size()) {
+                    qDebug("Error read styles.xml, cellXfs borderId");
+                } else if (ids[XfBorderId] != -1 && applied[XfBorderId]) {
+                    copyProperties(format, m_bordersList.at(ids[XfBorderId]),
+                                   FormatPrivate::P_Border_STARTID,
+                                   FormatPrivate::P_Border_ENDID);
                 }
 
-                bool apply =
-                    parseXsdBoolean(xfAttrs.value(QLatin1String("applyAlignment")).toString());
-                if (apply) {
+                if (applyAlignment) {
                     reader.readNextStartElement();
                     if (reader.name() == QLatin1String("alignment")) {
                         QXmlStreamAttributes alignAttrs = reader.attributes();
@@ -1253,7 +1721,13 @@ bool Styles::readCellXfs(QXmlStreamReader &reader)
                     }
                 }
 
-                addXfFormat(format, true);
+                if (m_lookupTablesDeferred) {
+                    if (!format.isEmpty())
+                        format.setXfIndex(m_xf_formatsList.size());
+                    m_xf_formatsList.append(format);
+                } else {
+                    addXfFormat(format, true);
+                }
             }
         }
     }
@@ -1314,7 +1788,13 @@ bool Styles::readDxf(QXmlStreamReader &reader)
             }
         }
     }
-    addDxfFormat(format, true);
+    if (m_lookupTablesDeferred) {
+        if (!format.isEmpty())
+            format.setDxfIndex(m_dxf_formatsList.size());
+        m_dxf_formatsList.append(format);
+    } else {
+        addDxfFormat(format, true);
+    }
     return true;
 }
 
@@ -1355,6 +1835,15 @@ bool Styles::readIndexedColors(QXmlStreamReader &reader)
     return true;
 }
 
+/*
+  The cell formats are the elements of the styles.
+ */
+qint64 Styles::elementCount() const
+{
+    QMutexLocker locker(m_mutex.data());
+    return m_xf_formatsList.size();
+}
+
 bool Styles::loadFromXmlFile(QIODevice *device)
 {
     QXmlStreamReader reader(device);
@@ -1389,32 +1878,543 @@ bool Styles::loadFromXmlFile(QIODevice *device)
     return true;
 }
 
-QColor Styles::getColorByIndex(int idx)
+/*
+  The fill patterns of the BIFF12 records, which order the last four
+  patterns differently.
+ */
+static int binaryFillPattern(Format::FillPattern pattern)
+{
+    switch (pattern) {
+    case Format::PatternLightTrellis:
+        return 16;
+    case Format::PatternGray125:
+        return 17;
+    case Format::PatternGray0625:
+        return 18;
+    case Format::PatternLightGrid:
+        return 15;
+    default:
+        return pattern;
+    }
+}
+
+static Format::FillPattern fillPatternFromBinary(int fls)
+{
+    switch (fls) {
+    case 15:
+        return Format::PatternLightGrid;
+    case 16:
+        return Format::PatternLightTrellis;
+    case 17:
+        return Format::PatternGray125;
+    case 18:
+        return Format::PatternGray0625;
+    default:
+        return fls >= 0 && fls < 15 ? Format::FillPattern(fls) : Format::PatternNone;
+    }
+}
+
+static void writeBinaryColor(Biff12Writer &writer, const Format &format, int propertyId)
+{
+    format.property(propertyId).value<XlsxColor>().saveToBinary(writer);
+}
+
+static void readBinaryColor(Biff12Reader &reader, Format &format, int propertyId)
+{
+    XlsxColor color;
+    color.loadFromBinary(reader);
+    if (!color.isInvalid())
+        format.setProperty(propertyId, color);
+}
+
+/*
+  Write the styles as the BIFF12 records of a styles.bin part, in the
+  order of the styles.xml elements. The indexed colors keep their default
+  values.
+ */
+void Styles::saveToBinaryFile(QIODevice *device) const
+{
+    const_cast<Styles *>(this)->buildLookupTables();
+    Biff12Writer writer(device);
+    writer.writeRecord(BrtBeginStyleSheet);
+
+    writer.beginRecord(BrtBeginFmts);
+    writer.writeUInt32(m_customNumFmtIdMap.size());
+    writer.endRecord();
+    QMapIterator<int, QSharedPointer<XlsxFormatNumberData>> it(m_customNumFmtIdMap);
+    while (it.hasNext()) {
+        it.next();
+        writer.beginRecord(BrtFmt);
+        writer.writeUInt16(quint16(it.value()->formatIndex));
+        writer.writeString(it.value()->formatString);
+        writer.endRecord();
+    }
+    writer.writeRecord(BrtEndFmts);
+
+    writer.beginRecord(BrtBeginFonts);
+    writer.writeUInt32(m_fontsList.size());
+    writer.endRecord();
+    foreach (const Format &font, m_fontsList)
+        writeBinaryFont(writer, font);
+    writer.writeRecord(BrtEndFonts);
+
+    writer.beginRecord(BrtBeginFills);
+    writer.writeUInt32(m_fillsList.size());
+    writer.endRecord();
+    foreach (const Format &fill, m_fillsList)
+        writeBinaryFill(writer, fill);
+    writer.writeRecord(BrtEndFills);
+
+    writer.beginRecord(BrtBeginBorders);
+    writer.writeUInt32(m_bordersList.size());
+    writer.endRecord();
+    foreach (const Format &border, m_bordersList)
+        writeBinaryBorder(writer, border);
+    writer.writeRecord(BrtEndBorders);
+
+    // The only cell style format, which has no parent
+    writer.beginRecord(BrtBeginCellStyleXFs);
+    writer.writeUInt32(1);
+    writer.endRecord();
+    writer.beginRecord(BrtXF);
+    writer.writeUInt16(0xFFFF);
+    writer.writeZeros(10);
+    writer.writeUInt16(quint16(Format::AlignBottom << 3 | 0x1000)); // locked
+    writer.writeUInt16(0);
+    writer.endRecord();
+    writer.writeRecord(BrtEndCellStyleXFs);
+
+    writer.beginRecord(BrtBeginCellXFs);
+    writer.writeUInt32(m_xf_formatsList.size());
+    writer.endRecord();
+    foreach (const Format &format, m_xf_formatsList)
+        writeBinaryXf(writer, format);
+    writer.writeRecord(BrtEndCellXFs);
+
+    writer.beginRecord(BrtBeginStyles);
+    writer.writeUInt32(1);
+    writer.endRecord();
+    writer.beginRecord(BrtStyle);
+    writer.writeUInt32(0); // xf
+    writer.writeUInt16(1); // built in
+    writer.writeUInt8(0); // Normal
+    writer.writeUInt8(0xFF);
+    writer.writeString(QStringLiteral("Normal"));
+    writer.endRecord();
+    writer.writeRecord(BrtEndStyles);
+
+    writer.beginRecord(BrtBeginDXFs);
+    writer.writeUInt32(0);
+    writer.endRecord();
+    writer.writeRecord(BrtEndDXFs);
+
+    writer.writeRecord(BrtEndStyleSheet);
+}
+
+void Styles::writeBinaryFont(Biff12Writer &writer, const Format &font) const
+{
+    quint16 flags = 0;
+    if (font.fontItalic())
+        flags |= 0x02;
+    if (font.fontStrikeOut())
+        flags |= 0x08;
+    if (font.fontOutline())
+        flags |= 0x10;
+    if (font.boolProperty(FormatPrivate::P_Font_Shadow))
+        flags |= 0x20;
+
+    quint8 underline = 0;
+    switch (font.fontUnderline()) {
+    case Format::FontUnderlineSingle:
+        underline = 0x01;
+        break;
+    case Format::FontUnderlineDouble:
+        underline = 0x02;
+        break;
+    case Format::FontUnderlineSingleAccounting:
+        underline = 0x21;
+        break;
+    case Format::FontUnderlineDoubleAccounting:
+        underline = 0x22;
+        break;
+    default:
+        break;
+    }
+
+    quint8 scheme = 0;
+    const QString schemeName = font.stringProperty(FormatPrivate::P_Font_Scheme);
+    if (schemeName == QLatin1String("major"))
+        scheme = 1;
+    else if (schemeName == QLatin1String("minor"))
+        scheme = 2;
+
+    writer.beginRecord(BrtFont);
+    // The size is in twips
+    writer.writeUInt16(quint16((font.hasProperty(FormatPrivate::P_Font_Size) ? font.fontSize()
+                                                                              : 11)
+                               * 20));
+    writer.writeUInt16(flags);
+    writer.writeUInt16(font.fontBold() ? 700 : 400);
+    writer.writeUInt16(quint16(font.fontScript()));
+    writer.writeUInt8(underline);
+    writer.writeUInt8(quint8(font.intProperty(FormatPrivate::P_Font_Family)));
+    writer.writeUInt8(quint8(font.intProperty(FormatPrivate::P_Font_Charset)));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, font, FormatPrivate::P_Font_Color);
+    writer.writeUInt8(scheme);
+    writer.writeString(font.fontName());
+    writer.endRecord();
+}
+
+void Styles::writeBinaryFill(Biff12Writer &writer, const Format &fill) const
+{
+    writer.beginRecord(BrtFill);
+    writer.writeUInt32(binaryFillPattern(fill.fillPattern()));
+    // For a solid fill, Excel reverses the role of foreground and background colours
+    if (fill.fillPattern() == Format::PatternSolid) {
+        writeBinaryColor(writer, fill, FormatPrivate::P_Fill_BgColor);
+        writeBinaryColor(writer, fill, FormatPrivate::P_Fill_FgColor);
+    } else {
+        writeBinaryColor(writer, fill, FormatPrivate::P_Fill_FgColor);
+        writeBinaryColor(writer, fill, FormatPrivate::P_Fill_BgColor);
+    }
+    // No gradient: its type, its degree, the four fill-to values and no stops
+    writer.writeUInt32(0);
+    for (int i = 0; i < 5; ++i)
+        writer.writeDouble(0);
+    writer.writeUInt32(0);
+    writer.endRecord();
+}
+
+void Styles::writeBinaryBorder(Biff12Writer &writer, const Format &border) const
+{
+    writer.beginRecord(BrtBorder);
+    writer.writeUInt8(quint8(border.diagonalBorderType()));
+    writer.writeUInt8(quint8(border.topBorderStyle()));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, border, FormatPrivate::P_Border_TopColor);
+    writer.writeUInt8(quint8(border.bottomBorderStyle()));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, border, FormatPrivate::P_Border_BottomColor);
+    writer.writeUInt8(quint8(border.leftBorderStyle()));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, border, FormatPrivate::P_Border_LeftColor);
+    writer.writeUInt8(quint8(border.rightBorderStyle()));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, border, FormatPrivate::P_Border_RightColor);
+    writer.writeUInt8(quint8(border.diagonalBorderStyle()));
+    writer.writeUInt8(0);
+    writeBinaryColor(writer, border, FormatPrivate::P_Border_DiagonalColor);
+    writer.endRecord();
+}
+
+void Styles::writeBinaryXf(Biff12Writer &writer, const Format &format) const
+{
+    quint16 alignment = 0x1000; // locked
+    alignment |= format.horizontalAlignment() & 0x07;
+    alignment |= (format.verticalAlignment() & 0x07) << 3;
+    if (format.textWrap())
+        alignment |= 0x40;
+    if (format.shrinkToFit())
+        alignment |= 0x100;
+
+    quint16 applied = 0;
+    if (format.hasNumFmtData())
+        applied |= 0x01;
+    if (format.hasFontData())
+        applied |= 0x02;
+    if (format.hasAlignmentData())
+        applied |= 0x04;
+    if (format.hasBorderData())
+        applied |= 0x08;
+    if (format.hasFillData())
+        applied |= 0x10;
+
+    writer.beginRecord(BrtXF);
+    writer.writeUInt16(0); // the cell style format
+    writer.writeUInt16(quint16(format.numberFormatIndex()));
+    writer.writeUInt16(quint16(format.fontIndex()));
+    writer.writeUInt16(quint16(format.fillIndex()));
+    writer.writeUInt16(quint16(format.borderIndex()));
+    writer.writeUInt8(quint8(format.rotation()));
+    writer.writeUInt8(quint8(format.indent()));
+    writer.writeUInt16(alignment);
+    writer.writeUInt16(applied);
+    writer.endRecord();
+}
+
+/*
+  Read the styles from the BIFF12 records of a styles.bin part. The
+  differential formats and the indexed colors are skipped.
+ */
+bool Styles::loadFromBinaryData(const QByteArray &data)
+{
+    Biff12Reader reader(data);
+    bool inCellXfs = false;
+    while (reader.readNext()) {
+        switch (reader.recordType()) {
+        case BrtFmt: {
+            QSharedPointer<XlsxFormatNumberData> fmt(new XlsxFormatNumberData);
+            fmt->formatIndex = reader.readUInt16();
+            fmt->formatString = reader.readString();
+            fmt->isDateTime = NumFormatParser::isDateTime(fmt->formatString);
+            if (fmt->formatIndex >= m_nextCustomNumFmtId)
+                m_nextCustomNumFmtId = fmt->formatIndex + 1;
+            m_customNumFmtIdMap.insert(fmt->formatIndex, fmt);
+            m_customNumFmtsHash.insert(fmt->formatString, fmt);
+            break;
+        }
+        case BrtFont: {
+            Format font;
+            readBinaryFont(reader, font);
+            m_fontsList.append(font);
+            if (!m_lookupTablesDeferred)
+                m_fontsHash.insert(font.fontFingerprint(), font);
+            if (font.isValid())
+                font.setFontIndex(m_fontsList.size() - 1);
+            break;
+        }
+        case BrtFill: {
+            Format fill;
+            readBinaryFill(reader, fill);
+            m_fillsList.append(fill);
+            if (!m_lookupTablesDeferred)
+                m_fillsHash.insert(fill.fillFingerprint(), fill);
+            if (fill.isValid())
+                fill.setFillIndex(m_fillsList.size() - 1);
+            break;
+        }
+        case BrtBorder: {
+            Format border;
+            readBinaryBorder(reader, border);
+            m_bordersList.append(border);
+            if (!m_lookupTablesDeferred)
+                m_bordersHash.insert(border.borderFingerprint(), border);
+            if (border.isValid())
+                border.setBorderIndex(m_bordersList.size() - 1);
+            break;
+        }
+        case BrtBeginCellXFs:
+            inCellXfs = true;
+            break;
+        case BrtEndCellXFs:
+            inCellXfs = false;
+            break;
+        case BrtXF:
+            if (inCellXfs)
+                readBinaryXf(reader);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (reader.hasError()) {
+        qWarning("Error when read the binary styles");
+        return false;
+    }
+    return true;
+}
+
+void Styles::readBinaryFont(Biff12Reader &reader, Format &font) const
+{
+    // A size in twips, which loses the half points
+    font.setFontSize(reader.readUInt16() / 20);
+    const quint16 flags = reader.readUInt16();
+    font.setFontItalic(flags & 0x02);
+    font.setFontStrikeOut(flags & 0x08);
+    font.setFontOutline(flags & 0x10);
+    if (flags & 0x20)
+        font.setProperty(FormatPrivate::P_Font_Shadow, true);
+    font.setFontBold(reader.readUInt16() >= 700);
+    const quint16 script = reader.readUInt16();
+    if (script == Format::FontScriptSuper || script == Format::FontScriptSub)
+        font.setFontScript(Format::FontScript(script));
+    switch (reader.readUInt8()) {
+    case 0x01:
+        font.setFontUnderline(Format::FontUnderlineSingle);
+        break;
+    case 0x02:
+        font.setFontUnderline(Format::FontUnderlineDouble);
+        break;
+    case 0x21:
+        font.setFontUnderline(Format::FontUnderlineSingleAccounting);
+        break;
+    case 0x22:
+        font.setFontUnderline(Format::FontUnderlineDoubleAccounting);
+        break;
+    default:
+        break;
+    }
+    const int family = reader.readUInt8();
+    const int charset = reader.readUInt8();
+    reader.skip(1);
+    if (family)
+        font.setProperty(FormatPrivate::P_Font_Family, family);
+    if (charset)
+        font.setProperty(FormatPrivate::P_Font_Charset, charset);
+    readBinaryColor(reader, font, FormatPrivate::P_Font_Color);
+    const quint8 scheme = reader.readUInt8();
+    if (scheme == 1)
+        font.setProperty(FormatPrivate::P_Font_Scheme, QStringLiteral("major"));
+    else if (scheme == 2)
+        font.setProperty(FormatPrivate::P_Font_Scheme, QStringLiteral("minor"));
+    const QString name = reader.readString();
+    if (!name.isEmpty())
+        font.setFontName(name);
+}
+
+void Styles::readBinaryFill(Biff12Reader &reader, Format &fill) const
+{
+    fill.setFillPattern(fillPatternFromBinary(reader.readUInt32()));
+    const bool solid = fill.fillPattern() == Format::PatternSolid;
+    readBinaryColor(reader, fill, solid ? FormatPrivate::P_Fill_BgColor
+                                        : FormatPrivate::P_Fill_FgColor);
+    readBinaryColor(reader, fill, solid ? FormatPrivate::P_Fill_FgColor
+                                        : FormatPrivate::P_Fill_BgColor);
+    // The gradients aren't supported
+}
+
+void Styles::readBinaryBorder(Biff12Reader &reader, Format &border) const
+{
+    border.setDiagonalBorderType(Format::DiagonalBorderType(reader.readUInt8() & 0x03));
+
+    static const int styleIds[] = {
+        FormatPrivate::P_Border_TopStyle, FormatPrivate::P_Border_BottomStyle,
+        FormatPrivate::P_Border_LeftStyle, FormatPrivate::P_Border_RightStyle,
+        FormatPrivate::P_Border_DiagonalStyle};
+    static const int colorIds[] = {
+        FormatPrivate::P_Border_TopColor, FormatPrivate::P_Border_BottomColor,
+        FormatPrivate::P_Border_LeftColor, FormatPrivate::P_Border_RightColor,
+        FormatPrivate::P_Border_DiagonalColor};
+    for (int i = 0; i < 5; ++i) {
+        const int style = reader.readUInt8();
+        reader.skip(1);
+        if (style > Format::BorderNone && style <= Format::BorderSlantDashDot)
+            border.setProperty(styleIds[i], style);
+        readBinaryColor(reader, border, colorIds[i]);
+    }
+}
+
+/*
+  Read a cell format, the parts of which are only taken from the number
+  formats, fonts, fills and borders when they are applied, as in
+  readCellXfs().
+ */
+void Styles::readBinaryXf(Biff12Reader &reader)
+{
+    Format format;
+    reader.skip(2); // the cell style format
+    const int numFmtIndex = reader.readUInt16();
+    const int fontIndex = reader.readUInt16();
+    const int fillIndex = reader.readUInt16();
+    const int borderIndex = reader.readUInt16();
+    const int rotation = reader.readUInt8();
+    const int indent = reader.readUInt8();
+    const quint16 alignment = reader.readUInt16();
+    const quint16 applied = reader.readUInt16();
+
+    if (applied & 0x01) {
+        const QSharedPointer<XlsxFormatNumberData> fmt = m_customNumFmtIdMap.value(numFmtIndex);
+        if (!fmt) {
+            format.setNumberFormatIndex(numFmtIndex);
+            format.fixDateTimeFormat(NumFormatParser::isBuiltinDateTime(numFmtIndex));
+        } else {
+            format.setNumberFormat(numFmtIndex, fmt->formatString);
+            format.fixDateTimeFormat(fmt->isDateTime);
+        }
+    }
+
+    if ((applied & 0x02) && fontIndex < m_fontsList.size()) {
+        const Format &fontFormat = m_fontsList.at(fontIndex);
+        for (int i = FormatPrivate::P_Font_STARTID; i < FormatPrivate::P_Font_ENDID; ++i) {
+            if (fontFormat.hasProperty(i))
+                format.setProperty(i, fontFormat.property(i));
+        }
+    }
+
+    if ((applied & 0x10) && fillIndex < m_fillsList.size()) {
+        const Format &fillFormat = m_fillsList.at(fillIndex);
+        for (int i = FormatPrivate::P_Fill_STARTID; i < FormatPrivate::P_Fill_ENDID; ++i) {
+            if (fillFormat.hasProperty(i))
+                format.setProperty(i, fillFormat.property(i));
+        }
+    }
+
+    if ((applied & 0x08) && borderIndex < m_bordersList.size()) {
+        const Format &borderFormat = m_bordersList.at(borderIndex);
+        for (int i = FormatPrivate::P_Border_STARTID; i < FormatPrivate::P_Border_ENDID; ++i) {
+            if (borderFormat.hasProperty(i))
+                format.setProperty(i, borderFormat.property(i));
+        }
+    }
+
+    if (applied & 0x04) {
+        const int horizontal = alignment & 0x07;
+        if (horizontal != Format::AlignHGeneral)
+            format.setHorizontalAlignment(Format::HorizontalAlignment(horizontal));
+        const int vertical = (alignment >> 3) & 0x07;
+        if (vertical != Format::AlignBottom && vertical <= Format::AlignVDistributed)
+            format.setVerticalAlignment(Format::VerticalAlignment(vertical));
+        if (indent)
+            format.setIndent(indent);
+        if (rotation)
+            format.setRotation(rotation);
+        if (alignment & 0x40)
+            format.setTextWarp(true);
+        if (alignment & 0x100)
+            format.setShrinkToFit(true);
+    }
+
+    if (m_lookupTablesDeferred) {
+        if (!format.isEmpty())
+            format.setXfIndex(m_xf_formatsList.size());
+        m_xf_formatsList.append(format);
+    } else {
+        addXfFormat(format, true);
+    }
+}
+
+/*
+  The font of the given index, from which the runs of the rich shared
+  strings take their format.
+ */
+Format Styles::fontFormat(int idx) const
+{
+    QMutexLocker locker(m_mutex.data());
+    return m_fontsList.value(idx);
+}
+
+/*
+  Returns the compiled code of the number format  numFmtId, built-in
+  or custom. The unknown ids are shown as General.
+ */
+QSharedPointer<const NumFormatter> Styles::numFormatter(int numFmtId) const
+{
+    QMutexLocker locker(m_mutex.data());
+    QSharedPointer<const NumFormatter> &formatter = m_numFormatters[numFmtId];
+    if (!formatter) {
+        QString code;
+        const QSharedPointer<XlsxFormatNumberData> custom = m_customNumFmtIdMap.value(numFmtId);
+        if (custom)
+            code = custom->formatString;
+        else if (const char *builtin = builtinNumFmtCode(numFmtId))
+            code = QString::fromLatin1(builtin);
+        formatter = QSharedPointer<const NumFormatter>(new NumFormatter(code));
+    }
+    return formatter;
+}
+
+/*
+  The color of the given index, from the palette of the workbook when it
+  has one, or from the default palette.
+ */
+QColor Styles::getColorByIndex(int idx) const
 {
     if (m_indexedColors.isEmpty()) {
-        m_indexedColors << QColor("#000000") << QColor("#FFFFFF") << QColor("#FF0000")
-                        << QColor("#00FF00") << QColor("#0000FF") << QColor("#FFFF00")
-                        << QColor("#FF00FF") << QColor("#00FFFF") << QColor("#000000")
-                        << QColor("#FFFFFF") << QColor("#FF0000") << QColor("#00FF00")
-                        << QColor("#0000FF") << QColor("#FFFF00") << QColor("#FF00FF")
-                        << QColor("#00FFFF") << QColor("#800000") << QColor("#008000")
-                        << QColor("#000080") << QColor("#808000") << QColor("#800080")
-                        << QColor("#008080") << QColor("#C0C0C0") << QColor("#808080")
-                        << QColor("#9999FF") << QColor("#993366") << QColor("#FFFFCC")
-                        << QColor("#CCFFFF") << QColor("#660066") << QColor("#FF8080")
-                        << QColor("#0066CC") << QColor("#CCCCFF") << QColor("#000080")
-                        << QColor("#FF00FF") << QColor("#FFFF00") << QColor("#00FFFF")
-                        << QColor("#800080") << QColor("#800000") << QColor("#008080")
-                        << QColor("#0000FF") << QColor("#00CCFF") << QColor("#CCFFFF")
-                        << QColor("#CCFFCC") << QColor("#FFFF99") << QColor("#99CCFF")
-                        << QColor("#FF99CC") << QColor("#CC99FF") << QColor("#FFCC99")
-                        << QColor("#3366FF") << QColor("#33CCCC") << QColor("#99CC00")
-                        << QColor("#FFCC00") << QColor("#FF9900") << QColor("#FF6600")
-                        << QColor("#666699") << QColor("#969696") << QColor("#003366")
-                        << QColor("#339966") << QColor("#003300") << QColor("#333300")
-                        << QColor("#993300") << QColor("#993366") << QColor("#333399")
-                        << QColor("#333333");
-        m_isIndexedColorsDefault = true;
+        if (idx < 0 || idx >= int(sizeof(defaultIndexedColors) / sizeof(QRgb)))
+            return QColor();
+        return QColor::fromRgb(defaultIndexedColors[idx]);
     }
     if (idx < 0 || idx >= m_indexedColors.size())
         return QColor();
@@ -43,6 +43,8 @@
 #include <QHash>
 #include <QList>
 #include <QMap>
+#include <QMutex>
+#include <QScopedPointer>
 #include <QStringList>
 #include <QVector>
 
@@ -54,17 +56,23 @@ class StylesTest;
 namespace QXlsx {
 
 class Format;
+class NumFormatter;
 class XlsxColor;
+class Biff12Writer;
+class Biff12Reader;
+struct StyleStatistics;
 
 struct XlsxFormatNumberData
 {
     XlsxFormatNumberData()
         : formatIndex(0)
+        , isDateTime(false)
     {
     }
 
     int formatIndex;
     QString formatString;
+    bool isDateTime; // classified once, when the format is read or added
 };
 
 class XLSX_AUTOTEST_EXPORT Styles : public AbstractOOXmlFile
@@ -72,20 +80,41 @@ class XLSX_AUTOTEST_EXPORT Styles : public AbstractOOXmlFile
 public:
     Styles(CreateFlag flag);
     ~Styles();
+    Styles *clone() const;
+    void setThreadSafe(bool enable);
+    void deferLookupTables();
+    void buildLookupTables();
     void addXfFormat(const Format &format, bool force = false);
     Format xfFormat(int idx) const;
+    int registerFormat(const Format &format);
+    bool isValidStyleId(int styleId) const;
     void addDxfFormat(const Format &format, bool force = false);
     Format dxfFormat(int idx) const;
+    StyleStatistics statistics() const;
+    qint64 memoryUsage() const;
+    void compact(const QVector<bool> &usedXfs, QVector<int> *xfMap);
 
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
+    void saveToBinaryFile(QIODevice *device) const;
+    bool loadFromBinaryData(const QByteArray &data);
+    qint64 elementCount() const;
+    Format fontFormat(int idx) const;
+    QSharedPointer<const NumFormatter> numFormatter(int numFmtId) const;
 
-    QColor getColorByIndex(int idx);
+    QColor getColorByIndex(int idx) const;
 
 private:
     friend class Format;
     friend class ::StylesTest;
 
+    static QByteArray defaultStylesXml();
+    static void copyProperties(Format &format, const Format &source, int first, int last);
+    bool hasDefaultFormats() const;
+    void buildLookupTablesLocked();
+    void addXfFormatLocked(const Format &format, bool force = false);
+    void addDxfFormatLocked(const Format &format, bool force = false);
+    void writeXml(QIODevice *device) const;
     void fixNumFmt(const Format &format);
 
     void writeNumFmts(QXmlStreamWriter &writer) const;
@@ -117,27 +146,44 @@ private:
     bool readColors(QXmlStreamReader &reader);
     bool readIndexedColors(QXmlStreamReader &reader);
 
-    QHash<QString, int> m_builtinNumFmtsHash;
+    void writeBinaryFont(Biff12Writer &writer, const Format &font) const;
+    void writeBinaryFill(Biff12Writer &writer, const Format &fill) const;
+    void writeBinaryBorder(Biff12Writer &writer, const Format &border) const;
+    void writeBinaryXf(Biff12Writer &writer, const Format &format) const;
+    void readBinaryFont(Biff12Reader &reader, Format &font) const;
+    void readBinaryFill(Biff12Reader &reader, Format &fill) const;
+    void readBinaryBorder(Biff12Reader &reader, Format &border) const;
+    void readBinaryXf(Biff12Reader &reader);
+
     QMap<int, QSharedPointer<XlsxFormatNumberData>> m_customNumFmtIdMap;
     QHash<QString, QSharedPointer<XlsxFormatNumberData>> m_customNumFmtsHash;
     int m_nextCustomNumFmtId;
+    // Compiled on the first value shown, the codes of the ids never change
+    mutable QHash<int, QSharedPointer<const NumFormatter>> m_numFormatters;
     QList<Format> m_fontsList;
     QList<Format> m_fillsList;
     QList<Format> m_bordersList;
-    QHash<QByteArray, Format> m_fontsHash;
-    QHash<QByteArray, Format> m_fillsHash;
-    QHash<QByteArray, Format> m_bordersHash;
+    QHash<quint64, Format> m_fontsHash;
+    QHash<quint64, Format> m_fillsHash;
+    QHash<quint64, Format> m_bordersHash;
 
-    QVector<QColor> m_indexedColors;
+    QVector<QColor> m_indexedColors; // empty for the default palette
     bool m_isIndexedColorsDefault;
 
     QList<Format> m_xf_formatsList;
-    QHash<QByteArray, Format> m_xf_formatsHash;
+    QHash<quint64, Format> m_xf_formatsHash;
 
     QList<Format> m_dxf_formatsList;
-    QHash<QByteArray, Format> m_dxf_formatsHash;
+    QHash<quint64, Format> m_dxf_formatsHash;
 
     bool m_emptyFormatAdded;
+    // The hashes of the fonts, fills, borders and formats are built
+    // on the first change when set.
+    bool m_lookupTablesDeferred;
+
+    // Only set in thread safe mode. It isn't recursive, the public
+    // functions only call the ...Locked() helpers.
+    QScopedPointer<QMutex> m_mutex;
 };
 }
 #endif // XLSXSTYLES_H
@@ -0,0 +1,155 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxtable_p.h"
+
+#include <QIODevice>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+Table::Table(CreateFlag flag)
+    : AbstractOOXmlFile(flag)
+    , id(0)
+    , headerRow(true)
+    , showFirstColumn(false)
+    , showLastColumn(false)
+    , showRowStripes(true)
+    , showColumnStripes(false)
+{
+}
+
+/*
+  Returns the position of the \a column in the table, from 0, or -1 if
+  the table has no such column. The names are case insensitive.
+ */
+int Table::columnIndex(const QString &column) const
+{
+    for (int i = 0; i < columns.size(); ++i) {
+        if (columns[i].compare(column, Qt::CaseInsensitive) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+  Returns the range of the table without its header row.
+ */
+CellRange Table::bodyRange() const
+{
+    const int firstRow = headerRow ? range.firstRow() + 1 : range.firstRow();
+    return CellRange(firstRow, range.firstColumn(), range.lastRow(), range.lastColumn());
+}
+
+void Table::saveToXmlFile(QIODevice *device) const
+{
+    if (!isDirty() && !m_xmlData.isEmpty()) {
+        device->write(m_xmlData);
+        return;
+    }
+
+    QXmlStreamWriter writer(device);
+    writer.writeStartDocument(QStringLiteral("1.0"), true);
+    writer.writeStartElement(QStringLiteral("table"));
+    writer.writeAttribute(
+        QStringLiteral("xmlns"),
+        QStringLiteral("http://schemas.openxmlformats.org/spreadsheetml/2006/main"));
+    writer.writeAttribute(QStringLiteral("id"), QString::number(id));
+    writer.writeAttribute(QStringLiteral("name"), name);
+    writer.writeAttribute(QStringLiteral("displayName"), name);
+    writer.writeAttribute(QStringLiteral("ref"), range.toString());
+    if (!headerRow)
+        writer.writeAttribute(QStringLiteral("headerRowCount"), QStringLiteral("0"));
+    writer.writeAttribute(QStringLiteral("totalsRowShown"), QStringLiteral("0"));
+
+    // The autofilter buttons are in the header row
+    if (headerRow) {
+        writer.writeEmptyElement(QStringLiteral("autoFilter"));
+        writer.writeAttribute(QStringLiteral("ref"), range.toString());
+    }
+
+    writer.writeStartElement(QStringLiteral("tableColumns"));
+    writer.writeAttribute(QStringLiteral("count"), QString::number(columns.size()));
+    for (int i = 0; i < columns.size(); ++i) {
+        writer.writeEmptyElement(QStringLiteral("tableColumn"));
+        writer.writeAttribute(QStringLiteral("id"), QString::number(i + 1));
+        writer.writeAttribute(QStringLiteral("name"), columns[i]);
+    }
+    writer.writeEndElement(); // tableColumns
+
+    if (!styleName.isEmpty()) {
+        writer.writeEmptyElement(QStringLiteral("tableStyleInfo"));
+        writer.writeAttribute(QStringLiteral("name"), styleName);
+        writer.writeAttribute(QStringLiteral("showFirstColumn"),
+                              showFirstColumn ? QStringLiteral("1") : QStringLiteral("0"));
+        writer.writeAttribute(QStringLiteral("showLastColumn"),
+                              showLastColumn ? QStringLiteral("1") : QStringLiteral("0"));
+        writer.writeAttribute(QStringLiteral("showRowStripes"),
+                              showRowStripes ? QStringLiteral("1") : QStringLiteral("0"));
+        writer.writeAttribute(QStringLiteral("showColumnStripes"),
+                              showColumnStripes ? QStringLiteral("1") : QStringLiteral("0"));
+    }
+
+    writer.writeEndElement(); // table
+    writer.writeEndDocument();
+}
+
+bool Table::loadFromXmlFile(QIODevice *device)
+{
+    m_xmlData = device->readAll();
+    columns.clear();
+
+    QXmlStreamReader reader(m_xmlData);
+    while (!reader.atEnd()) {
+        reader.readNextStartElement();
+        if (reader.tokenType() != QXmlStreamReader::StartElement)
+            continue;
+        const QXmlStreamAttributes attributes = reader.attributes();
+        if (reader.name() == QLatin1String("table")) {
+            id = attributes.value(QLatin1String("id")).toInt();
+            name = attributes.value(QLatin1String("displayName")).toString();
+            if (name.isEmpty())
+                name = attributes.value(QLatin1String("name")).toString();
+            range = CellRange(attributes.value(QLatin1String("ref")).toString());
+            headerRow = attributes.value(QLatin1String("headerRowCount")) != QLatin1String("0");
+        } else if (reader.name() == QLatin1String("tableColumn")) {
+            columns.append(attributes.value(QLatin1String("name")).toString());
+        } else if (reader.name() == QLatin1String("tableStyleInfo")) {
+            styleName = attributes.value(QLatin1String("name")).toString();
+            showFirstColumn =
+                attributes.value(QLatin1String("showFirstColumn")) == QLatin1String("1");
+            showLastColumn =
+                attributes.value(QLatin1String("showLastColumn")) == QLatin1String("1");
+            showRowStripes =
+                attributes.value(QLatin1String("showRowStripes")) == QLatin1String("1");
+            showColumnStripes =
+                attributes.value(QLatin1String("showColumnStripes")) == QLatin1String("1");
+        }
+    }
+    return !reader.hasError() && range.isValid();
+}
+
+QT_END_NAMESPACE_XLSX
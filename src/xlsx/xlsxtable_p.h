@@ -0,0 +1,88 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXTABLE_P_H
+#define XLSXTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxabstractooxmlfile.h"
+#include "xlsxcellrange.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The part of an Excel table, xl/tables/tableN.xml. The cells of the table
+  stay in the worksheet, the part gives them a name, a header row with the
+  names of the columns, an autofilter and a table style, which Excel draws
+  the bands with.
+
+  A loaded table is saved as it was read as long as it's unchanged, the
+  members only hold what the worksheet needs to know of it.
+ */
+class XLSX_AUTOTEST_EXPORT Table : public AbstractOOXmlFile
+{
+public:
+    Table(CreateFlag flag);
+
+    void saveToXmlFile(QIODevice *device) const;
+    bool loadFromXmlFile(QIODevice *device);
+
+    int columnIndex(const QString &column) const;
+    CellRange bodyRange() const;
+
+    int id; // unique in the workbook
+    QString name; // unique in the workbook, used by structured references
+    CellRange range; // the header row included
+    QStringList columns;
+    bool headerRow;
+    QString styleName;
+    bool showFirstColumn;
+    bool showLastColumn;
+    bool showRowStripes;
+    bool showColumnStripes;
+
+private:
+    QByteArray m_xmlData; // as loaded
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXTABLE_P_H
@@ -0,0 +1,442 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#include "xlsxtextmeter_p.h"
+#include "xlsxformat.h"
+
+#include <QCoreApplication>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QGuiApplication>
+#include <QLocale>
+
+#include <math.h>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+static inline qreal advance(const QFontMetricsF &metrics, const QString &text)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    return metrics.horizontalAdvance(text);
+#else
+    return metrics.width(text);
+#endif
+}
+
+/*
+  The advance of the ASCII character \a c in Calibri 11 at 96 dpi, in
+  pixels. The digits are 7 pixels wide, as columnWidth() expects.
+ */
+static qreal estimatedAdvance(char c)
+{
+    if (c < ' ')
+        return 0;
+    if (c >= '0' && c <= '9')
+        return 7;
+    switch (c) {
+    case ' ':
+    case '!':
+    case '\'':
+    case ',':
+    case '.':
+    case ':':
+    case ';':
+    case 'i':
+    case 'j':
+    case 'l':
+    case '|':
+        return 3;
+    case '(':
+    case ')':
+    case '-':
+    case '/':
+    case 'I':
+    case '[':
+    case '\\':
+    case ']':
+    case 'f':
+    case 'r':
+    case 't':
+        return 4;
+    case '%':
+    case 'm':
+    case 'w':
+        return 11;
+    case '@':
+    case 'M':
+    case 'W':
+        return 13;
+    default:
+        break;
+    }
+    if (c >= 'A' && c <= 'Z')
+        return 8;
+    if (c >= 'a' && c <= 'z')
+        return 6.5;
+    return 7;
+}
+
+/*
+  The code of the built-in number format \a numFmtId, for the formats
+  read from files, which only have the id.
+ */
+static QString builtinNumberFormat(int numFmtId)
+{
+    switch (numFmtId) {
+    case 1:
+        return QStringLiteral("0");
+    case 2:
+        return QStringLiteral("0.00");
+    case 3:
+        return QStringLiteral("#,##0");
+    case 4:
+        return QStringLiteral("#,##0.00");
+    case 9:
+        return QStringLiteral("0%");
+    case 10:
+        return QStringLiteral("0.00%");
+    case 11:
+        return QStringLiteral("0.00E+00");
+    case 12:
+        return QStringLiteral("# ?/?");
+    case 13:
+        return QStringLiteral("# ?\?/??");
+    case 14:
+        return QStringLiteral("m/d/yyyy");
+    case 15:
+        return QStringLiteral("d-mmm-yy");
+    case 16:
+        return QStringLiteral("d-mmm");
+    case 17:
+        return QStringLiteral("mmm-yy");
+    case 18:
+        return QStringLiteral("h:mm AM/PM");
+    case 19:
+        return QStringLiteral("h:mm:ss AM/PM");
+    case 20:
+        return QStringLiteral("h:mm");
+    case 21:
+        return QStringLiteral("h:mm:ss");
+    case 22:
+        return QStringLiteral("m/d/yyyy h:mm");
+    case 37:
+    case 38:
+        return QStringLiteral("(#,##0_);(#,##0)");
+    case 39:
+    case 40:
+        return QStringLiteral("(#,##0.00_);(#,##0.00)");
+    case 45:
+        return QStringLiteral("mm:ss");
+    case 46:
+        return QStringLiteral("[h]:mm:ss");
+    case 47:
+        return QStringLiteral("mm:ss.0");
+    case 48:
+        return QStringLiteral("##0.0E+0");
+    default:
+        break;
+    }
+    return QString();
+}
+
+/*
+  A text as wide as the dates and times shown by the format \a code: the
+  digits become zeros and the names of months and days long ones.
+ */
+static QString dateTimeSample(const QString &code)
+{
+    QString sample;
+    const int size = code.size();
+    for (int i = 0; i < size; ++i) {
+        const ushort c = code[i].unicode();
+        const ushort lower = code[i].toLower().unicode();
+        if (c == ';')
+            break;
+        if (c == '"') {
+            while (++i < size && code[i] != QLatin1Char('"'))
+                sample.append(code[i]);
+        } else if (c == '\\') {
+            if (++i < size)
+                sample.append(code[i]);
+        } else if (c == '[') {
+            // Elapsed times, colors or locales
+            const ushort inner = i + 1 < size ? code[i + 1].toLower().unicode() : 0;
+            if (inner == 'h' || inner == 'm' || inner == 's')
+                sample.append(QLatin1String("00"));
+            const int end = code.indexOf(QLatin1Char(']'), i);
+            i = end == -1 ? size : end;
+        } else if (code.midRef(i, 5).compare(QLatin1String("AM/PM"), Qt::CaseInsensitive) == 0) {
+            sample.append(QLatin1String("PM"));
+            i += 4;
+        } else if (code.midRef(i, 3).compare(QLatin1String("A/P"), Qt::CaseInsensitive) == 0) {
+            sample.append(QLatin1Char('P'));
+            i += 2;
+        } else if (lower == 'y' || lower == 'm' || lower == 'd' || lower == 'h' || lower == 's'
+                   || lower == 'e') {
+            int run = 1;
+            while (i + run < size && code[i + run].toLower().unicode() == lower)
+                ++run;
+            i += run - 1;
+            if (lower == 'm' && run == 3)
+                sample.append(QLatin1String("Sep"));
+            else if (lower == 'm' && run == 4)
+                sample.append(QLatin1String("September"));
+            else if (lower == 'm' && run > 4)
+                sample.append(QLatin1Char('S'));
+            else if (lower == 'd' && run == 3)
+                sample.append(QLatin1String("Wed"));
+            else if (lower == 'd' && run > 3)
+                sample.append(QLatin1String("Wednesday"));
+            else if (lower == 'e' || (lower == 'y' && run > 2))
+                sample.append(QLatin1String("0000"));
+            else
+                sample.append(QLatin1String("00"));
+        } else if (c == '_') {
+            // The room of the next character
+            ++i;
+            sample.append(QLatin1Char(' '));
+        } else if (c == '*') {
+            ++i;
+        } else {
+            sample.append(code[i]);
+        }
+    }
+    return sample;
+}
+
+/*
+  The text of \a value in the General number format, which shows at most
+  eleven characters.
+ */
+static QString generalText(double value)
+{
+    if (fabs(value) < 1e11 && value == floor(value))
+        return QString::number(qint64(value));
+    return QString::number(value, 'g', 10);
+}
+
+TextMeter::TextMeter()
+    : m_hasMetrics(qobject_cast<QGuiApplication *>(QCoreApplication::instance()) != 0)
+{
+}
+
+TextMeter::~TextMeter()
+{
+    foreach (FontWidths *widths, m_fonts)
+        delete widths->metrics;
+    qDeleteAll(m_fonts);
+}
+
+TextMeter::FontWidths *TextMeter::fontWidths(const Format &format)
+{
+    FontWidths *&widths = m_fonts[format.fontKey()];
+    if (widths)
+        return widths;
+
+    widths = new FontWidths;
+    const int size = format.fontSize() > 0 ? format.fontSize() : 11;
+    widths->scale = size / 11.0 * (format.fontBold() ? 1.05 : 1.0);
+    widths->metrics = 0;
+    if (m_hasMetrics) {
+        // Measured at 96 dpi whatever the screen, like the column widths
+        QFont font = format.font();
+        font.setPixelSize(qRound(size * 4.0 / 3.0));
+        widths->metrics = new QFontMetricsF(font);
+    }
+    for (int c = 0; c < 128; ++c) {
+        if (widths->metrics && c >= ' ')
+            widths->ascii[c] = advance(*widths->metrics, QString(QLatin1Char(char(c))));
+        else
+            widths->ascii[c] = estimatedAdvance(char(c)) * widths->scale;
+    }
+    return widths;
+}
+
+/*
+  Returns the width in pixels of \a text drawn with the font of \a format,
+  the one of its widest line for multi-line text.
+ */
+qreal TextMeter::textWidth(const QString &text, const Format &format)
+{
+    const FontWidths *widths = fontWidths(format);
+    const QChar *chars = text.constData();
+    const int size = text.size();
+    qreal width = 0;
+    qreal lineWidth = 0;
+    int lineStart = 0;
+    for (int i = 0; i <= size; ++i) {
+        const ushort c = i < size ? chars[i].unicode() : ushort('\n');
+        if (c == '\n') {
+            width = qMax(width, lineWidth);
+            lineWidth = 0;
+            lineStart = i + 1;
+        } else if (c < 128) {
+            lineWidth += widths->ascii[c];
+        } else if (widths->metrics) {
+            // The rest of the line is measured as a whole, for the shaping
+            int lineEnd = text.indexOf(QLatin1Char('\n'), i);
+            if (lineEnd == -1)
+                lineEnd = size;
+            lineWidth = advance(*widths->metrics, text.mid(lineStart, lineEnd - lineStart));
+            i = lineEnd - 1;
+        } else {
+            // Ideographs are about twice as wide as digits
+            lineWidth += (c >= 0x1100 ? 14 : 7) * widths->scale;
+        }
+    }
+    return width;
+}
+
+TextMeter::NumberStyle TextMeter::numberStyle(const Format &format)
+{
+    NumberStyle style;
+    QString code = format.numberFormat();
+    if (code.isEmpty())
+        code = builtinNumberFormat(format.numberFormatIndex());
+    if (code.isEmpty() || code == QLatin1String("@")
+        || code.compare(QLatin1String("General"), Qt::CaseInsensitive) == 0) {
+        return style;
+    }
+    if (format.isDateTimeFormat()) {
+        style.kind = NumberStyle::DateTime;
+        style.dateTimeWidth = textWidth(dateTimeSample(code), format);
+        return style;
+    }
+
+    // Only the first section counts, the one of the positive numbers
+    style.kind = NumberStyle::Fixed;
+    bool afterPoint = false;
+    const int size = code.size();
+    for (int i = 0; i < size; ++i) {
+        const QChar c = code[i];
+        switch (c.unicode()) {
+        case ';':
+            i = size;
+            break;
+        case '"':
+            while (++i < size && code[i] != QLatin1Char('"'))
+                style.affix.append(code[i]);
+            break;
+        case '\\':
+            if (++i < size)
+                style.affix.append(code[i]);
+            break;
+        case '[':
+            // Colors and conditions
+            while (i < size && code[i] != QLatin1Char(']'))
+                ++i;
+            break;
+        case '_':
+            ++i;
+            style.affix.append(QLatin1Char(' '));
+            break;
+        case '*':
+            ++i;
+            break;
+        case '0':
+        case '#':
+        case '?':
+            if (afterPoint)
+                ++style.decimals;
+            break;
+        case '.':
+            afterPoint = true;
+            break;
+        case ',':
+            if (!afterPoint)
+                style.grouping = true;
+            break;
+        case '%':
+            style.percent = true;
+            style.affix.append(c);
+            break;
+        case 'E':
+        case 'e':
+            // The digits of the exponent are those of QString::number()
+            style.kind = NumberStyle::Scientific;
+            while (i + 1 < size) {
+                const ushort next = code[i + 1].unicode();
+                if (next != '+' && next != '-' && next != '0' && next != '#')
+                    break;
+                ++i;
+            }
+            break;
+        default:
+            style.affix.append(c);
+            break;
+        }
+    }
+    return style;
+}
+
+/*
+  Returns the width in pixels of \a value shown with \a format, whose xf
+  index is \a formatIndex. All the dates and times of a format are given
+  the same width.
+ */
+qreal TextMeter::numberWidth(double value, int formatIndex, const Format &format)
+{
+    QHash<int, NumberStyle>::iterator it = m_numberStyles.find(formatIndex);
+    if (it == m_numberStyles.end())
+        it = m_numberStyles.insert(formatIndex, numberStyle(format));
+    const NumberStyle &style = it.value();
+
+    QString text;
+    switch (style.kind) {
+    case NumberStyle::DateTime:
+        return style.dateTimeWidth;
+    case NumberStyle::General:
+        text = generalText(value);
+        break;
+    case NumberStyle::Fixed: {
+        static const QLocale groupingLocale(QLocale::English, QLocale::UnitedStates);
+        const double shown = style.percent ? value * 100 : value;
+        if (style.grouping)
+            text = groupingLocale.toString(shown, 'f', style.decimals);
+        else
+            text = QString::number(shown, 'f', style.decimals);
+        text.append(style.affix);
+        break;
+    }
+    case NumberStyle::Scientific:
+        text = QString::number(value, 'E', style.decimals);
+        text.append(style.affix);
+        break;
+    }
+    return textWidth(text, format);
+}
+
+/*
+  Converts \a pixels of text to a column width in characters, with the
+  padding of the cells. Like Excel, the widths are counted in digits of
+  the default font, Calibri 11, whose digits are 7 pixels wide.
+ */
+double TextMeter::columnWidth(qreal pixels)
+{
+    const double width = floor((ceil(pixels) + 5) / 7 * 256) / 256;
+    return qMin(width, 255.0);
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,120 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef XLSXTEXTMETER_P_H
+#define XLSXTEXTMETER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+class QFontMetricsF;
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Format;
+
+/*
+  Measures the width in pixels of the text of cells, as drawn with the
+  font of their format. Each font gets a table of the advances of the
+  ASCII characters on first use, so most text is measured by adding up
+  table entries; the other characters go through QFontMetricsF. Without
+  a QGuiApplication there are no font metrics, and the advances are
+  estimated from the proportions of Calibri instead.
+
+  The numbers are measured as their number format shows them, the way
+  each format shows numbers being worked out once.
+ */
+class XLSX_AUTOTEST_EXPORT TextMeter
+{
+public:
+    TextMeter();
+    ~TextMeter();
+
+    qreal textWidth(const QString &text, const Format &format);
+    qreal numberWidth(double value, int formatIndex, const Format &format);
+
+    static double columnWidth(qreal pixels);
+
+private:
+    struct FontWidths
+    {
+        qreal ascii[128];
+        qreal scale; // of the estimated advances
+        QFontMetricsF *metrics; // 0 without a QGuiApplication
+    };
+
+    struct NumberStyle
+    {
+        enum Kind {
+            General,
+            Fixed,
+            Scientific,
+            DateTime
+        };
+
+        NumberStyle()
+            : kind(General)
+            , decimals(0)
+            , grouping(false)
+            , percent(false)
+            , dateTimeWidth(0)
+        {
+        }
+
+        Kind kind;
+        int decimals;
+        bool grouping;
+        bool percent;
+        QString affix; // the literal text of the format
+        qreal dateTimeWidth; // the same for all the values
+    };
+
+    FontWidths *fontWidths(const Format &format);
+    NumberStyle numberStyle(const Format &format);
+
+    Q_DISABLE_COPY(TextMeter)
+
+    bool m_hasMetrics;
+    QHash<QByteArray, FontWidths *> m_fonts;
+    QHash<int, NumberStyle> m_numberStyles;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXTEXTMETER_P_H
@@ -24,10 +24,12 @@
 ****************************************************************************/
 #include "xlsxtheme_p.h"
 #include <QIODevice>
+#include <QXmlStreamReader>
 
 namespace QXlsx {
 
-const char *defaultXmlData =
+// Written as it is when the workbook has no theme of its own
+static const char defaultXmlData[] =
     "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
     "<a:theme xmlns:a=\"http://schemas.openxmlformats.org/drawingml/2006/main\" name=\"Office "
     "\xe4\xb8\xbb\xe9\xa2\x98\">"
@@ -218,15 +220,20 @@ const char *defaultXmlData =
     "<a:extraClrSchemeLst/>"
     "</a:theme>";
 
+/*
+  The theme is kept as its xml, which is saved as it is. Only the colors
+  are parsed, once they are looked up.
+ */
 Theme::Theme(CreateFlag flag)
     : AbstractOOXmlFile(flag)
+    , m_colorsLoaded(false)
 {
 }
 
 void Theme::saveToXmlFile(QIODevice *device) const
 {
     if (xmlData.isEmpty())
-        device->write(defaultXmlData);
+        device->write(defaultXmlData, sizeof(defaultXmlData) - 1);
     else
         device->write(xmlData);
 }
@@ -234,7 +241,7 @@ void Theme::saveToXmlFile(QIODevice *device) const
 QByteArray Theme::saveToXmlData() const
 {
     if (xmlData.isEmpty())
-        return defaultXmlData;
+        return QByteArray::fromRawData(defaultXmlData, sizeof(defaultXmlData) - 1);
     else
         return xmlData;
 }
@@ -242,12 +249,58 @@ QByteArray Theme::saveToXmlData() const
 bool Theme::loadFromXmlData(const QByteArray &data)
 {
     xmlData = data;
+    m_colors.clear();
+    m_colorsLoaded = false;
+    setDirty(false);
     return true;
 }
 
 bool Theme::loadFromXmlFile(QIODevice *device)
 {
-    xmlData = device->readAll();
-    return true;
+    return loadFromXmlData(device->readAll());
+}
+
+/*
+  Returns the color of the theme with the given \a index, as the theme
+  attribute of the colors of the styles refers to it, or an invalid color.
+  The styles swap the dark and the light colors of the scheme: 0 is lt1,
+  1 is dk1, 2 is lt2 and 3 is dk2.
+ */
+QColor Theme::color(int index) const
+{
+    if (!m_colorsLoaded)
+        loadColors();
+    if (index >= 0 && index < 4)
+        index ^= 1;
+    if (index < 0 || index >= m_colors.size())
+        return QColor();
+    return QColor::fromRgb(m_colors[index]);
+}
+
+/*
+  Read the colors of the <a:clrScheme>, in the order of the scheme: dk1,
+  lt1, dk2, lt2, accent1 to accent6, hlink and folHlink.
+ */
+void Theme::loadColors() const
+{
+    m_colorsLoaded = true;
+    QXmlStreamReader reader(saveToXmlData());
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isEndElement() && reader.name() == QLatin1String("clrScheme"))
+            break;
+        if (!reader.isStartElement())
+            continue;
+        QStringRef value;
+        if (reader.name() == QLatin1String("srgbClr"))
+            value = reader.attributes().value(QLatin1String("val"));
+        else if (reader.name() == QLatin1String("sysClr"))
+            value = reader.attributes().value(QLatin1String("lastClr"));
+        else
+            continue;
+        bool ok = false;
+        const QRgb rgb = value.toString().toUInt(&ok, 16);
+        m_colors.append(ok ? qRgb(qRed(rgb), qGreen(rgb), qBlue(rgb)) : qRgb(0, 0, 0));
+    }
 }
 }
@@ -37,7 +37,9 @@
 //
 #include "xlsxabstractooxmlfile.h"
 
+#include <QColor>
 #include <QString>
+#include <QVector>
 class QIODevice;
 
 namespace QXlsx {
@@ -52,7 +54,16 @@ public:
     bool loadFromXmlData(const QByteArray &data);
     bool loadFromXmlFile(QIODevice *device);
 
-    QByteArray xmlData;
+    bool isDefault() const { return xmlData.isEmpty(); }
+    QColor color(int index) const;
+
+    QByteArray xmlData; // empty for the default theme
+private:
+    void loadColors() const;
+
+    // Parsed from the xml on first use
+    mutable QVector<QRgb> m_colors;
+    mutable bool m_colorsLoaded;
 };
 }
 #endif // XLSXTHEME_H
@@ -0,0 +1,287 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxtypedrowwriter.h"
+#include "xlsxworksheet.h"
+#include "xlsxworksheet_p.h"
+#include "xlsxworkbook.h"
+#include "xlsxsharedstrings_p.h"
+#include "xlsxcelltable_p.h"
+#include "xlsxutility_p.h"
+
+#include <QTextDocument>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  The row being written is kept in \a cells, stored at once by endRow().
+  The xf indexes of the columns are resolved by the constructor, -2
+  standing for the columns whose cells keep the format they have.
+ */
+class TypedRowWriterBasePrivate
+{
+public:
+    Worksheet *worksheet;
+    WorksheetPrivate *sheet;
+    int firstColumn;
+    QVector<int> xfs;
+    QList<Format> formats; // of the strings written by Worksheet::writeString()
+    bool html;
+    bool date1904;
+
+    int row;
+    QVector<CellData> cells;
+    QVector<int> richStrings; // columns of the row holding html
+    QStringList richTexts;
+
+    int cellXf(int index) const
+    {
+        return sheet->batchCellXfIndex(xfs[index], row, firstColumn + index);
+    }
+};
+
+/*!
+  \class TypedRowWriterBase
+  \inmodule QtXlsx
+  \brief The TypedRowWriterBase class stores the rows written by a
+  TypedRowWriter.
+
+  \sa TypedRowWriter
+*/
+
+/*!
+  \enum TypedRowWriterBase::ColumnType
+
+  \value NumberColumn The cells hold numbers.
+  \value BoolColumn The cells hold booleans.
+  \value StringColumn The cells hold strings, stored like
+         Worksheet::writeString() does.
+  \value DateColumn The cells hold dates.
+  \value DateTimeColumn The cells hold date times.
+*/
+
+/*!
+  \class TypedRowWriter
+  \inmodule QtXlsx
+  \brief The TypedRowWriter class writes rows whose column types are
+  known at compile time.
+
+  Each column has the type given by the template arguments, which
+  may be double, int, bool, QString, QDate or QDateTime, and the format
+  given when the writer is created. The formats are registered then,
+  so that writeRow() only converts the values and stores the row at
+  once, the right conversion being picked at compile time for each
+  column.
+
+  \code
+  TypedRowWriter<QString, QDate, double, int> writer(xlsx.currentWorksheet(), formats);
+  for (int i = 0; i < orders.size(); ++i)
+      writer.writeRow(i + 2, orders[i].customer, orders[i].date, orders[i].amount,
+                      orders[i].quantity);
+  \endcode
+
+  A column without a format, or with an invalid one, keeps the format its
+  cells already have. The date columns whose format isn't a date format
+  use the default date format of the workbook instead. The writer must not
+  be kept over a call to Workbook::compactStyles(), which renumbers the
+  formats.
+
+  The class is only available when the compiler supports variadic
+  templates.
+*/
+
+/*!
+  \fn TypedRowWriter::TypedRowWriter(Worksheet *sheet, const QList<Format> &formats, int firstColumn)
+
+  Creates a writer of the rows of \a sheet, whose first column is
+  \a firstColumn; the \a formats are those of the columns.
+*/
+
+/*!
+  \fn bool TypedRowWriter::writeRow(int row, const Types &... values)
+
+  Writes the \a values to \a row, replacing the cells it has in the
+  columns of the writer. Returns false if the row is outside the sheet,
+  or has been flushed in constant memory mode.
+*/
+
+/*!
+  Creates a writer of the \a count columns of \a sheet starting at
+  \a firstColumn, whose types are \a types and whose formats are
+  \a formats.
+*/
+TypedRowWriterBase::TypedRowWriterBase(Worksheet *sheet, const ColumnType *types, int count,
+                                       const QList<Format> &formats, int firstColumn)
+    : d_ptr(new TypedRowWriterBasePrivate)
+{
+    Q_D(TypedRowWriterBase);
+    d->worksheet = sheet;
+    d->sheet = sheet->d_func();
+    d->firstColumn = firstColumn;
+    d->html = d->sheet->workbook->isHtmlToRichStringEnabled();
+    d->date1904 = d->sheet->workbook->isDate1904();
+    d->row = 0;
+    d->cells.resize(count);
+    d->xfs.resize(count);
+    for (int i = 0; i < count; ++i) {
+        Format format = formats.value(i);
+        if ((types[i] == DateColumn || types[i] == DateTimeColumn)
+            && (!format.isValid() || !format.isDateTimeFormat()))
+            format.setNumberFormat(d->sheet->workbook->defaultDateFormat());
+        d->xfs[i] = d->sheet->batchXfIndex(format);
+        d->formats.append(format);
+    }
+}
+
+/*!
+  Destroys the writer.
+*/
+TypedRowWriterBase::~TypedRowWriterBase()
+{
+    delete d_ptr;
+}
+
+/*!
+  Returns the sheet the rows are written to.
+*/
+Worksheet *TypedRowWriterBase::worksheet() const
+{
+    Q_D(const TypedRowWriterBase);
+    return d->worksheet;
+}
+
+/*!
+  Returns the first column written.
+*/
+int TypedRowWriterBase::firstColumn() const
+{
+    Q_D(const TypedRowWriterBase);
+    return d->firstColumn;
+}
+
+/*!
+  Returns the number of columns written.
+*/
+int TypedRowWriterBase::columnCount() const
+{
+    Q_D(const TypedRowWriterBase);
+    return d->cells.size();
+}
+
+/*!
+  Starts writing \a row. Returns false if the cells of the row can't be
+  written.
+*/
+bool TypedRowWriterBase::beginRow(int row)
+{
+    Q_D(TypedRowWriterBase);
+    if (!d->sheet->checkBatchDimensions(row, d->firstColumn, row,
+                                        d->firstColumn + d->cells.size() - 1))
+        return false;
+    d->row = row;
+    return true;
+}
+
+/*!
+  Sets the cell of the column \a index of the row to the number \a value.
+*/
+void TypedRowWriterBase::setCell(int index, double value)
+{
+    Q_D(TypedRowWriterBase);
+    d->cells[index] = CellData::fromNumber(value, d->cellXf(index));
+}
+
+/*!
+  \fn void TypedRowWriterBase::setCell(int index, int value)
+  \overload
+*/
+
+/*!
+  \overload
+*/
+void TypedRowWriterBase::setCell(int index, bool value)
+{
+    Q_D(TypedRowWriterBase);
+    d->cells[index] = CellData::fromBool(value, d->cellXf(index));
+}
+
+/*!
+  \overload
+*/
+void TypedRowWriterBase::setCell(int index, const QString &value)
+{
+    Q_D(TypedRowWriterBase);
+    const int xf = d->cellXf(index);
+    if (d->html && Qt::mightBeRichText(value)) {
+        // Written by Worksheet::writeString() once the row is stored
+        d->cells[index] = CellData(CellData::Blank, Cell::NumberType, xf);
+        d->richStrings.append(index);
+        d->richTexts.append(value);
+    } else if (d->sheet->isInlineString(d->firstColumn + index, value)) {
+        CellExtraData extra;
+        extra.value = value;
+        d->cells[index] = CellData::fromExtra(d->sheet->cellTable.addExtra(extra),
+                                              Cell::InlineStringType, xf);
+    } else {
+        d->cells[index] =
+            CellData::fromSharedString(d->sheet->sharedStrings()->addSharedString(value), xf);
+    }
+}
+
+/*!
+  \overload
+*/
+void TypedRowWriterBase::setCell(int index, const QDate &value)
+{
+    Q_D(TypedRowWriterBase);
+    d->cells[index] = CellData::fromNumber(dateToNumber(value, d->date1904), d->xfs[index]);
+}
+
+/*!
+  \overload
+*/
+void TypedRowWriterBase::setCell(int index, const QDateTime &value)
+{
+    Q_D(TypedRowWriterBase);
+    d->cells[index] = CellData::fromNumber(datetimeToNumber(value, d->date1904), d->xfs[index]);
+}
+
+/*!
+  Stores the cells of the row.
+*/
+void TypedRowWriterBase::endRow()
+{
+    Q_D(TypedRowWriterBase);
+    d->sheet->setCells(d->row, d->firstColumn, d->cells.constData(), d->cells.size());
+    for (int i = 0; i < d->richStrings.size(); ++i) {
+        const int index = d->richStrings[i];
+        d->worksheet->writeString(d->row, d->firstColumn + index, d->richTexts[i],
+                                  d->formats[index]);
+    }
+    d->richStrings.clear();
+    d->richTexts.clear();
+}
+
+QT_END_NAMESPACE_XLSX
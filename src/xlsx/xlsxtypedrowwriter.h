@@ -0,0 +1,150 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef QXLSX_XLSXTYPEDROWWRITER_H
+#define QXLSX_XLSXTYPEDROWWRITER_H
+
+#include "xlsxglobal.h"
+#include "xlsxformat.h"
+#include <QDate>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+class Worksheet;
+class TypedRowWriterBasePrivate;
+
+class Q_XLSX_EXPORT TypedRowWriterBase
+{
+    Q_DECLARE_PRIVATE(TypedRowWriterBase)
+public:
+    enum ColumnType {
+        NumberColumn,
+        BoolColumn,
+        StringColumn,
+        DateColumn,
+        DateTimeColumn
+    };
+
+    Worksheet *worksheet() const;
+    int firstColumn() const;
+    int columnCount() const;
+
+protected:
+    TypedRowWriterBase(Worksheet *sheet, const ColumnType *types, int count,
+                       const QList<Format> &formats, int firstColumn);
+    ~TypedRowWriterBase();
+
+    bool beginRow(int row);
+    void setCell(int index, double value);
+    void setCell(int index, int value) { setCell(index, double(value)); }
+    void setCell(int index, bool value);
+    void setCell(int index, const QString &value);
+    void setCell(int index, const QDate &value);
+    void setCell(int index, const QDateTime &value);
+    void endRow();
+
+private:
+    Q_DISABLE_COPY(TypedRowWriterBase)
+    TypedRowWriterBasePrivate *const d_ptr;
+};
+
+// Not defined for the types the cells can't hold
+template <typename T> struct TypedRowColumn;
+
+template <> struct TypedRowColumn<double>
+{
+    enum { Type = TypedRowWriterBase::NumberColumn };
+};
+
+template <> struct TypedRowColumn<int>
+{
+    enum { Type = TypedRowWriterBase::NumberColumn };
+};
+
+template <> struct TypedRowColumn<bool>
+{
+    enum { Type = TypedRowWriterBase::BoolColumn };
+};
+
+template <> struct TypedRowColumn<QString>
+{
+    enum { Type = TypedRowWriterBase::StringColumn };
+};
+
+template <> struct TypedRowColumn<QDate>
+{
+    enum { Type = TypedRowWriterBase::DateColumn };
+};
+
+template <> struct TypedRowColumn<QDateTime>
+{
+    enum { Type = TypedRowWriterBase::DateTimeColumn };
+};
+
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+template <typename... Types>
+class TypedRowWriter : public TypedRowWriterBase
+{
+    Q_STATIC_ASSERT(sizeof...(Types) > 0);
+
+public:
+    explicit TypedRowWriter(Worksheet *sheet, const QList<Format> &formats = QList<Format>(),
+                            int firstColumn = 1)
+        : TypedRowWriterBase(sheet, columnTypes(), int(sizeof...(Types)), formats, firstColumn)
+    {
+    }
+
+    bool writeRow(int row, const Types &... values)
+    {
+        if (!beginRow(row))
+            return false;
+        setCells(0, values...);
+        endRow();
+        return true;
+    }
+
+private:
+    static const ColumnType *columnTypes()
+    {
+        static const ColumnType types[] = {ColumnType(TypedRowColumn<Types>::Type)...};
+        return types;
+    }
+
+    void setCells(int) {}
+
+    template <typename T, typename... Rest>
+    void setCells(int index, const T &value, const Rest &... rest)
+    {
+        setCell(index, value);
+        setCells(index + 1, rest...);
+    }
+};
+#endif
+
+QT_END_NAMESPACE_XLSX
+
+#endif // QXLSX_XLSXTYPEDROWWRITER_H
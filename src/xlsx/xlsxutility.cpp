@@ -33,6 +33,20 @@
 #include <QColor>
 #include <QDateTime>
 #include <QDebug>
+#include <QByteArray>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include <charconv>
+#endif
+#endif
+
+#include <climits>
 
 namespace QXlsx {
 
@@ -67,24 +81,43 @@ QString getRelFilePath(const QString &filePath)
                    + QLatin1String(".rels"));
 }
 
-double datetimeToNumber(const QDateTime &dt, bool is1904)
-{
-    // Note, for number 0, Excel2007 shown as 1900-1-0, which should be 1899-12-31
-    QDateTime epoch(is1904 ? QDate(1904, 1, 1) : QDate(1899, 12, 31), QTime(0, 0));
-
-    double excel_time = epoch.msecsTo(dt) / (1000 * 60 * 60 * 24.0);
+// The julian days of the day 0 of the 1900 and 1904 date systems,
+// 1899-12-31 and 1904-01-01.
+static const qint64 julianDay1900 = 2415020;
+static const qint64 julianDay1904 = 2416481;
+static const qint64 msecsPerDay = 86400000;
+// The serial numbers of 1970-01-01
+static const double epochNumber1900 = 25569;
+static const double epochNumber1904 = 24107;
 
-#if QT_VERSION >= 0x050200
-    if (dt.isDaylightTime()) // Add one hour if the date is Daylight
-        excel_time += 1.0 / 24.0;
-#endif
+/*
+  Returns the serial number of the day \a julianDay. Excel erroneously
+  treats 1900 as a leap year, so the days from 1900-03-01 on are one more
+  than the days elapsed in the 1900 date system.
+ */
+static inline double dayToNumber(qint64 julianDay, qint64 epochDay, qint64 leapDay)
+{
+    const qint64 days = julianDay - epochDay;
+    return double(days >= leapDay ? days + 1 : days);
+}
 
-    if (!is1904 && excel_time > 59) { // 31+28
-        // Account for Excel erroneously treating 1900 as a leap year.
-        excel_time += 1;
-    }
+/*
+  The date and the time shown by \a dt are converted, like Excel does, so
+  the conversion only involves arithmetic, whatever the time spec of \a dt.
+ */
+double datetimeToNumber(const QDateTime &dt, bool is1904)
+{
+    return dateToNumber(dt.date(), is1904) + timeToNumber(dt.time());
+}
 
-    return excel_time;
+// Note, for number 0, Excel2007 shown as 1900-1-0, which should be 1899-12-31
+double dateToNumber(const QDate &date, bool is1904)
+{
+    if (!date.isValid())
+        return 0;
+    if (is1904)
+        return double(date.toJulianDay() - julianDay1904);
+    return dayToNumber(date.toJulianDay(), julianDay1900, 60);
 }
 
 double timeToNumber(const QTime &time)
@@ -97,19 +130,80 @@ QDateTime datetimeFromNumber(double num, bool is1904)
     if (!is1904 && num > 60)
         num = num - 1;
 
-    qint64 msecs = static_cast<qint64>(num * 1000 * 60 * 60 * 24.0 + 0.5);
-    QDateTime epoch(is1904 ? QDate(1904, 1, 1) : QDate(1899, 12, 31), QTime(0, 0));
+    const qint64 msecs = static_cast<qint64>(std::floor(num * msecsPerDay + 0.5));
+    qint64 days = msecs / msecsPerDay;
+    qint64 time = msecs % msecsPerDay;
+    if (time < 0) {
+        time += msecsPerDay;
+        --days;
+    }
+    const QDate date = QDate::fromJulianDay((is1904 ? julianDay1904 : julianDay1900) + days);
+    return QDateTime(date, QTime(0, 0).addMSecs(int(time)));
+}
 
-    QDateTime dt = epoch.addMSecs(msecs);
+/*
+  Convert the \a count \a dates to serial numbers, stored in \a numbers.
+  Invalid dates give 0.
+ */
+void datesToNumbers(const QDate *dates, int count, double *numbers, bool is1904)
+{
+    const qint64 epochDay = is1904 ? julianDay1904 : julianDay1900;
+    const qint64 leapDay = is1904 ? std::numeric_limits<qint64>::max() : 60;
+    for (int i = 0; i < count; ++i) {
+        numbers[i] =
+            dates[i].isValid() ? dayToNumber(dates[i].toJulianDay(), epochDay, leapDay) : 0;
+    }
+}
 
-#if QT_VERSION >= 0x050200
-    // Remove one hour to see whether the date is Daylight
-    QDateTime dt2 = dt.addMSecs(-3600);
-    if (dt2.isDaylightTime())
-        return dt2;
-#endif
+/*
+  Convert the \a count date times \a values to serial numbers like
+  datetimeToNumber() does.
+ */
+void datetimesToNumbers(const QDateTime *values, int count, double *numbers, bool is1904)
+{
+    const qint64 epochDay = is1904 ? julianDay1904 : julianDay1900;
+    const qint64 leapDay = is1904 ? std::numeric_limits<qint64>::max() : 60;
+    const QTime midnight(0, 0);
+    for (int i = 0; i < count; ++i) {
+        const QDate date = values[i].date();
+        if (!date.isValid()) {
+            numbers[i] = 0;
+            continue;
+        }
+        numbers[i] = dayToNumber(date.toJulianDay(), epochDay, leapDay)
+            + midnight.msecsTo(values[i].time()) / double(msecsPerDay);
+    }
+}
 
-    return dt;
+/*
+  Convert the \a count timestamps \a msecs, in milliseconds since
+  1970-01-01T00:00:00, to serial numbers. The timestamps are taken as
+  they are, so UTC ones give UTC dates.
+ */
+void msecsSinceEpochToNumbers(const qint64 *msecs, int count, double *numbers, bool is1904)
+{
+    const double epoch = is1904 ? epochNumber1904 : epochNumber1900;
+    // Before 1900-03-01, the 1900 date system has no leap day to skip
+    const double leapNumber = is1904 ? -std::numeric_limits<double>::infinity() : 61;
+    for (int i = 0; i < count; ++i) {
+        const double number = msecs[i] / double(msecsPerDay) + epoch;
+        numbers[i] = number < leapNumber ? number - 1 : number;
+    }
+}
+
+/*
+  Convert the \a count serial \a numbers to timestamps in milliseconds
+  since 1970-01-01T00:00:00, stored in \a msecs. This is the reverse of
+  msecsSinceEpochToNumbers().
+ */
+void numbersToMsecsSinceEpoch(const double *numbers, int count, qint64 *msecs, bool is1904)
+{
+    const double epoch = is1904 ? epochNumber1904 : epochNumber1900;
+    const double leapNumber = is1904 ? -std::numeric_limits<double>::infinity() : 60;
+    for (int i = 0; i < count; ++i) {
+        const double number = numbers[i] < leapNumber ? numbers[i] + 1 : numbers[i];
+        msecs[i] = qRound64((number - epoch) * msecsPerDay);
+    }
 }
 
 /*
@@ -175,32 +269,356 @@ QString unescapeSheetName(const QString &sheetName)
     return name;
 }
 
+static inline bool isXmlSpace(QChar ch)
+{
+    const ushort u = ch.unicode();
+    return u == ' ' || u == '\t' || u == '\n' || u == '\r';
+}
+
 /*
  * whether the string s starts or ends with space
  */
 bool isSpaceReserveNeeded(const QString &s)
 {
-    QString spaces(QStringLiteral(" \t\n\r"));
-    return !s.isEmpty() && (spaces.contains(s.at(0)) || spaces.contains(s.at(s.length() - 1)));
+    return !s.isEmpty() && (isXmlSpace(s.at(0)) || isXmlSpace(s.at(s.length() - 1)));
+}
+
+static inline uint referenceChar(QChar ch)
+{
+    return ch.unicode();
+}
+
+static inline uint referenceChar(char ch)
+{
+    return uchar(ch);
 }
 
 /*
- * Convert shared formula for non-root cells.
- *
- * For example, if "B1:B10" have shared formula "=A1*A1", this function will return "=A2*A2"
- * for "B2" cell, "=A3*A3" for "B3" cell, etc.
+ * Decode the A1 style reference of the \a size characters of \a data in one
+ * pass. It is shared by the QStringRef and the byte versions.
+ */
+template <typename Char>
+static bool parseReference(const Char *data, int size, int *row, int *column)
+{
+    int i = 0;
+    if (i < size && referenceChar(data[i]) == '$')
+        ++i;
+
+    int col = 0;
+    const int colStart = i;
+    while (i < size && i - colStart < 3) {
+        const uint c = referenceChar(data[i]);
+        if (c < 'A' || c > 'Z')
+            break;
+        col = col * 26 + (c - 'A' + 1);
+        ++i;
+    }
+    if (i == colStart)
+        return false;
+
+    if (i < size && referenceChar(data[i]) == '$')
+        ++i;
+
+    int r = 0;
+    const int rowStart = i;
+    while (i < size) {
+        const uint c = referenceChar(data[i]);
+        if (c < '0' || c > '9' || r > (INT_MAX - 9) / 10)
+            return false;
+        r = r * 10 + (c - '0');
+        ++i;
+    }
+    if (i == rowStart)
+        return false;
+
+    *row = r;
+    *column = col;
+    return true;
+}
+
+/*
+ * Parse the A1 style reference \a ref, such as "B3" or "$B$3", into \a row and
+ * \a column without creating any temporary string. This is used on the hot
+ * path of the sheet loader, which sees one reference per cell.
  *
- * Note, the formula "=A1*A1" for B1 can also be written as "=RC[-1]*RC[-1]", which is the same
- * for all other cells. In other words, this formula is shared.
+ * Returns false and leaves \a row and \a column untouched if \a ref is not
+ * a valid cell reference.
+ */
+bool parseCellReference(const QStringRef &ref, int *row, int *column)
+{
+    return parseReference(ref.unicode(), ref.size(), row, column);
+}
+
+/*
+ * \overload
+ * Parse the reference made of the \a size Latin-1 characters of \a data,
+ * or of all of them up to the terminating zero if \a size is -1.
+ */
+bool parseCellReference(const char *data, int size, int *row, int *column)
+{
+    if (!data)
+        return false;
+    return parseReference(data, size == -1 ? int(qstrlen(data)) : size, row, column);
+}
+
+/*
+ * Write the A1 style reference of the cell at \a row and \a column to
+ * \a buffer, which must hold XLSX_CELL_REFERENCE_BUFFER_SIZE characters. The
+ * row or the column is prefixed with a '$' when \a rowAbsolute or
+ * \a columnAbsolute is true. Returns the number of characters written, which
+ * are not zero terminated.
+ */
+int formatCellReference(int row, int column, char *buffer, bool rowAbsolute,
+                        bool columnAbsolute)
+{
+    char letters[8];
+    int letterCount = 0;
+    for (uint number = uint(qMax(column, 1)); number; number = (number - 1) / 26)
+        letters[letterCount++] = char('A' + (number - 1) % 26);
+
+    char digits[12];
+    int digitCount = 0;
+    uint number = uint(qMax(row, 0));
+    do {
+        digits[digitCount++] = char('0' + number % 10);
+        number /= 10;
+    } while (number);
+
+    int size = 0;
+    if (columnAbsolute)
+        buffer[size++] = '$';
+    while (letterCount)
+        buffer[size++] = letters[--letterCount];
+    if (rowAbsolute)
+        buffer[size++] = '$';
+    while (digitCount)
+        buffer[size++] = digits[--digitCount];
+    return size;
+}
+
+/*
+  Write the shortest text which reads back as exactly \a value to
+  \a buffer, which must have room for XLSX_DOUBLE_BUFFER_SIZE
+  characters, and return its length. The text isn't null terminated.
+  Integral values are formatted directly, other values are formatted by
+  std::to_chars when the standard library provides it.
+ */
+int formatDouble(double value, char *buffer)
+{
+    if (std::fabs(value) < 1e15 && value == std::floor(value)) {
+        char digits[24];
+        int pos = sizeof(digits);
+        qint64 integer = qint64(value);
+        quint64 number = integer < 0 ? quint64(0) - quint64(integer) : quint64(integer);
+        do {
+            digits[--pos] = char('0' + number % 10);
+            number /= 10;
+        } while (number);
+        if (integer < 0)
+            digits[--pos] = '-';
+        const int size = sizeof(digits) - pos;
+        memcpy(buffer, digits + pos, size);
+        return size;
+    }
+
+#if defined(__cpp_lib_to_chars)
+    const std::to_chars_result result = std::to_chars(buffer, buffer + XLSX_DOUBLE_BUFFER_SIZE,
+                                                      value);
+    if (result.ec == std::errc())
+        return int(result.ptr - buffer);
+#endif
+
+    // 15 digits are enough for most values, 17 digits for all of them
+    QByteArray number = QByteArray::number(value, 'g', 15);
+    if (std::isfinite(value) && number.toDouble() != value)
+        number = QByteArray::number(value, 'g', 17);
+    const int size = qMin(number.size(), int(XLSX_DOUBLE_BUFFER_SIZE));
+    memcpy(buffer, number.constData(), size);
+    return size;
+}
+
+/*
+  Parse the xsd:double \a text, such as the value of a numeric cell.
+  Plain numbers are converted by std::from_chars when the standard
+  library provides it, anything else by QStringRef::toDouble().
+ */
+double parseDouble(const QStringRef &text, bool *ok)
+{
+#if defined(__cpp_lib_to_chars)
+    const int size = text.size();
+    if (size > 0 && size <= 64) {
+        char buffer[64];
+        const QChar *data = text.constData();
+        int i = 0;
+        for (; i < size; ++i) {
+            const ushort c = data[i].unicode();
+            if (c >= 0x80)
+                break;
+            buffer[i] = char(c);
+        }
+        if (i == size) {
+            double value = 0;
+            const std::from_chars_result result = std::from_chars(buffer, buffer + size, value);
+            if (result.ec == std::errc() && result.ptr == buffer + size) {
+                if (ok)
+                    *ok = true;
+                return value;
+            }
+        }
+    }
+#endif
+    return text.toDouble(ok);
+}
+
+/*
+  \overload
+  Parse the \a size bytes of the Latin-1 number \a data.
+ */
+double parseDouble(const char *data, int size, bool *ok)
+{
+#if defined(__cpp_lib_to_chars)
+    double value = 0;
+    const std::from_chars_result result = std::from_chars(data, data + size, value);
+    if (result.ec == std::errc() && result.ptr == data + size) {
+        if (ok)
+            *ok = true;
+        return value;
+    }
+#endif
+    return QByteArray::fromRawData(data, size).toDouble(ok);
+}
+
+namespace {
+
+const quint64 xxhPrime1 = Q_UINT64_C(0x9E3779B185EBCA87);
+const quint64 xxhPrime2 = Q_UINT64_C(0xC2B2AE3D27D4EB4F);
+const quint64 xxhPrime3 = Q_UINT64_C(0x165667B19E3779F9);
+const quint64 xxhPrime4 = Q_UINT64_C(0x85EBCA77C2B2AE63);
+const quint64 xxhPrime5 = Q_UINT64_C(0x27D4EB2F165667C5);
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 xxhRound(quint64 acc, quint64 input)
+{
+    acc += input * xxhPrime2;
+    return rotateLeft(acc, 31) * xxhPrime1;
+}
+
+inline quint64 xxhMerge(quint64 acc, quint64 value)
+{
+    acc ^= xxhRound(0, value);
+    return acc * xxhPrime1 + xxhPrime4;
+}
+
+} // namespace
+
+/*
+ * Returns the XXH64 hash of \a bytes, a fast non-cryptographic hash used
+ * to find files with the same contents.
+ */
+quint64 contentHash(const QByteArray &bytes)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(bytes.constData());
+    const uchar *end = p + bytes.size();
+    quint64 hash;
+
+    if (bytes.size() >= 32) {
+        const uchar *limit = end - 32;
+        quint64 v1 = xxhPrime1 + xxhPrime2;
+        quint64 v2 = xxhPrime2;
+        quint64 v3 = 0;
+        quint64 v4 = 0 - xxhPrime1;
+        do {
+            v1 = xxhRound(v1, qFromLittleEndian<quint64>(p));
+            v2 = xxhRound(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = xxhRound(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = xxhRound(v4, qFromLittleEndian<quint64>(p + 24));
+            p += 32;
+        } while (p <= limit);
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = xxhMerge(hash, v1);
+        hash = xxhMerge(hash, v2);
+        hash = xxhMerge(hash, v3);
+        hash = xxhMerge(hash, v4);
+    } else {
+        hash = xxhPrime5;
+    }
+    hash += quint64(bytes.size());
+
+    for (; p + 8 <= end; p += 8) {
+        hash ^= xxhRound(0, qFromLittleEndian<quint64>(p));
+        hash = rotateLeft(hash, 27) * xxhPrime1 + xxhPrime4;
+    }
+    if (p + 4 <= end) {
+        hash ^= quint64(qFromLittleEndian<quint32>(p)) * xxhPrime1;
+        hash = rotateLeft(hash, 23) * xxhPrime2 + xxhPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash ^= (*p) * xxhPrime5;
+        hash = rotateLeft(hash, 11) * xxhPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= xxhPrime2;
+    hash ^= hash >> 29;
+    hash *= xxhPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/*
+ * Move the span [\a first, \a last] of rows or columns as \a count of them
+ * are inserted before \a at, or -\a count are removed from \a at on. The
+ * span grows or shrinks when the rows or columns are inserted into it or
+ * removed from it, and is cut at \a max. Returns false if all of it is
+ * removed or pushed past \a max.
+ */
+bool shiftSpan(int *first, int *last, int at, int count, int max)
+{
+    if (count >= 0) {
+        if (*first >= at)
+            *first += count;
+        if (*last >= at)
+            *last += count;
+        if (*first > max)
+            return false;
+        *last = qMin(*last, max);
+        return true;
+    }
+
+    const int removedLast = at - count - 1;
+    if (*first >= at && *last <= removedLast)
+        return false;
+    if (*first > removedLast)
+        *first += count;
+    else if (*first > at)
+        *first = at;
+    if (*last > removedLast)
+        *last += count;
+    else if (*last >= at)
+        *last = at - 1;
+    return true;
+}
+
+/*
+ * Tokenize the shared formula \a rootFormula of \a rootCell once: the
+ * relative references are parsed, and the text between them is kept as is,
+ * so the formula of every other cell of the shared range can be built
+ * without scanning the formula again.
  *
  * For long run, we need a formula parser.
  */
-QString convertSharedFormula(const QString &rootFormula, const CellReference &rootCell,
-                             const CellReference &cell)
+SharedFormulaTemplate::SharedFormulaTemplate(const QString &rootFormula,
+                                             const CellReference &rootCell)
+    : m_rootRow(rootCell.row())
+    , m_rootColumn(rootCell.column())
+    , m_textSize(0)
 {
     // Find all the "$?[A-Z]+$?[0-9]+" patterns in the rootFormula.
-    QList<QPair<QString, int>> segments;
-
     QString segment;
     bool inQuote = false;
     enum RefState { INVALID, PRE_AZ, AZ, PRE_09, _09 };
@@ -222,7 +640,7 @@ QString convertSharedFormula(const QString &rootFormula, const CellReference &ro
                     refState = PRE_09;
                     refFlag |= 0x02;
                 } else {
-                    segments.append(qMakePair(segment, refState == _09 ? refFlag : -1));
+                    appendSegment(segment, refState == _09 ? refFlag : -1);
                     segment = QString(ch); // Start new segment.
                     refState = PRE_AZ;
                     refFlag = 0x01;
@@ -231,7 +649,7 @@ QString convertSharedFormula(const QString &rootFormula, const CellReference &ro
                 if (refState == PRE_AZ || refState == AZ) {
                     segment.append(ch);
                 } else {
-                    segments.append(qMakePair(segment, refState == _09 ? refFlag : -1));
+                    appendSegment(segment, refState == _09 ? refFlag : -1);
                     segment = QString(ch); // Start new segment.
                     refFlag = 0x00;
                 }
@@ -245,7 +663,7 @@ QString convertSharedFormula(const QString &rootFormula, const CellReference &ro
                     refState = INVALID;
             } else {
                 if (refState == _09) {
-                    segments.append(qMakePair(segment, refFlag));
+                    appendSegment(segment, refFlag);
                     segment = QString(ch); // Start new segment.
                 } else {
                     segment.append(ch);
@@ -256,26 +674,236 @@ QString convertSharedFormula(const QString &rootFormula, const CellReference &ro
     }
 
     if (!segment.isEmpty())
-        segments.append(qMakePair(segment, refState == _09 ? refFlag : -1));
-
-    // Replace "A1", "$A1", "A$1" segment with proper one.
-    QStringList result;
-    typedef QPair<QString, int> PairType;
-    foreach (PairType p, segments) {
-        // qDebug()<<p.first<<p.second;
-        if (p.second != -1 && p.second != 3) {
-            CellReference oldRef(p.first);
-            int row = p.second & 0x02 ? oldRef.row() : oldRef.row() - rootCell.row() + cell.row();
-            int col = p.second & 0x01 ? oldRef.column()
-                                      : oldRef.column() - rootCell.column() + cell.column();
-            result.append(CellReference(row, col).toString(p.second & 0x02, p.second & 0x01));
+        appendSegment(segment, refState == _09 ? refFlag : -1);
+}
+
+/*
+ * Add \a segment to the tokens. \a refFlag is -1 for plain text; the
+ * absolute references keep their text, as they never change from one cell
+ * of the shared range to the other, but are parsed for shiftedText().
+ */
+void SharedFormulaTemplate::appendSegment(const QString &segment, int refFlag)
+{
+    if (segment.isEmpty())
+        return;
+    if (refFlag == -1) {
+        m_textSize += segment.size();
+        if (!m_tokens.isEmpty() && m_tokens.last().flag == -1)
+            m_tokens.last().text.append(segment);
+        else
+            m_tokens.append(Token(segment));
+        return;
+    }
+
+    Token token;
+    token.flag = refFlag;
+    if (refFlag == 3) {
+        token.text = segment;
+        m_textSize += segment.size();
+    }
+    parseCellReference(QStringRef(&segment), &token.row, &token.column);
+    m_tokens.append(token);
+}
+
+/*
+ * Returns the formula of \a cell, whose relative references are moved
+ * from the root cell as far as \a cell is. The text starts with \a prefix,
+ * so that "=" can be added without copying the formula again.
+ */
+QString SharedFormulaTemplate::formulaText(const CellReference &cell, QLatin1String prefix) const
+{
+    const int rowOffset = cell.row() - m_rootRow;
+    const int columnOffset = cell.column() - m_rootColumn;
+
+    QString result;
+    result.reserve(prefix.size() + m_textSize + 8 * m_tokens.size());
+    result.append(prefix);
+    foreach (const Token &token, m_tokens) {
+        if (token.flag == -1 || token.flag == 3) {
+            result.append(token.text);
         } else {
-            result.append(p.first);
+            const int row = token.flag & 0x02 ? token.row : token.row + rowOffset;
+            const int col = token.flag & 0x01 ? token.column : token.column + columnOffset;
+            char buffer[XLSX_CELL_REFERENCE_BUFFER_SIZE];
+            const int size = formatCellReference(row, col, buffer, token.flag & 0x02,
+                                                 token.flag & 0x01);
+            result.append(QLatin1String(buffer, size));
         }
     }
+    return result;
+}
 
-    // OK
-    return result.join(QString());
+/*
+ * Returns true if the formula has relative references, and nothing which
+ * the tokenizer could take for a reference by mistake: quoted sheet names,
+ * external or structured references, array constants, and names such as
+ * LOG10 which are followed by a parenthesis or preceded by a letter.
+ */
+bool SharedFormulaTemplate::isShareable() const
+{
+    bool hasReference = false;
+    for (int i = 0; i < m_tokens.size(); ++i) {
+        const Token &token = m_tokens[i];
+        if (isText(i)) {
+            if (token.text.contains(QLatin1Char('\'')) || token.text.contains(QLatin1Char('['))
+                || token.text.contains(QLatin1Char('{')))
+                return false;
+            continue;
+        }
+        hasReference = true;
+        if (i + 1 < m_tokens.size() && isText(i + 1)
+            && m_tokens[i + 1].text.startsWith(QLatin1Char('(')))
+            return false;
+        if (i > 0 && isText(i - 1)) {
+            const QChar ch = m_tokens[i - 1].text.at(m_tokens[i - 1].text.size() - 1);
+            if (ch.isLetterOrNumber() || ch == QLatin1Char('_') || ch == QLatin1Char('.'))
+                return false;
+        }
+    }
+    return hasReference;
+}
+
+/*
+ * Returns a key which is the same for the formulas of the cells which
+ * only differ by the offset of their relative references from the cell,
+ * as if the formula was written in the R1C1 style.
+ */
+QString SharedFormulaTemplate::relativeKey() const
+{
+    QString key;
+    key.reserve(m_textSize + 16 * m_tokens.size());
+    foreach (const Token &token, m_tokens) {
+        if (token.flag == -1 || token.flag == 3) {
+            key.append(token.text);
+        } else {
+            key.append(QChar(1));
+            key.append(QString::number(token.flag));
+            key.append(QLatin1Char(','));
+            key.append(QString::number(token.flag & 0x02 ? token.row : token.row - m_rootRow));
+            key.append(QLatin1Char(','));
+            key.append(
+                QString::number(token.flag & 0x01 ? token.column : token.column - m_rootColumn));
+            key.append(QChar(1));
+        }
+    }
+    return key;
+}
+
+/*
+ * Returns true if the token \a i is a reference to a cell of the sheet
+ * itself: not the name of a function such as LOG10, nor a part of a name
+ * or of a reference to another sheet.
+ */
+bool SharedFormulaTemplate::isCellReference(int i) const
+{
+    if (m_tokens[i].flag == -1)
+        return false;
+    if (i + 1 < m_tokens.size() && m_tokens[i + 1].flag == -1
+        && m_tokens[i + 1].text.startsWith(QLatin1Char('(')))
+        return false;
+    if (i > 0) {
+        if (m_tokens[i - 1].flag != -1)
+            return false;
+        const QChar ch = m_tokens[i - 1].text.at(m_tokens[i - 1].text.size() - 1);
+        if (ch.isLetterOrNumber() || ch == QLatin1Char('_') || ch == QLatin1Char('.')
+            || ch == QLatin1Char('!') || ch == QLatin1Char(']'))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Returns the formula, as written in the root cell, with its references
+ * moved along with the cells they refer to when \a count rows, or columns
+ * if \a rows is false, are inserted before \a first, or -\a count are
+ * removed from \a first on. \a max is the last row or column of a sheet.
+ * The ends of the ranges move on their own, so a range grows or shrinks
+ * with the rows or columns inserted into it or removed from it. References
+ * whose cells are all removed become #REF!.
+ *
+ * References to other sheets, and whole rows or columns, are left as is.
+ */
+QString SharedFormulaTemplate::shiftedText(bool rows, int first, int count, int max) const
+{
+    QString result;
+    result.reserve(m_textSize + 8 * m_tokens.size());
+    for (int i = 0; i < m_tokens.size(); ++i) {
+        const Token &token = m_tokens[i];
+        if (!isCellReference(i)) {
+            if (token.flag == -1 || token.flag == 3) {
+                result.append(token.text);
+            } else {
+                char buffer[XLSX_CELL_REFERENCE_BUFFER_SIZE];
+                const int size = formatCellReference(token.row, token.column, buffer,
+                                                     token.flag & 0x02, token.flag & 0x01);
+                result.append(QLatin1String(buffer, size));
+            }
+            continue;
+        }
+
+        // A range is two references joined by a colon
+        int last = i;
+        if (i + 2 < m_tokens.size() && m_tokens[i + 1].flag == -1
+            && m_tokens[i + 1].text == QLatin1String(":") && isCellReference(i + 2)) {
+            last = i + 2;
+        }
+        const Token &lastToken = m_tokens[last];
+        int firstRow = qMin(token.row, lastToken.row);
+        int lastRow = qMax(token.row, lastToken.row);
+        int firstColumn = qMin(token.column, lastToken.column);
+        int lastColumn = qMax(token.column, lastToken.column);
+        const bool kept = rows ? shiftSpan(&firstRow, &lastRow, first, count, max)
+                               : shiftSpan(&firstColumn, &lastColumn, first, count, max);
+        if (!kept) {
+            result.append(QLatin1String("#REF!"));
+        } else {
+            char buffer[XLSX_CELL_REFERENCE_BUFFER_SIZE];
+            int size = formatCellReference(firstRow, firstColumn, buffer, token.flag & 0x02,
+                                           token.flag & 0x01);
+            result.append(QLatin1String(buffer, size));
+            if (last != i) {
+                result.append(QLatin1Char(':'));
+                size = formatCellReference(lastRow, lastColumn, buffer, lastToken.flag & 0x02,
+                                           lastToken.flag & 0x01);
+                result.append(QLatin1String(buffer, size));
+            }
+        }
+        i = last;
+    }
+    return result;
+}
+
+/*
+ * Returns a key which is the same for formulas which mean the same once
+ * their relative references are taken from \a root, such as "A1>0" at
+ * A1 and "A2>0" at A2. Returns a null string if the formula has relative
+ * references which can't be told apart from the rest of its text, in
+ * which case it can only be compared with itself.
+ */
+QString relativeFormulaKey(const QString &formula, const CellReference &root)
+{
+    const SharedFormulaTemplate formulaTemplate(formula, root);
+    const QString key = formulaTemplate.relativeKey();
+    if (!formulaTemplate.isShareable() && key.contains(QChar(1)))
+        return QString();
+    return key.isNull() ? QStringLiteral("") : key;
+}
+
+/*
+ * Convert shared formula for non-root cells.
+ *
+ * For example, if "B1:B10" have shared formula "=A1*A1", this function will return "=A2*A2"
+ * for "B2" cell, "=A3*A3" for "B3" cell, etc.
+ *
+ * Note, the formula "=A1*A1" for B1 can also be written as "=RC[-1]*RC[-1]", which is the same
+ * for all other cells. In other words, this formula is shared.
+ *
+ * Use a SharedFormulaTemplate instead when many cells share the formula.
+ */
+QString convertSharedFormula(const QString &rootFormula, const CellReference &rootCell,
+                             const CellReference &cell)
+{
+    return SharedFormulaTemplate(rootFormula, rootCell).formulaText(cell);
 }
 
 } // namespace QXlsx
@@ -37,10 +37,14 @@
 //
 
 #include "xlsxglobal.h"
+#include <QString>
+#include <QVector>
+
 class QPoint;
-class QString;
+class QStringRef;
 class QStringList;
 class QColor;
+class QDate;
 class QDateTime;
 class QTime;
 
@@ -55,6 +59,15 @@ XLSX_AUTOTEST_EXPORT QString getRelFilePath(const QString &filePath);
 XLSX_AUTOTEST_EXPORT double datetimeToNumber(const QDateTime &dt, bool is1904 = false);
 XLSX_AUTOTEST_EXPORT QDateTime datetimeFromNumber(double num, bool is1904 = false);
 XLSX_AUTOTEST_EXPORT double timeToNumber(const QTime &t);
+XLSX_AUTOTEST_EXPORT double dateToNumber(const QDate &date, bool is1904 = false);
+XLSX_AUTOTEST_EXPORT void datesToNumbers(const QDate *dates, int count, double *numbers,
+                                         bool is1904 = false);
+XLSX_AUTOTEST_EXPORT void datetimesToNumbers(const QDateTime *values, int count, double *numbers,
+                                             bool is1904 = false);
+XLSX_AUTOTEST_EXPORT void msecsSinceEpochToNumbers(const qint64 *msecs, int count, double *numbers,
+                                                   bool is1904 = false);
+XLSX_AUTOTEST_EXPORT void numbersToMsecsSinceEpoch(const double *numbers, int count, qint64 *msecs,
+                                                   bool is1904 = false);
 
 XLSX_AUTOTEST_EXPORT QString createSafeSheetName(const QString &nameProposal);
 XLSX_AUTOTEST_EXPORT QString escapeSheetName(const QString &sheetName);
@@ -62,6 +75,65 @@ XLSX_AUTOTEST_EXPORT QString unescapeSheetName(const QString &sheetName);
 
 XLSX_AUTOTEST_EXPORT bool isSpaceReserveNeeded(const QString &string);
 
+XLSX_AUTOTEST_EXPORT bool parseCellReference(const QStringRef &ref, int *row, int *column);
+XLSX_AUTOTEST_EXPORT bool parseCellReference(const char *data, int size, int *row, int *column);
+
+enum { XLSX_CELL_REFERENCE_BUFFER_SIZE = 20 };
+XLSX_AUTOTEST_EXPORT int formatCellReference(int row, int column, char *buffer,
+                                             bool rowAbsolute = false, bool columnAbsolute = false);
+
+enum { XLSX_DOUBLE_BUFFER_SIZE = 32 };
+XLSX_AUTOTEST_EXPORT int formatDouble(double value, char *buffer);
+XLSX_AUTOTEST_EXPORT double parseDouble(const QStringRef &text, bool *ok = 0);
+XLSX_AUTOTEST_EXPORT double parseDouble(const char *data, int size, bool *ok = 0);
+XLSX_AUTOTEST_EXPORT quint64 contentHash(const QByteArray &bytes);
+XLSX_AUTOTEST_EXPORT bool shiftSpan(int *first, int *last, int at, int count, int max);
+
+class XLSX_AUTOTEST_EXPORT SharedFormulaTemplate
+{
+public:
+    SharedFormulaTemplate()
+        : m_rootRow(0)
+        , m_rootColumn(0)
+        , m_textSize(0)
+    {
+    }
+    SharedFormulaTemplate(const QString &rootFormula, const CellReference &rootCell);
+
+    QString formulaText(const CellReference &cell, QLatin1String prefix = QLatin1String("")) const;
+    bool isShareable() const;
+    QString relativeKey() const;
+    QString shiftedText(bool rows, int first, int count, int max) const;
+
+private:
+    struct Token
+    {
+        Token(const QString &text = QString())
+            : text(text)
+            , flag(-1)
+            , row(0)
+            , column(0)
+        {
+        }
+
+        QString text; // also kept for the absolute references
+        int flag; // -1 for text, else 0x00, 0x01, 0x02, 0x03 ==> A1, $A1, A$1, $A$1
+        int row;
+        int column;
+    };
+
+    void appendSegment(const QString &segment, int refFlag);
+    bool isText(int i) const { return m_tokens[i].flag == -1 || m_tokens[i].flag == 3; }
+    bool isCellReference(int i) const;
+
+    QVector<Token> m_tokens;
+    int m_rootRow;
+    int m_rootColumn;
+    int m_textSize;
+};
+
+XLSX_AUTOTEST_EXPORT QString relativeFormulaKey(const QString &formula,
+                                                const CellReference &root);
 XLSX_AUTOTEST_EXPORT QString convertSharedFormula(const QString &rootFormula,
                                                   const CellReference &rootCell,
                                                   const CellReference &cell);
@@ -24,6 +24,7 @@
 ****************************************************************************/
 #include "xlsxworkbook.h"
 #include "xlsxworkbook_p.h"
+#include "xlsxbiff12_p.h"
 #include "xlsxsharedstrings_p.h"
 #include "xlsxworksheet.h"
 #include "xlsxchartsheet.h"
@@ -32,16 +33,48 @@
 #include "xlsxworksheet_p.h"
 #include "xlsxformat_p.h"
 #include "xlsxmediafile_p.h"
+#include "xlsxdrawing_p.h"
+#include "xlsxtable_p.h"
+#include "xlsxchart.h"
+#include "xlsxzipreader_p.h"
 #include "xlsxutility_p.h"
+#include "xlsxformulaengine_p.h"
+#include "xlsxsheetloader_p.h"
 
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
 #include <QFile>
 #include <QBuffer>
 #include <QDir>
+#include <QRunnable>
+#include <QThreadPool>
 
 QT_BEGIN_NAMESPACE_XLSX
 
+namespace {
+
+/*
+  Encode an image added with MediaFile::setImage() in the background.
+ */
+class EncodeMediaTask : public QRunnable
+{
+public:
+    EncodeMediaTask(const QSharedPointer<MediaFile> &media)
+        : m_media(media)
+    {
+    }
+
+    void run()
+    {
+        m_media->contents();
+    }
+
+private:
+    QSharedPointer<MediaFile> m_media;
+};
+
+} // namespace
+
 WorkbookPrivate::WorkbookPrivate(Workbook *q, Workbook::CreateFlag flag)
     : AbstractOOXmlFilePrivate(q, flag)
 {
@@ -57,6 +90,10 @@ WorkbookPrivate::WorkbookPrivate(Workbook *q, Workbook::CreateFlag flag)
     strings_to_numbers_enabled = false;
     strings_to_hyperlinks_enabled = true;
     html_to_richstring_enabled = false;
+    concurrent_writes_enabled = false;
+    memoryBudget = 0;
+    rowBlockLoad = false;
+    calculation_enabled = false;
     date1904 = false;
     defaultDateFormat = QStringLiteral("yyyy-mm-dd");
     activesheetIndex = 0;
@@ -66,6 +103,216 @@ WorkbookPrivate::WorkbookPrivate(Workbook *q, Workbook::CreateFlag flag)
     last_worksheet_index = 0;
     last_chartsheet_index = 0;
     last_sheet_id = 0;
+
+    lazyStringSlots = 0;
+    indexedMediaCount = 0;
+}
+
+WorkbookPrivate::~WorkbookPrivate()
+{
+    // Stop the worker before the sheets go away
+    sheetLoader.reset();
+}
+
+/*
+  Keep \a zipReader to load the sheets on first access. The shared strings
+  loaded so far are held, so that the cells of the loaded sheets can't
+  release a string still used by a sheet which is not loaded yet.
+ */
+void WorkbookPrivate::setLazyPackage(const QSharedPointer<ZipReader> &zipReader)
+{
+    if (sheets.isEmpty())
+        return;
+
+    lazyPackage = zipReader;
+    for (int i = 0; i < sheets.size(); ++i)
+        lazySheets.insert(sheets[i].data());
+
+    lazyStringSlots = sharedStrings->slotCount();
+    for (int idx = 0; idx < lazyStringSlots; ++idx)
+        sharedStrings->incRefByStringIndex(idx);
+}
+
+/*
+  Parse the sheets not loaded yet on a worker thread, reading them from the
+  file \a packageName. The active sheet comes first, then the others in
+  their order. Returns the loader, which reports the loaded sheets, or 0
+  when there is no sheet to load.
+ */
+SheetLoader *WorkbookPrivate::loadSheetsInBackground(const QString &packageName)
+{
+    if (lazySheets.isEmpty())
+        return 0;
+
+    QList<AbstractSheet *> order;
+    if (activesheetIndex >= 0 && activesheetIndex < sheets.size()
+        && lazySheets.contains(sheets[activesheetIndex].data()))
+        order.append(sheets[activesheetIndex].data());
+    for (int i = 0; i < sheets.size(); ++i) {
+        if (i != activesheetIndex && lazySheets.contains(sheets[i].data()))
+            order.append(sheets[i].data());
+    }
+
+    sheetLoader.reset(new SheetLoader(this, packageName));
+    sheetLoader->start(order);
+    return sheetLoader.data();
+}
+
+/*
+  Load \a sheet from the package kept by the lazy load mode. Its drawing
+  is left in the package until the anchors are needed, see
+  Drawing::load(). Does nothing if the sheet has been loaded already.
+ */
+void WorkbookPrivate::loadSheet(AbstractSheet *sheet)
+{
+    if (!lazySheets.contains(sheet))
+        return;
+    const bool parsed = sheetLoader && sheetLoader->takeSheet(sheet);
+    lazySheets.remove(sheet);
+
+    QString rel_path = getRelFilePath(sheet->filePath());
+    if (!parsed) {
+        if (lazyPackage->contains(rel_path))
+            sheet->relationships()->loadFromXmlData(lazyPackage->fileData(rel_path));
+        sheet->loadFromXmlData(lazyPackage->fileData(sheet->filePath()));
+    } else if (sheet->sheetType() == AbstractSheet::ST_WorkSheet) {
+        static_cast<Worksheet *>(sheet)->d_func()->mergeSstRefs();
+    }
+
+    if (sheet->sheetType() == AbstractSheet::ST_WorkSheet) {
+        const WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet)->d_func();
+        foreach (const QSharedPointer<Table> &table, sheet_d->tables)
+            table->loadFromXmlData(lazyPackage->fileData(table->filePath()));
+    }
+
+    if (Drawing *drawing = sheet->drawing()) {
+        rel_path = getRelFilePath(drawing->filePath());
+        if (lazyPackage->contains(rel_path))
+            drawing->relationships()->loadFromXmlData(lazyPackage->fileData(rel_path));
+        drawing->setPackage(lazyPackage);
+    }
+
+    if (lazySheets.isEmpty())
+        releaseLazyPackage();
+    if (sheetLoader)
+        sheetLoader->reportLoaded(sheet);
+}
+
+void WorkbookPrivate::loadAllSheets()
+{
+    for (int i = 0; i < sheets.size() && !lazySheets.isEmpty(); ++i)
+        loadSheet(sheets[i].data());
+}
+
+/*
+  Parse the drawings left in the package, in the order of the sheets, so
+  that all the charts and pictures are known.
+ */
+void WorkbookPrivate::loadDrawings()
+{
+    loadAllSheets();
+    for (int i = 0; i < sheets.size(); ++i) {
+        if (Drawing *drawing = sheets[i]->drawing())
+            drawing->load();
+    }
+}
+
+/*
+  Update the positions of the sheets from \a from on, after sheets have
+  been inserted, removed or moved there.
+ */
+void WorkbookPrivate::reindexSheets(int from)
+{
+    sheetsByType.clear();
+    for (int i = from; i < sheetNames.size(); ++i)
+        sheetIndexes.insert(sheetNames[i], i);
+}
+
+/*
+  Add the defined name at \a index of definedNamesList to the index, and
+  parse its formula when it's a single range, with or without a sheet
+  name. Lists of ranges, constants and expressions are left unparsed.
+ */
+void WorkbookPrivate::indexDefinedName(int index)
+{
+    XlsxDefineNameData &data = definedNamesList[index];
+    definedNameIndex.insert(qMakePair(data.name.toLower(), data.sheetId), index);
+
+    const int separator = data.formula.lastIndexOf(QLatin1Char('!'));
+    QString sheetName = data.formula.left(qMax(separator, 0));
+    if (sheetName.length() > 2 && sheetName.startsWith(QLatin1Char('\''))
+        && sheetName.endsWith(QLatin1Char('\''))) {
+        sheetName = unescapeSheetName(sheetName);
+    } else if (sheetName.contains(QLatin1Char('!')) || sheetName.contains(QLatin1Char(','))
+               || sheetName.contains(QLatin1Char('('))) {
+        return;
+    }
+    const CellRange range(data.formula.mid(separator + 1));
+    if (!range.isValid())
+        return;
+    data.rangeSheet = sheetName;
+    data.range = range;
+}
+
+/*
+  Returns the name \a name of the scope \a sheetId, -1 being the global
+  scope, or 0 when there is no such name. The case is ignored.
+ */
+const XlsxDefineNameData *WorkbookPrivate::definedName(const QString &name, int sheetId) const
+{
+    const int index = definedNameIndex.value(qMakePair(name.toLower(), sheetId), -1);
+    return index == -1 ? 0 : &definedNamesList[index];
+}
+
+/*
+  Called once no sheet is left to load: drops the package and the hold
+  on the shared strings.
+ */
+void WorkbookPrivate::releaseLazyPackage()
+{
+    lazySheets.clear();
+    lazyPackage.reset();
+    for (int idx = 0; idx < lazyStringSlots; ++idx)
+        sharedStrings->decRefByStringIndex(idx);
+    lazyStringSlots = 0;
+}
+
+/*
+  Spill cells to disk until the worksheets fit in the memory budget: the
+  rows of \a current above the block of \a row first, then all the rows
+  of the other worksheets. The sheets not loaded yet, which may be parsed
+  by a worker thread, and the streamed ones are left alone.
+ */
+void WorkbookPrivate::enforceMemoryBudget(Worksheet *current, int row)
+{
+    QList<WorksheetPrivate *> others;
+    qint64 total = current->d_func()->cellTable.memoryEstimate();
+    foreach (const QSharedPointer<AbstractSheet> &sheet, sheets) {
+        if (sheet->sheetType() != AbstractSheet::ST_WorkSheet || sheet.data() == current
+            || lazySheets.contains(sheet.data())) {
+            continue;
+        }
+        WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        if (sheet_d->constantMemory)
+            continue;
+        total += sheet_d->cellTable.memoryEstimate();
+        others.append(sheet_d);
+    }
+    if (total <= memoryBudget)
+        return;
+
+    WorksheetPrivate *current_d = current->d_func();
+    total -= current_d->cellTable.memoryEstimate();
+    current_d->spillCells(row);
+    total += current_d->cellTable.memoryEstimate();
+
+    foreach (WorksheetPrivate *sheet_d, others) {
+        if (total <= memoryBudget)
+            break;
+        total -= sheet_d->cellTable.memoryEstimate();
+        sheet_d->spillCells(XLSX_ROW_MAX + 1);
+        total += sheet_d->cellTable.memoryEstimate();
+    }
 }
 
 Workbook::Workbook(CreateFlag flag)
@@ -73,6 +320,60 @@ Workbook::Workbook(CreateFlag flag)
 {
 }
 
+/*
+  Returns a copy of the workbook to be saved while this one keeps changing.
+  The sheets must all be loaded. The cells are implicitly shared, while the
+  shared strings and the styles are copied with their indexes. The drawings,
+  charts, pictures and external links are shared with this workbook.
+ */
+Workbook *Workbook::snapshot() const
+{
+    Q_D(const Workbook);
+    Workbook *book = new Workbook(F_NewFromScratch);
+    WorkbookPrivate *book_d = book->d_func();
+
+    book_d->sharedStrings = QSharedPointer<SharedStrings>(d->sharedStrings->clone());
+    book_d->styles = QSharedPointer<Styles>(d->styles->clone());
+    book_d->theme->loadFromXmlData(d->theme->saveToXmlData());
+
+    foreach (const QSharedPointer<AbstractSheet> &sheet, d->sheets) {
+        AbstractSheet *copy = 0;
+        if (sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+            copy = static_cast<Worksheet *>(sheet.data())->snapshot(book);
+        else
+            copy = static_cast<Chartsheet *>(sheet.data())->snapshot(book);
+        book_d->sheets.append(QSharedPointer<AbstractSheet>(copy));
+    }
+    book_d->sheetNames = d->sheetNames;
+    book_d->sheetIndexes = d->sheetIndexes;
+    book_d->externalLinks = d->externalLinks;
+    book_d->mediaFiles = d->mediaFiles;
+    book_d->mediaIndex = d->mediaIndex;
+    book_d->indexedMediaCount = d->indexedMediaCount;
+    book_d->imageIndex = d->imageIndex;
+    book_d->chartFiles = d->chartFiles;
+    book_d->chartFileIndexes = d->chartFileIndexes;
+    book_d->definedNamesList = d->definedNamesList;
+    book_d->definedNameIndex = d->definedNameIndex;
+
+    book_d->strings_to_numbers_enabled = d->strings_to_numbers_enabled;
+    book_d->strings_to_hyperlinks_enabled = d->strings_to_hyperlinks_enabled;
+    book_d->html_to_richstring_enabled = d->html_to_richstring_enabled;
+    book_d->date1904 = d->date1904;
+    book_d->defaultDateFormat = d->defaultDateFormat;
+    book_d->x_window = d->x_window;
+    book_d->y_window = d->y_window;
+    book_d->window_width = d->window_width;
+    book_d->window_height = d->window_height;
+    book_d->activesheetIndex = d->activesheetIndex;
+    book_d->firstsheet = d->firstsheet;
+    book_d->table_count = d->table_count;
+    book_d->last_worksheet_index = d->last_worksheet_index;
+    book_d->last_chartsheet_index = d->last_chartsheet_index;
+    book_d->last_sheet_id = d->last_sheet_id;
+    return book;
+}
+
 Workbook::~Workbook()
 {
 }
@@ -154,6 +455,232 @@ void Workbook::setDefaultDateFormat(const QString &format)
     d->defaultDateFormat = format;
 }
 
+/*!
+  Returns true if the worksheets can be written from several threads.
+
+  \sa setConcurrentWritesEnabled()
+ */
+bool Workbook::isConcurrentWritesEnabled() const
+{
+    Q_D(const Workbook);
+    return d->concurrent_writes_enabled;
+}
+
+/*!
+  Lets different worksheets of the workbook be written from different
+  threads at the same time when \a enable is true. The shared strings
+  table and the styles, which all the worksheets use, are then locked
+  in every call.
+
+  Each thread must work on its own worksheet, or on its own RowWriter,
+  with its own Format objects, and the workbook must only be saved once
+  all of them are done. Adding, removing or renaming sheets, images or charts is still
+  not thread safe.
+
+  This must be set before the threads start, the default is false.
+ */
+void Workbook::setConcurrentWritesEnabled(bool enable)
+{
+    Q_D(Workbook);
+    d->concurrent_writes_enabled = enable;
+    // The background loader keeps them locked until it's done
+    if (d->sheetLoader && !d->sheetLoader->isFinished())
+        return;
+    d->sharedStrings->setThreadSafe(enable);
+    d->styles->setThreadSafe(enable);
+}
+
+/*!
+  Registers \a format with the styles of the workbook, and returns its
+  style id, which can be passed to the Worksheet::write() overload which
+  takes one. Resolving a format once this way saves the per cell work of
+  matching it against the known formats. The id of an empty format is -1,
+  which means the cell has no format.
+
+  \sa registeredFormat()
+ */
+int Workbook::registerFormat(const Format &format)
+{
+    Q_D(Workbook);
+    return d->styles->registerFormat(format);
+}
+
+/*!
+  Returns the format whose style id is \a styleId, or an empty format
+  if the id is not known.
+
+  \sa registerFormat()
+ */
+Format Workbook::registeredFormat(int styleId) const
+{
+    Q_D(const Workbook);
+    return d->styles->xfFormat(styleId);
+}
+
+/*!
+  \class QXlsx::StyleStatistics
+  \inmodule QtXlsx
+  \brief The number of the entries of each table of the workbook styles.
+
+  The custom number formats, the fonts, the fills, the borders, the cell
+  formats (xf) and the differential formats (dxf) used by the conditional
+  formattings are counted.
+ */
+
+/*!
+  Returns the number of the entries of each table of the styles, which
+  can be compared before and after compactStyles().
+ */
+StyleStatistics Workbook::styleStatistics() const
+{
+    Q_D(const Workbook);
+    return d->styles->statistics();
+}
+
+/*!
+  Merges the identical cell formats and drops the ones which are not used
+  by any cell, row or column, together with the fonts, fills and borders
+  which are no longer used. The cells of all the worksheets are updated.
+  Workbooks loaded from files which have been edited many times often
+  have thousands of them.
+
+  The formats which have been used before keep working, but the style
+  ids returned by registerFormat() must be registered again.
+
+  Returns false if the styles can't be compacted, because some rows of a
+  worksheet in constant memory mode have been written already.
+
+  \sa styleStatistics(), Document::CompactStyles
+ */
+bool Workbook::compactStyles()
+{
+    Q_D(Workbook);
+    d->loadAllSheets();
+
+    QList<Worksheet *> worksheets;
+    foreach (QSharedPointer<AbstractSheet> sheet, d->sheets) {
+        if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        Worksheet *worksheet = static_cast<Worksheet *>(sheet.data());
+        if (worksheet->d_func()->streamFile)
+            return false;
+        worksheets.append(worksheet);
+    }
+
+    QVector<bool> usedXfs(d->styles->statistics().cellFormats, false);
+    foreach (Worksheet *worksheet, worksheets)
+        worksheet->d_func()->markUsedXfIndexes(usedXfs);
+
+    QVector<int> xfMap;
+    d->styles->compact(usedXfs, &xfMap);
+
+    bool remapped = false;
+    for (int i = 0; i < xfMap.size() && !remapped; ++i)
+        remapped = xfMap[i] != i && usedXfs[i];
+    if (remapped) {
+        foreach (Worksheet *worksheet, worksheets) {
+            worksheet->d_func()->remapXfIndexes(xfMap);
+            worksheet->setDirty();
+        }
+    }
+    return true;
+}
+
+/*
+  Compact the styles and the shared strings, and release the memory the
+  worksheets hold without needing it, see Document::compact(). Returns
+  false, leaving the workbook unchanged, if a worksheet is in constant
+  memory mode.
+ */
+bool WorkbookPrivate::compact()
+{
+    Q_Q(Workbook);
+    if (!q->compactStyles())
+        return false;
+
+    QList<Worksheet *> worksheets;
+    foreach (QSharedPointer<AbstractSheet> sheet, sheets) {
+        if (sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+            worksheets.append(static_cast<Worksheet *>(sheet.data()));
+    }
+
+    QVector<int> stringMap;
+    if (sharedStrings->compact(&stringMap)) {
+        foreach (Worksheet *worksheet, worksheets) {
+            worksheet->d_func()->remapSharedStrings(stringMap);
+            // The loaded parts refer to the strings by their former indexes
+            worksheet->setDirty();
+        }
+    }
+    foreach (Worksheet *worksheet, worksheets)
+        worksheet->d_func()->squeeze();
+    return true;
+}
+
+/*!
+  Returns true if the formulas are calculated when the workbook is saved.
+
+  \sa setCalculationEnabled(), recalculate()
+ */
+bool Workbook::isCalculationEnabled() const
+{
+    Q_D(const Workbook);
+    return d->calculation_enabled;
+}
+
+/*!
+  When \a enable is true, recalculate() is called each time the document
+  is saved, so that the values saved with the formulas are up to date
+  even though the file has not been opened by Excel. The default is false.
+
+  \sa recalculate()
+ */
+void Workbook::setCalculationEnabled(bool enable)
+{
+    Q_D(Workbook);
+    d->calculation_enabled = enable;
+    if (enable)
+        return;
+    foreach (QSharedPointer<AbstractSheet> sheet, d->sheets) {
+        if (sheet->sheetType() == AbstractSheet::ST_WorkSheet)
+            static_cast<Worksheet *>(sheet.data())->d_func()->formulaEngine.reset();
+    }
+}
+
+/*!
+  Calculates the formulas of the worksheets, and stores the results as
+  the values of the formula cells.
+
+  The first call calculates all the formulas of each worksheet, and
+  records which cells each formula refers to. Later calls only calculate
+  the formulas which depend, directly or through other formulas, on the
+  cells written since.
+
+  The arithmetic, comparison, concatenation and percent operators, the
+  references to the cells and ranges of the same sheet and the functions
+  SUM, AVERAGE, MIN, MAX, COUNT, IF, AND, OR, NOT, ABS, ROUND and VLOOKUP
+  are supported. The other formulas keep the values they were loaded or
+  written with. Worksheets in constant memory mode are not calculated.
+
+  \sa setCalculationEnabled()
+ */
+void Workbook::recalculate()
+{
+    Q_D(Workbook);
+    d->loadAllSheets();
+
+    foreach (QSharedPointer<AbstractSheet> sheet, d->sheets) {
+        if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        WorksheetPrivate *sheet_d = static_cast<Worksheet *>(sheet.data())->d_func();
+        if (sheet_d->constantMemory)
+            continue;
+        if (!sheet_d->formulaEngine)
+            sheet_d->formulaEngine.reset(new FormulaEngine(sheet_d));
+        sheet_d->formulaEngine->recalculate();
+    }
+}
+
 /*!
  * \brief Create a defined name in the workbook.
  * \param name The defined name
@@ -174,18 +701,54 @@ bool Workbook::defineName(const QString &name, const QString &formula, const QSt
 
     int id = -1;
     if (!scope.isEmpty()) {
-        for (int i = 0; i < d->sheets.size(); ++i) {
-            if (d->sheets[i]->sheetName() == scope) {
-                id = d->sheets[i]->sheetId();
-                break;
-            }
-        }
+        const int index = d->sheetIndexes.value(scope, -1);
+        if (index != -1)
+            id = d->sheets[index]->sheetId();
     }
 
     d->definedNamesList.append(XlsxDefineNameData(name, formulaString, comment, id));
+    d->indexDefinedName(d->definedNamesList.size() - 1);
     return true;
 }
 
+/*!
+ * Returns the range the defined name \a name refers to, or an invalid
+ * range when there is no such name or its formula isn't a single range,
+ * such as "Sheet1!$A$1:$B$10". The name is looked for in the scope of the
+ * sheet \a scope first, then among the global names, ignoring the case.
+ *
+ * The name of the sheet of the range is stored in \a sheetName if it
+ * isn't null.
+ */
+CellRange Workbook::definedNameRange(const QString &name, const QString &scope,
+                                     QString *sheetName) const
+{
+    Q_D(const Workbook);
+    const XlsxDefineNameData *data = 0;
+    int scopeIndex = -1;
+    if (!scope.isEmpty()) {
+        scopeIndex = d->sheetIndexes.value(scope, -1);
+        if (scopeIndex != -1)
+            data = d->definedName(name, d->sheets[scopeIndex]->sheetId());
+    }
+    if (!data) {
+        data = d->definedName(name, -1);
+        scopeIndex = -1;
+    }
+    if (!data || !data->range.isValid())
+        return CellRange();
+
+    if (sheetName) {
+        if (!data->rangeSheet.isEmpty())
+            *sheetName = data->rangeSheet;
+        else if (scopeIndex != -1)
+            *sheetName = d->sheetNames[scopeIndex];
+        else
+            *sheetName = QString();
+    }
+    return data->range;
+}
+
 AbstractSheet *Workbook::addSheet(const QString &name, AbstractSheet::SheetType type)
 {
     Q_D(Workbook);
@@ -201,6 +764,16 @@ QStringList Workbook::worksheetNames() const
     return d->sheetNames;
 }
 
+/*!
+ * \internal
+ * Returns the position of the sheet named \a name, or -1.
+ */
+int Workbook::sheetIndex(const QString &name) const
+{
+    Q_D(const Workbook);
+    return d->sheetIndexes.value(name, -1);
+}
+
 /*!
  * \internal
  * Used only when load the xlsx file!!
@@ -221,6 +794,7 @@ AbstractSheet *Workbook::addSheet(const QString &name, int sheetId, AbstractShee
     }
     d->sheets.append(QSharedPointer<AbstractSheet>(sheet));
     d->sheetNames.append(name);
+    d->reindexSheets(d->sheets.size() - 1);
     return sheet;
 }
 
@@ -230,19 +804,19 @@ AbstractSheet *Workbook::insertSheet(int index, const QString &name, AbstractShe
     QString sheetName = createSafeSheetName(name);
     if (!sheetName.isEmpty()) {
         // If user given an already in-used name, we should not continue any more!
-        if (d->sheetNames.contains(sheetName))
+        if (d->sheetIndexes.contains(sheetName))
             return 0;
     } else {
         if (type == AbstractSheet::ST_WorkSheet) {
             do {
                 ++d->last_worksheet_index;
                 sheetName = QStringLiteral("Sheet%1").arg(d->last_worksheet_index);
-            } while (d->sheetNames.contains(sheetName));
+            } while (d->sheetIndexes.contains(sheetName));
         } else if (type == AbstractSheet::ST_ChartSheet) {
             do {
                 ++d->last_chartsheet_index;
                 sheetName = QStringLiteral("Chart%1").arg(d->last_chartsheet_index);
-            } while (d->sheetNames.contains(sheetName));
+            } while (d->sheetIndexes.contains(sheetName));
         } else {
             qWarning("unsupported sheet type.");
             return 0;
@@ -258,6 +832,7 @@ AbstractSheet *Workbook::insertSheet(int index, const QString &name, AbstractShe
 
     d->sheets.insert(index, QSharedPointer<AbstractSheet>(sheet));
     d->sheetNames.insert(index, sheetName);
+    d->reindexSheets(index);
     d->activesheetIndex = index;
     return sheet;
 }
@@ -270,7 +845,9 @@ AbstractSheet *Workbook::activeSheet() const
     Q_D(const Workbook);
     if (d->sheets.isEmpty())
         const_cast<Workbook *>(this)->addSheet();
-    return d->sheets[d->activesheetIndex].data();
+    AbstractSheet *sheet = d->sheets[d->activesheetIndex].data();
+    const_cast<WorkbookPrivate *>(d)->loadSheet(sheet);
+    return sheet;
 }
 
 bool Workbook::setActiveSheet(int index)
@@ -295,13 +872,13 @@ bool Workbook::renameSheet(int index, const QString &newName)
         return false;
 
     // If user given an already in-used name, return false
-    for (int i = 0; i < d->sheets.size(); ++i) {
-        if (d->sheets[i]->sheetName() == name)
-            return false;
-    }
+    if (d->sheetIndexes.contains(name))
+        return false;
 
+    d->sheetIndexes.remove(d->sheetNames[index]);
     d->sheets[index]->setSheetName(name);
     d->sheetNames[index] = name;
+    d->sheetIndexes.insert(name, index);
     return true;
 }
 
@@ -315,8 +892,13 @@ bool Workbook::deleteSheet(int index)
         return false;
     if (index < 0 || index >= d->sheets.size())
         return false;
+    if (d->sheetLoader && d->lazySheets.contains(d->sheets[index].data()))
+        d->sheetLoader->dropSheet(d->sheets[index].data());
+    if (d->lazySheets.remove(d->sheets[index].data()) && d->lazySheets.isEmpty())
+        d->releaseLazyPackage();
     d->sheets.removeAt(index);
-    d->sheetNames.removeAt(index);
+    d->sheetIndexes.remove(d->sheetNames.takeAt(index));
+    d->reindexSheets(index);
     return true;
 }
 
@@ -341,6 +923,7 @@ bool Workbook::moveSheet(int srcIndex, int distIndex)
         d->sheets.append(sheet);
         d->sheetNames.append(sheet->sheetName());
     }
+    d->reindexSheets(qMin(srcIndex, qMax(distIndex, 0)));
     return true;
 }
 
@@ -353,7 +936,7 @@ bool Workbook::copySheet(int index, const QString &newName)
     QString worksheetName = createSafeSheetName(newName);
     if (!newName.isEmpty()) {
         // If user given an already in-used name, we should not continue any more!
-        if (d->sheetNames.contains(newName))
+        if (d->sheetIndexes.contains(newName))
             return false;
     } else {
         int copy_index = 1;
@@ -361,13 +944,15 @@ bool Workbook::copySheet(int index, const QString &newName)
             ++copy_index;
             worksheetName =
                 QStringLiteral("%1(%2)").arg(d->sheets[index]->sheetName()).arg(copy_index);
-        } while (d->sheetNames.contains(worksheetName));
+        } while (d->sheetIndexes.contains(worksheetName));
     }
 
+    d->loadSheet(d->sheets[index].data());
     ++d->last_sheet_id;
     AbstractSheet *sheet = d->sheets[index]->copy(worksheetName, d->last_sheet_id);
     d->sheets.append(QSharedPointer<AbstractSheet>(sheet));
     d->sheetNames.append(sheet->sheetName());
+    d->reindexSheets(d->sheets.size() - 1);
 
     return false;
 }
@@ -389,7 +974,9 @@ AbstractSheet *Workbook::sheet(int index) const
     Q_D(const Workbook);
     if (index < 0 || index >= d->sheets.size())
         return 0;
-    return d->sheets.at(index).data();
+    AbstractSheet *sheet = d->sheets.at(index).data();
+    const_cast<WorkbookPrivate *>(d)->loadSheet(sheet);
+    return sheet;
 }
 
 SharedStrings *Workbook::sharedStrings() const
@@ -418,6 +1005,7 @@ Theme *Workbook::theme()
 QList<Drawing *> Workbook::drawings()
 {
     Q_D(Workbook);
+    d->loadAllSheets();
     QList<Drawing *> ds;
     for (int i = 0; i < d->sheets.size(); ++i) {
         QSharedPointer<AbstractSheet> sheet = d->sheets[i];
@@ -428,18 +1016,104 @@ QList<Drawing *> Workbook::drawings()
     return ds;
 }
 
+/*!
+ * \internal
+ * Returns the position of \a drawing in drawings(), which is looked up
+ * in a table while the package is saved.
+ */
+int Workbook::drawingIndex(const Drawing *drawing)
+{
+    Q_D(Workbook);
+    if (!d->savedDrawingIndexes.isEmpty())
+        return d->savedDrawingIndexes.value(drawing, -1);
+    return drawings().indexOf(const_cast<Drawing *>(drawing));
+}
+
+/*!
+ * \internal
+ * Returns the tables of the worksheets, in the order of the sheets.
+ */
+QList<Table *> Workbook::tables()
+{
+    Q_D(Workbook);
+    d->loadAllSheets();
+    QList<Table *> tables;
+    for (int i = 0; i < d->sheets.size(); ++i) {
+        if (d->sheets[i]->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        const WorksheetPrivate *sheet_d = static_cast<Worksheet *>(d->sheets[i].data())->d_func();
+        foreach (const QSharedPointer<Table> &table, sheet_d->tables)
+            tables.append(table.data());
+    }
+    return tables;
+}
+
+/*!
+ * \internal
+ * Returns the position of \a table in tables(), which is looked up in a
+ * table while the package is saved.
+ */
+int Workbook::tableIndex(const Table *table)
+{
+    Q_D(Workbook);
+    if (!d->savedTableIndexes.isEmpty())
+        return d->savedTableIndexes.value(table, -1);
+    return tables().indexOf(const_cast<Table *>(table));
+}
+
+/*!
+ * \internal
+ * Returns the worksheets which have comments, in the order of the sheets.
+ */
+QList<Worksheet *> Workbook::commentedSheets()
+{
+    Q_D(Workbook);
+    d->loadAllSheets();
+    QList<Worksheet *> sheets;
+    for (int i = 0; i < d->sheets.size(); ++i) {
+        if (d->sheets[i]->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        Worksheet *sheet = static_cast<Worksheet *>(d->sheets[i].data());
+        if (!sheet->d_func()->comments.isEmpty())
+            sheets.append(sheet);
+    }
+    return sheets;
+}
+
+/*!
+ * \internal
+ * Returns the position of \a sheet in commentedSheets(), which numbers its
+ * comments part and its VML drawing.
+ */
+int Workbook::commentsIndex(const Worksheet *sheet)
+{
+    Q_D(Workbook);
+    if (!d->savedCommentIndexes.isEmpty())
+        return d->savedCommentIndexes.value(sheet, -1);
+    return commentedSheets().indexOf(const_cast<Worksheet *>(sheet));
+}
+
 /*!
  * \internal
  */
 QList<QSharedPointer<AbstractSheet>> Workbook::getSheetsByTypes(AbstractSheet::SheetType type) const
 {
     Q_D(const Workbook);
-    QList<QSharedPointer<AbstractSheet>> list;
-    for (int i = 0; i < d->sheets.size(); ++i) {
-        if (d->sheets[i]->sheetType() == type)
-            list.append(d->sheets[i]);
+    QHash<int, QList<QSharedPointer<AbstractSheet>>>::const_iterator it =
+        d->sheetsByType.constFind(type);
+    if (it == d->sheetsByType.constEnd()) {
+        QList<QSharedPointer<AbstractSheet>> list;
+        for (int i = 0; i < d->sheets.size(); ++i) {
+            if (d->sheets[i]->sheetType() == type)
+                list.append(d->sheets[i]);
+        }
+        it = d->sheetsByType.insert(type, list);
+    }
+    if (!d->lazySheets.isEmpty()) {
+        foreach (const QSharedPointer<AbstractSheet> &sheet, it.value())
+            const_cast<WorkbookPrivate *>(d)->loadSheet(sheet.data());
     }
-    return list;
+    return it.value();
 }
 
 void Workbook::saveToXmlFile(QIODevice *device) const
@@ -661,12 +1335,119 @@ bool Workbook::loadFromXmlFile(QIODevice *device)
                 }
                 data.formula = reader.readElementText();
                 d->definedNamesList.append(data);
+                d->indexDefinedName(d->definedNamesList.size() - 1);
             }
         }
     }
     return true;
 }
 
+/*
+  Write the workbook as the BIFF12 records of a workbook.bin part. Only
+  the worksheets are written, the book views, the defined names and the
+  external links aren't.
+ */
+void Workbook::saveToBinaryFile(QIODevice *device) const
+{
+    Q_D(const Workbook);
+    d->relationships->clear();
+    if (d->sheets.isEmpty())
+        const_cast<Workbook *>(this)->addSheet();
+
+    Biff12Writer writer(device);
+    writer.writeRecord(BrtBeginBook);
+
+    writer.beginRecord(BrtFileVersion);
+    writer.writeZeros(16); // no code name
+    writer.writeString(QStringLiteral("xl"));
+    writer.writeString(QStringLiteral("4"));
+    writer.writeString(QStringLiteral("4"));
+    writer.writeString(QStringLiteral("4505"));
+    writer.endRecord();
+
+    writer.beginRecord(BrtWbProp);
+    writer.writeUInt32(d->date1904 ? 1 : 0);
+    writer.writeUInt32(124226); // the theme version
+    writer.writeString(QString());
+    writer.endRecord();
+
+    writer.writeRecord(BrtBeginBundleShs);
+    int worksheetIndex = 0;
+    for (int i = 0; i < d->sheets.size(); ++i) {
+        QSharedPointer<AbstractSheet> sheet = d->sheets[i];
+        if (sheet->sheetType() != AbstractSheet::ST_WorkSheet)
+            continue;
+        d->relationships->addDocumentRelationship(
+            QStringLiteral("/worksheet"),
+            QStringLiteral("worksheets/sheet%1.bin").arg(++worksheetIndex));
+
+        writer.beginRecord(BrtBundleSh);
+        writer.writeUInt32(sheet->sheetState());
+        writer.writeUInt32(sheet->sheetId());
+        writer.writeString(QStringLiteral("rId%1").arg(d->relationships->count()));
+        writer.writeString(sheet->sheetName());
+        writer.endRecord();
+    }
+    writer.writeRecord(BrtEndBundleShs);
+
+    writer.writeRecord(BrtEndBook);
+
+    d->relationships->addDocumentRelationship(QStringLiteral("/theme"),
+                                              QStringLiteral("theme/theme1.xml"));
+    d->relationships->addDocumentRelationship(QStringLiteral("/styles"),
+                                              QStringLiteral("styles.bin"));
+    if (!sharedStrings()->isEmpty())
+        d->relationships->addDocumentRelationship(QStringLiteral("/sharedStrings"),
+                                                  QStringLiteral("sharedStrings.bin"));
+}
+
+/*
+  Read the sheets and the workbook properties from the BIFF12 records of
+  a workbook.bin part.
+ */
+bool Workbook::loadFromBinaryData(const QByteArray &data)
+{
+    Q_D(Workbook);
+
+    Biff12Reader reader(data);
+    while (reader.readNext()) {
+        if (reader.recordType() == BrtBundleSh) {
+            const int stateValue = reader.readInt32();
+            const int sheetId = reader.readInt32();
+            const QString rId = reader.readString();
+            const QString name = reader.readString();
+            AbstractSheet::SheetState state = AbstractSheet::SS_Visible;
+            if (stateValue == AbstractSheet::SS_Hidden
+                || stateValue == AbstractSheet::SS_VeryHidden)
+                state = AbstractSheet::SheetState(stateValue);
+
+            XlsxRelationship relationship = d->relationships->getRelationshipById(rId);
+
+            AbstractSheet::SheetType type = AbstractSheet::ST_WorkSheet;
+            if (relationship.type.endsWith(QLatin1String("/chartsheet")))
+                type = AbstractSheet::ST_ChartSheet;
+            else if (relationship.type.endsWith(QLatin1String("/dialogsheet")))
+                type = AbstractSheet::ST_DialogSheet;
+            else if (relationship.type.endsWith(QLatin1String("/xlMacrosheet")))
+                type = AbstractSheet::ST_MacroSheet;
+
+            AbstractSheet *sheet = addSheet(name, sheetId, type);
+            sheet->setSheetState(state);
+            const QString fullPath = QDir::cleanPath(splitPath(filePath())[0]
+                                                     + QLatin1String("/") + relationship.target);
+            sheet->setFilePath(fullPath);
+        } else if (reader.recordType() == BrtWbProp) {
+            d->date1904 = reader.readUInt32() & 0x01;
+        }
+    }
+
+    if (reader.hasError()) {
+        qWarning("Error when read the binary workbook");
+        return false;
+    }
+    return true;
+}
+
 /*!
  * \internal
  */
@@ -679,20 +1460,94 @@ QList<QSharedPointer<MediaFile>> Workbook::mediaFiles() const
 
 /*!
  * \internal
+ * Adds \a media to the workbook, unless a file with the same contents
+ * is already there, and returns the file to use. Images which are still
+ * waiting to be encoded are encoded in the global thread pool, and only
+ * deduplicated by deduplicateMediaFiles() once they are.
  */
-void Workbook::addMediaFile(QSharedPointer<MediaFile> media, bool force)
+QSharedPointer<MediaFile> Workbook::addMediaFile(QSharedPointer<MediaFile> media, bool force)
 {
     Q_D(Workbook);
+    if (!force && !media->isEncoded()) {
+        // Copies of the same QImage are found without encoding them
+        QHash<qint64, int>::const_iterator it = d->imageIndex.constFind(media->imageKey());
+        if (it != d->imageIndex.constEnd())
+            return d->mediaFiles[it.value()];
+
+        d->imageIndex.insert(media->imageKey(), d->mediaFiles.size());
+        media->setIndex(d->mediaFiles.size());
+        d->mediaFiles.append(media);
+        QThreadPool::globalInstance()->start(new EncodeMediaTask(media));
+        return media;
+    }
+
     if (!force) {
-        for (int i = 0; i < d->mediaFiles.size(); ++i) {
-            if (d->mediaFiles[i]->hashKey() == media->hashKey()) {
-                media->setIndex(i);
-                return;
-            }
+        // Index the files added since the last lookup, whose contents
+        // may not have been known when they were added
+        for (; d->indexedMediaCount < d->mediaFiles.size(); ++d->indexedMediaCount) {
+            QSharedPointer<MediaFile> file = d->mediaFiles[d->indexedMediaCount];
+            if (file->isEncoded())
+                d->mediaIndex.insert(file->hashKey(), d->indexedMediaCount);
+        }
+
+        const QByteArray key = media->hashKey();
+        QMultiHash<QByteArray, int>::const_iterator it = d->mediaIndex.constFind(key);
+        for (; it != d->mediaIndex.constEnd() && it.key() == key; ++it) {
+            // The hash isn't cryptographic, so the contents are compared too
+            if (d->mediaFiles[it.value()]->contents() == media->contents())
+                return d->mediaFiles[it.value()];
         }
     }
     media->setIndex(d->mediaFiles.size());
     d->mediaFiles.append(media);
+    return media;
+}
+
+/*!
+ * \internal
+ * Merges the images added as QImage which have the same encoded contents,
+ * which encodes the images still waiting for it, and renumbers the media
+ * files. The files which are dropped get the index of the one they
+ * duplicate, so the drawings holding them still refer to the right part.
+ * The other files have already been deduplicated by addMediaFile().
+ */
+void Workbook::deduplicateMediaFiles()
+{
+    Q_D(Workbook);
+    QList<QSharedPointer<MediaFile>> unique;
+    QMultiHash<QByteArray, int> encodedImages;
+    QHash<qint64, int> imageIndex;
+    foreach (QSharedPointer<MediaFile> media, d->mediaFiles) {
+        if (!media->imageKey()) {
+            media->setIndex(unique.size());
+            unique.append(media);
+            continue;
+        }
+
+        const QByteArray key = media->hashKey();
+        int index = -1;
+        QMultiHash<QByteArray, int>::const_iterator it = encodedImages.constFind(key);
+        for (; it != encodedImages.constEnd() && it.key() == key; ++it) {
+            if (unique[it.value()]->contents() == media->contents()) {
+                index = it.value();
+                break;
+            }
+        }
+        if (index < 0) {
+            index = unique.size();
+            unique.append(media);
+            encodedImages.insert(key, index);
+        }
+        media->setIndex(index);
+        imageIndex.insert(media->imageKey(), index);
+    }
+
+    if (unique.size() == d->mediaFiles.size())
+        return;
+    d->mediaFiles = unique;
+    d->imageIndex = imageIndex;
+    d->mediaIndex.clear();
+    d->indexedMediaCount = 0;
 }
 
 /*!
@@ -705,6 +1560,16 @@ QList<QSharedPointer<Chart>> Workbook::chartFiles() const
     return d->chartFiles;
 }
 
+/*!
+ * \internal
+ * Returns the position of \a chart in chartFiles(), or -1.
+ */
+int Workbook::chartFileIndex(const Chart *chart) const
+{
+    Q_D(const Workbook);
+    return d->chartFileIndexes.value(chart, -1);
+}
+
 /*!
  * \internal
  */
@@ -712,8 +1577,10 @@ void Workbook::addChartFile(QSharedPointer<Chart> chart)
 {
     Q_D(Workbook);
 
-    if (!d->chartFiles.contains(chart))
+    if (!d->chartFileIndexes.contains(chart.data())) {
+        d->chartFileIndexes.insert(chart.data(), d->chartFiles.size());
         d->chartFiles.append(chart);
+    }
 }
 
 QT_END_NAMESPACE_XLSX
@@ -39,6 +39,7 @@ QT_BEGIN_NAMESPACE_XLSX
 class SharedStrings;
 class Styles;
 class Drawing;
+class Table;
 class Document;
 class Theme;
 class Relationships;
@@ -47,6 +48,28 @@ class MediaFile;
 class Chart;
 class Chartsheet;
 class Worksheet;
+class Format;
+class CellRange;
+
+struct StyleStatistics
+{
+    StyleStatistics()
+        : numberFormats(0)
+        , fonts(0)
+        , fills(0)
+        , borders(0)
+        , cellFormats(0)
+        , differentialFormats(0)
+    {
+    }
+
+    int numberFormats;
+    int fonts;
+    int fills;
+    int borders;
+    int cellFormats;
+    int differentialFormats;
+};
 
 class WorkbookPrivate;
 class Q_XLSX_EXPORT Workbook : public AbstractOOXmlFile
@@ -73,6 +96,8 @@ public:
     //    void addChart();
     bool defineName(const QString &name, const QString &formula, const QString &comment = QString(),
                     const QString &scope = QString());
+    CellRange definedNameRange(const QString &name, const QString &scope = QString(),
+                               QString *sheetName = 0) const;
     bool isDate1904() const;
     void setDate1904(bool date1904);
     bool isStringsToNumbersEnabled() const;
@@ -83,12 +108,24 @@ public:
     void setHtmlToRichStringEnabled(bool enable = true);
     QString defaultDateFormat() const;
     void setDefaultDateFormat(const QString &format);
+    bool isConcurrentWritesEnabled() const;
+    void setConcurrentWritesEnabled(bool enable = true);
+
+    int registerFormat(const Format &format);
+    Format registeredFormat(int styleId) const;
+    StyleStatistics styleStatistics() const;
+    bool compactStyles();
+    bool isCalculationEnabled() const;
+    void setCalculationEnabled(bool enable = true);
+    void recalculate();
 
     // internal used member
-    void addMediaFile(QSharedPointer<MediaFile> media, bool force = false);
+    QSharedPointer<MediaFile> addMediaFile(QSharedPointer<MediaFile> media, bool force = false);
     QList<QSharedPointer<MediaFile>> mediaFiles() const;
+    void deduplicateMediaFiles();
     void addChartFile(QSharedPointer<Chart> chartFile);
     QList<QSharedPointer<Chart>> chartFiles() const;
+    int chartFileIndex(const Chart *chart) const;
 
 private:
     friend class Worksheet;
@@ -96,19 +133,30 @@ private:
     friend class WorksheetPrivate;
     friend class Document;
     friend class DocumentPrivate;
+    friend class DocumentBatchPrivate;
+    friend class ConditionalFormattingEvaluator;
 
     Workbook(Workbook::CreateFlag flag);
+    Workbook *snapshot() const;
 
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
+    void saveToBinaryFile(QIODevice *device) const;
+    bool loadFromBinaryData(const QByteArray &data);
 
     SharedStrings *sharedStrings() const;
     Styles *styles();
     Theme *theme();
     QList<QImage> images();
     QList<Drawing *> drawings();
+    int drawingIndex(const Drawing *drawing);
+    QList<Table *> tables();
+    int tableIndex(const Table *table);
+    QList<Worksheet *> commentedSheets();
+    int commentsIndex(const Worksheet *sheet);
     QList<QSharedPointer<AbstractSheet>> getSheetsByTypes(AbstractSheet::SheetType type) const;
     QStringList worksheetNames() const;
+    int sheetIndex(const QString &name) const;
     AbstractSheet *addSheet(const QString &name, int sheetId,
                             AbstractSheet::SheetType type = AbstractSheet::ST_WorkSheet);
 };
@@ -41,13 +41,21 @@
 #include "xlsxtheme_p.h"
 #include "xlsxsimpleooxmlfile_p.h"
 #include "xlsxrelationships_p.h"
+#include "xlsxcellrange.h"
+#include "xlsxloadfilter.h"
 
+#include <QScopedPointer>
 #include <QSharedPointer>
+#include <QMultiHash>
 #include <QPair>
+#include <QSet>
 #include <QStringList>
 
 namespace QXlsx {
 
+class ZipReader;
+class SheetLoader;
+
 struct XlsxDefineNameData
 {
     XlsxDefineNameData()
@@ -67,6 +75,10 @@ struct XlsxDefineNameData
     QString comment;
     // using internal sheetId, instead of the localSheetId(order in the workbook)
     int sheetId;
+    // The formula parsed when it's a single range, rangeSheet being empty
+    // when the range is on the sheet of the scope
+    QString rangeSheet;
+    CellRange range;
 };
 
 class WorkbookPrivate : public AbstractOOXmlFilePrivate
@@ -74,20 +86,67 @@ class WorkbookPrivate : public AbstractOOXmlFilePrivate
     Q_DECLARE_PUBLIC(Workbook)
 public:
     WorkbookPrivate(Workbook *q, Workbook::CreateFlag flag);
+    ~WorkbookPrivate();
+
+    void setLazyPackage(const QSharedPointer<ZipReader> &zipReader);
+    SheetLoader *loadSheetsInBackground(const QString &packageName);
+    void loadSheet(AbstractSheet *sheet);
+    void loadAllSheets();
+    void loadDrawings();
+    bool compact();
+    void releaseLazyPackage();
+    void enforceMemoryBudget(Worksheet *current, int row);
+    void reindexSheets(int from);
+    void indexDefinedName(int index);
+    const XlsxDefineNameData *definedName(const QString &name, int sheetId) const;
 
     QSharedPointer<SharedStrings> sharedStrings;
     QList<QSharedPointer<AbstractSheet>> sheets;
     QList<QSharedPointer<SimpleOOXmlFile>> externalLinks;
     QStringList sheetNames;
+    // Positions of the sheets by their name, kept in step with sheetNames
+    QHash<QString, int> sheetIndexes;
+    // The sheets of each type, built by getSheetsByTypes() and dropped when
+    // the sheets change
+    mutable QHash<int, QList<QSharedPointer<AbstractSheet>>> sheetsByType;
     QSharedPointer<Styles> styles;
     QSharedPointer<Theme> theme;
     QList<QSharedPointer<MediaFile>> mediaFiles;
+    // Media files by hashKey(), for deduplication. Only the first
+    // indexedMediaCount files are in the index, without the images
+    // which were still being encoded.
+    QMultiHash<QByteArray, int> mediaIndex;
+    int indexedMediaCount;
+    // Media files by MediaFile::imageKey(), for the images added as QImage
+    QHash<qint64, int> imageIndex;
     QList<QSharedPointer<Chart>> chartFiles;
+    QHash<const Chart *, int> chartFileIndexes;
+    // Positions of the drawings, only set while the package is saved
+    QHash<const Drawing *, int> savedDrawingIndexes;
+    // Positions of the tables, only set while the package is saved
+    QHash<const Table *, int> savedTableIndexes;
+    // Positions of the worksheets with comments, only set while the package is saved
+    QHash<const Worksheet *, int> savedCommentIndexes;
     QList<XlsxDefineNameData> definedNamesList;
+    // Positions of the defined names by their lower case name and sheetId,
+    // the last definition of a name winning
+    QHash<QPair<QString, int>, int> definedNameIndex;
+
+    // Package and sheets not loaded yet, used by the lazy load mode
+    QSharedPointer<ZipReader> lazyPackage;
+    QSet<AbstractSheet *> lazySheets;
+    int lazyStringSlots; // shared strings held until all the sheets are loaded
+    // Parses the lazy sheets on a worker thread, for Document::openAsync()
+    QScopedPointer<SheetLoader> sheetLoader;
 
     bool strings_to_numbers_enabled;
     bool strings_to_hyperlinks_enabled;
     bool html_to_richstring_enabled;
+    bool concurrent_writes_enabled;
+    qint64 memoryBudget; // bytes the cells may take, 0 when there is no budget
+    bool rowBlockLoad; // Document::RowBlockLoad
+    LoadFilter loadFilter; // of the document, applied to the sheets as they are loaded
+    bool calculation_enabled;
     bool date1904;
     QString defaultDateFormat;
 
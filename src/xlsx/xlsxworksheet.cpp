@@ -26,6 +26,9 @@
 #include "xlsxcellreference.h"
 #include "xlsxworksheet.h"
 #include "xlsxworksheet_p.h"
+#include "xlsxbiff12_p.h"
+#include "xlsxcsv_p.h"
+#include "xlsxnumformatter_p.h"
 #include "xlsxworkbook.h"
 #include "xlsxformat.h"
 #include "xlsxformat_p.h"
@@ -36,11 +39,24 @@
 #include "xlsxcell.h"
 #include "xlsxcell_p.h"
 #include "xlsxcellrange.h"
+#include "xlsxcellrangeset_p.h"
 #include "xlsxconditionalformatting_p.h"
+#include "xlsxdatavalidation_p.h"
 #include "xlsxdrawinganchor_p.h"
 #include "xlsxchart.h"
 #include "xlsxcellformula.h"
 #include "xlsxcellformula_p.h"
+#include "xlsxsheetdatawriter_p.h"
+#include "xlsxxmlpullparser_p.h"
+#include "xlsxrowwriter.h"
+#include "xlsxformulaengine_p.h"
+#include "xlsxconditionalformattingevaluator_p.h"
+#include "xlsxdatavalidationchecker_p.h"
+#include "xlsxpixelaxis_p.h"
+#include "xlsxtextmeter_p.h"
+#include "xlsxprogressmonitor.h"
+#include "xlsxstatistics_p.h"
+#include "xlsxzipwriter_p.h"
 
 #include <QVariant>
 #include <QDateTime>
@@ -50,17 +66,32 @@
 #include <QRegularExpression>
 #include <QDebug>
 #include <QBuffer>
+#include <QImageReader>
+#include <QBitArray>
+#include <QSet>
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
 #include <QTextDocument>
 #include <QDir>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 
+#include <algorithm>
 #include <math.h>
+#include <string.h>
 
 QT_BEGIN_NAMESPACE_XLSX
 
+// Blocks of rows kept in memory by the sheets loaded with Document::RowBlockLoad
+static const int RowBlockCacheSize = 16;
+// Expanded shared formulas kept by a sheet for read()
+static const int MaxSharedFormulaTexts = 256 * 1024;
+
 WorksheetPrivate::WorksheetPrivate(Worksheet *p, Worksheet::CreateFlag flag)
     : AbstractSheetPrivate(p, flag)
+    , removedMerges(0)
     , windowProtection(false)
     , showFormulas(false)
     , showGridLines(true)
@@ -72,6 +103,16 @@ WorksheetPrivate::WorksheetPrivate(Worksheet *p, Worksheet::CreateFlag flag)
     , showOutlineSymbols(true)
     , showWhiteSpace(true)
     , urlPattern(QStringLiteral("^([fh]tt?ps?://)|(mailto:)|(file://)"))
+    , stringStorage(Worksheet::SharedStringStorage)
+    , constantMemory(false)
+    , streamFlushedRow(0)
+    , streamError(false)
+    , checkedCellMemory(0)
+    , deferSstRefs(false)
+    , progressMonitor(0)
+    , incrementalSave(false)
+    , savedBlockLastString(-1)
+    , savedBlockHasFormula(false)
 {
     previous_row = 0;
 
@@ -84,6 +125,19 @@ WorksheetPrivate::WorksheetPrivate(Worksheet *p, Worksheet::CreateFlag flag)
 
 WorksheetPrivate::~WorksheetPrivate()
 {
+    qDeleteAll(rowWriters);
+}
+
+static void mergeSpan(QMap<int, QPair<int, int>> &spans, int block, int firstColumn,
+                      int lastColumn)
+{
+    QMap<int, QPair<int, int>>::iterator it = spans.find(block);
+    if (it == spans.end()) {
+        spans.insert(block, qMakePair(firstColumn, lastColumn));
+    } else {
+        it.value().first = qMin(it.value().first, firstColumn);
+        it.value().second = qMax(it.value().second, lastColumn);
+    }
 }
 
 /*
@@ -91,54 +145,31 @@ WorksheetPrivate::~WorksheetPrivate()
   XLSX optimisation and isn't strictly required. However, it
   makes comparing files easier. The span is the same for each
   block of 16 rows.
+
+  The cell table keeps the first and the last column of each row, and the
+  comments of a row are sorted by column, so no cell is looked at, and
+  the spilled rows are not read back.
  */
 void WorksheetPrivate::calculateSpans() const
 {
     row_spans.clear();
-    int span_min = XLSX_COLUMN_MAX + 1;
-    int span_max = -1;
-
-    for (int row_num = dimension.firstRow(); row_num <= dimension.lastRow(); row_num++) {
-        if (cellTable.contains(row_num)) {
-            for (int col_num = dimension.firstColumn(); col_num <= dimension.lastColumn();
-                 col_num++) {
-                if (cellTable[row_num].contains(col_num)) {
-                    if (span_max == -1) {
-                        span_min = col_num;
-                        span_max = col_num;
-                    } else {
-                        if (col_num < span_min)
-                            span_min = col_num;
-                        else if (col_num > span_max)
-                            span_max = col_num;
-                    }
-                }
-            }
-        }
-        if (comments.contains(row_num)) {
-            for (int col_num = dimension.firstColumn(); col_num <= dimension.lastColumn();
-                 col_num++) {
-                if (comments[row_num].contains(col_num)) {
-                    if (span_max == -1) {
-                        span_min = col_num;
-                        span_max = col_num;
-                    } else {
-                        if (col_num < span_min)
-                            span_min = col_num;
-                        else if (col_num > span_max)
-                            span_max = col_num;
-                    }
-                }
-            }
-        }
+    QMap<int, QPair<int, int>> spans;
 
-        if (row_num % 16 == 0 || row_num == dimension.lastRow()) {
-            if (span_max != -1) {
-                row_spans[row_num / 16] = QStringLiteral("%1:%2").arg(span_min).arg(span_max);
-                span_min = XLSX_COLUMN_MAX + 1;
-                span_max = -1;
-            }
-        }
+    for (int i = 0; i < cellTable.size(); ++i) {
+        const ColumnSpan &span = cellTable.rowSpanAt(i);
+        mergeSpan(spans, (cellTable.rowNumberAt(i) - 1) / 16, span.first, span.last);
+    }
+
+    QMap<int, QMap<int, QString>>::const_iterator it;
+    for (it = comments.constBegin(); it != comments.constEnd(); ++it) {
+        if (!it.value().isEmpty())
+            mergeSpan(spans, (it.key() - 1) / 16, it.value().firstKey(), it.value().lastKey());
+    }
+
+    QMap<int, QPair<int, int>>::const_iterator spanIt;
+    for (spanIt = spans.constBegin(); spanIt != spans.constEnd(); ++spanIt) {
+        row_spans[spanIt.key()] =
+            QStringLiteral("%1:%2").arg(spanIt.value().first).arg(spanIt.value().second);
     }
 }
 
@@ -165,6 +196,15 @@ int WorksheetPrivate::checkDimensions(int row, int col, bool ignore_row, bool ig
     if (row > XLSX_ROW_MAX || row < 1 || col > XLSX_COLUMN_MAX || col < 1)
         return -1;
 
+    if (constantMemory && !ignore_row) {
+        // Rows already written to the stream can not be changed any more.
+        if (row <= streamFlushedRow)
+            return -1;
+        flushStreamRows(row);
+    } else if (!ignore_row && workbook && workbook->d_func()->memoryBudget > 0) {
+        checkMemoryBudget(row);
+    }
+
     if (!ignore_row) {
         if (row < dimension.firstRow() || dimension.firstRow() == -1)
             dimension.setFirstRow(row);
@@ -207,37 +247,116 @@ Worksheet *Worksheet::copy(const QString &distName, int distId) const
 {
     Q_D(const Worksheet);
     Worksheet *sheet = new Worksheet(distName, distId, d->workbook, F_NewFromScratch);
-    WorksheetPrivate *sheet_d = sheet->d_func();
-
-    sheet_d->dimension = d->dimension;
+    d->copyContents(sheet->d_func());
+
+    // The copy holds its own references to the shared strings of its cells.
+    SharedStrings *sst = d->workbook->sharedStrings();
+    QVector<int> sstRefs(sst->slotCount(), 0);
+    for (int i = 0; i < d->cellTable.size(); ++i) {
+        const CellRow &cells = d->cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const CellData &cell = cells.cells[j];
+            int sstIndex = -1;
+            if (cell.storage == CellData::SharedString)
+                sstIndex = cell.index;
+            else if (cell.storage == CellData::Extra)
+                sstIndex = d->cellTable.extra(cell.index).sharedStringIndex;
+            if (sstIndex >= 0 && sstIndex < sstRefs.size())
+                ++sstRefs[sstIndex];
+        }
+    }
+    for (int idx = 0; idx < sstRefs.size(); ++idx) {
+        if (sstRefs[idx])
+            sst->incRefByStringIndex(idx, sstRefs[idx]);
+    }
 
-    QMapIterator<int, QMap<int, QSharedPointer<Cell>>> it(d->cellTable);
-    while (it.hasNext()) {
-        it.next();
-        int row = it.key();
-        QMapIterator<int, QSharedPointer<Cell>> it2(it.value());
-        while (it2.hasNext()) {
-            it2.next();
-            int col = it2.key();
+    return sheet;
+}
 
-            QSharedPointer<Cell> cell(new Cell(it2.value().data()));
-            cell->d_ptr->parent = sheet;
+/*!
+ * \internal
+ *
+ * Make a copy of this sheet in \a workbook, a snapshot of the workbook of
+ * this sheet whose shared strings and styles have the same indexes, to be
+ * saved while this sheet keeps changing. The drawing is shared with this
+ * sheet, as are the comments and the hyperlinks, which are only replaced
+ * when they change.
+ */
+Worksheet *Worksheet::snapshot(Workbook *workbook) const
+{
+    Q_D(const Worksheet);
+    Worksheet *sheet = new Worksheet(d->name, d->id, workbook, F_NewFromScratch);
+    WorksheetPrivate *sheet_d = sheet->d_func();
+    d->copyContents(sheet_d);
 
-            if (cell->cellType() == Cell::SharedStringType)
-                d->workbook->sharedStrings()->addSharedString(cell->d_ptr->richString);
+    sheet_d->sheetState = d->sheetState;
+    sheet_d->drawing = d->drawing;
+    sheet_d->comments = d->comments;
+    sheet_d->urlTable = d->urlTable;
+    sheet_d->tabSelected = d->tabSelected;
+    return sheet;
+}
 
-            sheet_d->cellTable[row][col] = cell;
-        }
+/*
+  Copy the cells and the settings of the sheet to \a other, a new sheet. The
+  cells are implicitly shared, the references to the shared strings are
+  left to the caller.
+ */
+void WorksheetPrivate::copyContents(WorksheetPrivate *other) const
+{
+    other->dimension = dimension;
+
+    // The vectors of the cell table are implicitly shared, so the cells are
+    // only copied when one of the sheets changes them, and then row by row.
+    other->cellTable = cellTable;
+    other->inlineFonts = inlineFonts;
+    other->inlineFontXml = inlineFontXml;
+    other->inlineFontIds = inlineFontIds;
+
+    other->merges = merges;
+    other->mergeIndex = mergeIndex;
+    other->removedMerges = removedMerges;
+
+    // The infos are shared pointers which get modified in place, so each
+    // sheet needs its own ones.
+    QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator rowIt = rowsInfo.constBegin();
+    for (; rowIt != rowsInfo.constEnd(); ++rowIt) {
+        other->rowsInfo.insert(rowIt.key(),
+                               QSharedPointer<XlsxRowInfo>(new XlsxRowInfo(*rowIt.value())));
+    }
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::const_iterator colIt = colsInfo.constBegin();
+    for (; colIt != colsInfo.constEnd(); ++colIt) {
+        other->colsInfo.insert(
+            colIt.key(), QSharedPointer<XlsxColumnInfo>(new XlsxColumnInfo(*colIt.value())));
     }
 
-    sheet_d->merges = d->merges;
-    //    sheet_d->rowsInfo = d->rowsInfo;
-    //    sheet_d->colsInfo = d->colsInfo;
-    //    sheet_d->colsInfoHelper = d->colsInfoHelper;
-    //    sheet_d->dataValidationsList = d->dataValidationsList;
-    //    sheet_d->conditionalFormattingList = d->conditionalFormattingList;
-
-    return sheet;
+    other->dataValidationsList = dataValidationsList;
+    other->dataValidationKeys = dataValidationKeys;
+    other->dataValidationIndex = dataValidationIndex;
+    other->conditionalFormattingList = conditionalFormattingList;
+    other->conditionalFormattingKeys = conditionalFormattingKeys;
+    other->conditionalFormattingIndex = conditionalFormattingIndex;
+    other->sharedFormulaMap = sharedFormulaMap;
+    other->autoFilterRange = autoFilterRange;
+    other->autoFilterColumns = autoFilterColumns;
+
+    other->outline_row_level = outline_row_level;
+    other->outline_col_level = outline_col_level;
+    other->default_row_height = default_row_height;
+    other->default_row_zeroed = default_row_zeroed;
+    other->sheetFormatProps = sheetFormatProps;
+
+    other->windowProtection = windowProtection;
+    other->showFormulas = showFormulas;
+    other->showGridLines = showGridLines;
+    other->showRowColHeaders = showRowColHeaders;
+    other->showZeros = showZeros;
+    other->rightToLeft = rightToLeft;
+    other->showRuler = showRuler;
+    other->showOutlineSymbols = showOutlineSymbols;
+    other->showWhiteSpace = showWhiteSpace;
+    other->stringStorage = stringStorage;
+    other->commentAuthor = commentAuthor;
 }
 
 /*!
@@ -262,6 +381,7 @@ bool Worksheet::isWindowProtected() const
 void Worksheet::setWindowProtected(bool protect)
 {
     Q_D(Worksheet);
+    setDirty();
     d->windowProtection = protect;
 }
 
@@ -280,6 +400,7 @@ bool Worksheet::isFormulasVisible() const
 void Worksheet::setFormulasVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showFormulas = visible;
 }
 
@@ -298,6 +419,7 @@ bool Worksheet::isGridLinesVisible() const
 void Worksheet::setGridLinesVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showGridLines = visible;
 }
 
@@ -316,6 +438,7 @@ bool Worksheet::isRowColumnHeadersVisible() const
 void Worksheet::setRowColumnHeadersVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showRowColHeaders = visible;
 }
 
@@ -334,6 +457,7 @@ bool Worksheet::isRightToLeft() const
 void Worksheet::setRightToLeft(bool enable)
 {
     Q_D(Worksheet);
+    setDirty();
     d->rightToLeft = enable;
 }
 
@@ -352,6 +476,7 @@ bool Worksheet::isZerosVisible() const
 void Worksheet::setZerosVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showZeros = visible;
 }
 
@@ -370,6 +495,7 @@ bool Worksheet::isSelected() const
 void Worksheet::setSelected(bool select)
 {
     Q_D(Worksheet);
+    setDirty();
     d->tabSelected = select;
 }
 
@@ -388,6 +514,7 @@ bool Worksheet::isRulerVisible() const
 void Worksheet::setRulerVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showRuler = visible;
 }
 
@@ -406,6 +533,7 @@ bool Worksheet::isOutlineSymbolsVisible() const
 void Worksheet::setOutlineSymbolsVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showOutlineSymbols = visible;
 }
 
@@ -424,9 +552,20 @@ bool Worksheet::isWhiteSpaceVisible() const
 void Worksheet::setWhiteSpaceVisible(bool visible)
 {
     Q_D(Worksheet);
+    setDirty();
     d->showWhiteSpace = visible;
 }
 
+/*!
+    \enum Worksheet::WriteOption
+
+    \value DefaultWriteOptions Strings starting with "=" are written as
+           formulas, and urls as hyperlinks if
+           Workbook::isStringsToHyperlinksEnabled() is true.
+    \value RawWrite Strings are always written as plain strings, which
+           skips the checks made for every string.
+ */
+
 /*!
  * Write \a value to cell (\a row, \a column) with the \a format.
  * Both \a row and \a column are all 1-indexed value.
@@ -434,6 +573,19 @@ void Worksheet::setWhiteSpaceVisible(bool visible)
  * Returns true on success.
  */
 bool Worksheet::write(int row, int column, const QVariant &value, const Format &format)
+{
+    return write(row, column, value, format, DefaultWriteOptions);
+}
+
+/*!
+ * \overload
+ * Write \a value to cell (\a row, \a column) with the \a format and
+ * the write \a options.
+ *
+ * Returns true on success.
+ */
+bool Worksheet::write(int row, int column, const QVariant &value, const Format &format,
+                      WriteOptions options)
 {
     Q_D(Worksheet);
 
@@ -449,10 +601,12 @@ bool Worksheet::write(int row, int column, const QVariant &value, const Format &
         QString token = value.toString();
         bool ok;
 
-        if (token.startsWith(QLatin1String("="))) {
+        if (options & RawWrite) {
+            d->setPlainString(row, column, token, format);
+        } else if (token.startsWith(QLatin1String("="))) {
             // convert to formula
             ret = writeFormula(row, column, CellFormula(token), format);
-        } else if (d->workbook->isStringsToHyperlinksEnabled() && token.contains(d->urlPattern)) {
+        } else if (d->workbook->isStringsToHyperlinksEnabled() && d->isUrl(token)) {
             // convert to url
             ret = writeHyperlink(row, column, QUrl(token));
         } else if (d->workbook->isStringsToNumbersEnabled() && (value.toDouble(&ok), ok)) {
@@ -506,6 +660,63 @@ bool Worksheet::write(const CellReference &row_column, const QVariant &value, co
     return write(row_column.row(), row_column.column(), value, format);
 }
 
+/*!
+ * \overload
+ * Write \a value to cell \a row_column with the \a format and the write
+ * \a options.
+ * Returns true on success.
+ */
+bool Worksheet::write(const CellReference &row_column, const QVariant &value, const Format &format,
+                      WriteOptions options)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return write(row_column.row(), row_column.column(), value, format, options);
+}
+
+/*!
+ * \overload
+ * Write \a value to cell (\a row, \a column) with the style \a styleId,
+ * which has been returned by Workbook::registerFormat(). Numbers, booleans
+ * and plain strings are stored without any format lookup.
+ *
+ * Returns true on success.
+ */
+bool Worksheet::write(int row, int column, const QVariant &value, int styleId)
+{
+    Q_D(Worksheet);
+
+    if (!d->workbook->styles()->isValidStyleId(styleId)) {
+        qDebug("Unknown style id %d", styleId);
+        return false;
+    }
+    if (d->checkDimensions(row, column))
+        return false;
+
+    CellData cell;
+    if (value.isNull())
+        cell = CellData(CellData::Blank, Cell::NumberType, styleId);
+    else if (!d->batchVariantCell(value, styleId, &cell))
+        return write(row, column, value, d->workbook->styles()->xfFormat(styleId));
+
+    d->setCell(row, column, cell);
+    return true;
+}
+
+/*!
+ * \overload
+ * Write \a value to cell \a row_column with the style \a styleId.
+ * Returns true on success.
+ */
+bool Worksheet::write(const CellReference &row_column, const QVariant &value, int styleId)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return write(row_column.row(), row_column.column(), value, styleId);
+}
+
 /*!
     \overload
     Return the contents of the cell \a row_column.
@@ -525,246 +736,1528 @@ QVariant Worksheet::read(int row, int column) const
 {
     Q_D(const Worksheet);
 
-    Cell *cell = cellAt(row, column);
+    d->cellTable.trimRestoredBlocks();
+    const CellData *cell = d->cellTable.cell(row, column);
     if (!cell)
         return QVariant();
 
-    if (cell->hasFormula()) {
-        if (cell->formula().formulaType() == CellFormula::NormalType) {
-            return QVariant(QLatin1String("=") + cell->formula().formulaText());
-        } else if (cell->formula().formulaType() == CellFormula::SharedType) {
-            if (!cell->formula().formulaText().isEmpty()) {
-                return QVariant(QLatin1String("=") + cell->formula().formulaText());
+    if (cell->storage == CellData::Extra && d->cellTable.extra(cell->index).formula.isValid()) {
+        const CellFormula &formula = d->cellTable.extra(cell->index).formula;
+        if (formula.formulaType() == CellFormula::NormalType) {
+            return QVariant(QLatin1String("=") + formula.formulaText());
+        } else if (formula.formulaType() == CellFormula::SharedType) {
+            if (!formula.formulaText().isEmpty()) {
+                return QVariant(QLatin1String("=") + formula.formulaText());
             } else {
-                const CellFormula &rootFormula = d->sharedFormulaMap[cell->formula().sharedIndex()];
-                CellReference rootCellRef = rootFormula.reference().topLeft();
-                QString rootFormulaText = rootFormula.formulaText();
-                QString newFormulaText =
-                    convertSharedFormula(rootFormulaText, rootCellRef, CellReference(row, column));
-                return QVariant(QLatin1String("=") + newFormulaText);
+                return QVariant(d->sharedFormulaText(row, column, formula.sharedIndex()));
             }
         }
     }
 
-    if (cell->isDateTime()) {
-        double val = cell->value().toDouble();
-        QDateTime dt = cell->dateTime();
-        if (val < 1)
-            return dt.time();
-        if (fmod(val, 1.0) < 1.0 / (1000 * 60 * 60 * 24)) // integer
-            return dt.date();
-        return dt;
+    QVariant value = d->cellValue(*cell);
+    if (cell->cellType == Cell::NumberType && cell->xfIndex != -1) {
+        double val = value.toDouble();
+        if (val >= 0 && d->cellFormat(*cell).isDateTimeFormat()) {
+            QDateTime dt = datetimeFromNumber(val, d->workbook->isDate1904());
+            if (val < 1)
+                return dt.time();
+            if (fmod(val, 1.0) < 1.0 / (1000 * 60 * 60 * 24)) // integer
+                return dt.date();
+            return dt;
+        }
     }
 
-    return cell->value();
+    return value;
 }
 
 /*!
- * Returns the cell at the given \a row_column. If there
- * is no cell at the specified position, the function returns 0.
+    \overload
+    Returns the text of the cell \a row_column as Excel shows it.
  */
-Cell *Worksheet::cellAt(const CellReference &row_column) const
+QString Worksheet::displayText(const CellReference &row_column) const
 {
     if (!row_column.isValid())
-        return 0;
+        return QString();
 
-    return cellAt(row_column.row(), row_column.column());
+    return displayText(row_column.row(), row_column.column());
 }
 
 /*!
- * Returns the cell at the given \a row and \a column. If there
- * is no cell at the specified position, the function returns 0.
+    Returns the text of the cell (\a row, \a column) as Excel shows it:
+    the numbers and the dates in the number format of the cell, the
+    booleans as TRUE or FALSE, and the strings through the text section
+    of the format. The formulas show their cached results, and an empty
+    string is returned for an empty cell.
+
+    Each number format is compiled once, the first time it is used.
+
+    \sa read()
  */
-Cell *Worksheet::cellAt(int row, int column) const
+QString Worksheet::displayText(int row, int column) const
 {
     Q_D(const Worksheet);
-    if (!d->cellTable.contains(row))
-        return 0;
-    if (!d->cellTable[row].contains(column))
-        return 0;
 
-    return d->cellTable[row][column].data();
+    d->cellTable.trimRestoredBlocks();
+    const CellData *cell = d->cellTable.cell(row, column);
+    return cell ? d->displayText(*cell) : QString();
 }
 
-Format WorksheetPrivate::cellFormat(int row, int col) const
+QString WorksheetPrivate::displayText(const CellData &cell) const
 {
-    if (!cellTable.contains(row))
-        return Format();
-    if (!cellTable[row].contains(col))
-        return Format();
-    return cellTable[row][col]->format();
+    const int numFmtId = cell.xfIndex == -1 ? 0 : cellFormat(cell).numberFormatIndex();
+    double number;
+    if (cellNumber(cell, &number)) {
+        return workbook->styles()->numFormatter(numFmtId)->format(number,
+                                                                  workbook->isDate1904());
+    }
+    if (cell.type() == Cell::BooleanType)
+        return cellValue(cell).toBool() ? QStringLiteral("TRUE") : QStringLiteral("FALSE");
+
+    const QVariant value = cellValue(cell);
+    if (!value.isValid())
+        return QString();
+    if (cell.type() == Cell::ErrorType)
+        return value.toString();
+    return workbook->styles()->numFormatter(numFmtId)->formatText(value.toString());
 }
 
 /*!
-  \overload
-  Write string \a value to the cell \a row_column with the \a format.
+    Reads the numbers stored in \a column from \a firstRow to \a lastRow
+    into \a values, one for each row. Cells that do not hold a number,
+    including empty ones, are read as 0. If \a valid is given, its bits tell
+    which values come from a number.
 
-  Returns true on success.
+    Dates are read as their serial numbers, and formulas as their cached
+    results. Returns false if the rows or the column are invalid.
+
+    \sa readRange()
  */
-bool Worksheet::writeString(const CellReference &row_column, const RichString &value,
-                            const Format &format)
+bool Worksheet::readColumn(int column, int firstRow, int lastRow, QVector<double> *values,
+                           QBitArray *valid) const
 {
-    if (!row_column.isValid())
-        return false;
-
-    return writeString(row_column.row(), row_column.column(), value, format);
+    return readRange(CellRange(firstRow, column, lastRow, column), values, valid);
 }
 
 /*!
-  Write string \a value to the cell (\a row, \a column) with the \a format.
-  Returns true on success.
-*/
-bool Worksheet::writeString(int row, int column, const RichString &value, const Format &format)
+    \overload
+    Reads the date times stored in \a column from \a firstRow to \a lastRow
+    into \a values, one for each row. Every number is converted as a date
+    time serial number, whatever the format of its cell. Cells that do not
+    hold a number give an invalid QDateTime, and the bits of \a valid are
+    cleared for them.
+ */
+bool Worksheet::readColumn(int column, int firstRow, int lastRow, QVector<QDateTime> *values,
+                           QBitArray *valid) const
 {
-    Q_D(Worksheet);
-    //    QString content = value.toPlainString();
-    if (d->checkDimensions(row, column))
+    Q_D(const Worksheet);
+    if (!values)
         return false;
 
-    //    if (content.size() > d->xls_strmax) {
-    //        content = content.left(d->xls_strmax);
-    //        error = -2;
-    //    }
+    QVector<double> numbers;
+    QBitArray numberBits;
+    if (!readColumn(column, firstRow, lastRow, &numbers, &numberBits))
+        return false;
 
-    d->sharedStrings()->addSharedString(value);
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    if (value.fragmentCount() == 1 && value.fragmentFormat(0).isValid())
-        fmt.mergeFormat(value.fragmentFormat(0));
-    d->workbook->styles()->addXfFormat(fmt);
-    QSharedPointer<Cell> cell =
-        QSharedPointer<Cell>(new Cell(value.toPlainString(), Cell::SharedStringType, fmt, this));
-    cell->d_ptr->richString = value;
-    d->cellTable[row][column] = cell;
+    const bool date1904 = d->workbook->isDate1904();
+    values->fill(QDateTime(), numbers.size());
+    QDateTime *dt = values->data();
+    for (int i = 0; i < numbers.size(); ++i) {
+        if (numberBits.testBit(i) && numbers[i] >= 0)
+            dt[i] = datetimeFromNumber(numbers[i], date1904);
+        else
+            numberBits.clearBit(i);
+    }
+    if (valid)
+        *valid = numberBits;
     return true;
 }
 
 /*!
-    \overload
-    Write string \a value to the cell \a row_column with the \a format.
+    Reads the numbers stored in \a range into \a values, row by row, so that
+    the value of the cell (row, column) is at
+    (row - firstRow) * columnCount + (column - firstColumn). Cells that do
+    not hold a number are read as 0. If \a valid is given, its bits tell
+    which values come from a number.
+
+    Only stored cells are visited, so sparse ranges are read quickly.
+    Returns false if \a range is invalid.
+
+    \sa readColumn()
  */
-bool Worksheet::writeString(const CellReference &row_column, const QString &value,
-                            const Format &format)
+bool Worksheet::readRange(const CellRange &range, QVector<double> *values, QBitArray *valid) const
 {
-    if (!row_column.isValid())
+    Q_D(const Worksheet);
+    if (!values || !range.isValid() || range.firstRow() < 1 || range.firstColumn() < 1
+        || range.lastRow() > XLSX_ROW_MAX || range.lastColumn() > XLSX_COLUMN_MAX)
         return false;
 
-    return writeString(row_column.row(), row_column.column(), value, format);
+    const int size = range.rowCount() * range.columnCount();
+    values->fill(0, size);
+    if (valid)
+        valid->fill(false, size);
+    d->readNumbers(range, values->data(), valid);
+    return true;
 }
 
 /*!
-    \overload
+    Returns the value of the cell (\a row, \a column) as it is stored,
+    without building a QVariant and without looking at its format. Dates
+    and times are returned as numbers.
 
-    Write string \a value to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
-*/
-bool Worksheet::writeString(int row, int column, const QString &value, const Format &format)
+    \sa read(), sharedString(), RawRowIterator
+ */
+RawCellValue Worksheet::readRaw(int row, int column) const
 {
-    Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
-        return false;
-
-    RichString rs;
-    if (d->workbook->isHtmlToRichStringEnabled() && Qt::mightBeRichText(value))
-        rs.setHtml(value);
-    else
-        rs.addFragment(value, Format());
-
-    return writeString(row, column, rs, format);
+    Q_D(const Worksheet);
+    d->cellTable.trimRestoredBlocks();
+    const CellData *cell = d->cellTable.cell(row, column);
+    if (!cell)
+        return RawCellValue();
+    return d->rawValue(*cell);
 }
 
 /*!
-    \overload
-    Write string \a value to the cell \a row_column with the \a format
+    Returns the text of the shared string \a index, as found in a
+    RawCellValue, without its rich text formatting.
  */
-bool Worksheet::writeInlineString(const CellReference &row_column, const QString &value,
-                                  const Format &format)
+QString Worksheet::sharedString(int index) const
 {
-    if (!row_column.isValid())
-        return false;
-
-    return writeInlineString(row_column.row(), row_column.column(), value, format);
+    Q_D(const Worksheet);
+    return d->sharedStrings()->getSharedPlainString(index);
 }
 
 /*!
-    Write string \a value to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
-*/
-bool Worksheet::writeInlineString(int row, int column, const QString &value, const Format &format)
-{
-    Q_D(Worksheet);
-    // int error = 0;
-    QString content = value;
-    if (d->checkDimensions(row, column))
-        return false;
+    Returns the first cell of \a range, row by row, whose value is \a value,
+    or an invalid reference if there is none. The whole sheet is searched
+    if \a range is not valid.
 
-    if (value.size() > XLSX_STRING_MAX) {
-        content = value.left(XLSX_STRING_MAX);
-        // error = -2;
-    }
+    Strings are compared case sensitively with the text of the cells,
+    numbers, dates and times with the numbers stored, and booleans with
+    the booleans; the values of the formulas are searched too. The columns
+    are indexed the first time they are searched, each lookup then only
+    goes through the cells which hold the value.
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    d->workbook->styles()->addXfFormat(fmt);
-    d->cellTable[row][column] =
-        QSharedPointer<Cell>(new Cell(value, Cell::InlineStringType, fmt, this));
-    return true;
+    \sa findAll(), replaceAll()
+ */
+CellReference Worksheet::find(const QVariant &value, const CellRange &range) const
+{
+    Q_D(const Worksheet);
+    const QList<CellReference> cells = d->findCells(value, range, true);
+    return cells.isEmpty() ? CellReference() : cells.first();
 }
 
 /*!
-    \overload
-    Write numeric \a value to the cell \a row_column with the \a format.
-    Returns true on success.
+    Returns the cells of \a range whose value is \a value, row by row. The
+    whole sheet is searched if \a range is not valid.
+
+    \sa find(), replaceAll()
  */
-bool Worksheet::writeNumeric(const CellReference &row_column, double value, const Format &format)
+QList<CellReference> Worksheet::findAll(const QVariant &value, const CellRange &range) const
 {
-    if (!row_column.isValid())
-        return false;
-
-    return writeNumeric(row_column.row(), row_column.column(), value, format);
+    Q_D(const Worksheet);
+    return d->findCells(value, range, false);
 }
 
 /*!
-    Write numeric \a value to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
-*/
-bool Worksheet::writeNumeric(int row, int column, double value, const Format &format)
+    Write \a after to the cells of \a range whose value is \a before, the
+    cells keeping their formats. The whole sheet is searched if \a range is
+    not valid. The formulas are left as they are, even when their values
+    match.
+
+    Returns the number of cells replaced.
+
+    \sa find(), findAll()
+ */
+int Worksheet::replaceAll(const QVariant &before, const QVariant &after, const CellRange &range)
 {
     Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
-        return false;
-
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    d->workbook->styles()->addXfFormat(fmt);
-    d->cellTable[row][column] = QSharedPointer<Cell>(new Cell(value, Cell::NumberType, fmt, this));
-    return true;
+    int replaced = 0;
+    foreach (const CellReference &cell, d->findCells(before, range, false)) {
+        const CellData *data = d->cellTable.cell(cell.row(), cell.column());
+        if (data && data->storage == CellData::Extra
+            && d->cellTable.extra(data->index).formula.isValid()) {
+            continue;
+        }
+        if (write(cell.row(), cell.column(), after))
+            ++replaced;
+    }
+    return replaced;
 }
 
 /*!
-    \overload
-    Write \a formula to the cell \a row_column with the \a format and \a result.
-    Returns true on success.
+ * Returns the cell at the given \a row_column. If there
+ * is no cell at the specified position, the function returns 0.
  */
-bool Worksheet::writeFormula(const CellReference &row_column, const CellFormula &formula,
-                             const Format &format, double result)
+Cell *Worksheet::cellAt(const CellReference &row_column) const
 {
     if (!row_column.isValid())
-        return false;
+        return 0;
 
-    return writeFormula(row_column.row(), row_column.column(), formula, format, result);
+    return cellAt(row_column.row(), row_column.column());
 }
 
 /*!
-    Write \a formula_ to the cell (\a row, \a column) with the \a format and \a result.
-    Returns true on success.
-*/
-bool Worksheet::writeFormula(int row, int column, const CellFormula &formula_, const Format &format,
-                             double result)
+ * Returns the cell at the given \a row and \a column. If there
+ * is no cell at the specified position, the function returns 0.
+ */
+Cell *Worksheet::cellAt(int row, int column) const
 {
-    Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
-        return false;
-
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    d->workbook->styles()->addXfFormat(fmt);
+    Q_D(const Worksheet);
+    return d->cellAt(row, column);
+}
+
+static inline quint64 cellKey(int row, int col)
+{
+    return (quint64(row) << 32) | quint32(col);
+}
+
+/*
+  Cells are not stored as Cell objects, so one is created the first
+  time it's asked for. It is kept up to date with the stored data
+  until its row is removed or the sheet is destroyed.
+ */
+Cell *WorksheetPrivate::cellAt(int row, int col) const
+{
+    cellTable.trimRestoredBlocks();
+    if (!cellTable.cell(row, col))
+        return 0;
+
+    Cell *&cell = cellCache[cellKey(row, col)];
+    if (!cell) {
+        Q_Q(const Worksheet);
+        cell = cellPool.create(const_cast<Worksheet *>(q));
+        updateCachedCell(row, col);
+    }
+    return cell;
+}
+
+void WorksheetPrivate::updateCachedCell(int row, int col) const
+{
+    QHash<quint64, Cell *>::const_iterator it = cellCache.constFind(cellKey(row, col));
+    if (it == cellCache.constEnd())
+        return;
+
+    const CellData *data = cellTable.cell(row, col);
+    if (!data) {
+        releaseCachedCell(row, col);
+        return;
+    }
+
+    CellPrivate *cell_d = it.value()->d_ptr;
+    cell_d->value = cellValue(*data);
+    cell_d->cellType = data->type();
+    cell_d->format = cellFormat(*data);
+    cell_d->formula = cellFormula(*data);
+    cell_d->richString = cellRichString(*data);
+}
+
+/*
+  Destroy the Cell object of (\a row, \a col), if one was handed out.
+ */
+void WorksheetPrivate::releaseCachedCell(int row, int col) const
+{
+    QHash<quint64, Cell *>::iterator it = cellCache.find(cellKey(row, col));
+    if (it == cellCache.end())
+        return;
+    cellPool.destroy(it.value());
+    cellCache.erase(it);
+}
+
+Format WorksheetPrivate::cellFormat(int row, int col) const
+{
+    const CellData *cell = cellTable.cell(row, col);
+    if (!cell)
+        return Format();
+    return cellFormat(*cell);
+}
+
+Format WorksheetPrivate::cellFormat(const CellData &cell) const
+{
+    if (cell.xfIndex == -1)
+        return Format();
+    return workbook->styles()->xfFormat(cell.xfIndex);
+}
+
+QVariant WorksheetPrivate::cellValue(const CellData &cell) const
+{
+    switch (cell.storage) {
+    case CellData::Number:
+        return cell.number;
+    case CellData::Boolean:
+        return cell.boolean;
+    case CellData::SharedString:
+        return sharedStrings()->getSharedPlainString(cell.index);
+    case CellData::Extra: {
+        // Shared strings are resolved through the table, even with a formula
+        const CellExtraData &extra = cellTable.extra(cell.index);
+        if (extra.sharedStringIndex != -1)
+            return sharedStrings()->getSharedPlainString(extra.sharedStringIndex);
+        return extra.value;
+    }
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+/*
+  Stores the number held by \a cell into \a number. Returns false if the
+  cell holds something else.
+ */
+bool WorksheetPrivate::cellNumber(const CellData &cell, double *number) const
+{
+    if (cell.storage == CellData::Number) {
+        *number = cell.number;
+        return true;
+    }
+    if (cell.storage == CellData::Extra && cell.cellType == Cell::NumberType) {
+        const QVariant &value = cellTable.extra(cell.index).value;
+        if (!value.isValid())
+            return false;
+        bool ok = false;
+        *number = value.toDouble(&ok);
+        return ok;
+    }
+    return false;
+}
+
+/*
+  Returns the value held by \a cell, with the shared strings and numbers
+  of the extra data resolved as cellValue() does.
+ */
+RawCellValue WorksheetPrivate::rawValue(const CellData &cell) const
+{
+    RawCellValue value;
+    value.formatIndex = cell.xfIndex;
+    switch (cell.storage) {
+    case CellData::Blank:
+        break;
+    case CellData::Number:
+        value.type = RawCellValue::Number;
+        value.number = cell.number;
+        break;
+    case CellData::Boolean:
+        value.type = RawCellValue::Boolean;
+        value.boolean = cell.boolean;
+        break;
+    case CellData::SharedString:
+        value.type = RawCellValue::SharedString;
+        value.sharedStringIndex = cell.index;
+        break;
+    default: {
+        const CellExtraData &extra = cellTable.extra(cell.index);
+        if (extra.sharedStringIndex != -1) {
+            value.type = RawCellValue::SharedString;
+            value.sharedStringIndex = extra.sharedStringIndex;
+        } else if (cellNumber(cell, &value.number)) {
+            value.type = RawCellValue::Number;
+        } else if (cell.cellType == Cell::BooleanType && extra.value.type() == QVariant::Bool) {
+            value.type = RawCellValue::Boolean;
+            value.boolean = extra.value.toBool();
+        } else if (extra.value.isValid()) {
+            value.type = RawCellValue::Other;
+        }
+        break;
+    }
+    }
+    return value;
+}
+
+/*
+  Returns what \a cell is found by in the value index: its number, its
+  boolean, its shared string or its text. Blank cells and the other values
+  are not indexed.
+ */
+CellValueIndex::Key WorksheetPrivate::valueKey(const CellData &cell) const
+{
+    const RawCellValue value = rawValue(cell);
+    switch (value.type) {
+    case RawCellValue::Number:
+        return CellValueIndex::Key::fromNumber(value.number);
+    case RawCellValue::Boolean:
+        return CellValueIndex::Key::fromBoolean(value.boolean);
+    case RawCellValue::SharedString:
+        return CellValueIndex::Key::fromSharedString(value.sharedStringIndex);
+    case RawCellValue::Other: {
+        const QVariant other = cellValue(cell);
+        if (other.userType() == QMetaType::QString)
+            return CellValueIndex::Key::fromText(other.toString());
+        break;
+    }
+    default:
+        break;
+    }
+    return CellValueIndex::Key();
+}
+
+/*
+  Returns the key of the indexed cell (\a row, \a col), taken before the
+  cell is changed, or a null key if its column is not indexed.
+ */
+CellValueIndex::Key WorksheetPrivate::indexedValue(int row, int col) const
+{
+    if (!valueIndex || !valueIndex->hasColumn(col))
+        return CellValueIndex::Key();
+    const CellData *cell = cellTable.cell(row, col);
+    return cell ? valueKey(*cell) : CellValueIndex::Key();
+}
+
+/*
+  Move the changed cell (\a row, \a col) from the rows of the key \a before
+  to the rows of its new value.
+ */
+void WorksheetPrivate::reindexValue(int row, int col, const CellValueIndex::Key &before)
+{
+    if (!valueIndex || !valueIndex->hasColumn(col))
+        return;
+    valueIndex->remove(before, row, col);
+    if (const CellData *cell = cellTable.cell(row, col))
+        indexValue(row, col, valueKey(*cell));
+}
+
+void WorksheetPrivate::indexValue(int row, int col, const CellValueIndex::Key &key) const
+{
+    if (!valueIndex->insert(key, row, col) || key.type != CellValueIndex::Key::SharedString)
+        return;
+    // The first cell of a string, which may not be the one given for its text
+    const QString text = sharedStrings()->getSharedPlainString(int(key.bits));
+    if (sharedStrings()->getSharedStringIndex(text) != int(key.bits))
+        valueIndex->addAlias(text, int(key.bits));
+}
+
+/*
+  Index the cells of the columns \a colFirst to \a colLast which are not
+  indexed yet, in one pass over the rows.
+ */
+void WorksheetPrivate::indexColumns(int colFirst, int colLast) const
+{
+    if (!valueIndex)
+        valueIndex.reset(new CellValueIndex);
+    QVector<bool> added(colLast - colFirst + 1, false);
+    bool any = false;
+    for (int col = colFirst; col <= colLast; ++col) {
+        if (!valueIndex->hasColumn(col)) {
+            valueIndex->addColumn(col);
+            added[col - colFirst] = true;
+            any = true;
+        }
+    }
+    if (!any)
+        return;
+
+    for (int i = 0; i < cellTable.size(); ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+        const CellRow &cells = cellTable.rowAt(i);
+        const int row = cellTable.rowNumberAt(i);
+        for (int j = cells.lowerBound(colFirst); j < cells.size() && cells.columns[j] <= colLast;
+             ++j) {
+            if (added[cells.columns[j] - colFirst])
+                indexValue(row, cells.columns[j], valueKey(cells.cells[j]));
+        }
+    }
+}
+
+/*
+  Returns the keys of the cells which hold \a value: strings are found by
+  their shared strings and by their text.
+ */
+QList<CellValueIndex::Key> WorksheetPrivate::searchKeys(const QVariant &value) const
+{
+    QList<CellValueIndex::Key> keys;
+    switch (value.userType()) {
+    case QMetaType::UnknownType:
+        break;
+    case QMetaType::Bool:
+        keys.append(CellValueIndex::Key::fromBoolean(value.toBool()));
+        break;
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+    case QMetaType::Float:
+        keys.append(CellValueIndex::Key::fromNumber(value.toDouble()));
+        break;
+    case QMetaType::QDate:
+    case QMetaType::QDateTime:
+        keys.append(CellValueIndex::Key::fromNumber(
+            datetimeToNumber(value.toDateTime(), workbook->isDate1904())));
+        break;
+    case QMetaType::QTime:
+        keys.append(CellValueIndex::Key::fromNumber(timeToNumber(value.toTime())));
+        break;
+    default: {
+        const QString text = value.userType() == qMetaTypeId<RichString>()
+            ? value.value<RichString>().toPlainString()
+            : value.toString();
+        const int index = sharedStrings()->getSharedStringIndex(text);
+        if (index != -1)
+            keys.append(CellValueIndex::Key::fromSharedString(index));
+        foreach (int alias, valueIndex->aliases(text)) {
+            // The string may have been released and its slot reused since
+            if (alias != index && sharedStrings()->getSharedPlainString(alias) == text)
+                keys.append(CellValueIndex::Key::fromSharedString(alias));
+        }
+        keys.append(CellValueIndex::Key::fromText(text));
+        break;
+    }
+    }
+    return keys;
+}
+
+/*
+  Returns the cells of \a range which hold \a value, row by row, or only
+  the first one if \a firstOnly is true.
+ */
+QList<CellReference> WorksheetPrivate::findCells(const QVariant &value, const CellRange &range,
+                                                 bool firstOnly) const
+{
+    QList<CellReference> found;
+    // The flushed rows of the constant memory mode can't be searched
+    if (constantMemory || !dimension.isValid())
+        return found;
+    const CellRange searched = range.isValid() ? range : dimension;
+    const int rowFirst = qMax(searched.firstRow(), dimension.firstRow());
+    const int rowLast = qMin(searched.lastRow(), dimension.lastRow());
+    const int colFirst = qMax(searched.firstColumn(), dimension.firstColumn());
+    const int colLast = qMin(searched.lastColumn(), dimension.lastColumn());
+    if (rowFirst > rowLast || colFirst > colLast)
+        return found;
+
+    indexColumns(colFirst, colLast);
+    const QList<CellValueIndex::Key> keys = searchKeys(value);
+    if (keys.isEmpty())
+        return found;
+
+    QVector<quint64> cells;
+    quint64 first = Q_UINT64_C(0xffffffffffffffff);
+    for (int col = colFirst; col <= colLast; ++col) {
+        foreach (const CellValueIndex::Key &key, keys) {
+            const QVector<int> &rows = valueIndex->rows(key, col);
+            QVector<int>::const_iterator it =
+                std::lower_bound(rows.constBegin(), rows.constEnd(), rowFirst);
+            for (; it != rows.constEnd() && *it <= rowLast; ++it) {
+                const quint64 cell = (quint64(*it) << 32) | quint32(col);
+                if (firstOnly) {
+                    first = qMin(first, cell);
+                    break;
+                }
+                cells.append(cell);
+            }
+        }
+    }
+    if (firstOnly) {
+        if (first != Q_UINT64_C(0xffffffffffffffff))
+            found.append(CellReference(int(first >> 32), int(first & 0xffffffff)));
+        return found;
+    }
+
+    // Row by row, the cells of each column being found one after the other
+    std::sort(cells.begin(), cells.end());
+    found.reserve(cells.size());
+    foreach (quint64 cell, cells)
+        found.append(CellReference(int(cell >> 32), int(cell & 0xffffffff)));
+    return found;
+}
+
+/*
+  Stores the numbers of \a range into \a values row by row, and sets their
+  bits in \a valid. The other values are left untouched.
+ */
+void WorksheetPrivate::readNumbers(const CellRange &range, double *values, QBitArray *valid) const
+{
+    const int columnCount = range.columnCount();
+    for (int i = cellTable.rowLowerBound(range.firstRow());
+         i < cellTable.size() && cellTable.rowNumberAt(i) <= range.lastRow(); ++i) {
+        const int offset = (cellTable.rowNumberAt(i) - range.firstRow()) * columnCount;
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = cells.lowerBound(range.firstColumn());
+             j < cells.size() && cells.columns[j] <= range.lastColumn(); ++j) {
+            const int index = offset + cells.columns[j] - range.firstColumn();
+            if (cellNumber(cells.cells[j], values + index) && valid)
+                valid->setBit(index);
+        }
+    }
+}
+
+/*
+  Stores the values of \a range as text into \a texts row by row, numbers
+  being written as in the xml. Empty cells are left untouched.
+ */
+void WorksheetPrivate::readTexts(const CellRange &range, QString *texts) const
+{
+    const int columnCount = range.columnCount();
+    for (int i = cellTable.rowLowerBound(range.firstRow());
+         i < cellTable.size() && cellTable.rowNumberAt(i) <= range.lastRow(); ++i) {
+        const int offset = (cellTable.rowNumberAt(i) - range.firstRow()) * columnCount;
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = cells.lowerBound(range.firstColumn());
+             j < cells.size() && cells.columns[j] <= range.lastColumn(); ++j) {
+            const CellData &cell = cells.cells[j];
+            QString &text = texts[offset + cells.columns[j] - range.firstColumn()];
+            double number;
+            if (cellNumber(cell, &number)) {
+                char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+                text = QString::fromLatin1(buffer, formatDouble(number, buffer));
+            } else if (cell.storage != CellData::Blank) {
+                text = cellValue(cell).toString();
+            }
+        }
+    }
+}
+
+CellFormula WorksheetPrivate::cellFormula(const CellData &cell) const
+{
+    if (cell.storage == CellData::Extra)
+        return cellTable.extra(cell.index).formula;
+    return CellFormula();
+}
+
+RichString WorksheetPrivate::cellRichString(const CellData &cell) const
+{
+    if (cell.storage == CellData::SharedString)
+        return sharedStrings()->getSharedString(cell.index);
+    if (cell.storage == CellData::Extra) {
+        const CellExtraData &extra = cellTable.extra(cell.index);
+        if (extra.sharedStringIndex != -1)
+            return sharedStrings()->getSharedString(extra.sharedStringIndex);
+        if (!extra.inlineRuns.isEmpty()) {
+            const QString text = extra.value.toString();
+            RichString string;
+            int pos = 0;
+            foreach (const InlineRun &run, extra.inlineRuns) {
+                string.addFragment(text.mid(pos, run.length),
+                                   run.fontId == -1 ? Format() : inlineFonts[run.fontId]);
+                pos += run.length;
+            }
+            return string;
+        }
+    }
+    return RichString();
+}
+
+/*
+  Returns the id of the font of \a format in the inline fonts of the
+  sheet, adding it if needed, or -1 if \a format has no font data. The
+  runs of the rich inline strings refer to their fonts this way, so an
+  inline string costs no more than its text and its runs however many
+  cells use the same fonts.
+ */
+int WorksheetPrivate::inlineFontId(const Format &format)
+{
+    if (!format.hasFontData())
+        return -1;
+    const quint64 fingerprint = format.fontFingerprint();
+    QHash<quint64, int>::const_iterator it = inlineFontIds.constFind(fingerprint);
+    if (it != inlineFontIds.constEnd())
+        return it.value();
+
+    const int id = inlineFonts.size();
+    inlineFonts.append(format);
+    inlineFontXml.append(SharedStrings::richStringPart_rPrXml(format));
+    inlineFontIds.insert(fingerprint, id);
+    return id;
+}
+
+/*
+  Returns the runs of the rich \a string, as stored by the inline string
+  cells.
+ */
+QVector<InlineRun> WorksheetPrivate::inlineRuns(const RichString &string)
+{
+    QVector<InlineRun> runs(string.fragmentCount());
+    for (int i = 0; i < runs.size(); ++i) {
+        runs[i].length = string.fragmentText(i).size();
+        runs[i].fontId = inlineFontId(string.fragmentFormat(i));
+    }
+    return runs;
+}
+
+/*
+  Returns the index of the xf record used by \a format, which must have
+  been added to the styles already, or -1 for an empty format.
+ */
+int WorksheetPrivate::xfIndexOf(const Format &format)
+{
+    if (format.isEmpty())
+        return -1;
+    return format.xfIndex();
+}
+
+/*
+  Returns the shared formula \a sharedIndex tokenized once, from which
+  the formulas of the cells which share it are built.
+ */
+const SharedFormulaTemplate &WorksheetPrivate::sharedFormulaTemplate(int sharedIndex) const
+{
+    QHash<int, SharedFormulaTemplate>::const_iterator it =
+        sharedFormulaTemplates.constFind(sharedIndex);
+    if (it == sharedFormulaTemplates.constEnd()) {
+        const CellFormula rootFormula = sharedFormulaMap.value(sharedIndex);
+        it = sharedFormulaTemplates.insert(
+            sharedIndex,
+            SharedFormulaTemplate(rootFormula.formulaText(), rootFormula.reference().topLeft()));
+    }
+    return it.value();
+}
+
+/*
+  Returns "=" and the formula of the cell (\a row, \a col), which belongs to
+  the shared formula \a sharedIndex. The text is kept, so that scanning a
+  column of formulas again only costs a lookup. Up to
+  MaxSharedFormulaTexts cells are kept.
+ */
+QString WorksheetPrivate::sharedFormulaText(int row, int col, int sharedIndex) const
+{
+    const quint64 key = cellKey(row, col);
+    QHash<quint64, SharedFormulaText>::const_iterator it = sharedFormulaTexts.constFind(key);
+    if (it != sharedFormulaTexts.constEnd() && it->sharedIndex == sharedIndex)
+        return it->text;
+
+    if (sharedFormulaTexts.size() >= MaxSharedFormulaTexts)
+        sharedFormulaTexts.clear();
+    SharedFormulaText text = {sharedIndex, sharedFormulaTemplate(sharedIndex).formulaText(
+                                               CellReference(row, col), QLatin1String("="))};
+    sharedFormulaTexts.insert(key, text);
+    return text.text;
+}
+
+/*
+  Set the entries of \a usedXfs which are referred to by the cells, the
+  rows or the columns of the sheet.
+ */
+void WorksheetPrivate::markUsedXfIndexes(QVector<bool> &usedXfs) const
+{
+    for (int i = 0; i < cellTable.size(); ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const int xf = cells.cells[j].xfIndex;
+            if (xf >= 0 && xf < usedXfs.size())
+                usedXfs[xf] = true;
+        }
+    }
+    foreach (const QSharedPointer<XlsxRowInfo> &info, rowsInfo) {
+        const int xf = xfIndexOf(info->format);
+        if (xf >= 0 && xf < usedXfs.size())
+            usedXfs[xf] = true;
+    }
+    foreach (const QSharedPointer<XlsxColumnInfo> &info, colsInfo) {
+        const int xf = xfIndexOf(info->format);
+        if (xf >= 0 && xf < usedXfs.size())
+            usedXfs[xf] = true;
+    }
+}
+
+/*
+  Replace the xf index of each cell, row and column by its entry in
+  \a xfMap, once the styles have been compacted.
+ */
+void WorksheetPrivate::remapXfIndexes(const QVector<int> &xfMap)
+{
+    for (int i = 0; i < cellTable.size(); ++i) {
+        CellRow &cells = cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            CellData &cell = cells.cells[j];
+            if (cell.xfIndex >= 0)
+                cell.xfIndex = cell.xfIndex < xfMap.size() ? xfMap[cell.xfIndex] : -1;
+        }
+    }
+
+    Styles *styles = workbook->styles();
+    foreach (const QSharedPointer<XlsxRowInfo> &info, rowsInfo) {
+        const int xf = xfIndexOf(info->format);
+        if (xf >= 0)
+            info->format = styles->xfFormat(xf < xfMap.size() ? xfMap[xf] : -1);
+    }
+    foreach (const QSharedPointer<XlsxColumnInfo> &info, colsInfo) {
+        const int xf = xfIndexOf(info->format);
+        if (xf >= 0)
+            info->format = styles->xfFormat(xf < xfMap.size() ? xfMap[xf] : -1);
+    }
+}
+
+/*
+  Replace the shared string index of each cell by its entry in
+  \a stringMap, once the shared strings have been compacted. Only the
+  rows whose indexes change are handed out for writing. The blocks of
+  rows saved by the last incremental save stay valid, the strings being
+  saved with the same indexes.
+ */
+void WorksheetPrivate::remapSharedStrings(const QVector<int> &stringMap)
+{
+    const CellTable &table = cellTable;
+    for (int i = 0; i < table.size(); ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            table.releaseRestoredBlocks();
+        const CellRow &cells = table.rowAt(i);
+        bool changed = false;
+        for (int j = 0; j < cells.size(); ++j) {
+            const CellData &cell = cells.cells[j];
+            if (cell.storage == CellData::SharedString) {
+                changed = changed || stringMap.value(cell.index, -1) != cell.index;
+            } else if (cell.storage == CellData::Extra) {
+                int &index = cellTable.extra(cell.index).sharedStringIndex;
+                if (index != -1)
+                    index = stringMap.value(index, -1);
+            }
+        }
+        if (!changed)
+            continue;
+        CellRow &changedCells = cellTable.rowAt(i);
+        for (int j = 0; j < changedCells.size(); ++j) {
+            CellData &cell = changedCells.cells[j];
+            if (cell.storage == CellData::SharedString)
+                cell.index = stringMap.value(cell.index, -1);
+        }
+    }
+
+    // A block whose last string has been dropped was already out of date
+    QHash<int, SavedRowBlock>::iterator it = savedRowBlocks.begin();
+    while (it != savedRowBlocks.end()) {
+        if (it->lastSharedString == -1) {
+            ++it;
+            continue;
+        }
+        it->lastSharedString = stringMap.value(it->lastSharedString, -1);
+        if (it->lastSharedString == -1)
+            it = savedRowBlocks.erase(it);
+        else
+            ++it;
+    }
+    // Found by the indexes of the strings, built again when needed
+    valueIndex.reset();
+}
+
+void WorksheetPrivate::setCell(int row, int col, const CellData &cell)
+{
+    Statistics::count(Statistics::CellsWritten);
+    const CellValueIndex::Key indexed = indexedValue(row, col);
+    if (const CellData *old = cellTable.cell(row, col))
+        releaseSharedString(*old);
+    cellTable.setCell(row, col, cell);
+    reindexValue(row, col, indexed);
+    updateCachedCell(row, col);
+    if (formulaEngine)
+        formulaEngine->cellChanged(row, col);
+    cfEvaluator.reset();
+    dirty = true;
+}
+
+/*
+  Store a cell with any kind of content, choosing the most compact
+  representation. Shared strings cells should be stored with their
+  string index instead, whenever possible. The reference to the shared
+  string \a sharedStringIndex is given to the cell. The \a inlineRuns
+  are the runs of a rich inline string.
+ */
+void WorksheetPrivate::setCell(int row, int col, Cell::CellType type, const QVariant &value,
+                               const Format &format, const CellFormula &formula,
+                               const QVector<InlineRun> &inlineRuns, int sharedStringIndex)
+{
+    const int xf = xfIndexOf(format);
+    if (!formula.isValid()) {
+        if (type == Cell::NumberType) {
+            if (value.isValid())
+                setCell(row, col, CellData::fromNumber(value.toDouble(), xf));
+            else
+                setCell(row, col, CellData(CellData::Blank, Cell::NumberType, xf));
+            return;
+        } else if (type == Cell::BooleanType && value.isValid()) {
+            setCell(row, col, CellData::fromBool(value.toBool(), xf));
+            return;
+        }
+    }
+
+    CellExtraData extra;
+    extra.value = value;
+    extra.formula = formula;
+    extra.inlineRuns = inlineRuns;
+    extra.sharedStringIndex = sharedStringIndex;
+    setCell(row, col, CellData::fromExtra(cellTable.addExtra(extra), type, xf));
+}
+
+/*
+  Store \a value as a plain shared string, without building a RichString.
+ */
+void WorksheetPrivate::setPlainString(int row, int col, const QString &value,
+                                      const Format &format)
+{
+    Format fmt = format.isValid() ? format : cellFormat(row, col);
+    workbook->styles()->addXfFormat(fmt);
+    setCell(row, col, CellData::fromSharedString(sharedStrings()->addSharedString(value),
+                                                 xfIndexOf(fmt)));
+}
+
+/*
+  Returns true if the string \a value written to the column \a col is
+  stored inline, as the string storage of the sheet wants. The adaptive
+  storage counts the distinct strings of each column, and once enough
+  strings are written, inlines those of the columns where most strings
+  are distinct: their entries in the shared strings table would cost
+  more than they save.
+ */
+bool WorksheetPrivate::isInlineString(int col, const QString &value)
+{
+    if (stringStorage != Worksheet::AdaptiveStringStorage)
+        return stringStorage == Worksheet::InlineStringStorage;
+
+    const int minimumCount = 64;
+    CardinalityEstimator &cardinality = columnCardinality[col];
+    cardinality.add(value);
+    return cardinality.count() >= minimumCount
+           && cardinality.estimate() > cardinality.count() * 0.5;
+}
+
+/*
+  Drop the reference which the overwritten \a cell holds on its shared string.
+ */
+void WorksheetPrivate::releaseSharedString(const CellData &cell)
+{
+    if (cell.cellType != Cell::SharedStringType || cell.storage == CellData::Blank)
+        return;
+
+    const int sst_idx = cell.storage == CellData::Extra
+        ? cellTable.extra(cell.index).sharedStringIndex
+        : cell.index;
+    if (sst_idx == -1)
+        return;
+    if (!deferSstRefs)
+        sharedStrings()->decRefByStringIndex(sst_idx);
+    else if (sst_idx >= 0 && sst_idx < sstRefCounts.size())
+        --sstRefCounts[sst_idx];
+}
+
+/*
+  Add the references to the shared strings counted while the sheet was
+  loaded along with other sheets to the SharedStrings table, and count
+  them there from now on.
+ */
+void WorksheetPrivate::mergeSstRefs()
+{
+    for (int idx = 0; idx < sstRefCounts.size(); ++idx) {
+        if (sstRefCounts[idx])
+            sharedStrings()->incRefByStringIndex(idx, sstRefCounts[idx]);
+    }
+    deferSstRefs = false;
+    sstRefCounts.clear();
+}
+
+/*
+  Store the \a count \a cells of \a row, starting at \a firstCol. This is
+  the counterpart of setCell() used by the batch write functions.
+ */
+void WorksheetPrivate::setCells(int row, int firstCol, const CellData *cells, int count)
+{
+    Statistics::count(Statistics::CellsWritten, count);
+    if (const CellRow *old = cellTable.row(row)) {
+        const int lastCol = firstCol + count - 1;
+        for (int i = old->lowerBound(firstCol); i < old->size() && old->columns[i] <= lastCol; ++i)
+            releaseSharedString(old->cells[i]);
+    }
+    QVector<CellValueIndex::Key> indexed;
+    if (valueIndex) {
+        indexed.resize(count);
+        for (int i = 0; i < count; ++i)
+            indexed[i] = indexedValue(row, firstCol + i);
+    }
+    cellTable.setCells(row, firstCol, cells, count);
+    for (int i = 0; i < indexed.size(); ++i)
+        reindexValue(row, firstCol + i, indexed[i]);
+    if (!cellCache.isEmpty()) {
+        for (int i = 0; i < count; ++i)
+            updateCachedCell(row, firstCol + i);
+    }
+    if (formulaEngine) {
+        for (int i = 0; i < count; ++i)
+            formulaEngine->cellChanged(row, firstCol + i);
+    }
+    cfEvaluator.reset();
+    dirty = true;
+}
+
+/*
+  Check the range of a batch write and update the dimension once for
+  the whole range. Returns false if nothing can be written.
+ */
+bool WorksheetPrivate::checkBatchDimensions(int firstRow, int firstCol, int lastRow, int lastCol)
+{
+    if (firstRow < 1 || firstCol < 1 || lastRow > XLSX_ROW_MAX || lastCol > XLSX_COLUMN_MAX
+        || lastRow < firstRow || lastCol < firstCol) {
+        return false;
+    }
+
+    // In constant memory mode, only the rows before firstRow are flushed
+    if (checkDimensions(firstRow, firstCol))
+        return false;
+    checkDimensions(lastRow, lastCol, true, false);
+    if (lastRow > dimension.lastRow())
+        dimension.setLastRow(lastRow);
+    return true;
+}
+
+/*
+  Returns the xf index used for the cells of a batch written with
+  \a format, or -2 if every cell keeps the format it has already.
+ */
+int WorksheetPrivate::batchXfIndex(const Format &format)
+{
+    if (!format.isValid())
+        return -2;
+    workbook->styles()->addXfFormat(format);
+    return xfIndexOf(format);
+}
+
+int WorksheetPrivate::batchCellXfIndex(int xf, int row, int col) const
+{
+    if (xf != -2)
+        return xf;
+    const CellData *cell = cellTable.cell(row, col);
+    return cell ? cell->xfIndex : -1;
+}
+
+/*
+  Returns true if \a value is converted to a hyperlink. Every alternative
+  of the url pattern contains a colon, so the expression doesn't need to
+  be matched for the strings without one.
+ */
+bool WorksheetPrivate::isUrl(const QString &value) const
+{
+    if (!value.contains(QLatin1Char(':')))
+        return false;
+    Statistics::count(Statistics::RegexEvaluations);
+    return value.contains(urlPattern);
+}
+
+/*
+  Returns true if Worksheet::write() stores \a value as a plain
+  shared string.
+ */
+bool WorksheetPrivate::isPlainString(const QString &value) const
+{
+    if (value.startsWith(QLatin1Char('=')))
+        return false;
+    if (workbook->isStringsToHyperlinksEnabled() && isUrl(value))
+        return false;
+    if (workbook->isHtmlToRichStringEnabled() && Qt::mightBeRichText(value))
+        return false;
+    return true;
+}
+
+/*
+  Convert \a value to the \a cell which Worksheet::write() would store.
+  Returns false for the values which need the per-cell write path.
+ */
+bool WorksheetPrivate::batchVariantCell(const QVariant &value, int xf, CellData *cell)
+{
+    switch (value.userType()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+    case QMetaType::Float:
+        *cell = CellData::fromNumber(value.toDouble(), xf);
+        return true;
+    case QMetaType::Bool:
+        *cell = CellData::fromBool(value.toBool(), xf);
+        return true;
+    case QMetaType::QString: {
+        const QString string = value.toString();
+        if (!isPlainString(string))
+            break;
+        *cell = CellData::fromSharedString(sharedStrings()->addSharedString(string), xf);
+        return true;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+/*
+  Store the \a cells of a batch starting at (\a row, \a col), along
+  the row, or down the column if \a vertical is true.
+ */
+void WorksheetPrivate::storeBatchCells(int row, int col, const QVector<CellData> &cells,
+                                       bool vertical)
+{
+    if (!vertical) {
+        setCells(row, col, cells.constData(), cells.size());
+    } else {
+        for (int i = 0; i < cells.size(); ++i)
+            setCells(row + i, col, cells.constData() + i, 1);
+    }
+}
+
+/*
+  Write the string \a values like writeBatchVariants() does, each one
+  being stored like Worksheet::writeString() does.
+ */
+void WorksheetPrivate::writeBatchStrings(int row, int col, const QStringList &values,
+                                         bool vertical, const Format &format)
+{
+    Q_Q(Worksheet);
+    const bool html = workbook->isHtmlToRichStringEnabled();
+    const int xf = batchXfIndex(format);
+    QVector<CellData> cells(values.size());
+    QVector<int> richStrings;
+    for (int i = 0; i < values.size(); ++i) {
+        const int cellXf = batchCellXfIndex(xf, vertical ? row + i : row, vertical ? col : col + i);
+        if (html && Qt::mightBeRichText(values[i])) {
+            cells[i] = CellData(CellData::Blank, Cell::NumberType, cellXf);
+            richStrings.append(i);
+        } else if (isInlineString(vertical ? col : col + i, values[i])) {
+            CellExtraData extra;
+            extra.value = values[i];
+            cells[i] = CellData::fromExtra(cellTable.addExtra(extra), Cell::InlineStringType,
+                                           cellXf);
+        } else {
+            cells[i] = CellData::fromSharedString(sharedStrings()->addSharedString(values[i]),
+                                                  cellXf);
+        }
+    }
+    storeBatchCells(row, col, cells, vertical);
+
+    foreach (int i, richStrings)
+        q->writeString(vertical ? row + i : row, vertical ? col : col + i, values[i], format);
+}
+
+/*
+  Write the \a values starting at (\a row, \a col), along the row, or
+  down the column if \a vertical is true. Values which can't be stored
+  directly, such as formulas or dates, go through Worksheet::write().
+  The dimension must have been checked already.
+ */
+bool WorksheetPrivate::writeBatchVariants(int row, int col, const QVector<QVariant> &values,
+                                          bool vertical, const Format &format)
+{
+    Q_Q(Worksheet);
+    const int xf = batchXfIndex(format);
+    QVector<CellData> cells(values.size());
+    QVector<int> others;
+    for (int i = 0; i < values.size(); ++i) {
+        const int r = vertical ? row + i : row;
+        const int c = vertical ? col : col + i;
+        const int cellXf = batchCellXfIndex(xf, r, c);
+        if (values[i].isNull() || !batchVariantCell(values[i], cellXf, &cells[i])) {
+            // Cells of the other values are replaced by Worksheet::write()
+            // below, they keep their format in the meantime.
+            cells[i] = CellData(CellData::Blank, Cell::NumberType, cellXf);
+            if (!values[i].isNull())
+                others.append(i);
+        }
+    }
+    storeBatchCells(row, col, cells, vertical);
+
+    bool ret = true;
+    foreach (int i, others) {
+        if (!q->write(vertical ? row + i : row, vertical ? col : col + i, values[i], format))
+            ret = false;
+    }
+    return ret;
+}
+
+/*
+  Write the serial \a numbers of a batch of dates like writeBatchVariants()
+  does. The cells get the default date format of the workbook, unless
+  \a format is a date time format.
+ */
+void WorksheetPrivate::writeBatchDates(int row, int col, const QVector<double> &numbers,
+                                       bool vertical, const Format &format)
+{
+    Format fmt = format;
+    if (!fmt.isValid() || !fmt.isDateTimeFormat())
+        fmt.setNumberFormat(workbook->defaultDateFormat());
+    const int xf = batchXfIndex(fmt);
+
+    QVector<CellData> cells(numbers.size());
+    for (int i = 0; i < numbers.size(); ++i)
+        cells[i] = CellData::fromNumber(numbers[i], xf);
+    storeBatchCells(row, col, cells, vertical);
+}
+
+void WorksheetPrivate::setCellFormat(int row, int col, const Format &format)
+{
+    CellData *cell = cellTable.cell(row, col);
+    if (!cell)
+        return;
+    cell->xfIndex = xfIndexOf(format);
+    updateCachedCell(row, col);
+    dirty = true;
+}
+
+/*
+  Attach \a formula to the existing cell (\a row, \a col).
+ */
+void WorksheetPrivate::setCellFormula(int row, int col, const CellFormula &formula)
+{
+    CellData *cell = cellTable.cell(row, col);
+    if (!cell)
+        return;
+    if (cell->storage != CellData::Extra) {
+        CellExtraData extra;
+        if (cell->storage == CellData::SharedString)
+            extra.sharedStringIndex = cell->index;
+        else
+            extra.value = cellValue(*cell);
+        cell->index = cellTable.addExtra(extra);
+        cell->storage = CellData::Extra;
+    }
+    cellTable.extra(cell->index).formula = formula;
+    updateCachedCell(row, col);
+    if (formulaEngine)
+        formulaEngine->cellChanged(row, col);
+    cfEvaluator.reset();
+    dirty = true;
+}
+
+/*!
+  \overload
+  Write string \a value to the cell \a row_column with the \a format.
+
+  Returns true on success.
+ */
+bool Worksheet::writeString(const CellReference &row_column, const RichString &value,
+                            const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeString(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+  Write string \a value to the cell (\a row, \a column) with the \a format.
+  Returns true on success.
+*/
+bool Worksheet::writeString(int row, int column, const RichString &value, const Format &format)
+{
+    Q_D(Worksheet);
+    //    QString content = value.toPlainString();
+    if (d->checkDimensions(row, column))
+        return false;
+
+    //    if (content.size() > d->xls_strmax) {
+    //        content = content.left(d->xls_strmax);
+    //        error = -2;
+    //    }
+
+    int sst_idx = d->sharedStrings()->addSharedString(value);
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    if (value.fragmentCount() == 1 && value.fragmentFormat(0).isValid())
+        fmt.mergeFormat(value.fragmentFormat(0));
+    d->workbook->styles()->addXfFormat(fmt);
+    d->setCell(row, column, CellData::fromSharedString(sst_idx, d->xfIndexOf(fmt)));
+    return true;
+}
+
+/*!
+    \overload
+    Write string \a value to the cell \a row_column with the \a format.
+ */
+bool Worksheet::writeString(const CellReference &row_column, const QString &value,
+                            const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeString(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+    \overload
+
+    Write string \a value to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+*/
+bool Worksheet::writeString(int row, int column, const QString &value, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    if (d->workbook->isHtmlToRichStringEnabled() && Qt::mightBeRichText(value)) {
+        RichString rs;
+        rs.setHtml(value);
+        return writeString(row, column, rs, format);
+    }
+
+    if (d->isInlineString(column, value))
+        return writeInlineString(row, column, value, format);
+    d->setPlainString(row, column, value, format);
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the UTF-8 string \a data of \a size bytes to the cell \a row_column
+    with the \a format. If \a size is negative, \a data is null terminated.
+ */
+bool Worksheet::writeUtf8String(const CellReference &row_column, const char *data, int size,
+                                const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeUtf8String(row_column.row(), row_column.column(), data, size, format);
+}
+
+/*!
+    Write the UTF-8 string \a data of \a size bytes to the cell (\a row,
+    \a column) with the \a format. If \a size is negative, \a data is null
+    terminated. The text is stored as a plain shared string, which is
+    decoded once and added to the shared strings table directly.
+    Returns true on success.
+
+    \sa writeString()
+ */
+bool Worksheet::writeUtf8String(int row, int column, const char *data, int size,
+                                const Format &format)
+{
+    Q_D(Worksheet);
+    if (!data || d->checkDimensions(row, column))
+        return false;
+
+    d->setPlainString(row, column, QString::fromUtf8(data, size), format);
+    return true;
+}
+
+/*!
+    \overload
+    Write string \a value to the cell \a row_column with the \a format
+ */
+bool Worksheet::writeInlineString(const CellReference &row_column, const QString &value,
+                                  const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeInlineString(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+    Write string \a value to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+*/
+bool Worksheet::writeInlineString(int row, int column, const QString &value, const Format &format)
+{
+    Q_D(Worksheet);
+    // int error = 0;
+    QString content = value;
+    if (d->checkDimensions(row, column))
+        return false;
+
+    if (value.size() > XLSX_STRING_MAX) {
+        content = value.left(XLSX_STRING_MAX);
+        // error = -2;
+    }
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    d->workbook->styles()->addXfFormat(fmt);
+    d->setCell(row, column, Cell::InlineStringType, value, fmt);
+    return true;
+}
+
+/*!
+    \overload
+    Write the rich text \a value to the cell \a row_column with the \a format.
+ */
+bool Worksheet::writeInlineString(const CellReference &row_column, const RichString &value,
+                                  const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeInlineString(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+    \overload
+    Write the rich text \a value to the cell (\a row, \a column) with the
+    \a format, in the cell itself instead of the shared strings table.
+    The formats of the fragments are only kept for their font, which is
+    stored once for all the inline strings of the sheet, so text which
+    differs from cell to cell doesn't grow the shared strings.
+    Returns true on success.
+
+    \sa writeString()
+*/
+bool Worksheet::writeInlineString(int row, int column, const RichString &value,
+                                  const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    if (value.fragmentCount() == 1 && value.fragmentFormat(0).isValid())
+        fmt.mergeFormat(value.fragmentFormat(0));
+    d->workbook->styles()->addXfFormat(fmt);
+    d->setCell(row, column, Cell::InlineStringType, value.toPlainString(), fmt, CellFormula(),
+               value.isRichString() ? d->inlineRuns(value) : QVector<InlineRun>());
+    return true;
+}
+
+/*!
+    \overload
+    Write numeric \a value to the cell \a row_column with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeNumeric(const CellReference &row_column, double value, const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeNumeric(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+    Write numeric \a value to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+*/
+bool Worksheet::writeNumeric(int row, int column, double value, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    d->workbook->styles()->addXfFormat(fmt);
+    d->setCell(row, column, CellData::fromNumber(value, d->xfIndexOf(fmt)));
+    return true;
+}
+
+/*!
+    \overload
+    Write \a formula to the cell \a row_column with the \a format and \a result.
+    Returns true on success.
+ */
+bool Worksheet::writeFormula(const CellReference &row_column, const CellFormula &formula,
+                             const Format &format, double result)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeFormula(row_column.row(), row_column.column(), formula, format, result);
+}
+
+/*!
+    Write \a formula_ to the cell (\a row, \a column) with the \a format and \a result.
+    Returns true on success.
+*/
+bool Worksheet::writeFormula(int row, int column, const CellFormula &formula_, const Format &format,
+                             double result)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    d->workbook->styles()->addXfFormat(fmt);
 
     CellFormula formula = formula_;
     formula.d->ca = true;
@@ -775,357 +2268,2719 @@ bool Worksheet::writeFormula(int row, int column, const CellFormula &formula_, c
             ++si;
         formula.d->si = si;
         d->sharedFormulaMap[si] = formula;
+        d->sharedFormulaTemplates.remove(si);
+        d->sharedFormulaTexts.clear();
+    }
+
+    d->setCell(row, column, Cell::NumberType, result, fmt, formula);
+
+    CellRange range = formula.reference();
+    if (formula.formulaType() == CellFormula::SharedType) {
+        CellFormula sf(QString(), CellFormula::SharedType);
+        sf.d->si = formula.sharedIndex();
+        for (int r = qMax(range.firstRow(), d->streamFlushedRow + 1); r <= range.lastRow(); ++r) {
+            for (int c = range.firstColumn(); c <= range.lastColumn(); ++c) {
+                if (!(r == row && c == column)) {
+                    if (d->cellTable.cell(r, c))
+                        d->setCellFormula(r, c, sf);
+                    else
+                        d->setCell(r, c, Cell::NumberType, result, fmt, sf);
+                }
+            }
+        }
+    } else if (formula.formulaType() == CellFormula::SharedType) {
+    }
+
+    return true;
+}
+
+/*!
+    \overload
+    Write a empty cell \a row_column with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeBlank(const CellReference &row_column, const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeBlank(row_column.row(), row_column.column(), format);
+}
+
+/*!
+    Write a empty cell (\a row, \a column) with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeBlank(int row, int column, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    d->workbook->styles()->addXfFormat(fmt);
+
+    // Note: NumberType with an invalid QVariant value means blank.
+    d->setCell(row, column, CellData(CellData::Blank, Cell::NumberType, d->xfIndexOf(fmt)));
+
+    return true;
+}
+/*!
+    \overload
+    Write a bool \a value to the cell \a row_column with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeBool(const CellReference &row_column, bool value, const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeBool(row_column.row(), row_column.column(), value, format);
+}
+
+/*!
+    Write a bool \a value to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeBool(int row, int column, bool value, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    d->workbook->styles()->addXfFormat(fmt);
+    d->setCell(row, column, CellData::fromBool(value, d->xfIndexOf(fmt)));
+
+    return true;
+}
+/*!
+    \overload
+    Write a QDateTime \a dt to the cell \a row_column with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeDateTime(const CellReference &row_column, const QDateTime &dt,
+                              const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeDateTime(row_column.row(), row_column.column(), dt, format);
+}
+
+/*!
+    Write a QDateTime \a dt to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeDateTime(int row, int column, const QDateTime &dt, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    if (!fmt.isValid() || !fmt.isDateTimeFormat())
+        fmt.setNumberFormat(d->workbook->defaultDateFormat());
+    d->workbook->styles()->addXfFormat(fmt);
+
+    double value = datetimeToNumber(dt, d->workbook->isDate1904());
+
+    d->setCell(row, column, CellData::fromNumber(value, d->xfIndexOf(fmt)));
+
+    return true;
+}
+
+/*!
+    \overload
+    Write a QTime \a t to the cell \a row_column with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeTime(const CellReference &row_column, const QTime &t, const Format &format)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeTime(row_column.row(), row_column.column(), t, format);
+}
+
+/*!
+    Write a QTime \a t to the cell (\a row, \a column) with the \a format.
+    Returns true on success.
+ */
+bool Worksheet::writeTime(int row, int column, const QTime &t, const Format &format)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    if (!fmt.isValid() || !fmt.isDateTimeFormat())
+        fmt.setNumberFormat(QStringLiteral("hh:mm:ss"));
+    d->workbook->styles()->addXfFormat(fmt);
+
+    d->setCell(row, column, CellData::fromNumber(timeToNumber(t), d->xfIndexOf(fmt)));
+
+    return true;
+}
+
+/*!
+    Write the \a count numbers of \a values to the cells of \a row, starting
+    at \a firstColumn, with the \a format. If \a format is invalid, each
+    cell keeps its current format.
+
+    This is much faster than writing the cells one by one, as the
+    dimension and the format are processed once for the whole batch.
+    Returns true on success.
+
+    \sa writeColumn(), writeRange()
+ */
+bool Worksheet::writeRow(int row, int firstColumn, const double *values, int count,
+                         const Format &format)
+{
+    return writeRange(row, firstColumn, values, 1, count, format);
+}
+
+/*!
+    \overload
+
+    Write the string \a values to the cells of \a row, starting at
+    \a firstColumn, with the \a format. The strings are stored like
+    writeString() does.
+ */
+bool Worksheet::writeRow(int row, int firstColumn, const QStringList &values,
+                         const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(row, firstColumn, row, firstColumn + values.size() - 1)) {
+        return false;
+    }
+
+    d->writeBatchStrings(row, firstColumn, values, false, format);
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the \a values to the cells of \a row, starting at \a firstColumn,
+    with the \a format. Each value is stored like write() does.
+ */
+bool Worksheet::writeRow(int row, int firstColumn, const QVector<QVariant> &values,
+                         const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(row, firstColumn, row, firstColumn + values.size() - 1)) {
+        return false;
+    }
+
+    return d->writeBatchVariants(row, firstColumn, values, false, format);
+}
+
+/*!
+    \overload
+
+    Write the dates \a values to the cells of \a row, starting at
+    \a firstColumn, with the \a format. If \a format is not a date time
+    format, the default date format of the workbook is used instead.
+
+    \sa Workbook::defaultDateFormat()
+ */
+bool Worksheet::writeRow(int row, int firstColumn, const QVector<QDate> &values,
+                         const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(row, firstColumn, row, firstColumn + values.size() - 1)) {
+        return false;
+    }
+
+    QVector<double> numbers(values.size());
+    datesToNumbers(values.constData(), values.size(), numbers.data(), d->workbook->isDate1904());
+    d->writeBatchDates(row, firstColumn, numbers, false, format);
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the date times \a values to the cells of \a row, starting at
+    \a firstColumn, with the \a format. If \a format is not a date time
+    format, the default date format of the workbook is used instead.
+
+    \sa Workbook::defaultDateFormat()
+ */
+bool Worksheet::writeRow(int row, int firstColumn, const QVector<QDateTime> &values,
+                         const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(row, firstColumn, row, firstColumn + values.size() - 1)) {
+        return false;
+    }
+
+    QVector<double> numbers(values.size());
+    datetimesToNumbers(values.constData(), values.size(), numbers.data(),
+                       d->workbook->isDate1904());
+    d->writeBatchDates(row, firstColumn, numbers, false, format);
+    return true;
+}
+
+/*!
+    Write the \a count numbers of \a values to the cells of \a column,
+    starting at \a firstRow, with the \a format. If \a format is invalid,
+    each cell keeps its current format.
+    Returns true on success.
+
+    \sa writeRow(), writeRange()
+ */
+bool Worksheet::writeColumn(int firstRow, int column, const double *values, int count,
+                            const Format &format)
+{
+    return writeRange(firstRow, column, values, count, 1, format);
+}
+
+/*!
+    \overload
+
+    Write the string \a values to the cells of \a column, starting at
+    \a firstRow, with the \a format. The strings are stored like
+    writeString() does.
+ */
+bool Worksheet::writeColumn(int firstRow, int column, const QStringList &values,
+                            const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(firstRow, column, firstRow + values.size() - 1, column)) {
+        return false;
+    }
+
+    d->writeBatchStrings(firstRow, column, values, true, format);
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the \a values to the cells of \a column, starting at \a firstRow,
+    with the \a format. Each value is stored like write() does.
+ */
+bool Worksheet::writeColumn(int firstRow, int column, const QVector<QVariant> &values,
+                            const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(firstRow, column, firstRow + values.size() - 1, column)) {
+        return false;
+    }
+
+    return d->writeBatchVariants(firstRow, column, values, true, format);
+}
+
+/*!
+    \overload
+
+    Write the dates \a values to the cells of \a column, starting at
+    \a firstRow, with the \a format. If \a format is not a date time
+    format, the default date format of the workbook is used instead.
+
+    \sa Workbook::defaultDateFormat()
+ */
+bool Worksheet::writeColumn(int firstRow, int column, const QVector<QDate> &values,
+                            const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(firstRow, column, firstRow + values.size() - 1, column)) {
+        return false;
+    }
+
+    QVector<double> numbers(values.size());
+    datesToNumbers(values.constData(), values.size(), numbers.data(), d->workbook->isDate1904());
+    d->writeBatchDates(firstRow, column, numbers, true, format);
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the date times \a values to the cells of \a column, starting at
+    \a firstRow, with the \a format. If \a format is not a date time
+    format, the default date format of the workbook is used instead.
+
+    \sa Workbook::defaultDateFormat()
+ */
+bool Worksheet::writeColumn(int firstRow, int column, const QVector<QDateTime> &values,
+                            const Format &format)
+{
+    Q_D(Worksheet);
+    if (values.isEmpty()
+        || !d->checkBatchDimensions(firstRow, column, firstRow + values.size() - 1, column)) {
+        return false;
+    }
+
+    QVector<double> numbers(values.size());
+    datetimesToNumbers(values.constData(), values.size(), numbers.data(),
+                       d->workbook->isDate1904());
+    d->writeBatchDates(firstRow, column, numbers, true, format);
+    return true;
+}
+
+/*!
+    Write the \a rowCount x \a columnCount numbers of \a values, which are
+    stored row by row, to the cells starting at (\a firstRow,
+    \a firstColumn) with the \a format. If \a format is invalid, each cell
+    keeps its current format.
+    Returns true on success.
+
+    \sa writeRow(), writeColumn()
+ */
+bool Worksheet::writeRange(int firstRow, int firstColumn, const double *values, int rowCount,
+                           int columnCount, const Format &format)
+{
+    Q_D(Worksheet);
+    if (!values || rowCount < 1 || columnCount < 1
+        || !d->checkBatchDimensions(firstRow, firstColumn, firstRow + rowCount - 1,
+                                    firstColumn + columnCount - 1)) {
+        return false;
+    }
+
+    const int xf = d->batchXfIndex(format);
+    QVector<CellData> cells(columnCount);
+    for (int r = 0; r < rowCount; ++r) {
+        const int row = firstRow + r;
+        const double *rowValues = values + qint64(r) * columnCount;
+        for (int c = 0; c < columnCount; ++c) {
+            const int cellXf = d->batchCellXfIndex(xf, row, firstColumn + c);
+            cells[c] = CellData::fromNumber(rowValues[c], cellXf);
+        }
+        d->setCells(row, firstColumn, cells.constData(), columnCount);
+    }
+    return true;
+}
+
+/*!
+    \overload
+
+    Write the rows of \a values to the cells starting at (\a firstRow,
+    \a firstColumn) with the \a format. Each value is stored like write()
+    does.
+ */
+bool Worksheet::writeRange(int firstRow, int firstColumn, const QVector<QVector<QVariant>> &values,
+                           const Format &format)
+{
+    Q_D(Worksheet);
+    int columnCount = 0;
+    foreach (const QVector<QVariant> &rowValues, values)
+        columnCount = qMax(columnCount, rowValues.size());
+    if (columnCount == 0
+        || !d->checkBatchDimensions(firstRow, firstColumn, firstRow + values.size() - 1,
+                                    firstColumn + columnCount - 1)) {
+        return false;
+    }
+
+    bool ret = true;
+    for (int r = 0; r < values.size(); ++r) {
+        if (!values[r].isEmpty()
+            && !d->writeBatchVariants(firstRow + r, firstColumn, values[r], false, format)) {
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+/*!
+    \fn bool Worksheet::writeRecords(int firstRow, int firstColumn, const QVector<T> &records, const QStringList &properties, const QList<Format> &formats)
+
+    Write the \a records, whose type T is a Q_GADGET, one per row, and
+    the names of their \a properties above them, starting at
+    (\a firstRow, \a firstColumn). The cells of the properties are
+    written with the \a formats, in the same order as the properties.
+    When \a properties is empty, all the readable properties are written.
+    Returns false if a property can't be read or if the records don't fit
+    in the sheet.
+
+    The properties and the formats are resolved once for all the records,
+    and each row is stored at once. The values which can't be stored
+    directly, such as formulas or dates, are written like write() does.
+
+    \code
+    struct Product
+    {
+        Q_GADGET
+        Q_PROPERTY(QString name MEMBER name)
+        Q_PROPERTY(double price MEMBER price)
+    public:
+        QString name;
+        double price;
+    };
+
+    sheet->writeRecords(1, 1, products);
+    QVector<Product> loaded = sheet->readRecords<Product>();
+    \endcode
+
+    \sa readRecords()
+ */
+
+/*!
+    \fn bool Worksheet::writeRecords(int firstRow, int firstColumn, const QVector<T *> &records, const QStringList &properties, const QList<Format> &formats)
+    \overload
+
+    Write the \a records, whose type T is a QObject subclass. The
+    properties are those of T, the ones of QObject are left out when
+    \a properties is empty.
+ */
+
+/*!
+    \fn QVector<T> Worksheet::readRecords(const CellRange &range) const
+
+    Returns the records of type T, a Q_GADGET, held by the rows of
+    \a range, or of the whole sheet if \a range isn't valid. The first row
+    holds the names of the properties, which are looked up once; the
+    columns whose header isn't the name of a writable property are
+    skipped, as are the empty cells.
+
+    \sa writeRecords()
+ */
+
+/*
+  Write the header and the \a records, which point to QObjects when
+  \a objects is true, to gadgets of \a metaObject otherwise.
+ */
+bool Worksheet::writeMetaRecords(int firstRow, int firstColumn, const QMetaObject *metaObject,
+                                 const QVector<const void *> &records, bool objects,
+                                 const QStringList &properties, const QList<Format> &formats)
+{
+    Q_D(Worksheet);
+    QVector<QMetaProperty> columns;
+    QStringList names;
+    if (properties.isEmpty()) {
+        const int first = objects ? QObject::staticMetaObject.propertyCount() : 0;
+        for (int i = first; i < metaObject->propertyCount(); ++i) {
+            const QMetaProperty property = metaObject->property(i);
+            if (property.isReadable()) {
+                columns.append(property);
+                names.append(QString::fromLatin1(property.name()));
+            }
+        }
+    } else {
+        foreach (const QString &name, properties) {
+            const int index = metaObject->indexOfProperty(name.toLatin1().constData());
+            if (index == -1 || !metaObject->property(index).isReadable()) {
+                qWarning("%s has no readable property %s", metaObject->className(),
+                         qPrintable(name));
+                return false;
+            }
+            columns.append(metaObject->property(index));
+            names.append(name);
+        }
+    }
+    if (columns.isEmpty()
+        || !d->checkBatchDimensions(firstRow, firstColumn, firstRow + records.size(),
+                                    firstColumn + columns.size() - 1)) {
+        return false;
+    }
+
+    d->writeBatchStrings(firstRow, firstColumn, names, false, Format());
+    QVector<int> xfs(columns.size());
+    for (int i = 0; i < columns.size(); ++i)
+        xfs[i] = d->batchXfIndex(formats.value(i));
+
+    bool ret = true;
+    QVector<QVariant> values(columns.size());
+    QVector<CellData> cells(columns.size());
+    QVector<int> others;
+    for (int r = 0; r < records.size(); ++r) {
+        const int row = firstRow + 1 + r;
+        others.clear();
+        for (int i = 0; i < columns.size(); ++i) {
+            values[i] = objects ? columns[i].read(static_cast<const QObject *>(records[r]))
+                                : columns[i].readOnGadget(records[r]);
+            const int cellXf = d->batchCellXfIndex(xfs[i], row, firstColumn + i);
+            if (values[i].isNull() || !d->batchVariantCell(values[i], cellXf, &cells[i])) {
+                // Written by write() once the row is stored, like writeRow() does
+                cells[i] = CellData(CellData::Blank, Cell::NumberType, cellXf);
+                if (!values[i].isNull())
+                    others.append(i);
+            }
+        }
+        d->setCells(row, firstColumn, cells.constData(), cells.size());
+        foreach (int i, others) {
+            if (!write(row, firstColumn + i, values[i], formats.value(i)))
+                ret = false;
+        }
+    }
+    return ret;
+}
+
+/*
+  Returns the properties of \a metaObject named by the first row of
+  \a range, or of the sheet, one per column, invalid for the columns
+  which don't name a writable property. \a records is set to the rows
+  which follow the header.
+ */
+QVector<QMetaProperty> Worksheet::recordProperties(const QMetaObject *metaObject,
+                                                   const CellRange &range,
+                                                   CellRange *records) const
+{
+    const CellRange table = range.isValid() ? range : dimension();
+    QVector<QMetaProperty> columns;
+    *records = CellRange();
+    if (!table.isValid())
+        return columns;
+
+    for (int column = table.firstColumn(); column <= table.lastColumn(); ++column) {
+        const QString name = read(table.firstRow(), column).toString().trimmed();
+        const int index =
+            name.isEmpty() ? -1 : metaObject->indexOfProperty(name.toLatin1().constData());
+        if (index != -1 && metaObject->property(index).isWritable())
+            columns.append(metaObject->property(index));
+        else
+            columns.append(QMetaProperty());
+    }
+    *records =
+        CellRange(table.firstRow() + 1, table.firstColumn(), table.lastRow(), table.lastColumn());
+    return columns;
+}
+#endif
+
+/*!
+    \enum Worksheet::CsvOption
+
+    \value DefaultCsvOptions The type of each column is inferred from the
+           first records.
+    \value CsvHeader The first record holds the names of the columns, which
+           are stored as strings and aren't used to infer the types.
+    \value CsvStringsOnly Every field is stored as a string.
+ */
+
+/*!
+    Returns a writer which fills the rows \a firstRow to \a lastRow of the
+    sheet from another thread, or 0 if the rows overlap the ones of another
+    writer of the sheet, or if the sheet is in constant memory mode.
+
+    The writer is owned by the sheet. Its cells are merged into the sheet
+    by mergeRowWriters(), which is called when the document is saved, and
+    the writer is deleted then. The concurrent writes of the workbook are
+    enabled by the first writer.
+
+    \sa RowWriter, Workbook::setConcurrentWritesEnabled()
+ */
+RowWriter *Worksheet::rowWriter(int firstRow, int lastRow)
+{
+    Q_D(Worksheet);
+    if (firstRow < 1 || lastRow > XLSX_ROW_MAX || lastRow < firstRow || d->constantMemory)
+        return 0;
+
+    QMap<int, RowWriter *>::const_iterator it = d->rowWriters.lowerBound(firstRow);
+    if (it != d->rowWriters.constEnd() && it.key() <= lastRow)
+        return 0;
+    if (it != d->rowWriters.constBegin() && (it - 1).value()->lastRow() >= firstRow)
+        return 0;
+
+    if (!d->workbook->isConcurrentWritesEnabled())
+        d->workbook->setConcurrentWritesEnabled(true);
+    RowWriter *writer = new RowWriter(d, firstRow, lastRow);
+    d->rowWriters.insert(firstRow, writer);
+    return writer;
+}
+
+/*!
+    Moves the cells of the writers returned by rowWriter() to the sheet, in
+    the order of their rows, and deletes the writers. The writers must be
+    done, this is called from the thread of the sheet.
+
+    \sa rowWriter()
+ */
+void Worksheet::mergeRowWriters()
+{
+    Q_D(Worksheet);
+    d->mergeRowWriters();
+}
+
+void WorksheetPrivate::mergeRowWriters()
+{
+    // Taken first, the writes of the merged cells don't see the writers
+    const QMap<int, RowWriter *> writers = rowWriters;
+    rowWriters.clear();
+    foreach (RowWriter *writer, writers) {
+        writer->merge();
+        delete writer;
+    }
+}
+
+/*
+  Returns true if \a delimiter can separate the fields of a CSV file.
+ */
+static bool isCsvDelimiter(QChar delimiter)
+{
+    const ushort c = delimiter.unicode();
+    return c > 0 && c < 0x80 && c != '"' && c != '\r' && c != '\n';
+}
+
+/*!
+    Read the UTF-8 CSV file of \a device into the cells starting at
+    (\a row, \a column), one row per record, the fields being separated by
+    the ASCII \a delimiter, such as a comma, a semicolon or a tab.
+
+    The type of each column is inferred once, from its first thousand
+    fields: the columns whose fields are all plain decimal numbers hold
+    numbers, those whose fields are all TRUE or FALSE hold booleans, and
+    the other ones hold strings. A field of a number or boolean column
+    which isn't one is stored as a string. The strings are stored as they
+    are, as plain shared strings, and the empty fields leave their cells
+    unchanged. The cells are stored a row at a time, so in constant memory
+    mode the sheet is streamed as the file is read.
+
+    Returns false if the device can't be read or if a record doesn't fit
+    in the sheet, the records read until then are kept.
+
+    \sa exportCsv()
+ */
+bool Worksheet::importCsv(QIODevice *device, int row, int column, CsvOptions options,
+                          QChar delimiter)
+{
+    Q_D(Worksheet);
+    if (!device || !isCsvDelimiter(delimiter) || row < 1 || column < 1)
+        return false;
+
+    CsvReader reader(device, delimiter.toLatin1());
+    return d->importCsv(reader, row, column, options);
+}
+
+bool WorksheetPrivate::importCsv(CsvReader &reader, int row, int col,
+                                 Worksheet::CsvOptions options)
+{
+    enum { SampleRecords = 1000 };
+    QVector<CellData> cells;
+    QVector<int> types;
+    if ((options & Worksheet::CsvHeader) && reader.readRecord()) {
+        if (!storeCsvRecord(row++, col, reader.record(), types, cells))
+            return false;
+    }
+
+    // The records the types are inferred from are kept until then
+    QVector<CsvRecord> sample;
+    while (sample.size() < SampleRecords && reader.readRecord())
+        sample.append(reader.record());
+    if (!(options & Worksheet::CsvStringsOnly))
+        types = CsvReader::columnTypes(sample);
+    for (int i = 0; i < sample.size(); ++i) {
+        if (!storeCsvRecord(row++, col, sample[i], types, cells))
+            return false;
+    }
+    sample.clear();
+
+    while (reader.readRecord()) {
+        if (!storeCsvRecord(row++, col, reader.record(), types, cells))
+            return false;
+    }
+    return !reader.hasError();
+}
+
+/*
+  Store the fields of \a record to the cells of \a row starting at \a col,
+  as the CsvColumnType \a types of their columns. Each run of non empty
+  fields is stored by one setCells() call, with \a cells as its buffer.
+ */
+bool WorksheetPrivate::storeCsvRecord(int row, int col, const CsvRecord &record,
+                                      const QVector<int> &types, QVector<CellData> &cells)
+{
+    int first = 0;
+    int last = record.fieldCount() - 1;
+    while (first <= last && record.fieldSize(first) == 0)
+        ++first;
+    while (last >= first && record.fieldSize(last) == 0)
+        --last;
+    if (first > last)
+        return row <= XLSX_ROW_MAX;
+    if (!checkBatchDimensions(row, col + first, row, col + last))
+        return false;
+
+    // The cells of a new row have no format to keep
+    const bool keepFormats = cellTable.contains(row);
+    cells.resize(0);
+    for (int i = first; i <= last + 1; ++i) {
+        if (i > last || record.fieldSize(i) == 0) {
+            if (!cells.isEmpty())
+                setCells(row, col + i - cells.size(), cells.constData(), cells.size());
+            cells.resize(0);
+            continue;
+        }
+
+        const char *data = record.fieldData(i);
+        const int size = record.fieldSize(i);
+        const int type = i < types.size() ? types[i] : int(CsvStringColumn);
+        const int xf = keepFormats ? batchCellXfIndex(-2, row, col + i) : -1;
+        double number;
+        bool boolean;
+        if (type == CsvNumberColumn && CsvReader::parseNumber(data, size, &number)) {
+            cells.append(CellData::fromNumber(number, xf));
+        } else if (type == CsvBooleanColumn && CsvReader::parseBoolean(data, size, &boolean)) {
+            cells.append(CellData::fromBool(boolean, xf));
+        } else {
+            const int index = sharedStrings()->addSharedString(QString::fromUtf8(data, size));
+            cells.append(CellData::fromSharedString(index, xf));
+        }
+    }
+    return true;
+}
+
+/*!
+    Write the values of the cells of \a range, or of the whole sheet if
+    \a range is invalid, to \a device as a UTF-8 CSV file, one record per
+    row, the fields being separated by the ASCII \a delimiter. The numbers,
+    dates included, are written in full precision, the booleans as TRUE or
+    FALSE, and the formulas as their values. Returns false if the
+    \a device can't be written, or in constant memory mode.
+
+    \sa importCsv()
+ */
+bool Worksheet::exportCsv(QIODevice *device, const CellRange &range, QChar delimiter) const
+{
+    Q_D(const Worksheet);
+    if (!device || !isCsvDelimiter(delimiter) || d->constantMemory)
+        return false;
+
+    CsvWriter writer(device, delimiter.toLatin1());
+    const CellRange area = range.isValid() ? range : d->dimension;
+    if (area.isValid())
+        d->exportCsv(writer, area);
+    return writer.flush();
+}
+
+void WorksheetPrivate::exportCsv(CsvWriter &writer, const CellRange &range) const
+{
+    int index = cellTable.rowLowerBound(range.firstRow());
+    for (int row = range.firstRow(); row <= range.lastRow(); ++row) {
+        int col = range.firstColumn();
+        if (index < cellTable.size() && cellTable.rowNumberAt(index) == row) {
+            // Keep about one block of spilled rows in memory
+            if (index % CellTable::SpillBlockRows == 0)
+                cellTable.releaseRestoredBlocks();
+            const CellRow &cells = cellTable.rowAt(index++);
+            for (int i = cells.lowerBound(range.firstColumn());
+                 i < cells.size() && cells.columns[i] <= range.lastColumn(); ++i) {
+                for (; col < cells.columns[i]; ++col)
+                    writer.writeField("", 0);
+                ++col;
+
+                const CellData &cell = cells.cells[i];
+                double number;
+                if (cellNumber(cell, &number)) {
+                    char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+                    writer.writeField(buffer, formatDouble(number, buffer));
+                } else if (cell.type() == Cell::BooleanType) {
+                    const bool value = cellValue(cell).toBool();
+                    writer.writeField(value ? "TRUE" : "FALSE", value ? 4 : 5);
+                } else {
+                    writer.writeField(cellValue(cell).toString());
+                }
+            }
+        }
+        for (; col <= range.lastColumn(); ++col)
+            writer.writeField("", 0);
+        writer.endRecord();
+    }
+}
+
+/*!
+    \overload
+    Write a QUrl \a url to the cell \a row_column with the given \a format \a display and \a tip.
+    Returns true on success.
+ */
+bool Worksheet::writeHyperlink(const CellReference &row_column, const QUrl &url,
+                               const Format &format, const QString &display, const QString &tip)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeHyperlink(row_column.row(), row_column.column(), url, format, display, tip);
+}
+
+/*!
+    Write a QUrl \a url to the cell (\a row, \a column) with the given \a format \a display and \a
+   tip. Returns true on success.
+ */
+bool Worksheet::writeHyperlink(int row, int column, const QUrl &url, const Format &format,
+                               const QString &display, const QString &tip)
+{
+    Q_D(Worksheet);
+    if (d->checkDimensions(row, column))
+        return false;
+
+    // int error = 0;
+
+    QString urlString = url.toString();
+
+    // Generate proper display string
+    QString displayString = display.isEmpty() ? urlString : display;
+    if (displayString.startsWith(QLatin1String("mailto:")))
+        displayString.replace(QLatin1String("mailto:"), QString());
+    if (displayString.size() > XLSX_STRING_MAX) {
+        displayString = displayString.left(XLSX_STRING_MAX);
+        // error = -2;
+    }
+
+    /*
+      Location within target. If target is a workbook (or this workbook)
+      this shall refer to a sheet and cell or a defined name. Can also
+      be an HTML anchor if target is HTML file.
+
+      c:\temp\file.xlsx#Sheet!A1
+      http://a.com/aaa.html#aaaaa
+    */
+    QString locationString;
+    if (url.hasFragment()) {
+        locationString = url.fragment();
+        urlString = url.toString(QUrl::RemoveFragment);
+    }
+
+    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
+    // Given a default style for hyperlink
+    if (!fmt.isValid()) {
+        fmt.setFontColor(Qt::blue);
+        fmt.setFontUnderline(Format::FontUnderlineSingle);
+    }
+    d->workbook->styles()->addXfFormat(fmt);
+
+    // Write the hyperlink string as normal string.
+    int sst_idx = d->sharedStrings()->addSharedString(displayString);
+    d->setCell(row, column, CellData::fromSharedString(sst_idx, d->xfIndexOf(fmt)));
+
+    // Store the hyperlink data in a separate table
+    d->urlTable.insert(row, column,
+                       XlsxHyperlinkData(XlsxHyperlinkData::External, urlString,
+                                         locationString, QString(), tip));
+
+    return true;
+}
+
+/*!
+    \overload
+    Write the comment \a text to the cell \a row_column.
+    Returns true on success.
+ */
+bool Worksheet::writeComment(const CellReference &row_column, const QString &text)
+{
+    if (!row_column.isValid())
+        return false;
+
+    return writeComment(row_column.row(), row_column.column(), text);
+}
+
+/*!
+    Write the comment \a text to the cell (\a row, \a column), replacing
+    the comment of the cell if it has one. The comment is shown as a note
+    when the mouse is over the cell, its author is commentAuthor().
+    Returns false if \a text is empty or the cell is out of the sheet.
+
+    \sa comment(), removeComment()
+ */
+bool Worksheet::writeComment(int row, int column, const QString &text)
+{
+    Q_D(Worksheet);
+    if (text.isEmpty() || d->checkDimensions(row, column))
+        return false;
+
+    setDirty();
+    d->comments[row][column] = text.left(XLSX_STRING_MAX);
+    return true;
+}
+
+/*!
+    \overload
+    Returns the comment of the cell \a row_column, or an empty string.
+ */
+QString Worksheet::comment(const CellReference &row_column) const
+{
+    return comment(row_column.row(), row_column.column());
+}
+
+/*!
+    Returns the comment of the cell (\a row, \a column), or an empty
+    string if the cell has no comment.
+ */
+QString Worksheet::comment(int row, int column) const
+{
+    Q_D(const Worksheet);
+    QMap<int, QMap<int, QString>>::const_iterator it = d->comments.constFind(row);
+    if (it == d->comments.constEnd())
+        return QString();
+    return it.value().value(column);
+}
+
+/*!
+    \overload
+    Removes the comment of the cell \a row_column.
+ */
+bool Worksheet::removeComment(const CellReference &row_column)
+{
+    return removeComment(row_column.row(), row_column.column());
+}
+
+/*!
+    Removes the comment of the cell (\a row, \a column). Returns false if
+    the cell has no comment.
+ */
+bool Worksheet::removeComment(int row, int column)
+{
+    Q_D(Worksheet);
+    QMap<int, QMap<int, QString>>::iterator it = d->comments.find(row);
+    if (it == d->comments.end() || !it.value().remove(column))
+        return false;
+
+    setDirty();
+    if (it.value().isEmpty())
+        d->comments.erase(it);
+    d->updateDimension();
+    return true;
+}
+
+/*!
+    Sets the \a author of the comments of the sheet, which is shown at the
+    top of the notes.
+
+    \sa commentAuthor()
+ */
+void Worksheet::setCommentAuthor(const QString &author)
+{
+    Q_D(Worksheet);
+    setDirty();
+    d->commentAuthor = author;
+}
+
+/*!
+    Returns the author of the comments of the sheet, an empty string by
+    default.
+
+    \sa setCommentAuthor()
+ */
+QString Worksheet::commentAuthor() const
+{
+    Q_D(const Worksheet);
+    return d->commentAuthor;
+}
+
+/*!
+ * Add one DataValidation \a validation to the sheet.
+ * Returns true on success.
+ */
+bool Worksheet::addDataValidation(const DataValidation &validation)
+{
+    Q_D(Worksheet);
+    setDirty();
+    if (validation.ranges().isEmpty() || validation.validationType() == DataValidation::None)
+        return false;
+
+    d->addDataValidation(validation);
+    return true;
+}
+
+/*!
+ * Add one ConditionalFormatting \a cf to the sheet.
+ * Returns true on success.
+ */
+bool Worksheet::addConditionalFormatting(const ConditionalFormatting &cf)
+{
+    Q_D(Worksheet);
+    setDirty();
+    if (cf.ranges().isEmpty())
+        return false;
+
+    for (int i = 0; i < cf.d->cfRules.size(); ++i) {
+        const QSharedPointer<XlsxCfRuleData> &rule = cf.d->cfRules[i];
+        if (!rule->dxfFormat.isEmpty())
+            d->workbook->styles()->addDxfFormat(rule->dxfFormat);
+        rule->priority = 1;
+    }
+    d->addConditionalFormatting(cf);
+    return true;
+}
+
+/*
+  Returns true if \a name can name a table: it starts with a letter, an
+  underscore or a backslash, is made of letters, digits, underscores and
+  periods, and can't be read as a cell reference.
+ */
+static bool isValidTableName(const QString &name)
+{
+    if (name.isEmpty() || name.size() > 255)
+        return false;
+    const QChar first = name.at(0);
+    if (!first.isLetter() && first != QLatin1Char('_') && first != QLatin1Char('\\'))
+        return false;
+    for (int i = 1; i < name.size(); ++i) {
+        const QChar c = name.at(i);
+        if (!c.isLetterOrNumber() && c != QLatin1Char('_') && c != QLatin1Char('.'))
+            return false;
+    }
+    return !CellReference(name).isValid() && name.compare(QLatin1String("R"), Qt::CaseInsensitive)
+           && name.compare(QLatin1String("C"), Qt::CaseInsensitive);
+}
+
+static bool rangesIntersect(const CellRange &left, const CellRange &right)
+{
+    return left.firstRow() <= right.lastRow() && right.firstRow() <= left.lastRow()
+           && left.firstColumn() <= right.lastColumn() && right.firstColumn() <= left.lastColumn();
+}
+
+/*!
+    Turns the cells of \a range into an Excel table, whose first row is the
+    header row. Excel then shows the autofilter buttons in the header row,
+    draws the bands of the table \a style, "TableStyleMedium2" when empty,
+    and lets formulas refer to the columns by their names.
+
+    The columns are named by \a headers, then by the text of the header
+    cells, or "Column1", "Column2"... when both are missing. The names are
+    made unique and written to the header row. The table is named \a name,
+    or "Table1", "Table2"... when empty; the name must be unique in the
+    workbook.
+
+    The body of the table is written like any other cells, with
+    writeColumn() or writeTableColumn() for instance. Its bands come from
+    the style, the cells need no format of their own.
+
+    Returns false if the range has less than two rows, if it overlaps
+    another table or merged cells, or if the name is invalid or already used.
+
+    \sa tableNames(), writeTableColumn()
+ */
+bool Worksheet::addTable(const CellRange &range, const QStringList &headers,
+                         const QString &style, const QString &name)
+{
+    Q_D(Worksheet);
+    if (!range.isValid() || range.firstRow() < 1 || range.firstColumn() < 1
+        || range.lastRow() > XLSX_ROW_MAX || range.lastColumn() > XLSX_COLUMN_MAX
+        || range.rowCount() < 2 || headers.size() > range.columnCount()) {
+        return false;
+    }
+    foreach (const QSharedPointer<Table> &table, d->tables) {
+        if (rangesIntersect(table->range, range))
+            return false;
+    }
+    if (d->mergeIndex.intersects(range))
+        return false;
+    if (d->autoFilterRange.isValid() && rangesIntersect(d->autoFilterRange, range))
+        return false;
+
+    // The ids and the names are unique in the workbook
+    QList<Table *> tables = d->workbook->tables();
+    // The sheet may not be in the workbook yet
+    foreach (const QSharedPointer<Table> &table, d->tables) {
+        if (!tables.contains(table.data()))
+            tables.append(table.data());
+    }
+    int id = 0;
+    foreach (const Table *table, tables)
+        id = qMax(id, table->id);
+    ++id;
+    const QString tableName = name.isEmpty() ? QStringLiteral("Table%1").arg(id) : name;
+    if (!isValidTableName(tableName))
+        return false;
+    foreach (const Table *table, tables) {
+        if (table->name.compare(tableName, Qt::CaseInsensitive) == 0)
+            return false;
+    }
+
+    QSharedPointer<Table> table(new Table(Table::F_NewFromScratch));
+    table->id = id;
+    table->name = tableName;
+    table->range = range;
+    table->styleName = style.isEmpty() ? QStringLiteral("TableStyleMedium2") : style;
+    for (int i = 0; i < range.columnCount(); ++i) {
+        const int column = range.firstColumn() + i;
+        QString header =
+            i < headers.size() ? headers[i] : read(range.firstRow(), column).toString();
+        if (header.isEmpty())
+            header = QStringLiteral("Column%1").arg(i + 1);
+        QString unique = header;
+        for (int suffix = 2; table->columnIndex(unique) != -1; ++suffix)
+            unique = header + QString::number(suffix);
+        table->columns.append(unique);
+
+        // The header cells hold the names of the columns
+        if (!writeString(range.firstRow(), column, unique, d->cellFormat(range.firstRow(), column)))
+            return false;
+    }
+
+    setDirty();
+    d->tables.append(table);
+    return true;
+}
+
+/*!
+    Returns the names of the tables of the sheet.
+
+    \sa addTable(), tableRange()
+ */
+QStringList Worksheet::tableNames() const
+{
+    Q_D(const Worksheet);
+    QStringList names;
+    foreach (const QSharedPointer<Table> &table, d->tables)
+        names.append(table->name);
+    return names;
+}
+
+/*!
+    Returns the range of the table \a name, its header row included, or an
+    invalid range if the sheet has no such table.
+ */
+CellRange Worksheet::tableRange(const QString &name) const
+{
+    Q_D(const Worksheet);
+    if (const Table *table = d->table(name))
+        return table->range;
+    return CellRange();
+}
+
+/*!
+    Write the \a count numbers of \a values to the \a column of the \a table,
+    from the first row of its body on, with the \a format.
+
+    Returns false if the sheet has no such table or column, or if the
+    values don't fit in the body of the table.
+
+    \sa addTable(), writeColumn()
+ */
+bool Worksheet::writeTableColumn(const QString &table, const QString &column,
+                                 const double *values, int count, const Format &format)
+{
+    Q_D(Worksheet);
+    const Table *t = d->table(table);
+    const int index = t ? t->columnIndex(column) : -1;
+    if (index == -1 || count > t->bodyRange().rowCount())
+        return false;
+    return writeColumn(t->bodyRange().firstRow(), t->range.firstColumn() + index, values, count,
+                       format);
+}
+
+/*!
+    \overload
+
+    Write the string \a values to the \a column of the \a table, with the
+    \a format.
+ */
+bool Worksheet::writeTableColumn(const QString &table, const QString &column,
+                                 const QStringList &values, const Format &format)
+{
+    Q_D(Worksheet);
+    const Table *t = d->table(table);
+    const int index = t ? t->columnIndex(column) : -1;
+    if (index == -1 || values.size() > t->bodyRange().rowCount())
+        return false;
+    return writeColumn(t->bodyRange().firstRow(), t->range.firstColumn() + index, values,
+                       format);
+}
+
+/*!
+    \overload
+
+    Write the \a values to the \a column of the \a table, with the
+    \a format, each value like write() does.
+ */
+bool Worksheet::writeTableColumn(const QString &table, const QString &column,
+                                 const QVector<QVariant> &values, const Format &format)
+{
+    Q_D(Worksheet);
+    const Table *t = d->table(table);
+    const int index = t ? t->columnIndex(column) : -1;
+    if (index == -1 || values.size() > t->bodyRange().rowCount())
+        return false;
+    return writeColumn(t->bodyRange().firstRow(), t->range.firstColumn() + index, values,
+                       format);
+}
+
+/*
+  Returns the table of the sheet named \a name, case insensitively, or 0.
+ */
+Table *WorksheetPrivate::table(const QString &name) const
+{
+    foreach (const QSharedPointer<Table> &table, tables) {
+        if (table->name.compare(name, Qt::CaseInsensitive) == 0)
+            return table.data();
+    }
+    return 0;
+}
+
+/*!
+    Add an autofilter to \a range, whose first row holds the headers of
+    its columns. Excel shows the autofilter buttons in the header row.
+    The values of the filtered columns are cleared. An invalid \a range
+    removes the autofilter.
+
+    Returns false if \a range overlaps a table, which has an autofilter
+    of its own.
+
+    \sa setAutoFilterValues(), applyAutoFilter()
+ */
+bool Worksheet::setAutoFilter(const CellRange &range)
+{
+    Q_D(Worksheet);
+    if (range.isValid()) {
+        if (range.firstRow() < 1 || range.firstColumn() < 1 || range.lastRow() > XLSX_ROW_MAX
+            || range.lastColumn() > XLSX_COLUMN_MAX) {
+            return false;
+        }
+        foreach (const QSharedPointer<Table> &table, d->tables) {
+            if (rangesIntersect(table->range, range))
+                return false;
+        }
+    }
+    setDirty();
+    d->autoFilterRange = range.isValid() ? range : CellRange();
+    d->autoFilterColumns.clear();
+    return true;
+}
+
+/*!
+    Returns the range of the autofilter of the sheet, its header row
+    included, or an invalid range if the sheet has none.
+ */
+CellRange Worksheet::autoFilter() const
+{
+    Q_D(const Worksheet);
+    return d->autoFilterRange;
+}
+
+/*!
+    Show only the rows whose cell in \a column holds one of the \a values,
+    once the filter is applied. The values are compared with the texts of
+    the cells without regard to case, the numbers being written as with
+    the general number format and the booleans as TRUE and FALSE; an empty
+    value shows the rows whose cell is empty. An empty list of \a values
+    stops filtering \a column.
+
+    Excel applies the filter when the workbook is opened in it,
+    applyAutoFilter() hides the rows beforehand.
+
+    Returns false if \a column is not a column of the autofilter.
+ */
+bool Worksheet::setAutoFilterValues(int column, const QStringList &values)
+{
+    Q_D(Worksheet);
+    const CellRange &range = d->autoFilterRange;
+    if (!range.isValid() || column < range.firstColumn() || column > range.lastColumn())
+        return false;
+    setDirty();
+    if (values.isEmpty())
+        d->autoFilterColumns.remove(column);
+    else
+        d->autoFilterColumns.insert(column, values);
+    return true;
+}
+
+/*!
+    Returns the values shown by \a column of the autofilter, or an empty
+    list if the column is not filtered.
+ */
+QStringList Worksheet::autoFilterValues(int column) const
+{
+    Q_D(const Worksheet);
+    return d->autoFilterColumns.value(column);
+}
+
+static void addFilterText(QHash<QString, QString> *texts, const QString &text)
+{
+    const QString key = text.toCaseFolded();
+    if (!texts->contains(key))
+        texts->insert(key, text);
+}
+
+static bool caseInsensitiveLessThan(const QString &left, const QString &right)
+{
+    return QString::localeAwareCompare(left.toCaseFolded(), right.toCaseFolded()) < 0;
+}
+
+/*!
+    Returns the distinct values of the cells of \a column below the header
+    row of the autofilter, as compared by setAutoFilterValues(): the
+    numbers in ascending order, then the texts, FALSE and TRUE, and an
+    empty string if some cells are empty. Of the texts which only differ
+    by their case, the first one is returned. Each shared string is looked at
+    only once, however many cells hold it.
+ */
+QStringList Worksheet::autoFilterDistinctValues(int column) const
+{
+    Q_D(const Worksheet);
+    const CellRange &range = d->autoFilterRange;
+    if (!range.isValid() || column < range.firstColumn() || column > range.lastColumn())
+        return QStringList();
+
+    QSet<int> sstIndexes;
+    QHash<QString, QString> texts; // by case folded text
+    QVector<double> numbers;
+    bool booleans[2] = {false, false};
+    int cellCount = 0;
+    const int firstRow = range.firstRow() + 1;
+    const CellTable &cellTable = d->cellTable;
+    const int end = cellTable.rowLowerBound(range.lastRow() + 1);
+    for (int i = cellTable.rowLowerBound(firstRow); i < end; ++i) {
+        const CellRow &cells = cellTable.rowAt(i);
+        const int j = cells.indexOf(column);
+        if (j == -1 || cells.cells[j].storage == CellData::Blank)
+            continue;
+        ++cellCount;
+        const CellData &cell = cells.cells[j];
+        int sst_idx = -1;
+        if (cell.storage == CellData::SharedString)
+            sst_idx = cell.index;
+        else if (cell.storage == CellData::Extra)
+            sst_idx = cellTable.extra(cell.index).sharedStringIndex;
+        double number;
+        if (sst_idx != -1)
+            sstIndexes.insert(sst_idx);
+        else if (d->cellNumber(cell, &number))
+            numbers.append(number);
+        else if (cell.type() == Cell::BooleanType)
+            booleans[d->cellValue(cell).toBool()] = true;
+        else
+            addFilterText(&texts, d->filterText(cell));
+    }
+    // The first of the shared strings equal but for their case is kept
+    QList<int> sortedIndexes = sstIndexes.values();
+    std::sort(sortedIndexes.begin(), sortedIndexes.end());
+    foreach (int sst_idx, sortedIndexes)
+        addFilterText(&texts, d->sharedStrings()->getSharedPlainString(sst_idx));
+    texts.remove(QString());
+
+    QStringList values;
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+    char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+    foreach (double number, numbers)
+        values.append(QString::fromLatin1(buffer, formatDouble(number, buffer)));
+    QStringList sortedTexts = texts.values();
+    std::sort(sortedTexts.begin(), sortedTexts.end(), caseInsensitiveLessThan);
+    values += sortedTexts;
+    if (booleans[0])
+        values.append(QStringLiteral("FALSE"));
+    if (booleans[1])
+        values.append(QStringLiteral("TRUE"));
+    if (cellCount < range.lastRow() - firstRow + 1)
+        values.append(QString());
+    return values;
+}
+
+/*!
+    Hide the rows of the autofilter whose cells don't hold the values of
+    the filtered columns, and show the others, as Excel does when the
+    filter is applied. The hidden and the shown rows are set by runs of
+    rows. Returns the number of rows hidden, or -1 if the sheet has no
+    autofilter.
+
+    \sa setAutoFilterValues()
+ */
+int Worksheet::applyAutoFilter()
+{
+    Q_D(Worksheet);
+    if (!d->autoFilterRange.isValid())
+        return -1;
+    setDirty();
+    return d->applyAutoFilter();
+}
+
+/*
+  The text of \a cell which the values of the autofilter are compared with.
+ */
+QString WorksheetPrivate::filterText(const CellData &cell) const
+{
+    double number;
+    if (cellNumber(cell, &number)) {
+        char buffer[XLSX_DOUBLE_BUFFER_SIZE];
+        return QString::fromLatin1(buffer, formatDouble(number, buffer));
+    }
+    if (cell.type() == Cell::BooleanType)
+        return cellValue(cell).toBool() ? QStringLiteral("TRUE") : QStringLiteral("FALSE");
+    return cellValue(cell).toString();
+}
+
+/*
+  A filtered column of the autofilter, while it's applied. Whether the
+  shared strings match is only found once for each of them.
+ */
+struct AutoFilterColumn
+{
+    int column;
+    QSet<QString> values; // case folded
+    QHash<int, bool> sharedStringMatches;
+};
+
+int WorksheetPrivate::applyAutoFilter()
+{
+    const int firstRow = autoFilterRange.firstRow() + 1;
+    const int lastRow = autoFilterRange.lastRow();
+    if (firstRow > lastRow)
+        return 0;
+
+    QVector<AutoFilterColumn> columns;
+    QMap<int, QStringList>::const_iterator it = autoFilterColumns.constBegin();
+    for (; it != autoFilterColumns.constEnd(); ++it) {
+        AutoFilterColumn column;
+        column.column = it.key();
+        foreach (const QString &value, it.value())
+            column.values.insert(value.toCaseFolded());
+        columns.append(column);
+    }
+
+    // The rows without cells only show if the empty cells do
+    bool showEmpty = true;
+    for (int k = 0; k < columns.size(); ++k)
+        showEmpty = showEmpty && columns[k].values.contains(QString());
+    QBitArray hidden(lastRow - firstRow + 1, !showEmpty);
+
+    const int end = cellTable.rowLowerBound(lastRow + 1);
+    for (int i = cellTable.rowLowerBound(firstRow); i < end; ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+        const CellRow &cells = cellTable.rowAt(i);
+        bool shown = true;
+        for (int k = 0; k < columns.size() && shown; ++k) {
+            AutoFilterColumn &column = columns[k];
+            const int j = cells.indexOf(column.column);
+            const CellData *cell = j == -1 ? 0 : &cells.cells[j];
+            int sst_idx = -1;
+            if (cell && cell->storage == CellData::SharedString)
+                sst_idx = cell->index;
+            else if (cell && cell->storage == CellData::Extra)
+                sst_idx = cellTable.extra(cell->index).sharedStringIndex;
+            if (sst_idx != -1) {
+                QHash<int, bool>::const_iterator match =
+                    column.sharedStringMatches.constFind(sst_idx);
+                if (match == column.sharedStringMatches.constEnd()) {
+                    const QString text = sharedStrings()->getSharedPlainString(sst_idx);
+                    match = column.sharedStringMatches.insert(
+                        sst_idx, column.values.contains(text.toCaseFolded()));
+                }
+                shown = match.value();
+            } else {
+                const QString text = cell ? filterText(*cell) : QString();
+                shown = column.values.contains(text.toCaseFolded());
+            }
+        }
+        hidden.setBit(cellTable.rowNumberAt(i) - firstRow, !shown);
+    }
+
+    // Set the rows by runs, the visible rows only where they have infos
+    int hiddenCount = 0;
+    int run = 0;
+    while (run < hidden.size()) {
+        const bool hide = hidden.testBit(run);
+        int runEnd = run;
+        while (runEnd + 1 < hidden.size() && hidden.testBit(runEnd + 1) == hide)
+            ++runEnd;
+        const int runFirst = firstRow + run;
+        const int runLast = firstRow + runEnd;
+        bool hasInfos = hide;
+        if (!hide) {
+            QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator info =
+                rowsInfo.upperBound(runLast);
+            hasInfos = info != rowsInfo.constBegin() && (--info).value()->lastRow >= runFirst;
+        }
+        if (hasInfos) {
+            foreach (const QSharedPointer<XlsxRowInfo> &info, rowInfoRange(runFirst, runLast))
+                info->hidden = hide;
+        }
+        if (hide)
+            hiddenCount += runEnd - run + 1;
+        run = runEnd + 1;
     }
+    return hiddenCount;
+}
+
+/*!
+ * Insert an \a image  at the position \a row, \a column
+ * Returns true on success.
+ */
+bool Worksheet::insertImage(int row, int column, const QImage &image)
+{
+    Q_D(Worksheet);
+    setDirty();
+
+    if (image.isNull())
+        return false;
+
+    if (!d->drawing)
+        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
+    d->drawing->load();
+    d->drawing->setDirty();
+
+    DrawingOneCellAnchor *anchor =
+        new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
+
+    /*
+        The size are expressed as English Metric Units (EMUs). There are
+        12,700 EMUs per point. Therefore, 12,700 * 3 /4 = 9,525 EMUs per
+        pixel
+    */
+    anchor->from = XlsxMarker(row, column, 0, 0);
+    anchor->ext = QSize(image.width() * 9525, image.height() * 9525);
 
-    QSharedPointer<Cell> data = QSharedPointer<Cell>(new Cell(result, Cell::NumberType, fmt, this));
-    data->d_ptr->formula = formula;
-    d->cellTable[row][column] = data;
+    anchor->setObjectPicture(image);
+    return true;
+}
 
-    CellRange range = formula.reference();
-    if (formula.formulaType() == CellFormula::SharedType) {
-        CellFormula sf(QString(), CellFormula::SharedType);
-        sf.d->si = formula.sharedIndex();
-        for (int r = range.firstRow(); r <= range.lastRow(); ++r) {
-            for (int c = range.firstColumn(); c <= range.lastColumn(); ++c) {
-                if (!(r == row && c == column)) {
-                    if (Cell *cell = cellAt(r, c)) {
-                        cell->d_ptr->formula = sf;
-                    } else {
-                        QSharedPointer<Cell> newCell =
-                            QSharedPointer<Cell>(new Cell(result, Cell::NumberType, fmt, this));
-                        newCell->d_ptr->formula = sf;
-                        d->cellTable[r][c] = newCell;
-                    }
-                }
-            }
+/*!
+ * Inserts the \a images one below the other, the first one at the top
+ * left corner of the cell \a row, \a column, leaving \a spacing pixels
+ * between them. The cells in which the images start are found from the
+ * heights of the rows, so that images which cross rows of different
+ * heights still don't overlap.
+ *
+ * Returns false if one of the images is null, the others are inserted.
+ */
+bool Worksheet::insertImages(int row, int column, const QList<QImage> &images, int spacing)
+{
+    Q_D(Worksheet);
+    setDirty();
+
+    if (!d->drawing)
+        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
+    d->drawing->load();
+    d->drawing->setDirty();
+
+    // The markers count the rows from 0
+    const PixelAxis &rows = d->rowPixels();
+    qint64 y = rows.offset(row + 1);
+    bool ok = true;
+    foreach (const QImage &image, images) {
+        if (image.isNull()) {
+            ok = false;
+            continue;
         }
-    } else if (formula.formulaType() == CellFormula::SharedType) {
+
+        int rowOffset;
+        const int imageRow = rows.indexAt(y, &rowOffset) - 1;
+        DrawingOneCellAnchor *anchor =
+            new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
+        anchor->from = XlsxMarker(imageRow, column, rowOffset * 9525, 0);
+        anchor->ext = QSize(image.width() * 9525, image.height() * 9525);
+        anchor->setObjectPicture(image);
+        y += image.height() + spacing;
+    }
+    return ok;
+}
+
+/*!
+ * \overload
+ *
+ * Insert the \a encoded bytes of an image, such as the content of a JPEG
+ * or PNG file, at the position \a row, \a column. The bytes are stored as
+ * they are, without being decoded and encoded again, and \a suffix, such
+ * as "jpeg" or "png", gives their format.
+ *
+ * The size of the image is \a pixelSize. When it isn't valid, it is read
+ * from the header of the image, without decoding it.
+ *
+ * Returns true on success.
+ */
+bool Worksheet::insertImage(int row, int column, const QByteArray &encoded,
+                            const QString &suffix, const QSize &pixelSize)
+{
+    Q_D(Worksheet);
+    setDirty();
+
+    if (encoded.isEmpty() || suffix.isEmpty())
+        return false;
+
+    QSize size = pixelSize;
+    if (!size.isValid()) {
+        QBuffer buffer;
+        buffer.setData(encoded);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, suffix.toLatin1());
+        size = reader.size();
+        if (!size.isValid())
+            return false;
     }
 
+    if (!d->drawing)
+        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
+    d->drawing->load();
+    d->drawing->setDirty();
+
+    DrawingOneCellAnchor *anchor =
+        new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
+    anchor->from = XlsxMarker(row, column, 0, 0);
+    anchor->ext = QSize(size.width() * 9525, size.height() * 9525);
+
+    anchor->setObjectPicture(encoded, suffix);
     return true;
 }
 
 /*!
-    \overload
-    Write a empty cell \a row_column with the \a format.
-    Returns true on success.
+ * Creates an chart with the given \a size and insert
+ * at the position \a row, \a column.
+ * The chart will be returned.
  */
-bool Worksheet::writeBlank(const CellReference &row_column, const Format &format)
+Chart *Worksheet::insertChart(int row, int column, const QSize &size)
 {
-    if (!row_column.isValid())
-        return false;
+    Q_D(Worksheet);
+    setDirty();
 
-    return writeBlank(row_column.row(), row_column.column(), format);
+    if (!d->drawing)
+        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
+    d->drawing->load();
+    d->drawing->setDirty();
+
+    DrawingOneCellAnchor *anchor =
+        new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
+
+    /*
+        The size are expressed as English Metric Units (EMUs). There are
+        12,700 EMUs per point. Therefore, 12,700 * 3 /4 = 9,525 EMUs per
+        pixel
+    */
+    anchor->from = XlsxMarker(row, column, 0, 0);
+    anchor->ext = size * 9525;
+
+    QSharedPointer<Chart> chart = QSharedPointer<Chart>(new Chart(this, F_NewFromScratch));
+    anchor->setObjectGraphicFrame(chart);
+
+    return chart.data();
 }
 
 /*!
-    Write a empty cell (\a row, \a column) with the \a format.
-    Returns true on success.
+    Insert \a count empty rows before \a row. The cells, the row heights and
+    formats, the merged cells, the hyperlinks, the comments, the data
+    validations and the conditional formattings of the rows below move
+    down, and the ranges the rows are inserted into grow. The formulas of
+    the sheet are rewritten to refer to the cells where they moved. The
+    rows pushed past the last row of a sheet are lost.
+
+    Returns false if \a row or \a count are out of range, or when the
+    constant memory mode is enabled.
+
+    \sa removeRows(), insertColumns()
  */
-bool Worksheet::writeBlank(int row, int column, const Format &format)
+bool Worksheet::insertRows(int row, int count)
 {
     Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
+    if (row < 1 || row > XLSX_ROW_MAX || count < 1)
         return false;
+    setDirty();
+    return d->shiftCells(true, row, qMin(count, XLSX_ROW_MAX - row + 1));
+}
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    d->workbook->styles()->addXfFormat(fmt);
+/*!
+    Remove the \a count rows from \a row on, and move the rows below them
+    up, along with everything insertRows() moves. The references of the
+    formulas to removed cells become #REF!.
 
-    // Note: NumberType with an invalid QVariant value means blank.
-    d->cellTable[row][column] =
-        QSharedPointer<Cell>(new Cell(QVariant(), Cell::NumberType, fmt, this));
+    Returns false if \a row or \a count are out of range, or when the
+    constant memory mode is enabled.
 
-    return true;
+    \sa insertRows(), removeColumns()
+ */
+bool Worksheet::removeRows(int row, int count)
+{
+    Q_D(Worksheet);
+    if (row < 1 || row > XLSX_ROW_MAX || count < 1)
+        return false;
+    setDirty();
+    return d->shiftCells(true, row, -qMin(count, XLSX_ROW_MAX - row + 1));
 }
+
 /*!
-    \overload
-    Write a bool \a value to the cell \a row_column with the \a format.
-    Returns true on success.
+    Insert \a count empty columns before \a column, moving the columns on
+    its right as insertRows() moves the rows.
+
+    Returns false if \a column or \a count are out of range, or when the
+    constant memory mode is enabled.
+
+    \sa removeColumns(), insertRows()
  */
-bool Worksheet::writeBool(const CellReference &row_column, bool value, const Format &format)
+bool Worksheet::insertColumns(int column, int count)
 {
-    if (!row_column.isValid())
+    Q_D(Worksheet);
+    if (column < 1 || column > XLSX_COLUMN_MAX || count < 1)
         return false;
-
-    return writeBool(row_column.row(), row_column.column(), value, format);
+    setDirty();
+    return d->shiftCells(false, column, qMin(count, XLSX_COLUMN_MAX - column + 1));
 }
 
 /*!
-    Write a bool \a value to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
+    Remove the \a count columns from \a column on, moving the columns on
+    their right as removeRows() moves the rows.
+
+    Returns false if \a column or \a count are out of range, or when the
+    constant memory mode is enabled.
+
+    \sa insertColumns(), removeRows()
  */
-bool Worksheet::writeBool(int row, int column, bool value, const Format &format)
+bool Worksheet::removeColumns(int column, int count)
 {
     Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
+    if (column < 1 || column > XLSX_COLUMN_MAX || count < 1)
         return false;
+    setDirty();
+    return d->shiftCells(false, column, -qMin(count, XLSX_COLUMN_MAX - column + 1));
+}
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    d->workbook->styles()->addXfFormat(fmt);
-    d->cellTable[row][column] = QSharedPointer<Cell>(new Cell(value, Cell::BooleanType, fmt, this));
+/*
+  Returns \a range moved along with its cells, or an invalid range if all
+  of its cells are removed. See shiftSpan().
+ */
+static CellRange shiftedRange(const CellRange &range, bool rows, int first, int count, int max)
+{
+    int from = rows ? range.firstRow() : range.firstColumn();
+    int to = rows ? range.lastRow() : range.lastColumn();
+    if (!shiftSpan(&from, &to, first, count, max))
+        return CellRange();
+    if (rows)
+        return CellRange(from, range.firstColumn(), to, range.lastColumn());
+    return CellRange(range.firstRow(), from, range.lastRow(), to);
+}
+
+static QList<CellRange> shiftedRanges(const QList<CellRange> &ranges, bool rows, int first,
+                                      int count, int max)
+{
+    QList<CellRange> shifted;
+    foreach (const CellRange &range, ranges) {
+        const CellRange moved = shiftedRange(range, rows, first, count, max);
+        if (moved.isValid())
+            shifted.append(moved);
+    }
+    return shifted;
+}
+
+/*
+  Move the entries of \a map, keyed by row and column, along with their
+  cells. The entries of the removed cells are dropped.
+ */
+template <typename T>
+static void shiftCellMap(QMap<int, QMap<int, T>> &map, bool rows, int first, int count, int max)
+{
+    QMap<int, QMap<int, T>> shifted;
+    typename QMap<int, QMap<int, T>>::const_iterator it = map.constBegin();
+    for (; it != map.constEnd(); ++it) {
+        int row = it.key();
+        if (rows) {
+            if (shiftSpan(&row, &row, first, count, max))
+                shifted.insert(row, it.value());
+            continue;
+        }
+        QMap<int, T> columns;
+        typename QMap<int, T>::const_iterator jt = it.value().constBegin();
+        for (; jt != it.value().constEnd(); ++jt) {
+            int column = jt.key();
+            if (shiftSpan(&column, &column, first, count, max))
+                columns.insert(column, jt.value());
+        }
+        if (!columns.isEmpty())
+            shifted.insert(row, columns);
+    }
+    map.swap(shifted);
+}
+
+/*
+  Insert \a count rows, or columns when \a rows is false, before \a first,
+  or remove -\a count of them from \a first on. Each of the tables the
+  sheet keeps by cell is gone over once; the cells themselves only have
+  their row numbers or columns changed.
+ */
+bool WorksheetPrivate::shiftCells(bool rows, int first, int count)
+{
+    if (constantMemory)
+        return false;
+    const int max = rows ? XLSX_ROW_MAX : XLSX_COLUMN_MAX;
+
+    // The formulas are rewritten where they are, before the cells move
+    shiftFormulas(rows, first, count, max);
+
+    // The cells removed, or pushed past the end of the sheet
+    const int removedFirst = count < 0 ? first : max - count + 1;
+    const int removedCount = qAbs(count);
+    releaseCells(rows, removedFirst, removedCount);
+    if (rows) {
+        if (count > 0) {
+            cellTable.removeRows(removedFirst, removedCount);
+            cellTable.insertRows(first, count);
+        } else {
+            cellTable.removeRows(removedFirst, removedCount);
+        }
+    } else {
+        if (count > 0) {
+            cellTable.removeColumns(removedFirst, removedCount);
+            cellTable.insertColumns(first, count);
+        } else {
+            cellTable.removeColumns(removedFirst, removedCount);
+        }
+    }
 
+    // The Cell objects handed out move along with their cells
+    QHash<quint64, Cell *> cells;
+    QHash<quint64, Cell *>::const_iterator it = cellCache.constBegin();
+    for (; it != cellCache.constEnd(); ++it) {
+        int row = int(it.key() >> 32);
+        int col = int(it.key() & 0xffffffff);
+        if (shiftSpan(rows ? &row : &col, rows ? &row : &col, first, count, max))
+            cells.insert(cellKey(row, col), it.value());
+        else
+            cellPool.destroy(it.value());
+    }
+    cellCache.swap(cells);
+    for (it = cellCache.constBegin(); it != cellCache.constEnd(); ++it)
+        updateCachedCell(int(it.key() >> 32), int(it.key() & 0xffffffff));
+
+    shiftCellMap(comments, rows, first, count, max);
+    urlTable.shift(rows, first, count, max);
+    shiftRanges(rows, first, count, max);
+
+    if (dimension.isValid()) {
+        dimension = shiftedRange(dimension, rows, first, count, max);
+        updateDimension();
+    }
+
+    row_spans.clear();
+    cfEvaluator.reset();
+    valueIndex.reset();
+    rowAxis.reset();
+    columnAxis.reset();
+    // Built again from the moved cells by the next recalculation
+    formulaEngine.reset();
     return true;
 }
+
+/*
+  Rewrite the formulas of the cells which are not removed, so that they
+  refer to the cells where they move. The cells of the shared formulas get
+  their own formulas, as the rows or columns inserted into a shared range
+  or its references would change its cells differently; they are shared
+  again when the sheet is saved.
+ */
+void WorksheetPrivate::shiftFormulas(bool rows, int first, int count, int max)
+{
+    for (int i = 0; i < cellTable.size(); ++i) {
+        const int row = cellTable.rowNumberAt(i);
+        if (rows && count < 0 && row >= first && row < first - count)
+            continue;
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const CellData &data = cells.cells[j];
+            if (data.storage != CellData::Extra || !cellTable.extra(data.index).formula.isValid())
+                continue;
+            const int col = cells.columns[j];
+            if (!rows && count < 0 && col >= first && col < first - count)
+                continue;
+
+            CellFormula &formula = cellTable.extra(data.index).formula;
+            CellFormula::FormulaType type = formula.formulaType();
+            QString text = formula.formulaText();
+            CellRange reference = formula.reference();
+            if (type == CellFormula::SharedType) {
+                if (text.isEmpty())
+                    text = sharedFormulaTemplate(formula.sharedIndex())
+                               .formulaText(CellReference(row, col));
+                type = CellFormula::NormalType;
+                reference = CellRange();
+            } else if (reference.isValid()) {
+                reference = shiftedRange(reference, rows, first, count, max);
+            }
+
+            CellFormula shifted(
+                SharedFormulaTemplate(text, CellReference(row, col)).shiftedText(rows, first,
+                                                                                 count, max),
+                reference, type);
+            shifted.d->ca = formula.d->ca;
+            formula = shifted;
+        }
+    }
+
+    sharedFormulaMap.clear();
+    sharedFormulaTemplates.clear();
+    sharedFormulaTexts.clear();
+}
+
+/*
+  Release the shared strings of the cells of the \a count rows, or columns
+  when \a rows is false, from \a first on, which are about to be removed.
+ */
+void WorksheetPrivate::releaseCells(bool rows, int first, int count)
+{
+    const int end = rows ? cellTable.rowLowerBound(first + count) : cellTable.size();
+    for (int i = rows ? cellTable.rowLowerBound(first) : 0; i < end; ++i) {
+        const CellRow &cells = cellTable.rowAt(i);
+        const int cellEnd = rows ? cells.size() : cells.lowerBound(first + count);
+        for (int j = rows ? 0 : cells.lowerBound(first); j < cellEnd; ++j)
+            releaseSharedString(cells.cells[j]);
+    }
+}
+
+/*
+  Move the ranges of the merged cells, the data validations, the
+  conditional formattings and the autofilter, and of the row or column
+  infos. The ranges
+  whose cells are all removed are dropped, and so are the merges left
+  with a single cell.
+ */
+void WorksheetPrivate::shiftRanges(bool rows, int first, int count, int max)
+{
+    const QList<CellRange> oldMerges = merges;
+    merges.clear();
+    mergeIndex.clear();
+    removedMerges = 0;
+    foreach (const CellRange &range, oldMerges) {
+        if (!range.isValid())
+            continue;
+        const CellRange moved = shiftedRange(range, rows, first, count, max);
+        if (moved.isValid() && (moved.rowCount() > 1 || moved.columnCount() > 1))
+            addMerge(moved);
+    }
+
+    const QList<DataValidation> validations = dataValidationsList;
+    dataValidationsList.clear();
+    dataValidationKeys.clear();
+    dataValidationIndex.clear();
+    foreach (DataValidation validation, validations) {
+        validation.d->ranges = shiftedRanges(validation.d->ranges, rows, first, count, max);
+        if (!validation.d->ranges.isEmpty())
+            addDataValidation(validation);
+    }
+
+    const QList<ConditionalFormatting> formattings = conditionalFormattingList;
+    conditionalFormattingList.clear();
+    conditionalFormattingKeys.clear();
+    conditionalFormattingIndex.clear();
+    foreach (ConditionalFormatting cf, formattings) {
+        cf.d->ranges = shiftedRanges(cf.d->ranges, rows, first, count, max);
+        if (!cf.d->ranges.isEmpty())
+            addConditionalFormatting(cf);
+    }
+
+    if (autoFilterRange.isValid()) {
+        autoFilterRange = shiftedRange(autoFilterRange, rows, first, count, max);
+        QMap<int, QStringList> filterColumns;
+        QMap<int, QStringList>::const_iterator it = autoFilterColumns.constBegin();
+        for (; it != autoFilterColumns.constEnd() && autoFilterRange.isValid(); ++it) {
+            int column = it.key();
+            if (rows || shiftSpan(&column, &column, first, count, max))
+                filterColumns.insert(column, it.value());
+        }
+        autoFilterColumns.swap(filterColumns);
+    }
+
+    if (rows) {
+        QMap<int, QSharedPointer<XlsxRowInfo>> infos;
+        foreach (const QSharedPointer<XlsxRowInfo> &info, rowsInfo) {
+            if (shiftSpan(&info->firstRow, &info->lastRow, first, count, max))
+                infos.insert(info->firstRow, info);
+        }
+        rowsInfo.swap(infos);
+    } else {
+        QMap<int, QSharedPointer<XlsxColumnInfo>> infos;
+        foreach (const QSharedPointer<XlsxColumnInfo> &info, colsInfo) {
+            if (shiftSpan(&info->firstColumn, &info->lastColumn, first, count, max))
+                infos.insert(info->firstColumn, info);
+        }
+        colsInfo.swap(infos);
+    }
+}
+
 /*!
-    \overload
-    Write a QDateTime \a dt to the cell \a row_column with the \a format.
-    Returns true on success.
+    Clear the cells of \a range. With ClearValues, the values, the formulas
+    and the hyperlinks are removed and the formatted cells are left blank;
+    with ClearFormats, the formats are removed; ClearAll removes the cells
+    along with their comments. Merged cells, data validations and
+    conditional formattings are left as they are.
+
+    Returns false if \a range is not valid, or when the constant memory
+    mode is enabled.
  */
-bool Worksheet::writeDateTime(const CellReference &row_column, const QDateTime &dt,
-                              const Format &format)
+bool Worksheet::clear(const CellRange &range, ClearOptions options)
 {
-    if (!row_column.isValid())
+    Q_D(Worksheet);
+    if (!range.isValid() || d->constantMemory)
         return false;
+    setDirty();
 
-    return writeDateTime(row_column.row(), row_column.column(), dt, format);
+    QHash<int, int> sstRefs;
+    d->clearCells(range, options, sstRefs);
+    d->addSharedStringRefs(sstRefs);
+    d->updateCachedCells(range);
+    return true;
 }
 
 /*!
-    Write a QDateTime \a dt to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
+    Copy the cells of \a source, with their values, formats, formulas,
+    hyperlinks and comments, to the range of the same size whose top left
+    cell is \a destination. The cells of the destination range are
+    replaced, the empty cells of \a source included. The relative
+    references of the formulas are moved as far as the cells are. Merged
+    cells, data validations and conditional formattings are not copied.
+
+    Returns false if \a source is not valid or the destination range goes
+    past the end of the sheet, or when the constant memory mode is enabled.
+
+    \sa moveRange()
  */
-bool Worksheet::writeDateTime(int row, int column, const QDateTime &dt, const Format &format)
+bool Worksheet::copyRange(const CellRange &source, const CellReference &destination)
 {
     Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
+    setDirty();
+    return d->copyCells(source, destination, false);
+}
+
+/*!
+    Move the cells of \a source to the range of the same size whose top
+    left cell is \a destination, as copyRange() does but leaving the cells
+    of \a source which are not in the destination range empty. The
+    formulas moved keep their references.
+
+    \sa copyRange()
+ */
+bool Worksheet::moveRange(const CellRange &source, const CellReference &destination)
+{
+    Q_D(Worksheet);
+    setDirty();
+    return d->copyCells(source, destination, true);
+}
+
+/*
+  Count \a count more references of \a cell to its shared string in
+  \a sstRefs, if it has one.
+ */
+void WorksheetPrivate::countSharedStringRef(const CellData &cell, int count,
+                                            QHash<int, int> &sstRefs) const
+{
+    if (cell.cellType != Cell::SharedStringType || cell.storage == CellData::Blank)
+        return;
+    const int sst_idx = cell.storage == CellData::Extra
+        ? cellTable.extra(cell.index).sharedStringIndex
+        : cell.index;
+    if (sst_idx != -1)
+        sstRefs[sst_idx] += count;
+}
+
+/*
+  Add the references counted by countSharedStringRef() to the shared
+  strings, once for each string.
+ */
+void WorksheetPrivate::addSharedStringRefs(const QHash<int, int> &sstRefs)
+{
+    QHash<int, int>::const_iterator it = sstRefs.constBegin();
+    for (; it != sstRefs.constEnd(); ++it) {
+        if (!deferSstRefs)
+            sharedStrings()->incRefByStringIndex(it.key(), it.value());
+        else if (it.key() >= 0 && it.key() < sstRefCounts.size())
+            sstRefCounts[it.key()] += it.value();
+    }
+}
+
+/*
+  Bring the Cell objects handed out for the cells of \a range up to date,
+  going over the cached cells or the range, whichever is smaller.
+ */
+void WorksheetPrivate::updateCachedCells(const CellRange &range) const
+{
+    if (qint64(range.rowCount()) * range.columnCount() > cellCache.size()) {
+        const QList<quint64> keys = cellCache.keys();
+        foreach (quint64 key, keys) {
+            const int row = int(key >> 32);
+            const int col = int(key & 0xffffffff);
+            if (row >= range.firstRow() && row <= range.lastRow() && col >= range.firstColumn()
+                && col <= range.lastColumn()) {
+                updateCachedCell(row, col);
+            }
+        }
+        return;
+    }
+    for (int row = range.firstRow(); row <= range.lastRow(); ++row) {
+        for (int col = range.firstColumn(); col <= range.lastColumn(); ++col)
+            updateCachedCell(row, col);
+    }
+}
+
+/*
+  Remove the entries of \a map, keyed by row and column, which are in \a range.
+ */
+template <typename T>
+static void removeCellEntries(QMap<int, QMap<int, T>> &map, const CellRange &range)
+{
+    typename QMap<int, QMap<int, T>>::iterator it = map.lowerBound(range.firstRow());
+    while (it != map.end() && it.key() <= range.lastRow()) {
+        typename QMap<int, T>::iterator jt = it.value().lowerBound(range.firstColumn());
+        while (jt != it.value().end() && jt.key() <= range.lastColumn())
+            jt = it.value().erase(jt);
+        if (it.value().isEmpty())
+            it = map.erase(it);
+        else
+            ++it;
+    }
+}
+
+/*
+  Clear the cells of \a range as Worksheet::clear() does with \a options.
+  The references to the shared strings which are released are counted in
+  \a sstRefs.
+ */
+void WorksheetPrivate::clearCells(const CellRange &range, Worksheet::ClearOptions options,
+                                  QHash<int, int> &sstRefs)
+{
+    const int end = cellTable.rowLowerBound(range.lastRow() + 1);
+    for (int i = cellTable.rowLowerBound(range.firstRow()); i < end; ++i) {
+        CellRow &cells = cellTable.rowAt(i);
+        const int cellEnd = cells.lowerBound(range.lastColumn() + 1);
+        for (int j = cells.lowerBound(range.firstColumn()); j < cellEnd; ++j) {
+            if (options & Worksheet::ClearValues)
+                countSharedStringRef(cells.cells[j], -1, sstRefs);
+            else
+                cells.cells[j].xfIndex = -1;
+        }
+    }
+    if (options & Worksheet::ClearValues) {
+        cellTable.removeCells(range.firstRow(), range.firstColumn(), range.lastRow(),
+                              range.lastColumn(), !(options & Worksheet::ClearFormats));
+    }
+
+    if (options & Worksheet::ClearValues)
+        urlTable.remove(range);
+    if ((options & Worksheet::ClearAll) == Worksheet::ClearAll)
+        removeCellEntries(comments, range);
+    updateDimension();
+
+    // Built again by the next recalculation, rather than told about each
+    // cell of what may be whole columns
+    formulaEngine.reset();
+    cfEvaluator.reset();
+    valueIndex.reset();
+}
+
+// A cell read by copyCells(), at its destination
+struct CopiedCell
+{
+    int row;
+    int column;
+    CellData data; // the index of the extra data is in the copied ones
+};
+
+/*
+  Copy, or move when \a move is true, the cells of \a source to the range
+  whose top left cell is \a destination. The cells are read from the table
+  first, so that the ranges can overlap, and the references to the shared
+  strings are counted for all of them at once.
+ */
+bool WorksheetPrivate::copyCells(const CellRange &source, const CellReference &destination,
+                                 bool move)
+{
+    if (!source.isValid() || !destination.isValid() || constantMemory)
         return false;
+    const CellRange target(destination.row(), destination.column(),
+                           destination.row() + source.rowCount() - 1,
+                           destination.column() + source.columnCount() - 1);
+    if (target.lastRow() > XLSX_ROW_MAX || target.lastColumn() > XLSX_COLUMN_MAX)
+        return false;
+    if (checkDimensions(target.firstRow(), target.firstColumn())
+        || checkDimensions(target.lastRow(), target.lastColumn())) {
+        return false;
+    }
+    const int rowOffset = target.firstRow() - source.firstRow();
+    const int columnOffset = target.firstColumn() - source.firstColumn();
+
+    QVector<CopiedCell> copied;
+    QVector<CellExtraData> extras;
+    QHash<int, int> sstRefs;
+
+    const int end = cellTable.rowLowerBound(source.lastRow() + 1);
+    for (int i = cellTable.rowLowerBound(source.firstRow()); i < end; ++i) {
+        const int row = cellTable.rowNumberAt(i);
+        const CellRow &cells = cellTable.rowAt(i);
+        const int cellEnd = cells.lowerBound(source.lastColumn() + 1);
+        for (int j = cells.lowerBound(source.firstColumn()); j < cellEnd; ++j) {
+            const int col = cells.columns[j];
+            CopiedCell cell = {row + rowOffset, col + columnOffset, cells.cells[j]};
+            if (!move)
+                countSharedStringRef(cell.data, 1, sstRefs);
+            if (cell.data.storage != CellData::Extra) {
+                copied.append(cell);
+                continue;
+            }
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    if (!fmt.isValid() || !fmt.isDateTimeFormat())
-        fmt.setNumberFormat(d->workbook->defaultDateFormat());
-    d->workbook->styles()->addXfFormat(fmt);
+            // The extra data are added again, with the formula moved along
+            CellExtraData extra = cellTable.extra(cell.data.index);
+            if (extra.formula.isValid()) {
+                const CellFormula &formula = extra.formula;
+                CellFormula::FormulaType type = formula.formulaType();
+                QString text = formula.formulaText();
+                CellRange reference = formula.reference();
+                if (type == CellFormula::SharedType) {
+                    if (text.isEmpty())
+                        text = sharedFormulaTemplate(formula.sharedIndex())
+                                   .formulaText(CellReference(row, col));
+                    type = CellFormula::NormalType;
+                    reference = CellRange();
+                } else if (reference.isValid()) {
+                    reference = CellRange(reference.firstRow() + rowOffset,
+                                          reference.firstColumn() + columnOffset,
+                                          reference.lastRow() + rowOffset,
+                                          reference.lastColumn() + columnOffset);
+                }
+                if (!move) {
+                    text = SharedFormulaTemplate(text, CellReference(row, col))
+                               .formulaText(CellReference(cell.row, cell.column));
+                }
+                CellFormula moved(text, reference, type);
+                moved.d->ca = formula.d->ca;
+                extra.formula = moved;
+            }
+            cell.data.index = extras.size();
+            extras.append(extra);
+            copied.append(cell);
+        }
+    }
 
-    double value = datetimeToNumber(dt, d->workbook->isDate1904());
+    // The hyperlinks and the comments go along with the cells
+    QVector<HyperlinkTable::Link> links = urlTable.links(source);
+    for (int i = 0; i < links.size(); ++i) {
+        links[i].row += rowOffset;
+        links[i].column += columnOffset;
+    }
+    QList<QPair<CellReference, QString>> notes;
+    QMap<int, QMap<int, QString>>::const_iterator noteIt = comments.lowerBound(source.firstRow());
+    for (; noteIt != comments.constEnd() && noteIt.key() <= source.lastRow(); ++noteIt) {
+        QMap<int, QString>::const_iterator it = noteIt.value().lowerBound(source.firstColumn());
+        for (; it != noteIt.value().constEnd() && it.key() <= source.lastColumn(); ++it) {
+            notes.append(qMakePair(CellReference(noteIt.key() + rowOffset, it.key() + columnOffset),
+                                   it.value()));
+        }
+    }
+
+    // The moved cells keep their references to the shared strings
+    if (move) {
+        QHash<int, int> movedRefs;
+        clearCells(source, Worksheet::ClearAll, movedRefs);
+    }
+    clearCells(target, Worksheet::ClearAll, sstRefs);
+
+    for (int i = 0; i < copied.size(); ++i) {
+        CellData data = copied[i].data;
+        if (data.storage == CellData::Extra)
+            data.index = cellTable.addExtra(extras[data.index]);
+        cellTable.setCell(copied[i].row, copied[i].column, data);
+    }
+    addSharedStringRefs(sstRefs);
+    valueIndex.reset();
 
-    d->cellTable[row][column] = QSharedPointer<Cell>(new Cell(value, Cell::NumberType, fmt, this));
+    urlTable.insert(links);
+    for (int i = 0; i < notes.size(); ++i)
+        comments[notes[i].first.row()][notes[i].first.column()] = notes[i].second;
 
+    if (move)
+        updateCachedCells(source);
+    updateCachedCells(target);
     return true;
 }
 
 /*!
-    \overload
-    Write a QTime \a t to the cell \a row_column with the \a format.
-    Returns true on success.
+    Sort the rows of \a range by the values of their cells in \a column,
+    in the given \a order. See the other overload.
  */
-bool Worksheet::writeTime(const CellReference &row_column, const QTime &t, const Format &format)
+bool Worksheet::sortRange(const CellRange &range, int column, Qt::SortOrder order)
 {
-    if (!row_column.isValid())
-        return false;
-
-    return writeTime(row_column.row(), row_column.column(), t, format);
+    return sortRange(range, QList<QPair<int, Qt::SortOrder>>() << qMakePair(column, order));
 }
 
 /*!
-    Write a QTime \a t to the cell (\a row, \a column) with the \a format.
-    Returns true on success.
+    Sort the rows of \a range by the values of their cells in the columns
+    of \a keys, the first key coming first, each in its own order. As in
+    Excel, numbers come before texts, which are compared without regard
+    to case, then booleans and errors, or the other way round in
+    descending order; the empty cells always come last. Rows with equal
+    keys keep their order.
+
+    Only the cells of \a range move, with their formats, formulas and
+    hyperlinks, and with their comments. The relative references of the
+    formulas are moved as far as the cells are, as copyRange() does.
+
+    Returns false if \a range is not valid, if a key is not a column of
+    \a range, if \a range contains merged cells, or when the constant
+    memory mode is enabled.
+
+    \sa moveRange()
  */
-bool Worksheet::writeTime(int row, int column, const QTime &t, const Format &format)
+bool Worksheet::sortRange(const CellRange &range, const QList<QPair<int, Qt::SortOrder>> &keys)
 {
     Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
+    if (!d->sortCells(range, keys))
         return false;
+    setDirty();
+    return true;
+}
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    if (!fmt.isValid() || !fmt.isDateTimeFormat())
-        fmt.setNumberFormat(QStringLiteral("hh:mm:ss"));
-    d->workbook->styles()->addXfFormat(fmt);
+namespace {
 
-    d->cellTable[row][column] =
-        QSharedPointer<Cell>(new Cell(timeToNumber(t), Cell::NumberType, fmt, this));
+// Ranges of this many rows are sorted by all the threads
+const int ParallelSortRows = 64 * 1024;
 
-    return true;
-}
+enum SortValueType { SortNumber, SortText, SortBoolean, SortError, SortBlank };
 
-/*!
-    \overload
-    Write a QUrl \a url to the cell \a row_column with the given \a format \a display and \a tip.
-    Returns true on success.
- */
-bool Worksheet::writeHyperlink(const CellReference &row_column, const QUrl &url,
-                               const Format &format, const QString &display, const QString &tip)
+// The value of one key of one row, a number, the rank of a text among the
+// texts of the keys, or 0 and 1 for the booleans
+struct SortKeyValue
 {
-    if (!row_column.isValid())
-        return false;
-
-    return writeHyperlink(row_column.row(), row_column.column(), url, format, display, tip);
-}
+    int type;
+    double value;
+};
 
-/*!
-    Write a QUrl \a url to the cell (\a row, \a column) with the given \a format \a display and \a
-   tip. Returns true on success.
+/*
+  Orders the rows of a range, given by their offsets, by the values of
+  their keys, which are stored one row after another.
  */
-bool Worksheet::writeHyperlink(int row, int column, const QUrl &url, const Format &format,
-                               const QString &display, const QString &tip)
+class SortRowLessThan
 {
-    Q_D(Worksheet);
-    if (d->checkDimensions(row, column))
-        return false;
+public:
+    SortRowLessThan(const SortKeyValue *values, const QVector<Qt::SortOrder> &orders)
+        : m_values(values)
+        , m_orders(orders.constData())
+        , m_count(orders.size())
+    {
+    }
 
-    // int error = 0;
+    bool operator()(int a, int b) const
+    {
+        const SortKeyValue *x = m_values + qint64(a) * m_count;
+        const SortKeyValue *y = m_values + qint64(b) * m_count;
+        for (int k = 0; k < m_count; ++k) {
+            // The blanks are last in both orders
+            if (x[k].type == SortBlank || y[k].type == SortBlank) {
+                if (x[k].type != y[k].type)
+                    return y[k].type == SortBlank;
+                continue;
+            }
+            int c = x[k].type - y[k].type;
+            if (c == 0)
+                c = x[k].value < y[k].value ? -1 : (x[k].value > y[k].value ? 1 : 0);
+            if (c != 0)
+                return m_orders[k] == Qt::AscendingOrder ? c < 0 : c > 0;
+        }
+        return false;
+    }
 
-    QString urlString = url.toString();
+private:
+    const SortKeyValue *m_values;
+    const Qt::SortOrder *m_orders;
+    int m_count;
+};
 
-    // Generate proper display string
-    QString displayString = display.isEmpty() ? urlString : display;
-    if (displayString.startsWith(QLatin1String("mailto:")))
-        displayString.replace(QLatin1String("mailto:"), QString());
-    if (displayString.size() > XLSX_STRING_MAX) {
-        displayString = displayString.left(XLSX_STRING_MAX);
-        // error = -2;
+class SortSliceTask : public QRunnable
+{
+public:
+    SortSliceTask(int *begin, int *end, const SortRowLessThan &lessThan)
+        : m_begin(begin)
+        , m_end(end)
+        , m_lessThan(lessThan)
+    {
     }
 
-    /*
-      Location within target. If target is a workbook (or this workbook)
-      this shall refer to a sheet and cell or a defined name. Can also
-      be an HTML anchor if target is HTML file.
+    void run() { std::stable_sort(m_begin, m_end, m_lessThan); }
 
-      c:\temp\file.xlsx#Sheet!A1
-      http://a.com/aaa.html#aaaaa
-    */
-    QString locationString;
-    if (url.hasFragment()) {
-        locationString = url.fragment();
-        urlString = url.toString(QUrl::RemoveFragment);
-    }
+private:
+    int *m_begin;
+    int *m_end;
+    SortRowLessThan m_lessThan;
+};
 
-    Format fmt = format.isValid() ? format : d->cellFormat(row, column);
-    // Given a default style for hyperlink
-    if (!fmt.isValid()) {
-        fmt.setFontColor(Qt::blue);
-        fmt.setFontUnderline(Format::FontUnderlineSingle);
+// Orders the case folded texts of the keys by their indexes
+class TextLessThan
+{
+public:
+    explicit TextLessThan(const QVector<QString> &texts)
+        : m_texts(texts)
+    {
     }
-    d->workbook->styles()->addXfFormat(fmt);
 
-    // Write the hyperlink string as normal string.
-    d->sharedStrings()->addSharedString(displayString);
-    d->cellTable[row][column] =
-        QSharedPointer<Cell>(new Cell(displayString, Cell::SharedStringType, fmt, this));
+    bool operator()(int a, int b) const
+    {
+        return QString::localeAwareCompare(m_texts[a], m_texts[b]) < 0;
+    }
 
-    // Store the hyperlink data in a separate table
-    d->urlTable[row][column] = QSharedPointer<XlsxHyperlinkData>(new XlsxHyperlinkData(
-        XlsxHyperlinkData::External, urlString, locationString, QString(), tip));
+private:
+    const QVector<QString> &m_texts;
+};
 
-    return true;
-}
+} // namespace
 
-/*!
- * Add one DataValidation \a validation to the sheet.
- * Returns true on success.
+/*
+  Move the entries of \a map, keyed by row and column, which are in
+  \a range along with the rows of \a range: the offset of each row goes
+  to \a target[offset].
  */
-bool Worksheet::addDataValidation(const DataValidation &validation)
+template <typename T>
+static void permuteCellEntries(QMap<int, QMap<int, T>> &map, const CellRange &range,
+                               const QVector<int> &target)
 {
-    Q_D(Worksheet);
-    if (validation.ranges().isEmpty() || validation.validationType() == DataValidation::None)
-        return false;
-
-    d->dataValidationsList.append(validation);
-    return true;
+    QList<QPair<CellReference, T>> entries;
+    typename QMap<int, QMap<int, T>>::const_iterator it = map.lowerBound(range.firstRow());
+    for (; it != map.constEnd() && it.key() <= range.lastRow(); ++it) {
+        const int row = range.firstRow() + target[it.key() - range.firstRow()];
+        typename QMap<int, T>::const_iterator jt = it.value().lowerBound(range.firstColumn());
+        for (; jt != it.value().constEnd() && jt.key() <= range.lastColumn(); ++jt)
+            entries.append(qMakePair(CellReference(row, jt.key()), jt.value()));
+    }
+    removeCellEntries(map, range);
+    for (int i = 0; i < entries.size(); ++i)
+        map[entries[i].first.row()][entries[i].first.column()] = entries[i].second;
 }
 
-/*!
- * Add one ConditionalFormatting \a cf to the sheet.
- * Returns true on success.
+/*
+  Give each cell of the shared formulas a formula of its own, so that the
+  cells can be moved one by one. They are shared again when the sheet is saved.
  */
-bool Worksheet::addConditionalFormatting(const ConditionalFormatting &cf)
+void WorksheetPrivate::unshareFormulas()
 {
-    Q_D(Worksheet);
-    if (cf.ranges().isEmpty())
-        return false;
-
-    for (int i = 0; i < cf.d->cfRules.size(); ++i) {
-        const QSharedPointer<XlsxCfRuleData> &rule = cf.d->cfRules[i];
-        if (!rule->dxfFormat.isEmpty())
-            d->workbook->styles()->addDxfFormat(rule->dxfFormat);
-        rule->priority = 1;
+    if (sharedFormulaMap.isEmpty())
+        return;
+    for (int i = 0; i < cellTable.size(); ++i) {
+        const int row = cellTable.rowNumberAt(i);
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const CellData &data = cells.cells[j];
+            if (data.storage != CellData::Extra)
+                continue;
+            CellFormula &formula = cellTable.extra(data.index).formula;
+            if (formula.formulaType() != CellFormula::SharedType)
+                continue;
+            QString text = formula.formulaText();
+            if (text.isEmpty()) {
+                text = sharedFormulaTemplate(formula.sharedIndex())
+                           .formulaText(CellReference(row, cells.columns[j]));
+            }
+            CellFormula normal(text);
+            normal.d->ca = formula.d->ca;
+            formula = normal;
+        }
     }
-    d->conditionalFormattingList.append(cf);
-    return true;
+    sharedFormulaMap.clear();
+    sharedFormulaTemplates.clear();
+    sharedFormulaTexts.clear();
 }
 
-/*!
- * Insert an \a image  at the position \a row, \a column
- * Returns true on success.
+/*
+  Sort the rows of \a range as Worksheet::sortRange() does. The keys are
+  read once into a table of numbers, the texts being replaced by their
+  ranks, so that comparing two rows never touches a string. The rows are
+  then permuted in the cell table, without their values being read again.
  */
-bool Worksheet::insertImage(int row, int column, const QImage &image)
+bool WorksheetPrivate::sortCells(const CellRange &range,
+                                 const QList<QPair<int, Qt::SortOrder>> &keys)
 {
-    Q_D(Worksheet);
-
-    if (image.isNull())
+    if (!range.isValid() || keys.isEmpty() || constantMemory || mergeIndex.intersects(range))
         return false;
+    QVector<Qt::SortOrder> orders;
+    for (int k = 0; k < keys.size(); ++k) {
+        if (keys[k].first < range.firstColumn() || keys[k].first > range.lastColumn())
+            return false;
+        orders.append(keys[k].second);
+    }
+    // The empty rows below the cells would stay where they are
+    if (cellTable.isEmpty() || cellTable.lastRow() <= range.firstRow())
+        return true;
+    const int firstRow = range.firstRow();
+    const int lastRow = qMin(range.lastRow(), cellTable.lastRow());
+    const int count = lastRow - firstRow + 1;
+    const int keyCount = keys.size();
+
+    const SortKeyValue blank = {SortBlank, 0};
+    QVector<SortKeyValue> values(count * keyCount, blank);
+    QHash<int, int> sstTexts;
+    QHash<QString, int> otherTexts;
+    QVector<QString> texts;
+    const int end = cellTable.rowLowerBound(lastRow + 1);
+    for (int i = cellTable.rowLowerBound(firstRow); i < end; ++i) {
+        const int offset = cellTable.rowNumberAt(i) - firstRow;
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int k = 0; k < keyCount; ++k) {
+            const int j = cells.indexOf(keys[k].first);
+            if (j == -1)
+                continue;
+            const CellData &cell = cells.cells[j];
+            SortKeyValue &value = values[offset * keyCount + k];
+            int sst_idx = -1;
+            if (cell.storage == CellData::Number) {
+                value.type = SortNumber;
+                value.value = cell.number;
+                continue;
+            } else if (cell.storage == CellData::Boolean) {
+                value.type = SortBoolean;
+                value.value = cell.boolean;
+                continue;
+            } else if (cell.storage == CellData::SharedString) {
+                sst_idx = cell.index;
+            } else if (cell.storage == CellData::Extra) {
+                const CellExtraData &extra = cellTable.extra(cell.index);
+                sst_idx = extra.sharedStringIndex;
+                if (sst_idx == -1) {
+                    // A formula without a cached value is left blank
+                    if (!extra.value.isValid())
+                        continue;
+                    if (cell.type() == Cell::NumberType) {
+                        value.type = SortNumber;
+                        value.value = extra.value.toDouble();
+                        continue;
+                    } else if (cell.type() == Cell::BooleanType) {
+                        value.type = SortBoolean;
+                        value.value = extra.value.toBool();
+                        continue;
+                    } else if (cell.type() == Cell::ErrorType) {
+                        value.type = SortError;
+                        continue;
+                    }
+                }
+            } else {
+                continue;
+            }
 
-    if (!d->drawing)
-        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
-
-    DrawingOneCellAnchor *anchor =
-        new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
-
-    /*
-        The size are expressed as English Metric Units (EMUs). There are
-        12,700 EMUs per point. Therefore, 12,700 * 3 /4 = 9,525 EMUs per
-        pixel
-    */
-    anchor->from = XlsxMarker(row, column, 0, 0);
-    anchor->ext = QSize(image.width() * 9525, image.height() * 9525);
-
-    anchor->setObjectPicture(image);
-    return true;
-}
+            // The texts are numbered as they are found, then ranked below
+            value.type = SortText;
+            if (sst_idx != -1) {
+                QHash<int, int>::const_iterator it = sstTexts.constFind(sst_idx);
+                if (it == sstTexts.constEnd()) {
+                    it = sstTexts.insert(sst_idx, texts.size());
+                    texts.append(sharedStrings()->getSharedPlainString(sst_idx));
+                }
+                value.value = it.value();
+            } else {
+                const QString text = cellValue(cell).toString();
+                QHash<QString, int>::const_iterator it = otherTexts.constFind(text);
+                if (it == otherTexts.constEnd()) {
+                    it = otherTexts.insert(text, texts.size());
+                    texts.append(text);
+                }
+                value.value = it.value();
+            }
+        }
+    }
 
-/*!
- * Creates an chart with the given \a size and insert
- * at the position \a row, \a column.
- * The chart will be returned.
- */
-Chart *Worksheet::insertChart(int row, int column, const QSize &size)
-{
-    Q_D(Worksheet);
+    // Rank the distinct texts once, the equal ones sharing their rank
+    if (!texts.isEmpty()) {
+        for (int i = 0; i < texts.size(); ++i)
+            texts[i] = texts[i].toCaseFolded();
+        QVector<int> sorted(texts.size());
+        for (int i = 0; i < sorted.size(); ++i)
+            sorted[i] = i;
+        std::sort(sorted.begin(), sorted.end(), TextLessThan(texts));
+        QVector<int> ranks(texts.size());
+        int rank = 0;
+        for (int i = 0; i < sorted.size(); ++i) {
+            if (i > 0 && QString::localeAwareCompare(texts[sorted[i - 1]], texts[sorted[i]]) != 0)
+                ++rank;
+            ranks[sorted[i]] = rank;
+        }
+        for (int i = 0; i < values.size(); ++i) {
+            if (values[i].type == SortText)
+                values[i].value = ranks[int(values[i].value)];
+        }
+    }
 
-    if (!d->drawing)
-        d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_NewFromScratch));
+    QVector<int> order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = i;
+    const SortRowLessThan lessThan(values.constData(), orders);
+    const int threads = QThread::idealThreadCount();
+    if (count < ParallelSortRows || threads < 2) {
+        std::stable_sort(order.begin(), order.end(), lessThan);
+    } else {
+        // Each thread sorts a slice, then the neighbouring slices are merged
+        QVector<int> bounds;
+        for (int t = 0; t <= threads; ++t)
+            bounds.append(int(qint64(count) * t / threads));
+        QThreadPool pool;
+        for (int t = 0; t < threads; ++t)
+            pool.start(new SortSliceTask(order.data() + bounds[t], order.data() + bounds[t + 1],
+                                         lessThan));
+        pool.waitForDone();
+        for (int width = 1; width < threads; width *= 2) {
+            for (int t = 0; t + width < threads; t += 2 * width) {
+                std::inplace_merge(order.begin() + bounds[t], order.begin() + bounds[t + width],
+                                   order.begin() + bounds[qMin(t + 2 * width, threads)],
+                                   lessThan);
+            }
+        }
+    }
 
-    DrawingOneCellAnchor *anchor =
-        new DrawingOneCellAnchor(d->drawing.data(), DrawingAnchor::Picture);
+    QVector<int> target(count);
+    bool moved = false;
+    for (int i = 0; i < count; ++i) {
+        target[order[i]] = i;
+        moved = moved || order[i] != i;
+    }
+    if (!moved)
+        return true;
 
-    /*
-        The size are expressed as English Metric Units (EMUs). There are
-        12,700 EMUs per point. Therefore, 12,700 * 3 /4 = 9,525 EMUs per
-        pixel
-    */
-    anchor->from = XlsxMarker(row, column, 0, 0);
-    anchor->ext = size * 9525;
+    // The formulas are rewritten where they are, before the cells move
+    unshareFormulas();
+    for (int i = cellTable.rowLowerBound(firstRow); i < end; ++i) {
+        const int row = cellTable.rowNumberAt(i);
+        const int rowOffset = target[row - firstRow] - (row - firstRow);
+        if (rowOffset == 0)
+            continue;
+        const CellRow &cells = cellTable.rowAt(i);
+        const int cellEnd = cells.lowerBound(range.lastColumn() + 1);
+        for (int j = cells.lowerBound(range.firstColumn()); j < cellEnd; ++j) {
+            const CellData &data = cells.cells[j];
+            if (data.storage != CellData::Extra || !cellTable.extra(data.index).formula.isValid())
+                continue;
+            const int col = cells.columns[j];
+            CellFormula &formula = cellTable.extra(data.index).formula;
+            CellRange reference = formula.reference();
+            if (reference.isValid()) {
+                reference = CellRange(reference.firstRow() + rowOffset, reference.firstColumn(),
+                                      reference.lastRow() + rowOffset, reference.lastColumn());
+            }
+            CellFormula sorted(SharedFormulaTemplate(formula.formulaText(), CellReference(row, col))
+                                   .formulaText(CellReference(row + rowOffset, col)),
+                               reference, formula.formulaType());
+            sorted.d->ca = formula.d->ca;
+            formula = sorted;
+        }
+    }
 
-    QSharedPointer<Chart> chart = QSharedPointer<Chart>(new Chart(this, F_NewFromScratch));
-    anchor->setObjectGraphicFrame(chart);
+    const CellRange sortedRange(firstRow, range.firstColumn(), lastRow, range.lastColumn());
+    cellTable.permuteRows(firstRow, range.firstColumn(), lastRow, range.lastColumn(), order);
+    urlTable.permuteRows(sortedRange, target);
+    permuteCellEntries(comments, sortedRange, target);
 
-    return chart.data();
+    row_spans.clear();
+    formulaEngine.reset();
+    cfEvaluator.reset();
+    valueIndex.reset();
+    updateCachedCells(sortedRange);
+    return true;
 }
 
 /*!
     Merge a \a range of cells. The first cell should contain the data and the others should
     be blank. All cells will be applied the same style if a valid \a format is given.
-    Returns true on success.
+    Returns true on success, or false if \a range overlaps cells which are merged already.
 
     \note All cells except the top-left one will be cleared.
  */
 bool Worksheet::mergeCells(const CellRange &range, const Format &format)
 {
     Q_D(Worksheet);
+    setDirty();
     if (range.rowCount() < 2 && range.columnCount() < 2)
         return false;
 
     if (d->checkDimensions(range.firstRow(), range.firstColumn()))
         return false;
 
+    if (d->mergeIndex.intersects(range))
+        return false;
+
     if (format.isValid())
         d->workbook->styles()->addXfFormat(format);
 
     for (int row = range.firstRow(); row <= range.lastRow(); ++row) {
         for (int col = range.firstColumn(); col <= range.lastColumn(); ++col) {
             if (row == range.firstRow() && col == range.firstColumn()) {
-                Cell *cell = cellAt(row, col);
-                if (cell) {
+                if (d->cellTable.cell(row, col)) {
                     if (format.isValid())
-                        cell->d_ptr->format = format;
+                        d->setCellFormat(row, col, format);
                 } else {
                     writeBlank(row, col, format);
                 }
@@ -1135,7 +4990,7 @@ bool Worksheet::mergeCells(const CellRange &range, const Format &format)
         }
     }
 
-    d->merges.append(range);
+    d->addMerge(range);
     return true;
 }
 
@@ -1146,20 +5001,149 @@ bool Worksheet::mergeCells(const CellRange &range, const Format &format)
 bool Worksheet::unmergeCells(const CellRange &range)
 {
     Q_D(Worksheet);
-    if (!d->merges.contains(range))
+    setDirty();
+    const int index = d->mergeIndexOf(range);
+    if (index == -1)
         return false;
 
-    d->merges.removeOne(range);
+    d->removeMerge(index);
     return true;
 }
 
 /*!
-  Returns all the merged cells.
+  Returns all the merged cells.
+*/
+QList<CellRange> Worksheet::mergedCells() const
+{
+    Q_D(const Worksheet);
+    const_cast<WorksheetPrivate *>(d)->compactMerges();
+    return d->merges;
+}
+
+/*!
+  Returns the merged cells which contain the cell (\a row, \a column), or an
+  invalid range if the cell isn't merged.
+*/
+CellRange Worksheet::mergedRangeAt(int row, int column) const
+{
+    Q_D(const Worksheet);
+    const QList<int> indexes = d->mergeIndex.valuesAt(row, column);
+    if (indexes.isEmpty())
+        return CellRange();
+    return d->merges[indexes.first()];
+}
+
+/*!
+  Returns the data validations which apply to the cell (\a row, \a column),
+  in the order they were added.
+*/
+QList<DataValidation> Worksheet::dataValidationsAt(int row, int column) const
+{
+    Q_D(const Worksheet);
+    QList<DataValidation> validations;
+    foreach (int index, d->dataValidationIndex.valuesAt(row, column))
+        validations.append(d->dataValidationsList[index]);
+    return validations;
+}
+
+static bool violationLessThan(const DataValidationViolation &left,
+                              const DataValidationViolation &right)
+{
+    if (left.row != right.row)
+        return left.row < right.row;
+    return left.column < right.column;
+}
+
+/*!
+  Checks the stored cells of \a range against the data validations of the
+  sheet, and returns the cells whose values aren't allowed, sorted by row
+  and column.
+
+  Whole, decimal, date, time, text length, list and custom validations
+  are checked. Lists and operands which refer to other sheets, or use
+  functions the formula engine doesn't know, are not checked. Blank
+  cells are only reported when they are stored, for example with a
+  format, and their validation doesn't allow blanks.
+*/
+QList<DataValidationViolation> Worksheet::validate(const CellRange &range) const
+{
+    Q_D(const Worksheet);
+    QList<DataValidationViolation> violations;
+    if (!range.isValid())
+        return violations;
+
+    const CellTable &table = d->cellTable;
+    foreach (int index, d->dataValidationIndex.intersecting(range)) {
+        const DataValidation &validation = d->dataValidationsList[index];
+        const DataValidationChecker checker(d, validation);
+        foreach (const CellRange &validated, validation.ranges()) {
+            const int firstRow = qMax(range.firstRow(), validated.firstRow());
+            const int lastRow = qMin(range.lastRow(), validated.lastRow());
+            const int firstColumn = qMax(range.firstColumn(), validated.firstColumn());
+            const int lastColumn = qMin(range.lastColumn(), validated.lastColumn());
+            if (firstRow > lastRow || firstColumn > lastColumn)
+                continue;
+            for (int i = table.rowLowerBound(firstRow);
+                 i < table.size() && table.rowNumberAt(i) <= lastRow; ++i) {
+                const int row = table.rowNumberAt(i);
+                const CellRow &cells = table.rowAt(i);
+                for (int j = cells.lowerBound(firstColumn);
+                     j < cells.size() && cells.columns[j] <= lastColumn; ++j) {
+                    const int column = cells.columns[j];
+                    if (!checker.isValid(row, column, FormulaEngine::cellValue(d, row, column)))
+                        violations.append(DataValidationViolation(row, column, validation));
+                }
+            }
+        }
+    }
+
+    std::stable_sort(violations.begin(), violations.end(), violationLessThan);
+    return violations;
+}
+
+/*!
+  Returns the conditional formattings which apply to the cell (\a row,
+  \a column), in the order they were added.
+*/
+QList<ConditionalFormatting> Worksheet::conditionalFormattingsAt(int row, int column) const
+{
+    Q_D(const Worksheet);
+    QList<ConditionalFormatting> formattings;
+    foreach (int index, d->conditionalFormattingIndex.valuesAt(row, column))
+        formattings.append(d->conditionalFormattingList[index]);
+    return formattings;
+}
+
+/*!
+  Returns the format the conditional formattings of the sheet give to the
+  cell (\a row, \a column) with its current value, or an invalid format if
+  no rule applies. When several rules match, the properties of the rule
+  with the higher priority win. Color scales give a solid fill; data bars
+  are reported by conditionalDataBar().
+
+  The statistics the rules need, such as the average of their ranges, are
+  computed once and kept until a cell or a conditional formatting of the
+  sheet changes. Time period rules are not supported.
+*/
+Format Worksheet::conditionalFormat(int row, int column) const
+{
+    Q_D(const Worksheet);
+    if (!d->cfEvaluator)
+        d->cfEvaluator.reset(new ConditionalFormattingEvaluator(d));
+    return d->cfEvaluator->format(row, column);
+}
+
+/*!
+  Returns true if a data bar rule applies to the cell (\a row, \a column),
+  storing the length of its bar, from 0 to 1 of the cell width, in
+  \a length and its color in \a color.
 */
-QList<CellRange> Worksheet::mergedCells() const
+bool Worksheet::conditionalDataBar(int row, int column, double *length, QColor *color) const
 {
     Q_D(const Worksheet);
-    return d->merges;
+    if (!d->cfEvaluator)
+        d->cfEvaluator.reset(new ConditionalFormattingEvaluator(d));
+    return d->cfEvaluator->dataBar(row, column, length, color);
 }
 
 /*!
@@ -1188,6 +5172,12 @@ void Worksheet::saveToXmlFile(QIODevice *device) const
     //    "http://schemas.microsoft.com/office/spreadsheetml/2009/9/ac");
     //    writer.writeAttribute("mc:Ignorable", "x14ac");
 
+    // The rows of a filtered autofilter may be hidden
+    if (!d->autoFilterColumns.isEmpty()) {
+        writer.writeEmptyElement(QStringLiteral("sheetPr"));
+        writer.writeAttribute(QStringLiteral("filterMode"), QStringLiteral("1"));
+    }
+
     writer.writeStartElement(QStringLiteral("dimension"));
     writer.writeAttribute(QStringLiteral("ref"), d->generateDimensionString());
     writer.writeEndElement(); // dimension
@@ -1265,159 +5255,796 @@ void Worksheet::saveToXmlFile(QIODevice *device) const
     }
 
     writer.writeStartElement(QStringLiteral("sheetData"));
-    if (d->dimension.isValid())
+    if (d->constantMemory)
+        const_cast<WorksheetPrivate *>(d)->saveStreamedSheetData(writer);
+    else if (d->dimension.isValid())
         d->saveXmlSheetData(writer);
     writer.writeEndElement(); // sheetData
 
+    d->saveXmlAutoFilter(writer);
     d->saveXmlMergeCells(writer);
     foreach (const ConditionalFormatting cf, d->conditionalFormattingList)
         cf.saveToXml(writer);
     d->saveXmlDataValidations(writer);
     d->saveXmlHyperlinks(writer);
     d->saveXmlDrawings(writer);
+    d->saveXmlLegacyDrawing(writer);
+    d->saveXmlTableParts(writer);
 
     writer.writeEndElement(); // worksheet
     writer.writeEndDocument();
 }
 
+/*
+  Tell the progress monitor, every rowInterval() rows, that \a rowsDone rows
+  of the sheet have been loaded or saved. Returns false when the load or the
+  save has been canceled and the sheet data should no longer be processed.
+ */
+bool WorksheetPrivate::reportRows(int rowsDone) const
+{
+    if (rowsDone % ProgressMonitor::rowInterval())
+        return true;
+    if (progressMonitor->isCanceled())
+        return false;
+    progressMonitor->rowsDone(name, rowsDone);
+    return true;
+}
+
 void WorksheetPrivate::saveXmlSheetData(QXmlStreamWriter &writer) const
 {
     calculateSpans();
-    for (int row_num = dimension.firstRow(); row_num <= dimension.lastRow(); row_num++) {
-        if (!(cellTable.contains(row_num) || comments.contains(row_num)
-              || rowsInfo.contains(row_num))) {
-            // Only process rows with cell data / comments / formatting
-            continue;
+
+    // The rows and cells are written by the SheetDataWriter, straight
+    // to the device of the QXmlStreamWriter.
+    SheetDataWriter dataWriter(writer.device());
+    dataWriter.reserveColumns(dimension.lastColumn());
+    const QVector<int> columnXfs = columnXfIndices();
+    findSharedFormulas();
+    bool started = false;
+    int rowsDone = 0;
+
+    // The blocks of rows kept by the last save which haven't changed are
+    // written again as they are, deflated already when the sheet is
+    // written to a zip entry.
+    ZipEntryDevice *entry = 0;
+    int stringGeneration = 0;
+    if (incrementalSave) {
+        entry = dynamic_cast<ZipEntryDevice *>(writer.device());
+        stringGeneration = sharedStrings()->saveIndexGeneration();
+        const QByteArray rowsKey = savedRowsKeyOf(columnXfs);
+        if (rowsKey != savedRowsKey) {
+            savedRowBlocks.clear();
+            savedRowsKey = rowsKey;
+        }
+    } else {
+        savedRowBlocks.clear();
+        savedRowsKey.clear();
+    }
+    int block = -1; // the block of rows being written and kept
+    SavedRowBlock saved;
+    bool segment = false;
+
+    // Only process rows with cell data / comments / formatting, so walk
+    // the three row ordered containers side by side.
+    // A row info covers a range of rows, infoRow is the next row of it.
+    int cellIdx = 0;
+    while (cellIdx < cellTable.size() && cellTable.rowNumberAt(cellIdx) < dimension.firstRow())
+        ++cellIdx;
+    QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator infoIt =
+        rowsInfo.upperBound(dimension.firstRow());
+    if (infoIt != rowsInfo.constBegin() && (infoIt - 1).value()->lastRow >= dimension.firstRow())
+        --infoIt;
+    int infoRow = infoIt != rowsInfo.constEnd()
+                      ? qMax(infoIt.key(), dimension.firstRow()) : XLSX_ROW_MAX + 1;
+    QMap<int, QMap<int, QString>>::const_iterator commentIt =
+        comments.lowerBound(dimension.firstRow());
+
+    forever {
+        int row_num = XLSX_ROW_MAX + 1;
+        if (cellIdx < cellTable.size())
+            row_num = cellTable.rowNumberAt(cellIdx);
+        if (infoIt != rowsInfo.constEnd())
+            row_num = qMin(row_num, infoRow);
+        if (commentIt != comments.constEnd())
+            row_num = qMin(row_num, commentIt.key());
+
+        const int rowBlock = (row_num - 1) / CellTable::SpillBlockRows;
+        if (block != -1 && (rowBlock != block || row_num > dimension.lastRow())) {
+            // Keep the block which has just been written
+            dataWriter.flush();
+            bool ok = true;
+            if (segment)
+                ok = entry->endSegment(&saved.data, &saved.crc, &saved.size);
+            else
+                dataWriter.setCapture(0);
+            if (ok && !savedBlockHasFormula) {
+                saved.lastSharedString = savedBlockLastString;
+                savedRowBlocks.insert(block, saved);
+            } else {
+                savedRowBlocks.remove(block);
+            }
+            block = -1;
         }
+        if (row_num > dimension.lastRow())
+            break;
 
-        int span_index = (row_num - 1) / 16;
-        QString span;
-        if (row_spans.contains(span_index))
-            span = row_spans[span_index];
+        if (!started) {
+            // Close the start tag of <sheetData>
+            writer.writeCharacters(QString());
+            started = true;
+        }
 
-        writer.writeStartElement(QStringLiteral("row"));
-        writer.writeAttribute(QStringLiteral("r"), QString::number(row_num));
+        if (incrementalSave && block == -1) {
+            const QByteArray key = savedRowBlockKey(rowBlock, infoIt, commentIt);
+            const int rowCount = savedRowBlocks.value(rowBlock).rowCount;
+            if (writeSavedRowBlock(dataWriter, entry, rowBlock, key)) {
+                const int nextRow = (rowBlock + 1) * CellTable::SpillBlockRows + 1;
+                cellIdx = cellTable.rowLowerBound(nextRow);
+                while (infoIt != rowsInfo.constEnd() && infoIt.value()->lastRow < nextRow)
+                    ++infoIt;
+                if (infoIt != rowsInfo.constEnd())
+                    infoRow = qMax(infoIt.key(), nextRow);
+                commentIt = comments.lowerBound(nextRow);
+                bool canceled = false;
+                for (int i = 0; i < rowCount && progressMonitor && !canceled; ++i)
+                    canceled = !reportRows(++rowsDone);
+                if (canceled)
+                    break;
+                continue;
+            }
 
-        if (!span.isEmpty())
-            writer.writeAttribute(QStringLiteral("spans"), span);
+            // Write the block again, and keep it
+            block = rowBlock;
+            saved = SavedRowBlock();
+            saved.key = key;
+            saved.revision = cellTable.blockRevision(block);
+            saved.stringGeneration = stringGeneration;
+            saved.rowCount = 0;
+            saved.crc = 0;
+            saved.size = 0;
+            dataWriter.flush();
+            segment = entry && entry->beginSegment();
+            saved.deflated = segment;
+            saved.compressionLevel = segment ? entry->compressionLevel() : 0;
+            if (!segment)
+                dataWriter.setCapture(&saved.data);
+            savedBlockLastString = -1;
+            savedBlockHasFormula = false;
+        }
 
-        if (rowsInfo.contains(row_num)) {
-            QSharedPointer<XlsxRowInfo> rowInfo = rowsInfo[row_num];
-            if (!rowInfo->format.isEmpty()) {
-                writer.writeAttribute(QStringLiteral("s"),
-                                      QString::number(rowInfo->format.xfIndex()));
-                writer.writeAttribute(QStringLiteral("customFormat"), QStringLiteral("1"));
-            }
-            //! Todo: support customHeight from info struct
-            //! Todo: where does this magic number '15' come from?
-            if (rowInfo->customHeight) {
-                writer.writeAttribute(QStringLiteral("ht"), QString::number(rowInfo->height));
-                writer.writeAttribute(QStringLiteral("customHeight"), QStringLiteral("1"));
-            } else {
-                writer.writeAttribute(QStringLiteral("customHeight"), QStringLiteral("0"));
-            }
+        // Keep about one block of spilled rows in memory
+        if (cellIdx % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+
+        // The spans and the cells of the row are looked up
+        Statistics::count(Statistics::SheetDataLookups, 2);
+        const QString span = row_spans.value((row_num - 1) / 16);
+
+        const XlsxRowInfo *rowInfo = 0;
+        if (infoIt != rowsInfo.constEnd() && infoRow == row_num)
+            rowInfo = infoIt.value().data();
+        saveXmlRow(dataWriter, row_num, span, rowInfo, columnXfs);
+        ++saved.rowCount;
+        if (progressMonitor && !reportRows(++rowsDone))
+            break;
+
+        if (cellIdx < cellTable.size() && cellTable.rowNumberAt(cellIdx) == row_num)
+            ++cellIdx;
+        if (rowInfo) {
+            if (++infoRow > rowInfo->lastRow && ++infoIt != rowsInfo.constEnd())
+                infoRow = infoIt.key();
+        }
+        if (commentIt != comments.constEnd() && commentIt.key() == row_num)
+            ++commentIt;
+    }
 
-            if (rowInfo->hidden)
-                writer.writeAttribute(QStringLiteral("hidden"), QStringLiteral("1"));
-            if (rowInfo->outlineLevel > 0)
-                writer.writeAttribute(QStringLiteral("outlineLevel"),
-                                      QString::number(rowInfo->outlineLevel));
-            if (rowInfo->collapsed)
-                writer.writeAttribute(QStringLiteral("collapsed"), QStringLiteral("1"));
+    // A block left unfinished by a cancel isn't kept
+    if (block != -1) {
+        dataWriter.flush();
+        if (segment)
+            entry->endSegment(&saved.data, &saved.crc, &saved.size);
+        else
+            dataWriter.setCapture(0);
+        savedRowBlocks.remove(block);
+    }
+
+    // Everything must be on the device before </sheetData> is written
+    dataWriter.flush();
+    savedSharedFormulas.clear();
+}
+
+/*
+  Returns what all the kept blocks of rows depend on for the incremental
+  save, besides their cells and rows: the columns of the dimension, whose
+  cells are the only ones written, and the styles of the columns, given
+  by \a columnXfs.
+ */
+QByteArray WorksheetPrivate::savedRowsKeyOf(const QVector<int> &columnXfs) const
+{
+    QByteArray key;
+    key.reserve(int(sizeof(int)) * (columnXfs.size() + 2));
+    const int columns[2] = {dimension.firstColumn(), dimension.lastColumn()};
+    key.append(reinterpret_cast<const char *>(columns), sizeof(columns));
+    key.append(reinterpret_cast<const char *>(columnXfs.constData()),
+               columnXfs.size() * int(sizeof(int)));
+    return key;
+}
+
+/*
+  Returns what the <row> elements of \a block depend on besides its cells:
+  its rows within the dimension, the infos of its rows, the first of them
+  being \a infoIt, and its rows with comments, the first of them being
+  \a commentIt.
+ */
+QByteArray WorksheetPrivate::savedRowBlockKey(
+    int block, QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator infoIt,
+    QMap<int, QMap<int, QString>>::const_iterator commentIt) const
+{
+    const int firstRow = qMax(block * CellTable::SpillBlockRows + 1, dimension.firstRow());
+    const int lastRow = qMin((block + 1) * CellTable::SpillBlockRows, dimension.lastRow());
+    QVector<qint64> values;
+    values << firstRow << lastRow;
+    for (; infoIt != rowsInfo.constEnd() && infoIt.key() <= lastRow; ++infoIt) {
+        const XlsxRowInfo *info = infoIt.value().data();
+        qint64 height;
+        memcpy(&height, &info->height, sizeof(height));
+        values << qMax(infoIt.key(), firstRow) << qMin(info->lastRow, lastRow)
+               << (info->format.isEmpty() ? -1 : info->format.xfIndex()) << height
+               << info->customHeight << info->hidden << info->outlineLevel << info->collapsed;
+    }
+    for (; commentIt != comments.constEnd() && commentIt.key() <= lastRow; ++commentIt) {
+        values << commentIt.key();
+        if (!commentIt.value().isEmpty())
+            values << commentIt.value().firstKey() << commentIt.value().lastKey();
+    }
+    return QByteArray(reinterpret_cast<const char *>(values.constData()),
+                      values.size() * int(sizeof(qint64)));
+}
+
+/*
+  Write the kept <row> elements of \a block, with \a key being what they
+  depend on now, either deflated to \a entry, or as xml to \a writer.
+  Returns false if the block has to be written again: it has changed
+  since it was kept, the saved indexes of its shared strings have
+  changed, or its deflated data can't be used by \a entry.
+ */
+bool WorksheetPrivate::writeSavedRowBlock(SheetDataWriter &writer, ZipEntryDevice *entry,
+                                          int block, const QByteArray &key) const
+{
+    QHash<int, SavedRowBlock>::const_iterator it = savedRowBlocks.constFind(block);
+    if (it == savedRowBlocks.constEnd())
+        return false;
+    const SavedRowBlock &saved = it.value();
+    if (saved.revision != cellTable.blockRevision(block) || saved.key != key)
+        return false;
+    if (saved.lastSharedString != -1
+        && sharedStrings()->firstChangedSaveIndex(saved.stringGeneration)
+               <= saved.lastSharedString) {
+        return false;
+    }
+
+    if (!saved.deflated) {
+        writer.writeRaw(saved.data.constData(), saved.data.size());
+        return true;
+    }
+    if (!entry || !entry->canWriteSegments() || entry->compressionLevel() != saved.compressionLevel)
+        return false;
+    writer.flush();
+    return entry->writeSegment(saved.data, saved.crc, saved.size);
+}
+
+/*
+  Returns the xf index of the format of each column, indexed by column
+  number, or -1 for the columns without format. Columns after the end
+  of the returned vector have no format either.
+ */
+QVector<int> WorksheetPrivate::columnXfIndices() const
+{
+    QVector<int> xfs;
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::const_iterator it = colsInfo.constBegin();
+    for (; it != colsInfo.constEnd(); ++it) {
+        const XlsxColumnInfo *info = it.value().data();
+        if (info->format.isEmpty() || info->lastColumn < qMax(info->firstColumn, 0))
+            continue;
+        if (xfs.size() <= info->lastColumn)
+            xfs.resize(info->lastColumn + 1);
+    }
+    if (xfs.isEmpty())
+        return xfs;
+
+    xfs.fill(-1);
+    for (it = colsInfo.constBegin(); it != colsInfo.constEnd(); ++it) {
+        const XlsxColumnInfo *info = it.value().data();
+        if (info->format.isEmpty())
+            continue;
+        const int xf = info->format.xfIndex();
+        for (int col = qMax(info->firstColumn, 0); col <= info->lastColumn; ++col)
+            xfs[col] = xf;
+    }
+    return xfs;
+}
+
+/*
+  Write the <row> element of \a row_num, whose info is \a rowInfo or 0.
+  The style of the cells without format is taken from the row, or else
+  from \a columnXfs, which is computed once per save by columnXfIndices().
+ */
+void WorksheetPrivate::saveXmlRow(SheetDataWriter &writer, int row_num, const QString &span,
+                                  const XlsxRowInfo *rowInfo, const QVector<int> &columnXfs) const
+{
+    writer.writeRaw("<row r=\"");
+    writer.writeInt(row_num);
+    writer.writeRaw("\"");
+
+    if (!span.isEmpty()) {
+        writer.writeRaw(" spans=\"");
+        writer.writeEscaped(span);
+        writer.writeRaw("\"");
+    }
+
+    int rowXf = -1;
+    if (rowInfo) {
+        if (!rowInfo->format.isEmpty()) {
+            rowXf = rowInfo->format.xfIndex();
+            writer.writeRaw(" s=\"");
+            writer.writeInt(rowXf);
+            writer.writeRaw("\" customFormat=\"1\"");
+        }
+        //! Todo: support customHeight from info struct
+        //! Todo: where does this magic number '15' come from?
+        if (rowInfo->customHeight) {
+            const QByteArray height = QByteArray::number(rowInfo->height);
+            writer.writeRaw(" ht=\"");
+            writer.writeRaw(height.constData(), height.size());
+            writer.writeRaw("\" customHeight=\"1\"");
+        } else {
+            writer.writeRaw(" customHeight=\"0\"");
         }
 
-        // Write cell data if row contains filled cells
-        if (cellTable.contains(row_num)) {
-            for (int col_num = dimension.firstColumn(); col_num <= dimension.lastColumn();
-                 col_num++) {
-                if (cellTable[row_num].contains(col_num)) {
-                    saveXmlCellData(writer, row_num, col_num, cellTable[row_num][col_num]);
+        if (rowInfo->hidden)
+            writer.writeRaw(" hidden=\"1\"");
+        if (rowInfo->outlineLevel > 0) {
+            writer.writeRaw(" outlineLevel=\"");
+            writer.writeInt(rowInfo->outlineLevel);
+            writer.writeRaw("\"");
+        }
+        if (rowInfo->collapsed)
+            writer.writeRaw(" collapsed=\"1\"");
+    }
+
+    // Write cell data if row contains filled cells
+    bool hasCells = false;
+    if (const CellRow *cells = cellTable.row(row_num)) {
+        for (int i = 0; i < cells->size(); ++i) {
+            int col_num = cells->columns[i];
+            if (col_num >= dimension.firstColumn() && col_num <= dimension.lastColumn()) {
+                if (!hasCells) {
+                    writer.writeRaw(">");
+                    hasCells = true;
                 }
+                const CellData &cell = cells->cells[i];
+                int xf = cell.xfIndex;
+                if (xf == -1)
+                    xf = rowXf != -1 || col_num >= columnXfs.size() ? rowXf : columnXfs[col_num];
+                saveXmlCellData(writer, row_num, col_num, cell, xf);
             }
         }
-        writer.writeEndElement(); // row
     }
+
+    if (hasCells)
+        writer.writeRaw("</row>");
+    else
+        writer.writeRaw("/>");
 }
 
-void WorksheetPrivate::saveXmlCellData(QXmlStreamWriter &writer, int row, int col,
-                                       QSharedPointer<Cell> cell) const
+/*
+  Spill the finished rows to disk if the cells of the workbook take more
+  than its memory budget. Called before \a row is written or loaded, when
+  no reference to the cells is held. The memory is only added up once the
+  cells of the sheet have grown enough since the last check.
+ */
+void WorksheetPrivate::checkMemoryBudget(int row)
 {
-    // This is the innermost loop so efficiency is important.
-    QString cell_pos = CellReference(row, col).toString();
-
-    writer.writeStartElement(QStringLiteral("c"));
-    writer.writeAttribute(QStringLiteral("r"), cell_pos);
-
-    // Style used by the cell, row or col
-    if (!cell->format().isEmpty())
-        writer.writeAttribute(QStringLiteral("s"), QString::number(cell->format().xfIndex()));
-    else if (rowsInfo.contains(row) && !rowsInfo[row]->format.isEmpty())
-        writer.writeAttribute(QStringLiteral("s"),
-                              QString::number(rowsInfo[row]->format.xfIndex()));
-    else if (colsInfoHelper.contains(col) && !colsInfoHelper[col]->format.isEmpty())
-        writer.writeAttribute(QStringLiteral("s"),
-                              QString::number(colsInfoHelper[col]->format.xfIndex()));
-
-    if (cell->cellType() == Cell::SharedStringType) {
-        int sst_idx;
-        if (cell->isRichString())
-            sst_idx = sharedStrings()->getSharedStringIndex(cell->d_ptr->richString);
+    WorkbookPrivate *book_d = workbook->d_func();
+    const qint64 usage = cellTable.memoryEstimate();
+    const qint64 interval = qBound(qint64(64 * 1024), book_d->memoryBudget / 16,
+                                   qint64(1024 * 1024));
+    if (usage - checkedCellMemory < interval)
+        return;
+    checkedCellMemory = usage;
+
+    // The other sheets may be written, or parsed, by other threads
+    if (deferSstRefs || book_d->concurrent_writes_enabled) {
+        if (usage > book_d->memoryBudget)
+            spillCells(row);
+    } else {
+        book_d->enforceMemoryBudget(q_func(), row);
+    }
+}
+
+/*
+  Spill the blocks of rows above the block of \a beforeRow to disk.
+ */
+void WorksheetPrivate::spillCells(int beforeRow)
+{
+    cellTable.spill(beforeRow);
+    checkedCellMemory = cellTable.memoryEstimate();
+}
+
+/*
+  Write all the buffered rows before \a beforeRow to the temporary
+  stream file, and release their cells. Only used in constant memory mode.
+  The span of each streamed row is calculated from the row itself, as
+  the following rows are unknown when it's written. When the stream file
+  can't be opened, the rows are kept in memory instead.
+ */
+void WorksheetPrivate::flushStreamRows(int beforeRow)
+{
+    if (!streamFile) {
+        streamFile.reset(new QTemporaryFile);
+        if (!streamFile->open()) {
+            qWarning("Failed to open the temporary file used by constant memory mode, "
+                     "the rows are kept in memory");
+            return;
+        }
+        streamWriter.reset(new SheetDataWriter(streamFile.data()));
+    }
+    if (!streamFile->isOpen())
+        return;
+
+    // The written shared string indexes can't be changed anymore
+    sharedStrings()->disableCompaction();
+
+    QVector<int> columnXfs;
+    bool columnXfsResolved = false;
+    forever {
+        int row_num = -1;
+        if (!cellTable.isEmpty() && cellTable.firstRow() < beforeRow)
+            row_num = cellTable.firstRow();
+        if (!rowsInfo.isEmpty() && rowsInfo.firstKey() < beforeRow
+            && (row_num == -1 || rowsInfo.firstKey() < row_num))
+            row_num = rowsInfo.firstKey();
+        if (row_num == -1)
+            break;
+
+        QString span;
+        const CellRow *cells = cellTable.row(row_num);
+        if (cells && !cells->isEmpty())
+            span = QStringLiteral("%1:%2").arg(cells->firstColumn()).arg(cells->lastColumn());
+
+        if (!columnXfsResolved) {
+            columnXfs = columnXfIndices();
+            columnXfsResolved = true;
+        }
+        // The first row range starts at row_num if it contains it
+        QSharedPointer<XlsxRowInfo> rowInfo;
+        if (!rowsInfo.isEmpty() && rowsInfo.firstKey() == row_num) {
+            rowInfo = rowsInfo.take(row_num);
+            rowAxis.reset();
+        }
+        saveXmlRow(*streamWriter, row_num, span, rowInfo.data(), columnXfs);
+        if (cells) {
+            for (int i = 0; i < cells->size(); ++i)
+                releaseCachedCell(row_num, cells->columns[i]);
+        }
+        cellTable.removeRow(row_num);
+        if (rowInfo && rowInfo->lastRow > row_num) {
+            rowInfo->firstRow = row_num + 1;
+            rowsInfo.insert(row_num + 1, rowInfo);
+        }
+        streamFlushedRow = row_num;
+    }
+}
+
+/*
+  Flush the remaining rows, then copy the streamed rows into the
+  <sheetData> element which has just been started by \a writer.
+ */
+void WorksheetPrivate::saveStreamedSheetData(QXmlStreamWriter &writer)
+{
+    flushStreamRows(XLSX_ROW_MAX + 1);
+    if (!streamFile || !streamFile->isOpen()) {
+        // The rows have been kept in memory
+        if (dimension.isValid())
+            saveXmlSheetData(writer);
+        return;
+    }
+    streamWriter->flush();
+
+    // Close the start tag of <sheetData>, so that the raw data can be
+    // written to the underlying device directly.
+    writer.writeCharacters(QString());
+
+    // The rows which couldn't be written to the stream file are lost
+    QIODevice *device = writer.device();
+    const qint64 pos = streamFile->pos();
+    if (streamFile->error() != QFileDevice::NoError || !streamFile->seek(0))
+        streamError = true;
+    while (!streamError && !streamFile->atEnd()) {
+        const QByteArray data = streamFile->read(64 * 1024);
+        if (data.isEmpty() || streamFile->error() != QFileDevice::NoError)
+            streamError = true;
         else
-            sst_idx = sharedStrings()->getSharedStringIndex(cell->value().toString());
-
-        writer.writeAttribute(QStringLiteral("t"), QStringLiteral("s"));
-        writer.writeTextElement(QStringLiteral("v"), QString::number(sst_idx));
-    } else if (cell->cellType() == Cell::InlineStringType) {
-        writer.writeAttribute(QStringLiteral("t"), QStringLiteral("inlineStr"));
-        writer.writeStartElement(QStringLiteral("is"));
-        if (cell->isRichString()) {
-            // Rich text string
-            RichString string = cell->d_ptr->richString;
-            for (int i = 0; i < string.fragmentCount(); ++i) {
-                writer.writeStartElement(QStringLiteral("r"));
-                if (string.fragmentFormat(i).hasFontData()) {
-                    writer.writeStartElement(QStringLiteral("rPr"));
-                    //:Todo
-                    writer.writeEndElement(); // rPr
+            device->write(data);
+    }
+    streamFile->seek(pos);
+    if (streamError)
+        qWarning("The rows written to the temporary file of constant memory mode are lost");
+}
+
+/*
+  Write the <c> element of \a cell, using the style \a xfIndex resolved
+  from the cell, row or column by saveXmlRow().
+ */
+void WorksheetPrivate::saveXmlCellData(SheetDataWriter &writer, int row, int col,
+                                       const CellData &cell, int xfIndex) const
+{
+    // This is the innermost loop so efficiency is important.
+    writer.writeRaw("<c r=\"");
+    writer.writeCellReference(row, col);
+    writer.writeRaw("\"");
+
+    if (xfIndex != -1) {
+        writer.writeRaw(" s=\"");
+        writer.writeInt(xfIndex);
+        writer.writeRaw("\"");
+    }
+
+    // Only cells which can't be stored compactly have extra data
+    const CellExtraData *extra =
+        cell.storage == CellData::Extra ? &cellTable.extra(cell.index) : 0;
+
+    if (cell.cellType == Cell::SharedStringType) {
+        // The index is known since the cell was written or loaded
+        const int sst_idx = extra ? extra->sharedStringIndex : cell.index;
+
+        if (sst_idx > savedBlockLastString)
+            savedBlockLastString = sst_idx;
+        writer.writeRaw(" t=\"s\"><v>");
+        writer.writeInt(sharedStrings()->saveIndex(sst_idx));
+        writer.writeRaw("</v>");
+    } else if (cell.cellType == Cell::InlineStringType) {
+        writer.writeRaw(" t=\"inlineStr\"><is>");
+        if (extra && !extra->inlineRuns.isEmpty()) {
+            // Rich text string, the <rPr> of each font is only built once
+            const QString text = extra->value.toString();
+            int pos = 0;
+            foreach (const InlineRun &run, extra->inlineRuns) {
+                writer.writeRaw("<r>");
+                if (run.fontId != -1) {
+                    const QByteArray &rPr = inlineFontXml[run.fontId];
+                    writer.writeRaw(rPr.constData(), rPr.size());
                 }
-                writer.writeStartElement(QStringLiteral("t"));
-                if (isSpaceReserveNeeded(string.fragmentText(i)))
-                    writer.writeAttribute(QStringLiteral("xml:space"), QStringLiteral("preserve"));
-                writer.writeCharacters(string.fragmentText(i));
-                writer.writeEndElement(); // t
-                writer.writeEndElement(); // r
+                writer.writeTextElement(text.mid(pos, run.length));
+                writer.writeRaw("</r>");
+                pos += run.length;
             }
         } else {
-            writer.writeStartElement(QStringLiteral("t"));
-            QString string = cell->value().toString();
-            if (isSpaceReserveNeeded(string))
-                writer.writeAttribute(QStringLiteral("xml:space"), QStringLiteral("preserve"));
-            writer.writeCharacters(string);
-            writer.writeEndElement(); // t
-        }
-        writer.writeEndElement(); // is
-    } else if (cell->cellType() == Cell::NumberType) {
-        if (cell->hasFormula())
-            cell->formula().saveToXml(writer);
-        if (cell->value().isValid()) { // note that, invalid value means 'v' is blank
-            double value = cell->value().toDouble();
-            writer.writeTextElement(QStringLiteral("v"), QString::number(value, 'g', 15));
-        }
-    } else if (cell->cellType() == Cell::StringType) {
-        writer.writeAttribute(QStringLiteral("t"), QStringLiteral("str"));
-        if (cell->hasFormula())
-            cell->formula().saveToXml(writer);
-        writer.writeTextElement(QStringLiteral("v"), cell->value().toString());
-    } else if (cell->cellType() == Cell::BooleanType) {
-        writer.writeAttribute(QStringLiteral("t"), QStringLiteral("b"));
-        writer.writeTextElement(QStringLiteral("v"),
-                                cell->value().toBool() ? QStringLiteral("1") : QStringLiteral("0"));
-    }
-    writer.writeEndElement(); // c
+            writer.writeTextElement(cellValue(cell).toString());
+        }
+        writer.writeRaw("</is>");
+    } else if (cell.cellType == Cell::NumberType) {
+        const bool hasFormula = extra && extra->formula.isValid();
+        // invalid value means 'v' is blank
+        const bool hasValue = cell.storage == CellData::Number || (extra && extra->value.isValid());
+        if (!hasFormula && !hasValue) {
+            writer.writeRaw("/>");
+            return;
+        }
+        writer.writeRaw(">");
+        if (hasFormula)
+            saveXmlCellFormula(writer, savedCellFormula(row, col, extra->formula));
+        if (hasValue) {
+            writer.writeRaw("<v>");
+            writer.writeDouble(cell.storage == CellData::Number ? cell.number
+                                                                : extra->value.toDouble());
+            writer.writeRaw("</v>");
+        }
+    } else if (cell.cellType == Cell::StringType) {
+        writer.writeRaw(" t=\"str\">");
+        if (extra && extra->formula.isValid())
+            saveXmlCellFormula(writer, savedCellFormula(row, col, extra->formula));
+        writer.writeRaw("<v>");
+        writer.writeEscaped(cellValue(cell).toString());
+        writer.writeRaw("</v>");
+    } else if (cell.cellType == Cell::BooleanType) {
+        writer.writeRaw(" t=\"b\">");
+        if (extra && extra->formula.isValid())
+            saveXmlCellFormula(writer, savedCellFormula(row, col, extra->formula));
+        if (cellValue(cell).toBool())
+            writer.writeRaw("<v>1</v>");
+        else
+            writer.writeRaw("<v>0</v>");
+    } else if (cell.cellType == Cell::ErrorType && extra) {
+        writer.writeRaw(" t=\"e\">");
+        if (extra->formula.isValid())
+            saveXmlCellFormula(writer, savedCellFormula(row, col, extra->formula));
+        writer.writeRaw("<v>");
+        writer.writeEscaped(extra->value.toString());
+        writer.writeRaw("</v>");
+    } else {
+        writer.writeRaw("/>");
+        return;
+    }
+    writer.writeRaw("</c>");
+}
+
+/*
+  Same as CellFormula::saveToXml(), for the cells of <sheetData>.
+ */
+void WorksheetPrivate::saveXmlCellFormula(SheetDataWriter &writer,
+                                          const CellFormula &formula) const
+{
+    const CellFormulaPrivate *f = formula.d.constData();
+    savedBlockHasFormula = true;
+
+    writer.writeRaw("<f");
+    if (f->type == CellFormula::ArrayType)
+        writer.writeRaw(" t=\"array\"");
+    else if (f->type == CellFormula::SharedType)
+        writer.writeRaw(" t=\"shared\"");
+    if (f->reference.isValid()) {
+        writer.writeRaw(" ref=\"");
+        writer.writeEscaped(f->reference.toString());
+        writer.writeRaw("\"");
+    }
+    if (f->ca)
+        writer.writeRaw(" ca=\"1\"");
+    if (f->type == CellFormula::SharedType) {
+        writer.writeRaw(" si=\"");
+        writer.writeInt(f->si);
+        writer.writeRaw("\"");
+    }
+
+    if (f->formula.isEmpty()) {
+        writer.writeRaw("/>");
+    } else {
+        writer.writeRaw(">");
+        writer.writeEscaped(f->formula);
+        writer.writeRaw("</f>");
+    }
+}
+
+/*
+  Returns the key of the normal formula of \a cell, which is the same for
+  the formulas which can be shared with it, or an empty string if it's
+  not worth or not safe to share it.
+ */
+QString WorksheetPrivate::shareableFormulaKey(int row, int col, const CellData &cell) const
+{
+    if (cell.storage != CellData::Extra
+        || (cell.cellType != Cell::NumberType && cell.cellType != Cell::StringType))
+        return QString();
+    if (row < dimension.firstRow() || row > dimension.lastRow() || col < dimension.firstColumn()
+        || col > dimension.lastColumn())
+        return QString();
+
+    const CellFormula &formula = cellTable.extra(cell.index).formula;
+    if (!formula.isValid() || formula.formulaType() != CellFormula::NormalType
+        || formula.reference().isValid())
+        return QString();
+
+    const SharedFormulaTemplate formulaTemplate(formula.formulaText(), CellReference(row, col));
+    if (!formulaTemplate.isShareable())
+        return QString();
+    return (formula.d->ca ? QLatin1String("1") : QLatin1String("0"))
+           + formulaTemplate.relativeKey();
+}
+
+/*
+  Save the formulas of the cells from (\a firstRow, \a firstCol) to
+  (\a lastRow, \a lastCol) as one shared formula, whose text is the one
+  of the first cell.
+ */
+void WorksheetPrivate::addSavedSharedFormula(int firstRow, int firstCol, int lastRow,
+                                             int lastCol, int *nextSharedIndex) const
+{
+    const CellData *rootCell = cellTable.cell(firstRow, firstCol);
+    const CellFormula &rootFormula = cellTable.extra(rootCell->index).formula;
+
+    CellFormula root(rootFormula.formulaText(), CellRange(firstRow, firstCol, lastRow, lastCol),
+                     CellFormula::SharedType);
+    CellFormula child(QString(), CellFormula::SharedType);
+    root.d->ca = child.d->ca = rootFormula.d->ca;
+    root.d->si = child.d->si = (*nextSharedIndex)++;
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int col = firstCol; col <= lastCol; ++col)
+            savedSharedFormulas.insert(cellKey(row, col), child);
+    }
+    savedSharedFormulas.insert(cellKey(firstRow, firstCol), root);
+}
+
+/*
+  Find the runs of cells, down a column or else along a row, whose normal
+  formulas only differ by the offset of their relative references. They
+  are saved as shared formulas: the first cell of each run holds the
+  formula and the others only refer to it.
+ */
+void WorksheetPrivate::findSharedFormulas() const
+{
+    savedSharedFormulas.clear();
+    int nextSharedIndex = sharedFormulaMap.isEmpty() ? 0 : sharedFormulaMap.lastKey() + 1;
+
+    // The open run of each column: its key, first row and last row
+    struct FormulaRun
+    {
+        QString key;
+        int first;
+        int last;
+    };
+    QMap<int, FormulaRun> columnRuns;
+    for (int i = 0; i < cellTable.size(); ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+        const int row = cellTable.rowNumberAt(i);
+        const CellRow &cells = cellTable.rowAt(i);
+        for (int j = 0; j < cells.size(); ++j) {
+            const int col = cells.columns[j];
+            const QString key = shareableFormulaKey(row, col, cells.cells[j]);
+            QMap<int, FormulaRun>::iterator it = columnRuns.find(col);
+            if (it != columnRuns.end()) {
+                if (!key.isEmpty() && it->last == row - 1 && it->key == key) {
+                    it->last = row;
+                    continue;
+                }
+                if (it->last > it->first)
+                    addSavedSharedFormula(it->first, col, it->last, col, &nextSharedIndex);
+                columnRuns.erase(it);
+            }
+            if (!key.isEmpty()) {
+                FormulaRun run = {key, row, row};
+                columnRuns.insert(col, run);
+            }
+        }
+    }
+    for (QMap<int, FormulaRun>::const_iterator it = columnRuns.constBegin();
+         it != columnRuns.constEnd(); ++it) {
+        if (it->last > it->first)
+            addSavedSharedFormula(it->first, it.key(), it->last, it.key(), &nextSharedIndex);
+    }
+
+    // The formulas which are not shared down a column may be along a row
+    for (int i = 0; i < cellTable.size(); ++i) {
+        if (i % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+        const int row = cellTable.rowNumberAt(i);
+        const CellRow &cells = cellTable.rowAt(i);
+        FormulaRun run = {QString(), 0, -1};
+        for (int j = 0; j <= cells.size(); ++j) {
+            QString key;
+            int col = -1;
+            if (j < cells.size()) {
+                col = cells.columns[j];
+                if (!savedSharedFormulas.contains(cellKey(row, col)))
+                    key = shareableFormulaKey(row, col, cells.cells[j]);
+            }
+            if (!key.isEmpty() && run.last == col - 1 && run.key == key) {
+                run.last = col;
+                continue;
+            }
+            if (run.last > run.first)
+                addSavedSharedFormula(row, run.first, row, run.last, &nextSharedIndex);
+            run.key = key;
+            run.first = run.last = key.isEmpty() ? -1 : col;
+        }
+    }
+}
+
+/*
+  Returns the formula saved for the cell (\a row, \a col) instead of its
+  \a formula, if it's saved as a shared formula.
+ */
+CellFormula WorksheetPrivate::savedCellFormula(int row, int col, const CellFormula &formula) const
+{
+    if (savedSharedFormulas.isEmpty())
+        return formula;
+    return savedSharedFormulas.value(cellKey(row, col), formula);
 }
 
 void WorksheetPrivate::saveXmlMergeCells(QXmlStreamWriter &writer) const
 {
+    const_cast<WorksheetPrivate *>(this)->compactMerges();
     if (merges.isEmpty())
         return;
 
@@ -1432,6 +6059,34 @@ void WorksheetPrivate::saveXmlMergeCells(QXmlStreamWriter &writer) const
     writer.writeEndElement(); // mergeCells
 }
 
+void WorksheetPrivate::saveXmlAutoFilter(QXmlStreamWriter &writer) const
+{
+    if (!autoFilterRange.isValid())
+        return;
+
+    writer.writeStartElement(QStringLiteral("autoFilter"));
+    writer.writeAttribute(QStringLiteral("ref"), autoFilterRange.toString());
+    QMap<int, QStringList>::const_iterator it = autoFilterColumns.constBegin();
+    for (; it != autoFilterColumns.constEnd(); ++it) {
+        writer.writeStartElement(QStringLiteral("filterColumn"));
+        writer.writeAttribute(QStringLiteral("colId"),
+                              QString::number(it.key() - autoFilterRange.firstColumn()));
+        writer.writeStartElement(QStringLiteral("filters"));
+        // The empty cells are not a value of their own
+        if (it.value().contains(QString()))
+            writer.writeAttribute(QStringLiteral("blank"), QStringLiteral("1"));
+        foreach (const QString &value, it.value()) {
+            if (value.isEmpty())
+                continue;
+            writer.writeEmptyElement(QStringLiteral("filter"));
+            writer.writeAttribute(QStringLiteral("val"), value);
+        }
+        writer.writeEndElement(); // filters
+        writer.writeEndElement(); // filterColumn
+    }
+    writer.writeEndElement(); // autoFilter
+}
+
 void WorksheetPrivate::saveXmlDataValidations(QXmlStreamWriter &writer) const
 {
     if (dataValidationsList.isEmpty())
@@ -1452,34 +6107,33 @@ void WorksheetPrivate::saveXmlHyperlinks(QXmlStreamWriter &writer) const
         return;
 
     writer.writeStartElement(QStringLiteral("hyperlinks"));
-    QMapIterator<int, QMap<int, QSharedPointer<XlsxHyperlinkData>>> it(urlTable);
-    while (it.hasNext()) {
-        it.next();
-        int row = it.key();
-        QMapIterator<int, QSharedPointer<XlsxHyperlinkData>> it2(it.value());
-        while (it2.hasNext()) {
-            it2.next();
-            int col = it2.key();
-            QSharedPointer<XlsxHyperlinkData> data = it2.value();
-            QString ref = CellReference(row, col).toString();
-            writer.writeEmptyElement(QStringLiteral("hyperlink"));
-            writer.writeAttribute(QStringLiteral("ref"), ref);
-            if (data->linkType == XlsxHyperlinkData::External) {
-                // Update relationships
-                relationships->addWorksheetRelationship(QStringLiteral("/hyperlink"), data->target,
+    // The links to the same target share its relationship
+    QHash<int, QString> relationshipIds;
+    char ref[XLSX_CELL_REFERENCE_BUFFER_SIZE];
+    for (int i = 0; i < urlTable.size(); ++i) {
+        const HyperlinkTable::Link &link = urlTable.at(i);
+        writer.writeEmptyElement(QStringLiteral("hyperlink"));
+        writer.writeAttribute(QStringLiteral("ref"),
+                              QString::fromLatin1(ref,
+                                                  formatCellReference(link.row, link.column, ref)));
+        if (link.target != -1) {
+            QHash<int, QString>::const_iterator it = relationshipIds.constFind(link.target);
+            if (it == relationshipIds.constEnd()) {
+                relationships->addWorksheetRelationship(QStringLiteral("/hyperlink"),
+                                                        urlTable.string(link.target),
                                                         QStringLiteral("External"));
-
-                writer.writeAttribute(QStringLiteral("r:id"),
-                                      QStringLiteral("rId%1").arg(relationships->count()));
+                it = relationshipIds.insert(link.target,
+                                            QStringLiteral("rId%1").arg(relationships->count()));
             }
-
-            if (!data->location.isEmpty())
-                writer.writeAttribute(QStringLiteral("location"), data->location);
-            if (!data->display.isEmpty())
-                writer.writeAttribute(QStringLiteral("display"), data->display);
-            if (!data->tooltip.isEmpty())
-                writer.writeAttribute(QStringLiteral("tooltip"), data->tooltip);
+            writer.writeAttribute(QStringLiteral("r:id"), it.value());
         }
+
+        if (link.location)
+            writer.writeAttribute(QStringLiteral("location"), urlTable.string(link.location));
+        if (link.display)
+            writer.writeAttribute(QStringLiteral("display"), urlTable.string(link.display));
+        if (link.tooltip)
+            writer.writeAttribute(QStringLiteral("tooltip"), urlTable.string(link.tooltip));
     }
 
     writer.writeEndElement(); // hyperlinks
@@ -1490,7 +6144,7 @@ void WorksheetPrivate::saveXmlDrawings(QXmlStreamWriter &writer) const
     if (!drawing)
         return;
 
-    int idx = workbook->drawings().indexOf(drawing.data());
+    int idx = workbook->drawingIndex(drawing.data());
     relationships->addWorksheetRelationship(
         QStringLiteral("/drawing"), QStringLiteral("../drawings/drawing%1.xml").arg(idx + 1));
 
@@ -1499,46 +6153,212 @@ void WorksheetPrivate::saveXmlDrawings(QXmlStreamWriter &writer) const
                           QStringLiteral("rId%1").arg(relationships->count()));
 }
 
-void WorksheetPrivate::splitColsInfo(int colFirst, int colLast)
+/*
+  Refer to the comments part of the sheet and to the VML drawing with the
+  shapes of its notes, which are written by the document.
+ */
+void WorksheetPrivate::saveXmlLegacyDrawing(QXmlStreamWriter &writer) const
+{
+    if (comments.isEmpty())
+        return;
+
+    const int idx = workbook ? workbook->commentsIndex(q_func()) : 0;
+    relationships->addWorksheetRelationship(QStringLiteral("/comments"),
+                                            QStringLiteral("../comments%1.xml").arg(idx + 1));
+    relationships->addWorksheetRelationship(
+        QStringLiteral("/vmlDrawing"), QStringLiteral("../drawings/vmlDrawing%1.vml").arg(idx + 1));
+
+    writer.writeEmptyElement(QStringLiteral("legacyDrawing"));
+    writer.writeAttribute(QStringLiteral("r:id"),
+                          QStringLiteral("rId%1").arg(relationships->count()));
+}
+
+void WorksheetPrivate::saveXmlTableParts(QXmlStreamWriter &writer) const
+{
+    if (tables.isEmpty())
+        return;
+
+    writer.writeStartElement(QStringLiteral("tableParts"));
+    writer.writeAttribute(QStringLiteral("count"), QString::number(tables.size()));
+    for (int i = 0; i < tables.size(); ++i) {
+        int idx = workbook->tableIndex(tables[i].data());
+        if (idx == -1)
+            idx = i;
+        relationships->addWorksheetRelationship(
+            QStringLiteral("/table"), QStringLiteral("../tables/table%1.xml").arg(idx + 1));
+        writer.writeEmptyElement(QStringLiteral("tablePart"));
+        writer.writeAttribute(QStringLiteral("r:id"),
+                              QStringLiteral("rId%1").arg(relationships->count()));
+    }
+    writer.writeEndElement(); // tableParts
+}
+
+/*
+  Returns the info of the range which contains \a col, or a null pointer.
+ */
+QSharedPointer<XlsxColumnInfo> WorksheetPrivate::columnInfoAt(int col) const
+{
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::const_iterator it = colsInfo.upperBound(col);
+    if (it == colsInfo.constBegin())
+        return QSharedPointer<XlsxColumnInfo>();
+    --it;
+    if (it.value()->lastColumn < col)
+        return QSharedPointer<XlsxColumnInfo>();
+    return it.value();
+}
+
+/*
+  Returns the info of the range which contains \a row, or a null pointer.
+ */
+QSharedPointer<XlsxRowInfo> WorksheetPrivate::rowInfoAt(int row) const
+{
+    QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator it = rowsInfo.upperBound(row);
+    if (it == rowsInfo.constBegin())
+        return QSharedPointer<XlsxRowInfo>();
+    --it;
+    if (it.value()->lastRow < row)
+        return QSharedPointer<XlsxRowInfo>();
+    return it.value();
+}
+
+void WorksheetPrivate::splitColsInfo(int colFirst, int colLast)
+{
+    // Split current columnInfo, for example, if "A:H" has been set,
+    // we are trying to set "B:D", there should be "A", "B:D", "E:H".
+    // Only the ranges which contain colFirst or colLast need to be split.
+    QSharedPointer<XlsxColumnInfo> info = columnInfoAt(colFirst);
+    if (info && info->firstColumn < colFirst) {
+        QSharedPointer<XlsxColumnInfo> info2(new XlsxColumnInfo(*info));
+        info->lastColumn = colFirst - 1;
+        info2->firstColumn = colFirst;
+        colsInfo.insert(colFirst, info2);
+    }
+
+    info = columnInfoAt(colLast);
+    if (info && info->lastColumn > colLast) {
+        QSharedPointer<XlsxColumnInfo> info2(new XlsxColumnInfo(*info));
+        info->lastColumn = colLast;
+        info2->firstColumn = colLast + 1;
+        colsInfo.insert(colLast + 1, info2);
+    }
+}
+
+void WorksheetPrivate::splitRowsInfo(int rowFirst, int rowLast)
+{
+    QSharedPointer<XlsxRowInfo> info = rowInfoAt(rowFirst);
+    if (info && info->firstRow < rowFirst) {
+        QSharedPointer<XlsxRowInfo> info2(new XlsxRowInfo(*info));
+        info->lastRow = rowFirst - 1;
+        info2->firstRow = rowFirst;
+        rowsInfo.insert(rowFirst, info2);
+    }
+
+    info = rowInfoAt(rowLast);
+    if (info && info->lastRow > rowLast) {
+        QSharedPointer<XlsxRowInfo> info2(new XlsxRowInfo(*info));
+        info->lastRow = rowLast;
+        info2->firstRow = rowLast + 1;
+        rowsInfo.insert(rowLast + 1, info2);
+    }
+}
+
+static bool sameRowInfo(const XlsxRowInfo &left, const XlsxRowInfo &right)
+{
+    return left.customHeight == right.customHeight && left.height == right.height
+           && left.hidden == right.hidden && left.outlineLevel == right.outlineLevel
+           && left.collapsed == right.collapsed && left.format == right.format;
+}
+
+static bool sameColumnInfo(const XlsxColumnInfo &left, const XlsxColumnInfo &right)
+{
+    return left.customWidth == right.customWidth && left.width == right.width
+           && left.hidden == right.hidden && left.outlineLevel == right.outlineLevel
+           && left.collapsed == right.collapsed && left.format == right.format;
+}
+
+/*
+  Joins the adjacent alike infos from the one before \a colFirst to the
+  one after \a colLast, undoing the splits of columnInfoRange().
+ */
+void WorksheetPrivate::mergeColsInfo(int colFirst, int colLast)
+{
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::iterator it = colsInfo.lowerBound(colFirst);
+    if (it != colsInfo.begin())
+        --it;
+    while (it != colsInfo.end() && it.key() <= colLast) {
+        QMap<int, QSharedPointer<XlsxColumnInfo>>::iterator next = it + 1;
+        if (next == colsInfo.end())
+            break;
+        XlsxColumnInfo *info = it.value().data();
+        const XlsxColumnInfo *nextInfo = next.value().data();
+        if (nextInfo->firstColumn == info->lastColumn + 1 && sameColumnInfo(*info, *nextInfo)) {
+            info->lastColumn = nextInfo->lastColumn;
+            colsInfo.erase(next);
+        } else {
+            it = next;
+        }
+    }
+}
+
+void WorksheetPrivate::mergeRowsInfo(int rowFirst, int rowLast)
+{
+    QMap<int, QSharedPointer<XlsxRowInfo>>::iterator it = rowsInfo.lowerBound(rowFirst);
+    if (it != rowsInfo.begin())
+        --it;
+    while (it != rowsInfo.end() && it.key() <= rowLast) {
+        QMap<int, QSharedPointer<XlsxRowInfo>>::iterator next = it + 1;
+        if (next == rowsInfo.end())
+            break;
+        XlsxRowInfo *info = it.value().data();
+        const XlsxRowInfo *nextInfo = next.value().data();
+        if (nextInfo->firstRow == info->lastRow + 1 && sameRowInfo(*info, *nextInfo)) {
+            info->lastRow = nextInfo->lastRow;
+            rowsInfo.erase(next);
+        } else {
+            it = next;
+        }
+    }
+}
+
+/*
+  Release the memory the sheet holds without needing it: the capacity
+  left in the cell table by the removed cells, the row and column infos
+  left with the default values, which write empty rows, and the caches
+  which are built again on demand.
+ */
+void WorksheetPrivate::squeeze()
 {
-    // Split current columnInfo, for example, if "A:H" has been set,
-    // we are trying to set "B:D", there should be "A", "B:D", "E:H".
-    // This will be more complex if we try to set "C:F" after "B:D".
-    {
-        QMapIterator<int, QSharedPointer<XlsxColumnInfo>> it(colsInfo);
-        while (it.hasNext()) {
-            it.next();
-            QSharedPointer<XlsxColumnInfo> info = it.value();
-            if (colFirst > info->firstColumn && colFirst <= info->lastColumn) {
-                // split the range,
-                QSharedPointer<XlsxColumnInfo> info2(new XlsxColumnInfo(*info));
-                info->lastColumn = colFirst - 1;
-                info2->firstColumn = colFirst;
-                colsInfo.insert(colFirst, info2);
-                for (int c = info2->firstColumn; c <= info2->lastColumn; ++c)
-                    colsInfoHelper[c] = info2;
-
-                break;
-            }
+    cellTable.squeeze();
+
+    bool infosDropped = false;
+    QMap<int, QSharedPointer<XlsxRowInfo>>::iterator rowIt = rowsInfo.begin();
+    while (rowIt != rowsInfo.end()) {
+        if (sameRowInfo(*rowIt.value(), XlsxRowInfo())) {
+            rowIt = rowsInfo.erase(rowIt);
+            infosDropped = true;
+        } else {
+            ++rowIt;
         }
     }
-    {
-        QMapIterator<int, QSharedPointer<XlsxColumnInfo>> it(colsInfo);
-        while (it.hasNext()) {
-            it.next();
-            QSharedPointer<XlsxColumnInfo> info = it.value();
-            if (colLast >= info->firstColumn && colLast < info->lastColumn) {
-                QSharedPointer<XlsxColumnInfo> info2(new XlsxColumnInfo(*info));
-                info->lastColumn = colLast;
-                info2->firstColumn = colLast + 1;
-                colsInfo.insert(colLast + 1, info2);
-                for (int c = info2->firstColumn; c <= info2->lastColumn; ++c)
-                    colsInfoHelper[c] = info2;
-
-                break;
-            }
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::iterator colIt = colsInfo.begin();
+    while (colIt != colsInfo.end()) {
+        if (sameColumnInfo(*colIt.value(), XlsxColumnInfo())) {
+            colIt = colsInfo.erase(colIt);
+            infosDropped = true;
+        } else {
+            ++colIt;
         }
     }
+    if (infosDropped)
+        dirty = true;
+
+    cellCache.squeeze();
+    sharedFormulaTexts.clear();
+    sharedFormulaTexts.squeeze();
+    valueIndex.reset();
+    cfEvaluator.reset();
+    rowAxis.reset();
+    columnAxis.reset();
 }
 
 bool WorksheetPrivate::isColumnRangeValid(int colFirst, int colLast)
@@ -1557,23 +6377,71 @@ bool WorksheetPrivate::isColumnRangeValid(int colFirst, int colLast)
     return true;
 }
 
-QList<int> WorksheetPrivate ::getColumnIndexes(int colFirst, int colLast)
+/*
+  Returns the infos which cover the columns [\a colFirst, \a colLast]
+  exactly, splitting the existing ranges and creating the missing ones.
+ */
+QList<QSharedPointer<XlsxColumnInfo>> WorksheetPrivate::columnInfoRange(int colFirst, int colLast)
 {
+    // The infos are changed by the callers
+    columnAxis.reset();
     splitColsInfo(colFirst, colLast);
 
-    QList<int> nodes;
-    nodes.append(colFirst);
-    for (int col = colFirst; col <= colLast; ++col) {
-        if (colsInfo.contains(col)) {
-            if (nodes.last() != col)
-                nodes.append(col);
-            int nextCol = colsInfo[col]->lastColumn + 1;
-            if (nextCol <= colLast)
-                nodes.append(nextCol);
+    QList<QSharedPointer<XlsxColumnInfo>> columnsInfoList;
+    QMap<int, QSharedPointer<XlsxColumnInfo>>::iterator it = colsInfo.lowerBound(colFirst);
+    int col = colFirst;
+    while (col <= colLast) {
+        if (it != colsInfo.end() && it.key() == col) {
+            columnsInfoList.append(it.value());
+            col = it.value()->lastColumn + 1;
+        } else {
+            // Fill the gap before the next range
+            int colEnd = colLast;
+            if (it != colsInfo.end() && it.key() <= colLast)
+                colEnd = it.key() - 1;
+            QSharedPointer<XlsxColumnInfo> info(new XlsxColumnInfo(col, colEnd));
+            it = colsInfo.insert(col, info);
+            columnsInfoList.append(info);
+            col = colEnd + 1;
+        }
+        ++it;
+    }
+
+    return columnsInfoList;
+}
+
+/*
+  Returns the infos which cover the rows [\a rowFirst, \a rowLast]
+  exactly, splitting the existing ranges and creating the missing ones.
+ */
+QList<QSharedPointer<XlsxRowInfo>> WorksheetPrivate::rowInfoRange(int rowFirst, int rowLast)
+{
+    // The infos are changed by the callers
+    rowAxis.reset();
+    splitRowsInfo(rowFirst, rowLast);
+
+    QList<QSharedPointer<XlsxRowInfo>> rowInfoList;
+    QMap<int, QSharedPointer<XlsxRowInfo>>::iterator it = rowsInfo.lowerBound(rowFirst);
+    int row = rowFirst;
+    while (row <= rowLast) {
+        if (it != rowsInfo.end() && it.key() == row) {
+            rowInfoList.append(it.value());
+            row = it.value()->lastRow + 1;
+        } else {
+            int rowEnd = rowLast;
+            if (it != rowsInfo.end() && it.key() <= rowLast)
+                rowEnd = it.key() - 1;
+            QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo);
+            info->firstRow = row;
+            info->lastRow = rowEnd;
+            it = rowsInfo.insert(row, info);
+            rowInfoList.append(info);
+            row = rowEnd + 1;
         }
+        ++it;
     }
 
-    return nodes;
+    return rowInfoList;
 }
 
 /*!
@@ -1621,6 +6489,7 @@ bool Worksheet::setColumnHidden(const CellRange &range, bool hidden)
 bool Worksheet::setColumnWidth(int colFirst, int colLast, double width)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxColumnInfo>> columnInfoList = d->getColumnInfoList(colFirst, colLast);
     foreach (QSharedPointer<XlsxColumnInfo> columnInfo, columnInfoList)
@@ -1637,6 +6506,7 @@ bool Worksheet::setColumnWidth(int colFirst, int colLast, double width)
 bool Worksheet::setColumnFormat(int colFirst, int colLast, const Format &format)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxColumnInfo>> columnInfoList = d->getColumnInfoList(colFirst, colLast);
     foreach (QSharedPointer<XlsxColumnInfo> columnInfo, columnInfoList)
@@ -1657,6 +6527,7 @@ bool Worksheet::setColumnFormat(int colFirst, int colLast, const Format &format)
 bool Worksheet::setColumnHidden(int colFirst, int colLast, bool hidden)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxColumnInfo>> columnInfoList = d->getColumnInfoList(colFirst, colLast);
     foreach (QSharedPointer<XlsxColumnInfo> columnInfo, columnInfoList)
@@ -1665,6 +6536,93 @@ bool Worksheet::setColumnHidden(int colFirst, int colLast, bool hidden)
     return (columnInfoList.count() > 0);
 }
 
+/*!
+  Sets the widths of the columns of \a range so that they fit the cells of
+  the range, as Excel does when the border of a column is double-clicked.
+  The columns without cells in the range, and the cells which wrap their
+  text, are left out. When \a range is invalid, the whole sheet is fitted.
+
+  The cells are read in one pass, each shared string being measured once
+  per format, and the widths of runs of columns are set at once. The text is
+  measured with QFontMetricsF when there is a QGuiApplication, and from
+  the proportions of Calibri otherwise.
+
+  Returns false if no column was fitted.
+ */
+bool Worksheet::autoFitColumns(const CellRange &range)
+{
+    Q_D(Worksheet);
+    const CellRange fitted = range.isValid() ? range : dimension();
+    if (!fitted.isValid())
+        return false;
+
+    TextMeter meter;
+    Styles *styles = d->workbook->styles();
+    QVector<qreal> pixels(fitted.columnCount(), 0);
+    // The widths of the shared strings, by string and xf indexes
+    QHash<quint64, qreal> stringWidths;
+    RawRowIterator it(this, fitted);
+    while (it.nextRow()) {
+        for (int i = 0; i < it.cellCount(); ++i) {
+            const RawCellValue value = it.value(i);
+            if (value.type == RawCellValue::Empty)
+                continue;
+            const Format format =
+                value.formatIndex == -1 ? Format() : styles->xfFormat(value.formatIndex);
+            if (format.textWrap())
+                continue;
+
+            qreal width = 0;
+            switch (value.type) {
+            case RawCellValue::Number:
+                width = meter.numberWidth(value.number, value.formatIndex, format);
+                break;
+            case RawCellValue::Boolean:
+                width = meter.textWidth(value.boolean ? QStringLiteral("TRUE")
+                                                      : QStringLiteral("FALSE"), format);
+                break;
+            case RawCellValue::SharedString: {
+                const quint64 key = (quint64(quint32(value.sharedStringIndex)) << 32)
+                                    | quint32(value.formatIndex);
+                QHash<quint64, qreal>::const_iterator cached = stringWidths.constFind(key);
+                if (cached != stringWidths.constEnd()) {
+                    width = cached.value();
+                } else {
+                    width = meter.textWidth(sharedString(value.sharedStringIndex), format);
+                    stringWidths.insert(key, width);
+                }
+                break;
+            }
+            default:
+                width = meter.textWidth(read(it.row(), it.column(i)).toString(), format);
+                break;
+            }
+            qreal &columnPixels = pixels[it.column(i) - fitted.firstColumn()];
+            columnPixels = qMax(columnPixels, width);
+        }
+    }
+
+    // The runs of columns of the same width share their info
+    bool changed = false;
+    int first = 0;
+    while (first < pixels.size()) {
+        if (pixels[first] <= 0) {
+            ++first;
+            continue;
+        }
+        const double width = TextMeter::columnWidth(pixels[first]);
+        int last = first;
+        while (last + 1 < pixels.size() && pixels[last + 1] > 0
+               && TextMeter::columnWidth(pixels[last + 1]) == width) {
+            ++last;
+        }
+        changed |= setColumnWidth(fitted.firstColumn() + first, fitted.firstColumn() + last,
+                                  width);
+        first = last + 1;
+    }
+    return changed;
+}
+
 /*!
   Returns width of the \a column in characters of the normal font. Columns are 1-indexed.
  */
@@ -1717,6 +6675,7 @@ bool Worksheet::isColumnHidden(int column)
 bool Worksheet::setRowHeight(int rowFirst, int rowLast, double height)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxRowInfo>> rowInfoList = d->getRowInfoList(rowFirst, rowLast);
 
@@ -1737,6 +6696,7 @@ bool Worksheet::setRowHeight(int rowFirst, int rowLast, double height)
 bool Worksheet::setRowFormat(int rowFirst, int rowLast, const Format &format)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxRowInfo>> rowInfoList = d->getRowInfoList(rowFirst, rowLast);
 
@@ -1756,6 +6716,7 @@ bool Worksheet::setRowFormat(int rowFirst, int rowLast, const Format &format)
 bool Worksheet::setRowHidden(int rowFirst, int rowLast, bool hidden)
 {
     Q_D(Worksheet);
+    setDirty();
 
     QList<QSharedPointer<XlsxRowInfo>> rowInfoList = d->getRowInfoList(rowFirst, rowLast);
     foreach (QSharedPointer<XlsxRowInfo> rowInfo, rowInfoList)
@@ -1772,10 +6733,11 @@ double Worksheet::rowHeight(int row)
     Q_D(Worksheet);
     int min_col = d->dimension.isValid() ? d->dimension.firstColumn() : 1;
 
-    if (d->checkDimensions(row, min_col, false, true) || !d->rowsInfo.contains(row))
+    QSharedPointer<XlsxRowInfo> rowInfo = d->rowInfoAt(row);
+    if (d->checkDimensions(row, min_col, false, true) || !rowInfo)
         return d->sheetFormatProps.defaultRowHeight; // return default on invalid row
 
-    return d->rowsInfo[row]->height;
+    return rowInfo->height;
 }
 
 /*!
@@ -1785,10 +6747,11 @@ Format Worksheet::rowFormat(int row)
 {
     Q_D(Worksheet);
     int min_col = d->dimension.isValid() ? d->dimension.firstColumn() : 1;
-    if (d->checkDimensions(row, min_col, false, true) || !d->rowsInfo.contains(row))
+    QSharedPointer<XlsxRowInfo> rowInfo = d->rowInfoAt(row);
+    if (d->checkDimensions(row, min_col, false, true) || !rowInfo)
         return Format(); // return default on invalid row
 
-    return d->rowsInfo[row]->format;
+    return rowInfo->format;
 }
 
 /*!
@@ -1798,10 +6761,11 @@ bool Worksheet::isRowHidden(int row)
 {
     Q_D(Worksheet);
     int min_col = d->dimension.isValid() ? d->dimension.firstColumn() : 1;
-    if (d->checkDimensions(row, min_col, false, true) || !d->rowsInfo.contains(row))
+    QSharedPointer<XlsxRowInfo> rowInfo = d->rowInfoAt(row);
+    if (d->checkDimensions(row, min_col, false, true) || !rowInfo)
         return false; // return default on invalid row
 
-    return d->rowsInfo[row]->hidden;
+    return rowInfo->hidden;
 }
 
 /*!
@@ -1812,23 +6776,23 @@ bool Worksheet::isRowHidden(int row)
 bool Worksheet::groupRows(int rowFirst, int rowLast, bool collapsed)
 {
     Q_D(Worksheet);
+    if (rowFirst < 1 || rowLast > XLSX_ROW_MAX || rowFirst > rowLast)
+        return false;
+    setDirty();
 
-    for (int row = rowFirst; row <= rowLast; ++row) {
-        if (d->rowsInfo.contains(row)) {
-            d->rowsInfo[row]->outlineLevel += 1;
-        } else {
-            QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo);
-            info->outlineLevel += 1;
-            d->rowsInfo.insert(row, info);
-        }
+    // The rows share the infos of their runs, a group of a million rows
+    // takes as many infos as the runs it crosses.
+    foreach (QSharedPointer<XlsxRowInfo> rowInfo, d->getRowInfoList(rowFirst, rowLast)) {
+        rowInfo->outlineLevel += 1;
+        d->outline_row_level = qMax(d->outline_row_level, rowInfo->outlineLevel);
         if (collapsed)
-            d->rowsInfo[row]->hidden = true;
+            rowInfo->hidden = true;
     }
-    if (collapsed) {
-        if (!d->rowsInfo.contains(rowLast + 1))
-            d->rowsInfo.insert(rowLast + 1, QSharedPointer<XlsxRowInfo>(new XlsxRowInfo));
-        d->rowsInfo[rowLast + 1]->collapsed = true;
+    if (collapsed && rowLast < XLSX_ROW_MAX) {
+        foreach (QSharedPointer<XlsxRowInfo> rowInfo, d->getRowInfoList(rowLast + 1, rowLast + 1))
+            rowInfo->collapsed = true;
     }
+    d->mergeRowsInfo(rowFirst, qMin(rowLast + 1, XLSX_ROW_MAX));
     return true;
 }
 
@@ -1852,58 +6816,29 @@ bool Worksheet::groupColumns(const CellRange &range, bool collapsed)
 bool Worksheet::groupColumns(int colFirst, int colLast, bool collapsed)
 {
     Q_D(Worksheet);
+    if (!d->isColumnRangeValid(colFirst, colLast))
+        return false;
+    setDirty();
 
-    d->splitColsInfo(colFirst, colLast);
+    foreach (QSharedPointer<XlsxColumnInfo> info, d->columnInfoRange(colFirst, colLast)) {
+        info->outlineLevel += 1;
+        d->outline_col_level = qMax(d->outline_col_level, info->outlineLevel);
+        if (collapsed)
+            info->hidden = true;
+    }
 
-    QList<int> nodes;
-    nodes.append(colFirst);
-    for (int col = colFirst; col <= colLast; ++col) {
-        if (d->colsInfo.contains(col)) {
-            if (nodes.last() != col)
-                nodes.append(col);
-            int nextCol = d->colsInfo[col]->lastColumn + 1;
-            if (nextCol <= colLast)
-                nodes.append(nextCol);
-        }
-    }
-
-    for (int idx = 0; idx < nodes.size(); ++idx) {
-        int colStart = nodes[idx];
-        if (d->colsInfo.contains(colStart)) {
-            QSharedPointer<XlsxColumnInfo> info = d->colsInfo[colStart];
-            info->outlineLevel += 1;
-            if (collapsed)
-                info->hidden = true;
-        } else {
-            int colEnd = (idx == nodes.size() - 1) ? colLast : nodes[idx + 1] - 1;
-            QSharedPointer<XlsxColumnInfo> info(new XlsxColumnInfo(colStart, colEnd));
-            info->outlineLevel += 1;
-            d->colsInfo.insert(colFirst, info);
-            if (collapsed)
-                info->hidden = true;
-            for (int c = colStart; c <= colEnd; ++c)
-                d->colsInfoHelper[c] = info;
-        }
-    }
-
-    if (collapsed) {
-        int col = colLast + 1;
-        d->splitColsInfo(col, col);
-        if (d->colsInfo.contains(col))
-            d->colsInfo[col]->collapsed = true;
-        else {
-            QSharedPointer<XlsxColumnInfo> info(new XlsxColumnInfo(col, col));
+    if (collapsed && colLast < XLSX_COLUMN_MAX) {
+        foreach (QSharedPointer<XlsxColumnInfo> info, d->columnInfoRange(colLast + 1, colLast + 1))
             info->collapsed = true;
-            d->colsInfo.insert(col, info);
-            d->colsInfoHelper[col] = info;
-        }
     }
+    d->mergeColsInfo(colFirst, qMin(colLast + 1, XLSX_COLUMN_MAX));
 
-    return false;
+    return true;
 }
 
 /*!
-    Return the range that contains cell data.
+    Return the range that contains cell data. The range is kept up to date
+    as cells are written and removed, so this is cheap to call.
  */
 CellRange Worksheet::dimension() const
 {
@@ -1911,56 +6846,274 @@ CellRange Worksheet::dimension() const
     return d->dimension;
 }
 
+/*!
+    Enables the constant memory mode when \a enable is true.
+
+    In this mode, the cells are not kept by the worksheet. Once a cell
+    in a higher row is written, all the rows before that row are
+    flushed to a temporary file and their data is released, so the
+    memory usage depends on the width of the rows instead of the size
+    of the sheet. The rows must be written in ascending order; cells,
+    comments and row properties of rows which have been flushed can
+    not be read or modified any more.
+
+    When the temporary file can't be opened, the rows are kept in memory.
+    When it can't be written, the rows written to it are lost and the
+    document fails to be saved.
+
+    The mode can only be changed before any cell has been written.
+    Returns false if the mode can not be changed.
+
+    \sa isConstantMemoryEnabled()
+ */
+bool Worksheet::setConstantMemoryEnabled(bool enable)
+{
+    Q_D(Worksheet);
+    setDirty();
+    if (enable == d->constantMemory)
+        return true;
+    if (d->streamFile || !d->cellTable.isEmpty())
+        return false;
+
+    d->constantMemory = enable;
+    return true;
+}
+
+/*!
+    Returns whether the constant memory mode is enabled.
+
+    \sa setConstantMemoryEnabled()
+ */
+bool Worksheet::isConstantMemoryEnabled() const
+{
+    Q_D(const Worksheet);
+    return d->constantMemory;
+}
+
+/*!
+    Sets where writeString() stores the plain strings to \a storage: in the
+    shared strings table, which is the default, in the cells themselves,
+    or in the cells for the columns where most strings are distinct.
+
+    The shared strings table pays off for the labels repeated over the
+    rows, but identifiers and free text only make it larger and slower
+    to save. The adaptive storage estimates the number of distinct
+    strings of each column as they are written, and inlines the strings
+    of a column once enough of them show that most are distinct. The
+    strings already written stay where they are.
+
+    \sa writeInlineString()
+ */
+void Worksheet::setStringStorage(StringStorage storage)
+{
+    Q_D(Worksheet);
+    d->stringStorage = storage;
+    d->columnCardinality.clear();
+}
+
+/*!
+    Returns where writeString() stores the plain strings.
+ */
+Worksheet::StringStorage Worksheet::stringStorage() const
+{
+    Q_D(const Worksheet);
+    return d->stringStorage;
+}
+
 /*
- Convert the height of a cell from user's units to pixels. If the
- height hasn't been set by the user we use the default value. If
- the row is hidden it has a value of zero.
+ Convert the height of a row from points to pixels.
 */
-int WorksheetPrivate::rowPixelsSize(int row) const
+static int rowHeightPixels(double height)
 {
-    double height;
-    if (row_sizes.contains(row))
-        height = row_sizes[row];
-    else
-        height = default_row_height;
     return static_cast<int>(4.0 / 3.0 * height);
 }
 
 /*
- Convert the width of a cell from user's units to pixels. Excel rounds
- the column width to the nearest pixel. If the width hasn't been set
- by the user we use the default value. If the column is hidden it
- has a value of zero.
+ Convert the width of a column from characters to pixels. Excel rounds
+ the column width to the nearest pixel.
 */
-int WorksheetPrivate::colPixelsSize(int col) const
+static int columnWidthPixels(double width)
 {
     double max_digit_width = 7.0; // For Calabri 11
     double padding = 5.0;
-    int pixels = 0;
+    if (width <= 0)
+        return 64;
+    if (width < 1)
+        return static_cast<int>(width * (max_digit_width + padding) + 0.5);
+    return static_cast<int>(width * max_digit_width + 0.5) + padding;
+}
 
-    if (col_sizes.contains(col)) {
-        double width = col_sizes[col];
-        if (width < 1)
-            pixels = static_cast<int>(width * (max_digit_width + padding) + 0.5);
-        else
-            pixels = static_cast<int>(width * max_digit_width + 0.5) + padding;
-    } else {
-        pixels = 64;
+/*
+ Returns the height of the row in pixels. If the height hasn't been set
+ by the user we use the default value. If the row is hidden it has a
+ value of zero.
+*/
+int WorksheetPrivate::rowPixelsSize(int row) const
+{
+    return rowPixels().size(row);
+}
+
+/*
+ Returns the width of the column in pixels. If the width hasn't been
+ set by the user we use the default value. If the column is hidden it
+ has a value of zero.
+*/
+int WorksheetPrivate::colPixelsSize(int col) const
+{
+    return columnPixels().size(col);
+}
+
+/*
+  Returns the pixel sizes and offsets of the rows, made from rowsInfo.
+ */
+const PixelAxis &WorksheetPrivate::rowPixels() const
+{
+    if (!rowAxis) {
+        const int defaultSize = rowHeightPixels(sheetFormatProps.defaultRowHeight);
+        rowAxis.reset(new PixelAxis(defaultSize));
+        foreach (const QSharedPointer<XlsxRowInfo> &info, rowsInfo) {
+            int size = info->customHeight ? rowHeightPixels(info->height) : defaultSize;
+            if (info->hidden)
+                size = 0;
+            if (size != defaultSize)
+                rowAxis->addRun(info->firstRow, info->lastRow, size);
+        }
+    }
+    return *rowAxis;
+}
+
+/*
+  Returns the pixel sizes and offsets of the columns, made from colsInfo.
+ */
+const PixelAxis &WorksheetPrivate::columnPixels() const
+{
+    if (!columnAxis) {
+        const int defaultSize = columnWidthPixels(sheetFormatProps.defaultColWidth);
+        columnAxis.reset(new PixelAxis(defaultSize));
+        foreach (const QSharedPointer<XlsxColumnInfo> &info, colsInfo) {
+            int size = info->width > 0 ? columnWidthPixels(info->width) : defaultSize;
+            if (info->hidden)
+                size = 0;
+            if (size != defaultSize)
+                columnAxis->addRun(info->firstColumn, info->lastColumn, size);
+        }
+    }
+    return *columnAxis;
+}
+
+/*
+  Decodes the reference \a ref of a <c> element into \a row and \a column.
+  Cells normally belong to the row being read, whose "r" attribute is
+  \a rowText, so only their column letters are decoded in that case. Leaves
+  \a row and \a column untouched if \a ref is invalid.
+ */
+static void readCellPosition(const QStringRef &ref, const QString &rowText, int *row,
+                             int *column)
+{
+    const int letters = ref.size() - rowText.size();
+    if (!rowText.isEmpty() && letters > 0 && ref.endsWith(rowText)) {
+        int col = 0;
+        int i = 0;
+        for (; i < letters; ++i) {
+            const ushort c = ref.at(i).unicode();
+            if (c == '$' && (i == 0 || i == letters - 1))
+                continue;
+            if (c < 'A' || c > 'Z' || col > XLSX_COLUMN_MAX)
+                break;
+            col = col * 26 + (c - 'A' + 1);
+        }
+        if (i == letters && col > 0 && col <= XLSX_COLUMN_MAX) {
+            *column = col;
+            return;
+        }
+    }
+    parseCellReference(ref, row, column);
+}
+
+/*
+  Maps the "t" attribute of a <c> element to its cell type. Unknown
+  values are treated as numbers, the default of the attribute.
+ */
+static Cell::CellType cellTypeFromString(const QStringRef &type)
+{
+    switch (type.size()) {
+    case 1:
+        switch (type.at(0).unicode()) {
+        case 's':
+            return Cell::SharedStringType;
+        case 'b':
+            return Cell::BooleanType;
+        case 'e':
+            return Cell::ErrorType;
+        default:
+            break;
+        }
+        break;
+    case 3:
+        if (type == QLatin1String("str"))
+            return Cell::StringType;
+        break;
+    case 9:
+        if (type == QLatin1String("inlineStr"))
+            return Cell::InlineStringType;
+        break;
+    default:
+        break;
     }
-    return pixels;
+    return Cell::NumberType;
+}
+
+/*
+  The filter of the document the sheet is loaded by, or 0 if all of the
+  sheet is loaded.
+ */
+const LoadFilter *WorksheetPrivate::loadFilter() const
+{
+    if (!workbook || workbook->d_func()->loadFilter.isEmpty())
+        return 0;
+    return &workbook->d_func()->loadFilter;
 }
 
 void WorksheetPrivate::loadXmlSheetData(QXmlStreamReader &reader)
 {
-    Q_Q(Worksheet);
     Q_ASSERT(reader.name() == QLatin1String("sheetData"));
 
+    // The "r" attributes of <row> and <c> are optional, elements without
+    // one follow the previous element.
+    int currentRow = 0;
+    int currentColumn = 0;
+    QString currentRowText;
+    int rowsDone = 0;
+    // With Document::RowBlockLoad, each finished block of rows is spilled
+    const bool rowBlocks = workbook && workbook->d_func()->rowBlockLoad;
+    const LoadFilter *filter = loadFilter();
+    const LoadFilter::Options options = filter ? filter->options() : LoadFilter::DefaultOptions;
+    int currentBlock = 0;
+    QSharedPointer<XlsxRowInfo> previousRowInfo;
+    int previousRowXf = -1;
+
     while (!reader.atEnd()
            && !(reader.name() == QLatin1String("sheetData")
                 && reader.tokenType() == QXmlStreamReader::EndElement)) {
         if (reader.readNextStartElement()) {
             if (reader.name() == QLatin1String("row")) {
-                QXmlStreamAttributes attributes = reader.attributes();
+                if (progressMonitor && !reportRows(++rowsDone))
+                    return;
+                const QXmlStreamAttributes attributes = reader.attributes();
+                const QStringRef r = attributes.value(QLatin1String("r"));
+                currentRow = r.isEmpty() ? currentRow + 1 : r.toInt();
+                currentRowText = QString::number(currentRow);
+                currentColumn = 0;
+                if (filter && !filter->acceptsRow(currentRow)) {
+                    reader.skipCurrentElement();
+                    continue;
+                }
+                if (rowBlocks && (currentRow - 1) / CellTable::SpillBlockRows > currentBlock) {
+                    currentBlock = (currentRow - 1) / CellTable::SpillBlockRows;
+                    cellTable.spill(currentRow);
+                } else if (workbook && workbook->d_func()->memoryBudget > 0) {
+                    checkMemoryBudget(currentRow);
+                }
 
                 if (attributes.hasAttribute(QLatin1String("customFormat"))
                     || attributes.hasAttribute(QLatin1String("customHeight"))
@@ -1968,111 +7121,139 @@ void WorksheetPrivate::loadXmlSheetData(QXmlStreamReader &reader)
                     || attributes.hasAttribute(QLatin1String("outlineLevel"))
                     || attributes.hasAttribute(QLatin1String("collapsed"))) {
 
-                    QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo);
+                    XlsxRowInfo attributesInfo;
+                    int rowXf = -1;
                     if (attributes.hasAttribute(QLatin1String("customFormat"))
-                        && attributes.hasAttribute(QLatin1String("s"))) {
-                        int idx = attributes.value(QLatin1String("s")).toString().toInt();
-                        info->format = workbook->styles()->xfFormat(idx);
+                        && attributes.hasAttribute(QLatin1String("s"))
+                        && !(options & LoadFilter::SkipStyles)) {
+                        rowXf = attributes.value(QLatin1String("s")).toInt();
+                        attributesInfo.format = workbook->styles()->xfFormat(rowXf);
                     }
 
                     if (attributes.hasAttribute(QLatin1String("customHeight"))) {
-                        info->customHeight =
+                        attributesInfo.customHeight =
                             attributes.value(QLatin1String("customHeight")) == QLatin1String("1");
                         // Row height is only specified when customHeight is set
                         if (attributes.hasAttribute(QLatin1String("ht"))) {
-                            info->height =
-                                attributes.value(QLatin1String("ht")).toString().toDouble();
+                            attributesInfo.height =
+                                attributes.value(QLatin1String("ht")).toDouble();
                         }
                     }
 
                     // both "hidden" and "collapsed" default are false
-                    info->hidden = attributes.value(QLatin1String("hidden")) == QLatin1String("1");
-                    info->collapsed =
+                    attributesInfo.hidden =
+                        attributes.value(QLatin1String("hidden")) == QLatin1String("1");
+                    attributesInfo.collapsed =
                         attributes.value(QLatin1String("collapsed")) == QLatin1String("1");
 
                     if (attributes.hasAttribute(QLatin1String("outlineLevel")))
-                        info->outlineLevel =
-                            attributes.value(QLatin1String("outlineLevel")).toString().toInt();
-
-                    //"r" is optional too.
-                    if (attributes.hasAttribute(QLatin1String("r"))) {
-                        int row = attributes.value(QLatin1String("r")).toString().toInt();
-                        rowsInfo[row] = info;
+                        attributesInfo.outlineLevel =
+                            attributes.value(QLatin1String("outlineLevel")).toInt();
+
+                    // The rows of an outline group or a block of hidden rows
+                    // share one info
+                    if (previousRowInfo && previousRowInfo->lastRow == currentRow - 1
+                        && rowXf == previousRowXf
+                        && sameRowInfo(*previousRowInfo, attributesInfo)) {
+                        previousRowInfo->lastRow = currentRow;
+                    } else {
+                        QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo(attributesInfo));
+                        info->firstRow = currentRow;
+                        info->lastRow = currentRow;
+                        rowsInfo[currentRow] = info;
+                        previousRowInfo = info;
+                        previousRowXf = rowXf;
                     }
                 }
 
             } else if (reader.name() == QLatin1String("c")) { // Cell
-                QXmlStreamAttributes attributes = reader.attributes();
-                QString r = attributes.value(QLatin1String("r")).toString();
-                CellReference pos(r);
-
-                // get format
+                // One pass over the attributes, working on the reader's own buffer
+                // instead of temporary strings.
+                int row = currentRow;
+                int column = currentColumn + 1;
                 Format format;
-                if (attributes.hasAttribute(QLatin1String("s"))) { //"s" == style index
-                    int idx = attributes.value(QLatin1String("s")).toString().toInt();
-                    format = workbook->styles()->xfFormat(idx);
-                    ////Empty format exists in styles xf table of real .xlsx files, see issue #65.
-                    // if (!format.isValid())
-                    //    qDebug()<<QStringLiteral("<c s=\"%1\">Invalid style index:
-                    //    ").arg(idx)<<idx;
-                }
-
                 Cell::CellType cellType = Cell::NumberType;
-                if (attributes.hasAttribute(QLatin1String("t"))) {
-                    QString typeString = attributes.value(QLatin1String("t")).toString();
-                    if (typeString == QLatin1String("s"))
-                        cellType = Cell::SharedStringType;
-                    else if (typeString == QLatin1String("inlineStr"))
-                        cellType = Cell::InlineStringType;
-                    else if (typeString == QLatin1String("str"))
-                        cellType = Cell::StringType;
-                    else if (typeString == QLatin1String("b"))
-                        cellType = Cell::BooleanType;
-                    else if (typeString == QLatin1String("e"))
-                        cellType = Cell::ErrorType;
-                    else
-                        cellType = Cell::NumberType;
+                const QXmlStreamAttributes attributes = reader.attributes();
+                for (int i = 0; i < attributes.size(); ++i) {
+                    const QXmlStreamAttribute &attribute = attributes.at(i);
+                    const QStringRef name = attribute.name();
+                    if (name == QLatin1String("r")) {
+                        readCellPosition(attribute.value(), currentRowText, &row, &column);
+                    } else if (name == QLatin1String("s")
+                               && !(options & LoadFilter::SkipStyles)) { //"s" == style index
+                        format = workbook->styles()->xfFormat(attribute.value().toInt());
+                        // Empty format exists in styles xf table of real .xlsx files,
+                        // see issue #65.
+                    } else if (name == QLatin1String("t")) {
+                        cellType = cellTypeFromString(attribute.value());
+                    }
+                }
+                if (filter && !filter->acceptsCell(row, column)) {
+                    // The shared formulas are still kept for the cells loaded
+                    while (reader.readNextStartElement()) {
+                        const QXmlStreamAttributes f = reader.attributes();
+                        if (reader.name() == QLatin1String("f")
+                            && f.value(QLatin1String("t")) == QLatin1String("shared")
+                            && f.hasAttribute(QLatin1String("ref"))
+                            && !(options & LoadFilter::SkipFormulas)) {
+                            CellFormula formula;
+                            formula.loadFromXml(reader);
+                            sharedFormulaMap[formula.sharedIndex()] = formula;
+                            sharedFormulaTemplates.remove(formula.sharedIndex());
+                            sharedFormulaTexts.clear();
+                        } else {
+                            reader.skipCurrentElement();
+                        }
+                    }
+                    currentColumn = column;
+                    continue;
                 }
 
-                QSharedPointer<Cell> cell(new Cell(QVariant(), cellType, format, q));
+                QVariant value;
+                CellFormula formula;
+                int sst_idx = -1;
+                QVector<InlineRun> inlineRuns;
                 while (!reader.atEnd()
                        && !(reader.name() == QLatin1String("c")
                             && reader.tokenType() == QXmlStreamReader::EndElement)) {
                     if (reader.readNextStartElement()) {
-                        if (reader.name() == QLatin1String("f")) {
-                            CellFormula &formula = cell->d_func()->formula;
+                        if (reader.name() == QLatin1String("f")
+                            && (options & LoadFilter::SkipFormulas)) {
+                            reader.skipCurrentElement();
+                        } else if (reader.name() == QLatin1String("f")) {
                             formula.loadFromXml(reader);
                             if (formula.formulaType() == CellFormula::SharedType
                                 && !formula.formulaText().isEmpty()) {
                                 sharedFormulaMap[formula.sharedIndex()] = formula;
+                                sharedFormulaTemplates.remove(formula.sharedIndex());
+                                sharedFormulaTexts.clear();
                             }
                         } else if (reader.name() == QLatin1String("v")) {
-                            QString value = reader.readElementText();
+                            // The value is a single run of characters, which is read in
+                            // place instead of through readElementText().
+                            reader.readNext();
+                            const QStringRef text =
+                                reader.isCharacters() ? reader.text() : QStringRef();
                             if (cellType == Cell::SharedStringType) {
-                                int sst_idx = value.toInt();
-                                sharedStrings()->incRefByStringIndex(sst_idx);
-                                RichString rs = sharedStrings()->getSharedString(sst_idx);
-                                cell->d_func()->value = rs.toPlainString();
-                                if (rs.isRichString())
-                                    cell->d_func()->richString = rs;
+                                sst_idx = text.toInt();
+                                if (!deferSstRefs) {
+                                    sharedStrings()->incRefByStringIndex(sst_idx);
+                                } else if (sst_idx >= 0) {
+                                    if (sst_idx >= sstRefCounts.size())
+                                        sstRefCounts.resize(sst_idx + 1);
+                                    ++sstRefCounts[sst_idx];
+                                }
                             } else if (cellType == Cell::NumberType) {
-                                cell->d_func()->value = value.toDouble();
+                                value = parseDouble(text);
                             } else if (cellType == Cell::BooleanType) {
-                                cell->d_func()->value = value.toInt() ? true : false;
+                                value = text.toInt() ? true : false;
                             } else { // Cell::ErrorType and Cell::StringType
-                                cell->d_func()->value = value;
+                                value = text.toString();
                             }
+                            if (!reader.isEndElement())
+                                reader.skipCurrentElement();
                         } else if (reader.name() == QLatin1String("is")) {
-                            while (!reader.atEnd()
-                                   && !(reader.name() == QLatin1String("is")
-                                        && reader.tokenType() == QXmlStreamReader::EndElement)) {
-                                if (reader.readNextStartElement()) {
-                                    //:Todo, add rich text read support
-                                    if (reader.name() == QLatin1String("t")) {
-                                        cell->d_func()->value = reader.readElementText();
-                                    }
-                                }
-                            }
+                            value = loadXmlInlineString(reader, &inlineRuns);
                         } else if (reader.name() == QLatin1String("extLst")) {
                             // skip extLst element
                             while (!reader.atEnd()
@@ -2083,10 +7264,344 @@ void WorksheetPrivate::loadXmlSheetData(QXmlStreamReader &reader)
                         }
                     }
                 }
-                cellTable[pos.row()][pos.column()] = cell;
+
+                currentColumn = column;
+
+                // Shared strings only need their index, their text is read
+                // from the table when the cell is read.
+                if (cellType == Cell::SharedStringType && sst_idx != -1 && !formula.isValid())
+                    setCell(row, column, CellData::fromSharedString(sst_idx, xfIndexOf(format)));
+                else
+                    setCell(row, column, cellType, value, format, formula, inlineRuns, sst_idx);
+            }
+        }
+    }
+
+    if (rowBlocks) {
+        cellTable.spill(XLSX_ROW_MAX + 1);
+        cellTable.setRestoredBlockLimit(RowBlockCacheSize);
+    }
+}
+
+/*
+  Read the inline string <is> and return its text. The runs of a rich
+  text are added to \a runs, their fonts going to the inline fonts of the
+  sheet. The phonetic runs are skipped.
+ */
+QString WorksheetPrivate::loadXmlInlineString(QXmlStreamReader &reader, QVector<InlineRun> *runs)
+{
+    Q_ASSERT(reader.name() == QLatin1String("is"));
+
+    QString text;
+    while (!reader.atEnd()
+           && !(reader.name() == QLatin1String("is")
+                && reader.tokenType() == QXmlStreamReader::EndElement)) {
+        if (!reader.readNextStartElement())
+            continue;
+        if (reader.name() == QLatin1String("t")) {
+            text = reader.readElementText();
+        } else if (reader.name() == QLatin1String("r")) {
+            InlineRun run = {0, -1};
+            QString runText;
+            while (!reader.atEnd()
+                   && !(reader.name() == QLatin1String("r")
+                        && reader.tokenType() == QXmlStreamReader::EndElement)) {
+                if (!reader.readNextStartElement())
+                    continue;
+                if (reader.name() == QLatin1String("rPr"))
+                    run.fontId = inlineFontId(SharedStrings::readRichStringPart_rPr(reader));
+                else if (reader.name() == QLatin1String("t"))
+                    runText = reader.readElementText();
+            }
+            run.length = runText.size();
+            runs->append(run);
+            text += runText;
+        } else {
+            reader.skipCurrentElement();
+        }
+    }
+    return text;
+}
+
+/*
+  \overload
+  Decodes the \a size bytes of the reference \a ref, \a rowText being the
+  "r" attribute of the row being read.
+ */
+static void readCellPosition(const char *ref, int size, const QByteArray &rowText, int *row,
+                             int *column)
+{
+    const int letters = size - rowText.size();
+    if (!rowText.isEmpty() && letters > 0
+        && memcmp(ref + letters, rowText.constData(), rowText.size()) == 0) {
+        int col = 0;
+        int i = 0;
+        for (; i < letters; ++i) {
+            const char c = ref[i];
+            if (c == '$' && (i == 0 || i == letters - 1))
+                continue;
+            if (c < 'A' || c > 'Z' || col > XLSX_COLUMN_MAX)
+                break;
+            col = col * 26 + (c - 'A' + 1);
+        }
+        if (i == letters && col > 0 && col <= XLSX_COLUMN_MAX) {
+            *column = col;
+            return;
+        }
+    }
+    parseCellReference(ref, size, row, column);
+}
+
+/*
+  \overload
+ */
+static Cell::CellType cellTypeFromString(const char *type, int size)
+{
+    switch (size) {
+    case 1:
+        switch (type[0]) {
+        case 's':
+            return Cell::SharedStringType;
+        case 'b':
+            return Cell::BooleanType;
+        case 'e':
+            return Cell::ErrorType;
+        default:
+            break;
+        }
+        break;
+    case 3:
+        if (memcmp(type, "str", 3) == 0)
+            return Cell::StringType;
+        break;
+    case 9:
+        if (memcmp(type, "inlineStr", 9) == 0)
+            return Cell::InlineStringType;
+        break;
+    default:
+        break;
+    }
+    return Cell::NumberType;
+}
+
+/*
+  \overload
+  Read the <sheetData> element the native \a parser is on, the same as
+  above. Only the text of the strings and formulas is decoded, the
+  references, styles and numbers are parsed from the bytes of the part.
+ */
+void WorksheetPrivate::loadXmlSheetData(XmlPullParser &parser)
+{
+    Q_ASSERT(parser.isName("sheetData"));
+
+    int currentRow = 0;
+    int currentColumn = 0;
+    QByteArray currentRowText;
+    int rowsDone = 0;
+    const bool rowBlocks = workbook && workbook->d_func()->rowBlockLoad;
+    const LoadFilter *filter = loadFilter();
+    const bool skipStyles = filter && (filter->options() & LoadFilter::SkipStyles);
+    int currentBlock = 0;
+    QSharedPointer<XlsxRowInfo> previousRowInfo;
+    int previousRowXf = -1;
+
+    while (parser.readNextStartElement()) {
+        if (!parser.isName("row")) {
+            parser.skipCurrentElement();
+            continue;
+        }
+        if (progressMonitor && !reportRows(++rowsDone))
+            return;
+        currentRow = parser.attributeInt("r", currentRow + 1);
+        if (filter && !filter->acceptsRow(currentRow)) {
+            // The rows are in order, none of the rest are loaded
+            if (currentRow > filter->range().lastRow()) {
+                parser.skipToEndTag("sheetData");
+                continue;
+            }
+            parser.skipCurrentElement();
+            continue;
+        }
+        currentRowText = QByteArray::number(currentRow);
+        currentColumn = 0;
+        if (rowBlocks && (currentRow - 1) / CellTable::SpillBlockRows > currentBlock) {
+            currentBlock = (currentRow - 1) / CellTable::SpillBlockRows;
+            cellTable.spill(currentRow);
+        } else if (workbook && workbook->d_func()->memoryBudget > 0) {
+            checkMemoryBudget(currentRow);
+        }
+
+        if (parser.hasAttribute("customFormat") || parser.hasAttribute("customHeight")
+            || parser.hasAttribute("hidden") || parser.hasAttribute("outlineLevel")
+            || parser.hasAttribute("collapsed")) {
+            XlsxRowInfo attributesInfo;
+            int rowXf = -1;
+            if (parser.hasAttribute("customFormat") && parser.hasAttribute("s") && !skipStyles) {
+                rowXf = parser.attributeInt("s");
+                attributesInfo.format = workbook->styles()->xfFormat(rowXf);
+            }
+            if (parser.hasAttribute("customHeight")) {
+                attributesInfo.customHeight = parser.attributeEquals("customHeight", "1");
+                // Row height is only specified when customHeight is set
+                if (parser.hasAttribute("ht"))
+                    attributesInfo.height = parser.attributeDouble("ht");
+            }
+            attributesInfo.hidden = parser.attributeEquals("hidden", "1");
+            attributesInfo.collapsed = parser.attributeEquals("collapsed", "1");
+            if (parser.hasAttribute("outlineLevel"))
+                attributesInfo.outlineLevel = parser.attributeInt("outlineLevel");
+
+            if (previousRowInfo && previousRowInfo->lastRow == currentRow - 1
+                && rowXf == previousRowXf && sameRowInfo(*previousRowInfo, attributesInfo)) {
+                previousRowInfo->lastRow = currentRow;
+            } else {
+                QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo(attributesInfo));
+                info->firstRow = currentRow;
+                info->lastRow = currentRow;
+                rowsInfo[currentRow] = info;
+                previousRowInfo = info;
+                previousRowXf = rowXf;
+            }
+        }
+
+        while (parser.readNextStartElement()) {
+            if (parser.isName("c"))
+                loadXmlCell(parser, currentRowText, currentRow, &currentColumn, filter);
+            else
+                parser.skipCurrentElement();
+        }
+    }
+
+    if (rowBlocks) {
+        cellTable.spill(XLSX_ROW_MAX + 1);
+        cellTable.setRestoredBlockLimit(RowBlockCacheSize);
+    }
+}
+
+/*
+  Read the <c> element the native \a parser is on, in the row \a row whose
+  "r" attribute is \a rowText. \a column is the column of the previous
+  cell of the row, it's set to the one of this cell.
+ */
+void WorksheetPrivate::loadXmlCell(XmlPullParser &parser, const QByteArray &rowText, int row,
+                                   int *column, const LoadFilter *filter)
+{
+    int cellRow = row;
+    int cellColumn = *column + 1;
+    Format format;
+    Cell::CellType cellType = Cell::NumberType;
+    const char *data;
+    int size;
+    if (parser.attribute("r", &data, &size))
+        readCellPosition(data, size, rowText, &cellRow, &cellColumn);
+    const LoadFilter::Options options = filter ? filter->options() : LoadFilter::DefaultOptions;
+    if (filter && !filter->acceptsCell(cellRow, cellColumn)) {
+        // The shared formulas are still kept for the cells loaded
+        while (parser.readNextStartElement()) {
+            if (parser.isName("f") && parser.attributeEquals("t", "shared")
+                && parser.hasAttribute("ref") && !(options & LoadFilter::SkipFormulas)) {
+                CellFormula formula;
+                formula.loadFromXml(parser);
+                sharedFormulaMap[formula.sharedIndex()] = formula;
+                sharedFormulaTemplates.remove(formula.sharedIndex());
+                sharedFormulaTexts.clear();
+            } else {
+                parser.skipCurrentElement();
+            }
+        }
+        *column = cellColumn;
+        return;
+    }
+    if (!(options & LoadFilter::SkipStyles) && parser.attribute("s", &data, &size))
+        format = workbook->styles()->xfFormat(XmlPullParser::toInt(data, size));
+    if (parser.attribute("t", &data, &size))
+        cellType = cellTypeFromString(data, size);
+
+    QVariant value;
+    CellFormula formula;
+    int sst_idx = -1;
+    QVector<InlineRun> inlineRuns;
+    while (parser.readNextStartElement()) {
+        if (parser.isName("f") && (options & LoadFilter::SkipFormulas)) {
+            parser.skipCurrentElement();
+        } else if (parser.isName("f")) {
+            formula.loadFromXml(parser);
+            if (formula.formulaType() == CellFormula::SharedType
+                && !formula.formulaText().isEmpty()) {
+                sharedFormulaMap[formula.sharedIndex()] = formula;
+                sharedFormulaTemplates.remove(formula.sharedIndex());
+                sharedFormulaTexts.clear();
+            }
+        } else if (parser.isName("v")) {
+            if (cellType == Cell::SharedStringType || cellType == Cell::NumberType
+                || cellType == Cell::BooleanType) {
+                parser.readElementCharacters(&data, &size);
+                if (cellType == Cell::SharedStringType) {
+                    sst_idx = XmlPullParser::toInt(data, size);
+                    if (!deferSstRefs) {
+                        sharedStrings()->incRefByStringIndex(sst_idx);
+                    } else if (sst_idx >= 0) {
+                        if (sst_idx >= sstRefCounts.size())
+                            sstRefCounts.resize(sst_idx + 1);
+                        ++sstRefCounts[sst_idx];
+                    }
+                } else if (cellType == Cell::NumberType) {
+                    value = parseDouble(data, size);
+                } else {
+                    value = XmlPullParser::toInt(data, size) ? true : false;
+                }
+            } else { // Cell::ErrorType and Cell::StringType
+                value = parser.readElementText();
+            }
+        } else if (parser.isName("is")) {
+            value = loadXmlInlineString(parser, &inlineRuns);
+        } else {
+            parser.skipCurrentElement(); // extLst
+        }
+    }
+
+    *column = cellColumn;
+    if (cellType == Cell::SharedStringType && sst_idx != -1 && !formula.isValid())
+        setCell(cellRow, cellColumn, CellData::fromSharedString(sst_idx, xfIndexOf(format)));
+    else
+        setCell(cellRow, cellColumn, cellType, value, format, formula, inlineRuns, sst_idx);
+}
+
+/*
+  \overload
+  The run properties are read by QXmlStreamReader from the bytes of their
+  <rPr> element, they are rare enough.
+ */
+QString WorksheetPrivate::loadXmlInlineString(XmlPullParser &parser, QVector<InlineRun> *runs)
+{
+    Q_ASSERT(parser.isName("is"));
+
+    QString text;
+    while (parser.readNextStartElement()) {
+        if (parser.isName("t")) {
+            text = parser.readElementText();
+        } else if (parser.isName("r")) {
+            InlineRun run = {0, -1};
+            QString runText;
+            while (parser.readNextStartElement()) {
+                if (parser.isName("rPr")) {
+                    QXmlStreamReader reader(parser.readElementXml());
+                    if (reader.readNextStartElement())
+                        run.fontId = inlineFontId(SharedStrings::readRichStringPart_rPr(reader));
+                } else if (parser.isName("t")) {
+                    runText = parser.readElementText();
+                } else {
+                    parser.skipCurrentElement();
+                }
             }
+            run.length = runText.size();
+            runs->append(run);
+            text += runText;
+        } else {
+            parser.skipCurrentElement();
         }
     }
+    return text;
 }
 
 void WorksheetPrivate::loadXmlColumnsInfo(QXmlStreamReader &reader)
@@ -2132,13 +7647,46 @@ void WorksheetPrivate::loadXmlColumnsInfo(QXmlStreamReader &reader)
                         colAttrs.value(QLatin1String("outlineLevel")).toString().toInt();
 
                 colsInfo.insert(min, info);
-                for (int col = min; col <= max; ++col)
-                    colsInfoHelper[col] = info;
             }
         }
     }
 }
 
+/*
+  Load the autofilter and the values of its filtered columns. The custom,
+  top 10 and dynamic filters are not supported, their columns are left
+  unfiltered.
+ */
+void WorksheetPrivate::loadXmlAutoFilter(QXmlStreamReader &reader)
+{
+    Q_ASSERT(reader.name() == QLatin1String("autoFilter"));
+
+    autoFilterRange = CellRange(reader.attributes().value(QLatin1String("ref")).toString());
+    autoFilterColumns.clear();
+    int column = 0;
+    while (!reader.atEnd()
+           && !(reader.name() == QLatin1String("autoFilter")
+                && reader.tokenType() == QXmlStreamReader::EndElement)) {
+        reader.readNextStartElement();
+        if (reader.tokenType() != QXmlStreamReader::StartElement)
+            continue;
+        const QXmlStreamAttributes attributes = reader.attributes();
+        if (reader.name() == QLatin1String("filterColumn")) {
+            column = autoFilterRange.firstColumn()
+                     + attributes.value(QLatin1String("colId")).toString().toInt();
+        } else if (reader.name() == QLatin1String("filters")) {
+            if (attributes.value(QLatin1String("blank")) == QLatin1String("1")
+                || attributes.value(QLatin1String("blank")) == QLatin1String("true")) {
+                autoFilterColumns[column].append(QString());
+            }
+        } else if (reader.name() == QLatin1String("filter")) {
+            autoFilterColumns[column].append(attributes.value(QLatin1String("val")).toString());
+        }
+    }
+    if (!autoFilterRange.isValid())
+        autoFilterColumns.clear();
+}
+
 void WorksheetPrivate::loadXmlMergeCells(QXmlStreamReader &reader)
 {
     Q_ASSERT(reader.name() == QLatin1String("mergeCells"));
@@ -2154,7 +7702,7 @@ void WorksheetPrivate::loadXmlMergeCells(QXmlStreamReader &reader)
             if (reader.name() == QLatin1String("mergeCell")) {
                 QXmlStreamAttributes attrs = reader.attributes();
                 QString rangeStr = attrs.value(QLatin1String("ref")).toString();
-                merges.append(CellRange(rangeStr));
+                addMerge(CellRange(rangeStr));
             }
         }
     }
@@ -2169,17 +7717,19 @@ void WorksheetPrivate::loadXmlDataValidations(QXmlStreamReader &reader)
     QXmlStreamAttributes attributes = reader.attributes();
     int count = attributes.value(QLatin1String("count")).toString().toInt();
 
+    int loaded = 0;
     while (!reader.atEnd()
            && !(reader.name() == QLatin1String("dataValidations")
                 && reader.tokenType() == QXmlStreamReader::EndElement)) {
         reader.readNextStartElement();
         if (reader.tokenType() == QXmlStreamReader::StartElement
             && reader.name() == QLatin1String("dataValidation")) {
-            dataValidationsList.append(DataValidation::loadFromXml(reader));
+            addDataValidation(DataValidation::loadFromXml(reader));
+            ++loaded;
         }
     }
 
-    if (dataValidationsList.size() != count)
+    if (loaded != count)
         qDebug("read data validation error");
 }
 
@@ -2244,6 +7794,9 @@ void WorksheetPrivate::loadXmlSheetFormatProps(QXmlStreamReader &reader)
     if (formatProps.defaultColWidth == 0.0) { // not set
         formatProps.defaultColWidth = WorksheetPrivate::calculateColWidth(formatProps.baseColWidth);
     }
+    // Kept by the save, with the levels added by groupRows() and groupColumns()
+    outline_row_level = formatProps.outlineLevelRow;
+    outline_col_level = formatProps.outlineLevelCol;
 }
 double WorksheetPrivate::calculateColWidth(int characters)
 {
@@ -2252,6 +7805,30 @@ double WorksheetPrivate::calculateColWidth(int characters)
     return characters + 0.5;
 }
 
+/*
+  Create the tables of the <tableParts> element, their parts are loaded
+  once the sheet is.
+ */
+void WorksheetPrivate::loadXmlTableParts(QXmlStreamReader &reader)
+{
+    Q_ASSERT(reader.name() == QLatin1String("tableParts"));
+
+    const QString dir = splitPath(filePathInPackage)[0];
+    while (!reader.atEnd()
+           && !(reader.name() == QLatin1String("tableParts")
+                && reader.tokenType() == QXmlStreamReader::EndElement)) {
+        reader.readNextStartElement();
+        if (reader.tokenType() == QXmlStreamReader::StartElement
+            && reader.name() == QLatin1String("tablePart")) {
+            const QString rId = reader.attributes().value(QLatin1String("r:id")).toString();
+            const QString name = relationships->getRelationshipById(rId).target;
+            QSharedPointer<Table> table(new Table(Table::F_LoadFromExists));
+            table->setFilePath(QDir::cleanPath(dir + QLatin1String("/") + name));
+            tables.append(table);
+        }
+    }
+}
+
 void WorksheetPrivate::loadXmlHyperlinks(QXmlStreamReader &reader)
 {
     Q_ASSERT(reader.name() == QLatin1String("hyperlinks"));
@@ -2265,21 +7842,21 @@ void WorksheetPrivate::loadXmlHyperlinks(QXmlStreamReader &reader)
             QXmlStreamAttributes attrs = reader.attributes();
             CellReference pos(attrs.value(QLatin1String("ref")).toString());
             if (pos.isValid()) { // Valid
-                QSharedPointer<XlsxHyperlinkData> link(new XlsxHyperlinkData);
-                link->display = attrs.value(QLatin1String("display")).toString();
-                link->tooltip = attrs.value(QLatin1String("tooltip")).toString();
-                link->location = attrs.value(QLatin1String("location")).toString();
+                XlsxHyperlinkData link;
+                link.display = attrs.value(QLatin1String("display")).toString();
+                link.tooltip = attrs.value(QLatin1String("tooltip")).toString();
+                link.location = attrs.value(QLatin1String("location")).toString();
 
                 if (attrs.hasAttribute(QLatin1String("r:id"))) {
-                    link->linkType = XlsxHyperlinkData::External;
+                    link.linkType = XlsxHyperlinkData::External;
                     XlsxRelationship ship = relationships->getRelationshipById(
                         attrs.value(QLatin1String("r:id")).toString());
-                    link->target = ship.target;
+                    link.target = ship.target;
                 } else {
-                    link->linkType = XlsxHyperlinkData::Internal;
+                    link.linkType = XlsxHyperlinkData::Internal;
                 }
 
-                urlTable[pos.row()][pos.column()] = link;
+                urlTable.insert(pos.row(), pos.column(), link);
             }
         }
     }
@@ -2287,54 +7864,89 @@ void WorksheetPrivate::loadXmlHyperlinks(QXmlStreamReader &reader)
 
 QList<QSharedPointer<XlsxColumnInfo>> WorksheetPrivate::getColumnInfoList(int colFirst, int colLast)
 {
-    QList<QSharedPointer<XlsxColumnInfo>> columnsInfoList;
-    if (isColumnRangeValid(colFirst, colLast)) {
-        QList<int> nodes = getColumnIndexes(colFirst, colLast);
-
-        for (int idx = 0; idx < nodes.size(); ++idx) {
-            int colStart = nodes[idx];
-            if (colsInfo.contains(colStart)) {
-                QSharedPointer<XlsxColumnInfo> info = colsInfo[colStart];
-                columnsInfoList.append(info);
-            } else {
-                int colEnd = (idx == nodes.size() - 1) ? colLast : nodes[idx + 1] - 1;
-                QSharedPointer<XlsxColumnInfo> info(new XlsxColumnInfo(colStart, colEnd));
-                colsInfo.insert(colFirst, info);
-                columnsInfoList.append(info);
-                for (int c = colStart; c <= colEnd; ++c)
-                    colsInfoHelper[c] = info;
-            }
-        }
-    }
+    if (!isColumnRangeValid(colFirst, colLast))
+        return QList<QSharedPointer<XlsxColumnInfo>>();
 
-    return columnsInfoList;
+    return columnInfoRange(colFirst, colLast);
 }
 
 QList<QSharedPointer<XlsxRowInfo>> WorksheetPrivate::getRowInfoList(int rowFirst, int rowLast)
 {
-    QList<QSharedPointer<XlsxRowInfo>> rowInfoList;
-
     int min_col = dimension.firstColumn() < 1 ? 1 : dimension.firstColumn();
 
-    for (int row = rowFirst; row <= rowLast; ++row) {
-        if (checkDimensions(row, min_col, false, true))
-            continue;
-
-        QSharedPointer<XlsxRowInfo> rowInfo;
-        if ((rowsInfo[row]).isNull()) {
-            rowsInfo[row] = QSharedPointer<XlsxRowInfo>(new XlsxRowInfo());
-        }
-        rowInfoList.append(rowsInfo[row]);
-    }
+    // Invalid rows are skipped, as are the rows already streamed out
+    // in constant memory mode.
+    rowFirst = qMax(rowFirst, 1);
+    rowLast = qMin(rowLast, XLSX_ROW_MAX);
+    if (constantMemory)
+        rowFirst = qMax(rowFirst, streamFlushedRow + 1);
+    if (rowFirst > rowLast || checkDimensions(rowFirst, min_col, false, true))
+        return QList<QSharedPointer<XlsxRowInfo>>();
+    // Don't check rowLast the same way, as that flushes the rows before it
+    if (rowLast > dimension.lastRow())
+        dimension.setLastRow(rowLast);
+
+    return rowInfoRange(rowFirst, rowLast);
+}
 
-    return rowInfoList;
+/*!
+ * \internal
+ *
+ * The cells kept in memory are the elements of the sheet.
+ */
+qint64 Worksheet::elementCount() const
+{
+    Q_D(const Worksheet);
+    return d->cellTable.cellCount();
 }
 
+/*!
+ * \internal
+ *
+ * The <sheetData> element, the bulk of the part, is read by the native
+ * XmlPullParser from the bytes of the part, and the rest of the part by
+ * QXmlStreamReader. The parts which aren't in UTF-8 or use prefixed
+ * elements are read by QXmlStreamReader alone.
+ */
 bool Worksheet::loadFromXmlFile(QIODevice *device)
 {
     Q_D(Worksheet);
 
-    QXmlStreamReader reader(device);
+    // The sheets left out by the filter of the document stay empty
+    const LoadFilter *filter = d->loadFilter();
+    if (filter && !filter->acceptsSheet(sheetName()))
+        return true;
+
+    // The buffers of loadFromXmlData() aren't copied
+    QBuffer *buffer = qobject_cast<QBuffer *>(device);
+    const QByteArray data =
+        buffer && buffer->pos() == 0 ? buffer->data() : device->readAll();
+
+    int sheetDataBegin = -1;
+    int sheetDataEnd = -1;
+    if (XmlPullParser::canParse(data)) {
+        XmlPullParser parser(data);
+        while (parser.readNext() != XmlPullParser::EndDocument && !parser.hasError()) {
+            if (parser.tokenType() == XmlPullParser::StartElement
+                && parser.isName("sheetData")) {
+                sheetDataBegin = parser.tokenOffset();
+                d->loadXmlSheetData(parser);
+                if (d->progressMonitor && d->progressMonitor->isCanceled())
+                    return false;
+                sheetDataEnd = parser.hasError() ? data.size() : parser.offset();
+                break;
+            }
+        }
+    }
+
+    QXmlStreamReader reader;
+    if (sheetDataBegin == -1) {
+        reader.addData(data);
+    } else {
+        reader.addData(QByteArray::fromRawData(data.constData(), sheetDataBegin));
+        reader.addData(QByteArray::fromRawData(data.constData() + sheetDataEnd,
+                                               data.size() - sheetDataEnd));
+    }
     while (!reader.atEnd()) {
         reader.readNextStartElement();
         if (reader.tokenType() == QXmlStreamReader::StartElement) {
@@ -2350,6 +7962,10 @@ bool Worksheet::loadFromXmlFile(QIODevice *device)
                 d->loadXmlColumnsInfo(reader);
             } else if (reader.name() == QLatin1String("sheetData")) {
                 d->loadXmlSheetData(reader);
+                if (d->progressMonitor && d->progressMonitor->isCanceled())
+                    return false;
+            } else if (reader.name() == QLatin1String("autoFilter")) {
+                d->loadXmlAutoFilter(reader);
             } else if (reader.name() == QLatin1String("mergeCells")) {
                 d->loadXmlMergeCells(reader);
             } else if (reader.name() == QLatin1String("dataValidations")) {
@@ -2357,7 +7973,7 @@ bool Worksheet::loadFromXmlFile(QIODevice *device)
             } else if (reader.name() == QLatin1String("conditionalFormatting")) {
                 ConditionalFormatting cf;
                 cf.loadFromXml(reader, workbook()->styles());
-                d->conditionalFormattingList.append(cf);
+                d->addConditionalFormatting(cf);
             } else if (reader.name() == QLatin1String("hyperlinks")) {
                 d->loadXmlHyperlinks(reader);
             } else if (reader.name() == QLatin1String("drawing")) {
@@ -2367,6 +7983,8 @@ bool Worksheet::loadFromXmlFile(QIODevice *device)
                     QDir::cleanPath(splitPath(filePath())[0] + QLatin1String("/") + name);
                 d->drawing = QSharedPointer<Drawing>(new Drawing(this, F_LoadFromExists));
                 d->drawing->setFilePath(path);
+            } else if (reader.name() == QLatin1String("tableParts")) {
+                d->loadXmlTableParts(reader);
             } else if (reader.name() == QLatin1String("extLst")) {
                 // Todo: add extLst support
                 while (!reader.atEnd()
@@ -2382,6 +8000,503 @@ bool Worksheet::loadFromXmlFile(QIODevice *device)
     return true;
 }
 
+/*
+  The codes of the error values of the BIFF12 cell records.
+ */
+static quint8 binaryErrorCode(const QString &error)
+{
+    if (error == QLatin1String("#NULL!"))
+        return 0x00;
+    if (error == QLatin1String("#DIV/0!"))
+        return 0x07;
+    if (error == QLatin1String("#VALUE!"))
+        return 0x0F;
+    if (error == QLatin1String("#REF!"))
+        return 0x17;
+    if (error == QLatin1String("#NAME?"))
+        return 0x1D;
+    if (error == QLatin1String("#NUM!"))
+        return 0x24;
+    return 0x2A; // #N/A
+}
+
+static QString errorFromBinaryCode(quint8 code)
+{
+    switch (code) {
+    case 0x00:
+        return QStringLiteral("#NULL!");
+    case 0x07:
+        return QStringLiteral("#DIV/0!");
+    case 0x0F:
+        return QStringLiteral("#VALUE!");
+    case 0x17:
+        return QStringLiteral("#REF!");
+    case 0x1D:
+        return QStringLiteral("#NAME?");
+    case 0x24:
+        return QStringLiteral("#NUM!");
+    default:
+        return QStringLiteral("#N/A");
+    }
+}
+
+/*
+  An RK number is either a 30 bit integer or the 30 high bits of a
+  double, which may both be divided by 100.
+ */
+static double numberFromRk(quint32 rk)
+{
+    double number;
+    if (rk & 0x02) {
+        number = qint32(rk & 0xFFFFFFFC) / 4;
+    } else {
+        const quint64 bits = quint64(rk & 0xFFFFFFFC) << 32;
+        memcpy(&number, &bits, sizeof(number));
+    }
+    if (rk & 0x01)
+        number /= 100;
+    return number;
+}
+
+/*
+  Start the record of a cell: its column and its style, which is the
+  default one for -1.
+ */
+static void beginBinaryCell(Biff12Writer &writer, int type, int col, int xfIndex)
+{
+    writer.beginRecord(type);
+    writer.writeUInt32(col - 1);
+    writer.writeUInt32(quint32(qMax(xfIndex, 0)) & 0xFFFFFF);
+}
+
+/*
+  Write the worksheet as the BIFF12 records of a sheetN.bin part: the
+  dimension, the columns, the rows and cells and the merged cells. The
+  sheet views and the default row height aren't written, nor are the
+  parts refused by DocumentPrivate::binaryUnsupportedFeature().
+ */
+void Worksheet::saveToBinaryFile(QIODevice *device) const
+{
+    Q_D(const Worksheet);
+    d->relationships->clear();
+
+    Biff12Writer writer(device);
+    writer.writeRecord(BrtBeginSheet);
+
+    writer.beginRecord(BrtWsDim);
+    if (d->dimension.isValid()) {
+        writer.writeUInt32(d->dimension.firstRow() - 1);
+        writer.writeUInt32(d->dimension.lastRow() - 1);
+        writer.writeUInt32(d->dimension.firstColumn() - 1);
+        writer.writeUInt32(d->dimension.lastColumn() - 1);
+    } else {
+        writer.writeZeros(16);
+    }
+    writer.endRecord();
+
+    if (!d->colsInfo.isEmpty()) {
+        writer.writeRecord(BrtBeginColInfos);
+        foreach (const QSharedPointer<XlsxColumnInfo> &info, d->colsInfo) {
+            quint16 flags = quint16((info->outlineLevel & 0x07) << 8);
+            if (info->hidden)
+                flags |= 0x01;
+            if (info->width)
+                flags |= 0x02; // set by the user
+            if (info->collapsed)
+                flags |= 0x1000;
+            writer.beginRecord(BrtColInfo);
+            writer.writeUInt32(qMax(info->firstColumn, 1) - 1);
+            writer.writeUInt32(qMax(info->lastColumn, 1) - 1);
+            // The width is in 1/256 of a character, Excel's default otherwise
+            writer.writeUInt32(info->width ? quint32(qRound(info->width * 256)) : 2340);
+            writer.writeUInt32(info->format.isEmpty() ? 0 : info->format.xfIndex());
+            writer.writeUInt16(flags);
+            writer.endRecord();
+        }
+        writer.writeRecord(BrtEndColInfos);
+    }
+
+    writer.writeRecord(BrtBeginSheetData);
+    if (d->dimension.isValid())
+        d->saveBinarySheetData(writer);
+    writer.writeRecord(BrtEndSheetData);
+
+    const_cast<WorksheetPrivate *>(d)->compactMerges();
+    if (!d->merges.isEmpty()) {
+        writer.beginRecord(BrtBeginMergeCells);
+        writer.writeUInt32(d->merges.size());
+        writer.endRecord();
+        foreach (const CellRange &range, d->merges) {
+            writer.beginRecord(BrtMergeCell);
+            writer.writeUInt32(range.firstRow() - 1);
+            writer.writeUInt32(range.lastRow() - 1);
+            writer.writeUInt32(range.firstColumn() - 1);
+            writer.writeUInt32(range.lastColumn() - 1);
+            writer.endRecord();
+        }
+        writer.writeRecord(BrtEndMergeCells);
+    }
+
+    writer.writeRecord(BrtEndSheet);
+}
+
+/*
+  Same as saveXmlSheetData(), the rows with cells or formatting are
+  written in turn.
+ */
+void WorksheetPrivate::saveBinarySheetData(Biff12Writer &writer) const
+{
+    const QVector<int> columnXfs = columnXfIndices();
+    int rowsDone = 0;
+
+    int cellIdx = 0;
+    while (cellIdx < cellTable.size() && cellTable.rowNumberAt(cellIdx) < dimension.firstRow())
+        ++cellIdx;
+    QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator infoIt =
+        rowsInfo.upperBound(dimension.firstRow());
+    if (infoIt != rowsInfo.constBegin() && (infoIt - 1).value()->lastRow >= dimension.firstRow())
+        --infoIt;
+    int infoRow = infoIt != rowsInfo.constEnd()
+                      ? qMax(infoIt.key(), dimension.firstRow()) : XLSX_ROW_MAX + 1;
+
+    forever {
+        int row_num = XLSX_ROW_MAX + 1;
+        if (cellIdx < cellTable.size())
+            row_num = cellTable.rowNumberAt(cellIdx);
+        if (infoIt != rowsInfo.constEnd())
+            row_num = qMin(row_num, infoRow);
+        if (row_num > dimension.lastRow())
+            break;
+
+        // Keep about one block of spilled rows in memory
+        if (cellIdx % CellTable::SpillBlockRows == 0)
+            cellTable.releaseRestoredBlocks();
+
+        const XlsxRowInfo *rowInfo = 0;
+        if (infoIt != rowsInfo.constEnd() && infoRow == row_num)
+            rowInfo = infoIt.value().data();
+        saveBinaryRow(writer, row_num, rowInfo, columnXfs);
+        if (progressMonitor && !reportRows(++rowsDone))
+            break;
+
+        if (cellIdx < cellTable.size() && cellTable.rowNumberAt(cellIdx) == row_num)
+            ++cellIdx;
+        if (rowInfo) {
+            if (++infoRow > rowInfo->lastRow && ++infoIt != rowsInfo.constEnd())
+                infoRow = infoIt.key();
+        }
+    }
+}
+
+/*
+  Write the header record of \a row_num, then the records of its cells,
+  whose style is resolved as in saveXmlRow().
+ */
+void WorksheetPrivate::saveBinaryRow(Biff12Writer &writer, int row_num,
+                                     const XlsxRowInfo *rowInfo,
+                                     const QVector<int> &columnXfs) const
+{
+    const CellRow *cells = cellTable.row(row_num);
+    int firstIdx = -1;
+    int lastIdx = -1;
+    if (cells) {
+        for (int i = 0; i < cells->size(); ++i) {
+            const int col_num = cells->columns[i];
+            if (col_num >= dimension.firstColumn() && col_num <= dimension.lastColumn()) {
+                if (firstIdx == -1)
+                    firstIdx = i;
+                lastIdx = i;
+            }
+        }
+    }
+
+    int rowXf = -1;
+    int height = 15 * 20; // in twips
+    quint16 flags = 0;
+    if (rowInfo) {
+        flags = quint16((rowInfo->outlineLevel & 0x07) << 8);
+        if (rowInfo->collapsed)
+            flags |= 0x0800;
+        if (rowInfo->hidden)
+            flags |= 0x1000;
+        if (rowInfo->customHeight) {
+            height = qRound(rowInfo->height * 20);
+            flags |= 0x2000;
+        }
+        if (!rowInfo->format.isEmpty()) {
+            rowXf = rowInfo->format.xfIndex();
+            flags |= 0x4000;
+        }
+    }
+
+    writer.beginRecord(BrtRowHdr);
+    writer.writeUInt32(row_num - 1);
+    writer.writeUInt32(qMax(rowXf, 0));
+    writer.writeUInt16(quint16(height));
+    writer.writeUInt16(flags);
+    writer.writeUInt8(0);
+    // The span of the cells of the row
+    if (firstIdx != -1) {
+        writer.writeUInt32(1);
+        writer.writeUInt32(cells->columns[firstIdx] - 1);
+        writer.writeUInt32(cells->columns[lastIdx] - 1);
+    } else {
+        writer.writeUInt32(0);
+    }
+    writer.endRecord();
+
+    for (int i = firstIdx; i != -1 && i <= lastIdx; ++i) {
+        const int col_num = cells->columns[i];
+        if (col_num < dimension.firstColumn() || col_num > dimension.lastColumn())
+            continue;
+        const CellData &cell = cells->cells[i];
+        int xf = cell.xfIndex;
+        if (xf == -1)
+            xf = rowXf != -1 || col_num >= columnXfs.size() ? rowXf : columnXfs[col_num];
+        saveBinaryCell(writer, col_num, cell, xf);
+    }
+}
+
+/*
+  Write the record of \a cell. The formulas aren't written, only their
+  values: the formulas of the BIFF12 records are parsed expressions.
+ */
+void WorksheetPrivate::saveBinaryCell(Biff12Writer &writer, int col, const CellData &cell,
+                                      int xfIndex) const
+{
+    const CellExtraData *extra =
+        cell.storage == CellData::Extra ? &cellTable.extra(cell.index) : 0;
+
+    double number;
+    if (cell.cellType == Cell::SharedStringType) {
+        // The index is known since the cell was written or loaded
+        const int sst_idx = extra ? extra->sharedStringIndex : cell.index;
+        beginBinaryCell(writer, BrtCellIsst, col, xfIndex);
+        writer.writeUInt32(sharedStrings()->saveIndex(sst_idx));
+    } else if (cell.cellType == Cell::InlineStringType || cell.cellType == Cell::StringType) {
+        beginBinaryCell(writer, BrtCellSt, col, xfIndex);
+        writer.writeString(cellValue(cell).toString());
+    } else if (cell.cellType == Cell::NumberType && cellNumber(cell, &number)) {
+        if (number == floor(number) && number >= -536870912.0 && number < 536870912.0) {
+            beginBinaryCell(writer, BrtCellRk, col, xfIndex);
+            writer.writeUInt32((quint32(qint32(number)) << 2) | 0x02);
+        } else {
+            beginBinaryCell(writer, BrtCellReal, col, xfIndex);
+            writer.writeDouble(number);
+        }
+    } else if (cell.cellType == Cell::BooleanType) {
+        beginBinaryCell(writer, BrtCellBool, col, xfIndex);
+        writer.writeUInt8(cellValue(cell).toBool() ? 1 : 0);
+    } else if (cell.cellType == Cell::ErrorType && extra) {
+        beginBinaryCell(writer, BrtCellError, col, xfIndex);
+        writer.writeUInt8(binaryErrorCode(extra->value.toString()));
+    } else {
+        beginBinaryCell(writer, BrtCellBlank, col, xfIndex);
+    }
+    writer.endRecord();
+}
+
+/*
+  Read the worksheet from the BIFF12 records of a sheetN.bin part, the
+  records which aren't supported are skipped.
+ */
+bool Worksheet::loadFromBinaryData(const QByteArray &data)
+{
+    Q_D(Worksheet);
+
+    // The sheets left out by the filter of the document stay empty
+    const LoadFilter *filter = d->loadFilter();
+    if (filter && !filter->acceptsSheet(sheetName()))
+        return true;
+
+    Biff12Reader reader(data);
+    while (reader.readNext()) {
+        switch (reader.recordType()) {
+        case BrtWsDim: {
+            const int firstRow = reader.readInt32() + 1;
+            const int lastRow = reader.readInt32() + 1;
+            const int firstColumn = reader.readInt32() + 1;
+            const int lastColumn = reader.readInt32() + 1;
+            d->dimension = CellRange(firstRow, firstColumn, lastRow, lastColumn);
+            break;
+        }
+        case BrtColInfo:
+            d->loadBinaryColumnInfo(reader);
+            break;
+        case BrtBeginSheetData:
+            if (!d->loadBinarySheetData(reader))
+                return false;
+            break;
+        case BrtMergeCell: {
+            const int firstRow = reader.readInt32() + 1;
+            const int lastRow = reader.readInt32() + 1;
+            const int firstColumn = reader.readInt32() + 1;
+            const int lastColumn = reader.readInt32() + 1;
+            d->addMerge(CellRange(firstRow, firstColumn, lastRow, lastColumn));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    if (reader.hasError()) {
+        qWarning("Error when read the binary worksheet");
+        return false;
+    }
+    d->validateDimension();
+    return true;
+}
+
+void WorksheetPrivate::loadBinaryColumnInfo(Biff12Reader &reader)
+{
+    QSharedPointer<XlsxColumnInfo> info(new XlsxColumnInfo);
+    info->firstColumn = reader.readInt32() + 1;
+    info->lastColumn = reader.readInt32() + 1;
+    const quint32 width = reader.readUInt32();
+    const int xf = reader.readInt32();
+    const quint16 flags = reader.readUInt16();
+
+    info->hidden = flags & 0x01;
+    // The width of the columns not set by the user is the default one
+    info->customWidth = flags & 0x02;
+    if (info->customWidth)
+        info->width = width / 256.0;
+    if (xf > 0)
+        info->format = workbook->styles()->xfFormat(xf);
+    info->outlineLevel = (flags >> 8) & 0x07;
+    info->collapsed = flags & 0x1000;
+    colsInfo.insert(info->firstColumn, info);
+}
+
+/*
+  Read the rows and cells up to BrtEndSheetData, as loadXmlSheetData()
+  does. The formula cells keep their values only. Returns false if the
+  load is canceled or the records are truncated.
+ */
+bool WorksheetPrivate::loadBinarySheetData(Biff12Reader &reader)
+{
+    int currentRow = 0;
+    int rowsDone = 0;
+    // With Document::RowBlockLoad, each finished block of rows is spilled
+    const bool rowBlocks = workbook && workbook->d_func()->rowBlockLoad;
+    const LoadFilter *filter = loadFilter();
+    const LoadFilter::Options options = filter ? filter->options() : LoadFilter::DefaultOptions;
+    int currentBlock = 0;
+    QSharedPointer<XlsxRowInfo> previousRowInfo;
+    int previousRowXf = -1;
+
+    while (reader.readNext() && reader.recordType() != BrtEndSheetData) {
+        const int type = reader.recordType();
+        if (type == BrtRowHdr) {
+            if (progressMonitor && !reportRows(++rowsDone))
+                return false;
+            currentRow = reader.readInt32() + 1;
+            const int xf = reader.readInt32();
+            const int height = reader.readUInt16();
+            const quint16 flags = reader.readUInt16();
+            if (filter && !filter->acceptsRow(currentRow))
+                continue;
+            if (rowBlocks && (currentRow - 1) / CellTable::SpillBlockRows > currentBlock) {
+                currentBlock = (currentRow - 1) / CellTable::SpillBlockRows;
+                cellTable.spill(currentRow);
+            } else if (workbook && workbook->d_func()->memoryBudget > 0) {
+                checkMemoryBudget(currentRow);
+            }
+
+            // The outline level, collapsed, hidden, custom height and custom format bits
+            if (!(flags & 0x7F00))
+                continue;
+            XlsxRowInfo flagsInfo;
+            int rowXf = -1;
+            if ((flags & 0x4000) && !(options & LoadFilter::SkipStyles)) {
+                rowXf = xf;
+                flagsInfo.format = workbook->styles()->xfFormat(rowXf);
+            }
+            if (flags & 0x2000) {
+                flagsInfo.customHeight = true;
+                flagsInfo.height = height / 20.0;
+            }
+            flagsInfo.hidden = flags & 0x1000;
+            flagsInfo.collapsed = flags & 0x0800;
+            flagsInfo.outlineLevel = (flags >> 8) & 0x07;
+
+            // The rows of an outline group or a block of hidden rows
+            // share one info
+            if (previousRowInfo && previousRowInfo->lastRow == currentRow - 1
+                && rowXf == previousRowXf && sameRowInfo(*previousRowInfo, flagsInfo)) {
+                previousRowInfo->lastRow = currentRow;
+            } else {
+                QSharedPointer<XlsxRowInfo> info(new XlsxRowInfo(flagsInfo));
+                info->firstRow = currentRow;
+                info->lastRow = currentRow;
+                rowsInfo[currentRow] = info;
+                previousRowInfo = info;
+                previousRowXf = rowXf;
+            }
+        } else if (type >= BrtCellBlank && type <= BrtFmlaError) {
+            loadBinaryCell(reader, currentRow, filter);
+        }
+    }
+
+    if (rowBlocks) {
+        cellTable.spill(XLSX_ROW_MAX + 1);
+        cellTable.setRestoredBlockLimit(RowBlockCacheSize);
+    }
+    return !reader.hasError();
+}
+
+void WorksheetPrivate::loadBinaryCell(Biff12Reader &reader, int row, const LoadFilter *filter)
+{
+    const int type = reader.recordType();
+    const int column = reader.readInt32() + 1;
+    if (filter && !filter->acceptsCell(row, column))
+        return;
+    int xf = reader.readUInt32() & 0xFFFFFF;
+    if (filter && (filter->options() & LoadFilter::SkipStyles))
+        xf = 0;
+    // The first format is the default one, as for the cells without style
+    const Format format = xf > 0 ? workbook->styles()->xfFormat(xf) : Format();
+
+    switch (type) {
+    case BrtCellRk:
+        setCell(row, column, CellData::fromNumber(numberFromRk(reader.readUInt32()),
+                                                  xfIndexOf(format)));
+        break;
+    case BrtCellReal:
+    case BrtFmlaNum:
+        setCell(row, column, CellData::fromNumber(reader.readDouble(), xfIndexOf(format)));
+        break;
+    case BrtCellBool:
+    case BrtFmlaBool:
+        setCell(row, column, CellData::fromBool(reader.readUInt8() != 0, xfIndexOf(format)));
+        break;
+    case BrtCellError:
+    case BrtFmlaError:
+        setCell(row, column, Cell::ErrorType, errorFromBinaryCode(reader.readUInt8()), format,
+                CellFormula(), QVector<InlineRun>(), -1);
+        break;
+    case BrtCellSt:
+        setCell(row, column, Cell::InlineStringType, reader.readString(), format, CellFormula(),
+                QVector<InlineRun>(), -1);
+        break;
+    case BrtFmlaString:
+        setCell(row, column, Cell::StringType, reader.readString(), format, CellFormula(),
+                QVector<InlineRun>(), -1);
+        break;
+    case BrtCellIsst: {
+        const int sst_idx = reader.readInt32();
+        sharedStrings()->incRefByStringIndex(sst_idx);
+        setCell(row, column, CellData::fromSharedString(sst_idx, xfIndexOf(format)));
+        break;
+    }
+    default: // BrtCellBlank
+        setCell(row, column, Cell::NumberType, QVariant(), format, CellFormula(),
+                QVector<InlineRun>(), -1);
+        break;
+    }
+}
+
 /*
  *  Documents imported from Google Docs does not contain dimension data.
  */
@@ -2390,26 +8505,63 @@ void WorksheetPrivate::validateDimension()
     if (dimension.isValid() || cellTable.isEmpty())
         return;
 
-    int firstRow = cellTable.constBegin().key();
-    int lastRow = (cellTable.constEnd() - 1).key();
-    int firstColumn = -1;
-    int lastColumn = -1;
+    CellRange cr(cellTable.firstRow(), cellTable.firstColumn(), cellTable.lastRow(),
+                 cellTable.lastColumn());
 
-    for (QMap<int, QMap<int, QSharedPointer<Cell>>>::const_iterator it = cellTable.begin();
-         it != cellTable.end(); ++it) {
-        Q_ASSERT(!it.value().isEmpty());
+    if (cr.isValid())
+        dimension = cr;
+}
 
-        if (firstColumn == -1 || it.value().constBegin().key() < firstColumn)
-            firstColumn = it.value().constBegin().key();
+/*
+  Grow [\a first, \a last], which is empty when \a first is -1, to cover
+  [\a from, \a to].
+ */
+static void growSpan(int *first, int *last, int from, int to)
+{
+    if (*first == -1 || from < *first)
+        *first = from;
+    if (to > *last)
+        *last = to;
+}
 
-        if (lastColumn == -1 || (it.value().constEnd() - 1).key() > lastColumn)
-            lastColumn = (it.value().constEnd() - 1).key();
-    }
+/*
+  Find the dimension again once cells or comments have been removed, as
+  checkDimensions() only ever grows it: the range of the cells, the
+  comments, and the rows and the columns which have properties. The cell
+  table knows its range, so only the rows of the comments are gone over.
+  The rows flushed in constant memory mode are no longer known, so the
+  dimension is left as it is in that mode.
+ */
+void WorksheetPrivate::updateDimension()
+{
+    if (constantMemory)
+        return;
 
-    CellRange cr(firstRow, firstColumn, lastRow, lastColumn);
+    int firstRow = -1;
+    int lastRow = -1;
+    int firstColumn = -1;
+    int lastColumn = -1;
+    if (!cellTable.isEmpty()) {
+        firstRow = cellTable.firstRow();
+        lastRow = cellTable.lastRow();
+        firstColumn = cellTable.firstColumn();
+        lastColumn = cellTable.lastColumn();
+    }
+    QMap<int, QMap<int, QString>>::const_iterator it;
+    for (it = comments.constBegin(); it != comments.constEnd(); ++it) {
+        growSpan(&firstRow, &lastRow, it.key(), it.key());
+        growSpan(&firstColumn, &lastColumn, it.value().firstKey(), it.value().lastKey());
+    }
+    if (!rowsInfo.isEmpty()) {
+        growSpan(&firstRow, &lastRow, rowsInfo.firstKey(),
+                 (rowsInfo.constEnd() - 1).value()->lastRow);
+    }
+    if (!colsInfo.isEmpty()) {
+        growSpan(&firstColumn, &lastColumn, colsInfo.firstKey(),
+                 (colsInfo.constEnd() - 1).value()->lastColumn);
+    }
 
-    if (cr.isValid())
-        dimension = cr;
+    dimension = CellRange(firstRow, firstColumn, lastRow, lastColumn);
 }
 
 /*!
@@ -2421,4 +8573,102 @@ SharedStrings *WorksheetPrivate::sharedStrings() const
     return workbook->sharedStrings();
 }
 
+void WorksheetPrivate::addMerge(const CellRange &range)
+{
+    merges.append(range);
+    mergeIndex.insert(range, merges.size() - 1);
+}
+
+/*
+  Returns the position of the merged \a range in merges, or -1. The merges
+  can't overlap, so only those holding its first cell are compared.
+ */
+int WorksheetPrivate::mergeIndexOf(const CellRange &range) const
+{
+    foreach (int index, mergeIndex.valuesAt(range.firstRow(), range.firstColumn())) {
+        if (merges[index] == range)
+            return index;
+    }
+    return -1;
+}
+
+/*
+  Remove the merge at \a index. It is only replaced by an invalid range,
+  so that the positions of the next merges, and their index entries, stay
+  the same. The removed merges are dropped by compactMerges(), once they
+  are half of the list or when the merges are listed or saved.
+ */
+void WorksheetPrivate::removeMerge(int index)
+{
+    mergeIndex.remove(merges[index], index);
+    merges[index] = CellRange();
+    if (++removedMerges * 2 > merges.size())
+        compactMerges();
+}
+
+/*
+  Drop the merges removed by removeMerge(), keeping the order of the others,
+  and index them again by their new positions.
+ */
+void WorksheetPrivate::compactMerges()
+{
+    if (!removedMerges)
+        return;
+    merges.removeAll(CellRange());
+    removedMerges = 0;
+    mergeIndex.clear();
+    for (int i = 0; i < merges.size(); ++i)
+        mergeIndex.insert(merges[i], i);
+}
+
+/*
+  Add \a validation, or merge its ranges into a validation which only
+  differs by its ranges, so that generators adding one validation per
+  row don't write thousands of them.
+ */
+void WorksheetPrivate::addDataValidation(const DataValidation &validation)
+{
+    const QString key = validation.d->mergeKey();
+    QHash<QString, int>::const_iterator it = dataValidationKeys.constFind(key);
+    if (!key.isEmpty() && it != dataValidationKeys.constEnd()) {
+        DataValidation &merged = dataValidationsList[it.value()];
+        foreach (const CellRange &range, validation.ranges()) {
+            CellRangeSet::append(merged.d->ranges, range);
+            dataValidationIndex.insert(range, it.value());
+        }
+        return;
+    }
+
+    if (!key.isEmpty())
+        dataValidationKeys.insert(key, dataValidationsList.size());
+    dataValidationsList.append(validation);
+    foreach (const CellRange &range, validation.ranges())
+        dataValidationIndex.insert(range, dataValidationsList.size() - 1);
+}
+
+/*
+  Add \a cf, or merge its ranges into a conditional formatting which only
+  differs by its ranges, like addDataValidation() does.
+ */
+void WorksheetPrivate::addConditionalFormatting(const ConditionalFormatting &cf)
+{
+    cfEvaluator.reset();
+    const QString key = cf.d->mergeKey();
+    QHash<QString, int>::const_iterator it = conditionalFormattingKeys.constFind(key);
+    if (!key.isEmpty() && it != conditionalFormattingKeys.constEnd()) {
+        ConditionalFormatting &merged = conditionalFormattingList[it.value()];
+        foreach (const CellRange &range, cf.ranges()) {
+            CellRangeSet::append(merged.d->ranges, range);
+            conditionalFormattingIndex.insert(range, it.value());
+        }
+        return;
+    }
+
+    if (!key.isEmpty())
+        conditionalFormattingKeys.insert(key, conditionalFormattingList.size());
+    conditionalFormattingList.append(cf);
+    foreach (const CellRange &range, cf.ranges())
+        conditionalFormattingIndex.insert(range, conditionalFormattingList.size() - 1);
+}
+
 QT_END_NAMESPACE_XLSX
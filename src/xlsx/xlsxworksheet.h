@@ -29,16 +29,25 @@
 #include "xlsxcell.h"
 #include "xlsxcellrange.h"
 #include "xlsxcellreference.h"
+#include "xlsxrawcell.h"
 #include <QStringList>
 #include <QMap>
+#include <QMetaProperty>
+#include <QPair>
 #include <QVariant>
+#include <QVector>
 #include <QPointF>
+#include <QSize>
 #include <QSharedPointer>
 class QIODevice;
+class QBitArray;
+class QDate;
 class QDateTime;
 class QUrl;
 class QImage;
+class QColor;
 class WorksheetTest;
+class MemoryTest;
 
 QT_BEGIN_NAMESPACE_XLSX
 class DocumentPrivate;
@@ -46,32 +55,87 @@ class Workbook;
 class Format;
 class Drawing;
 class DataValidation;
+class DataValidationViolation;
 class ConditionalFormatting;
 class CellRange;
 class RichString;
 class Relationships;
 class Chart;
+class RowWriter;
 
 class WorksheetPrivate;
 class Q_XLSX_EXPORT Worksheet : public AbstractSheet
 {
     Q_DECLARE_PRIVATE(Worksheet)
 public:
+    enum WriteOption {
+        DefaultWriteOptions = 0x0,
+        RawWrite = 0x1 // Store strings as they are, without any conversion
+    };
+    Q_DECLARE_FLAGS(WriteOptions, WriteOption)
+
+    enum ClearOption {
+        ClearValues = 0x1, // Values, formulas and hyperlinks
+        ClearFormats = 0x2,
+        ClearAll = ClearValues | ClearFormats // Comments included
+    };
+    Q_DECLARE_FLAGS(ClearOptions, ClearOption)
+
+    enum CsvOption {
+        DefaultCsvOptions = 0x0,
+        CsvHeader = 0x1, // The first record holds the names of the columns
+        CsvStringsOnly = 0x2 // The types of the columns aren't inferred
+    };
+    Q_DECLARE_FLAGS(CsvOptions, CsvOption)
+
+    enum StringStorage {
+        SharedStringStorage, // In the shared strings table
+        InlineStringStorage, // In the cells themselves
+        AdaptiveStringStorage // Inline in the columns of mostly distinct strings
+    };
+
     bool write(const CellReference &row_column, const QVariant &value,
                const Format &format = Format());
     bool write(int row, int column, const QVariant &value, const Format &format = Format());
+    bool write(const CellReference &row_column, const QVariant &value, const Format &format,
+               WriteOptions options);
+    bool write(int row, int column, const QVariant &value, const Format &format,
+               WriteOptions options);
+    bool write(const CellReference &row_column, const QVariant &value, int styleId);
+    bool write(int row, int column, const QVariant &value, int styleId);
     QVariant read(const CellReference &row_column) const;
     QVariant read(int row, int column) const;
+    QString displayText(const CellReference &row_column) const;
+    QString displayText(int row, int column) const;
+    bool readColumn(int column, int firstRow, int lastRow, QVector<double> *values,
+                    QBitArray *valid = 0) const;
+    bool readColumn(int column, int firstRow, int lastRow, QVector<QDateTime> *values,
+                    QBitArray *valid = 0) const;
+    bool readRange(const CellRange &range, QVector<double> *values, QBitArray *valid = 0) const;
+    RawCellValue readRaw(int row, int column) const;
+    QString sharedString(int index) const;
+    CellReference find(const QVariant &value, const CellRange &range = CellRange()) const;
+    QList<CellReference> findAll(const QVariant &value, const CellRange &range = CellRange()) const;
+    int replaceAll(const QVariant &before, const QVariant &after,
+                   const CellRange &range = CellRange());
     bool writeString(const CellReference &row_column, const QString &value,
                      const Format &format = Format());
     bool writeString(int row, int column, const QString &value, const Format &format = Format());
     bool writeString(const CellReference &row_column, const RichString &value,
                      const Format &format = Format());
     bool writeString(int row, int column, const RichString &value, const Format &format = Format());
+    bool writeUtf8String(const CellReference &row_column, const char *data, int size = -1,
+                         const Format &format = Format());
+    bool writeUtf8String(int row, int column, const char *data, int size = -1,
+                         const Format &format = Format());
     bool writeInlineString(const CellReference &row_column, const QString &value,
                            const Format &format = Format());
     bool writeInlineString(int row, int column, const QString &value,
                            const Format &format = Format());
+    bool writeInlineString(const CellReference &row_column, const RichString &value,
+                           const Format &format = Format());
+    bool writeInlineString(int row, int column, const RichString &value,
+                           const Format &format = Format());
     bool writeNumeric(const CellReference &row_column, double value,
                       const Format &format = Format());
     bool writeNumeric(int row, int column, double value, const Format &format = Format());
@@ -90,24 +154,114 @@ public:
                    const Format &format = Format());
     bool writeTime(int row, int column, const QTime &t, const Format &format = Format());
 
+    bool writeRow(int row, int firstColumn, const double *values, int count,
+                  const Format &format = Format());
+    bool writeRow(int row, int firstColumn, const QStringList &values,
+                  const Format &format = Format());
+    bool writeRow(int row, int firstColumn, const QVector<QVariant> &values,
+                  const Format &format = Format());
+    bool writeRow(int row, int firstColumn, const QVector<QDate> &values,
+                  const Format &format = Format());
+    bool writeRow(int row, int firstColumn, const QVector<QDateTime> &values,
+                  const Format &format = Format());
+    bool writeColumn(int firstRow, int column, const double *values, int count,
+                     const Format &format = Format());
+    bool writeColumn(int firstRow, int column, const QStringList &values,
+                     const Format &format = Format());
+    bool writeColumn(int firstRow, int column, const QVector<QVariant> &values,
+                     const Format &format = Format());
+    bool writeColumn(int firstRow, int column, const QVector<QDate> &values,
+                     const Format &format = Format());
+    bool writeColumn(int firstRow, int column, const QVector<QDateTime> &values,
+                     const Format &format = Format());
+    bool writeRange(int firstRow, int firstColumn, const double *values, int rowCount,
+                    int columnCount, const Format &format = Format());
+    bool writeRange(int firstRow, int firstColumn, const QVector<QVector<QVariant>> &values,
+                    const Format &format = Format());
+    RowWriter *rowWriter(int firstRow, int lastRow);
+    void mergeRowWriters();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    template <typename T>
+    bool writeRecords(int firstRow, int firstColumn, const QVector<T> &records,
+                      const QStringList &properties = QStringList(),
+                      const QList<Format> &formats = QList<Format>());
+    template <typename T>
+    bool writeRecords(int firstRow, int firstColumn, const QVector<T *> &records,
+                      const QStringList &properties = QStringList(),
+                      const QList<Format> &formats = QList<Format>());
+    template <typename T> QVector<T> readRecords(const CellRange &range = CellRange()) const;
+#endif
+
+    bool importCsv(QIODevice *device, int row = 1, int column = 1,
+                   CsvOptions options = DefaultCsvOptions, QChar delimiter = QLatin1Char(','));
+    bool exportCsv(QIODevice *device, const CellRange &range = CellRange(),
+                   QChar delimiter = QLatin1Char(',')) const;
+
     bool writeHyperlink(const CellReference &row_column, const QUrl &url,
                         const Format &format = Format(), const QString &display = QString(),
                         const QString &tip = QString());
     bool writeHyperlink(int row, int column, const QUrl &url, const Format &format = Format(),
                         const QString &display = QString(), const QString &tip = QString());
 
+    bool writeComment(const CellReference &row_column, const QString &text);
+    bool writeComment(int row, int column, const QString &text);
+    QString comment(const CellReference &row_column) const;
+    QString comment(int row, int column) const;
+    bool removeComment(const CellReference &row_column);
+    bool removeComment(int row, int column);
+    void setCommentAuthor(const QString &author);
+    QString commentAuthor() const;
+
     bool addDataValidation(const DataValidation &validation);
     bool addConditionalFormatting(const ConditionalFormatting &cf);
 
+    bool addTable(const CellRange &range, const QStringList &headers = QStringList(),
+                  const QString &style = QString(), const QString &name = QString());
+    QStringList tableNames() const;
+    CellRange tableRange(const QString &name) const;
+    bool writeTableColumn(const QString &table, const QString &column, const double *values,
+                          int count, const Format &format = Format());
+    bool writeTableColumn(const QString &table, const QString &column, const QStringList &values,
+                          const Format &format = Format());
+    bool writeTableColumn(const QString &table, const QString &column,
+                          const QVector<QVariant> &values, const Format &format = Format());
+
+    bool setAutoFilter(const CellRange &range);
+    CellRange autoFilter() const;
+    bool setAutoFilterValues(int column, const QStringList &values);
+    QStringList autoFilterValues(int column) const;
+    QStringList autoFilterDistinctValues(int column) const;
+    int applyAutoFilter();
+
     Cell *cellAt(const CellReference &row_column) const;
     Cell *cellAt(int row, int column) const;
 
     bool insertImage(int row, int column, const QImage &image);
+    bool insertImages(int row, int column, const QList<QImage> &images, int spacing = 0);
+    bool insertImage(int row, int column, const QByteArray &encoded, const QString &suffix,
+                     const QSize &pixelSize = QSize());
     Chart *insertChart(int row, int column, const QSize &size);
 
+    bool insertRows(int row, int count = 1);
+    bool removeRows(int row, int count = 1);
+    bool insertColumns(int column, int count = 1);
+    bool removeColumns(int column, int count = 1);
+
+    bool clear(const CellRange &range, ClearOptions options = ClearAll);
+    bool copyRange(const CellRange &source, const CellReference &destination);
+    bool moveRange(const CellRange &source, const CellReference &destination);
+    bool sortRange(const CellRange &range, int column, Qt::SortOrder order = Qt::AscendingOrder);
+    bool sortRange(const CellRange &range, const QList<QPair<int, Qt::SortOrder>> &keys);
+
     bool mergeCells(const CellRange &range, const Format &format = Format());
     bool unmergeCells(const CellRange &range);
     QList<CellRange> mergedCells() const;
+    CellRange mergedRangeAt(int row, int column) const;
+    QList<DataValidation> dataValidationsAt(int row, int column) const;
+    QList<DataValidationViolation> validate(const CellRange &range) const;
+    QList<ConditionalFormatting> conditionalFormattingsAt(int row, int column) const;
+    Format conditionalFormat(int row, int column) const;
+    bool conditionalDataBar(int row, int column, double *length, QColor *color = 0) const;
 
     bool setColumnWidth(const CellRange &range, double width);
     bool setColumnFormat(const CellRange &range, const Format &format);
@@ -115,6 +269,7 @@ public:
     bool setColumnWidth(int colFirst, int colLast, double width);
     bool setColumnFormat(int colFirst, int colLast, const Format &format);
     bool setColumnHidden(int colFirst, int colLast, bool hidden);
+    bool autoFitColumns(const CellRange &range = CellRange());
     double columnWidth(int column);
     Format columnFormat(int column);
     bool isColumnHidden(int column);
@@ -132,6 +287,11 @@ public:
     bool groupColumns(const CellRange &range, bool collapsed = true);
     CellRange dimension() const;
 
+    bool setConstantMemoryEnabled(bool enable = true);
+    bool isConstantMemoryEnabled() const;
+    void setStringStorage(StringStorage storage);
+    StringStorage stringStorage() const;
+
     bool isWindowProtected() const;
     void setWindowProtected(bool protect);
     bool isFormulasVisible() const;
@@ -158,13 +318,80 @@ public:
 private:
     friend class DocumentPrivate;
     friend class Workbook;
+    friend class WorkbookPrivate;
+    friend class SheetLoader;
+    friend class ArrowBridge;
+    friend class RawRowIterator;
+    friend class TypedRowWriterBase;
+    friend class ChartPrivate;
     friend class ::WorksheetTest;
+    friend class ::MemoryTest;
     Worksheet(const QString &sheetName, int sheetId, Workbook *book, CreateFlag flag);
     Worksheet *copy(const QString &distName, int distId) const;
+    Worksheet *snapshot(Workbook *workbook) const;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    bool writeMetaRecords(int firstRow, int firstColumn, const QMetaObject *metaObject,
+                          const QVector<const void *> &records, bool objects,
+                          const QStringList &properties, const QList<Format> &formats);
+    QVector<QMetaProperty> recordProperties(const QMetaObject *metaObject, const CellRange &range,
+                                            CellRange *records) const;
+#endif
 
     void saveToXmlFile(QIODevice *device) const;
     bool loadFromXmlFile(QIODevice *device);
+    void saveToBinaryFile(QIODevice *device) const;
+    bool loadFromBinaryData(const QByteArray &data);
+    qint64 elementCount() const;
 };
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+template <typename T>
+bool Worksheet::writeRecords(int firstRow, int firstColumn, const QVector<T> &records,
+                             const QStringList &properties, const QList<Format> &formats)
+{
+    QVector<const void *> pointers;
+    pointers.reserve(records.size());
+    for (int i = 0; i < records.size(); ++i)
+        pointers.append(&records[i]);
+    return writeMetaRecords(firstRow, firstColumn, &T::staticMetaObject, pointers, false,
+                            properties, formats);
+}
+
+template <typename T>
+bool Worksheet::writeRecords(int firstRow, int firstColumn, const QVector<T *> &records,
+                             const QStringList &properties, const QList<Format> &formats)
+{
+    QVector<const void *> pointers;
+    pointers.reserve(records.size());
+    for (int i = 0; i < records.size(); ++i)
+        pointers.append(static_cast<const QObject *>(records[i]));
+    return writeMetaRecords(firstRow, firstColumn, &T::staticMetaObject, pointers, true,
+                            properties, formats);
+}
+
+template <typename T> QVector<T> Worksheet::readRecords(const CellRange &range) const
+{
+    CellRange rows;
+    const QVector<QMetaProperty> columns = recordProperties(&T::staticMetaObject, range, &rows);
+    QVector<T> records;
+    for (int row = rows.firstRow(); row <= rows.lastRow(); ++row) {
+        T record;
+        for (int i = 0; i < columns.size(); ++i) {
+            if (!columns[i].isValid())
+                continue;
+            const QVariant value = read(row, rows.firstColumn() + i);
+            if (!value.isNull())
+                columns[i].writeOnGadget(&record, value);
+        }
+        records.append(record);
+    }
+    return records;
+}
+#endif
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Worksheet::WriteOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(Worksheet::ClearOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(Worksheet::CsvOptions)
+
 QT_END_NAMESPACE_XLSX
 #endif // XLSXWORKSHEET_H
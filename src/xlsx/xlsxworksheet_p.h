@@ -42,13 +42,25 @@
 #include "xlsxdatavalidation.h"
 #include "xlsxconditionalformatting.h"
 #include "xlsxcellformula.h"
+#include "xlsxcelltable_p.h"
+#include "xlsxcellrangeindex_p.h"
+#include "xlsxcellvalueindex_p.h"
+#include "xlsxcell_p.h"
+#include "xlsxutility_p.h"
+#include "xlsxtable_p.h"
+#include "xlsxcardinality_p.h"
+#include "xlsxhyperlinktable_p.h"
 
 #include <QImage>
+#include <QHash>
 #include <QSharedPointer>
+#include <QScopedPointer>
+#include <QVector>
 #include <QRegularExpression>
 
 class QXmlStreamWriter;
 class QXmlStreamReader;
+class QTemporaryFile;
 
 namespace QXlsx {
 
@@ -57,28 +69,20 @@ const int XLSX_COLUMN_MAX = 16384;
 const int XLSX_STRING_MAX = 32767;
 
 class SharedStrings;
-
-struct XlsxHyperlinkData
-{
-    enum LinkType { External, Internal };
-
-    XlsxHyperlinkData(LinkType linkType = External, const QString &target = QString(),
-                      const QString &location = QString(), const QString &display = QString(),
-                      const QString &tip = QString())
-        : linkType(linkType)
-        , target(target)
-        , location(location)
-        , display(display)
-        , tooltip(tip)
-    {
-    }
-
-    LinkType linkType;
-    QString target; // For External link
-    QString location;
-    QString display;
-    QString tooltip;
-};
+class SheetDataWriter;
+class Biff12Writer;
+class Biff12Reader;
+class CsvRecord;
+class CsvReader;
+class CsvWriter;
+class XmlPullParser;
+class FormulaEngine;
+class ConditionalFormattingEvaluator;
+class PixelAxis;
+class ProgressMonitor;
+class ZipEntryDevice;
+class LoadFilter;
+class RowWriter;
 
 // ECMA-376 Part1 18.3.1.81
 struct XlsxSheetFormatProps
@@ -119,6 +123,8 @@ struct XlsxRowInfo
         , hidden(hidden)
         , outlineLevel(0)
         , collapsed(false)
+        , firstRow(0)
+        , lastRow(0)
     {
     }
 
@@ -128,6 +134,9 @@ struct XlsxRowInfo
     bool hidden;
     int outlineLevel;
     bool collapsed;
+    // The rows [firstRow, lastRow] which share this info
+    int firstRow;
+    int lastRow;
 };
 
 struct XlsxColumnInfo
@@ -160,56 +169,210 @@ class XLSX_AUTOTEST_EXPORT WorksheetPrivate : public AbstractSheetPrivate
 public:
     WorksheetPrivate(Worksheet *p, Worksheet::CreateFlag flag);
     ~WorksheetPrivate();
+    void copyContents(WorksheetPrivate *other) const;
     int checkDimensions(int row, int col, bool ignore_row = false, bool ignore_col = false);
     Format cellFormat(int row, int col) const;
+    Format cellFormat(const CellData &cell) const;
+    QVariant cellValue(const CellData &cell) const;
+    bool cellNumber(const CellData &cell, double *number) const;
+    RawCellValue rawValue(const CellData &cell) const;
+    QString displayText(const CellData &cell) const;
+    void readNumbers(const CellRange &range, double *values, QBitArray *valid) const;
+
+    CellValueIndex::Key valueKey(const CellData &cell) const;
+    CellValueIndex::Key indexedValue(int row, int col) const;
+    void reindexValue(int row, int col, const CellValueIndex::Key &before);
+    void indexValue(int row, int col, const CellValueIndex::Key &key) const;
+    void indexColumns(int colFirst, int colLast) const;
+    QList<CellValueIndex::Key> searchKeys(const QVariant &value) const;
+    QList<CellReference> findCells(const QVariant &value, const CellRange &range,
+                                   bool firstOnly) const;
+    void readTexts(const CellRange &range, QString *texts) const;
+    CellFormula cellFormula(const CellData &cell) const;
+    RichString cellRichString(const CellData &cell) const;
+    int inlineFontId(const Format &format);
+    QVector<InlineRun> inlineRuns(const RichString &string);
+    Cell *cellAt(int row, int col) const;
+    void setCell(int row, int col, const CellData &cell);
+    void setCell(int row, int col, Cell::CellType type, const QVariant &value, const Format &format,
+                 const CellFormula &formula = CellFormula(),
+                 const QVector<InlineRun> &inlineRuns = QVector<InlineRun>(),
+                 int sharedStringIndex = -1);
+    void setPlainString(int row, int col, const QString &value, const Format &format);
+    bool isInlineString(int col, const QString &value);
+    void releaseSharedString(const CellData &cell);
+    void setCells(int row, int firstCol, const CellData *cells, int count);
+    bool checkBatchDimensions(int firstRow, int firstCol, int lastRow, int lastCol);
+    int batchXfIndex(const Format &format);
+    int batchCellXfIndex(int xf, int row, int col) const;
+    bool isUrl(const QString &value) const;
+    bool isPlainString(const QString &value) const;
+    bool batchVariantCell(const QVariant &value, int xf, CellData *cell);
+    void storeBatchCells(int row, int col, const QVector<CellData> &cells, bool vertical);
+    void writeBatchStrings(int row, int col, const QStringList &values, bool vertical,
+                           const Format &format);
+    bool writeBatchVariants(int row, int col, const QVector<QVariant> &values, bool vertical,
+                            const Format &format);
+    void writeBatchDates(int row, int col, const QVector<double> &numbers, bool vertical,
+                         const Format &format);
+    bool importCsv(CsvReader &reader, int row, int col, Worksheet::CsvOptions options);
+    bool storeCsvRecord(int row, int col, const CsvRecord &record, const QVector<int> &types,
+                        QVector<CellData> &cells);
+    void exportCsv(CsvWriter &writer, const CellRange &range) const;
+    void setCellFormat(int row, int col, const Format &format);
+    void setCellFormula(int row, int col, const CellFormula &formula);
+    void updateCachedCell(int row, int col) const;
+    void releaseCachedCell(int row, int col) const;
+    static int xfIndexOf(const Format &format);
+    const SharedFormulaTemplate &sharedFormulaTemplate(int sharedIndex) const;
+    void markUsedXfIndexes(QVector<bool> &usedXfs) const;
+    void remapXfIndexes(const QVector<int> &xfMap);
+    void remapSharedStrings(const QVector<int> &stringMap);
+    void squeeze();
     QString generateDimensionString() const;
     void calculateSpans() const;
     void splitColsInfo(int colFirst, int colLast);
+    void splitRowsInfo(int rowFirst, int rowLast);
+    void mergeColsInfo(int colFirst, int colLast);
+    void mergeRowsInfo(int rowFirst, int rowLast);
+    QSharedPointer<XlsxColumnInfo> columnInfoAt(int col) const;
+    QSharedPointer<XlsxRowInfo> rowInfoAt(int row) const;
     void validateDimension();
+    void updateDimension();
 
     void saveXmlSheetData(QXmlStreamWriter &writer) const;
-    void saveXmlCellData(QXmlStreamWriter &writer, int row, int col,
-                         QSharedPointer<Cell> cell) const;
+    QVector<int> columnXfIndices() const;
+    void saveXmlRow(SheetDataWriter &writer, int row_num, const QString &span,
+                    const XlsxRowInfo *rowInfo, const QVector<int> &columnXfs) const;
+    void saveXmlCellData(SheetDataWriter &writer, int row, int col, const CellData &cell,
+                         int xfIndex) const;
+    void saveXmlCellFormula(SheetDataWriter &writer, const CellFormula &formula) const;
+    QString shareableFormulaKey(int row, int col, const CellData &cell) const;
+    void addSavedSharedFormula(int firstRow, int firstCol, int lastRow, int lastCol,
+                               int *nextSharedIndex) const;
+    void findSharedFormulas() const;
+    CellFormula savedCellFormula(int row, int col, const CellFormula &formula) const;
     void saveXmlMergeCells(QXmlStreamWriter &writer) const;
     void saveXmlHyperlinks(QXmlStreamWriter &writer) const;
+    void saveXmlAutoFilter(QXmlStreamWriter &writer) const;
     void saveXmlDrawings(QXmlStreamWriter &writer) const;
+    void saveXmlLegacyDrawing(QXmlStreamWriter &writer) const;
+    void saveXmlTableParts(QXmlStreamWriter &writer) const;
     void saveXmlDataValidations(QXmlStreamWriter &writer) const;
+    void saveBinarySheetData(Biff12Writer &writer) const;
+    void saveBinaryRow(Biff12Writer &writer, int row_num, const XlsxRowInfo *rowInfo,
+                       const QVector<int> &columnXfs) const;
+    void saveBinaryCell(Biff12Writer &writer, int col, const CellData &cell, int xfIndex) const;
     int rowPixelsSize(int row) const;
     int colPixelsSize(int col) const;
+    const PixelAxis &rowPixels() const;
+    const PixelAxis &columnPixels() const;
 
+    const LoadFilter *loadFilter() const;
     void loadXmlSheetData(QXmlStreamReader &reader);
+    QString loadXmlInlineString(QXmlStreamReader &reader, QVector<InlineRun> *runs);
+    void loadXmlSheetData(XmlPullParser &parser);
+    void loadXmlCell(XmlPullParser &parser, const QByteArray &rowText, int row, int *column,
+                     const LoadFilter *filter);
+    QString loadXmlInlineString(XmlPullParser &parser, QVector<InlineRun> *runs);
     void loadXmlColumnsInfo(QXmlStreamReader &reader);
     void loadXmlMergeCells(QXmlStreamReader &reader);
+    void loadXmlAutoFilter(QXmlStreamReader &reader);
     void loadXmlDataValidations(QXmlStreamReader &reader);
     void loadXmlSheetFormatProps(QXmlStreamReader &reader);
     void loadXmlSheetViews(QXmlStreamReader &reader);
     void loadXmlHyperlinks(QXmlStreamReader &reader);
+    void loadXmlTableParts(QXmlStreamReader &reader);
+    void loadBinaryColumnInfo(Biff12Reader &reader);
+    bool loadBinarySheetData(Biff12Reader &reader);
+    void loadBinaryCell(Biff12Reader &reader, int row, const LoadFilter *filter);
+    Table *table(const QString &name) const;
+    QString filterText(const CellData &cell) const;
+    int applyAutoFilter();
 
     QList<QSharedPointer<XlsxRowInfo>> getRowInfoList(int rowFirst, int rowLast);
     QList<QSharedPointer<XlsxColumnInfo>> getColumnInfoList(int colFirst, int colLast);
-    QList<int> getColumnIndexes(int colFirst, int colLast);
+    QList<QSharedPointer<XlsxRowInfo>> rowInfoRange(int rowFirst, int rowLast);
+    QList<QSharedPointer<XlsxColumnInfo>> columnInfoRange(int colFirst, int colLast);
     bool isColumnRangeValid(int colFirst, int colLast);
 
     SharedStrings *sharedStrings() const;
 
-    QMap<int, QMap<int, QSharedPointer<Cell>>> cellTable;
+    bool shiftCells(bool rows, int first, int count);
+    void shiftFormulas(bool rows, int first, int count, int max);
+    void releaseCells(bool rows, int first, int count);
+    void shiftRanges(bool rows, int first, int count, int max);
+    void clearCells(const CellRange &range, Worksheet::ClearOptions options,
+                    QHash<int, int> &sstRefs);
+    bool copyCells(const CellRange &source, const CellReference &destination, bool move);
+    bool sortCells(const CellRange &range, const QList<QPair<int, Qt::SortOrder>> &keys);
+    void unshareFormulas();
+    void countSharedStringRef(const CellData &cell, int count, QHash<int, int> &sstRefs) const;
+    void addSharedStringRefs(const QHash<int, int> &sstRefs);
+    void updateCachedCells(const CellRange &range) const;
+
+    void addMerge(const CellRange &range);
+    int mergeIndexOf(const CellRange &range) const;
+    void removeMerge(int index);
+    void compactMerges();
+    void addDataValidation(const DataValidation &validation);
+    void addConditionalFormatting(const ConditionalFormatting &cf);
+
+    void flushStreamRows(int beforeRow);
+    void saveStreamedSheetData(QXmlStreamWriter &writer);
+
+    CellTable cellTable;
+    // The fonts of the runs of the rich inline strings, each distinct
+    // font being stored once, along with its <rPr> element
+    QList<Format> inlineFonts;
+    QVector<QByteArray> inlineFontXml;
+    QHash<quint64, int> inlineFontIds; // by font fingerprint
+    // Cell objects handed out by cellAt(), keyed by row and column
+    mutable QHash<quint64, Cell *> cellCache;
+    mutable CellPool cellPool;
     QMap<int, QMap<int, QString>> comments;
-    QMap<int, QMap<int, QSharedPointer<XlsxHyperlinkData>>> urlTable;
+    QString commentAuthor; // of all the comments
+    HyperlinkTable urlTable;
     QList<CellRange> merges;
+    int removedMerges; // left as invalid ranges in merges
+    // The Excel tables of the sheet, their parts are written with the sheet
+    QList<QSharedPointer<Table>> tables;
+    // The autofilter of the sheet, its header row included, and the values
+    // shown by its filtered columns, keyed by column
+    CellRange autoFilterRange;
+    QMap<int, QStringList> autoFilterColumns;
+    // Positions of the merges, data validations and conditional formattings by their ranges
+    CellRangeIndex mergeIndex;
+    CellRangeIndex dataValidationIndex;
+    CellRangeIndex conditionalFormattingIndex;
+    // Non-overlapping row and column ranges, keyed by their first row / column
     QMap<int, QSharedPointer<XlsxRowInfo>> rowsInfo;
     QMap<int, QSharedPointer<XlsxColumnInfo>> colsInfo;
-    QMap<int, QSharedPointer<XlsxColumnInfo>> colsInfoHelper;
 
     QList<DataValidation> dataValidationsList;
     QList<ConditionalFormatting> conditionalFormattingList;
+    // Merge keys of the validations and formattings, to their positions
+    QHash<QString, int> dataValidationKeys;
+    QHash<QString, int> conditionalFormattingKeys;
     QMap<int, CellFormula> sharedFormulaMap;
+    // Tokenized sharedFormulaMap entries, built when a formula is first read
+    mutable QHash<int, SharedFormulaTemplate> sharedFormulaTemplates;
+    // The text read() returns for the cells of the shared formulas, by cell,
+    // dropped when a shared formula changes
+    struct SharedFormulaText
+    {
+        int sharedIndex;
+        QString text;
+    };
+    mutable QHash<quint64, SharedFormulaText> sharedFormulaTexts;
+    QString sharedFormulaText(int row, int col, int sharedIndex) const;
+    // The formulas saved as shared ones, keyed by their cell, while the sheet data is saved
+    mutable QHash<quint64, CellFormula> savedSharedFormulas;
 
     CellRange dimension;
     int previous_row;
 
     mutable QMap<int, QString> row_spans;
-    QMap<int, double> row_sizes;
-    QMap<int, double> col_sizes;
 
     int outline_row_level;
     int outline_col_level;
@@ -232,6 +395,83 @@ public:
 
     QRegularExpression urlPattern;
 
+    // Where Worksheet::writeString() stores the strings, and the number of
+    // distinct strings of each column, for the adaptive storage
+    Worksheet::StringStorage stringStorage;
+    QHash<int, CardinalityEstimator> columnCardinality;
+
+    // Constant memory mode: rows are flushed to streamFile once a higher row is written.
+    bool constantMemory;
+    int streamFlushedRow;
+    bool streamError; // the stream file couldn't be written or read back
+    QScopedPointer<QTemporaryFile> streamFile;
+    QScopedPointer<SheetDataWriter> streamWriter;
+
+    // Memory budget: finished blocks of rows are spilled to disk once the
+    // cells of the workbook take more than the budget of the document.
+    qint64 checkedCellMemory;
+    void checkMemoryBudget(int row);
+    void spillCells(int beforeRow);
+
+    // The writers filling ranges of rows from other threads, keyed by their
+    // first row, until they are merged
+    QMap<int, RowWriter *> rowWriters;
+    void mergeRowWriters();
+
+    // Created by Workbook::recalculate(), and told about every written cell afterwards
+    QScopedPointer<FormulaEngine> formulaEngine;
+    // Created by the first conditionalFormat() call, and dropped when cells or
+    // conditional formattings change
+    mutable QScopedPointer<ConditionalFormattingEvaluator> cfEvaluator;
+    // Built for the columns searched by Worksheet::find(), told about every
+    // written cell afterwards and dropped when cells move
+    mutable QScopedPointer<CellValueIndex> valueIndex;
+    // The pixel offsets of the rows and columns, built when they are first
+    // needed and dropped when the row or column infos change
+    mutable QScopedPointer<PixelAxis> rowAxis;
+    mutable QScopedPointer<PixelAxis> columnAxis;
+
+    // When sheets are loaded concurrently, references to the shared strings are
+    // counted here and merged into the SharedStrings table afterwards.
+    bool deferSstRefs;
+    QVector<int> sstRefCounts;
+    void mergeSstRefs();
+
+    // Set by the document while the sheet is loaded or saved, not owned
+    ProgressMonitor *progressMonitor;
+    bool reportRows(int rowsDone) const;
+
+    // Document::IncrementalSave: the <row> elements of each block of
+    // CellTable::SpillBlockRows rows as written by the last save, deflated
+    // when the sheet was written to a zip entry, and what they depend on
+    // besides the cells. Blocks with formulas aren't kept, their values
+    // change when the workbook is recalculated.
+    struct SavedRowBlock
+    {
+        QByteArray key; // see savedRowBlockKey()
+        quint64 revision; // CellTable::blockRevision()
+        int lastSharedString; // highest shared string slot of the cells, or -1
+        int stringGeneration; // SharedStrings::saveIndexGeneration()
+        int rowCount;
+        bool deflated;
+        int compressionLevel; // of the deflated data
+        QByteArray data;
+        quint32 crc; // and size of the xml, when the data is deflated
+        qint64 size;
+    };
+    bool incrementalSave; // set by the document before the sheet is saved
+    mutable QHash<int, SavedRowBlock> savedRowBlocks;
+    mutable QByteArray savedRowsKey; // what all the blocks depend on
+    // Gathered while the rows of one block are being written
+    mutable int savedBlockLastString;
+    mutable bool savedBlockHasFormula;
+    QByteArray savedRowsKeyOf(const QVector<int> &columnXfs) const;
+    QByteArray savedRowBlockKey(int block,
+                                QMap<int, QSharedPointer<XlsxRowInfo>>::const_iterator infoIt,
+                                QMap<int, QMap<int, QString>>::const_iterator commentIt) const;
+    bool writeSavedRowBlock(SheetDataWriter &writer, ZipEntryDevice *entry, int block,
+                            const QByteArray &key) const;
+
 private:
     static double calculateColWidth(int characters);
 };
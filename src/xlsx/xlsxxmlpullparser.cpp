@@ -0,0 +1,629 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "xlsxxmlpullparser_p.h"
+#include "xlsxutility_p.h"
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+namespace {
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline const char *findByte(const char *from, const char *end, char c)
+{
+    return static_cast<const char *>(memchr(from, c, size_t(end - from)));
+}
+
+void appendCharacter(QString &text, uint code)
+{
+    if (QChar::requiresSurrogates(code)) {
+        text.append(QChar(QChar::highSurrogate(code)));
+        text.append(QChar(QChar::lowSurrogate(code)));
+    } else {
+        text.append(QChar(ushort(code)));
+    }
+}
+
+/*
+  Append the character of the entity reference \a name, of \a size bytes
+  without its '&' and ';', to \a text. Returns false if the entity isn't
+  a character reference or one of the predefined entities.
+ */
+bool appendEntity(const char *name, int size, QString &text)
+{
+    if (size >= 2 && name[0] == '#') {
+        const bool hex = name[1] == 'x';
+        const int first = hex ? 2 : 1;
+        if (size == first)
+            return false;
+        uint code = 0;
+        for (int i = first; i < size; ++i) {
+            const char c = name[i];
+            uint digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (hex && c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (hex && c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                return false;
+            code = code * (hex ? 16 : 10) + digit;
+            if (code > 0x10FFFF)
+                return false;
+        }
+        appendCharacter(text, code);
+        return true;
+    }
+
+    static const struct
+    {
+        const char *name;
+        int size;
+        char character;
+    } entities[] = {
+        {"lt", 2, '<'}, {"gt", 2, '>'}, {"amp", 3, '&'}, {"quot", 4, '"'}, {"apos", 4, '\''}};
+    for (size_t i = 0; i < sizeof(entities) / sizeof(entities[0]); ++i) {
+        if (size == entities[i].size && memcmp(name, entities[i].name, size) == 0) {
+            text.append(QLatin1Char(entities[i].character));
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool needsDecoding(char c, bool attribute)
+{
+    return c == '&' || c == '\r' || (attribute && (c == '\n' || c == '\t'));
+}
+
+/*
+  Decode the \a size bytes of UTF-8 \a data: the entity references are
+  replaced, and the line ends become "\n". The line ends and the tabs of
+  an \a attribute value become spaces.
+ */
+QString decode(const char *data, int size, bool attribute)
+{
+    const char *end = data + size;
+    // Plain text is the common case
+    if (attribute) {
+        const char *p = data;
+        while (p < end && !needsDecoding(*p, true))
+            ++p;
+        if (p == end)
+            return QString::fromUtf8(data, size);
+    } else if (!findByte(data, end, '&') && !findByte(data, end, '\r')) {
+        return QString::fromUtf8(data, size);
+    }
+
+    QString text;
+    text.reserve(size);
+    const char *chunk = data;
+    for (const char *p = data; p < end; ++p) {
+        const char c = *p;
+        if (!needsDecoding(c, attribute))
+            continue;
+        text.append(QString::fromUtf8(chunk, int(p - chunk)));
+        if (c == '&') {
+            // The longest reference is "&#x10FFFF;"
+            const char *semicolon = findByte(p + 1, qMin(end, p + 10), ';');
+            if (semicolon && appendEntity(p + 1, int(semicolon - p - 1), text))
+                p = semicolon;
+            else
+                text.append(QLatin1Char('&'));
+        } else if (c == '\r') {
+            // Both "\r\n" and a lone "\r" are a line end
+            text.append(QLatin1Char(attribute ? ' ' : '\n'));
+            if (p + 1 < end && p[1] == '\n')
+                ++p;
+        } else {
+            text.append(QLatin1Char(' '));
+        }
+        chunk = p + 1;
+    }
+    text.append(QString::fromUtf8(chunk, int(end - chunk)));
+    return text;
+}
+
+} // namespace
+
+XmlPullParser::XmlPullParser(const char *data, int size)
+{
+    init(data, size);
+}
+
+XmlPullParser::XmlPullParser(const QByteArray &data)
+{
+    init(data.constData(), data.size());
+}
+
+void XmlPullParser::init(const char *data, int size)
+{
+    m_begin = data;
+    m_end = data + size;
+    m_pos = data;
+    m_tokenStart = data;
+    m_token = NoToken;
+    m_depth = 0;
+    m_pendingEnd = false;
+    m_name = data;
+    m_nameSize = 0;
+    m_text = data;
+    m_textSize = 0;
+    m_cdata = false;
+}
+
+/*
+  Returns false if \a data isn't encoded in UTF-8, or in ASCII, according
+  to its byte order mark and its xml declaration.
+ */
+bool XmlPullParser::canParse(const QByteArray &data)
+{
+    const char *p = data.constData();
+    int size = data.size();
+    if (size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+        size -= 3;
+    }
+    // UTF-16 and UTF-32 have zero bytes or a byte order mark in front
+    if (size >= 2 && (p[0] == 0 || p[1] == 0 || uchar(p[0]) >= 0xFE))
+        return false;
+    if (size < 5 || memcmp(p, "<?xml", 5) != 0)
+        return true;
+
+    const char *end = findByte(p, p + size, '>');
+    const QByteArray declaration = QByteArray::fromRawData(p, end ? int(end - p) : size);
+    int begin = declaration.indexOf("encoding");
+    if (begin == -1)
+        return true;
+    begin = declaration.indexOf('=', begin) + 1;
+    while (begin > 0 && begin < declaration.size() && isSpace(declaration.at(begin)))
+        ++begin;
+    if (begin <= 0 || begin >= declaration.size())
+        return false;
+    const int close = declaration.indexOf(declaration.at(begin), begin + 1);
+    if (close == -1)
+        return false;
+    const QByteArray encoding = declaration.mid(begin + 1, close - begin - 1).toLower();
+    return encoding == "utf-8" || encoding == "utf8" || encoding == "us-ascii";
+}
+
+/*
+  Parse the \a size bytes of the decimal integer \a data. Returns 0 if
+  \a data isn't a number, as QString::toInt() does.
+ */
+int XmlPullParser::toInt(const char *data, int size)
+{
+    int i = 0;
+    bool negative = false;
+    if (size > 0 && (data[0] == '-' || data[0] == '+')) {
+        negative = data[0] == '-';
+        i = 1;
+    }
+    // Nine digits can't overflow
+    if (size - i <= 9) {
+        int value = 0;
+        for (; i < size && data[i] >= '0' && data[i] <= '9'; ++i)
+            value = value * 10 + (data[i] - '0');
+        if (i == size)
+            return negative ? -value : value;
+    }
+    return QByteArray::fromRawData(data, size).trimmed().toInt();
+}
+
+XmlPullParser::TokenType XmlPullParser::setError()
+{
+    m_pos = m_end;
+    m_pendingEnd = false;
+    m_attributes.clear();
+    return m_token = Invalid;
+}
+
+/*
+  Returns the first occurrence of the \a size bytes of \a terminator at
+  or after \a from, or 0.
+ */
+const char *XmlPullParser::find(const char *from, const char *terminator, int size) const
+{
+    while ((from = findByte(from, m_end, terminator[0])) != 0) {
+        if (m_end - from < size)
+            return 0;
+        if (memcmp(from, terminator, size) == 0)
+            return from;
+        ++from;
+    }
+    return 0;
+}
+
+/*
+  Read the next token. The comments, processing instructions and DTDs are
+  skipped, an empty element is reported as a start and an end element.
+ */
+XmlPullParser::TokenType XmlPullParser::readNext()
+{
+    if (atEnd())
+        return m_token;
+    m_attributes.clear();
+    if (m_pendingEnd) {
+        // The name is still the one of the start tag
+        m_pendingEnd = false;
+        --m_depth;
+        return m_token = EndElement;
+    }
+
+    m_cdata = false;
+    for (;;) {
+        m_tokenStart = m_pos;
+        if (m_pos == m_end)
+            return m_token = EndDocument;
+        if (*m_pos != '<') {
+            const char *next = findByte(m_pos, m_end, '<');
+            m_text = m_pos;
+            m_pos = next ? next : m_end;
+            m_textSize = int(m_pos - m_text);
+            return m_token = Characters;
+        }
+        const TokenType token = readMarkup();
+        if (token != NoToken)
+            return m_token = token;
+    }
+}
+
+/*
+  Read the markup at the '<' the parser is on. Returns NoToken for the
+  skipped markup.
+ */
+XmlPullParser::TokenType XmlPullParser::readMarkup()
+{
+    const char *p = m_pos + 1;
+    const int left = int(m_end - p);
+    if (left > 0 && *p == '/') {
+        const char *close = findByte(p, m_end, '>');
+        if (!close)
+            return setError();
+        m_name = p + 1;
+        const char *nameEnd = m_name;
+        while (nameEnd < close && !isSpace(*nameEnd))
+            ++nameEnd;
+        m_nameSize = int(nameEnd - m_name);
+        m_pos = close + 1;
+        --m_depth;
+        return EndElement;
+    }
+    if (left > 0 && *p == '?') {
+        const char *end = find(p, "?>", 2);
+        if (!end)
+            return setError();
+        m_pos = end + 2;
+        return NoToken;
+    }
+    if (left > 0 && *p == '!') {
+        if (left >= 3 && memcmp(p, "!--", 3) == 0) {
+            const char *end = find(p + 3, "-->", 3);
+            if (!end)
+                return setError();
+            m_pos = end + 3;
+            return NoToken;
+        }
+        if (left >= 8 && memcmp(p, "![CDATA[", 8) == 0) {
+            m_text = p + 8;
+            const char *end = find(m_text, "]]>", 3);
+            if (!end)
+                return setError();
+            m_textSize = int(end - m_text);
+            m_cdata = true;
+            m_pos = end + 3;
+            return Characters;
+        }
+        // A DTD, whose internal subset isn't supported
+        const char *close = findByte(p, m_end, '>');
+        if (!close)
+            return setError();
+        m_pos = close + 1;
+        return NoToken;
+    }
+    return readStartTag();
+}
+
+XmlPullParser::TokenType XmlPullParser::readStartTag()
+{
+    const char *p = m_pos + 1;
+    m_name = p;
+    while (p < m_end && !isSpace(*p) && *p != '/' && *p != '>')
+        ++p;
+    m_nameSize = int(p - m_name);
+    if (m_nameSize == 0)
+        return setError();
+
+    for (;;) {
+        while (p < m_end && isSpace(*p))
+            ++p;
+        if (p == m_end)
+            return setError();
+        if (*p == '>') {
+            ++p;
+            break;
+        }
+        if (*p == '/') {
+            if (p + 1 == m_end || p[1] != '>')
+                return setError();
+            m_pendingEnd = true;
+            p += 2;
+            break;
+        }
+
+        Attribute attribute;
+        attribute.name = p;
+        while (p < m_end && *p != '=' && !isSpace(*p) && *p != '>' && *p != '/')
+            ++p;
+        attribute.nameSize = int(p - attribute.name);
+        while (p < m_end && isSpace(*p))
+            ++p;
+        if (attribute.nameSize == 0 || p == m_end || *p != '=')
+            return setError();
+        ++p;
+        while (p < m_end && isSpace(*p))
+            ++p;
+        if (p == m_end || (*p != '"' && *p != '\''))
+            return setError();
+        const char *close = findByte(p + 1, m_end, *p);
+        if (!close)
+            return setError();
+        attribute.value = p + 1;
+        attribute.valueSize = int(close - p - 1);
+        m_attributes.append(attribute);
+        p = close + 1;
+    }
+
+    m_pos = p;
+    ++m_depth;
+    return StartElement;
+}
+
+/*
+  Read until the next start element within the current element. Returns
+  false when the end of the current element is reached instead, or the
+  end of the data.
+ */
+bool XmlPullParser::readNextStartElement()
+{
+    for (;;) {
+        switch (readNext()) {
+        case StartElement:
+            return true;
+        case EndElement:
+        case EndDocument:
+        case Invalid:
+            return false;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+  Read until the end element which brings the parser back above \a depth.
+ */
+void XmlPullParser::skipTo(int depth)
+{
+    while (readNext() != EndDocument && m_token != Invalid) {
+        if (m_token == EndElement && m_depth < depth)
+            return;
+    }
+}
+
+/*
+  Skip the rest of the current start element, up to its end element.
+ */
+void XmlPullParser::skipCurrentElement()
+{
+    if (m_token == StartElement)
+        skipTo(m_depth);
+}
+
+/*
+  Skip the current start element, its following siblings and anything else
+  up to the end tag named \a name, which is the next token read. Used to
+  leave the rest of an ancestor unread, the tags in between aren't parsed
+  at all, so \a name must not be used by the skipped elements.
+ */
+void XmlPullParser::skipToEndTag(const char *name)
+{
+    if (m_token == StartElement) {
+        --m_depth;
+        m_pendingEnd = false;
+        m_token = EndElement;
+    }
+    m_attributes.clear();
+
+    char tag[64] = "</";
+    const int size = int(qstrlen(name)) + 2;
+    Q_ASSERT(size < int(sizeof(tag)));
+    qstrncpy(tag + 2, name, sizeof(tag) - 2);
+    const char *from = m_pos;
+    while ((from = find(from, tag, size)) != 0) {
+        if (from + size < m_end && (from[size] == '>' || isSpace(from[size]))) {
+            m_pos = from;
+            return;
+        }
+        from += size;
+    }
+    setError();
+}
+
+/*
+  Read the text of the current start element, up to its end element. The
+  text of the child elements is skipped.
+ */
+QString XmlPullParser::readElementText()
+{
+    if (m_token != StartElement)
+        return QString();
+
+    const int depth = m_depth;
+    QString result;
+    while (readNext() != EndDocument && m_token != Invalid) {
+        if (m_token == EndElement) {
+            if (m_depth < depth)
+                break;
+        } else if (m_token == Characters && m_depth == depth) {
+            result += text();
+        }
+    }
+    return result;
+}
+
+/*
+  Set \a data and \a size to the first run of characters of the current
+  start element, without decoding them, and skip to its end element. Used
+  for the values which are numbers.
+ */
+void XmlPullParser::readElementCharacters(const char **data, int *size)
+{
+    *data = m_pos;
+    *size = 0;
+    if (m_token != StartElement)
+        return;
+
+    const int depth = m_depth;
+    if (readNext() == Characters) {
+        *data = m_text;
+        *size = m_textSize;
+    }
+    if (m_token != EndElement || m_depth >= depth)
+        skipTo(depth);
+}
+
+/*
+  Returns the markup of the current start element, up to its end
+  element, and moves past it. The bytes aren't copied, parts of an element
+  which are too rare to be parsed here are read from them by
+  QXmlStreamReader.
+ */
+QByteArray XmlPullParser::readElementXml()
+{
+    if (m_token != StartElement)
+        return QByteArray();
+
+    const char *start = m_tokenStart;
+    skipTo(m_depth);
+    return QByteArray::fromRawData(start, int(m_pos - start));
+}
+
+/*
+  Returns true if the current start or end element is named \a name.
+ */
+bool XmlPullParser::isName(const char *name) const
+{
+    const int size = int(strlen(name));
+    return size == m_nameSize && memcmp(m_name, name, size) == 0;
+}
+
+/*
+  Returns the decoded characters of the current Characters token.
+ */
+QString XmlPullParser::text() const
+{
+    if (m_token != Characters)
+        return QString();
+    if (m_cdata)
+        return QString::fromUtf8(m_text, m_textSize);
+    return decode(m_text, m_textSize, false);
+}
+
+const XmlPullParser::Attribute *XmlPullParser::findAttribute(const char *name) const
+{
+    const int size = int(strlen(name));
+    for (int i = 0; i < m_attributes.size(); ++i) {
+        const Attribute &attribute = m_attributes.at(i);
+        if (attribute.nameSize == size && memcmp(attribute.name, name, size) == 0)
+            return &attribute;
+    }
+    return 0;
+}
+
+/*
+  Set \a value and \a size to the raw bytes of the attribute \a name of
+  the current start element. Returns false if there is no such attribute.
+ */
+bool XmlPullParser::attribute(const char *name, const char **value, int *size) const
+{
+    const Attribute *attribute = findAttribute(name);
+    if (!attribute)
+        return false;
+    *value = attribute->value;
+    *size = attribute->valueSize;
+    return true;
+}
+
+bool XmlPullParser::hasAttribute(const char *name) const
+{
+    return findAttribute(name) != 0;
+}
+
+bool XmlPullParser::attributeEquals(const char *name, const char *value) const
+{
+    const Attribute *attribute = findAttribute(name);
+    return attribute && attribute->valueSize == int(strlen(value))
+           && memcmp(attribute->value, value, attribute->valueSize) == 0;
+}
+
+/*
+  Returns the attribute \a name as an integer, or \a defaultValue if it's
+  missing or empty.
+ */
+int XmlPullParser::attributeInt(const char *name, int defaultValue) const
+{
+    const Attribute *attribute = findAttribute(name);
+    if (!attribute || attribute->valueSize == 0)
+        return defaultValue;
+    return toInt(attribute->value, attribute->valueSize);
+}
+
+double XmlPullParser::attributeDouble(const char *name, double defaultValue) const
+{
+    const Attribute *attribute = findAttribute(name);
+    if (!attribute || attribute->valueSize == 0)
+        return defaultValue;
+    return parseDouble(attribute->value, attribute->valueSize);
+}
+
+/*
+  Returns the decoded value of the attribute \a name, or a null string.
+ */
+QString XmlPullParser::attributeText(const char *name) const
+{
+    const Attribute *attribute = findAttribute(name);
+    if (!attribute)
+        return QString();
+    return decode(attribute->value, attribute->valueSize, true);
+}
+
+QT_END_NAMESPACE_XLSX
@@ -0,0 +1,137 @@
+/****************************************************************************
+** Copyright (c) 2013-2014 Debao Zhang <hello@debao.me>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef XLSXXMLPULLPARSER_P_H
+#define XLSXXMLPULLPARSER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Xlsx API.  It exists for the convenience
+// of the Qt Xlsx.  This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "xlsxglobal.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+QT_BEGIN_NAMESPACE_XLSX
+
+/*
+  A non-validating pull parser working on the UTF-8 bytes of a part, used
+  for <sheetData> and the shared string table, which make up the bulk of
+  a workbook. The tags are scanned in place, the next '<' and the closing
+  quotes being found by memchr(), and names and attribute values are
+  handed out as byte spans; only the text payloads are decoded to
+  QString.
+
+  Element names are compared as written, namespaces aren't processed, so
+  the parts using prefixed SpreadsheetML elements are left to
+  QXmlStreamReader, as are the parts which aren't encoded in UTF-8.
+  Mismatched end tags aren't detected, and DTDs are skipped. The parser
+  doesn't copy the data, which must outlive it.
+ */
+class XLSX_AUTOTEST_EXPORT XmlPullParser
+{
+public:
+    enum TokenType {
+        NoToken,
+        StartElement,
+        EndElement,
+        Characters,
+        EndDocument,
+        Invalid
+    };
+
+    XmlPullParser(const char *data, int size);
+    explicit XmlPullParser(const QByteArray &data);
+
+    static bool canParse(const QByteArray &data);
+    static int toInt(const char *data, int size);
+
+    TokenType readNext();
+    bool readNextStartElement();
+    void skipCurrentElement();
+    void skipToEndTag(const char *name);
+    QString readElementText();
+    void readElementCharacters(const char **data, int *size);
+    QByteArray readElementXml();
+
+    TokenType tokenType() const { return m_token; }
+    bool atEnd() const { return m_token == EndDocument || m_token == Invalid; }
+    bool hasError() const { return m_token == Invalid; }
+    int tokenOffset() const { return int(m_tokenStart - m_begin); }
+    int offset() const { return int(m_pos - m_begin); }
+
+    bool isName(const char *name) const;
+    QString text() const;
+
+    bool attribute(const char *name, const char **value, int *size) const;
+    bool hasAttribute(const char *name) const;
+    bool attributeEquals(const char *name, const char *value) const;
+    int attributeInt(const char *name, int defaultValue = 0) const;
+    double attributeDouble(const char *name, double defaultValue = 0) const;
+    QString attributeText(const char *name) const;
+
+private:
+    struct Attribute
+    {
+        const char *name;
+        int nameSize;
+        const char *value;
+        int valueSize;
+    };
+
+    void init(const char *data, int size);
+    TokenType readMarkup();
+    TokenType readStartTag();
+    TokenType setError();
+    const char *find(const char *from, const char *terminator, int size) const;
+    void skipTo(int depth);
+    const Attribute *findAttribute(const char *name) const;
+
+    const char *m_begin;
+    const char *m_end;
+    const char *m_pos;
+    const char *m_tokenStart;
+    TokenType m_token;
+    int m_depth;
+    bool m_pendingEnd; // the start tag being reported ends with "/>"
+    const char *m_name;
+    int m_nameSize;
+    const char *m_text;
+    int m_textSize;
+    bool m_cdata;
+    QVarLengthArray<Attribute, 8> m_attributes;
+};
+
+QT_END_NAMESPACE_XLSX
+
+#endif // XLSXXMLPULLPARSER_P_H
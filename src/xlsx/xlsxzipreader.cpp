@@ -24,20 +24,248 @@
 ****************************************************************************/
 
 #include "xlsxzipreader_p.h"
+#include "xlsxprofiler_p.h"
+#include "xlsxstatistics_p.h"
 
 #include <private/qzipreader_p.h>
 #include <QtCore/qvector.h>
+#include <QFile>
+#include <QBuffer>
+#include <QtEndian>
+#include <zlib.h>
+#include <string.h>
+#include <climits>
 
 namespace QXlsx {
 
+namespace {
+
+const int ZIP_BUFFER_SIZE = 64 * 1024;
+// Largest input given to zlib at once, whose sizes are 32 bit
+const qint64 ZIP_MAPPED_CHUNK_SIZE = 1 << 30;
+
+quint16 readUInt16(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+quint32 readUInt32(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+quint64 readUInt64(const QByteArray &data, int pos)
+{
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(data.constData() + pos));
+}
+
+/*
+  Replace the sizes and the offset of \a info which are set to 0xffffffff
+  in the central directory by the ones of the zip64 field of \a extra.
+  Returns false if they aren't all there.
+ */
+bool readZip64Field(const QByteArray &extra, ZipFileInfo *info)
+{
+    int pos = 0;
+    while (pos + 4 <= extra.size()) {
+        const int id = readUInt16(extra, pos);
+        const int size = readUInt16(extra, pos + 2);
+        pos += 4;
+        if (pos + size > extra.size())
+            return false;
+        if (id != 0x0001) {
+            pos += size;
+            continue;
+        }
+
+        // The 64-bit values are only there for the fields which overflow
+        qint64 *fields[3] = {&info->uncompressedSize, &info->compressedSize,
+                             &info->headerOffset};
+        const int end = pos + size;
+        for (int i = 0; i < 3; ++i) {
+            if (*fields[i] != 0xffffffff)
+                continue;
+            if (pos + 8 > end)
+                return false;
+            *fields[i] = qint64(readUInt64(extra, pos));
+            pos += 8;
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+/*
+  Read-only device which inflates the contents of one entry on the
+  fly, straight from the \a archive device. The archive is seeked
+  before each read, so it can be shared with other readers as long
+  as they are used from the same thread.
+
+  When the archive file is mapped in memory, \a mappedArchive points to
+  it, and the entry is inflated from the mapped region without any copy.
+ */
+ZipFileDevice::ZipFileDevice(QIODevice *archive, qint64 dataOffset, const ZipFileInfo &info,
+                             const uchar *mappedArchive)
+    : m_archive(archive)
+    , m_mappedArchive(mappedArchive)
+    , m_stream(new z_stream)
+    , m_inPos(dataOffset)
+    , m_inRemaining(info.compressedSize)
+    , m_outRemaining(info.uncompressedSize)
+    , m_deflated(info.method == 8)
+    , m_ok(true)
+{
+    memset(m_stream, 0, sizeof(z_stream));
+    if (m_deflated) {
+        if (inflateInit2(m_stream, -MAX_WBITS) != Z_OK)
+            m_ok = false;
+        if (!m_mappedArchive)
+            m_inBuffer.resize(ZIP_BUFFER_SIZE);
+    }
+    open(QIODevice::ReadOnly);
+}
+
+ZipFileDevice::~ZipFileDevice()
+{
+    if (m_deflated)
+        inflateEnd(m_stream);
+    delete m_stream;
+}
+
+bool ZipFileDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 ZipFileDevice::bytesAvailable() const
+{
+    return (m_ok ? m_outRemaining : 0) + QIODevice::bytesAvailable();
+}
+
+qint64 ZipFileDevice::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+/*
+  Read the next chunk of compressed data. Returns false on error.
+ */
+bool ZipFileDevice::fillInput()
+{
+    if (m_mappedArchive) {
+        const qint64 len = qMin<qint64>(m_inRemaining, ZIP_MAPPED_CHUNK_SIZE);
+        m_stream->next_in = const_cast<Bytef *>(m_mappedArchive + m_inPos);
+        m_stream->avail_in = uInt(len);
+        m_inPos += len;
+        m_inRemaining -= len;
+        return true;
+    }
+
+    const qint64 len = qMin<qint64>(m_inRemaining, m_inBuffer.size());
+    if (!m_archive->seek(m_inPos) || m_archive->read(m_inBuffer.data(), len) != len) {
+        setErrorString(QStringLiteral("Failed to read the zip archive"));
+        m_ok = false;
+        return false;
+    }
+    m_inPos += len;
+    m_inRemaining -= len;
+    m_stream->next_in = reinterpret_cast<Bytef *>(m_inBuffer.data());
+    m_stream->avail_in = len;
+    return true;
+}
+
+qint64 ZipFileDevice::readData(char *data, qint64 maxSize)
+{
+    if (!m_ok)
+        return -1;
+    maxSize = qMin(maxSize, m_outRemaining);
+    if (maxSize <= 0)
+        return 0;
+
+    if (!m_deflated && m_mappedArchive) {
+        memcpy(data, m_mappedArchive + m_inPos, maxSize);
+        m_inPos += maxSize;
+        m_outRemaining -= maxSize;
+        return maxSize;
+    }
+    if (!m_deflated) {
+        if (!m_archive->seek(m_inPos) || m_archive->read(data, maxSize) != maxSize) {
+            setErrorString(QStringLiteral("Failed to read the zip archive"));
+            m_ok = false;
+            return -1;
+        }
+        m_inPos += maxSize;
+        m_outRemaining -= maxSize;
+        return maxSize;
+    }
+
+    m_stream->next_out = reinterpret_cast<Bytef *>(data);
+    m_stream->avail_out = uInt(maxSize);
+    while (m_stream->avail_out > 0) {
+        if (m_stream->avail_in == 0 && (m_inRemaining <= 0 || !fillInput()))
+            break;
+        const int ret = inflate(m_stream, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+            break;
+        if (ret != Z_OK) {
+            setErrorString(QStringLiteral("Corrupted zip entry"));
+            m_ok = false;
+            break;
+        }
+    }
+
+    const qint64 have = maxSize - m_stream->avail_out;
+    Statistics::count(Statistics::BytesInflated, have);
+    if (!have && m_ok) {
+        // The entry is shorter than announced
+        m_outRemaining = 0;
+        return 0;
+    }
+    m_outRemaining -= have;
+    return have ? have : -1;
+}
+
+/*
+  The archive file is mapped in memory whenever possible, so that the
+  central directory and the entries are read without any system call
+  or copy.
+ */
 ZipReader::ZipReader(const QString &filePath)
-    : m_reader(new QZipReader(filePath))
+    : m_file(new QFile(filePath))
+    , m_device(m_file.data())
+    , m_map(0)
+    , m_mapSize(0)
+    , m_profiler(0)
 {
+    if (m_file->open(QIODevice::ReadOnly)) {
+        m_mapSize = m_file->size();
+        if (m_mapSize > 0)
+            m_map = m_file->map(0, m_mapSize);
+    }
     init();
 }
 
 ZipReader::ZipReader(QIODevice *device)
-    : m_reader(new QZipReader(device))
+    : m_device(device)
+    , m_map(0)
+    , m_mapSize(0)
+    , m_profiler(0)
+{
+    init();
+}
+
+/*
+  Reads the archive from \a device, which is deleted with the reader if
+  \a takeOwnership is true.
+ */
+ZipReader::ZipReader(QIODevice *device, bool takeOwnership)
+    : m_ownedDevice(takeOwnership ? device : 0)
+    , m_device(device)
+    , m_map(0)
+    , m_mapSize(0)
+    , m_profiler(0)
 {
     init();
 }
@@ -48,16 +276,43 @@ ZipReader::~ZipReader()
 
 void ZipReader::init()
 {
-    auto allFiles = m_reader->fileInfoList();
-    foreach (const QZipReader::FileInfo &fi, allFiles) {
-        if (fi.isFile)
-            m_filePaths.append(fi.filePath);
+    m_fileInfosRead = false;
+    if (m_map || (m_device && !m_device->isSequential())) {
+        // Every entry can be read straight from the archive, the central
+        // directory doesn't have to be parsed by QZipReader too, which
+        // doesn't know about zip64 anyway.
+        m_fileInfosRead = true;
+        if (!readCentralDirectory(&m_filePaths))
+            m_filePaths.clear();
+    }
+
+    if (m_filePaths.isEmpty()) {
+        auto allFiles = reader()->fileInfoList();
+        foreach (const QZipReader::FileInfo &fi, allFiles) {
+            if (fi.isFile)
+                m_filePaths.append(fi.filePath);
+        }
     }
+
+    m_filePathSet.reserve(m_filePaths.size());
+    foreach (const QString &path, m_filePaths)
+        m_filePathSet.insert(path);
+}
+
+/*
+  Returns the QZipReader used for the entries which can't be read
+  directly, created on first use.
+ */
+QZipReader *ZipReader::reader() const
+{
+    if (!m_reader)
+        m_reader.reset(new QZipReader(m_device));
+    return m_reader.data();
 }
 
 bool ZipReader::exists() const
 {
-    return m_reader->exists();
+    return m_map || reader()->exists();
 }
 
 QStringList ZipReader::filePaths() const
@@ -65,9 +320,288 @@ QStringList ZipReader::filePaths() const
     return m_filePaths;
 }
 
+/*
+  Returns true if the archive contains the file \a fileName. Unlike
+  filePaths().contains(), this doesn't scan the whole list of files.
+ */
+bool ZipReader::contains(const QString &fileName) const
+{
+    return m_filePathSet.contains(fileName);
+}
+
+/*
+  Looks up the entry of \a fileName in the central directory and returns
+  its \a info. Returns false if the entry can't be read directly, such as
+  encrypted entries, or if it doesn't exist.
+ */
+bool ZipReader::entry(const QString &fileName, ZipFileInfo *info) const
+{
+    ensureFileInfos();
+    QHash<QString, ZipFileInfo>::const_iterator it = m_fileInfos.constFind(fileName);
+    if (it == m_fileInfos.constEnd())
+        return false;
+    *info = *it;
+    return true;
+}
+
 QByteArray ZipReader::fileData(const QString &fileName) const
 {
-    return m_reader->fileData(fileName);
+    QByteArray data;
+    fileData(fileName, &data);
+    return data;
+}
+
+/*
+  Inflates the contents of \a fileName into \a buffer, whose memory is
+  reused when it's large enough, so that a buffer can be used again for
+  several files. Returns false if the file can't be read.
+ */
+bool ZipReader::fileData(const QString &fileName, QByteArray *buffer) const
+{
+    ProfilerScope scope(m_profiler, Profiler::InflatePhase, fileName);
+    const bool ok = inflateFile(fileName, buffer);
+    scope.setBytes(buffer->size());
+    return ok;
+}
+
+/*
+  Report the files inflated by fileData() to \a profiler, unless it's 0.
+ */
+void ZipReader::setProfiler(Profiler *profiler)
+{
+    m_profiler = profiler;
+}
+
+bool ZipReader::inflateFile(const QString &fileName, QByteArray *buffer) const
+{
+    ZipFileInfo info;
+    qint64 dataOffset;
+    if (!findFile(fileName, &info, &dataOffset)) {
+        *buffer = reader()->fileData(fileName);
+        return !buffer->isEmpty() || contains(fileName);
+    }
+    if (info.uncompressedSize > INT_MAX) {
+        // Too large for a QByteArray, only openFile() can read it
+        buffer->clear();
+        return false;
+    }
+
+    const int size = int(info.uncompressedSize);
+    buffer->resize(size);
+    ZipFileDevice device(m_device, dataOffset, info, m_map);
+    int pos = 0;
+    while (pos < size) {
+        const qint64 len = device.read(buffer->data() + pos, size - pos);
+        if (len <= 0)
+            break;
+        pos += int(len);
+    }
+    if (pos != size) {
+        buffer->clear();
+        return false;
+    }
+    return true;
+}
+
+/*
+  Returns a device from which the contents of \a fileName can be read
+  while it's being inflated, so that the whole file never has to be kept
+  in memory, or 0 if the file doesn't exist. The caller takes the
+  ownership of the device, which must not outlive the reader.
+
+  Entries which can't be streamed are inflated at once.
+ */
+QIODevice *ZipReader::openFile(const QString &fileName) const
+{
+    ZipFileInfo info;
+    qint64 dataOffset;
+    if (findFile(fileName, &info, &dataOffset)) {
+        if (m_map && info.method == 0) {
+            // Stored entries are read straight from the mapped file
+            QBuffer *buffer = new QBuffer;
+            buffer->setData(archiveData(dataOffset, info.uncompressedSize));
+            buffer->open(QIODevice::ReadOnly);
+            return buffer;
+        }
+        return new ZipFileDevice(m_device, dataOffset, info, m_map);
+    }
+
+    if (!contains(fileName))
+        return 0;
+    QBuffer *buffer = new QBuffer;
+    buffer->setData(fileData(fileName));
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
+
+/*
+  Reads the compressed contents of \a fileName into \a data as they are
+  stored in the archive, so that they can be copied to another archive
+  without being inflated. Returns false if the file doesn't exist or isn't
+  deflated.
+
+  When the archive is mapped, \a data refers to the mapped region, and
+  must not be used once the reader is destroyed.
+ */
+bool ZipReader::rawFileData(const QString &fileName, QByteArray *data, ZipFileInfo *info) const
+{
+    qint64 dataOffset;
+    if (!findFile(fileName, info, &dataOffset) || info->method != 8)
+        return false;
+    *data = archiveData(dataOffset, info->compressedSize);
+    return data->size() == info->compressedSize;
+}
+
+/*
+  Returns the uncompressed size of \a fileName as recorded in the central
+  directory, or -1 if it isn't known.
+ */
+qint64 ZipReader::fileSize(const QString &fileName) const
+{
+    ZipFileInfo info;
+    return entry(fileName, &info) ? info.uncompressedSize : -1;
+}
+
+void ZipReader::ensureFileInfos() const
+{
+    if (!m_fileInfosRead) {
+        m_fileInfosRead = true;
+        if (m_device && !m_device->isSequential())
+            readCentralDirectory();
+    }
+}
+
+/*
+  Returns the name of the archive file, or an empty string if the reader
+  was created from a device.
+ */
+QString ZipReader::fileName() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+/*
+  Looks up \a fileName in the central directory, which is read on first
+  use, and returns its \a info and the offset of its data.
+ */
+bool ZipReader::findFile(const QString &fileName, ZipFileInfo *info, qint64 *dataOffset) const
+{
+    if (!entry(fileName, info))
+        return false;
+
+    const QByteArray header = archiveData(info->headerOffset, 30);
+    if (header.size() != 30 || readUInt32(header, 0) != 0x04034b50)
+        return false;
+    *dataOffset = info->headerOffset + 30 + readUInt16(header, 26) + readUInt16(header, 28);
+    if (m_map && *dataOffset + info->compressedSize > m_mapSize)
+        return false;
+    return true;
+}
+
+/*
+  Returns \a size bytes of the archive from \a offset, or less if the
+  archive is shorter. The data refers to the mapped file when there is one.
+ */
+QByteArray ZipReader::archiveData(qint64 offset, qint64 size) const
+{
+    if (m_map) {
+        if (offset < 0 || offset > m_mapSize)
+            return QByteArray();
+        size = qMin(size, m_mapSize - offset);
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + offset),
+                                       int(qMin<qint64>(size, INT_MAX)));
+    }
+    if (!m_device->seek(offset))
+        return QByteArray();
+    return m_device->read(size);
+}
+
+/*
+  Collect the position and the sizes of the entries which can be streamed
+  from the central directory, and from the zip64 end of central directory
+  record and the zip64 extra fields when the archive or the entries are
+  larger than 4 GB. Encrypted entries are skipped.
+
+  The names of the files are appended to \a filePaths, if given. Returns
+  false if the directory is corrupted or if some files were skipped.
+ */
+bool ZipReader::readCentralDirectory(QStringList *filePaths) const
+{
+    const qint64 size = m_map ? m_mapSize : m_device->size();
+    const qint64 tailSize = qMin<qint64>(size, 0xffff + 22);
+    if (tailSize < 22)
+        return false;
+    const QByteArray tail = archiveData(size - tailSize, tailSize);
+    if (tail.size() != tailSize)
+        return false;
+
+    int eocd = -1;
+    for (int i = tail.size() - 22; i >= 0; --i) {
+        if (readUInt32(tail, i) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == -1)
+        return false;
+
+    qint64 entryCount = readUInt16(tail, eocd + 10);
+    qint64 directorySize = readUInt32(tail, eocd + 12);
+    qint64 directoryOffset = readUInt32(tail, eocd + 16);
+
+    // The zip64 record is found by the locator right before the end record
+    const qint64 eocdOffset = size - tailSize + eocd;
+    if (eocdOffset >= 20) {
+        const QByteArray locator = archiveData(eocdOffset - 20, 20);
+        if (locator.size() == 20 && readUInt32(locator, 0) == 0x07064b50) {
+            const QByteArray record = archiveData(qint64(readUInt64(locator, 8)), 56);
+            if (record.size() != 56 || readUInt32(record, 0) != 0x06064b50)
+                return false;
+            entryCount = qint64(readUInt64(record, 32));
+            directorySize = qint64(readUInt64(record, 40));
+            directoryOffset = qint64(readUInt64(record, 48));
+        }
+    }
+    if (directorySize > INT_MAX || directoryOffset < 0)
+        return false;
+    const QByteArray directory = archiveData(directoryOffset, directorySize);
+
+    bool complete = true;
+    int pos = 0;
+    for (qint64 i = 0; i < entryCount && pos + 46 <= directory.size(); ++i) {
+        if (readUInt32(directory, pos) != 0x02014b50)
+            return false;
+        const quint16 flags = readUInt16(directory, pos + 8);
+        const int nameLength = readUInt16(directory, pos + 28);
+        const int extraLength = readUInt16(directory, pos + 30);
+        const int entrySize = 46 + nameLength + extraLength + readUInt16(directory, pos + 32);
+        if (pos + entrySize > directory.size())
+            return false;
+
+        ZipFileInfo info;
+        info.method = readUInt16(directory, pos + 10);
+        info.crc = readUInt32(directory, pos + 16);
+        info.compressedSize = readUInt32(directory, pos + 20);
+        info.uncompressedSize = readUInt32(directory, pos + 24);
+        info.headerOffset = readUInt32(directory, pos + 42);
+        const QByteArray name = directory.mid(pos + 46, nameLength);
+        bool sized = true;
+        if (info.compressedSize == 0xffffffff || info.uncompressedSize == 0xffffffff
+            || info.headerOffset == 0xffffffff) {
+            sized = readZip64Field(directory.mid(pos + 46 + nameLength, extraLength), &info);
+        }
+        const QString path =
+            flags & 0x800 ? QString::fromUtf8(name) : QString::fromLocal8Bit(name);
+        if (!(flags & 0x1) && sized && (info.method == 0 || info.method == 8)) {
+            m_fileInfos.insert(path, info);
+            if (filePaths && !path.endsWith(QLatin1Char('/')))
+                filePaths->append(path);
+        } else {
+            complete = false;
+        }
+        pos += entrySize;
+    }
+    return complete && pos == int(directorySize);
 }
 
 } // namespace QXlsx
@@ -40,26 +40,94 @@
 #include "xlsxglobal.h"
 #include <QScopedPointer>
 #include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QIODevice>
 class QZipReader;
-class QIODevice;
+class QFile;
+struct z_stream_s;
 
 namespace QXlsx {
 
+class Profiler;
+
+struct ZipFileInfo
+{
+    int method;
+    quint32 crc;
+    qint64 compressedSize;
+    qint64 uncompressedSize;
+    qint64 headerOffset;
+};
+
+class XLSX_AUTOTEST_EXPORT ZipFileDevice : public QIODevice
+{
+public:
+    ZipFileDevice(QIODevice *archive, qint64 dataOffset, const ZipFileInfo &info,
+                  const uchar *mappedArchive = 0);
+    ~ZipFileDevice();
+
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 len);
+
+private:
+    bool fillInput();
+
+    QIODevice *m_archive;
+    const uchar *m_mappedArchive;
+    z_stream_s *m_stream;
+    QByteArray m_inBuffer;
+    qint64 m_inPos;
+    qint64 m_inRemaining;
+    qint64 m_outRemaining;
+    bool m_deflated;
+    bool m_ok;
+};
+
 class XLSX_AUTOTEST_EXPORT ZipReader
 {
 public:
     explicit ZipReader(const QString &fileName);
     explicit ZipReader(QIODevice *device);
+    ZipReader(QIODevice *device, bool takeOwnership);
     ~ZipReader();
     bool exists() const;
     QStringList filePaths() const;
+    bool contains(const QString &fileName) const;
+    bool entry(const QString &fileName, ZipFileInfo *info) const;
     QByteArray fileData(const QString &fileName) const;
+    bool fileData(const QString &fileName, QByteArray *buffer) const;
+    QIODevice *openFile(const QString &fileName) const;
+    bool rawFileData(const QString &fileName, QByteArray *data, ZipFileInfo *info) const;
+    qint64 fileSize(const QString &fileName) const;
+    QString fileName() const;
+    void setProfiler(Profiler *profiler);
 
 private:
     Q_DISABLE_COPY(ZipReader)
     void init();
-    QScopedPointer<QZipReader> m_reader;
+    QZipReader *reader() const;
+    QByteArray archiveData(qint64 offset, qint64 size) const;
+    bool readCentralDirectory(QStringList *filePaths = 0) const;
+    void ensureFileInfos() const;
+    bool findFile(const QString &fileName, ZipFileInfo *info, qint64 *dataOffset) const;
+    bool inflateFile(const QString &fileName, QByteArray *buffer) const;
+
+    QScopedPointer<QFile> m_file;
+    QScopedPointer<QIODevice> m_ownedDevice; // the device, when the reader owns it
+    QIODevice *m_device;
+    uchar *m_map; // the whole archive file, when it could be mapped
+    qint64 m_mapSize;
+    mutable QScopedPointer<QZipReader> m_reader;
     QStringList m_filePaths;
+    QSet<QString> m_filePathSet;
+    mutable QHash<QString, ZipFileInfo> m_fileInfos;
+    mutable bool m_fileInfosRead;
+    Profiler *m_profiler;
 };
 
 } // namespace QXlsx
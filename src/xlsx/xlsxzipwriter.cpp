@@ -23,46 +23,851 @@
 **
 ****************************************************************************/
 #include "xlsxzipwriter_p.h"
+#include "xlsxprogressmonitor.h"
+#include "xlsxstatistics_p.h"
 #include <QDebug>
-#include <private/qzipwriter_p.h>
+#include <QFile>
+#include <QDateTime>
+#include <QtEndian>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <zlib.h>
+#include <string.h>
 
 namespace QXlsx {
 
+namespace {
+
+const int ZIP_BUFFER_SIZE = 64 * 1024;
+// Size of the chunks which are deflated in parallel, and of the window
+// which primes each chunk with the end of the previous one.
+const int ZIP_CHUNK_SIZE = 256 * 1024;
+const int ZIP_WINDOW_SIZE = 32 * 1024;
+
+void appendUInt16(QByteArray &data, quint16 value)
+{
+    uchar buf[2];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 2);
+}
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    uchar buf[4];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 4);
+}
+
+void appendUInt64(QByteArray &data, quint64 value)
+{
+    uchar buf[8];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 8);
+}
+
+// The sizes and offsets which don't fit the 32-bit fields are stored in
+// the zip64 extra field, or record, and the field is set to this value.
+const qint64 ZIP64_LIMIT = 0xffffffffLL;
+
+quint32 zip32(qint64 value)
+{
+    return value >= ZIP64_LIMIT ? quint32(ZIP64_LIMIT) : quint32(value);
+}
+
+quint32 currentDosTime()
+{
+    const QDateTime dt = QDateTime::currentDateTime();
+    const QDate date = dt.date();
+    const QTime time = dt.time();
+    quint32 dosDate = ((date.year() - 1980) << 9) | (date.month() << 5) | date.day();
+    quint32 dosTime = (time.hour() << 11) | (time.minute() << 5) | (time.second() / 2);
+    return (dosDate << 16) | dosTime;
+}
+
+} // namespace
+
+/*
+  One chunk of an entry which is deflated on the thread pool. Each chunk
+  ends with a sync flush, except the last one, so that the compressed
+  chunks put one after another form a single deflate stream.
+ */
+class ZipDeflateChunk : public QRunnable
+{
+public:
+    ZipDeflateChunk(const QByteArray &input, const QByteArray &dictionary, int level, bool last)
+        : m_input(input)
+        , m_dictionary(dictionary)
+        , m_level(level)
+        , m_last(last)
+        , m_ok(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(z_stream));
+        if (deflateInit2(&stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+            == Z_OK) {
+            if (!m_dictionary.isEmpty()) {
+                deflateSetDictionary(&stream,
+                                     reinterpret_cast<const Bytef *>(m_dictionary.constData()),
+                                     m_dictionary.size());
+            }
+            m_output.resize(deflateBound(&stream, m_input.size()) + 16);
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m_input.constData()));
+            stream.avail_in = m_input.size();
+            stream.next_out = reinterpret_cast<Bytef *>(m_output.data());
+            stream.avail_out = m_output.size();
+            const int ret = deflate(&stream, m_last ? Z_FINISH : Z_SYNC_FLUSH);
+            m_ok = stream.avail_in == 0 && stream.avail_out > 0
+                && (m_last ? ret == Z_STREAM_END : ret == Z_OK);
+            m_output.resize(m_output.size() - stream.avail_out);
+            deflateEnd(&stream);
+        }
+        m_input.clear();
+        m_done.release();
+    }
+
+    /*
+      Wait until the chunk is deflated. Returns false on error.
+     */
+    bool wait()
+    {
+        m_done.acquire();
+        return m_ok;
+    }
+
+    QByteArray output() const { return m_output; }
+
+private:
+    QByteArray m_input;
+    QByteArray m_dictionary;
+    QByteArray m_output;
+    QSemaphore m_done;
+    int m_level;
+    bool m_last;
+    bool m_ok;
+};
+
+/*
+  Write-only device used to produce the contents of one entry. Data
+  written to it is deflated on the fly.
+
+  When created by ZipWriter::beginFile(), the compressed data goes
+  straight into the archive, and the local file header is patched once
+  the entry is finished. When the writer uses data descriptors, as it
+  does for sequential devices, the crc and the sizes are written after
+  the data instead, so that nothing has to be seeked. The stored entries
+  of a sequential device, and all the entries if no writer is given at
+  all, are kept in memory instead, and are written out later. The latter
+  is used to compress entries in other threads, see
+  ZipWriter::addCompressedFile().
+
+  The data is deflated with the zlib \a compressionLevel, or stored as it
+  is when the level is 0. When the writer enables the parallel deflate,
+  entries larger than one chunk are deflated on the global thread pool.
+ */
+ZipEntryDevice::ZipEntryDevice(const QString &filePath, ZipWriter *writer,
+                               int compressionLevel)
+    : m_writer(writer)
+    , m_stream(new z_stream)
+    , m_deferred(!writer
+                 || (writer->m_device->isSequential()
+                     && (compressionLevel == 0 || !writer->m_dataDescriptors)))
+    , m_streamed(!m_deferred && writer->m_dataDescriptors && compressionLevel != 0)
+    , m_ok(true)
+    , m_level(qBound(-1, compressionLevel, 9))
+    , m_parallel(writer && writer->m_parallelDeflate && compressionLevel != 0)
+    , m_flushed(true)
+    , m_recording(false)
+    , m_segmentCrc(0)
+    , m_segmentSize(0)
+{
+    m_info.name = filePath.toUtf8();
+    m_info.method = compressionLevel == 0 ? 0 : 8;
+    m_info.dosTime = currentDosTime();
+    m_info.crc = crc32(0L, Z_NULL, 0);
+    m_info.compressedSize = 0;
+    m_info.uncompressedSize = 0;
+    m_info.headerOffset = writer ? writer->m_offset : 0;
+    m_info.dataDescriptor = m_streamed;
+
+    memset(m_stream, 0, sizeof(z_stream));
+    if (m_info.method == 8) {
+        if (deflateInit2(m_stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+            != Z_OK) {
+            m_ok = false;
+        }
+        m_inBuffer.reserve(ZIP_BUFFER_SIZE);
+        m_outBuffer.resize(ZIP_BUFFER_SIZE);
+    }
+
+    // Sizes and crc are unknown yet, they will be updated by finish().
+    if (!m_deferred)
+        m_writer->writeLocalFileHeader(m_info);
+
+    open(QIODevice::WriteOnly);
+}
+
+ZipEntryDevice::~ZipEntryDevice()
+{
+    foreach (ZipDeflateChunk *chunk, m_chunks) {
+        chunk->wait();
+        delete chunk;
+    }
+    if (m_info.method == 8)
+        deflateEnd(m_stream);
+    delete m_stream;
+}
+
+bool ZipEntryDevice::isSequential() const
+{
+    return true;
+}
+
+bool ZipEntryDevice::isDeferred() const
+{
+    return m_deferred;
+}
+
+QByteArray ZipEntryDevice::compressedData() const
+{
+    return m_pending;
+}
+
+ZipEntryInfo ZipEntryDevice::info() const
+{
+    return m_info;
+}
+
+qint64 ZipEntryDevice::readData(char *, qint64)
+{
+    return -1;
+}
+
+qint64 ZipEntryDevice::writeData(const char *data, qint64 len)
+{
+    if (!m_ok)
+        return -1;
+
+    // The crc of a segment is combined with the one of the entry at its end
+    if (m_recording) {
+        m_segmentCrc = crc32(m_segmentCrc, reinterpret_cast<const Bytef *>(data), len);
+        m_segmentSize += len;
+    } else {
+        m_info.crc = crc32(m_info.crc, reinterpret_cast<const Bytef *>(data), len);
+    }
+    m_info.uncompressedSize += len;
+    if (m_info.method == 0)
+        return writeCompressed(data, len) ? len : -1;
+    Statistics::count(Statistics::BytesDeflated, len);
+    m_flushed = false;
+
+    if (m_parallel) {
+        qint64 pos = 0;
+        while (pos < len) {
+            const int size = int(qMin<qint64>(len - pos, ZIP_CHUNK_SIZE - m_chunk.size()));
+            m_chunk.append(data + pos, size);
+            pos += size;
+            if (m_chunk.size() == ZIP_CHUNK_SIZE && !startChunk(false))
+                return -1;
+        }
+        return len;
+    }
+
+    // Small writes are very common when QXmlStreamWriter is used,
+    // so collect them before feeding zlib.
+    if (m_inBuffer.size() + len < ZIP_BUFFER_SIZE) {
+        m_inBuffer.append(data, len);
+        return len;
+    }
+
+    if (!deflateBuffer(Z_NO_FLUSH))
+        return -1;
+    if (len < ZIP_BUFFER_SIZE) {
+        m_inBuffer.append(data, len);
+    } else {
+        m_inBuffer = QByteArray::fromRawData(data, len);
+        if (!deflateBuffer(Z_NO_FLUSH))
+            return -1;
+    }
+    return len;
+}
+
+bool ZipEntryDevice::deflateBuffer(int flush)
+{
+    m_stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m_inBuffer.constData()));
+    m_stream->avail_in = m_inBuffer.size();
+    int ret;
+    do {
+        m_stream->next_out = reinterpret_cast<Bytef *>(m_outBuffer.data());
+        m_stream->avail_out = m_outBuffer.size();
+        ret = deflate(m_stream, flush);
+        if (ret == Z_STREAM_ERROR) {
+            m_ok = false;
+            return false;
+        }
+        const int have = m_outBuffer.size() - m_stream->avail_out;
+        if (have > 0 && !writeCompressed(m_outBuffer.constData(), have))
+            return false;
+    } while (m_stream->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+    m_inBuffer.clear();
+    return true;
+}
+
+bool ZipEntryDevice::writeCompressed(const char *data, qint64 size)
+{
+    m_info.compressedSize += size;
+    if (m_recording)
+        m_segment.append(data, size);
+    if (m_deferred) {
+        m_pending.append(data, size);
+        return true;
+    }
+    if (!m_writer->writeData(data, size)) {
+        m_ok = false;
+        return false;
+    }
+    return true;
+}
+
+/*
+  Hand the collected chunk over to the thread pool, the \a last one
+  finishing the deflate stream. As in pigz, each chunk is primed with the
+  end of the previous one, so that the compression ratio is hardly worse.
+
+  The chunks are written to the archive in order, once deflated. At most
+  two chunks per thread are in flight, to bound the memory used.
+ */
+bool ZipEntryDevice::startChunk(bool last)
+{
+    ZipDeflateChunk *chunk = new ZipDeflateChunk(m_chunk, m_dictionary, m_level, last);
+    m_chunks.append(chunk);
+    QThreadPool::globalInstance()->start(chunk);
+
+    m_dictionary = m_chunk.right(ZIP_WINDOW_SIZE);
+    m_chunk.clear();
+    m_chunk.reserve(ZIP_CHUNK_SIZE);
+
+    const int maxChunks = qMax(2, QThreadPool::globalInstance()->maxThreadCount() * 2);
+    while (m_chunks.size() > (last ? 0 : maxChunks)) {
+        if (!writeChunk())
+            return false;
+    }
+    return true;
+}
+
+/*
+  Wait for the oldest chunk in flight and write it out.
+ */
+bool ZipEntryDevice::writeChunk()
+{
+    ZipDeflateChunk *chunk = m_chunks.takeFirst();
+    const bool ok = chunk->wait();
+    const QByteArray output = chunk->output();
+    delete chunk;
+    if (!ok || !writeCompressed(output.constData(), output.size()))
+        m_ok = false;
+    return m_ok;
+}
+
+/*
+  Returns true if the entry can be made of segments, which needs it to be
+  deflated without the parallel chunks.
+ */
+bool ZipEntryDevice::canWriteSegments() const
+{
+    return m_ok && m_info.method == 8 && !m_parallel && isOpen();
+}
+
+/*
+  Start a segment of the entry: the data written until endSegment() is
+  deflated independently of the data around it, and its compressed bytes
+  are collected, so that another entry deflated with the same level can
+  take them as they are with writeSegment(). The deflate stream is fully
+  flushed at both ends of the segment, which costs a few bytes and the
+  matches across its boundaries. Returns false if the entry can't be
+  made of segments.
+ */
+bool ZipEntryDevice::beginSegment()
+{
+    if (!canWriteSegments() || m_recording || !fullFlush())
+        return false;
+    m_recording = true;
+    m_segment.clear();
+    m_segmentCrc = crc32(0L, Z_NULL, 0);
+    m_segmentSize = 0;
+    return true;
+}
+
+/*
+  End the segment started by beginSegment(), and return its deflated
+  data, and the crc and the size of its uncompressed data. Returns false
+  on error.
+ */
+bool ZipEntryDevice::endSegment(QByteArray *deflatedData, quint32 *crc, qint64 *size)
+{
+    if (!m_recording)
+        return false;
+    const bool ok = fullFlush();
+    m_recording = false;
+    m_info.crc = crc32_combine(m_info.crc, m_segmentCrc, m_segmentSize);
+    deflatedData->swap(m_segment);
+    m_segment.clear();
+    *crc = m_segmentCrc;
+    *size = m_segmentSize;
+    return ok;
+}
+
+/*
+  Append a segment returned by endSegment(), of an entry deflated with
+  the same level, without deflating its data again.
+ */
+bool ZipEntryDevice::writeSegment(const QByteArray &deflatedData, quint32 crc, qint64 size)
+{
+    if (!canWriteSegments() || m_recording || !fullFlush())
+        return false;
+    m_info.crc = crc32_combine(m_info.crc, crc, size);
+    m_info.uncompressedSize += size;
+    return writeCompressed(deflatedData.constData(), deflatedData.size());
+}
+
+/*
+  Flush the deflate stream to a byte boundary and reset its history,
+  unless nothing has been written since the last time.
+ */
+bool ZipEntryDevice::fullFlush()
+{
+    if (m_flushed)
+        return m_ok;
+    m_flushed = true;
+    return deflateBuffer(Z_FULL_FLUSH);
+}
+
+/*
+  Flush the remaining data of the entry. Returns false on error.
+ */
+bool ZipEntryDevice::finish()
+{
+    if (!isOpen())
+        return m_ok;
+    if (m_ok && m_parallel && (!m_chunks.isEmpty() || !m_dictionary.isEmpty())) {
+        startChunk(true);
+    } else if (m_ok && m_info.method == 8) {
+        // Entries smaller than one chunk are deflated at once
+        if (m_parallel)
+            m_inBuffer = m_chunk;
+        deflateBuffer(Z_FINISH);
+    }
+    close();
+    if (!m_ok || m_deferred)
+        return m_ok;
+    if (m_streamed) {
+        m_writer->writeDataDescriptor(m_info);
+        return !m_writer->m_error;
+    }
+
+    // Go back and fill in the crc and sizes of the local file header. The
+    // sizes of zip64 entries are only found in the central directory.
+    QIODevice *device = m_writer->m_device;
+    const qint64 endPos = device->pos();
+    QByteArray data;
+    appendUInt32(data, m_info.crc);
+    appendUInt32(data, zip32(m_info.compressedSize));
+    appendUInt32(data, zip32(m_info.uncompressedSize));
+    if (!device->seek(m_info.headerOffset + 14) || device->write(data) != data.size()
+        || !device->seek(endPos)) {
+        m_ok = false;
+    }
+    return m_ok;
+}
+
 ZipWriter::ZipWriter(const QString &filePath)
+    : m_device(new QFile(filePath))
+    , m_ownDevice(true)
 {
-    m_writer = new QZipWriter(filePath, QIODevice::WriteOnly);
-    m_writer->setCompressionPolicy(QZipWriter::AutoCompress);
+    init();
+    if (!m_device->open(QIODevice::WriteOnly))
+        m_error = true;
 }
 
+/*
+  Write the archive to \a device, from its current position. Sequential
+  devices, such as sockets and pipes, are written with data descriptors,
+  the entries going out as soon as they are compressed.
+ */
 ZipWriter::ZipWriter(QIODevice *device)
+    : m_device(device)
+    , m_ownDevice(false)
+{
+    init();
+    if (!m_device || !m_device->isWritable()) {
+        m_error = true;
+    } else if (m_device->isSequential()) {
+        m_dataDescriptors = true;
+    } else {
+        m_offset = m_device->pos();
+    }
+}
+
+void ZipWriter::init()
 {
-    m_writer = new QZipWriter(device);
-    m_writer->setCompressionPolicy(QZipWriter::AutoCompress);
+    m_error = false;
+    m_closed = false;
+    m_offset = 0;
+    m_entry = 0;
+    m_progressMonitor = 0;
+    m_compressionLevel = Z_DEFAULT_COMPRESSION;
+    m_parallelDeflate = false;
+    m_dataDescriptors = false;
 }
 
 ZipWriter::~ZipWriter()
 {
-    delete m_writer;
+    close();
+    if (m_ownDevice)
+        delete m_device;
+}
+
+/*
+  Sets the zlib compression \a level of the entries, from 1 (fastest) to
+  9 (smallest), or -1 for the default level of zlib. Entries are stored
+  without compression when the level is 0.
+ */
+void ZipWriter::setCompressionLevel(int level)
+{
+    m_compressionLevel = level;
+}
+
+/*
+  Sets the compression \a level of the entry named \a path, or of all the
+  entries in the directory \a path when it ends with a slash. This takes
+  precedence over the level of the parent directories and the default one.
+ */
+void ZipWriter::setCompressionLevel(const QString &path, int level)
+{
+    m_compressionLevels[path] = level;
+}
+
+/*
+  Deflate the entries written through beginFile() in chunks on the global
+  thread pool when \a enable is true. Only the entries larger than one
+  chunk benefit from it, the smaller ones are deflated as usual.
+ */
+void ZipWriter::setParallelDeflateEnabled(bool enable)
+{
+    m_parallelDeflate = enable;
+}
+
+/*
+  Write the crc and the sizes of the deflated entries started by
+  beginFile() in a data descriptor after their data when \a enable is
+  true, instead of seeking back to their local file header. This is
+  always the case for sequential devices. The entries whose data is
+  known before it is written don't need one.
+ */
+void ZipWriter::setDataDescriptorsEnabled(bool enable)
+{
+    m_dataDescriptors = enable || (m_device && m_device->isSequential());
+}
+
+/*
+  Tell \a monitor about every entry written to the archive. The monitor
+  is not owned, and may be 0.
+ */
+void ZipWriter::setProgressMonitor(ProgressMonitor *monitor)
+{
+    m_progressMonitor = monitor;
+}
+
+/*
+  Returns the compression level which is used for the entry \a filePath.
+ */
+int ZipWriter::compressionLevel(const QString &filePath) const
+{
+    QHash<QString, int>::const_iterator it = m_compressionLevels.constFind(filePath);
+    if (it != m_compressionLevels.constEnd())
+        return it.value();
+    int slash = filePath.lastIndexOf(QLatin1Char('/'));
+    while (slash >= 0) {
+        it = m_compressionLevels.constFind(filePath.left(slash + 1));
+        if (it != m_compressionLevels.constEnd())
+            return it.value();
+        slash = slash > 0 ? filePath.lastIndexOf(QLatin1Char('/'), slash - 1) : -1;
+    }
+    return m_compressionLevel;
 }
 
 bool ZipWriter::error() const
 {
-    return m_writer->status() != QZipWriter::NoError;
+    return m_error;
+}
+
+bool ZipWriter::writeData(const char *data, qint64 size)
+{
+    if (m_error)
+        return false;
+    if (m_device->write(data, size) != size)
+        m_error = true;
+    m_offset += size;
+    return !m_error;
+}
+
+/*
+  Start a new entry named \a filePath, and return the device
+  which the contents of the entry should be written to. The
+  device is valid until endFile() is called.
+ */
+QIODevice *ZipWriter::beginFile(const QString &filePath)
+{
+    if (m_entry)
+        endFile();
+    m_entry = new ZipEntryDevice(filePath, this, compressionLevel(filePath));
+    return m_entry;
+}
+
+/*
+  Finish the entry started by beginFile().
+ */
+void ZipWriter::endFile()
+{
+    if (!m_entry)
+        return;
+
+    if (!m_entry->finish())
+        m_error = true;
+    else if (m_entry->isDeferred())
+        writeCompressedEntry(m_entry->info(), m_entry->compressedData());
+    else
+        appendEntry(m_entry->info());
+    delete m_entry;
+    m_entry = 0;
+}
+
+/*
+  Write the finished \a entry, which has been compressed to memory,
+  to the archive as \a filePath.
+ */
+void ZipWriter::addCompressedFile(const QString &filePath, const ZipEntryDevice *entry)
+{
+    ZipEntryInfo info = entry->info();
+    info.name = filePath.toUtf8();
+    writeCompressedEntry(info, entry->compressedData());
+}
+
+/*
+  Write \a deflatedData, the raw deflated contents of a file copied from
+  another archive, as \a filePath. Its \a crc and \a uncompressedSize
+  are those recorded by the source archive.
+ */
+void ZipWriter::addRawFile(const QString &filePath, const QByteArray &deflatedData, quint32 crc,
+                           qint64 uncompressedSize)
+{
+    ZipEntryInfo info;
+    info.name = filePath.toUtf8();
+    info.method = 8;
+    info.dosTime = currentDosTime();
+    info.crc = crc;
+    info.compressedSize = deflatedData.size();
+    info.uncompressedSize = uncompressedSize;
+    info.headerOffset = 0;
+    info.dataDescriptor = false;
+    writeCompressedEntry(info, deflatedData);
+}
+
+/*
+  Returns the uncompressed size of the last file written to the archive.
+ */
+qint64 ZipWriter::lastFileSize() const
+{
+    return m_entries.isEmpty() ? 0 : m_entries.last().uncompressedSize;
+}
+
+void ZipWriter::writeCompressedEntry(ZipEntryInfo info, const QByteArray &data)
+{
+    info.headerOffset = m_offset;
+    info.dataDescriptor = false;
+    writeLocalFileHeader(info);
+    if (writeData(data.constData(), data.size()))
+        appendEntry(info);
+}
+
+/*
+  Record the written entry \a info, and tell the progress monitor.
+ */
+void ZipWriter::appendEntry(const ZipEntryInfo &info)
+{
+    m_entries.append(info);
+    if (m_progressMonitor) {
+        m_progressMonitor->partDone(QString::fromUtf8(info.name), m_entries.size());
+        m_progressMonitor->bytesWritten(m_offset);
+    }
 }
 
 void ZipWriter::addFile(const QString &filePath, QIODevice *device)
 {
-    m_writer->addFile(filePath, device);
+    QIODevice *entry = beginFile(filePath);
+    bool opened = false;
+    if (!device->isOpen())
+        opened = device->open(QIODevice::ReadOnly);
+    while (!device->atEnd()) {
+        const QByteArray data = device->read(ZIP_BUFFER_SIZE);
+        if (data.isEmpty())
+            break;
+        entry->write(data);
+    }
+    if (opened)
+        device->close();
+    endFile();
 }
 
 void ZipWriter::addFile(const QString &filePath, const QByteArray &data)
 {
-    m_writer->addFile(filePath, data);
+    beginFile(filePath)->write(data);
+    endFile();
+}
+
+/*
+  Write the local file header of the entry \a info. A zip64 extra field
+  is only written for the entries whose sizes are known, and too large.
+ */
+void ZipWriter::writeLocalFileHeader(const ZipEntryInfo &info)
+{
+    const bool zip64 = !info.dataDescriptor
+        && (info.compressedSize >= ZIP64_LIMIT || info.uncompressedSize >= ZIP64_LIMIT);
+    QByteArray header;
+    header.reserve(30 + info.name.size() + 20);
+    appendUInt32(header, 0x04034b50); // signature
+    appendUInt16(header, zip64 ? 45 : 20); // version needed to extract
+    // general purpose flag: utf8 encoded names, and data descriptor
+    appendUInt16(header, info.dataDescriptor ? 0x0808 : 0x0800);
+    appendUInt16(header, info.method); // compression method
+    appendUInt32(header, info.dosTime);
+    appendUInt32(header, info.crc);
+    appendUInt32(header, zip64 ? quint32(ZIP64_LIMIT) : quint32(info.compressedSize));
+    appendUInt32(header, zip64 ? quint32(ZIP64_LIMIT) : quint32(info.uncompressedSize));
+    appendUInt16(header, info.name.size());
+    appendUInt16(header, zip64 ? 20 : 0); // extra field length
+    header.append(info.name);
+    if (zip64) {
+        appendUInt16(header, 0x0001);
+        appendUInt16(header, 16);
+        appendUInt64(header, info.uncompressedSize);
+        appendUInt64(header, info.compressedSize);
+    }
+    writeData(header.constData(), header.size());
+}
+
+/*
+  Write the data descriptor which follows the data of the entry \a info.
+  The sizes take 8 bytes each when either doesn't fit in 4 bytes.
+ */
+void ZipWriter::writeDataDescriptor(const ZipEntryInfo &info)
+{
+    QByteArray data;
+    appendUInt32(data, 0x08074b50); // signature
+    appendUInt32(data, info.crc);
+    if (info.compressedSize >= ZIP64_LIMIT || info.uncompressedSize >= ZIP64_LIMIT) {
+        appendUInt64(data, info.compressedSize);
+        appendUInt64(data, info.uncompressedSize);
+    } else {
+        appendUInt32(data, info.compressedSize);
+        appendUInt32(data, info.uncompressedSize);
+    }
+    writeData(data.constData(), data.size());
+}
+
+/*
+  Write the central directory, and the end of central directory record.
+  The sizes and the offsets which don't fit in 4 bytes go to zip64 extra
+  fields, and the zip64 end of central directory record is added when
+  there are too many entries or the directory starts too far.
+ */
+void ZipWriter::writeCentralDirectory()
+{
+    const qint64 offset = m_offset;
+    QByteArray data;
+    foreach (const ZipEntryInfo &info, m_entries) {
+        QByteArray extra;
+        if (info.uncompressedSize >= ZIP64_LIMIT)
+            appendUInt64(extra, info.uncompressedSize);
+        if (info.compressedSize >= ZIP64_LIMIT)
+            appendUInt64(extra, info.compressedSize);
+        if (info.headerOffset >= ZIP64_LIMIT)
+            appendUInt64(extra, info.headerOffset);
+        const int version = extra.isEmpty() ? 20 : 45;
+
+        appendUInt32(data, 0x02014b50); // signature
+        appendUInt16(data, (3 << 8) | version); // version made by: unix
+        appendUInt16(data, version); // version needed to extract
+        appendUInt16(data, info.dataDescriptor ? 0x0808 : 0x0800); // general purpose flag
+        appendUInt16(data, info.method); // compression method
+        appendUInt32(data, info.dosTime);
+        appendUInt32(data, info.crc);
+        appendUInt32(data, zip32(info.compressedSize));
+        appendUInt32(data, zip32(info.uncompressedSize));
+        appendUInt16(data, info.name.size());
+        appendUInt16(data, extra.isEmpty() ? 0 : extra.size() + 4); // extra field length
+        appendUInt16(data, 0); // file comment length
+        appendUInt16(data, 0); // disk number start
+        appendUInt16(data, 0); // internal file attributes
+        appendUInt32(data, 0100644u << 16); // external file attributes
+        appendUInt32(data, zip32(info.headerOffset));
+        data.append(info.name);
+        if (!extra.isEmpty()) {
+            appendUInt16(data, 0x0001);
+            appendUInt16(data, extra.size());
+            data.append(extra);
+        }
+    }
+    const qint64 size = data.size();
+    const int entries = m_entries.size();
+
+    if (entries >= 0xffff || size >= ZIP64_LIMIT || offset >= ZIP64_LIMIT) {
+        // Zip64 end of central directory record, and its locator
+        appendUInt32(data, 0x06064b50);
+        appendUInt64(data, 44); // size of the rest of the record
+        appendUInt16(data, (3 << 8) | 45); // version made by: unix
+        appendUInt16(data, 45); // version needed to extract
+        appendUInt32(data, 0); // number of this disk
+        appendUInt32(data, 0); // disk where central directory starts
+        appendUInt64(data, entries);
+        appendUInt64(data, entries);
+        appendUInt64(data, size);
+        appendUInt64(data, offset);
+        appendUInt32(data, 0x07064b50);
+        appendUInt32(data, 0); // disk of the zip64 end of central directory record
+        appendUInt64(data, offset + size);
+        appendUInt32(data, 1); // total number of disks
+    }
+
+    // End of central directory record
+    appendUInt32(data, 0x06054b50);
+    appendUInt16(data, 0); // number of this disk
+    appendUInt16(data, 0); // disk where central directory starts
+    appendUInt16(data, qMin(entries, 0xffff));
+    appendUInt16(data, qMin(entries, 0xffff));
+    appendUInt32(data, zip32(size));
+    appendUInt32(data, zip32(offset));
+    appendUInt16(data, 0); // comment length
+    writeData(data.constData(), data.size());
 }
 
 void ZipWriter::close()
 {
-    m_writer->close();
+    if (m_closed)
+        return;
+    m_closed = true;
+
+    endFile();
+    if (m_device && !m_error)
+        writeCentralDirectory();
+    if (m_ownDevice)
+        m_device->close();
 }
 
 } // namespace QXlsx
@@ -36,13 +36,88 @@
 // We mean it.
 //
 
+#include "xlsxglobal.h"
 #include <QString>
-class QIODevice;
-class QZipWriter;
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QIODevice>
+struct z_stream_s;
 
 namespace QXlsx {
 
-class ZipWriter
+class ZipWriter;
+class ZipDeflateChunk;
+class ProgressMonitor;
+
+struct ZipEntryInfo
+{
+    QByteArray name;
+    quint16 method; // 0 when stored, 8 when deflated
+    quint32 dosTime;
+    quint32 crc;
+    qint64 compressedSize;
+    qint64 uncompressedSize;
+    qint64 headerOffset;
+    bool dataDescriptor; // the crc and sizes follow the data
+};
+
+class XLSX_AUTOTEST_EXPORT ZipEntryDevice : public QIODevice
+{
+public:
+    explicit ZipEntryDevice(const QString &filePath = QString(), ZipWriter *writer = 0,
+                            int compressionLevel = -1);
+    ~ZipEntryDevice();
+
+    bool isSequential() const;
+    bool finish();
+    bool isDeferred() const;
+    QByteArray compressedData() const;
+    ZipEntryInfo info() const;
+    int compressionLevel() const { return m_level; }
+
+    bool canWriteSegments() const;
+    bool beginSegment();
+    bool endSegment(QByteArray *deflatedData, quint32 *crc, qint64 *size);
+    bool writeSegment(const QByteArray &deflatedData, quint32 crc, qint64 size);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 len);
+
+private:
+    bool deflateBuffer(int flush);
+    bool writeCompressed(const char *data, qint64 size);
+    bool startChunk(bool last);
+    bool writeChunk();
+    bool fullFlush();
+
+    ZipWriter *m_writer;
+    z_stream_s *m_stream;
+    ZipEntryInfo m_info;
+    QByteArray m_inBuffer;
+    QByteArray m_outBuffer;
+    QByteArray m_pending;
+    bool m_deferred;
+    bool m_streamed; // followed by a data descriptor, see finish()
+    bool m_ok;
+
+    // Parallel deflate, see startChunk()
+    int m_level;
+    bool m_parallel;
+    QByteArray m_chunk;
+    QByteArray m_dictionary;
+    QList<ZipDeflateChunk *> m_chunks;
+
+    // Segments, see beginSegment()
+    bool m_flushed; // nothing has been written since the last full flush
+    bool m_recording;
+    QByteArray m_segment;
+    quint32 m_segmentCrc;
+    qint64 m_segmentSize;
+};
+
+class XLSX_AUTOTEST_EXPORT ZipWriter
 {
 public:
     explicit ZipWriter(const QString &filePath);
@@ -51,11 +126,46 @@ public:
 
     void addFile(const QString &filePath, QIODevice *device);
     void addFile(const QString &filePath, const QByteArray &data);
+    QIODevice *beginFile(const QString &filePath);
+    void endFile();
+    void addCompressedFile(const QString &filePath, const ZipEntryDevice *entry);
+    void addRawFile(const QString &filePath, const QByteArray &deflatedData, quint32 crc,
+                    qint64 uncompressedSize);
+    qint64 lastFileSize() const;
+    void setCompressionLevel(int level);
+    void setCompressionLevel(const QString &path, int level);
+    int compressionLevel(const QString &filePath) const;
+    void setParallelDeflateEnabled(bool enable);
+    void setDataDescriptorsEnabled(bool enable);
+    void setProgressMonitor(ProgressMonitor *monitor);
     bool error() const;
     void close();
 
 private:
-    QZipWriter *m_writer;
+    Q_DISABLE_COPY(ZipWriter)
+    friend class ZipEntryDevice;
+
+    void init();
+    bool writeData(const char *data, qint64 size);
+    void writeLocalFileHeader(const ZipEntryInfo &info);
+    void writeDataDescriptor(const ZipEntryInfo &info);
+    void writeCompressedEntry(ZipEntryInfo info, const QByteArray &data);
+    void appendEntry(const ZipEntryInfo &info);
+    void writeCentralDirectory();
+
+    QIODevice *m_device;
+    bool m_ownDevice;
+    bool m_error;
+    bool m_closed;
+    qint64 m_offset; // of the next bytes in the archive
+    QList<ZipEntryInfo> m_entries;
+    ZipEntryDevice *m_entry;
+    int m_compressionLevel;
+    bool m_parallelDeflate;
+    bool m_dataDescriptors;
+    QHash<QString, int> m_compressionLevels; // by file or directory path
+    ProgressMonitor *m_progressMonitor;
+
 };
 
 } // namespace QXlsx
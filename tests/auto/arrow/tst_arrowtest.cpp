@@ -0,0 +1,243 @@
+#include "xlsxarrow.h"
+#include "xlsxworksheet.h"
+#include "xlsxcell.h"
+#include "xlsxformat.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class ArrowTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    ArrowTest();
+
+private Q_SLOTS:
+    void testWriteArray();
+    void testWriteDictionary();
+    void testWriteRecordBatch();
+    void testReadArray();
+    void testReadRecordBatch();
+};
+
+ArrowTest::ArrowTest()
+{
+}
+
+static void noRelease(ArrowSchema *schema)
+{
+    schema->release = 0;
+}
+
+static void noRelease(ArrowArray *array)
+{
+    array->release = 0;
+}
+
+static ArrowSchema makeSchema(const char *format, const char *name = "")
+{
+    ArrowSchema schema = { format, name, 0, ARROW_FLAG_NULLABLE, 0, 0, 0, noRelease, 0 };
+    return schema;
+}
+
+static ArrowArray makeArray(int64_t length, int64_t nullCount, int64_t bufferCount,
+                            const void **buffers)
+{
+    ArrowArray array = { length, nullCount, 0, bufferCount, 0, buffers, 0, 0, noRelease, 0 };
+    return array;
+}
+
+void ArrowTest::testWriteArray()
+{
+    Worksheet sheet("", 1, 0, Worksheet::F_NewFromScratch);
+
+    const double numbers[] = { 1.5, 0, 3 };
+    const uchar validity[] = { 0x5 };
+    const void *numberBuffers[] = { validity, numbers };
+    ArrowSchema numberSchema = makeSchema("g");
+    ArrowArray numberArray = makeArray(3, 1, 2, numberBuffers);
+    QVERIFY(ArrowBridge::writeArray(&sheet, 1, 1, &numberSchema, &numberArray));
+    QCOMPARE(sheet.read(1, 1).toDouble(), 1.5);
+    QVERIFY(!sheet.read(2, 1).isValid());
+    QCOMPARE(sheet.read(3, 1).toDouble(), 3.0);
+
+    const qint32 offsets[] = { 0, 5, 5, 10 };
+    const char text[] = "HelloWorld";
+    const void *stringBuffers[] = { 0, offsets, text };
+    ArrowSchema stringSchema = makeSchema("u");
+    ArrowArray stringArray = makeArray(3, 0, 3, stringBuffers);
+    QVERIFY(ArrowBridge::writeArray(&sheet, 1, 2, &stringSchema, &stringArray));
+    QCOMPARE(sheet.read(1, 2).toString(), QString("Hello"));
+    QCOMPARE(sheet.read(2, 2).toString(), QString());
+    QCOMPARE(sheet.read(3, 2).toString(), QString("World"));
+
+    // 2014-07-15 and 2014-07-15T18:00
+    const qint32 days[] = { 16266 };
+    const void *dayBuffers[] = { 0, days };
+    ArrowSchema daySchema = makeSchema("tdD");
+    ArrowArray dayArray = makeArray(1, 0, 2, dayBuffers);
+    QVERIFY(ArrowBridge::writeArray(&sheet, 1, 3, &daySchema, &dayArray));
+    QCOMPARE(sheet.read(1, 3), QVariant(QDate(2014, 7, 15)));
+
+    const qint64 seconds[] = { Q_INT64_C(1405447200) };
+    const void *secondBuffers[] = { 0, seconds };
+    ArrowSchema timestampSchema = makeSchema("tss:UTC");
+    ArrowArray timestampArray = makeArray(1, 0, 2, secondBuffers);
+    QVERIFY(ArrowBridge::writeArray(&sheet, 2, 3, &timestampSchema, &timestampArray));
+    QCOMPARE(sheet.cellAt(2, 3)->value().toDouble(), 41835.75);
+    QVERIFY(sheet.cellAt(2, 3)->isDateTime());
+
+    const uchar bits[] = { 0x2 };
+    const void *boolBuffers[] = { 0, bits };
+    ArrowSchema boolSchema = makeSchema("b");
+    ArrowArray boolArray = makeArray(2, 0, 2, boolBuffers);
+    QVERIFY(ArrowBridge::writeArray(&sheet, 1, 4, &boolSchema, &boolArray));
+    QCOMPARE(sheet.read(1, 4), QVariant(false));
+    QCOMPARE(sheet.read(2, 4), QVariant(true));
+
+    ArrowSchema listSchema = makeSchema("+l");
+    QVERIFY(!ArrowBridge::writeArray(&sheet, 1, 5, &listSchema, &boolArray));
+    QVERIFY(!ArrowBridge::writeArray(&sheet, 0, 5, &boolSchema, &boolArray));
+}
+
+void ArrowTest::testWriteDictionary()
+{
+    Worksheet sheet("", 1, 0, Worksheet::F_NewFromScratch);
+
+    const qint32 offsets[] = { 0, 3, 6 };
+    const char text[] = "redblue";
+    const void *dictionaryBuffers[] = { 0, offsets, text };
+    ArrowSchema dictionarySchema = makeSchema("u");
+    ArrowArray dictionaryArray = makeArray(2, 0, 3, dictionaryBuffers);
+
+    const qint8 indexes[] = { 1, 0, 1, 1 };
+    const void *indexBuffers[] = { 0, indexes };
+    ArrowSchema schema = makeSchema("c");
+    schema.dictionary = &dictionarySchema;
+    ArrowArray array = makeArray(4, 0, 2, indexBuffers);
+    array.dictionary = &dictionaryArray;
+
+    QVERIFY(ArrowBridge::writeArray(&sheet, 1, 1, &schema, &array));
+    QCOMPARE(sheet.read(1, 1).toString(), QString("blue"));
+    QCOMPARE(sheet.read(2, 1).toString(), QString("red"));
+    QCOMPARE(sheet.cellAt(4, 1)->value().toString(), QString("blue"));
+}
+
+void ArrowTest::testWriteRecordBatch()
+{
+    Worksheet sheet("", 1, 0, Worksheet::F_NewFromScratch);
+
+    const qint32 ids[] = { 1, 2, 3 };
+    const double prices[] = { 9.5, 10, 12.25 };
+    const void *idBuffers[] = { 0, ids };
+    const void *priceBuffers[] = { 0, prices };
+    ArrowSchema idSchema = makeSchema("i", "id");
+    ArrowSchema priceSchema = makeSchema("g", "price");
+    ArrowArray idArray = makeArray(3, 0, 2, idBuffers);
+    ArrowArray priceArray = makeArray(3, 0, 2, priceBuffers);
+
+    ArrowSchema *childSchemas[] = { &idSchema, &priceSchema };
+    ArrowArray *children[] = { &idArray, &priceArray };
+    const void *structBuffers[] = { 0 };
+    ArrowSchema schema = makeSchema("+s");
+    schema.n_children = 2;
+    schema.children = childSchemas;
+    ArrowArray array = makeArray(2, 0, 1, structBuffers);
+    array.offset = 1;
+    array.n_children = 2;
+    array.children = children;
+
+    QVERIFY(ArrowBridge::writeRecordBatch(&sheet, 1, 1, &schema, &array));
+    QCOMPARE(sheet.read(1, 1).toString(), QString("id"));
+    QCOMPARE(sheet.read(1, 2).toString(), QString("price"));
+    QCOMPARE(sheet.read(2, 1).toDouble(), 2.0);
+    QCOMPARE(sheet.read(3, 2).toDouble(), 12.25);
+    QCOMPARE(sheet.dimension(), CellRange("A1:B3"));
+}
+
+void ArrowTest::testReadArray()
+{
+    Worksheet sheet("", 1, 0, Worksheet::F_NewFromScratch);
+    sheet.write(1, 1, 1.5);
+    sheet.write(3, 1, 4);
+    sheet.write(1, 2, "red");
+    sheet.write(2, 2, "blue");
+    sheet.write(3, 2, "red");
+    sheet.write(4, 2, 7);
+    sheet.write(1, 3, QDate(2014, 7, 15));
+
+    ArrowSchema schema;
+    ArrowArray array;
+    QVERIFY(ArrowBridge::readArray(&sheet, 1, 1, 3, &schema, &array));
+    QCOMPARE(QByteArray(schema.format), QByteArray("g"));
+    QCOMPARE(QByteArray(schema.name), QByteArray("A"));
+    QCOMPARE(array.length, int64_t(3));
+    QCOMPARE(array.null_count, int64_t(1));
+    const uchar *validity = static_cast<const uchar *>(array.buffers[0]);
+    QCOMPARE(int(validity[0]), 0x5);
+    const double *numbers = static_cast<const double *>(array.buffers[1]);
+    QCOMPARE(numbers[0], 1.5);
+    QCOMPARE(numbers[2], 4.0);
+    array.release(&array);
+    schema.release(&schema);
+    QVERIFY(!array.release);
+    QVERIFY(!schema.release);
+
+    // One dictionary entry for each string
+    QVERIFY(ArrowBridge::readArray(&sheet, 2, 1, 4, &schema, &array));
+    QCOMPARE(QByteArray(schema.format), QByteArray("i"));
+    QCOMPARE(QByteArray(schema.dictionary->format), QByteArray("u"));
+    QCOMPARE(array.null_count, int64_t(0));
+    const qint32 *indexes = static_cast<const qint32 *>(array.buffers[1]);
+    QCOMPARE(indexes[0], 0);
+    QCOMPARE(indexes[1], 1);
+    QCOMPARE(indexes[2], 0);
+    QCOMPARE(indexes[3], 2);
+    const ArrowArray *dictionary = array.dictionary;
+    QCOMPARE(dictionary->length, int64_t(3));
+    const qint32 *offsets = static_cast<const qint32 *>(dictionary->buffers[1]);
+    const char *text = static_cast<const char *>(dictionary->buffers[2]);
+    QCOMPARE(QByteArray(text, offsets[3]), QByteArray("redblue7"));
+    array.release(&array);
+    schema.release(&schema);
+
+    QVERIFY(ArrowBridge::readArray(&sheet, 3, 1, 1, &schema, &array));
+    QCOMPARE(QByteArray(schema.format), QByteArray("tsm:"));
+    QCOMPARE(static_cast<const qint64 *>(array.buffers[1])[0], Q_INT64_C(1405382400000));
+    array.release(&array);
+    schema.release(&schema);
+
+    QVERIFY(!ArrowBridge::readArray(&sheet, 0, 1, 1, &schema, &array));
+    QVERIFY(!ArrowBridge::readArray(&sheet, 1, 2, 1, &schema, &array));
+}
+
+void ArrowTest::testReadRecordBatch()
+{
+    Worksheet sheet("", 1, 0, Worksheet::F_NewFromScratch);
+    sheet.write(1, 1, "id");
+    sheet.write(1, 2, "done");
+    sheet.write(2, 1, 1);
+    sheet.write(3, 1, 2);
+    sheet.write(2, 2, true);
+
+    ArrowSchema schema;
+    ArrowArray array;
+    QVERIFY(ArrowBridge::readRecordBatch(&sheet, CellRange("A1:C3"), &schema, &array));
+    QCOMPARE(QByteArray(schema.format), QByteArray("+s"));
+    QCOMPARE(schema.n_children, int64_t(3));
+    QCOMPARE(array.length, int64_t(2));
+    QCOMPARE(QByteArray(schema.children[0]->name), QByteArray("id"));
+    QCOMPARE(QByteArray(schema.children[1]->name), QByteArray("done"));
+    QCOMPARE(QByteArray(schema.children[1]->format), QByteArray("b"));
+    QCOMPARE(QByteArray(schema.children[2]->name), QByteArray("C"));
+    QCOMPARE(array.children[2]->null_count, int64_t(2));
+    QCOMPARE(static_cast<const double *>(array.children[0]->buffers[1])[1], 2.0);
+    array.release(&array);
+    schema.release(&schema);
+}
+
+QTEST_APPLESS_MAIN(ArrowTest)
+
+#include "tst_arrowtest.moc"
@@ -13,4 +13,19 @@ SUBDIRS=\
     richstring \
     xlsxconditionalformatting \
     cellreference \
+    celltable \
+    cellrangeindex \
+    cellrangeset \
+    pixelaxis \
+    sheetdatawriter \
+    xmlpullparser \
+    encryption \
+    numformatter \
+    sheetreader \
+    sheetappender \
+    sheetmodel \
+    sheettemplate \
+    formulaengine \
     cmake
+
+xlsx_arrow: SUBDIRS += arrow
@@ -0,0 +1,114 @@
+#include "private/xlsxcellrangeindex_p.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class CellRangeIndexTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    CellRangeIndexTest();
+
+private Q_SLOTS:
+    void testValuesAt();
+    void testIntersecting();
+    void testTallRanges();
+    void testManyRanges();
+    void testRemove();
+};
+
+CellRangeIndexTest::CellRangeIndexTest()
+{
+}
+
+void CellRangeIndexTest::testValuesAt()
+{
+    CellRangeIndex index;
+    QVERIFY(index.isEmpty());
+    index.insert(CellRange("B2:C3"), 0);
+    index.insert(CellRange("C3:D40"), 1);
+    index.insert(CellRange(), 2);
+    QCOMPARE(index.size(), 2);
+
+    QCOMPARE(index.valuesAt(2, 2), QList<int>() << 0);
+    QCOMPARE(index.valuesAt(3, 3), QList<int>() << 0 << 1);
+    QCOMPARE(index.valuesAt(40, 4), QList<int>() << 1);
+    QVERIFY(index.valuesAt(1, 1).isEmpty());
+    QVERIFY(index.valuesAt(41, 4).isEmpty());
+
+    index.clear();
+    QVERIFY(index.isEmpty());
+    QVERIFY(index.valuesAt(3, 3).isEmpty());
+}
+
+void CellRangeIndexTest::testIntersecting()
+{
+    CellRangeIndex index;
+    index.insert(CellRange("A1:B100"), 0);
+    index.insert(CellRange("D10:E12"), 1);
+    index.insert(CellRange("A200:C200"), 2);
+
+    // Each range is found once, whatever the blocks it spans
+    QCOMPARE(index.intersecting(CellRange("A1:Z300")), QList<int>() << 0 << 1 << 2);
+    QCOMPARE(index.intersecting(CellRange("B50:D11")), QList<int>());
+    QCOMPARE(index.intersecting(CellRange("B11:D50")), QList<int>() << 0 << 1);
+    QVERIFY(index.intersects(CellRange("C200:C300")));
+    QVERIFY(!index.intersects(CellRange("C1:C199")));
+    QVERIFY(!index.intersects(CellRange()));
+
+    // A value stored with several ranges is returned once
+    index.insert(CellRange("C1:C5"), 2);
+    QCOMPARE(index.intersecting(CellRange("A1:C300")), QList<int>() << 0 << 2);
+}
+
+void CellRangeIndexTest::testTallRanges()
+{
+    CellRangeIndex index;
+    index.insert(CellRange("B1:B1048576"), 0);
+    index.insert(CellRange("A5000:C5000"), 1);
+
+    QCOMPARE(index.valuesAt(5000, 2), QList<int>() << 0 << 1);
+    QCOMPARE(index.valuesAt(900000, 2), QList<int>() << 0);
+    QVERIFY(index.valuesAt(900000, 3).isEmpty());
+    QCOMPARE(index.intersecting(CellRange("C1:C1048576")), QList<int>() << 1);
+}
+
+void CellRangeIndexTest::testManyRanges()
+{
+    CellRangeIndex index;
+    for (int i = 0; i < 50000; ++i)
+        index.insert(CellRange(i * 2 + 1, 1, i * 2 + 2, 2), i);
+
+    QCOMPARE(index.valuesAt(1, 1), QList<int>() << 0);
+    QCOMPARE(index.valuesAt(100000, 2), QList<int>() << 49999);
+    QCOMPARE(index.intersecting(CellRange("B4:C7")), QList<int>() << 1 << 2 << 3);
+    QVERIFY(!index.intersects(CellRange("C1:C100000")));
+}
+
+void CellRangeIndexTest::testRemove()
+{
+    CellRangeIndex index;
+    index.insert(CellRange("A1:B40"), 0);
+    index.insert(CellRange("B2:C3"), 1);
+    index.insert(CellRange("D1:D1048576"), 2);
+
+    QVERIFY(!index.remove(CellRange("A1:B40"), 1));
+    QVERIFY(index.remove(CellRange("A1:B40"), 0));
+    QVERIFY(!index.remove(CellRange("A1:B40"), 0));
+    QCOMPARE(index.size(), 2);
+    QCOMPARE(index.valuesAt(2, 2), QList<int>() << 1);
+    QVERIFY(index.valuesAt(40, 1).isEmpty());
+
+    QCOMPARE(index.valuesAt(500000, 4), QList<int>() << 2);
+
+    QVERIFY(index.remove(CellRange("D1:D1048576"), 2));
+    QVERIFY(index.remove(CellRange("B2:C3"), 1));
+    QVERIFY(index.isEmpty());
+    QVERIFY(!index.intersects(CellRange("A1:Z100")));
+}
+
+QTEST_APPLESS_MAIN(CellRangeIndexTest)
+
+#include "tst_cellrangeindextest.moc"
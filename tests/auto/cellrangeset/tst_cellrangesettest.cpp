@@ -0,0 +1,74 @@
+#include "private/xlsxcellrangeset_p.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class CellRangeSetTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    CellRangeSetTest();
+
+private Q_SLOTS:
+    void testAdd();
+    void testCoalesced();
+    void testFirstRangeKept();
+};
+
+CellRangeSetTest::CellRangeSetTest()
+{
+}
+
+void CellRangeSetTest::testAdd()
+{
+    CellRangeSet set;
+    QVERIFY(set.isEmpty());
+    set.add(CellRange("A1"));
+    set.add(CellRange("A2"));
+    set.add(CellRange("A3:A5"));
+    set.add(CellRange("B1"));
+    set.add(CellRange("C1:D1"));
+    QCOMPARE(set.ranges(), QList<CellRange>() << CellRange("A1:A5") << CellRange("B1:D1"));
+}
+
+void CellRangeSetTest::testCoalesced()
+{
+    CellRangeSet set;
+    for (int column = 1; column <= 3; ++column) {
+        for (int row = 1; row <= 100; ++row)
+            set.add(CellRange(row, column, row, column));
+    }
+    QCOMPARE(set.ranges().size(), 3);
+    QCOMPARE(set.coalesced(), QList<CellRange>() << CellRange("A1:C100"));
+    QCOMPARE(set.toString(), QString("A1:C100"));
+
+    // Overlapping ranges
+    CellRangeSet overlapping(QList<CellRange>() << CellRange("A1:B2") << CellRange("B1:C2")
+                                                << CellRange("A3:C3"));
+    QCOMPARE(overlapping.toString(), QString("A1:C3"));
+
+    // Which would need more ranges than given
+    CellRangeSet stairs(QList<CellRange>() << CellRange("A1:B2") << CellRange("B2:C3"));
+    QCOMPARE(stairs.toString(), QString("A1:B2 B2:C3"));
+
+    QCOMPARE(CellRangeSet().toString(), QString());
+}
+
+void CellRangeSetTest::testFirstRangeKept()
+{
+    // Formulas are relative to the top left cell of the first range
+    CellRangeSet moved(QList<CellRange>() << CellRange("C5") << CellRange("A1")
+                                          << CellRange("A2"));
+    QCOMPARE(moved.toString(), QString("C5 A1:A2"));
+
+    CellRangeSet absorbed(QList<CellRange>() << CellRange("B2") << CellRange("A1:A3")
+                                             << CellRange("B1") << CellRange("B3"));
+    QCOMPARE(absorbed.coalesced().size(), 4);
+    QCOMPARE(absorbed.coalesced().first(), CellRange("B2"));
+}
+
+QTEST_APPLESS_MAIN(CellRangeSetTest)
+
+#include "tst_cellrangesettest.moc"
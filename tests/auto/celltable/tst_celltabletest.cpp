@@ -0,0 +1,358 @@
+#include "private/xlsxcelltable_p.h"
+#include "private/xlsxcell_p.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class CellTableTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    CellTableTest();
+
+private Q_SLOTS:
+    void testSetCell();
+    void testReplaceCell();
+    void testSetCells();
+    void testExtraData();
+    void testSqueeze();
+    void testRemoveRow();
+    void testShiftRows();
+    void testShiftColumns();
+    void testPermuteRows();
+    void testSpill();
+    void testCellPool();
+    void testBlockRevisions();
+};
+
+CellTableTest::CellTableTest()
+{
+}
+
+void CellTableTest::testSetCell()
+{
+    CellTable table;
+    QVERIFY(table.isEmpty());
+
+    table.setCell(5, 3, CellData::fromNumber(53, -1));
+    table.setCell(2, 7, CellData::fromNumber(27, -1));
+    table.setCell(5, 1, CellData::fromBool(true, 2));
+    table.setCell(9, 2, CellData::fromSharedString(4, -1));
+
+    QCOMPARE(table.size(), 3);
+    QCOMPARE(table.firstRow(), 2);
+    QCOMPARE(table.lastRow(), 9);
+    QCOMPARE(table.rowNumberAt(1), 5);
+    QVERIFY(table.contains(5));
+    QVERIFY(!table.contains(3));
+
+    const CellRow *row = table.row(5);
+    QVERIFY(row);
+    QCOMPARE(row->size(), 2);
+    QCOMPARE(row->firstColumn(), 1);
+    QCOMPARE(row->lastColumn(), 3);
+
+    QCOMPARE(table.cell(5, 3)->number, 53.0);
+    QCOMPARE(table.cell(5, 1)->type(), Cell::BooleanType);
+    QCOMPARE(table.cell(5, 1)->boolean, true);
+    QCOMPARE(table.cell(5, 1)->xfIndex, 2);
+    QCOMPARE(table.cell(9, 2)->index, 4);
+    QVERIFY(!table.cell(5, 2));
+    QVERIFY(!table.cell(6, 3));
+}
+
+void CellTableTest::testSetCells()
+{
+    CellTable table;
+    table.setCell(1, 2, CellData::fromNumber(12, -1));
+
+    CellData data[3];
+    for (int i = 0; i < 3; ++i)
+        data[i] = CellData::fromNumber(i, 1);
+
+    // Appended to the row
+    table.setCells(1, 4, data, 3);
+    // Overlapping the existing cells
+    table.setCells(1, 1, data, 3);
+    // New row
+    table.setCells(3, 2, data, 2);
+
+    const CellRow *row = table.row(1);
+    QVERIFY(row);
+    QCOMPARE(row->size(), 6);
+    QCOMPARE(row->firstColumn(), 1);
+    QCOMPARE(row->lastColumn(), 6);
+    QCOMPARE(table.cell(1, 2)->number, 1.0);
+    QCOMPARE(table.cell(1, 4)->number, 0.0);
+    QCOMPARE(table.cell(1, 6)->number, 2.0);
+    QCOMPARE(table.cell(1, 6)->xfIndex, 1);
+
+    QCOMPARE(table.size(), 2);
+    QCOMPARE(table.row(3)->size(), 2);
+    QCOMPARE(table.cell(3, 3)->number, 1.0);
+}
+
+void CellTableTest::testReplaceCell()
+{
+    CellTable table;
+    table.setCell(1, 1, CellData::fromNumber(1, -1));
+    table.setCell(1, 1, CellData::fromSharedString(0, 3));
+
+    QCOMPARE(table.size(), 1);
+    QCOMPARE(table.row(1)->size(), 1);
+    QCOMPARE(table.cell(1, 1)->type(), Cell::SharedStringType);
+    QCOMPARE(table.cell(1, 1)->xfIndex, 3);
+}
+
+void CellTableTest::testExtraData()
+{
+    CellTable table;
+    CellExtraData extra;
+    extra.value = QStringLiteral("#DIV/0!");
+    extra.formula = CellFormula(QStringLiteral("1/0"));
+    int idx = table.addExtra(extra);
+    table.setCell(1, 1, CellData::fromExtra(idx, Cell::ErrorType, -1));
+
+    const CellData *cell = table.cell(1, 1);
+    QCOMPARE(cell->type(), Cell::ErrorType);
+    QCOMPARE(table.extra(cell->index).value.toString(), QStringLiteral("#DIV/0!"));
+    QCOMPARE(table.extra(cell->index).formula, CellFormula(QStringLiteral("1/0")));
+
+    // The slot of the replaced cell is reused
+    table.setCell(1, 1, CellData::fromNumber(2, -1));
+    QVERIFY(!table.extra(idx).value.isValid());
+    CellExtraData extra2;
+    extra2.value = QStringLiteral("inline");
+    QCOMPARE(table.addExtra(extra2), idx);
+}
+
+void CellTableTest::testSqueeze()
+{
+    CellTable table;
+    for (int row = 1; row <= 4; ++row) {
+        CellExtraData extra;
+        extra.value = QStringLiteral("Inline %1").arg(row);
+        table.setCell(row, 1,
+                      CellData::fromExtra(table.addExtra(extra), Cell::InlineStringType, -1));
+    }
+    table.setCell(1, 1, CellData::fromNumber(1, -1));
+    table.removeRow(3);
+    QCOMPARE(table.extraCount(), 2);
+    const qint64 before = table.memoryUsage();
+
+    // The extra data is moved down over the released slots
+    table.squeeze();
+    QVERIFY(table.memoryUsage() < before);
+    QCOMPARE(table.extraCount(), 2);
+    QCOMPARE(table.cell(1, 1)->number, 1.0);
+    QCOMPARE(table.cell(2, 1)->index, 0);
+    QCOMPARE(table.extra(table.cell(2, 1)->index).value.toString(), QStringLiteral("Inline 2"));
+    QCOMPARE(table.extra(table.cell(4, 1)->index).value.toString(), QStringLiteral("Inline 4"));
+    QCOMPARE(table.addExtra(CellExtraData()), 2);
+}
+
+void CellTableTest::testRemoveRow()
+{
+    CellTable table;
+    for (int row = 1; row <= 10; ++row) {
+        for (int col = 1; col <= 5; ++col)
+            table.setCell(row, col, CellData::fromNumber(row * col, -1));
+    }
+    table.removeRow(1);
+    table.removeRow(5);
+    table.removeRow(20);
+
+    QCOMPARE(table.size(), 8);
+    QCOMPARE(table.firstRow(), 2);
+    QVERIFY(!table.cell(5, 1));
+    QCOMPARE(table.cell(6, 5)->number, 30.0);
+
+    table.clear();
+    QVERIFY(table.isEmpty());
+}
+
+void CellTableTest::testShiftRows()
+{
+    CellTable table;
+    for (int row = 1; row <= 10; ++row)
+        table.setCell(row * 2, 1, CellData::fromNumber(row, -1));
+
+    table.insertRows(5, 3);
+    QCOMPARE(table.size(), 10);
+    QCOMPARE(table.cell(4, 1)->number, 2.0);
+    QVERIFY(!table.cell(6, 1));
+    QCOMPARE(table.cell(9, 1)->number, 3.0);
+    QCOMPARE(table.lastRow(), 23);
+
+    // Rows 9 to 12 are gone, the extra data of their cells are released
+    CellExtraData extra;
+    extra.value = QStringLiteral("inline");
+    const int idx = table.addExtra(extra);
+    table.setCell(11, 2, CellData::fromExtra(idx, Cell::InlineStringType, -1));
+    table.removeRows(9, 4);
+    QCOMPARE(table.size(), 8);
+    QCOMPARE(table.cellCount(), qint64(8));
+    QCOMPARE(table.extraCount(), 0);
+    QCOMPARE(table.cell(9, 1)->number, 5.0);
+    QCOMPARE(table.lastRow(), 19);
+}
+
+void CellTableTest::testShiftColumns()
+{
+    CellTable table;
+    for (int col = 1; col <= 5; ++col) {
+        table.setCell(1, col, CellData::fromNumber(col, -1));
+        table.setCell(2, col + 2, CellData::fromNumber(col * 10, -1));
+    }
+
+    table.insertColumns(3, 2);
+    QCOMPARE(table.cell(1, 2)->number, 2.0);
+    QVERIFY(!table.cell(1, 3));
+    QCOMPARE(table.cell(1, 5)->number, 3.0);
+    QCOMPARE(table.cell(2, 7)->number, 30.0);
+
+    // The second row is left empty and removed
+    table.removeColumns(5, 10);
+    QCOMPARE(table.size(), 1);
+    QCOMPARE(table.cellCount(), qint64(2));
+    QCOMPARE(table.cell(1, 2)->number, 2.0);
+
+    table.removeColumns(1, 1);
+    QCOMPARE(table.cell(1, 1)->number, 2.0);
+}
+
+void CellTableTest::testPermuteRows()
+{
+    CellTable table;
+    for (int row = 1; row <= 3; ++row) {
+        table.setCell(row, 1, CellData::fromNumber(row, -1));
+        table.setCell(row, 2, CellData::fromNumber(row * 10, -1));
+        table.setCell(row, 5, CellData::fromNumber(row * 100, -1));
+    }
+    table.setCell(6, 5, CellData::fromNumber(600, -1));
+    const int extra = table.addExtra(CellExtraData());
+    table.setCell(1, 3, CellData::fromExtra(extra, Cell::InlineStringType, -1));
+
+    // Rows 2 and 4 are swapped in columns 1 to 3, row 4 has no cells there
+    QVector<int> order;
+    order << 0 << 3 << 2 << 1;
+    table.permuteRows(1, 1, 4, 3, order);
+    QCOMPARE(table.cellCount(), qint64(11));
+    QCOMPARE(table.cell(1, 3)->index, extra);
+    QVERIFY(!table.cell(2, 1));
+    QCOMPARE(table.cell(2, 5)->number, 200.0);
+    QCOMPARE(table.cell(3, 2)->number, 30.0);
+    QCOMPARE(table.cell(4, 1)->number, 2.0);
+    QCOMPARE(table.cell(4, 2)->number, 20.0);
+    QCOMPARE(table.row(4)->size(), 2);
+    QCOMPARE(table.cell(6, 5)->number, 600.0);
+
+    // The row left empty is removed
+    order.clear();
+    order << 1 << 0;
+    table.permuteRows(4, 1, 5, 3, order);
+    QVERIFY(!table.contains(4));
+    QCOMPARE(table.cell(5, 1)->number, 2.0);
+    QCOMPARE(table.cellCount(), qint64(11));
+}
+
+void CellTableTest::testSpill()
+{
+    const int rows = CellTable::SpillBlockRows * 3 + 10;
+    CellTable table;
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= 4; ++col)
+            table.setCell(row, col, CellData::fromNumber(row * 10 + col, col));
+    }
+    const qint64 before = table.memoryEstimate();
+
+    // The last block isn't finished
+    table.spill(rows);
+    QVERIFY(table.hasSpilledRows());
+    QVERIFY(table.memoryEstimate() < before);
+    QCOMPARE(table.cellCount(), qint64(rows) * 4);
+    QCOMPARE(table.size(), rows);
+
+    // Read back
+    QCOMPARE(table.cell(1, 1)->number, 11.0);
+    QCOMPARE(table.cell(CellTable::SpillBlockRows * 2 + 5, 4)->xfIndex, 4);
+    QCOMPARE(table.rowAt(CellTable::SpillBlockRows).size(), 4);
+    table.releaseRestoredBlocks();
+    QVERIFY(table.memoryEstimate() < before);
+
+    // Changed rows are kept in memory, and spilled again
+    table.setCell(2, 5, CellData::fromBool(true, -1));
+    table.removeRow(3);
+    QCOMPARE(table.cellCount(), qint64(rows) * 4 - 3);
+    table.spill(rows);
+    QCOMPARE(table.cell(2, 5)->type(), Cell::BooleanType);
+    QVERIFY(!table.contains(3));
+    QCOMPARE(table.cell(4, 2)->number, 42.0);
+
+    // Copies share the spilled rows
+    CellTable copy = table;
+    table.clear();
+    QVERIFY(copy.hasSpilledRows());
+    QCOMPARE(copy.cell(rows - CellTable::SpillBlockRows, 1)->number,
+             double((rows - CellTable::SpillBlockRows) * 10 + 1));
+    QCOMPARE(copy.cellCount(), qint64(rows) * 4 - 3);
+}
+
+void CellTableTest::testCellPool()
+{
+    CellPool pool;
+    QVector<Cell *> cells;
+    for (int i = 0; i < 600; ++i) {
+        Cell *cell = pool.create(0);
+        QVERIFY(cell);
+        QCOMPARE(cell->cellType(), Cell::NumberType);
+        QVERIFY(!cells.contains(cell));
+        cells.append(cell);
+    }
+
+    // Slots of destroyed cells are reused
+    Cell *cell = cells.takeAt(300);
+    pool.destroy(cell);
+    QCOMPARE(pool.create(0), cell);
+    // The live cells are destroyed with the pool
+}
+
+void CellTableTest::testBlockRevisions()
+{
+    CellTable table;
+    const CellTable &constTable = table;
+    table.setCell(1, 1, CellData::fromNumber(1, -1));
+    table.setCell(1500, 1, CellData::fromNumber(2, -1));
+    table.setCell(3000, 1, CellData::fromNumber(3, -1));
+    const quint64 first = table.blockRevision(0);
+    const quint64 second = table.blockRevision(1);
+    const quint64 third = table.blockRevision(2);
+    QCOMPARE(table.blockRevision(5), table.blockRevision(6));
+
+    // Reading doesn't change the blocks
+    QCOMPARE(constTable.cell(1500, 1)->number, 2.0);
+    QCOMPARE(constTable.rowAt(1).size(), 1);
+    QCOMPARE(table.blockRevision(1), second);
+
+    // Writing only changes the block of the row
+    table.setCell(1500, 2, CellData::fromNumber(4, -1));
+    QVERIFY(table.blockRevision(1) != second);
+    QCOMPARE(table.blockRevision(0), first);
+    QCOMPARE(table.blockRevision(2), third);
+
+    const quint64 changed = table.blockRevision(1);
+    table.removeCells(1, 1, 1024, 5);
+    QVERIFY(table.blockRevision(0) != first);
+    QCOMPARE(table.blockRevision(1), changed);
+
+    // Moving the rows changes all the blocks
+    table.insertRows(2000, 1);
+    QVERIFY(table.blockRevision(1) != changed);
+    QVERIFY(table.blockRevision(2) != third);
+}
+
+QTEST_APPLESS_MAIN(CellTableTest)
+
+#include "tst_celltabletest.moc"
@@ -2,11 +2,201 @@
 #include "xlsxcell.h"
 #include "xlsxformat.h"
 #include "xlsxcellformula.h"
+#include "xlsxworkbook.h"
+#include "xlsxchart.h"
+#include "xlsxdatavalidation.h"
+#include "xlsxdocumentbatch.h"
+#include "xlsxprofiler.h"
+#include "xlsxprogressmonitor.h"
+#include "xlsxrowwriter.h"
+#include "xlsxtypedrowwriter.h"
+#include "xlsxworksheet.h"
+#include <QBitArray>
 #include <QString>
 #include <QtTest>
+#include <QSignalSpy>
+#include <QImage>
+#include <QThread>
 
 QTXLSX_USE_NAMESPACE
 
+/*
+  A write-only device which can't be seeked, such as a socket.
+ */
+class SequentialWriter : public QIODevice
+{
+public:
+    SequentialWriter() { open(QIODevice::WriteOnly); }
+    bool isSequential() const { return true; }
+    QByteArray data;
+
+protected:
+    qint64 readData(char *, qint64) { return -1; }
+    qint64 writeData(const char *bytes, qint64 size)
+    {
+        data.append(bytes, int(size));
+        return size;
+    }
+};
+
+/*
+  Fills the rows of a RowWriter with numbers, strings and formulas.
+ */
+class FillRowsThread : public QThread
+{
+public:
+    explicit FillRowsThread(RowWriter *writer)
+        : writer(writer)
+    {
+    }
+
+    void run()
+    {
+        Format bold;
+        bold.setFontBold(true);
+        for (int row = writer->firstRow(); row <= writer->lastRow(); ++row) {
+            writer->write(row, 1, row);
+            writer->write(row, 2, QStringLiteral("Row %1").arg(row % 100), bold);
+            writer->write(row, 3, QStringLiteral("=A%1*2").arg(row));
+            writer->writeBool(row, 4, row % 2);
+        }
+    }
+
+    RowWriter *writer;
+};
+
+/*
+  The records written and read back by testRecords().
+ */
+struct Product
+{
+    Q_GADGET
+    Q_PROPERTY(QString name MEMBER name)
+    Q_PROPERTY(double price MEMBER price)
+    Q_PROPERTY(QDate released MEMBER released)
+    Q_PROPERTY(bool inStock MEMBER inStock)
+
+public:
+    Product()
+        : price(0)
+        , inStock(false)
+    {
+    }
+
+    QString name;
+    double price;
+    QDate released;
+    bool inStock;
+};
+
+class ProductObject : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString name MEMBER name)
+    Q_PROPERTY(int quantity MEMBER quantity)
+
+public:
+    QString name;
+    int quantity;
+};
+
+/*
+  Writes the index of the document, and refuses the document 3.
+ */
+class IndexFiller : public DocumentFiller
+{
+public:
+    bool fill(Document *document, int index)
+    {
+        Format bold;
+        bold.setFontBold(true);
+        document->write("B2", index, bold);
+        document->write("C2", QStringLiteral("Document %1").arg(index));
+        return index != 3;
+    }
+};
+
+/*
+  Records the phases reported by the document.
+ */
+class RecordingProfiler : public Profiler
+{
+public:
+    RecordingProfiler()
+        : depth(0)
+    {
+    }
+
+    void begin(Phase phase, const QString &partName)
+    {
+        begun.append(qMakePair(phase, partName));
+        ++depth;
+    }
+
+    void end(Phase phase, const QString &partName, qint64 bytes, qint64 elements)
+    {
+        --depth;
+        ended.append(qMakePair(phase, partName));
+        if (!partName.isEmpty()) {
+            this->bytes.insert(partName, bytes);
+            this->elements.insert(partName, elements);
+        }
+    }
+
+    int count(Phase phase) const
+    {
+        int n = 0;
+        for (int i = 0; i < ended.size(); ++i) {
+            if (ended[i].first == phase)
+                ++n;
+        }
+        return n;
+    }
+
+    QList<QPair<Phase, QString> > begun;
+    QList<QPair<Phase, QString> > ended;
+    QHash<QString, qint64> bytes;
+    QHash<QString, qint64> elements;
+    int depth;
+};
+
+/*
+  Records the progress reported by the document, and cancels once
+  cancelAfterRows rows of a sheet are done.
+ */
+class RecordingMonitor : public ProgressMonitor
+{
+public:
+    RecordingMonitor()
+        : cancelAfterRows(-1)
+        , rows(0)
+        , bytes(0)
+    {
+    }
+
+    void partDone(const QString &partName, int partsDone)
+    {
+        parts.append(partName);
+        QCOMPARE(partsDone, parts.size());
+    }
+
+    void rowsDone(const QString &sheetName, int rowsDone)
+    {
+        sheets.insert(sheetName);
+        rows = rowsDone;
+        if (cancelAfterRows >= 0 && rowsDone >= cancelAfterRows)
+            cancel();
+    }
+
+    void bytesWritten(qint64 bytes) { this->bytes = bytes; }
+
+    int cancelAfterRows;
+    QStringList parts;
+    QSet<QString> sheets;
+    int rows;
+    qint64 bytes;
+};
+
 class DocumentTest : public QObject
 {
     Q_OBJECT
@@ -28,6 +218,43 @@ private Q_SLOTS:
     void testMoveWorksheet();
     void testDeleteWorksheet();
     void testCopyWorksheet();
+
+    void testParallelSave();
+    void testParallelLoad();
+    void testLazyLoad();
+    void testRowBlockLoad();
+    void testSaveUnchangedParts();
+    void testTables();
+    void testComments();
+    void testCompression();
+    void testCompactStyles();
+    void testCompact();
+    void testInsertEncodedImage();
+    void testDeduplicateImages();
+    void testChartValueCache();
+    void testChartTemplate();
+    void testChartDownsampling();
+    void testInsertImages();
+    void testSheetLookup();
+    void testProfiler();
+    void testProgressMonitor();
+    void testSaveAsAsync();
+    void testOpenAsync();
+    void testStatistics();
+    void testMemoryBudget();
+    void testBinaryFormat();
+    void testReset();
+    void testDefinedNameRange();
+    void testIncrementalSave();
+    void testSequentialSave();
+    void testLoadFilter();
+    void testRowWriter();
+    void testDocumentBatch();
+    void testSnapshot();
+    void testTypedRowWriter();
+    void testRecords();
+    void testDisplayText();
+    void testDeferredDrawings();
 };
 
 DocumentTest::DocumentTest()
@@ -327,19 +554,33 @@ void DocumentTest::testCopyWorksheet()
     xlsx1.write("A1", "String");
     xlsx1.write("A2", 999);
     xlsx1.write("A3", true);
+    xlsx1.setRowHeight(2, 30);
+    DataValidation validation(DataValidation::Whole, DataValidation::Between, "1", "10");
+    validation.addRange(CellRange("B1:B5"));
+    xlsx1.addDataValidation(validation);
     xlsx1.addSheet();
     QCOMPARE(xlsx1.sheetNames(), QStringList()<<"Sheet1"<<"Sheet2"<<"Sheet3");
 
     xlsx1.copySheet("Sheet2");
     QCOMPARE(xlsx1.sheetNames(), QStringList()<<"Sheet1"<<"Sheet2"<<"Sheet3"<<"Sheet2(2)");
 
+    // Changing the copy leaves the original alone
+    xlsx1.selectSheet("Sheet2(2)");
+    xlsx1.write("A2", 1000);
+    xlsx1.setRowHeight(2, 40);
+    QCOMPARE(xlsx1.currentWorksheet()->dataValidationsAt(3, 2).size(), 1);
+    xlsx1.selectSheet("Sheet2");
+    QCOMPARE(xlsx1.read("A2").toInt(), 999);
+    QCOMPARE(xlsx1.rowHeight(2), 30.0);
+
     xlsx1.deleteSheet("Sheet2");
     QCOMPARE(xlsx1.sheetNames(), QStringList()<<"Sheet1"<<"Sheet3"<<"Sheet2(2)");
 
     xlsx1.selectSheet("Sheet2(2)");
     QCOMPARE(xlsx1.read("A1").toString(), QString("String"));
-    QCOMPARE(xlsx1.read("A2").toInt(), 999);
+    QCOMPARE(xlsx1.read("A2").toInt(), 1000);
     QCOMPARE(xlsx1.read("A3").toBool(), true);
+    QCOMPARE(xlsx1.rowHeight(2), 40.0);
 }
 
 void DocumentTest::testDeleteWorksheet()
@@ -360,6 +601,1503 @@ void DocumentTest::testDeleteWorksheet()
     QCOMPARE(xlsx1.sheetNames(), QStringList()<<"Sheet3");
 }
 
-QTEST_APPLESS_MAIN(DocumentTest)
+void DocumentTest::testParallelSave()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+
+    Document xlsx1;
+    xlsx1.setSaveOptions(Document::ParallelSave);
+    for (int i = 1; i <= 8; ++i) {
+        xlsx1.addSheet(QString("Sheet%1").arg(i));
+        for (int row = 1; row <= 100; ++row) {
+            xlsx1.write(row, 1, QString("Text %1").arg(row * i));
+            xlsx1.write(row, 2, row * i);
+        }
+    }
+    QVERIFY(xlsx1.saveAs(&device));
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    QCOMPARE(xlsx2.sheetNames().size(), 8);
+    xlsx2.selectSheet("Sheet5");
+    QCOMPARE(xlsx2.read("A100").toString(), QString("Text 500"));
+    QCOMPARE(xlsx2.read("B100").toInt(), 500);
+}
+
+void DocumentTest::testParallelLoad()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+
+    Document xlsx1;
+    for (int i = 1; i <= 8; ++i) {
+        xlsx1.addSheet(QString("Sheet%1").arg(i));
+        for (int row = 1; row <= 100; ++row) {
+            xlsx1.write(row, 1, QString("Text %1").arg(row * i));
+            xlsx1.write(row, 2, row * i);
+        }
+    }
+    xlsx1.saveAs(&device);
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device, Document::ParallelLoad);
+    QCOMPARE(xlsx2.sheetNames().size(), 8);
+    for (int i = 1; i <= 8; ++i) {
+        xlsx2.selectSheet(QString("Sheet%1").arg(i));
+        QCOMPARE(xlsx2.read("A100").toString(), QString("Text %1").arg(100 * i));
+        QCOMPARE(xlsx2.read("B100").toInt(), 100 * i);
+    }
+
+    //Shared strings must survive a round trip after a parallel load
+    QBuffer device2;
+    device2.open(QIODevice::WriteOnly);
+    xlsx2.saveAs(&device2);
+    device2.open(QIODevice::ReadOnly);
+    Document xlsx3(&device2);
+    xlsx3.selectSheet("Sheet8");
+    QCOMPARE(xlsx3.read("A1").toString(), QString("Text 8"));
+}
+
+void DocumentTest::testLazyLoad()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+
+    Document xlsx1;
+    xlsx1.write("A1", "Shared");
+    xlsx1.addSheet("Sheet2");
+    xlsx1.write("A1", "Shared");
+    xlsx1.write("A2", 2);
+    xlsx1.addSheet("Sheet3");
+    xlsx1.write("A1", "Shared");
+    xlsx1.write("A2", 3);
+    xlsx1.saveAs(&device);
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device, Document::LazyLoad);
+    QCOMPARE(xlsx2.sheetNames().size(), 3);
+    xlsx2.selectSheet("Sheet2");
+    QCOMPARE(xlsx2.read("A1").toString(), QString("Shared"));
+    QCOMPARE(xlsx2.read("A2").toInt(), 2);
+
+    //The string is still used by the sheets which are not loaded yet
+    xlsx2.write("A1", "Changed");
+    xlsx2.write("A3", "New");
+
+    QBuffer device2;
+    device2.open(QIODevice::WriteOnly);
+    xlsx2.saveAs(&device2);
+    device2.open(QIODevice::ReadOnly);
+    Document xlsx3(&device2);
+    xlsx3.selectSheet("Sheet1");
+    QCOMPARE(xlsx3.read("A1").toString(), QString("Shared"));
+    xlsx3.selectSheet("Sheet2");
+    QCOMPARE(xlsx3.read("A1").toString(), QString("Changed"));
+    QCOMPARE(xlsx3.read("A3").toString(), QString("New"));
+    xlsx3.selectSheet("Sheet3");
+    QCOMPARE(xlsx3.read("A1").toString(), QString("Shared"));
+    QCOMPARE(xlsx3.read("A2").toInt(), 3);
+}
+
+void DocumentTest::testRowBlockLoad()
+{
+    const int rows = 50000;
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    for (int row = 1; row <= rows; ++row) {
+        xlsx1.write(row, 1, row);
+        xlsx1.write(row, 2, QStringLiteral("Row %1").arg(row % 100));
+    }
+    xlsx1.saveAs(&device);
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device, Document::RowBlockLoad);
+    QCOMPARE(xlsx2.dimension(), CellRange(1, 1, rows, 2));
+    // Random reads, over more blocks than are kept in memory
+    for (int i = 0; i < 200; ++i) {
+        const int row = (i * 7919) % rows + 1;
+        QCOMPARE(xlsx2.read(row, 1).toInt(), row);
+        QCOMPARE(xlsx2.read(row, 2).toString(), QStringLiteral("Row %1").arg(row % 100));
+    }
+    QVERIFY(xlsx2.cellAt(rows, 1));
+    QCOMPARE(xlsx2.cellAt(rows, 1)->value().toInt(), rows);
+
+    xlsx2.write(10, 1, QStringLiteral("Changed"));
+    QBuffer device2;
+    device2.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx2.saveAs(&device2));
+    device2.open(QIODevice::ReadOnly);
+    Document xlsx3(&device2);
+    QCOMPARE(xlsx3.read(10, 1).toString(), QStringLiteral("Changed"));
+    QCOMPARE(xlsx3.read(rows - 1, 1).toInt(), rows - 1);
+    QCOMPARE(xlsx3.read(rows - 1, 2).toString(), QStringLiteral("Row %1").arg((rows - 1) % 100));
+}
+
+void DocumentTest::testSaveUnchangedParts()
+{
+    {
+        Document xlsx1;
+        xlsx1.write("A1", "First");
+        xlsx1.addSheet("Sheet2");
+        xlsx1.write("A1", "Second");
+        xlsx1.saveAs("unchanged_parts.xlsx");
+    }
+
+    {
+        Document xlsx2("unchanged_parts.xlsx");
+        QVERIFY(!xlsx2.sheet("Sheet1")->isDirty());
+        QVERIFY(!xlsx2.sheet("Sheet2")->isDirty());
+        xlsx2.selectSheet("Sheet2");
+        xlsx2.write("A2", "New");
+        QVERIFY(xlsx2.sheet("Sheet2")->isDirty());
+        QVERIFY(!xlsx2.sheet("Sheet1")->isDirty());
+
+        // Sheet1 is copied from the package, twice
+        for (int i = 0; i < 2; ++i) {
+            QBuffer device;
+            device.open(QIODevice::WriteOnly);
+            QVERIFY(xlsx2.saveAs(&device));
+            device.open(QIODevice::ReadOnly);
+            Document xlsx3(&device);
+            xlsx3.selectSheet("Sheet1");
+            QCOMPARE(xlsx3.read("A1").toString(), QString("First"));
+            xlsx3.selectSheet("Sheet2");
+            QCOMPARE(xlsx3.read("A1").toString(), QString("Second"));
+            QCOMPARE(xlsx3.read("A2").toString(), QString("New"));
+        }
+    }
+
+    QFile::remove("unchanged_parts.xlsx");
+}
+
+void DocumentTest::testTables()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    {
+        Document xlsx1;
+        Worksheet *sheet = xlsx1.currentWorksheet();
+        QVERIFY(sheet->addTable(CellRange("A1:B4"), QStringList() << "Name" << "Value"));
+        QVERIFY(sheet->writeTableColumn("Table1", "Name", QStringList() << "a" << "b" << "c"));
+        const double values[] = { 1, 2, 3 };
+        QVERIFY(sheet->writeTableColumn("Table1", "Value", values, 3));
+        xlsx1.addSheet("Sheet2");
+        QVERIFY(xlsx1.currentWorksheet()->addTable(CellRange("C3:D5"), QStringList(),
+                                                   "TableStyleLight9", "Prices"));
+        // The names are unique in the workbook
+        QVERIFY(!xlsx1.currentWorksheet()->addTable(CellRange("F1:G5"), QStringList(),
+                                                    QString(), "prices"));
+        QVERIFY(xlsx1.saveAs(&device));
+    }
+
+    device.open(QIODevice::ReadOnly);
+    for (int lazy = 0; lazy < 2; ++lazy) {
+        device.seek(0);
+        Document xlsx2(&device, lazy ? Document::LazyLoad : Document::DefaultLoadOptions);
+        QCOMPARE(xlsx2.currentWorksheet()->tableNames(), QStringList() << "Table1");
+        QCOMPARE(xlsx2.currentWorksheet()->tableRange("Table1"), CellRange("A1:B4"));
+        QCOMPARE(xlsx2.read("B1").toString(), QString("Value"));
+        QCOMPARE(xlsx2.read("B4").toDouble(), 3.0);
+        xlsx2.selectSheet("Sheet2");
+        QCOMPARE(xlsx2.currentWorksheet()->tableNames(), QStringList() << "Prices");
+        QCOMPARE(xlsx2.read("D3").toString(), QString("Column2"));
+
+        // A new table gets an id of its own, and the loaded ones are kept
+        QVERIFY(xlsx2.currentWorksheet()->addTable(CellRange("F1:G5")));
+        QCOMPARE(xlsx2.currentWorksheet()->tableNames(), QStringList() << "Prices" << "Table3");
+        QBuffer saved;
+        saved.open(QIODevice::WriteOnly);
+        QVERIFY(xlsx2.saveAs(&saved));
+        saved.open(QIODevice::ReadOnly);
+        Document xlsx3(&saved);
+        xlsx3.selectSheet("Sheet2");
+        QCOMPARE(xlsx3.currentWorksheet()->tableNames(), QStringList() << "Prices" << "Table3");
+    }
+}
+
+void DocumentTest::testComments()
+{
+    RecordingProfiler profiler;
+    Document xlsx;
+    xlsx.write("A1", "Total");
+    QVERIFY(xlsx.currentWorksheet()->writeComment("A1", "Checked"));
+    xlsx.addSheet("Sheet2");
+    xlsx.addSheet("Sheet3");
+    for (int row = 1; row <= 100; ++row)
+        QVERIFY(xlsx.currentWorksheet()->writeComment(row, 2, QString("Note %1").arg(row)));
+    xlsx.setProfiler(&profiler);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&device));
+
+    // The sheets without comments get no parts
+    QCOMPARE(profiler.elements.value("xl/comments1.xml"), qint64(1));
+    QCOMPARE(profiler.elements.value("xl/comments2.xml"), qint64(100));
+    QCOMPARE(profiler.elements.value("xl/drawings/vmlDrawing2.vml"), qint64(100));
+    QVERIFY(!profiler.bytes.contains("xl/comments3.xml"));
+    QVERIFY(profiler.bytes.contains("xl/worksheets/_rels/sheet3.xml.rels"));
+    QVERIFY(!profiler.bytes.contains("xl/worksheets/_rels/sheet2.xml.rels"));
+}
+
+void DocumentTest::testCompression()
+{
+    Document xlsx1;
+    for (int row = 1; row <= 1000; ++row)
+        xlsx1.write(row, 1, row);
+
+    QBuffer defaultDevice;
+    defaultDevice.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&defaultDevice);
+
+    xlsx1.setCompression(Document::NoCompression);
+    xlsx1.setCompression("xl/styles.xml", Document::BestCompression);
+    QCOMPARE(xlsx1.compression(), Document::NoCompression);
+    QBuffer storedDevice;
+    storedDevice.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&storedDevice);
+    QVERIFY(storedDevice.data().size() > defaultDevice.data().size());
+
+    storedDevice.open(QIODevice::ReadOnly);
+    Document xlsx2(&storedDevice);
+    QCOMPARE(xlsx2.read(1000, 1).toInt(), 1000);
+}
+
+void DocumentTest::testCompactStyles()
+{
+    Document xlsx1;
+    Format bold;
+    bold.setFontBold(true);
+    Format italic;
+    italic.setFontItalic(true);
+    Format red;
+    red.setPatternBackgroundColor(Qt::red);
+    xlsx1.write("A1", 1, bold);
+    xlsx1.write("A2", 2, italic);
+    xlsx1.write("A3", 3, red);
+    xlsx1.write("A2", 2, bold);
+
+    StyleStatistics before = xlsx1.workbook()->styleStatistics();
+    QCOMPARE(before.cellFormats, 4);
+    QCOMPARE(before.fonts, 3);
+    QCOMPARE(before.fills, 3);
+
+    QVERIFY(xlsx1.workbook()->compactStyles());
+    StyleStatistics after = xlsx1.workbook()->styleStatistics();
+    QCOMPARE(after.cellFormats, 3);
+    QCOMPARE(after.fonts, 2);
+    QCOMPARE(after.fills, 3);
+    QCOMPARE(after.borders, before.borders);
+
+    QVERIFY(xlsx1.cellAt("A1")->format().fontBold());
+    QVERIFY(xlsx1.cellAt("A2")->format().fontBold());
+    QCOMPARE(xlsx1.cellAt("A3")->format().patternBackgroundColor(), QColor(Qt::red));
+
+    // The format whose xf has been dropped can still be used
+    xlsx1.write("A4", 4, italic);
+    QVERIFY(xlsx1.cellAt("A4")->format().fontItalic());
+    QVERIFY(!xlsx1.cellAt("A3")->format().fontItalic());
+
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.setSaveOptions(Document::CompactStyles);
+    QVERIFY(xlsx1.saveAs(&device));
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    QCOMPARE(xlsx2.workbook()->styleStatistics().cellFormats, 4);
+    QVERIFY(xlsx2.cellAt("A1")->format().fontBold());
+    QVERIFY(xlsx2.cellAt("A2")->format().fontBold());
+    QCOMPARE(xlsx2.cellAt("A3")->format().patternBackgroundColor(), QColor(Qt::red));
+    QVERIFY(xlsx2.cellAt("A4")->format().fontItalic());
+}
+
+void DocumentTest::testCompact()
+{
+    Document xlsx1;
+    Format bold;
+    bold.setFontBold(true);
+    Format italic;
+    italic.setFontItalic(true);
+    for (int row = 1; row <= 1000; ++row) {
+        xlsx1.write(row, 1, QStringLiteral("Text %1").arg(row), bold);
+        xlsx1.write(row, 2, QStringLiteral("Kept %1").arg(row % 10));
+    }
+    // The strings and the format of the first column are no longer used
+    for (int row = 1; row <= 1000; ++row)
+        xlsx1.write(row, 1, row, italic);
+    QCOMPARE(xlsx1.cellAt(13, 2)->value().toString(), QStringLiteral("Kept 3"));
+    QCOMPARE(xlsx1.workbook()->styleStatistics().cellFormats, 3);
+
+    const DocumentMemoryUsage before = xlsx1.memoryUsage();
+    QCOMPARE(before.total,
+             before.cells + before.cellObjects + before.sharedStrings + before.styles);
+    QVERIFY(before.cells > 0);
+    QVERIFY(before.cellObjects > 0);
+    QVERIFY(xlsx1.compact());
+    const DocumentMemoryUsage after = xlsx1.memoryUsage();
+    QVERIFY(after.sharedStrings < before.sharedStrings);
+    QVERIFY(after.total < before.total);
+    QCOMPARE(xlsx1.workbook()->styleStatistics().cellFormats, 2);
+
+    QCOMPARE(xlsx1.read(10, 1).toInt(), 10);
+    QVERIFY(xlsx1.cellAt(10, 1)->format().fontItalic());
+    QCOMPARE(xlsx1.read(999, 2).toString(), QStringLiteral("Kept 9"));
+    QCOMPARE(xlsx1.cellAt(13, 2)->value().toString(), QStringLiteral("Kept 3"));
+    xlsx1.write(1001, 2, QStringLiteral("Kept 3"));
+    xlsx1.write(1002, 2, QStringLiteral("New"));
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&buffer));
+    buffer.close();
+
+    // The sheets left to load are loaded first
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer, Document::LazyLoad);
+    xlsx2.write(1002, 2, 42);
+    QVERIFY(xlsx2.compact());
+    QCOMPARE(xlsx2.read(5, 1).toInt(), 5);
+    QCOMPARE(xlsx2.read(999, 2).toString(), QStringLiteral("Kept 9"));
+    QCOMPARE(xlsx2.read(1001, 2).toString(), QStringLiteral("Kept 3"));
+    QCOMPARE(xlsx2.read(1002, 2).toInt(), 42);
+    buffer.close();
+
+    QByteArray data2;
+    QBuffer buffer2(&data2);
+    buffer2.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx2.saveAs(&buffer2));
+    buffer2.close();
+    buffer2.open(QIODevice::ReadOnly);
+    Document xlsx3(&buffer2);
+    QCOMPARE(xlsx3.read(13, 2).toString(), QStringLiteral("Kept 3"));
+    QCOMPARE(xlsx3.read(1001, 2).toString(), QStringLiteral("Kept 3"));
+    QCOMPARE(xlsx3.read(1002, 2).toInt(), 42);
+
+    // Nothing is compacted in constant memory mode
+    Document xlsx4;
+    xlsx4.currentWorksheet()->setConstantMemoryEnabled(true);
+    xlsx4.write(1, 1, QStringLiteral("Streamed"));
+    xlsx4.write(2, 1, 2);
+    QVERIFY(!xlsx4.compact());
+}
+
+void DocumentTest::testInsertEncodedImage()
+{
+    QImage image(12, 8, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    QByteArray png;
+    QBuffer pngDevice(&png);
+    pngDevice.open(QIODevice::WriteOnly);
+    image.save(&pngDevice, "PNG");
+
+    Document xlsx1;
+    // The size is read from the header
+    QVERIFY(xlsx1.insertImage(2, 3, png, "png"));
+    QVERIFY(!xlsx1.insertImage(1, 1, QByteArray("not an image"), "png"));
+    QVERIFY(xlsx1.insertImage(1, 1, QByteArray("JPEG bytes kept as they are"), "jpg",
+                              QSize(4, 4)));
+
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    QVERIFY(device.data().contains(png));
+    QVERIFY(device.data().contains("JPEG bytes kept as they are"));
+    QVERIFY(device.data().contains("image/jpeg"));
+    // 12 x 8 pixels, in EMUs
+    QVERIFY(device.data().contains("cx=\"114300\" cy=\"76200\""));
+}
+
+void DocumentTest::testDeduplicateImages()
+{
+    QImage image(16, 16, QImage::Format_RGB32);
+    image.fill(Qt::blue);
+    QImage other(16, 16, QImage::Format_RGB32);
+    other.fill(Qt::green);
+
+    Document xlsx1;
+    for (int row = 1; row <= 10; ++row) {
+        xlsx1.insertImage(row, 1, image);
+        xlsx1.insertImage(row, 2, other);
+        // Equal images which aren't copies are merged once they are encoded
+        xlsx1.insertImage(row, 3, image.copy());
+    }
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    QCOMPARE(device.data().count("xl/media/image1.png"), 2);
+    QCOMPARE(device.data().count("xl/media/image2.png"), 2);
+    QVERIFY(!device.data().contains("xl/media/image3.png"));
+}
+
+void DocumentTest::testChartValueCache()
+{
+    Document xlsx1;
+    xlsx1.write("A1", "one");
+    xlsx1.write("A2", "two");
+    xlsx1.write("A3", "three");
+    xlsx1.write("B1", 1.5);
+    xlsx1.write("B3", 3);
+    Chart *chart = xlsx1.insertChart(4, 4, QSize(300, 300));
+    chart->setChartType(Chart::CT_Scatter);
+    chart->addSeries(CellRange("A1:B3"));
+    QVERIFY(!chart->isValueCacheEnabled());
+    chart->setValueCacheEnabled();
+
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    const QByteArray data = device.data();
+    QVERIFY(data.contains("<c:xVal><c:strRef><c:f>Sheet1!$A$1:$A$3</c:f><c:strCache>"
+                          "<c:ptCount val=\"3\"/><c:pt idx=\"0\"><c:v>one</c:v></c:pt>"));
+    // The empty cell B2 has no point
+    QVERIFY(data.contains("<c:numCache><c:formatCode>General</c:formatCode>"
+                          "<c:ptCount val=\"3\"/><c:pt idx=\"0\"><c:v>1.5</c:v></c:pt>"
+                          "<c:pt idx=\"2\"><c:v>3</c:v></c:pt></c:numCache>"));
+}
+
+void DocumentTest::testChartTemplate()
+{
+    Document xlsx1;
+    xlsx1.addSheet("My & Sheet");
+    xlsx1.selectSheet("My & Sheet");
+    Chart *chart = xlsx1.insertChart(4, 4, QSize(300, 300));
+    chart->setChartType(Chart::CT_Bar);
+    chart->addSeries(CellRange("A1:B3"));
+
+    Chart *copy = xlsx1.insertChart(24, 4, QSize(300, 300));
+    copy->setTemplate(chart, 10);
+    Chart *copyOfCopy = xlsx1.insertChart(44, 4, QSize(300, 300));
+    copyOfCopy->setTemplate(copy, 10, 2);
+    Chart *outside = xlsx1.insertChart(64, 4, QSize(300, 300));
+    outside->setTemplate(chart, -1);
+
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    const QByteArray data = device.data();
+    QVERIFY(data.contains("<c:f>'My &amp; Sheet'!$A$1:$A$3</c:f>"));
+    QVERIFY(data.contains("<c:f>'My &amp; Sheet'!$B$11:$B$13</c:f>"));
+    QVERIFY(data.contains("<c:f>'My &amp; Sheet'!$D$21:$D$23</c:f>"));
+    QVERIFY(data.contains("<c:f>'My &amp; Sheet'!#REF!</c:f>"));
+    QCOMPARE(data.count("<c:barChart>"), 4);
+}
+
+void DocumentTest::testChartDownsampling()
+{
+    Document xlsx1;
+    for (int row = 1; row <= 3000; ++row) {
+        xlsx1.write(row, 1, row * 0.25 + 0.125);
+        xlsx1.write(row, 2, row == 1500 ? 1000 : row % 10);
+    }
+    xlsx1.write(1, 5, 1);
+    xlsx1.write(2, 5, 2);
+
+    Chart *scatter = xlsx1.insertChart(4, 4, QSize(300, 300));
+    scatter->setChartType(Chart::CT_Scatter);
+    scatter->addSeries(CellRange("A1:B3000"));
+    QCOMPARE(scatter->downsamplingMode(), Chart::NoDownsampling);
+    scatter->setDownsampling(Chart::LttbDownsampling, 100);
+    QCOMPARE(scatter->downsamplingPointCount(), 100);
+
+    Chart *line = xlsx1.insertChart(24, 4, QSize(300, 300));
+    line->setChartType(Chart::CT_Line);
+    line->addSeries(CellRange("B1:B3000"));
+    line->addSeries(CellRange("E1:E2"));
+    line->setDownsampling(Chart::MinMaxDownsampling, 50);
+
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    const QByteArray data = device.data();
+    // The reduced series hold their points in place of the references
+    QVERIFY(!data.contains("$A$1:$A$3000"));
+    QVERIFY(!data.contains("$B$1:$B$3000"));
+    QCOMPARE(data.count("<c:numLit><c:formatCode>General</c:formatCode>"
+                        "<c:ptCount val=\"100\"/><c:pt idx=\"0\"><c:v>0.375</c:v></c:pt>"),
+             1);
+    QCOMPARE(data.count("<c:ptCount val=\"100\"/>"), 2);
+    QCOMPARE(data.count("<c:ptCount val=\"50\"/>"), 1);
+    // The spike is kept by both
+    QCOMPARE(data.count("<c:v>1000</c:v>"), 2);
+    // The series which is short enough still refers to its cells
+    QVERIFY(data.contains("<c:f>Sheet1!$E$1:$E$2</c:f>"));
+}
+
+void DocumentTest::testInsertImages()
+{
+    QImage image(10, 30, QImage::Format_RGB32);
+    image.fill(Qt::red);
+
+    Document xlsx1;
+    // The default rows are 20 pixels high, the second one 40 pixels
+    xlsx1.setRowHeight(2, 2, 30);
+    QVERIFY(xlsx1.insertImages(0, 1, QList<QImage>() << image << image << image));
+    QVERIFY(!xlsx1.insertImages(5, 1, QList<QImage>() << QImage()));
+
+    xlsx1.setCompression(Document::NoCompression);
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    const QByteArray data = device.data();
+    QVERIFY(data.contains("<xdr:row>0</xdr:row><xdr:rowOff>0</xdr:rowOff>"));
+    QVERIFY(data.contains("<xdr:row>1</xdr:row><xdr:rowOff>95250</xdr:rowOff>"));
+    QVERIFY(data.contains("<xdr:row>2</xdr:row><xdr:rowOff>0</xdr:rowOff>"));
+}
+
+void DocumentTest::testSheetLookup()
+{
+    Document xlsx1;
+    xlsx1.addSheet("One");
+    xlsx1.addSheet("Two");
+    xlsx1.addSheet("Chart", AbstractSheet::ST_ChartSheet);
+    xlsx1.insertSheet(0, "Zero");
+    QCOMPARE(xlsx1.sheetNames(), QStringList() << "Zero" << "One" << "Two" << "Chart");
+    QCOMPARE(xlsx1.sheet("Two")->sheetName(), QString("Two"));
+    QVERIFY(!xlsx1.addSheet("One"));
+
+    QVERIFY(xlsx1.renameSheet("One", "First"));
+    QVERIFY(!xlsx1.sheet("One"));
+    QCOMPARE(xlsx1.sheet("First")->sheetName(), QString("First"));
+    QVERIFY(!xlsx1.renameSheet("First", "Two"));
+
+    QVERIFY(xlsx1.moveSheet("Two", 0));
+    QCOMPARE(xlsx1.sheetNames(), QStringList() << "Two" << "Zero" << "First" << "Chart");
+    QVERIFY(xlsx1.selectSheet("First"));
+    QCOMPARE(xlsx1.currentSheet()->sheetName(), QString("First"));
+
+    QVERIFY(xlsx1.deleteSheet("Zero"));
+    QVERIFY(!xlsx1.sheet("Zero"));
+    QCOMPARE(xlsx1.sheet("Chart")->sheetName(), QString("Chart"));
+    QVERIFY(xlsx1.selectSheet("Chart"));
+    QCOMPARE(xlsx1.currentSheet()->sheetType(), AbstractSheet::ST_ChartSheet);
+}
+
+void DocumentTest::testProfiler()
+{
+    RecordingProfiler saveProfiler;
+    Document xlsx1;
+    for (int row = 1; row <= 10; ++row) {
+        xlsx1.write(row, 1, QString("Text %1").arg(row));
+        xlsx1.write(row, 2, row);
+    }
+    xlsx1.setProfiler(&saveProfiler);
+    QCOMPARE(xlsx1.profiler(), static_cast<Profiler *>(&saveProfiler));
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+
+    QCOMPARE(saveProfiler.depth, 0);
+    QCOMPARE(saveProfiler.begun.size(), saveProfiler.ended.size());
+    QCOMPARE(saveProfiler.count(Profiler::SavePhase), 1);
+    QCOMPARE(saveProfiler.count(Profiler::PrepareSavePhase), 1);
+    QCOMPARE(saveProfiler.ended.last().first, Profiler::SavePhase);
+    QCOMPARE(saveProfiler.elements.value("xl/worksheets/sheet1.xml"), qint64(20));
+    QCOMPARE(saveProfiler.elements.value("xl/sharedStrings.xml"), qint64(10));
+    QVERIFY(saveProfiler.bytes.value("xl/worksheets/sheet1.xml") > 0);
+    QVERIFY(saveProfiler.bytes.contains("[Content_Types].xml"));
+    QVERIFY(saveProfiler.bytes.contains("_rels/.rels"));
+
+    RecordingProfiler loadProfiler;
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&loadProfiler, &device);
+    QCOMPARE(xlsx2.read("A10").toString(), QString("Text 10"));
+
+    QCOMPARE(loadProfiler.depth, 0);
+    QCOMPARE(loadProfiler.begun.size(), loadProfiler.ended.size());
+    QCOMPARE(loadProfiler.count(Profiler::LoadPhase), 1);
+    QCOMPARE(loadProfiler.ended.last().first, Profiler::LoadPhase);
+    QVERIFY(loadProfiler.count(Profiler::InflatePhase) > 0);
+    QVERIFY(loadProfiler.count(Profiler::ParsePhase) > 0);
+    QCOMPARE(loadProfiler.elements.value("xl/worksheets/sheet1.xml"), qint64(20));
+    QCOMPARE(loadProfiler.bytes.value("xl/worksheets/sheet1.xml"),
+             saveProfiler.bytes.value("xl/worksheets/sheet1.xml"));
+
+    //Nothing more is reported once the profiler is reset
+    xlsx2.setProfiler(0);
+    const int reported = loadProfiler.ended.size();
+    QBuffer device2;
+    device2.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx2.saveAs(&device2));
+    QCOMPARE(loadProfiler.ended.size(), reported);
+}
+
+void DocumentTest::testProgressMonitor()
+{
+    const int rows = ProgressMonitor::rowInterval() * 3 + 10;
+    Document xlsx1;
+    xlsx1.addSheet("Data");
+    for (int row = 1; row <= rows; ++row)
+        xlsx1.write(row, 1, row);
+
+    RecordingMonitor saveMonitor;
+    xlsx1.setProgressMonitor(&saveMonitor);
+    QCOMPARE(xlsx1.progressMonitor(), static_cast<ProgressMonitor *>(&saveMonitor));
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+    QVERIFY(saveMonitor.parts.contains("xl/worksheets/sheet1.xml"));
+    QCOMPARE(saveMonitor.parts.last(), QString("[Content_Types].xml"));
+    QCOMPARE(saveMonitor.sheets, QSet<QString>() << "Data");
+    QCOMPARE(saveMonitor.rows, ProgressMonitor::rowInterval() * 3);
+    QVERIFY(saveMonitor.bytes > 0);
+    QVERIFY(saveMonitor.bytes <= device.data().size());
+
+    RecordingMonitor loadMonitor;
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&loadMonitor, &device);
+    QCOMPARE(xlsx2.read(rows, 1).toInt(), rows);
+    QVERIFY(loadMonitor.parts.contains("xl/worksheets/sheet1.xml"));
+    QCOMPARE(loadMonitor.rows, ProgressMonitor::rowInterval() * 3);
+
+    //A canceled save fails, until the monitor is reset
+    saveMonitor.cancelAfterRows = ProgressMonitor::rowInterval();
+    QBuffer device2;
+    device2.open(QIODevice::WriteOnly);
+    QVERIFY(!xlsx1.saveAs(&device2));
+    QVERIFY(saveMonitor.isCanceled());
+    QCOMPARE(saveMonitor.rows, ProgressMonitor::rowInterval());
+    saveMonitor.reset();
+    saveMonitor.cancelAfterRows = -1;
+    device2.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device2));
+
+    //A canceled load leaves an empty document
+    RecordingMonitor cancelMonitor;
+    cancelMonitor.cancelAfterRows = ProgressMonitor::rowInterval();
+    device.open(QIODevice::ReadOnly);
+    Document xlsx3(&cancelMonitor, &device);
+    QVERIFY(cancelMonitor.isCanceled());
+    QCOMPARE(cancelMonitor.rows, ProgressMonitor::rowInterval());
+    QVERIFY(!xlsx3.sheetNames().contains("Data"));
+    QVERIFY(xlsx3.read(rows, 1).isNull());
+}
+
+void DocumentTest::testSaveAsAsync()
+{
+    Format bold;
+    bold.setFontBold(true);
+    Document xlsx1;
+    for (int row = 1; row <= 1000; ++row) {
+        xlsx1.write(row, 1, QString("Text %1").arg(row));
+        xlsx1.write(row, 2, row, bold);
+    }
+    xlsx1.addSheet("Second");
+    xlsx1.write("A1", "Second sheet");
+
+    QFuture<bool> future = xlsx1.saveAsAsync("async_save.xlsx");
+
+    //The document may change while it's saved
+    xlsx1.selectSheet("Sheet1");
+    Format italic;
+    italic.setFontItalic(true);
+    for (int row = 1; row <= 1000; ++row)
+        xlsx1.write(row, 1, QString("Changed %1").arg(row), italic);
+    xlsx1.setRowHeight(1, 10, 40);
+    xlsx1.deleteSheet("Second");
+    xlsx1.addSheet("Third");
+
+    future.waitForFinished();
+    QVERIFY(future.result());
+
+    {
+        Document xlsx2("async_save.xlsx");
+        QCOMPARE(xlsx2.sheetNames(), QStringList() << "Sheet1" << "Second");
+        xlsx2.selectSheet("Sheet1");
+        QCOMPARE(xlsx2.read(1000, 1).toString(), QString("Text 1000"));
+        QCOMPARE(xlsx2.read(1000, 2).toInt(), 1000);
+        QVERIFY(xlsx2.cellAt(1000, 2)->format().fontBold());
+        QVERIFY(!xlsx2.cellAt(1, 1)->format().fontItalic());
+        xlsx2.selectSheet("Second");
+        QCOMPARE(xlsx2.read("A1").toString(), QString("Second sheet"));
+    }
+
+    //The edits are saved by the next save
+    QVERIFY(xlsx1.saveAsAsync("async_save.xlsx").result());
+    Document xlsx3("async_save.xlsx");
+    QCOMPARE(xlsx3.sheetNames(), QStringList() << "Sheet1" << "Third");
+    xlsx3.selectSheet("Sheet1");
+    QCOMPARE(xlsx3.read(1000, 1).toString(), QString("Changed 1000"));
+    QVERIFY(xlsx3.cellAt(1, 1)->format().fontItalic());
+
+    QFile::remove("async_save.xlsx");
+}
+
+void DocumentTest::testOpenAsync()
+{
+    Document xlsx1;
+    xlsx1.addSheet("First");
+    xlsx1.addSheet("Second");
+    xlsx1.addSheet("Third");
+    foreach (QString name, xlsx1.sheetNames()) {
+        xlsx1.selectSheet(name);
+        for (int row = 1; row <= 2000; ++row) {
+            xlsx1.write(row, 1, QString("%1 %2").arg(name).arg(row));
+            xlsx1.write(row, 2, row);
+        }
+    }
+    xlsx1.selectSheet("Second");
+    QVERIFY(xlsx1.saveAs("open_async.xlsx"));
+
+    {
+        Document xlsx2;
+        QSignalSpy loaded(&xlsx2, SIGNAL(sheetLoaded(QString)));
+        QSignalSpy finished(&xlsx2, SIGNAL(loadFinished()));
+        QVERIFY(xlsx2.openAsync("open_async.xlsx"));
+        QCOMPARE(xlsx2.sheetNames(), QStringList() << "First" << "Second" << "Third");
+        QVERIFY(finished.wait());
+
+        //The active sheet is loaded first
+        QCOMPARE(loaded.count(), 3);
+        QCOMPARE(loaded[0][0].toString(), QString("Second"));
+        xlsx2.selectSheet("Third");
+        QCOMPARE(xlsx2.read(2000, 1).toString(), QString("Third 2000"));
+        QCOMPARE(xlsx2.read(2000, 2).toInt(), 2000);
+    }
+
+    {
+        //The sheets can be used while they are loaded
+        Document xlsx3;
+        QSignalSpy finished(&xlsx3, SIGNAL(loadFinished()));
+        QVERIFY(xlsx3.openAsync("open_async.xlsx"));
+        xlsx3.selectSheet("Third");
+        QCOMPARE(xlsx3.read(1, 1).toString(), QString("Third 1"));
+        xlsx3.write(1, 3, "Third 1");
+        xlsx3.deleteSheet("First");
+        QVERIFY(finished.wait());
+        QCOMPARE(xlsx3.sheetNames(), QStringList() << "Second" << "Third");
+        xlsx3.selectSheet("Second");
+        QCOMPARE(xlsx3.read(2000, 1).toString(), QString("Second 2000"));
+        QVERIFY(xlsx3.saveAs("open_async2.xlsx"));
+    }
+
+    Document xlsx4("open_async2.xlsx");
+    xlsx4.selectSheet("Third");
+    QCOMPARE(xlsx4.read(1, 3).toString(), QString("Third 1"));
+    QCOMPARE(xlsx4.read(2000, 1).toString(), QString("Third 2000"));
+
+    Document xlsx5;
+    QSignalSpy finished(&xlsx5, SIGNAL(loadFinished()));
+    QVERIFY(!xlsx5.openAsync("no_such_file.xlsx"));
+    QVERIFY(finished.wait());
+
+    QFile::remove("open_async.xlsx");
+    QFile::remove("open_async2.xlsx");
+}
+
+void DocumentTest::testStatistics()
+{
+    Document::resetStatistics();
+    Document xlsx1;
+    for (int row = 1; row <= 100; ++row) {
+        Format bold;
+        bold.setFontBold(true);
+        xlsx1.write(row, 1, "Same text", bold);
+        xlsx1.write(row, 2, QString("http://example.com/%1").arg(row));
+    }
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&buffer));
+    buffer.close();
+
+    DocumentStatistics statistics = Document::statistics();
+    if (!statistics.enabled) {
+        QCOMPARE(statistics.cellsWritten, qint64(0));
+        QCOMPARE(statistics.bytesDeflated, qint64(0));
+        return;
+    }
+    QVERIFY(statistics.cellsWritten >= 200);
+    QVERIFY(statistics.sharedStringMisses >= 1);
+    QVERIFY(statistics.sharedStringHits >= 99);
+    QVERIFY(statistics.cellFormatHits >= 99);
+    //A new format for every cell has its key computed every time
+    QVERIFY(statistics.formatKeyComputations >= 100);
+    QVERIFY(statistics.regexEvaluations >= 100);
+    QVERIFY(statistics.sheetDataLookups >= 200);
+    QVERIFY(statistics.bytesDeflated > data.size());
+    QCOMPARE(statistics.bytesInflated, qint64(0));
+
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer);
+    QVERIFY(Document::statistics().bytesInflated > 0);
+
+    Document::resetStatistics();
+    QCOMPARE(Document::statistics().cellsWritten, qint64(0));
+}
+
+void DocumentTest::testMemoryBudget()
+{
+    const int rows = 20000;
+    Document xlsx;
+    QCOMPARE(xlsx.memoryBudget(), qint64(0));
+    xlsx.setMemoryBudget(256 * 1024);
+    QCOMPARE(xlsx.memoryBudget(), qint64(256 * 1024));
+
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= 10; ++col)
+            xlsx.write(row, col, row * 100 + col);
+    }
+    xlsx.addSheet(QStringLiteral("Sheet2"));
+    for (int row = 1; row <= rows; ++row)
+        xlsx.write(row, 1, QStringLiteral("Row %1").arg(row));
+
+    // Spilled rows are read back, and can be changed
+    xlsx.selectSheet(QStringLiteral("Sheet1"));
+    QCOMPARE(xlsx.read(5, 3).toInt(), 503);
+    xlsx.write(6, 3, 42);
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&buffer));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer);
+    QCOMPARE(xlsx2.read(1, 1).toInt(), 101);
+    QCOMPARE(xlsx2.read(6, 3).toInt(), 42);
+    QCOMPARE(xlsx2.read(rows / 2, 7).toInt(), rows / 2 * 100 + 7);
+    QCOMPARE(xlsx2.read(rows, 10).toInt(), rows * 100 + 10);
+    QCOMPARE(xlsx2.dimension(), CellRange(1, 1, rows, 10));
+    xlsx2.selectSheet(QStringLiteral("Sheet2"));
+    QCOMPARE(xlsx2.read(rows - 1, 1).toString(), QStringLiteral("Row %1").arg(rows - 1));
+}
+
+void DocumentTest::testBinaryFormat()
+{
+    Document xlsx1;
+    QCOMPARE(xlsx1.fileFormat(), Document::Xlsx);
+    Format format;
+    format.setFontBold(true);
+    format.setPatternBackgroundColor(Qt::yellow);
+    format.setNumberFormat(QStringLiteral("0.000"));
+    xlsx1.write("A1", 42);
+    xlsx1.write("A2", 1.5, format);
+    xlsx1.write("A3", 1e12);
+    xlsx1.write("B1", QStringLiteral("Hello"));
+    xlsx1.write("B2", QStringLiteral("Hello"));
+    xlsx1.write("C1", true);
+    xlsx1.mergeCells("D1:E2");
+    xlsx1.setColumnWidth(2, 25.0);
+    xlsx1.setRowHeight(3, 30.0);
+    xlsx1.addSheet(QStringLiteral("Second"));
+    xlsx1.write("A1", QStringLiteral("World"));
+
+    xlsx1.setFileFormat(Document::Xlsb);
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&buffer));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer);
+    QCOMPARE(xlsx2.fileFormat(), Document::Xlsb);
+    QCOMPARE(xlsx2.sheetNames(), QStringList() << QStringLiteral("Sheet1")
+                                               << QStringLiteral("Second"));
+    QCOMPARE(xlsx2.read("A1").toInt(), 42);
+    QCOMPARE(xlsx2.read("A2").toDouble(), 1.5);
+    QCOMPARE(xlsx2.read("A3").toDouble(), 1e12);
+    QCOMPARE(xlsx2.read("B2").toString(), QStringLiteral("Hello"));
+    QCOMPARE(xlsx2.read("C1").toBool(), true);
+    Format loaded = xlsx2.cellAt("A2")->format();
+    QVERIFY(loaded.fontBold());
+    QCOMPARE(loaded.patternBackgroundColor(), QColor(Qt::yellow));
+    QCOMPARE(loaded.numberFormat(), QStringLiteral("0.000"));
+    QVERIFY(!xlsx2.cellAt("A1")->format().isValid());
+    QCOMPARE(xlsx2.currentWorksheet()->mergedCells(), QList<CellRange>() << CellRange("D1:E2"));
+    QCOMPARE(xlsx2.columnWidth(2), 25.0);
+    QCOMPARE(xlsx2.rowHeight(3), 30.0);
+    xlsx2.selectSheet(QStringLiteral("Second"));
+    QCOMPARE(xlsx2.read("A1").toString(), QStringLiteral("World"));
+
+    // The formulas can't be written as binary records
+    xlsx2.write("B5", QStringLiteral("=A1+1"));
+    QBuffer refused;
+    refused.open(QIODevice::WriteOnly);
+    QVERIFY(!xlsx2.saveAs(&refused));
+    xlsx2.setFileFormat(Document::Xlsx);
+    QVERIFY(xlsx2.saveAs(&refused));
+}
+
+void DocumentTest::testReset()
+{
+    Document xlsx;
+    Format bold;
+    bold.setFontBold(true);
+    xlsx.write("A1", QStringLiteral("Hello"), bold);
+    xlsx.addSheet(QStringLiteral("Second"));
+    xlsx.setDocumentProperty(QStringLiteral("title"), QStringLiteral("Title"));
+    xlsx.workbook()->setStringsToNumbersEnabled(true);
+    xlsx.workbook()->setDefaultDateFormat(QStringLiteral("dd/mm/yyyy"));
+    xlsx.workbook()->setConcurrentWritesEnabled(true);
+
+    xlsx.reset();
+    // The first sheet is only added by the next access to the current one
+    QVERIFY(xlsx.sheetNames().isEmpty());
+    QVERIFY(xlsx.documentProperty(QStringLiteral("title")).isEmpty());
+    QVERIFY(xlsx.workbook()->isStringsToNumbersEnabled());
+    QCOMPARE(xlsx.workbook()->defaultDateFormat(), QStringLiteral("dd/mm/yyyy"));
+    QVERIFY(xlsx.workbook()->isConcurrentWritesEnabled());
+
+    // Reused for one more file, which holds nothing of the first one
+    xlsx.write("B2", QStringLiteral("12"));
+    QCOMPARE(xlsx.sheetNames(), QStringList() << QStringLiteral("Sheet1"));
+    QVERIFY(xlsx.read("A1").isNull());
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&buffer));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer);
+    QCOMPARE(xlsx2.sheetNames(), QStringList() << QStringLiteral("Sheet1"));
+    QVERIFY(xlsx2.read("A1").isNull());
+    QCOMPARE(xlsx2.read("B2").toDouble(), 12.0);
+}
+
+void DocumentTest::testDefinedNameRange()
+{
+    Document xlsx1;
+    for (int row = 1; row <= 3; ++row)
+        xlsx1.write(row, 1, row * 1.5);
+    xlsx1.write("A2", QStringLiteral("Text"));
+    xlsx1.addSheet(QStringLiteral("My Data"));
+    xlsx1.write("B1", 7);
+    xlsx1.write("B2", 8);
+    xlsx1.defineName(QStringLiteral("Values"), QStringLiteral("=Sheet1!$A$1:$A$3"));
+    xlsx1.defineName(QStringLiteral("Pair"), QStringLiteral("'My Data'!$B$1:$B$2"));
+    xlsx1.defineName(QStringLiteral("Local"), QStringLiteral("$B$2"), QString(),
+                     QStringLiteral("My Data"));
+    xlsx1.defineName(QStringLiteral("Total"), QStringLiteral("SUM(Sheet1!A1:A3)"));
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&buffer));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx2(&buffer);
+    QString sheetName;
+    QCOMPARE(xlsx2.definedNameRange(QStringLiteral("values"), &sheetName), CellRange("A1:A3"));
+    QCOMPARE(sheetName, QStringLiteral("Sheet1"));
+    QCOMPARE(xlsx2.readRange(QStringLiteral("Values")),
+             QVector<QVariant>() << 1.5 << QStringLiteral("Text") << 4.5);
+
+    QVector<double> numbers;
+    QBitArray valid;
+    QVERIFY(xlsx2.readRange(QStringLiteral("PAIR"), &numbers, &valid));
+    QCOMPARE(numbers, QVector<double>() << 7 << 8);
+    QCOMPARE(valid.count(true), 2);
+
+    // Only the names of the current sheet and the global ones are found
+    QVERIFY(!xlsx2.definedNameRange(QStringLiteral("Local")).isValid());
+    xlsx2.selectSheet(QStringLiteral("My Data"));
+    QCOMPARE(xlsx2.definedNameRange(QStringLiteral("Local"), &sheetName), CellRange("B2"));
+    QCOMPARE(sheetName, QStringLiteral("My Data"));
+    QCOMPARE(xlsx2.readRange(QStringLiteral("Local")), QVector<QVariant>() << 8.0);
+
+    // Expressions aren't ranges
+    QVERIFY(!xlsx2.definedNameRange(QStringLiteral("Total")).isValid());
+    QVERIFY(xlsx2.readRange(QStringLiteral("Total")).isEmpty());
+    QVERIFY(!xlsx2.readRange(QStringLiteral("Missing"), &numbers));
+}
+
+void DocumentTest::testIncrementalSave()
+{
+    Document xlsx1;
+    xlsx1.setSaveOptions(Document::IncrementalSave);
+    for (int row = 1; row <= 3000; ++row) {
+        xlsx1.write(row, 1, QStringLiteral("Text %1").arg(row));
+        xlsx1.write(row, 2, row);
+    }
+    xlsx1.write(2500, 3, QStringLiteral("=B2500*2"));
+
+    QList<QByteArray> saved;
+    for (int i = 0; i < 4; ++i) {
+        if (i == 1) {
+            // A new string, and one whose index is dropped
+            xlsx1.write(1500, 1, QStringLiteral("Changed"));
+            xlsx1.write(10, 1, 10);
+        } else if (i == 3) {
+            // The rows written from scratch, to compare with
+            xlsx1.setSaveOptions(Document::DefaultSaveOptions);
+        }
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(xlsx1.saveAs(&buffer));
+        saved.append(data);
+    }
+
+    QBuffer expectedBuffer(&saved[3]);
+    expectedBuffer.open(QIODevice::ReadOnly);
+    Document expected(&expectedBuffer);
+    QCOMPARE(expected.read(1500, 1).toString(), QStringLiteral("Changed"));
+    QCOMPARE(expected.read(10, 1).toInt(), 10);
+    for (int i = 1; i < 3; ++i) {
+        QBuffer buffer(&saved[i]);
+        buffer.open(QIODevice::ReadOnly);
+        Document xlsx2(&buffer);
+        for (int row = 1; row <= 3000; ++row) {
+            for (int col = 1; col <= 3; ++col)
+                QCOMPARE(xlsx2.read(row, col), expected.read(row, col));
+        }
+    }
+}
+
+void DocumentTest::testSequentialSave()
+{
+    Document xlsx1;
+    for (int row = 1; row <= 2000; ++row) {
+        xlsx1.write(row, 1, QStringLiteral("Text %1").arg(row));
+        xlsx1.write(row, 2, row);
+    }
+    xlsx1.addSheet(QStringLiteral("Second"));
+    xlsx1.write("A1", QStringLiteral("Hello"));
+
+    QList<Document::SaveOptions> optionsList;
+    optionsList << Document::DefaultSaveOptions << Document::ParallelSave;
+    foreach (Document::SaveOptions options, optionsList) {
+        xlsx1.setSaveOptions(options);
+        SequentialWriter device;
+        QVERIFY(xlsx1.saveAs(&device));
+
+        QBuffer buffer(&device.data);
+        buffer.open(QIODevice::ReadOnly);
+        Document xlsx2(&buffer);
+        QCOMPARE(xlsx2.sheetNames().size(), 2);
+        QCOMPARE(xlsx2.read("A2000").toString(), QStringLiteral("Text 2000"));
+        QCOMPARE(xlsx2.read("B2000").toInt(), 2000);
+        xlsx2.selectSheet(QStringLiteral("Second"));
+        QCOMPARE(xlsx2.read("A1").toString(), QStringLiteral("Hello"));
+    }
+}
+
+void DocumentTest::testLoadFilter()
+{
+    Document xlsx1;
+    Format bold;
+    bold.setFontBold(true);
+    for (int row = 1; row <= 2000; ++row) {
+        xlsx1.write(row, 1, QStringLiteral("Text %1").arg(row));
+        xlsx1.write(row, 2, row, bold);
+        xlsx1.write(row, 3, QStringLiteral("=B%1*2").arg(row));
+    }
+    xlsx1.addSheet(QStringLiteral("Second"));
+    xlsx1.write("A1", QStringLiteral("Hello"));
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    xlsx1.saveAs(&device);
+    device.close();
+
+    LoadFilter filter;
+    QVERIFY(filter.isEmpty());
+    filter.setColumns(QList<int>() << 1 << 3);
+    filter.setRange(CellRange("A1:XFD1500"));
+    QVERIFY(!filter.isEmpty());
+    QCOMPARE(filter.columns(), QList<int>() << 1 << 3);
+
+    QList<Document::LoadOptions> optionsList;
+    optionsList << Document::DefaultLoadOptions << Document::LazyLoad << Document::ParallelLoad;
+    foreach (Document::LoadOptions options, optionsList) {
+        device.open(QIODevice::ReadOnly);
+        Document xlsx2(&device, filter, options);
+        device.close();
+        xlsx2.selectSheet(QStringLiteral("Sheet1"));
+        QCOMPARE(xlsx2.read("A1500").toString(), QStringLiteral("Text 1500"));
+        QVERIFY(!xlsx2.read("B10").isValid());
+        QVERIFY(!xlsx2.read("A1501").isValid());
+        QVERIFY(xlsx2.cellAt("C10")->hasFormula());
+        xlsx2.selectSheet(QStringLiteral("Second"));
+        QCOMPARE(xlsx2.read("A1").toString(), QStringLiteral("Hello"));
+    }
+
+    // The styles and the formulas are left out
+    filter = LoadFilter();
+    filter.setOptions(LoadFilter::ValuesOnly);
+    device.open(QIODevice::ReadOnly);
+    Document xlsx3(&device, filter);
+    device.close();
+    xlsx3.selectSheet(QStringLiteral("Sheet1"));
+    QCOMPARE(xlsx3.read("B10").toInt(), 10);
+    QVERIFY(!xlsx3.cellAt("B10")->format().fontBold());
+    QVERIFY(!xlsx3.cellAt("C10") || !xlsx3.cellAt("C10")->hasFormula());
+
+    // Only the second sheet is loaded
+    filter = LoadFilter();
+    filter.setSheets(QStringList() << QStringLiteral("Second"));
+    optionsList.clear();
+    optionsList << Document::DefaultLoadOptions << Document::LazyLoad;
+    foreach (Document::LoadOptions options, optionsList) {
+        device.open(QIODevice::ReadOnly);
+        Document xlsx4(&device, filter, options);
+        device.close();
+        QCOMPARE(xlsx4.sheetNames().size(), 2);
+        xlsx4.selectSheet(QStringLiteral("Sheet1"));
+        QVERIFY(!xlsx4.read("A1").isValid());
+        xlsx4.selectSheet(QStringLiteral("Second"));
+        QCOMPARE(xlsx4.read("A1").toString(), QStringLiteral("Hello"));
+    }
+}
+
+void DocumentTest::testRowWriter()
+{
+    Document xlsx1;
+    Worksheet *sheet = xlsx1.currentWorksheet();
+    sheet->write("E5000", QStringLiteral("Kept"));
+    QList<RowWriter *> writers;
+    for (int i = 0; i < 4; ++i)
+        writers.append(sheet->rowWriter(i * 2500 + 1, (i + 1) * 2500));
+    QVERIFY(!writers.contains(0));
+    QVERIFY(!sheet->rowWriter(2000, 3000));
+    QVERIFY(!writers[0]->write(2501, 1, 1));
+
+    QList<FillRowsThread *> threads;
+    foreach (RowWriter *writer, writers) {
+        threads.append(new FillRowsThread(writer));
+        threads.last()->start();
+    }
+    foreach (FillRowsThread *thread, threads)
+        QVERIFY(thread->wait());
+    qDeleteAll(threads);
+
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+    QCOMPARE(sheet->dimension(), CellRange("A1:E10000"));
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    for (int row = 1; row <= 10000; row += 999) {
+        QCOMPARE(xlsx2.read(row, 1).toInt(), row);
+        QCOMPARE(xlsx2.read(row, 2).toString(), QStringLiteral("Row %1").arg(row % 100));
+        QVERIFY(xlsx2.cellAt(row, 2)->format().fontBold());
+        QVERIFY(xlsx2.cellAt(row, 3)->hasFormula());
+        QCOMPARE(xlsx2.read(row, 4).toBool(), bool(row % 2));
+    }
+    QCOMPARE(xlsx2.read("E5000").toString(), QStringLiteral("Kept"));
+}
+
+void DocumentTest::testDocumentBatch()
+{
+    Document templateXlsx;
+    templateXlsx.write("A1", QStringLiteral("Invoice"));
+    templateXlsx.write("A2", 42);
+    templateXlsx.addSheet(QStringLiteral("Notes"));
+    templateXlsx.write("A1", QStringLiteral("Template note"));
+    templateXlsx.selectSheet(QStringLiteral("Sheet1"));
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(templateXlsx.saveAs(&device));
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    DocumentBatch batch(&device);
+    QVERIFY(batch.isValid());
+    QVERIFY(batch.templateDocument());
+    QVERIFY(!DocumentBatch(QStringLiteral("no_such_template.xlsx")).isValid());
+    batch.setMaxThreadCount(4);
+    QCOMPARE(batch.maxThreadCount(), 4);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QStringList fileNames;
+    for (int i = 0; i < 20; ++i)
+        fileNames.append(dir.path() + QStringLiteral("/document%1.xlsx").arg(i));
+    IndexFiller filler;
+    QVERIFY(!batch.generate(fileNames, &filler));
+    QCOMPARE(batch.failedDocuments(), QList<int>() << 3);
+    QVERIFY(!QFile::exists(fileNames[3]));
+
+    for (int i = 0; i < fileNames.size(); ++i) {
+        if (i == 3)
+            continue;
+        Document xlsx(fileNames[i]);
+        QCOMPARE(xlsx.sheetNames(), QStringList() << QStringLiteral("Sheet1")
+                                                  << QStringLiteral("Notes"));
+        QCOMPARE(xlsx.read("A1").toString(), QStringLiteral("Invoice"));
+        QCOMPARE(xlsx.read("A2").toInt(), 42);
+        QCOMPARE(xlsx.read("B2").toInt(), i);
+        QVERIFY(xlsx.cellAt("B2")->format().fontBold());
+        QCOMPARE(xlsx.read("C2").toString(), QStringLiteral("Document %1").arg(i));
+        QVERIFY(xlsx.selectSheet(QStringLiteral("Notes")));
+        QCOMPARE(xlsx.read("A1").toString(), QStringLiteral("Template note"));
+    }
+
+    // The template itself is left as it was
+    QVERIFY(batch.templateDocument()->read("B2").isNull());
+}
+
+void DocumentTest::testSnapshot()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString sourceName = dir.path() + QStringLiteral("/source.xlsx");
+    const QString snapshotName = dir.path() + QStringLiteral("/source.snapshot");
+    {
+        Document xlsx1;
+        Format bold;
+        bold.setFontBold(true);
+        xlsx1.write("A1", QStringLiteral("Reference"), bold);
+        xlsx1.write("A2", 3.5);
+        xlsx1.write("B2", true);
+        xlsx1.addSheet(QStringLiteral("Rates"));
+        xlsx1.write("C3", QStringLiteral("Rate"));
+        QVERIFY(xlsx1.saveAs(sourceName));
+    }
+
+    Document source(sourceName);
+    QVERIFY(source.saveSnapshot(snapshotName));
+
+    Document xlsx2;
+    QVERIFY(!xlsx2.loadSnapshot(sourceName));
+    QVERIFY(xlsx2.loadSnapshot(snapshotName, sourceName));
+    QCOMPARE(xlsx2.fileFormat(), Document::Xlsx);
+    QCOMPARE(xlsx2.sheetNames(), QStringList() << QStringLiteral("Sheet1")
+                                               << QStringLiteral("Rates"));
+    QVERIFY(xlsx2.selectSheet(QStringLiteral("Sheet1")));
+    QCOMPARE(xlsx2.read("A1").toString(), QStringLiteral("Reference"));
+    QVERIFY(xlsx2.cellAt("A1")->format().fontBold());
+    QCOMPARE(xlsx2.read("A2").toDouble(), 3.5);
+    QCOMPARE(xlsx2.read("B2").toBool(), true);
+    QVERIFY(xlsx2.selectSheet(QStringLiteral("Rates")));
+    QCOMPARE(xlsx2.read("C3").toString(), QStringLiteral("Rate"));
+
+    // A document the binary parts can't hold is kept as xml parts
+    xlsx2.write("D4", QStringLiteral("=SUM(1,2)"));
+    const QString formulaSnapshotName = dir.path() + QStringLiteral("/formula.snapshot");
+    QVERIFY(xlsx2.saveSnapshot(formulaSnapshotName));
+    Document xlsx3;
+    QVERIFY(xlsx3.loadSnapshot(formulaSnapshotName, sourceName));
+    QVERIFY(xlsx3.selectSheet(QStringLiteral("Rates")));
+    QVERIFY(xlsx3.cellAt("D4")->hasFormula());
+
+    // The snapshots of a changed source are stale
+    {
+        Document xlsx4(sourceName);
+        xlsx4.write("A3", 1);
+        QVERIFY(xlsx4.save());
+    }
+    Document xlsx5;
+    xlsx5.write("A1", QStringLiteral("Kept"));
+    QVERIFY(!xlsx5.loadSnapshot(snapshotName, sourceName));
+    QCOMPARE(xlsx5.read("A1").toString(), QStringLiteral("Kept"));
+    QVERIFY(xlsx5.loadSnapshot(snapshotName));
+    QVERIFY(xlsx5.selectSheet(QStringLiteral("Sheet1")));
+    QCOMPARE(xlsx5.read("A1").toString(), QStringLiteral("Reference"));
+}
+
+void DocumentTest::testTypedRowWriter()
+{
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+    Document xlsx1;
+    Worksheet *sheet = xlsx1.currentWorksheet();
+    sheet->write("B3", QStringLiteral("Replaced"));
+    Format bold;
+    bold.setFontBold(true);
+    Format dateFormat;
+    dateFormat.setNumberFormat(QStringLiteral("dd/mm/yyyy"));
+
+    TypedRowWriter<QString, QDate, double, int, bool> writer(
+        sheet, QList<Format>() << bold << dateFormat, 2);
+    QCOMPARE(writer.columnCount(), 5);
+    QCOMPARE(writer.firstColumn(), 2);
+    for (int row = 1; row <= 1000; ++row) {
+        QVERIFY(writer.writeRow(row, QStringLiteral("Item %1").arg(row % 10),
+                                QDate(2014, 1, 1).addDays(row), row * 0.5, row, row % 2));
+    }
+    QVERIFY(!writer.writeRow(0, QString(), QDate(), 0, 0, false));
+    QCOMPARE(sheet->dimension(), CellRange("B1:F1000"));
+
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    for (int row = 1; row <= 1000; row += 111) {
+        QCOMPARE(xlsx2.read(row, 2).toString(), QStringLiteral("Item %1").arg(row % 10));
+        QVERIFY(xlsx2.cellAt(row, 2)->format().fontBold());
+        QCOMPARE(xlsx2.read(row, 3).toDate(), QDate(2014, 1, 1).addDays(row));
+        QCOMPARE(xlsx2.cellAt(row, 3)->format().numberFormat(), QStringLiteral("dd/mm/yyyy"));
+        QCOMPARE(xlsx2.read(row, 4).toDouble(), row * 0.5);
+        QCOMPARE(xlsx2.read(row, 5).toInt(), row);
+        QCOMPARE(xlsx2.read(row, 6).toBool(), bool(row % 2));
+    }
+#else
+    QSKIP("Variadic templates are not supported");
+#endif
+}
+
+void DocumentTest::testRecords()
+{
+    QVector<Product> products;
+    for (int i = 0; i < 100; ++i) {
+        Product product;
+        product.name = QStringLiteral("Product %1").arg(i);
+        product.price = i * 1.25;
+        product.released = QDate(2014, 1, 1).addDays(i);
+        product.inStock = i % 3;
+        products.append(product);
+    }
+    Format bold;
+    bold.setFontBold(true);
+
+    Document xlsx1;
+    Worksheet *sheet = xlsx1.currentWorksheet();
+    QVERIFY(sheet->writeRecords(2, 2, products, QStringList(), QList<Format>() << bold));
+    QCOMPARE(sheet->read(2, 2).toString(), QStringLiteral("name"));
+    QCOMPARE(sheet->read(2, 5).toString(), QStringLiteral("inStock"));
+    QCOMPARE(sheet->dimension(), CellRange("B2:E102"));
+    QVERIFY(!sheet->writeRecords(1, 10, products, QStringList() << QStringLiteral("weight")));
+
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    Worksheet *sheet2 = xlsx2.currentWorksheet();
+    QVERIFY(sheet2->cellAt(10, 2)->format().fontBold());
+    QVector<Product> loaded = sheet2->readRecords<Product>();
+    QCOMPARE(loaded.size(), products.size());
+    for (int i = 0; i < loaded.size(); ++i) {
+        QCOMPARE(loaded[i].name, products[i].name);
+        QCOMPARE(loaded[i].price, products[i].price);
+        QCOMPARE(loaded[i].released, products[i].released);
+        QCOMPARE(loaded[i].inStock, products[i].inStock);
+    }
+
+    // The objects in a range of their own, the name being left out
+    ProductObject object1;
+    object1.setObjectName(QStringLiteral("first"));
+    object1.name = QStringLiteral("Bolt");
+    object1.quantity = 12;
+    ProductObject object2;
+    object2.name = QStringLiteral("Nut");
+    object2.quantity = 40;
+    QVERIFY(sheet2->writeRecords(1, 10, QVector<ProductObject *>() << &object1 << &object2));
+    QCOMPARE(sheet2->read(1, 10).toString(), QStringLiteral("name"));
+    QCOMPARE(sheet2->read(1, 11).toString(), QStringLiteral("quantity"));
+    QCOMPARE(sheet2->read(3, 10).toString(), QStringLiteral("Nut"));
+    QCOMPARE(sheet2->read(3, 11).toInt(), 40);
+
+    QVector<Product> names = sheet2->readRecords<Product>(CellRange("J1:K3"));
+    QCOMPARE(names.size(), 2);
+    QCOMPARE(names[0].name, QStringLiteral("Bolt"));
+    QCOMPARE(names[0].price, 0.0);
+}
+
+void DocumentTest::testDisplayText()
+{
+    Format money;
+    money.setNumberFormat(QStringLiteral("#,##0.00;[Red](#,##0.00)"));
+    Format percent;
+    percent.setNumberFormatIndex(10);
+    Format date;
+    date.setNumberFormat(QStringLiteral("d mmmm yyyy"));
+    Format quoted;
+    quoted.setNumberFormat(QStringLiteral("0;-0;0;\"[\"@\"]\""));
+
+    Document xlsx1;
+    Worksheet *sheet = xlsx1.currentWorksheet();
+    sheet->write(1, 1, 1234.5, money);
+    sheet->write(2, 1, -1234.5, money);
+    sheet->write(3, 1, 0.125, percent);
+    sheet->write(4, 1, QDate(2014, 3, 1), date);
+    sheet->write(5, 1, QStringLiteral("text"), quoted);
+    sheet->write(6, 1, true);
+    sheet->write(7, 1, 2.5);
+    sheet->writeFormula(8, 1, CellFormula(QStringLiteral("A7*2")), money, 5);
+
+    QCOMPARE(sheet->displayText(1, 1), QStringLiteral("1,234.50"));
+    QCOMPARE(sheet->displayText(2, 1), QStringLiteral("(1,234.50)"));
+    QCOMPARE(sheet->displayText(3, 1), QStringLiteral("12.50%"));
+    QCOMPARE(sheet->displayText(4, 1), QStringLiteral("1 March 2014"));
+    QCOMPARE(sheet->displayText(5, 1), QStringLiteral("[text]"));
+    QCOMPARE(sheet->displayText(6, 1), QStringLiteral("TRUE"));
+    QCOMPARE(sheet->displayText(CellReference("A7")), QStringLiteral("2.5"));
+    QCOMPARE(sheet->displayText(8, 1), QStringLiteral("5.00"));
+    QVERIFY(sheet->displayText(9, 1).isEmpty());
+
+    // The custom codes are found again by their ids
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx1.saveAs(&device));
+    device.close();
+    device.open(QIODevice::ReadOnly);
+    Document xlsx2(&device);
+    Worksheet *sheet2 = xlsx2.currentWorksheet();
+    QCOMPARE(sheet2->displayText(2, 1), QStringLiteral("(1,234.50)"));
+    QCOMPARE(sheet2->displayText(4, 1), QStringLiteral("1 March 2014"));
+    QCOMPARE(sheet2->displayText(5, 1), QStringLiteral("[text]"));
+}
+
+void DocumentTest::testDeferredDrawings()
+{
+    QImage image(16, 16, QImage::Format_RGB32);
+    image.fill(Qt::blue);
+    QImage other(16, 16, QImage::Format_RGB32);
+    other.fill(Qt::green);
+
+    {
+        Document xlsx1;
+        xlsx1.write("A1", 1);
+        xlsx1.insertImage(2, 2, image);
+        xlsx1.insertChart(4, 4, QSize(300, 300))->addSeries(CellRange("A1:A1"));
+        xlsx1.saveAs("deferred_drawings.xlsx");
+    }
+    {
+        // The drawing of the sheet is parsed by saving it
+        Document xlsx2("deferred_drawings.xlsx");
+        QVERIFY(xlsx2.workbook()->chartFiles().isEmpty());
+        QVERIFY(xlsx2.workbook()->mediaFiles().isEmpty());
+        QVERIFY(xlsx2.saveAs("deferred_drawings_copy.xlsx"));
+        QCOMPARE(xlsx2.workbook()->chartFiles().size(), 1);
+        QCOMPARE(xlsx2.workbook()->mediaFiles().size(), 1);
+
+        Document xlsx3("deferred_drawings.xlsx");
+        QVERIFY(xlsx3.insertImage(10, 2, other));
+        QCOMPARE(xlsx3.workbook()->chartFiles().size(), 1);
+        QCOMPARE(xlsx3.workbook()->mediaFiles().size(), 2);
+        QVERIFY(xlsx3.save());
+    }
+    // Loaded from devices, the drawings are parsed right away
+    QFile copy("deferred_drawings_copy.xlsx");
+    QVERIFY(copy.open(QIODevice::ReadOnly));
+    Document xlsx4(&copy);
+    QCOMPARE(xlsx4.workbook()->chartFiles().size(), 1);
+    QCOMPARE(xlsx4.workbook()->mediaFiles().size(), 1);
+    copy.close();
+
+    // The document saved over its own file keeps the first anchors
+    QFile saved("deferred_drawings.xlsx");
+    QVERIFY(saved.open(QIODevice::ReadOnly));
+    Document xlsx5(&saved);
+    QCOMPARE(xlsx5.workbook()->chartFiles().size(), 1);
+    QCOMPARE(xlsx5.workbook()->mediaFiles().size(), 2);
+    QCOMPARE(xlsx5.read("A1").toInt(), 1);
+    saved.close();
+
+    QFile::remove("deferred_drawings.xlsx");
+    QFile::remove("deferred_drawings_copy.xlsx");
+}
+
+//The asynchronous loads report to the event loop
+QTEST_GUILESS_MAIN(DocumentTest)
 
 #include "tst_documenttest.moc"
@@ -0,0 +1,337 @@
+#include "xlsxdocument.h"
+#include "private/xlsxaes_p.h"
+#include "private/xlsxcompoundfile_p.h"
+#include "private/xlsxencryption_p.h"
+#include <QBuffer>
+#include <QScopedPointer>
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class EncryptionTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    EncryptionTest();
+
+private Q_SLOTS:
+    void cleanup();
+
+    void testAes();
+    void testAes_data();
+    void testCbc();
+    void testCbc_data();
+    void testCompoundFile();
+    void testPackage();
+    void testPackage_data();
+    void testDocument();
+    void testAgileFile();
+
+private:
+    static QByteArray pattern(int size, int seed);
+};
+
+EncryptionTest::EncryptionTest()
+{
+}
+
+void EncryptionTest::cleanup()
+{
+    Aes::setHardwareSupportEnabled(true);
+}
+
+QByteArray EncryptionTest::pattern(int size, int seed)
+{
+    QByteArray data(size, 0);
+    quint32 state = quint32(seed) * 2654435761u + 1;
+    for (int i = 0; i < size; ++i) {
+        state = state * 1103515245 + 12345;
+        data[i] = char(state >> 16);
+    }
+    return data;
+}
+
+void EncryptionTest::testAes_data()
+{
+    QTest::addColumn<bool>("hardware");
+    QTest::addColumn<QByteArray>("key");
+    QTest::addColumn<QByteArray>("cipherText");
+
+    // FIPS-197, appendix C
+    const QByteArray key = "000102030405060708090a0b0c0d0e0f1011121314151617"
+                           "18191a1b1c1d1e1f";
+    for (int hardware = 0; hardware < 2; ++hardware) {
+        const char *path = hardware ? "AES-NI" : "tables";
+        QTest::newRow(QByteArray(path).append(" 128").constData())
+            << bool(hardware) << QByteArray::fromHex(key.left(32))
+            << QByteArray::fromHex("69c4e0d86a7b0430d8cdb78070b4c55a");
+        QTest::newRow(QByteArray(path).append(" 192").constData())
+            << bool(hardware) << QByteArray::fromHex(key.left(48))
+            << QByteArray::fromHex("dda97ca4864cdfe06eaf70a0ec0d7191");
+        QTest::newRow(QByteArray(path).append(" 256").constData())
+            << bool(hardware) << QByteArray::fromHex(key)
+            << QByteArray::fromHex("8ea2b7ca516745bfeafc49904b496089");
+    }
+}
+
+void EncryptionTest::testAes()
+{
+    QFETCH(bool, hardware);
+    QFETCH(QByteArray, key);
+    QFETCH(QByteArray, cipherText);
+
+    Aes::setHardwareSupportEnabled(hardware);
+    Aes aes;
+    QVERIFY(aes.setKey(key));
+    QVERIFY(!aes.setKey(QByteArray(20, 0)) && !aes.isValid());
+    QVERIFY(aes.setKey(key));
+
+    const QByteArray plainText = QByteArray::fromHex("00112233445566778899aabbccddeeff");
+    uchar block[Aes::BlockSize];
+    aes.encryptBlock(reinterpret_cast<const uchar *>(plainText.constData()), block);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(block), Aes::BlockSize), cipherText);
+    aes.decryptBlock(block, block);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(block), Aes::BlockSize), plainText);
+}
+
+void EncryptionTest::testCbc_data()
+{
+    QTest::addColumn<bool>("hardware");
+
+    QTest::newRow("tables") << false;
+    QTest::newRow("AES-NI") << true;
+}
+
+void EncryptionTest::testCbc()
+{
+    QFETCH(bool, hardware);
+
+    // SP 800-38A, F.2.5
+    Aes::setHardwareSupportEnabled(hardware);
+    Aes aes;
+    aes.setKey(QByteArray::fromHex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914df"
+                                   "f4"));
+    const QByteArray iv = QByteArray::fromHex("000102030405060708090a0b0c0d0e0f");
+    const QByteArray plainText = QByteArray::fromHex(
+        "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+        "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+    const QByteArray cipherText = aes.encryptCbc(plainText, iv);
+    QCOMPARE(cipherText, QByteArray::fromHex(
+                             "f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d"
+                             "39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b"));
+    QCOMPARE(aes.decryptCbc(cipherText, iv), plainText);
+
+    // Past the blocks deciphered four at a time
+    const QByteArray data = pattern(16 * 9, 1);
+    QCOMPARE(aes.decryptCbc(aes.encryptCbc(data, iv), iv), data);
+    // The partial block is padded with zeros
+    QCOMPARE(aes.encryptCbc(data.left(20), iv).size(), 32);
+}
+
+void EncryptionTest::testCompoundFile()
+{
+    QByteArray file;
+    QBuffer buffer(&file);
+    buffer.open(QIODevice::ReadWrite);
+    // Large enough for the FAT to be listed by DIFAT sectors
+    const QByteArray large = pattern(8 * 1024 * 1024 + 77, 2);
+    {
+        CompoundFileWriter writer(&buffer);
+        QVERIFY(writer.addStream(QStringLiteral("small"), pattern(100, 1)));
+        QVERIFY(writer.addStream(QStringLiteral("storage/sub/medium"), pattern(4095, 3)));
+        QVERIFY(writer.addStream(QStringLiteral("storage/big"), pattern(5000, 4)));
+        QVERIFY(writer.addStream(QStringLiteral("empty"), QByteArray()));
+        QVERIFY(!writer.addStream(QStringLiteral("Small"), QByteArray("x")));
+
+        QIODevice *stream = writer.beginStream(QStringLiteral("Streamed"));
+        QVERIFY(stream);
+        QVERIFY(!writer.beginStream(QStringLiteral("other")));
+        for (int pos = 0; pos < large.size(); pos += 100000)
+            stream->write(large.constData() + pos, qMin(100000, large.size() - pos));
+        QVERIFY(stream->seek(5));
+        QCOMPARE(stream->read(3), large.mid(5, 3));
+        QVERIFY(writer.endStream());
+        QVERIFY(writer.close());
+    }
+
+    QBuffer input(&file);
+    input.open(QIODevice::ReadOnly);
+    QVERIFY(CompoundFileReader::isCompoundFile(&input));
+    CompoundFileReader reader(&input);
+    QVERIFY(reader.isValid());
+    QCOMPARE(reader.streamData(QStringLiteral("small")), pattern(100, 1));
+    QCOMPARE(reader.streamData(QStringLiteral("STORAGE/Sub/medium")), pattern(4095, 3));
+    QCOMPARE(reader.streamData(QStringLiteral("storage/big")), pattern(5000, 4));
+    QVERIFY(reader.contains(QStringLiteral("empty")));
+    QCOMPARE(reader.streamSize(QStringLiteral("empty")), qint64(0));
+    QVERIFY(!reader.contains(QStringLiteral("storage")));
+    QVERIFY(!reader.contains(QStringLiteral("missing")));
+    QCOMPARE(reader.streamSize(QStringLiteral("Streamed")), qint64(large.size()));
+
+    QScopedPointer<QIODevice> stream(reader.openStream(QStringLiteral("Streamed")));
+    QVERIFY(stream);
+    QVERIFY(stream->seek(1000000));
+    QCOMPARE(stream->read(70000), large.mid(1000000, 70000));
+    QVERIFY(stream->seek(0));
+    QCOMPARE(stream->readAll(), large);
+
+    QBuffer zip;
+    zip.setData("PK\x03\x04");
+    zip.open(QIODevice::ReadOnly);
+    QVERIFY(!CompoundFileReader::isCompoundFile(&zip));
+}
+
+void EncryptionTest::testPackage_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("readable");
+
+    QTest::newRow("empty") << 0 << true;
+    QTest::newRow("one segment") << 4096 << true;
+    QTest::newRow("partial segment") << 100123 << true;
+    QTest::newRow("write only device") << 100123 << false;
+}
+
+void EncryptionTest::testPackage()
+{
+    QFETCH(int, size);
+    QFETCH(bool, readable);
+
+    const QByteArray package = pattern(size, 5);
+    QByteArray file;
+    QBuffer output(&file);
+    output.open(readable ? QIODevice::ReadWrite : QIODevice::WriteOnly);
+    {
+        EncryptedPackageWriter writer(&output, QStringLiteral("Secret"));
+        QVERIFY(!writer.error());
+        for (int pos = 0; pos < package.size(); pos += 777)
+            QVERIFY(writer.write(package.constData() + pos, qMin(777, package.size() - pos)) > 0);
+        QVERIFY(writer.finish());
+    }
+
+    QBuffer input(&file);
+    input.open(QIODevice::ReadOnly);
+    QVERIFY(EncryptedPackageReader::isEncryptedPackage(&input));
+    EncryptedPackageReader wrongPassword(&input);
+    QVERIFY(!wrongPassword.decrypt(QStringLiteral("secret")));
+    QVERIFY(!wrongPassword.isOpen());
+
+    EncryptedPackageReader reader(&input);
+    QVERIFY(reader.decrypt(QStringLiteral("Secret")));
+    QCOMPARE(reader.size(), qint64(size));
+    QCOMPARE(reader.readAll(), package);
+    if (size > 8192) {
+        // Across a segment boundary, then whole segments
+        QVERIFY(reader.seek(4090));
+        QCOMPARE(reader.read(10), package.mid(4090, 10));
+        QVERIFY(reader.seek(8192));
+        QCOMPARE(reader.read(8192), package.mid(8192, 8192));
+        QVERIFY(reader.seek(size - 5));
+        QCOMPARE(reader.read(100), package.right(5));
+    }
+}
+
+void EncryptionTest::testDocument()
+{
+    QByteArray file;
+    {
+        Document xlsx;
+        xlsx.write(QStringLiteral("A1"), QStringLiteral("Hello"));
+        xlsx.write(QStringLiteral("B2"), 42);
+        xlsx.setPassword(QStringLiteral("Secret"));
+        QCOMPARE(xlsx.password(), QStringLiteral("Secret"));
+        QBuffer buffer(&file);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(xlsx.saveAs(&buffer));
+    }
+    QVERIFY(file.startsWith("\xD0\xCF\x11\xE0"));
+
+    QBuffer buffer(&file);
+    buffer.open(QIODevice::ReadOnly);
+    {
+        Document xlsx(&buffer, QStringLiteral("Secret"));
+        QCOMPARE(xlsx.read(QStringLiteral("A1")).toString(), QStringLiteral("Hello"));
+        QCOMPARE(xlsx.read(QStringLiteral("B2")).toInt(), 42);
+        QCOMPARE(xlsx.password(), QStringLiteral("Secret"));
+    }
+    {
+        Document xlsx(&buffer, QStringLiteral("Wrong"));
+        QVERIFY(xlsx.read(QStringLiteral("A1")).isNull());
+    }
+
+    // Saved again to a file, and loaded by its name
+    QTemporaryDir dir;
+    const QString name = dir.path() + QStringLiteral("/encrypted.xlsx");
+    {
+        Document xlsx(&buffer, QStringLiteral("Secret"));
+        xlsx.write(QStringLiteral("A2"), QStringLiteral("World"));
+        QVERIFY(xlsx.saveAs(name));
+    }
+    Document xlsx(name, QStringLiteral("Secret"));
+    QCOMPARE(xlsx.read(QStringLiteral("A1")).toString(), QStringLiteral("Hello"));
+    QCOMPARE(xlsx.read(QStringLiteral("A2")).toString(), QStringLiteral("World"));
+    xlsx.setPassword(QString());
+    QVERIFY(xlsx.saveAs(name));
+    QFile saved(name);
+    QVERIFY(saved.open(QIODevice::ReadOnly));
+    QVERIFY(saved.read(2) == "PK");
+}
+
+void EncryptionTest::testAgileFile()
+{
+    // Encrypted apart from this code, as Excel 2013 and later do: SHA-512,
+    // AES-256, 100000 spins, the small streams in the mini stream
+    const QString name = QStringLiteral(SRCDIR "data/agile-sha512.xlsx");
+    {
+        Document xlsx(name, QStringLiteral("Password1"));
+        QCOMPARE(xlsx.sheetNames(), QStringList() << QStringLiteral("Data"));
+        QCOMPARE(xlsx.read(QStringLiteral("A1")).toString(), QStringLiteral("Name"));
+        QCOMPARE(xlsx.read(QStringLiteral("C1")).toString(), QStringLiteral("Hello"));
+        QCOMPARE(xlsx.read(QStringLiteral("A2")).toInt(), 1);
+        QCOMPARE(xlsx.read(QStringLiteral("B2")).toDouble(), 7628.46);
+        QCOMPARE(xlsx.read(QStringLiteral("A301")).toInt(), 300);
+        QCOMPARE(xlsx.read(QStringLiteral("B301")).toDouble(), 6612.8);
+    }
+    {
+        Document xlsx(name, QStringLiteral("password1"));
+        QVERIFY(xlsx.read(QStringLiteral("A1")).isNull());
+    }
+
+    // The data spaces of the packages written here are the same
+    QFile file(name);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    CompoundFileReader expected(&file);
+    QVERIFY(expected.isValid());
+
+    QByteArray data;
+    QBuffer output(&data);
+    output.open(QIODevice::ReadWrite);
+    {
+        EncryptedPackageWriter writer(&output, QStringLiteral("Password1"));
+        QVERIFY(writer.write("PK", 2) == 2);
+        QVERIFY(writer.finish());
+    }
+    QBuffer input(&data);
+    input.open(QIODevice::ReadOnly);
+    CompoundFileReader written(&input);
+    QVERIFY(written.isValid());
+    const QString dataSpaces = QChar(6) + QStringLiteral("DataSpaces/");
+    const QStringList streams = QStringList()
+                                << QStringLiteral("Version") << QStringLiteral("DataSpaceMap")
+                                << QStringLiteral("DataSpaceInfo/StrongEncryptionDataSpace")
+                                << QStringLiteral("TransformInfo/StrongEncryptionTransform/")
+                                       + QChar(6) + QStringLiteral("Primary");
+    foreach (const QString &stream, streams) {
+        QVERIFY2(expected.contains(dataSpaces + stream), qPrintable(stream));
+        QCOMPARE(written.streamData(dataSpaces + stream),
+                 expected.streamData(dataSpaces + stream));
+    }
+    QCOMPARE(written.streamData(QStringLiteral("EncryptionInfo")).left(8),
+             expected.streamData(QStringLiteral("EncryptionInfo")).left(8));
+}
+
+QTEST_APPLESS_MAIN(EncryptionTest)
+
+#include "tst_encryptiontest.moc"
@@ -14,6 +14,8 @@ public:
 private Q_SLOTS:
     void testDateTimeFormat();
     void testDateTimeFormat_data();
+    void testFingerprint();
+    void testProperties();
 };
 
 FormatTest::FormatTest()
@@ -29,6 +31,14 @@ void FormatTest::testDateTimeFormat()
     fmt.setNumberFormat(data);
 
     QCOMPARE(fmt.isDateTimeFormat(), res);
+
+    // The cached result follows the changes of the number format
+    fmt.setNumberFormatIndex(res ? 2 : 14);
+    QCOMPARE(fmt.isDateTimeFormat(), !res);
+    Format copy = fmt;
+    copy.setNumberFormat(data);
+    QCOMPARE(copy.isDateTimeFormat(), res);
+    QCOMPARE(fmt.isDateTimeFormat(), !res);
 }
 
 void FormatTest::testDateTimeFormat_data()
@@ -52,6 +62,88 @@ void FormatTest::testDateTimeFormat_data()
     QTest::newRow("23") << QString("###;m/d/yy")<<false;
 }
 
+void FormatTest::testFingerprint()
+{
+    Format empty;
+    QCOMPARE(empty.formatFingerprint(), Q_UINT64_C(0));
+    QCOMPARE(empty, Format());
+
+    Format fmt1;
+    fmt1.setFontBold(true);
+    fmt1.setFontColor(Qt::red);
+    fmt1.setPatternBackgroundColor(Qt::yellow);
+
+    Format fmt2;
+    fmt2.setPatternBackgroundColor(Qt::yellow);
+    fmt2.setFontColor(Qt::red);
+    fmt2.setFontBold(true);
+
+    QVERIFY(fmt1.formatFingerprint() != 0);
+    QCOMPARE(fmt1.formatFingerprint(), fmt2.formatFingerprint());
+    QCOMPARE(fmt1.fontFingerprint(), fmt2.fontFingerprint());
+    QCOMPARE(fmt1.fillFingerprint(), fmt2.fillFingerprint());
+    QCOMPARE(fmt1.borderFingerprint(), Q_UINT64_C(0));
+    QCOMPARE(fmt1, fmt2);
+
+    //Changing one property invalidates the cached fingerprints
+    quint64 fillFingerprint = fmt2.fillFingerprint();
+    fmt2.setFontColor(Qt::blue);
+    QVERIFY(fmt1 != fmt2);
+    QVERIFY(fmt1.fontFingerprint() != fmt2.fontFingerprint());
+    QCOMPARE(fmt2.fillFingerprint(), fillFingerprint);
+
+    //A copy which is modified doesn't change the original one
+    Format fmt3 = fmt1;
+    fmt3.setFontItalic(true);
+    QVERIFY(fmt1 != fmt3);
+    QVERIFY(fmt1.fontFingerprint() != fmt3.fontFingerprint());
+    QCOMPARE(fmt1.fillFingerprint(), fmt3.fillFingerprint());
+}
+
+void FormatTest::testProperties()
+{
+    Format fmt;
+    QVERIFY(fmt.isEmpty());
+    QVERIFY(!fmt.hasFontData());
+
+    fmt.setFontBold(true);
+    fmt.setFontName(QStringLiteral("Arial"));
+    fmt.setHorizontalAlignment(Format::AlignHCenter);
+    QVERIFY(!fmt.isEmpty());
+    QVERIFY(fmt.hasFontData());
+    QVERIFY(fmt.hasAlignmentData());
+    QVERIFY(!fmt.hasBorderData());
+    QVERIFY(!fmt.hasFillData());
+    QVERIFY(fmt.fontBold());
+    QCOMPARE(fmt.fontName(), QStringLiteral("Arial"));
+    QCOMPARE(fmt.horizontalAlignment(), Format::AlignHCenter);
+
+    //Setting the default value removes the property
+    fmt.setFontBold(false);
+    fmt.setFontName(QStringLiteral("Calibri"));
+    QVERIFY(!fmt.hasFontData());
+    QVERIFY(!fmt.isEmpty());
+    fmt.setHorizontalAlignment(Format::AlignHGeneral);
+    QVERIFY(fmt.isEmpty());
+
+    //Merging only overrides the properties of the modifier
+    Format base;
+    base.setFontItalic(true);
+    base.setBottomBorderStyle(Format::BorderThin);
+    Format modifier;
+    modifier.setBottomBorderStyle(Format::BorderThick);
+    base.mergeFormat(modifier);
+    QVERIFY(base.fontItalic());
+    QCOMPARE(base.bottomBorderStyle(), Format::BorderThick);
+
+    //Copies are independent of each other
+    Format copy = base;
+    copy.setFontItalic(false);
+    QVERIFY(base.fontItalic());
+    QVERIFY(!copy.fontItalic());
+    QCOMPARE(copy.bottomBorderStyle(), Format::BorderThick);
+}
+
 QTEST_APPLESS_MAIN(FormatTest)
 
 #include "tst_formattest.moc"
@@ -0,0 +1,274 @@
+#include "private/xlsxformulaengine_p.h"
+#include "xlsxdocument.h"
+#include "xlsxworkbook.h"
+#include "xlsxworksheet.h"
+#include "xlsxcell.h"
+#include "xlsxcellformula.h"
+#include <QString>
+#include <QBuffer>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class FormulaEngineTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    FormulaEngineTest();
+
+private Q_SLOTS:
+    void testParse_data();
+    void testParse();
+    void testCalculate_data();
+    void testCalculate();
+    void testIncrementalRecalculation();
+    void testSharedFormula();
+    void testUnsupportedFormula();
+    void testCircularReference();
+    void testDownwardChain();
+    void testSaveCalculatedValues();
+};
+
+FormulaEngineTest::FormulaEngineTest()
+{
+}
+
+void FormulaEngineTest::testParse_data()
+{
+    QTest::addColumn<QString>("formula");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("number") << "1.5e3" << true;
+    QTest::newRow("leading =") << "=A1+1" << true;
+    QTest::newRow("precedence") << "1+2*3^-2%" << true;
+    QTest::newRow("string") << "\"a\"\"b\"&C3" << true;
+    QTest::newRow("range") << "SUM($A$1:B10, 3)" << true;
+    QTest::newRow("omitted argument") << "IF(A1,,2)" << true;
+    QTest::newRow("nested") << "IF(AND(A1>=1,NOT(B1)),VLOOKUP(A1,D1:E5,2,FALSE),#N/A)" << true;
+    QTest::newRow("lower case") << "sum(a1:a3)" << true;
+    QTest::newRow("other sheet") << "Sheet2!A1" << false;
+    QTest::newRow("defined name") << "Total*2" << false;
+    QTest::newRow("unknown function") << "STDEV(A1:A3)" << false;
+    QTest::newRow("too few arguments") << "VLOOKUP(A1,B1:C3)" << false;
+    QTest::newRow("unbalanced") << "(1+2" << false;
+    QTest::newRow("trailing text") << "1 2" << false;
+    QTest::newRow("unterminated string") << "\"abc" << false;
+}
+
+void FormulaEngineTest::testParse()
+{
+    QFETCH(QString, formula);
+    QFETCH(bool, valid);
+
+    QCOMPARE(ParsedFormula(formula).isValid(), valid);
+}
+
+void FormulaEngineTest::testCalculate_data()
+{
+    QTest::addColumn<QString>("formula");
+    QTest::addColumn<QVariant>("result");
+    QTest::addColumn<int>("cellType");
+
+    const int number = Cell::NumberType;
+    QTest::newRow("arithmetic") << "A1*2+A2/4-1" << QVariant(3.75) << number;
+    QTest::newRow("power and negation") << "-2^2" << QVariant(4.0) << number;
+    QTest::newRow("percent") << "50%*A1" << QVariant(1.0) << number;
+    QTest::newRow("empty cell") << "Z99+1" << QVariant(1.0) << number;
+    QTest::newRow("numeric text") << "\"3\"*2" << QVariant(6.0) << number;
+    QTest::newRow("sum") << "SUM(A1:A3,10)" << QVariant(19.0) << number;
+    QTest::newRow("average") << "AVERAGE(A1:A4)" << QVariant(3.0) << number;
+    QTest::newRow("min max") << "MAX(A1:A4)-MIN(A1:A4)" << QVariant(2.0) << number;
+    QTest::newRow("count") << "COUNT(A1:A4)" << QVariant(3.0) << number;
+    QTest::newRow("round") << "ROUND(2.675,2)" << QVariant(2.68) << number;
+    QTest::newRow("round negative") << "ROUND(-1250,-2)" << QVariant(-1300.0) << number;
+    QTest::newRow("abs") << "ABS(-A1)" << QVariant(2.0) << number;
+    QTest::newRow("if") << "IF(A1>1,\"big\",\"small\")" << QVariant(QStringLiteral("big"))
+                        << int(Cell::StringType);
+    QTest::newRow("if lazy") << "IF(TRUE,1,1/0)" << QVariant(1.0) << number;
+    QTest::newRow("comparison") << "A4=\"TEXT\"" << QVariant(true) << int(Cell::BooleanType);
+    QTest::newRow("and or")
+        << "OR(AND(A1>0,A2>10),NOT(A3))" << QVariant(false) << int(Cell::BooleanType);
+    QTest::newRow("concat") << "A4&\"-\"&A1&TRUE" << QVariant(QStringLiteral("text-2TRUE"))
+                            << int(Cell::StringType);
+    QTest::newRow("vlookup exact")
+        << "VLOOKUP(\"b\",C1:D3,2,FALSE)" << QVariant(20.0) << number;
+    QTest::newRow("vlookup approximate") << "VLOOKUP(25,E1:F3,2)" << QVariant(QStringLiteral("y"))
+                                         << int(Cell::StringType);
+    QTest::newRow("vlookup not found")
+        << "VLOOKUP(\"z\",C1:D3,2,FALSE)" << QVariant(QStringLiteral("#N/A"))
+        << int(Cell::ErrorType);
+    QTest::newRow("vlookup column") << "VLOOKUP(\"b\",C1:D3,3,FALSE)"
+                                    << QVariant(QStringLiteral("#REF!")) << int(Cell::ErrorType);
+    QTest::newRow("division by zero") << "A1/(A2-3)" << QVariant(QStringLiteral("#DIV/0!"))
+                                      << int(Cell::ErrorType);
+    QTest::newRow("bad text") << "A4+1" << QVariant(QStringLiteral("#VALUE!"))
+                              << int(Cell::ErrorType);
+    QTest::newRow("error propagation") << "SUM(A1,1/0)" << QVariant(QStringLiteral("#DIV/0!"))
+                                       << int(Cell::ErrorType);
+}
+
+void FormulaEngineTest::testCalculate()
+{
+    QFETCH(QString, formula);
+    QFETCH(QVariant, result);
+    QFETCH(int, cellType);
+
+    Document xlsx;
+    xlsx.write("A1", 2);
+    xlsx.write("A2", 3);
+    xlsx.write("A3", 4);
+    xlsx.write("A4", "text");
+    xlsx.write("C1", "a");
+    xlsx.write("D1", 10);
+    xlsx.write("C2", "B");
+    xlsx.write("D2", 20);
+    xlsx.write("C3", "c");
+    xlsx.write("D3", 30);
+    xlsx.write("E1", 10);
+    xlsx.write("F1", "x");
+    xlsx.write("E2", 20);
+    xlsx.write("F2", "y");
+    xlsx.write("E3", 30);
+    xlsx.write("F3", "z");
+    xlsx.currentWorksheet()->writeFormula("H1", CellFormula(formula));
+
+    xlsx.workbook()->recalculate();
+    Cell *cell = xlsx.cellAt("H1");
+    QVERIFY(cell);
+    QCOMPARE(int(cell->cellType()), cellType);
+    if (result.type() == QVariant::Double)
+        QCOMPARE(cell->value().toDouble(), result.toDouble());
+    else
+        QCOMPARE(cell->value(), result);
+}
+
+void FormulaEngineTest::testIncrementalRecalculation()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row <= 1000; ++row)
+        sheet->write(row, 1, row);
+    sheet->writeFormula("B1", CellFormula("SUM(A1:A1000)"));
+    sheet->writeFormula("B2", CellFormula("B1*2"));
+    sheet->writeFormula("C1", CellFormula("A2+1"));
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 500500.0);
+    QCOMPARE(xlsx.cellAt("B2")->value().toDouble(), 1001000.0);
+    QCOMPARE(xlsx.cellAt("C1")->value().toDouble(), 3.0);
+
+    // Only the dependents of the written cell are calculated
+    sheet->write("A500", 0);
+    sheet->write("C1", 0);
+    sheet->writeFormula("C1", CellFormula("A2+1"), Format(), 42);
+    sheet->write("A2", 100);
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 500500.0 - 500 + 98);
+    QCOMPARE(xlsx.cellAt("B2")->value().toDouble(), 2 * (500500.0 - 500 + 98));
+    QCOMPARE(xlsx.cellAt("C1")->value().toDouble(), 101.0);
+
+    // A formula replaced by a value no longer depends on its old references
+    sheet->write("B1", 7);
+    sheet->write("A1", 1000);
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 7.0);
+    QCOMPARE(xlsx.cellAt("B2")->value().toDouble(), 14.0);
+}
+
+void FormulaEngineTest::testSharedFormula()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row <= 5; ++row)
+        sheet->write(row, 1, row);
+    sheet->writeFormula("B1", CellFormula("A1*10", "B1:B5", CellFormula::SharedType));
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 10.0);
+    QCOMPARE(xlsx.cellAt("B5")->value().toDouble(), 50.0);
+
+    sheet->write("A4", 7);
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("B4")->value().toDouble(), 70.0);
+}
+
+void FormulaEngineTest::testUnsupportedFormula()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->write("A1", 1);
+    sheet->writeFormula("B1", CellFormula("Sheet2!A1+A1"), Format(), 5);
+    sheet->writeFormula("C1", CellFormula("B1*2"));
+    xlsx.workbook()->recalculate();
+
+    // The cached value is kept, and still used by the dependent formulas
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 5.0);
+    QCOMPARE(xlsx.cellAt("C1")->value().toDouble(), 10.0);
+}
+
+void FormulaEngineTest::testCircularReference()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->writeFormula("A1", CellFormula("B1+1"), Format(), 1);
+    sheet->writeFormula("B1", CellFormula("A1+1"), Format(), 2);
+    sheet->writeFormula("C1", CellFormula("A1+B1"));
+    xlsx.workbook()->recalculate();
+
+    // The cycle is left as it is, but the calculation terminates
+    QVERIFY(xlsx.cellAt("C1")->value().toDouble() > 0);
+}
+
+void FormulaEngineTest::testDownwardChain()
+{
+    // Each formula refers to the row below it, the whole chain being
+    // calculated before its first cell
+    const int rows = 100000;
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row < rows; ++row)
+        sheet->writeFormula(row, 1, CellFormula(QStringLiteral("A%1+1").arg(row + 1)));
+    sheet->write(rows, 1, 0);
+    sheet->writeFormula("B1", CellFormula("SUM(A1:A3)"));
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("A1")->value().toDouble(), double(rows - 1));
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 3.0 * rows - 6);
+
+    sheet->write(rows, 1, 10);
+    xlsx.workbook()->recalculate();
+    QCOMPARE(xlsx.cellAt("A1")->value().toDouble(), double(rows + 9));
+    QCOMPARE(xlsx.cellAt(rows / 2, 1)->value().toDouble(), double(rows / 2 + 10));
+}
+
+void FormulaEngineTest::testSaveCalculatedValues()
+{
+    QByteArray data;
+    {
+        Document xlsx;
+        xlsx.workbook()->setCalculationEnabled();
+        Worksheet *sheet = xlsx.currentWorksheet();
+        sheet->write("A1", 4);
+        sheet->writeFormula("B1", CellFormula("A1*A1"));
+        sheet->writeFormula("B2", CellFormula("A1>3"));
+        sheet->writeFormula("B3", CellFormula("1/0"));
+        sheet->writeFormula("B4", CellFormula("\"n=\"&A1"));
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(xlsx.saveAs(&buffer));
+    }
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+    QCOMPARE(xlsx.cellAt("B1")->value().toDouble(), 16.0);
+    QCOMPARE(xlsx.cellAt("B2")->cellType(), Cell::BooleanType);
+    QCOMPARE(xlsx.cellAt("B2")->value().toBool(), true);
+    QVERIFY(xlsx.cellAt("B2")->hasFormula());
+    QCOMPARE(xlsx.cellAt("B3")->cellType(), Cell::ErrorType);
+    QCOMPARE(xlsx.cellAt("B3")->value().toString(), QStringLiteral("#DIV/0!"));
+    QCOMPARE(xlsx.cellAt("B3")->formula().formulaText(), QStringLiteral("1/0"));
+    QCOMPARE(xlsx.cellAt("B4")->value().toString(), QStringLiteral("n=4"));
+}
+
+QTEST_APPLESS_MAIN(FormulaEngineTest)
+
+#include "tst_formulaenginetest.moc"
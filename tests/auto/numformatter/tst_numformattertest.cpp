@@ -0,0 +1,214 @@
+#include "private/xlsxnumformatter_p.h"
+#include <QColor>
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class NumFormatterTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    NumFormatterTest();
+
+private Q_SLOTS:
+    void testNumbers();
+    void testNumbers_data();
+    void testDateTimes();
+    void testDateTimes_data();
+    void testSections();
+    void testSections_data();
+    void testText();
+    void testColors();
+    void testIsDateTime();
+};
+
+NumFormatterTest::NumFormatterTest()
+{
+}
+
+void NumFormatterTest::testNumbers_data()
+{
+    QTest::addColumn<QString>("code");
+    QTest::addColumn<double>("value");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("general") << QStringLiteral("General") << 1234.5 << QStringLiteral("1234.5");
+    QTest::newRow("general negative") << QStringLiteral("General") << -3.0 << QStringLiteral("-3");
+    QTest::newRow("general digits") << QStringLiteral("General") << 0.1 + 0.2
+                                    << QStringLiteral("0.3");
+    QTest::newRow("general large") << QStringLiteral("General") << 123456789012.0
+                                   << QStringLiteral("1.23457E+11");
+    QTest::newRow("general small") << QStringLiteral("General") << 0.00001234
+                                   << QStringLiteral("1.234E-05");
+    QTest::newRow("empty code") << QString() << 1.5 << QStringLiteral("1.5");
+    QTest::newRow("integer") << QStringLiteral("0") << 2.5 << QStringLiteral("3");
+    QTest::newRow("decimals") << QStringLiteral("0.00") << 2.675 << QStringLiteral("2.68");
+    QTest::newRow("negative") << QStringLiteral("0.00") << -1.5 << QStringLiteral("-1.50");
+    QTest::newRow("grouping") << QStringLiteral("#,##0") << 1234567.0
+                              << QStringLiteral("1,234,567");
+    QTest::newRow("zero integer") << QStringLiteral("#,##0.00") << 0.5 << QStringLiteral("0.50");
+    QTest::newRow("no integer") << QStringLiteral("#.00") << 0.5 << QStringLiteral(".50");
+    QTest::newRow("optional decimals") << QStringLiteral("0.0#") << 1.5 << QStringLiteral("1.5");
+    QTest::newRow("aligned decimals") << QStringLiteral("0.0?") << 1.5 << QStringLiteral("1.5 ");
+    QTest::newRow("percent") << QStringLiteral("0.00%") << 0.256 << QStringLiteral("25.60%");
+    QTest::newRow("thousands") << QStringLiteral("#,##0,") << 1234567.0 << QStringLiteral("1,235");
+    QTest::newRow("millions") << QStringLiteral("0.0,,") << 12345678.0 << QStringLiteral("12.3");
+    QTest::newRow("digits in literals") << QStringLiteral("000-00-0000") << 123456789.0
+                                        << QStringLiteral("123-45-6789");
+    QTest::newRow("scientific") << QStringLiteral("0.00E+00") << 12345.0
+                                << QStringLiteral("1.23E+04");
+    QTest::newRow("scientific small") << QStringLiteral("0.00E+00") << 0.00012
+                                      << QStringLiteral("1.20E-04");
+    QTest::newRow("scientific carry") << QStringLiteral("0.00E+00") << 9.999
+                                      << QStringLiteral("1.00E+01");
+    QTest::newRow("engineering") << QStringLiteral("##0.0E+0") << 12345.0
+                                 << QStringLiteral("12.3E+3");
+    QTest::newRow("fraction") << QStringLiteral("# ?/?") << 1.5 << QStringLiteral("1 1/2");
+    QTest::newRow("whole fraction") << QStringLiteral("# ?/?") << 3.0 << QStringLiteral("3    ");
+    QTest::newRow("fraction digits") << QStringLiteral("# ?\?/??") << 0.333
+                                     << QStringLiteral("  1/3 ");
+    QTest::newRow("fraction only") << QStringLiteral("?/???") << 3.14159265
+                                   << QStringLiteral("355/113");
+    QTest::newRow("fixed denominator") << QStringLiteral("# ?/8") << 2.25
+                                       << QStringLiteral("2 2/8");
+    QTest::newRow("literals") << QStringLiteral("0.0 \"kg\"") << 2.0 << QStringLiteral("2.0 kg");
+    QTest::newRow("escaped") << QStringLiteral("\\$0") << 2.0 << QStringLiteral("$2");
+    QTest::newRow("currency") << QString::fromUtf8("[$\xE2\x82\xAC-407]#,##0.00") << 1234.5
+                              << QString::fromUtf8("\xE2\x82\xAC" "1,234.50");
+    QTest::newRow("padding") << QStringLiteral("_($* #,##0.00_)") << 3.0
+                             << QStringLiteral(" $3.00 ");
+    QTest::newRow("general literal") << QStringLiteral("General\" kg\"") << 2.0
+                                     << QStringLiteral("2 kg");
+}
+
+void NumFormatterTest::testNumbers()
+{
+    QFETCH(QString, code);
+    QFETCH(double, value);
+    QFETCH(QString, text);
+
+    QCOMPARE(NumFormatter(code).format(value), text);
+}
+
+void NumFormatterTest::testDateTimes_data()
+{
+    QTest::addColumn<QString>("code");
+    QTest::addColumn<double>("value");
+    QTest::addColumn<bool>("date1904");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("short date") << QStringLiteral("m/d/yy") << 41640.0 << false
+                                << QStringLiteral("1/1/14");
+    QTest::newRow("iso date") << QStringLiteral("yyyy-mm-dd") << 41640.5 << false
+                              << QStringLiteral("2014-01-01");
+    QTest::newRow("month name") << QStringLiteral("mmmm d, yyyy") << 41640.0 << false
+                                << QStringLiteral("January 1, 2014");
+    QTest::newRow("short month") << QStringLiteral("d-mmm-yy") << 41640.0 << false
+                                 << QStringLiteral("1-Jan-14");
+    QTest::newRow("day name") << QStringLiteral("dddd") << 41640.0 << false
+                              << QStringLiteral("Wednesday");
+    QTest::newRow("leap day") << QStringLiteral("yyyy-mm-dd") << 60.0 << false
+                              << QStringLiteral("1900-02-29");
+    QTest::newRow("after leap day") << QStringLiteral("yyyy-mm-dd") << 61.0 << false
+                                    << QStringLiteral("1900-03-01");
+    QTest::newRow("day zero") << QStringLiteral("yyyy-mm-dd") << 0.0 << false
+                              << QStringLiteral("1900-01-00");
+    QTest::newRow("1904") << QStringLiteral("yyyy-mm-dd") << 0.0 << true
+                          << QStringLiteral("1904-01-01");
+    QTest::newRow("time") << QStringLiteral("h:mm") << 0.75 << false << QStringLiteral("18:00");
+    QTest::newRow("am pm") << QStringLiteral("h:mm AM/PM") << 0.75 << false
+                           << QStringLiteral("6:00 PM");
+    QTest::newRow("a p") << QStringLiteral("h:mm a/p") << 0.1 << false
+                         << QStringLiteral("2:24 a");
+    QTest::newRow("seconds") << QStringLiteral("hh:mm:ss") << 0.5 + 1.0 / 86400 << false
+                             << QStringLiteral("12:00:01");
+    QTest::newRow("fraction of second") << QStringLiteral("mm:ss.0") << 1.25 / 86400 << false
+                                        << QStringLiteral("00:01.3");
+    QTest::newRow("elapsed hours") << QStringLiteral("[h]:mm:ss") << 1.5 << false
+                                   << QStringLiteral("36:00:00");
+    QTest::newRow("elapsed minutes") << QStringLiteral("[mm]:ss") << 1.0 / 24 << false
+                                     << QStringLiteral("60:00");
+    QTest::newRow("rounded to next day") << QStringLiteral("m/d/yy h:mm") << 41640.999999
+                                         << false << QStringLiteral("1/2/14 0:00");
+    QTest::newRow("negative") << QStringLiteral("yyyy-mm-dd") << -1.0 << false
+                              << QStringLiteral("########");
+}
+
+void NumFormatterTest::testDateTimes()
+{
+    QFETCH(QString, code);
+    QFETCH(double, value);
+    QFETCH(bool, date1904);
+    QFETCH(QString, text);
+
+    QCOMPARE(NumFormatter(code).format(value, date1904), text);
+}
+
+void NumFormatterTest::testSections_data()
+{
+    QTest::addColumn<QString>("code");
+    QTest::addColumn<double>("value");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("positive") << QStringLiteral("#,##0_);(#,##0)") << 1234.0
+                              << QStringLiteral("1,234 ");
+    QTest::newRow("negative") << QStringLiteral("#,##0_);(#,##0)") << -1234.0
+                              << QStringLiteral("(1,234)");
+    QTest::newRow("zero") << QStringLiteral("0;-0;\"zero\"") << 0.0 << QStringLiteral("zero");
+    QTest::newRow("hidden zero") << QStringLiteral("0;-0;;@") << 0.0 << QString();
+    QTest::newRow("condition") << QStringLiteral("[>=100]\"big\";[<0]\"neg\"0;0") << 150.0
+                               << QStringLiteral("big");
+    QTest::newRow("negative condition") << QStringLiteral("[>=100]\"big\";[<0]\"neg\"0;0")
+                                        << -5.0 << QStringLiteral("neg5");
+    QTest::newRow("other values") << QStringLiteral("[>=100]\"big\";[<0]\"neg\"0;0") << 5.0
+                                  << QStringLiteral("5");
+    QTest::newRow("text only") << QStringLiteral("@") << 12.0 << QStringLiteral("12");
+}
+
+void NumFormatterTest::testSections()
+{
+    QFETCH(QString, code);
+    QFETCH(double, value);
+    QFETCH(QString, text);
+
+    QCOMPARE(NumFormatter(code).format(value), text);
+}
+
+void NumFormatterTest::testText()
+{
+    QCOMPARE(NumFormatter(QStringLiteral("0;-0;0;\"<\"@\">\"")).formatText(QStringLiteral("ab")),
+             QStringLiteral("<ab>"));
+    QCOMPARE(NumFormatter(QStringLiteral("\"Name: \"@")).formatText(QStringLiteral("ab")),
+             QStringLiteral("Name: ab"));
+    QCOMPARE(NumFormatter(QStringLiteral("0.00")).formatText(QStringLiteral("ab")),
+             QStringLiteral("ab"));
+}
+
+void NumFormatterTest::testColors()
+{
+    NumFormatter formatter(QStringLiteral("[Blue]0.00;[Red]0.00;[Color3]0"));
+    QColor color;
+    QCOMPARE(formatter.format(1, false, &color), QStringLiteral("1.00"));
+    QCOMPARE(color, QColor(Qt::blue));
+    QCOMPARE(formatter.format(-1, false, &color), QStringLiteral("1.00"));
+    QCOMPARE(color, QColor(Qt::red));
+    QCOMPARE(formatter.format(0, false, &color), QStringLiteral("0"));
+    QCOMPARE(color, QColor(Qt::red));
+
+    QCOMPARE(NumFormatter(QStringLiteral("0")).format(1, false, &color), QStringLiteral("1"));
+    QVERIFY(!color.isValid());
+}
+
+void NumFormatterTest::testIsDateTime()
+{
+    QVERIFY(NumFormatter(QStringLiteral("h:mm")).isDateTime());
+    QVERIFY(NumFormatter(QStringLiteral("[h]:mm")).isDateTime());
+    QVERIFY(!NumFormatter(QStringLiteral("0.00")).isDateTime());
+    QVERIFY(!NumFormatter(QStringLiteral("\"d\"0")).isDateTime());
+}
+
+QTEST_APPLESS_MAIN(NumFormatterTest)
+
+#include "tst_numformattertest.moc"
@@ -0,0 +1,93 @@
+#include "private/xlsxpixelaxis_p.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class PixelAxisTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    PixelAxisTest();
+
+private Q_SLOTS:
+    void testDefaultSize();
+    void testRuns();
+    void testHiddenRuns();
+};
+
+PixelAxisTest::PixelAxisTest()
+{
+}
+
+void PixelAxisTest::testDefaultSize()
+{
+    PixelAxis axis(20);
+    QCOMPARE(axis.size(7), 20);
+    QCOMPARE(axis.offset(1), qint64(0));
+    QCOMPARE(axis.offset(1048576), qint64(1048575) * 20);
+
+    int remainder = -1;
+    QCOMPARE(axis.indexAt(0, &remainder), 1);
+    QCOMPARE(remainder, 0);
+    QCOMPARE(axis.indexAt(45, &remainder), 3);
+    QCOMPARE(remainder, 5);
+}
+
+void PixelAxisTest::testRuns()
+{
+    // Rows 3 to 4 are 50 pixels high and row 10 is 5 pixels high
+    PixelAxis axis(20);
+    axis.addRun(3, 4, 50);
+    axis.addRun(10, 10, 5);
+
+    QCOMPARE(axis.size(2), 20);
+    QCOMPARE(axis.size(4), 50);
+    QCOMPARE(axis.size(10), 5);
+    QCOMPARE(axis.offset(3), qint64(40));
+    QCOMPARE(axis.offset(4), qint64(90));
+    QCOMPARE(axis.offset(5), qint64(140));
+    QCOMPARE(axis.offset(10), qint64(240));
+    QCOMPARE(axis.offset(11), qint64(245));
+    QCOMPARE(axis.offset(12), qint64(265));
+
+    int remainder = -1;
+    QCOMPARE(axis.indexAt(39, &remainder), 2);
+    QCOMPARE(remainder, 19);
+    QCOMPARE(axis.indexAt(100, &remainder), 4);
+    QCOMPARE(remainder, 10);
+    QCOMPARE(axis.indexAt(150, &remainder), 5);
+    QCOMPARE(remainder, 10);
+    QCOMPARE(axis.indexAt(243, &remainder), 10);
+    QCOMPARE(remainder, 3);
+    QCOMPARE(axis.indexAt(245, &remainder), 11);
+    QCOMPARE(remainder, 0);
+
+    // Every pixel belongs to the index found for it
+    for (qint64 pixel = 0; pixel < 400; ++pixel) {
+        const int index = axis.indexAt(pixel, &remainder);
+        QVERIFY(axis.offset(index) <= pixel);
+        QVERIFY(pixel < axis.offset(index + 1));
+        QCOMPARE(axis.offset(index) + remainder, pixel);
+    }
+}
+
+void PixelAxisTest::testHiddenRuns()
+{
+    PixelAxis axis(20);
+    axis.addRun(2, 3, 0);
+    axis.addRun(4, 4, 10);
+    axis.addRun(6, 6, 0);
+
+    QCOMPARE(axis.offset(4), qint64(20));
+    QCOMPARE(axis.offset(7), qint64(50));
+    QCOMPARE(axis.indexAt(20), 4);
+    QCOMPARE(axis.indexAt(30), 5);
+    QCOMPARE(axis.indexAt(50), 7);
+    QCOMPARE(axis.indexAt(-5), 1);
+}
+
+QTEST_APPLESS_MAIN(PixelAxisTest)
+
+#include "tst_pixelaxistest.moc"
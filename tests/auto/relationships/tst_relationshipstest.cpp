@@ -12,6 +12,7 @@ public:
 private Q_SLOTS:
     void testSaveXml();
     void testLoadXml();
+    void testLookup();
 };
 
 RelationshipsTest::RelationshipsTest()
@@ -27,6 +28,15 @@ void RelationshipsTest::testSaveXml()
     QByteArray xmldata = rels.saveToXmlData();
 
     QVERIFY2(xmldata.contains("<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"xl/workbook.xml\"/>"), "");
+
+    rels.addWorksheetRelationship("/hyperlink", "http://a.b/?x=1&y=\"2\"", "External");
+    xmldata = rels.saveToXmlData();
+    QVERIFY2(xmldata.contains("<Relationship Id=\"rId2\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/hyperlink\" Target=\"http://a.b/?x=1&amp;y=&quot;2&quot;\" TargetMode=\"External\"/>"), "");
+
+    QXlsx::Relationships loaded;
+    QVERIFY(loaded.loadFromXmlData(xmldata));
+    QCOMPARE(loaded.worksheetRelationships("/hyperlink").first().target,
+             QString("http://a.b/?x=1&y=\"2\""));
 }
 
 void RelationshipsTest::testLoadXml()
@@ -42,6 +52,35 @@ void RelationshipsTest::testLoadXml()
     QCOMPARE(rels.documentRelationships("/officeDocument").size(), 1);
 }
 
+void RelationshipsTest::testLookup()
+{
+    QXlsx::Relationships rels;
+    for (int i = 0; i < 1000; ++i) {
+        rels.addDocumentRelationship("/drawing", QString("../drawings/drawing%1.xml").arg(i));
+        rels.addDocumentRelationship("/image", QString("../media/image%1.png").arg(i));
+    }
+    rels.addPackageRelationship("/metadata/core-properties", "docProps/core.xml");
+
+    QList<QXlsx::XlsxRelationship> images = rels.documentRelationships("/image");
+    QCOMPARE(images.size(), 1000);
+    QCOMPARE(images[10].target, QString("../media/image10.png"));
+    QCOMPARE(images[10].id, QString("rId22"));
+    QCOMPARE(rels.getRelationshipById("rId22").target, QString("../media/image10.png"));
+    QCOMPARE(rels.packageRelationships("/metadata/core-properties").size(), 1);
+    QVERIFY(rels.documentRelationships("/chart").isEmpty());
+    QVERIFY(rels.getRelationshipById("rId2002").id.isEmpty());
+
+    // The first of the relationships sharing an id is found
+    QByteArray xmldata("<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+                       "<Relationship Id=\"rId1\" Type=\"a\" Target=\"first\"/>"
+                       "<Relationship Id=\"rId1\" Type=\"a\" Target=\"second\"/>"
+                       "</Relationships>");
+    QVERIFY(rels.loadFromXmlData(xmldata));
+    QCOMPARE(rels.count(), 2);
+    QCOMPARE(rels.getRelationshipById("rId1").target, QString("first"));
+    QVERIFY(rels.documentRelationships("/image").isEmpty());
+}
+
 QTEST_APPLESS_MAIN(RelationshipsTest)
 
 #include "tst_relationshipstest.moc"
@@ -11,6 +11,8 @@ public:
 
 private Q_SLOTS:
     void testEqual();
+    void testMove();
+    void testHash();
 };
 
 RichstringTest::RichstringTest()
@@ -36,6 +38,62 @@ void RichstringTest::testEqual()
     QVERIFY2(rs2 != QStringLiteral("Hello Qt!"), "Failure");
 }
 
+void RichstringTest::testMove()
+{
+    QXlsx::Format format;
+    format.setFontBold(true);
+    QString text = QStringLiteral("Hello");
+
+    QXlsx::RichString rs;
+    rs.addFragment(std::move(text), std::move(format));
+    rs.addFragment(QStringLiteral(" Qt!"), QXlsx::Format());
+    QCOMPARE(rs.fragmentCount(), 2);
+    QCOMPARE(rs.fragmentText(0), QStringLiteral("Hello"));
+    QVERIFY(rs.fragmentFormat(0).fontBold());
+    QCOMPARE(rs.toPlainString(), QStringLiteral("Hello Qt!"));
+
+    QXlsx::RichString rs2(std::move(rs));
+    QCOMPARE(rs2.toPlainString(), QStringLiteral("Hello Qt!"));
+
+    QXlsx::RichString rs3;
+    rs3 = std::move(rs2);
+    QCOMPARE(rs3.toPlainString(), QStringLiteral("Hello Qt!"));
+    QCOMPARE(rs2.fragmentCount(), 0);
+}
+
+void RichstringTest::testHash()
+{
+    QXlsx::RichString plain(QStringLiteral("Hello Qt!"));
+    QXlsx::RichString plain2;
+    plain2.addFragment(QStringLiteral("Hello Qt!"), QXlsx::Format());
+    QVERIFY(plain == plain2);
+    QCOMPARE(qHash(plain, 7), qHash(plain2, 7));
+
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    QXlsx::RichString rs;
+    rs.addFragment(QStringLiteral("Hello"), bold);
+    rs.addFragment(QStringLiteral(" Qt!"), QXlsx::Format());
+    QXlsx::RichString rs2;
+    rs2.addFragment(QStringLiteral("Hello"), QXlsx::Format());
+    rs2.addFragment(QStringLiteral(" Qt!"), QXlsx::Format());
+    QVERIFY(rs != rs2);
+
+    QXlsx::RichString rs3(rs);
+    QVERIFY(rs3 == rs);
+    QCOMPARE(qHash(rs3, 7), qHash(rs, 7));
+    QVERIFY(qHash(rs, 7) == qHash(rs, 7));
+
+    // The cached hash must follow the added fragments
+    const uint oldHash = qHash(rs3, 7);
+    rs3.addFragment(QStringLiteral(" Again"), QXlsx::Format());
+    QVERIFY(rs3 != rs);
+    QVERIFY(qHash(rs3, 7) != oldHash);
+    rs.addFragment(QStringLiteral(" Again"), QXlsx::Format());
+    QVERIFY(rs3 == rs);
+    QCOMPARE(qHash(rs3, 7), qHash(rs, 7));
+}
+
 QTEST_APPLESS_MAIN(RichstringTest)
 
 #include "tst_richstringtest.moc"
@@ -4,6 +4,10 @@
 #include <QString>
 #include <QtTest>
 #include <QXmlStreamReader>
+#include <QThread>
+#include <QBuffer>
+
+#include <climits>
 
 class SharedStringsTest : public QObject
 {
@@ -15,9 +19,15 @@ public:
 private Q_SLOTS:
     void testAddSharedString();
     void testRemoveSharedString();
+    void testCompaction();
+    void testCompact();
+    void testThreadSafe();
 
     void testLoadXmlData();
     void testLoadRichStringXmlData();
+    void testRunFormatsShared();
+    void testLoadLargeXmlData();
+    void testLoadPhoneticXmlData();
 
 };
 
@@ -99,6 +109,114 @@ void SharedStringsTest::testRemoveSharedString()
     QCOMPARE(uniqueCount, 2);
 }
 
+void SharedStringsTest::testCompaction()
+{
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_NewFromScratch);
+    QCOMPARE(sst.addSharedString("Hello"), 0);
+    QCOMPARE(sst.addSharedString("Qt"), 1);
+    QCOMPARE(sst.addSharedString("Xlsx"), 2);
+
+    //Released strings are dropped from the saved table.
+    sst.decRefByStringIndex(1);
+    QCOMPARE(sst.getSharedStringIndex("Qt"), -1);
+    QCOMPARE(sst.getSharedPlainString(2), QStringLiteral("Xlsx"));
+    QCOMPARE(sst.saveIndex(0), 0);
+    QCOMPARE(sst.saveIndex(1), -1);
+    QCOMPARE(sst.saveIndex(2), 1);
+
+    QSharedPointer<QXlsx::SharedStrings> sst2(new QXlsx::SharedStrings(QXlsx::SharedStrings::F_LoadFromExists));
+    sst2->loadFromXmlData(sst.saveToXmlData());
+    QCOMPARE(sst2->getSharedPlainString(0), QStringLiteral("Hello"));
+    QCOMPARE(sst2->getSharedPlainString(1), QStringLiteral("Xlsx"));
+
+    //The slot is reused, and the other indexes are kept.
+    QCOMPARE(sst.addSharedString("World"), 1);
+    QCOMPARE(sst.getSharedStringIndex("Xlsx"), 2);
+    QCOMPARE(sst.saveIndex(1), 1);
+    QCOMPARE(sst.saveIndex(2), 2);
+
+    //Written indexes are kept unchanged once compaction is disabled.
+    sst.decRefByStringIndex(0);
+    sst.disableCompaction();
+    QCOMPARE(sst.saveIndex(2), 2);
+}
+
+void SharedStringsTest::testCompact()
+{
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_NewFromScratch);
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    QXlsx::RichString rich;
+    rich.addFragment("Rich", bold);
+    rich.addFragment(" text", QXlsx::Format());
+    sst.addSharedString("Hello");
+    sst.addSharedString("Qt");
+    sst.addSharedString(rich);
+    sst.addSharedString("Xlsx");
+    const int generation = sst.saveIndexGeneration();
+    sst.decRefByStringIndex(1);
+
+    //The kept strings move down, their saved indexes don't change.
+    QVector<int> indexMap;
+    QVERIFY(sst.compact(&indexMap));
+    QCOMPARE(indexMap, QVector<int>() << 0 << -1 << 1 << 2);
+    QCOMPARE(sst.slotCount(), 3);
+    QVERIFY(sst.hasStableIndices());
+    QCOMPARE(sst.getSharedStringIndex("Xlsx"), 2);
+    QCOMPARE(sst.getSharedStringIndex(rich), 1);
+    QVERIFY(sst.getSharedString(1).isRichString());
+    QCOMPARE(sst.firstChangedSaveIndex(generation), 1);
+    QCOMPARE(sst.firstChangedSaveIndex(sst.saveIndexGeneration()), INT_MAX);
+
+    QVERIFY(!sst.compact(&indexMap));
+    QVERIFY(indexMap.isEmpty());
+    QCOMPARE(sst.addSharedString("World"), 3);
+
+    //Written indexes are kept unchanged once compaction is disabled.
+    sst.decRefByStringIndex(0);
+    sst.disableCompaction();
+    QVERIFY(!sst.compact(&indexMap));
+    QCOMPARE(sst.slotCount(), 4);
+}
+
+class AddStringsThread : public QThread
+{
+public:
+    AddStringsThread(QXlsx::SharedStrings *sst)
+        : sst(sst)
+    {
+    }
+
+    void run()
+    {
+        for (int i = 0; i < 10000; ++i) {
+            int idx = sst->addSharedString(QString::number(i % 100));
+            if (i % 2)
+                sst->decRefByStringIndex(idx);
+        }
+    }
+
+    QXlsx::SharedStrings *sst;
+};
+
+void SharedStringsTest::testThreadSafe()
+{
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_NewFromScratch);
+    sst.setThreadSafe(true);
+
+    AddStringsThread thread1(&sst);
+    AddStringsThread thread2(&sst);
+    thread1.start();
+    thread2.start();
+    thread1.wait();
+    thread2.wait();
+
+    // The odd strings are released again, each even one is referenced 200 times
+    QCOMPARE(sst.count(), 10000);
+    for (int i = 0; i < 100; ++i)
+        QCOMPARE(sst.getSharedStringIndex(QString::number(i)) != -1, i % 2 == 0);
+}
+
 void SharedStringsTest::testLoadXmlData()
 {
     QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_NewFromScratch);
@@ -159,6 +277,97 @@ void SharedStringsTest::testLoadRichStringXmlData()
     QCOMPARE(format.fontSize(), 11);
 }
 
+void SharedStringsTest::testRunFormatsShared()
+{
+    QByteArray xmlData = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+            "<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" count=\"2\" uniqueCount=\"2\">"
+            "<si><r><rPr><b/><sz val=\"11\"/></rPr><t>Item</t></r><r><t> 1</t></r></si>"
+            "<si><r><rPr><b/><sz val=\"11\"/></rPr><t>Item</t></r><r><t> 2</t></r></si>"
+            "</sst>";
+
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_LoadFromExists);
+    sst.loadFromXmlData(xmlData);
+
+    // The runs of both strings hold the same format, whose indexes are shared
+    QXlsx::Format format = sst.getSharedString(0).fragmentFormat(0);
+    QVERIFY(format.fontBold());
+    format.setFontIndex(7);
+    QXlsx::Format other = sst.getSharedString(1).fragmentFormat(0);
+    QVERIFY(other.fontIndexValid());
+    QCOMPARE(other.fontIndex(), 7);
+
+    // So do the strings added with formats of their own
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    bold.setFontSize(11);
+    QXlsx::RichString rs;
+    rs.addFragment("Item", bold);
+    rs.addFragment(" 3", QXlsx::Format());
+    const int index = sst.addSharedString(rs);
+    QCOMPARE(sst.getSharedString(index).fragmentFormat(0).fontIndex(), 7);
+    QCOMPARE(sst.getSharedStringIndex(rs), index);
+    QCOMPARE(sst.addSharedString(rs), index);
+}
+
 QTEST_APPLESS_MAIN(SharedStringsTest)
 
+void SharedStringsTest::testLoadLargeXmlData()
+{
+    // Big enough to be read in slices by several threads
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_NewFromScratch);
+    QXlsx::RichString rs;
+    rs.addFragment("Hello", QXlsx::Format());
+    rs.addFragment(" RichText", QXlsx::Format());
+    const int count = 200000;
+    for (int i = 0; i < count; ++i) {
+        if (i % 1000 == 0)
+            sst.addSharedString(rs);
+        sst.addSharedString(QString("string number %1 & <text>").arg(i));
+    }
+    QByteArray xmlData = sst.saveToXmlData();
+    QVERIFY(xmlData.size() > 4 * 1024 * 1024);
+
+    QXlsx::SharedStrings sst2(QXlsx::SharedStrings::F_LoadFromExists);
+    QVERIFY(sst2.loadFromXmlData(xmlData));
+    QCOMPARE(sst2.slotCount(), sst.slotCount());
+    QCOMPARE(sst2.getSharedString(0), rs);
+    QCOMPARE(sst2.getSharedPlainString(1), QString("string number 0 & <text>"));
+    QCOMPARE(sst2.getSharedPlainString(sst2.slotCount() - 1),
+             QString("string number %1 & <text>").arg(count - 1));
+    QCOMPARE(sst2.getSharedStringIndex(QString("string number 999 & <text>")), 1000);
+    QCOMPARE(sst2.getSharedStringIndex(rs), 0);
+    QVERIFY(!sst2.isDirty());
+}
+
+void SharedStringsTest::testLoadPhoneticXmlData()
+{
+    // The phonetic runs aren't part of the text
+    QByteArray xmlData = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+            "<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\""
+            " count=\"2\" uniqueCount=\"2\">"
+            "<si><t>a&amp;&#x41;</t><rPh sb=\"0\" eb=\"1\"><t>phonetic</t></rPh>"
+            "<phoneticPr fontId=\"1\"/></si>"
+            "<!-- comment --><si><t><![CDATA[<b>]]></t></si>"
+            "</sst>";
+
+    QXlsx::SharedStrings sst(QXlsx::SharedStrings::F_LoadFromExists);
+    QVERIFY(sst.loadFromXmlData(xmlData));
+    QCOMPARE(sst.getSharedPlainString(0), QString("a&A"));
+    QCOMPARE(sst.getSharedPlainString(1), QString("<b>"));
+    QVERIFY(!sst.isDirty());
+
+    // The same through QXmlStreamReader
+    QBuffer buffer(&xmlData);
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::SharedStrings sst2(QXlsx::SharedStrings::F_LoadFromExists);
+    QVERIFY(sst2.loadFromXmlFile(&buffer));
+    QCOMPARE(sst2.getSharedPlainString(0), QString("a&A"));
+    QCOMPARE(sst2.getSharedPlainString(1), QString("<b>"));
+
+    // A wrong count is an error
+    xmlData.replace("uniqueCount=\"2\"", "uniqueCount=\"3\"");
+    QXlsx::SharedStrings sst3(QXlsx::SharedStrings::F_LoadFromExists);
+    QVERIFY(!sst3.loadFromXmlData(xmlData));
+}
+
 #include "tst_sharedstringstest.moc"
@@ -0,0 +1,13 @@
+QT       += testlib xlsx
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_sheetappendertest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_sheetappendertest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
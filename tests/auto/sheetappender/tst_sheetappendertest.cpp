@@ -0,0 +1,206 @@
+#include "xlsxdocument.h"
+#include "xlsxsheetappender.h"
+#include "xlsxsheetreader.h"
+#include "private/xlsxzipreader_p.h"
+#include <QString>
+#include <QtTest>
+#include <QBuffer>
+
+QTXLSX_USE_NAMESPACE
+
+class SheetAppenderTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetAppenderTest();
+
+private Q_SLOTS:
+    void testAppendRows();
+    void testEmptySheet();
+    void testOtherPartsCopied();
+    void testSave();
+    void testFailedSave();
+    void testInvalid();
+};
+
+SheetAppenderTest::SheetAppenderTest()
+{
+}
+
+void SheetAppenderTest::testAppendRows()
+{
+    QByteArray package;
+    QBuffer device(&package);
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    xlsx1.write("A1", "Name");
+    xlsx1.write("B1", "Count");
+    for (int row = 2; row <= 100; ++row) {
+        xlsx1.write(row, 1, QString("Item %1").arg(row));
+        xlsx1.write(row, 2, row);
+    }
+    xlsx1.addSheet("Second");
+    xlsx1.write("A1", "Other");
+    xlsx1.saveAs(&device);
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    SheetAppender appender(&device);
+    QVERIFY(appender.isValid());
+    QCOMPARE(appender.sheetName(), QStringLiteral("Sheet1"));
+    QCOMPARE(appender.lastRow(), 100);
+    QCOMPARE(appender.appendRow(QList<QVariant>() << "Appended" << 12.5 << true), 101);
+    QCOMPARE(appender.appendRow(QList<QVariant>() << QVariant() << " spaced "), 102);
+    QCOMPARE(appender.appendedRowCount(), 2);
+
+    QByteArray appended;
+    QBuffer output(&appended);
+    output.open(QIODevice::WriteOnly);
+    QVERIFY(appender.saveAs(&output));
+    output.close();
+
+    output.open(QIODevice::ReadOnly);
+    Document xlsx2(&output);
+    QCOMPARE(xlsx2.sheetNames(), QStringList() << "Sheet1" << "Second");
+    QCOMPARE(xlsx2.read("A50").toString(), QStringLiteral("Item 50"));
+    QCOMPARE(xlsx2.read("A101").toString(), QStringLiteral("Appended"));
+    QCOMPARE(xlsx2.read("B101").toDouble(), 12.5);
+    QCOMPARE(xlsx2.read("C101"), QVariant(true));
+    QVERIFY(!xlsx2.read("A102").isValid());
+    QCOMPARE(xlsx2.read("B102").toString(), QStringLiteral(" spaced "));
+    QCOMPARE(xlsx2.dimension().toString(), QStringLiteral("A1:C102"));
+    QVERIFY(xlsx2.selectSheet("Second"));
+    QCOMPARE(xlsx2.read("A1").toString(), QStringLiteral("Other"));
+}
+
+void SheetAppenderTest::testEmptySheet()
+{
+    QByteArray package;
+    QBuffer device(&package);
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    xlsx1.write("A1", "First");
+    xlsx1.addSheet("Empty");
+    xlsx1.saveAs(&device);
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    SheetAppender appender(&device, "Empty");
+    QVERIFY(appender.isValid());
+    QCOMPARE(appender.lastRow(), 0);
+    QCOMPARE(appender.appendRow(QList<QVariant>() << 1 << 2), 1);
+
+    QByteArray appended;
+    QBuffer output(&appended);
+    output.open(QIODevice::WriteOnly);
+    QVERIFY(appender.saveAs(&output));
+    output.close();
+
+    output.open(QIODevice::ReadOnly);
+    SheetReader reader(&output, "Empty");
+    QVERIFY(reader.nextRow());
+    QCOMPARE(reader.row(), 1);
+    QCOMPARE(reader.cellCount(), 2);
+    QCOMPARE(reader.value(1).toDouble(), 2.0);
+    QVERIFY(!reader.nextRow());
+}
+
+void SheetAppenderTest::testOtherPartsCopied()
+{
+    QByteArray package;
+    QBuffer device(&package);
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    xlsx1.write("A1", "Hello");
+    xlsx1.saveAs(&device);
+    device.close();
+
+    device.open(QIODevice::ReadOnly);
+    SheetAppender appender(&device);
+    appender.appendRow(QList<QVariant>() << "World");
+    QByteArray appended;
+    QBuffer output(&appended);
+    output.open(QIODevice::WriteOnly);
+    QVERIFY(appender.saveAs(&output));
+    output.close();
+
+    // The strings of the new rows are inline, the shared strings are kept
+    ZipReader source(&device);
+    ZipReader result(&output);
+    QCOMPARE(result.filePaths(), source.filePaths());
+    QCOMPARE(result.fileData("xl/sharedStrings.xml"), source.fileData("xl/sharedStrings.xml"));
+    QCOMPARE(result.fileData("xl/styles.xml"), source.fileData("xl/styles.xml"));
+    QVERIFY(result.fileData("xl/worksheets/sheet1.xml").contains("t=\"inlineStr\""));
+}
+
+void SheetAppenderTest::testSave()
+{
+    const QString fileName = QStringLiteral("sheetappender_test.xlsx");
+    Document xlsx1;
+    xlsx1.write("A1", 1);
+    QVERIFY(xlsx1.saveAs(fileName));
+
+    {
+        SheetAppender appender(fileName);
+        QCOMPARE(appender.lastRow(), 1);
+        appender.appendRow(QList<QVariant>() << 2);
+        QVERIFY(appender.save());
+        // More rows follow the saved ones
+        QCOMPARE(appender.lastRow(), 2);
+        QCOMPARE(appender.appendedRowCount(), 0);
+        QCOMPARE(appender.appendRow(QList<QVariant>() << 3), 3);
+        QVERIFY(appender.save());
+    }
+
+    Document xlsx2(fileName);
+    QCOMPARE(xlsx2.read("A2").toInt(), 2);
+    QCOMPARE(xlsx2.read("A3").toInt(), 3);
+    QFile::remove(fileName);
+}
+
+void SheetAppenderTest::testFailedSave()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/failed.xlsx");
+    Document xlsx1;
+    xlsx1.write("A1", 1);
+    QVERIFY(xlsx1.saveAs(fileName));
+
+    SheetAppender appender(fileName);
+    appender.appendRow(QList<QVariant>() << 2);
+    const QFile::Permissions permissions = QFile::permissions(dir.path());
+    QVERIFY(QFile::setPermissions(dir.path(), QFile::ReadOwner | QFile::ExeOwner));
+    QFile probe(dir.path() + QStringLiteral("/probe"));
+    if (probe.open(QIODevice::WriteOnly)) {
+        probe.close();
+        probe.remove();
+        QFile::setPermissions(dir.path(), permissions);
+        QSKIP("The directory can still be written, such as by root");
+    }
+
+    // The source can't be replaced, the appender and its rows are kept
+    QVERIFY(!appender.save());
+    QFile::setPermissions(dir.path(), permissions);
+    QVERIFY(appender.isValid());
+    QCOMPARE(appender.lastRow(), 1);
+    QCOMPARE(appender.appendedRowCount(), 1);
+
+    QVERIFY(appender.save());
+    QCOMPARE(appender.lastRow(), 2);
+    Document xlsx2(fileName);
+    QCOMPARE(xlsx2.read("A2").toInt(), 2);
+}
+
+void SheetAppenderTest::testInvalid()
+{
+    SheetAppender appender(QStringLiteral("no_such_file.xlsx"));
+    QVERIFY(!appender.isValid());
+    QCOMPARE(appender.appendRow(QList<QVariant>() << 1), -1);
+    QVERIFY(!appender.save());
+}
+
+QTEST_APPLESS_MAIN(SheetAppenderTest)
+
+#include "tst_sheetappendertest.moc"
@@ -0,0 +1,222 @@
+#include "private/xlsxsheetdatawriter_p.h"
+#include <QString>
+#include <QBuffer>
+#include <QXmlStreamReader>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class SheetDataWriterTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetDataWriterTest();
+
+private Q_SLOTS:
+    void testNumbers();
+    void testNumbers_data();
+    void testCellReference();
+    void testEscaped();
+    void testEscapedAttribute();
+    void testEscapedLongText();
+    void testEscapedAtBufferEnd();
+    void testEscapedAtBufferEnd_data();
+    void testTextElement();
+    void testLargeData();
+};
+
+SheetDataWriterTest::SheetDataWriterTest()
+{
+}
+
+void SheetDataWriterTest::testNumbers_data()
+{
+    QTest::addColumn<double>("value");
+
+    QTest::newRow("zero") << 0.0;
+    QTest::newRow("integer") << 12345.0;
+    QTest::newRow("negative") << -42.0;
+    QTest::newRow("fraction") << 3.14159265358979;
+    QTest::newRow("17 digits") << 0.1 + 0.2;
+    QTest::newRow("small") << 0.00001;
+    QTest::newRow("large") << 1e20;
+    QTest::newRow("precision") << 123456789012345.0;
+    QTest::newRow("exponent") << 1234567890123456.0;
+}
+
+void SheetDataWriterTest::testNumbers()
+{
+    QFETCH(double, value);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeDouble(value);
+    }
+    // Shortest text which reads back as the same value
+    QCOMPARE(buffer.data().toDouble(), value);
+    QVERIFY(buffer.data().size() <= QString::number(value, 'g', 17).size());
+}
+
+void SheetDataWriterTest::testCellReference()
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeCellReference(1, 1);
+        writer.writeRaw(" ");
+        writer.writeCellReference(20, 26);
+        writer.writeRaw(" ");
+        writer.writeCellReference(3, 27);
+        writer.writeRaw(" ");
+        writer.writeCellReference(1048576, 16384);
+        writer.writeRaw(" ");
+        writer.writeInt(-1234567890123LL);
+
+        // Cached column letters and row digits
+        writer.reserveColumns(28);
+        writer.writeRaw(" ");
+        writer.writeCellReference(3, 27);
+        writer.writeRaw(" ");
+        writer.writeCellReference(3, 28);
+        writer.writeRaw(" ");
+        writer.writeCellReference(20, 26);
+        writer.writeRaw(" ");
+        writer.writeCellReference(20, 16384);
+    }
+    QCOMPARE(buffer.data(),
+             QByteArray("A1 Z20 AA3 XFD1048576 -1234567890123 AA3 AB3 Z20 XFD20"));
+}
+
+void SheetDataWriterTest::testEscaped()
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeEscaped(QString::fromUtf8("a<b>&\"c\r\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80"));
+    }
+    QCOMPARE(buffer.data(),
+             QByteArray("a&lt;b&gt;&amp;\"c&#13;\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80"));
+}
+
+void SheetDataWriterTest::testEscapedAttribute()
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeEscapedAttribute(QString::fromUtf8("a<\"b\"&\n\t\xc3\xa9"));
+    }
+    QCOMPARE(buffer.data(), QByteArray("a&lt;&quot;b&quot;&amp;&#10;&#9;\xc3\xa9"));
+}
+
+void SheetDataWriterTest::testEscapedLongText()
+{
+    // Special and non ASCII characters at every position of the blocks,
+    // and runs crossing the end of the buffer
+    QString text;
+    QByteArray expected;
+    const char *const words[] = {"plain", "<", "ab&cd", "\r", "\xc3\xa9", "\"", "0123456789abc"};
+    const char *const escaped[] = {"plain", "&lt;", "ab&amp;cd", "&#13;", "\xc3\xa9", "\"",
+                                   "0123456789abc"};
+    for (int i = 0; i < 8000; ++i) {
+        const int word = (i * 5 + i / 7) % 7;
+        text.append(QString::fromUtf8(words[word]));
+        expected.append(escaped[word]);
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeRaw("x");
+        writer.writeEscaped(text);
+    }
+    QCOMPARE(buffer.data(), QByteArray("x") + expected);
+}
+
+void SheetDataWriterTest::testEscapedAtBufferEnd_data()
+{
+    QTest::addColumn<QString>("last");
+
+    QTest::newRow("entity") << QStringLiteral("&");
+    QTest::newRow("quote") << QStringLiteral("\"");
+    QTest::newRow("non ascii") << QString::fromUtf8("\xc3\xa9");
+    QTest::newRow("surrogate pair") << QString::fromUtf8("\xf0\x9f\x98\x80");
+}
+
+void SheetDataWriterTest::testEscapedAtBufferEnd()
+{
+    QFETCH(QString, last);
+
+    // A run of plain ASCII which fills the buffer up to its last byte,
+    // followed by a character which needs several bytes
+    const QString text = QString(16383, QLatin1Char('a')) + last;
+    for (int attribute = 0; attribute < 2; ++attribute) {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        {
+            SheetDataWriter writer(&buffer);
+            writer.writeRaw("<c r=\"");
+            if (attribute)
+                writer.writeEscapedAttribute(text);
+            writer.writeRaw("\">");
+            if (!attribute)
+                writer.writeTextElement(text);
+            writer.writeRaw("</c>");
+        }
+
+        QXmlStreamReader reader(buffer.data());
+        QVERIFY(reader.readNextStartElement());
+        if (attribute) {
+            QCOMPARE(reader.attributes().value(QLatin1String("r")).toString(), text);
+        } else {
+            QVERIFY(reader.readNextStartElement());
+            QCOMPARE(reader.readElementText(), text);
+        }
+        QVERIFY(!reader.hasError());
+    }
+}
+
+void SheetDataWriterTest::testTextElement()
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        writer.writeTextElement(QStringLiteral("a b"));
+        writer.writeTextElement(QStringLiteral(" a<b"));
+        writer.writeTextElement(QStringLiteral("a\n"));
+        writer.writeTextElement(QString());
+    }
+    QCOMPARE(buffer.data(), QByteArray("<t>a b</t><t xml:space=\"preserve\"> a&lt;b</t>"
+                                       "<t xml:space=\"preserve\">a\n</t><t></t>"));
+}
+
+void SheetDataWriterTest::testLargeData()
+{
+    QByteArray expected;
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SheetDataWriter writer(&buffer);
+        for (int i = 0; i < 10000; ++i) {
+            writer.writeRaw("<v>");
+            writer.writeInt(i);
+            writer.writeRaw("</v>");
+            expected.append("<v>").append(QByteArray::number(i)).append("</v>");
+        }
+        const QByteArray big(100 * 1024, 'x');
+        writer.writeRaw(big.constData(), big.size());
+        expected.append(big);
+    }
+    QCOMPARE(buffer.data(), expected);
+}
+
+QTEST_APPLESS_MAIN(SheetDataWriterTest)
+
+#include "tst_sheetdatawritertest.moc"
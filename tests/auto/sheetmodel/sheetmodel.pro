@@ -0,0 +1,13 @@
+QT       += testlib xlsx
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_sheetmodeltest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_sheetmodeltest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
@@ -0,0 +1,125 @@
+#include "xlsxdocument.h"
+#include "xlsxformat.h"
+#include "xlsxsheetmodel.h"
+#include "xlsxworksheet.h"
+#include <QSignalSpy>
+#include <QString>
+#include <QtTest>
+
+QTXLSX_USE_NAMESPACE
+
+class SheetModelTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetModelTest();
+
+private Q_SLOTS:
+    void testData();
+    void testSetData();
+    void testInvalidate();
+    void testScrolling();
+};
+
+SheetModelTest::SheetModelTest()
+{
+}
+
+void SheetModelTest::testData()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    Format format;
+    format.setHorizontalAlignment(Format::AlignRight);
+    sheet->write(1, 1, QStringLiteral("Hello"));
+    sheet->write(1, 2, 12.5, format);
+    sheet->write(2, 1, true);
+    sheet->write(3, 3, QDate(2014, 3, 1));
+
+    SheetModel model(sheet);
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(model.columnCount(), 3);
+    QCOMPARE(model.data(model.index(0, 0)).toString(), QStringLiteral("Hello"));
+    QCOMPARE(model.data(model.index(0, 1)).toDouble(), 12.5);
+    QCOMPARE(model.data(model.index(1, 0)).toBool(), true);
+    QCOMPARE(model.data(model.index(2, 2)).toDate(), QDate(2014, 3, 1));
+    QVERIFY(!model.data(model.index(2, 0)).isValid());
+    QCOMPARE(model.data(model.index(1, 0), SheetModel::DisplayTextRole).toString(),
+             QStringLiteral("TRUE"));
+    QCOMPARE(model.data(model.index(0, 1), SheetModel::DisplayTextRole).toString(),
+             QStringLiteral("12.5"));
+
+    QCOMPARE(Qt::Alignment(model.data(model.index(0, 1), Qt::TextAlignmentRole).toInt()),
+             Qt::Alignment(Qt::AlignRight));
+    QCOMPARE(model.headerData(27, Qt::Horizontal).toString(), QStringLiteral("AB"));
+    QCOMPARE(model.headerData(4, Qt::Vertical).toString(), QStringLiteral("5"));
+}
+
+void SheetModelTest::testSetData()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->write(1, 1, 1);
+    sheet->write(2, 2, 2);
+
+    SheetModel model(sheet);
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 1);
+
+    QSignalSpy spy(&model, SIGNAL(dataChanged(QModelIndex, QModelIndex)));
+    QVERIFY(model.setData(model.index(0, 0), QStringLiteral("Changed")));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(model.data(model.index(0, 0)).toString(), QStringLiteral("Changed"));
+    QCOMPARE(sheet->read(1, 1).toString(), QStringLiteral("Changed"));
+    QCOMPARE(model.data(model.index(0, 0), Qt::EditRole).toString(), QStringLiteral("Changed"));
+}
+
+void SheetModelTest::testInvalidate()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->write(1, 1, 1);
+    sheet->write(500, 1, 2);
+
+    SheetModel model(sheet);
+    QCOMPARE(model.data(model.index(499, 0)).toInt(), 2);
+
+    // The cached values stay until the model is told about the writes
+    sheet->write(500, 1, 3);
+    QCOMPARE(model.data(model.index(499, 0)).toInt(), 2);
+    model.invalidate(CellRange(500, 1, 500, 1));
+    QCOMPARE(model.data(model.index(499, 0)).toInt(), 3);
+
+    sheet->write(1, 1, 4);
+    sheet->write(500, 1, 5);
+    model.invalidate();
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 4);
+    QCOMPARE(model.data(model.index(499, 0)).toInt(), 5);
+}
+
+void SheetModelTest::testScrolling()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row <= 5000; ++row) {
+        sheet->write(row, 1, row);
+        sheet->write(row, 2, QStringLiteral("Row %1").arg(row));
+    }
+
+    // Scroll down and back up, the prefetched rows being read in between
+    SheetModel model(sheet);
+    for (int row = 0; row < 5000; ++row) {
+        QCOMPARE(model.data(model.index(row, 0)).toInt(), row + 1);
+        if (row % 50 == 0)
+            QCoreApplication::processEvents();
+    }
+    for (int row = 4999; row >= 0; --row) {
+        QCOMPARE(model.data(model.index(row, 1)).toString(), QStringLiteral("Row %1").arg(row + 1));
+        if (row % 50 == 0)
+            QCoreApplication::processEvents();
+    }
+}
+
+QTEST_GUILESS_MAIN(SheetModelTest)
+
+#include "tst_sheetmodeltest.moc"
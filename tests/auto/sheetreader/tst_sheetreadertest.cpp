@@ -0,0 +1,108 @@
+#include "xlsxdocument.h"
+#include "xlsxsheetreader.h"
+#include "xlsxformat.h"
+#include <QString>
+#include <QtTest>
+#include <QBuffer>
+
+QTXLSX_USE_NAMESPACE
+
+class SheetReaderTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetReaderTest();
+
+private Q_SLOTS:
+    void testReadRows();
+    void testSelectSheet();
+    void testInvalid();
+};
+
+SheetReaderTest::SheetReaderTest()
+{
+}
+
+void SheetReaderTest::testReadRows()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    Format bold;
+    bold.setFontBold(true);
+    xlsx1.write("A1", "Hello");
+    xlsx1.write("C1", 12.5, bold);
+    xlsx1.write("B3", true);
+    for (int row = 10; row <= 1000; ++row)
+        xlsx1.write(row, 2, QString("Text %1").arg(row));
+    xlsx1.saveAs(&device);
+
+    device.open(QIODevice::ReadOnly);
+    SheetReader reader(&device);
+    QVERIFY(reader.isValid());
+    QCOMPARE(reader.sheetName(), QStringLiteral("Sheet1"));
+
+    QVERIFY(reader.nextRow());
+    QCOMPARE(reader.row(), 1);
+    QCOMPARE(reader.cellCount(), 2);
+    QCOMPARE(reader.column(0), 1);
+    QCOMPARE(reader.cellType(0), Cell::SharedStringType);
+    QCOMPARE(reader.value(0).toString(), QStringLiteral("Hello"));
+    QCOMPARE(reader.column(1), 3);
+    QCOMPARE(reader.value(1).toDouble(), 12.5);
+    QVERIFY(reader.format(1).fontBold());
+
+    QVERIFY(reader.nextRow());
+    QCOMPARE(reader.row(), 3);
+    QCOMPARE(reader.cellCount(), 1);
+    QCOMPARE(reader.column(0), 2);
+    QCOMPARE(reader.value(0), QVariant(true));
+
+    int rows = 0;
+    while (reader.nextRow()) {
+        QCOMPARE(reader.value(0).toString(), QString("Text %1").arg(reader.row()));
+        ++rows;
+    }
+    QCOMPARE(rows, 991);
+    QVERIFY(!reader.hasError());
+}
+
+void SheetReaderTest::testSelectSheet()
+{
+    QBuffer device;
+    device.open(QIODevice::WriteOnly);
+    Document xlsx1;
+    xlsx1.write("A1", 1);
+    xlsx1.addSheet("Second");
+    xlsx1.write("A2", 2);
+    xlsx1.saveAs(&device);
+
+    device.open(QIODevice::ReadOnly);
+    SheetReader reader(&device, "Second");
+    QCOMPARE(reader.sheetNames(), QStringList() << "Sheet1" << "Second");
+    QVERIFY(reader.nextRow());
+    QCOMPARE(reader.row(), 2);
+    QCOMPARE(reader.value(0).toInt(), 2);
+    QVERIFY(!reader.nextRow());
+
+    QVERIFY(reader.selectSheet("Sheet1"));
+    QVERIFY(reader.nextRow());
+    QCOMPARE(reader.row(), 1);
+    QCOMPARE(reader.value(0).toInt(), 1);
+
+    QVERIFY(!reader.selectSheet("None"));
+    QVERIFY(!reader.nextRow());
+}
+
+void SheetReaderTest::testInvalid()
+{
+    SheetReader reader(QStringLiteral("no-such-file.xlsx"));
+    QVERIFY(!reader.isValid());
+    QVERIFY(!reader.nextRow());
+    QCOMPARE(reader.cellCount(), 0);
+}
+
+QTEST_APPLESS_MAIN(SheetReaderTest)
+
+#include "tst_sheetreadertest.moc"
@@ -0,0 +1,173 @@
+#include "xlsxdocument.h"
+#include "xlsxcell.h"
+#include "xlsxformat.h"
+#include "xlsxsheettemplate.h"
+#include "xlsxworksheet.h"
+#include <QBuffer>
+#include <QString>
+#include <QtTest>
+
+QTXLSX_USE_NAMESPACE
+
+class SheetTemplateTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    SheetTemplateTest();
+
+private Q_SLOTS:
+    void initTestCase();
+    void testIndex();
+    void testFill();
+    void testRepeatedRows();
+    void testEmptyList();
+
+private:
+    QByteArray m_package;
+};
+
+SheetTemplateTest::SheetTemplateTest()
+{
+}
+
+void SheetTemplateTest::initTestCase()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    Format number;
+    number.setNumberFormat(QStringLiteral("0.00"));
+    sheet->write("A1", "Invoice {{ number }} of {{date}}");
+    sheet->write("B1", "{{date}}");
+    sheet->write("A2", "{{customer.name}}");
+    sheet->write("A3", "Item");
+    sheet->write("A4", "{{items.name}}");
+    sheet->write("B4", "{{items.qty}}", number);
+    sheet->write("C4", "{{items.name}} x{{items.qty}}");
+    sheet->mergeCells(CellRange("C4:D4"));
+    sheet->setRowHeight(4, 4, 30);
+    sheet->write("A5", "Total");
+    sheet->write("B5", "{{total}}", number);
+    sheet->write("A6", "{{notes}}");
+    sheet->write("B6", "{{} not a placeholder");
+
+    QBuffer buffer(&m_package);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&buffer));
+}
+
+void SheetTemplateTest::testIndex()
+{
+    QBuffer buffer(&m_package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+    SheetTemplate invoice(xlsx.currentWorksheet());
+
+    QCOMPARE(invoice.placeholders(), QStringList() << "number" << "date" << "customer.name"
+                                                   << "items.name" << "items.qty" << "total"
+                                                   << "notes");
+    QCOMPARE(invoice.locations("date"), QList<CellReference>() << CellReference("A1")
+                                                               << CellReference("B1"));
+    QCOMPARE(invoice.locations("items.qty"), QList<CellReference>() << CellReference("B4")
+                                                                    << CellReference("C4"));
+    QVERIFY(invoice.locations("missing").isEmpty());
+}
+
+void SheetTemplateTest::testFill()
+{
+    QBuffer buffer(&m_package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+    Worksheet *sheet = xlsx.currentWorksheet();
+    SheetTemplate invoice(sheet);
+
+    QVariantMap customer;
+    customer["name"] = "ACME";
+    QVariantMap data;
+    data["number"] = 42;
+    data["date"] = QDate(2014, 5, 1);
+    data["customer"] = customer;
+    data["total"] = 12.5;
+    QVERIFY(invoice.fill(sheet, data));
+
+    QCOMPARE(sheet->read("A1").toString(), QString("Invoice 42 of 2014-05-01"));
+    QCOMPARE(sheet->read("B1").toDate(), QDate(2014, 5, 1));
+    QCOMPARE(sheet->read("A2").toString(), QString("ACME"));
+    // Not a list, the region is not repeated
+    QCOMPARE(sheet->read("A5").toString(), QString("Total"));
+    QCOMPARE(sheet->read("B5").toDouble(), 12.5);
+    QCOMPARE(sheet->cellAt("B5")->format().numberFormat(), QString("0.00"));
+    QVERIFY(!sheet->read("A6").isValid());
+    QCOMPARE(sheet->read("B6").toString(), QString("{{} not a placeholder"));
+
+    // Not a sheet of the template
+    Document other;
+    other.write("A1", "{{number}}");
+    QVERIFY(!invoice.fill(other.currentWorksheet(), data));
+    QCOMPARE(other.read("A1").toString(), QString("{{number}}"));
+}
+
+void SheetTemplateTest::testRepeatedRows()
+{
+    QBuffer source(&m_package);
+    source.open(QIODevice::ReadOnly);
+    Document templateXlsx(&source);
+    SheetTemplate invoice(templateXlsx.currentWorksheet());
+
+    // The index serves every sheet loaded from the template
+    QBuffer buffer(&m_package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+    Worksheet *sheet = xlsx.currentWorksheet();
+
+    QVariantList items;
+    for (int i = 1; i <= 3; ++i) {
+        QVariantMap item;
+        item["name"] = QStringLiteral("Item %1").arg(i);
+        item["qty"] = i * 2;
+        items.append(item);
+    }
+    QVariantMap data;
+    data["items"] = items;
+    data["total"] = 12;
+    data["notes"] = "Thanks";
+    QVERIFY(invoice.fill(sheet, data));
+
+    QCOMPARE(sheet->read("A3").toString(), QString("Item"));
+    for (int i = 1; i <= 3; ++i) {
+        const int row = 3 + i;
+        QCOMPARE(sheet->read(row, 1).toString(), QStringLiteral("Item %1").arg(i));
+        QCOMPARE(sheet->read(row, 2).toDouble(), double(i * 2));
+        QCOMPARE(sheet->cellAt(row, 2)->format().numberFormat(), QString("0.00"));
+        QCOMPARE(sheet->read(row, 3).toString(), QStringLiteral("Item %1 x%2").arg(i).arg(i * 2));
+        QCOMPARE(sheet->rowHeight(row), 30.0);
+    }
+    QVERIFY(sheet->mergedCells().contains(CellRange("C6:D6")));
+    QCOMPARE(sheet->read("A7").toString(), QString("Total"));
+    QCOMPARE(sheet->read("B7").toDouble(), 12.0);
+    QCOMPARE(sheet->read("A8").toString(), QString("Thanks"));
+    QVERIFY(!sheet->read("A2").isValid());
+}
+
+void SheetTemplateTest::testEmptyList()
+{
+    QBuffer buffer(&m_package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+    Worksheet *sheet = xlsx.currentWorksheet();
+    SheetTemplate invoice(sheet);
+
+    QVariantMap data;
+    data["items"] = QVariantList();
+    data["total"] = 0;
+    QVERIFY(invoice.fill(sheet, data));
+
+    QCOMPARE(sheet->read("A3").toString(), QString("Item"));
+    QCOMPARE(sheet->read("A4").toString(), QString("Total"));
+    QCOMPARE(sheet->read("B4").toDouble(), 0.0);
+    QVERIFY(!sheet->mergedCells().contains(CellRange("C4:D4")));
+}
+
+QTEST_APPLESS_MAIN(SheetTemplateTest)
+
+#include "tst_sheettemplatetest.moc"
@@ -1,6 +1,8 @@
 #include "private/xlsxstyles_p.h"
 #include "xlsxformat.h"
 #include "private/xlsxformat_p.h"
+#include "private/xlsxcolor_p.h"
+#include "private/xlsxtheme_p.h"
 #include <QString>
 #include <QtTest>
 #include <QXmlStreamReader>
@@ -24,6 +26,10 @@ private Q_SLOTS:
     void testReadFonts();
     void testReadFills();
     void testReadBorders();
+    void testReadCellXfs();
+    void testDeferLookupTables();
+    void testCompact();
+    void testResolveColors();
 };
 
 StylesTest::StylesTest()
@@ -164,8 +170,183 @@ void StylesTest::testReadNumFmts()
     QCOMPARE(styles.m_customNumFmtIdMap[164]->formatString, QStringLiteral("yyyy-mm-ddThh:mm:ss"));
     QVERIFY(styles.m_customNumFmtIdMap.contains(165));
     QCOMPARE(styles.m_customNumFmtIdMap[165]->formatString, QStringLiteral("dd/mm/yyyy"));
+    QVERIFY(styles.m_customNumFmtIdMap[165]->isDateTime);
+
+    // The classification is given to the formats using the number format
+    QXlsx::Format format;
+    format.setNumberFormatIndex(165);
+    styles.fixNumFmt(format);
+    QVERIFY(format.isDateTimeFormat());
+}
+
+void StylesTest::testCompact()
+{
+    QXlsx::Styles styles(QXlsx::Styles::F_NewFromScratch);
+
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    QXlsx::Format italic;
+    italic.setFontItalic(true);
+    QXlsx::Format boldRed;
+    boldRed.setFontBold(true);
+    boldRed.setPatternBackgroundColor(Qt::red);
+    QXlsx::Format bold2;
+    bold2.setFontBold(true);
+    styles.addXfFormat(bold);
+    styles.addXfFormat(italic);
+    styles.addXfFormat(boldRed);
+    // A duplicate, as found in the loaded files
+    styles.addXfFormat(bold2, true);
+    QCOMPARE(styles.m_xf_formatsList.size(), 5);
+    QCOMPARE(styles.m_fontsList.size(), 3);
+    QCOMPARE(styles.m_fillsList.size(), 3);
+
+    QVector<bool> usedXfs(5, false);
+    usedXfs[1] = true;
+    usedXfs[3] = true;
+    usedXfs[4] = true;
+    QVector<int> xfMap;
+    styles.compact(usedXfs, &xfMap);
+
+    QCOMPARE(xfMap, QVector<int>() << 0 << 1 << -1 << 2 << 1);
+    QCOMPARE(styles.m_xf_formatsList.size(), 3);
+    QCOMPARE(styles.m_fontsList.size(), 2);
+    QCOMPARE(styles.m_fillsList.size(), 3);
+    QCOMPARE(bold.xfIndex(), 1);
+    QCOMPARE(boldRed.xfIndex(), 2);
+    QCOMPARE(boldRed.fontIndex(), 1);
+    QCOMPARE(boldRed.fillIndex(), 2);
+
+    // The dropped format gets a new index when it's added again
+    styles.addXfFormat(italic);
+    QCOMPARE(italic.xfIndex(), 3);
+    QCOMPARE(italic.fontIndex(), 2);
+    QVERIFY(styles.xfFormat(3).fontItalic());
+    QCOMPARE(styles.m_fontsList.size(), 3);
+}
+
+void StylesTest::testResolveColors()
+{
+    QXlsx::Styles styles(QXlsx::Styles::F_NewFromScratch);
+    QXlsx::Theme theme(QXlsx::Theme::F_NewFromScratch);
+    QVERIFY(theme.isDefault());
+
+    // The light and dark colors are swapped
+    QCOMPARE(theme.color(0), QColor(Qt::white));
+    QCOMPARE(theme.color(1), QColor(Qt::black));
+    QCOMPARE(theme.color(3), QColor(0x1F, 0x49, 0x7D));
+    QCOMPARE(theme.color(4), QColor(0x4F, 0x81, 0xBD));
+    QCOMPARE(theme.color(11), QColor(0x80, 0x00, 0x80));
+    QVERIFY(!theme.color(12).isValid());
+
+    QCOMPARE(QXlsx::XlsxColor(QStringLiteral("4")).resolvedColor(&styles, &theme),
+             QColor(0x4F, 0x81, 0xBD));
+    const QColor lighter =
+        QXlsx::XlsxColor(QStringLiteral("4"), QStringLiteral("0.5")).resolvedColor(0, &theme);
+    QVERIFY(lighter.lightness() > QColor(0x4F, 0x81, 0xBD).lightness());
+    QCOMPARE(QXlsx::XlsxColor(QStringLiteral("1"), QStringLiteral("-0.5"))
+                 .resolvedColor(0, &theme),
+             QColor(Qt::black));
+    QCOMPARE(QXlsx::XlsxColor(2).resolvedColor(&styles, &theme), QColor(Qt::red));
+    QCOMPARE(QXlsx::XlsxColor(QColor(Qt::green)).resolvedColor(0, 0), QColor(Qt::green));
+    QVERIFY(!QXlsx::XlsxColor(QStringLiteral("4")).resolvedColor(&styles, 0).isValid());
+
+    // Loaded themes are kept as they are, and parsed again
+    const QByteArray xml =
+        "<a:theme xmlns:a=\"http://schemas.openxmlformats.org/drawingml/2006/main\">"
+        "<a:themeElements><a:clrScheme name=\"Custom\">"
+        "<a:dk1><a:srgbClr val=\"102030\"/></a:dk1>"
+        "<a:lt1><a:sysClr val=\"window\" lastClr=\"FEFEFE\"/></a:lt1>"
+        "</a:clrScheme></a:themeElements></a:theme>";
+    theme.loadFromXmlData(xml);
+    QVERIFY(!theme.isDefault());
+    QCOMPARE(theme.saveToXmlData(), xml);
+    QCOMPARE(theme.color(0), QColor(0xFE, 0xFE, 0xFE));
+    QCOMPARE(theme.color(1), QColor(0x10, 0x20, 0x30));
+    QVERIFY(!theme.color(4).isValid());
 }
 
 QTEST_APPLESS_MAIN(StylesTest)
 
+void StylesTest::testReadCellXfs()
+{
+    QByteArray xmlData = "<styleSheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+            "<numFmts count=\"1\"><numFmt numFmtId=\"164\" formatCode=\"0.000\"/></numFmts>"
+            "<fonts count=\"2\"><font><sz val=\"11\"/><name val=\"Calibri\"/></font>"
+            "<font><b/><sz val=\"12\"/><name val=\"Arial\"/></font></fonts>"
+            "<fills count=\"3\"><fill><patternFill patternType=\"none\"/></fill>"
+            "<fill><patternFill patternType=\"gray125\"/></fill>"
+            "<fill><patternFill patternType=\"lightUp\"/></fill></fills>"
+            "<borders count=\"2\"><border><left/><right/><top/><bottom/><diagonal/></border>"
+            "<border><left style=\"thin\"><color auto=\"1\"/></left><right/><top/><bottom/><diagonal/></border></borders>"
+            "<cellXfs count=\"5\">"
+            "<xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\"/>"
+            "<xf numFmtId=\"164\" fontId=\"1\" fillId=\"2\" borderId=\"1\" xfId=\"0\" applyNumberFormat=\"1\" applyFont=\"1\" applyFill=\"1\" applyBorder=\"1\"/>"
+            "<xf applyFont=\"true\" fontId=\"1\" borderId=\"1\" applyBorder=\"0\" numFmtId=\"14\" applyNumberFormat=\"1\"/>"
+            "<xf fontId=\"1\" fillId=\"2\" applyFill=\"1\" applyAlignment=\"1\"><alignment horizontal=\"center\" wrapText=\"1\"/></xf>"
+            "<xf fontId=\"7\" applyFont=\"1\" numFmtId=\"2\"/>"
+            "</cellXfs>"
+            "</styleSheet>";
+    QXlsx::Styles styles(QXlsx::Styles::F_LoadFromExists);
+    QVERIFY(styles.loadFromXmlData(xmlData));
+    QCOMPARE(styles.m_xf_formatsList.size(), 5);
+
+    QXlsx::Format xf1 = styles.xfFormat(1);
+    QCOMPARE(xf1.numberFormat(), QStringLiteral("0.000"));
+    QVERIFY(xf1.fontBold());
+    QCOMPARE(xf1.fontName(), QStringLiteral("Arial"));
+    QCOMPARE(xf1.fillPattern(), QXlsx::Format::PatternLightUp);
+    QCOMPARE(xf1.leftBorderStyle(), QXlsx::Format::BorderThin);
+    QCOMPARE(xf1.fontIndex(), 1);
+
+    // Any order, the flags which are not set are not applied
+    QXlsx::Format xf2 = styles.xfFormat(2);
+    QVERIFY(xf2.fontBold());
+    QCOMPARE(xf2.numberFormatIndex(), 14);
+    QVERIFY(xf2.isDateTimeFormat());
+    QVERIFY(!xf2.hasBorderData());
+
+    QXlsx::Format xf3 = styles.xfFormat(3);
+    QVERIFY(!xf3.hasFontData());
+    QCOMPARE(xf3.fillPattern(), QXlsx::Format::PatternLightUp);
+    QCOMPARE(xf3.horizontalAlignment(), QXlsx::Format::AlignHCenter);
+    QVERIFY(xf3.textWrap());
+
+    // Out of range font, and numFmtId without applyNumberFormat
+    QXlsx::Format xf4 = styles.xfFormat(4);
+    QVERIFY(!xf4.hasFontData());
+    QVERIFY(!xf4.hasNumFmtData());
+}
+
+void StylesTest::testDeferLookupTables()
+{
+    QXlsx::Styles styles(QXlsx::Styles::F_NewFromScratch);
+    QXlsx::Format format;
+    format.setFontBold(true);
+    format.setPatternBackgroundColor(QColor(Qt::red));
+    styles.addXfFormat(format);
+    const QByteArray xmlData = styles.saveToXmlData();
+
+    QXlsx::Styles styles2(QXlsx::Styles::F_LoadFromExists);
+    styles2.deferLookupTables();
+    styles2.loadFromXmlData(xmlData);
+    QVERIFY(styles2.m_fontsHash.isEmpty());
+    QVERIFY(styles2.m_xf_formatsHash.isEmpty());
+    QCOMPARE(styles2.xfFormat(1).xfIndex(), 1);
+    QVERIFY(styles2.xfFormat(1).fontBold());
+
+    // Built by the first change
+    QXlsx::Format format2;
+    format2.setFontBold(true);
+    format2.setPatternBackgroundColor(QColor(Qt::red));
+    styles2.addXfFormat(format2);
+    QVERIFY(!styles2.m_xf_formatsHash.isEmpty());
+    QCOMPARE(format2.xfIndex(), 1);
+
+    // Same as loaded without deferring
+    QXlsx::Styles styles3(QXlsx::Styles::F_LoadFromExists);
+    styles3.loadFromXmlData(xmlData);
+    QCOMPARE(styles2.saveToXmlData(), styles3.saveToXmlData());
+}
+
 #include "tst_stylestest.moc"
@@ -44,6 +44,7 @@ private Q_SLOTS:
 
     void test_datetimeFromNumber_data();
     void test_datetimeFromNumber();
+    void test_batchDateConversion();
 
     void test_createSafeSheetName_data();
     void test_createSafeSheetName();
@@ -51,8 +52,19 @@ private Q_SLOTS:
     void test_escapeSheetName_data();
     void test_escapeSheetName();
 
+    void test_parseCellReference_data();
+    void test_parseCellReference();
+
+    void test_formatDouble_data();
+    void test_formatDouble();
+    void test_parseDouble();
+    void test_contentHash();
+
     void test_convertSharedFormula_data();
     void test_convertSharedFormula();
+    void test_sharedFormulaTemplate();
+    void test_shiftedFormula_data();
+    void test_shiftedFormula();
 };
 
 UtilityTest::UtilityTest()
@@ -129,6 +141,48 @@ void UtilityTest::test_datetimeFromNumber()
     QCOMPARE(QXlsx::datetimeFromNumber(num, is1904), dt);
 }
 
+void UtilityTest::test_batchDateConversion()
+{
+    const QVector<QDate> dates = QVector<QDate>() << QDate(1899, 12, 31) << QDate(1900, 2, 28)
+                                                  << QDate(1900, 3, 1) << QDate(1970, 1, 1)
+                                                  << QDate(2014, 7, 15) << QDate();
+    QVector<double> numbers(dates.size());
+    QXlsx::datesToNumbers(dates.constData(), dates.size(), numbers.data());
+    QCOMPARE(numbers, QVector<double>() << 0 << 59 << 61 << 25569 << 41835 << 0);
+    for (int i = 0; i < dates.size() - 1; ++i)
+        QCOMPARE(QXlsx::dateToNumber(dates[i]), numbers[i]);
+
+    QXlsx::datesToNumbers(dates.constData() + 3, 2, numbers.data(), true);
+    QCOMPARE(numbers[0], 24107.0);
+    QCOMPARE(numbers[1], 40373.0);
+
+    // The date and time shown are converted, whatever the time spec
+    const QVector<QDateTime> datetimes =
+        QVector<QDateTime>() << QDateTime(QDate(2014, 7, 15), QTime(6, 0))
+                             << QDateTime(QDate(2014, 7, 15), QTime(18, 0), Qt::UTC)
+                             << QDateTime(QDate(1900, 2, 28), QTime(12, 0));
+    QXlsx::datetimesToNumbers(datetimes.constData(), datetimes.size(), numbers.data());
+    QCOMPARE(numbers[0], 41835.25);
+    QCOMPARE(numbers[1], 41835.75);
+    QCOMPARE(numbers[2], 59.5);
+    QCOMPARE(QXlsx::datetimeToNumber(datetimes[1]), 41835.75);
+    QCOMPARE(QXlsx::datetimeFromNumber(41835.25), datetimes[0]);
+
+    const qint64 msecs[] = { 0, Q_INT64_C(1405447200000), Q_INT64_C(-2203891200000) - 43200000 };
+    QXlsx::msecsSinceEpochToNumbers(msecs, 3, numbers.data());
+    QCOMPARE(numbers[0], 25569.0);
+    QCOMPARE(numbers[1], 41835.75);
+    QCOMPARE(numbers[2], 59.5);
+    QXlsx::msecsSinceEpochToNumbers(msecs, 1, numbers.data(), true);
+    QCOMPARE(numbers[0], 24107.0);
+
+    qint64 converted[3];
+    QXlsx::msecsSinceEpochToNumbers(msecs, 3, numbers.data());
+    QXlsx::numbersToMsecsSinceEpoch(numbers.constData(), 3, converted);
+    for (int i = 0; i < 3; ++i)
+        QCOMPARE(converted[i], msecs[i]);
+}
+
 void UtilityTest::test_createSafeSheetName_data()
 {
     QTest::addColumn<QString>("original");
@@ -185,6 +239,113 @@ void UtilityTest::test_escapeSheetName()
     QCOMPARE(QXlsx::escapeSheetName(original), result);
 }
 
+void UtilityTest::test_parseCellReference_data()
+{
+    QTest::addColumn<QString>("reference");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<int>("row");
+    QTest::addColumn<int>("column");
+
+    QTest::newRow("A1") << QString("A1") << true << 1 << 1;
+    QTest::newRow("Z9") << QString("Z9") << true << 9 << 26;
+    QTest::newRow("AA10") << QString("AA10") << true << 10 << 27;
+    QTest::newRow("XFD1048576") << QString("XFD1048576") << true << 1048576 << 16384;
+    QTest::newRow("$B$3") << QString("$B$3") << true << 3 << 2;
+    QTest::newRow("B$3") << QString("B$3") << true << 3 << 2;
+    QTest::newRow("empty") << QString() << false << -1 << -1;
+    QTest::newRow("no row") << QString("AB") << false << -1 << -1;
+    QTest::newRow("no column") << QString("12") << false << -1 << -1;
+    QTest::newRow("lower case") << QString("a1") << false << -1 << -1;
+    QTest::newRow("too many letters") << QString("ABCD1") << false << -1 << -1;
+    QTest::newRow("trailing") << QString("A1:B2") << false << -1 << -1;
+}
+
+void UtilityTest::test_parseCellReference()
+{
+    QFETCH(QString, reference);
+    QFETCH(bool, valid);
+    QFETCH(int, row);
+    QFETCH(int, column);
+
+    int r = -1;
+    int c = -1;
+    QCOMPARE(QXlsx::parseCellReference(QStringRef(&reference), &r, &c), valid);
+    QCOMPARE(r, row);
+    QCOMPARE(c, column);
+
+    const QByteArray latin1 = reference.toLatin1();
+    r = -1;
+    c = -1;
+    QCOMPARE(QXlsx::parseCellReference(latin1.constData(), latin1.size(), &r, &c), valid);
+    QCOMPARE(r, row);
+    QCOMPARE(c, column);
+
+    QXlsx::CellReference cell(reference);
+    QCOMPARE(cell.isValid(), valid);
+    if (valid) {
+        QCOMPARE(cell.row(), row);
+        QCOMPARE(cell.column(), column);
+        QCOMPARE(QXlsx::CellReference(latin1.constData()), cell);
+
+        char buffer[QXlsx::XLSX_CELL_REFERENCE_BUFFER_SIZE];
+        const int size = QXlsx::formatCellReference(row, column, buffer, reference.contains("$3"),
+                                                    reference.startsWith('$'));
+        QCOMPARE(QByteArray(buffer, size), latin1);
+    }
+}
+
+void UtilityTest::test_formatDouble_data()
+{
+    QTest::addColumn<double>("value");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("zero") << 0.0 << QString("0");
+    QTest::newRow("integer") << 12345.0 << QString("12345");
+    QTest::newRow("negative") << -42.0 << QString("-42");
+    QTest::newRow("fraction") << 1.5 << QString("1.5");
+    QTest::newRow("15 digits") << 123456789012345.0 << QString("123456789012345");
+    QTest::newRow("17 digits") << 0.1 + 0.2 << QString();
+    QTest::newRow("pi") << 3.141592653589793 << QString();
+    QTest::newRow("small") << 0.00001 << QString();
+    QTest::newRow("large") << 1e20 << QString();
+    QTest::newRow("max") << 1.7976931348623157e308 << QString();
+}
+
+void UtilityTest::test_formatDouble()
+{
+    QFETCH(double, value);
+    QFETCH(QString, text);
+
+    char buffer[QXlsx::XLSX_DOUBLE_BUFFER_SIZE];
+    const int size = QXlsx::formatDouble(value, buffer);
+    QVERIFY(size > 0 && size <= QXlsx::XLSX_DOUBLE_BUFFER_SIZE);
+    const QString result = QString::fromLatin1(buffer, size);
+    if (!text.isEmpty())
+        QCOMPARE(result, text);
+    // The text must read back as the same value
+    QCOMPARE(result.toDouble(), value);
+}
+
+void UtilityTest::test_parseDouble()
+{
+    bool ok = false;
+    QString text = QStringLiteral("0.30000000000000004");
+    QCOMPARE(QXlsx::parseDouble(QStringRef(&text), &ok), 0.1 + 0.2);
+    QVERIFY(ok);
+
+    text = QStringLiteral("-1.5E+20");
+    QCOMPARE(QXlsx::parseDouble(QStringRef(&text), &ok), -1.5e20);
+    QVERIFY(ok);
+
+    text = QStringLiteral(" 42");
+    QCOMPARE(QXlsx::parseDouble(QStringRef(&text), &ok), 42.0);
+    QVERIFY(ok);
+
+    text = QStringLiteral("12abc");
+    QXlsx::parseDouble(QStringRef(&text), &ok);
+    QVERIFY(!ok);
+}
+
 void UtilityTest::test_convertSharedFormula_data()
 {
     QTest::addColumn<QString>("original");
@@ -218,6 +379,66 @@ void UtilityTest::test_convertSharedFormula()
 
     QCOMPARE(QXlsx::convertSharedFormula(original, rootCell, cell), result);
 }
+
+void UtilityTest::test_sharedFormulaTemplate()
+{
+    QXlsx::SharedFormulaTemplate formula(QString("SUM($A1:A$1)*\"B1\"+$C$3"), QString("B1"));
+    QCOMPARE(formula.formulaText(QString("B1")), QString("SUM($A1:A$1)*\"B1\"+$C$3"));
+    QCOMPARE(formula.formulaText(QString("B2")), QString("SUM($A2:A$1)*\"B1\"+$C$3"));
+    QCOMPARE(formula.formulaText(QString("D9")), QString("SUM($A9:C$1)*\"B1\"+$C$3"));
+    QCOMPARE(formula.formulaText(QString("B2")), QString("SUM($A2:A$1)*\"B1\"+$C$3"));
+}
+void UtilityTest::test_shiftedFormula_data()
+{
+    QTest::addColumn<QString>("formula");
+    QTest::addColumn<bool>("rows");
+    QTest::addColumn<int>("first");
+    QTest::addColumn<int>("count");
+    QTest::addColumn<QString>("result");
+
+    QTest::newRow("above") << QString("A1+B2") << true << 5 << 2 << QString("A1+B2");
+    QTest::newRow("below") << QString("A5+$B$6") << true << 5 << 2 << QString("A7+$B$8");
+    QTest::newRow("range grows") << QString("SUM(A1:A10)") << true << 5 << 3
+                                 << QString("SUM(A1:A13)");
+    QTest::newRow("columns") << QString("C1*$D1") << false << 2 << 1 << QString("D1*$E1");
+    QTest::newRow("removed") << QString("A3+A6") << true << 2 << -3 << QString("#REF!+A3");
+    QTest::newRow("range shrinks") << QString("SUM(B3:B10)") << true << 2 << -3
+                                   << QString("SUM(B2:B7)");
+    QTest::newRow("range removed") << QString("SUM(B3:C4)") << false << 2 << -2
+                                   << QString("SUM(#REF!)");
+    QTest::newRow("not references") << QString("LOG10(A5)&\"A5\"&Sheet2!A5") << true << 1 << 1
+                                    << QString("LOG10(A6)&\"A5\"&Sheet2!A5");
+    QTest::newRow("past the end") << QString("A1048576") << true << 1 << 1 << QString("#REF!");
+}
+
+void UtilityTest::test_shiftedFormula()
+{
+    QFETCH(QString, formula);
+    QFETCH(bool, rows);
+    QFETCH(int, first);
+    QFETCH(int, count);
+    QFETCH(QString, result);
+
+    QXlsx::SharedFormulaTemplate formulaTemplate(formula, QString("A1"));
+    QCOMPARE(formulaTemplate.shiftedText(rows, first, count, rows ? 1048576 : 16384), result);
+    // The absolute references are still left as they are by the template
+    QCOMPARE(formulaTemplate.formulaText(QString("A1")), formula);
+}
+
+void UtilityTest::test_contentHash()
+{
+    // Reference values of XXH64 with a seed of 0
+    QCOMPARE(QXlsx::contentHash(QByteArray()), Q_UINT64_C(0xEF46DB3751D8E999));
+    QCOMPARE(QXlsx::contentHash(QByteArray("abc")), Q_UINT64_C(0x44BC2CF5AD770999));
+
+    QByteArray bytes(1000, 'x');
+    const quint64 hash = QXlsx::contentHash(bytes);
+    QCOMPARE(QXlsx::contentHash(QByteArray(1000, 'x')), hash);
+    bytes[500] = 'y';
+    QVERIFY(QXlsx::contentHash(bytes) != hash);
+    QVERIFY(QXlsx::contentHash(bytes.left(999)) != QXlsx::contentHash(bytes));
+}
+
 QTEST_APPLESS_MAIN(UtilityTest)
 
 #include "tst_utilitytest.moc"
@@ -3,11 +3,16 @@
 #include <QXmlStreamReader>
 
 #include "xlsxworksheet.h"
+#include "xlsxworkbook.h"
 #include "xlsxcell.h"
 #include "xlsxcellrange.h"
 #include "xlsxdatavalidation.h"
+#include "xlsxconditionalformatting.h"
 #include "private/xlsxworksheet_p.h"
 #include "private/xlsxsharedstrings_p.h"
+#include "private/xlsxcardinality_p.h"
+#include "private/xlsxcommentswriter_p.h"
+#include "private/xlsxxmlpullparser_p.h"
 #include "xlsxrichstring.h"
 #include "xlsxcellformula.h"
 
@@ -23,17 +28,57 @@ private Q_SLOTS:
     void testDimension();
     void testSheetView();
     void testSetColumn();
+    void testSetRow();
+    void testGroupRows();
+    void testGroupColumns();
+    void testAutoFitColumns();
+    void testAddTable();
+    void testFind();
+    void testCsv();
 
     void testWriteCells();
+    void testBatchWrite();
+    void testBatchRead();
+    void testRawRead();
+    void testRawWrite();
+    void testWriteUtf8String();
+    void testWriteInlineRichString();
+    void testStringStorage();
+    void testWriteStyleId();
+    void testSaveSharedFormulas();
+    void testCellAt();
+    void testOverwriteString();
+    void testRowSpans();
     void testWriteHyperlinks();
+    void testWriteComments();
     void testWriteDataValidations();
+    void testValidate();
+    void testMergeSimilarRules();
     void testMerge();
     void testUnMerge();
+    void testUnMergeMany();
+    void testConstantMemoryMode();
+    void testConstantMemoryWithoutTemporaryFile();
+    void testInsertRemoveRows();
+    void testInsertRemoveColumns();
+    void testClearRange();
+    void testCopyRange();
+    void testMoveRange();
+    void testSortRange();
+    void testAutoFilter();
 
     void testReadSheetData();
+    void testReadSheetData_data();
+    void testReadSheetDataWithoutReference();
+    void testReadSheetDataWithoutReference_data();
+    void testReadSharedStringFormula();
+    void testReadSharedStringFormula_data();
     void testReadColsInfo();
     void testReadRowsInfo();
+    void testReadRowsInfo_data();
+    void testLoadFromXmlFile();
     void testReadMergeCells();
+    void testReadAutoFilter();
     void testReadDataValidations();
 };
 
@@ -67,6 +112,31 @@ void WorksheetTest::testDimension()
 
     sheet.write(10000, 10000, "For test");
     QCOMPARE(sheet.dimension(), QXlsx::CellRange(2, 2, 10000, 10000));
+
+    // The dimension shrinks back when cells are removed
+    QVERIFY(sheet.clear(QXlsx::CellRange(10000, 10000, 10000, 10000)));
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("B2:D4"));
+    QCOMPARE(sheet.d_func()->cellTable.lastColumn(), 4);
+    sheet.setRowHeight(8, 9, 30);
+    QVERIFY(sheet.writeComment("F3", "Note"));
+    QVERIFY(sheet.clear(QXlsx::CellRange("B2:C3")));
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("D3:F9"));
+    QVERIFY(sheet.removeComment(3, 6));
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("D4:D9"));
+    QVERIFY(sheet.saveToXmlData().contains("<dimension ref=\"D4:D9\"/>"));
+
+    // The spans of the rows are kept by the cell table
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet2.write("C1", 1);
+    sheet2.write("E2", 2);
+    sheet2.write("B20", 3);
+    QVERIFY(sheet2.insertColumns(4, 2));
+    QCOMPARE(sheet2.d_func()->cellTable.rowSpanAt(1).first, 7);
+    QVERIFY(sheet2.clear(QXlsx::CellRange(2, 7, 2, 7)));
+    QCOMPARE(sheet2.dimension(), QXlsx::CellRange("B1:C20"));
+    QByteArray xmldata = sheet2.saveToXmlData();
+    QVERIFY(xmldata.contains("<row r=\"1\" spans=\"3:3\">"));
+    QVERIFY(xmldata.contains("<row r=\"20\" spans=\"2:2\">"));
 }
 
 void WorksheetTest::testSheetView()
@@ -96,6 +166,277 @@ void WorksheetTest::testSetColumn()
     QVERIFY(xmldata.contains("<col min=\"7\" max=\"8\"")); //"G:H"
     QVERIFY(xmldata.contains("<col min=\"9\" max=\"9\""));//"I:I"
     QVERIFY(xmldata.contains("<col min=\"10\" max=\"11\""));//"J:K"
+
+    // Ranges are kept as ranges, not as one entry per column
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet2.setColumnWidth(1, 16384, 20.0);
+    QCOMPARE(sheet2.d_func()->colsInfo.size(), 1);
+    sheet2.setColumnWidth(3, 5, 10.0);
+    QCOMPARE(sheet2.d_func()->colsInfo.size(), 3);
+    QCOMPARE(sheet2.columnWidth(2), 20.0);
+    QCOMPARE(sheet2.columnWidth(5), 10.0);
+    QCOMPARE(sheet2.columnWidth(16384), 20.0);
+}
+
+void WorksheetTest::testSetRow()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.setRowHeight(1, 1000000, 20.0);
+    QCOMPARE(sheet.d_func()->rowsInfo.size(), 1);
+    sheet.setRowHeight(10, 10, 30.0);
+    QCOMPARE(sheet.d_func()->rowsInfo.size(), 3);
+    QCOMPARE(sheet.rowHeight(9), 20.0);
+    QCOMPARE(sheet.rowHeight(10), 30.0);
+    QCOMPARE(sheet.rowHeight(1000000), 20.0);
+    QCOMPARE(sheet.rowHeight(1000001), sheet.d_func()->sheetFormatProps.defaultRowHeight);
+
+    // Each row of a range is written
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet2.write("B2", 1);
+    sheet2.setRowHeight(2, 4, 20.0);
+    sheet2.setRowHidden(3, 3, true);
+    QByteArray xmldata = sheet2.saveToXmlData();
+    QVERIFY(xmldata.contains("<row r=\"2\" spans=\"2:2\" ht=\"20\" customHeight=\"1\"><c r=\"B2\""));
+    QVERIFY(xmldata.contains("<row r=\"3\" spans=\"2:2\" ht=\"20\" customHeight=\"1\" hidden=\"1\"/>"));
+    QVERIFY(xmldata.contains("<row r=\"4\" spans=\"2:2\" ht=\"20\" customHeight=\"1\"/>"));
+}
+
+void WorksheetTest::testGroupRows()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(!sheet.groupRows(10, 5));
+    QVERIFY(!sheet.groupRows(0, 5));
+
+    // The rows of a group share one info
+    QVERIFY(sheet.groupRows(2, 500001, false));
+    QCOMPARE(sheet.d_func()->rowsInfo.size(), 1);
+    QVERIFY(sheet.groupRows(100, 200));
+    QCOMPARE(sheet.d_func()->rowsInfo.size(), 4);
+    QCOMPARE(sheet.d_func()->rowInfoAt(150)->outlineLevel, 2);
+    QVERIFY(sheet.d_func()->rowInfoAt(150)->hidden);
+    QVERIFY(sheet.d_func()->rowInfoAt(201)->collapsed);
+    QCOMPARE(sheet.d_func()->rowInfoAt(202)->outlineLevel, 1);
+    QCOMPARE(sheet.d_func()->outline_row_level, 2);
+
+    // A group next to an alike one joins it
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet2.write("A1", 1);
+    QVERIFY(sheet2.groupRows(2, 3, false));
+    QVERIFY(sheet2.groupRows(4, 5, false));
+    QCOMPARE(sheet2.d_func()->rowsInfo.size(), 1);
+    QCOMPARE(sheet2.d_func()->rowInfoAt(5)->firstRow, 2);
+
+    QByteArray xmldata = sheet2.saveToXmlData();
+    QVERIFY(xmldata.contains("outlineLevelRow=\"1\""));
+    QVERIFY(xmldata.contains("<row r=\"5\" spans=\"1:1\" customHeight=\"0\" outlineLevel=\"1\"/>"));
+
+    // And so do the rows read
+    QXmlStreamReader reader(xmldata);
+    while (!reader.atEnd()
+           && !(reader.isStartElement() && reader.name() == QLatin1String("sheetData")))
+        reader.readNext();
+    QXlsx::Worksheet sheet3("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    sheet3.d_func()->loadXmlSheetData(reader);
+    QCOMPARE(sheet3.d_func()->rowsInfo.size(), 1);
+    QCOMPARE(sheet3.d_func()->rowInfoAt(2)->lastRow, 5);
+}
+
+void WorksheetTest::testGroupColumns()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(!sheet.groupColumns(5, 2));
+    QVERIFY(sheet.groupColumns(2, 4, false));
+    QVERIFY(sheet.groupColumns(5, 8, false));
+    QCOMPARE(sheet.d_func()->colsInfo.size(), 1);
+    QVERIFY(sheet.groupColumns(3, 4));
+    QCOMPARE(sheet.d_func()->colsInfo.size(), 4);
+    QVERIFY(sheet.d_func()->columnInfoAt(5)->collapsed);
+    QCOMPARE(sheet.d_func()->outline_col_level, 2);
+}
+
+void WorksheetTest::testAutoFitColumns()
+{
+    // Without a QGuiApplication the advances are those of Calibri 11,
+    // 7 pixels for the digits and 5 pixels of padding
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(!sheet.autoFitColumns());
+    sheet.write("A1", "Hi");
+    sheet.write("A2", 12345);
+    QXlsx::Format date;
+    date.setNumberFormat("yyyy-mm-dd");
+    sheet.writeNumeric(1, 2, 45000, date);
+    QXlsx::Format fixed;
+    fixed.setNumberFormat("#,##0.00");
+    sheet.writeNumeric(1, 4, 1234567, fixed);
+    sheet.writeNumeric(2, 5, 1234567, fixed);
+    QXlsx::Format wrapped;
+    wrapped.setTextWarp(true);
+    sheet.write("F1", "A long text which wraps", wrapped);
+    QVERIFY(sheet.autoFitColumns());
+
+    // 40 pixels, truncated to 1/256 of character
+    QCOMPARE(sheet.d_func()->columnInfoAt(1)->width, 1462 / 256.0);
+    // "0000-00-00", 69 pixels
+    QCOMPARE(sheet.d_func()->columnInfoAt(2)->width, 2523 / 256.0);
+    QVERIFY(!sheet.d_func()->columnInfoAt(3));
+    // "1,234,567.00", 77 pixels, the same in D and E
+    QSharedPointer<QXlsx::XlsxColumnInfo> info = sheet.d_func()->columnInfoAt(4);
+    QCOMPARE(info->width, 11.0);
+    QCOMPARE(info->lastColumn, 5);
+    QVERIFY(!sheet.d_func()->columnInfoAt(6));
+
+    // Only the columns of the range are fitted
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet2.write("A1", "Some text");
+    sheet2.write("B1", "Some text");
+    QVERIFY(sheet2.autoFitColumns(QXlsx::CellRange("B1:B10")));
+    QVERIFY(!sheet2.d_func()->columnInfoAt(1));
+    QVERIFY(sheet2.d_func()->columnInfoAt(2)->width > 0);
+}
+
+void WorksheetTest::testAddTable()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("B2", "Name");
+    sheet.write("C2", 10);
+    sheet.mergeCells(QXlsx::CellRange("F1:G2"));
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("B2:D2")));
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("E1:F5")));
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("B2:C5"), QStringList(), QString(), "A1"));
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("B2:C5"), QStringList(), QString(), "My table"));
+
+    // The columns are named by the header cells when there are no headers,
+    // and the names are made unique
+    QVERIFY(sheet.addTable(QXlsx::CellRange("B2:E5"), QStringList() << QString() << "name"));
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("A1:B3")));
+    QCOMPARE(sheet.tableNames(), QStringList() << "Table1");
+    QCOMPARE(sheet.tableRange("table1"), QXlsx::CellRange("B2:E5"));
+    QCOMPARE(sheet.read("B2").toString(), QString("Name"));
+    QCOMPARE(sheet.read("C2").toString(), QString("name2"));
+    QCOMPARE(sheet.read("D2").toString(), QString("Column3"));
+
+    QVector<QVariant> values;
+    values << 1 << "two" << 3.5;
+    QVERIFY(sheet.writeTableColumn("Table1", "Column3", values));
+    QCOMPARE(sheet.read("D4").toString(), QString("two"));
+    QVERIFY(!sheet.writeTableColumn("Table1", "Column3", values << 4));
+    QVERIFY(!sheet.writeTableColumn("Table1", "Missing", QStringList() << "a"));
+    QVERIFY(!sheet.writeTableColumn("Table2", "Name", QStringList() << "a"));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<tableParts count=\"1\"><tablePart r:id=\"rId1\"/></tableParts>"));
+
+    QByteArray tableData = sheet.d_func()->tables[0]->saveToXmlData();
+    QVERIFY(tableData.contains("<table xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/"
+                               "2006/main\" id=\"1\" name=\"Table1\" displayName=\"Table1\" "
+                               "ref=\"B2:E5\""));
+    QVERIFY(tableData.contains("<autoFilter ref=\"B2:E5\"/>"));
+    QVERIFY(tableData.contains("<tableColumn id=\"2\" name=\"name2\"/>"));
+    QVERIFY(tableData.contains("<tableStyleInfo name=\"TableStyleMedium2\""));
+
+    QXlsx::Table table(QXlsx::Table::F_LoadFromExists);
+    QVERIFY(table.loadFromXmlData(tableData));
+    QCOMPARE(table.id, 1);
+    QCOMPARE(table.name, QString("Table1"));
+    QCOMPARE(table.columns, QStringList() << "Name" << "name2" << "Column3" << "Column4");
+    QCOMPARE(table.styleName, QString("TableStyleMedium2"));
+    QVERIFY(table.showRowStripes);
+    QCOMPARE(table.saveToXmlData(), tableData);
+}
+
+void WorksheetTest::testFind()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 100; ++row) {
+        sheet.write(row, 1, QString("Key %1").arg(row));
+        sheet.write(row, 2, row % 10);
+    }
+    sheet.write("C5", true);
+    sheet.write("C6", 1);
+    sheet.write("C7", QDate(2014, 1, 1));
+    sheet.write("D8", "Key 42");
+    sheet.writeFormula("E9", QXlsx::CellFormula("1+2"), QXlsx::Format(), 3);
+
+    QCOMPARE(sheet.find("Key 42"), QXlsx::CellReference("A42"));
+    QCOMPARE(sheet.findAll("Key 42"), QList<QXlsx::CellReference>()
+                                           << QXlsx::CellReference("A42")
+                                           << QXlsx::CellReference("D8"));
+    QCOMPARE(sheet.find("Key 42", QXlsx::CellRange("B1:D100")), QXlsx::CellReference("D8"));
+    QCOMPARE(sheet.find("key 42"), QXlsx::CellReference());
+    QCOMPARE(sheet.findAll(3, QXlsx::CellRange("B1:B30")).size(), 3);
+    // A boolean is not the number 1, a date is its number
+    QCOMPARE(sheet.find(true), QXlsx::CellReference("C5"));
+    QCOMPARE(sheet.find(1, QXlsx::CellRange("C1:C10")), QXlsx::CellReference("C6"));
+    QCOMPARE(sheet.find(QDate(2014, 1, 1)), QXlsx::CellReference("C7"));
+    QCOMPARE(sheet.find(3.0, QXlsx::CellRange("E1:E10")), QXlsx::CellReference("E9"));
+
+    // The indexed columns are told about the written cells
+    sheet.write("A42", "Moved");
+    sheet.write("A90", "Key 42");
+    QCOMPARE(sheet.findAll("Key 42", QXlsx::CellRange("A1:A1048576")),
+             QList<QXlsx::CellReference>() << QXlsx::CellReference("A90"));
+    QCOMPARE(sheet.find("Moved"), QXlsx::CellReference("A42"));
+
+    // and dropped when the cells move
+    sheet.insertRows(1, 2);
+    QCOMPARE(sheet.find("Moved"), QXlsx::CellReference("A44"));
+
+    QCOMPARE(sheet.replaceAll(3, 30, QXlsx::CellRange("B1:B1048576")), 10);
+    QVERIFY(sheet.findAll(3, QXlsx::CellRange("B1:B1048576")).isEmpty());
+    QCOMPARE(sheet.findAll(30).size(), 10);
+    // Formulas are not replaced
+    QCOMPARE(sheet.replaceAll(3, 4), 0);
+    QCOMPARE(sheet.find(3), QXlsx::CellReference("E11"));
+}
+
+void WorksheetTest::testCsv()
+{
+    QByteArray csv("\xEF\xBB\xBFName,Count,Zip,Flag,Mixed\r\n"
+                   "\"Smith, John\",12,01234,true,1\n"
+                   "\"He said \"\"hi\"\"\",-1.5e3,75001,FALSE,x\r\n"
+                   "\"Two\nlines\",,,,\n"
+                   "\n"
+                   "Last,7,1,TRUE,2");
+    QBuffer input(&csv);
+    input.open(QIODevice::ReadOnly);
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(sheet.importCsv(&input, 2, 2, QXlsx::Worksheet::CsvHeader));
+
+    QCOMPARE(sheet.read("B2").toString(), QString("Name"));
+    QCOMPARE(sheet.read("C2").toString(), QString("Count"));
+    QCOMPARE(sheet.read("B3").toString(), QString("Smith, John"));
+    QCOMPARE(sheet.read("C3").toDouble(), 12.0);
+    QCOMPARE(sheet.read("C4").toDouble(), -1500.0);
+    // A leading zero makes the column a text one
+    QCOMPARE(sheet.read("D3").toString(), QString("01234"));
+    QCOMPARE(sheet.read("D4").toString(), QString("75001"));
+    QCOMPARE(sheet.read("E3").toBool(), true);
+    QCOMPARE(sheet.cellAt("E4")->cellType(), QXlsx::Cell::BooleanType);
+    QCOMPARE(sheet.read("F3").toString(), QString("1"));
+    QCOMPARE(sheet.read("B4").toString(), QString("He said \"hi\""));
+    QCOMPARE(sheet.read("B5").toString(), QString("Two\nlines"));
+    QVERIFY(!sheet.cellAt("C5"));
+    QVERIFY(!sheet.cellAt("B6"));
+    QCOMPARE(sheet.read("C7").toDouble(), 7.0);
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("B2:F7"));
+
+    QByteArray exported;
+    QBuffer output(&exported);
+    output.open(QIODevice::WriteOnly);
+    QVERIFY(sheet.exportCsv(&output, QXlsx::CellRange("B3:E5"), QLatin1Char(';')));
+    QCOMPARE(exported, QByteArray("Smith, John;12;01234;TRUE\r\n"
+                                  "\"He said \"\"hi\"\"\";-1500;75001;FALSE\r\n"
+                                  "\"Two\nlines\";;;\r\n"));
+
+    // Strings only, read back from the export
+    QXlsx::Worksheet sheet2("", 2, 0, QXlsx::Worksheet::F_NewFromScratch);
+    output.close();
+    output.open(QIODevice::ReadOnly);
+    QVERIFY(sheet2.importCsv(&output, 1, 1, QXlsx::Worksheet::CsvStringsOnly,
+                             QLatin1Char(';')));
+    QCOMPARE(sheet2.read("B2").toString(), QString("-1500"));
+    QCOMPARE(sheet2.read("A2").toString(), QString("He said \"hi\""));
+    QCOMPARE(sheet2.dimension(), QXlsx::CellRange("A1:D3"));
 }
 
 void WorksheetTest::testWriteCells()
@@ -107,6 +448,9 @@ void WorksheetTest::testWriteCells()
     sheet.write("A4", true);
     sheet.write("A5", "=44+33");
     sheet.writeFormula(5, 2, "44+33", QXlsx::Format(), 77);
+    sheet.writeInlineString(6, 1, " a<b & c "); //A6
+    sheet.write("A7", 1.5);
+    sheet.setRowHeight(2, 2, 30);
 
     QByteArray xmldata = sheet.saveToXmlData();
     qDebug()<<xmldata;
@@ -117,10 +461,384 @@ void WorksheetTest::testWriteCells()
     QVERIFY2(xmldata.contains("<c r=\"A4\" t=\"b\"><v>1</v></c>"), "boolean");
     QVERIFY2(xmldata.contains("<c r=\"A5\"><f ca=\"1\">44+33</f><v>0</v></c>"), "formula");
     QVERIFY2(xmldata.contains("<c r=\"B5\"><f ca=\"1\">44+33</f><v>77</v></c>"), "formula");
+    QVERIFY2(xmldata.contains("<c r=\"A6\" t=\"inlineStr\"><is><t xml:space=\"preserve\">"
+                              " a&lt;b &amp; c </t></is></c>"), "escaped inline string");
+    QVERIFY2(xmldata.contains("<c r=\"A7\"><v>1.5</v></c>"), "decimal");
+    QVERIFY2(xmldata.contains("<row r=\"2\" spans=\"1:2\" ht=\"30\" customHeight=\"1\">"), "row");
 
     QCOMPARE(sheet.d_func()->sharedStrings()->getSharedString(0).toPlainString(), QStringLiteral("Hello"));
 }
 
+void WorksheetTest::testBatchWrite()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    const double numbers[] = {1, 2.5, 3, 4, 5, 6};
+
+    QVERIFY(sheet.writeRow(1, 2, numbers, 3));
+    QVERIFY(sheet.writeColumn(2, 1, QStringList() << "Hello" << "World"));
+    QVERIFY(sheet.writeRange(4, 2, numbers, 2, 3));
+    QVERIFY(sheet.writeRow(6, 1, QVector<QVariant>() << 7 << true << "Hello" << QVariant()
+                                                      << "=1+2" << QDate(2014, 1, 1)));
+    QVERIFY(!sheet.writeRow(1, 16383, numbers, 3));
+    QVERIFY(!sheet.writeColumn(0, 1, numbers, 3));
+
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("A1:F6"));
+    QCOMPARE(sheet.read(1, 3).toDouble(), 2.5);
+    QCOMPARE(sheet.read(3, 1).toString(), QString("World"));
+    QCOMPARE(sheet.read(5, 4).toDouble(), 6.0);
+    QCOMPARE(sheet.read(6, 1).toDouble(), 7.0);
+    QCOMPARE(sheet.read(6, 2).toBool(), true);
+    QCOMPARE(sheet.read(6, 3).toString(), QString("Hello"));
+    QVERIFY(sheet.cellAt(6, 5)->hasFormula());
+    QVERIFY(sheet.cellAt(6, 6)->isDateTime());
+
+    // Three references to the two strings
+    QCOMPARE(sheet.d_func()->sharedStrings()->count(), 3);
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<row r=\"1\" spans=\"1:6\"><c r=\"B1\"><v>1</v></c>"
+                             "<c r=\"C1\"><v>2.5</v></c><c r=\"D1\"><v>3</v></c></row>"));
+    QVERIFY(xmldata.contains("<c r=\"A2\" t=\"s\"><v>0</v></c>"));
+
+    // Existing formats are kept when no format is given
+    QXlsx::Format format;
+    format.setFontBold(true);
+    sheet.writeNumeric(4, 2, 0, format);
+    QVERIFY(sheet.writeRow(4, 2, numbers + 3, 3));
+    QCOMPARE(sheet.cellAt(4, 2)->format(), format);
+    QCOMPARE(sheet.read(4, 2).toDouble(), 4.0);
+
+    // Dates get the default date format, unless a date time format is given
+    const QVector<QDate> dates = QVector<QDate>() << QDate(2014, 1, 1) << QDate(2014, 1, 2);
+    QVERIFY(sheet.writeColumn(8, 1, dates));
+    QVERIFY(sheet.cellAt(9, 1)->isDateTime());
+    QCOMPARE(sheet.read(9, 1).toDate(), QDate(2014, 1, 2));
+    QXlsx::Format dateFormat;
+    dateFormat.setNumberFormat("yyyy-mm-dd hh:mm");
+    QVERIFY(sheet.writeRow(10, 1, QVector<QDateTime>() << QDateTime(QDate(2014, 1, 1), QTime(6, 0)),
+                           dateFormat));
+    QCOMPARE(sheet.cellAt(10, 1)->value().toDouble(), 41640.25);
+    QCOMPARE(sheet.cellAt(10, 1)->format().numberFormat(), QString("yyyy-mm-dd hh:mm"));
+}
+
+void WorksheetTest::testBatchRead()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    const double numbers[] = {1, 2.5, 3, 4};
+
+    sheet.writeRange(2, 2, numbers, 2, 2);
+    sheet.writeString(2, 3, "Hello");
+    sheet.writeFormula(5, 2, QXlsx::CellFormula("1+2"), QXlsx::Format(), 3);
+    sheet.writeDateTime(6, 2, QDateTime(QDate(2014, 1, 1), QTime(12, 0)));
+
+    QVector<double> values;
+    QBitArray valid;
+    QVERIFY(sheet.readRange(QXlsx::CellRange("B2:D3"), &values, &valid));
+    QCOMPARE(values, QVector<double>() << 1 << 0 << 0 << 3 << 4 << 0);
+    QCOMPARE(valid.size(), 6);
+    QVERIFY(valid.testBit(0) && !valid.testBit(1) && !valid.testBit(2));
+    QVERIFY(valid.testBit(3) && valid.testBit(4) && !valid.testBit(5));
+
+    QVERIFY(sheet.readColumn(2, 1, 6, &values, &valid));
+    QCOMPARE(values.size(), 6);
+    QCOMPARE(values[0], 0.0);
+    QCOMPARE(values[2], 3.0);
+    QCOMPARE(values[4], 3.0);
+    QCOMPARE(values[5], 41640.5);
+    QVERIFY(!valid.testBit(0) && !valid.testBit(3) && valid.testBit(4));
+
+    QVector<QDateTime> dates;
+    QVERIFY(sheet.readColumn(2, 5, 7, &dates, &valid));
+    QCOMPARE(dates.size(), 3);
+    QCOMPARE(dates[1], QDateTime(QDate(2014, 1, 1), QTime(12, 0)));
+    QVERIFY(!dates[2].isValid());
+    QVERIFY(valid.testBit(1) && !valid.testBit(2));
+
+    QVERIFY(!sheet.readColumn(0, 1, 2, &values));
+    QVERIFY(!sheet.readRange(QXlsx::CellRange(), &values));
+}
+
+void WorksheetTest::testRawRead()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write(1, 1, 1.5);
+    sheet.write(1, 2, true);
+    sheet.writeString(1, 3, "Hello");
+    sheet.writeFormula(1, 4, QXlsx::CellFormula("1+2"), QXlsx::Format(), 3);
+    sheet.writeDateTime(2, 2, QDateTime(QDate(2014, 1, 1), QTime(12, 0)));
+    sheet.writeBlank(3, 1);
+    sheet.writeInlineString(3, 5, "Inline");
+
+    QXlsx::RawCellValue value = sheet.readRaw(1, 1);
+    QCOMPARE(value.type, QXlsx::RawCellValue::Number);
+    QCOMPARE(value.number, 1.5);
+    QCOMPARE(sheet.readRaw(1, 2).type, QXlsx::RawCellValue::Boolean);
+    QVERIFY(sheet.readRaw(1, 2).boolean);
+    value = sheet.readRaw(1, 3);
+    QCOMPARE(value.type, QXlsx::RawCellValue::SharedString);
+    QCOMPARE(sheet.sharedString(value.sharedStringIndex), QString("Hello"));
+    QCOMPARE(sheet.readRaw(1, 4).number, 3.0);
+    // Dates are their numbers
+    value = sheet.readRaw(2, 2);
+    QCOMPARE(value.type, QXlsx::RawCellValue::Number);
+    QCOMPARE(value.number, 41640.5);
+    QVERIFY(value.formatIndex != -1);
+    QCOMPARE(sheet.readRaw(3, 1).type, QXlsx::RawCellValue::Empty);
+    QCOMPARE(sheet.readRaw(3, 5).type, QXlsx::RawCellValue::Other);
+    QCOMPARE(sheet.readRaw(9, 9).type, QXlsx::RawCellValue::Empty);
+
+    QXlsx::RawRowIterator it(&sheet, QXlsx::CellRange("B1:D2"));
+    QVERIFY(it.nextRow());
+    QCOMPARE(it.row(), 1);
+    QCOMPARE(it.cellCount(), 3);
+    QCOMPARE(it.column(0), 2);
+    QCOMPARE(it.value(2).number, 3.0);
+    QVERIFY(it.nextRow());
+    QCOMPARE(it.row(), 2);
+    QCOMPARE(it.cellCount(), 1);
+    QVERIFY(!it.nextRow());
+    QVERIFY(!it.nextRow());
+
+    QXlsx::RawRowIterator all(&sheet);
+    int cells = 0;
+    while (all.nextRow())
+        cells += all.cellCount();
+    QCOMPARE(cells, 7);
+}
+
+void WorksheetTest::testRawWrite()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write(1, 1, "=1+2", QXlsx::Format(), QXlsx::Worksheet::RawWrite);
+    sheet.write(2, 1, "http://qt-project.org", QXlsx::Format(), QXlsx::Worksheet::RawWrite);
+    sheet.write(3, 1, "http://qt-project.org");
+    sheet.write(4, 1, "no url: here");
+
+    QVERIFY(!sheet.cellAt(1, 1)->hasFormula());
+    QCOMPARE(sheet.read(1, 1).toString(), QString("=1+2"));
+    QCOMPARE(sheet.cellAt(2, 1)->cellType(), QXlsx::Cell::SharedStringType);
+    QCOMPARE(sheet.read(4, 1).toString(), QString("no url: here"));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<hyperlink ref=\"A3\""));
+    QVERIFY(!xmldata.contains("<hyperlink ref=\"A2\""));
+    QVERIFY(!xmldata.contains("<hyperlink ref=\"A4\""));
+}
+
+void WorksheetTest::testWriteStyleId()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QXlsx::Workbook *workbook = sheet.d_func()->workbook;
+    QXlsx::Format format;
+    format.setFontBold(true);
+    const int styleId = workbook->registerFormat(format);
+    QVERIFY(styleId > 0);
+    QCOMPARE(workbook->registerFormat(format), styleId);
+    QCOMPARE(workbook->registerFormat(QXlsx::Format()), -1);
+    QVERIFY(workbook->registeredFormat(styleId).fontBold());
+
+    QVERIFY(sheet.write(1, 1, 1.5, styleId));
+    QVERIFY(sheet.write(2, 1, "text", styleId));
+    QVERIFY(sheet.write(3, 1, QDate(2014, 1, 1), styleId));
+    QVERIFY(sheet.write(4, 1, QVariant(), styleId));
+    QVERIFY(!sheet.write(5, 1, 1, styleId + 100));
+
+    QCOMPARE(sheet.cellAt(1, 1)->format().xfIndex(), styleId);
+    QCOMPARE(sheet.cellAt(2, 1)->cellType(), QXlsx::Cell::SharedStringType);
+    QVERIFY(sheet.cellAt(3, 1)->isDateTime());
+    QVERIFY(sheet.cellAt(3, 1)->format().fontBold());
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains(QString("<c r=\"A1\" s=\"%1\"><v>1.5</v></c>").arg(styleId).toLatin1()));
+    QVERIFY(xmldata.contains(QString("<c r=\"A4\" s=\"%1\"/>").arg(styleId).toLatin1()));
+}
+
+void WorksheetTest::testWriteUtf8String()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    const char data[] = "caf\xc3\xa9 cr\xc3\xa8me";
+    QVERIFY(sheet.writeUtf8String(1, 1, data));
+    QVERIFY(sheet.writeUtf8String(2, 1, data, 5));
+    QVERIFY(sheet.writeString(3, 1, QString::fromUtf8(data)));
+    QVERIFY(!sheet.writeUtf8String(1, 1, 0));
+
+    QCOMPARE(sheet.read(1, 1).toString(), QString::fromUtf8("caf\xc3\xa9 cr\xc3\xa8me"));
+    QCOMPARE(sheet.read(2, 1).toString(), QString::fromUtf8("caf\xc3\xa9"));
+    QCOMPARE(sheet.cellAt(1, 1)->cellType(), QXlsx::Cell::SharedStringType);
+
+    // The same shared string is used by A1 and A3
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<c r=\"A1\" t=\"s\"><v>0</v></c>"));
+    QVERIFY(xmldata.contains("<c r=\"A3\" t=\"s\"><v>0</v></c>"));
+}
+
+void WorksheetTest::testWriteInlineRichString()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    for (int row = 1; row <= 3; ++row) {
+        QXlsx::RichString text;
+        text.addFragment(QString("Item %1").arg(row), bold);
+        text.addFragment(" of the list", QXlsx::Format());
+        QVERIFY(sheet.writeInlineString(row, 1, text));
+    }
+
+    // The cells share the font, and the text doesn't go to the shared strings
+    QXlsx::WorksheetPrivate *sheet_d = sheet.d_func();
+    QCOMPARE(sheet_d->inlineFonts.size(), 1);
+    QCOMPARE(sheet_d->sharedStrings()->count(), 0);
+    QCOMPARE(sheet.cellAt(2, 1)->cellType(), QXlsx::Cell::InlineStringType);
+    QVERIFY(sheet.cellAt(2, 1)->isRichString());
+    QCOMPARE(sheet.read(2, 1).toString(), QString("Item 2 of the list"));
+    QXlsx::RichString string = sheet_d->cellRichString(*sheet_d->cellTable.cell(2, 1));
+    QCOMPARE(string.fragmentCount(), 2);
+    QCOMPARE(string.fragmentText(0), QString("Item 2"));
+    QVERIFY(string.fragmentFormat(0).fontBold());
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<c r=\"A2\" t=\"inlineStr\"><is><r><rPr><b/></rPr><t>Item 2</t></r>"
+                             "<r><t xml:space=\"preserve\"> of the list</t></r></is></c>"));
+
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    QVERIFY(sheet2.loadFromXmlData(xmldata));
+    QCOMPARE(sheet2.d_func()->inlineFonts.size(), 1);
+    QCOMPARE(sheet2.read(3, 1).toString(), QString("Item 3 of the list"));
+    QVERIFY(sheet2.cellAt(3, 1)->isRichString());
+    QVERIFY(sheet2.saveToXmlData().contains("<r><rPr><b/></rPr><t>Item 3</t></r>"));
+
+    // A single fragment is a plain inline string in the format of the fragment
+    QXlsx::RichString plain;
+    plain.addFragment("Plain", bold);
+    QVERIFY(sheet.writeInlineString(4, 1, plain));
+    QVERIFY(!sheet.cellAt(4, 1)->isRichString());
+    QVERIFY(sheet.cellAt(4, 1)->format().fontBold());
+}
+
+void WorksheetTest::testStringStorage()
+{
+    QXlsx::CardinalityEstimator distinct;
+    QXlsx::CardinalityEstimator repeated;
+    for (int i = 0; i < 10000; ++i) {
+        distinct.add(QString("ID-%1").arg(i));
+        repeated.add(QString("Label %1").arg(i % 10));
+    }
+    QCOMPARE(distinct.count(), 10000);
+    QVERIFY(qAbs(distinct.estimate() - 10000) < 1500);
+    QVERIFY(qAbs(repeated.estimate() - 10) < 2);
+
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QCOMPARE(sheet.stringStorage(), QXlsx::Worksheet::SharedStringStorage);
+    sheet.setStringStorage(QXlsx::Worksheet::InlineStringStorage);
+    sheet.writeString(1, 4, "inline");
+    QCOMPARE(sheet.cellAt(1, 4)->cellType(), QXlsx::Cell::InlineStringType);
+    QCOMPARE(sheet.d_func()->sharedStrings()->count(), 0);
+
+    // The identifiers of column A are inlined once enough of them are seen,
+    // the labels of column B stay shared
+    sheet.setStringStorage(QXlsx::Worksheet::AdaptiveStringStorage);
+    for (int row = 1; row <= 200; ++row) {
+        sheet.writeString(row, 1, QString("ID-%1").arg(row));
+        sheet.writeString(row, 2, QString("Label %1").arg(row % 5));
+    }
+    QVERIFY(sheet.writeRow(1, 3, QStringList() << "x" << "y"));
+    QCOMPARE(sheet.cellAt(1, 1)->cellType(), QXlsx::Cell::SharedStringType);
+    QCOMPARE(sheet.cellAt(200, 1)->cellType(), QXlsx::Cell::InlineStringType);
+    QCOMPARE(sheet.read(200, 1).toString(), QString("ID-200"));
+    QCOMPARE(sheet.cellAt(200, 2)->cellType(), QXlsx::Cell::SharedStringType);
+    QCOMPARE(sheet.d_func()->sharedStrings()->count(), 5 + 63 + 2);
+    QVERIFY(sheet.saveToXmlData().contains(
+        "<c r=\"A200\" t=\"inlineStr\"><is><t>ID-200</t></is></c>"));
+}
+
+void WorksheetTest::testSaveSharedFormulas()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 4; ++row)
+        sheet.write(row, 2, QString("=A%1*$A$1").arg(row));
+    sheet.write(5, 2, "=LOG10(A5)");
+    sheet.write(6, 2, "=LOG10(A6)");
+    for (int col = 3; col <= 5; ++col)
+        sheet.write(1, col, QString("=%1+1").arg(QXlsx::CellReference(1, col - 1).toString()));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<c r=\"B1\"><f t=\"shared\" ref=\"B1:B4\" ca=\"1\" si=\"0\">"
+                             "A1*$A$1</f><v>0</v></c>"));
+    QVERIFY(xmldata.contains("<c r=\"B4\"><f t=\"shared\" ca=\"1\" si=\"0\"/><v>0</v></c>"));
+    QVERIFY(xmldata.contains("<c r=\"C1\"><f t=\"shared\" ref=\"C1:E1\" ca=\"1\" si=\"1\">"
+                             "B1+1</f><v>0</v></c>"));
+    QVERIFY(xmldata.contains("<c r=\"E1\"><f t=\"shared\" ca=\"1\" si=\"1\"/><v>0</v></c>"));
+    // LOG10 is not a reference
+    QVERIFY(xmldata.contains("<c r=\"B6\"><f ca=\"1\">LOG10(A6)</f><v>0</v></c>"));
+    QCOMPARE(sheet.read(4, 2).toString(), QString("=A4*$A$1"));
+
+    QXmlStreamReader reader(xmldata);
+    while (!reader.atEnd() && reader.name() != QLatin1String("sheetData"))
+        reader.readNextStartElement();
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    sheet2.d_func()->loadXmlSheetData(reader);
+    QCOMPARE(sheet2.read(3, 2).toString(), QString("=A3*$A$1"));
+    QCOMPARE(sheet2.read(1, 5).toString(), QString("=D1+1"));
+    QCOMPARE(sheet2.read(6, 2).toString(), QString("=LOG10(A6)"));
+
+    // Read again from the expanded texts
+    QCOMPARE(sheet2.read(3, 2).toString(), QString("=A3*$A$1"));
+    QCOMPARE(sheet2.d_func()->sharedFormulaTexts.size(), 2);
+    QCOMPARE(sheet2.read(1, 5).toString(), QString("=D1+1"));
+}
+
+void WorksheetTest::testCellAt()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", 123);
+    sheet.write("B2", "Hello");
+    QVERIFY(!sheet.cellAt("A2"));
+
+    QXlsx::Cell *cell = sheet.cellAt("A1");
+    QVERIFY(cell);
+    QCOMPARE(cell->cellType(), QXlsx::Cell::NumberType);
+    QCOMPARE(cell->value().toInt(), 123);
+    QCOMPARE(sheet.cellAt("B2")->value().toString(), QStringLiteral("Hello"));
+
+    //The same cell object is returned, and it follows the new content
+    sheet.write("A1", "World");
+    QCOMPARE(sheet.cellAt("A1"), cell);
+    QCOMPARE(cell->cellType(), QXlsx::Cell::SharedStringType);
+    QCOMPARE(cell->value().toString(), QStringLiteral("World"));
+}
+
+void WorksheetTest::testOverwriteString()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", "Hello");
+    sheet.write("A2", "World");
+    sheet.write("A1", "Qt");
+
+    //"Hello" is no longer referenced, so the indexes are compacted
+    QXlsx::SharedStrings *sst = sheet.d_func()->sharedStrings();
+    QCOMPARE(sst->getSharedStringIndex("Hello"), -1);
+    QCOMPARE(sst->count(), 2);
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<c r=\"A1\" t=\"s\"><v>1</v></c>"));
+    QVERIFY(xmldata.contains("<c r=\"A2\" t=\"s\"><v>0</v></c>"));
+}
+
+void WorksheetTest::testRowSpans()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write(1, 1, 1);
+    sheet.write(1, 16384, 2);
+    sheet.write(2, 5, 3);
+    sheet.write(20, 3, 4);
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<row r=\"1\" spans=\"1:16384\"><c r=\"A1\"><v>1</v></c>"
+                             "<c r=\"XFD1\"><v>2</v></c></row>"));
+    QVERIFY(xmldata.contains("<row r=\"2\" spans=\"1:16384\">"));
+    QVERIFY(xmldata.contains("<row r=\"20\" spans=\"3:3\"><c r=\"C20\"><v>4</v></c></row>"));
+}
+
 void WorksheetTest::testWriteHyperlinks()
 {
     QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
@@ -143,6 +861,81 @@ void WorksheetTest::testWriteHyperlinks()
     QCOMPARE(sheet.d_func()->sharedStrings()->getSharedString(2).toPlainString(), QStringLiteral("http://qt-project.org/abc.html#test"));
     QCOMPARE(sheet.d_func()->sharedStrings()->getSharedString(3).toPlainString(), QStringLiteral("xyz@debao.me"));
     QCOMPARE(sheet.d_func()->sharedStrings()->getSharedString(4).toPlainString(), QStringLiteral("xyz@debao.me?subject=Test"));
+
+    // The links to the same target share its relationship and its string
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 100; row >= 1; --row) {
+        sheet2.writeHyperlink(row, 1, QUrl("http://qt-project.org/docs"), QXlsx::Format(), "",
+                              "Docs");
+    }
+    sheet2.writeHyperlink(50, 2, QUrl("http://qt-project.org/blog"));
+    const QXlsx::HyperlinkTable &links = sheet2.d_func()->urlTable;
+    QCOMPARE(links.size(), 101);
+    QCOMPARE(links.stringCount(), 4);
+    QCOMPARE(links.at(0).row, 1);
+    QCOMPARE(links.at(50).column, 2);
+    QCOMPARE(links.data(links.indexOf(7, 1)).tooltip, QString("Docs"));
+    xmldata = sheet2.saveToXmlData();
+    QVERIFY(xmldata.contains("<hyperlink ref=\"A1\" r:id=\"rId1\" tooltip=\"Docs\"/>"));
+    QVERIFY(xmldata.contains("<hyperlink ref=\"A100\" r:id=\"rId1\" tooltip=\"Docs\"/>"));
+    QVERIFY(xmldata.contains("<hyperlink ref=\"B50\" r:id=\"rId2\"/>"));
+}
+
+void WorksheetTest::testWriteComments()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(sheet.writeComment("B2", "Check <this>"));
+    QVERIFY(sheet.writeComment(1, 3, "First row"));
+    QVERIFY(!sheet.writeComment(1, 4, QString()));
+    QCOMPARE(sheet.comment("B2"), QString("Check <this>"));
+    QCOMPARE(sheet.comment(1, 4), QString());
+    sheet.setCommentAuthor("Reviewer");
+    QCOMPARE(sheet.commentAuthor(), QString("Reviewer"));
+
+    // The rows of the comments are written even without cells
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<row r=\"2\""));
+    QVERIFY(xmldata.contains("<legacyDrawing r:id=\"rId2\"/>"));
+    QCOMPARE(sheet.d_func()->relationships->count(), 2);
+
+    QXlsx::CommentsWriter writer(sheet.d_func()->comments, sheet.commentAuthor());
+    QCOMPARE(writer.count(), 2);
+    QCOMPARE(writer.shapeBlockCount(), 1);
+    QBuffer comments;
+    comments.open(QIODevice::WriteOnly);
+    writer.saveComments(&comments);
+    QVERIFY(comments.data().contains("<authors><author>Reviewer</author></authors>"));
+    QVERIFY(comments.data().contains("<comment ref=\"C1\" authorId=\"0\"><text>"
+                                     "<t xml:space=\"preserve\">First row</t></text></comment>"
+                                     "<comment ref=\"B2\""));
+    QVERIFY(comments.data().contains("Check &lt;this&gt;"));
+
+    QBuffer vml;
+    vml.open(QIODevice::WriteOnly);
+    writer.saveVmlDrawing(&vml, 3);
+    QCOMPARE(vml.data().count("<v:shapetype "), 1);
+    QVERIFY(vml.data().contains("<o:idmap v:ext=\"edit\" data=\"3\"/>"));
+    QVERIFY(vml.data().contains("<v:shape id=\"_x0000_s3073\""));
+    QVERIFY(vml.data().contains("<x:Anchor>3, 15, 0, 2, 5, 15, 4, 16</x:Anchor>"));
+    QVERIFY(vml.data().contains("<x:Row>1</x:Row><x:Column>1</x:Column>"));
+
+    // The shape ids of many notes take several blocks
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 2500; ++row)
+        sheet2.writeComment(row, 2, QString("Note %1").arg(row));
+    QXlsx::CommentsWriter writer2(sheet2.d_func()->comments, QString());
+    QCOMPARE(writer2.shapeBlockCount(), 3);
+    vml.setData(QByteArray());
+    vml.open(QIODevice::WriteOnly);
+    writer2.saveVmlDrawing(&vml, 1);
+    QVERIFY(vml.data().contains("data=\"1,2,3\""));
+    QCOMPARE(vml.data().count("<v:shape id="), 2500);
+    QVERIFY(vml.data().contains("<v:shape id=\"_x0000_s2049\""));
+    QVERIFY(!vml.data().contains("<v:shape id=\"_x0000_s2048\""));
+
+    QVERIFY(sheet.removeComment(1, 3));
+    QVERIFY(!sheet.removeComment(1, 3));
+    QCOMPARE(sheet.d_func()->comments.size(), 1);
 }
 
 void WorksheetTest::testWriteDataValidations()
@@ -157,8 +950,106 @@ void WorksheetTest::testWriteDataValidations()
 
     QByteArray xmldata = sheet.saveToXmlData();
     QVERIFY(xmldata.contains("<dataValidation type=\"whole\" showInputMessage=\"1\" showErrorMessage=\"1\" sqref=\"A1 C2:C4\"><formula1>10</formula1><formula2>100</formula2></dataValidation>"));
+
+    QCOMPARE(sheet.dataValidationsAt(3, 3).size(), 1);
+    QCOMPARE(sheet.dataValidationsAt(3, 3).first().formula1(), QString("10"));
+    QVERIFY(sheet.dataValidationsAt(1, 3).isEmpty());
+
+    QXlsx::ConditionalFormatting cf;
+    cf.addHighlightCellsRule(QXlsx::ConditionalFormatting::Highlight_Equal, "1", QXlsx::Format());
+    cf.addRange("B1:B1000");
+    sheet.addConditionalFormatting(cf);
+    QCOMPARE(sheet.conditionalFormattingsAt(500, 2).size(), 1);
+    QVERIFY(sheet.conditionalFormattingsAt(500, 3).isEmpty());
  }
 
+void WorksheetTest::testValidate()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", 5);
+    sheet.write("A2", 15);
+    sheet.write("A3", 7.5);
+    sheet.write("A4", "text");
+    sheet.write("B1", "red");
+    sheet.write("B2", "Blue");
+    sheet.write("B3", "green");
+    sheet.write("C1", "ab");
+    sheet.write("C2", "abcdef");
+    sheet.write("D1", "y");
+    sheet.write("D2", "z");
+    sheet.write("F1", "x");
+    sheet.write("F2", "y");
+
+    QXlsx::DataValidation whole(QXlsx::DataValidation::Whole, QXlsx::DataValidation::Between,
+                                "1", "10");
+    whole.addRange("A1:A5");
+    sheet.addDataValidation(whole);
+    QXlsx::DataValidation inlineList(QXlsx::DataValidation::List,
+                                     QXlsx::DataValidation::Between, "\"red,blue\"");
+    inlineList.addRange("B1:B3");
+    sheet.addDataValidation(inlineList);
+    QXlsx::DataValidation length(QXlsx::DataValidation::TextLength,
+                                 QXlsx::DataValidation::LessThanOrEqual, "3");
+    length.addRange("C1:C2");
+    sheet.addDataValidation(length);
+    QXlsx::DataValidation cellList(QXlsx::DataValidation::List,
+                                   QXlsx::DataValidation::Between, "$F$1:$F$2");
+    cellList.addRange("D1:D2");
+    sheet.addDataValidation(cellList);
+
+    QList<QXlsx::DataValidationViolation> violations = sheet.validate(QXlsx::CellRange("A1:D5"));
+    QCOMPARE(violations.size(), 6);
+    QCOMPARE(violations[0].row, 2);
+    QCOMPARE(violations[0].column, 1);
+    QCOMPARE(violations[0].validation.formula2(), QString("10"));
+    QCOMPARE(violations[1].column, 3);
+    QCOMPARE(violations[2].column, 4);
+    QCOMPARE(violations[3].row, 3);
+    QCOMPARE(violations[3].column, 1);
+    QCOMPARE(violations[4].column, 2);
+    QCOMPARE(violations[5].row, 4);
+
+    QCOMPARE(sheet.validate(QXlsx::CellRange("A1:A2")).size(), 1);
+    QVERIFY(sheet.validate(QXlsx::CellRange("F1:F2")).isEmpty());
+}
+
+void WorksheetTest::testMergeSimilarRules()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 100; ++row) {
+        QXlsx::DataValidation whole(QXlsx::DataValidation::Whole,
+                                    QXlsx::DataValidation::Between, "1", "10");
+        whole.addCell(row, 1);
+        sheet.addDataValidation(whole);
+
+        // Relative references mean the same thing in every row
+        QXlsx::DataValidation custom(QXlsx::DataValidation::Custom,
+                                     QXlsx::DataValidation::Between,
+                                     QString("B%1>0").arg(row));
+        custom.addCell(row, 3);
+        sheet.addDataValidation(custom);
+
+        QXlsx::ConditionalFormatting cf;
+        cf.addHighlightCellsRule(QXlsx::ConditionalFormatting::Highlight_Equal, "1",
+                                 QXlsx::Format());
+        cf.addRange(QXlsx::CellRange(row, 4, row, 5));
+        sheet.addConditionalFormatting(cf);
+    }
+    QXlsx::DataValidation other(QXlsx::DataValidation::Whole, QXlsx::DataValidation::Between,
+                                "1", "20");
+    other.addCell(1, 6);
+    sheet.addDataValidation(other);
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<dataValidations count=\"3\">"));
+    QVERIFY(xmldata.contains("sqref=\"A1:A100\"><formula1>1</formula1>"));
+    QVERIFY(xmldata.contains("sqref=\"C1:C100\"><formula1>B1&gt;0</formula1>"));
+    QVERIFY(xmldata.contains("<conditionalFormatting sqref=\"D1:E100\">"));
+    QCOMPARE(xmldata.count("<conditionalFormatting "), 1);
+    QCOMPARE(sheet.dataValidationsAt(50, 3).size(), 1);
+    QCOMPARE(sheet.conditionalFormattingsAt(50, 5).size(), 1);
+}
+
 void WorksheetTest::testMerge()
 {
     QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
@@ -167,6 +1058,13 @@ void WorksheetTest::testMerge()
     QByteArray xmldata = sheet.saveToXmlData();
 
     QVERIFY2(xmldata.contains("<mergeCells count=\"1\"><mergeCell ref=\"B1:B5\"/></mergeCells>"), "");
+
+    // Merged cells can't overlap
+    QVERIFY(!sheet.mergeCells("A3:C3"));
+    QVERIFY(sheet.mergeCells("C3:D4"));
+    QCOMPARE(sheet.mergedRangeAt(3, 2), QXlsx::CellRange("B1:B5"));
+    QCOMPARE(sheet.mergedRangeAt(4, 4), QXlsx::CellRange("C3:D4"));
+    QVERIFY(!sheet.mergedRangeAt(6, 2).isValid());
 }
 
 void WorksheetTest::testUnMerge()
@@ -174,33 +1072,435 @@ void WorksheetTest::testUnMerge()
     QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
     sheet.write("B1", 123);
     sheet.mergeCells("B1:B5");
-    sheet.unmergeCells("B1:B5");
+    QVERIFY(sheet.mergeCells("C1:D2"));
+    // Only the exact merged range is unmerged
+    QVERIFY(!sheet.unmergeCells("B1:B4"));
+    QVERIFY(sheet.unmergeCells("B1:B5"));
+    QVERIFY(!sheet.unmergeCells("B1:B5"));
+    QVERIFY(!sheet.mergedRangeAt(2, 2).isValid());
+    QCOMPARE(sheet.mergedRangeAt(2, 4), QXlsx::CellRange("C1:D2"));
+    QVERIFY(sheet.unmergeCells("C1:D2"));
+    QVERIFY(sheet.mergeCells("A2:B3"));
+    QVERIFY(sheet.unmergeCells("A2:B3"));
 
     QByteArray xmldata = sheet.saveToXmlData();
 
     QVERIFY2(!xmldata.contains("<mergeCell"), "");
 }
 
+void WorksheetTest::testUnMergeMany()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 2000; ++row)
+        QVERIFY(sheet.mergeCells(QXlsx::CellRange(row, 1, row, 3)));
+    // Spans too many blocks to be indexed by blocks
+    QVERIFY(sheet.mergeCells("E1:E2000"));
+
+    // Unmerge from the middle, the remaining merges are still found
+    for (int row = 500; row <= 1500; ++row)
+        QVERIFY(sheet.unmergeCells(QXlsx::CellRange(row, 1, row, 3)));
+    QCOMPARE(sheet.mergedCells().size(), 1000);
+    for (int row = 1; row <= 2000; ++row) {
+        const bool merged = row < 500 || row > 1500;
+        QCOMPARE(sheet.mergedRangeAt(row, 2).isValid(), merged);
+        if (merged)
+            QCOMPARE(sheet.mergedRangeAt(row, 2), QXlsx::CellRange(row, 1, row, 3));
+    }
+    QCOMPARE(sheet.mergedRangeAt(1000, 5), QXlsx::CellRange("E1:E2000"));
+
+    QVERIFY(sheet.unmergeCells("E1:E2000"));
+    QVERIFY(!sheet.mergedRangeAt(1000, 5).isValid());
+    QVERIFY(sheet.mergeCells("A1000:C1000"));
+    QVERIFY(!sheet.mergeCells("B400:B600"));
+
+    // The merges stay in the order they were added
+    const QList<QXlsx::CellRange> merges = sheet.mergedCells();
+    QCOMPARE(merges.size(), 1000);
+    QCOMPARE(merges[0], QXlsx::CellRange("A1:C1"));
+    QCOMPARE(merges[498], QXlsx::CellRange("A499:C499"));
+    QCOMPARE(merges[499], QXlsx::CellRange("A1501:C1501"));
+    QCOMPARE(merges[998], QXlsx::CellRange("A2000:C2000"));
+    QCOMPARE(merges[999], QXlsx::CellRange("A1000:C1000"));
+
+    QXlsx::Worksheet small("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(small.mergeCells("A1:B1"));
+    QVERIFY(small.mergeCells("A2:B2"));
+    QVERIFY(small.mergeCells("A3:B3"));
+    QVERIFY(small.unmergeCells("A2:B2"));
+    QCOMPARE(small.mergedRangeAt(3, 2), QXlsx::CellRange("A3:B3"));
+    QVERIFY(small.mergeCells("A2:B2"));
+    QVERIFY(small.saveToXmlData().contains(
+        "<mergeCells count=\"3\"><mergeCell ref=\"A1:B1\"/><mergeCell ref=\"A3:B3\"/>"
+        "<mergeCell ref=\"A2:B2\"/></mergeCells>"));
+}
+
+void WorksheetTest::testConstantMemoryMode()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(sheet.setConstantMemoryEnabled());
+    QVERIFY(sheet.isConstantMemoryEnabled());
+
+    sheet.write("A1", 123);
+    sheet.write("B1", "Hello");
+    QVERIFY(sheet.cellAt("A1"));
+    sheet.write("A3", true);
+    QVERIFY(!sheet.cellAt("A1")); // row 1 has been flushed
+    QVERIFY(!sheet.write("C1", 456)); // flushed rows can not be changed
+    QVERIFY(!sheet.setConstantMemoryEnabled(false));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+
+    QVERIFY2(xmldata.contains("<dimension ref=\"A1:B3\"/>"), "");
+    QVERIFY2(xmldata.contains("<row r=\"1\" spans=\"1:2\"><c r=\"A1\"><v>123</v></c>"
+                              "<c r=\"B1\" t=\"s\"><v>0</v></c></row>"), "");
+    QVERIFY2(xmldata.contains("<row r=\"3\" spans=\"1:1\"><c r=\"A3\" t=\"b\"><v>1</v></c></row>"
+                              "</sheetData>"), "");
+}
+
+void WorksheetTest::testConstantMemoryWithoutTemporaryFile()
+{
+#ifdef Q_OS_UNIX
+    // The stream file can't be created, the rows are kept in memory
+    const QByteArray tmpDir = qgetenv("TMPDIR");
+    qputenv("TMPDIR", "/nonexistent/directory");
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QVERIFY(sheet.setConstantMemoryEnabled());
+    sheet.write("A1", 123);
+    sheet.write("A3", true);
+    if (tmpDir.isNull())
+        qunsetenv("TMPDIR");
+    else
+        qputenv("TMPDIR", tmpDir);
+    QVERIFY(sheet.cellAt("A1"));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY2(xmldata.contains("<row r=\"1\" spans=\"1:1\"><c r=\"A1\"><v>123</v></c></row>"
+                              "<row r=\"3\" spans=\"1:1\"><c r=\"A3\" t=\"b\"><v>1</v></c></row>"),
+             "");
+#else
+    QSKIP("The temporary directory is only moved on Unix");
+#endif
+}
+
+void WorksheetTest::testInsertRemoveRows()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    for (int row = 1; row <= 10; ++row)
+        sheet.write(row, 1, row);
+    sheet.write("B10", "=SUM(A1:A10)");
+    sheet.write("C5", "Text");
+    sheet.writeFormula("D1", QXlsx::CellFormula("A1*2", "D1:D10", QXlsx::CellFormula::SharedType));
+    sheet.writeHyperlink(6, 2, QUrl("http://qt-project.org"));
+    sheet.mergeCells("E3:F8");
+    sheet.setRowHeight(4, 4, 30);
+    QXlsx::DataValidation validation(QXlsx::DataValidation::Whole);
+    validation.addRange("A8:A10");
+    sheet.addDataValidation(validation);
+    QXlsx::Cell *cell = sheet.cellAt(5, 3);
+
+    QVERIFY(sheet.insertRows(4, 2));
+    QCOMPARE(sheet.read(3, 1).toInt(), 3);
+    QVERIFY(!sheet.read(4, 1).isValid());
+    QCOMPARE(sheet.read(6, 1).toInt(), 4);
+    QCOMPARE(sheet.read("B12").toString(), QString("=SUM(A1:A12)"));
+    QCOMPARE(sheet.read("D3").toString(), QString("=A3*2"));
+    QCOMPARE(sheet.read("D7").toString(), QString("=A7*2"));
+    QCOMPARE(sheet.cellAt(7, 3), cell);
+    QCOMPARE(cell->value().toString(), QString("Text"));
+    QCOMPARE(sheet.mergedCells(), QList<QXlsx::CellRange>() << QXlsx::CellRange("E3:F10"));
+    QCOMPARE(sheet.rowHeight(6), 30.0);
+    QCOMPARE(sheet.dataValidationsAt(10, 1).size(), 1);
+    QVERIFY(sheet.dataValidationsAt(8, 1).isEmpty());
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("A1:F12"));
+
+    QVERIFY(sheet.removeRows(2, 6));
+    QCOMPARE(sheet.read(1, 1).toInt(), 1);
+    QCOMPARE(sheet.read(2, 1).toInt(), 6);
+    QCOMPARE(sheet.read("B6").toString(), QString("=SUM(A1:A6)"));
+    QCOMPARE(sheet.read("D2").toString(), QString("=A2*2"));
+    QCOMPARE(sheet.mergedCells(), QList<QXlsx::CellRange>() << QXlsx::CellRange("E2:F4"));
+    QVERIFY(!sheet.cellAt(7, 3));
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("A1:F6"));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<hyperlink ref=\"B2\""));
+    QVERIFY(!sheet.insertRows(0));
+    QVERIFY(!sheet.removeRows(1, 0));
+}
+
+void WorksheetTest::testInsertRemoveColumns()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", 1);
+    sheet.write("B1", 2);
+    sheet.write("C1", "=A1+$B$1");
+    sheet.writeHyperlink(2, 3, QUrl("http://qt-project.org"));
+    sheet.setColumnWidth(2, 3, 20);
+
+    QVERIFY(sheet.insertColumns(2));
+    QCOMPARE(sheet.read("C1").toInt(), 2);
+    QCOMPARE(sheet.read("D1").toString(), QString("=A1+$C$1"));
+    QCOMPARE(sheet.columnWidth(4), 20.0);
+    QVERIFY(sheet.saveToXmlData().contains("ref=\"D2\""));
+
+    QVERIFY(sheet.removeColumns(1));
+    QCOMPARE(sheet.read("C1").toString(), QString("=#REF!+$B$1"));
+    QVERIFY(!sheet.read("A1").isValid());
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("B1:C2"));
+}
+
+void WorksheetTest::testClearRange()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    QXlsx::Format bold;
+    bold.setFontBold(true);
+    for (int row = 1; row <= 4; ++row) {
+        sheet.write(row, 1, "Text", bold);
+        sheet.write(row, 2, row);
+    }
+    sheet.writeHyperlink(3, 3, QUrl("http://qt-project.org"));
+    QXlsx::SharedStrings *sst = sheet.d_func()->sharedStrings();
+    QCOMPARE(sst->count(), 5);
+
+    // The formatted cells are left blank
+    QVERIFY(sheet.clear(QXlsx::CellRange("A1:C2"), QXlsx::Worksheet::ClearValues));
+    QCOMPARE(sst->count(), 3);
+    QVERIFY(!sheet.read(1, 1).isValid());
+    QVERIFY(sheet.cellAt(1, 1)->format().fontBold());
+    QVERIFY(!sheet.cellAt(1, 2));
+
+    QVERIFY(sheet.clear(QXlsx::CellRange("A3:A4"), QXlsx::Worksheet::ClearFormats));
+    QCOMPARE(sheet.read(3, 1).toString(), QString("Text"));
+    QVERIFY(!sheet.cellAt(3, 1)->format().fontBold());
+
+    QVERIFY(sheet.clear(QXlsx::CellRange("A1:C4")));
+    QCOMPARE(sst->count(), 0);
+    QVERIFY(!sheet.cellAt(1, 1));
+    QVERIFY(!sheet.saveToXmlData().contains("<hyperlink "));
+    QVERIFY(!sheet.clear(QXlsx::CellRange()));
+}
+
+void WorksheetTest::testCopyRange()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", 1);
+    sheet.write("A2", "Text");
+    sheet.write("B1", "=A1*2+$A$1");
+    sheet.writeFormula("C1", QXlsx::CellFormula("A1+1", "C1:C2", QXlsx::CellFormula::SharedType));
+    sheet.write("E6", "Replaced");
+    QXlsx::SharedStrings *sst = sheet.d_func()->sharedStrings();
+
+    QVERIFY(sheet.copyRange(QXlsx::CellRange("A1:C2"), QXlsx::CellReference("D5")));
+    QCOMPARE(sheet.read("D5").toInt(), 1);
+    QCOMPARE(sheet.read("D6").toString(), QString("Text"));
+    QCOMPARE(sheet.read("E5").toString(), QString("=D5*2+$A$1"));
+    QCOMPARE(sheet.read("F6").toString(), QString("=D6+1"));
+    // The empty source cells replace the cells of the destination
+    QVERIFY(!sheet.read("E6").isValid());
+    QCOMPARE(sst->count(), 2);
+    // The source is unchanged
+    QCOMPARE(sheet.read("B1").toString(), QString("=A1*2+$A$1"));
+    QCOMPARE(sheet.read("C2").toString(), QString("=A2+1"));
+    QCOMPARE(sheet.dimension(), QXlsx::CellRange("A1:F6"));
+
+    // Overlapping ranges are read before they are written
+    QVERIFY(sheet.copyRange(QXlsx::CellRange("A1:A2"), QXlsx::CellReference("A2")));
+    QCOMPARE(sheet.read("A2").toInt(), 1);
+    QCOMPARE(sheet.read("A3").toString(), QString("Text"));
+    QVERIFY(!sheet.copyRange(QXlsx::CellRange("A1:C2"), QXlsx::CellReference(1048576, 1)));
+}
+
+void WorksheetTest::testMoveRange()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", "First");
+    sheet.write("A2", "Second");
+    sheet.write("B1", "=A1&A2");
+    sheet.writeHyperlink(2, 2, QUrl("http://qt-project.org"));
+    QXlsx::SharedStrings *sst = sheet.d_func()->sharedStrings();
+    QCOMPARE(sst->count(), 3);
+
+    QVERIFY(sheet.moveRange(QXlsx::CellRange("A1:B2"), QXlsx::CellReference("B2")));
+    QCOMPARE(sheet.read("B2").toString(), QString("First"));
+    QCOMPARE(sheet.read("B3").toString(), QString("Second"));
+    QCOMPARE(sheet.read("C2").toString(), QString("=A1&A2"));
+    QVERIFY(!sheet.read("A1").isValid());
+    QVERIFY(!sheet.read("A2").isValid());
+    QCOMPARE(sst->count(), 3);
+    QVERIFY(sheet.saveToXmlData().contains("<hyperlink ref=\"C3\""));
+}
+
+void WorksheetTest::testSortRange()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", "Name");
+    sheet.write("B1", "Value");
+    const char *names[] = {"e", "b", "c", "d", "a", "f"};
+    for (int i = 0; i < 6; ++i)
+        sheet.write(i + 2, 1, QString::fromLatin1(names[i]));
+    sheet.write("B2", 3);
+    sheet.write("C2", "=B2*2");
+    sheet.write("B3", "banana");
+    sheet.write("B4", true);
+    sheet.write("B6", "Apple");
+    sheet.write("B7", 1);
+    sheet.writeHyperlink(7, 1, QUrl("http://qt-project.org"));
+
+    // Numbers, texts without regard to case, booleans, then the blanks
+    QVERIFY(sheet.sortRange(QXlsx::CellRange("A2:C7"), 2));
+    QCOMPARE(sheet.read("A1").toString(), QString("Name"));
+    QString sorted;
+    for (int row = 2; row <= 7; ++row)
+        sorted += sheet.read(row, 1).toString();
+    QCOMPARE(sorted, QString("feabcd"));
+    QCOMPARE(sheet.read("C3").toString(), QString("=B3*2"));
+    QVERIFY(sheet.saveToXmlData().contains("<hyperlink ref=\"A2\""));
+
+    QVERIFY(sheet.sortRange(QXlsx::CellRange("A2:C7"), 2, Qt::DescendingOrder));
+    sorted.clear();
+    for (int row = 2; row <= 7; ++row)
+        sorted += sheet.read(row, 1).toString();
+    QCOMPARE(sorted, QString("cbaefd"));
+
+    // The second key orders the rows whose first keys are equal
+    sheet.write("B2", 1);
+    sheet.write("B3", 2);
+    sheet.write("B4", 1);
+    QList<QPair<int, Qt::SortOrder>> keys;
+    keys << qMakePair(2, Qt::AscendingOrder) << qMakePair(1, Qt::AscendingOrder);
+    QVERIFY(sheet.sortRange(QXlsx::CellRange("A2:C4"), keys));
+    QCOMPARE(sheet.read("A2").toString(), QString("a"));
+    QCOMPARE(sheet.read("A3").toString(), QString("c"));
+    QCOMPARE(sheet.read("A4").toString(), QString("b"));
+
+    QVERIFY(!sheet.sortRange(QXlsx::CellRange("A2:C7"), 4));
+    sheet.mergeCells(QXlsx::CellRange("D2:D3"));
+    QVERIFY(!sheet.sortRange(QXlsx::CellRange("A2:D7"), 1));
+}
+
+void WorksheetTest::testAutoFilter()
+{
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_NewFromScratch);
+    sheet.write("A1", "Fruit");
+    sheet.write("B1", "Count");
+    const char *fruits[] = {"apple", "Pear", "apple", "plum", "pear", "apple"};
+    for (int i = 0; i < 6; ++i) {
+        sheet.write(i + 2, 1, QString::fromLatin1(fruits[i]));
+        sheet.write(i + 2, 2, i % 3 + 0.5);
+    }
+    sheet.write("C8", true);
+
+    QVERIFY(!sheet.setAutoFilterValues(1, QStringList() << "apple"));
+    QVERIFY(sheet.setAutoFilter(QXlsx::CellRange("A1:C8")));
+    QCOMPARE(sheet.autoFilter().toString(), QString("A1:C8"));
+    QCOMPARE(sheet.autoFilterDistinctValues(1), QStringList() << "apple" << "Pear" << "plum"
+                                                               << "");
+    QCOMPARE(sheet.autoFilterDistinctValues(2), QStringList() << "0.5" << "1.5" << "2.5" << "");
+    QCOMPARE(sheet.autoFilterDistinctValues(3), QStringList() << "TRUE" << "");
+
+    // Row 8 has no fruit, and the fruits are compared without regard to case
+    QVERIFY(sheet.setAutoFilterValues(1, QStringList() << "PEAR" << "plum"));
+    QVERIFY(!sheet.setAutoFilterValues(4, QStringList() << "x"));
+    QCOMPARE(sheet.applyAutoFilter(), 4);
+    QVERIFY(sheet.isRowHidden(2));
+    QVERIFY(!sheet.isRowHidden(3));
+    QVERIFY(!sheet.isRowHidden(5));
+    QVERIFY(!sheet.isRowHidden(6));
+    QVERIFY(sheet.isRowHidden(7));
+    QVERIFY(!sheet.isRowHidden(1));
+
+    QVERIFY(sheet.setAutoFilterValues(2, QStringList() << "1.5"));
+    QCOMPARE(sheet.applyAutoFilter(), 5);
+    QVERIFY(sheet.isRowHidden(5));
+    QVERIFY(!sheet.isRowHidden(3));
+    QVERIFY(!sheet.isRowHidden(6));
+
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<sheetPr filterMode=\"1\"/>"));
+    QVERIFY(xmldata.contains("<autoFilter ref=\"A1:C8\"><filterColumn colId=\"0\"><filters>"
+                             "<filter val=\"PEAR\"/><filter val=\"plum\"/></filters>"
+                             "</filterColumn><filterColumn colId=\"1\"><filters>"
+                             "<filter val=\"1.5\"/></filters></filterColumn></autoFilter>"));
+
+    // All the rows show again once the filter is cleared
+    QVERIFY(sheet.setAutoFilterValues(1, QStringList()));
+    QVERIFY(sheet.setAutoFilterValues(2, QStringList()));
+    QCOMPARE(sheet.applyAutoFilter(), 0);
+    for (int row = 2; row <= 8; ++row)
+        QVERIFY(!sheet.isRowHidden(row));
+    QVERIFY(!sheet.saveToXmlData().contains("filterMode"));
+
+    // The autofilter moves with the rows inserted above it
+    QVERIFY(sheet.setAutoFilterValues(3, QStringList() << ""));
+    QVERIFY(sheet.insertColumns(1, 1));
+    QCOMPARE(sheet.autoFilter().toString(), QString("B1:D8"));
+    QCOMPARE(sheet.autoFilterValues(4), QStringList() << "");
+    QVERIFY(sheet.insertRows(1, 2));
+    QCOMPARE(sheet.autoFilter().toString(), QString("B3:D10"));
+
+    // Tables have autofilters of their own
+    QVERIFY(!sheet.addTable(QXlsx::CellRange("D9:E12")));
+    QVERIFY(sheet.addTable(QXlsx::CellRange("F1:G4")));
+    QVERIFY(!sheet.setAutoFilter(QXlsx::CellRange("E1:F4")));
+    QVERIFY(sheet.setAutoFilter(QXlsx::CellRange()));
+    QVERIFY(!sheet.autoFilter().isValid());
+    QVERIFY(!sheet.saveToXmlData().contains("<autoFilter "));
+}
+
+/*
+  Load the <sheetData> element \a xmlData into \a sheet, by the native
+  parser or by QXmlStreamReader.
+ */
+static void loadSheetData(QXlsx::Worksheet &sheet, const QByteArray &xmlData, bool native)
+{
+    if (native) {
+        QXlsx::XmlPullParser parser(xmlData);
+        parser.readNextStartElement();//current node is sheetData
+        sheet.d_func()->loadXmlSheetData(parser);
+    } else {
+        QXmlStreamReader reader(xmlData);
+        reader.readNextStartElement();//current node is sheetData
+        sheet.d_func()->loadXmlSheetData(reader);
+    }
+}
+
+static void addSheetDataReaders()
+{
+    QTest::addColumn<bool>("native");
+
+    QTest::newRow("QXmlStreamReader") << false;
+    QTest::newRow("XmlPullParser") << true;
+}
+
+void WorksheetTest::testReadSheetData_data()
+{
+    addSheetDataReaders();
+}
+
 void WorksheetTest::testReadSheetData()
 {
+    QFETCH(bool, native);
+
     const QByteArray xmlData = "<sheetData>"
             "<row r=\"1\" spans=\"1:6\">"
             "<c r=\"A1\" s=\"1\" t=\"s\"><v>0</v></c>"
             "<c r=\"B1\"><f>44+33</f><v>77</v></c>"
             "<c r=\"C1\" t=\"str\"><f>44+33</f><v>77</v></c>"
+            "<c r=\"D1\" t=\"s\"><f>A1</f><v>0</v></c>"
             "</row>"
             "<row r=\"3\" spans=\"1:6\">"
             "<c r=\"B3\" s=\"1\"><v>12345</v></c>"
             "<c r=\"C3\" s=\"1\" t=\"inlineStr\"><is><t>inline test string</t></is></c>"
             "<c r=\"E3\" t=\"e\"><f>1/0</f><v>#DIV/0!</v></c>"
+            "<c r=\"F3\" t=\"inlineStr\"><is><r><rPr><i/></rPr><t>rich</t></r><r><t> text</t></r>"
+            "<rPh sb=\"0\" eb=\"1\"><t>phonetic</t></rPh></is></c>"
+            "<c r=\"G3\" t=\"str\"><f ca=\"1\">\"a&amp;b\"</f><v>a&amp;b&#x20AC;</v></c>"
             "</row>"
             "</sheetData>";
-    QXmlStreamReader reader(xmlData);
-    reader.readNextStartElement();//current node is sheetData
 
     QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
     sheet.d_func()->sharedStrings()->addSharedString("Hello");
-    sheet.d_func()->loadXmlSheetData(reader);
+    loadSheetData(sheet, xmlData, native);
 
     QCOMPARE(sheet.d_func()->cellTable.size(), 2);
 
@@ -218,6 +1518,12 @@ void WorksheetTest::testReadSheetData()
     QCOMPARE(sheet.cellAt("C1")->value().toInt(), 77);
     QCOMPARE(sheet.cellAt("C1")->formula(), QXlsx::CellFormula("44+33"));
 
+    //D1, the text is read from the shared strings
+    QCOMPARE(sheet.cellAt("D1")->cellType(), QXlsx::Cell::SharedStringType);
+    QCOMPARE(sheet.cellAt("D1")->value().toString(), QStringLiteral("Hello"));
+    QCOMPARE(sheet.cellAt("D1")->formula(), QXlsx::CellFormula("A1"));
+    QCOMPARE(sheet.read("D1").toString(), QStringLiteral("=A1"));
+
     //B3
     QCOMPARE(sheet.cellAt("B3")->cellType(), QXlsx::Cell::NumberType);
     QCOMPARE(sheet.cellAt("B3")->value().toInt(), 12345);
@@ -229,6 +1535,90 @@ void WorksheetTest::testReadSheetData()
     //E3
     QCOMPARE(sheet.cellAt("E3")->cellType(), QXlsx::Cell::ErrorType);
     QCOMPARE(sheet.cellAt("E3")->value().toString(), QStringLiteral("#DIV/0!"));
+
+    //F3, the phonetic run is not part of the text
+    QCOMPARE(sheet.cellAt("F3")->cellType(), QXlsx::Cell::InlineStringType);
+    QCOMPARE(sheet.cellAt("F3")->value().toString(), QStringLiteral("rich text"));
+    QVERIFY(sheet.cellAt("F3")->isRichString());
+
+    //G3, the entities are decoded
+    QCOMPARE(sheet.cellAt("G3")->value().toString(), QString::fromUtf8("a&b\xE2\x82\xAC"));
+    QCOMPARE(sheet.cellAt("G3")->formula().formulaText(), QStringLiteral("\"a&b\""));
+    QVERIFY(sheet.saveToXmlData().contains("ca=\"1\""));
+}
+
+void WorksheetTest::testReadSheetDataWithoutReference_data()
+{
+    addSheetDataReaders();
+}
+
+void WorksheetTest::testReadSheetDataWithoutReference()
+{
+    QFETCH(bool, native);
+
+    const QByteArray xmlData = "<sheetData>"
+            "<row>"
+            "<c><v>1</v></c>"
+            "<c><v>2</v></c>"
+            "</row>"
+            "<row r=\"4\" customHeight=\"1\" ht=\"30\">"
+            "<c r=\"$B$4\"><v>3</v></c>"
+            "<c><v>4</v></c>"
+            "<c r=\"F4\"><v>5</v></c>"
+            "</row>"
+            "<row hidden=\"1\">"
+            "<c r=\"C5\"><v>6</v></c>"
+            "<c><v>7</v></c>"
+            "</row>"
+            "</sheetData>";
+
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    loadSheetData(sheet, xmlData, native);
+
+    QCOMPARE(sheet.read("A1").toInt(), 1);
+    QCOMPARE(sheet.read("B1").toInt(), 2);
+    QCOMPARE(sheet.read("B4").toInt(), 3);
+    QCOMPARE(sheet.read("C4").toInt(), 4);
+    QCOMPARE(sheet.read("F4").toInt(), 5);
+    QCOMPARE(sheet.read("C5").toInt(), 6);
+    QCOMPARE(sheet.read("D5").toInt(), 7);
+    QCOMPARE(sheet.rowHeight(4), 30.0);
+    QVERIFY(sheet.isRowHidden(5));
+}
+
+void WorksheetTest::testReadSharedStringFormula_data()
+{
+    addSheetDataReaders();
+}
+
+void WorksheetTest::testReadSharedStringFormula()
+{
+    QFETCH(bool, native);
+
+    const QByteArray xmlData = "<sheetData>"
+            "<row r=\"1\" spans=\"1:2\">"
+            "<c r=\"A1\" t=\"s\"><f>B1</f><v>1</v></c>"
+            "<c r=\"B1\" t=\"s\"><v>1</v></c>"
+            "</row>"
+            "</sheetData>";
+
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    QXlsx::SharedStrings *sst = sheet.d_func()->sharedStrings();
+    sst->addSharedString("Hello");
+    sst->addSharedString("World");
+    loadSheetData(sheet, xmlData, native);
+
+    QCOMPARE(sheet.cellAt("A1")->value().toString(), QStringLiteral("World"));
+    QCOMPARE(sheet.cellAt("A1")->formula(), QXlsx::CellFormula("B1"));
+
+    //The cell with a formula keeps its shared string reference
+    QCOMPARE(sst->count(), 4);
+    QByteArray xmldata = sheet.saveToXmlData();
+    QVERIFY(xmldata.contains("<c r=\"A1\" t=\"s\"><v>1</v></c>"));
+    sheet.write("B1", 2);
+    QCOMPARE(sst->count(), 3);
+    sheet.write("A1", 3);
+    QCOMPARE(sst->count(), 2);
 }
 
 void WorksheetTest::testReadColsInfo()
@@ -246,8 +1636,15 @@ void WorksheetTest::testReadColsInfo()
     QCOMPARE(sheet.d_func()->colsInfo[9]->width, 5.0);
 }
 
+void WorksheetTest::testReadRowsInfo_data()
+{
+    addSheetDataReaders();
+}
+
 void WorksheetTest::testReadRowsInfo()
 {
+    QFETCH(bool, native);
+
     const QByteArray xmlData = "<sheetData>"
             "<row r=\"1\" spans=\"1:6\">"
             "<c r=\"A1\" s=\"1\" t=\"s\"><v>0</v></c>"
@@ -256,16 +1653,47 @@ void WorksheetTest::testReadRowsInfo()
             "<c r=\"B3\" s=\"3\"><v>12345</v></c>"
             "</row>"
             "</sheetData>";
-    QXmlStreamReader reader(xmlData);
-    reader.readNextStartElement();//current node is sheetData
 
     QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
-    sheet.d_func()->loadXmlSheetData(reader);
+    loadSheetData(sheet, xmlData, native);
 
     QCOMPARE(sheet.d_func()->rowsInfo.size(), 1);
     QCOMPARE(sheet.d_func()->rowsInfo[3]->height, 40.0);
 }
 
+void WorksheetTest::testLoadFromXmlFile()
+{
+    // The <sheetData> is read by the native parser, the rest of the part
+    // by QXmlStreamReader
+    const QByteArray xmlData = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\r\n"
+            "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+            "<dimension ref=\"A1:B2\"/>"
+            "<cols><col min=\"1\" max=\"1\" width=\"5\" customWidth=\"1\"/></cols>"
+            "<!-- <sheetData/> -->"
+            "<sheetData><row r=\"1\"><c r=\"A1\"><v>1.5</v></c>"
+            "<c r=\"B1\" t=\"str\"><v>&lt;a&gt;</v></c></row>"
+            "<row r=\"2\"><c r=\"B2\" t=\"inlineStr\"><is><t xml:space=\"preserve\"> x </t></is>"
+            "</c></row></sheetData>"
+            "<mergeCells count=\"1\"><mergeCell ref=\"A2:B2\"/></mergeCells>"
+            "</worksheet>";
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    QVERIFY(sheet.loadFromXmlData(xmlData));
+    QCOMPARE(sheet.read("A1").toDouble(), 1.5);
+    QCOMPARE(sheet.read("B1").toString(), QStringLiteral("<a>"));
+    QCOMPARE(sheet.read("B2").toString(), QStringLiteral(" x "));
+    QCOMPARE(sheet.columnWidth(1), 5.0);
+    QCOMPARE(sheet.mergedCells(), QList<QXlsx::CellRange>() << QXlsx::CellRange("A2:B2"));
+
+    // Prefixed elements are left to QXmlStreamReader
+    const QByteArray prefixedData =
+            "<x:worksheet xmlns:x=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+            "<x:sheetData><x:row r=\"1\"><x:c r=\"A1\"><x:v>2</x:v></x:c></x:row></x:sheetData>"
+            "</x:worksheet>";
+    QXlsx::Worksheet sheet2("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    QVERIFY(sheet2.loadFromXmlData(prefixedData));
+    QCOMPARE(sheet2.read("A1").toInt(), 2);
+}
+
 void WorksheetTest::testReadMergeCells()
 {
     const QByteArray xmlData = "<mergeCells count=\"2\"><mergeCell ref=\"B1:B5\"/><mergeCell ref=\"E2:G4\"/></mergeCells>";
@@ -280,6 +1708,26 @@ void WorksheetTest::testReadMergeCells()
     QCOMPARE(sheet.d_func()->merges[0].toString(), QStringLiteral("B1:B5"));
 }
 
+void WorksheetTest::testReadAutoFilter()
+{
+    const QByteArray xmlData = "<autoFilter ref=\"B2:D20\">"
+            "<filterColumn colId=\"0\"><filters blank=\"1\"><filter val=\"a\"/><filter val=\"b\"/>"
+            "</filters></filterColumn>"
+            "<filterColumn colId=\"2\"><customFilters>"
+            "<customFilter operator=\"greaterThan\" val=\"3\"/></customFilters></filterColumn>"
+            "</autoFilter>";
+
+    QXmlStreamReader reader(xmlData);
+    reader.readNextStartElement();//current node is autoFilter
+
+    QXlsx::Worksheet sheet("", 1, 0, QXlsx::Worksheet::F_LoadFromExists);
+    sheet.d_func()->loadXmlAutoFilter(reader);
+
+    QCOMPARE(sheet.autoFilter().toString(), QString("B2:D20"));
+    QCOMPARE(sheet.autoFilterValues(2), QStringList() << "" << "a" << "b");
+    QVERIFY(sheet.autoFilterValues(4).isEmpty());
+}
+
 void WorksheetTest::testReadDataValidations()
 {
     const QByteArray xmlData = "<dataValidations count=\"2\">"
@@ -1,5 +1,7 @@
 #include "xlsxconditionalformatting.h"
 #include "xlsxformat.h"
+#include "xlsxdocument.h"
+#include "xlsxworksheet.h"
 #include "private/xlsxconditionalformatting_p.h"
 
 #include <QString>
@@ -20,6 +22,9 @@ private Q_SLOTS:
     void testHighlightRules();
     void testHighlightRules_data();
     void testDataBarRules();
+    void testEvaluateHighlightRules();
+    void testEvaluateColorScale();
+    void testEvaluateDataBar();
 };
 
 ConditionalFormattingTest::ConditionalFormattingTest()
@@ -98,6 +103,99 @@ void ConditionalFormattingTest::testDataBarRules()
     QVERIFY(buffer.buffer().contains(res));
 }
 
+void ConditionalFormattingTest::testEvaluateHighlightRules()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row <= 5; ++row)
+        sheet->write(row, 1, row);
+    sheet->write(1, 2, 1);
+    sheet->write(2, 2, 2);
+    sheet->write(3, 2, 3);
+    sheet->write(4, 2, 10);
+
+    Format red;
+    red.setFontColor(Qt::red);
+    ConditionalFormatting greater;
+    greater.addHighlightCellsRule(ConditionalFormatting::Highlight_GreaterThan, "3", red);
+    greater.addRange("A1:A5");
+    sheet->addConditionalFormatting(greater);
+
+    Format bold;
+    bold.setFontBold(true);
+    bold.setFontColor(Qt::green);
+    ConditionalFormatting top;
+    top.addHighlightCellsRule(ConditionalFormatting::Highlight_Top, "1", bold);
+    top.addRange("A1:A5");
+    sheet->addConditionalFormatting(top);
+
+    Format italic;
+    italic.setFontItalic(true);
+    ConditionalFormatting average;
+    average.addHighlightCellsRule(ConditionalFormatting::Highlight_AboveAverage, italic);
+    average.addRange("B1:B4");
+    sheet->addConditionalFormatting(average);
+
+    QVERIFY(!sheet->conditionalFormat(1, 1).isValid());
+    QCOMPARE(sheet->conditionalFormat(4, 1).fontColor(), QColor(Qt::red));
+    QVERIFY(!sheet->conditionalFormat(4, 1).fontBold());
+    // The first rule has the higher priority
+    QCOMPARE(sheet->conditionalFormat(5, 1).fontColor(), QColor(Qt::red));
+    QVERIFY(sheet->conditionalFormat(5, 1).fontBold());
+
+    QVERIFY(!sheet->conditionalFormat(3, 2).isValid());
+    QVERIFY(sheet->conditionalFormat(4, 2).fontItalic());
+
+    // The statistics of the rules follow the cells
+    sheet->write(3, 1, 10);
+    QVERIFY(sheet->conditionalFormat(3, 1).fontBold());
+    QVERIFY(!sheet->conditionalFormat(5, 1).fontBold());
+    QCOMPARE(sheet->conditionalFormat(5, 1).fontColor(), QColor(Qt::red));
+}
+
+void ConditionalFormattingTest::testEvaluateColorScale()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->write(1, 1, 0);
+    sheet->write(2, 1, 50);
+    sheet->write(3, 1, 100);
+
+    ConditionalFormatting cf;
+    cf.add2ColorScaleRule(QColor(0, 0, 0), QColor(200, 100, 0));
+    cf.addRange("A1:A3");
+    sheet->addConditionalFormatting(cf);
+
+    QCOMPARE(sheet->conditionalFormat(1, 1).fillPattern(), Format::PatternSolid);
+    QCOMPARE(sheet->conditionalFormat(1, 1).patternBackgroundColor(), QColor(0, 0, 0));
+    QCOMPARE(sheet->conditionalFormat(2, 1).patternBackgroundColor(), QColor(100, 50, 0));
+    QCOMPARE(sheet->conditionalFormat(3, 1).patternBackgroundColor(), QColor(200, 100, 0));
+}
+
+void ConditionalFormattingTest::testEvaluateDataBar()
+{
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    sheet->write(1, 1, 0);
+    sheet->write(2, 1, 25);
+    sheet->write(3, 1, 100);
+
+    ConditionalFormatting cf;
+    cf.addDataBarRule(Qt::blue);
+    cf.addRange("A1:A4");
+    sheet->addConditionalFormatting(cf);
+
+    double length = -1;
+    QColor color;
+    QVERIFY(sheet->conditionalDataBar(2, 1, &length, &color));
+    QCOMPARE(length, 0.25);
+    QCOMPARE(color, QColor(Qt::blue));
+    QVERIFY(sheet->conditionalDataBar(3, 1, &length));
+    QCOMPARE(length, 1.0);
+    QVERIFY(!sheet->conditionalDataBar(4, 1, &length));
+    QVERIFY(!sheet->conditionalFormat(2, 1).isValid());
+}
+
 QTEST_APPLESS_MAIN(ConditionalFormattingTest)
 
 #include "tst_conditionalformattingtest.moc"
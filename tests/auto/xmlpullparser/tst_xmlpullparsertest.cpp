@@ -0,0 +1,209 @@
+#include "private/xlsxxmlpullparser_p.h"
+#include <QString>
+#include <QtTest>
+
+using namespace QXlsx;
+
+class XmlPullParserTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    XmlPullParserTest();
+
+private Q_SLOTS:
+    void testElements();
+    void testAttributes();
+    void testText();
+    void testText_data();
+    void testSkip();
+    void testSkipToEndTag();
+    void testElementXml();
+    void testErrors();
+    void testCanParse();
+    void testCanParse_data();
+};
+
+XmlPullParserTest::XmlPullParserTest()
+{
+}
+
+void XmlPullParserTest::testElements()
+{
+    const QByteArray data = "<?xml version=\"1.0\"?>\r\n<!-- <b/> --><a><b/>text<c></c></a>";
+    XmlPullParser parser(data);
+
+    QVERIFY(parser.readNextStartElement());
+    QVERIFY(parser.isName("a"));
+    QVERIFY(!parser.isName("ab"));
+    QCOMPARE(parser.tokenOffset(), data.indexOf("<a>"));
+    QVERIFY(parser.readNextStartElement());
+    QVERIFY(parser.isName("b"));
+    // An empty element ends right away
+    QCOMPARE(parser.readNext(), XmlPullParser::EndElement);
+    QVERIFY(parser.isName("b"));
+    QCOMPARE(parser.readNext(), XmlPullParser::Characters);
+    QCOMPARE(parser.text(), QStringLiteral("text"));
+    QVERIFY(parser.readNextStartElement());
+    QVERIFY(parser.isName("c"));
+    QVERIFY(!parser.readNextStartElement());
+    QVERIFY(parser.isName("c"));
+    QVERIFY(!parser.readNextStartElement());
+    QVERIFY(parser.isName("a"));
+    QCOMPARE(parser.readNext(), XmlPullParser::EndDocument);
+    QVERIFY(parser.atEnd());
+    QVERIFY(!parser.hasError());
+}
+
+void XmlPullParserTest::testAttributes()
+{
+    const QByteArray data = "<c r=\"B12\" s = '3' ht=\"15.5\" t=\"\" v=\"a&amp;b\r\nc\"/>";
+    XmlPullParser parser(data);
+    QVERIFY(parser.readNextStartElement());
+
+    const char *value;
+    int size;
+    QVERIFY(parser.attribute("r", &value, &size));
+    QCOMPARE(QByteArray(value, size), QByteArray("B12"));
+    QCOMPARE(parser.attributeInt("s"), 3);
+    QCOMPARE(parser.attributeDouble("ht"), 15.5);
+    QVERIFY(parser.hasAttribute("t"));
+    QCOMPARE(parser.attributeInt("t", -1), -1);
+    QVERIFY(!parser.hasAttribute("x"));
+    QCOMPARE(parser.attributeInt("x", 7), 7);
+    QVERIFY(parser.attributeEquals("r", "B12"));
+    QVERIFY(!parser.attributeEquals("r", "B1"));
+    // The line ends of attribute values become spaces
+    QCOMPARE(parser.attributeText("v"), QStringLiteral("a&b c"));
+    QVERIFY(parser.attributeText("x").isNull());
+
+    QCOMPARE(XmlPullParser::toInt("-42", 3), -42);
+    QCOMPARE(XmlPullParser::toInt("12x", 3), 0);
+}
+
+void XmlPullParserTest::testText_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("plain") << QByteArray("<t>Hello</t>") << QStringLiteral("Hello");
+    QTest::newRow("empty") << QByteArray("<t/>") << QString();
+    QTest::newRow("utf-8") << QByteArray("<t>\xE4\xB8\xAD\xE6\x96\x87</t>")
+                           << QString::fromUtf8("\xE4\xB8\xAD\xE6\x96\x87");
+    QTest::newRow("entities") << QByteArray("<t>&lt;&gt;&amp;&quot;&apos;</t>")
+                              << QStringLiteral("<>&\"'");
+    QTest::newRow("character references") << QByteArray("<t>&#65;&#x42;&#x1F600;</t>")
+                                          << QString::fromUtf8("AB\xF0\x9F\x98\x80");
+    QTest::newRow("unknown entity") << QByteArray("<t>&nbsp;&</t>") << QStringLiteral("&nbsp;&");
+    QTest::newRow("line ends") << QByteArray("<t>a\r\nb\rc\nd</t>") << QStringLiteral("a\nb\nc\nd");
+    QTest::newRow("cdata") << QByteArray("<t>a<![CDATA[<&>]]>b</t>") << QStringLiteral("a<&>b");
+    QTest::newRow("child elements") << QByteArray("<t>a<b>skipped</b><!-- c -->b</t>")
+                                    << QStringLiteral("ab");
+}
+
+void XmlPullParserTest::testText()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(QString, text);
+
+    XmlPullParser parser(data);
+    QVERIFY(parser.readNextStartElement());
+    QCOMPARE(parser.readElementText(), text);
+    QCOMPARE(parser.tokenType(), XmlPullParser::EndElement);
+    QVERIFY(parser.isName("t"));
+}
+
+void XmlPullParserTest::testSkip()
+{
+    const QByteArray data = "<row><c><v>1</v><is><t>x</t></is></c><c><v>25</v></c></row>";
+    XmlPullParser parser(data);
+    QVERIFY(parser.readNextStartElement()); // row
+    QVERIFY(parser.readNextStartElement()); // c
+    parser.skipCurrentElement();
+    QCOMPARE(parser.tokenType(), XmlPullParser::EndElement);
+    QVERIFY(parser.isName("c"));
+
+    QVERIFY(parser.readNextStartElement()); // c
+    QVERIFY(parser.readNextStartElement()); // v
+    const char *value;
+    int size;
+    parser.readElementCharacters(&value, &size);
+    QCOMPARE(QByteArray(value, size), QByteArray("25"));
+    QVERIFY(parser.isName("v"));
+    QVERIFY(!parser.readNextStartElement());
+    QVERIFY(parser.isName("c"));
+    QVERIFY(!parser.readNextStartElement());
+    QVERIFY(parser.isName("row"));
+}
+
+void XmlPullParserTest::testSkipToEndTag()
+{
+    const QByteArray data = "<sheetData><row r=\"1\"/><row r=\"2\"><c><v>1</v></c></row>"
+                            "<row r=\"3\"/></sheetData ><cols/>";
+    XmlPullParser parser(data);
+    QVERIFY(parser.readNextStartElement()); // sheetData
+    QVERIFY(parser.readNextStartElement()); // row 1
+    parser.skipCurrentElement();
+    QVERIFY(parser.readNextStartElement()); // row 2
+    parser.skipToEndTag("sheetData");
+    QVERIFY(!parser.readNextStartElement());
+    QVERIFY(parser.isName("sheetData"));
+    QVERIFY(parser.readNextStartElement());
+    QVERIFY(parser.isName("cols"));
+
+    const QByteArray unclosedData = "<sheetData><row/><row/>";
+    XmlPullParser unclosed(unclosedData);
+    QVERIFY(unclosed.readNextStartElement());
+    QVERIFY(unclosed.readNextStartElement());
+    unclosed.skipToEndTag("sheetData");
+    QVERIFY(unclosed.hasError());
+}
+
+void XmlPullParserTest::testElementXml()
+{
+    const QByteArray data = "<r><rPr><b/><sz val=\"11\"/></rPr><t>x</t></r>";
+    XmlPullParser parser(data);
+    QVERIFY(parser.readNextStartElement()); // r
+    QVERIFY(parser.readNextStartElement()); // rPr
+    QCOMPARE(parser.readElementXml(), QByteArray("<rPr><b/><sz val=\"11\"/></rPr>"));
+    QVERIFY(parser.readNextStartElement());
+    QVERIFY(parser.isName("t"));
+    QCOMPARE(parser.readElementXml(), QByteArray("<t>x</t>"));
+}
+
+void XmlPullParserTest::testErrors()
+{
+    const char *documents[] = {"<a", "<a b>", "<a b=\"1>", "<a><!-- x", "<a><![CDATA[x", "<a/"};
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); ++i) {
+        const QByteArray data(documents[i]);
+        XmlPullParser parser(data);
+        while (!parser.atEnd())
+            parser.readNext();
+        QVERIFY2(parser.hasError(), documents[i]);
+    }
+}
+
+void XmlPullParserTest::testCanParse_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("canParse");
+
+    QTest::newRow("no declaration") << QByteArray("<a/>") << true;
+    QTest::newRow("utf-8") << QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?><a/>") << true;
+    QTest::newRow("utf-8 bom") << QByteArray("\xEF\xBB\xBF<?xml version='1.0'?><a/>") << true;
+    QTest::newRow("latin-1") << QByteArray("<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><a/>")
+                             << false;
+    QTest::newRow("utf-16") << QByteArray("\xFF\xFE<\0a\0/\0>\0", 10) << false;
+}
+
+void XmlPullParserTest::testCanParse()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, canParse);
+
+    QCOMPARE(XmlPullParser::canParse(data), canParse);
+}
+
+QTEST_APPLESS_MAIN(XmlPullParserTest)
+
+#include "tst_xmlpullparsertest.moc"
@@ -1,10 +1,52 @@
 #include "private/xlsxzipreader_p.h"
+#include "private/xlsxzipwriter_p.h"
 #include <QString>
 #include <QtTest>
 #include <QBuffer>
+#include <QtEndian>
 
 const char fileContent[] = "\x50\x4B\x03\x04\x0A\x00\x00\x00\x00\x00\x8F\x51\x25\x43\x82\x89\xD1\xF7\x05\x00\x00\x00\x05\x00\x00\x00\x09\x00\x00\x00\x68\x65\x6C\x6C\x6F\x2E\x74\x78\x74\x48\x65\x6C\x6C\x6F\x50\x4B\x03\x04\x0A\x00\x00\x00\x00\x00\xB8\x53\x25\x43\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x03\x00\x00\x00\x71\x74\x2F\x50\x4B\x03\x04\x0A\x00\x00\x00\x00\x00\x92\x51\x25\x43\x2E\x19\xFC\x34\x04\x00\x00\x00\x04\x00\x00\x00\x0B\x00\x00\x00\x71\x74\x2F\x78\x6C\x73\x78\x2E\x74\x78\x74\x58\x6C\x73\x78\x50\x4B\x01\x02\x14\x00\x0A\x00\x00\x00\x00\x00\x8F\x51\x25\x43\x82\x89\xD1\xF7\x05\x00\x00\x00\x05\x00\x00\x00\x09\x00\x00\x00\x00\x00\x00\x00\x01\x00\x20\x00\x00\x00\x00\x00\x00\x00\x68\x65\x6C\x6C\x6F\x2E\x74\x78\x74\x50\x4B\x01\x02\x14\x00\x0A\x00\x00\x00\x00\x00\xB8\x53\x25\x43\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00\x10\x00\x00\x00\x2C\x00\x00\x00\x71\x74\x2F\x50\x4B\x01\x02\x14\x00\x0A\x00\x00\x00\x00\x00\x92\x51\x25\x43\x2E\x19\xFC\x34\x04\x00\x00\x00\x04\x00\x00\x00\x0B\x00\x00\x00\x00\x00\x00\x00\x01\x00\x20\x00\x00\x00\x4D\x00\x00\x00\x71\x74\x2F\x78\x6C\x73\x78\x2E\x74\x78\x74\x50\x4B\x05\x06\x00\x00\x00\x00\x03\x00\x03\x00\xA1\x00\x00\x00\x7A\x00\x00\x00\x00\x00";
 
+static void appendUInt16(QByteArray &data, quint16 value)
+{
+    uchar buf[2];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 2);
+}
+
+static void appendUInt32(QByteArray &data, quint32 value)
+{
+    uchar buf[4];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 4);
+}
+
+static void appendUInt64(QByteArray &data, quint64 value)
+{
+    uchar buf[8];
+    qToLittleEndian(value, buf);
+    data.append(reinterpret_cast<const char *>(buf), 8);
+}
+
+/*
+  A write-only device which can't be seeked, such as a socket.
+ */
+class SequentialWriter : public QIODevice
+{
+public:
+    SequentialWriter() { open(QIODevice::WriteOnly); }
+    bool isSequential() const { return true; }
+    QByteArray data;
+
+protected:
+    qint64 readData(char *, qint64) { return -1; }
+    qint64 writeData(const char *bytes, qint64 size)
+    {
+        data.append(bytes, int(size));
+        return size;
+    }
+};
+
 class ZipReaderTest : public QObject
 {
     Q_OBJECT
@@ -14,6 +56,15 @@ public:
     
 private Q_SLOTS:
     void testFileList();
+    void testStreamEntries();
+    void testOpenFile();
+    void testRawFileData();
+    void testMappedFile();
+    void testCompressionLevel();
+    void testParallelDeflate();
+    void testSegments();
+    void testDataDescriptors();
+    void testZip64();
 };
 
 ZipReaderTest::ZipReaderTest()
@@ -33,6 +84,454 @@ void ZipReaderTest::testFileList()
     QVERIFY(files.contains("qt/xlsx.txt"));
     QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
     QCOMPARE(reader.fileData("qt/xlsx.txt"), QByteArray("Xlsx"));
+
+    QVERIFY(reader.contains("hello.txt"));
+    QVERIFY(!reader.contains("qt/"));
+    QVERIFY(!reader.contains("none.txt"));
+    QXlsx::ZipFileInfo info;
+    QVERIFY(reader.entry("qt/xlsx.txt", &info));
+    QCOMPARE(info.method, 0);
+    QCOMPARE(info.uncompressedSize, qint64(4));
+    QVERIFY(!reader.entry("none.txt", &info));
+}
+
+void ZipReaderTest::testStreamEntries()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        writer.addFile("hello.txt", QByteArray("Hello"));
+        QIODevice *entry = writer.beginFile("qt/big.txt");
+        for (int i = 0; i < bigData.size(); i += 1000)
+            entry->write(bigData.mid(i, 1000));
+        writer.endFile();
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QStringList files = reader.filePaths();
+    QCOMPARE(files.size(), 2);
+    QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
+    QCOMPARE(reader.fileData("qt/big.txt"), bigData);
+}
+
+void ZipReaderTest::testOpenFile()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        writer.addFile("qt/big.txt", bigData);
+        writer.close();
+    }
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QVERIFY(!reader.openFile("none.txt"));
+
+    //Deflated entry, read in small chunks
+    QScopedPointer<QIODevice> entry(reader.openFile("qt/big.txt"));
+    QVERIFY(entry);
+    QByteArray data;
+    while (!entry->atEnd())
+        data.append(entry->read(999));
+    QCOMPARE(data, bigData);
+
+    //Stored entries
+    QByteArray storedArchive(fileContent, sizeof(fileContent) - 1);
+    QBuffer storedBuffer(&storedArchive);
+    storedBuffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader storedReader(&storedBuffer);
+    QScopedPointer<QIODevice> hello(storedReader.openFile("hello.txt"));
+    QVERIFY(hello);
+    QCOMPARE(hello->readAll(), QByteArray("Hello"));
+}
+
+void ZipReaderTest::testRawFileData()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        writer.addFile("qt/big.txt", bigData);
+        writer.close();
+    }
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QCOMPARE(reader.fileSize("qt/big.txt"), qint64(bigData.size()));
+    QCOMPARE(reader.fileSize("none.txt"), qint64(-1));
+
+    QByteArray rawData;
+    QXlsx::ZipFileInfo info;
+    QVERIFY(!reader.rawFileData("none.txt", &rawData, &info));
+    QVERIFY(reader.rawFileData("qt/big.txt", &rawData, &info));
+    QVERIFY(rawData.size() < bigData.size());
+
+    //Copy the entry to another archive without inflating it
+    QByteArray copy;
+    QBuffer copyBuffer(&copy);
+    copyBuffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&copyBuffer);
+        writer.addRawFile("copy.txt", rawData, info.crc, info.uncompressedSize);
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    copyBuffer.close();
+
+    copyBuffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader copyReader(&copyBuffer);
+    QCOMPARE(copyReader.fileData("copy.txt"), bigData);
+
+    //Stored entries can't be copied raw
+    QByteArray storedArchive(fileContent, sizeof(fileContent) - 1);
+    QBuffer storedBuffer(&storedArchive);
+    storedBuffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader storedReader(&storedBuffer);
+    QVERIFY(!storedReader.rawFileData("hello.txt", &rawData, &info));
+}
+
+void ZipReaderTest::testMappedFile()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    {
+        QXlsx::ZipWriter writer(QStringLiteral("mapped.zip"));
+        writer.addFile("qt/big.txt", bigData);
+        writer.addFile("hello.txt", QByteArray("Hello"));
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    {
+        QXlsx::ZipReader reader(QStringLiteral("mapped.zip"));
+        QVERIFY(reader.exists());
+        QCOMPARE(reader.filePaths(), QStringList() << "qt/big.txt" << "hello.txt");
+        QCOMPARE(reader.fileData("qt/big.txt"), bigData);
+
+        //The buffer is reused for the next file
+        QByteArray buffer;
+        QVERIFY(reader.fileData("qt/big.txt", &buffer));
+        QCOMPARE(buffer, bigData);
+        QVERIFY(reader.fileData("hello.txt", &buffer));
+        QCOMPARE(buffer, QByteArray("Hello"));
+        QVERIFY(!reader.fileData("none.txt", &buffer));
+    }
+    QFile::remove("mapped.zip");
+
+    //Stored entries
+    {
+        QFile file("stored.zip");
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(fileContent, sizeof(fileContent) - 1);
+    }
+    {
+        QXlsx::ZipReader reader(QStringLiteral("stored.zip"));
+        QStringList files = reader.filePaths();
+        QCOMPARE(files.size(), 2);
+        QVERIFY(files.contains("hello.txt"));
+        QVERIFY(files.contains("qt/xlsx.txt"));
+        QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
+
+        QScopedPointer<QIODevice> device(reader.openFile("qt/xlsx.txt"));
+        QVERIFY(device);
+        QCOMPARE(device->readAll(), QByteArray("Xlsx"));
+    }
+    QFile::remove("stored.zip");
+}
+
+void ZipReaderTest::testCompressionLevel()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        writer.setCompressionLevel(9);
+        writer.setCompressionLevel("media/", 0);
+        writer.setCompressionLevel("media/fast.txt", 1);
+        QCOMPARE(writer.compressionLevel("best.txt"), 9);
+        QCOMPARE(writer.compressionLevel("media/stored.txt"), 0);
+        QCOMPARE(writer.compressionLevel("media/fast.txt"), 1);
+
+        writer.addFile("best.txt", bigData);
+        writer.addFile("media/stored.txt", bigData);
+        writer.addFile("media/fast.txt", bigData);
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QXlsx::ZipFileInfo stored;
+    QVERIFY(reader.entry("media/stored.txt", &stored));
+    QCOMPARE(stored.method, 0);
+    QCOMPARE(stored.compressedSize, qint64(bigData.size()));
+    QXlsx::ZipFileInfo best;
+    QVERIFY(reader.entry("best.txt", &best));
+    QCOMPARE(best.method, 8);
+    QVERIFY(best.compressedSize < bigData.size());
+
+    QCOMPARE(reader.fileData("best.txt"), bigData);
+    QCOMPARE(reader.fileData("media/stored.txt"), bigData);
+    QCOMPARE(reader.fileData("media/fast.txt"), bigData);
+}
+
+void ZipReaderTest::testParallelDeflate()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 300000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        writer.setParallelDeflateEnabled(true);
+        writer.addFile("hello.txt", QByteArray("Hello"));
+        writer.addFile("big.txt", bigData);
+        QIODevice *entry = writer.beginFile("streamed.txt");
+        for (int i = 0; i < bigData.size(); i += 1000)
+            entry->write(bigData.mid(i, 1000));
+        writer.endFile();
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
+    QCOMPARE(reader.fileData("big.txt"), bigData);
+    QCOMPARE(reader.fileData("streamed.txt"), bigData);
+    QXlsx::ZipFileInfo info;
+    QVERIFY(reader.entry("big.txt", &info));
+    QVERIFY(info.compressedSize < bigData.size() / 2);
+}
+
+void ZipReaderTest::testSegments()
+{
+    QByteArray head("<head>");
+    QByteArray middle;
+    for (int i = 0; i < 50000; ++i)
+        middle.append(QByteArray::number(i)).append(',');
+    QByteArray tail("<tail>");
+
+    // Record the deflated middle of an entry
+    QByteArray segment;
+    quint32 crc = 0;
+    qint64 size = 0;
+    QByteArray archive;
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&buffer);
+        QXlsx::ZipEntryDevice *entry =
+            static_cast<QXlsx::ZipEntryDevice *>(writer.beginFile("first.txt"));
+        QVERIFY(entry->canWriteSegments());
+        entry->write(head);
+        QVERIFY(entry->beginSegment());
+        for (int i = 0; i < middle.size(); i += 1000)
+            entry->write(middle.mid(i, 1000));
+        QVERIFY(entry->endSegment(&segment, &crc, &size));
+        entry->write(tail);
+        writer.endFile();
+
+        // And write it again in another entry
+        entry = static_cast<QXlsx::ZipEntryDevice *>(writer.beginFile("second.txt"));
+        entry->write(tail);
+        QVERIFY(entry->writeSegment(segment, crc, size));
+        entry->write(head);
+        writer.endFile();
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    buffer.close();
+    QCOMPARE(size, qint64(middle.size()));
+    QVERIFY(segment.size() < middle.size() / 2);
+
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QCOMPARE(reader.fileData("first.txt"), head + middle + tail);
+    QCOMPARE(reader.fileData("second.txt"), tail + middle + head);
+}
+
+void ZipReaderTest::testDataDescriptors()
+{
+    QByteArray bigData;
+    for (int i = 0; i < 100000; ++i)
+        bigData.append(QByteArray::number(i)).append(',');
+
+    SequentialWriter device;
+    {
+        QXlsx::ZipWriter writer(&device);
+        writer.setCompressionLevel("stored.txt", 0);
+        QIODevice *entry = writer.beginFile("streamed.txt");
+        for (int i = 0; i < bigData.size(); i += 1000)
+            entry->write(bigData.mid(i, 1000));
+        writer.endFile();
+        writer.addFile("stored.txt", bigData);
+        writer.addFile("hello.txt", QByteArray("Hello"));
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    // The first entry has the data descriptor flag
+    QVERIFY(device.data.startsWith("PK\x03\x04"));
+    QCOMPARE(int(device.data.at(6)) & 0x08, 0x08);
+    QVERIFY(device.data.contains("PK\x07\x08"));
+
+    QBuffer buffer(&device.data);
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QCOMPARE(reader.filePaths().size(), 3);
+    QCOMPARE(reader.fileData("streamed.txt"), bigData);
+    QCOMPARE(reader.fileData("stored.txt"), bigData);
+    QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
+
+    // Seekable devices as well, on demand
+    QByteArray archive;
+    QBuffer output(&archive);
+    output.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&output);
+        writer.setDataDescriptorsEnabled(true);
+        writer.addFile("big.txt", bigData);
+        writer.close();
+    }
+    output.close();
+    QCOMPARE(int(archive.at(6)) & 0x08, 0x08);
+    output.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader2(&output);
+    QCOMPARE(reader2.fileData("big.txt"), bigData);
+}
+
+void ZipReaderTest::testZip64()
+{
+    // A stored entry whose sizes and offset are all in zip64 fields
+    const QByteArray name("hello.txt");
+    QByteArray archive;
+    appendUInt32(archive, 0x04034b50);
+    appendUInt16(archive, 45);
+    appendUInt16(archive, 0x0800);
+    appendUInt16(archive, 0); // stored
+    appendUInt32(archive, 0);
+    appendUInt32(archive, 0xf7d18982); // crc of "Hello"
+    appendUInt32(archive, 0xffffffff);
+    appendUInt32(archive, 0xffffffff);
+    appendUInt16(archive, name.size());
+    appendUInt16(archive, 20);
+    archive.append(name);
+    appendUInt16(archive, 0x0001);
+    appendUInt16(archive, 16);
+    appendUInt64(archive, 5);
+    appendUInt64(archive, 5);
+    archive.append("Hello");
+
+    const int directoryOffset = archive.size();
+    appendUInt32(archive, 0x02014b50);
+    appendUInt16(archive, 45);
+    appendUInt16(archive, 45);
+    appendUInt16(archive, 0x0800);
+    appendUInt16(archive, 0);
+    appendUInt32(archive, 0);
+    appendUInt32(archive, 0xf7d18982);
+    appendUInt32(archive, 0xffffffff);
+    appendUInt32(archive, 0xffffffff);
+    appendUInt16(archive, name.size());
+    appendUInt16(archive, 28);
+    appendUInt16(archive, 0);
+    appendUInt16(archive, 0);
+    appendUInt16(archive, 0);
+    appendUInt32(archive, 0);
+    appendUInt32(archive, 0xffffffff);
+    archive.append(name);
+    appendUInt16(archive, 0x0001);
+    appendUInt16(archive, 24);
+    appendUInt64(archive, 5);
+    appendUInt64(archive, 5);
+    appendUInt64(archive, 0);
+    const int directorySize = archive.size() - directoryOffset;
+
+    const int recordOffset = archive.size();
+    appendUInt32(archive, 0x06064b50);
+    appendUInt64(archive, 44);
+    appendUInt16(archive, 45);
+    appendUInt16(archive, 45);
+    appendUInt32(archive, 0);
+    appendUInt32(archive, 0);
+    appendUInt64(archive, 1);
+    appendUInt64(archive, 1);
+    appendUInt64(archive, directorySize);
+    appendUInt64(archive, directoryOffset);
+    appendUInt32(archive, 0x07064b50);
+    appendUInt32(archive, 0);
+    appendUInt64(archive, recordOffset);
+    appendUInt32(archive, 1);
+    appendUInt32(archive, 0x06054b50);
+    appendUInt16(archive, 0);
+    appendUInt16(archive, 0);
+    appendUInt16(archive, 0xffff);
+    appendUInt16(archive, 0xffff);
+    appendUInt32(archive, 0xffffffff);
+    appendUInt32(archive, 0xffffffff);
+    appendUInt16(archive, 0);
+
+    QBuffer buffer(&archive);
+    buffer.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader reader(&buffer);
+    QXlsx::ZipFileInfo info;
+    QVERIFY(reader.entry("hello.txt", &info));
+    QCOMPARE(info.uncompressedSize, qint64(5));
+    QCOMPARE(info.headerOffset, qint64(0));
+    QCOMPARE(reader.fileData("hello.txt"), QByteArray("Hello"));
+    buffer.close();
+
+    // More entries than the end of central directory record can count
+    QByteArray large;
+    QBuffer output(&large);
+    output.open(QIODevice::WriteOnly);
+    {
+        QXlsx::ZipWriter writer(&output);
+        writer.setCompressionLevel(0);
+        for (int i = 0; i < 70000; ++i)
+            writer.addFile(QString::number(i), QByteArray::number(i));
+        writer.close();
+        QVERIFY(!writer.error());
+    }
+    output.close();
+    output.open(QIODevice::ReadOnly);
+    QXlsx::ZipReader largeReader(&output);
+    QCOMPARE(largeReader.fileSize("69999"), qint64(5));
+    QCOMPARE(largeReader.fileData("69999"), QByteArray("69999"));
 }
 
 QTEST_APPLESS_MAIN(ZipReaderTest)
@@ -0,0 +1,14 @@
+QT       += testlib xlsx
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_adversarialtest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_adversarialtest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+win32:LIBS += -lpsapi
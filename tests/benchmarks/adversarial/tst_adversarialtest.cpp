@@ -0,0 +1,281 @@
+#include "xlsxdocument.h"
+#include "xlsxformat.h"
+#include "xlsxrichstring.h"
+#include "xlsxworksheet.h"
+#include <QBuffer>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QtTest>
+
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+QTXLSX_USE_NAMESPACE
+
+namespace {
+
+/*
+  The workbooks customers send which take the slow paths: a huge number of
+  empty styled cells, rows as wide as a sheet can be, shared strings made
+  of rich text runs, cells whose strings are replaced over and over, and
+  many distinct pictures.
+ */
+enum Kind {
+    EmptyStyledCells,
+    WideRows,
+    RichStrings,
+    ReplacedStrings,
+    DistinctImages
+};
+
+// A workbook four times as large should take about four times as long,
+// quadratic behavior makes it sixteen times.
+const int ScaleFactor = 4;
+const int MaxGrowth = 8;
+// Below this, the times are too noisy to be compared
+const qint64 MinMsecs = 50;
+
+struct Measure
+{
+    qint64 loadMsecs;
+    qint64 saveMsecs;
+    qint64 bytes; // growth of the process while loading and saving
+    qint64 elements; // cells, strings or pictures
+};
+
+#if defined(Q_OS_LINUX)
+qint64 statusValue(const QByteArray &status, const char *name)
+{
+    int pos = status.indexOf(name);
+    if (pos == -1)
+        return 0;
+    pos += int(strlen(name));
+    int end = status.indexOf("kB", pos);
+    return status.mid(pos, end - pos).trimmed().toLongLong() * 1024;
+}
+#endif
+
+/*
+  The peak resident set size of the process, in bytes. The peak can only
+  be reset on Linux, elsewhere it covers the whole run and the memory
+  bounds are not checked.
+ */
+qint64 peakMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (file.open(QIODevice::ReadOnly))
+        return statusValue(file.readAll(), "VmHWM:");
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(Q_OS_MAC)
+        return usage.ru_maxrss;
+#else
+        return qint64(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+qint64 residentMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (file.open(QIODevice::ReadOnly))
+        return statusValue(file.readAll(), "VmRSS:");
+#endif
+    return peakMemory();
+}
+
+void resetPeakMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QStringLiteral("/proc/self/clear_refs"));
+    if (file.open(QIODevice::WriteOnly))
+        file.write("5");
+#endif
+}
+
+} // namespace
+
+class AdversarialTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    AdversarialTest();
+
+private Q_SLOTS:
+    void testScaling();
+    void testScaling_data();
+
+private:
+    static qint64 fillDocument(Document &xlsx, Kind kind, int size);
+    static QByteArray generatePackage(Kind kind, int size, qint64 *elements);
+    static Measure measure(Kind kind, int size);
+};
+
+AdversarialTest::AdversarialTest()
+{
+}
+
+/*
+  Write the workbook of \a kind, \a size being its number of rows, strings
+  or pictures. Returns the number of cells, strings or pictures written.
+ */
+qint64 AdversarialTest::fillDocument(Document &xlsx, Kind kind, int size)
+{
+    Worksheet *sheet = xlsx.currentWorksheet();
+    Format bold;
+    bold.setFontBold(true);
+    Format italic;
+    italic.setFontItalic(true);
+    italic.setFontColor(QColor(Qt::red));
+
+    switch (kind) {
+    case EmptyStyledCells:
+        for (int row = 1; row <= size; ++row) {
+            for (int col = 1; col <= 10; ++col)
+                sheet->writeBlank(row, col, row % 2 ? bold : italic);
+        }
+        return qint64(size) * 10;
+    case WideRows:
+        // 16384 columns is the widest a row can be
+        for (int row = 1; row <= size; ++row) {
+            for (int col = 1; col <= 16384; ++col)
+                sheet->writeNumeric(row, col, row + col);
+        }
+        return qint64(size) * 16384;
+    case RichStrings:
+        for (int row = 1; row <= size; ++row) {
+            RichString text;
+            text.addFragment(QStringLiteral("Item "), bold);
+            text.addFragment(QString::number(row), italic);
+            text.addFragment(QStringLiteral(" of the list"), Format());
+            sheet->writeString(row, 1, text);
+        }
+        return size;
+    case ReplacedStrings:
+        // Each cell releases the string it held twice
+        for (int pass = 0; pass < 3; ++pass) {
+            for (int row = 1; row <= size; ++row)
+                sheet->writeString(row, 1, QStringLiteral("Text %1 %2").arg(pass).arg(row));
+        }
+        return qint64(size) * 3;
+    case DistinctImages:
+        for (int i = 0; i < size; ++i) {
+            QImage image(32, 24, QImage::Format_RGB32);
+            image.fill(QColor(i % 256, (i / 256) % 256, 64));
+            sheet->insertImage(i * 2, 0, image);
+        }
+        return size;
+    }
+    return 0;
+}
+
+QByteArray AdversarialTest::generatePackage(Kind kind, int size, qint64 *elements)
+{
+    QByteArray data;
+    Document xlsx;
+    *elements = fillDocument(xlsx, kind, size);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    xlsx.saveAs(&buffer);
+    return data;
+}
+
+/*
+  Load and save the workbook of \a kind and \a size. The strings are
+  replaced once an empty workbook is loaded instead, as that's where the
+  time goes.
+ */
+Measure AdversarialTest::measure(Kind kind, int size)
+{
+    Measure result = {0, 0, 0, 0};
+    QByteArray package =
+        generatePackage(kind, kind == ReplacedStrings ? 0 : size, &result.elements);
+
+    resetPeakMemory();
+    const qint64 before = residentMemory();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        QBuffer input(&package);
+        input.open(QIODevice::ReadOnly);
+        Document xlsx(&input);
+        if (kind == ReplacedStrings)
+            result.elements = fillDocument(xlsx, kind, size);
+        result.loadMsecs = timer.restart();
+
+        QByteArray saved;
+        QBuffer output(&saved);
+        output.open(QIODevice::WriteOnly);
+        xlsx.saveAs(&output);
+        result.saveMsecs = timer.elapsed();
+        result.bytes = peakMemory() - before;
+    }
+    return result;
+}
+
+void AdversarialTest::testScaling()
+{
+    QFETCH(int, kind);
+    QFETCH(int, size);
+    QFETCH(int, maxMsecs);
+    QFETCH(int, maxBytesPerElement);
+
+    const Measure small = measure(Kind(kind), size);
+    const Measure large = measure(Kind(kind), size * ScaleFactor);
+    qDebug("%lld elements: load %lld ms, save %lld ms; %lld elements: load %lld ms, "
+           "save %lld ms, %lld bytes",
+           small.elements, small.loadMsecs, small.saveMsecs, large.elements, large.loadMsecs,
+           large.saveMsecs, large.bytes);
+
+    QVERIFY2(large.loadMsecs <= qMax(small.loadMsecs, MinMsecs) * MaxGrowth,
+             "the load doesn't scale linearly");
+    QVERIFY2(large.saveMsecs <= qMax(small.saveMsecs, MinMsecs) * MaxGrowth,
+             "the save doesn't scale linearly");
+    QVERIFY2(large.loadMsecs + large.saveMsecs <= maxMsecs, "the load and save are too slow");
+#if defined(Q_OS_LINUX)
+    QVERIFY2(large.bytes <= large.elements * maxBytesPerElement,
+             "the load and save use too much memory");
+#else
+    Q_UNUSED(maxBytesPerElement);
+#endif
+    QTest::setBenchmarkResult(large.loadMsecs + large.saveMsecs, QTest::WalltimeMilliseconds);
+}
+
+void AdversarialTest::testScaling_data()
+{
+    QTest::addColumn<int>("kind");
+    QTest::addColumn<int>("size");
+    // Bounds of the large workbook
+    QTest::addColumn<int>("maxMsecs");
+    QTest::addColumn<int>("maxBytesPerElement");
+
+    QTest::newRow("1M empty styled cells") << int(EmptyStyledCells) << 25000 << 30000 << 200;
+    QTest::newRow("16K-column rows") << int(WideRows) << 8 << 30000 << 200;
+    QTest::newRow("400k rich shared strings") << int(RichStrings) << 100000 << 30000 << 1500;
+    QTest::newRow("300k replaced shared strings") << int(ReplacedStrings) << 25000 << 30000
+                                                  << 500;
+    QTest::newRow("2000 distinct images") << int(DistinctImages) << 500 << 30000 << 32768;
+}
+
+QTEST_APPLESS_MAIN(AdversarialTest)
+
+#include "tst_adversarialtest.moc"
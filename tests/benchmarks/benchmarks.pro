@@ -1,3 +1,7 @@
 TEMPLATE = subdirs
 SUBDIRS += \
-    xmlspace
+    xmlspace \
+    writecells \
+    package \
+    memory \
+    adversarial
@@ -0,0 +1,14 @@
+QT       += testlib xlsx xlsx-private
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_memorytest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_memorytest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+win32:LIBS += -lpsapi
@@ -0,0 +1,286 @@
+#include "xlsxdocument.h"
+#include "xlsxcell.h"
+#include "xlsxformat.h"
+#include "xlsxworkbook.h"
+#include "private/xlsxcell_p.h"
+#include "private/xlsxcelltable_p.h"
+#include "private/xlsxformat_p.h"
+#include "private/xlsxsharedstrings_p.h"
+#include "private/xlsxworksheet_p.h"
+#include <QBuffer>
+#include <QFile>
+#include <QString>
+#include <QtTest>
+
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+QTXLSX_USE_NAMESPACE
+
+namespace {
+
+/*
+  Resident and peak resident set sizes of the process, in bytes. The peak
+  can only be reset on Linux, elsewhere it covers the whole run.
+ */
+struct ProcessMemory
+{
+    qint64 resident;
+    qint64 peak;
+};
+
+#if defined(Q_OS_LINUX)
+qint64 statusValue(const QByteArray &status, const char *name)
+{
+    int pos = status.indexOf(name);
+    if (pos == -1)
+        return 0;
+    pos += int(strlen(name));
+    int end = status.indexOf("kB", pos);
+    return status.mid(pos, end - pos).trimmed().toLongLong() * 1024;
+}
+#endif
+
+ProcessMemory processMemory()
+{
+    ProcessMemory memory = {0, 0};
+#if defined(Q_OS_LINUX)
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (file.open(QIODevice::ReadOnly)) {
+        QByteArray status = file.readAll();
+        memory.resident = statusValue(status, "VmRSS:");
+        memory.peak = statusValue(status, "VmHWM:");
+    }
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        memory.resident = counters.WorkingSetSize;
+        memory.peak = counters.PeakWorkingSetSize;
+    }
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(Q_OS_MAC)
+        memory.peak = usage.ru_maxrss;
+#else
+        memory.peak = qint64(usage.ru_maxrss) * 1024;
+#endif
+        memory.resident = memory.peak;
+    }
+#endif
+    return memory;
+}
+
+void resetPeakMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QStringLiteral("/proc/self/clear_refs"));
+    if (file.open(QIODevice::WriteOnly))
+        file.write("5");
+#endif
+}
+
+} // namespace
+
+class MemoryTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    MemoryTest();
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testWriteOnly();
+    void testWriteOnly_data();
+    void testReadOnly();
+    void testReadOnly_data();
+    void testRoundTrip();
+    void testRoundTrip_data();
+
+private:
+    static void addSizes();
+    static void fillSheet(Document &xlsx, int rows, int columns);
+    static QByteArray generatePackage(int rows, int columns);
+    void report(Document &xlsx, const ProcessMemory &before, qint64 cellCount);
+};
+
+MemoryTest::MemoryTest()
+{
+}
+
+void MemoryTest::initTestCase()
+{
+    // The layout of the structures the cells are made of
+    qDebug("sizeof: CellData %d, CellExtraData %d, CellRow %d", int(sizeof(CellData)),
+           int(sizeof(CellExtraData)), int(sizeof(CellRow)));
+    qDebug("sizeof: Cell %d, CellPrivate %d, QVariant %d, Format %d, FormatPrivate %d",
+           int(sizeof(Cell)), int(sizeof(CellPrivate)), int(sizeof(QVariant)),
+           int(sizeof(Format)), int(sizeof(FormatPrivate)));
+}
+
+void MemoryTest::addSizes()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("columns");
+
+    QTest::newRow("10k cells") << 1000 << 10;
+    QTest::newRow("100k cells") << 10000 << 10;
+    QTest::newRow("1M cells") << 100000 << 10;
+}
+
+/*
+  Write numbers, shared strings, distinct strings and formatted cells.
+ */
+void MemoryTest::fillSheet(Document &xlsx, int rows, int columns)
+{
+    QList<Format> formats;
+    for (int i = 0; i < 8; ++i) {
+        Format format;
+        format.setFontBold(i % 2);
+        format.setNumberFormat(i % 4 ? QStringLiteral("0.00") : QStringLiteral("#,##0"));
+        formats.append(format);
+    }
+
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= columns; ++col) {
+            switch (col % 4) {
+            case 0:
+                xlsx.write(row, col, row * 0.5 + col);
+                break;
+            case 1:
+                xlsx.write(row, col, QStringLiteral("Category %1").arg(row % 100));
+                break;
+            case 2:
+                xlsx.write(row, col, QStringLiteral("Text %1 %2").arg(row).arg(col));
+                break;
+            default:
+                xlsx.write(row, col, row, formats[row % formats.size()]);
+                break;
+            }
+        }
+    }
+}
+
+QByteArray MemoryTest::generatePackage(int rows, int columns)
+{
+    QByteArray data;
+    Document xlsx;
+    fillSheet(xlsx, rows, columns);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    xlsx.saveAs(&buffer);
+    return data;
+}
+
+/*
+  Print where the memory of the current sheet of \a xlsx goes, and record
+  the growth of the process since \a before, per cell, as the result.
+ */
+void MemoryTest::report(Document &xlsx, const ProcessMemory &before, qint64 cellCount)
+{
+    const ProcessMemory after = processMemory();
+    WorksheetPrivate *sheet_d = xlsx.currentWorksheet()->d_func();
+
+    const qint64 cellTable = sheet_d->cellTable.memoryUsage();
+    const qint64 cellObjects =
+        qint64(sheet_d->cellCache.size()) * (sizeof(Cell) + sizeof(CellPrivate));
+    const qint64 sharedStrings = sheet_d->sharedStrings()->memoryUsage();
+    const StyleStatistics styles = xlsx.workbook()->styleStatistics();
+    const qint64 formatSize = sizeof(Format) + sizeof(FormatPrivate);
+    const qint64 styleBytes = (styles.cellFormats + styles.differentialFormats + styles.fonts
+                               + styles.fills + styles.borders) * formatSize;
+
+    qDebug("cells %lld, extras %d: cell table %lld (%.1f per cell), Cell objects %lld",
+           cellCount, sheet_d->cellTable.extraCount(), cellTable,
+           double(cellTable) / qMax(cellCount, qint64(1)), cellObjects);
+    qDebug("shared strings %d: %lld, styles %d xfs: %lld", sheet_d->sharedStrings()->count(),
+           sharedStrings, styles.cellFormats, styleBytes);
+    qDebug("resident %lld -> %lld, peak %lld", before.resident, after.resident, after.peak);
+
+    const qint64 grown = qMax(after.peak, after.resident) - before.resident;
+    QTest::setBenchmarkResult(qreal(grown) / qMax(cellCount, qint64(1)), QTest::BytesAllocated);
+}
+
+void MemoryTest::testWriteOnly()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    resetPeakMemory();
+    const ProcessMemory before = processMemory();
+    Document xlsx;
+    fillSheet(xlsx, rows, columns);
+    report(xlsx, before, qint64(rows) * columns);
+}
+
+void MemoryTest::testWriteOnly_data()
+{
+    addSizes();
+}
+
+void MemoryTest::testReadOnly()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    QByteArray package = generatePackage(rows, columns);
+    resetPeakMemory();
+    const ProcessMemory before = processMemory();
+    QBuffer buffer(&package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer, Document::ReadOnlyLoad);
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= columns; ++col)
+            xlsx.read(row, col);
+    }
+    report(xlsx, before, qint64(rows) * columns);
+}
+
+void MemoryTest::testReadOnly_data()
+{
+    addSizes();
+}
+
+void MemoryTest::testRoundTrip()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    QByteArray package = generatePackage(rows, columns);
+    resetPeakMemory();
+    const ProcessMemory before = processMemory();
+    QBuffer buffer(&package);
+    buffer.open(QIODevice::ReadOnly);
+    Document xlsx(&buffer);
+
+    // Change one row in ten, and hand out Cell objects for another one
+    for (int row = 1; row <= rows; row += 10) {
+        for (int col = 1; col <= columns; ++col) {
+            xlsx.write(row, col, QStringLiteral("Changed %1").arg(col));
+            xlsx.cellAt(row + 1, col);
+        }
+    }
+
+    QByteArray saved;
+    QBuffer output(&saved);
+    output.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&output));
+    report(xlsx, before, qint64(rows) * columns);
+}
+
+void MemoryTest::testRoundTrip_data()
+{
+    addSizes();
+}
+
+QTEST_APPLESS_MAIN(MemoryTest)
+
+#include "tst_memorytest.moc"
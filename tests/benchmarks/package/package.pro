@@ -0,0 +1,13 @@
+QT       += testlib xlsx # xlsx-private
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_packagetest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_packagetest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
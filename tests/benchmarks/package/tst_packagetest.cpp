@@ -0,0 +1,205 @@
+#include "xlsxdocument.h"
+#include "xlsxcell.h"
+#include "xlsxcellformula.h"
+#include "xlsxformat.h"
+#include "xlsxworkbook.h"
+#include <QBuffer>
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <QtTest>
+
+QTXLSX_USE_NAMESPACE
+
+class PackageTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    PackageTest();
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testSave();
+    void testSave_data();
+    void testLoad();
+    void testLoad_data();
+    void testLoadAndRead();
+    void testSharedFormulas();
+    void testSaveImages();
+    void testSaveImages_data();
+
+private:
+    static void fillSheet(Document &xlsx, int rows, int columns);
+
+    QByteArray m_largePackage;
+    int m_largeRows;
+    int m_largeColumns;
+};
+
+PackageTest::PackageTest()
+    : m_largeRows(100000)
+    , m_largeColumns(10)
+{
+}
+
+/*
+  Write numbers, strings and formatted cells, one column of each kind in turn.
+ */
+void PackageTest::fillSheet(Document &xlsx, int rows, int columns)
+{
+    Format format;
+    format.setFontBold(true);
+    format.setPatternBackgroundColor(QColor(Qt::yellow));
+
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= columns; ++col) {
+            switch (col % 3) {
+            case 0:
+                xlsx.write(row, col, row * 0.5 + col);
+                break;
+            case 1:
+                xlsx.write(row, col, QStringLiteral("Text %1").arg(row % 1000));
+                break;
+            default:
+                xlsx.write(row, col, row, format);
+                break;
+            }
+        }
+    }
+}
+
+void PackageTest::initTestCase()
+{
+    // The package read by the load benchmarks, 1M cells
+    Document xlsx;
+    fillSheet(xlsx, m_largeRows, m_largeColumns);
+    QBuffer buffer(&m_largePackage);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(xlsx.saveAs(&buffer));
+}
+
+void PackageTest::testSave()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    Document xlsx;
+    fillSheet(xlsx, rows, columns);
+
+    QBENCHMARK {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        xlsx.saveAs(&buffer);
+    }
+}
+
+void PackageTest::testSave_data()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("columns");
+
+    QTest::newRow("10k cells") << 1000 << 10;
+    QTest::newRow("100k cells") << 10000 << 10;
+    QTest::newRow("1M cells") << 100000 << 10;
+}
+
+void PackageTest::testLoad()
+{
+    QFETCH(int, options);
+
+    QBENCHMARK {
+        QBuffer buffer(&m_largePackage);
+        buffer.open(QIODevice::ReadOnly);
+        Document xlsx(&buffer, Document::LoadOptions(Document::LoadOption(options)));
+        QVERIFY(!xlsx.sheetNames().isEmpty());
+    }
+}
+
+void PackageTest::testLoad_data()
+{
+    QTest::addColumn<int>("options");
+
+    QTest::newRow("default") << int(Document::DefaultLoadOptions);
+    QTest::newRow("parallel") << int(Document::ParallelLoad);
+    QTest::newRow("lazy") << int(Document::LazyLoad);
+    QTest::newRow("read only") << int(Document::ReadOnlyLoad);
+}
+
+void PackageTest::testLoadAndRead()
+{
+    QBENCHMARK {
+        QBuffer buffer(&m_largePackage);
+        buffer.open(QIODevice::ReadOnly);
+        Document xlsx(&buffer);
+        double sum = 0;
+        for (int row = 1; row <= m_largeRows; ++row) {
+            for (int col = 1; col <= m_largeColumns; ++col) {
+                QVariant value = xlsx.read(row, col);
+                if (value.type() == QVariant::Double)
+                    sum += value.toDouble();
+            }
+        }
+        QVERIFY(sum > 0);
+    }
+}
+
+void PackageTest::testSharedFormulas()
+{
+    const int rows = 100000;
+    Document xlsx;
+    Worksheet *sheet = xlsx.currentWorksheet();
+    for (int row = 1; row <= rows; ++row)
+        sheet->write(row, 1, row);
+    sheet->writeFormula(1, 2, CellFormula(QStringLiteral("A1*2+1"),
+                                          CellRange(1, 2, rows, 2), CellFormula::SharedType));
+
+    // Reading the formulas expands them from the shared one, and so does
+    // the recalculation
+    QBENCHMARK {
+        int size = 0;
+        for (int row = 1; row <= rows; ++row)
+            size += sheet->cellAt(row, 2)->formula().formulaText().size();
+        xlsx.workbook()->recalculate();
+        QVERIFY(size > 0);
+    }
+}
+
+void PackageTest::testSaveImages()
+{
+    QFETCH(int, count);
+    QFETCH(int, distinct);
+
+    Document xlsx;
+    QList<QImage> images;
+    for (int i = 0; i < distinct; ++i) {
+        QImage image(64, 48, QImage::Format_RGB32);
+        image.fill(QColor(i % 256, i / 256, 128));
+        images.append(image);
+    }
+    for (int i = 0; i < count; ++i)
+        xlsx.insertImage(i * 4, 0, images[i % distinct]);
+
+    QBENCHMARK {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        xlsx.saveAs(&buffer);
+    }
+}
+
+void PackageTest::testSaveImages_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<int>("distinct");
+
+    QTest::newRow("100 images") << 100 << 100;
+    QTest::newRow("1000 images") << 1000 << 1000;
+    QTest::newRow("1000 copies of 10 images") << 1000 << 10;
+}
+
+QTEST_APPLESS_MAIN(PackageTest)
+
+#include "tst_packagetest.moc"
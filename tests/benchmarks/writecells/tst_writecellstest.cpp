@@ -0,0 +1,218 @@
+#include "xlsxdocument.h"
+#include "xlsxformat.h"
+#include "xlsxworksheet.h"
+#include <QBuffer>
+#include <QColor>
+#include <QString>
+#include <QStringList>
+#include <QtTest>
+
+QTXLSX_USE_NAMESPACE
+
+class WriteCellsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    WriteCellsTest();
+
+private Q_SLOTS:
+    void testWriteNumbers();
+    void testWriteNumbers_data();
+    void testWriteStrings();
+    void testWriteStrings_data();
+    void testWriteMixed();
+    void testWriteMixed_data();
+    void testWriteSharedStrings();
+    void testWriteSharedStrings_data();
+    void testWriteStyled();
+    void testWriteStyled_data();
+    void testImportCsv();
+    void testImportCsv_data();
+
+private:
+    void addSizes();
+};
+
+WriteCellsTest::WriteCellsTest()
+{
+}
+
+void WriteCellsTest::addSizes()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("columns");
+
+    QTest::newRow("100x10") << 100 << 10;
+    QTest::newRow("1000x10") << 1000 << 10;
+    QTest::newRow("10000x10") << 10000 << 10;
+    QTest::newRow("1000x100") << 1000 << 100;
+}
+
+void WriteCellsTest::testWriteNumbers()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    QBENCHMARK {
+        Document xlsx;
+        for (int row = 1; row <= rows; ++row) {
+            for (int col = 1; col <= columns; ++col)
+                xlsx.write(row, col, row * 1.5 + col);
+        }
+    }
+}
+
+void WriteCellsTest::testWriteNumbers_data()
+{
+    addSizes();
+}
+
+void WriteCellsTest::testWriteStrings()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    // Every cell gets a string of its own
+    QBENCHMARK {
+        Document xlsx;
+        for (int row = 1; row <= rows; ++row) {
+            for (int col = 1; col <= columns; ++col)
+                xlsx.write(row, col, QStringLiteral("Text %1 %2").arg(row).arg(col));
+        }
+    }
+}
+
+void WriteCellsTest::testWriteStrings_data()
+{
+    addSizes();
+}
+
+void WriteCellsTest::testWriteMixed()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    QBENCHMARK {
+        Document xlsx;
+        for (int row = 1; row <= rows; ++row) {
+            for (int col = 1; col <= columns; ++col) {
+                switch (col % 4) {
+                case 0:
+                    xlsx.write(row, col, row * 0.25);
+                    break;
+                case 1:
+                    xlsx.write(row, col, QStringLiteral("Item %1").arg(row));
+                    break;
+                case 2:
+                    xlsx.write(row, col, row % 2 == 0);
+                    break;
+                default:
+                    xlsx.write(row, col, QDate(2014, 1, 1).addDays(row));
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void WriteCellsTest::testWriteMixed_data()
+{
+    addSizes();
+}
+
+void WriteCellsTest::testWriteSharedStrings()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    // A small set of strings repeated all over the sheet
+    QStringList words;
+    for (int i = 0; i < 50; ++i)
+        words.append(QStringLiteral("Category %1").arg(i));
+
+    QBENCHMARK {
+        Document xlsx;
+        for (int row = 1; row <= rows; ++row) {
+            for (int col = 1; col <= columns; ++col)
+                xlsx.write(row, col, words[(row * columns + col) % words.size()]);
+        }
+    }
+}
+
+void WriteCellsTest::testWriteSharedStrings_data()
+{
+    addSizes();
+}
+
+void WriteCellsTest::testWriteStyled()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    QList<Format> formats;
+    for (int i = 0; i < 16; ++i) {
+        Format format;
+        format.setFontBold(i % 2);
+        format.setFontItalic(i % 3 == 0);
+        format.setPatternBackgroundColor(QColor::fromHsv(i * 20, 128, 255));
+        format.setNumberFormat(i % 4 ? QStringLiteral("0.00") : QStringLiteral("#,##0"));
+        formats.append(format);
+    }
+
+    QBENCHMARK {
+        Document xlsx;
+        for (int row = 1; row <= rows; ++row) {
+            for (int col = 1; col <= columns; ++col)
+                xlsx.write(row, col, row + col, formats[(row + col) % formats.size()]);
+        }
+    }
+}
+
+void WriteCellsTest::testWriteStyled_data()
+{
+    addSizes();
+}
+
+void WriteCellsTest::testImportCsv()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+
+    // Numbers, repeated words and distinct texts, the same as testWriteMixed()
+    QByteArray csv;
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= columns; ++col) {
+            if (col > 1)
+                csv.append(',');
+            switch (col % 3) {
+            case 0:
+                csv.append(QByteArray::number(row * 0.25));
+                break;
+            case 1:
+                csv.append("Category ").append(QByteArray::number(row % 50));
+                break;
+            default:
+                csv.append("\"Item ").append(QByteArray::number(row)).append(", done\"");
+                break;
+            }
+        }
+        csv.append("\r\n");
+    }
+
+    QBENCHMARK {
+        Document xlsx;
+        QBuffer buffer(&csv);
+        buffer.open(QIODevice::ReadOnly);
+        QVERIFY(xlsx.currentWorksheet()->importCsv(&buffer));
+    }
+}
+
+void WriteCellsTest::testImportCsv_data()
+{
+    addSizes();
+}
+
+QTEST_APPLESS_MAIN(WriteCellsTest)
+
+#include "tst_writecellstest.moc"
@@ -0,0 +1,13 @@
+QT       += testlib xlsx # xlsx-private
+CONFIG += testcase
+DEFINES += XLSX_TEST
+
+TARGET = tst_writecellstest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += tst_writecellstest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
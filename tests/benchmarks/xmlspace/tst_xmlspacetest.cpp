@@ -20,6 +20,13 @@ bool startsWithOrEndsWithSpace(const QString &s, int flag)
         //static QString spaces(" \t\n\r");
         QString spaces(QStringLiteral(" \t\n\r"));
         return !s.isEmpty() && (spaces.contains(s.at(0))||spaces.contains(s.at(s.length()-1)));
+    } else if (flag == 5) {
+        if (s.isEmpty())
+            return false;
+        const ushort first = s.at(0).unicode();
+        const ushort last = s.at(s.length() - 1).unicode();
+        return first == ' ' || first == '\t' || first == '\n' || first == '\r' || last == ' '
+               || last == '\t' || last == '\n' || last == '\r';
     } else {
         return false;
     }
@@ -49,7 +56,7 @@ void XmlspaceTest::teststartsWithOrEndsWithSpace()
     QFETCH(QString, data);
     QFETCH(bool, res);
 
-    for (int f=0; f<5; ++f) {
+    for (int f=0; f<6; ++f) {
         QCOMPARE(startsWithOrEndsWithSpace(data, f), res);
     }
 }
@@ -91,6 +98,7 @@ void XmlspaceTest::testCase1_data()
     QTest::newRow("2") << 2;
     QTest::newRow("3") << 3;
     QTest::newRow("4") << 4;
+    QTest::newRow("5") << 5;
 }
 
 QTEST_APPLESS_MAIN(XmlspaceTest)